@@ -0,0 +1,601 @@
+/* Headless batch image conversion tool, which also doubles as a throughput
+ * benchmark for `pl_renderer`.
+ *
+ * Images are decoded (and optionally encoded again) on a pool of CPU
+ * threads using SDL2_image, while the main thread streams them through the
+ * GPU in batches: every batch uploads, renders and downloads a number of
+ * independent images with a single submission, and the downloads of one
+ * batch complete asynchronously while the next batch is being prepared.
+ *
+ * Usage: imgbatch [options] <image>...
+ *   -o <dir>   write the results as PNG files into <dir> (default: discard)
+ *   -W <w>     fit the output into this width (default: source width)
+ *   -H <h>     fit the output into this height (default: source height)
+ *   -p <file>  ICC profile to convert the output to
+ *   -j <n>     number of decoding/encoding threads (default: 4)
+ *   -b <n>     number of images per GPU submission (default: 16)
+ *   -r <n>     repeat the list of inputs this many times (default: 1)
+ *   -q         use the high quality rendering preset
+ *
+ * License: CC0 / Public Domain
+ */
+
+#include <SDL_image.h>
+#include <pthread.h>
+#include <string.h>
+
+#include "common.h"
+#include "utils.h"
+
+#include <libplacebo/renderer.h>
+#include <libplacebo/utils/upload.h>
+#include <libplacebo/vulkan.h>
+
+#define MAX_THREADS 64
+#define MAX_BATCH   256
+#define MAX_QUEUED  (2 * MAX_BATCH) // decoded images waiting for the GPU
+
+struct job {
+    struct job *next;
+    const char *path;
+    int index;
+
+    // Decoded input, owned by the job until uploaded
+    SDL_Surface *img;
+
+    // Downloaded output, owned by the job until encoded
+    void *data;
+    int w, h;
+};
+
+// All of the state shared between the GPU thread and the worker threads
+struct shared {
+    pthread_mutex_t lock;
+    pthread_cond_t work_cond;   // signalled when workers have something to do
+    pthread_cond_t ready_cond;  // signalled when a decoded image is available
+
+    char **paths;
+    int num_paths;
+    int total;                  // `num_paths` times the number of repeats
+    int next_decode;            // index of the next image to decode
+    int num_decoded;            // number of images done decoding (or failed)
+    int num_failed;
+    bool quit;
+
+    // Singly linked FIFOs, decoded images are bounded by `MAX_QUEUED`
+    struct job *decoded, **decoded_tail;
+    struct job *encode, **encode_tail;
+    int num_queued;
+    int num_encoding;           // number of jobs in `encode` or in progress
+
+    const char *outdir;
+};
+
+static void push_job(struct job **tail_ptr[], struct job *job)
+{
+    job->next = NULL;
+    **tail_ptr = job;
+    *tail_ptr = &job->next;
+}
+
+static struct job *pop_job(struct job **head, struct job **tail_ptr[])
+{
+    struct job *job = *head;
+    if (job) {
+        *head = job->next;
+        if (!*head)
+            *tail_ptr = head;
+    }
+    return job;
+}
+
+static SDL_Surface *decode_image(const char *path)
+{
+    SDL_Surface *img = IMG_Load(path);
+    if (!img) {
+        fprintf(stderr, "Failed loading '%s': %s\n", path, SDL_GetError());
+        return NULL;
+    }
+
+    if (SDL_ISPIXELFORMAT_INDEXED(img->format->format)) {
+        // libplacebo doesn't handle indexed formats yet
+        SDL_Surface *fixed = SDL_ConvertSurfaceFormat(img, SDL_PIXELFORMAT_RGBA32, 0);
+        SDL_FreeSurface(img);
+        img = fixed;
+    }
+
+    return img;
+}
+
+static void encode_image(const struct shared *s, struct job *job)
+{
+    char name[1024];
+    const char *base = strrchr(job->path, '/');
+    base = base ? base + 1 : job->path;
+    const char *ext = strrchr(base, '.');
+    int len = ext ? (int) (ext - base) : (int) strlen(base);
+    if (s->total > s->num_paths) {
+        snprintf(name, sizeof(name), "%s/%.*s-%d.png", s->outdir, len, base,
+                 job->index / s->num_paths);
+    } else {
+        snprintf(name, sizeof(name), "%s/%.*s.png", s->outdir, len, base);
+    }
+
+    SDL_Surface *out;
+    out = SDL_CreateRGBSurfaceWithFormatFrom(job->data, job->w, job->h, 32,
+                                             job->w * 4, SDL_PIXELFORMAT_RGBA32);
+    if (!out || IMG_SavePNG(out, name) != 0)
+        fprintf(stderr, "Failed saving '%s': %s\n", name, SDL_GetError());
+    SDL_FreeSurface(out);
+}
+
+static void free_job(struct job *job)
+{
+    if (!job)
+        return;
+    SDL_FreeSurface(job->img);
+    free(job->data);
+    free(job);
+}
+
+static void *worker_loop(void *arg)
+{
+    struct shared *s = arg;
+
+    pthread_mutex_lock(&s->lock);
+    while (!s->quit) {
+        // Prefer encoding, since those jobs hold on to finished results
+        struct job *job = pop_job(&s->encode, &s->encode_tail);
+        if (job) {
+            pthread_mutex_unlock(&s->lock);
+            encode_image(s, job);
+            free_job(job);
+            pthread_mutex_lock(&s->lock);
+            s->num_encoding--;
+            pthread_cond_broadcast(&s->ready_cond);
+            continue;
+        }
+
+        if (s->next_decode < s->total && s->num_queued < MAX_QUEUED) {
+            int index = s->next_decode++;
+            s->num_queued++;
+            pthread_mutex_unlock(&s->lock);
+
+            job = calloc(1, sizeof(*job));
+            if (job) {
+                job->index = index;
+                job->path = s->paths[index % s->num_paths];
+                job->img = decode_image(job->path);
+            }
+
+            pthread_mutex_lock(&s->lock);
+            s->num_decoded++;
+            if (job && job->img) {
+                push_job(&s->decoded_tail, job);
+            } else {
+                free_job(job);
+                s->num_queued--;
+                s->num_failed++;
+            }
+            pthread_cond_broadcast(&s->ready_cond);
+            continue;
+        }
+
+        pthread_cond_wait(&s->work_cond, &s->lock);
+    }
+    pthread_mutex_unlock(&s->lock);
+    return NULL;
+}
+
+// Blocks until at least one decoded image is available, or returns NULL once
+// there are no more images left to decode
+static struct job *get_decoded(struct shared *s, bool block)
+{
+    pthread_mutex_lock(&s->lock);
+    struct job *job;
+    while (!(job = pop_job(&s->decoded, &s->decoded_tail))) {
+        if (!block || s->num_decoded == s->total)
+            break;
+        pthread_cond_wait(&s->ready_cond, &s->lock);
+    }
+    if (job) {
+        s->num_queued--;
+        pthread_cond_broadcast(&s->work_cond);
+    }
+    pthread_mutex_unlock(&s->lock);
+    return job;
+}
+
+// GPU resources for a single image in flight
+struct entry {
+    struct job *job;
+    pl_tex src;
+    pl_tex dst;
+    pl_buf buf;
+};
+
+struct state {
+    pl_log log;
+    pl_vulkan vk;
+    pl_gpu gpu;
+    pl_renderer rr;
+    pl_fmt fmt;
+    struct pl_render_params params;
+    struct pl_icc_profile icc;
+    int width, height;
+
+    struct shared *shared;
+    struct entry entries[2][MAX_BATCH]; // double buffered batches
+    int batch_size;
+    int num_done;
+};
+
+static void fit_size(const struct state *st, int w, int h, int *out_w, int *out_h)
+{
+    double sx = st->width ? (double) st->width / w : 0.0,
+           sy = st->height ? (double) st->height / h : 0.0;
+    double scale = 1.0;
+    if (sx && sy) {
+        scale = sx < sy ? sx : sy;
+    } else if (sx || sy) {
+        scale = sx ? sx : sy;
+    }
+
+    *out_w = (int) (w * scale + 0.5);
+    *out_h = (int) (h * scale + 0.5);
+    *out_w = *out_w > 1 ? *out_w : 1;
+    *out_h = *out_h > 1 ? *out_h : 1;
+}
+
+static bool process_image(struct state *st, struct entry *e)
+{
+    pl_gpu gpu = st->gpu;
+    SDL_Surface *img = e->job->img;
+    const SDL_PixelFormat *fmt = img->format;
+
+    struct pl_plane_data data = {
+        .type           = PL_FMT_UNORM,
+        .width          = img->w,
+        .height         = img->h,
+        .pixel_stride   = fmt->BytesPerPixel,
+        .row_stride     = img->pitch,
+        .pixels         = img->pixels,
+    };
+
+    uint64_t masks[4] = { fmt->Rmask, fmt->Gmask, fmt->Bmask, fmt->Amask };
+    pl_plane_data_from_mask(&data, masks);
+
+    // The pixel data is copied into a staging area by the upload, so the
+    // decoded image can be released right away
+    struct pl_plane plane;
+    bool ok = pl_upload_plane(gpu, &plane, &e->src, &data);
+    SDL_FreeSurface(img);
+    e->job->img = NULL;
+    if (!ok) {
+        fprintf(stderr, "Failed uploading '%s'\n", e->job->path);
+        return false;
+    }
+
+    int w, h;
+    fit_size(st, data.width, data.height, &w, &h);
+    ok = pl_tex_recreate(gpu, &e->dst, pl_tex_params(
+        .w = w,
+        .h = h,
+        .format = st->fmt,
+        .renderable = true,
+        .host_readable = true,
+    ));
+
+    size_t size = (size_t) w * h * st->fmt->texel_size;
+    if (ok && (!e->buf || e->buf->params.size < size)) {
+        pl_buf_destroy(gpu, &e->buf);
+        e->buf = pl_buf_create(gpu, pl_buf_params(
+            .size = size,
+            .host_mapped = true,
+        ));
+        ok = e->buf;
+    }
+
+    if (!ok) {
+        fprintf(stderr, "Failed creating output resources for '%s'\n",
+                e->job->path);
+        return false;
+    }
+
+    struct pl_frame image = {
+        .num_planes = 1,
+        .planes     = { plane },
+        .repr       = pl_color_repr_unknown,
+        .color      = pl_color_space_unknown,
+        .crop       = {0, 0, data.width, data.height},
+    };
+
+    // This seems to be the case for SDL2_image
+    image.repr.alpha = PL_ALPHA_INDEPENDENT;
+
+    struct pl_frame target = {
+        .num_planes = 1,
+        .planes     = {{
+            .texture            = e->dst,
+            .components         = 4,
+            .component_mapping  = {0, 1, 2, 3},
+        }},
+        .repr       = pl_color_repr_rgb,
+        .color      = pl_color_space_srgb,
+        .profile    = st->icc,
+    };
+    target.repr.alpha = PL_ALPHA_INDEPENDENT;
+
+    if (!pl_render_image(st->rr, &image, &target, &st->params)) {
+        fprintf(stderr, "Failed rendering '%s'\n", e->job->path);
+        return false;
+    }
+
+    // Asynchronous, completion is polled for before the entry is reused
+    ok = pl_tex_download(gpu, pl_tex_transfer_params(
+        .tex = e->dst,
+        .buf = e->buf,
+    ));
+    if (!ok) {
+        fprintf(stderr, "Failed downloading '%s'\n", e->job->path);
+        return false;
+    }
+
+    e->job->w = w;
+    e->job->h = h;
+    return true;
+}
+
+// Waits for a previously submitted entry to finish, and hands off the result
+static void finish_entry(struct state *st, struct entry *e)
+{
+    struct job *job = e->job;
+    if (!job)
+        return;
+    e->job = NULL;
+
+    while (pl_buf_poll(st->gpu, e->buf, UINT64_MAX))
+        ; // busy loop
+
+    st->num_done++;
+    struct shared *s = st->shared;
+    if (!s->outdir) {
+        free_job(job);
+        return;
+    }
+
+    size_t size = (size_t) job->w * job->h * st->fmt->texel_size;
+    job->data = malloc(size);
+    if (!job->data) {
+        free_job(job);
+        return;
+    }
+    memcpy(job->data, e->buf->data, size);
+
+    pthread_mutex_lock(&s->lock);
+    push_job(&s->encode_tail, job);
+    s->num_encoding++;
+    pthread_cond_signal(&s->work_cond);
+    pthread_mutex_unlock(&s->lock);
+}
+
+static void run_batches(struct state *st)
+{
+    double start = 0.0, last = 0.0, now = 0.0;
+    utils_gettime(&start);
+    last = start;
+    int last_done = 0;
+
+    for (int b = 0;; b ^= 1) {
+        struct entry *batch = st->entries[b];
+        for (int i = 0; i < st->batch_size; i++)
+            finish_entry(st, &batch[i]);
+
+        // Block for the first image only, to avoid stalling the GPU
+        int num = 0;
+        while (num < st->batch_size) {
+            struct job *job = get_decoded(st->shared, num == 0);
+            if (!job)
+                break;
+
+            struct entry *e = &batch[num];
+            e->job = job;
+            if (!process_image(st, e)) {
+                free_job(job);
+                e->job = NULL;
+                continue;
+            }
+            num++;
+        }
+
+        if (!num) {
+            // Nothing left to do, drain the other batch and stop
+            for (int i = 0; i < st->batch_size; i++)
+                finish_entry(st, &st->entries[b ^ 1][i]);
+            break;
+        }
+
+        // Submit the whole batch at once
+        pl_gpu_flush(st->gpu);
+
+        utils_gettime(&now);
+        if (now - last > 5.0) {
+            printf("%d/%d images, %.2f images/s\n", st->num_done,
+                   st->shared->total, (st->num_done - last_done) / (now - last));
+            last = now;
+            last_done = st->num_done;
+        }
+    }
+
+    utils_gettime(&now);
+    double elapsed = now - start;
+    printf("%d images in %.3f s => %.3f ms/image (%.2f images/s)\n",
+           st->num_done, elapsed, 1e3 * elapsed / (st->num_done ? st->num_done : 1),
+           st->num_done / elapsed);
+    if (st->shared->num_failed)
+        printf("%d images failed to decode\n", st->shared->num_failed);
+}
+
+static bool load_icc(const char *path, struct pl_icc_profile *out)
+{
+    if (!path)
+        return true;
+
+    FILE *fp = fopen(path, "rb");
+    if (!fp)
+        return false;
+
+    bool ok = false;
+    void *data = NULL;
+    if (fseeko(fp, 0, SEEK_END))
+        goto done;
+    off_t size = ftello(fp);
+    if (size <= 0 || fseeko(fp, 0, SEEK_SET))
+        goto done;
+    if (!(data = malloc(size)) || !fread(data, size, 1, fp))
+        goto done;
+
+    *out = (struct pl_icc_profile) {
+        .data = data,
+        .len = size,
+    };
+    pl_icc_profile_compute_signature(out);
+    data = NULL;
+    ok = true;
+
+done:
+    free(data);
+    fclose(fp);
+    return ok;
+}
+
+int main(int argc, char **argv)
+{
+    struct shared s = {
+        .lock = PTHREAD_MUTEX_INITIALIZER,
+        .work_cond = PTHREAD_COND_INITIALIZER,
+        .ready_cond = PTHREAD_COND_INITIALIZER,
+    };
+    s.decoded_tail = &s.decoded;
+    s.encode_tail = &s.encode;
+
+    struct state st = {
+        .shared = &s,
+        .params = pl_render_default_params,
+        .batch_size = 16,
+    };
+
+    const char *icc_path = NULL;
+    int num_threads = 4, repeat = 1, opt;
+    while ((opt = getopt(argc, argv, "o:W:H:p:j:b:r:q")) != -1) {
+        switch (opt) {
+        case 'o': s.outdir = optarg; break;
+        case 'W': st.width = atoi(optarg); break;
+        case 'H': st.height = atoi(optarg); break;
+        case 'p': icc_path = optarg; break;
+        case 'j': num_threads = atoi(optarg); break;
+        case 'b': st.batch_size = atoi(optarg); break;
+        case 'r': repeat = atoi(optarg); break;
+        case 'q': st.params = pl_render_high_quality_params; break;
+        default: goto usage;
+        }
+    }
+
+    s.paths = &argv[optind];
+    s.num_paths = argc - optind;
+    s.total = s.num_paths * repeat;
+    if (!s.num_paths || st.width < 0 || st.height < 0 || repeat < 1 ||
+        num_threads < 1 || num_threads > MAX_THREADS ||
+        st.batch_size < 1 || st.batch_size > MAX_BATCH)
+    {
+        goto usage;
+    }
+
+    int ret = 1;
+    pthread_t threads[MAX_THREADS];
+    int num_started = 0;
+
+    if (!load_icc(icc_path, &st.icc)) {
+        fprintf(stderr, "Failed opening ICC profile '%s'\n", icc_path);
+        return 1;
+    }
+
+    st.log = pl_log_create(PL_API_VER, pl_log_params(
+        .log_cb = pl_log_color,
+        .log_level = PL_LOG_WARN,
+    ));
+
+    st.vk = pl_vulkan_create(st.log, pl_vulkan_params(
+        .async_transfer = true,
+        .async_compute = true,
+    ));
+    if (!st.vk) {
+        fprintf(stderr, "Failed creating vulkan context\n");
+        goto error;
+    }
+
+    st.gpu = st.vk->gpu;
+    st.rr = pl_renderer_create(st.log, st.gpu);
+    st.fmt = pl_find_named_fmt(st.gpu, "rgba8");
+    const enum pl_fmt_caps caps = PL_FMT_CAP_RENDERABLE | PL_FMT_CAP_HOST_READABLE;
+    if (!st.fmt || (st.fmt->caps & caps) != caps) {
+        fprintf(stderr, "No suitable output format found\n");
+        goto error;
+    }
+
+    IMG_Init(IMG_INIT_JPG | IMG_INIT_PNG | IMG_INIT_TIF | IMG_INIT_WEBP);
+    for (; num_started < num_threads; num_started++) {
+        if (pthread_create(&threads[num_started], NULL, worker_loop, &s)) {
+            fprintf(stderr, "Failed creating worker thread\n");
+            goto error;
+        }
+    }
+
+    run_batches(&st);
+    ret = 0;
+
+    // Wait for all pending results to be written out
+    pthread_mutex_lock(&s.lock);
+    while (s.num_encoding)
+        pthread_cond_wait(&s.ready_cond, &s.lock);
+    pthread_mutex_unlock(&s.lock);
+
+error:
+    pthread_mutex_lock(&s.lock);
+    s.quit = true;
+    pthread_cond_broadcast(&s.work_cond);
+    pthread_mutex_unlock(&s.lock);
+    for (int i = 0; i < num_started; i++)
+        pthread_join(threads[i], NULL);
+
+    struct job *job;
+    while ((job = pop_job(&s.decoded, &s.decoded_tail)))
+        free_job(job);
+    while ((job = pop_job(&s.encode, &s.encode_tail)))
+        free_job(job);
+
+    for (int b = 0; b < 2; b++) {
+        for (int i = 0; i < MAX_BATCH; i++) {
+            struct entry *e = &st.entries[b][i];
+            free_job(e->job);
+            if (!st.gpu)
+                continue;
+            pl_tex_destroy(st.gpu, &e->src);
+            pl_tex_destroy(st.gpu, &e->dst);
+            pl_buf_destroy(st.gpu, &e->buf);
+        }
+    }
+
+    IMG_Quit();
+    pl_renderer_destroy(&st.rr);
+    pl_vulkan_destroy(&st.vk);
+    pl_log_destroy(&st.log);
+    free((void *) st.icc.data);
+    return ret;
+
+usage:
+    fprintf(stderr, "Usage: %s [-o <dir>] [-W <width>] [-H <height>] "
+            "[-p <icc>] [-j <threads>] [-b <batch>] [-r <repeat>] [-q] "
+            "<image>...\n", argv[0]);
+    return 255;
+}
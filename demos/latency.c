@@ -0,0 +1,266 @@
+/* Measures the end-to-end latency of swapchain presentation, i.e. the time
+ * from `pl_swapchain_start_frame` until a frame is actually presented (if
+ * the swapchain reports presentation timing) or at least done rendering, for
+ * a given windowing API, present mode and swapchain depth.
+ *
+ * Try e.g. `./latency -a vulkan -m mailbox -d 2`.
+ *
+ * License: CC0 / Public Domain
+ */
+
+#include <string.h>
+
+#include "common.h"
+#include "utils.h"
+#include "window.h"
+
+#ifdef PL_HAVE_VULKAN
+#include <libplacebo/vulkan.h>
+#endif
+
+static pl_log logger;
+static struct window *win;
+
+// Per-frame timestamps in seconds, or 0 if unknown
+struct frame_times {
+    double start;       // before `pl_swapchain_start_frame`
+    double acquired;    // after `pl_swapchain_start_frame`
+    double swapped;     // after `pl_swapchain_swap_buffers`
+    double completed;   // when the GPU was first observed to be done with it
+    double presented;   // as reported by the presentation engine
+    uint64_t present_id;
+};
+
+static struct frame_times *frames;
+
+enum metric {
+    METRIC_ACQUIRE,     // time blocked in `pl_swapchain_start_frame`
+    METRIC_CPU,         // until `pl_swapchain_swap_buffers` returned
+    METRIC_COMPLETE,    // until the frame finished rendering (upper bound)
+    METRIC_PRESENT,     // until the frame was presented
+    METRIC_COUNT,
+};
+
+static const char * const metric_names[METRIC_COUNT] = {
+    [METRIC_ACQUIRE]    = "acquire",
+    [METRIC_CPU]        = "cpu",
+    [METRIC_COMPLETE]   = "complete",
+    [METRIC_PRESENT]    = "present",
+};
+
+static void uninit(int ret)
+{
+    window_destroy(&win);
+    pl_log_destroy(&logger);
+    free(frames);
+    exit(ret);
+}
+
+static double now(void)
+{
+    double ts;
+    if (!utils_gettime(&ts))
+        uninit(1);
+    return ts;
+}
+
+static int cmp_double(const void *pa, const void *pb)
+{
+    double a = *(const double *) pa, b = *(const double *) pb;
+    return (a > b) - (a < b);
+}
+
+// Prints the latency distribution of `frames[first..last)`
+static void print_metric(enum metric metric, int first, int last)
+{
+    double *samples = malloc((last - first + 1) * sizeof(double));
+    if (!samples)
+        uninit(1);
+
+    int num = 0;
+    for (int i = first; i < last; i++) {
+        const struct frame_times *f = &frames[i];
+        const double end[METRIC_COUNT] = {
+            [METRIC_ACQUIRE]    = f->acquired,
+            [METRIC_CPU]        = f->swapped,
+            [METRIC_COMPLETE]   = f->completed,
+            [METRIC_PRESENT]    = f->presented,
+        };
+
+        if (end[metric])
+            samples[num++] = 1e3 * (end[metric] - f->start);
+    }
+
+    if (!num) {
+        printf("  %-9s (not available)\n", metric_names[metric]);
+    } else {
+        qsort(samples, num, sizeof(double), cmp_double);
+        printf("  %-9s median %7.3f ms, p95 %7.3f ms, p99 %7.3f ms, "
+               "max %7.3f ms (%d frames)\n", metric_names[metric],
+               samples[num / 2], samples[(num * 95 + 99) / 100 - 1],
+               samples[(num * 99 + 99) / 100 - 1], samples[num - 1], num);
+    }
+
+    free(samples);
+}
+
+// Records the presentation time reported for the most recently presented
+// frame, if any. Returns false if the swapchain doesn't report it.
+static bool update_present_timing(int num_submitted)
+{
+#ifdef PL_HAVE_VULKAN
+    struct pl_vulkan_present_timing timing;
+    if (!pl_vulkan_get(win->gpu) ||
+        !pl_vulkan_swapchain_present_timing(win->swapchain, &timing))
+    {
+        return false;
+    }
+
+    // Presentation reports lag behind by a few frames
+    for (int i = num_submitted - 1; i >= 0; i--) {
+        if (frames[i].present_id == timing.present_id) {
+            frames[i].presented = 1e-9 * timing.actual_time;
+            break;
+        }
+    }
+    return true;
+#else
+    (void) num_submitted;
+    return false;
+#endif
+}
+
+static bool set_present_mode(const char *mode)
+{
+#ifdef PL_HAVE_VULKAN
+    if (!pl_vulkan_get(win->gpu))
+        return false;
+
+    VkPresentModeKHR vk_mode;
+    if (!strcmp(mode, "fifo")) {
+        vk_mode = VK_PRESENT_MODE_FIFO_KHR;
+    } else if (!strcmp(mode, "mailbox")) {
+        vk_mode = VK_PRESENT_MODE_MAILBOX_KHR;
+    } else if (!strcmp(mode, "immediate")) {
+        vk_mode = VK_PRESENT_MODE_IMMEDIATE_KHR;
+    } else {
+        return false;
+    }
+
+    return pl_vulkan_swapchain_set_present_mode(win->swapchain, vk_mode);
+#else
+    (void) mode;
+    return false;
+#endif
+}
+
+static const char usage[] =
+    "Usage: %s [options]\n"
+    "  -a API      only use windowing APIs whose name contains API\n"
+    "  -d DEPTH    swapchain depth (maximum number of frames in flight)\n"
+    "  -m MODE     present mode: fifo, mailbox or immediate (vulkan only)\n"
+    "  -n FRAMES   number of frames to measure (default: 600)\n";
+
+int main(int argc, char **argv)
+{
+    struct window_params params = {
+        .title = "latency demo",
+        .width = 640,
+        .height = 480,
+    };
+
+    const char *mode = NULL;
+    int num_frames = 600;
+    for (int i = 1; i < argc; i += 2) {
+        const char *val = i + 1 < argc ? argv[i + 1] : NULL;
+        if (!strcmp(argv[i], "-a") && val) {
+            params.api = val;
+        } else if (!strcmp(argv[i], "-d") && val) {
+            params.swapchain_depth = atoi(val);
+        } else if (!strcmp(argv[i], "-m") && val) {
+            mode = val;
+        } else if (!strcmp(argv[i], "-n") && val && atoi(val) > 0) {
+            num_frames = atoi(val);
+        } else {
+            fprintf(stderr, usage, argv[0]);
+            return 1;
+        }
+    }
+
+    logger = pl_log_create(PL_API_VER, pl_log_params(
+        .log_cb = pl_log_color,
+        .log_level = PL_LOG_WARN,
+    ));
+
+    frames = calloc(num_frames, sizeof(*frames));
+    if (!frames)
+        uninit(1);
+
+    win = window_create(logger, &params);
+    if (!win)
+        uninit(1);
+
+    if (mode && !set_present_mode(mode)) {
+        fprintf(stderr, "Present mode '%s' is not supported by this API, or "
+                "this device!\n", mode);
+        uninit(1);
+    }
+
+    bool present_timing = false;
+    int num_submitted = 0, num_completed = 0;
+    while (num_submitted < num_frames && !win->window_lost) {
+        struct frame_times *f = &frames[num_submitted];
+        f->start = now();
+
+        struct pl_swapchain_frame frame;
+        if (!pl_swapchain_start_frame(win->swapchain, &frame)) {
+            // Window probably not visible, wait for events and try again
+            window_poll(win, true);
+            continue;
+        }
+        f->acquired = now();
+
+        float value = (num_submitted % 256) / 255.0;
+        pl_tex_clear(win->gpu, frame.fbo, (float[4]) { value, value, value, 1.0 });
+        if (!pl_swapchain_submit_frame(win->swapchain)) {
+            fprintf(stderr, "libplacebo: failed submitting frame!\n");
+            uninit(3);
+        }
+
+        // Frames complete in order, so this tells us which ones are done
+        pl_gpu_end_frame(win->gpu, 0, 0);
+        pl_swapchain_swap_buffers(win->swapchain);
+        f->swapped = now();
+#ifdef PL_HAVE_VULKAN
+        if (pl_vulkan_get(win->gpu))
+            f->present_id = pl_vulkan_swapchain_present_id(win->swapchain);
+#endif
+        num_submitted++;
+
+        // Completion is only observed at this point, once per frame, so it
+        // is an upper bound rounded up to the next `swap_buffers` return
+        int done = num_submitted - pl_gpu_frames_in_flight(win->gpu);
+        for (; num_completed < done; num_completed++)
+            frames[num_completed].completed = f->swapped;
+
+        present_timing |= update_present_timing(num_submitted);
+        window_poll(win, false);
+    }
+
+    // Wait for the remaining frames, to include them in the statistics
+    pl_gpu_finish(win->gpu);
+    for (; num_completed < num_submitted; num_completed++)
+        frames[num_completed].completed = now();
+    if (present_timing)
+        update_present_timing(num_submitted);
+
+    // Skip the first frames, which include swapchain creation and warm-up
+    int first = num_submitted / 10 < 60 ? num_submitted / 10 : 60;
+    printf("Latency of %d frames on %s, present mode %s, swapchain latency %d:\n",
+           num_submitted - first, win->impl->name, mode ? mode : "(default)",
+           pl_swapchain_latency(win->swapchain));
+    for (enum metric m = 0; m < METRIC_COUNT; m++)
+        print_metric(m, first, num_submitted);
+
+    uninit(0);
+}
@@ -9,12 +9,15 @@
  * License: CC0 / Public Domain
  */
 
+#include <inttypes.h>
 #include <pthread.h>
 #include <libgen.h>
+#include <stdatomic.h>
 
 #include <libavutil/cpu.h>
 #include <libavutil/file.h>
 #include <libavutil/pixdesc.h>
+#include <libavutil/time.h>
 #include <libavformat/avformat.h>
 #include <libavcodec/avcodec.h>
 
@@ -38,6 +41,57 @@ static bool ui_draw(struct ui *ui, const struct pl_swapchain_frame *frame) { ret
 #define MAX_FRAME_PASSES 256
 #define MAX_BLEND_FRAMES 8
 
+// Playback is split into three stages, each running on its own thread:
+// decoding, uploading (mapping frames to the GPU) and rendering. Decoded
+// frames are handed to the upload thread through a bounded lock-free ring
+// buffer, and mapped frames to the render thread through an SPSC `pl_queue`.
+// Uploads are submitted from the upload thread, so on GPUs with a dedicated
+// transfer queue, they run in parallel with rendering.
+#define MAX_DECODED_FRAMES 4
+#define MAX_MAPPED_FRAMES 16
+
+// How long to sleep while waiting on another stage, in microseconds
+#define STALL_US 1000
+
+struct decoded_frame {
+    AVFrame *frame; // or NULL to signal EOF
+    double pts;
+};
+
+// Single-producer, single-consumer ring buffer of decoded frames
+struct decoded_ring {
+    struct decoded_frame elem[MAX_DECODED_FRAMES];
+    atomic_uint head; // next slot to write, only advanced by the producer
+    atomic_uint tail; // next slot to read, only advanced by the consumer
+};
+
+// Frames mapped by the upload thread, owning the textures backing them
+struct mapped_frame {
+    struct plplay *p;
+    pl_tex tex[4];
+    struct pl_frame frame;
+    atomic_bool in_use; // set by the upload thread, cleared once unmapped
+};
+
+enum stage {
+    STAGE_DECODE,
+    STAGE_UPLOAD,
+    STAGE_RENDER,
+    STAGE_COUNT,
+};
+
+static const char *stage_names[STAGE_COUNT] = {
+    [STAGE_DECODE] = "decode",
+    [STAGE_UPLOAD] = "upload",
+    [STAGE_RENDER] = "render",
+};
+
+struct stage_stats {
+    atomic_uint_fast64_t frames;    // frames passed on by this stage
+    atomic_uint_fast64_t dropped;   // frames dropped by this stage
+    atomic_uint_fast64_t stall_us;  // time spent blocked on another stage
+};
+
 struct pass_info {
     struct pl_dispatch_info pass;
     char *name;
@@ -57,8 +111,15 @@ struct plplay {
     AVCodecContext *codec;
     const AVStream *stream; // points to first video stream of `format`
     pthread_t decoder_thread;
+    pthread_t upload_thread;
     bool decoder_thread_created;
-    bool exit_thread;
+    bool upload_thread_created;
+    atomic_bool exit_thread;
+
+    // pipeline state
+    struct decoded_ring decoded;
+    struct mapped_frame mapped[MAX_MAPPED_FRAMES];
+    struct stage_stats stats[STAGE_COUNT];
 
     // settings / ui state
     const struct pl_filter_preset *upscaler, *downscaler, *frame_mixer;
@@ -91,15 +152,59 @@ struct plplay {
     int num_frame_passes;
 };
 
+static bool decoded_push(struct decoded_ring *r, const struct decoded_frame *df)
+{
+    unsigned head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    unsigned tail = atomic_load_explicit(&r->tail, memory_order_acquire);
+    if (head - tail == MAX_DECODED_FRAMES)
+        return false;
+
+    r->elem[head % MAX_DECODED_FRAMES] = *df;
+    atomic_store_explicit(&r->head, head + 1, memory_order_release);
+    return true;
+}
+
+static bool decoded_pop(struct decoded_ring *r, struct decoded_frame *df)
+{
+    unsigned tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    unsigned head = atomic_load_explicit(&r->head, memory_order_acquire);
+    if (head == tail)
+        return false;
+
+    *df = r->elem[tail % MAX_DECODED_FRAMES];
+    atomic_store_explicit(&r->tail, tail + 1, memory_order_release);
+    return true;
+}
+
+static void stall(struct plplay *p, enum stage stage)
+{
+    int64_t start = av_gettime_relative();
+    av_usleep(STALL_US);
+    atomic_fetch_add(&p->stats[stage].stall_us, av_gettime_relative() - start);
+}
+
 static void uninit(struct plplay *p)
 {
-    if (p->decoder_thread_created) {
-        p->exit_thread = true;
-        pl_queue_push(p->queue, NULL); // Signal EOF to wake up thread
+    // Both threads only ever block with a timeout, so they notice this
+    atomic_store(&p->exit_thread, true);
+    if (p->upload_thread_created)
+        pthread_join(p->upload_thread, NULL);
+    if (p->decoder_thread_created)
         pthread_join(p->decoder_thread, NULL);
-    }
+
+    // Free any frames still stuck in the pipeline
+    struct decoded_frame df;
+    while (decoded_pop(&p->decoded, &df))
+        av_frame_free(&df.frame);
 
     pl_queue_destroy(&p->queue);
+    for (int i = 0; p->win && i < MAX_MAPPED_FRAMES; i++) {
+        struct mapped_frame *mf = &p->mapped[i];
+        if (atomic_load(&mf->in_use))
+            pl_unmap_avframe(p->win->gpu, &mf->frame);
+        for (int n = 0; n < PL_ARRAY_SIZE(mf->tex); n++)
+            pl_tex_destroy(p->win->gpu, &mf->tex[n]);
+    }
     pl_renderer_destroy(&p->renderer);
 
     for (int i = 0; i < p->shader_num; i++) {
@@ -242,38 +347,32 @@ static bool init_codec(struct plplay *p)
     return true;
 }
 
+// Frames are already mapped by the upload thread, so this just hands them out
 static bool map_frame(pl_gpu gpu, pl_tex *tex,
                       const struct pl_source_frame *src,
                       struct pl_frame *out_frame)
 {
-    AVFrame *frame = src->frame_data;
-    struct plplay *p = frame->opaque;
-    bool ok = pl_map_avframe_ex(gpu, out_frame, pl_avframe_params(
-        .frame      = frame,
-        .tex        = tex,
-        .map_dovi   = !p->ignore_dovi,
-    ));
-
-    av_frame_free(&frame); // references are preserved by `out_frame`
-    if (!ok) {
-        fprintf(stderr, "Failed mapping AVFrame!\n");
-        return false;
-    }
-
-    pl_frame_copy_stream_props(out_frame, p->stream);
+    const struct mapped_frame *mf = src->frame_data;
+    *out_frame = mf->frame;
     return true;
 }
 
+static void release_frame(pl_gpu gpu, struct mapped_frame *mf)
+{
+    pl_unmap_avframe(gpu, &mf->frame);
+    atomic_store_explicit(&mf->in_use, false, memory_order_release);
+}
+
 static void unmap_frame(pl_gpu gpu, struct pl_frame *frame,
                         const struct pl_source_frame *src)
 {
-    pl_unmap_avframe(gpu, frame);
+    release_frame(gpu, src->frame_data);
 }
 
 static void discard_frame(const struct pl_source_frame *src)
 {
-    AVFrame *frame = src->frame_data;
-    av_frame_free(&frame);
+    struct mapped_frame *mf = src->frame_data;
+    release_frame(mf->p->win->gpu, mf);
     printf("Dropped frame with PTS %.3f\n", src->pts);
 }
 
@@ -289,7 +388,7 @@ static void *decode_loop(void *arg)
     double first_pts = 0.0, base_pts = 0.0, last_pts = 0.0;
     uint64_t num_frames = 0;
 
-    while (!p->exit_thread) {
+    while (!atomic_load(&p->exit_thread)) {
         switch ((ret = av_read_frame(p->format, packet))) {
         case 0:
             if (packet->stream_index != p->stream->index) {
@@ -321,14 +420,19 @@ static void *decode_loop(void *arg)
             last_pts = frame->pts * av_q2d(p->stream->time_base);
             if (num_frames++ == 0)
                 first_pts = last_pts;
-            frame->opaque = p;
-            pl_queue_push_block(p->queue, UINT64_MAX, &(struct pl_source_frame) {
+
+            const struct decoded_frame df = {
+                .frame = frame,
                 .pts = last_pts - first_pts + base_pts,
-                .map = map_frame,
-                .unmap = unmap_frame,
-                .discard = discard_frame,
-                .frame_data = frame,
-            });
+            };
+
+            while (!decoded_push(&p->decoded, &df)) {
+                if (atomic_load(&p->exit_thread))
+                    goto done;
+                stall(p, STAGE_DECODE);
+            }
+
+            atomic_fetch_add(&p->stats[STAGE_DECODE].frames, 1);
             frame = av_frame_alloc();
         }
 
@@ -357,12 +461,118 @@ static void *decode_loop(void *arg)
     }
 
 done:
-    pl_queue_push(p->queue, NULL); // Signal EOF to flush queue
+    // Signal EOF to the upload thread
+    while (!decoded_push(&p->decoded, &(struct decoded_frame) {0})) {
+        if (atomic_load(&p->exit_thread))
+            break;
+        stall(p, STAGE_DECODE);
+    }
+
     av_packet_free(&packet);
     av_frame_free(&frame);
     return NULL;
 }
 
+static struct mapped_frame *get_mapped_frame(struct plplay *p)
+{
+    while (!atomic_load(&p->exit_thread)) {
+        for (int i = 0; i < MAX_MAPPED_FRAMES; i++) {
+            struct mapped_frame *mf = &p->mapped[i];
+            if (!atomic_load_explicit(&mf->in_use, memory_order_acquire))
+                return mf;
+        }
+
+        // All frames are still held by the render thread
+        stall(p, STAGE_UPLOAD);
+    }
+
+    return NULL;
+}
+
+static void *upload_loop(void *arg)
+{
+    struct plplay *p = arg;
+    pl_gpu gpu = p->win->gpu;
+
+    while (!atomic_load(&p->exit_thread)) {
+        struct decoded_frame df;
+        if (!decoded_pop(&p->decoded, &df)) {
+            // Waiting on the decoder doesn't count as a stall of this stage
+            av_usleep(STALL_US);
+            continue;
+        }
+
+        if (!df.frame)
+            break; // EOF
+
+        struct mapped_frame *mf = get_mapped_frame(p);
+        if (!mf) {
+            av_frame_free(&df.frame);
+            break;
+        }
+
+        bool ok = pl_map_avframe_ex(gpu, &mf->frame, pl_avframe_params(
+            .frame      = df.frame,
+            .tex        = mf->tex,
+            .map_dovi   = !p->ignore_dovi,
+        ));
+
+        av_frame_free(&df.frame); // references are preserved by `mf->frame`
+        if (!ok) {
+            fprintf(stderr, "Failed mapping AVFrame!\n");
+            atomic_fetch_add(&p->stats[STAGE_UPLOAD].dropped, 1);
+            continue;
+        }
+
+        pl_frame_copy_stream_props(&mf->frame, p->stream);
+        mf->p = p;
+        atomic_store(&mf->in_use, true);
+
+        // Get the upload going in the background, before handing it off
+        pl_gpu_flush(gpu);
+
+        const struct pl_source_frame src = {
+            .pts = df.pts,
+            .map = map_frame,
+            .unmap = unmap_frame,
+            .discard = discard_frame,
+            .frame_data = mf,
+        };
+
+        // Use a finite timeout, so we can still notice `exit_thread`
+        int64_t start = av_gettime_relative();
+        bool pushed = false;
+        while (!pushed && !atomic_load(&p->exit_thread))
+            pushed = pl_queue_push_block(p->queue, STALL_US * 1000, &src);
+        atomic_fetch_add(&p->stats[STAGE_UPLOAD].stall_us, av_gettime_relative() - start);
+        if (!pushed) {
+            release_frame(gpu, mf);
+            break;
+        }
+
+        atomic_fetch_add(&p->stats[STAGE_UPLOAD].frames, 1);
+    }
+
+    pl_queue_push(p->queue, NULL); // Signal EOF to flush queue
+    return NULL;
+}
+
+static void print_stats(struct plplay *p)
+{
+    // Frames dropped by the render stage are those evicted from the queue
+    // without ever being shown, e.g. because rendering fell behind
+    struct pl_queue_stats qstats = pl_queue_get_stats(p->queue);
+    atomic_store(&p->stats[STAGE_RENDER].dropped, qstats.frames_dropped);
+
+    for (enum stage i = 0; i < STAGE_COUNT; i++) {
+        const struct stage_stats *st = &p->stats[i];
+        printf("%s: %"PRIu64" frames, %"PRIu64" dropped, stalled for %.3f s\n",
+               stage_names[i], (uint64_t) atomic_load(&st->frames),
+               (uint64_t) atomic_load(&st->dropped),
+               atomic_load(&st->stall_us) / 1e6);
+    }
+}
+
 static void update_settings(struct plplay *p);
 
 static void update_colorspace_hint(struct plplay *p, const struct pl_frame_mix *mix)
@@ -489,15 +699,20 @@ retry:
         qparams.timeout = 50000000; // 50 ms
         qparams.pts = pts;
 
+        int64_t start = av_gettime_relative();
         switch (pl_queue_update(p->queue, &mix, &qparams)) {
         case PL_QUEUE_ERR: goto error;
         case PL_QUEUE_EOF: return true;
         case PL_QUEUE_OK:
             if (!render_frame(p, &frame, &mix))
                 goto error;
+            atomic_fetch_add(&p->stats[STAGE_RENDER].frames, 1);
             stuck = false;
             break;
         case PL_QUEUE_MORE:
+            // Waiting on the upload thread
+            atomic_fetch_add(&p->stats[STAGE_RENDER].stall_us,
+                             av_gettime_relative() - start);
             stuck = true;
             goto retry;
         }
@@ -660,19 +875,28 @@ int main(int argc, char **argv)
     if (!init_codec(p))
         goto error;
 
-    p->queue = pl_queue_create(p->win->gpu);
+    // Only the upload thread ever pushes frames to the queue
+    p->queue = pl_queue_create_spsc(p->win->gpu);
     int ret = pthread_create(&p->decoder_thread, NULL, decode_loop, p);
     if (ret != 0) {
-        fprintf(stderr, "Failed creating decode thread: %s\n", strerror(errno));
+        fprintf(stderr, "Failed creating decode thread: %s\n", strerror(ret));
         goto error;
     }
 
     p->decoder_thread_created = true;
+    ret = pthread_create(&p->upload_thread, NULL, upload_loop, p);
+    if (ret != 0) {
+        fprintf(stderr, "Failed creating upload thread: %s\n", strerror(ret));
+        goto error;
+    }
+
+    p->upload_thread_created = true;
 
     p->renderer = pl_renderer_create(p->log, p->win->gpu);
     if (!render_loop(p))
         goto error;
 
+    print_stats(p);
     printf("Exiting...\n");
     uninit(p);
     return 0;
@@ -1,5 +1,7 @@
 // License: CC0 / Public Domain
 
+#include <string.h>
+
 #include "common.h"
 #include "window.h"
 
@@ -31,6 +33,8 @@ static const struct window_impl *win_impls[] = {
 struct window *window_create(pl_log log, const struct window_params *params)
 {
     for (const struct window_impl **impl = win_impls; *impl; impl++) {
+        if (params->api && !strstr((*impl)->name, params->api))
+            continue;
         printf("Attempting to initialize API: %s\n", (*impl)->name);
         struct window *win = (*impl)->create(log, params);
         if (win)
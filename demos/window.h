@@ -18,6 +18,13 @@ struct window_params {
     // initial color space
     struct pl_swapchain_colors colors;
     bool alpha;
+
+    // maximum number of frames in flight, or 0 for the API's default
+    int swapchain_depth;
+
+    // only try window implementations whose name contains this (e.g.
+    // "vulkan" or "SDL2"), or NULL to try all of them
+    const char *api;
 };
 
 struct window *window_create(pl_log log, const struct window_params *params);
@@ -262,6 +262,7 @@ static struct window *glfw_create(pl_log log, const struct window_params *params
     p->w.swapchain = pl_vulkan_create_swapchain(p->vk, pl_vulkan_swapchain_params(
         .surface = p->surf,
         .present_mode = VK_PRESENT_MODE_FIFO_KHR,
+        .swapchain_depth = params->swapchain_depth,
     ));
 
     if (!p->w.swapchain) {
@@ -287,6 +288,7 @@ static struct window *glfw_create(pl_log log, const struct window_params *params
 
     p->w.swapchain = pl_opengl_create_swapchain(p->gl, pl_opengl_swapchain_params(
         .swap_buffers = (void (*)(void *)) glfwSwapBuffers,
+        .max_swapchain_depth = params->swapchain_depth,
         .priv = p->win,
     ));
 
@@ -299,7 +301,10 @@ static struct window *glfw_create(pl_log log, const struct window_params *params
 #endif // USE_GL
 
 #ifdef USE_D3D11
-    p->d3d11 = pl_d3d11_create(log, pl_d3d11_params( .debug = DEBUG ));
+    p->d3d11 = pl_d3d11_create(log, pl_d3d11_params(
+        .debug = DEBUG,
+        .max_frame_latency = params->swapchain_depth,
+    ));
     if (!p->d3d11) {
         fprintf(stderr, "libplacebo: Failed creating D3D11 device\n");
         goto error;
@@ -131,6 +131,7 @@ static struct window *sdl_create(pl_log log, const struct window_params *params)
     p->w.swapchain = pl_vulkan_create_swapchain(p->vk, pl_vulkan_swapchain_params(
         .surface = p->surf,
         .present_mode = VK_PRESENT_MODE_FIFO_KHR,
+        .swapchain_depth = params->swapchain_depth,
     ));
 
     if (!p->w.swapchain) {
@@ -162,6 +163,7 @@ static struct window *sdl_create(pl_log log, const struct window_params *params)
 
     p->w.swapchain = pl_opengl_create_swapchain(p->gl, pl_opengl_swapchain_params(
         .swap_buffers = (void (*)(void *)) SDL_GL_SwapWindow,
+        .max_swapchain_depth = params->swapchain_depth,
         .priv = p->win,
     ));
 
@@ -0,0 +1,411 @@
+/*
+ * This file is part of libplacebo.
+ *
+ * libplacebo is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * libplacebo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with libplacebo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include "cache.h"
+#include "log.h"
+#include "pl_thread.h"
+
+struct cache_entry {
+    pl_cache_obj obj;
+    uint64_t last_use;
+};
+
+struct priv {
+    pl_log log;
+    pl_mutex lock;
+    PL_ARRAY(struct cache_entry) entries;
+    size_t total_size;
+    uint64_t clock; // for LRU tracking
+};
+
+void pl_cache_obj_free(pl_cache_obj *obj)
+{
+    if (obj->free)
+        obj->free(obj->data);
+    *obj = (pl_cache_obj) {0};
+}
+
+pl_cache pl_cache_create(const struct pl_cache_params *params)
+{
+    struct pl_cache *cache = pl_zalloc_obj(NULL, cache, struct priv);
+    struct priv *p = PL_PRIV(cache);
+    cache->params = *params;
+    p->log = params->log;
+    pl_mutex_init(&p->lock);
+    return cache;
+}
+
+static void cache_clear(struct priv *p)
+{
+    for (int i = 0; i < p->entries.num; i++)
+        pl_cache_obj_free(&p->entries.elem[i].obj);
+    p->entries.num = 0;
+    p->total_size = 0;
+}
+
+void pl_cache_destroy(pl_cache *pcache)
+{
+    pl_cache cache = *pcache;
+    if (!cache)
+        return;
+
+    struct priv *p = PL_PRIV(cache);
+    cache_clear(p);
+    pl_mutex_destroy(&p->lock);
+    pl_free((void *) cache);
+    *pcache = NULL;
+}
+
+void pl_cache_reset(pl_cache cache)
+{
+    struct priv *p = PL_PRIV(cache);
+    pl_mutex_lock(&p->lock);
+    cache_clear(p);
+    pl_mutex_unlock(&p->lock);
+}
+
+size_t pl_cache_size(pl_cache cache)
+{
+    struct priv *p = PL_PRIV(cache);
+    pl_mutex_lock(&p->lock);
+    size_t size = p->total_size;
+    pl_mutex_unlock(&p->lock);
+    return size;
+}
+
+int pl_cache_objects(pl_cache cache)
+{
+    struct priv *p = PL_PRIV(cache);
+    pl_mutex_lock(&p->lock);
+    int num = p->entries.num;
+    pl_mutex_unlock(&p->lock);
+    return num;
+}
+
+static struct cache_entry *cache_find(struct priv *p, uint64_t key)
+{
+    for (int i = 0; i < p->entries.num; i++) {
+        if (p->entries.elem[i].obj.key == key)
+            return &p->entries.elem[i];
+    }
+
+    return NULL;
+}
+
+static void cache_remove(struct priv *p, struct cache_entry *e)
+{
+    p->total_size -= e->obj.size;
+    pl_cache_obj_free(&e->obj);
+    PL_ARRAY_REMOVE_AT(p->entries, e - p->entries.elem);
+}
+
+// Takes over ownership of `obj`, which must own its data. Must be called
+// with `p->lock` held.
+static struct cache_entry *cache_insert(pl_cache cache, pl_cache_obj obj)
+{
+    struct priv *p = PL_PRIV(cache);
+    const struct pl_cache_params *params = &cache->params;
+
+    struct cache_entry *old = cache_find(p, obj.key);
+    if (old)
+        cache_remove(p, old);
+
+    if (params->max_total_size && obj.size > params->max_total_size) {
+        PL_DEBUG(p, "Object 0x%"PRIx64" (%zu bytes) exceeds the cache size "
+                 "budget, ignoring", obj.key, obj.size);
+        pl_cache_obj_free(&obj);
+        return NULL;
+    }
+
+    // Evict the least recently used objects until the new object fits
+    while (params->max_total_size &&
+           p->total_size + obj.size > params->max_total_size)
+    {
+        struct cache_entry *lru = &p->entries.elem[0];
+        for (int i = 1; i < p->entries.num; i++) {
+            if (p->entries.elem[i].last_use < lru->last_use)
+                lru = &p->entries.elem[i];
+        }
+
+        PL_TRACE(p, "Evicting object 0x%"PRIx64" (%zu bytes) from cache",
+                 lru->obj.key, lru->obj.size);
+        cache_remove(p, lru);
+    }
+
+    PL_ARRAY_APPEND((void *) cache, p->entries, (struct cache_entry) {
+        .obj = obj,
+        .last_use = ++p->clock,
+    });
+    p->total_size += obj.size;
+    return &p->entries.elem[p->entries.num - 1];
+}
+
+// Returns the matching entry, consulting the external `get` callback on
+// misses. Must be called with `p->lock` held.
+static struct cache_entry *cache_lookup(pl_cache cache, uint64_t key)
+{
+    struct priv *p = PL_PRIV(cache);
+    const struct pl_cache_params *params = &cache->params;
+    struct cache_entry *e = cache_find(p, key);
+    if (!e && params->get) {
+        pl_cache_obj obj = params->get(params->priv, key);
+        if (obj.size) {
+            obj.key = key;
+            e = cache_insert(cache, obj);
+        } else {
+            pl_cache_obj_free(&obj);
+        }
+    }
+
+    if (e)
+        e->last_use = ++p->clock;
+    return e;
+}
+
+bool pl_cache_get(pl_cache cache, pl_cache_obj *obj)
+{
+    struct priv *p = PL_PRIV(cache);
+    uint64_t key = obj->key;
+    *obj = (pl_cache_obj) { .key = key };
+
+    pl_mutex_lock(&p->lock);
+    struct cache_entry *e = cache_lookup(cache, key);
+    void *data = e ? malloc(e->obj.size) : NULL;
+    if (data) {
+        memcpy(data, e->obj.data, e->obj.size);
+        *obj = (pl_cache_obj) {
+            .key = key,
+            .data = data,
+            .size = e->obj.size,
+            .free = free,
+        };
+    }
+    pl_mutex_unlock(&p->lock);
+    return data;
+}
+
+bool pl_cache_get_exact(pl_cache cache, uint64_t key, void *out, size_t size)
+{
+    if (!cache)
+        return false;
+
+    struct priv *p = PL_PRIV(cache);
+    pl_mutex_lock(&p->lock);
+    struct cache_entry *e = cache_lookup(cache, key);
+    bool ok = e && e->obj.size == size;
+    if (ok)
+        memcpy(out, e->obj.data, size);
+    pl_mutex_unlock(&p->lock);
+    return ok;
+}
+
+// Turns `obj` into an object that owns its data, by copying it if needed.
+// Returns false (and releases `obj`) on allocation failure.
+static bool obj_own(pl_cache_obj *obj)
+{
+    if (obj->free || !obj->size)
+        return true;
+
+    void *data = malloc(obj->size);
+    if (!data) {
+        *obj = (pl_cache_obj) {0};
+        return false;
+    }
+
+    memcpy(data, obj->data, obj->size);
+    obj->data = data;
+    obj->free = free;
+    return true;
+}
+
+void pl_cache_set(pl_cache cache, pl_cache_obj *obj)
+{
+    struct priv *p = PL_PRIV(cache);
+    const struct pl_cache_params *params = &cache->params;
+    if (params->max_object_size && obj->size > params->max_object_size) {
+        PL_DEBUG(p, "Object 0x%"PRIx64" (%zu bytes) exceeds the maximum "
+                 "object size, ignoring", obj->key, obj->size);
+        pl_cache_obj_free(obj);
+        return;
+    }
+
+    if (!obj_own(obj))
+        return;
+
+    pl_mutex_lock(&p->lock);
+    if (params->set) {
+        params->set(params->priv, (pl_cache_obj) {
+            .key = obj->key,
+            .data = obj->data,
+            .size = obj->size,
+        });
+    }
+
+    if (obj->size) {
+        cache_insert(cache, *obj);
+    } else {
+        struct cache_entry *e = cache_find(p, obj->key);
+        if (e)
+            cache_remove(p, e);
+        pl_cache_obj_free(obj);
+    }
+    pl_mutex_unlock(&p->lock);
+
+    *obj = (pl_cache_obj) {0};
+}
+
+void pl_cache_set_copy(pl_cache cache, uint64_t key, const void *data, size_t size)
+{
+    if (!cache || !size)
+        return;
+
+    pl_cache_set(cache, &(pl_cache_obj) {
+        .key = key,
+        .data = (void *) data,
+        .size = size,
+    });
+}
+
+static const char cache_magic[] = {'p', 'l', 'c', 'a', 'c', 'h', 'e', '\0'};
+static const uint32_t cache_version = 1;
+static const uint32_t cache_hash_id = PL_MEM_HASH_ID;
+
+struct cache_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t hash_id;
+    uint32_t num_objects;
+    uint32_t reserved;
+};
+
+struct cache_obj_header {
+    uint64_t key;
+    uint64_t size;
+    uint64_t hash;
+};
+
+size_t pl_cache_save(pl_cache cache, uint8_t *out)
+{
+    struct priv *p = PL_PRIV(cache);
+    pl_mutex_lock(&p->lock);
+
+    size_t size = sizeof(struct cache_header) +
+                  p->entries.num * sizeof(struct cache_obj_header) +
+                  p->total_size;
+    if (!out)
+        goto done;
+
+    struct cache_header header = {
+        .version = cache_version,
+        .hash_id = cache_hash_id,
+        .num_objects = p->entries.num,
+    };
+    memcpy(header.magic, cache_magic, sizeof(header.magic));
+    memcpy(out, &header, sizeof(header));
+    out += sizeof(header);
+
+    for (int i = 0; i < p->entries.num; i++) {
+        const pl_cache_obj *obj = &p->entries.elem[i].obj;
+        struct cache_obj_header obj_header = {
+            .key  = obj->key,
+            .size = obj->size,
+            .hash = pl_mem_hash(obj->data, obj->size),
+        };
+        memcpy(out, &obj_header, sizeof(obj_header));
+        out += sizeof(obj_header);
+        memcpy(out, obj->data, obj->size);
+        out += obj->size;
+    }
+
+    PL_DEBUG(p, "Saved %d cached objects (%zu bytes)", p->entries.num, size);
+
+done:
+    pl_mutex_unlock(&p->lock);
+    return size;
+}
+
+int pl_cache_load(pl_cache cache, const uint8_t *data, size_t size)
+{
+    struct priv *p = PL_PRIV(cache);
+    const struct pl_cache_params *params = &cache->params;
+
+    struct cache_header header;
+    if (size < sizeof(header)) {
+        PL_ERR(p, "Failed loading cache: truncated header");
+        return -1;
+    }
+
+    memcpy(&header, data, sizeof(header));
+    data += sizeof(header);
+    size -= sizeof(header);
+    if (memcmp(header.magic, cache_magic, sizeof(header.magic)) != 0) {
+        PL_ERR(p, "Failed loading cache: invalid magic bytes");
+        return -1;
+    }
+
+    if (header.version != cache_version || header.hash_id != cache_hash_id) {
+        PL_INFO(p, "Failed loading cache: wrong version... skipping");
+        return -1;
+    }
+
+    int num_loaded = 0;
+    pl_mutex_lock(&p->lock);
+    for (uint32_t i = 0; i < header.num_objects; i++) {
+        struct cache_obj_header obj_header;
+        if (size < sizeof(obj_header)) {
+            PL_WARN(p, "Cache truncated after %u objects", i);
+            break;
+        }
+
+        memcpy(&obj_header, data, sizeof(obj_header));
+        data += sizeof(obj_header);
+        size -= sizeof(obj_header);
+        if (obj_header.size > size) {
+            PL_WARN(p, "Cache truncated after %u objects", i);
+            break;
+        }
+
+        pl_cache_obj obj = {
+            .key = obj_header.key,
+            .data = (void *) data,
+            .size = obj_header.size,
+        };
+        data += obj.size;
+        size -= obj.size;
+
+        if (pl_mem_hash(obj.data, obj.size) != obj_header.hash) {
+            PL_WARN(p, "Object 0x%"PRIx64" failed integrity check, skipping",
+                    obj.key);
+            continue;
+        }
+
+        if (!obj.size)
+            continue;
+        if (params->max_object_size && obj.size > params->max_object_size)
+            continue;
+        if (!obj_own(&obj))
+            break;
+        if (cache_insert(cache, obj))
+            num_loaded++;
+    }
+    pl_mutex_unlock(&p->lock);
+
+    PL_DEBUG(p, "Loaded %d cached objects", num_loaded);
+    return num_loaded;
+}
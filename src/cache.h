@@ -0,0 +1,43 @@
+/*
+ * This file is part of libplacebo.
+ *
+ * libplacebo is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * libplacebo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with libplacebo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "common.h"
+
+#include <libplacebo/cache.h>
+
+// Internal convenience wrappers. Both are no-ops on a NULL `cache`.
+//
+// `pl_cache_get_exact` copies the object matching `key` into `out`, but only
+// if it has exactly `size` bytes, avoiding the intermediate allocation of
+// `pl_cache_get`. `pl_cache_set_copy` inserts a copy of `data`.
+bool pl_cache_get_exact(pl_cache cache, uint64_t key, void *out, size_t size);
+void pl_cache_set_copy(pl_cache cache, uint64_t key, const void *data, size_t size);
+
+// Salts for the keys of the different kinds of cached objects, to prevent
+// collisions between subsystems sharing the same cache
+enum pl_cache_key_type {
+    PL_CACHE_KEY_PROGRAM = 0x50524f47,  // "PROG", `pl_pass` cached programs
+    PL_CACHE_KEY_LUT     = 0x4c555420,  // "LUT ", `sh_lut` contents
+};
+
+static inline uint64_t pl_cache_key(enum pl_cache_key_type type, uint64_t key)
+{
+    pl_hash_merge(&key, type);
+    return key;
+}
@@ -1219,9 +1219,7 @@ void pl_icc_profile_compute_signature(struct pl_icc_profile *profile)
 {
     // In theory, we could get this value from the profile header itself if
     // lcms is available, but I'm not sure if it's even worth the trouble. Just
-    // hard-code this to a siphash64(), which is decently fast anyway.
-    profile->signature = pl_str_hash((pl_str) {
-        .buf = (uint8_t *) profile->data,
-        .len = profile->len
-    });
+    // hard-code this to a siphash64(), which is decently fast anyway. Users
+    // may persist this signature, so don't switch it to `pl_mem_hash`.
+    profile->signature = pl_siphash(profile->data, profile->len);
 }
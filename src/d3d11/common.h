@@ -39,6 +39,9 @@ struct d3d11_ctx {
 
     // pl_gpu_is_failed (We saw a device removed error!)
     bool is_failed;
+
+    // Copy of `pl_d3d11_params.exclusive`
+    bool exclusive;
 };
 
 // Pointer to dxgi.dll!CreateDXGIFactory1()
@@ -320,6 +320,7 @@ pl_d3d11 pl_d3d11_create(pl_log log, const struct pl_d3d11_params *params)
     struct d3d11_ctx *ctx = PL_PRIV(d3d11);
     ctx->log = log;
     ctx->d3d11 = d3d11;
+    ctx->exclusive = params->exclusive;
 
     if (params->device) {
         d3d11->device = params->device;
@@ -21,6 +21,7 @@
 #include "gpu.h"
 #include "formats.h"
 #include "glsl/spirv.h"
+#include "pl_clock.h"
 
 #define D3D11_FORMAT_SUPPORT2_UAV_TYPED_STORE (0x80)
 #define DXGI_ADAPTER_FLAG3_SUPPORT_MONITORED_FENCES (0x8)
@@ -38,21 +39,51 @@ struct pl_timer {
     struct timer_query queries[16];
 };
 
-void pl_d3d11_timer_start(pl_gpu gpu, pl_timer timer)
+// Takes a query from the shared pool, or creates a new one if it's empty
+static ID3D11Query *timer_get_query(pl_gpu gpu, D3D11_QUERY type)
 {
     struct pl_gpu_d3d11 *p = PL_PRIV(gpu);
     struct d3d11_ctx *ctx = p->ctx;
+    ID3D11Query *query = NULL;
+
+    if (type == D3D11_QUERY_TIMESTAMP && p->ts_queries.num)
+        return p->ts_queries.elem[--p->ts_queries.num];
+    if (type == D3D11_QUERY_TIMESTAMP_DISJOINT && p->dj_queries.num)
+        return p->dj_queries.elem[--p->dj_queries.num];
+
+    D3D(ID3D11Device_CreateQuery(p->dev, &(D3D11_QUERY_DESC) { type }, &query));
+    return query;
+
+error:
+    return NULL;
+}
+
+static void timer_put_query(pl_gpu gpu, D3D11_QUERY type, ID3D11Query **query)
+{
+    struct pl_gpu_d3d11 *p = PL_PRIV(gpu);
+    if (!*query)
+        return;
+
+    if (type == D3D11_QUERY_TIMESTAMP) {
+        PL_ARRAY_APPEND(gpu, p->ts_queries, *query);
+    } else {
+        PL_ARRAY_APPEND(gpu, p->dj_queries, *query);
+    }
+    *query = NULL;
+}
+
+void pl_d3d11_timer_start(pl_gpu gpu, pl_timer timer)
+{
+    struct pl_gpu_d3d11 *p = PL_PRIV(gpu);
 
     if (!timer)
         return;
     struct timer_query *query = &timer->queries[timer->current];
 
-    // Create the query objects lazilly
+    // Get the query objects lazilly, recycling those of destroyed timers
     if (!query->ts_start) {
-        D3D(ID3D11Device_CreateQuery(p->dev,
-            &(D3D11_QUERY_DESC) { D3D11_QUERY_TIMESTAMP }, &query->ts_start));
-        D3D(ID3D11Device_CreateQuery(p->dev,
-            &(D3D11_QUERY_DESC) { D3D11_QUERY_TIMESTAMP }, &query->ts_end));
+        query->ts_start = timer_get_query(gpu, D3D11_QUERY_TIMESTAMP);
+        query->ts_end = timer_get_query(gpu, D3D11_QUERY_TIMESTAMP);
 
         // Measuring duration in D3D11 requires three queries: start and end
         // timestamp queries, and a disjoint query containing a flag which says
@@ -60,8 +91,9 @@ void pl_d3d11_timer_start(pl_gpu gpu, pl_timer timer)
         // between them, like a change in power state or clock speed. The
         // disjoint query also contains the timer frequency, so the timestamps
         // are useless without it.
-        D3D(ID3D11Device_CreateQuery(p->dev,
-            &(D3D11_QUERY_DESC) { D3D11_QUERY_TIMESTAMP_DISJOINT }, &query->disjoint));
+        query->disjoint = timer_get_query(gpu, D3D11_QUERY_TIMESTAMP_DISJOINT);
+        if (!query->ts_start || !query->ts_end || !query->disjoint)
+            goto error;
     }
 
     // Query the start timestamp
@@ -70,9 +102,9 @@ void pl_d3d11_timer_start(pl_gpu gpu, pl_timer timer)
     return;
 
 error:
-    SAFE_RELEASE(query->ts_start);
-    SAFE_RELEASE(query->ts_end);
-    SAFE_RELEASE(query->disjoint);
+    timer_put_query(gpu, D3D11_QUERY_TIMESTAMP, &query->ts_start);
+    timer_put_query(gpu, D3D11_QUERY_TIMESTAMP, &query->ts_end);
+    timer_put_query(gpu, D3D11_QUERY_TIMESTAMP_DISJOINT, &query->disjoint);
 }
 
 void pl_d3d11_timer_end(pl_gpu gpu, pl_timer timer)
@@ -171,9 +203,9 @@ static void d3d11_timer_destroy(pl_gpu gpu, pl_timer timer)
     struct d3d11_ctx *ctx = p->ctx;
 
     for (int i = 0; i < PL_ARRAY_SIZE(timer->queries); i++) {
-        SAFE_RELEASE(timer->queries[i].ts_start);
-        SAFE_RELEASE(timer->queries[i].ts_end);
-        SAFE_RELEASE(timer->queries[i].disjoint);
+        timer_put_query(gpu, D3D11_QUERY_TIMESTAMP, &timer->queries[i].ts_start);
+        timer_put_query(gpu, D3D11_QUERY_TIMESTAMP, &timer->queries[i].ts_end);
+        timer_put_query(gpu, D3D11_QUERY_TIMESTAMP_DISJOINT, &timer->queries[i].disjoint);
     }
 
     pl_d3d11_flush_message_queue(ctx, "After timer destroy");
@@ -204,7 +236,9 @@ static void d3d11_gpu_flush(pl_gpu gpu)
 {
     struct pl_gpu_d3d11 *p = PL_PRIV(gpu);
     struct d3d11_ctx *ctx = p->ctx;
+    pl_d3d11_state_reset(gpu);
     ID3D11DeviceContext_Flush(p->imm);
+    pl_d3d11_poll_readbacks(gpu, false);
 
     pl_d3d11_flush_message_queue(ctx, "After gpu flush");
 }
@@ -215,6 +249,7 @@ static void d3d11_gpu_finish(pl_gpu gpu)
     struct d3d11_ctx *ctx = p->ctx;
     HRESULT hr;
 
+    pl_d3d11_state_reset(gpu);
     if (p->finish_fence) {
         p->finish_value++;
         D3D(ID3D11Fence_SetEventOnCompletion(p->finish_fence, p->finish_value,
@@ -244,12 +279,48 @@ static void d3d11_gpu_finish(pl_gpu gpu)
         }
     }
 
+    // All downloads are done at this point, so this only fires the callbacks
+    pl_d3d11_poll_readbacks(gpu, true);
+
     pl_d3d11_flush_message_queue(ctx, "After gpu finish");
 
 error:
     return;
 }
 
+// Frame fences are implemented as event queries
+static void *d3d11_fence_create(pl_gpu gpu)
+{
+    struct pl_gpu_d3d11 *p = PL_PRIV(gpu);
+    struct d3d11_ctx *ctx = p->ctx;
+    ID3D11Query *query = NULL;
+
+    D3D(ID3D11Device_CreateQuery(p->dev,
+        &(D3D11_QUERY_DESC) { D3D11_QUERY_EVENT }, &query));
+    ID3D11DeviceContext_End(p->imm, (ID3D11Asynchronous *) query);
+
+error:
+    d3d11_gpu_flush(gpu);
+    return query;
+}
+
+static bool d3d11_fence_poll(pl_gpu gpu, void *fence, bool flush)
+{
+    struct pl_gpu_d3d11 *p = PL_PRIV(gpu);
+    BOOL done = FALSE;
+    HRESULT hr = ID3D11DeviceContext_GetData(p->imm, (ID3D11Asynchronous *) fence,
+                                             &done, sizeof(done),
+                                             flush ? 0 : D3D11_ASYNC_GETDATA_DONOTFLUSH);
+    // Don't leave callers waiting forever on errors
+    return FAILED(hr) || (hr == S_OK && done);
+}
+
+static void d3d11_fence_destroy(pl_gpu gpu, void *fence)
+{
+    ID3D11Query *query = fence;
+    SAFE_RELEASE(query);
+}
+
 static bool d3d11_gpu_is_failed(pl_gpu gpu)
 {
     struct pl_gpu_d3d11 *p = PL_PRIV(gpu);
@@ -268,13 +339,40 @@ static bool d3d11_gpu_is_failed(pl_gpu gpu)
     return ctx->is_failed;
 }
 
+void pl_d3d11_lock(pl_gpu gpu)
+{
+    struct pl_gpu_d3d11 *p = PL_PRIV(gpu);
+    if (p->mt) {
+        ID3D11Multithread_Enter(p->mt);
+    } else {
+        pl_mutex_lock(&p->lock);
+    }
+}
+
+void pl_d3d11_unlock(pl_gpu gpu)
+{
+    struct pl_gpu_d3d11 *p = PL_PRIV(gpu);
+    if (p->mt) {
+        ID3D11Multithread_Leave(p->mt);
+    } else {
+        pl_mutex_unlock(&p->lock);
+    }
+}
+
 static void d3d11_gpu_destroy(pl_gpu gpu)
 {
     struct pl_gpu_d3d11 *p = PL_PRIV(gpu);
 
+    pl_d3d11_poll_readbacks(gpu, true);
+    for (int i = 0; i < D3D_READBACK_SLOTS; i++) {
+        SAFE_RELEASE(p->readback[i].staging);
+        SAFE_RELEASE(p->readback[i].query);
+    }
+
     pl_buf_destroy(gpu, &p->finish_buf_src);
     pl_buf_destroy(gpu, &p->finish_buf_dst);
     pl_dispatch_destroy(&p->dp);
+    pl_d3d11_shader_cache_uninit(gpu);
 
     // Release everything except the immediate context
     SAFE_RELEASE(p->dev);
@@ -284,6 +382,7 @@ static void d3d11_gpu_destroy(pl_gpu gpu)
     SAFE_RELEASE(p->imm4);
     SAFE_RELEASE(p->vbuf.buf);
     SAFE_RELEASE(p->ibuf.buf);
+    SAFE_RELEASE(p->cbuf.buf);
     SAFE_RELEASE(p->rstate);
     SAFE_RELEASE(p->dsstate);
     for (int i = 0; i < PL_TEX_SAMPLE_MODE_COUNT; i++) {
@@ -295,6 +394,11 @@ static void d3d11_gpu_destroy(pl_gpu gpu)
     if (p->finish_event)
         CloseHandle(p->finish_event);
     SAFE_RELEASE(p->finish_query);
+    for (int i = 0; i < p->ts_queries.num; i++)
+        SAFE_RELEASE(p->ts_queries.elem[i]);
+    for (int i = 0; i < p->dj_queries.num; i++)
+        SAFE_RELEASE(p->dj_queries.elem[i]);
+    SAFE_RELEASE(p->mt);
 
     // Destroy the immediate context synchronously so referenced objects don't
     // show up in the leak check
@@ -302,6 +406,7 @@ static void d3d11_gpu_destroy(pl_gpu gpu)
     ID3D11DeviceContext_Flush(p->imm);
     SAFE_RELEASE(p->imm);
 
+    pl_mutex_destroy(&p->lock);
     pl_free((void *) gpu);
 }
 
@@ -358,29 +463,133 @@ static bool load_d3d_compiler(pl_gpu gpu)
     return false;
 }
 
+#define LOCKED(ret, name, sig, args)    \
+    static ret locked_##name sig        \
+    {                                   \
+        pl_d3d11_lock(gpu);             \
+        ret res = name args;            \
+        pl_d3d11_unlock(gpu);           \
+        return res;                     \
+    }
+
+#define LOCKED_VOID(name, sig, args)    \
+    static void locked_##name sig       \
+    {                                   \
+        pl_d3d11_lock(gpu);             \
+        name args;                      \
+        pl_d3d11_unlock(gpu);           \
+    }
+
+LOCKED(pl_tex, pl_d3d11_tex_create, (pl_gpu gpu, const struct pl_tex_params *params), (gpu, params))
+LOCKED_VOID(pl_d3d11_tex_destroy, (pl_gpu gpu, pl_tex tex), (gpu, tex))
+LOCKED_VOID(pl_d3d11_tex_invalidate, (pl_gpu gpu, pl_tex tex), (gpu, tex))
+LOCKED_VOID(pl_d3d11_tex_clear_ex, (pl_gpu gpu, pl_tex tex, const union pl_clear_color color), (gpu, tex, color))
+LOCKED_VOID(pl_d3d11_tex_blit, (pl_gpu gpu, const struct pl_tex_blit_params *params), (gpu, params))
+LOCKED(bool, pl_d3d11_tex_upload, (pl_gpu gpu, const struct pl_tex_transfer_params *params), (gpu, params))
+LOCKED(bool, pl_d3d11_tex_download, (pl_gpu gpu, const struct pl_tex_transfer_params *params), (gpu, params))
+LOCKED(bool, pl_d3d11_tex_poll, (pl_gpu gpu, pl_tex tex, uint64_t timeout), (gpu, tex, timeout))
+LOCKED(pl_buf, pl_d3d11_buf_create, (pl_gpu gpu, const struct pl_buf_params *params), (gpu, params))
+LOCKED_VOID(pl_d3d11_buf_destroy, (pl_gpu gpu, pl_buf buf), (gpu, buf))
+LOCKED_VOID(pl_d3d11_buf_write, (pl_gpu gpu, pl_buf buf, size_t offset, const void *data, size_t size), (gpu, buf, offset, data, size))
+LOCKED(bool, pl_d3d11_buf_read, (pl_gpu gpu, pl_buf buf, size_t offset, void *dest, size_t size), (gpu, buf, offset, dest, size))
+LOCKED_VOID(pl_d3d11_buf_copy, (pl_gpu gpu, pl_buf dst, size_t dst_offset, pl_buf src, size_t src_offset, size_t size), (gpu, dst, dst_offset, src, src_offset, size))
+LOCKED(pl_pass, pl_d3d11_pass_create, (pl_gpu gpu, const struct pl_pass_params *params), (gpu, params))
+LOCKED(pl_pass, pl_d3d11_pass_create_async, (pl_gpu gpu, const struct pl_pass_params *params), (gpu, params))
+LOCKED(bool, pl_d3d11_pass_poll, (pl_gpu gpu, pl_pass pass, bool block, bool *ok), (gpu, pass, block, ok))
+LOCKED_VOID(pl_d3d11_pass_destroy, (pl_gpu gpu, pl_pass pass), (gpu, pass))
+LOCKED_VOID(pl_d3d11_pass_run, (pl_gpu gpu, const struct pl_pass_run_params *params), (gpu, params))
+LOCKED(pl_timer, d3d11_timer_create, (pl_gpu gpu), (gpu))
+LOCKED_VOID(d3d11_timer_destroy, (pl_gpu gpu, pl_timer timer), (gpu, timer))
+LOCKED(uint64_t, d3d11_timer_query, (pl_gpu gpu, pl_timer timer), (gpu, timer))
+LOCKED_VOID(d3d11_gpu_flush, (pl_gpu gpu), (gpu))
+LOCKED_VOID(d3d11_gpu_finish, (pl_gpu gpu), (gpu))
+LOCKED(bool, d3d11_gpu_is_failed, (pl_gpu gpu), (gpu))
+LOCKED(void *, d3d11_fence_create, (pl_gpu gpu), (gpu))
+LOCKED(bool, d3d11_fence_poll, (pl_gpu gpu, void *fence, bool flush), (gpu, fence, flush))
+LOCKED_VOID(d3d11_fence_destroy, (pl_gpu gpu, void *fence), (gpu, fence))
+
+// Polls the fence without holding the device lock in between attempts, since
+// D3D11 has no way of blocking on queries
+static bool d3d11_fence_wait(pl_gpu gpu, void *fence, uint64_t timeout)
+{
+    const uint64_t start = timeout ? pl_clock_now() : 0;
+    for (bool flush = false;; flush = true) {
+        if (locked_d3d11_fence_poll(gpu, fence, flush))
+            return true;
+        if (!timeout || pl_clock_now() - start >= timeout)
+            return false;
+        Sleep(1);
+    }
+}
+
+// D3D11 manages memory internally, so this is limited to the usage of each
+// memory segment group as reported by DXGI 1.4+
+static void d3d11_memory_stats(pl_gpu gpu, struct pl_gpu_memory_stats *stats)
+{
+    struct pl_gpu_d3d11 *p = PL_PRIV(gpu);
+    struct d3d11_ctx *ctx = p->ctx;
+    IDXGIAdapter *adapter = NULL;
+    IDXGIAdapter3 *adapter3 = NULL;
+
+    if (FAILED(IDXGIDevice1_GetAdapter(ctx->dxgi_dev, &adapter)))
+        return;
+    if (FAILED(IDXGIAdapter_QueryInterface(adapter, &IID_IDXGIAdapter3,
+                                           (void **) &adapter3)))
+        goto done;
+
+    static const DXGI_MEMORY_SEGMENT_GROUP groups[] = {
+        DXGI_MEMORY_SEGMENT_GROUP_LOCAL,
+        DXGI_MEMORY_SEGMENT_GROUP_NON_LOCAL,
+    };
+
+    for (int i = 0; i < PL_ARRAY_SIZE(groups); i++) {
+        DXGI_QUERY_VIDEO_MEMORY_INFO info;
+        if (FAILED(IDXGIAdapter3_QueryVideoMemoryInfo(adapter3, 0, groups[i], &info)))
+            continue;
+        stats->heaps[stats->num_heaps++] = (struct pl_gpu_heap_usage) {
+            .size = info.Budget,
+            .allocated = info.CurrentUsage,
+            .used = info.CurrentUsage,
+            .device_local = groups[i] == DXGI_MEMORY_SEGMENT_GROUP_LOCAL,
+        };
+    }
+
+done:
+    SAFE_RELEASE(adapter3);
+    SAFE_RELEASE(adapter);
+}
+
 static struct pl_gpu_fns pl_fns_d3d11 = {
-    .tex_create             = pl_d3d11_tex_create,
-    .tex_destroy            = pl_d3d11_tex_destroy,
-    .tex_invalidate         = pl_d3d11_tex_invalidate,
-    .tex_clear_ex           = pl_d3d11_tex_clear_ex,
-    .tex_blit               = pl_d3d11_tex_blit,
-    .tex_upload             = pl_d3d11_tex_upload,
-    .tex_download           = pl_d3d11_tex_download,
-    .buf_create             = pl_d3d11_buf_create,
-    .buf_destroy            = pl_d3d11_buf_destroy,
-    .buf_write              = pl_d3d11_buf_write,
-    .buf_read               = pl_d3d11_buf_read,
-    .buf_copy               = pl_d3d11_buf_copy,
+    .tex_create             = locked_pl_d3d11_tex_create,
+    .tex_destroy            = locked_pl_d3d11_tex_destroy,
+    .tex_invalidate         = locked_pl_d3d11_tex_invalidate,
+    .tex_clear_ex           = locked_pl_d3d11_tex_clear_ex,
+    .tex_blit               = locked_pl_d3d11_tex_blit,
+    .tex_upload             = locked_pl_d3d11_tex_upload,
+    .tex_download           = locked_pl_d3d11_tex_download,
+    .tex_poll               = locked_pl_d3d11_tex_poll,
+    .buf_create             = locked_pl_d3d11_buf_create,
+    .buf_destroy            = locked_pl_d3d11_buf_destroy,
+    .buf_write              = locked_pl_d3d11_buf_write,
+    .buf_read               = locked_pl_d3d11_buf_read,
+    .buf_copy               = locked_pl_d3d11_buf_copy,
     .desc_namespace         = d3d11_desc_namespace,
-    .pass_create            = pl_d3d11_pass_create,
-    .pass_destroy           = pl_d3d11_pass_destroy,
-    .pass_run               = pl_d3d11_pass_run,
-    .timer_create           = d3d11_timer_create,
-    .timer_destroy          = d3d11_timer_destroy,
-    .timer_query            = d3d11_timer_query,
-    .gpu_flush              = d3d11_gpu_flush,
-    .gpu_finish             = d3d11_gpu_finish,
-    .gpu_is_failed          = d3d11_gpu_is_failed,
+    .pass_create            = locked_pl_d3d11_pass_create,
+    .pass_create_async      = locked_pl_d3d11_pass_create_async,
+    .pass_poll              = locked_pl_d3d11_pass_poll,
+    .pass_destroy           = locked_pl_d3d11_pass_destroy,
+    .pass_run               = locked_pl_d3d11_pass_run,
+    .timer_create           = locked_d3d11_timer_create,
+    .timer_destroy          = locked_d3d11_timer_destroy,
+    .timer_query            = locked_d3d11_timer_query,
+    .gpu_flush              = locked_d3d11_gpu_flush,
+    .gpu_finish             = locked_d3d11_gpu_finish,
+    .gpu_is_failed          = locked_d3d11_gpu_is_failed,
+    .fence_create           = locked_d3d11_fence_create,
+    .fence_wait             = d3d11_fence_wait,
+    .fence_destroy          = locked_d3d11_fence_destroy,
+    .fence_wait_unlocked    = true,
+    .memory_stats           = d3d11_memory_stats,
     .destroy                = d3d11_gpu_destroy,
 };
 
@@ -405,13 +614,28 @@ pl_gpu pl_gpu_create_d3d11(struct d3d11_ctx *ctx)
         .spirv = spirv_compiler_create(ctx->log),
         .vbuf.bind_flags = D3D11_BIND_VERTEX_BUFFER,
         .ibuf.bind_flags = D3D11_BIND_INDEX_BUFFER,
+        .cbuf.bind_flags = D3D11_BIND_CONSTANT_BUFFER,
+        // Constant buffer offsets must be a multiple of 16 constants
+        .cbuf.align = 16 * CBUF_ELEM,
     };
+    pl_mutex_init(&p->cache_lock);
+    pl_mutex_init_type(&p->lock, PL_MUTEX_RECURSIVE);
     if (!p->spirv)
         goto error;
 
     ID3D11Device_AddRef(p->dev);
     ID3D11Device_GetImmediateContext(p->dev, &p->imm);
 
+    // Prefer the runtime's own locking of the immediate context, since users
+    // sharing the device can then synchronize with us using Enter/Leave
+    hr = ID3D11DeviceContext_QueryInterface(p->imm, &IID_ID3D11Multithread,
+                                            (void **) &p->mt);
+    if (SUCCEEDED(hr)) {
+        ID3D11Multithread_SetMultithreadProtected(p->mt, TRUE);
+    } else {
+        p->mt = NULL;
+    }
+
     // Check D3D11.1 interfaces
     hr = ID3D11Device_QueryInterface(p->dev, &IID_ID3D11Device1,
                                      (void **) &p->dev1);
@@ -433,6 +657,16 @@ pl_gpu pl_gpu_create_d3d11(struct d3d11_ctx *ctx)
 
     PL_INFO(gpu, "Using Direct3D 11.%d runtime", p->minor);
 
+    // Streaming uniform buffers through a shared buffer requires both binding
+    // constant buffers with offsets and mapping them with NO_OVERWRITE
+    if (p->imm1) {
+        D3D11_FEATURE_DATA_D3D11_OPTIONS opts = {0};
+        hr = ID3D11Device_CheckFeatureSupport(p->dev, D3D11_FEATURE_D3D11_OPTIONS,
+                                              &opts, sizeof(opts));
+        p->has_cbuf_offsets = SUCCEEDED(hr) && opts.ConstantBufferOffsetting &&
+                              opts.MapNoOverwriteOnDynamicConstantBuffer;
+    }
+
     D3D(ID3D11Device_QueryInterface(p->dev, &IID_IDXGIDevice1, (void **) &dxgi_dev));
     D3D(IDXGIDevice1_GetParent(dxgi_dev, &IID_IDXGIAdapter1, (void **) &adapter));
 
@@ -455,6 +689,8 @@ pl_gpu pl_gpu_create_d3d11(struct d3d11_ctx *ctx)
         .max_ssbo_size = max_res_size,
         .max_vbo_size = max_res_size,
         .align_vertex_stride = 1,
+        .thread_safe = true,
+        .callbacks = true,
 
         // Make up some values
         .align_tex_xfer_offset = 32,
@@ -463,6 +699,8 @@ pl_gpu pl_gpu_create_d3d11(struct d3d11_ctx *ctx)
     };
 
     p->fl = ID3D11Device_GetFeatureLevel(p->dev);
+    p->exclusive = ctx->exclusive;
+    gpu->limits.instancing = p->fl >= D3D_FEATURE_LEVEL_9_3;
 
     // If we're not using FL9_x, we can use the same suballocated buffer as a
     // vertex buffer and index buffer
@@ -24,6 +24,7 @@
 #include <spirv_cross_c.h>
 
 #include "../gpu.h"
+#include "../pl_thread.h"
 
 #include "common.h"
 #include "utils.h"
@@ -43,6 +44,75 @@ struct d3d_stream_buf {
     unsigned int align;
 };
 
+enum d3d_stage {
+    D3D_STAGE_VS,
+    D3D_STAGE_PS,
+    D3D_STAGE_CS,
+    D3D_STAGE_COUNT,
+};
+
+// Shadow copy of the shader inputs bound to one pipeline stage. This does not
+// hold any references, since bound objects are kept alive by the device
+// context itself.
+struct d3d_stage_state {
+    ID3D11Buffer *cbvs[D3D11_COMMONSHADER_CONSTANT_BUFFER_API_SLOT_COUNT];
+    UINT cbv_first[D3D11_COMMONSHADER_CONSTANT_BUFFER_API_SLOT_COUNT];
+    UINT cbv_num[D3D11_COMMONSHADER_CONSTANT_BUFFER_API_SLOT_COUNT];
+    ID3D11ShaderResourceView *srvs[D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT];
+    ID3D11Resource *srv_res[D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT];
+    ID3D11SamplerState *samplers[D3D11_COMMONSHADER_SAMPLER_SLOT_COUNT];
+
+    // Number of leading slots which may be non-NULL
+    int num_cbvs;
+    int num_srvs;
+    int num_samplers;
+};
+
+// Shadow copy of the pipeline state bound by `pl_d3d11_pass_run`, so that
+// consecutive passes only need to rebind what actually changed. Outputs
+// (render targets and UAVs) are not tracked, and are unbound after every pass.
+struct d3d_pipeline_state {
+    struct d3d_stage_state stages[D3D_STAGE_COUNT];
+    ID3D11VertexShader *vs;
+    ID3D11PixelShader *ps;
+    ID3D11ComputeShader *cs;
+    ID3D11InputLayout *layout;
+    ID3D11BlendState *bstate;
+    ID3D11RasterizerState *rstate;
+    ID3D11DepthStencilState *dsstate;
+    D3D_PRIMITIVE_TOPOLOGY topology;
+};
+
+// Ring of staging textures, used to implement asynchronous texture downloads
+// without blocking on the transfer
+#define D3D_READBACK_SLOTS 4
+
+struct d3d_readback {
+    ID3D11Resource *staging;
+    ID3D11Query *query; // signalled once the copy into `staging` is done
+    int dims;
+    DXGI_FORMAT fmt;
+    UINT w, h, d;       // matches the size of the transfer
+    uint64_t id;        // submission order of the most recent transfer
+    bool busy;          // transfer pending, or data not yet copied out
+
+    // Source and destination of the pending transfer. `tex` is cleared if the
+    // texture is destroyed before the transfer completes.
+    pl_tex tex;
+    char *dst;
+    size_t row_pitch;
+    size_t depth_pitch;
+    size_t line_size;
+    void (*callback)(void *priv);
+    void *priv;
+};
+
+// Entry of the device-wide program cache, see `pl_d3d11_save_shader_cache`
+struct d3d_cache_entry {
+    uint64_t signature;
+    pl_str program;
+};
+
 struct pl_gpu_d3d11 {
     struct pl_gpu_fns impl;
     struct d3d11_ctx *ctx;
@@ -56,6 +126,10 @@ struct pl_gpu_d3d11 {
     // The Direct3D 11 minor version number
     int minor;
 
+    // Serializes access to the immediate context, see `pl_d3d11_lock`
+    ID3D11Multithread *mt;
+    pl_mutex lock;
+
     struct spirv_compiler *spirv;
 
     pD3DCompile D3DCompile;
@@ -78,6 +152,11 @@ struct pl_gpu_d3d11 {
     struct d3d_stream_buf vbuf;
     struct d3d_stream_buf ibuf;
 
+    // Streaming constant buffer for the system memory mirrors of uniform
+    // buffers, bound with offsets. Only used if `has_cbuf_offsets` is set.
+    struct d3d_stream_buf cbuf;
+    bool has_cbuf_offsets;
+
     // Shared rasterizer state
     ID3D11RasterizerState *rstate;
 
@@ -87,6 +166,19 @@ struct pl_gpu_d3d11 {
     // Array of ID3D11SamplerStates for every combination of sample/address modes
     ID3D11SamplerState *samplers[PL_TEX_SAMPLE_MODE_COUNT][PL_TEX_ADDRESS_MODE_COUNT];
 
+    // Pipeline state currently bound on the immediate context. Unless
+    // `exclusive` is set, this is reset again after every pass.
+    struct d3d_pipeline_state state;
+    bool exclusive;
+
+    // Pools of unused timestamp and disjoint queries, shared by all timers
+    PL_ARRAY(ID3D11Query *) ts_queries;
+    PL_ARRAY(ID3D11Query *) dj_queries;
+
+    // Readback ring for asynchronous texture downloads
+    struct d3d_readback readback[D3D_READBACK_SLOTS];
+    uint64_t readback_id;
+
     // Resources for finish()
     ID3D11Fence *finish_fence;
     uint64_t finish_value;
@@ -94,10 +186,32 @@ struct pl_gpu_d3d11 {
     ID3D11Query *finish_query;
     pl_buf finish_buf_src;
     pl_buf finish_buf_dst;
+
+    // Compiled programs of all passes created on this device, which are
+    // never removed, so `program` stays valid for the lifetime of the gpu
+    pl_mutex cache_lock;
+    PL_ARRAY(struct d3d_cache_entry) cache;
 };
 
 void pl_d3d11_setup_formats(struct pl_gpu *gpu);
 
+// Device contexts are not thread-safe, so every `pl_gpu` entry point that may
+// touch the immediate context holds this (recursive) lock for the duration of
+// the call. Uses ID3D11Multithread if available, so that users sharing the
+// device can synchronize with us.
+void pl_d3d11_lock(pl_gpu gpu);
+void pl_d3d11_unlock(pl_gpu gpu);
+void pl_d3d11_shader_cache_uninit(pl_gpu gpu);
+
+// Unbind everything in `pl_gpu_d3d11.state`, and reset it. This is done after
+// every pass unless `pl_gpu_d3d11.exclusive` is set, and otherwise on
+// `pl_gpu_flush` and `pl_gpu_finish`.
+void pl_d3d11_state_reset(pl_gpu gpu);
+
+// Unbind all shader resource views of `res` still bound from earlier passes.
+// Must be called before `res` is bound as an output, or destroyed.
+void pl_d3d11_state_unbind(pl_gpu gpu, ID3D11Resource *res);
+
 void pl_d3d11_timer_start(pl_gpu gpu, pl_timer timer);
 void pl_d3d11_timer_end(pl_gpu gpu, pl_timer timer);
 
@@ -156,6 +270,13 @@ void pl_d3d11_tex_clear_ex(pl_gpu gpu, pl_tex tex,
 void pl_d3d11_tex_blit(pl_gpu gpu, const struct pl_tex_blit_params *params);
 bool pl_d3d11_tex_upload(pl_gpu gpu, const struct pl_tex_transfer_params *params);
 bool pl_d3d11_tex_download(pl_gpu gpu, const struct pl_tex_transfer_params *params);
+bool pl_d3d11_tex_poll(pl_gpu gpu, pl_tex tex, uint64_t timeout);
+
+// Complete all finished asynchronous texture downloads, in submission order,
+// and fire their callbacks. If `wait` is true, this blocks until all pending
+// downloads are done. Since this runs user callbacks, it must only be called
+// from API functions invoked by the user, e.g. not from `fence_poll`.
+void pl_d3d11_poll_readbacks(pl_gpu gpu, bool wait);
 
 // Constant buffer layout used for gl_NumWorkGroups emulation
 struct d3d_num_workgroups_buf {
@@ -202,12 +323,33 @@ struct pl_pass_d3d11 {
 
     // Pre-allocated resource arrays to use in pl_pass_run
     ID3D11Buffer **cbv_arr;
+    UINT *cbv_first_arr;
+    UINT *cbv_num_arr;
     ID3D11ShaderResourceView **srv_arr;
+    ID3D11Resource **srv_res_arr;
     ID3D11SamplerState **sampler_arr;
     ID3D11UnorderedAccessView **uav_arr;
+    ID3D11Resource **uav_res_arr;
+
+    // Slices of `pl_gpu_d3d11.cbuf` for each entry of `params->descriptors`,
+    // with a size of 0 for descriptors that are not streamed
+    struct stream_buf_slice *cbuf_slices;
+
+    // Cached program, and the DXBC of each shader stage, which points into it
+    pl_str program;
+    pl_str vert_bc;
+    pl_str frag_bc;
+    pl_str comp_bc;
+
+    // Background compilation of passes created by `pl_d3d11_pass_create_async`
+    struct d3d_pass_job *job;
+    bool failed;
 };
 
 void pl_d3d11_pass_destroy(pl_gpu gpu, pl_pass pass);
 const struct pl_pass *pl_d3d11_pass_create(pl_gpu gpu,
                                            const struct pl_pass_params *params);
+const struct pl_pass *pl_d3d11_pass_create_async(pl_gpu gpu,
+                                                 const struct pl_pass_params *params);
+bool pl_d3d11_pass_poll(pl_gpu gpu, pl_pass pass, bool block, bool *ok);
 void pl_d3d11_pass_run(pl_gpu gpu, const struct pl_pass_run_params *params);
@@ -24,6 +24,8 @@ void pl_d3d11_buf_destroy(pl_gpu gpu, pl_buf buf)
     struct d3d11_ctx *ctx = p->ctx;
     struct pl_buf_d3d11 *buf_p = PL_PRIV(buf);
 
+    // Don't keep the buffer alive through stale bindings
+    pl_d3d11_state_unbind(gpu, (ID3D11Resource *) buf_p->buf);
     SAFE_RELEASE(buf_p->buf);
     SAFE_RELEASE(buf_p->staging);
     SAFE_RELEASE(buf_p->raw_srv);
@@ -225,6 +227,7 @@ void pl_d3d11_buf_resolve(pl_gpu gpu, pl_buf buf)
 
     ID3D11DeviceContext_UpdateSubresource(p->imm, (ID3D11Resource *) buf_p->buf,
         0, NULL, buf_p->data, 0, 0);
+    buf_p->dirty = false;
 }
 
 bool pl_d3d11_buf_read(pl_gpu gpu, pl_buf buf, size_t offset, void *dest,
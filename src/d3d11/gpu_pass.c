@@ -18,6 +18,8 @@
 #include "gpu.h"
 #include "formats.h"
 #include "glsl/spirv.h"
+#include "pl_clock.h"
+#include "pl_thread_pool.h"
 
 struct stream_buf_slice {
     const void *data;
@@ -349,6 +351,7 @@ static ID3DBlob *shader_compile_glsl(pl_gpu gpu, pl_pass pass,
     HRESULT hr;
 
     clock_t start = clock();
+    uint64_t start_ns = pl_clock_now();
     pl_str spirv = spirv_compile_glsl(p->spirv, tmp, &gpu->glsl, stage, glsl);
     if (!spirv.len)
         goto error;
@@ -461,6 +464,8 @@ static ID3DBlob *shader_compile_glsl(pl_gpu gpu, pl_pass pass,
 
     clock_t after_spvc = clock();
     pl_log_cpu_time(gpu->log, after_glsl, after_spvc, "translating SPIR-V to HLSL");
+    uint64_t after_spvc_ns = pl_clock_now();
+    pl_gpu_count_spirv(gpu, after_spvc_ns - start_ns);
 
     hr = p->D3DCompile(hlsl, strlen(hlsl), NULL, NULL, NULL, "main",
         get_shader_target(gpu, stage),
@@ -475,6 +480,7 @@ static ID3DBlob *shader_compile_glsl(pl_gpu gpu, pl_pass pass,
     }
 
     pl_log_cpu_time(gpu->log, after_spvc, clock(), "translating HLSL to DXBC");
+    pl_gpu_count_driver(gpu, pl_clock_now() - after_spvc_ns);
 
 error:;
     if (hlsl) {
@@ -550,16 +556,10 @@ static inline size_t cache_payload_size(struct d3d11_cache_header *header)
 }
 
 static bool d3d11_use_cached_program(pl_gpu gpu, struct pl_pass *pass,
-                                     const struct pl_pass_params *params,
-                                     pl_str *vert_bc, pl_str *frag_bc, pl_str *comp_bc)
+                                     pl_str cache)
 {
     struct pl_pass_d3d11 *pass_p = PL_PRIV(pass);
 
-    pl_str cache = {
-        .buf = (uint8_t *) params->cached_program,
-        .len = params->cached_program_len,
-    };
-
     if (cache.len < sizeof(struct d3d11_cache_header))
         return false;
 
@@ -570,7 +570,7 @@ static bool d3d11_use_cached_program(pl_gpu gpu, struct pl_pass *pass,
         return false;
     if (header->cache_version != CACHE_VERSION)
         return false;
-    if (header->hash != pass_cache_signature(gpu, params))
+    if (header->hash != pass_cache_signature(gpu, &pass->params))
         return false;
 
     // determine required cache size before reading anything
@@ -598,11 +598,10 @@ static bool d3d11_use_cached_program(pl_gpu gpu, struct pl_pass *pass,
     GET_STAGE_ARRAY(vertex, samplers);
     GET_ARRAY(pass_p, uavs, header->num_uavs);
 
-#define GET_SHADER(ptr)                                    \
-    do {                                                   \
-        if (ptr)                                           \
-            *ptr = pl_str_take(cache, header->ptr##_len);  \
-        cache = pl_str_drop(cache, header->ptr##_len);     \
+#define GET_SHADER(name)                                        \
+    do {                                                        \
+        pass_p->name = pl_str_take(cache, header->name##_len);  \
+        cache = pl_str_drop(cache, header->name##_len);         \
     } while (0)
 
     GET_SHADER(vert_bc);
@@ -612,9 +611,9 @@ static bool d3d11_use_cached_program(pl_gpu gpu, struct pl_pass *pass,
     return true;
 }
 
-static void d3d11_update_program_cache(pl_gpu gpu, struct pl_pass *pass,
-                                       const pl_str *vs_str, const pl_str *ps_str,
-                                       const pl_str *cs_str)
+// Builds `pass_p->program` from the current bindings and shader bytecode,
+// and repoints the bytecode into it
+static void d3d11_update_program_cache(pl_gpu gpu, struct pl_pass *pass)
 {
     struct pl_pass_d3d11 *pass_p = PL_PRIV(pass);
 
@@ -630,9 +629,9 @@ static void d3d11_update_program_cache(pl_gpu gpu, struct pl_pass *pass,
         .num_vertex_srvs = pass_p->vertex.srvs.num,
         .num_vertex_samplers = pass_p->vertex.samplers.num,
         .num_uavs = pass_p->uavs.num,
-        .vert_bc_len = vs_str ? vs_str->len : 0,
-        .frag_bc_len = ps_str ? ps_str->len : 0,
-        .comp_bc_len = cs_str ? cs_str->len : 0,
+        .vert_bc_len = pass_p->vert_bc.len,
+        .frag_bc_len = pass_p->frag_bc.len,
+        .comp_bc_len = pass_p->comp_bc.len,
     };
 
     size_t cache_size = sizeof(header) + cache_payload_size(&header);
@@ -650,19 +649,188 @@ static void d3d11_update_program_cache(pl_gpu gpu, struct pl_pass *pass,
     WRITE_ARRAY(vertex.samplers);
     WRITE_ARRAY(uavs);
 
-    if (vs_str)
-        pl_str_append(pass, &cache, *vs_str);
+    size_t bc_offset = cache.len;
+    pl_str_append(pass, &cache, pass_p->vert_bc);
+    pl_str_append(pass, &cache, pass_p->frag_bc);
+    pl_str_append(pass, &cache, pass_p->comp_bc);
+    pl_assert(cache_size == cache.len);
 
-    if (ps_str)
-        pl_str_append(pass, &cache, *ps_str);
+    // The bytecode may point into temporary compiler blobs or into the
+    // user-provided `cached_program`, neither of which we can hold on to
+#define MOVE_SHADER(name)                                                   \
+    do {                                                                    \
+        pass_p->name.buf = pass_p->name.len ? cache.buf + bc_offset : NULL; \
+        bc_offset += pass_p->name.len;                                      \
+    } while (0)
 
-    if (cs_str)
-        pl_str_append(pass, &cache, *cs_str);
+    MOVE_SHADER(vert_bc);
+    MOVE_SHADER(frag_bc);
+    MOVE_SHADER(comp_bc);
 
-    pl_assert(cache_size == cache.len);
+    pass_p->program = cache;
+}
+
+// Looks up a program in the device-wide cache. The result stays valid for
+// the lifetime of `gpu`, since entries are never removed.
+static pl_str cache_lookup(pl_gpu gpu, uint64_t signature)
+{
+    struct pl_gpu_d3d11 *p = PL_PRIV(gpu);
+    pl_str program = {0};
+
+    pl_mutex_lock(&p->cache_lock);
+    for (int i = 0; i < p->cache.num; i++) {
+        if (p->cache.elem[i].signature == signature) {
+            program = p->cache.elem[i].program;
+            break;
+        }
+    }
+    pl_mutex_unlock(&p->cache_lock);
+    return program;
+}
+
+// Adds a copy of `program` to the device-wide cache, unless already present.
+// Must be called with `p->cache_lock` held.
+static void cache_insert_locked(pl_gpu gpu, pl_str program)
+{
+    struct pl_gpu_d3d11 *p = PL_PRIV(gpu);
+    struct d3d11_cache_header header;
+    memcpy(&header, program.buf, sizeof(header)); // may be unaligned
+    uint64_t signature = header.hash;
+    for (int i = 0; i < p->cache.num; i++) {
+        if (p->cache.elem[i].signature == signature)
+            return;
+    }
+
+    PL_ARRAY_APPEND(NULL, p->cache, (struct d3d_cache_entry) {
+        .signature = signature,
+        .program = pl_strdup(NULL, program),
+    });
+}
+
+#define SHADER_CACHE_MAGIC {'P','L','D','X','B','C'}
+#define SHADER_CACHE_VERSION 1
+static const char d3d11_shader_cache_magic[6] = SHADER_CACHE_MAGIC;
+
+struct d3d11_shader_cache_header {
+    char magic[sizeof(d3d11_shader_cache_magic)];
+    int cache_version;
+    int num_programs;
+};
+
+size_t pl_d3d11_save_shader_cache(pl_gpu gpu, uint8_t *out_cache, size_t size)
+{
+    if (!pl_d3d11_get(gpu))
+        return 0;
+
+    struct pl_gpu_d3d11 *p = PL_PRIV(gpu);
+    struct d3d11_shader_cache_header header = {
+        .magic = SHADER_CACHE_MAGIC,
+        .cache_version = SHADER_CACHE_VERSION,
+    };
+
+    if (out_cache && size < sizeof(header))
+        return 0;
+
+    pl_mutex_lock(&p->cache_lock);
+    size_t pos = sizeof(header);
+    for (int i = 0; i < p->cache.num; i++) {
+        pl_str prog = p->cache.elem[i].program;
+        size_t rec_size = sizeof(uint64_t) + prog.len;
+        if (out_cache) {
+            if (pos + rec_size > size)
+                break;
+            uint64_t len = prog.len;
+            memcpy(&out_cache[pos], &len, sizeof(len));
+            memcpy(&out_cache[pos + sizeof(len)], prog.buf, prog.len);
+        }
+        header.num_programs++;
+        pos += rec_size;
+    }
+    pl_mutex_unlock(&p->cache_lock);
 
-    pass->params.cached_program = cache.buf;
-    pass->params.cached_program_len = cache.len;
+    if (out_cache) {
+        memcpy(out_cache, &header, sizeof(header));
+        PL_DEBUG(gpu, "Saved %d programs (%zu bytes) to shader cache",
+                 header.num_programs, pos);
+    }
+
+    return pos;
+}
+
+void pl_d3d11_load_shader_cache(pl_gpu gpu, const uint8_t *cache, size_t size)
+{
+    if (!pl_d3d11_get(gpu))
+        return;
+
+    struct d3d11_shader_cache_header header;
+    if (size < sizeof(header))
+        return;
+
+    memcpy(&header, cache, sizeof(header));
+    if (strncmp(header.magic, d3d11_shader_cache_magic,
+                sizeof(d3d11_shader_cache_magic)) != 0)
+    {
+        PL_ERR(gpu, "Failed loading shader cache: invalid magic bytes");
+        return;
+    }
+    if (header.cache_version != SHADER_CACHE_VERSION) {
+        PL_INFO(gpu, "Failed loading shader cache: wrong version... skipping");
+        return;
+    }
+
+    struct pl_gpu_d3d11 *p = PL_PRIV(gpu);
+    pl_str data = pl_str_drop((pl_str) { (uint8_t *) cache, size }, sizeof(header));
+    int num_loaded = 0;
+
+    pl_mutex_lock(&p->cache_lock);
+    for (int i = 0; i < header.num_programs; i++) {
+        uint64_t len;
+        if (data.len < sizeof(len))
+            break;
+        memcpy(&len, data.buf, sizeof(len));
+        data = pl_str_drop(data, sizeof(len));
+        if (len > data.len) {
+            PL_WARN(gpu, "Shader cache truncated, ignoring remaining programs");
+            break;
+        }
+
+        // Programs are validated again when used, so stale entries (e.g.
+        // from a different compiler version) are harmless
+        pl_str prog = pl_str_take(data, len);
+        data = pl_str_drop(data, len);
+        if (prog.len < sizeof(struct d3d11_cache_header))
+            continue;
+        cache_insert_locked(gpu, prog);
+        num_loaded++;
+    }
+    pl_mutex_unlock(&p->cache_lock);
+
+    PL_DEBUG(gpu, "Loaded %d programs from shader cache", num_loaded);
+}
+
+void pl_d3d11_shader_cache_uninit(pl_gpu gpu)
+{
+    struct pl_gpu_d3d11 *p = PL_PRIV(gpu);
+    for (int i = 0; i < p->cache.num; i++)
+        pl_free(p->cache.elem[i].program.buf);
+    pl_free(p->cache.elem);
+    pl_mutex_destroy(&p->cache_lock);
+}
+
+struct d3d_pass_job {
+    pl_gpu gpu;
+    struct pl_pass *pass;
+    pl_job job;
+    bool ok;
+};
+
+static void pass_job_destroy(struct d3d_pass_job **job)
+{
+    if (!*job)
+        return;
+
+    pl_job_wait(&(*job)->job);
+    pl_free_ptr(job);
 }
 
 void pl_d3d11_pass_destroy(pl_gpu gpu, pl_pass pass)
@@ -671,6 +839,7 @@ void pl_d3d11_pass_destroy(pl_gpu gpu, pl_pass pass)
     struct d3d11_ctx *ctx = p->ctx;
     struct pl_pass_d3d11 *pass_p = PL_PRIV(pass);
 
+    pass_job_destroy(&pass_p->job);
     SAFE_RELEASE(pass_p->vs);
     SAFE_RELEASE(pass_p->ps);
     SAFE_RELEASE(pass_p->cs);
@@ -682,45 +851,88 @@ void pl_d3d11_pass_destroy(pl_gpu gpu, pl_pass pass)
     pl_free((void *) pass);
 }
 
-static bool pass_create_raster(pl_gpu gpu, struct pl_pass *pass,
-                               const struct pl_pass_params *params)
+// Loads the program from the user-provided `cached_program`, or failing that,
+// from the device-wide cache
+static bool pass_load_program(pl_gpu gpu, struct pl_pass *pass,
+                              const struct pl_pass_params *params)
 {
-    struct pl_gpu_d3d11 *p = PL_PRIV(gpu);
-    struct d3d11_ctx *ctx = p->ctx;
-    struct pl_pass_d3d11 *pass_p = PL_PRIV(pass);
-    ID3DBlob *vs_blob = NULL;
-    pl_str vs_str = {0};
-    ID3DBlob *ps_blob = NULL;
-    pl_str ps_str = {0};
-    D3D11_INPUT_ELEMENT_DESC *in_descs = NULL;
-    bool success = false;
+    pl_str cache = {
+        .buf = (uint8_t *) params->cached_program,
+        .len = params->cached_program_len,
+    };
 
-    if (d3d11_use_cached_program(gpu, pass, params, &vs_str, &ps_str, NULL))
+    if (d3d11_use_cached_program(gpu, pass, cache)) {
         PL_DEBUG(gpu, "Using cached DXBC shaders");
+        return true;
+    }
+
+    cache = cache_lookup(gpu, pass_cache_signature(gpu, params));
+    if (cache.len && d3d11_use_cached_program(gpu, pass, cache)) {
+        PL_DEBUG(gpu, "Using DXBC shaders from the device cache");
+        return true;
+    }
+
+    return false;
+}
+
+static inline pl_str blob_str(ID3DBlob *blob)
+{
+    return (pl_str) {
+        .buf = ID3D10Blob_GetBufferPointer(blob),
+        .len = ID3D10Blob_GetBufferSize(blob),
+    };
+}
+
+// Compiles all shader stages of a pass and builds its program. This is pure
+// CPU work that never touches the device, so it's safe to run on any thread
+static bool pass_compile(pl_gpu gpu, struct pl_pass *pass)
+{
+    struct pl_pass_d3d11 *pass_p = PL_PRIV(pass);
+    const struct pl_pass_params *params = &pass->params;
+    ID3DBlob *vs_blob = NULL, *ps_blob = NULL, *cs_blob = NULL;
+    bool success = false;
 
-    pl_assert((vs_str.len == 0) == (ps_str.len == 0));
-    if (vs_str.len == 0) {
+    if (params->type == PL_PASS_COMPUTE) {
+        cs_blob = shader_compile_glsl(gpu, pass, &pass_p->main,
+                                      GLSL_SHADER_COMPUTE, params->glsl_shader);
+        if (!cs_blob)
+            goto error;
+        pass_p->comp_bc = blob_str(cs_blob);
+    } else {
         vs_blob = shader_compile_glsl(gpu, pass, &pass_p->vertex,
                                       GLSL_SHADER_VERTEX, params->vertex_shader);
         if (!vs_blob)
             goto error;
-
-        vs_str = (pl_str) {
-            .buf = ID3D10Blob_GetBufferPointer(vs_blob),
-            .len = ID3D10Blob_GetBufferSize(vs_blob),
-        };
+        pass_p->vert_bc = blob_str(vs_blob);
 
         ps_blob = shader_compile_glsl(gpu, pass, &pass_p->main,
                                       GLSL_SHADER_FRAGMENT, params->glsl_shader);
         if (!ps_blob)
             goto error;
-
-        ps_str = (pl_str) {
-            .buf = ID3D10Blob_GetBufferPointer(ps_blob),
-            .len = ID3D10Blob_GetBufferSize(ps_blob),
-        };
+        pass_p->frag_bc = blob_str(ps_blob);
     }
 
+    d3d11_update_program_cache(gpu, pass);
+    success = true;
+
+error:
+    SAFE_RELEASE(vs_blob);
+    SAFE_RELEASE(ps_blob);
+    SAFE_RELEASE(cs_blob);
+    return success;
+}
+
+static bool pass_init_raster(pl_gpu gpu, struct pl_pass *pass)
+{
+    struct pl_gpu_d3d11 *p = PL_PRIV(gpu);
+    struct d3d11_ctx *ctx = p->ctx;
+    struct pl_pass_d3d11 *pass_p = PL_PRIV(pass);
+    const struct pl_pass_params *params = &pass->params;
+    pl_str vs_str = pass_p->vert_bc, ps_str = pass_p->frag_bc;
+    D3D11_INPUT_ELEMENT_DESC *in_descs = NULL;
+    bool success = false;
+
+    pl_assert(vs_str.len && ps_str.len);
     D3D(ID3D11Device_CreateVertexShader(p->dev, vs_str.buf, vs_str.len, NULL,
                                         &pass_p->vs));
 
@@ -740,6 +952,13 @@ static bool pass_create_raster(pl_gpu gpu, struct pl_pass *pass,
             .AlignedByteOffset = va->offset,
             .Format = fmt_to_dxgi(va->fmt),
         };
+
+        // Per-instance attributes are sourced from the second input slot
+        if (va->instanced) {
+            in_descs[i].InputSlot = 1;
+            in_descs[i].InputSlotClass = D3D11_INPUT_PER_INSTANCE_DATA;
+            in_descs[i].InstanceDataStepRate = 1;
+        }
     }
     D3D(ID3D11Device_CreateInputLayout(p->dev, in_descs,
         params->num_vertex_attribs, vs_str.buf, vs_str.len, &pass_p->layout));
@@ -770,41 +989,20 @@ static bool pass_create_raster(pl_gpu gpu, struct pl_pass *pass,
     }
     D3D(ID3D11Device_CreateBlendState(p->dev, &bdesc, &pass_p->bstate));
 
-    d3d11_update_program_cache(gpu, pass, &vs_str, &ps_str, NULL);
-
     success = true;
 error:
-    SAFE_RELEASE(vs_blob);
-    SAFE_RELEASE(ps_blob);
     pl_free(in_descs);
     return success;
 }
 
-static bool pass_create_compute(pl_gpu gpu, struct pl_pass *pass,
-                                const struct pl_pass_params *params)
+static bool pass_init_compute(pl_gpu gpu, struct pl_pass *pass)
 {
     struct pl_gpu_d3d11 *p = PL_PRIV(gpu);
     struct d3d11_ctx *ctx = p->ctx;
     struct pl_pass_d3d11 *pass_p = PL_PRIV(pass);
-    ID3DBlob *cs_blob = NULL;
-    pl_str cs_str = {0};
-    bool success = false;
-
-    if (d3d11_use_cached_program(gpu, pass, params, NULL, NULL, &cs_str))
-        PL_DEBUG(gpu, "Using cached DXBC shader");
-
-    if (cs_str.len == 0) {
-        cs_blob = shader_compile_glsl(gpu, pass, &pass_p->main,
-                                      GLSL_SHADER_COMPUTE, params->glsl_shader);
-        if (!cs_blob)
-            goto error;
-
-        cs_str = (pl_str) {
-            .buf = ID3D10Blob_GetBufferPointer(cs_blob),
-            .len = ID3D10Blob_GetBufferSize(cs_blob),
-        };
-    }
+    pl_str cs_str = pass_p->comp_bc;
 
+    pl_assert(cs_str.len);
     D3D(ID3D11Device_CreateComputeShader(p->dev, cs_str.buf, cs_str.len, NULL,
                                          &pass_p->cs));
 
@@ -817,46 +1015,44 @@ static bool pass_create_compute(pl_gpu gpu, struct pl_pass *pass,
                                       &pass_p->num_workgroups_buf));
     }
 
-    d3d11_update_program_cache(gpu, pass, NULL, NULL, &cs_str);
+    return true;
 
-    success = true;
 error:
-    SAFE_RELEASE(cs_blob);
-    return success;
+    return false;
 }
 
-const struct pl_pass *pl_d3d11_pass_create(pl_gpu gpu,
-                                           const struct pl_pass_params *params)
+// Creates the device objects of a pass from its compiled program
+static bool pass_finish(pl_gpu gpu, struct pl_pass *pass)
 {
     struct pl_gpu_d3d11 *p = PL_PRIV(gpu);
     struct d3d11_ctx *ctx = p->ctx;
-
-    struct pl_pass *pass = pl_zalloc_obj(NULL, pass, struct pl_pass_d3d11);
-    pass->params = pl_pass_params_copy(pass, params);
     struct pl_pass_d3d11 *pass_p = PL_PRIV(pass);
-    *pass_p = (struct pl_pass_d3d11) {
-        .max_binding = -1,
-    };
+    const struct pl_pass_params *params = &pass->params;
 
     if (params->type == PL_PASS_COMPUTE) {
-        if (!pass_create_compute(gpu, pass, params))
-            goto error;
+        if (!pass_init_compute(gpu, pass))
+            return false;
     } else {
-        if (!pass_create_raster(gpu, pass, params))
-            goto error;
+        if (!pass_init_raster(gpu, pass))
+            return false;
     }
 
     // Pre-allocate resource arrays to use in pl_pass_run
-    pass_p->cbv_arr = pl_calloc(pass,
-        PL_MAX(pass_p->main.cbvs.num, pass_p->vertex.cbvs.num),
-        sizeof(*pass_p->cbv_arr));
-    pass_p->srv_arr = pl_calloc(pass,
-        PL_MAX(pass_p->main.srvs.num, pass_p->vertex.srvs.num),
-        sizeof(*pass_p->srv_arr));
+    int num_cbvs = PL_MAX(pass_p->main.cbvs.num, pass_p->vertex.cbvs.num);
+    pass_p->cbv_arr = pl_calloc(pass, num_cbvs, sizeof(*pass_p->cbv_arr));
+    pass_p->cbv_first_arr = pl_calloc(pass, num_cbvs, sizeof(*pass_p->cbv_first_arr));
+    pass_p->cbv_num_arr = pl_calloc(pass, num_cbvs, sizeof(*pass_p->cbv_num_arr));
+    pass_p->cbuf_slices = pl_calloc(pass, params->num_descriptors,
+                                    sizeof(*pass_p->cbuf_slices));
+    int num_srvs = PL_MAX(pass_p->main.srvs.num, pass_p->vertex.srvs.num);
+    pass_p->srv_arr = pl_calloc(pass, num_srvs, sizeof(*pass_p->srv_arr));
+    pass_p->srv_res_arr = pl_calloc(pass, num_srvs, sizeof(*pass_p->srv_res_arr));
     pass_p->sampler_arr = pl_calloc(pass,
         PL_MAX(pass_p->main.samplers.num, pass_p->vertex.samplers.num),
         sizeof(*pass_p->sampler_arr));
     pass_p->uav_arr = pl_calloc(pass, pass_p->uavs.num, sizeof(*pass_p->uav_arr));
+    pass_p->uav_res_arr = pl_calloc(pass, pass_p->uavs.num,
+                                    sizeof(*pass_p->uav_res_arr));
 
     // Find the highest binding number used in `params->descriptors` if we
     // haven't found it already. (If the shader was compiled fresh rather than
@@ -899,7 +1095,68 @@ const struct pl_pass *pl_d3d11_pass_create(pl_gpu gpu,
     MAP_RESOURCES(pass_p->uavs);
     pl_free(binding_map);
 
+    pass->params.cached_program = pass_p->program.buf;
+    pass->params.cached_program_len = pass_p->program.len;
+
+    pl_mutex_lock(&p->cache_lock);
+    cache_insert_locked(gpu, pass_p->program);
+    pl_mutex_unlock(&p->cache_lock);
+
     pl_d3d11_flush_message_queue(ctx, "After pass create");
+    return true;
+}
+
+static void pass_job_run(void *arg)
+{
+    struct d3d_pass_job *job = arg;
+
+    clock_t start = clock();
+    job->ok = pass_compile(job->gpu, job->pass);
+    if (job->ok)
+        pl_log_cpu_time(job->gpu->log, start, clock(), "compiling pass in background");
+}
+
+// Starts compiling a pass in the background. Returns false if the job could
+// not be submitted, in which case the pass should be compiled synchronously.
+static bool pass_job_start(pl_gpu gpu, struct pl_pass *pass)
+{
+    struct pl_pass_d3d11 *pass_p = PL_PRIV(pass);
+    struct d3d_pass_job *job = pl_zalloc_ptr(NULL, job);
+    job->gpu = gpu;
+    job->pass = pass;
+
+    job->job = pl_job_submit(gpu->log, pass_job_run, job);
+    if (!job->job) {
+        pl_free(job);
+        return false;
+    }
+
+    pass_p->job = job;
+    return true;
+}
+
+static const struct pl_pass *pass_create(pl_gpu gpu,
+                                         const struct pl_pass_params *params,
+                                         bool async)
+{
+    struct pl_pass *pass = pl_zalloc_obj(NULL, pass, struct pl_pass_d3d11);
+    pass->params = pl_pass_params_copy(pass, params);
+    struct pl_pass_d3d11 *pass_p = PL_PRIV(pass);
+    *pass_p = (struct pl_pass_d3d11) {
+        .max_binding = -1,
+    };
+
+    if (pass_load_program(gpu, pass, params)) {
+        d3d11_update_program_cache(gpu, pass);
+    } else if (async && pass_job_start(gpu, pass)) {
+        // Finished by `pl_d3d11_pass_poll` or `pl_d3d11_pass_run`
+        return pass;
+    } else if (!pass_compile(gpu, pass)) {
+        goto error;
+    }
+
+    if (!pass_finish(gpu, pass))
+        goto error;
 
     return pass;
 
@@ -908,18 +1165,53 @@ error:
     return NULL;
 }
 
+const struct pl_pass *pl_d3d11_pass_create(pl_gpu gpu,
+                                           const struct pl_pass_params *params)
+{
+    return pass_create(gpu, params, false);
+}
+
+const struct pl_pass *pl_d3d11_pass_create_async(pl_gpu gpu,
+                                                 const struct pl_pass_params *params)
+{
+    return pass_create(gpu, params, true);
+}
+
+bool pl_d3d11_pass_poll(pl_gpu gpu, pl_pass pass, bool block, bool *ok)
+{
+    struct pl_pass_d3d11 *pass_p = PL_PRIV(pass);
+    struct d3d_pass_job *job = pass_p->job;
+    if (job) {
+        if (!block && !pl_job_done(job->job))
+            return false;
+
+        pl_job_wait(&job->job);
+        bool compiled = job->ok;
+        pl_free_ptr(&pass_p->job);
+        pass_p->failed = !compiled || !pass_finish(gpu, (struct pl_pass *) pass);
+    }
+
+    *ok = !pass_p->failed;
+    return true;
+}
+
 // Shared logic between VS, PS and CS for filling the resource arrays that are
 // passed to ID3D11DeviceContext methods
 static void fill_resources(pl_gpu gpu, pl_pass pass,
                            struct d3d_pass_stage *pass_s,
                            const struct pl_pass_run_params *params,
                            ID3D11Buffer **cbvs, ID3D11ShaderResourceView **srvs,
+                           ID3D11Resource **srv_res,
                            ID3D11SamplerState **samplers)
 {
     struct pl_gpu_d3d11 *p = PL_PRIV(gpu);
     struct pl_pass_d3d11 *pass_p = PL_PRIV(pass);
 
     for (int i = 0; i < pass_s->cbvs.num; i++) {
+        // Bind the entire buffer unless it was streamed, see `upload_cbufs`
+        pass_p->cbv_first_arr[i] = 0;
+        pass_p->cbv_num_arr[i] = D3D11_REQ_CONSTANT_BUFFER_ELEMENT_COUNT;
+
         int binding = pass_s->cbvs.elem[i];
         if (binding == HLSL_BINDING_NUM_WORKGROUPS) {
             cbvs[i] = pass_p->num_workgroups_buf;
@@ -929,6 +1221,14 @@ static void fill_resources(pl_gpu gpu, pl_pass pass,
             continue;
         }
 
+        const struct stream_buf_slice *slice = &pass_p->cbuf_slices[binding];
+        if (slice->size) {
+            cbvs[i] = p->cbuf.buf;
+            pass_p->cbv_first_arr[i] = slice->offset / CBUF_ELEM;
+            pass_p->cbv_num_arr[i] = PL_ALIGN2(slice->size, p->cbuf.align) / CBUF_ELEM;
+            continue;
+        }
+
         pl_buf buf = params->desc_bindings[binding].object;
         pl_d3d11_buf_resolve(gpu, buf);
         struct pl_buf_d3d11 *buf_p = PL_PRIV(buf);
@@ -937,10 +1237,10 @@ static void fill_resources(pl_gpu gpu, pl_pass pass,
 
     for (int i = 0; i < pass_s->srvs.num; i++) {
         int binding = pass_s->srvs.elem[i];
-        if (binding < 0) {
-            srvs[i] = NULL;
+        srvs[i] = NULL;
+        srv_res[i] = NULL;
+        if (binding < 0)
             continue;
-        }
 
         pl_tex tex;
         struct pl_tex_d3d11 *tex_p;
@@ -952,17 +1252,20 @@ static void fill_resources(pl_gpu gpu, pl_pass pass,
             tex = params->desc_bindings[binding].object;
             tex_p = PL_PRIV(tex);
             srvs[i] = tex_p->srv;
+            srv_res[i] = tex_p->res;
             break;
         case PL_DESC_BUF_STORAGE:
             buf = params->desc_bindings[binding].object;
             buf_p = PL_PRIV(buf);
             srvs[i] = buf_p->raw_srv;
+            srv_res[i] = (ID3D11Resource *) buf_p->buf;
             break;
         case PL_DESC_BUF_TEXEL_UNIFORM:
         case PL_DESC_BUF_TEXEL_STORAGE:
             buf = params->desc_bindings[binding].object;
             buf_p = PL_PRIV(buf);
             srvs[i] = buf_p->texel_srv;
+            srv_res[i] = (ID3D11Resource *) buf_p->buf;
             break;
         default:
             break;
@@ -981,17 +1284,59 @@ static void fill_resources(pl_gpu gpu, pl_pass pass,
     }
 }
 
+// Uploads the system memory mirrors of all uniform buffers used by a pass to
+// the streaming constant buffer, which `fill_resources` then binds at the
+// respective offsets. This needs only a single NO_OVERWRITE map per pass,
+// rather than updating (and thereby renaming) every buffer separately.
+static bool upload_cbufs(pl_gpu gpu, const struct pl_pass_run_params *params)
+{
+    struct pl_gpu_d3d11 *p = PL_PRIV(gpu);
+    pl_pass pass = params->pass;
+    struct pl_pass_d3d11 *pass_p = PL_PRIV(pass);
+    if (!p->has_cbuf_offsets)
+        return true;
+
+    int num_descs = pass->params.num_descriptors;
+    bool streamed = false;
+    for (int i = 0; i < num_descs; i++) {
+        pass_p->cbuf_slices[i] = (struct stream_buf_slice) {0};
+        if (pass->params.descriptors[i].type != PL_DESC_BUF_UNIFORM)
+            continue;
+
+        pl_buf buf = params->desc_bindings[i].object;
+        struct pl_buf_d3d11 *buf_p = PL_PRIV(buf);
+        if (!buf_p->data)
+            continue;
+
+        pass_p->cbuf_slices[i] = (struct stream_buf_slice) {
+            .data = buf_p->data,
+            .size = PL_ALIGN2(buf->params.size, CBUF_ELEM),
+        };
+        streamed = true;
+    }
+
+    if (!streamed)
+        return true;
+
+    if (!stream_buf_upload(gpu, &p->cbuf, pass_p->cbuf_slices, num_descs)) {
+        PL_ERR(gpu, "Failed to upload constant buffers");
+        return false;
+    }
+
+    return true;
+}
+
 static void fill_uavs(pl_pass pass, const struct pl_pass_run_params *params,
-                      ID3D11UnorderedAccessView **uavs)
+                      ID3D11UnorderedAccessView **uavs, ID3D11Resource **uav_res)
 {
     struct pl_pass_d3d11 *pass_p = PL_PRIV(pass);
 
     for (int i = 0; i < pass_p->uavs.num; i++) {
         int binding = pass_p->uavs.elem[i];
-        if (binding < 0) {
-            uavs[i] = NULL;
+        uavs[i] = NULL;
+        uav_res[i] = NULL;
+        if (binding < 0)
             continue;
-        }
 
         pl_tex tex;
         struct pl_tex_d3d11 *tex_p;
@@ -1002,16 +1347,19 @@ static void fill_uavs(pl_pass pass, const struct pl_pass_run_params *params,
             buf = params->desc_bindings[binding].object;
             buf_p = PL_PRIV(buf);
             uavs[i] = buf_p->raw_uav;
+            uav_res[i] = (ID3D11Resource *) buf_p->buf;
             break;
         case PL_DESC_STORAGE_IMG:
             tex = params->desc_bindings[binding].object;
             tex_p = PL_PRIV(tex);
             uavs[i] = tex_p->uav;
+            uav_res[i] = tex_p->res;
             break;
         case PL_DESC_BUF_TEXEL_STORAGE:
             buf = params->desc_bindings[binding].object;
             buf_p = PL_PRIV(buf);
             uavs[i] = buf_p->texel_uav;
+            uav_res[i] = (ID3D11Resource *) buf_p->buf;
             break;
         default:
             break;
@@ -1019,6 +1367,209 @@ static void fill_uavs(pl_pass pass, const struct pl_pass_run_params *params,
     }
 }
 
+static ID3D11Buffer *const null_cbvs[D3D11_COMMONSHADER_CONSTANT_BUFFER_API_SLOT_COUNT];
+static ID3D11ShaderResourceView *const null_srvs[D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT];
+static ID3D11SamplerState *const null_samplers[D3D11_COMMONSHADER_SAMPLER_SLOT_COUNT];
+
+// If `first` and `num` are NULL, the buffers are bound in their entirety
+static void set_cbvs(struct pl_gpu_d3d11 *p, enum d3d_stage stage,
+                     UINT slot, UINT count, ID3D11Buffer *const *cbvs,
+                     const UINT *first, const UINT *num)
+{
+    if (first && p->has_cbuf_offsets) {
+        switch (stage) {
+        case D3D_STAGE_VS:
+            ID3D11DeviceContext1_VSSetConstantBuffers1(p->imm1, slot, count, cbvs, first, num);
+            return;
+        case D3D_STAGE_PS:
+            ID3D11DeviceContext1_PSSetConstantBuffers1(p->imm1, slot, count, cbvs, first, num);
+            return;
+        case D3D_STAGE_CS:
+            ID3D11DeviceContext1_CSSetConstantBuffers1(p->imm1, slot, count, cbvs, first, num);
+            return;
+        case D3D_STAGE_COUNT: break;
+        }
+        pl_unreachable();
+    }
+
+    switch (stage) {
+    case D3D_STAGE_VS:
+        ID3D11DeviceContext_VSSetConstantBuffers(p->imm, slot, count, cbvs);
+        return;
+    case D3D_STAGE_PS:
+        ID3D11DeviceContext_PSSetConstantBuffers(p->imm, slot, count, cbvs);
+        return;
+    case D3D_STAGE_CS:
+        ID3D11DeviceContext_CSSetConstantBuffers(p->imm, slot, count, cbvs);
+        return;
+    case D3D_STAGE_COUNT: break;
+    }
+
+    pl_unreachable();
+}
+
+static void set_srvs(struct pl_gpu_d3d11 *p, enum d3d_stage stage, UINT slot,
+                     UINT count, ID3D11ShaderResourceView *const *srvs)
+{
+    switch (stage) {
+    case D3D_STAGE_VS:
+        ID3D11DeviceContext_VSSetShaderResources(p->imm, slot, count, srvs);
+        return;
+    case D3D_STAGE_PS:
+        ID3D11DeviceContext_PSSetShaderResources(p->imm, slot, count, srvs);
+        return;
+    case D3D_STAGE_CS:
+        ID3D11DeviceContext_CSSetShaderResources(p->imm, slot, count, srvs);
+        return;
+    case D3D_STAGE_COUNT: break;
+    }
+
+    pl_unreachable();
+}
+
+static void set_samplers(struct pl_gpu_d3d11 *p, enum d3d_stage stage,
+                         UINT slot, UINT count,
+                         ID3D11SamplerState *const *samplers)
+{
+    switch (stage) {
+    case D3D_STAGE_VS:
+        ID3D11DeviceContext_VSSetSamplers(p->imm, slot, count, samplers);
+        return;
+    case D3D_STAGE_PS:
+        ID3D11DeviceContext_PSSetSamplers(p->imm, slot, count, samplers);
+        return;
+    case D3D_STAGE_CS:
+        ID3D11DeviceContext_CSSetSamplers(p->imm, slot, count, samplers);
+        return;
+    case D3D_STAGE_COUNT: break;
+    }
+
+    pl_unreachable();
+}
+
+// Finds the range of slots in which `arr` differs from `shadow`. Returns
+// false if they're identical.
+static bool dirty_range(const void *shadow, const void *arr, size_t size,
+                        int num, int *first, int *count)
+{
+    const uint8_t *a = shadow, *b = arr;
+    int lo = 0, hi = num;
+    while (lo < hi && !memcmp(a + lo * size, b + lo * size, size))
+        lo++;
+    while (hi > lo && !memcmp(a + (hi - 1) * size, b + (hi - 1) * size, size))
+        hi--;
+
+    *first = lo;
+    *count = hi - lo;
+    return hi > lo;
+}
+
+// Bind the resources gathered by `fill_resources` to a stage, skipping the
+// slots already bound to the same objects. Slots past the end are left as-is,
+// since the shader doesn't access them anyway.
+static void bind_resources(pl_gpu gpu, pl_pass pass, enum d3d_stage stage,
+                           const struct d3d_pass_stage *pass_s)
+{
+    struct pl_gpu_d3d11 *p = PL_PRIV(gpu);
+    struct pl_pass_d3d11 *pass_p = PL_PRIV(pass);
+    struct d3d_stage_state *st = &p->state.stages[stage];
+    int first, count;
+
+    // Some runtimes ignore a changed offset if the same buffer is already
+    // bound, so such slots are explicitly unbound first
+    int num = pass_s->cbvs.num;
+    int lo = 0, hi = num;
+    while (lo < hi && st->cbvs[lo] == pass_p->cbv_arr[lo] &&
+           st->cbv_first[lo] == pass_p->cbv_first_arr[lo] &&
+           st->cbv_num[lo] == pass_p->cbv_num_arr[lo])
+        lo++;
+    while (hi > lo && st->cbvs[hi - 1] == pass_p->cbv_arr[hi - 1] &&
+           st->cbv_first[hi - 1] == pass_p->cbv_first_arr[hi - 1] &&
+           st->cbv_num[hi - 1] == pass_p->cbv_num_arr[hi - 1])
+        hi--;
+    if (hi > lo) {
+        bool rebind = false;
+        for (int i = lo; i < hi; i++)
+            rebind |= p->has_cbuf_offsets && st->cbvs[i] == pass_p->cbv_arr[i];
+        if (rebind)
+            set_cbvs(p, stage, lo, hi - lo, null_cbvs, NULL, NULL);
+
+        set_cbvs(p, stage, lo, hi - lo, &pass_p->cbv_arr[lo],
+                 &pass_p->cbv_first_arr[lo], &pass_p->cbv_num_arr[lo]);
+        for (int i = lo; i < hi; i++) {
+            st->cbvs[i] = pass_p->cbv_arr[i];
+            st->cbv_first[i] = pass_p->cbv_first_arr[i];
+            st->cbv_num[i] = pass_p->cbv_num_arr[i];
+        }
+        st->num_cbvs = PL_MAX(st->num_cbvs, hi);
+    }
+
+    num = pass_s->srvs.num;
+    if (dirty_range(st->srvs, pass_p->srv_arr, sizeof(*st->srvs), num,
+                    &first, &count))
+    {
+        set_srvs(p, stage, first, count, &pass_p->srv_arr[first]);
+        memcpy(&st->srvs[first], &pass_p->srv_arr[first],
+               count * sizeof(*st->srvs));
+        memcpy(&st->srv_res[first], &pass_p->srv_res_arr[first],
+               count * sizeof(*st->srv_res));
+        st->num_srvs = PL_MAX(st->num_srvs, first + count);
+    }
+
+    num = pass_s->samplers.num;
+    if (dirty_range(st->samplers, pass_p->sampler_arr, sizeof(*st->samplers),
+                    num, &first, &count))
+    {
+        set_samplers(p, stage, first, count, &pass_p->sampler_arr[first]);
+        memcpy(&st->samplers[first], &pass_p->sampler_arr[first],
+               count * sizeof(*st->samplers));
+        st->num_samplers = PL_MAX(st->num_samplers, first + count);
+    }
+}
+
+void pl_d3d11_state_unbind(pl_gpu gpu, ID3D11Resource *res)
+{
+    struct pl_gpu_d3d11 *p = PL_PRIV(gpu);
+    if (!res)
+        return;
+
+    for (enum d3d_stage stage = 0; stage < D3D_STAGE_COUNT; stage++) {
+        struct d3d_stage_state *st = &p->state.stages[stage];
+        for (int i = 0; i < st->num_srvs; i++) {
+            if (st->srvs[i] && st->srv_res[i] == res) {
+                set_srvs(p, stage, i, 1, null_srvs);
+                st->srvs[i] = NULL;
+                st->srv_res[i] = NULL;
+            }
+        }
+    }
+}
+
+void pl_d3d11_state_reset(pl_gpu gpu)
+{
+    struct pl_gpu_d3d11 *p = PL_PRIV(gpu);
+    struct d3d_pipeline_state *state = &p->state;
+
+    for (enum d3d_stage stage = 0; stage < D3D_STAGE_COUNT; stage++) {
+        const struct d3d_stage_state *st = &state->stages[stage];
+        if (st->num_cbvs)
+            set_cbvs(p, stage, 0, st->num_cbvs, null_cbvs, NULL, NULL);
+        if (st->num_srvs)
+            set_srvs(p, stage, 0, st->num_srvs, null_srvs);
+        if (st->num_samplers)
+            set_samplers(p, stage, 0, st->num_samplers, null_samplers);
+    }
+
+    if (state->vs)
+        ID3D11DeviceContext_VSSetShader(p->imm, NULL, NULL, 0);
+    if (state->ps)
+        ID3D11DeviceContext_PSSetShader(p->imm, NULL, NULL, 0);
+    if (state->cs)
+        ID3D11DeviceContext_CSSetShader(p->imm, NULL, NULL, 0);
+
+    *state = (struct d3d_pipeline_state) {0};
+}
+
 static void pass_run_raster(pl_gpu gpu, const struct pl_pass_run_params *params)
 {
     struct pl_gpu_d3d11 *p = PL_PRIV(gpu);
@@ -1040,6 +1591,9 @@ static void pass_run_raster(pl_gpu gpu, const struct pl_pass_run_params *params)
         return;
     }
 
+    if (!upload_cbufs(gpu, params))
+        return;
+
     // Figure out how much vertex/index data to upload, if any
     size_t vertex_alloc = params->vertex_data ? pl_vertex_buf_size(params) : 0;
     size_t index_alloc = params->index_data ? pl_index_buf_size(params) : 0;
@@ -1102,33 +1656,50 @@ static void pass_run_raster(pl_gpu gpu, const struct pl_pass_run_params *params)
             index_fmts[params->index_fmt], params->index_offset);
     }
 
-    ID3D11DeviceContext_IASetInputLayout(p->imm, pass_p->layout);
+    if (params->instance_buf) {
+        struct pl_buf_d3d11 *buf_p = PL_PRIV(params->instance_buf);
+        ID3D11DeviceContext_IASetVertexBuffers(p->imm, 1, 1, &buf_p->buf,
+            &(UINT) { pass->params.instance_stride },
+            &(UINT) { params->instance_offset });
+    }
+
+    struct d3d_pipeline_state *state = &p->state;
+    if (state->layout != pass_p->layout) {
+        ID3D11DeviceContext_IASetInputLayout(p->imm, pass_p->layout);
+        state->layout = pass_p->layout;
+    }
 
     static const D3D_PRIMITIVE_TOPOLOGY prim_topology[] = {
         [PL_PRIM_TRIANGLE_LIST] = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST,
         [PL_PRIM_TRIANGLE_STRIP] = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP,
     };
-    ID3D11DeviceContext_IASetPrimitiveTopology(p->imm,
-        prim_topology[pass->params.vertex_type]);
+    D3D_PRIMITIVE_TOPOLOGY topology = prim_topology[pass->params.vertex_type];
+    if (state->topology != topology) {
+        ID3D11DeviceContext_IASetPrimitiveTopology(p->imm, topology);
+        state->topology = topology;
+    }
 
-    ID3D11DeviceContext_VSSetShader(p->imm, pass_p->vs, NULL, 0);
+    if (state->vs != pass_p->vs) {
+        ID3D11DeviceContext_VSSetShader(p->imm, pass_p->vs, NULL, 0);
+        state->vs = pass_p->vs;
+    }
 
     ID3D11Buffer **cbvs = pass_p->cbv_arr;
     ID3D11ShaderResourceView **srvs = pass_p->srv_arr;
+    ID3D11Resource **srv_res = pass_p->srv_res_arr;
     ID3D11SamplerState **samplers = pass_p->sampler_arr;
     ID3D11UnorderedAccessView **uavs = pass_p->uav_arr;
+    ID3D11Resource **uav_res = pass_p->uav_res_arr;
+
+    // Set vertex shader resources. Only changed slots are rebound, which also
+    // avoids the debug layer complaining about calls with 0 resources.
+    fill_resources(gpu, pass, &pass_p->vertex, params, cbvs, srvs, srv_res, samplers);
+    bind_resources(gpu, pass, D3D_STAGE_VS, &pass_p->vertex);
 
-    // Set vertex shader resources. The device context is called conditionally
-    // because the debug layer complains if these are called with 0 resources.
-    fill_resources(gpu, pass, &pass_p->vertex, params, cbvs, srvs, samplers);
-    if (pass_p->vertex.cbvs.num)
-        ID3D11DeviceContext_VSSetConstantBuffers(p->imm, 0, pass_p->vertex.cbvs.num, cbvs);
-    if (pass_p->vertex.srvs.num)
-        ID3D11DeviceContext_VSSetShaderResources(p->imm, 0, pass_p->vertex.srvs.num, srvs);
-    if (pass_p->vertex.samplers.num)
-        ID3D11DeviceContext_VSSetSamplers(p->imm, 0, pass_p->vertex.samplers.num, samplers);
-
-    ID3D11DeviceContext_RSSetState(p->imm, p->rstate);
+    if (state->rstate != p->rstate) {
+        ID3D11DeviceContext_RSSetState(p->imm, p->rstate);
+        state->rstate = p->rstate;
+    }
     ID3D11DeviceContext_RSSetViewports(p->imm, 1, (&(D3D11_VIEWPORT) {
         .TopLeftX = params->viewport.x0,
         .TopLeftY = params->viewport.y0,
@@ -1144,59 +1715,61 @@ static void pass_run_raster(pl_gpu gpu, const struct pl_pass_run_params *params)
         .bottom = params->scissors.y1,
     }));
 
-    ID3D11DeviceContext_PSSetShader(p->imm, pass_p->ps, NULL, 0);
+    if (state->ps != pass_p->ps) {
+        ID3D11DeviceContext_PSSetShader(p->imm, pass_p->ps, NULL, 0);
+        state->ps = pass_p->ps;
+    }
 
     // Set pixel shader resources
-    fill_resources(gpu, pass, &pass_p->main, params, cbvs, srvs, samplers);
-    if (pass_p->main.cbvs.num)
-        ID3D11DeviceContext_PSSetConstantBuffers(p->imm, 0, pass_p->main.cbvs.num, cbvs);
-    if (pass_p->main.srvs.num)
-        ID3D11DeviceContext_PSSetShaderResources(p->imm, 0, pass_p->main.srvs.num, srvs);
-    if (pass_p->main.samplers.num)
-        ID3D11DeviceContext_PSSetSamplers(p->imm, 0, pass_p->main.samplers.num, samplers);
+    fill_resources(gpu, pass, &pass_p->main, params, cbvs, srvs, srv_res, samplers);
+    bind_resources(gpu, pass, D3D_STAGE_PS, &pass_p->main);
 
-    ID3D11DeviceContext_OMSetBlendState(p->imm, pass_p->bstate, NULL,
-                                        D3D11_DEFAULT_SAMPLE_MASK);
-    ID3D11DeviceContext_OMSetDepthStencilState(p->imm, p->dsstate, 0);
-
-    fill_uavs(pass, params, uavs);
+    if (state->bstate != pass_p->bstate) {
+        ID3D11DeviceContext_OMSetBlendState(p->imm, pass_p->bstate, NULL,
+                                            D3D11_DEFAULT_SAMPLE_MASK);
+        state->bstate = pass_p->bstate;
+    }
+    if (state->dsstate != p->dsstate) {
+        ID3D11DeviceContext_OMSetDepthStencilState(p->imm, p->dsstate, 0);
+        state->dsstate = p->dsstate;
+    }
 
+    // Inputs left bound by earlier passes must not alias any of the outputs,
+    // or D3D11 would silently unbind them behind our back
     struct pl_tex_d3d11 *target_p = PL_PRIV(params->target);
+    fill_uavs(pass, params, uavs, uav_res);
+    pl_d3d11_state_unbind(gpu, target_p->res);
+    for (int i = 0; i < pass_p->uavs.num; i++)
+        pl_d3d11_state_unbind(gpu, uav_res[i]);
+
     ID3D11DeviceContext_OMSetRenderTargetsAndUnorderedAccessViews(
         p->imm, 1, &target_p->rtv, NULL, 1, pass_p->uavs.num, uavs, NULL);
 
-    if (params->index_data || params->index_buf) {
+    if (params->instance_count > 1) {
+        if (params->index_data || params->index_buf) {
+            ID3D11DeviceContext_DrawIndexedInstanced(p->imm, params->vertex_count,
+                                                     params->instance_count, 0, 0, 0);
+        } else {
+            ID3D11DeviceContext_DrawInstanced(p->imm, params->vertex_count,
+                                              params->instance_count, 0, 0);
+        }
+    } else if (params->index_data || params->index_buf) {
         ID3D11DeviceContext_DrawIndexed(p->imm, params->vertex_count, 0, 0);
     } else {
         ID3D11DeviceContext_Draw(p->imm, params->vertex_count, 0);
     }
 
-    // Unbind everything. It's easier to do this than to actually track state,
-    // and if we leave the RTV bound, it could trip up D3D's conflict checker.
-    // Also, apparently unbinding SRVs can prevent a 10level9 bug?
+    // Unbind the outputs, since leaving the RTV or UAVs bound could trip up
+    // D3D's conflict checker once they're used as inputs. Inputs only stay
+    // bound for the next pass if we own the immediate context, and never on
+    // 10level9, where apparently unbinding SRVs can prevent a bug?
     // https://docs.microsoft.com/en-us/windows/win32/direct3d11/overviews-direct3d-11-devices-downlevel-prevent-null-srvs
-    for (int i = 0; i < PL_MAX(pass_p->main.cbvs.num, pass_p->vertex.cbvs.num); i++)
-        cbvs[i] = NULL;
-    for (int i = 0; i < PL_MAX(pass_p->main.srvs.num, pass_p->vertex.srvs.num); i++)
-        srvs[i] = NULL;
-    for (int i = 0; i < PL_MAX(pass_p->main.samplers.num, pass_p->vertex.samplers.num); i++)
-        samplers[i] = NULL;
     for (int i = 0; i < pass_p->uavs.num; i++)
         uavs[i] = NULL;
-    if (pass_p->vertex.cbvs.num)
-        ID3D11DeviceContext_VSSetConstantBuffers(p->imm, 0, pass_p->vertex.cbvs.num, cbvs);
-    if (pass_p->vertex.srvs.num)
-        ID3D11DeviceContext_VSSetShaderResources(p->imm, 0, pass_p->vertex.srvs.num, srvs);
-    if (pass_p->vertex.samplers.num)
-        ID3D11DeviceContext_VSSetSamplers(p->imm, 0, pass_p->vertex.samplers.num, samplers);
-    if (pass_p->main.cbvs.num)
-        ID3D11DeviceContext_PSSetConstantBuffers(p->imm, 0, pass_p->main.cbvs.num, cbvs);
-    if (pass_p->main.srvs.num)
-        ID3D11DeviceContext_PSSetShaderResources(p->imm, 0, pass_p->main.srvs.num, srvs);
-    if (pass_p->main.samplers.num)
-        ID3D11DeviceContext_PSSetSamplers(p->imm, 0, pass_p->main.samplers.num, samplers);
     ID3D11DeviceContext_OMSetRenderTargetsAndUnorderedAccessViews(
         p->imm, 0, NULL, NULL, 1, pass_p->uavs.num, uavs, NULL);
+    if (!p->exclusive || p->fl <= D3D_FEATURE_LEVEL_9_3)
+        pl_d3d11_state_reset(gpu);
 }
 
 static void pass_run_compute(pl_gpu gpu, const struct pl_pass_run_params *params)
@@ -1221,22 +1794,29 @@ static void pass_run_compute(pl_gpu gpu, const struct pl_pass_run_params *params
         }
     }
 
-    ID3D11DeviceContext_CSSetShader(p->imm, pass_p->cs, NULL, 0);
+    if (!upload_cbufs(gpu, params))
+        return;
+
+    struct d3d_pipeline_state *state = &p->state;
+    if (state->cs != pass_p->cs) {
+        ID3D11DeviceContext_CSSetShader(p->imm, pass_p->cs, NULL, 0);
+        state->cs = pass_p->cs;
+    }
 
     ID3D11Buffer **cbvs = pass_p->cbv_arr;
     ID3D11ShaderResourceView **srvs = pass_p->srv_arr;
+    ID3D11Resource **srv_res = pass_p->srv_res_arr;
     ID3D11UnorderedAccessView **uavs = pass_p->uav_arr;
+    ID3D11Resource **uav_res = pass_p->uav_res_arr;
     ID3D11SamplerState **samplers = pass_p->sampler_arr;
 
-    fill_resources(gpu, pass, &pass_p->main, params, cbvs, srvs, samplers);
-    fill_uavs(pass, params, uavs);
+    fill_resources(gpu, pass, &pass_p->main, params, cbvs, srvs, srv_res, samplers);
+    fill_uavs(pass, params, uavs, uav_res);
+    bind_resources(gpu, pass, D3D_STAGE_CS, &pass_p->main);
 
-    if (pass_p->main.cbvs.num)
-        ID3D11DeviceContext_CSSetConstantBuffers(p->imm, 0, pass_p->main.cbvs.num, cbvs);
-    if (pass_p->main.srvs.num)
-        ID3D11DeviceContext_CSSetShaderResources(p->imm, 0, pass_p->main.srvs.num, srvs);
-    if (pass_p->main.samplers.num)
-        ID3D11DeviceContext_CSSetSamplers(p->imm, 0, pass_p->main.samplers.num, samplers);
+    // See `pass_run_raster`
+    for (int i = 0; i < pass_p->uavs.num; i++)
+        pl_d3d11_state_unbind(gpu, uav_res[i]);
     if (pass_p->uavs.num)
         ID3D11DeviceContext_CSSetUnorderedAccessViews(p->imm, 0, pass_p->uavs.num, uavs, NULL);
 
@@ -1244,23 +1824,13 @@ static void pass_run_compute(pl_gpu gpu, const struct pl_pass_run_params *params
                                          params->compute_groups[1],
                                          params->compute_groups[2]);
 
-    // Unbind everything
-    for (int i = 0; i < pass_p->main.cbvs.num; i++)
-        cbvs[i] = NULL;
-    for (int i = 0; i < pass_p->main.srvs.num; i++)
-        srvs[i] = NULL;
-    for (int i = 0; i < pass_p->main.samplers.num; i++)
-        samplers[i] = NULL;
+    // Unbind the outputs, see `pass_run_raster`
     for (int i = 0; i < pass_p->uavs.num; i++)
         uavs[i] = NULL;
-    if (pass_p->main.cbvs.num)
-        ID3D11DeviceContext_CSSetConstantBuffers(p->imm, 0, pass_p->main.cbvs.num, cbvs);
-    if (pass_p->main.srvs.num)
-        ID3D11DeviceContext_CSSetShaderResources(p->imm, 0, pass_p->main.srvs.num, srvs);
-    if (pass_p->main.samplers.num)
-        ID3D11DeviceContext_CSSetSamplers(p->imm, 0, pass_p->main.samplers.num, samplers);
     if (pass_p->uavs.num)
         ID3D11DeviceContext_CSSetUnorderedAccessViews(p->imm, 0, pass_p->uavs.num, uavs, NULL);
+    if (!p->exclusive || p->fl <= D3D_FEATURE_LEVEL_9_3)
+        pl_d3d11_state_reset(gpu);
 }
 
 void pl_d3d11_pass_run(pl_gpu gpu, const struct pl_pass_run_params *params)
@@ -1269,6 +1839,12 @@ void pl_d3d11_pass_run(pl_gpu gpu, const struct pl_pass_run_params *params)
     struct d3d11_ctx *ctx = p->ctx;
     pl_pass pass = params->pass;
 
+    // Passes created by `pl_d3d11_pass_create_async` may not be finished yet
+    bool ok;
+    pl_d3d11_pass_poll(gpu, pass, true, &ok);
+    if (!ok)
+        return;
+
     pl_d3d11_timer_start(gpu, params->timer);
 
     if (pass->params.type == PL_PASS_COMPUTE) {
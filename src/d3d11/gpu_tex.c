@@ -150,6 +150,13 @@ void pl_d3d11_tex_destroy(pl_gpu gpu, pl_tex tex)
     struct d3d11_ctx *ctx = p->ctx;
     struct pl_tex_d3d11 *tex_p = PL_PRIV(tex);
 
+    // Don't keep the texture alive through stale bindings
+    pl_d3d11_state_unbind(gpu, tex_p->res);
+    for (int i = 0; i < D3D_READBACK_SLOTS; i++) {
+        if (p->readback[i].tex == tex)
+            p->readback[i].tex = NULL;
+    }
+
     SAFE_RELEASE(tex_p->srv);
     SAFE_RELEASE(tex_p->rtv);
     SAFE_RELEASE(tex_p->uav);
@@ -317,7 +324,7 @@ error:
     return NULL;
 }
 
-pl_tex pl_d3d11_wrap(pl_gpu gpu, const struct pl_d3d11_wrap_params *params)
+static pl_tex d3d11_wrap(pl_gpu gpu, const struct pl_d3d11_wrap_params *params)
 {
     struct pl_gpu_d3d11 *p = PL_PRIV(gpu);
     struct d3d11_ctx *ctx = p->ctx;
@@ -463,6 +470,14 @@ pl_tex pl_d3d11_wrap(pl_gpu gpu, const struct pl_d3d11_wrap_params *params)
         goto error;
     }
 
+    // Swapchain images may be created with UAV usage even if the format
+    // doesn't support typed UAV stores, so only expose what actually works
+    if (tex->params.storable && !(tex->params.format->caps & PL_FMT_CAP_STORABLE)) {
+        tex->params.storable = false;
+        if (p->fl >= D3D_FEATURE_LEVEL_11_0)
+            tex->params.blit_src = tex->params.blit_dst = false;
+    }
+
     if (!tex_init(gpu, tex))
         goto error;
 
@@ -475,6 +490,16 @@ error:
     return NULL;
 }
 
+pl_tex pl_d3d11_wrap(pl_gpu gpu, const struct pl_d3d11_wrap_params *params)
+{
+    pl_d3d11_lock(gpu);
+    pl_tex tex = d3d11_wrap(gpu, params);
+    pl_d3d11_unlock(gpu);
+    if (tex)
+        pl_gpu_track_tex(gpu, tex);
+    return tex;
+}
+
 void pl_d3d11_tex_invalidate(pl_gpu gpu, pl_tex tex)
 {
     struct pl_gpu_d3d11 *p = PL_PRIV(gpu);
@@ -579,6 +604,7 @@ bool pl_d3d11_tex_upload(pl_gpu gpu, const struct pl_tex_transfer_params *params
     pl_tex tex = params->tex;
     struct pl_tex_d3d11 *tex_p = PL_PRIV(tex);
 
+    pl_d3d11_poll_readbacks(gpu, false);
     pl_d3d11_timer_start(gpu, params->timer);
 
     ID3D11DeviceContext_UpdateSubresource(p->imm, tex_p->res,
@@ -588,6 +614,225 @@ bool pl_d3d11_tex_upload(pl_gpu gpu, const struct pl_tex_transfer_params *params
     pl_d3d11_timer_end(gpu, params->timer);
     pl_d3d11_flush_message_queue(ctx, "After texture upload");
 
+    // UpdateSubresource copies the data immediately, so the transfer is
+    // already complete as far as the user is concerned
+    if (params->callback)
+        params->callback(params->priv);
+
+    return true;
+}
+
+// Copies `h * d` lines of `line_size` bytes out of a mapped staging texture,
+// starting at `src`
+static void copy_lines(char *dst, size_t row_pitch, size_t depth_pitch,
+                       const char *src, const D3D11_MAPPED_SUBRESOURCE *lock,
+                       size_t line_size, int h, int d)
+{
+    for (int z = 0; z < d; z++) {
+        for (int y = 0; y < h; y++) {
+            memcpy(dst + z * depth_pitch + y * row_pitch,
+                   src + z * lock->DepthPitch + y * lock->RowPitch,
+                   line_size);
+        }
+    }
+}
+
+// Copies the transfer of a busy readback slot out to its destination, and
+// fires its callback. Blocks if the transfer is still pending.
+static void readback_complete(pl_gpu gpu, struct d3d_readback *slot)
+{
+    struct pl_gpu_d3d11 *p = PL_PRIV(gpu);
+    struct d3d11_ctx *ctx = p->ctx;
+
+    D3D11_MAPPED_SUBRESOURCE lock;
+    D3D(ID3D11DeviceContext_Map(p->imm, slot->staging, 0, D3D11_MAP_READ, 0,
+                                &lock));
+    copy_lines(slot->dst, slot->row_pitch, slot->depth_pitch, lock.pData,
+               &lock, slot->line_size, slot->h, slot->d);
+    ID3D11DeviceContext_Unmap(p->imm, slot->staging, 0);
+
+error:
+    // Fire the callback even on failure, so users don't wait forever. The
+    // slot may be reused from within the callback, so release it first.
+    slot->busy = false;
+    slot->callback(slot->priv);
+}
+
+void pl_d3d11_poll_readbacks(pl_gpu gpu, bool wait)
+{
+    struct pl_gpu_d3d11 *p = PL_PRIV(gpu);
+
+    for (;;) {
+        struct d3d_readback *oldest = NULL;
+        for (int i = 0; i < D3D_READBACK_SLOTS; i++) {
+            struct d3d_readback *slot = &p->readback[i];
+            if (slot->busy && (!oldest || slot->id < oldest->id))
+                oldest = slot;
+        }
+
+        if (!oldest)
+            return;
+
+        if (!wait) {
+            BOOL done = FALSE;
+            HRESULT hr = ID3D11DeviceContext_GetData(p->imm,
+                (ID3D11Asynchronous *) oldest->query, &done, sizeof(done),
+                D3D11_ASYNC_GETDATA_DONOTFLUSH);
+            // On errors, let readback_complete deal with it
+            if (SUCCEEDED(hr) && !(hr == S_OK && done))
+                return;
+        }
+
+        readback_complete(gpu, oldest);
+    }
+}
+
+bool pl_d3d11_tex_poll(pl_gpu gpu, pl_tex tex, uint64_t timeout)
+{
+    struct pl_gpu_d3d11 *p = PL_PRIV(gpu);
+
+    // D3D11 tracks hazards on the texture itself, so it only counts as busy
+    // while an asynchronous download from it has not fired its callback yet.
+    // Since queries can't be waited on with a timeout, any nonzero timeout
+    // blocks until all pending downloads are done.
+    pl_d3d11_poll_readbacks(gpu, false);
+    for (int i = 0; i < D3D_READBACK_SLOTS; i++) {
+        const struct d3d_readback *slot = &p->readback[i];
+        if (!slot->busy || slot->tex != tex)
+            continue;
+        if (!timeout)
+            return true;
+        pl_d3d11_poll_readbacks(gpu, true);
+        break;
+    }
+
+    return false;
+}
+
+// Returns an idle readback slot for transferring `rc` out of `tex`, preferring
+// one whose staging texture already matches. If all slots are busy, this
+// blocks on the oldest transfer. Returns NULL on failure.
+static struct d3d_readback *get_readback_slot(pl_gpu gpu, pl_tex tex,
+                                              struct pl_rect3d rc)
+{
+    struct pl_gpu_d3d11 *p = PL_PRIV(gpu);
+    struct d3d11_ctx *ctx = p->ctx;
+    struct pl_tex_d3d11 *tex_p = PL_PRIV(tex);
+    int dims = pl_tex_params_dimension(tex->params);
+    DXGI_FORMAT fmt = fmt_to_dxgi(tex->params.format);
+    UINT w = pl_rect_w(rc), h = pl_rect_h(rc), d = pl_rect_d(rc);
+
+    struct d3d_readback *slot = NULL;
+    while (!slot) {
+        struct d3d_readback *oldest = NULL;
+        for (int i = 0; i < D3D_READBACK_SLOTS; i++) {
+            struct d3d_readback *s = &p->readback[i];
+            if (s->busy) {
+                if (!oldest || s->id < oldest->id)
+                    oldest = s;
+                continue;
+            }
+
+            if (s->staging && s->dims == dims && s->fmt == fmt &&
+                s->w == w && s->h == h && s->d == d)
+            {
+                return s;
+            }
+
+            // Otherwise, recycle the least recently used idle slot
+            if (!slot || s->id < slot->id)
+                slot = s;
+        }
+
+        if (!slot)
+            readback_complete(gpu, oldest);
+    }
+
+    SAFE_RELEASE(slot->staging);
+    if (!slot->query) {
+        D3D(ID3D11Device_CreateQuery(p->dev,
+            &(D3D11_QUERY_DESC) { D3D11_QUERY_EVENT }, &slot->query));
+    }
+
+    // Staging textures only need to be as large as the transferred region,
+    // otherwise they are created just like the ones in pl_d3d11_tex_create
+    switch (dims) {
+    case 1:;
+        D3D11_TEXTURE1D_DESC desc1d;
+        ID3D11Texture1D *tex1d;
+        ID3D11Texture1D_GetDesc(tex_p->staging1d, &desc1d);
+        desc1d.Width = w;
+        D3D(ID3D11Device_CreateTexture1D(p->dev, &desc1d, NULL, &tex1d));
+        slot->staging = (ID3D11Resource *) tex1d;
+        break;
+    case 2:;
+        D3D11_TEXTURE2D_DESC desc2d;
+        ID3D11Texture2D *tex2d;
+        ID3D11Texture2D_GetDesc(tex_p->staging2d, &desc2d);
+        desc2d.Width = w;
+        desc2d.Height = h;
+        D3D(ID3D11Device_CreateTexture2D(p->dev, &desc2d, NULL, &tex2d));
+        slot->staging = (ID3D11Resource *) tex2d;
+        break;
+    case 3:;
+        D3D11_TEXTURE3D_DESC desc3d;
+        ID3D11Texture3D *tex3d;
+        ID3D11Texture3D_GetDesc(tex_p->staging3d, &desc3d);
+        desc3d.Width = w;
+        desc3d.Height = h;
+        desc3d.Depth = d;
+        D3D(ID3D11Device_CreateTexture3D(p->dev, &desc3d, NULL, &tex3d));
+        slot->staging = (ID3D11Resource *) tex3d;
+        break;
+    default:
+        pl_unreachable();
+    }
+
+    slot->dims = dims;
+    slot->fmt = fmt;
+    slot->w = w;
+    slot->h = h;
+    slot->d = d;
+    return slot;
+
+error:
+    return NULL;
+}
+
+// Copies the texture into a readback slot and returns immediately. The data
+// is copied out to the user's pointer once the GPU is done with the copy, as
+// observed by pl_d3d11_poll_readbacks.
+static bool tex_download_async(pl_gpu gpu,
+                               const struct pl_tex_transfer_params *params)
+{
+    struct pl_gpu_d3d11 *p = PL_PRIV(gpu);
+    struct d3d11_ctx *ctx = p->ctx;
+    pl_tex tex = params->tex;
+    struct pl_tex_d3d11 *tex_p = PL_PRIV(tex);
+
+    struct d3d_readback *slot = get_readback_slot(gpu, tex, params->rc);
+    if (!slot)
+        return false;
+
+    pl_d3d11_timer_start(gpu, params->timer);
+
+    ID3D11DeviceContext_CopySubresourceRegion(p->imm, slot->staging, 0, 0, 0, 0,
+        tex_p->res, tex_subresource(tex), &pl_rect3d_to_box(params->rc));
+    ID3D11DeviceContext_End(p->imm, (ID3D11Asynchronous *) slot->query);
+
+    pl_d3d11_timer_end(gpu, params->timer);
+
+    slot->id = ++p->readback_id;
+    slot->busy = true;
+    slot->tex = tex;
+    slot->dst = params->ptr;
+    slot->row_pitch = params->row_pitch;
+    slot->depth_pitch = params->depth_pitch;
+    slot->line_size = pl_rect_w(params->rc) * tex->params.format->texel_size;
+    slot->callback = params->callback;
+    slot->priv = params->priv;
+
+    pl_d3d11_flush_message_queue(ctx, "After texture download");
     return true;
 }
 
@@ -601,6 +846,14 @@ bool pl_d3d11_tex_download(pl_gpu gpu, const struct pl_tex_transfer_params *para
     if (!tex_p->staging)
         return false;
 
+    // Retire finished transfers first, to free up their slots
+    pl_d3d11_poll_readbacks(gpu, false);
+
+    // Asynchronous downloads don't share the texture's own staging texture,
+    // so they never have to wait for the GPU
+    if (params->callback)
+        return tex_download_async(gpu, params);
+
     pl_d3d11_timer_start(gpu, params->timer);
 
     ID3D11DeviceContext_CopySubresourceRegion(p->imm,
@@ -612,17 +865,14 @@ bool pl_d3d11_tex_download(pl_gpu gpu, const struct pl_tex_transfer_params *para
     D3D(ID3D11DeviceContext_Map(p->imm, (ID3D11Resource *) tex_p->staging, 0,
                                 D3D11_MAP_READ, 0, &lock));
 
-    char *cdst = params->ptr;
-    char *csrc = lock.pData;
-    size_t line_size = pl_rect_w(params->rc) * tex->params.format->texel_size;
-    for (int z = 0; z < pl_rect_d(params->rc); z++) {
-        for (int y = 0; y < pl_rect_h(params->rc); y++) {
-            memcpy(cdst + z * params->depth_pitch + y * params->row_pitch,
-                   csrc + (params->rc.z0 + z) * lock.DepthPitch +
-                          (params->rc.y0 + y) * lock.RowPitch + params->rc.x0,
-                   line_size);
-        }
-    }
+    size_t texel_size = tex->params.format->texel_size;
+    const char *csrc = (const char *) lock.pData +
+                       params->rc.z0 * lock.DepthPitch +
+                       params->rc.y0 * lock.RowPitch +
+                       params->rc.x0 * texel_size;
+    copy_lines(params->ptr, params->row_pitch, params->depth_pitch, csrc, &lock,
+               pl_rect_w(params->rc) * texel_size, pl_rect_h(params->rc),
+               pl_rect_d(params->rc));
 
     ID3D11DeviceContext_Unmap(p->imm, (ID3D11Resource*)tex_p->staging, 0);
 
@@ -25,6 +25,13 @@ struct priv {
     struct d3d11_ctx *ctx;
     IDXGISwapChain *swapchain;
     pl_tex backbuffer;
+
+    // Frame latency waitable object, if enabled
+    IDXGISwapChain2 *swapchain2;
+    HANDLE latency_event;
+
+    // Last values returned by `pl_d3d11_swapchain_stats`
+    DXGI_FRAME_STATISTICS last_stats;
 };
 
 static void d3d11_sw_destroy(pl_swapchain sw)
@@ -32,6 +39,9 @@ static void d3d11_sw_destroy(pl_swapchain sw)
     struct priv *p = PL_PRIV(sw);
 
     pl_tex_destroy(sw->gpu, &p->backbuffer);
+    if (p->latency_event)
+        CloseHandle(p->latency_event);
+    SAFE_RELEASE(p->swapchain2);
     SAFE_RELEASE(p->swapchain);
     pl_free((void *) sw);
 }
@@ -42,7 +52,11 @@ static int d3d11_sw_latency(pl_swapchain sw)
     struct d3d11_ctx *ctx = p->ctx;
 
     UINT max_latency;
-    IDXGIDevice1_GetMaximumFrameLatency(ctx->dxgi_dev, &max_latency);
+    if (p->swapchain2) {
+        IDXGISwapChain2_GetMaximumFrameLatency(p->swapchain2, &max_latency);
+    } else {
+        IDXGIDevice1_GetMaximumFrameLatency(ctx->dxgi_dev, &max_latency);
+    }
     return max_latency;
 }
 
@@ -82,8 +96,11 @@ static bool d3d11_sw_resize(pl_swapchain sw, int *width, int *height)
             return false;
         }
 
-        D3D(IDXGISwapChain_ResizeBuffers(p->swapchain, 0, w, h,
-                                         DXGI_FORMAT_UNKNOWN, desc.Flags));
+        pl_d3d11_lock(sw->gpu);
+        HRESULT hr = IDXGISwapChain_ResizeBuffers(p->swapchain, 0, w, h,
+                                                  DXGI_FORMAT_UNKNOWN, desc.Flags);
+        pl_d3d11_unlock(sw->gpu);
+        D3D(hr);
     }
 
     *width = w;
@@ -108,6 +125,15 @@ static bool d3d11_sw_start_frame(pl_swapchain sw,
         return false;
     }
 
+    // Block until the swapchain can accept a new frame without exceeding the
+    // maximum frame latency. Time out eventually to avoid hanging forever,
+    // e.g. if the window was hidden
+    if (p->latency_event) {
+        DWORD res = WaitForSingleObjectEx(p->latency_event, 1000, TRUE);
+        if (res != WAIT_OBJECT_0)
+            PL_WARN(sw, "Timed out waiting for swapchain frame latency object");
+    }
+
     p->backbuffer = get_backbuffer(sw);
     if (!p->backbuffer)
         return false;
@@ -149,7 +175,10 @@ static void d3d11_sw_swap_buffers(pl_swapchain sw)
     struct d3d11_ctx *ctx = p->ctx;
 
     // Present can fail with a device removed error
-    D3D(IDXGISwapChain_Present(p->swapchain, 1, 0));
+    pl_d3d11_lock(sw->gpu);
+    HRESULT hr = IDXGISwapChain_Present(p->swapchain, 1, 0);
+    pl_d3d11_unlock(sw->gpu);
+    D3D(hr);
 
 error:
     return;
@@ -162,6 +191,40 @@ IDXGISwapChain *pl_d3d11_swapchain_unwrap(pl_swapchain sw)
     return p->swapchain;
 }
 
+bool pl_d3d11_swapchain_stats(pl_swapchain sw, struct pl_d3d11_swapchain_stats *stats)
+{
+    struct priv *p = PL_PRIV(sw);
+    DXGI_FRAME_STATISTICS fs = {0};
+    UINT last_present_count = 0;
+
+    HRESULT hr = IDXGISwapChain_GetFrameStatistics(p->swapchain, &fs);
+    if (FAILED(hr)) {
+        // DXGI_ERROR_FRAME_STATISTICS_DISJOINT is expected after e.g. mode
+        // changes, so just restart missed vblank counting from scratch
+        p->last_stats = (DXGI_FRAME_STATISTICS) {0};
+        return false;
+    }
+    IDXGISwapChain_GetLastPresentCount(p->swapchain, &last_present_count);
+
+    uint64_t missed = 0;
+    if (p->last_stats.SyncRefreshCount) {
+        uint64_t vblanks = fs.SyncRefreshCount - p->last_stats.SyncRefreshCount;
+        uint64_t frames = fs.PresentCount - p->last_stats.PresentCount;
+        missed = vblanks > frames ? vblanks - frames : 0;
+    }
+    p->last_stats = fs;
+
+    *stats = (struct pl_d3d11_swapchain_stats) {
+        .present_count = fs.PresentCount,
+        .present_refresh_count = fs.PresentRefreshCount,
+        .sync_refresh_count = fs.SyncRefreshCount,
+        .sync_qpc_time = fs.SyncQPCTime.QuadPart,
+        .last_present_count = last_present_count,
+        .missed_vblanks = missed,
+    };
+    return true;
+}
+
 static struct pl_sw_fns d3d11_swapchain = {
     .destroy      = d3d11_sw_destroy,
     .latency      = d3d11_sw_latency,
@@ -193,8 +256,12 @@ static HRESULT create_swapchain_1_2(struct d3d11_ctx *ctx,
         desc.BufferUsage |= DXGI_USAGE_UNORDERED_ACCESS;
 
     if (flip) {
-        UINT max_latency;
-        IDXGIDevice1_GetMaximumFrameLatency(ctx->dxgi_dev, &max_latency);
+        UINT max_latency = params->max_latency;
+        if (max_latency) {
+            desc.Flags |= DXGI_SWAP_CHAIN_FLAG_FRAME_LATENCY_WAITABLE_OBJECT;
+        } else {
+            IDXGIDevice1_GetMaximumFrameLatency(ctx->dxgi_dev, &max_latency);
+        }
 
         // Make sure we have at least enough buffers to allow `max_latency`
         // frames in-flight at once, plus one frame for the frontbuffer
@@ -257,6 +324,9 @@ static HRESULT create_swapchain_1_1(struct d3d11_ctx *ctx,
         .Flags = params->flags,
     };
 
+    if (ID3D11Device_GetFeatureLevel(ctx->dev) >= D3D_FEATURE_LEVEL_11_0)
+        desc.BufferUsage |= DXGI_USAGE_UNORDERED_ACCESS;
+
     return IDXGIFactory1_CreateSwapChain(factory, (IUnknown *) ctx->dev, &desc,
                                          swapchain_out);
 }
@@ -374,6 +444,27 @@ pl_swapchain pl_d3d11_create_swapchain(pl_d3d11 d3d11,
         PL_INFO(gpu, "Using bitblt-model presentation");
     }
 
+    if (scd.Flags & DXGI_SWAP_CHAIN_FLAG_FRAME_LATENCY_WAITABLE_OBJECT) {
+        D3D(IDXGISwapChain_QueryInterface(p->swapchain, &IID_IDXGISwapChain2,
+                                          (void **) &p->swapchain2));
+        if (params->max_latency) {
+            D3D(IDXGISwapChain2_SetMaximumFrameLatency(p->swapchain2,
+                                                       params->max_latency));
+        }
+
+        p->latency_event = IDXGISwapChain2_GetFrameLatencyWaitableObject(p->swapchain2);
+        if (!p->latency_event) {
+            PL_ERR(gpu, "Failed getting swapchain frame latency object");
+            goto error;
+        }
+
+        PL_INFO(gpu, "Using waitable swapchain with maximum frame latency %d",
+                d3d11_sw_latency(sw));
+    } else if (params->max_latency && !params->swapchain) {
+        PL_WARN(gpu, "Frame latency waitable object not supported by this "
+                "swapchain, ignoring `max_latency`");
+    }
+
     success = true;
 error:
     if (!success) {
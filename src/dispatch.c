@@ -15,46 +15,137 @@
  * License along with libplacebo. If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <errno.h>
+#include <stdio.h>
+
+#ifndef PL_HAVE_WIN32
+#include <sys/mman.h>
+#endif
+
 #include "common.h"
+#include "cache.h"
 #include "log.h"
 #include "shaders.h"
 #include "dispatch.h"
 #include "gpu.h"
+#include "pl_clock.h"
 #include "pl_thread.h"
+#include "pl_thread_pool.h"
 
-// Maximum number of passes to keep around at once. If full, passes older than
-// MIN_AGE are evicted to make room. (Failing that, the cache size doubles)
+// Default maximum number of passes to keep around at once. If full, the least
+// recently used passes are evicted to make room, except for passes used within
+// the last MIN_AGE frames (which are always kept)
 #define MAX_PASSES 100
 #define MIN_AGE 10
 
+// Size and maximum number of the segments of the shared ring that the uniform
+// data of small passes is streamed through, if supported by the GPU
+#define UBO_SEGMENT_SIZE (64 * 1024)
+#define UBO_MAX_SEGMENTS 16
+
 enum {
     TMP_PRELUDE,   // GLSL version, global definitions, etc.
     TMP_MAIN,      // main GLSL shader body
+    TMP_FOOTER,    // main() function, following the shader text
     TMP_VERT_HEAD, // vertex shader inputs/outputs
     TMP_VERT_BODY, // vertex shader body
     TMP_COUNT,
 };
 
 struct pl_dispatch {
-    pl_mutex lock;
+    pl_mutex lock; // protects the pass cache and everything not listed below
     pl_log log;
     pl_gpu gpu;
-    uint8_t current_ident;
-    uint8_t current_index;
-    bool dynamic_constants;
+    bool compile_only;
+    uint64_t frame; // for pass age tracking
+
+    // pass cache budget, 0 = unlimited
     int max_passes;
+    size_t max_pass_bytes;
+    bool warned_budget;
 
     void (*info_callback)(void *, const struct pl_dispatch_info *);
     void *info_priv;
 
+    // Shader and scratch buffer pools, and the state handed out to new
+    // shaders, protected by `pool_lock` instead of `lock`. These are
+    // unparented, since they're grown without holding `lock` (which guards
+    // allocations parented to `dp`)
+    pl_mutex pool_lock;
+    uint8_t current_ident;
+    uint8_t current_index;
     PL_ARRAY(pl_shader) shaders;                // to avoid re-allocations
-    PL_ARRAY(struct pass *) passes;             // compiled passes
+    PL_ARRAY(pl_str *) scratch;                 // arrays of TMP_COUNT pl_str
+    PL_ARRAY(struct const_stat) const_stats;    // see `pl_dispatch_const_dynamic`
+    uint64_t const_frame;                       // frame counter for `const_stats`
+    struct pass *lru_head, *lru_tail;           // compiled passes, MRU first
+    struct pass **pass_table;                   // hash table of compiled passes
+    int pass_table_size;                        // number of buckets (power of 2)
+    int num_passes;
+    size_t pass_bytes;                          // estimated size of all passes
     PL_ARRAY(struct cached_pass) cached_passes; // not-yet-compiled passes
+    PL_ARRAY(struct ubo_segment) ubo_ring;      // see `ubo_ring_write`
+    int ubo_ring_idx;                           // segment currently filled
+    size_t ubo_ring_pos;                        // next free offset inside it
+    PL_ARRAY(struct ubo_fence) ubo_fences;      // pending, oldest first
+    uint64_t ubo_done_frame;                    // all frames before completed
+    bool ubo_written;                           // ring used in current frame
+    bool ubo_poll;                              // no fences, poll segments
+
+    // Shader parameters set by `pl_dispatch_mark_*` and
+    // `pl_dispatch_async_compile`. These are atomic, since they're read by
+    // `pl_dispatch_begin` without holding `lock`
+    atomic_bool dynamic_constants;
+    atomic_bool half_precision;
+    atomic_bool fast_transfer;
+    atomic_bool async;
+
+    // for asynchronous pass compilation
+    bool draining;                              // `drain_job` is processing `jobs`
+    bool thread_exit;
+    pl_job drain_job;
+    pl_cond cond;                               // signalled on job updates
+    PL_ARRAY(struct compile_job *) jobs;        // queued compile jobs
+    struct compile_job *cur_job;                // job currently compiling
+    uint64_t num_skipped;
+
+    // CPU time spent per `enum pl_render_cpu_section`, see `pl_prof`
+    uint64_t cpu_times[PL_RENDER_CPU_COUNT];
+
+    // for the persistent program cache file
+    FILE *cache_file;
+    char *cache_path;
+    size_t cache_size;                          // current size of the file
+    size_t cache_max_size;
+    uint64_t cache_clock;                       // for LRU tracking
+    PL_ARRAY(struct cache_record) cache_index;  // records stored in the file
+    int *cache_table;                           // hash table of `cache_index`
+    int cache_table_size;                       // number of buckets (power of 2)
+    PL_ARRAY(struct cache_map) cache_maps;      // kept until destruction
+
+    // for timeline trace recording
+    FILE *trace_file;
+    uint64_t trace_start;                       // clock value at ts = 0
+    uint64_t trace_seq;                         // for GPU event IDs
+    bool trace_empty;                           // no events written yet
+};
 
-    // temporary buffers to help avoid re_allocations during pass creation
-    pl_str tmp[TMP_COUNT];
+// Change history of a single shader constant, identified by its name, shader
+// step, and the number of such constants preceding it in the same frame
+struct const_stat {
+    uint64_t key;
+    uint64_t value;     // hash of the last seen value
+    uint64_t frame;     // frame in which this was last seen
+    uint8_t history;    // one bit per observation, set if the value changed
+    uint8_t uses;       // uses of this name in `frame` (for occurrence 0 only)
+    bool seen;          // `value` is valid
+    bool dynamic;
 };
 
+// Maximum number of tracked constants, and of occurrences per name
+#define MAX_CONST_STATS 256
+#define MAX_CONST_USES  16
+
 enum pass_var_type {
     PASS_VAR_NONE = 0,
     PASS_VAR_GLOBAL, // regular/global uniforms
@@ -73,7 +164,23 @@ struct pass_var {
 struct pass {
     uint64_t signature; // as returned by pl_shader_signature
     pl_pass pass;
-    int last_index;
+    uint64_t last_frame;
+    size_t size; // estimated memory footprint, for the cache budget
+
+    // for the pass cache
+    struct pass *hash_next;
+    struct pass *lru_prev, *lru_next;
+
+    // if non-NULL, `pass` is still being compiled asynchronously
+    struct compile_job *job;
+
+    // hash of the program retrieved from the `pl_gpu_cache`, if any, to
+    // avoid redundantly storing it again after compilation
+    uint64_t cache_hash;
+
+    // if true, `pass` was created by `pl_pass_create_async` and is still
+    // being compiled by the driver
+    bool compiling;
 
     // contains cached data and update metadata, same order as pl_shader
     struct pass_var *vars;
@@ -82,13 +189,31 @@ struct pass {
     // for uniform buffer updates
     struct pl_shader_desc ubo_desc; // temporary
     int ubo_index;
-    pl_buf ubo;
+    pl_buf ubo;                // dedicated UBO, unless `ubo_stream` is set
+    bool ubo_stream;           // streamed through `pl_dispatch.ubo_ring`
+    size_t ubo_size;
+    uint8_t *ubo_data;         // host copy of the UBO contents
+    size_t ubo_dirty_start;    // range of `ubo_data` that needs uploading
+    size_t ubo_dirty_end;
 
     // Cached pl_pass_run_params. This will also contain mutable allocations
     // for the push constants, descriptor bindings (including the binding for
     // the UBO pre-filled), vertex array and variable updates
     struct pl_pass_run_params run_params;
 
+    // ring of persistent vertex buffers for the quad, and a host copy of the
+    // contents of the current one
+    pl_buf vbos[4];
+    int vbo_idx;
+    uint8_t *vbo_data;
+
+    // ring of buffers for per-instance data uploaded from host memory
+    pl_buf instance_bufs[4];
+    int instance_idx;
+
+    // submission times of pending `timer` results, for trace recording
+    PL_ARRAY(uint64_t) trace_submits;
+
     // for pl_dispatch_info
     pl_timer timer;
     uint64_t ts_last;
@@ -98,18 +223,462 @@ struct pass {
     int ts_idx;
 };
 
+struct ubo_segment {
+    pl_buf buf;
+    uint64_t frame; // `pl_dispatch.frame` this was last written in
+};
+
+// Fence covering the GPU work of all frames up to and including `frame`
+struct ubo_fence {
+    void *fence;
+    uint64_t frame;
+};
+
 struct cached_pass {
     uint64_t signature;
     const uint8_t *cached_program;
     size_t cached_program_len;
+    bool mapped; // `cached_program` points into a cache file mapping
+};
+
+struct cache_record {
+    uint64_t signature;
+    size_t offset; // offset of the program data inside the cache file
+    size_t size;
+    uint64_t last_use;
+    int hash_next; // index of the next record in the same bucket, or -1
+};
+
+struct cache_map {
+    void *data;
+    size_t size;
 };
 
+struct compile_job {
+    struct pass *pass; // set to NULL if the pass gets destroyed meanwhile
+    struct pl_pass_params params; // deep copy, owned by the job
+};
+
+static struct pass **pass_bucket(pl_dispatch dp, uint64_t sig)
+{
+    // Signatures are already hashes, so we can use the low bits directly
+    return &dp->pass_table[sig & (dp->pass_table_size - 1)];
+}
+
+static struct pass *pass_lookup(pl_dispatch dp, uint64_t sig)
+{
+    if (!dp->pass_table_size)
+        return NULL;
+
+    for (struct pass *p = *pass_bucket(dp, sig); p; p = p->hash_next) {
+        if (p->signature == sig)
+            return p;
+    }
+
+    return NULL;
+}
+
+static void lru_unlink(pl_dispatch dp, struct pass *pass)
+{
+    if (pass->lru_prev) {
+        pass->lru_prev->lru_next = pass->lru_next;
+    } else {
+        dp->lru_head = pass->lru_next;
+    }
+
+    if (pass->lru_next) {
+        pass->lru_next->lru_prev = pass->lru_prev;
+    } else {
+        dp->lru_tail = pass->lru_prev;
+    }
+
+    pass->lru_prev = pass->lru_next = NULL;
+}
+
+static void lru_push_front(pl_dispatch dp, struct pass *pass)
+{
+    pass->lru_prev = NULL;
+    pass->lru_next = dp->lru_head;
+    if (dp->lru_head) {
+        dp->lru_head->lru_prev = pass;
+    } else {
+        dp->lru_tail = pass;
+    }
+    dp->lru_head = pass;
+}
+
+// Mark a pass as used in the current frame
+static void pass_touch(pl_dispatch dp, struct pass *pass)
+{
+    pass->last_frame = dp->frame;
+    if (dp->lru_head != pass) {
+        lru_unlink(dp, pass);
+        lru_push_front(dp, pass);
+    }
+}
+
+static void pass_insert(pl_dispatch dp, struct pass *pass)
+{
+    if (dp->num_passes >= dp->pass_table_size) {
+        // Grow and rehash the table
+        int new_size = PL_MAX(dp->pass_table_size * 2, 64);
+        pl_free(dp->pass_table);
+        dp->pass_table = pl_calloc_ptr(dp, new_size, dp->pass_table);
+        dp->pass_table_size = new_size;
+        for (struct pass *p = dp->lru_head; p; p = p->lru_next) {
+            struct pass **bucket = pass_bucket(dp, p->signature);
+            p->hash_next = *bucket;
+            *bucket = p;
+        }
+    }
+
+    struct pass **bucket = pass_bucket(dp, pass->signature);
+    pass->hash_next = *bucket;
+    *bucket = pass;
+    pass->last_frame = dp->frame;
+    lru_push_front(dp, pass);
+    dp->num_passes++;
+    dp->pass_bytes += pass->size;
+}
+
+static void pass_remove(pl_dispatch dp, struct pass *pass)
+{
+    struct pass **link = pass_bucket(dp, pass->signature);
+    while (*link != pass)
+        link = &(*link)->hash_next;
+    *link = pass->hash_next;
+    lru_unlink(dp, pass);
+    dp->num_passes--;
+    dp->pass_bytes -= pass->size;
+}
+
+static void pass_update_size(pl_dispatch dp, struct pass *pass, size_t size)
+{
+    dp->pass_bytes += size - pass->size;
+    pass->size = size;
+}
+
+// Timeline tracks, used as the thread IDs of trace events
+enum trace_track {
+    TRACE_DISPATCH = 1, // generation and submission of passes
+    TRACE_COMPILER,     // asynchronous pass compilation
+    TRACE_GPU,          // GPU execution of passes
+};
+
+static void trace_write_str(FILE *f, const char *str)
+{
+    fputc('"', f);
+    for (; *str; str++) {
+        if (*str == '"' || *str == '\\') {
+            fprintf(f, "\\%c", *str);
+        } else if ((unsigned char) *str < 0x20) {
+            fprintf(f, "\\u%04x", (unsigned) *str);
+        } else {
+            fputc(*str, f);
+        }
+    }
+    fputc('"', f);
+}
+
+// Writes the common prefix of a trace event, up to and including the name
+static void trace_event(pl_dispatch dp, const char *ph, enum trace_track tid,
+                        const char *cat, const char *name, uint64_t ts)
+{
+    FILE *f = dp->trace_file;
+    double ts_us = ((double) ts - (double) dp->trace_start) / 1e3;
+    fprintf(f, "%s{\"ph\":\"%s\",\"pid\":1,\"tid\":%d,\"cat\":\"%s\","
+            "\"ts\":%.3f,\"name\":", dp->trace_empty ? "" : ",\n", ph, (int) tid,
+            cat, PL_MAX(ts_us, 0.0));
+    trace_write_str(f, name);
+    dp->trace_empty = false;
+}
+
+static void trace_slice(pl_dispatch dp, enum trace_track tid, const char *cat,
+                        const char *name, uint64_t signature,
+                        uint64_t start, uint64_t end)
+{
+    if (!dp->trace_file)
+        return;
+
+    trace_event(dp, "X", tid, cat, name, start);
+    fprintf(dp->trace_file, ",\"dur\":%.3f,\"args\":{\"frame\":%"PRIu64","
+            "\"signature\":\"0x%"PRIx64"\"}}", (end - start) / 1e3,
+            dp->frame, signature);
+}
+
+// Records the GPU execution of a pass. GPU timers only measure durations, so
+// the interval is placed at the time of submission, as an asynchronous slice
+// (since these may overlap).
+static void trace_gpu(pl_dispatch dp, struct pass *pass, const char *name,
+                      uint64_t duration)
+{
+    uint64_t submitted;
+    if (!dp->trace_file || !pass->trace_submits.num)
+        return;
+
+    submitted = pass->trace_submits.elem[0];
+    PL_ARRAY_REMOVE_AT(pass->trace_submits, 0);
+
+    uint64_t id = dp->trace_seq++;
+    trace_event(dp, "b", TRACE_GPU, "gpu", name, submitted);
+    fprintf(dp->trace_file, ",\"id\":%"PRIu64",\"args\":{\"frame\":%"PRIu64","
+            "\"signature\":\"0x%"PRIx64"\"}}", id, dp->frame, pass->signature);
+    trace_event(dp, "e", TRACE_GPU, "gpu", name, submitted + duration);
+    fprintf(dp->trace_file, ",\"id\":%"PRIu64"}", id);
+}
+
+static void trace_close(pl_dispatch dp)
+{
+    if (!dp->trace_file)
+        return;
+
+    fprintf(dp->trace_file, "\n]\n");
+    fclose(dp->trace_file);
+    dp->trace_file = NULL;
+}
+
+bool pl_dispatch_trace_begin(pl_dispatch dp, const char *path)
+{
+    pl_mutex_lock(&dp->lock);
+    trace_close(dp);
+
+    dp->trace_file = fopen(path, "wb");
+    if (!dp->trace_file) {
+        PL_ERR(dp, "Failed opening trace file '%s': %s", path, strerror(errno));
+        pl_mutex_unlock(&dp->lock);
+        return false;
+    }
+
+    dp->trace_start = pl_clock_now();
+    dp->trace_empty = true;
+    for (struct pass *pass = dp->lru_head; pass; pass = pass->lru_next)
+        pass->trace_submits.num = 0;
+
+    static const struct { enum trace_track tid; const char *name; } tracks[] = {
+        { TRACE_DISPATCH,   "dispatch" },
+        { TRACE_COMPILER,   "async compilation" },
+        { TRACE_GPU,        "GPU" },
+    };
+
+    fprintf(dp->trace_file, "[\n");
+    for (int i = 0; i < PL_ARRAY_SIZE(tracks); i++) {
+        trace_event(dp, "M", tracks[i].tid, "__metadata", "thread_name", 0);
+        fprintf(dp->trace_file, ",\"args\":{\"name\":\"%s\"}}", tracks[i].name);
+    }
+
+    pl_mutex_unlock(&dp->lock);
+    return true;
+}
+
+void pl_dispatch_trace_end(pl_dispatch dp)
+{
+    pl_mutex_lock(&dp->lock);
+    trace_close(dp);
+    pl_mutex_unlock(&dp->lock);
+}
+
+// Size of the segments of `pl_dispatch.ubo_ring`, or 0 if the GPU can't bind
+// sub-ranges of persistently mapped uniform buffers
+static size_t ubo_segment_size(pl_gpu gpu)
+{
+    const struct pl_gpu_limits *limits = &gpu->limits;
+    if (!limits->align_ubo_offset)
+        return 0;
+
+    size_t size = PL_MIN(limits->max_ubo_size, UBO_SEGMENT_SIZE);
+    return PL_MIN(size, limits->max_mapped_size);
+}
+
+// Retires the fences of completed frames. If `wait` is set, this blocks until
+// the work of `frame` is done. Returns whether `frame` is known to be complete.
+static bool ubo_frame_done(pl_dispatch dp, uint64_t frame, bool wait)
+{
+    const struct pl_gpu_fns *impl = PL_PRIV(dp->gpu);
+    while (dp->ubo_fences.num) {
+        const struct ubo_fence *f = &dp->ubo_fences.elem[0];
+        uint64_t timeout = wait && f->frame <= frame ? UINT64_MAX : 0;
+        if (!impl->fence_wait(dp->gpu, f->fence, timeout))
+            break;
+        dp->ubo_done_frame = f->frame + 1;
+        impl->fence_destroy(dp->gpu, f->fence);
+        PL_ARRAY_REMOVE_AT(dp->ubo_fences, 0);
+    }
+
+    return frame < dp->ubo_done_frame;
+}
+
+// Marks the end of the current frame's use of the ring, called with the lock
+static void ubo_ring_end_frame(pl_dispatch dp)
+{
+    const struct pl_gpu_fns *impl = PL_PRIV(dp->gpu);
+    if (dp->ubo_written && !dp->ubo_poll) {
+        void *fence = impl->fence_create ? impl->fence_create(dp->gpu) : NULL;
+        if (fence) {
+            PL_ARRAY_APPEND(dp, dp->ubo_fences, (struct ubo_fence) {
+                .fence = fence,
+                .frame = dp->frame,
+            });
+        } else {
+            PL_DEBUG(dp, "GPU can't track frame completion, polling UBO "
+                     "ring segments instead");
+            dp->ubo_poll = true;
+        }
+    }
+
+    dp->ubo_written = false;
+    ubo_frame_done(dp, 0, false);
+}
+
+static bool ubo_segment_busy(pl_dispatch dp, const struct ubo_segment *seg)
+{
+    if (dp->ubo_poll)
+        return pl_buf_poll(dp->gpu, seg->buf, 0);
+    return !ubo_frame_done(dp, seg->frame, false);
+}
+
+static void ubo_segment_wait(pl_dispatch dp, const struct ubo_segment *seg)
+{
+    if (dp->ubo_poll || seg->frame == dp->frame) {
+        // No fence covers the current frame yet
+        while (pl_buf_poll(dp->gpu, seg->buf, UINT64_MAX))
+            ;
+        return;
+    }
+
+    ubo_frame_done(dp, seg->frame, true);
+}
+
+// Streams the uniform data of a pass into the shared ring, returning the
+// segment (and offset inside it) to bind, or NULL on failure.
+//
+// Each segment is written to directly through its persistent mapping, and
+// only once between two wrap-arounds. Buffer hazards are tracked for whole
+// buffers, so instead of synchronizing every write, each segment remembers
+// the frame it was last written in. It's only reused once the fence created
+// for that frame by `pl_dispatch_reset_frame` has signalled, and otherwise the
+// ring grows by another segment. (Polling the segment itself would force a
+// flush on some backends whenever it's still in use.)
+static pl_buf ubo_ring_write(pl_dispatch dp, const void *data, size_t size,
+                             size_t *out_offset)
+{
+    pl_gpu gpu = dp->gpu;
+    const size_t seg_size = ubo_segment_size(gpu);
+    size_t pos = PL_ALIGN(dp->ubo_ring_pos, gpu->limits.align_ubo_offset);
+
+    if (!dp->ubo_ring.num || pos + size > seg_size) {
+        int idx = 0;
+        if (dp->ubo_ring.num)
+            idx = (dp->ubo_ring_idx + 1) % dp->ubo_ring.num;
+
+        if (!dp->ubo_ring.num || ubo_segment_busy(dp, &dp->ubo_ring.elem[idx])) {
+            pl_buf buf = NULL;
+            if (dp->ubo_ring.num < UBO_MAX_SEGMENTS) {
+                buf = pl_buf_create(gpu, pl_buf_params(
+                    .size = seg_size,
+                    .uniform = true,
+                    .host_mapped = true,
+                    .debug_tag = PL_DEBUG_TAG,
+                ));
+            }
+
+            if (buf) {
+                // Insert it right before the oldest segment
+                PL_ARRAY_INSERT_AT(dp, dp->ubo_ring, idx, (struct ubo_segment) {
+                    .buf = buf,
+                });
+            } else if (dp->ubo_ring.num) {
+                PL_TRACE(dp, "UBO ring exhausted, waiting for the oldest segment");
+                ubo_segment_wait(dp, &dp->ubo_ring.elem[idx]);
+            } else {
+                return NULL;
+            }
+        }
+
+        dp->ubo_ring_idx = idx;
+        pos = 0;
+    }
+
+    struct ubo_segment *seg = &dp->ubo_ring.elem[dp->ubo_ring_idx];
+    memcpy(seg->buf->data + pos, data, size);
+    seg->frame = dp->frame;
+    dp->ubo_written = true;
+    dp->ubo_ring_pos = pos + size;
+    *out_offset = pos;
+    return seg->buf;
+}
+
+// Uploads the UBO contents accumulated by `update_pass_var` and binds the
+// UBO. Dedicated UBOs are only updated in the range that changed, using a
+// single buffer write to avoid unnecessary synchronization overhead.
+static bool update_ubo(pl_dispatch dp, struct pass *pass)
+{
+    struct pl_desc_binding *db = &pass->run_params.desc_bindings[pass->ubo_index];
+
+    if (pass->ubo_stream) {
+        size_t offset;
+        pl_buf seg = ubo_ring_write(dp, pass->ubo_data, pass->ubo_size, &offset);
+        if (seg) {
+            db->object = seg;
+            db->buf_offset = offset;
+            db->buf_size = pass->ubo_size;
+            return true;
+        }
+
+        // Fall back to a dedicated UBO for this pass
+        pass->ubo_stream = false;
+        pass->ubo_dirty_start = 0;
+        pass->ubo_dirty_end = pass->ubo_size;
+    }
+
+    if (!pass->ubo) {
+        pass->ubo = pl_buf_create(dp->gpu, pl_buf_params(
+            .size = pass->ubo_size,
+            .uniform = true,
+            .host_writable = true,
+            .debug_tag = PL_DEBUG_TAG,
+        ));
+
+        if (!pass->ubo) {
+            PL_ERR(dp, "Failed creating uniform buffer for dispatch");
+            return false;
+        }
+    }
+
+    const size_t start = pass->ubo_dirty_start, end = pass->ubo_dirty_end;
+    if (end > start) {
+        pl_buf_write(dp->gpu, pass->ubo, start, pass->ubo_data + start,
+                     end - start);
+        pass->ubo_dirty_start = pass->ubo_size;
+        pass->ubo_dirty_end = 0;
+    }
+
+    *db = (struct pl_desc_binding) { .object = pass->ubo };
+    return true;
+}
+
 static void pass_destroy(pl_dispatch dp, struct pass *pass)
 {
     if (!pass)
         return;
 
+    if (pass->job) {
+        // Cancel the pending compile job, or detach it if it's in progress
+        struct compile_job *job = pass->job;
+        job->pass = NULL;
+        for (int i = 0; i < dp->jobs.num; i++) {
+            if (dp->jobs.elem[i] == job) {
+                PL_ARRAY_REMOVE_AT(dp->jobs, i);
+                pl_free(job);
+                break;
+            }
+        }
+    }
+
     pl_buf_destroy(dp->gpu, &pass->ubo);
+    for (int i = 0; i < PL_ARRAY_SIZE(pass->vbos); i++)
+        pl_buf_destroy(dp->gpu, &pass->vbos[i]);
+    for (int i = 0; i < PL_ARRAY_SIZE(pass->instance_bufs); i++)
+        pl_buf_destroy(dp->gpu, &pass->instance_bufs[i]);
     pl_pass_destroy(dp->gpu, &pass->pass);
     pl_timer_destroy(dp->gpu, &pass->timer);
     pl_free(pass);
@@ -119,6 +688,8 @@ pl_dispatch pl_dispatch_create(pl_log log, pl_gpu gpu)
 {
     struct pl_dispatch *dp = pl_zalloc_ptr(NULL, dp);
     pl_mutex_init(&dp->lock);
+    pl_mutex_init(&dp->pool_lock);
+    pl_cond_init(&dp->cond);
     dp->log = log;
     dp->gpu = gpu;
     dp->max_passes = MAX_PASSES;
@@ -132,11 +703,47 @@ void pl_dispatch_destroy(pl_dispatch *ptr)
     if (!dp)
         return;
 
-    for (int i = 0; i < dp->passes.num; i++)
-        pass_destroy(dp, dp->passes.elem[i]);
+    pl_mutex_lock(&dp->lock);
+    dp->thread_exit = true;
+    pl_mutex_unlock(&dp->lock);
+    pl_job_cancel(&dp->drain_job);
+
+    while (dp->lru_head) {
+        struct pass *pass = dp->lru_head;
+        dp->lru_head = pass->lru_next;
+        pass_destroy(dp, pass);
+    }
+    const struct pl_gpu_fns *impl = PL_PRIV(dp->gpu);
+    for (int i = 0; i < dp->ubo_fences.num; i++) {
+        impl->fence_wait(dp->gpu, dp->ubo_fences.elem[i].fence, UINT64_MAX);
+        impl->fence_destroy(dp->gpu, dp->ubo_fences.elem[i].fence);
+    }
+    for (int i = 0; i < dp->ubo_ring.num; i++)
+        pl_buf_destroy(dp->gpu, &dp->ubo_ring.elem[i].buf);
+    pl_free(dp->ubo_ring.elem);
     for (int i = 0; i < dp->shaders.num; i++)
         pl_shader_free(&dp->shaders.elem[i]);
-
+    pl_free(dp->shaders.elem);
+    pl_free(dp->const_stats.elem);
+    for (int i = 0; i < dp->scratch.num; i++) {
+        pl_str *scratch = dp->scratch.elem[i];
+        for (int n = 0; n < TMP_COUNT; n++)
+            pl_free(scratch[n].buf);
+        pl_free(scratch);
+    }
+    pl_free(dp->scratch.elem);
+    pl_assert(!dp->jobs.num);
+
+    trace_close(dp);
+    if (dp->cache_file)
+        fclose(dp->cache_file);
+#ifndef PL_HAVE_WIN32
+    for (int i = 0; i < dp->cache_maps.num; i++)
+        munmap(dp->cache_maps.elem[i].data, dp->cache_maps.elem[i].size);
+#endif
+
+    pl_cond_destroy(&dp->cond);
+    pl_mutex_destroy(&dp->pool_lock);
     pl_mutex_destroy(&dp->lock);
     pl_free(dp);
     *ptr = NULL;
@@ -144,30 +751,127 @@ void pl_dispatch_destroy(pl_dispatch *ptr)
 
 pl_shader pl_dispatch_begin_ex(pl_dispatch dp, bool unique)
 {
-    pl_mutex_lock(&dp->lock);
+    pl_mutex_lock(&dp->pool_lock);
 
     struct pl_shader_params params = {
         .id = unique ? dp->current_ident++ : 0,
         .gpu = dp->gpu,
         .index = dp->current_index,
-        .dynamic_constants = dp->dynamic_constants,
+        .dynamic_constants = atomic_load_explicit(&dp->dynamic_constants,
+                                                  memory_order_relaxed),
+        .async_luts = atomic_load_explicit(&dp->async, memory_order_relaxed),
+        .half_precision = atomic_load_explicit(&dp->half_precision,
+                                               memory_order_relaxed),
+        .fast_transfer = atomic_load_explicit(&dp->fast_transfer,
+                                              memory_order_relaxed),
     };
 
     pl_shader sh = NULL;
     PL_ARRAY_POP(dp->shaders, &sh);
-    pl_mutex_unlock(&dp->lock);
+    pl_mutex_unlock(&dp->pool_lock);
 
     if (sh) {
         sh->res.params = params;
-        return sh;
+    } else {
+        sh = pl_shader_alloc(dp->log, &params);
     }
 
-    return pl_shader_alloc(dp->log, &params);
+    sh->dp = dp;
+    return sh;
+}
+
+static struct const_stat *const_stat_get(pl_dispatch dp, uint64_t key)
+{
+    for (int i = 0; i < dp->const_stats.num; i++) {
+        if (dp->const_stats.elem[i].key == key)
+            return &dp->const_stats.elem[i];
+    }
+
+    struct const_stat *stat;
+    if (dp->const_stats.num < MAX_CONST_STATS) {
+        PL_ARRAY_APPEND(NULL, dp->const_stats, (struct const_stat) {0});
+        stat = &dp->const_stats.elem[dp->const_stats.num - 1];
+    } else {
+        // Evict the least recently seen entry
+        stat = &dp->const_stats.elem[0];
+        for (int i = 1; i < dp->const_stats.num; i++) {
+            if (dp->const_stats.elem[i].frame < stat->frame)
+                stat = &dp->const_stats.elem[i];
+        }
+    }
+
+    *stat = (struct const_stat) {
+        .key = key,
+        .frame = dp->const_frame - 1,
+    };
+    return stat;
+}
+
+bool pl_dispatch_const_dynamic(pl_dispatch dp, const char *desc,
+                               const struct pl_shader_const *sc)
+{
+    uint64_t key = pl_str0_hash(sc->name);
+    pl_hash_merge(&key, desc ? pl_str0_hash(desc) : 0);
+    pl_hash_merge(&key, sc->type);
+    uint64_t value = pl_mem_hash(sc->data, pl_var_type_size(sc->type));
+
+    pl_mutex_lock(&dp->pool_lock);
+
+    // Disambiguate multiple constants sharing the same name and step
+    struct const_stat *stat = const_stat_get(dp, key);
+    if (stat->frame != dp->const_frame)
+        stat->uses = 0;
+    int occurrence = stat->uses;
+    stat->uses = PL_MIN(stat->uses + 1, MAX_CONST_USES);
+    stat->frame = dp->const_frame;
+    if (occurrence == MAX_CONST_USES) {
+        // Further occurrences can't be told apart, so leave them alone
+        // rather than mistaking their (differing) values for changes
+        pl_mutex_unlock(&dp->pool_lock);
+        return false;
+    } else if (occurrence) {
+        pl_hash_merge(&key, occurrence);
+        stat = const_stat_get(dp, key);
+        stat->frame = dp->const_frame;
+    }
+
+    stat->history = (stat->history << 1) | (stat->seen && stat->value != value);
+    stat->value = value;
+    stat->seen = true;
+
+    // Promote constants that changed in at least 3 of the last 8 frames, and
+    // only demote them again once they've been stable for 8 frames in a row
+    if (__builtin_popcount(stat->history) >= 3) {
+        stat->dynamic = true;
+    } else if (!stat->history) {
+        stat->dynamic = false;
+    }
+
+    bool dynamic = stat->dynamic;
+    pl_mutex_unlock(&dp->pool_lock);
+    return dynamic;
 }
 
 void pl_dispatch_mark_dynamic(pl_dispatch dp, bool dynamic)
 {
-    dp->dynamic_constants = dynamic;
+    atomic_store_explicit(&dp->dynamic_constants, dynamic, memory_order_relaxed);
+}
+
+void pl_dispatch_mark_half(pl_dispatch dp, bool half)
+{
+    atomic_store_explicit(&dp->half_precision, half, memory_order_relaxed);
+}
+
+void pl_dispatch_mark_fast_transfer(pl_dispatch dp, bool fast)
+{
+    atomic_store_explicit(&dp->fast_transfer, fast, memory_order_relaxed);
+}
+
+void pl_dispatch_compile_only(pl_dispatch dp, bool enable)
+{
+    pl_mutex_lock(&dp->lock);
+    dp->compile_only = enable;
+    pl_mutex_unlock(&dp->lock);
 }
 
 void pl_dispatch_callback(pl_dispatch dp, void *priv,
@@ -177,9 +881,177 @@ void pl_dispatch_callback(pl_dispatch dp, void *priv,
     dp->info_priv = priv;
 }
 
-pl_shader pl_dispatch_begin(pl_dispatch dp)
-{
-    return pl_dispatch_begin_ex(dp, false);
+pl_shader pl_dispatch_begin(pl_dispatch dp)
+{
+    return pl_dispatch_begin_ex(dp, false);
+}
+
+// Get a set of TMP_COUNT scratch buffers for building a pass
+static pl_str *scratch_get(pl_dispatch dp)
+{
+    pl_str *scratch = NULL;
+    pl_mutex_lock(&dp->pool_lock);
+    PL_ARRAY_POP(dp->scratch, &scratch);
+    pl_mutex_unlock(&dp->pool_lock);
+    return scratch ? scratch : pl_calloc(NULL, TMP_COUNT, sizeof(pl_str));
+}
+
+static void scratch_put(pl_dispatch dp, pl_str *scratch)
+{
+    for (int i = 0; i < TMP_COUNT; i++)
+        scratch[i].len = 0;
+
+    pl_mutex_lock(&dp->pool_lock);
+    PL_ARRAY_APPEND(NULL, dp->scratch, scratch);
+    pl_mutex_unlock(&dp->pool_lock);
+}
+
+static void cache_file_append(pl_dispatch dp, uint64_t sig, pl_pass pass);
+static void gpu_cache_append(pl_dispatch dp, const struct pass *pass, pl_pass pl);
+
+// Background job compiling queued passes until the queue runs dry
+static void compile_drain(void *arg)
+{
+    pl_dispatch dp = arg;
+    pl_mutex_lock(&dp->lock);
+
+    while (dp->jobs.num && !dp->thread_exit) {
+        struct compile_job *job = dp->jobs.elem[0];
+        PL_ARRAY_REMOVE_AT(dp->jobs, 0);
+        dp->cur_job = job;
+        pl_mutex_unlock(&dp->lock);
+
+        uint64_t start = pl_clock_now();
+        pl_pass pass = pl_pass_create(dp->gpu, &job->params);
+        uint64_t end = pl_clock_now();
+
+        pl_mutex_lock(&dp->lock);
+        dp->cur_job = NULL;
+        if (job->pass) {
+            trace_slice(dp, TRACE_COMPILER, "compile", "pass compilation",
+                        job->pass->signature, start, end);
+            // Hot-swap the compiled pass into the (so far skipped) dispatch
+            if (!pass)
+                PL_ERR(dp, "Failed creating render pass for dispatch");
+            cache_file_append(dp, job->pass->signature, pass);
+            gpu_cache_append(dp, job->pass, pass);
+            if (pass) {
+                pass_update_size(dp, job->pass, job->pass->size +
+                                 pass->params.cached_program_len);
+            }
+            job->pass->pass = pass;
+            job->pass->run_params.pass = pass;
+            job->pass->job = NULL;
+        } else {
+            pl_pass_destroy(dp->gpu, &pass);
+        }
+
+        pl_free(job);
+        pl_cond_broadcast(&dp->cond);
+    }
+
+    dp->draining = false;
+    pl_cond_broadcast(&dp->cond);
+    pl_mutex_unlock(&dp->lock);
+}
+
+// Returns whether `pass` is done compiling, finalizing passes created by
+// `pl_pass_create_async` as needed. Must be called with `dp->lock` held.
+static bool pass_finish(pl_dispatch dp, struct pass *pass, bool block)
+{
+    if (!pass->compiling)
+        return true;
+
+    bool ok;
+    if (!pl_pass_poll(dp->gpu, pass->pass, block, &ok))
+        return false;
+
+    pass->compiling = false;
+    if (!ok) {
+        PL_ERR(dp, "Failed creating render pass for dispatch");
+        pl_pass_destroy(dp->gpu, &pass->pass);
+        pass->run_params.pass = NULL;
+        return true;
+    }
+
+    cache_file_append(dp, pass->signature, pass->pass);
+    gpu_cache_append(dp, pass, pass->pass);
+    pass_update_size(dp, pass, pass->size + pass->pass->params.cached_program_len);
+    return true;
+}
+
+static bool pass_ready(pl_dispatch dp, struct pass *pass)
+{
+    return !pass->job && pass_finish(dp, pass, false);
+}
+
+void pl_dispatch_async_compile(pl_dispatch dp, bool enable)
+{
+    atomic_store_explicit(&dp->async, enable, memory_order_relaxed);
+}
+
+void pl_dispatch_async_wait(pl_dispatch dp)
+{
+    pl_mutex_lock(&dp->lock);
+    while (dp->jobs.num || dp->cur_job)
+        pl_cond_wait(&dp->cond, &dp->lock);
+    for (struct pass *pass = dp->lru_head; pass; pass = pass->lru_next)
+        pass_finish(dp, pass, true);
+    pl_mutex_unlock(&dp->lock);
+}
+
+uint64_t pl_dispatch_async_skipped(pl_dispatch dp)
+{
+    pl_mutex_lock(&dp->lock);
+    uint64_t num = dp->num_skipped;
+    pl_mutex_unlock(&dp->lock);
+    return num;
+}
+
+// Hands off the compilation of `pass` to a background job. Returns false
+// if this is not possible, in which case the pass must be compiled directly.
+static bool compile_async(pl_dispatch dp, struct pass *pass,
+                          const struct pl_pass_params *params,
+                          size_t constant_size)
+{
+    // Passes can only be created from other threads on thread-safe GPUs
+    if (!dp->gpu->limits.thread_safe)
+        return false;
+
+    if (!dp->draining) {
+        // The previous drain job (if any) is past its last use of `dp->lock`,
+        // so this never blocks for long
+        pl_job_wait(&dp->drain_job);
+        dp->drain_job = pl_job_submit(dp->log, compile_drain, dp);
+        if (!dp->drain_job) {
+            PL_WARN(dp, "Failed submitting pass compilation job, "
+                    "compiling synchronously");
+            atomic_store_explicit(&dp->async, false, memory_order_relaxed);
+            return false;
+        }
+        dp->draining = true;
+    }
+
+    struct compile_job *job = pl_alloc_ptr(NULL, job);
+    *job = (struct compile_job) {
+        .pass = pass,
+        .params = pl_pass_params_copy(job, params),
+    };
+
+    // These are not copied by `pl_pass_params_copy`. (The cached program may
+    // be owned by `pass`, which can be destroyed while the job is pending)
+    job->params.constant_data = pl_memdup(job, params->constant_data, constant_size);
+    job->params.cached_program = pl_memdup(job, params->cached_program,
+                                           params->cached_program_len);
+    job->params.cached_program_len = params->cached_program_len;
+
+    PL_DEBUG(dp, "Compiling pass with signature 0x%llx asynchronously",
+             (unsigned long long) pass->signature);
+
+    pass->job = job;
+    PL_ARRAY_APPEND(dp, dp->jobs, job);
+    pl_cond_broadcast(&dp->cond);
+    return true;
 }
 
 static bool add_pass_var(pl_dispatch dp, void *tmp, struct pass *pass,
@@ -244,8 +1116,9 @@ static bool add_pass_var(pl_dispatch dp, void *tmp, struct pass *pass,
     return false;
 }
 
-#define ADD(x, ...) pl_str_append_asprintf_c(dp, (x), __VA_ARGS__)
-#define ADD_STR(x, s) pl_str_append(dp, (x), (s))
+// Scratch buffers are unparented, see `pl_dispatch.scratch`
+#define ADD(x, ...) pl_str_append_asprintf_c(NULL, (x), __VA_ARGS__)
+#define ADD_STR(x, s) pl_str_append(NULL, (x), (s))
 
 static void add_var(pl_dispatch dp, pl_str *body, const struct pl_var *var)
 {
@@ -295,10 +1168,11 @@ static ident_t sh_var_from_va(pl_shader sh, const char *name,
 
 struct generate_params {
     void *tmp;
+    pl_str *scratch;
     pl_shader sh;
     struct pass *pass;
     struct pl_pass_params *pass_params;
-    ident_t vert_pos;
+    const char *vert_pos;
     ident_t out_mat;
     ident_t out_off;
 };
@@ -308,11 +1182,11 @@ static void generate_shaders(pl_dispatch dp, const struct generate_params *param
     pl_gpu gpu = dp->gpu;
     pl_shader sh = params->sh;
     void *tmp = params->tmp;
-    const struct pl_shader_res *res = pl_shader_finalize(sh);
+    const struct pl_shader_res *res = sh_finalize_internal(sh);
     struct pass *pass = params->pass;
     struct pl_pass_params *pass_params = params->pass_params;
 
-    pl_str *pre = &dp->tmp[TMP_PRELUDE];
+    pl_str *pre = &params->scratch[TMP_PRELUDE];
     ADD(pre, "#version %d%s\n", gpu->glsl.version,
         (gpu->glsl.gles && gpu->glsl.version > 100) ? " es" : "");
     if (pass_params->type == PL_PASS_COMPUTE)
@@ -579,15 +1453,15 @@ static void generate_shaders(pl_dispatch dp, const struct generate_params *param
     char *vert_out = gpu->glsl.version >= 130 ? "out" : "varying";
     char *frag_in  = gpu->glsl.version >= 130 ? "in" : "varying";
 
-    pl_str *glsl = &dp->tmp[TMP_MAIN];
+    pl_str *glsl = &params->scratch[TMP_MAIN];
     ADD_STR(glsl, *pre);
 
     const char *out_color = "gl_FragColor";
     switch(pass_params->type) {
     case PL_PASS_RASTER: {
         pl_assert(params->vert_pos);
-        pl_str *vert_head = &dp->tmp[TMP_VERT_HEAD];
-        pl_str *vert_body = &dp->tmp[TMP_VERT_BODY];
+        pl_str *vert_head = &params->scratch[TMP_VERT_HEAD];
+        pl_str *vert_body = &params->scratch[TMP_VERT_BODY];
 
         // Set up a trivial vertex shader
         ADD_STR(vert_head, *pre);
@@ -612,9 +1486,9 @@ static void generate_shaders(pl_dispatch dp, const struct generate_params *param
                 pl_assert(va->fmt->num_components == 2);
                 ADD(vert_body, "vec2 va_pos = %s; \n", va->name);
                 if (params->out_mat)
-                    ADD(vert_body, "va_pos = %s * va_pos; \n", params->out_mat);
+                    ADD(vert_body, "va_pos = "$" * va_pos; \n", params->out_mat);
                 if (params->out_off)
-                    ADD(vert_body, "va_pos += %s; \n", params->out_off);
+                    ADD(vert_body, "va_pos += "$"; \n", params->out_off);
                 ADD(vert_body, "gl_Position = vec4(va_pos, 0.0, 1.0); \n");
             } else {
                 // Everything else is just blindly passed through
@@ -647,76 +1521,90 @@ static void generate_shaders(pl_dispatch dp, const struct generate_params *param
         pl_unreachable();
     }
 
-    // Set up the main shader body
-    ADD(glsl, "%s", res->glsl);
-    ADD(glsl, "void main() {\n");
+    // The shader text itself goes in between, but is only written out by
+    // `write_glsl`, since it's not needed for passes that are already compiled
+    pl_str *footer = &params->scratch[TMP_FOOTER];
+    ADD(footer, "void main() {\n");
 
     pl_assert(res->input == PL_SHADER_SIG_NONE);
     switch (pass_params->type) {
     case PL_PASS_RASTER:
         pl_assert(res->output == PL_SHADER_SIG_COLOR);
-        ADD(glsl, "%s = %s();\n", out_color, res->name);
+        ADD(footer, "%s = %s();\n", out_color, res->name);
         break;
     case PL_PASS_COMPUTE:
-        ADD(glsl, "%s();\n", res->name);
+        ADD(footer, "%s();\n", res->name);
         break;
     case PL_PASS_INVALID:
     case PL_PASS_TYPE_COUNT:
         pl_unreachable();
     }
 
-    ADD(glsl, "}");
-    pass_params->glsl_shader = (char *) glsl->buf;
+    ADD(footer, "}");
     pl_hash_merge(&pass->signature, pl_str_hash(*glsl));
+    pl_hash_merge(&pass->signature, sh_text_hash(sh));
+    pl_hash_merge(&pass->signature, pl_str_hash(*footer));
+}
+
+// Assembles the full GLSL shader text generated by `generate_shaders`
+static void write_glsl(const struct generate_params *params)
+{
+    pl_str *glsl = &params->scratch[TMP_MAIN];
+    sh_text_write(params->sh, NULL, glsl);
+    ADD_STR(glsl, params->scratch[TMP_FOOTER]);
+    params->pass_params->glsl_shader = (char *) glsl->buf;
 }
 
 #undef ADD
 #undef ADD_STR
 
-#define pass_age(pass) (dp->current_index - (pass)->last_index)
-
-static int cmp_pass_age(const void *ptra, const void *ptrb)
+static bool over_budget(pl_dispatch dp)
 {
-    const struct pass *a = *(const struct pass **) ptra;
-    const struct pass *b = *(const struct pass **) ptrb;
-    return b->last_index - a->last_index;
+    return (dp->max_passes && dp->num_passes > dp->max_passes) ||
+           (dp->max_pass_bytes && dp->pass_bytes > dp->max_pass_bytes);
 }
 
 static void garbage_collect_passes(pl_dispatch dp)
 {
-    if (dp->passes.num <= dp->max_passes)
-        return;
-
-    // Garbage collect oldest passes, starting at the middle
-    qsort(dp->passes.elem, dp->passes.num, sizeof(struct pass *), cmp_pass_age);
-    int idx = dp->passes.num / 2;
-    while (idx < dp->passes.num && pass_age(dp->passes.elem[idx]) < MIN_AGE)
-        idx++;
-
-    for (int i = idx; i < dp->passes.num; i++)
-        pass_destroy(dp, dp->passes.elem[i]);
+    int num_evicted = 0;
+    while (over_budget(dp)) {
+        struct pass *pass = dp->lru_tail;
+        if (dp->frame - pass->last_frame < MIN_AGE) {
+            // All remaining passes are still in active use
+            if (!dp->warned_budget) {
+                PL_WARN(dp, "Dispatch pass cache budget exceeded by passes "
+                        "in active use (%d passes, %zu bytes), consider "
+                        "increasing the budget", dp->num_passes, dp->pass_bytes);
+                dp->warned_budget = true;
+            }
+            break;
+        }
 
-    int num_evicted = dp->passes.num - idx;
-    dp->passes.num = idx;
+        pass_remove(dp, pass);
+        pass_destroy(dp, pass);
+        num_evicted++;
+    }
 
     if (num_evicted) {
         PL_DEBUG(dp, "Evicted %d passes from dispatch cache, consider "
                  "using more dynamic shaders", num_evicted);
-    } else {
-        dp->max_passes *= 2;
     }
 }
 
-static struct pass *finalize_pass(pl_dispatch dp, pl_shader sh,
-                                  pl_tex target, ident_t vert_pos,
+// Generates the shader and looks it up in the pass cache, compiling it if
+// needed. The shader generation runs unlocked, but this function always
+// returns with `dp->lock` held (even on failure).
+static struct pass *finalize_pass(pl_dispatch dp, pl_str *scratch, pl_shader sh,
+                                  pl_tex target, const char *vert_pos,
                                   const struct pl_blend_params *blend, bool load,
                                   const struct pl_dispatch_vertex_params *vparams,
-                                  const struct pl_transform2x2 *proj)
+                                  const struct pl_transform2x2 *proj,
+                                  struct pl_prof *prof)
 {
-    struct pass *pass = pl_alloc_ptr(dp, pass);
+    bool locked = false;
+    struct pass *pass = pl_alloc_ptr(NULL, pass); // might be freed unlocked
     *pass = (struct pass) {
         .signature = 0x0, // updated incrementally below
-        .last_index = dp->current_index,
         .ubo_desc = {
             .desc = {
                 .name = "UBO",
@@ -733,11 +1621,13 @@ static struct pass *finalize_pass(pl_dispatch dp, pl_shader sh,
         .num_descriptors = sh->descs.num,
         .vertex_type = vparams ? vparams->vertex_type : PL_PRIM_TRIANGLE_STRIP,
         .vertex_stride = vparams ? vparams->vertex_stride : 0,
+        .instance_stride = vparams ? vparams->instance_stride : 0,
         .blend_params = blend,
     };
 
     struct generate_params gen_params = {
         .tmp = tmp,
+        .scratch = scratch,
         .pass = pass,
         .pass_params = &params,
         .sh = sh,
@@ -773,11 +1663,13 @@ static struct pass *finalize_pass(pl_dispatch dp, pl_shader sh,
             // attribute is the number of vec4s it consumes, rounded up
             const size_t va_loc_size = sizeof(float[4]);
             va_loc += (va->fmt->texel_size + va_loc_size - 1) / va_loc_size;
+            pl_hash_merge(&pass->signature, (uint64_t) va->instanced);
         }
 
         // Hash in the raster state configuration
         pl_hash_merge(&pass->signature, (uint64_t) params.vertex_type);
         pl_hash_merge(&pass->signature, (uint64_t) params.vertex_stride);
+        pl_hash_merge(&pass->signature, (uint64_t) params.instance_stride);
         pl_hash_merge(&pass->signature, (uint64_t) params.load_target);
         pl_hash_merge(&pass->signature, target->params.format->signature);
         if (blend) {
@@ -803,6 +1695,7 @@ static struct pass *finalize_pass(pl_dispatch dp, pl_shader sh,
 
     // Place all of the compile-time constants
     uint8_t *constant_data = NULL;
+    size_t constant_size = 0;
     if (sh->consts.num) {
         params.num_constants = sh->consts.num;
         params.constants = pl_alloc(tmp, sh->consts.num * sizeof(struct pl_constant));
@@ -821,6 +1714,7 @@ static struct pass *finalize_pass(pl_dispatch dp, pl_shader sh,
 
         // Write values into the constants buffer
         params.constant_data = constant_data = pl_alloc(pass, total_size);
+        constant_size = total_size;
         for (int i = 0; i < sh->consts.num; i++) {
             const struct pl_shader_const *sc = &sh->consts.elem[i];
             void *data = constant_data + params.constants[i].offset;
@@ -860,25 +1754,38 @@ static struct pass *finalize_pass(pl_dispatch dp, pl_shader sh,
         struct pl_desc *desc = &params.descriptors[i];
         *desc = sh->descs.elem[i].desc;
         desc->binding = binding[pl_desc_namespace(dp->gpu, desc->type)]++;
+
+        // The sampler state of a given shader practically never changes, so
+        // fix it as part of the pass, letting backends bake it in
+        if (desc->type == PL_DESC_SAMPLED_TEX) {
+            const struct pl_desc_binding *db = &sh->descs.elem[i].binding;
+            desc->fixed_sampler = true;
+            desc->sample_mode = db->sample_mode;
+            desc->address_mode = db->address_mode;
+            pl_hash_merge(&pass->signature, (uint64_t) db->sample_mode << 8 |
+                                            db->address_mode);
+        }
     }
 
     // Finalize the shader and look it up in the pass cache
+    pl_prof_enter(prof, PL_RENDER_CPU_FINALIZE);
     generate_shaders(dp, &gen_params);
-    for (int i = 0; i < dp->passes.num; i++) {
-        struct pass *p = dp->passes.elem[i];
-        if (p->signature != pass->signature)
-            continue;
+    pl_prof_enter(prof, PL_RENDER_CPU_LOOKUP);
+    pl_mutex_lock(&dp->lock);
+    locked = true;
 
+    struct pass *p = pass_lookup(dp, pass->signature);
+    if (p) {
         // Found existing shader, re-use directly
-        if (p->ubo)
-            sh->descs.elem[p->ubo_index].binding.object = p->ubo;
         pl_free(p->run_params.constant_data);
         p->run_params.constant_data = pl_steal(p, constant_data);
-        p->last_index = dp->current_index;
+        pass_touch(dp, p);
         pl_free(pass);
         return p;
     }
 
+    write_glsl(&gen_params);
+
     // Find and attach the cached program, if any
     for (int i = 0; i < dp->cached_passes.num; i++) {
         if (dp->cached_passes.elem[i].signature == pass->signature) {
@@ -892,10 +1799,36 @@ static struct pass *finalize_pass(pl_dispatch dp, pl_shader sh,
         }
     }
 
-    pass->pass = pl_pass_create(dp->gpu, &params);
-    if (!pass->pass) {
-        PL_ERR(dp, "Failed creating render pass for dispatch");
-        // Add it anyway
+    pl_cache cache = pl_gpu_cache(dp->gpu);
+    pl_cache_obj obj = { .key = pl_cache_key(PL_CACHE_KEY_PROGRAM, pass->signature) };
+    if (!params.cached_program_len && cache && pl_cache_get(cache, &obj)) {
+        PL_DEBUG(dp, "Re-using program with signature 0x%llx from pl_cache",
+                 (unsigned long long) pass->signature);
+        params.cached_program = pl_memdup(pass, obj.data, obj.size);
+        params.cached_program_len = obj.size;
+        pass->cache_hash = pl_mem_hash(obj.data, obj.size);
+        pl_cache_obj_free(&obj);
+    }
+
+    bool async = atomic_load_explicit(&dp->async, memory_order_relaxed);
+    if (async && pl_gpu_parallel_compile(dp->gpu)) {
+        // Let the driver compile the pass in parallel, and poll for
+        // completion when it's next used, see `pass_ready`
+        pass->pass = pl_pass_create_async(dp->gpu, &params);
+        pass->compiling = pass->pass;
+        if (!pass->pass)
+            PL_ERR(dp, "Failed creating render pass for dispatch");
+    } else if (!async || !compile_async(dp, pass, &params, constant_size)) {
+        uint64_t start = pl_clock_now();
+        pass->pass = pl_pass_create(dp->gpu, &params);
+        trace_slice(dp, TRACE_DISPATCH, "compile", "pass compilation",
+                    pass->signature, start, pl_clock_now());
+        if (!pass->pass) {
+            PL_ERR(dp, "Failed creating render pass for dispatch");
+            // Add it anyway
+        }
+        cache_file_append(dp, pass->signature, pass->pass);
+        gpu_cache_append(dp, pass, pass->pass);
     }
 
     struct pl_pass_run_params *rparams = &pass->run_params;
@@ -905,20 +1838,13 @@ static struct pass *finalize_pass(pl_dispatch dp, pl_shader sh,
     rparams->desc_bindings = pl_calloc_ptr(pass, params.num_descriptors,
                                            rparams->desc_bindings);
 
-    if (ubo_size && pass->pass) {
-        // Create the UBO
-        pass->ubo = pl_buf_create(dp->gpu, pl_buf_params(
-            .size = ubo_size,
-            .uniform = true,
-            .host_writable = true,
-        ));
-
-        if (!pass->ubo) {
-            PL_ERR(dp, "Failed creating uniform buffer for dispatch");
-            goto error;
-        }
-
-        sh->descs.elem[pass->ubo_index].binding.object = pass->ubo;
+    if (ubo_size && (pass->pass || pass->job)) {
+        // Small UBOs are streamed through the shared ring, larger ones get a
+        // dedicated buffer (created on first use, see `update_ubo`)
+        pass->ubo_size = ubo_size;
+        pass->ubo_data = pl_zalloc(pass, ubo_size);
+        pass->ubo_dirty_start = ubo_size;
+        pass->ubo_stream = ubo_size <= ubo_segment_size(dp->gpu) / 4;
     }
 
     if (params.type == PL_PASS_RASTER && !vparams) {
@@ -930,10 +1856,18 @@ static struct pass *finalize_pass(pl_dispatch dp, pl_shader sh,
 
     pass->timer = pl_timer_create(dp->gpu);
 
-    PL_ARRAY_APPEND(dp, dp->passes, pass);
+    pass->size = sizeof(*pass) + 2 * ubo_size + params.push_constants_size;
+    pass->size += strlen(params.glsl_shader);
+    if (params.vertex_shader)
+        pass->size += strlen(params.vertex_shader);
+    if (pass->pass && !pass->compiling)
+        pass->size += pass->pass->params.cached_program_len;
+    pass_insert(dp, pass);
     return pass;
 
 error:
+    if (!locked)
+        pl_mutex_lock(&dp->lock);
     pass_destroy(dp, pass);
     return NULL;
 }
@@ -964,27 +1898,13 @@ static void update_pass_var(pl_dispatch dp, struct pass *pass,
         break;
     }
     case PASS_VAR_UBO: {
-        pl_assert(pass->ubo);
+        // Assemble the correctly strided contents in RAM, the actual upload
+        // is deferred to `update_ubo`
+        pl_assert(pass->ubo_data);
         const size_t offset = pv->layout.offset;
-        if (host_layout.stride == pv->layout.stride) {
-            pl_assert(host_layout.size == pv->layout.size);
-            pl_buf_write(dp->gpu, pass->ubo, offset, sv->data, host_layout.size);
-        } else {
-            // Coalesce strided UBO write into a single pl_buf_write to avoid
-            // unnecessary synchronization overhead by assembling the correctly
-            // strided upload in RAM
-            pl_grow(dp, &dp->tmp[0].buf, pv->layout.size);
-            uint8_t * const tmp = dp->tmp[0].buf;
-            const uint8_t *src = sv->data;
-            const uint8_t *end = src + host_layout.size;
-            uint8_t *dst = tmp;
-            while (src < end) {
-                memcpy(dst, src, host_layout.stride);
-                src += host_layout.stride;
-                dst += pv->layout.stride;
-            }
-            pl_buf_write(dp->gpu, pass->ubo, offset, tmp, pv->layout.size);
-        }
+        memcpy_layout(pass->ubo_data, pv->layout, sv->data, host_layout);
+        pass->ubo_dirty_start = PL_MIN(pass->ubo_dirty_start, offset);
+        pass->ubo_dirty_end = PL_MAX(pass->ubo_dirty_end, offset + pv->layout.size);
         break;
     }
     case PASS_VAR_PUSHC:
@@ -994,6 +1914,82 @@ static void update_pass_var(pl_dispatch dp, struct pass *pass,
     };
 }
 
+// Returns a buffer of `pass->vbos` containing the current vertex data, skipping
+// the upload if it's unchanged from the previous run. Returns NULL if the
+// vertex data should be uploaded as part of the pass run instead.
+static pl_buf update_pass_vbo(pl_dispatch dp, struct pass *pass)
+{
+    const struct pl_pass_run_params *rparams = &pass->run_params;
+    size_t size = pl_vertex_buf_size(rparams);
+    pl_buf *vbo = &pass->vbos[pass->vbo_idx];
+    if (*vbo && !memcmp(pass->vbo_data, rparams->vertex_data, size))
+        return *vbo;
+
+    // Move on to the next buffer rather than updating the one that the last
+    // run drew from. Polling it first would force a flush on some backends,
+    // so rely on the ring being long enough for the previous user of the
+    // next buffer to have completed, in which case the write never stalls.
+    pass->vbo_idx = (pass->vbo_idx + 1) % PL_ARRAY_SIZE(pass->vbos);
+    vbo = &pass->vbos[pass->vbo_idx];
+    if (*vbo) {
+        pl_buf_write(dp->gpu, *vbo, 0, rparams->vertex_data, size);
+    } else {
+        if (size > dp->gpu->limits.max_vbo_size)
+            return NULL;
+        *vbo = pl_buf_create(dp->gpu, pl_buf_params(
+            .size = size,
+            .drawable = true,
+            .host_writable = true,
+            .initial_data = rparams->vertex_data,
+            .debug_tag = PL_DEBUG_TAG,
+        ));
+        if (!*vbo)
+            return NULL;
+        if (!pass->vbo_data)
+            pass->vbo_data = pl_alloc(pass, size);
+    }
+
+    memcpy(pass->vbo_data, rparams->vertex_data, size);
+    return *vbo;
+}
+
+// Uploads per-instance data into the next free buffer of `pass->instance_bufs`,
+// returning NULL if all of them are still in use
+static pl_buf upload_instances(pl_dispatch dp, struct pass *pass,
+                               const void *data, size_t size)
+{
+    const int num = PL_ARRAY_SIZE(pass->instance_bufs);
+    for (int i = 0; i < num; i++) {
+        int idx = (pass->instance_idx + i) % num;
+        pl_buf *buf = &pass->instance_bufs[idx];
+        if (*buf && pl_buf_poll(dp->gpu, *buf, 0))
+            continue;
+        if (*buf && (*buf)->params.size < size)
+            pl_buf_destroy(dp->gpu, buf);
+
+        if (*buf) {
+            pl_buf_write(dp->gpu, *buf, 0, data, size);
+        } else {
+            if (size > dp->gpu->limits.max_vbo_size)
+                return NULL;
+            *buf = pl_buf_create(dp->gpu, pl_buf_params(
+                .size = size,
+                .drawable = true,
+                .host_writable = true,
+                .initial_data = data,
+                .debug_tag = PL_DEBUG_TAG,
+            ));
+            if (!*buf)
+                return NULL;
+        }
+
+        pass->instance_idx = (idx + 1) % num;
+        return *buf;
+    }
+
+    return NULL;
+}
+
 static void compute_vertex_attribs(pl_dispatch dp, pl_shader sh,
                                    int width, int height, ident_t *out_scale)
 {
@@ -1005,7 +2001,7 @@ static void compute_vertex_attribs(pl_dispatch dp, pl_shader sh,
     });
 
     GLSLP("#define frag_pos(id) (vec2(id) + vec2(0.5)) \n"
-          "#define frag_map(id) (%s * frag_pos(id))    \n"
+          "#define frag_map(id) ("$" * frag_pos(id))   \n"
           "#define gl_FragCoord vec4(frag_pos(gl_GlobalInvocationID), 0.0, 1.0) \n",
           *out_scale);
 
@@ -1020,8 +2016,8 @@ static void compute_vertex_attribs(pl_dispatch dp, pl_shader sh,
         }
 
         GLSLP("#define %s_map(id) "
-             "(mix(mix(%s, %s, frag_map(id).x), "
-             "     mix(%s, %s, frag_map(id).x), "
+             "(mix(mix("$", "$", frag_map(id).x), "
+             "     mix("$", "$", frag_map(id).x), "
              "frag_map(id).y))\n"
              "#define %s (%s_map(gl_GlobalInvocationID))\n",
              sva->attr.name,
@@ -1068,11 +2064,11 @@ static void translate_compute_shader(pl_dispatch dp, pl_shader sh,
     int dx = rc->x0 > rc->x1 ? -1 : 1, dy = rc->y0 > rc->y1 ? -1 : 1;
     const char *swiz = sh->transpose ? "yx" : "xy";
     GLSL("ivec2 dir = ivec2(%d, %d);\n", dx, dy); // hard-code, not worth var
-    GLSL("ivec2 pos = %s + dir * ivec2(gl_GlobalInvocationID).%s;\n", base, swiz);
-    GLSL("vec2 fpos = %s * vec2(gl_GlobalInvocationID);\n", out_scale);
+    GLSL("ivec2 pos = "$" + dir * ivec2(gl_GlobalInvocationID).%s;\n", base, swiz);
+    GLSL("vec2 fpos = "$" * vec2(gl_GlobalInvocationID);\n", out_scale);
     GLSL("if (fpos.x < 1.0 && fpos.y < 1.0) {\n");
     if (params->blend_params) {
-        GLSL("vec4 orig = imageLoad(%s, pos);\n", fbo);
+        GLSL("vec4 orig = imageLoad("$", pos);\n", fbo);
 
         static const char *modes[] = {
             [PL_BLEND_ZERO] = "0.0",
@@ -1088,18 +2084,65 @@ static void translate_compute_shader(pl_dispatch dp, pl_shader sh,
              modes[params->blend_params->dst_rgb],
              modes[params->blend_params->dst_alpha]);
     }
-    GLSL("imageStore(%s, pos, color);\n", fbo);
+    GLSL("imageStore("$", pos, color);\n", fbo);
     GLSL("}\n");
     sh->res.output = PL_SHADER_SIG_NONE;
 }
 
-static void run_pass(pl_dispatch dp, pl_shader sh, struct pass *pass)
+// `start` is the time at which the CPU started preparing this dispatch
+// Must be called with `dp->lock` held
+static void prof_merge(pl_dispatch dp, struct pl_prof *prof)
+{
+#ifdef PL_CPU_PROFILE
+    pl_static_assert(PL_RENDER_CPU_COUNT <= PL_PROF_MAX_SECTIONS);
+    pl_prof_stop(prof);
+    for (int i = 0; i < PL_RENDER_CPU_COUNT; i++)
+        dp->cpu_times[i] += prof->times[i];
+#endif
+}
+
+void pl_dispatch_cpu_times(pl_dispatch dp, uint64_t out[PL_RENDER_CPU_COUNT])
+{
+    pl_mutex_lock(&dp->lock);
+    memcpy(out, dp->cpu_times, sizeof(dp->cpu_times));
+    pl_mutex_unlock(&dp->lock);
+}
+
+static void run_pass(pl_dispatch dp, pl_shader sh, struct pass *pass,
+                     uint64_t start, struct pl_prof *prof)
 {
-    const struct pl_shader_res *res = pl_shader_finalize(sh);
+    if (dp->compile_only) {
+        // Updates to global variables are only applied by `pl_pass_run`, so
+        // drop their cached values to make sure they get sent on the next run
+        for (int i = 0; i < sh->vars.num; i++) {
+            if (pass->vars[i].type == PASS_VAR_GLOBAL)
+                pl_free_ptr(&pass->vars[i].cached_data);
+        }
+        return;
+    }
+
+    const struct pl_shader_res *res = sh_finalize_internal(sh);
+    const uint64_t submit = pl_clock_now();
+    pl_prof_enter(prof, PL_RENDER_CPU_SUBMIT);
     pl_pass_run(dp->gpu, &pass->run_params);
 
+    if (dp->trace_file) {
+        trace_slice(dp, TRACE_DISPATCH, "generate", res->description,
+                    pass->signature, start, submit);
+        trace_slice(dp, TRACE_DISPATCH, "submit", res->description,
+                    pass->signature, submit, pl_clock_now());
+
+        // Drop the oldest entries if the timer results never arrive
+        if (pass->timer && pass->run_params.timer == pass->timer) {
+            if (pass->trace_submits.num == PL_ARRAY_SIZE(pass->samples))
+                PL_ARRAY_REMOVE_AT(pass->trace_submits, 0);
+            PL_ARRAY_APPEND(pass, pass->trace_submits, submit);
+        }
+    }
+
     for (uint64_t ts; (ts = pl_timer_query(dp->gpu, pass->timer));) {
         PL_TRACE(dp, "Spent %.3f ms on shader: %s", ts / 1e6, res->description);
+        trace_gpu(dp, pass, res->description, ts);
 
         uint64_t old = pass->samples[pass->ts_idx];
         pass->samples[pass->ts_idx] = ts;
@@ -1119,6 +2162,8 @@ static void run_pass(pl_dispatch dp, pl_shader sh, struct pass *pass)
         }
     }
 
+    // The info callback is accounted to the caller
+    pl_prof_stop(prof);
     if (!dp->info_callback)
         return;
 
@@ -1143,6 +2188,7 @@ static void run_pass(pl_dispatch dp, pl_shader sh, struct pass *pass)
     info.last = pass->ts_last;
     info.peak = pass->ts_peak;
     info.average = pass->ts_sum / PL_MAX(info.num_samples, 1);
+    info.cpu_time = pl_clock_now() - start;
     dp->info_callback(dp->info_priv, &info);
 }
 
@@ -1150,8 +2196,9 @@ bool pl_dispatch_finish(pl_dispatch dp, const struct pl_dispatch_params *params)
 {
     pl_shader sh = *params->shader;
     const struct pl_shader_res *res = &sh->res;
-    bool ret = false;
-    pl_mutex_lock(&dp->lock);
+    bool ret = false, locked = false;
+    pl_str *scratch = scratch_get(dp);
+    struct pl_prof prof = PL_PROF_INIT;
 
     if (sh->failed) {
         PL_ERR(sh, "Trying to dispatch a failed shader.");
@@ -1208,7 +2255,7 @@ bool pl_dispatch_finish(pl_dispatch dp, const struct pl_dispatch_params *params)
         goto error;
     }
 
-    ident_t vert_pos = NULL;
+    const char *vert_pos = NULL;
     const struct pl_transform2x2 *proj = NULL;
     if (pl_shader_is_compute(sh)) {
         // Translate the compute shader to simulate vertices etc.
@@ -1232,7 +2279,7 @@ bool pl_dispatch_finish(pl_dispatch dp, const struct pl_dispatch_params *params)
             PL_SWAP(vert_rect.x1, vert_rect.y1);
         }
 
-        vert_pos = sh_attr_vec2(sh, "position", &vert_rect);
+        vert_pos = sh_ident_pack(sh_attr_vec2(sh, "position", &vert_rect));
     }
 
     // We need to set pl_pass_params.load_target when either blending is
@@ -1246,8 +2293,19 @@ bool pl_dispatch_finish(pl_dispatch dp, const struct pl_dispatch_params *params)
     rc_norm.y1 = PL_MIN(rc_norm.y1, tpars->h);
     bool load = params->blend_params || !pl_rect2d_eq(rc_norm, full);
 
-    struct pass *pass = finalize_pass(dp, sh, params->target, vert_pos,
-                                      params->blend_params, load, NULL, proj);
+    const uint64_t start = pl_clock_now();
+    pl_prof_enter(&prof, PL_RENDER_CPU_LOOKUP);
+    struct pass *pass = finalize_pass(dp, scratch, sh, params->target, vert_pos,
+                                      params->blend_params, load, NULL, proj,
+                                      &prof);
+    locked = true;
+
+    // Skip passes which are still being compiled in the background
+    if (pass && !pass_ready(dp, pass)) {
+        dp->num_skipped++;
+        ret = true;
+        goto error;
+    }
 
     // Silently return on failed passes
     if (!pass || !pass->pass)
@@ -1256,13 +2314,18 @@ bool pl_dispatch_finish(pl_dispatch dp, const struct pl_dispatch_params *params)
     struct pl_pass_run_params *rparams = &pass->run_params;
 
     // Update the descriptor bindings
+    pl_prof_enter(&prof, PL_RENDER_CPU_BINDINGS);
     for (int i = 0; i < sh->descs.num; i++)
         rparams->desc_bindings[i] = sh->descs.elem[i].binding;
 
     // Update all of the variables (if needed)
+    pl_prof_enter(&prof, PL_RENDER_CPU_VARS);
     rparams->num_var_updates = 0;
     for (int i = 0; i < sh->vars.num; i++)
         update_pass_var(dp, pass, &sh->vars.elem[i], &pass->vars[i]);
+    if (pass->ubo_size && !update_ubo(dp, pass))
+        goto error;
+    pl_prof_enter(&prof, PL_RENDER_CPU_BINDINGS);
 
     // Update the vertex data
     if (rparams->vertex_data) {
@@ -1299,20 +2362,32 @@ bool pl_dispatch_finish(pl_dispatch dp, const struct pl_dispatch_params *params)
         rparams->scissors = rc_norm;
     }
 
-    // Dispatch the actual shader
+    // Dispatch the actual shader, drawing from the persistent vertex buffer
+    // if possible
     rparams->target = params->target;
     rparams->timer = PL_DEF(params->timer, pass->timer);
-    run_pass(dp, sh, pass);
+    rparams->async = params->async;
+    const void *vertex_data = rparams->vertex_data;
+    pl_buf vbo = vertex_data ? update_pass_vbo(dp, pass) : NULL;
+    if (vbo) {
+        rparams->vertex_buf = vbo;
+        rparams->vertex_data = NULL;
+    }
+    run_pass(dp, sh, pass, start, &prof);
+    if (vbo) {
+        rparams->vertex_buf = NULL;
+        rparams->vertex_data = vertex_data;
+    }
 
     ret = true;
     // fall through
 
 error:
-    // Reset the temporary buffers which we use to build the shader
-    for (int i = 0; i < PL_ARRAY_SIZE(dp->tmp); i++)
-        dp->tmp[i].len = 0;
-
-    pl_mutex_unlock(&dp->lock);
+    if (locked) {
+        prof_merge(dp, &prof);
+        pl_mutex_unlock(&dp->lock);
+    }
+    scratch_put(dp, scratch);
     pl_dispatch_abort(dp, params->shader);
     return ret;
 }
@@ -1321,8 +2396,9 @@ bool pl_dispatch_compute(pl_dispatch dp, const struct pl_dispatch_compute_params
 {
     pl_shader sh = *params->shader;
     const struct pl_shader_res *res = &sh->res;
-    bool ret = false;
-    pl_mutex_lock(&dp->lock);
+    bool ret = false, locked = false;
+    pl_str *scratch = scratch_get(dp);
+    struct pl_prof prof = PL_PROF_INIT;
 
     if (sh->failed) {
         PL_ERR(sh, "Trying to dispatch a failed shader.");
@@ -1357,7 +2433,18 @@ bool pl_dispatch_compute(pl_dispatch dp, const struct pl_dispatch_compute_params
                                &(ident_t){0});
     }
 
-    struct pass *pass = finalize_pass(dp, sh, NULL, NULL, NULL, false, NULL, NULL);
+    const uint64_t start = pl_clock_now();
+    pl_prof_enter(&prof, PL_RENDER_CPU_LOOKUP);
+    struct pass *pass = finalize_pass(dp, scratch, sh, NULL, NULL, NULL, false,
+                                      NULL, NULL, &prof);
+    locked = true;
+
+    // Skip passes which are still being compiled in the background
+    if (pass && !pass_ready(dp, pass)) {
+        dp->num_skipped++;
+        ret = true;
+        goto error;
+    }
 
     // Silently return on failed passes
     if (!pass || !pass->pass)
@@ -1366,13 +2453,18 @@ bool pl_dispatch_compute(pl_dispatch dp, const struct pl_dispatch_compute_params
     struct pl_pass_run_params *rparams = &pass->run_params;
 
     // Update the descriptor bindings
+    pl_prof_enter(&prof, PL_RENDER_CPU_BINDINGS);
     for (int i = 0; i < sh->descs.num; i++)
         rparams->desc_bindings[i] = sh->descs.elem[i].binding;
 
     // Update all of the variables (if needed)
+    pl_prof_enter(&prof, PL_RENDER_CPU_VARS);
     rparams->num_var_updates = 0;
     for (int i = 0; i < sh->vars.num; i++)
         update_pass_var(dp, pass, &sh->vars.elem[i], &pass->vars[i]);
+    if (pass->ubo_size && !update_ubo(dp, pass))
+        goto error;
+    pl_prof_enter(&prof, PL_RENDER_CPU_BINDINGS);
 
     // Update the dispatch size
     int groups = 1;
@@ -1395,17 +2487,18 @@ bool pl_dispatch_compute(pl_dispatch dp, const struct pl_dispatch_compute_params
 
     // Dispatch the actual shader
     rparams->timer = PL_DEF(params->timer, pass->timer);
-    run_pass(dp, sh, pass);
+    rparams->async = params->async;
+    run_pass(dp, sh, pass, start, &prof);
 
     ret = true;
     // fall through
 
 error:
-    // Reset the temporary buffers which we use to build the shader
-    for (int i = 0; i < PL_ARRAY_SIZE(dp->tmp); i++)
-        dp->tmp[i].len = 0;
-
-    pl_mutex_unlock(&dp->lock);
+    if (locked) {
+        prof_merge(dp, &prof);
+        pl_mutex_unlock(&dp->lock);
+    }
+    scratch_put(dp, scratch);
     pl_dispatch_abort(dp, params->shader);
     return ret;
 }
@@ -1414,8 +2507,9 @@ bool pl_dispatch_vertex(pl_dispatch dp, const struct pl_dispatch_vertex_params *
 {
     pl_shader sh = *params->shader;
     const struct pl_shader_res *res = &sh->res;
-    bool ret = false;
-    pl_mutex_lock(&dp->lock);
+    bool ret = false, locked = false;
+    pl_str *scratch = scratch_get(dp);
+    struct pl_prof prof = PL_PROF_INIT;
 
     if (sh->failed) {
         PL_ERR(sh, "Trying to dispatch a failed shader.");
@@ -1490,9 +2584,20 @@ bool pl_dispatch_vertex(pl_dispatch dp, const struct pl_dispatch_vertex_params *
         break;
     }
 
-    ident_t vert_pos = params->vertex_attribs[pos_idx].name;
-    struct pass *pass = finalize_pass(dp, sh, params->target, vert_pos,
-                                      params->blend_params, true, params, &proj);
+    const char *vert_pos = params->vertex_attribs[pos_idx].name;
+    const uint64_t start = pl_clock_now();
+    pl_prof_enter(&prof, PL_RENDER_CPU_LOOKUP);
+    struct pass *pass = finalize_pass(dp, scratch, sh, params->target, vert_pos,
+                                      params->blend_params, true, params, &proj,
+                                      &prof);
+    locked = true;
+
+    // Skip passes which are still being compiled in the background
+    if (pass && !pass_ready(dp, pass)) {
+        dp->num_skipped++;
+        ret = true;
+        goto error;
+    }
 
     // Silently return on failed passes
     if (!pass || !pass->pass)
@@ -1501,13 +2606,18 @@ bool pl_dispatch_vertex(pl_dispatch dp, const struct pl_dispatch_vertex_params *
     struct pl_pass_run_params *rparams = &pass->run_params;
 
     // Update the descriptor bindings
+    pl_prof_enter(&prof, PL_RENDER_CPU_BINDINGS);
     for (int i = 0; i < sh->descs.num; i++)
         rparams->desc_bindings[i] = sh->descs.elem[i].binding;
 
     // Update all of the variables (if needed)
+    pl_prof_enter(&prof, PL_RENDER_CPU_VARS);
     rparams->num_var_updates = 0;
     for (int i = 0; i < sh->vars.num; i++)
         update_pass_var(dp, pass, &sh->vars.elem[i], &pass->vars[i]);
+    if (pass->ubo_size && !update_ubo(dp, pass))
+        goto error;
+    pl_prof_enter(&prof, PL_RENDER_CPU_BINDINGS);
 
     // Update the scissors
     rparams->scissors = params->scissors;
@@ -1527,18 +2637,31 @@ bool pl_dispatch_vertex(pl_dispatch dp, const struct pl_dispatch_vertex_params *
     rparams->index_fmt = params->index_fmt;
     rparams->index_buf = params->index_buf;
     rparams->index_offset = params->index_offset;
+    rparams->instance_count = params->instance_count;
+    rparams->instance_data = params->instance_data;
+    rparams->instance_buf = params->instance_buf;
+    rparams->instance_offset = params->instance_offset;
+    if (params->instance_data) {
+        size_t size = params->instance_count * params->instance_stride;
+        pl_buf buf = upload_instances(dp, pass, params->instance_data, size);
+        if (buf) {
+            rparams->instance_data = NULL;
+            rparams->instance_buf = buf;
+            rparams->instance_offset = 0;
+        }
+    }
     rparams->timer = PL_DEF(params->timer, pass->timer);
-    run_pass(dp, sh, pass);
+    run_pass(dp, sh, pass, start, &prof);
 
     ret = true;
     // fall through
 
 error:
-    // Reset the temporary buffers which we use to build the shader
-    for (int i = 0; i < PL_ARRAY_SIZE(dp->tmp); i++)
-        dp->tmp[i].len = 0;
-
-    pl_mutex_unlock(&dp->lock);
+    if (locked) {
+        prof_merge(dp, &prof);
+        pl_mutex_unlock(&dp->lock);
+    }
+    scratch_put(dp, scratch);
     pl_dispatch_abort(dp, params->shader);
     return ret;
 }
@@ -1553,26 +2676,48 @@ void pl_dispatch_abort(pl_dispatch dp, pl_shader *psh)
     pl_shader_reset(sh, NULL);
 
     // Re-add the shader to the internal pool of shaders
-    pl_mutex_lock(&dp->lock);
-    PL_ARRAY_APPEND(dp, dp->shaders, sh);
-    pl_mutex_unlock(&dp->lock);
+    pl_mutex_lock(&dp->pool_lock);
+    PL_ARRAY_APPEND(NULL, dp->shaders, sh);
+    pl_mutex_unlock(&dp->pool_lock);
     *psh = NULL;
 }
 
 void pl_dispatch_reset_frame(pl_dispatch dp)
 {
-    pl_mutex_lock(&dp->lock);
-
+    pl_mutex_lock(&dp->pool_lock);
     dp->current_ident = 0;
     dp->current_index++;
+    dp->const_frame++;
+    pl_mutex_unlock(&dp->pool_lock);
+
+    pl_mutex_lock(&dp->lock);
+    ubo_ring_end_frame(dp);
+    dp->frame++;
     garbage_collect_passes(dp);
 
+    if (dp->trace_file) {
+        char name[32];
+        snprintf(name, sizeof(name), "frame %"PRIu64, dp->frame);
+        trace_event(dp, "i", TRACE_DISPATCH, "frame", name, pl_clock_now());
+        fprintf(dp->trace_file, ",\"s\":\"g\"}");
+    }
+
+    pl_mutex_unlock(&dp->lock);
+}
+
+void pl_dispatch_pass_budget(pl_dispatch dp, int max_passes, size_t max_bytes)
+{
+    pl_mutex_lock(&dp->lock);
+    dp->max_passes = max_passes;
+    dp->max_pass_bytes = max_bytes;
+    dp->warned_budget = false;
+    garbage_collect_passes(dp);
     pl_mutex_unlock(&dp->lock);
 }
 
 // Stuff related to caching
 static const char cache_magic[] = {'P', 'L', 'D', 'P'};
-static const uint32_t cache_version = 1;
+static const uint32_t cache_version = 2;
 
 static void write_buf(uint8_t *buf, size_t *pos, const void *src, size_t size)
 {
@@ -1596,6 +2741,7 @@ size_t pl_dispatch_save(pl_dispatch dp, uint8_t *out)
 
     write_buf(out, &size, cache_magic, sizeof(cache_magic));
     WRITE(uint32_t, cache_version);
+    WRITE(uint32_t, PL_MEM_HASH_ID);
 
     // Remember this position so we can go back and write the actual number of
     // cached programs
@@ -1604,8 +2750,7 @@ size_t pl_dispatch_save(pl_dispatch dp, uint8_t *out)
     size += sizeof(num_passes);
 
     // Save the cached programs for all compiled passes
-    for (int i = 0; i < dp->passes.num; i++) {
-        const struct pass *pass = dp->passes.elem[i];
+    for (const struct pass *pass = dp->lru_head; pass; pass = pass->lru_next) {
         if (!pass->pass)
             continue;
 
@@ -1666,6 +2811,14 @@ void pl_dispatch_load(pl_dispatch dp, const uint8_t *cache)
         return;
     }
 
+    // Signatures are only meaningful if computed by the same hash function
+    uint32_t hash_id;
+    LOAD(hash_id);
+    if (hash_id != PL_MEM_HASH_ID) {
+        PL_WARN(dp, "Failed loading dispatch cache: signature hash mismatch");
+        return;
+    }
+
     uint32_t num;
     LOAD(num);
 
@@ -1678,13 +2831,11 @@ void pl_dispatch_load(pl_dispatch dp, const uint8_t *cache)
             continue;
 
         // Skip passes that are already compiled
-        for (int n = 0; n < dp->passes.num; n++) {
-            if (dp->passes.elem[n]->signature == sig) {
-                PL_DEBUG(dp, "Skipping already compiled pass with signature %llx",
-                         (unsigned long long) sig);
-                cache += size;
-                continue;
-            }
+        if (pass_lookup(dp, sig)) {
+            PL_DEBUG(dp, "Skipping already compiled pass with signature %llx",
+                     (unsigned long long) sig);
+            cache += size;
+            continue;
         }
 
         // Find a cached_pass entry with this signature, if any
@@ -1706,10 +2857,410 @@ void pl_dispatch_load(pl_dispatch dp, const uint8_t *cache)
         PL_DEBUG(dp, "Loading %zu bytes of cached program with signature 0x%llx",
                  (size_t) size, (unsigned long long) sig);
 
-        pl_free((void *) pass->cached_program);
+        if (!pass->mapped)
+            pl_free((void *) pass->cached_program);
         pass->cached_program = pl_memdup(dp, cache, size);
         pass->cached_program_len = size;
+        pass->mapped = false;
         cache += size;
     }
     pl_mutex_unlock(&dp->lock);
 }
+
+// Persistent program cache file. This consists of a short header
+// followed by an append-only list of records, each containing the signature
+// and size of a cached program followed by the program data itself. Records
+// appearing later in the file override earlier ones.
+static const char cache_file_magic[] = {'P', 'L', 'D', 'C'};
+static const uint32_t cache_file_version = 2;
+static const uint32_t cache_file_hash_id = PL_MEM_HASH_ID;
+
+#define CACHE_FILE_HEADER_SIZE (sizeof(cache_file_magic) + 2 * sizeof(uint32_t))
+#define CACHE_FILE_RECORD_SIZE (2 * sizeof(uint64_t))
+#define CACHE_FILE_DEFAULT_SIZE (64 << 20)
+
+static int *cache_bucket(pl_dispatch dp, uint64_t sig)
+{
+    return &dp->cache_table[sig & (dp->cache_table_size - 1)];
+}
+
+static struct cache_record *cache_file_find(pl_dispatch dp, uint64_t sig)
+{
+    if (!dp->cache_table_size)
+        return NULL;
+
+    for (int i = *cache_bucket(dp, sig); i >= 0;) {
+        struct cache_record *rec = &dp->cache_index.elem[i];
+        if (rec->signature == sig)
+            return rec;
+        i = rec->hash_next;
+    }
+
+    return NULL;
+}
+
+static void cache_index_reset(pl_dispatch dp)
+{
+    dp->cache_index.num = 0;
+    for (int i = 0; i < dp->cache_table_size; i++)
+        dp->cache_table[i] = -1;
+}
+
+static void cache_index_add(pl_dispatch dp, struct cache_record rec)
+{
+    if (dp->cache_index.num >= dp->cache_table_size) {
+        // Grow and rehash the table
+        int new_size = PL_MAX(dp->cache_table_size * 2, 64);
+        pl_free(dp->cache_table);
+        dp->cache_table = pl_calloc_ptr(dp, new_size, dp->cache_table);
+        dp->cache_table_size = new_size;
+        for (int i = 0; i < new_size; i++)
+            dp->cache_table[i] = -1;
+        for (int i = 0; i < dp->cache_index.num; i++) {
+            int *bucket = cache_bucket(dp, dp->cache_index.elem[i].signature);
+            dp->cache_index.elem[i].hash_next = *bucket;
+            *bucket = i;
+        }
+    }
+
+    int *bucket = cache_bucket(dp, rec.signature);
+    rec.hash_next = *bucket;
+    *bucket = dp->cache_index.num;
+    PL_ARRAY_APPEND(dp, dp->cache_index, rec);
+}
+
+static bool write_header(FILE *f)
+{
+    return fwrite(cache_file_magic, sizeof(cache_file_magic), 1, f) == 1 &&
+           fwrite(&cache_file_version, sizeof(cache_file_version), 1, f) == 1 &&
+           fwrite(&cache_file_hash_id, sizeof(cache_file_hash_id), 1, f) == 1;
+}
+
+static bool write_record(FILE *f, uint64_t sig, const void *data, uint64_t size)
+{
+    return fwrite(&sig, sizeof(sig), 1, f) == 1 &&
+           fwrite(&size, sizeof(size), 1, f) == 1 &&
+           fwrite(data, size, 1, f) == 1;
+}
+
+// Returns read-only access to the first `size` bytes of `f`
+static const uint8_t *map_file(pl_dispatch dp, FILE *f, size_t size)
+{
+#ifdef PL_HAVE_WIN32
+    // No mmap, so just read the whole file instead
+    uint8_t *data = pl_alloc(dp, size);
+    if (fseek(f, 0, SEEK_SET) != 0 || fread(data, size, 1, f) != 1) {
+        pl_free(data);
+        return NULL;
+    }
+    return data;
+#else
+    void *data = mmap(NULL, size, PROT_READ, MAP_SHARED, fileno(f), 0);
+    if (data == MAP_FAILED)
+        return NULL;
+    PL_ARRAY_APPEND(dp, dp->cache_maps, (struct cache_map) { data, size });
+    return data;
+#endif
+}
+
+static int cmp_record_use(const void *pa, const void *pb)
+{
+    const struct cache_record *a = pa, *b = pb;
+    return PL_CMP(b->last_use, a->last_use);
+}
+
+// Rewrite the cache file, keeping only the most recently used records that
+// fit within `budget` bytes
+static bool cache_file_compact(pl_dispatch dp, size_t budget)
+{
+    void *tmp = pl_tmp(NULL);
+    char *tmp_path = pl_asprintf(tmp, "%s.tmp", dp->cache_path);
+    FILE *out = fopen(tmp_path, "w+b");
+    if (!out) {
+        PL_ERR(dp, "Failed creating '%s': %s", tmp_path, strerror(errno));
+        goto error;
+    }
+
+    struct cache_record *recs;
+    int num_recs = dp->cache_index.num;
+    recs = pl_memdup(tmp, dp->cache_index.elem, num_recs * sizeof(*recs));
+    qsort(recs, num_recs, sizeof(*recs), cmp_record_use);
+
+    uint8_t *buf = NULL;
+    size_t pos = CACHE_FILE_HEADER_SIZE;
+    int num_kept = 0;
+    if (!write_header(out))
+        goto write_error;
+
+    for (int i = 0; i < num_recs; i++) {
+        struct cache_record rec = recs[i];
+        if (pos + CACHE_FILE_RECORD_SIZE + rec.size > budget)
+            continue;
+
+        buf = pl_realloc(tmp, buf, rec.size);
+        if (fseek(dp->cache_file, rec.offset, SEEK_SET) != 0 ||
+            fread(buf, rec.size, 1, dp->cache_file) != 1)
+        {
+            PL_WARN(dp, "Failed reading cache file '%s', dropping record",
+                    dp->cache_path);
+            continue;
+        }
+
+        if (!write_record(out, rec.signature, buf, rec.size))
+            goto write_error;
+
+        rec.offset = pos + CACHE_FILE_RECORD_SIZE;
+        recs[num_kept++] = rec;
+        pos += CACHE_FILE_RECORD_SIZE + rec.size;
+    }
+
+    if (fflush(out) != 0)
+        goto write_error;
+
+    fclose(dp->cache_file);
+    dp->cache_file = NULL;
+#ifdef PL_HAVE_WIN32
+    remove(dp->cache_path); // rename() doesn't replace existing files
+#endif
+    if (rename(tmp_path, dp->cache_path) != 0) {
+        PL_ERR(dp, "Failed renaming '%s': %s", tmp_path, strerror(errno));
+        goto error;
+    }
+
+    PL_DEBUG(dp, "Compacted cache file '%s' from %zu to %zu bytes, evicted %d "
+             "programs", dp->cache_path, dp->cache_size, pos, num_recs - num_kept);
+
+    dp->cache_file = out;
+    dp->cache_size = pos;
+    cache_index_reset(dp);
+    for (int i = 0; i < num_kept; i++)
+        cache_index_add(dp, recs[i]);
+
+    pl_free(tmp);
+    return true;
+
+write_error:
+    PL_ERR(dp, "Failed writing '%s': %s", tmp_path, strerror(errno));
+    // fall through
+error:
+    if (out) {
+        fclose(out);
+        remove(tmp_path);
+    }
+    pl_free(tmp);
+    return false;
+}
+
+static void cache_file_close(pl_dispatch dp)
+{
+    if (dp->cache_file)
+        fclose(dp->cache_file);
+    dp->cache_file = NULL;
+    dp->cache_size = 0;
+    cache_index_reset(dp);
+    pl_free_ptr(&dp->cache_path);
+}
+
+// Called with the lock held after compiling a pass
+static void gpu_cache_append(pl_dispatch dp, const struct pass *pass, pl_pass pl)
+{
+    pl_cache cache = pl_gpu_cache(dp->gpu);
+    if (!cache || !pl || !pl->params.cached_program_len)
+        return;
+
+    const void *data = pl->params.cached_program;
+    size_t size = pl->params.cached_program_len;
+    if (pass->cache_hash && pl_mem_hash(data, size) == pass->cache_hash)
+        return; // unchanged from the version retrieved from the cache
+
+    pl_cache_set_copy(cache, pl_cache_key(PL_CACHE_KEY_PROGRAM, pass->signature),
+                      data, size);
+}
+
+// Called with the lock held after compiling a pass
+static void cache_file_append(pl_dispatch dp, uint64_t sig, pl_pass pass)
+{
+    if (!dp->cache_file || !pass || !pass->params.cached_program_len)
+        return;
+
+    struct cache_record *rec = cache_file_find(dp, sig);
+    if (rec) {
+        rec->last_use = ++dp->cache_clock;
+        return;
+    }
+
+    size_t size = pass->params.cached_program_len;
+    size_t rec_size = CACHE_FILE_RECORD_SIZE + size;
+    if (CACHE_FILE_HEADER_SIZE + rec_size > dp->cache_max_size) {
+        PL_DEBUG(dp, "Cached program (%zu bytes) exceeds cache file size "
+                 "budget, skipping", size);
+        return;
+    }
+
+    if (dp->cache_size + rec_size > dp->cache_max_size) {
+        // Compact to below the budget by some margin, to avoid having to
+        // re-compact again on every subsequent append
+        size_t budget = dp->cache_max_size * 3 / 4;
+        budget = budget > rec_size ? budget - rec_size : 0;
+        if (!cache_file_compact(dp, budget)) {
+            PL_ERR(dp, "Failed compacting cache file, disabling");
+            cache_file_close(dp);
+            return;
+        }
+    }
+
+    if (fseek(dp->cache_file, dp->cache_size, SEEK_SET) != 0 ||
+        !write_record(dp->cache_file, sig, pass->params.cached_program, size) ||
+        fflush(dp->cache_file) != 0)
+    {
+        PL_ERR(dp, "Failed writing to cache file '%s': %s, disabling",
+               dp->cache_path, strerror(errno));
+        cache_file_close(dp);
+        return;
+    }
+
+    PL_DEBUG(dp, "Appended %zu bytes of cached program with signature 0x%llx "
+             "to cache file", size, (unsigned long long) sig);
+
+    cache_index_add(dp, (struct cache_record) {
+        .signature = sig,
+        .offset = dp->cache_size + CACHE_FILE_RECORD_SIZE,
+        .size = size,
+        .last_use = ++dp->cache_clock,
+    });
+    dp->cache_size += rec_size;
+}
+
+// Makes `data` available as the cached program for signature `sig`
+static void add_mapped_program(pl_dispatch dp, uint64_t sig,
+                               const uint8_t *data, size_t size)
+{
+    if (pass_lookup(dp, sig))
+        return; // already compiled
+
+    struct cached_pass *pass = NULL;
+    for (int i = 0; i < dp->cached_passes.num; i++) {
+        if (dp->cached_passes.elem[i].signature == sig) {
+            pass = &dp->cached_passes.elem[i];
+            if (!pass->mapped)
+                pl_free((void *) pass->cached_program);
+            break;
+        }
+    }
+
+    if (!pass) {
+        PL_ARRAY_GROW(dp, dp->cached_passes);
+        pass = &dp->cached_passes.elem[dp->cached_passes.num++];
+    }
+
+    *pass = (struct cached_pass) {
+        .signature = sig,
+        .cached_program = data,
+        .cached_program_len = size,
+        .mapped = true,
+    };
+}
+
+bool pl_dispatch_cache_open(pl_dispatch dp, const char *path, size_t max_size)
+{
+    pl_mutex_lock(&dp->lock);
+    cache_file_close(dp);
+    dp->cache_max_size = PL_DEF(max_size, CACHE_FILE_DEFAULT_SIZE);
+    dp->cache_path = pl_str0dup0(dp, path);
+
+    FILE *f = fopen(path, "r+b");
+    if (!f && errno == ENOENT)
+        f = fopen(path, "w+b");
+    if (!f) {
+        PL_ERR(dp, "Failed opening cache file '%s': %s", path, strerror(errno));
+        goto error;
+    }
+
+    dp->cache_file = f;
+    long file_size = fseek(f, 0, SEEK_END) == 0 ? ftell(f) : -1;
+    if (file_size < 0) {
+        PL_ERR(dp, "Failed seeking cache file '%s': %s", path, strerror(errno));
+        goto error;
+    }
+
+    size_t size = file_size, pos = 0;
+    const uint8_t *data = NULL;
+    if (size >= CACHE_FILE_HEADER_SIZE && !(data = map_file(dp, f, size)))
+        PL_WARN(dp, "Failed mapping cache file '%s', ignoring contents", path);
+
+    if (data) {
+        uint32_t version, hash_id;
+        memcpy(&version, data + sizeof(cache_file_magic), sizeof(version));
+        memcpy(&hash_id, data + sizeof(cache_file_magic) + sizeof(version),
+               sizeof(hash_id));
+        if (memcmp(data, cache_file_magic, sizeof(cache_file_magic)) != 0 ||
+            version != cache_file_version || hash_id != cache_file_hash_id)
+        {
+            PL_WARN(dp, "Cache file '%s' has invalid header or wrong version, "
+                    "discarding contents", path);
+            data = NULL;
+        }
+    }
+
+    if (data) {
+        pos = CACHE_FILE_HEADER_SIZE;
+        while (size - pos >= CACHE_FILE_RECORD_SIZE) {
+            uint64_t sig, len;
+            memcpy(&sig, data + pos, sizeof(sig));
+            memcpy(&len, data + pos + sizeof(sig), sizeof(len));
+            if (!len || len > size - pos - CACHE_FILE_RECORD_SIZE)
+                break;
+
+            size_t offset = pos + CACHE_FILE_RECORD_SIZE;
+            add_mapped_program(dp, sig, data + offset, len);
+            struct cache_record *rec = cache_file_find(dp, sig);
+            if (rec) {
+                rec->offset = offset;
+                rec->size = len;
+                rec->last_use = ++dp->cache_clock;
+            } else {
+                cache_index_add(dp, (struct cache_record) {
+                    .signature = sig,
+                    .offset = offset,
+                    .size = len,
+                    .last_use = ++dp->cache_clock,
+                });
+            }
+
+            pos = offset + len;
+        }
+
+        PL_DEBUG(dp, "Loaded %d cached programs from cache file '%s'",
+                 dp->cache_index.num, path);
+    }
+
+    if (!pos) {
+        // New or invalid file, (re)initialize it
+        fclose(f);
+        dp->cache_file = f = fopen(path, "w+b");
+        if (!f || !write_header(f) || fflush(f) != 0) {
+            PL_ERR(dp, "Failed initializing cache file '%s': %s",
+                   path, strerror(errno));
+            goto error;
+        }
+        dp->cache_size = CACHE_FILE_HEADER_SIZE;
+    } else {
+        dp->cache_size = pos;
+        if (pos < size || size > dp->cache_max_size) {
+            // Get rid of trailing garbage (e.g. from an interrupted write), or
+            // shrink the file to a changed budget
+            if (pos < size)
+                PL_WARN(dp, "Cache file '%s' is truncated or corrupt", path);
+            if (!cache_file_compact(dp, dp->cache_max_size))
+                goto error;
+        }
+    }
+
+    pl_mutex_unlock(&dp->lock);
+    return true;
+
+error:
+    cache_file_close(dp);
+    pl_mutex_unlock(&dp->lock);
+    return false;
+}
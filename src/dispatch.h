@@ -29,3 +29,26 @@ pl_shader pl_dispatch_begin_ex(pl_dispatch dp, bool unique);
 //
 // This is a private API because it's sort of clunky/stateful.
 void pl_dispatch_mark_dynamic(pl_dispatch dp, bool dynamic);
+
+// Returns true if the (non-compile-time) constant `sc` should be turned into a
+// dynamic variable instead, because its value has kept changing in recent
+// frames. Called by `sh_const` for every constant added to shaders created by
+// this dispatch. Constants are told apart by their name, the shader step
+// `desc` they belong to (may be NULL), and their order of appearance.
+bool pl_dispatch_const_dynamic(pl_dispatch dp, const char *desc,
+                               const struct pl_shader_const *sc);
+
+// Set the `half_precision` field for newly created `pl_shader` objects.
+void pl_dispatch_mark_half(pl_dispatch dp, bool half);
+
+// Set the `fast_transfer` field for newly created `pl_shader` objects.
+void pl_dispatch_mark_fast_transfer(pl_dispatch dp, bool fast);
+
+// If enabled, passes are still generated and compiled (or loaded from the
+// cache) as usual, but never actually executed. Used for pre-compilation.
+void pl_dispatch_compile_only(pl_dispatch dp, bool enable);
+
+// Returns the cumulative CPU time spent in the dispatch-related sections of
+// `enum pl_render_cpu_section` so far. The remaining sections are always 0,
+// as is everything unless built with `-Dcpu-profiling=true`.
+void pl_dispatch_cpu_times(pl_dispatch dp, uint64_t out[PL_RENDER_CPU_COUNT]);
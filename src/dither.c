@@ -119,54 +119,72 @@ static void makegauss(struct ctx *k, unsigned int sizeb)
 #endif
 }
 
-static void setbit(struct ctx *k, index_t c)
+// Picks one of the (not yet set) entries with the lowest energy at random
+static index_t pickmin(struct ctx *k, index_t resnum)
 {
-    if (k->calcmat[c])
-        return;
-    k->calcmat[c] = true;
-    uint64_t *m = k->gaussmat;
-    uint64_t *me = k->gaussmat + k->size2;
-    uint64_t *g = k->gauss + WRAP_SIZE2(k, k->gauss_middle + k->size2 - c);
-    uint64_t *ge = k->gauss + k->size2;
-    while (g < ge)
-        *m++ += *g++;
-    g = k->gauss;
-    while (m < me)
-        *m++ += *g++;
+    assert(resnum > 0);
+    if (resnum == 1)
+        return k->randomat[0];
+    if (resnum == k->size2)
+        return k->size2 / 2;
+    return k->randomat[rand() % resnum];
 }
 
-static index_t getmin(struct ctx *k)
+struct minstate {
+    uint64_t min;
+    index_t resnum;
+};
+
+// Adds `g` to the energy of the entries in [start, end), while also keeping
+// track of the set of (not yet set) entries with the lowest energy
+static inline void addmin(struct ctx *k, struct minstate *st, const uint64_t *g,
+                          index_t start, index_t end)
 {
-    uint64_t min = UINT64_MAX;
-    index_t resnum = 0;
-    unsigned int size2 = k->size2;
-    for (index_t c = 0; c < size2; c++) {
-        if (k->calcmat[c])
+    uint64_t *m = k->gaussmat;
+    const bool *done = k->calcmat;
+    uint64_t min = st->min;
+    index_t resnum = st->resnum;
+    for (index_t i = start; i < end; i++) {
+        uint64_t total = m[i] + *g++;
+        m[i] = total;
+        if (total > min || done[i])
             continue;
-        uint64_t total = k->gaussmat[c];
-        if (total <= min) {
-            if (total != min) {
-                min = total;
-                resnum = 0;
-            }
-            k->randomat[resnum++] = c;
+        if (total != min) {
+            min = total;
+            resnum = 0;
         }
+        k->randomat[resnum++] = i;
     }
-    assert(resnum > 0);
-    if (resnum == 1)
-        return k->randomat[0];
-    if (resnum == size2)
-        return size2 / 2;
-    return k->randomat[rand() % resnum];
+
+    st->min = min;
+    st->resnum = resnum;
+}
+
+// Sets the bit at `c` and returns the next entry to set. This fuses the
+// energy update and the search for the new minimum into a single pass over
+// the matrix, which roughly halves the cost of generating it.
+static index_t setbit_getmin(struct ctx *k, index_t c)
+{
+    pl_assert(!k->calcmat[c]);
+    k->calcmat[c] = true;
+
+    // The kernel wraps around, so apply it in two halves
+    const unsigned int size2 = k->size2;
+    const index_t offset = WRAP_SIZE2(k, k->gauss_middle + size2 - c);
+    struct minstate st = { .min = UINT64_MAX };
+    addmin(k, &st, k->gauss + offset, 0, size2 - offset);
+    addmin(k, &st, k->gauss, size2 - offset, size2);
+    return st.resnum ? pickmin(k, st.resnum) : 0;
 }
 
 static void makeuniform(struct ctx *k)
 {
+    // Initially, all entries have the same (zero) energy
     unsigned int size2 = k->size2;
+    index_t r = pickmin(k, size2);
     for (index_t c = 0; c < size2; c++) {
-        index_t r = getmin(k);
-        setbit(k, r);
         k->unimat[r] = c;
+        r = setbit_getmin(k, r);
     }
 }
 
@@ -15,10 +15,12 @@
  * License along with libplacebo. If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <ctype.h>
 #include <limits.h>
 #include <string.h>
 
 #include "gpu.h"
+#include "pl_thread.h"
 
 const struct pl_gpu_dummy_params pl_gpu_dummy_default_params = { PL_GPU_DUMMY_DEFAULTS };
 static const struct pl_gpu_fns pl_fns_dummy;
@@ -26,8 +28,41 @@ static const struct pl_gpu_fns pl_fns_dummy;
 struct priv {
     struct pl_gpu_fns impl;
     struct pl_gpu_dummy_params params;
+
+    // For `record_stats`
+    pl_mutex lock;
+    struct pl_gpu_dummy_stats stats;
 };
 
+#define RECORD(gpu, ...)                                                        \
+    do {                                                                        \
+        struct priv *p_ = PL_PRIV(gpu);                                         \
+        if (p_->params.record_stats) {                                          \
+            struct pl_gpu_dummy_stats *stats = &p_->stats;                      \
+            pl_mutex_lock(&p_->lock);                                           \
+            __VA_ARGS__;                                                        \
+            stats->vram_peak = PL_MAX(stats->vram_peak, stats->vram);           \
+            pl_mutex_unlock(&p_->lock);                                         \
+        }                                                                       \
+    } while (0)
+
+struct pl_gpu_dummy_stats pl_gpu_dummy_get_stats(pl_gpu gpu)
+{
+    struct priv *p = PL_PRIV(gpu);
+    pl_mutex_lock(&p->lock);
+    struct pl_gpu_dummy_stats stats = p->stats;
+    pl_mutex_unlock(&p->lock);
+    return stats;
+}
+
+void pl_gpu_dummy_reset_stats(pl_gpu gpu)
+{
+    RECORD(gpu, *stats = (struct pl_gpu_dummy_stats) {
+        .vram = stats->vram,
+        .vram_peak = stats->vram,
+    });
+}
+
 pl_gpu pl_gpu_dummy_create(pl_log log, const struct pl_gpu_dummy_params *params)
 {
     params = PL_DEF(params, &pl_gpu_dummy_default_params);
@@ -41,6 +76,7 @@ pl_gpu pl_gpu_dummy_create(pl_log log, const struct pl_gpu_dummy_params *params)
     struct priv *p = PL_PRIV(gpu);
     p->impl = pl_fns_dummy;
     p->params = *params;
+    pl_mutex_init(&p->lock);
 
     // Forcibly override these, because we know for sure what the values are
     gpu->limits.align_tex_xfer_pitch = 1;
@@ -120,6 +156,8 @@ pl_gpu pl_gpu_dummy_create(pl_log log, const struct pl_gpu_dummy_params *params)
 
 static void dumb_destroy(pl_gpu gpu)
 {
+    struct priv *p = PL_PRIV(gpu);
+    pl_mutex_destroy(&p->lock);
     pl_free((void *) gpu);
 }
 
@@ -152,12 +190,20 @@ static pl_buf dumb_buf_create(pl_gpu gpu, const struct pl_buf_params *params)
     if (params->host_mapped)
         buf->data = p->data;
 
+    RECORD(gpu,
+        stats->buf_allocs++;
+        stats->vram += params->size;
+        if (params->initial_data)
+            stats->bytes_uploaded += params->size
+    );
+
     return buf;
 }
 
 static void dumb_buf_destroy(pl_gpu gpu, pl_buf buf)
 {
     struct buf_priv *p = PL_PRIV(buf);
+    RECORD(gpu, stats->vram -= buf->params.size);
     free(p->data);
     pl_free((void *) buf);
 }
@@ -173,6 +219,7 @@ static void dumb_buf_write(pl_gpu gpu, pl_buf buf, size_t buf_offset,
 {
     struct buf_priv *p = PL_PRIV(buf);
     memcpy(p->data + buf_offset, data, size);
+    RECORD(gpu, stats->bytes_uploaded += size);
 }
 
 static bool dumb_buf_read(pl_gpu gpu, pl_buf buf, size_t buf_offset,
@@ -180,6 +227,7 @@ static bool dumb_buf_read(pl_gpu gpu, pl_buf buf, size_t buf_offset,
 {
     struct buf_priv *p = PL_PRIV(buf);
     memcpy(dest, p->data + buf_offset, size);
+    RECORD(gpu, stats->bytes_downloaded += size);
     return true;
 }
 
@@ -220,6 +268,13 @@ static pl_tex dumb_tex_create(pl_gpu gpu, const struct pl_tex_params *params)
     if (params->initial_data)
         memcpy(p->data, params->initial_data, tex_size(gpu, tex));
 
+    RECORD(gpu,
+        stats->tex_allocs++;
+        stats->vram += tex_size(gpu, tex);
+        if (params->initial_data)
+            stats->bytes_uploaded += tex_size(gpu, tex)
+    );
+
     return tex;
 }
 
@@ -239,14 +294,17 @@ pl_tex pl_tex_dummy_create(pl_gpu gpu, const struct pl_tex_dummy_params *params)
         .user_data = params->user_data,
     };
 
+    pl_gpu_track_tex(gpu, tex);
     return tex;
 }
 
 static void dumb_tex_destroy(pl_gpu gpu, pl_tex tex)
 {
     struct tex_priv *p = PL_PRIV(tex);
-    if (p->data)
+    if (p->data) {
+        RECORD(gpu, stats->vram -= tex_size(gpu, tex));
         free(p->data);
+    }
     pl_free((void *) tex);
 }
 
@@ -282,6 +340,10 @@ static bool dumb_tex_upload(pl_gpu gpu, const struct pl_tex_transfer_params *par
         }
     }
 
+    RECORD(gpu,
+        stats->tex_uploads++;
+        stats->bytes_uploaded += pl_rect_d(params->rc) * pl_rect_h(params->rc) * row_size
+    );
     return true;
 }
 
@@ -311,6 +373,10 @@ static bool dumb_tex_download(pl_gpu gpu, const struct pl_tex_transfer_params *p
         }
     }
 
+    RECORD(gpu,
+        stats->tex_downloads++;
+        stats->bytes_downloaded += pl_rect_d(params->rc) * pl_rect_h(params->rc) * row_size
+    );
     return true;
 }
 
@@ -319,10 +385,172 @@ static int dumb_desc_namespace(pl_gpu gpu, enum pl_desc_type type)
     return 0; // safest behavior: never alias bindings
 }
 
+// Rough estimate of the work done by a single shader invocation
+struct pass_priv {
+    int tex_fetches;
+    int alu_ops;
+    int group_size;
+};
+
+// Counts the calls to any of the given (NULL-terminated) functions
+static int count_calls(pl_str glsl, const char *const names[])
+{
+    int num = 0;
+    for (int i = 0; names[i]; i++) {
+        pl_str name = pl_str0(names[i]);
+        pl_str rest = glsl;
+        int pos;
+        while ((pos = pl_str_find(rest, name)) >= 0) {
+            bool ident = pos > 0 && (rest.buf[pos - 1] == '_' ||
+                                     isalnum(rest.buf[pos - 1]));
+            rest = pl_str_drop(rest, pos + name.len);
+            if (!ident && pl_str_startswith0(pl_str_strip(rest), "("))
+                num++;
+        }
+    }
+
+    return num;
+}
+
+static void estimate_cost(struct pass_priv *pp, const struct pl_pass_params *params)
+{
+    static const char *const fetches[] = {
+        "texture", "textureLod", "textureGrad", "textureOffset",
+        "textureLodOffset", "texelFetch", "texelFetchOffset", "textureGather",
+        "textureGatherOffset", "texture2D", "texture3D", "texture1D",
+        "texture2DRect", "imageLoad", NULL,
+    };
+
+    static const char *const builtins[] = {
+        "abs", "clamp", "cos", "cross", "distance", "dot", "exp", "exp2",
+        "floor", "fract", "inversesqrt", "length", "log", "log2", "max",
+        "min", "mix", "mod", "normalize", "pow", "sign", "sin", "smoothstep",
+        "sqrt", "step", "tan", "atan", NULL,
+    };
+
+    pl_str glsl = pl_str0(params->glsl_shader);
+    pp->tex_fetches = count_calls(glsl, fetches);
+    pp->alu_ops = count_calls(glsl, builtins);
+    for (size_t i = 0; i < glsl.len; i++) {
+        switch (glsl.buf[i]) {
+        case '+': case '-': case '*': case '/':
+            pp->alu_ops++;
+            break;
+        }
+    }
+
+    pp->group_size = 1;
+    static const char *const dims[] = {
+        "local_size_x", "local_size_y", "local_size_z",
+    };
+
+    for (int i = 0; i < PL_ARRAY_SIZE(dims); i++) {
+        int pos = pl_str_find(glsl, pl_str0(dims[i]));
+        if (pos < 0)
+            continue;
+        pl_str rest = pl_str_drop(glsl, pos + strlen(dims[i]));
+        rest = pl_str_strip(rest);
+        if (!pl_str_eatstart0(&rest, "="))
+            continue;
+        int size = 1;
+        rest = pl_str_strip(rest);
+        pl_str num = pl_str_split_char(rest, ',', NULL);
+        num = pl_str_split_char(num, ')', NULL);
+        if (pl_str_parse_int(pl_str_strip(num), &size) && size > 0)
+            pp->group_size *= size;
+    }
+}
+
 static pl_pass dumb_pass_create(pl_gpu gpu, const struct pl_pass_params *params)
 {
-    PL_ERR(gpu, "Creating render passes is not supported for dummy GPUs");
-    return NULL;
+    struct priv *p = PL_PRIV(gpu);
+    if (!p->params.noop_passes) {
+        PL_ERR(gpu, "Creating render passes is not supported for dummy GPUs");
+        return NULL;
+    }
+
+    struct pl_pass *pass = pl_zalloc_obj(NULL, pass, struct pass_priv);
+    pass->params = pl_pass_params_copy(pass, params);
+    if (p->params.record_stats)
+        estimate_cost(PL_PRIV(pass), params);
+    return pass;
+}
+
+static void dumb_pass_destroy(pl_gpu gpu, pl_pass pass)
+{
+    pl_free((void *) pass);
+}
+
+static void dumb_pass_run(pl_gpu gpu, const struct pl_pass_run_params *params)
+{
+    struct priv *p = PL_PRIV(gpu);
+    if (!p->params.record_stats)
+        return;
+
+    pl_pass pass = params->pass;
+    struct pass_priv *pp = PL_PRIV(pass);
+    uint64_t invocations = 0, bytes_read = 0, bytes_written = 0;
+
+    switch (pass->params.type) {
+    case PL_PASS_RASTER: {
+        pl_tex target = params->target;
+        size_t texel_size = target->params.format->texel_size;
+        invocations = (uint64_t) pl_rect_w(params->scissors) *
+                      pl_rect_h(params->scissors);
+        bytes_written += invocations * texel_size;
+        if (pass->params.load_target || pass->params.blend_params)
+            bytes_read += invocations * texel_size;
+        break;
+    }
+    case PL_PASS_COMPUTE:
+        invocations = (uint64_t) pp->group_size * params->compute_groups[0] *
+                      params->compute_groups[1] * params->compute_groups[2];
+        break;
+    case PL_PASS_INVALID:
+    case PL_PASS_TYPE_COUNT:
+        pl_unreachable();
+    }
+
+    for (int i = 0; i < pass->params.num_descriptors; i++) {
+        const struct pl_desc *desc = &pass->params.descriptors[i];
+        struct pl_desc_binding db = params->desc_bindings[i];
+        size_t size = 0;
+        switch (desc->type) {
+        case PL_DESC_SAMPLED_TEX:
+        case PL_DESC_STORAGE_IMG:
+            size = tex_size(gpu, db.object);
+            break;
+        case PL_DESC_BUF_UNIFORM:
+        case PL_DESC_BUF_STORAGE: {
+            pl_buf buf = db.object;
+            size = PL_DEF(db.buf_size, buf->params.size - db.buf_offset);
+            break;
+        }
+        case PL_DESC_BUF_TEXEL_UNIFORM:
+        case PL_DESC_BUF_TEXEL_STORAGE: {
+            pl_buf buf = db.object;
+            size = buf->params.size;
+            break;
+        }
+        case PL_DESC_INVALID:
+        case PL_DESC_TYPE_COUNT:
+            pl_unreachable();
+        }
+
+        if (desc->type == PL_DESC_SAMPLED_TEX || desc->access != PL_DESC_ACCESS_WRITEONLY)
+            bytes_read += size;
+        if (desc->type != PL_DESC_SAMPLED_TEX && desc->access != PL_DESC_ACCESS_READONLY)
+            bytes_written += size;
+    }
+
+    RECORD(gpu,
+        stats->pass_runs++;
+        stats->invocations += invocations;
+        stats->tex_fetches += invocations * pp->tex_fetches;
+        stats->alu_ops += invocations * pp->alu_ops;
+        stats->bytes_read += bytes_read;
+        stats->bytes_written += bytes_written
+    );
 }
 
 static void dumb_gpu_finish(pl_gpu gpu)
@@ -343,5 +571,7 @@ static const struct pl_gpu_fns pl_fns_dummy = {
     .tex_download = dumb_tex_download,
     .desc_namespace = dumb_desc_namespace,
     .pass_create = dumb_pass_create,
+    .pass_destroy = dumb_pass_destroy,
+    .pass_run = dumb_pass_run,
     .gpu_finish = dumb_gpu_finish,
 };
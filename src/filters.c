@@ -104,30 +104,31 @@ double pl_filter_sample(const struct pl_filter_config *c, double x)
 // by the indicated subpixel offset. Writes `f->row_size` values to `out`.
 static void compute_row(struct pl_filter *f, double offset, float *out)
 {
+    // For the example of a filter with row size 4 and offset 0.3, we have:
+    //
+    // 0    1 *  2    3
+    //
+    // * indicates the sampled position. What we want to compute is the
+    // distance from each index to that sampled position.
+    pl_assert(f->row_size % 2 == 0);
+    const int base = f->row_size / 2 - 1; // index to the left of the center
+    const double center = base + offset; // offset of center relative to idx 0
+
+    // Stretch/squish the kernel by readjusting the value range
+    const double stretch = f->params.config.kernel->radius / f->radius;
+
     double wsum = 0.0;
     for (int i = 0; i < f->row_size; i++) {
-        // For the example of a filter with row size 4 and offset 0.3, we have:
-        //
-        // 0    1 *  2    3
-        //
-        // * indicates the sampled position. What we want to compute is the
-        // distance from each index to that sampled position.
-        pl_assert(f->row_size % 2 == 0);
-        const int base = f->row_size / 2 - 1; // index to the left of the center
-        const double center = base + offset; // offset of center relative to idx 0
-        double x = i - center;
-
-        // Stretch/squish the kernel by readjusting the value range
-        x *= f->params.config.kernel->radius / f->radius;
-        double w = pl_filter_sample(&f->params.config, x);
+        double w = pl_filter_sample(&f->params.config, (i - center) * stretch);
         out[i] = w;
         wsum += w;
     }
 
     // Readjust weights to preserve energy
     pl_assert(wsum > 0);
+    const double norm = 1.0 / wsum;
     for (int i = 0; i < f->row_size; i++)
-        out[i] /= wsum;
+        out[i] *= norm;
 }
 
 static struct pl_filter_function *dupfilter(void *alloc,
@@ -178,11 +179,21 @@ pl_filter pl_filter_generate(pl_log log, const struct pl_filter_params *params)
         }
         f->row_stride = PL_ALIGN(f->row_size, params->row_stride_align);
 
-        // Compute a 2D array indexed by the subpixel position
-        weights = pl_calloc(f, params->lut_entries * f->row_stride, sizeof(float));
-        for (int i = 0; i < params->lut_entries; i++) {
-            compute_row(f, i / (double)(params->lut_entries - 1),
-                        weights + f->row_stride * i);
+        // Compute a 2D array indexed by the subpixel position. Since all
+        // filters are symmetric, the row for offset `1 - x` is just the
+        // mirror image of the row for offset `x`, so only compute the first
+        // half of the rows and reflect them into the second half.
+        const int entries = params->lut_entries;
+        weights = pl_calloc(f, entries * f->row_stride, sizeof(float));
+        for (int i = 0; i < (entries + 1) / 2; i++) {
+            float *row = weights + f->row_stride * i;
+            compute_row(f, i / (double)(entries - 1), row);
+
+            float *mirror = weights + f->row_stride * (entries - 1 - i);
+            if (mirror == row)
+                continue;
+            for (int n = 0; n < f->row_size; n++)
+                mirror[n] = row[f->row_size - 1 - n];
         }
     }
 
@@ -21,6 +21,7 @@
 
 static int ccStrPrintInt32( char *str, int32_t n );
 static int ccStrPrintUint32( char *str, uint32_t n );
+static int ccStrPrintHex32( char *str, uint32_t n );
 static int ccStrPrintInt64( char *str, int64_t n );
 static int ccStrPrintUint64( char *str, uint64_t n );
 static int ccStrPrintDouble( char *str, int bufsize, int decimals, double value );
@@ -35,81 +36,116 @@ void pl_str_append_asprintf_c(void *alloc, pl_str *str, const char *fmt, ...)
     va_end(ap);
 }
 
+// Ensures `str` has room for `len` more bytes (plus a terminating \0), and
+// returns a pointer to the end of the string. `cap` caches the current size
+// of the allocation, to avoid having to query it on every append.
+static inline char *str_reserve(void *alloc, pl_str *str, size_t *cap, size_t len)
+{
+    size_t size = str->len + len + 1;
+    if (size > *cap) {
+        // Like pl_grow, but with some extra headroom
+        str->buf = pl_realloc(alloc, str->buf, size * 1.5);
+        *cap = pl_get_size(str->buf);
+    }
+
+    return (char *) str->buf + str->len;
+}
+
+static inline void str_append_raw(void *alloc, pl_str *str, size_t *cap,
+                                  const void *buf, size_t len)
+{
+    memcpy(str_reserve(alloc, str, cap, len), buf, len);
+    str->len += len;
+}
+
+#define NUM_BUFSIZE 32
+
 void pl_str_append_vasprintf_c(void *alloc, pl_str *str, const char *fmt,
                                va_list ap)
 {
-    for (const char *c; (c = strchr(fmt, '%')) != NULL; fmt = c + 1) {
-        // Append the preceding string literal
-        pl_str_append(alloc, str, (pl_str) { (uint8_t *) fmt, c - fmt });
-        c++; // skip '%'
+    if (!fmt[0])
+        return;
+
+    // Literal segments and formatted values are written directly into the
+    // output buffer, only growing it when needed
+    size_t cap = pl_get_size(str->buf);
+    for (;;) {
+        const char *c = strchr(fmt, '%');
+        str_append_raw(alloc, str, &cap, fmt, c ? c - fmt : strlen(fmt));
+        if (!c)
+            break;
 
-        char buf[32];
+        c++; // skip '%'
+        char *out;
         int len;
 
         // The format character follows the % sign
         switch (c[0]) {
         case '%':
-            pl_str_append(alloc, str, pl_str0("%"));
-            continue;
+            str_reserve(alloc, str, &cap, 1)[0] = '%';
+            str->len++;
+            break;
         case 'c':
-            buf[0] = (char) va_arg(ap, int);
-            pl_str_append(alloc, str, (pl_str) { (uint8_t *) buf, 1 });
-            continue;
-        case 's': {
-            const char *arg = va_arg(ap, const char *);
-            pl_str_append(alloc, str, pl_str0(arg));
-            continue;
-        }
-        case '.': { // only used for %.*s
+            str_reserve(alloc, str, &cap, 1)[0] = (char) va_arg(ap, int);
+            str->len++;
+            break;
+        case 's':
+            out = va_arg(ap, char *);
+            str_append_raw(alloc, str, &cap, out, strlen(out));
+            break;
+        case '.': // only used for %.*s
             assert(c[1] == '*');
             assert(c[2] == 's');
-            pl_str arg;
-            arg.len = va_arg(ap, int);
-            arg.buf = (uint8_t *) va_arg(ap, char *);
-            pl_str_append(alloc, str, arg);
+            len = va_arg(ap, int);
+            out = va_arg(ap, char *);
+            str_append_raw(alloc, str, &cap, out, len);
             c += 2; // skip '*s'
-            continue;
-        }
+            break;
         case 'd':
-            len = ccStrPrintInt32(buf, va_arg(ap, int));
-            pl_str_append(alloc, str, (pl_str) { (uint8_t *) buf, len });
-            continue;
+            out = str_reserve(alloc, str, &cap, NUM_BUFSIZE);
+            str->len += ccStrPrintInt32(out, va_arg(ap, int));
+            break;
         case 'u':
-            len = ccStrPrintUint32(buf, va_arg(ap, unsigned int));
-            pl_str_append(alloc, str, (pl_str) { (uint8_t *) buf, len });
-            continue;
+            out = str_reserve(alloc, str, &cap, NUM_BUFSIZE);
+            str->len += ccStrPrintUint32(out, va_arg(ap, unsigned int));
+            break;
         case 'l':
             assert(c[1] == 'l');
+            out = str_reserve(alloc, str, &cap, NUM_BUFSIZE);
             switch (c[2]) {
             case 'u':
-                len = ccStrPrintUint64(buf, va_arg(ap, unsigned long long));
+                str->len += ccStrPrintUint64(out, va_arg(ap, unsigned long long));
                 break;
             case 'd':
-                len = ccStrPrintInt64(buf, va_arg(ap, long long));
+                str->len += ccStrPrintInt64(out, va_arg(ap, long long));
                 break;
             default: abort();
             }
-            pl_str_append(alloc, str, (pl_str) { (uint8_t *) buf, len });
             c += 2;
-            continue;
+            break;
+        case 'x':
+            out = str_reserve(alloc, str, &cap, NUM_BUFSIZE);
+            str->len += ccStrPrintHex32(out, va_arg(ap, unsigned int));
+            break;
         case 'z':
             assert(c[1] == 'u');
-            len = ccStrPrintUint64(buf, va_arg(ap, size_t));
-            pl_str_append(alloc, str, (pl_str) { (uint8_t *) buf, len });
+            out = str_reserve(alloc, str, &cap, NUM_BUFSIZE);
+            str->len += ccStrPrintUint64(out, va_arg(ap, size_t));
             c++;
-            continue;
+            break;
         case 'f':
-            len = ccStrPrintDouble(buf, sizeof(buf), 20, va_arg(ap, double));
-            pl_str_append(alloc, str, (pl_str) { (uint8_t *) buf, len });
-            continue;
+            out = str_reserve(alloc, str, &cap, NUM_BUFSIZE);
+            str->len += ccStrPrintDouble(out, NUM_BUFSIZE, 20, va_arg(ap, double));
+            break;
         default:
             fprintf(stderr, "Invalid conversion character: '%c'!\n", c[0]);
             abort();
         }
+
+        fmt = c + 1;
     }
 
-    // Append the remaining string literal
-    pl_str_append(alloc, str, pl_str0(fmt));
+    str->buf[str->len] = '\0';
 }
 
 bool pl_str_parse_double(pl_str str, double *out)
@@ -347,6 +383,23 @@ static int ccStrPrintUint32( char *str, uint32_t n )
     return retsize;
 }
 
+static int ccStrPrintHex32( char *str, uint32_t n )
+{
+    static const char hexdigits[] = "0123456789abcdef";
+    int size = 1;
+    while( size < 8 && ( n >> ( size << 2 ) ) )
+        size++;
+
+    str[size] = 0;
+    for( int i = size - 1; i >= 0; i-- )
+    {
+        str[i] = hexdigits[ n & 0xf ];
+        n >>= 4;
+    }
+
+    return size;
+}
+
 static int ccStrPrintInt64( char *str, int64_t n )
 {
     int sign, size, retsize, pos;
@@ -107,8 +107,16 @@ struct pl_glslang_res *pl_glslang_compile(const struct pl_glsl_version *glsl,
         return res;
     }
 
+    // Run the SPIR-V optimizer (if glslang was built with SPIRV-Tools), to
+    // get rid of the dead code and constant branches left over from shader
+    // specialization, matching shaderc's `optimization_level_performance`
+    SpvOptions opts;
+    opts.disableOptimizer = false;
+    opts.optimizeSize = false;
+
+    spv::SpvBuildLogger logger;
     std::vector<unsigned int> spirv;
-    GlslangToSpv(*prog->getIntermediate(lang), spirv);
+    GlslangToSpv(*prog->getIntermediate(lang), spirv, &logger, &opts);
 
     res->success = true;
     res->size = spirv.size() * sizeof(unsigned int);
@@ -16,6 +16,32 @@
  */
 
 #include "spirv.h"
+#include "pl_thread.h"
+#include "pl_thread_pool.h"
+
+// Upper bound on the total size of cached SPIR-V, past which the oldest
+// entries are evicted
+#define SPIRV_CACHE_MAX_SIZE (64 << 20)
+
+struct spirv_cache_entry {
+    uint64_t key;
+    pl_str spirv; // separate allocation, freed on eviction
+};
+
+struct spirv_job {
+    struct spirv_compiler *spirv;
+    struct pl_glsl_version glsl;
+    enum glsl_shader_stage stage;
+    const char *shader;
+    pl_str result;
+    pl_job job;
+};
+
+struct spirv_state {
+    pl_mutex lock;
+    PL_ARRAY(struct spirv_cache_entry) cache;
+    size_t cache_size;
+};
 
 extern const struct spirv_compiler_impl pl_spirv_shaderc;
 extern const struct spirv_compiler_impl pl_spirv_glslang;
@@ -36,6 +62,9 @@ struct spirv_compiler *spirv_compiler_create(pl_log log)
         if (!spirv)
             continue;
 
+        struct spirv_state *s = spirv->state = pl_zalloc_ptr(NULL, s);
+        pl_mutex_init(&s->lock);
+
         pl_info(log, "Initialized SPIR-V compiler '%s'", compilers[i]->name);
         return spirv;
     }
@@ -50,13 +79,124 @@ void spirv_compiler_destroy(struct spirv_compiler **spirv)
     if (!*spirv)
         return;
 
+    struct spirv_state *s = (*spirv)->state;
+    for (int i = 0; i < s->cache.num; i++)
+        pl_free((void *) s->cache.elem[i].spirv.buf);
+    pl_mutex_destroy(&s->lock);
+    pl_free(s);
+
     (*spirv)->impl->destroy(*spirv);
 }
 
+static uint64_t cache_key(const struct spirv_compiler *spirv,
+                          const struct pl_glsl_version *glsl,
+                          enum glsl_shader_stage stage,
+                          const char *shader)
+{
+    uint64_t key = spirv->signature;
+    pl_hash_merge(&key, pl_str0_hash(shader));
+    pl_hash_merge(&key, (uint64_t) glsl->version << 32 | glsl->gles << 9 |
+                        glsl->vulkan << 8 | stage);
+    return key;
+}
+
+static pl_str cache_get(struct spirv_state *s, uint64_t key, void *alloc)
+{
+    pl_str res = {0};
+    pl_mutex_lock(&s->lock);
+    for (int i = 0; i < s->cache.num; i++) {
+        if (s->cache.elem[i].key == key) {
+            res = pl_strdup(alloc, s->cache.elem[i].spirv);
+            break;
+        }
+    }
+    pl_mutex_unlock(&s->lock);
+    return res;
+}
+
+static void cache_put(struct spirv_state *s, uint64_t key, pl_str spirv)
+{
+    if (!spirv.len || spirv.len > SPIRV_CACHE_MAX_SIZE)
+        return;
+
+    pl_mutex_lock(&s->lock);
+    for (int i = 0; i < s->cache.num; i++) {
+        if (s->cache.elem[i].key == key)
+            goto done; // raced with another thread compiling the same shader
+    }
+
+    while (s->cache_size + spirv.len > SPIRV_CACHE_MAX_SIZE) {
+        struct spirv_cache_entry *old = &s->cache.elem[0];
+        s->cache_size -= old->spirv.len;
+        pl_free((void *) old->spirv.buf);
+        PL_ARRAY_REMOVE_AT(s->cache, 0);
+    }
+
+    PL_ARRAY_APPEND(s, s->cache, (struct spirv_cache_entry) {
+        .key = key,
+        .spirv = pl_strdup(NULL, spirv),
+    });
+    s->cache_size += spirv.len;
+
+done:
+    pl_mutex_unlock(&s->lock);
+}
+
 pl_str spirv_compile_glsl(struct spirv_compiler *spirv, void *alloc,
                           const struct pl_glsl_version *glsl,
                           enum glsl_shader_stage stage,
                           const char *shader)
 {
-    return spirv->impl->compile(spirv, alloc, glsl, stage, shader);
+    uint64_t key = cache_key(spirv, glsl, stage, shader);
+    pl_str res = cache_get(spirv->state, key, alloc);
+    if (res.len) {
+        PL_TRACE(spirv, "Using cached SPIR-V (key 0x%"PRIx64")", key);
+        return res;
+    }
+
+    res = spirv->impl->compile(spirv, alloc, glsl, stage, shader);
+    cache_put(spirv->state, key, res);
+    return res;
+}
+
+static void spirv_job_run(void *arg)
+{
+    struct spirv_job *job = arg;
+    job->result = spirv_compile_glsl(job->spirv, job, &job->glsl, job->stage,
+                                     job->shader);
+}
+
+struct spirv_job *spirv_compile_glsl_async(struct spirv_compiler *spirv,
+                                           const struct pl_glsl_version *glsl,
+                                           enum glsl_shader_stage stage,
+                                           const char *shader)
+{
+    struct spirv_job *job = pl_zalloc_ptr(NULL, job);
+    *job = (struct spirv_job) {
+        .spirv  = spirv,
+        .glsl   = *glsl,
+        .stage  = stage,
+        .shader = pl_strdup0(job, pl_str0(shader)),
+    };
+
+    job->job = pl_job_submit(spirv->log, spirv_job_run, job);
+    if (!job->job)
+        spirv_job_run(job); // no background threads, compile synchronously
+    return job;
+}
+
+pl_str spirv_job_wait(struct spirv_job **pjob, void *alloc)
+{
+    struct spirv_job *job = *pjob;
+    if (!job)
+        return (pl_str) {0};
+
+    pl_job_wait(&job->job);
+    pl_str res = {
+        .buf = pl_steal(alloc, job->result.buf),
+        .len = job->result.len,
+    };
+
+    pl_free_ptr(pjob);
+    return res;
 }
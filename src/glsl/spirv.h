@@ -28,18 +28,37 @@ struct spirv_compiler {
     // For cache invalidation, should uniquely identify everything about this
     // spirv compiler and its configuration.
     uint64_t signature;
+
+    // SPIR-V cache, managed by `spirv.c`
+    struct spirv_state *state;
 };
 
 // Initialize a SPIR-V compiler instance, or returns NULL on failure.
 struct spirv_compiler *spirv_compiler_create(pl_log log);
 void spirv_compiler_destroy(struct spirv_compiler **spirv);
 
-// Compile GLSL to SPIR-V. Returns {0} on failure.
+// Compile GLSL to SPIR-V. Returns {0} on failure. Results are cached, keyed
+// by the GLSL source, version and stage as well as the compiler signature, so
+// identical shaders (e.g. vertex shaders shared by many passes) are only
+// compiled once. Thread-safe.
 pl_str spirv_compile_glsl(struct spirv_compiler *spirv, void *alloc,
                           const struct pl_glsl_version *glsl,
                           enum glsl_shader_stage stage,
                           const char *shader);
 
+// Asynchronous version of `spirv_compile_glsl`, which schedules compilation
+// on the shared background job pool (see `pl_thread_pool.h`). The result must be
+// retrieved with `spirv_job_wait`, which also frees the job. All jobs must be
+// waited on before destroying the compiler. Thread-safe.
+struct spirv_job *spirv_compile_glsl_async(struct spirv_compiler *spirv,
+                                           const struct pl_glsl_version *glsl,
+                                           enum glsl_shader_stage stage,
+                                           const char *shader);
+
+// Block until `job` is done, and return its result (allocated on `alloc`).
+// Returns {0} on failure.
+pl_str spirv_job_wait(struct spirv_job **job, void *alloc);
+
 struct spirv_compiler_impl {
     const char *name;
     void (*destroy)(struct spirv_compiler *spirv);
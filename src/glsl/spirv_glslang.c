@@ -48,6 +48,8 @@ static struct spirv_compiler *glslang_create(pl_log log)
     pl_hash_merge(&spirv->signature, (GLSLANG_VERSION_MAJOR & 0xFF) << 24 |
                                      (GLSLANG_VERSION_MINOR & 0xFF) << 16 |
                                      (GLSLANG_VERSION_PATCH & 0xFFFF));
+    // Invalidate programs cached before the SPIR-V optimizer was enabled
+    pl_hash_merge(&spirv->signature, pl_str0_hash("optimize"));
     return spirv;
 }
 
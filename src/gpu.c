@@ -21,6 +21,14 @@
 #include "log.h"
 #include "shaders.h"
 #include "gpu.h"
+#include "pl_clock.h"
+#include "pl_thread.h"
+
+#ifndef PL_HAVE_WIN32
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 #define require(expr)                                           \
   do {                                                          \
@@ -33,12 +41,723 @@
       }                                                         \
   } while (0)
 
+struct tex_cache_entry {
+    uint64_t key;
+    pl_tex tex;
+    int refs;
+};
+
+struct pl_tex_cache {
+    pl_mutex lock;
+    PL_ARRAY(struct tex_cache_entry) entries;
+};
+
+static void tex_cache_destroy(pl_gpu gpu, struct pl_tex_cache **pcache)
+{
+    struct pl_tex_cache *cache = *pcache;
+    if (!cache)
+        return;
+
+    if (cache->entries.num) {
+        PL_WARN(gpu, "%d shared textures still referenced when destroying the "
+                "GPU, releasing them anyway!", cache->entries.num);
+    }
+
+    for (int i = 0; i < cache->entries.num; i++)
+        pl_tex_destroy(gpu, &cache->entries.elem[i].tex);
+    pl_mutex_destroy(&cache->lock);
+    pl_free_ptr(pcache);
+}
+
+static struct tex_cache_entry *tex_cache_find(struct pl_tex_cache *cache,
+                                              uint64_t key, pl_tex tex)
+{
+    for (int i = 0; i < cache->entries.num; i++) {
+        struct tex_cache_entry *e = &cache->entries.elem[i];
+        if (tex ? e->tex == tex : e->key == key)
+            return e;
+    }
+
+    return NULL;
+}
+
+pl_tex pl_tex_cache_get(pl_gpu gpu, uint64_t key)
+{
+    struct pl_gpu_fns *impl = PL_PRIV(gpu);
+    struct pl_tex_cache *cache = impl->tex_cache;
+    pl_mutex_lock(&cache->lock);
+    struct tex_cache_entry *e = tex_cache_find(cache, key, NULL);
+    pl_tex tex = NULL;
+    if (e) {
+        e->refs++;
+        tex = e->tex;
+    }
+    pl_mutex_unlock(&cache->lock);
+    return tex;
+}
+
+pl_tex pl_tex_cache_add(pl_gpu gpu, uint64_t key, pl_tex tex)
+{
+    struct pl_gpu_fns *impl = PL_PRIV(gpu);
+    struct pl_tex_cache *cache = impl->tex_cache;
+    pl_mutex_lock(&cache->lock);
+    struct tex_cache_entry *e = tex_cache_find(cache, key, NULL);
+    if (e) {
+        // Lost the race against another thread, use the existing texture
+        pl_tex_destroy(gpu, &tex);
+        e->refs++;
+        tex = e->tex;
+    } else {
+        PL_ARRAY_APPEND(cache, cache->entries, (struct tex_cache_entry) {
+            .key = key,
+            .tex = tex,
+            .refs = 1,
+        });
+    }
+    pl_mutex_unlock(&cache->lock);
+    return tex;
+}
+
+void pl_tex_cache_release(pl_gpu gpu, pl_tex *tex)
+{
+    if (!*tex)
+        return;
+
+    struct pl_gpu_fns *impl = PL_PRIV(gpu);
+    struct pl_tex_cache *cache = impl->tex_cache;
+    pl_mutex_lock(&cache->lock);
+    struct tex_cache_entry *e = tex_cache_find(cache, 0, *tex);
+    pl_assert(e && e->refs > 0);
+    if (--e->refs == 0) {
+        pl_tex_destroy(gpu, &e->tex);
+        PL_ARRAY_REMOVE_AT(cache->entries, e - cache->entries.elem);
+    }
+    pl_mutex_unlock(&cache->lock);
+    *tex = NULL;
+}
+
+// Maximum number of host pointer imports to keep around
+#define MAX_BUF_CACHE 64
+
+struct buf_cache_entry {
+    uintptr_t start, end;
+    pl_buf buf;
+    uint64_t last_use;
+    int refs;
+    bool forgotten; // destroy once no longer referenced
+};
+
+struct pl_buf_cache {
+    pl_mutex lock;
+    PL_ARRAY(struct buf_cache_entry) entries;
+    uint64_t counter;
+};
+
+static void buf_cache_destroy(pl_gpu gpu, struct pl_buf_cache **pcache)
+{
+    struct pl_buf_cache *cache = *pcache;
+    if (!cache)
+        return;
+
+    for (int i = 0; i < cache->entries.num; i++)
+        pl_buf_destroy(gpu, &cache->entries.elem[i].buf);
+    pl_mutex_destroy(&cache->lock);
+    pl_free_ptr(pcache);
+}
+
+// Evict the least recently used unreferenced entry, if the cache is full
+static void buf_cache_evict(pl_gpu gpu, struct pl_buf_cache *cache)
+{
+    if (cache->entries.num < MAX_BUF_CACHE)
+        return;
+
+    int idx = -1;
+    for (int i = 0; i < cache->entries.num; i++) {
+        const struct buf_cache_entry *e = &cache->entries.elem[i];
+        if (e->refs)
+            continue;
+        if (idx < 0 || e->last_use < cache->entries.elem[idx].last_use)
+            idx = i;
+    }
+
+    if (idx >= 0) {
+        pl_buf_destroy(gpu, &cache->entries.elem[idx].buf);
+        PL_ARRAY_REMOVE_AT(cache->entries, idx);
+    }
+}
+
+pl_buf pl_buf_cache_import(pl_gpu gpu, const void *ptr, size_t size,
+                           size_t *out_offset)
+{
+    if (!(gpu->import_caps.buf & PL_HANDLE_HOST_PTR))
+        return NULL;
+
+    struct pl_gpu_fns *impl = PL_PRIV(gpu);
+    struct pl_buf_cache *cache = impl->buf_cache;
+    uintptr_t start = (uintptr_t) ptr, end = start + size;
+    pl_buf buf = NULL;
+
+    pl_mutex_lock(&cache->lock);
+    for (int i = 0; i < cache->entries.num; i++) {
+        struct buf_cache_entry *e = &cache->entries.elem[i];
+        if (!e->forgotten && e->start <= start && e->end >= end) {
+            e->refs++;
+            e->last_use = cache->counter++;
+            *out_offset = start - e->start;
+            buf = e->buf;
+            goto done;
+        }
+    }
+
+    // Suppress errors for this attempt, since it may fail (e.g. due to
+    // unsupported memory types), in which case the caller falls back
+    pl_log_level_cap(gpu->log, PL_LOG_DEBUG);
+    buf = pl_buf_create(gpu, pl_buf_params(
+        .size = size,
+        .import_handle = PL_HANDLE_HOST_PTR,
+        .shared_mem = {
+            .handle.ptr = (void *) ptr,
+            .size = size,
+        },
+        .debug_tag = PL_DEBUG_TAG,
+    ));
+    pl_log_level_cap(gpu->log, PL_LOG_NONE);
+    if (!buf)
+        goto done;
+
+    buf_cache_evict(gpu, cache);
+    PL_ARRAY_APPEND(cache, cache->entries, (struct buf_cache_entry) {
+        .start = start,
+        .end = end,
+        .buf = buf,
+        .last_use = cache->counter++,
+        .refs = 1,
+    });
+    *out_offset = 0;
+
+done:
+    pl_mutex_unlock(&cache->lock);
+    return buf;
+}
+
+void pl_buf_cache_release(pl_gpu gpu, pl_buf *buf)
+{
+    if (!*buf)
+        return;
+
+    struct pl_gpu_fns *impl = PL_PRIV(gpu);
+    struct pl_buf_cache *cache = impl->buf_cache;
+    pl_mutex_lock(&cache->lock);
+    for (int i = 0; i < cache->entries.num; i++) {
+        struct buf_cache_entry *e = &cache->entries.elem[i];
+        if (e->buf != *buf)
+            continue;
+        pl_assert(e->refs > 0);
+        if (--e->refs == 0 && e->forgotten) {
+            pl_buf_destroy(gpu, &e->buf);
+            PL_ARRAY_REMOVE_AT(cache->entries, i);
+        }
+        break;
+    }
+    pl_mutex_unlock(&cache->lock);
+    *buf = NULL;
+}
+
+void pl_buf_cache_forget(pl_gpu gpu, const void *ptr, size_t size)
+{
+    struct pl_gpu_fns *impl = PL_PRIV(gpu);
+    struct pl_buf_cache *cache = impl->buf_cache;
+    uintptr_t start = (uintptr_t) ptr, end = start + size;
+
+    pl_mutex_lock(&cache->lock);
+    for (int i = cache->entries.num - 1; i >= 0; i--) {
+        struct buf_cache_entry *e = &cache->entries.elem[i];
+        if (e->start >= end || e->end <= start)
+            continue;
+        if (e->refs) {
+            e->forgotten = true;
+        } else {
+            pl_buf_destroy(gpu, &e->buf);
+            PL_ARRAY_REMOVE_AT(cache->entries, i);
+        }
+    }
+    pl_mutex_unlock(&cache->lock);
+}
+
+// Maximum number of idle staging buffers to keep around for reuse
+#define MAX_STAGING 4
+
+struct pl_staging_pool {
+    pl_mutex lock;
+    PL_ARRAY(pl_buf) bufs;
+};
+
+static void staging_destroy(pl_gpu gpu, struct pl_staging_pool **ppool)
+{
+    struct pl_staging_pool *pool = *ppool;
+    if (!pool)
+        return;
+
+    for (int i = 0; i < pool->bufs.num; i++)
+        pl_buf_destroy(gpu, &pool->bufs.elem[i]);
+    pl_mutex_destroy(&pool->lock);
+    pl_free_ptr(ppool);
+}
+
+pl_buf pl_staging_get(pl_gpu gpu, size_t size, bool storable)
+{
+    struct pl_gpu_fns *impl = PL_PRIV(gpu);
+    struct pl_staging_pool *pool = impl->staging;
+    size_t max_size = 0;
+
+    pl_mutex_lock(&pool->lock);
+    for (int i = 0; i < pool->bufs.num; i++) {
+        pl_buf buf = pool->bufs.elem[i];
+        if (buf->params.storable != storable)
+            continue;
+        max_size = PL_MAX(max_size, buf->params.size);
+        if (buf->params.size < size || pl_buf_poll(gpu, buf, 0))
+            continue;
+        PL_ARRAY_REMOVE_AT(pool->bufs, i);
+        pl_mutex_unlock(&pool->lock);
+        return buf;
+    }
+    pl_mutex_unlock(&pool->lock);
+
+    // Size new buffers after the largest upload seen so far, rounded up to
+    // a power of two, so that they can be reused for similar future uploads
+    size_t new_size = PL_MAX(PL_ALIGN_POT(size), max_size);
+    size_t max_buf_size = storable ? gpu->limits.max_ssbo_size
+                                   : gpu->limits.max_buf_size;
+    if (new_size > max_buf_size)
+        new_size = size;
+
+    return pl_buf_create(gpu, pl_buf_params(
+        .size = new_size,
+        .host_writable = true,
+        .storable = storable,
+        .debug_tag = PL_DEBUG_TAG,
+    ));
+}
+
+void pl_staging_put(pl_gpu gpu, pl_buf buf)
+{
+    struct pl_gpu_fns *impl = PL_PRIV(gpu);
+    struct pl_staging_pool *pool = impl->staging;
+
+    pl_mutex_lock(&pool->lock);
+    if (pool->bufs.num == MAX_STAGING) {
+        // Evict the smallest buffer, to keep up with growing uploads
+        int idx = 0;
+        for (int i = 1; i < pool->bufs.num; i++) {
+            if (pool->bufs.elem[i]->params.size < pool->bufs.elem[idx]->params.size)
+                idx = i;
+        }
+        if (pool->bufs.elem[idx]->params.size < buf->params.size)
+            PL_SWAP(pool->bufs.elem[idx], buf);
+    }
+
+    if (pool->bufs.num < MAX_STAGING) {
+        PL_ARRAY_APPEND(pool, pool->bufs, buf);
+        buf = NULL;
+    }
+    pl_mutex_unlock(&pool->lock);
+
+    pl_buf_destroy(gpu, &buf);
+}
+
+// Maximum number of distinct plane layouts to remember
+#define MAX_PLANE_FMTS 256
+
+struct plane_fmt_entry {
+    struct plane_fmt_key key;
+    pl_fmt fmt;
+    int map[4];
+};
+
+struct pl_plane_fmt_cache {
+    pl_mutex lock;
+    PL_ARRAY(struct plane_fmt_entry) entries;
+};
+
+static void plane_fmt_cache_destroy(struct pl_plane_fmt_cache **pcache)
+{
+    struct pl_plane_fmt_cache *cache = *pcache;
+    if (!cache)
+        return;
+
+    pl_mutex_destroy(&cache->lock);
+    pl_free_ptr(pcache);
+}
+
+bool pl_plane_fmt_cache_get(pl_gpu gpu, const struct plane_fmt_key *key,
+                            pl_fmt *fmt, int map[4])
+{
+    struct pl_gpu_fns *impl = PL_PRIV(gpu);
+    struct pl_plane_fmt_cache *cache = impl->plane_fmt_cache;
+    bool found = false;
+
+    pl_mutex_lock(&cache->lock);
+    for (int i = 0; i < cache->entries.num; i++) {
+        const struct plane_fmt_entry *e = &cache->entries.elem[i];
+        if (memcmp(&e->key, key, sizeof(*key)) == 0) {
+            *fmt = e->fmt;
+            memcpy(map, e->map, sizeof(e->map));
+            found = true;
+            break;
+        }
+    }
+    pl_mutex_unlock(&cache->lock);
+    return found;
+}
+
+void pl_plane_fmt_cache_add(pl_gpu gpu, const struct plane_fmt_key *key,
+                            pl_fmt fmt, const int map[4])
+{
+    struct pl_gpu_fns *impl = PL_PRIV(gpu);
+    struct pl_plane_fmt_cache *cache = impl->plane_fmt_cache;
+
+    pl_mutex_lock(&cache->lock);
+    if (cache->entries.num < MAX_PLANE_FMTS) {
+        struct plane_fmt_entry e = { .key = *key, .fmt = fmt };
+        memcpy(e.map, map, sizeof(e.map));
+        PL_ARRAY_APPEND(cache, cache->entries, e);
+    }
+    pl_mutex_unlock(&cache->lock);
+}
+
+// Maximum number of idle DMA-BUF imports to keep around, and the number of
+// subsequent imports after which an idle entry is considered stale
+#define MAX_DMABUF_CACHE 32
+#define MAX_DMABUF_AGE   64
+
+struct dmabuf_cache_entry {
+    uint64_t dev, ino; // identifies the underlying DMA-BUF
+    pl_tex tex;
+    uint64_t last_use;
+    int refs;
+};
+
+struct pl_dmabuf_cache {
+    pl_mutex lock;
+    PL_ARRAY(struct dmabuf_cache_entry) entries;
+    uint64_t counter;
+};
+
+static void dmabuf_cache_destroy(pl_gpu gpu, struct pl_dmabuf_cache **pcache)
+{
+    struct pl_dmabuf_cache *cache = *pcache;
+    if (!cache)
+        return;
+
+    const struct pl_gpu_fns *impl = PL_PRIV(gpu);
+    for (int i = 0; i < cache->entries.num; i++) {
+        const struct dmabuf_cache_entry *e = &cache->entries.elem[i];
+        if (e->refs)
+            PL_WARN(gpu, "Imported DMA-BUF texture still referenced when "
+                    "destroying the GPU, releasing it anyway!");
+        impl->tex_destroy(gpu, e->tex);
+    }
+    pl_mutex_destroy(&cache->lock);
+    pl_free_ptr(pcache);
+}
+
+// Must be called with the lock held
+static void dmabuf_cache_remove(pl_gpu gpu, struct pl_dmabuf_cache *cache, int idx)
+{
+    const struct pl_gpu_fns *impl = PL_PRIV(gpu);
+    impl->tex_destroy(gpu, cache->entries.elem[idx].tex);
+    PL_ARRAY_REMOVE_AT(cache->entries, idx);
+}
+
+// Evict stale idle entries, as well as the least recently used idle entry if
+// the cache is full. Must be called with the lock held
+static void dmabuf_cache_evict(pl_gpu gpu, struct pl_dmabuf_cache *cache)
+{
+    int idle = 0, lru = -1;
+    for (int i = cache->entries.num - 1; i >= 0; i--) {
+        const struct dmabuf_cache_entry *e = &cache->entries.elem[i];
+        if (e->refs)
+            continue;
+        if (e->last_use + MAX_DMABUF_AGE < cache->counter) {
+            dmabuf_cache_remove(gpu, cache, i);
+            lru -= lru > i; // account for the shifted index
+            continue;
+        }
+        if (lru < 0 || e->last_use < cache->entries.elem[lru].last_use)
+            lru = i;
+        idle++;
+    }
+
+    if (idle > MAX_DMABUF_CACHE)
+        dmabuf_cache_remove(gpu, cache, lru);
+}
+
+static bool dmabuf_params_eq(const struct pl_tex_params *a,
+                             const struct pl_tex_params *b)
+{
+    return a->w == b->w && a->h == b->h && a->d == b->d &&
+           a->format        == b->format &&
+           a->sampleable    == b->sampleable &&
+           a->renderable    == b->renderable &&
+           a->storable      == b->storable &&
+           a->blit_src      == b->blit_src &&
+           a->blit_dst      == b->blit_dst &&
+           a->host_writable == b->host_writable &&
+           a->host_readable == b->host_readable &&
+           a->shared_mem.size           == b->shared_mem.size &&
+           a->shared_mem.offset         == b->shared_mem.offset &&
+           a->shared_mem.drm_format_mod == b->shared_mem.drm_format_mod &&
+           a->shared_mem.stride_w       == b->shared_mem.stride_w &&
+           a->shared_mem.stride_h       == b->shared_mem.stride_h;
+}
+
+// Creates (or reuses) a texture imported from a DMA-BUF. Decoders typically
+// cycle through a small, fixed set of surfaces, so re-importing the same
+// buffers every frame is wasteful. Since the imported texture keeps its
+// DMA-BUF alive, the (dev, inode) pair remains a unique identifier for as
+// long as the entry exists.
+static pl_tex dmabuf_cache_import(pl_gpu gpu, const struct pl_tex_params *params)
+{
+    struct pl_gpu_fns *impl = PL_PRIV(gpu);
+#ifndef PL_HAVE_WIN32
+    struct pl_dmabuf_cache *cache = impl->dmabuf_cache;
+    struct stat st;
+    if (fstat(params->shared_mem.handle.fd, &st) != 0)
+        return impl->tex_create(gpu, params);
+
+    pl_mutex_lock(&cache->lock);
+    cache->counter++;
+    for (int i = 0; i < cache->entries.num; i++) {
+        struct dmabuf_cache_entry *e = &cache->entries.elem[i];
+        if (e->dev != st.st_dev || e->ino != st.st_ino)
+            continue;
+        if (!dmabuf_params_eq(&e->tex->params, params))
+            continue;
+        if (!e->refs && impl->tex_reset_import)
+            impl->tex_reset_import(gpu, e->tex);
+        e->refs++;
+        e->last_use = cache->counter;
+        pl_tex tex = e->tex;
+        pl_mutex_unlock(&cache->lock);
+        return tex;
+    }
+    pl_mutex_unlock(&cache->lock);
+
+    // Drop the lock while importing, since allocations may end up calling
+    // `pl_gpu_trim` under memory pressure
+    pl_tex tex = impl->tex_create(gpu, params);
+    if (!tex)
+        return NULL;
+
+    pl_mutex_lock(&cache->lock);
+    dmabuf_cache_evict(gpu, cache);
+    PL_ARRAY_APPEND(cache, cache->entries, (struct dmabuf_cache_entry) {
+        .dev = st.st_dev,
+        .ino = st.st_ino,
+        .tex = tex,
+        .last_use = cache->counter,
+        .refs = 1,
+    });
+    pl_mutex_unlock(&cache->lock);
+    return tex;
+#else
+    return impl->tex_create(gpu, params);
+#endif
+}
+
+// Returns false if `tex` is not a cached DMA-BUF import
+static bool dmabuf_cache_release(pl_gpu gpu, pl_tex tex)
+{
+    struct pl_gpu_fns *impl = PL_PRIV(gpu);
+    struct pl_dmabuf_cache *cache = impl->dmabuf_cache;
+    bool found = false;
+
+    pl_mutex_lock(&cache->lock);
+    for (int i = 0; i < cache->entries.num; i++) {
+        struct dmabuf_cache_entry *e = &cache->entries.elem[i];
+        if (e->tex != tex)
+            continue;
+        pl_assert(e->refs > 0);
+        if (--e->refs == 0)
+            dmabuf_cache_evict(gpu, cache);
+        found = true;
+        break;
+    }
+    pl_mutex_unlock(&cache->lock);
+    return found;
+}
+
+void pl_gpu_trim(pl_gpu gpu)
+{
+    struct pl_gpu_fns *impl = PL_PRIV(gpu);
+    struct pl_dmabuf_cache *cache = impl->dmabuf_cache;
+    if (cache) {
+        pl_mutex_lock(&cache->lock);
+        for (int i = cache->entries.num - 1; i >= 0; i--) {
+            if (!cache->entries.elem[i].refs)
+                dmabuf_cache_remove(gpu, cache, i);
+        }
+        pl_mutex_unlock(&cache->lock);
+    }
+
+    struct pl_staging_pool *pool = impl->staging;
+    if (!pool)
+        return;
+
+    // Buffers still in use by the GPU are only freed once they complete
+    pl_mutex_lock(&pool->lock);
+    for (int i = 0; i < pool->bufs.num; i++)
+        pl_buf_destroy(gpu, &pool->bufs.elem[i]);
+    pool->bufs.num = 0;
+    pl_mutex_unlock(&pool->lock);
+}
+
+// Fences for the frames marked by `pl_gpu_end_frame`, oldest first
+struct pl_frame_fences {
+    pl_mutex lock;
+    PL_ARRAY(void *) fences;
+};
+
+static void frame_fences_destroy(pl_gpu gpu, struct pl_frame_fences **pframes)
+{
+    struct pl_gpu_fns *impl = PL_PRIV(gpu);
+    struct pl_frame_fences *frames = *pframes;
+    if (!frames)
+        return;
+
+    for (int i = 0; i < frames->fences.num; i++) {
+        impl->fence_wait(gpu, frames->fences.elem[i], UINT64_MAX);
+        impl->fence_destroy(gpu, frames->fences.elem[i]);
+    }
+    pl_mutex_destroy(&frames->lock);
+    pl_free_ptr(pframes);
+}
+
+// Pending request of `pl_gpu_completion_handle`
+struct notify_req {
+    void *fence;
+    union pl_handle signal; // our end of the handle given to the user
+};
+
+struct pl_gpu_notifier {
+    pl_gpu gpu;
+    pl_mutex lock;
+    pl_cond cond;
+    pl_thread thread;
+    bool running;
+    bool exit;
+    PL_ARRAY(struct notify_req) reqs; // oldest first
+};
+
+// Creates a pair of handles, where signalling `ours` wakes up `theirs`
+static bool notify_handle_create(union pl_handle *ours, union pl_handle *theirs)
+{
+#ifdef PL_HAVE_WIN32
+    HANDLE event = CreateEventW(NULL, TRUE, FALSE, NULL), dup = NULL;
+    if (!event)
+        return false;
+    if (!DuplicateHandle(GetCurrentProcess(), event, GetCurrentProcess(), &dup,
+                         0, FALSE, DUPLICATE_SAME_ACCESS))
+    {
+        CloseHandle(event);
+        return false;
+    }
+    ours->handle = event;
+    theirs->handle = dup;
+#else
+    int fds[2];
+    if (pipe(fds) != 0)
+        return false;
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+    theirs->fd = fds[0];
+    ours->fd = fds[1];
+#endif
+    return true;
+}
+
+static void notify_handle_signal(union pl_handle *ours)
+{
+#ifdef PL_HAVE_WIN32
+    SetEvent(ours->handle);
+    CloseHandle(ours->handle);
+#else
+    // Closing the write end makes the read end readable (end of file), and
+    // unlike writing to it, doesn't fail if the user already closed theirs
+    close(ours->fd);
+#endif
+}
+
+static PL_THREAD_VOID notifier_thread(void *arg)
+{
+    struct pl_gpu_notifier *notifier = arg;
+    pl_gpu gpu = notifier->gpu;
+    const struct pl_gpu_fns *impl = PL_PRIV(gpu);
+
+    pl_mutex_lock(&notifier->lock);
+    for (;;) {
+        while (!notifier->reqs.num && !notifier->exit)
+            pl_cond_wait(&notifier->cond, &notifier->lock);
+        if (!notifier->reqs.num)
+            break;
+
+        // Only this thread removes requests, so this stays valid unlocked
+        struct notify_req req = notifier->reqs.elem[0];
+        pl_mutex_unlock(&notifier->lock);
+        bool unlocked = impl->fence_wait_unlocked;
+        bool done = impl->fence_wait(gpu, req.fence, unlocked ? UINT64_MAX : 0);
+        pl_mutex_lock(&notifier->lock);
+        if (!done && !unlocked) {
+            // Poll again later, without keeping the GPU busy in the meantime
+            pl_cond_timedwait(&notifier->cond, &notifier->lock, 1000000);
+            continue;
+        }
+
+        PL_ARRAY_REMOVE_AT(notifier->reqs, 0);
+        pl_mutex_unlock(&notifier->lock);
+        impl->fence_destroy(gpu, req.fence);
+        notify_handle_signal(&req.signal);
+        pl_mutex_lock(&notifier->lock);
+    }
+    pl_mutex_unlock(&notifier->lock);
+
+    PL_THREAD_RETURN();
+}
+
+static void notifier_destroy(pl_gpu gpu, struct pl_gpu_notifier **pnotifier)
+{
+    struct pl_gpu_notifier *notifier = *pnotifier;
+    if (!notifier)
+        return;
+
+    // The thread drains all pending requests before exiting
+    pl_mutex_lock(&notifier->lock);
+    notifier->exit = true;
+    pl_cond_signal(&notifier->cond);
+    pl_mutex_unlock(&notifier->lock);
+    if (notifier->running)
+        pl_thread_join(notifier->thread);
+
+    pl_cond_destroy(&notifier->cond);
+    pl_mutex_destroy(&notifier->lock);
+    pl_free_ptr(pnotifier);
+}
+
 void pl_gpu_destroy(pl_gpu gpu)
 {
     if (!gpu)
         return;
 
-    const struct pl_gpu_fns *impl = PL_PRIV(gpu);
+    struct pl_gpu_fns *impl = PL_PRIV(gpu);
+    pl_dispatch_destroy(&impl->dp);
+    tex_cache_destroy(gpu, &impl->tex_cache);
+    dmabuf_cache_destroy(gpu, &impl->dmabuf_cache);
+    plane_fmt_cache_destroy(&impl->plane_fmt_cache);
+    buf_cache_destroy(gpu, &impl->buf_cache);
+    staging_destroy(gpu, &impl->staging);
+    notifier_destroy(gpu, &impl->notifier);
+    frame_fences_destroy(gpu, &impl->frames);
     impl->destroy(gpu);
 }
 
@@ -200,6 +919,24 @@ pl_gpu pl_gpu_finalize(struct pl_gpu *gpu)
     // Sort formats
     qsort(gpu->formats, gpu->num_formats, sizeof(pl_fmt), cmp_fmt);
 
+    struct pl_gpu_fns *impl = PL_PRIV(gpu);
+    impl->tex_cache = pl_zalloc_ptr(gpu, impl->tex_cache);
+    pl_mutex_init(&impl->tex_cache->lock);
+    impl->buf_cache = pl_zalloc_ptr(gpu, impl->buf_cache);
+    pl_mutex_init(&impl->buf_cache->lock);
+    impl->dmabuf_cache = pl_zalloc_ptr(gpu, impl->dmabuf_cache);
+    pl_mutex_init(&impl->dmabuf_cache->lock);
+    impl->plane_fmt_cache = pl_zalloc_ptr(gpu, impl->plane_fmt_cache);
+    pl_mutex_init(&impl->plane_fmt_cache->lock);
+    impl->staging = pl_zalloc_ptr(gpu, impl->staging);
+    pl_mutex_init(&impl->staging->lock);
+    impl->frames = pl_zalloc_ptr(gpu, impl->frames);
+    pl_mutex_init(&impl->frames->lock);
+    impl->notifier = pl_zalloc_ptr(gpu, impl->notifier);
+    impl->notifier->gpu = gpu;
+    pl_mutex_init(&impl->notifier->lock);
+    pl_cond_init(&impl->notifier->cond);
+
     // Verification
     pl_assert(gpu->ctx == gpu->log);
     pl_assert(gpu->limits.max_tex_2d_dim);
@@ -271,6 +1008,7 @@ pl_gpu pl_gpu_finalize(struct pl_gpu *gpu)
     LOG("zu", max_mapped_size);
     LOG(PRIu64, max_buffer_texels);
     LOG("zu", align_host_ptr);
+    LOG("zu", align_ubo_offset);
     // pl_tex
     LOG(PRIu32, max_tex_1d_dim);
     LOG(PRIu32, max_tex_2d_dim);
@@ -284,6 +1022,7 @@ pl_gpu pl_gpu_finalize(struct pl_gpu *gpu)
     LOG("zu", max_constants);
     LOG("zu", max_pushc_size);
     LOG("zu", align_vertex_stride);
+    LOG("d", instancing);
     if (gpu->glsl.compute) {
         LOG(PRIu32, max_dispatch[0]);
         LOG(PRIu32, max_dispatch[1]);
@@ -312,6 +1051,8 @@ pl_gpu pl_gpu_finalize(struct pl_gpu *gpu)
                 (unsigned int) gpu->export_caps.sync);
         PL_INFO(gpu, "      sync import caps: 0x%x",
                 (unsigned int) gpu->import_caps.sync);
+        PL_INFO(gpu, "      timeline sync export caps: 0x%x",
+                (unsigned int) gpu->export_caps.sync_timeline);
     }
 
     print_formats(gpu);
@@ -348,6 +1089,7 @@ pl_gpu pl_gpu_finalize(struct pl_gpu *gpu)
     gpu->limits.max_gather_offset = gpu->glsl.max_gather_offset;
     gpu->limits.max_variables = gpu->limits.max_variable_comps;
 
+    impl->dp = pl_dispatch_create(gpu->log, gpu);
     return gpu;
 }
 
@@ -605,6 +1347,118 @@ static inline bool check_mod(pl_gpu gpu, pl_fmt fmt, uint64_t mod)
     return false;
 }
 
+// Maps the source file embedded in a `PL_DEBUG_TAG` to the owner of the
+// resource, for `pl_gpu_get_memory_stats`. Since the path leading up to the
+// source tree is build-dependent, only the part relative to it is matched.
+static const struct {
+    const char *path;
+    enum pl_gpu_mem_owner owner;
+} mem_owners[] = {
+    { "src/renderer.c:",    PL_GPU_MEM_RENDERER },
+    { "src/shaders.c:",     PL_GPU_MEM_LUT },
+    { "src/shaders/",       PL_GPU_MEM_LUT },
+    { "src/dispatch.c:",    PL_GPU_MEM_DISPATCH },
+    { "src/gpu.c:",         PL_GPU_MEM_INTERNAL },
+    { "src/opengl/",        PL_GPU_MEM_INTERNAL },
+    { "src/vulkan/",        PL_GPU_MEM_INTERNAL },
+    { "src/d3d11/",         PL_GPU_MEM_INTERNAL },
+};
+
+static bool tag_has_path(const char *tag, const char *path)
+{
+    for (; *path; tag++, path++) {
+        char c = *tag == '\\' ? '/' : *tag;
+        if (c != *path)
+            return false;
+    }
+
+    return true;
+}
+
+static enum pl_gpu_mem_owner mem_owner(pl_debug_tag tag)
+{
+    if (!tag)
+        return PL_GPU_MEM_USER;
+    if (strcmp(tag, PL_DEBUG_TAG_MIXER) == 0)
+        return PL_GPU_MEM_MIXER;
+
+    for (const char *pos = tag; *pos; pos++) {
+        if (pos != tag && pos[-1] != '/' && pos[-1] != '\\')
+            continue; // only match at path component boundaries
+        for (int i = 0; i < PL_ARRAY_SIZE(mem_owners); i++) {
+            if (tag_has_path(pos, mem_owners[i].path))
+                return mem_owners[i].owner;
+        }
+    }
+
+    return PL_GPU_MEM_USER;
+}
+
+static void track_tex(pl_gpu gpu, pl_tex tex, int sign)
+{
+    struct pl_gpu_fns *impl = PL_PRIV(gpu);
+    enum pl_gpu_mem_owner owner = mem_owner(tex->params.debug_tag);
+    pl_fmt fmt = tex->params.format;
+    uint64_t bytes = 0;
+    if (fmt) { // may be missing for wrapped framebuffers
+        bytes = (uint64_t) fmt->texel_size * tex->params.w;
+        bytes *= PL_DEF(tex->params.h, 1);
+        bytes *= PL_DEF(tex->params.d, 1);
+    }
+
+    if (sign > 0) {
+        atomic_fetch_add_explicit(&impl->mem_textures[owner], 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&impl->mem_tex_bytes[owner], bytes, memory_order_relaxed);
+    } else {
+        atomic_fetch_sub_explicit(&impl->mem_textures[owner], 1, memory_order_relaxed);
+        atomic_fetch_sub_explicit(&impl->mem_tex_bytes[owner], bytes, memory_order_relaxed);
+    }
+}
+
+static void track_buf(pl_gpu gpu, pl_buf buf, int sign)
+{
+    struct pl_gpu_fns *impl = PL_PRIV(gpu);
+    enum pl_gpu_mem_owner owner = mem_owner(buf->params.debug_tag);
+    uint64_t bytes = buf->params.size;
+
+    if (sign > 0) {
+        atomic_fetch_add_explicit(&impl->mem_buffers[owner], 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&impl->mem_buf_bytes[owner], bytes, memory_order_relaxed);
+    } else {
+        atomic_fetch_sub_explicit(&impl->mem_buffers[owner], 1, memory_order_relaxed);
+        atomic_fetch_sub_explicit(&impl->mem_buf_bytes[owner], bytes, memory_order_relaxed);
+    }
+}
+
+void pl_gpu_track_tex(pl_gpu gpu, pl_tex tex)
+{
+    track_tex(gpu, tex, 1);
+}
+
+struct pl_gpu_memory_stats pl_gpu_get_memory_stats(pl_gpu gpu)
+{
+    const struct pl_gpu_fns *impl = PL_PRIV(gpu);
+    struct pl_gpu_memory_stats stats = {0};
+    for (int i = 0; i < PL_GPU_MEM_OWNER_COUNT; i++) {
+        struct pl_gpu_mem_usage *usage = &stats.owners[i];
+        usage->num_textures = atomic_load_explicit(&impl->mem_textures[i], memory_order_relaxed);
+        usage->num_buffers  = atomic_load_explicit(&impl->mem_buffers[i], memory_order_relaxed);
+        usage->tex_bytes    = atomic_load_explicit(&impl->mem_tex_bytes[i], memory_order_relaxed);
+        usage->buf_bytes    = atomic_load_explicit(&impl->mem_buf_bytes[i], memory_order_relaxed);
+        stats.total.num_textures += usage->num_textures;
+        stats.total.num_buffers  += usage->num_buffers;
+        stats.total.tex_bytes    += usage->tex_bytes;
+        stats.total.buf_bytes    += usage->buf_bytes;
+    }
+
+    stats.tex_upload_bytes = atomic_load_explicit(&impl->tex_upload_bytes,
+                                                  memory_order_relaxed);
+
+    if (impl->memory_stats)
+        impl->memory_stats(gpu, &stats);
+    return stats;
+}
+
 pl_tex pl_tex_create(pl_gpu gpu, const struct pl_tex_params *params)
 {
     require(!params->import_handle || !params->export_handle);
@@ -613,6 +1467,10 @@ pl_tex pl_tex_create(pl_gpu gpu, const struct pl_tex_params *params)
         require(params->export_handle & gpu->export_caps.tex);
         require(PL_ISPOT(params->export_handle));
     }
+    if (params->num_export_modifiers) {
+        require(params->export_handle == PL_HANDLE_DMA_BUF);
+        require(params->export_modifiers && params->num_export_modifiers > 0);
+    }
     if (params->import_handle) {
         require(params->import_handle & gpu->import_caps.tex);
         require(PL_ISPOT(params->import_handle));
@@ -661,8 +1519,22 @@ pl_tex pl_tex_create(pl_gpu gpu, const struct pl_tex_params *params)
     require(!params->blit_src   || fmt->caps & PL_FMT_CAP_BLITTABLE);
     require(!params->blit_dst   || fmt->caps & PL_FMT_CAP_BLITTABLE);
 
-    const struct pl_gpu_fns *impl = PL_PRIV(gpu);
-    return impl->tex_create(gpu, params);
+    struct pl_gpu_fns *impl = PL_PRIV(gpu);
+    pl_tex tex;
+    if (params->import_handle == PL_HANDLE_DMA_BUF) {
+        tex = dmabuf_cache_import(gpu, params);
+    } else {
+        tex = impl->tex_create(gpu, params);
+    }
+
+    if (tex)
+        track_tex(gpu, tex, 1);
+    if (tex && params->initial_data) {
+        uint64_t bytes = (uint64_t) fmt->texel_size * params->w;
+        bytes *= PL_DEF(params->h, 1) * PL_DEF(params->d, 1);
+        atomic_fetch_add_explicit(&impl->tex_upload_bytes, bytes, memory_order_relaxed);
+    }
+    return tex;
 
 error:
     if (params->debug_tag)
@@ -675,12 +1547,18 @@ void pl_tex_destroy(pl_gpu gpu, pl_tex *tex)
     if (!*tex)
         return;
 
+    track_tex(gpu, *tex, -1);
+
     const struct pl_gpu_fns *impl = PL_PRIV(gpu);
-    impl->tex_destroy(gpu, *tex);
+    if ((*tex)->params.import_handle != PL_HANDLE_DMA_BUF ||
+        !dmabuf_cache_release(gpu, *tex))
+    {
+        impl->tex_destroy(gpu, *tex);
+    }
     *tex = NULL;
 }
 
-static bool pl_tex_params_superset(struct pl_tex_params a, struct pl_tex_params b)
+bool pl_tex_params_superset(struct pl_tex_params a, struct pl_tex_params b)
 {
     return a.w == b.w && a.h == b.h && a.d == b.d &&
            a.format          == b.format &&
@@ -926,7 +1804,9 @@ bool pl_tex_upload(pl_gpu gpu, const struct pl_tex_transfer_params *params)
     if (!fix_tex_transfer(gpu, &fixed))
         goto error;
 
-    const struct pl_gpu_fns *impl = PL_PRIV(gpu);
+    struct pl_gpu_fns *impl = PL_PRIV(gpu);
+    atomic_fetch_add_explicit(&impl->tex_upload_bytes, pl_tex_transfer_size(&fixed),
+                              memory_order_relaxed);
     return impl->tex_upload(gpu, &fixed);
 
 error:
@@ -953,6 +1833,11 @@ error:
     return false;
 }
 
+void pl_tex_transfer_forget(pl_gpu gpu, const void *ptr, size_t size)
+{
+    pl_buf_cache_forget(gpu, ptr, size);
+}
+
 bool pl_tex_poll(pl_gpu gpu, pl_tex tex, uint64_t t)
 {
     const struct pl_gpu_fns *impl = PL_PRIV(gpu);
@@ -1023,8 +1908,10 @@ pl_buf pl_buf_create(pl_gpu gpu, const struct pl_buf_params *params)
 
     const struct pl_gpu_fns *impl = PL_PRIV(gpu);
     pl_buf buf = impl->buf_create(gpu, params);
-    if (buf)
+    if (buf) {
         require(!params->host_mapped || buf->data);
+        track_buf(gpu, buf, 1);
+    }
 
     return buf;
 
@@ -1039,12 +1926,14 @@ void pl_buf_destroy(pl_gpu gpu, pl_buf *buf)
     if (!*buf)
         return;
 
+    track_buf(gpu, *buf, -1);
+
     const struct pl_gpu_fns *impl = PL_PRIV(gpu);
     impl->buf_destroy(gpu, *buf);
     *buf = NULL;
 }
 
-static bool pl_buf_params_superset(struct pl_buf_params a, struct pl_buf_params b)
+bool pl_buf_params_superset(struct pl_buf_params a, struct pl_buf_params b)
 {
     return a.size            >= b.size &&
            a.memory_type     == b.memory_type &&
@@ -1410,7 +2299,8 @@ static inline void log_shader_sources(pl_log log, enum pl_log_level level,
     pl_unreachable();
 }
 
-pl_pass pl_pass_create(pl_gpu gpu, const struct pl_pass_params *params)
+static pl_pass pass_create(pl_gpu gpu, const struct pl_pass_params *params,
+                           bool async)
 {
     struct pl_pass_params fixed;
 
@@ -1419,12 +2309,15 @@ pl_pass pl_pass_create(pl_gpu gpu, const struct pl_pass_params *params)
     case PL_PASS_RASTER:
         require(params->vertex_shader);
         require(params->vertex_stride % gpu->limits.align_vertex_stride == 0);
+        require(params->instance_stride % gpu->limits.align_vertex_stride == 0);
         for (int i = 0; i < params->num_vertex_attribs; i++) {
             struct pl_vertex_attrib va = params->vertex_attribs[i];
             require(va.name);
             require(va.fmt);
             require(va.fmt->caps & PL_FMT_CAP_VERTEX);
-            require(va.offset + va.fmt->texel_size <= params->vertex_stride);
+            require(!va.instanced || gpu->limits.instancing);
+            size_t stride = va.instanced ? params->instance_stride : params->vertex_stride;
+            require(va.offset + va.fmt->texel_size <= stride);
         }
 
         if (!params->target_format) {
@@ -1463,6 +2356,9 @@ pl_pass pl_pass_create(pl_gpu gpu, const struct pl_pass_params *params)
     for (int i = 0; i < params->num_descriptors; i++) {
         struct pl_desc desc = params->descriptors[i];
         require(desc.name);
+        require(!desc.fixed_sampler || desc.type == PL_DESC_SAMPLED_TEX);
+        require(desc.sample_mode >= 0 && desc.sample_mode < PL_TEX_SAMPLE_MODE_COUNT);
+        require(desc.address_mode >= 0 && desc.address_mode < PL_TEX_ADDRESS_MODE_COUNT);
 
         // enforce disjoint descriptor bindings for each namespace
         int namespace = pl_desc_namespace(gpu, desc.type);
@@ -1478,10 +2374,20 @@ pl_pass pl_pass_create(pl_gpu gpu, const struct pl_pass_params *params)
 
     const struct pl_gpu_fns *impl = PL_PRIV(gpu);
     log_shader_sources(gpu->log, PL_LOG_DEBUG, params);
-    pl_pass pass = impl->pass_create(gpu, params);
+    pl_pass pass;
+    uint64_t start = pl_clock_now();
+    if (async && impl->pass_create_async) {
+        pass = impl->pass_create_async(gpu, params);
+    } else {
+        pass = impl->pass_create(gpu, params);
+    }
     if (!pass)
         goto error;
 
+    struct pl_gpu_fns *fns = PL_PRIV(gpu);
+    atomic_fetch_add_explicit(&fns->compile_passes, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&fns->compile_total, pl_clock_now() - start,
+                              memory_order_relaxed);
     return pass;
 
 error:
@@ -1489,6 +2395,55 @@ error:
     return NULL;
 }
 
+pl_pass pl_pass_create(pl_gpu gpu, const struct pl_pass_params *params)
+{
+    return pass_create(gpu, params, false);
+}
+
+pl_pass pl_pass_create_async(pl_gpu gpu, const struct pl_pass_params *params)
+{
+    return pass_create(gpu, params, true);
+}
+
+void pl_gpu_count_spirv(pl_gpu gpu, uint64_t ns)
+{
+    struct pl_gpu_fns *impl = PL_PRIV(gpu);
+    atomic_fetch_add_explicit(&impl->compile_spirv, ns, memory_order_relaxed);
+}
+
+void pl_gpu_count_driver(pl_gpu gpu, uint64_t ns)
+{
+    struct pl_gpu_fns *impl = PL_PRIV(gpu);
+    atomic_fetch_add_explicit(&impl->compile_driver, ns, memory_order_relaxed);
+}
+
+struct pl_gpu_compile_stats pl_gpu_get_compile_stats(pl_gpu gpu)
+{
+    struct pl_gpu_fns *impl = PL_PRIV(gpu);
+    return (struct pl_gpu_compile_stats) {
+        .num_passes = atomic_load_explicit(&impl->compile_passes, memory_order_relaxed),
+        .total      = atomic_load_explicit(&impl->compile_total, memory_order_relaxed),
+        .spirv      = atomic_load_explicit(&impl->compile_spirv, memory_order_relaxed),
+        .driver     = atomic_load_explicit(&impl->compile_driver, memory_order_relaxed),
+    };
+}
+
+bool pl_pass_poll(pl_gpu gpu, pl_pass pass, bool block, bool *ok)
+{
+    const struct pl_gpu_fns *impl = PL_PRIV(gpu);
+    if (!impl->pass_poll) {
+        *ok = true;
+        return true;
+    }
+
+    if (!impl->pass_poll(gpu, pass, block, ok))
+        return false;
+
+    if (!*ok)
+        log_shader_sources(gpu->log, PL_LOG_ERR, &pass->params);
+    return true;
+}
+
 void pl_pass_destroy(pl_gpu gpu, pl_pass *pass)
 {
     if (!*pass)
@@ -1514,6 +2469,8 @@ void pl_pass_run(pl_gpu gpu, const struct pl_pass_run_params *params)
             pl_fmt fmt = tex->params.format;
             require(tex->params.sampleable);
             require(db.sample_mode != PL_TEX_SAMPLE_LINEAR || (fmt->caps & PL_FMT_CAP_LINEAR));
+            require(!desc.fixed_sampler || (db.sample_mode == desc.sample_mode &&
+                                            db.address_mode == desc.address_mode));
             break;
         }
         case PL_DESC_STORAGE_IMG: {
@@ -1526,6 +2483,12 @@ void pl_pass_run(pl_gpu gpu, const struct pl_pass_run_params *params)
         case PL_DESC_BUF_UNIFORM: {
             pl_buf buf = db.object;
             require(buf->params.uniform);
+            if (db.buf_offset || db.buf_size) {
+                size_t align = gpu->limits.align_ubo_offset;
+                require(align && db.buf_offset % align == 0);
+                require(db.buf_offset + db.buf_size <= buf->params.size);
+                require(db.buf_offset < buf->params.size);
+            }
             break;
         }
         case PL_DESC_BUF_STORAGE: {
@@ -1592,6 +2555,25 @@ void pl_pass_run(pl_gpu gpu, const struct pl_pass_run_params *params)
             require(params->index_offset + index_size <= index_buf->params.size);
         }
 
+        bool instanced = false;
+        for (int i = 0; i < pass->params.num_vertex_attribs; i++)
+            instanced |= pass->params.vertex_attribs[i].instanced;
+
+        require(params->instance_count >= 0);
+        require(params->instance_count <= 1 || gpu->limits.instancing);
+        if (instanced) {
+            require(params->instance_count > 0);
+            require(!params->instance_data ^ !params->instance_buf);
+            if (params->instance_buf) {
+                pl_buf instance_buf = params->instance_buf;
+                size_t size = params->instance_count * pass->params.instance_stride;
+                require(instance_buf->params.drawable);
+                require(params->instance_offset + size <= instance_buf->params.size);
+            }
+        } else {
+            require(!params->instance_data && !params->instance_buf);
+        }
+
         pl_tex target = params->target;
         require(target);
         require(pl_tex_params_dimension(target->params) == 2);
@@ -1643,8 +2625,29 @@ void pl_pass_run(pl_gpu gpu, const struct pl_pass_run_params *params)
         pl_unreachable();
     }
 
+    // Backends only source per-instance data from buffers, so upload host
+    // instance data into a temporary buffer
+    pl_buf instance_buf = NULL;
+    if (new.instance_data) {
+        instance_buf = pl_buf_create(gpu, pl_buf_params(
+            .size = new.instance_count * pass->params.instance_stride,
+            .initial_data = new.instance_data,
+            .drawable = true,
+            .debug_tag = PL_DEBUG_TAG,
+        ));
+
+        if (!instance_buf) {
+            PL_ERR(gpu, "Failed allocating instance buffer!");
+            return;
+        }
+
+        new.instance_buf = instance_buf;
+        new.instance_data = NULL;
+    }
+
     const struct pl_gpu_fns *impl = PL_PRIV(gpu);
     impl->pass_run(gpu, &new);
+    pl_buf_destroy(gpu, &instance_buf);
 
 error:
     return;
@@ -1663,6 +2666,115 @@ void pl_gpu_finish(pl_gpu gpu)
     impl->gpu_finish(gpu);
 }
 
+// Retires all completed frames, waiting for up to `timeout` nanoseconds in
+// total for the number of frames in flight to drop to `max_frames`
+static int retire_frames(pl_gpu gpu, int max_frames, uint64_t timeout)
+{
+    struct pl_gpu_fns *impl = PL_PRIV(gpu);
+    struct pl_frame_fences *frames = impl->frames;
+    const uint64_t start = timeout ? pl_clock_now() : 0;
+
+    while (frames->fences.num) {
+        uint64_t left = 0;
+        if (max_frames > 0 && frames->fences.num > max_frames && timeout) {
+            uint64_t elapsed = pl_clock_now() - start;
+            left = elapsed < timeout ? timeout - elapsed : 0;
+        }
+
+        void *fence = frames->fences.elem[0];
+        if (!impl->fence_wait(gpu, fence, left))
+            break;
+        impl->fence_destroy(gpu, fence);
+        PL_ARRAY_REMOVE_AT(frames->fences, 0);
+    }
+
+    return frames->fences.num;
+}
+
+bool pl_gpu_end_frame(pl_gpu gpu, int max_frames, uint64_t timeout)
+{
+    const struct pl_gpu_fns *impl = PL_PRIV(gpu);
+    struct pl_frame_fences *frames = impl->frames;
+    void *fence = impl->fence_create ? impl->fence_create(gpu) : NULL;
+    if (!fence) {
+        // Can't track this frame, so just treat it as completed
+        pl_gpu_flush(gpu);
+        return true;
+    }
+
+    pl_mutex_lock(&frames->lock);
+    PL_ARRAY_APPEND(frames, frames->fences, fence);
+    int in_flight = retire_frames(gpu, max_frames, timeout);
+    pl_mutex_unlock(&frames->lock);
+    return max_frames <= 0 || in_flight <= max_frames;
+}
+
+int pl_gpu_frames_in_flight(pl_gpu gpu)
+{
+    const struct pl_gpu_fns *impl = PL_PRIV(gpu);
+    struct pl_frame_fences *frames = impl->frames;
+    if (!impl->fence_create)
+        return 0;
+
+    pl_mutex_lock(&frames->lock);
+    int in_flight = retire_frames(gpu, 0, 0);
+    pl_mutex_unlock(&frames->lock);
+    return in_flight;
+}
+
+bool pl_gpu_completion_handle(pl_gpu gpu, union pl_handle *out)
+{
+    const struct pl_gpu_fns *impl = PL_PRIV(gpu);
+    struct pl_gpu_notifier *notifier = impl->notifier;
+    if (!gpu->limits.thread_safe) {
+        PL_ERR(gpu, "Completion handles require a thread-safe GPU!");
+        return false;
+    }
+
+    union pl_handle ours, theirs;
+    if (!notify_handle_create(&ours, &theirs)) {
+        PL_ERR(gpu, "Failed creating completion handle!");
+        return false;
+    }
+
+    void *fence = impl->fence_create ? impl->fence_create(gpu) : NULL;
+    if (!fence) {
+        // Can't track completion, so treat all work as completed, consistent
+        // with `pl_gpu_end_frame`
+        pl_gpu_flush(gpu);
+        notify_handle_signal(&ours);
+        *out = theirs;
+        return true;
+    }
+
+    pl_mutex_lock(&notifier->lock);
+    if (!notifier->running) {
+        if (pl_thread_create(&notifier->thread, notifier_thread, notifier)) {
+            pl_mutex_unlock(&notifier->lock);
+            PL_ERR(gpu, "Failed creating completion notifier thread!");
+            impl->fence_wait(gpu, fence, UINT64_MAX);
+            impl->fence_destroy(gpu, fence);
+            notify_handle_signal(&ours);
+#ifdef PL_HAVE_WIN32
+            CloseHandle(theirs.handle);
+#else
+            close(theirs.fd);
+#endif
+            return false;
+        }
+        notifier->running = true;
+    }
+
+    PL_ARRAY_APPEND(notifier, notifier->reqs, (struct notify_req) {
+        .fence = fence,
+        .signal = ours,
+    });
+    pl_cond_signal(&notifier->cond);
+    pl_mutex_unlock(&notifier->lock);
+    *out = theirs;
+    return true;
+}
+
 bool pl_gpu_is_failed(pl_gpu gpu)
 {
     const struct pl_gpu_fns *impl = PL_PRIV(gpu);
@@ -1672,8 +2784,41 @@ bool pl_gpu_is_failed(pl_gpu gpu)
     return impl->gpu_is_failed(gpu);
 }
 
+void pl_gpu_set_cache(pl_gpu gpu, pl_cache cache)
+{
+    struct pl_gpu_fns *impl = PL_PRIV(gpu);
+    atomic_store(&impl->cache, cache);
+}
+
+pl_cache pl_gpu_cache(pl_gpu gpu)
+{
+    if (!gpu)
+        return NULL;
+
+    struct pl_gpu_fns *impl = PL_PRIV(gpu);
+    return atomic_load(&impl->cache);
+}
+
 // GPU-internal helpers
 
+// Returns a reference to a cached import of the persistent memory at
+// `params->ptr`, or NULL if it can't be used for the transfer
+static pl_buf transfer_import(pl_gpu gpu, const struct pl_tex_transfer_params *params,
+                              size_t size, size_t *out_offset)
+{
+    if (!params->ptr_persistent)
+        return NULL;
+
+    pl_fmt fmt = params->tex->params.format;
+    pl_buf buf = pl_buf_cache_import(gpu, params->ptr, size, out_offset);
+    if (buf && *out_offset % fmt->texel_size) {
+        pl_buf_cache_release(gpu, &buf);
+        *out_offset = 0;
+    }
+
+    return buf;
+}
+
 bool pl_tex_upload_pbo(pl_gpu gpu, const struct pl_tex_transfer_params *params)
 {
     if (params->buf)
@@ -1685,12 +2830,18 @@ bool pl_tex_upload_pbo(pl_gpu gpu, const struct pl_tex_transfer_params *params)
         .debug_tag = PL_DEBUG_TAG,
     };
 
+    // Asynchronous uploads from persistent memory can use a cached import
+    size_t buf_offset = 0;
+    if (params->callback)
+        buf = transfer_import(gpu, params, bufparams.size, &buf_offset);
+    bool cached = buf;
+
     // If we can import host pointers directly, and the function is being used
     // asynchronously, then we can use host pointer import to skip a memcpy. In
     // the synchronous case, we still force a host memcpy to avoid stalling the
     // host until the GPU memcpy completes.
     bool can_import = gpu->import_caps.buf & PL_HANDLE_HOST_PTR;
-    if (can_import && params->callback && bufparams.size > 32*1024) { // 32 KiB
+    if (!buf && can_import && params->callback && bufparams.size > 32*1024) { // 32 KiB
         bufparams.import_handle = PL_HANDLE_HOST_PTR;
         bufparams.shared_mem = (struct pl_shared_mem) {
             .handle.ptr = params->ptr,
@@ -1705,24 +2856,29 @@ bool pl_tex_upload_pbo(pl_gpu gpu, const struct pl_tex_transfer_params *params)
         pl_log_level_cap(gpu->log, PL_LOG_NONE);
     }
 
-    if (!buf) {
-        bufparams.import_handle = 0;
-        bufparams.host_writable = true;
-        buf = pl_buf_create(gpu, &bufparams);
-    }
-
+    // Otherwise, copy the data into a pooled staging buffer
+    bool staged = !buf;
+    if (staged)
+        buf = pl_staging_get(gpu, bufparams.size, false);
     if (!buf)
         return false;
 
-    if (!bufparams.import_handle)
-        pl_buf_write(gpu, buf, 0, params->ptr, buf->params.size);
+    if (staged)
+        pl_buf_write(gpu, buf, 0, params->ptr, bufparams.size);
 
     struct pl_tex_transfer_params newparams = *params;
     newparams.buf = buf;
+    newparams.buf_offset = buf_offset;
     newparams.ptr = NULL;
 
     bool ok = pl_tex_upload(gpu, &newparams);
-    pl_buf_destroy(gpu, &buf);
+    if (staged) {
+        pl_staging_put(gpu, buf);
+    } else if (cached) {
+        pl_buf_cache_release(gpu, &buf);
+    } else {
+        pl_buf_destroy(gpu, &buf);
+    }
     return ok;
 }
 
@@ -1756,11 +2912,19 @@ bool pl_tex_download_pbo(pl_gpu gpu, const struct pl_tex_transfer_params *params
         .debug_tag = PL_DEBUG_TAG,
     };
 
+    // Persistent memory can be downloaded into from a cached import, which
+    // avoids both the memcpy and the cost of re-importing it every time
+    size_t buf_offset = 0;
+    buf = transfer_import(gpu, params, bufparams.size, &buf_offset);
+    bool cached = buf;
+    if (cached)
+        bufparams.import_handle = PL_HANDLE_HOST_PTR;
+
     // If we can import host pointers directly, we can avoid an extra memcpy
     // (sometimes). In the cases where it isn't avoidable, the extra memcpy
     // will happen inside VRAM, which is typically faster anyway.
     bool can_import = gpu->import_caps.buf & PL_HANDLE_HOST_PTR;
-    if (can_import && bufparams.size > 32*1024) { // 32 KiB
+    if (!buf && can_import && bufparams.size > 32*1024) { // 32 KiB
         bufparams.import_handle = PL_HANDLE_HOST_PTR;
         bufparams.shared_mem = (struct pl_shared_mem) {
             .handle.ptr = params->ptr,
@@ -1788,6 +2952,7 @@ bool pl_tex_download_pbo(pl_gpu gpu, const struct pl_tex_transfer_params *params
     struct pl_tex_transfer_params newparams = *params;
     newparams.ptr = NULL;
     newparams.buf = buf;
+    newparams.buf_offset = buf_offset;
 
     // If the transfer is asynchronous, propagate our host read asynchronously
     if (params->callback && !bufparams.import_handle) {
@@ -1802,7 +2967,11 @@ bool pl_tex_download_pbo(pl_gpu gpu, const struct pl_tex_transfer_params *params
     }
 
     if (!pl_tex_download(gpu, &newparams)) {
-        pl_buf_destroy(gpu, &buf);
+        if (cached) {
+            pl_buf_cache_release(gpu, &buf);
+        } else {
+            pl_buf_destroy(gpu, &buf);
+        }
         return false;
     }
 
@@ -1812,7 +2981,13 @@ bool pl_tex_download_pbo(pl_gpu gpu, const struct pl_tex_transfer_params *params
     }
 
     bool ok;
-    if (bufparams.import_handle) {
+    if (cached) {
+        // Same as below, but the import stays cached for the next download.
+        // Destroying the buffer while in use is safe, so this may be evicted
+        // before the download completes.
+        ok = true;
+        pl_buf_cache_release(gpu, &buf);
+    } else if (bufparams.import_handle) {
         // Buffer download completion already means the host pointer contains
         // the valid data, no more need to copy. (Note: this applies even for
         // asynchronous downloads)
@@ -1877,14 +3052,14 @@ bool pl_tex_upload_texel(pl_gpu gpu, pl_dispatch dp,
     assert(fmt->texel_size == fmt->num_components * fmt->texel_align);
     GLSL("vec4 color = vec4(0.0, 0.0, 0.0, 1.0);                        \n"
          "ivec3 pos = ivec3(gl_GlobalInvocationID) + ivec3(%d, %d, %d); \n"
-         "int base = pos.z * %s + pos.y * %s + pos.x * %s;              \n",
+         "int base = pos.z * "$" + pos.y * "$" + pos.x * "$";           \n",
          params->rc.x0, params->rc.y0, params->rc.z0,
          SH_INT(params->depth_pitch / fmt->texel_align),
          SH_INT(params->row_pitch / fmt->texel_align),
          SH_INT(fmt->texel_size / fmt->texel_align));
 
     for (int i = 0; i < fmt->num_components; i++) {
-        GLSL("color[%d] = %s(%s, base + %d).r; \n",
+        GLSL("color[%d] = %s("$", base + %d).r; \n",
              i, ubo ? "texelFetch" : "imageLoad", buf, i);
     }
 
@@ -1895,7 +3070,7 @@ bool pl_tex_upload_texel(pl_gpu gpu, pl_dispatch dp,
         [3] = "ivec3",
     };
 
-    GLSL("imageStore(%s, %s(pos), color);\n", img, coord_types[dims]);
+    GLSL("imageStore("$", %s(pos), color);\n", img, coord_types[dims]);
     return pl_dispatch_compute(dp, pl_dispatch_compute_params(
         .shader = &sh,
         .dispatch_size = {
@@ -1957,8 +3132,8 @@ bool pl_tex_download_texel(pl_gpu gpu, pl_dispatch dp,
 
     assert(fmt->texel_size == fmt->num_components * fmt->texel_align);
     GLSL("ivec3 pos = ivec3(gl_GlobalInvocationID) + ivec3(%d, %d, %d); \n"
-         "int base = pos.z * %s + pos.y * %s + pos.x * %s;              \n"
-         "vec4 color = imageLoad(%s, %s(pos));                          \n",
+         "int base = pos.z * "$" + pos.y * "$" + pos.x * "$";           \n"
+         "vec4 color = imageLoad("$", %s(pos));                         \n",
          params->rc.x0, params->rc.y0, params->rc.z0,
          SH_INT(params->depth_pitch / fmt->texel_align),
          SH_INT(params->row_pitch / fmt->texel_align),
@@ -1966,7 +3141,7 @@ bool pl_tex_download_texel(pl_gpu gpu, pl_dispatch dp,
          img, coord_types[dims]);
 
     for (int i = 0; i < fmt->num_components; i++)
-        GLSL("imageStore(%s, base + %d, vec4(color[%d])); \n", buf, i, i);
+        GLSL("imageStore("$", base + %d, vec4(color[%d])); \n", buf, i, i);
 
     return pl_dispatch_compute(dp, pl_dispatch_compute_params(
         .shader = &sh,
@@ -1984,7 +3159,7 @@ error:
 bool pl_tex_blit_compute(pl_gpu gpu, pl_dispatch dp,
                          const struct pl_tex_blit_params *params)
 {
-    if (!params->src->params.storable || !params->dst->params.storable)
+    if (!params->dst->params.storable)
         return false;
 
     // Normalize `dst_rc`, moving all flipping to `src_rc` instead.
@@ -2013,6 +3188,13 @@ bool pl_tex_blit_compute(pl_gpu gpu, pl_dispatch dp,
     if (needs_sampling && !params->src->params.sampleable)
         return false;
 
+    // Scaled blits go through the sampler whenever possible, otherwise `src`
+    // is read using direct image loads
+    bool use_sampler = needs_sampling ||
+                       (needs_scaling && params->src->params.sampleable);
+    if (!use_sampler && !params->src->params.storable)
+        return false;
+
     const int threads = 256;
     int bw = PL_MIN(32, pl_rect_w(dst_rc));
     int bh = PL_MIN(threads / bw, pl_rect_h(dst_rc));
@@ -2067,7 +3249,7 @@ bool pl_tex_blit_compute(pl_gpu gpu, pl_dispatch dp,
          ivecs[dst_dims], ivecs[dst_dims],
          params->dst_rc.x0, params->dst_rc.y0, params->dst_rc.z0);
 
-    if (needs_sampling || (needs_scaling && params->src->params.sampleable)) {
+    if (use_sampler) {
 
         ident_t src = sh_desc(sh, (struct pl_shader_desc) {
             .desc = {
@@ -2101,8 +3283,39 @@ bool pl_tex_blit_compute(pl_gpu gpu, pl_dispatch dp,
                  (float) src_rc.z1 / params->src->params.d);
         }
 
-        GLSL("imageStore(%s, dst_pos, %s(%s, src_pos)); \n",
-             dst, sh_tex_fn(sh, params->src->params), src);
+        // For large linear downscales, a single bilinear tap per texel would
+        // skip over most of the source. Instead, average a grid of bilinear
+        // taps spread over the texel footprint, each of which already covers
+        // 2x2 source texels. This gives an exact box filter for 4x and 8x
+        // reductions
+        int taps_x = 1, taps_y = 1;
+        if (params->sample_mode == PL_TEX_SAMPLE_LINEAR && src_dims == 2) {
+            float rx = fabs((float) pl_rect_w(src_rc) / pl_rect_w(dst_rc)),
+                  ry = fabs((float) pl_rect_h(src_rc) / pl_rect_h(dst_rc));
+            taps_x = rx >= 8 ? 4 : rx >= 4 ? 2 : 1;
+            taps_y = ry >= 8 ? 4 : ry >= 4 ? 2 : 1;
+        }
+
+        if (taps_x > 1 || taps_y > 1) {
+            GLSL("vec4 color = vec4(0.0);                       \n"
+                 "const vec2 tap_step = vec2(%f, %f);            \n"
+                 "for (int y = 0; y < %d; y++) {                 \n"
+                 "for (int x = 0; x < %d; x++) {                 \n"
+                 "    vec2 tap = vec2(x, y) - vec2(%f, %f);      \n"
+                 "    color += %s("$", src_pos + tap * tap_step); \n"
+                 "}}                                             \n"
+                 "imageStore("$", dst_pos, color * vec4(%f));    \n",
+                 (float) pl_rect_w(src_rc) / (taps_x * pl_rect_w(dst_rc) *
+                                              params->src->params.w),
+                 (float) pl_rect_h(src_rc) / (taps_y * pl_rect_h(dst_rc) *
+                                              params->src->params.h),
+                 taps_y, taps_x, 0.5 * (taps_x - 1), 0.5 * (taps_y - 1),
+                 sh_tex_fn(sh, params->src->params), src,
+                 dst, 1.0 / (taps_x * taps_y));
+        } else {
+            GLSL("imageStore("$", dst_pos, %s("$", src_pos)); \n",
+                 dst, sh_tex_fn(sh, params->src->params), src);
+        }
 
     } else {
 
@@ -2125,7 +3338,7 @@ bool pl_tex_blit_compute(pl_gpu gpu, pl_dispatch dp,
         }
 
         GLSL("src_pos = ivec3(%d, %d, %d) * src_pos + ivec3(%d, %d, %d);    \n"
-             "imageStore(%s, dst_pos, imageLoad(%s, %s(src_pos)));          \n",
+             "imageStore("$", dst_pos, imageLoad("$", %s(src_pos)));        \n",
              src_rc.x1 < src_rc.x0 ? -1 : 1,
              src_rc.y1 < src_rc.y0 ? -1 : 1,
              src_rc.z1 < src_rc.z0 ? -1 : 1,
@@ -2173,7 +3386,7 @@ void pl_tex_blit_raster(pl_gpu gpu, pl_dispatch dp,
     ident_t pos, src = sh_bind(sh, params->src, PL_TEX_ADDRESS_CLAMP,
         params->sample_mode, "src_tex", &src_rc, &pos, NULL, NULL);
 
-    GLSL("vec4 color = %s(%s, %s); \n",
+    GLSL("vec4 color = %s("$", "$"); \n",
          sh_tex_fn(sh, params->src->params), src, pos);
 
     pl_dispatch_finish(dp, pl_dispatch_params(
@@ -2196,6 +3409,7 @@ void pl_pass_run_vbo(pl_gpu gpu, const struct pl_pass_run_params *params)
             .size = pl_vertex_buf_size(params),
             .initial_data = params->vertex_data,
             .drawable = true,
+            .debug_tag = PL_DEBUG_TAG,
         ));
 
         if (!vert) {
@@ -2212,6 +3426,7 @@ void pl_pass_run_vbo(pl_gpu gpu, const struct pl_pass_run_params *params)
             .size = pl_index_buf_size(params),
             .initial_data = params->index_data,
             .drawable = true,
+            .debug_tag = PL_DEBUG_TAG,
         ));
 
         if (!index) {
@@ -2273,6 +3488,19 @@ error:
     return NULL;
 }
 
+pl_sync pl_sync_create_timeline(pl_gpu gpu, enum pl_handle_type handle_type)
+{
+    require(handle_type);
+    require(handle_type & gpu->export_caps.sync_timeline);
+    require(PL_ISPOT(handle_type));
+
+    const struct pl_gpu_fns *impl = PL_PRIV(gpu);
+    return impl->sync_create_timeline(gpu, handle_type);
+
+error:
+    return NULL;
+}
+
 void pl_sync_destroy(pl_gpu gpu, pl_sync *sync)
 {
     if (!*sync)
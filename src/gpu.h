@@ -58,12 +58,90 @@ struct pl_gpu_fns {
     GPU_PFN(pass_create);
     GPU_PFN(pass_run);
     GPU_PFN(sync_create); // optional if !gpu->export_caps.sync
+    GPU_PFN(sync_create_timeline); // optional if !gpu->export_caps.sync_timeline
     GPU_PFN(tex_export); // optional if !gpu->export_caps.sync
     GPU_PFN(timer_create); // optional
     GPU_PFN(timer_query); // optional
     GPU_PFN(gpu_flush); // optional
     GPU_PFN(gpu_finish);
     GPU_PFN(gpu_is_failed); // optional
+
+    // Optional: Resets a texture imported from a DMA-BUF back to the state
+    // of a freshly imported texture, before it gets reused by the import cache
+    void (*tex_reset_import)(pl_gpu, pl_tex);
+
+    // Optional: Like `pass_create`, but only starts compiling the pass
+    // without waiting for the result. Passes created this way must be polled
+    // with `pass_poll` before they are used.
+    pl_pass (*pass_create_async)(pl_gpu, const struct pl_pass_params *);
+
+    // Optional: Returns true once `pass` is done compiling, setting `ok`
+    // to indicate whether this succeeded. If `block` is true, this waits
+    // for compilation to complete. Only needed if `pass_create_async` is set.
+    bool (*pass_poll)(pl_gpu, pl_pass, bool block, bool *ok);
+
+    // Optional: Flushes all previously submitted work, and returns a fence
+    // that signals once it has completed, or NULL on failure. Fences must only
+    // be destroyed after `fence_wait` has returned true for them.
+    void *(*fence_create)(pl_gpu);
+    bool (*fence_wait)(pl_gpu, void *fence, uint64_t timeout);
+    void (*fence_destroy)(pl_gpu, void *fence);
+
+    // Not a function: true if `fence_wait` doesn't prevent other threads from
+    // using the GPU while blocking. Otherwise, it's only ever called with a
+    // timeout of 0 outside of the thread submitting work.
+    bool fence_wait_unlocked;
+
+    // Optional: Fills in the backend-specific fields of `pl_gpu_memory_stats`,
+    // i.e. `heaps`, `num_heaps` and `slab_efficiency`
+    void (*memory_stats)(pl_gpu, struct pl_gpu_memory_stats *);
+
+    // Not a function: shared texture cache, managed by `pl_gpu_finalize`
+    struct pl_tex_cache *tex_cache;
+
+    // Not a function: host pointer import cache, managed by `pl_gpu_finalize`
+    struct pl_buf_cache *buf_cache;
+
+    // Not a function: DMA-BUF texture import cache, managed by `pl_gpu_finalize`
+    struct pl_dmabuf_cache *dmabuf_cache;
+
+    // Not a function: `pl_plane_find_fmt` result cache, managed by
+    // `pl_gpu_finalize`
+    struct pl_plane_fmt_cache *plane_fmt_cache;
+
+    // Not a function: staging buffer pool for `pl_tex_upload_pbo`, managed
+    // by `pl_gpu_finalize`
+    struct pl_staging_pool *staging;
+
+    // Not a function: fences of frames in flight, for `pl_gpu_end_frame`,
+    // managed by `pl_gpu_finalize`
+    struct pl_frame_fences *frames;
+
+    // Not a function: thread signalling the handles returned by
+    // `pl_gpu_completion_handle`, created on demand
+    struct pl_gpu_notifier *notifier;
+
+    // Not a function: dispatch object for internal helpers that run shaders
+    // without one being provided by the user (e.g. `pl_upload_packed`),
+    // managed by `pl_gpu_finalize`
+    pl_dispatch dp;
+
+    // Not a function: user-provided object cache, see `pl_gpu_set_cache`
+    _Atomic(pl_cache) cache;
+
+    // Not a function: counters for `pl_gpu_get_compile_stats`
+    atomic_int compile_passes;
+    atomic_uint_least64_t compile_total;
+    atomic_uint_least64_t compile_spirv;
+    atomic_uint_least64_t compile_driver;
+
+    // Not a function: counters for `pl_gpu_get_memory_stats`, indexed by
+    // `enum pl_gpu_mem_owner`
+    atomic_int mem_textures[PL_GPU_MEM_OWNER_COUNT];
+    atomic_int mem_buffers[PL_GPU_MEM_OWNER_COUNT];
+    atomic_uint_least64_t mem_tex_bytes[PL_GPU_MEM_OWNER_COUNT];
+    atomic_uint_least64_t mem_buf_bytes[PL_GPU_MEM_OWNER_COUNT];
+    atomic_uint_least64_t tex_upload_bytes;
 };
 #undef GPU_PFN
 
@@ -90,6 +168,71 @@ static inline bool pl_gpu_supports_interop(pl_gpu gpu)
 // should be returned as the last step when creating a `pl_gpu`.
 pl_gpu pl_gpu_finalize(struct pl_gpu *gpu);
 
+// GPU-wide cache of immutable textures, keyed by a hash that uniquely
+// identifies their contents and parameters. Used to share identical LUTs
+// between shader objects. These functions are thread-safe.
+//
+// `pl_tex_cache_get` returns a new reference to the texture matching `key`, or
+// NULL if there is none. `pl_tex_cache_add` inserts a freshly created texture,
+// taking over ownership of it, and returns a reference to the cached texture
+// (which may differ from `tex` if another thread inserted one first).
+// References must be released with `pl_tex_cache_release`, which destroys
+// the texture once the last reference is gone.
+pl_tex pl_tex_cache_get(pl_gpu gpu, uint64_t key);
+pl_tex pl_tex_cache_add(pl_gpu gpu, uint64_t key, pl_tex tex);
+void pl_tex_cache_release(pl_gpu gpu, pl_tex *tex);
+
+// GPU-wide cache of buffers wrapping imported host memory (PL_HANDLE_HOST_PTR),
+// keyed by address range. These functions are thread-safe.
+//
+// `pl_buf_cache_import` returns a new reference to a buffer covering the
+// memory range [`ptr`, `ptr + size`), importing it if needed, or NULL if that
+// is not possible. `out_offset` receives the offset of `ptr` within the
+// buffer. References must be released with `pl_buf_cache_release`.
+// `pl_buf_cache_forget` evicts all entries overlapping the given range; any
+// entries still referenced are destroyed once released.
+pl_buf pl_buf_cache_import(pl_gpu gpu, const void *ptr, size_t size,
+                           size_t *out_offset);
+void pl_buf_cache_release(pl_gpu gpu, pl_buf *buf);
+void pl_buf_cache_forget(pl_gpu gpu, const void *ptr, size_t size);
+
+// GPU-wide cache of `pl_plane_find_fmt` results, keyed by the plane layout.
+// The key must be zero-initialized before filling it in, since it's compared
+// bytewise. These functions are thread-safe.
+struct plane_fmt_key {
+    enum pl_fmt_type type;
+    int component_size[4];
+    int component_pad[4];
+    int component_map[4];
+    size_t pixel_stride;
+    size_t row_stride;
+};
+
+bool pl_plane_fmt_cache_get(pl_gpu gpu, const struct plane_fmt_key *key,
+                            pl_fmt *fmt, int map[4]);
+void pl_plane_fmt_cache_add(pl_gpu gpu, const struct plane_fmt_key *key,
+                            pl_fmt fmt, const int map[4]);
+
+// GPU-wide pool of host-writable staging buffers. These functions are
+// thread-safe.
+//
+// `pl_staging_get` returns an idle buffer of at least `size` bytes, which is
+// additionally `storable` if requested, reusing previously returned buffers
+// once the GPU is done with them. Buffers must be returned to the pool with
+// `pl_staging_put` after the last command using them has been submitted.
+pl_buf pl_staging_get(pl_gpu gpu, size_t size, bool storable);
+void pl_staging_put(pl_gpu gpu, pl_buf buf);
+
+// Releases GPU-wide cached resources that are not currently in use (e.g. idle
+// staging buffers), for GPU implementations to call under memory pressure.
+// Thread-safe. Doesn't poll or submit any commands, so this may safely be
+// called from within resource allocation.
+void pl_gpu_trim(pl_gpu gpu);
+
+// Returns the `pl_cache` attached by `pl_gpu_set_cache`, or NULL. Also
+// returns NULL for a NULL `gpu`.
+pl_cache pl_gpu_cache(pl_gpu gpu);
+
 // Look up the right GLSL image format qualifier from a partially filled-in
 // pl_fmt, or NULL if the format does not have a legal matching GLSL name.
 //
@@ -114,8 +257,14 @@ bool pl_tex_upload_texel(pl_gpu gpu, pl_dispatch dp,
 bool pl_tex_download_texel(pl_gpu gpu, pl_dispatch dp,
                            const struct pl_tex_transfer_params *params);
 
-// Both `src` and `dst must be storable. `src` must also be sampleable, if the
-// blit requires linear sampling. Returns false if these conditions are unmet.
+// Returns whether an object created with `a` can be used in place of one
+// created with `b`, as done by `pl_tex_recreate` and `pl_buf_recreate`
+bool pl_tex_params_superset(struct pl_tex_params a, struct pl_tex_params b);
+bool pl_buf_params_superset(struct pl_buf_params a, struct pl_buf_params b);
+
+// `dst` must be storable. `src` must be sampleable if the blit requires linear
+// sampling, and storable if it is not scaled (or not sampleable). Large linear
+// downscales are box-filtered. Returns false if these conditions are unmet.
 bool pl_tex_blit_compute(pl_gpu gpu, pl_dispatch dp,
                          const struct pl_tex_blit_params *params);
 
@@ -125,6 +274,38 @@ void pl_tex_blit_raster(pl_gpu gpu, pl_dispatch dp,
 
 void pl_pass_run_vbo(pl_gpu gpu, const struct pl_pass_run_params *params);
 
+// Create a pass without waiting for its compilation to complete, if the GPU
+// supports compiling passes in parallel (see `pl_gpu_fns.pass_create_async`).
+// Otherwise, this is equivalent to `pl_pass_create`. The resulting pass must
+// not be used before `pl_pass_poll` reports it as ready.
+pl_pass pl_pass_create_async(pl_gpu gpu, const struct pl_pass_params *params);
+
+// Returns true once a pass created by `pl_pass_create_async` is done compiling,
+// storing whether this succeeded in `ok`. Failed passes must be destroyed.
+// If `block` is true, this always returns true.
+bool pl_pass_poll(pl_gpu gpu, pl_pass pass, bool block, bool *ok);
+
+// Account time (in nanoseconds) spent in the respective stages of pass
+// compilation, for `pl_gpu_get_compile_stats`. Thread-safe.
+void pl_gpu_count_spirv(pl_gpu gpu, uint64_t ns);
+void pl_gpu_count_driver(pl_gpu gpu, uint64_t ns);
+
+// Accounts for a texture that was not created via `pl_tex_create`, e.g. by
+// wrapping an external object, for `pl_gpu_get_memory_stats`. Backends must
+// call this for all such textures, since `pl_tex_destroy` unconditionally
+// removes them from the statistics again. Thread-safe.
+void pl_gpu_track_tex(pl_gpu gpu, pl_tex tex);
+
+// Debug tag of the textures in the frame mixing cache, which are attributed
+// separately from those of the rest of the renderer
+#define PL_DEBUG_TAG_MIXER "pl_renderer frame mixing cache"
+
+static inline bool pl_gpu_parallel_compile(pl_gpu gpu)
+{
+    const struct pl_gpu_fns *impl = PL_PRIV(gpu);
+    return impl->pass_create_async;
+}
+
 // Make a deep-copy of the pass params. Note: cached_program etc. are not
 // copied, but cleared explicitly.
 struct pl_pass_params pl_pass_params_copy(void *alloc, const struct pl_pass_params *params);
@@ -0,0 +1,144 @@
+/*
+ * This file is part of libplacebo.
+ *
+ * libplacebo is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * libplacebo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with libplacebo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBPLACEBO_CACHE_H_
+#define LIBPLACEBO_CACHE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <libplacebo/config.h>
+#include <libplacebo/common.h>
+#include <libplacebo/log.h>
+
+PL_API_BEGIN
+
+// A single keyed blob stored in (or retrieved from) a `pl_cache`.
+typedef struct pl_cache_obj {
+    // Unique key identifying this object. Keys are generated internally by
+    // the subsystems using the cache, and should be treated as opaque.
+    uint64_t key;
+
+    // Contents of this object. A `size` of 0 represents an empty object.
+    void *data;
+    size_t size;
+
+    // Deallocator for `data`, or NULL if `data` is not owned by this object.
+    // Objects returned by `pl_cache_get` always have this set, and must be
+    // released with `pl_cache_obj_free`.
+    void (*free)(void *data);
+} pl_cache_obj;
+
+// Release the data associated with a `pl_cache_obj`, and reset it. Safe to
+// call on objects without a `free` callback, in which case only the object
+// itself is reset.
+void pl_cache_obj_free(pl_cache_obj *obj);
+
+struct pl_cache_params {
+    // Optional logging context.
+    pl_log log;
+
+    // Objects larger than this size (in bytes) are never stored. If 0, there
+    // is no limit.
+    size_t max_object_size;
+
+    // Total size budget of the cache, in bytes. Once exceeded, the least
+    // recently used objects are evicted until the cache fits again. If 0,
+    // there is no limit.
+    size_t max_total_size;
+
+    // Optional external storage callbacks, e.g. for write-through persistence
+    // to a database or a directory of files.
+    //
+    // `set` is called on every insertion into the cache (with a temporary
+    // view of the object, which must be copied if retained), as well as on
+    // explicit deletions (with `size == 0`). It is not called for objects
+    // added by `pl_cache_load`, or for objects returned by `get`.
+    //
+    // `get` is called whenever an object is not present in the cache. It
+    // should return the stored object with the matching key, with a `free`
+    // callback that releases its data, or an empty object if there is none.
+    // The cache takes over ownership of the returned data.
+    //
+    // Both callbacks may be called from any thread, but never concurrently
+    // for the same `pl_cache`.
+    void (*set)(void *priv, pl_cache_obj obj);
+    pl_cache_obj (*get)(void *priv, uint64_t key);
+    void *priv;
+};
+
+#define pl_cache_params(...) (&(struct pl_cache_params) { __VA_ARGS__ })
+
+// Cache of keyed binary blobs, such as compiled shader programs or
+// precomputed LUT contents. A single `pl_cache` may be shared by any number
+// of `pl_gpu`s (and thereby all `pl_dispatch`es and `pl_renderer`s using
+// them), which allows managing the persistence and size budget of all cached
+// data in one place. See `pl_gpu_set_cache`.
+//
+// Thread-safety: Safe
+typedef const PL_STRUCT(pl_cache) {
+    struct pl_cache_params params;
+} *pl_cache;
+
+// Create a new, empty cache. Never fails.
+pl_cache pl_cache_create(const struct pl_cache_params *params);
+
+// Destroy a cache, freeing all stored objects. Does not invoke `set`. The
+// cache must no longer be attached to any `pl_gpu` at this point.
+void pl_cache_destroy(pl_cache *cache);
+
+// Removes all objects from the cache. Does not invoke `set`.
+void pl_cache_reset(pl_cache cache);
+
+// Returns the total size (in bytes) and number of all objects in the cache.
+size_t pl_cache_size(pl_cache cache);
+int pl_cache_objects(pl_cache cache);
+
+// Look up the object with the key `obj->key`, falling back to the `get`
+// callback if it's not present. Returns false if no such object exists, in
+// which case `obj` is left empty. On success, `obj` receives a private copy
+// of the object, which must be freed by `pl_cache_obj_free`.
+bool pl_cache_get(pl_cache cache, pl_cache_obj *obj);
+
+// Insert (or replace) an object in the cache. If `obj->free` is set, the cache
+// takes over ownership of `obj->data`, otherwise the data is copied. Setting
+// an object with `size == 0` deletes any existing object with the same key.
+// `obj` is reset afterwards. Objects exceeding `max_object_size` are
+// released and ignored.
+void pl_cache_set(pl_cache cache, pl_cache_obj *obj);
+
+// Serialize the contents of the cache. Returns the number of bytes written to
+// `out_cache`, or the number of bytes that *would* have been written to
+// `out_cache` if it's NULL. This does not truncate, so the buffer provided by
+// the user must be large enough to contain the entire output.
+//
+// Note: Concurrent insertions may change the required size between calls.
+size_t pl_cache_save(pl_cache cache, uint8_t *out_cache);
+
+// Load the result of a previous `pl_cache_save` call, merging its contents
+// into the cache (replacing any existing objects with the same keys).
+// Returns the number of objects loaded, or a negative number if `data` is
+// not a valid serialized cache. Corrupt objects are skipped individually.
+//
+// Note: Loaded objects are untrusted input to the subsystems using the cache.
+// See the security warnings on `pl_pass_params.cached_program`.
+int pl_cache_load(pl_cache cache, const uint8_t *data, size_t size);
+
+PL_API_END
+
+#endif // LIBPLACEBO_CACHE_H_
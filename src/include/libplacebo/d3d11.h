@@ -32,6 +32,14 @@ typedef const PL_STRUCT(pl_d3d11) {
     // purposes, including taking a reference to the device (with AddRef) and
     // using it beyond the lifetime of the pl_d3d11 that created it (though if
     // this is done with debug enabled, it will confuse the leak checker.)
+    //
+    // Note: `gpu` is thread-safe, and may be used by several threads (e.g.
+    // one `pl_renderer` each) at once. Since device contexts are not, calls
+    // touching the immediate context are serialized internally. On runtimes
+    // exposing ID3D11Multithread, libplacebo enables multithread protection
+    // and uses ID3D11Multithread::Enter/Leave for this, so that users can
+    // safely submit their own work on the immediate context from other
+    // threads by doing the same.
     ID3D11Device *device;
 
     // True if the device is using a software (WARP) adapter
@@ -116,6 +124,14 @@ struct pl_d3d11_params {
     // swapchains (except for waitable swapchains.) See the documentation for
     // `pl_swapchain_latency` for more information.
     int max_frame_latency;
+
+    // If true, libplacebo assumes that nobody else modifies the shaders,
+    // shader resources, samplers or fixed function state of the immediate
+    // context in between calls into libplacebo. This allows leaving these
+    // bound after each shader pass, instead of unbinding them again, which
+    // avoids redundant state changes between consecutive passes. Leave this
+    // disabled when sharing the immediate context with other rendering code.
+    bool exclusive;
 };
 
 // Default/recommended parameters. Should generally be safe and efficient.
@@ -143,6 +159,23 @@ void pl_d3d11_destroy(pl_d3d11 *d3d11);
 // the underlying `pl_d3d11`. Returns NULL for any other type of `gpu`.
 pl_d3d11 pl_d3d11_get(pl_gpu gpu);
 
+// Serialize the device-wide shader cache, which holds the compiled DXBC of
+// all passes created on this `pl_gpu`, into an opaque buffer that can be e.g.
+// saved to disk and loaded again later. Writes at most `size` bytes to
+// `out_cache`. Returns the number of bytes written, or the size required to
+// hold the entire cache if `out_cache` is NULL. Returns 0 for non-D3D11 GPUs.
+//
+// Note: Unlike `pl_dispatch_save`, this is independent of any particular
+// `pl_dispatch` or `pl_renderer`, so passes are shared between all of them,
+// including libplacebo's own internal passes (e.g. for blits).
+size_t pl_d3d11_save_shader_cache(pl_gpu gpu, uint8_t *out_cache, size_t size);
+
+// Load the result of a previous `pl_d3d11_save_shader_cache` call, merging
+// it into the device-wide shader cache. Programs created by a different
+// shader compiler version or feature level are ignored. This is safe to call
+// from any thread at any time, but only benefits passes created afterwards.
+void pl_d3d11_load_shader_cache(pl_gpu gpu, const uint8_t *cache, size_t size);
+
 struct pl_d3d11_swapchain_params {
     // The Direct3D 11 swapchain to wrap. Optional. If NULL, libplacebo will
     // create its own swapchain using the options below. If set, all the options
@@ -182,6 +215,18 @@ struct pl_d3d11_swapchain_params {
     // No validation on these flags is being performed, and swapchain creation
     // may fail if an unsupported combination is requested.
     UINT flags;
+
+    // If set, libplacebo will create a flip-model swapchain with
+    // DXGI_SWAP_CHAIN_FLAG_FRAME_LATENCY_WAITABLE_OBJECT, limited to at most
+    // this many queued frames. `pl_swapchain_start_frame` then blocks until
+    // the swapchain is ready to accept a new frame, which gives predictable
+    // latency independent of the driver's render-ahead queue (e.g. 1 for
+    // single-frame latency). Ignored for bitblt-model swapchains.
+    //
+    // If `swapchain` is set and was created with the waitable object flag,
+    // libplacebo will wait on it regardless, and this field (if set) updates
+    // its maximum frame latency.
+    int max_latency;
 };
 
 #define pl_d3d11_swapchain_params(...) (&(struct pl_d3d11_swapchain_params) { __VA_ARGS__ })
@@ -197,6 +242,24 @@ pl_swapchain pl_d3d11_create_swapchain(pl_d3d11 d3d11,
 // call IDXGISwapChain::Release when finished with it.
 IDXGISwapChain *pl_d3d11_swapchain_unwrap(pl_swapchain sw);
 
+// Presentation statistics, as reported by IDXGISwapChain::GetFrameStatistics
+struct pl_d3d11_swapchain_stats {
+    uint64_t present_count;         // number of the last presented frame
+    uint64_t present_refresh_count; // vblank count it was displayed at
+    uint64_t sync_refresh_count;    // vblank count of the last sampled vblank
+    int64_t sync_qpc_time;          // QueryPerformanceCounter() of that vblank
+    uint64_t last_present_count;    // number of the last submitted frame
+
+    // Number of vblanks at which no new frame was displayed since the
+    // previous call to this function, e.g. because a frame was late
+    uint64_t missed_vblanks;
+};
+
+// Returns the current presentation statistics of a `pl_swapchain` created by
+// `pl_d3d11_create_swapchain`. Returns false if unavailable, e.g. for
+// bitblt-model swapchains in windowed mode or before the first present.
+bool pl_d3d11_swapchain_stats(pl_swapchain sw, struct pl_d3d11_swapchain_stats *stats);
+
 struct pl_d3d11_wrap_params {
     // The D3D11 texture to wrap, or a texture array containing the texture to
     // wrap. Must be a ID3D11Texture1D, ID3D11Texture2D or ID3D11Texture3D
@@ -42,6 +42,14 @@ void pl_dispatch_destroy(pl_dispatch *dp);
 // are the same.
 void pl_dispatch_reset_frame(pl_dispatch dp);
 
+// Configure the size budget of the internal cache of compiled passes. Whenever
+// more than `max_passes` passes, or more than `max_bytes` bytes worth of
+// (estimated) pass memory are held, the least recently used passes are
+// evicted as part of `pl_dispatch_reset_frame`. Passes used within the last
+// few frames are never evicted, even if this exceeds the budget. A value of 0
+// disables the corresponding limit. Defaults to 100 passes and no byte limit.
+void pl_dispatch_pass_budget(pl_dispatch dp, int max_passes, size_t max_bytes);
+
 // Returns a blank pl_shader object, suitable for recording rendering commands.
 // For more information, see the header documentation in `shaders/*.h`.
 pl_shader pl_dispatch_begin(pl_dispatch dp);
@@ -62,6 +70,10 @@ struct pl_dispatch_info {
     uint64_t last;
     uint64_t peak;
     uint64_t average;
+
+    // The CPU time spent generating and submitting this dispatch, in
+    // nanoseconds.
+    uint64_t cpu_time;
 };
 
 // Set up a dispatch callback for this `pl_dispatch` object. The given callback
@@ -70,6 +82,56 @@ struct pl_dispatch_info {
 void pl_dispatch_callback(pl_dispatch dp, void *priv,
                           void (*cb)(void *priv, const struct pl_dispatch_info *));
 
+// Enables or disables asynchronous compilation of new passes. While enabled,
+// shaders with a signature that has not been compiled yet are handed off to a
+// background thread instead of blocking the calling thread on
+// `pl_pass_create`. Until the compiled pass becomes available, dispatching
+// such a shader is skipped entirely - the dispatch function returns `true` but
+// does not touch the target. The finished pass is transparently swapped in on
+// the next dispatch after compilation completes. Defaults to disabled.
+//
+// Note: This has no effect unless `pl_gpu_limits.thread_safe` is set, since
+// passes can otherwise only be created from the thread using the `pl_gpu`.
+// The exception are GPUs that support compiling shaders in parallel natively
+// (e.g. OpenGL with `GL_KHR_parallel_shader_compile`, or D3D11), in which
+// case all new passes are compiled in parallel without blocking, instead.
+//
+// Regardless of `thread_safe`, this also sets `pl_shader_params.async_luts`
+// for newly created shaders.
+//
+// Users are expected to detect skipped dispatches using
+// `pl_dispatch_async_skipped` and substitute cheaper (already compiled)
+// shaders for the affected frames. `pl_renderer` does this automatically when
+// `pl_render_params.async_compile` is enabled.
+void pl_dispatch_async_compile(pl_dispatch dp, bool enable);
+
+// Blocks until all outstanding asynchronous compilation jobs have completed.
+void pl_dispatch_async_wait(pl_dispatch dp);
+
+// Returns the total number of dispatches skipped so far due to their pass
+// still being compiled in the background. This counter never decreases, so
+// callers can compare it before and after a set of dispatches.
+uint64_t pl_dispatch_async_skipped(pl_dispatch dp);
+
+// Start recording a timeline of all dispatches to the file at `path`, in the
+// Chrome trace event format (as understood by e.g. https://ui.perfetto.dev or
+// chrome://tracing). This records the CPU time spent generating, compiling
+// and submitting each pass, as well as its GPU execution time (if timers are
+// supported), annotated with the shader description. Frame boundaries (see
+// `pl_dispatch_reset_frame`) are marked as instant events.
+//
+// Since GPU timers only measure durations, GPU intervals are placed at the
+// time the pass was submitted, and may thus overlap. Dispatches using a
+// user-provided `timer` are not included in the GPU timeline.
+//
+// Only one trace can be recorded at a time; calling this again replaces the
+// previous trace. Returns false if the file could not be opened.
+bool pl_dispatch_trace_begin(pl_dispatch dp, const char *path);
+
+// Stop recording the current trace (if any) and close the file. Also happens
+// implicitly on `pl_dispatch_destroy`.
+void pl_dispatch_trace_end(pl_dispatch dp);
+
 struct pl_dispatch_params {
     // The shader to execute. The pl_dispatch will take over ownership
     // of this shader, and return it back to the internal pool.
@@ -104,6 +166,10 @@ struct pl_dispatch_params {
     // execution time of the shader, which means `pl_dispatch_info.samples` may
     // be empty as a result.
     pl_timer timer;
+
+    // If set, hints that this dispatch is independent of the surrounding
+    // work. Only affects compute shaders, see `pl_pass_run_params.async`.
+    bool async;
 };
 
 #define pl_dispatch_params(...) (&(struct pl_dispatch_params) { __VA_ARGS__ })
@@ -136,6 +202,10 @@ struct pl_dispatch_compute_params {
     // execution time of the shader, which means `pl_dispatch_info.samples` may
     // be empty as a result.
     pl_timer timer;
+
+    // If set, hints that this dispatch is independent of the surrounding
+    // work. See `pl_pass_run_params.async`.
+    bool async;
 };
 
 #define pl_dispatch_compute_params(...) (&(struct pl_dispatch_compute_params) { __VA_ARGS__ })
@@ -169,12 +239,14 @@ struct pl_dispatch_vertex_params {
     // enabled, `target->params.fmt->caps` must include `PL_FMT_CAP_BLENDABLE`.
     const struct pl_blend_params *blend_params;
 
-    // The description of the vertex format, including offsets.
+    // The description of the vertex format, including offsets. Attributes
+    // with `instanced` set are read from the per-instance data instead.
     //
     // Note: `location` is ignored and can safely be left unset.
     const struct pl_vertex_attrib *vertex_attribs;
     int num_vertex_attribs;
     size_t vertex_stride;
+    size_t instance_stride;
 
     // The index of the vertex position in `vertex_attribs`, as well as the
     // interpretation of its contents.
@@ -197,6 +269,15 @@ struct pl_dispatch_vertex_params {
     pl_buf index_buf;
     size_t index_offset;
 
+    // Number of instances and per-instance data. See
+    // `pl_pass_run_params.instance_data`. Optional. Instance data provided in
+    // host memory is uploaded into a ring of buffers owned by the dispatch,
+    // so drawing many instances every frame costs a single draw call.
+    int instance_count;
+    const void *instance_data;
+    pl_buf instance_buf;
+    size_t instance_offset;
+
     // If set, records the execution time of this dispatch into the given
     // timer object. Optional.
     //
@@ -234,6 +315,26 @@ size_t pl_dispatch_save(pl_dispatch dp, uint8_t *out_cache);
 // Note: See the security warnings on `pl_pass_params.cached_program`.
 void pl_dispatch_load(pl_dispatch dp, const uint8_t *cache);
 
+// Attach a persistent, file-backed program cache to this `pl_dispatch`. As an
+// alternative to `pl_dispatch_save`/`pl_dispatch_load`, this incrementally
+// appends the cached program of every newly compiled pass to the file at
+// `path` (which is created if it does not exist yet), and makes previously
+// stored programs available to future compilations. Existing file contents
+// are memory-mapped where supported, so only the cached programs that actually
+// end up being used need to be read from disk.
+//
+// `max_size` is the size budget for the file, in bytes. When appending a new
+// program would exceed this size, the file is compacted by discarding the
+// least recently used programs. If 0, a default of 64 MiB is used.
+//
+// Only one file can be attached at a time; calling this again replaces the
+// previously attached file. Returns false if the file could not be opened.
+//
+// Note: The file must not be modified externally (or used by other processes)
+// while it's attached, and is subject to the same security concerns as
+// `pl_dispatch_load`.
+bool pl_dispatch_cache_open(pl_dispatch dp, const char *path, size_t max_size);
+
 PL_API_END
 
 #endif // LIBPLACEBO_DISPATCH_H
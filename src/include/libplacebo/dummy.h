@@ -25,7 +25,7 @@ PL_API_BEGIN
 // The functions in this file allow creating and manipulating "dummy" contexts.
 // A dummy context isn't actually mapped by the GPU, all data exists purely on
 // the CPU. It also isn't capable of compiling or executing any shaders, any
-// attempts to do so will simply fail.
+// attempts to do so will simply fail (unless `noop_passes` is enabled).
 //
 // The main use case for this dummy context is for users who want to generate
 // advanced shaders that depend on specific GLSL features or support for
@@ -45,6 +45,18 @@ struct pl_gpu_dummy_params {
     // `glGet` queries etc.
     struct pl_glsl_version glsl;
     struct pl_gpu_limits limits;
+
+    // If true, creating passes always succeeds, but running them does
+    // nothing. This allows exercising higher-level code such as `pl_renderer`
+    // on the CPU alone, e.g. to measure its overhead. (Default: false)
+    bool noop_passes;
+
+    // If true, all GPU operations performed on this dummy GPU are recorded,
+    // together with a rough estimate of their cost. Combined with
+    // `noop_passes`, this allows predicting the resource requirements of a
+    // rendering configuration without access to a real GPU. See
+    // `pl_gpu_dummy_get_stats`. (Default: false)
+    bool record_stats;
 };
 
 #define PL_GPU_DUMMY_DEFAULTS                                           \
@@ -83,6 +95,7 @@ struct pl_gpu_dummy_params {
         .max_constants      = SIZE_MAX,                                 \
         .max_pushc_size     = SIZE_MAX,                                 \
         .max_dispatch       = { UINT32_MAX, UINT32_MAX, UINT32_MAX },   \
+        .instancing         = true,                                     \
         .fragment_queues    = 0,                                        \
         .compute_queues     = 0,                                        \
     },
@@ -99,6 +112,47 @@ extern const struct pl_gpu_dummy_params pl_gpu_dummy_default_params;
 pl_gpu pl_gpu_dummy_create(pl_log log, const struct pl_gpu_dummy_params *params);
 void pl_gpu_dummy_destroy(pl_gpu *gpu);
 
+// Operations and estimated costs recorded by a dummy GPU with `record_stats`
+// enabled. The shader costs are derived statically from the GLSL source of
+// each pass, so they don't account for loops or branches, and should only be
+// taken as a rough approximation of the real work done by a GPU.
+struct pl_gpu_dummy_stats {
+    // Number of operations of each type
+    int pass_runs;
+    int tex_uploads;
+    int tex_downloads;
+    int tex_allocs;
+    int buf_allocs;
+
+    // Data transferred between the host and the GPU, in bytes
+    uint64_t bytes_uploaded;
+    uint64_t bytes_downloaded;
+
+    // Estimated memory traffic of all passes, in bytes. This assumes every
+    // bound resource is read in full exactly once, and that raster passes
+    // write to (and, when blending, read from) the entire rendered area.
+    uint64_t bytes_read;
+    uint64_t bytes_written;
+
+    // Estimated shader work, summed over all shader invocations
+    uint64_t invocations;   // fragment shader or compute shader invocations
+    uint64_t tex_fetches;   // texture and image reads
+    uint64_t alu_ops;       // arithmetic operations and builtin function calls
+
+    // Memory occupied by all textures and buffers, in bytes
+    uint64_t vram;          // currently allocated
+    uint64_t vram_peak;     // highest value since the last reset
+};
+
+// Returns the statistics recorded since the last call to
+// `pl_gpu_dummy_reset_stats`. Always zero unless `record_stats` is enabled.
+// Thread-safe.
+struct pl_gpu_dummy_stats pl_gpu_dummy_get_stats(pl_gpu gpu);
+
+// Resets all recorded statistics, except for `vram`. Call this e.g. at the
+// start of every frame to obtain per-frame figures. Thread-safe.
+void pl_gpu_dummy_reset_stats(pl_gpu gpu);
+
 // Back-doors into the `pl_tex` and `pl_buf` representations. These allow you
 // to access the raw data backing this object. Textures are always laid out in
 // a tightly packed manner.
@@ -22,6 +22,7 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+#include <libplacebo/cache.h>
 #include <libplacebo/common.h>
 #include <libplacebo/log.h>
 
@@ -109,6 +110,11 @@ struct pl_gpu_limits {
     // misaligned, libplacebo will internally round (over-map) the region.
     size_t align_host_ptr;
 
+    // Required alignment for `pl_desc_binding.buf_offset` when binding a
+    // sub-range of a uniform buffer. If 0, only entire uniform buffers may be
+    // bound. Always a power of two.
+    size_t align_ubo_offset;
+
     // --- pl_tex
     uint32_t max_tex_1d_dim;    // maximum width for a 1D texture
     uint32_t max_tex_2d_dim;    // maximum width/height for a 2D texture (required)
@@ -129,6 +135,7 @@ struct pl_gpu_limits {
     size_t max_pushc_size;      // maximum `push_constants_size`
     size_t align_vertex_stride; // alignment of `pl_pass_params.vertex_stride`
     uint32_t max_dispatch[3];   // maximum dispatch size per dimension
+    bool instancing;            // supports `pl_vertex_attrib.instanced`
 
     // Note: At least one of `max_variable_comps` or `max_ubo_size` is
     // guaranteed to be nonzero.
@@ -171,6 +178,10 @@ struct pl_gpu_handle_caps {
     pl_handle_caps tex;  // supported handles for `pl_tex` + `pl_shared_mem`
     pl_handle_caps buf;  // supported handles for `pl_buf` + `pl_shared_mem`
     pl_handle_caps sync; // supported handles for `pl_sync`
+
+    // Supported handles for timeline `pl_sync` objects, see
+    // `pl_sync_create_timeline`.
+    pl_handle_caps sync_timeline;
 };
 
 // Wrapper for the handle used to communicate a shared resource externally.
@@ -694,12 +705,30 @@ struct pl_tex_params {
     // Setting this indicates that the memory backing this texture will be
     // imported from an external API. If so, this must be exactly *one* of
     // `pl_gpu.import_caps.tex`. Mutually exclusive with `initial_data`.
+    //
+    // Note: Textures imported from PL_HANDLE_DMA_BUF are cached internally,
+    // since decoders tend to cycle through a small set of surfaces. Importing
+    // the same DMA-BUF with the same parameters again returns the same
+    // `pl_tex` (whose `params` reflect the original import), as long as it
+    // is still cached. Idle imports keep their DMA-BUF alive until they are
+    // evicted after a while of disuse, under memory pressure, or when the
+    // `pl_gpu` is destroyed.
     enum pl_handle_type import_handle;
 
     // If the shared memory is being imported, the import handle must be
     // specified here. Otherwise, this is ignored.
     struct pl_shared_mem shared_mem;
 
+    // If `export_handle` is PL_HANDLE_DMA_BUF, this may optionally list the
+    // DRM format modifiers supported by the consumer of the exported texture.
+    // The implementation then allocates the texture with the best modifier
+    // (e.g. a compressed or tiled layout rather than LINEAR) supported by both
+    // itself and the consumer, and reports it in `shared_mem.drm_format_mod`.
+    // Texture creation fails if there is no modifier in common. If left
+    // empty, any modifier in `format->modifiers` may be picked.
+    const uint64_t *export_modifiers;
+    int num_export_modifiers;
+
     // If non-NULL, the texture will be created with these contents (tightly
     // packed). Using this does *not* require setting host_writable. Otherwise,
     // the initial data is undefined. Mutually exclusive with `import_handle`.
@@ -752,9 +781,11 @@ typedef const PL_STRUCT(pl_tex) {
     // While this texture is not in an "exported" state, the contents of the
     // memory are undefined. (See: `pl_tex_export`)
     //
-    // Note: Due to vulkan driver limitations, `shared_mem.drm_format_mod` will
-    // currently always be set to DRM_FORMAT_MOD_INVALID. No guarantee can be
-    // made about the cross-driver compatibility of textures exported this way.
+    // Note: For PL_HANDLE_DMA_BUF, `shared_mem.drm_format_mod` is set to the
+    // modifier picked by the implementation (see `export_modifiers`), or to
+    // DRM_FORMAT_MOD_INVALID if the implementation can't report it. In the
+    // latter case, no guarantee can be made about the cross-driver
+    // compatibility of textures exported this way.
     struct pl_shared_mem shared_mem;
 
     // If `params.sampleable` is true, this indicates the correct sampler type
@@ -892,6 +923,17 @@ struct pl_tex_transfer_params {
     // 2. Transferring to/from host memory directly:
     void *ptr;          // address of data
 
+    // If true, the user guarantees that the memory backing `ptr` stays
+    // allocated until it is explicitly released with `pl_tex_transfer_forget`,
+    // e.g. because it's a persistent capture or encoder buffer. On GPUs
+    // supporting host pointer imports (`PL_HANDLE_HOST_PTR`), this allows the
+    // memory to be imported once, cached by address range, and transferred
+    // to/from directly on subsequent transfers, skipping the host memcpy. For
+    // best results, `ptr` should be page-aligned (see
+    // `pl_gpu_limits.align_host_ptr`). Uploads only make use of this when
+    // asynchronous (i.e. with `callback` set). (Optional)
+    bool ptr_persistent;
+
     // Note: The contents of the memory region / buffer must exactly match the
     // texture format; i.e. there is no explicit conversion between formats.
 };
@@ -904,6 +946,12 @@ bool pl_tex_upload(pl_gpu gpu, const struct pl_tex_transfer_params *params);
 // Download data from a texture. Returns whether successful.
 bool pl_tex_download(pl_gpu gpu, const struct pl_tex_transfer_params *params);
 
+// Release any cached host pointer imports overlapping the given memory range,
+// as created by transfers with `pl_tex_transfer_params.ptr_persistent`. This
+// must be called before freeing (or unmapping) such memory, but only after
+// all transfers to/from it have completed.
+void pl_tex_transfer_forget(pl_gpu gpu, const void *ptr, size_t size);
+
 // Returns whether or not a texture is currently "in use". This can either be
 // because of a pending read operation, a pending write operation or a pending
 // texture export operation. Note that this function's usefulness is extremely
@@ -1092,6 +1140,12 @@ struct pl_vertex_attrib {
     pl_fmt fmt;         // data format (must have PL_FMT_CAP_VERTEX)
     size_t offset;      // byte offset into the vertex struct
     int location;       // vertex location (as used in the shader)
+
+    // If true, this attribute is sourced from the per-instance data instead,
+    // advancing once per instance rather than once per vertex. In this case,
+    // `offset` is relative to `pl_pass_params.instance_stride`. Requires
+    // `pl_gpu_limits.instancing`.
+    bool instanced;
 };
 
 // Returns an abstract namespace index for a given descriptor type. This will
@@ -1125,6 +1179,14 @@ struct pl_desc {
     // the other descriptor types (uniform buffers and sampled textures are
     // always read-only).
     enum pl_desc_access access;
+
+    // For sampled textures, this can be used to fix the sampler state of the
+    // descriptor at pass creation time, allowing backends to bake it into
+    // the pass (e.g. as immutable samplers). If enabled, the `sample_mode`
+    // and `address_mode` of all corresponding `pl_desc_binding` must match.
+    bool fixed_sampler;
+    enum pl_tex_sample_mode sample_mode;
+    enum pl_tex_address_mode address_mode;
 };
 
 // Framebuffer blending mode (for raster passes)
@@ -1220,6 +1282,10 @@ struct pl_pass_params {
     int num_vertex_attribs;
     size_t vertex_stride; // must be a multiple of limits.align_vertex_stride
 
+    // Stride of the per-instance data, for vertex attributes with `instanced`
+    // set. Must be a multiple of limits.align_vertex_stride.
+    size_t instance_stride;
+
     // The vertex shader itself.
     const char *vertex_shader;
 
@@ -1266,12 +1332,95 @@ typedef const PL_STRUCT(pl_pass) {
 pl_pass pl_pass_create(pl_gpu gpu, const struct pl_pass_params *params);
 void pl_pass_destroy(pl_gpu gpu, pl_pass *pass);
 
+// Cumulative statistics about pass compilation on a `pl_gpu`, for profiling
+// shader compilation latency and the effectiveness of the various caches
+// (e.g. `pl_renderer_load`, `pl_vulkan_load_pipeline_cache`). All times are
+// in nanoseconds of CPU (wall clock) time.
+struct pl_gpu_compile_stats {
+    int num_passes;     // number of passes created so far
+    uint64_t total;     // total time spent in `pl_pass_create`
+    uint64_t spirv;     // time spent translating GLSL (to SPIR-V, or HLSL)
+    uint64_t driver;    // time spent in the driver compiling the result (e.g.
+                        // vkCreate*Pipelines, glLinkProgram, D3DCompile)
+};
+
+// Returns the compilation statistics accumulated since the `pl_gpu` was
+// created. Note that `spirv` and `driver` may include work done on
+// background threads (e.g. for asynchronously compiled passes, or pipeline
+// optimization), and as such may exceed `total`. Thread-safe.
+struct pl_gpu_compile_stats pl_gpu_get_compile_stats(pl_gpu gpu);
+
+// Owners that GPU memory usage is attributed to by `pl_gpu_get_memory_stats`.
+// This is derived from the `debug_tag` of each texture and buffer, based on
+// the part of libplacebo that created it. Resources without a recognized
+// `debug_tag` (such as most wrapped textures) count as user-owned.
+enum pl_gpu_mem_owner {
+    PL_GPU_MEM_USER,        // created by the user
+    PL_GPU_MEM_RENDERER,    // `pl_renderer` FBOs, overlays and intermediates
+    PL_GPU_MEM_MIXER,       // `pl_renderer` frame mixing cache
+    PL_GPU_MEM_LUT,         // LUTs and other shader objects
+    PL_GPU_MEM_DISPATCH,    // `pl_dispatch` uniform buffers
+    PL_GPU_MEM_INTERNAL,    // other internal helpers (e.g. staging buffers)
+    PL_GPU_MEM_OWNER_COUNT,
+};
+
+struct pl_gpu_mem_usage {
+    int num_textures;
+    int num_buffers;
+    uint64_t tex_bytes;     // estimated from the texture dimensions and format
+    uint64_t buf_bytes;     // sum of `pl_buf_params.size`
+};
+
+#define PL_GPU_MAX_HEAPS 16
+
+struct pl_gpu_heap_usage {
+    uint64_t size;          // total size of the heap, or 0 if unknown
+    uint64_t allocated;     // memory allocated from this heap
+    uint64_t used;          // memory actually used by resources
+    bool device_local;      // heap is local to the device (i.e. VRAM)
+};
+
+struct pl_gpu_memory_stats {
+    // Totals of all currently live textures and buffers, as well as the
+    // breakdown thereof by owner (indexed by `enum pl_gpu_mem_owner`).
+    struct pl_gpu_mem_usage total;
+    struct pl_gpu_mem_usage owners[PL_GPU_MEM_OWNER_COUNT];
+
+    // Backend-specific information about the underlying memory heaps, if
+    // available. For Vulkan, this accounts for all memory allocated by
+    // libplacebo. For OpenGL and D3D11, whose drivers manage memory
+    // internally, this is limited to whatever the driver reports, which
+    // includes memory used by other processes.
+    int num_heaps;
+    struct pl_gpu_heap_usage heaps[PL_GPU_MAX_HEAPS];
+
+    // Fraction of memory sub-allocated from shared slabs that is actually in
+    // use, i.e. excluding fragmentation and unused pages. 0 if not available.
+    float slab_efficiency;
+
+    // Cumulative number of bytes uploaded to textures since the `pl_gpu` was
+    // created, via `pl_tex_upload` or `pl_tex_params.initial_data`. Useful
+    // for checking that steady-state rendering doesn't re-upload e.g. LUTs.
+    uint64_t tex_upload_bytes;
+};
+
+// Returns a snapshot of the current GPU memory usage. Thread-safe.
+struct pl_gpu_memory_stats pl_gpu_get_memory_stats(pl_gpu gpu);
+
 struct pl_desc_binding {
     const void *object; // pl_* object with type corresponding to pl_desc_type
 
     // For PL_DESC_SAMPLED_TEX, this can be used to configure the sampler.
     enum pl_tex_address_mode address_mode;
     enum pl_tex_sample_mode sample_mode;
+
+    // For PL_DESC_BUF_UNIFORM, this can be used to bind only a sub-range of
+    // the buffer, starting at `buf_offset` and spanning `buf_size` bytes. A
+    // `buf_size` of 0 binds the rest of the buffer. Requires `buf_offset` to
+    // be a multiple of `pl_gpu_limits.align_ubo_offset` (and hence 0 if that
+    // limit is 0).
+    size_t buf_offset;
+    size_t buf_size;
 };
 
 struct pl_var_update {
@@ -1351,11 +1500,32 @@ struct pl_pass_run_params {
     // present in buffer form, i.e. it's forbidden to mix `index_buf` with
     // `vertex_data` (though vice versa is allowed).
 
+    // Number of instances to draw. Leaving this as 0 draws a single instance.
+    // Drawing more than one instance requires `pl_gpu_limits.instancing`.
+    int instance_count;
+
+    // Per-instance data, laid out according to `pass->params.instance_stride`.
+    // Required if the pass has any `instanced` vertex attributes, in which
+    // case `instance_count` must be nonzero. Similar to vertex data, this
+    // can be provided in two forms:
+    // 1. From host memory
+    const void *instance_data;
+    // 2. From a vertex buffer (requires `instance_buf->params.drawable`)
+    pl_buf instance_buf;
+    size_t instance_offset;
+
     // --- pass->params.type==PL_PASS_COMPUTE only
 
     // Number of work groups to dispatch per dimension (X/Y/Z). Must be <= the
     // corresponding index of limits.max_dispatch
     int compute_groups[3];
+
+    // Hint that this dispatch is independent of the work submitted around
+    // it, allowing it to overlap with that work on an asynchronous compute
+    // queue, if the backend has one. Without this hint, compute passes are
+    // executed on the same queue as raster passes where possible, to avoid
+    // the cost of synchronizing between queues.
+    bool async;
 };
 
 #define pl_pass_run_params(...) (&(struct pl_pass_run_params) { __VA_ARGS__ })
@@ -1379,6 +1549,17 @@ typedef const PL_STRUCT(pl_sync) {
     // This handle is signalled by the user, and waited on by the `pl_gpu`. It
     // must fire when the user has finished accessing the shared resource.
     union pl_handle signal_handle;
+
+    // If true, both handles refer to timeline semaphores (or the equivalent
+    // in the external API) rather than binary semaphores. In this case, the
+    // handles stay valid across exports, and `wait_value` / `signal_value`
+    // give the counter values that `wait_handle` will reach, and that
+    // `signal_handle` must be signalled to, respectively, for the most
+    // recent `pl_tex_export`. Both start out as 0, and increase with every
+    // export. For binary sync objects, these are always 0.
+    bool timeline;
+    uint64_t wait_value;
+    uint64_t signal_value;
 } *pl_sync;
 
 // Create a synchronization object. Returns NULL on failure.
@@ -1387,6 +1568,14 @@ typedef const PL_STRUCT(pl_sync) {
 // indicates which type of handle to generate for sharing this sync object.
 pl_sync pl_sync_create(pl_gpu gpu, enum pl_handle_type handle_type);
 
+// Create a timeline synchronization object, which only needs to be imported
+// into the external API once, and can then be reused for every subsequent
+// export (of any number of textures, as long as the user signals the
+// values in order). Returns NULL on failure.
+//
+// `handle_type` must be exactly *one* of `pl_gpu.export_caps.sync_timeline`.
+pl_sync pl_sync_create_timeline(pl_gpu gpu, enum pl_handle_type handle_type);
+
 // Destroy a `pl_sync`. Note that this invalidates the externally imported
 // semaphores. Users should therefore make sure that all operations that
 // wait on or signal any of the semaphore have been fully submitted and
@@ -1448,6 +1637,43 @@ void pl_gpu_flush(pl_gpu gpu);
 // to a `pl_swapchain`.
 void pl_gpu_finish(pl_gpu gpu);
 
+// Marks the end of a frame's worth of work, flushing it like `pl_gpu_flush`,
+// and limits the number of such frames queued up on the GPU: if more than
+// `max_frames` frames marked this way are still in flight, this blocks for up
+// to `timeout` nanoseconds for the oldest of them to complete. A
+// `max_frames` of 0 disables the limit, which only tracks frames.
+//
+// Returns false if there are still more than `max_frames` frames in flight
+// after the timeout expired. Mainly useful for offline processing, where
+// rendering would otherwise run arbitrarily far ahead of the GPU, holding on
+// to the resources used by all of the pending frames.
+//
+// Note: On GPUs that don't support tracking the completion of frames (e.g.
+// OpenGL without GL_ARB_sync), this never blocks, and behaves as if all
+// frames completed immediately.
+bool pl_gpu_end_frame(pl_gpu gpu, int max_frames, uint64_t timeout);
+
+// Returns the number of frames marked by `pl_gpu_end_frame` that are still
+// being executed by the GPU. Does not block.
+int pl_gpu_frames_in_flight(pl_gpu gpu);
+
+// Flushes like `pl_gpu_flush`, and returns a handle that becomes signalled
+// once all of the GPU work submitted so far has completed, for integration
+// with external event loops (e.g. to wait for `pl_buf_poll` or download
+// callbacks without busy-polling). Returns false on failure.
+//
+// On POSIX systems, the handle is a file descriptor in `out->fd`, which
+// becomes readable (e.g. POLLIN / EPOLLIN) once signalled. On Windows, it's an
+// event object in `out->handle`, suitable for `WaitForMultipleObjects` or
+// `RegisterWaitForSingleObject`. Either way, the handle is owned by the
+// caller, who must close it once it's no longer needed.
+//
+// Note: Completion is detected by an internal thread, so this requires
+// `gpu->limits.thread_safe`. After the handle is signalled, pending
+// callbacks only run on the next call to a polling function (such as
+// `pl_buf_poll`), which is guaranteed not to block for this work anymore.
+bool pl_gpu_completion_handle(pl_gpu gpu, union pl_handle *out);
+
 // Returns true if the GPU is considered to be in a "failed" state, which
 // during normal operation is typically the result of things like the device
 // being lost (due to e.g. power management).
@@ -1456,6 +1682,13 @@ void pl_gpu_finish(pl_gpu gpu);
 // including all associated resources, via the appropriate mechanism.
 bool pl_gpu_is_failed(pl_gpu gpu);
 
+// Attach a `pl_cache` to this GPU, or detach it (if `cache` is NULL). While
+// attached, all `pl_dispatch` objects (and thereby `pl_renderer`s) using this
+// GPU look up and store compiled shader programs and precomputed LUTs in it,
+// in addition to their own internal caches. The same cache may be attached to
+// multiple GPUs. The cache must outlive the attachment.
+void pl_gpu_set_cache(pl_gpu gpu, pl_cache cache);
+
 PL_API_END
 
 #endif // LIBPLACEBO_GPU_H_
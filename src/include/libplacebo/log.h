@@ -48,6 +48,33 @@ struct pl_log_params {
     // in increased CPU usage as it may enable extra debug paths based on the
     // configured log level.
     enum pl_log_level log_level;
+
+    // If nonzero, messages are delivered asynchronously. They are formatted
+    // on the calling thread and pushed into a lock-free queue with room for
+    // (at least) this many messages, from which a background thread forwards
+    // them to `log_cb`. This keeps slow logging callbacks from blocking e.g.
+    // the rendering thread with verbose log levels enabled. Messages that
+    // don't fit into the queue are dropped, which is reported by a warning
+    // once the queue drains. `log_cb` is never called concurrently, and all
+    // pending messages are delivered by `pl_log_destroy`.
+    //
+    // Note: Messages with level PL_LOG_FATAL are still delivered
+    // synchronously. This field is only respected by `pl_log_create`, and
+    // cannot be changed by `pl_log_update`.
+    int async_queue;
+
+    // Optional external thread pool. If set, libplacebo hands all of its
+    // CPU-side background work (e.g. asynchronous shader compilation, LUT
+    // generation) to this callback, instead of running it on an internal
+    // pool of (at most) one thread per CPU core. The callback must arrange
+    // for `job(job_priv)` to be called exactly once, on any thread, at some
+    // point in the future.
+    //
+    // Note: If libplacebo needs the result of a job before it was started,
+    // libplacebo runs it on its own thread, in which case the later call to
+    // `job` returns immediately.
+    void (*queue_job)(void *queue_priv, void (*job)(void *job_priv), void *job_priv);
+    void *queue_priv;
 };
 
 #define pl_log_params(...) (&(struct pl_log_params) { __VA_ARGS__ })
@@ -46,6 +46,14 @@ struct pl_opengl_params {
     // Restrict the maximum allowed GLSL version. (Mainly for testing)
     int max_glsl_version;
 
+    // If true, libplacebo assumes that nobody else modifies the texture,
+    // sampler, program or vertex array bindings of the OpenGL context in
+    // between calls into libplacebo. This allows leaving these bound after
+    // each shader pass, instead of resetting them to their default state,
+    // which avoids redundant state changes between consecutive passes. Leave
+    // this disabled when sharing the context with other rendering code.
+    bool exclusive;
+
     // Optional. Required when importing/exporting dmabufs as textures.
     void *egl_display;
     void *egl_context;
@@ -61,6 +69,22 @@ struct pl_opengl_params {
     bool (*make_current)(void *priv);
     void (*release_current)(void *priv);
     void *priv;
+
+    // Optional callbacks to bind/release a secondary OpenGL context on the
+    // current thread. This context must be in the same share group as the
+    // main OpenGL context (e.g. created with it as the shared context), and
+    // must not be used for anything else. Only used if `make_current` is also
+    // specified, and requires sync objects (GL 3.2+, GLES 3.0+ or ARB_sync).
+    //
+    // If provided, `pl_tex_upload` from host memory is performed on this
+    // context, without blocking concurrent use of the main context from
+    // other threads. The main context waits on the upload (via `glWaitSync`)
+    // before it first accesses the texture afterwards. Uploads that would
+    // race against pending main context commands, i.e. those targeting a
+    // texture accessed since the last `pl_gpu_flush`, silently fall back to
+    // the main context instead.
+    bool (*make_current_upload)(void *priv);
+    void (*release_current_upload)(void *priv);
 };
 
 // Default/recommended parameters
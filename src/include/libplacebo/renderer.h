@@ -111,6 +111,13 @@ struct pl_render_params {
     // equivalent option in `pl_sample_filter_params` for more information.
     float antiringing_strength;
 
+    // If true, subsampled chroma planes are upscaled with the guidance of the
+    // luma plane (see `pl_shader_sample_cfl`), instead of using `upscaler`.
+    // This is always performed as part of the same pass that reads and
+    // combines the planes, avoiding intermediate chroma textures. Ignored
+    // for images without a separate luma plane.
+    bool chroma_from_luma;
+
     // Configures the algorithm used for frame mixing (when using
     // `pl_render_image_mix`). Ignored otherwise. As a special requirement,
     // this must be a filter config with `polar` set to false, since it's only
@@ -212,6 +219,24 @@ struct pl_render_params {
     // Significantly speeds up downscaling with high downscaling ratios.
     bool skip_anti_aliasing;
 
+    // If nonzero, downscaling by more than this factor (in both directions)
+    // is preceded by repeated 2x2 box reductions of the source, using plain
+    // bilinear sampling, until the remaining ratio falls below this factor.
+    // The configured `downscaler` then only performs the final step. This
+    // makes the cost of extreme downscaling (e.g. for thumbnails) largely
+    // independent of the source resolution. Values below 2.0 are treated as
+    // 2.0. A value of 4.0 is a good compromise.
+    float box_downscale_threshold;
+
+    // If true, the color management steps performed on the final output
+    // (custom LUTs, ICC profiles, tone mapping, gamut mapping and color
+    // blindness simulation) are evaluated once into an internal 3D LUT, which
+    // is then applied using a single (trilinear) lookup per pixel. The LUT is
+    // automatically regenerated whenever any of its inputs change. This can
+    // greatly reduce the per-pixel cost of color conversion on weak GPUs, at
+    // the cost of some precision. Ignored while peak detection is active.
+    bool bake_color_lut;
+
     // Cutoff value for polar sampling. See the equivalent option in
     // `pl_sample_filter_params` for more information.
     float polar_cutoff;
@@ -237,6 +262,88 @@ struct pl_render_params {
     // it will still read from, if they happen to already be cached)
     bool skip_caching_single_frame;
 
+    // If nonzero, frames which are no longer needed by `pl_render_image_mix`
+    // are kept in the mixing cache (e.g. for redraws or stepping backwards)
+    // until its total size exceeds this budget, in bytes, at which point the
+    // least recently used frames are evicted. Frames required by the current
+    // mix are never evicted, so this is a soft limit. If set to 0, frames are
+    // evicted as soon as they drop out of the frame mix.
+    size_t mixing_cache_budget;
+
+    // Allows `pl_render_image_mix` to store cached frames in a more compact
+    // texture format (e.g. rgb10a2) when this is sufficient for the target's
+    // color depth, which roughly halves the size of the mixing cache. Only
+    // used for targets of at most 8 bits, and for frames without alpha that
+    // are not stored in linear light.
+    bool mixing_cache_low_precision;
+
+    // If nonzero, enables partial re-rendering for updates which only affect
+    // `target->overlays` (e.g. subtitles or an OSD on top of a paused frame).
+    // `pl_render_image` retains a copy of the rendered frame, prior to
+    // blending the target overlays, tagged with this signature. When called
+    // again with the same signature and target texture, only the areas
+    // covered by the previous and current target overlays are restored from
+    // this copy and re-blended, skipping the rest of the rendering pipeline.
+    //
+    // The signature must change whenever anything other than the target
+    // overlays does, including the contents of the image. The contents of the
+    // target must also be preserved in between calls, which rules out most
+    // swapchains. Only supported for single-plane targets created with
+    // `blit_src` and `blit_dst`, and ignored otherwise.
+    uint64_t overlay_cache_signature;
+
+    // If nonzero, `pl_render_image` and `pl_render_image_mix` retain a copy
+    // of the final output, tagged with this signature. When called again
+    // with the same signature, and a target of the same size, format, crop
+    // and colorspace, this copy is simply blitted into the target, skipping
+    // the rendering pipeline entirely. Useful for repeated frames, e.g.
+    // paused video, still images, or low frame rate content on a high
+    // refresh rate display.
+    //
+    // The signature must change whenever anything else affecting the output
+    // does, including the contents of the image, the rendering parameters and
+    // all overlays. Unlike `overlay_cache_signature`, the target contents
+    // need not be preserved in between calls. Only supported for single-plane
+    // targets created with `blit_src` and `blit_dst`, and without `acquire`
+    // callbacks. Ignored otherwise.
+    uint64_t output_cache_signature;
+
+    // If nonzero, `pl_render_image` splits target crops larger than this
+    // size (in either dimension) into tiles of at most this many pixels,
+    // which are rendered one by one into an intermediate texture and then
+    // copied into place. This bounds the size of all intermediate textures,
+    // making it possible to render frames too large for the GPU's texture or
+    // memory limits. Tiles overlap by enough pixels for the built-in scalers
+    // and debanding to be seamless, although the dither and debanding grain
+    // patterns restart in every tile. Custom shaders (`hooks`) sampling from
+    // further away may produce visible seams. Peak detection is disabled,
+    // since it would be computed per tile. Only supported for single-plane
+    // targets which are not rotated relative to the image, and not together
+    // with `blend_params`. Ignored otherwise.
+    int render_tile_size;
+
+    // If nonzero, this is taken to uniquely identify the current set of
+    // parameters, including the contents of all structs referenced by them
+    // (filters, hooks, LUTs etc.). The renderer then only re-hashes the
+    // parameters (as done by `pl_render_image_mix` to validate its frame
+    // cache) when this signature changes, instead of on every call. Users
+    // must change this signature whenever any parameter changes, otherwise
+    // stale cached frames may be reused.
+    uint64_t params_signature;
+
+    // If nonzero, enables dynamic quality scaling with this target GPU time
+    // per frame, in nanoseconds. Whenever the measured GPU time of recent
+    // frames (see `pl_renderer_get_stats`) exceeds this budget, the renderer
+    // progressively lowers the quality of subsequent frames, first by
+    // replacing expensive scalers by `pl_filter_bicubic` and limiting
+    // debanding to a single iteration, then by disabling debanding and
+    // sigmoidization, and finally by falling back to built-in sampling and
+    // skipping custom `hooks`. Quality is restored step by step once the
+    // frame times leave enough headroom again. The current level is reported
+    // as `pl_render_stats.quality_level`. Requires GPU timer queries, and is
+    // ignored otherwise.
+    uint64_t gpu_time_budget;
+
     // --- Performance tuning / debugging options
     // These may affect performance or may make debugging problems easier,
     // but shouldn't have any effect on the quality.
@@ -283,8 +390,35 @@ struct pl_render_params {
     //
     // It's a good idea to enable while presenting configurable settings to the
     // user, but it should be set to false once those values are "dialed in".
+    //
+    // Note: Even when this is false, individual constants whose values keep
+    // changing from frame to frame are automatically made dynamic, and made
+    // constant again once they have stabilized. (GLSL 130+ only)
     bool dynamic_constants;
 
+    // If true, enables `pl_shader_params.half_precision` for all shaders,
+    // allowing scaling and SDR color conversion to use reduced precision
+    // arithmetic on GPUs that support it. Recommended for low-power devices.
+    bool half_precision;
+
+    // If true, enables `pl_shader_params.fast_transfer` for all shaders,
+    // replacing the exact PQ/HLG curves by cheaper approximations with an
+    // error below a quarter of a 12-bit code value.
+    bool fast_transfer;
+
+    // If true, new shaders are compiled asynchronously in the background
+    // (see `pl_dispatch_async_compile`). Frames that would require a shader
+    // which is not yet ready are instead rendered using a reduced set of
+    // features (built-in bilinear scaling, no debanding, dithering, peak
+    // detection, sigmoidization or custom hooks) until compilation completes.
+    // This avoids stalling the render thread whenever the rendering
+    // configuration or source properties change, at the cost of briefly
+    // lower quality output.
+    //
+    // This also enables `pl_shader_params.async_luts`, so e.g. tone mapping
+    // LUTs are regenerated in the background when their parameters change.
+    bool async_compile;
+
     // This callback is invoked for every pass successfully executed in the
     // process of rendering a frame. Optional.
     //
@@ -459,6 +593,12 @@ struct pl_overlay_part {
 struct pl_overlay {
     // The texture containing the backing data for overlay parts. Must have
     // `params.sampleable` set.
+    //
+    // Note: If this also has `params.blit_src` set, consecutive overlays with
+    // the same texture format, `mode`, `repr` and `color` are copied into a
+    // shared texture atlas and drawn together in a single pass. This is
+    // significantly faster for large numbers of small overlays, e.g. the
+    // bitmaps produced by subtitle renderers.
     pl_tex tex;
 
     // This controls the coloring mode of this overlay.
@@ -646,6 +786,99 @@ bool pl_render_image(pl_renderer rr, const struct pl_frame *image,
                      const struct pl_frame *target,
                      const struct pl_render_params *params);
 
+// Render a single image to multiple targets, e.g. the different resolutions
+// of an adaptive streaming ladder. This is equivalent to calling
+// `pl_render_image` once for each target, except that the image is only read,
+// decoded and pre-processed (debanding, film grain, color decoding, peak
+// detection, and any hooks up to and including PL_HOOK_RGB) once, and then
+// shared between all of the targets. Only the scaling and output stages are
+// performed per target.
+//
+// Note: Hooks up to PL_HOOK_RGB only see the first target. Targets whose
+// crop requires adjusting the image crop (e.g. because it lies partially
+// outside the target) are rendered individually instead, as are all targets
+// if intermediate FBOs are unavailable.
+bool pl_render_image_multi(pl_renderer rr, const struct pl_frame *image,
+                           const struct pl_frame *targets, int num_targets,
+                           const struct pl_render_params *params);
+
+// Render a batch of independent frames, `images[i]` to `targets[i]`. This is
+// equivalent to calling `pl_render_image` for each pair, except that the
+// work for all frames is submitted together with a single `pl_gpu_flush` at
+// the end. This minimizes per-frame submission overhead, at the cost of
+// latency, which is useful for offline (throughput-bound) processing.
+//
+// A failure to render one pair does not prevent the remaining pairs from
+// being rendered. Returns whether all pairs succeeded. To wait for
+// completion, use the regular mechanisms (e.g. `pl_tex_export` with a
+// `pl_sync`, or `pl_gpu_finish`).
+bool pl_render_image_batch(pl_renderer rr, const struct pl_frame *images,
+                           const struct pl_frame *targets, int num_frames,
+                           const struct pl_render_params *params);
+
+// A single source of `pl_render_composite`.
+struct pl_composite_source {
+    // The image to render. Its `crop` selects the part of the image to show.
+    const struct pl_frame *image;
+
+    // The rectangle of the target to render this image into, replacing the
+    // target's own `crop`.
+    struct pl_rect2df dst;
+
+    // Rendering parameters for this source, or NULL to use the parameters
+    // passed to `pl_render_composite`.
+    const struct pl_render_params *params;
+};
+
+// Composite many images into a single target, e.g. for video walls or
+// mosaics. This is equivalent to clearing the target once, rendering each
+// source into its `dst` rect with `skip_target_clearing` set, and then
+// drawing `target.overlays` on top, with a single `pl_gpu_flush` at the end.
+// Sources sharing the same configuration also share the same shaders and
+// intermediate textures, so the per-source cost is only that of executing
+// the passes themselves. Sources are drawn in order, so overlapping
+// sources render on top of earlier ones.
+//
+// `params` is used for clearing the target and drawing the target overlays,
+// as well as for all sources without their own parameters. A failure to
+// render one source does not prevent the remaining sources from being
+// rendered. Returns whether all of them succeeded.
+bool pl_render_composite(pl_renderer rr, const struct pl_composite_source *srcs,
+                         int num_srcs, const struct pl_frame *target,
+                         const struct pl_render_params *params);
+
+// Describes a single rendering configuration for `pl_renderer_precompile`.
+struct pl_render_config {
+    // The source and target frames. The textures referenced by these frames
+    // are only used for their parameters (format, size, capabilities), and
+    // their contents are never read or written. So the same set of
+    // uninitialized textures may be reused for all configurations sharing
+    // the same plane formats and dimensions.
+    const struct pl_frame *image;
+    const struct pl_frame *target;
+
+    // The rendering parameters to compile for, or NULL for the defaults.
+    const struct pl_render_params *params;
+};
+
+// Walks the same shader generation as `pl_render_image` would for each of
+// the given configurations, and compiles (or loads from the cache) all of the
+// resulting passes, without executing any of them. After this call, rendering
+// with matching configurations will not hit shader compilation. The frames'
+// textures are left untouched, as is any state the renderer retains across
+// frames (e.g. for peak detection or frame mixing).
+//
+// Note that `params.async_compile` is ignored, all passes are compiled
+// synchronously. To pre-warm shaders in the background, use a separate
+// renderer on another thread and transfer the compiled passes with
+// `pl_renderer_save`/`pl_renderer_load` (or share a cache file between them,
+// see `pl_dispatch_cache_open`).
+//
+// Returns false if any of the configurations failed to render.
+bool pl_renderer_precompile(pl_renderer rr,
+                            const struct pl_render_config *configs,
+                            int num_configs);
+
 // Flushes the internal state of this renderer. This is normally not needed,
 // even if the image parameters, colorspace or target configuration change,
 // since libplacebo will internally detect such circumstances and recreate
@@ -655,6 +888,81 @@ bool pl_render_image(pl_renderer rr, const struct pl_frame *image,
 // dramatically (e.g. when switching to a different file).
 void pl_renderer_flush_cache(pl_renderer rr);
 
+// Categories of rendering work, for the purposes of `pl_renderer_get_stats`.
+// Since the renderer fuses adjacent operations into a single shader where
+// possible, each pass is attributed to the most significant category among
+// the operations it contains (roughly in the order listed here).
+enum pl_render_stat {
+    PL_RENDER_STAT_HOOKS,       // shaders dispatched by `pl_render_params.hooks`
+    PL_RENDER_STAT_OVERLAY,     // drawing overlays
+    PL_RENDER_STAT_SCALER,      // scaling (main scaler and plane scalers)
+    PL_RENDER_STAT_DEBAND,      // debanding
+    PL_RENDER_STAT_GRAIN,       // film grain synthesis
+    PL_RENDER_STAT_COLOR_MAP,   // tone/gamut mapping, ICC, peak detection
+    PL_RENDER_STAT_DITHER,      // dithering
+    PL_RENDER_STAT_READ,        // reading, merging and decoding planes
+    PL_RENDER_STAT_OTHER,       // anything else (e.g. frame mixing)
+    PL_RENDER_STAT_COUNT,
+};
+
+// Rolling timing statistics for one category, over (up to) the last 256
+// rendered frames in which it was used. All times are in nanoseconds, and
+// summed over all passes within a frame. GPU times are only available if
+// the GPU supports timer queries, and otherwise 0.
+struct pl_render_stage_stats {
+    int num_frames; // number of frames included in these statistics
+    uint64_t gpu_mean, gpu_p95, gpu_peak;
+    uint64_t cpu_mean, cpu_p95, cpu_peak; // generating and submitting passes
+};
+
+// Sections of the CPU time spent per frame, for `pl_render_stats.cpu`. Unlike
+// `pl_render_stage_stats.cpu_*`, which measure the time per category of
+// rendering work, these break the time down by what the CPU is doing.
+enum pl_render_cpu_section {
+    PL_RENDER_CPU_GENERATE,     // generating shaders (and other renderer logic)
+    PL_RENDER_CPU_FINALIZE,     // `pl_shader_finalize` and GLSL generation
+    PL_RENDER_CPU_LOOKUP,       // placing variables and looking up passes,
+                                // including compilation on cache misses
+    PL_RENDER_CPU_VARS,         // updating variables (push constants, UBOs)
+    PL_RENDER_CPU_BINDINGS,     // updating descriptor bindings, vertex data
+                                // and other pass parameters
+    PL_RENDER_CPU_SUBMIT,       // `pl_pass_run`, i.e. backend work such as
+                                // descriptor updates and command recording
+    PL_RENDER_CPU_COUNT,
+};
+
+// Rolling timing statistics for one CPU section, over (up to) the last 256
+// rendered frames. All times are in nanoseconds.
+struct pl_render_cpu_stats {
+    int num_frames;
+    uint64_t last; // time spent during the most recent frame
+    uint64_t mean, p95, peak;
+};
+
+struct pl_render_stats {
+    struct pl_render_stage_stats stages[PL_RENDER_STAT_COUNT];
+
+    // CPU time breakdown, indexed by `enum pl_render_cpu_section`. Only
+    // measured if libplacebo was built with `-Dcpu-profiling=true`, since
+    // the timers are compiled out otherwise, in which case this is all 0.
+    struct pl_render_cpu_stats cpu[PL_RENDER_CPU_COUNT];
+
+    // Current amount of quality reduction applied due to
+    // `pl_render_params.gpu_time_budget`, from 0 (none) to 3 (maximum).
+    int quality_level;
+};
+
+// Returns the timing statistics accumulated by this renderer. Here, "frame"
+// refers to a single top-level call to `pl_render_image`,
+// `pl_render_image_mix` or `pl_render_image_multi`.
+//
+// Note: GPU timer results arrive asynchronously, so the GPU times of a
+// frame are the most recently available results for each of its passes.
+struct pl_render_stats pl_renderer_get_stats(pl_renderer rr);
+
+// Resets the statistics returned by `pl_renderer_get_stats`.
+void pl_renderer_reset_stats(pl_renderer rr);
+
 // Represents a mixture of input frames, distributed temporally.
 //
 // NOTE: Frames must be sorted by timestamp, i.e. `timestamps` must be
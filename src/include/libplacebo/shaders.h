@@ -63,6 +63,33 @@ struct pl_shader_params {
     // dynamic variables. This is mainly useful to avoid recompilation for
     // shaders which expect to have their values change constantly.
     bool dynamic_constants;
+
+    // If this is true, expensive LUTs (e.g. for tone mapping or dithering)
+    // are regenerated on a background thread whenever their parameters
+    // change. Until the new LUT is ready, shaders keep using the previous
+    // one, if it has the same dimensions. The first generation of a LUT, as
+    // well as any change in its size, still happens synchronously.
+    bool async_luts;
+
+    // If this is true, shaders may evaluate arithmetic that tolerates it
+    // (e.g. filter kernels and SDR color conversions) at reduced, typically
+    // 16-bit, floating point precision. Precision-sensitive operations, such
+    // as PQ/HLG transfer functions or peak detection, are unaffected. This
+    // can substantially improve throughput on GPUs with fast half-precision
+    // math, at the cost of slightly reduced accuracy.
+    //
+    // Note: This currently only has an effect for GLSL ES, where it is
+    // implemented using `mediump` precision qualifiers.
+    bool half_precision;
+
+    // If true, the PQ EOTF (and its inverse) and the HLG inverse OETF used by
+    // `pl_shader_linearize` and `pl_shader_delinearize` are replaced by
+    // polynomial approximations, which avoid most of the transcendental
+    // functions of the exact curves. The round-trip error of the approximations is
+    // bounded by a quarter of a 12-bit code value over the entire signal
+    // range, which is well below the threshold of visibility, but they are
+    // not bit-exact with the reference curves.
+    bool fast_transfer;
 };
 
 #define pl_shader_params(...) (&(struct pl_shader_params) { __VA_ARGS__ })
@@ -37,6 +37,16 @@ void pl_shader_set_alpha(pl_shader sh, struct pl_color_repr *repr,
 // automatically by `pl_shader_decode_color` for PL_COLOR_SYSTEM_DOLBYVISION.
 void pl_shader_dovi_reshape(pl_shader sh, const struct pl_dovi_metadata *data);
 
+// Like `pl_shader_dovi_reshape`, but evaluates the reshaping functions ahead
+// of time on the CPU, so the per-pixel cost is reduced to a LUT lookup. Purely
+// polynomial reshaping is baked into a 1D LUT per component, while MMR
+// reshaping (which mixes all components) requires a 3D LUT, and is therefore
+// slightly less precise. The LUT is cached in `state`, and only regenerated
+// when the contents of `data` change. Falls back to `pl_shader_dovi_reshape`
+// if the LUT can't be used.
+void pl_shader_dovi_reshape_lut(pl_shader sh, const struct pl_dovi_metadata *data,
+                                pl_shader_obj *state);
+
 // Decode the color into normalized RGB, given a specified color_repr. This
 // also takes care of additional pre- and post-conversions requires for the
 // "special" color systems (XYZ, BT.2020-C, etc.). If `params` is left as NULL,
@@ -127,6 +137,15 @@ struct pl_peak_detect_params {
     // imposes a hard lower bound on the detected peak. If left as 0.0, it
     // instead defaults to a value of 1.0.
     float minimum_peak;
+
+    // If set to a value between 0.0 and 100.0 (exclusive), the peak is taken
+    // as this percentile of the frame's brightness distribution, rather than
+    // the maximum. This ignores small specular highlights, which otherwise
+    // make the detected peak noisy. It also makes the scene change detection
+    // take changes in the detected peak into account. This is measured with
+    // a 256-bin histogram (in PQ space), so it costs an extra 1 KiB of shared
+    // memory. A good value is 99.995. If left as 0.0, this is disabled.
+    float percentile;
 };
 
 #define PL_PEAK_DETECT_DEFAULTS         \
@@ -269,12 +288,18 @@ struct pl_color_map_params {
     // Tone mapping LUT size. Defaults to 256. Note that when combining
     // this with peak detection, the resulting LUT is actually squared, so
     // avoid setting it too high.
+    //
+    // Note: When combined with peak detection, the built-in tone mapping
+    // functions are instead evaluated directly in GLSL for the detected
+    // peak, without the need for a LUT. This does not apply to custom
+    // `pl_tone_map_function`s, or when `force_tone_mapping_lut` is set.
     int lut_size;
 
     // --- Debugging options
 
     // Force the use of a full tone-mapping LUT even for functions that have
-    // faster pure GLSL replacements (e.g. clip).
+    // faster pure GLSL replacements (e.g. clip, or any built-in function when
+    // using peak detection).
     bool force_tone_mapping_lut;
 
     // --- Deprecated fields
@@ -255,6 +255,44 @@ struct pl_hook_res {
     struct pl_rect2df rect;
 };
 
+// How a hook parameter is bound to the shader
+enum pl_hook_par_mode {
+    PL_HOOK_PAR_VARIABLE,   // normal shader variable (uniform)
+    PL_HOOK_PAR_DYNAMIC,    // shader variable expected to change frequently
+    PL_HOOK_PAR_CONSTANT,   // specialization constant, changing this value
+                            // may require recompiling the affected shaders
+    PL_HOOK_PAR_MODE_COUNT,
+};
+
+typedef union pl_var_data {
+    int i;
+    unsigned u;
+    float f;
+} pl_var_data;
+
+// Struct describing a tunable parameter of a hook. The current value may be
+// freely updated by the user between frames, and takes effect the next time
+// the hook runs, without needing to re-create the hook.
+struct pl_hook_par {
+    // Name and description (may be NULL) of this parameter
+    const char *name;
+    const char *description;
+
+    // Type and binding mode. Only scalar types are supported, so `type` must
+    // be one of PL_VAR_SINT, PL_VAR_UINT or PL_VAR_FLOAT.
+    enum pl_var_type type;
+    enum pl_hook_par_mode mode;
+
+    // Pointer to the current value, owned by the hook. The value is clamped
+    // to the range [minimum, maximum] when used.
+    pl_var_data *data;
+
+    // Value range and initial (default) value
+    pl_var_data minimum;
+    pl_var_data maximum;
+    pl_var_data initial;
+};
+
 // Struct describing a hook.
 //
 // Note: Users may freely create their own instances of this struct, there is
@@ -270,6 +308,31 @@ struct pl_hook {
     // The hook function itself. Called by the renderer at any of the indicated
     // hook stages. See `pl_hook_res` for more info on the return values.
     struct pl_hook_res (*hook)(void *priv, const struct pl_hook_params *params);
+
+    // If true, the result of this hook is assumed to depend only on the
+    // contents of its input and on `pl_hook_params`, and not on any other
+    // state (e.g. frame counters, random numbers or textures saved from
+    // other passes). This allows `pl_render_image_mix` to retain the
+    // `PL_HOOK_SIG_TEX` results of such hooks, and re-use them when
+    // re-rendering the same frame (e.g. after a change to the output
+    // parameters while paused), skipping the hook entirely. (Optional)
+    bool deterministic;
+
+    // Tunable parameters exposed by this hook, if any. (Optional)
+    const struct pl_hook_par *parameters;
+    int num_parameters;
+
+    // If set to a value in the range (0, 1), hooks with `PL_HOOK_SIG_TEX`
+    // input are run at reduced resolution: the renderer downscales the input
+    // texture by this factor (using `pl_render_params.downscaler`) before
+    // calling the hook, and upscales the returned texture back by the inverse
+    // factor (using `pl_render_params.upscaler`) afterwards. The hook sees
+    // the reduced `tex` and `rect` throughout. This trades quality for speed
+    // for expensive filters. Ignored for other input signatures. (Optional)
+    //
+    // Note: Since hooks are passed by reference, this can be adjusted at
+    // runtime by making a copy of the `pl_hook` struct and changing it.
+    float scale;
 };
 
 // Compatibility layer with `mpv` user shaders. See the mpv man page for more
@@ -277,6 +340,28 @@ struct pl_hook {
 //
 // The resulting `pl_hook` objects should be destroyed with the corresponding
 // destructor when no longer needed.
+//
+// Shaders may expose tunable parameters by declaring `//!PARAM` sections:
+//
+//   //!PARAM <name>
+//   //!DESC <description>               (optional)
+//   //!TYPE [DYNAMIC|CONSTANT] <type>   (one of int, uint or float)
+//   //!MINIMUM <value>                  (optional)
+//   //!MAXIMUM <value>                  (optional)
+//   <initial value>
+//
+// These are made available to all passes under the given name, and exposed
+// as `pl_hook.parameters`.
+//
+// Shaders may also set `pl_hook.scale` by declaring a standalone header,
+// which applies to all passes:
+//
+//   //!SCALE <factor>
+//
+// Note: Embedded `//!TEXTURE` data (other than `STORAGE` textures) is shared
+// between all hooks parsed on the same `pl_gpu` with identical texture
+// sections, so re-parsing the same shader (e.g. for another stream) is cheap
+// and doesn't duplicate the textures in VRAM.
 const struct pl_hook *pl_mpv_user_shader_parse(pl_gpu gpu,
                                                const char *shader_text,
                                                size_t shader_len);
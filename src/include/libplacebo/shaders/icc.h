@@ -44,6 +44,12 @@ struct pl_icc_params {
     // metadata (or 1000:1 by default for SDR curves). Has no effect when the
     // input color space is also an ICC profile.
     bool use_display_contrast;
+
+    // If true, the 3DLUT is interpolated tetrahedrally in the shader, rather
+    // than relying on hardware trilinear filtering. This is considerably more
+    // accurate, to the point where a size of 33 is sufficient for all three
+    // dimensions, at the cost of a few more texture fetches per pixel.
+    bool tetrahedral;
 };
 
 #define PL_ICC_DEFAULTS                         \
@@ -95,6 +101,16 @@ struct pl_icc_result {
 // same `pl_shader` object, The only reason it's separate from `pl_icc_apply`
 // is to give users a chance to adapt the input colors to the color space
 // chosen by the ICC profile before applying it.
+//
+// Note: A small number of previously generated 3DLUTs are kept around in
+// `icc`, so switching back to a previously used combination of profiles,
+// color spaces and parameters does not require regenerating the 3DLUT.
+//
+// Note: If both profiles are plain matrix/TRC profiles, as is the case for
+// most calibrated displays, the transformation is instead decomposed into
+// per-channel 1D curves and a 3x3 matrix, which avoids generating (and
+// sampling) the 3DLUT altogether. The 3DLUT size parameters are ignored in
+// this case.
 bool pl_icc_update(pl_shader sh,
                    const struct pl_icc_color_space *src,
                    const struct pl_icc_color_space *dst,
@@ -54,12 +54,37 @@ struct pl_custom_lut {
     // Note: This is purely informative, `pl_shader_custom_lut` ignores it.
     struct pl_color_repr repr_in, repr_out;
     struct pl_color_space color_in, color_out;
+
+    // If true, 3D LUTs are interpolated tetrahedrally by
+    // `pl_shader_custom_lut`, rather than relying on hardware trilinear
+    // filtering. This is more accurate, especially for small LUTs (e.g. 33^3),
+    // at the cost of a few more texture fetches per pixel. Not stored by
+    // `pl_lut_save`.
+    bool tetrahedral;
 };
 
 // Parse a 3DLUT in .cube format. Returns NULL if the file fails parsing.
 struct pl_custom_lut *pl_lut_parse_cube(pl_log log, const char *str, size_t str_len);
 
-// Frees a LUT created by `pl_lut_parse_*`.
+// Serializes a LUT into a compact binary format, which can be loaded again
+// (much faster than re-parsing a .cube file) using `pl_lut_load`. Returns the
+// size of the serialized LUT in bytes. If `out` is non-NULL, it must point to
+// a buffer of at least this size, which the LUT will be written to.
+//
+// Note: The LUT data is stored in native byte order, so the result can only
+// be loaded on platforms with the same endianness.
+size_t pl_lut_save(const struct pl_custom_lut *lut, uint8_t *out);
+
+// Loads a LUT previously serialized with `pl_lut_save`. Returns NULL if the
+// data fails validation.
+//
+// Note: To avoid a redundant copy, the returned LUT references the LUT data
+// inside `buf` directly (if suitably aligned). The user must ensure `buf`
+// remains valid until the LUT is freed. This allows e.g. loading LUTs from
+// memory mapped files without any further copying or parsing.
+struct pl_custom_lut *pl_lut_load(pl_log log, const uint8_t *buf, size_t buf_len);
+
+// Frees a LUT created by `pl_lut_parse_*` or `pl_lut_load`.
 void pl_lut_free(struct pl_custom_lut **lut);
 
 // Apply a `pl_custom_lut`. The user is responsible for ensuring colors going
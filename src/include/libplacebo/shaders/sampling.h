@@ -26,6 +26,7 @@
 
 #include <libplacebo/filters.h>
 #include <libplacebo/shaders.h>
+#include <libplacebo/shaders/colorspace.h>
 
 PL_API_BEGIN
 
@@ -143,6 +144,21 @@ bool pl_shader_sample_bicubic(pl_shader sh, const struct pl_sample_src *src);
 bool pl_shader_sample_oversample(pl_shader sh, const struct pl_sample_src *src,
                                  float threshold);
 
+// Performs luma-guided chroma upsampling ("chroma from luma"). This samples
+// the subsampled chroma plane `src` like `pl_shader_sample_bilinear`, but
+// additionally fits a local linear model between the chroma and the co-sited
+// luma over the surrounding 4x4 chroma texels, and uses it to predict chroma
+// from the full-resolution luma in `luma`. The prediction is blended with the
+// bilinear estimate based on how well the model fits, so regions where
+// chroma does not correlate with luma are left unaffected.
+//
+// The luma is read from the first component of `luma->tex`, which must be
+// linearly sampleable. Both `src` and `luma` must be backed by textures, and
+// cover the same area at the same output size (`new_w` / `new_h`). Only
+// useful when upscaling.
+bool pl_shader_sample_cfl(pl_shader sh, const struct pl_sample_src *src,
+                          const struct pl_sample_src *luma);
+
 struct pl_sample_filter_params {
     // The filter to use for sampling.
     struct pl_filter_config filter;
@@ -159,6 +175,20 @@ struct pl_sample_filter_params {
     bool no_compute;
     // Disable the use of filter widening / anti-aliasing (for downscaling)
     bool no_widening;
+    // Disable the analytic evaluation of filter kernels with cheap closed
+    // forms, always sampling the filter weights from a LUT instead. Only
+    // relevant for polar filters.
+    bool no_analytic;
+
+    // If set, every source texel is linearized (as if by `pl_shader_linearize`)
+    // from this color space and/or sigmoidized (as if by
+    // `pl_shader_sigmoidize`) with these parameters before filtering. This
+    // avoids the need for a separate pre-processing pass. Only supported by
+    // the compute shader code paths, which load every texel exactly once.
+    // Samplers return false if they can't honor this, in which case `sh`
+    // must be discarded by the caller. See `pl_shader_sample_ortho_tiled`.
+    const struct pl_color_space *linearize;
+    const struct pl_sigmoid_params *sigmoidize;
 
     // This shader object is used to store the LUT, and will be recreated
     // if necessary. To avoid thrashing the resource, users should avoid trying
@@ -174,6 +204,10 @@ struct pl_sample_filter_params {
 // and GPU features. Returns whether or not it was successful.
 //
 // Note: `params->filter.polar` must be true to use this function.
+//
+// Note: If `params->linearize` or `params->sigmoidize` are set, this returns
+// false (possibly after having modified `sh`) if the compute shader can't be
+// used.
 bool pl_shader_sample_polar(pl_shader sh, const struct pl_sample_src *src,
                             const struct pl_sample_filter_params *params);
 
@@ -200,6 +234,23 @@ bool pl_shader_sample_ortho(pl_shader sh, int pass,
                             const struct pl_sample_src *src,
                             const struct pl_sample_filter_params *params);
 
+// Performs both passes of orthogonal sampling at once, inside a single compute
+// shader that keeps the intermediate result in shared memory. This avoids the
+// full-size intermediate texture required by two `pl_shader_sample_ortho`
+// calls, and is generally faster when scaling in both directions.
+//
+// Returns false, without modifying `sh`, if this is not possible, e.g. due to
+// missing compute shader support, `params->no_compute`, or the filter being
+// too large to fit into shared memory. Callers should fall back to
+// `pl_shader_sample_ortho` in this case, which does not support
+// `params->linearize` or `params->sigmoidize`. If `sh` gets marked as failed,
+// an actual error occurred instead.
+//
+// Note: This uses the same `params->lut` object as `pl_shader_sample_ortho`,
+// so both can be freely mixed for the same scaler.
+bool pl_shader_sample_ortho_tiled(pl_shader sh, const struct pl_sample_src *src,
+                                  const struct pl_sample_filter_params *params);
+
 PL_API_END
 
 #endif // LIBPLACEBO_SHADERS_SAMPLING_H_
@@ -89,6 +89,15 @@ static bool pl_upload_dav1dpicture(pl_gpu gpu,
 static int pl_allocate_dav1dpicture(Dav1dPicture *picture, void *gpu);
 static void pl_release_dav1dpicture(Dav1dPicture *picture, void *gpu);
 
+// Variant of `pl_allocate_dav1dpicture` that draws buffers from a
+// `pl_buf_pool`, which must be passed as the value of `cookie`. Buffers are
+// only reused for new pictures once the GPU is done uploading from them, and
+// `pl_buf_pool_params.max_bytes` can be used to cap the total memory held by
+// the pool. The same thread-safety notes apply, with respect to the GPU the
+// pool was created from.
+static int pl_allocate_dav1dpicture_pooled(Dav1dPicture *picture, void *pool);
+static void pl_release_dav1dpicture_pooled(Dav1dPicture *picture, void *pool);
+
 // Mapping functions for the various Dav1dColor* enums. Note that these are not
 // quite 1:1, and even for values that exist in both, the semantics sometimes
 // differ. Some special cases (e.g. ICtCp, or XYZ) are handled differently in
@@ -394,6 +394,7 @@ struct pl_dav1dalloc {
     uint32_t magic[2];
     pl_gpu gpu;
     pl_buf buf;
+    pl_buf_pool pool; // if set, `buf` is returned here instead of destroyed
 };
 
 struct pl_dav1dref {
@@ -515,9 +516,9 @@ static inline bool pl_upload_dav1dpicture(pl_gpu gpu,
     return true;
 }
 
-static inline int pl_allocate_dav1dpicture(Dav1dPicture *p, void *cookie)
+static inline int pl_allocate_dav1dpicture_internal(Dav1dPicture *p, pl_gpu gpu,
+                                                    pl_buf_pool pool)
 {
-    pl_gpu gpu = cookie;
     if (!gpu->limits.max_mapped_size || !gpu->limits.buf_transfer)
         return DAV1D_ERR(ENOTSUP);
 
@@ -549,18 +550,27 @@ static inline int pl_allocate_dav1dpicture(Dav1dPicture *p, void *cookie)
     if (total_size > gpu->limits.max_mapped_size)
         return DAV1D_ERR(ENOMEM);
 
-    pl_buf buf = pl_buf_create(gpu, pl_buf_params(
-        .size = total_size,
-        .host_mapped = true,
-        .memory_type = PL_BUF_MEM_HOST,
-    ));
+    pl_buf buf;
+    if (pool) {
+        buf = pl_buf_pool_get(pool, total_size);
+    } else {
+        buf = pl_buf_create(gpu, pl_buf_params(
+            .size = total_size,
+            .host_mapped = true,
+            .memory_type = PL_BUF_MEM_HOST,
+        ));
+    }
 
     if (!buf)
         return DAV1D_ERR(ENOMEM);
 
     struct pl_dav1dalloc *alloc = malloc(sizeof(struct pl_dav1dalloc));
     if (!alloc) {
-        pl_buf_destroy(gpu, &buf);
+        if (pool) {
+            pl_buf_pool_put(pool, &buf);
+        } else {
+            pl_buf_destroy(gpu, &buf);
+        }
         return DAV1D_ERR(ENOMEM);
     }
 
@@ -568,6 +578,7 @@ static inline int pl_allocate_dav1dpicture(Dav1dPicture *p, void *cookie)
         .magic = { PL_MAGIC0, PL_MAGIC1 },
         .gpu = gpu,
         .buf = buf,
+        .pool = pool,
     };
 
     assert(buf->data);
@@ -583,6 +594,17 @@ static inline int pl_allocate_dav1dpicture(Dav1dPicture *p, void *cookie)
     return 0;
 }
 
+static inline int pl_allocate_dav1dpicture(Dav1dPicture *p, void *cookie)
+{
+    return pl_allocate_dav1dpicture_internal(p, cookie, NULL);
+}
+
+static inline int pl_allocate_dav1dpicture_pooled(Dav1dPicture *p, void *cookie)
+{
+    pl_buf_pool pool = cookie;
+    return pl_allocate_dav1dpicture_internal(p, pl_buf_pool_gpu(pool), pool);
+}
+
 static inline void pl_release_dav1dpicture(Dav1dPicture *p, void *cookie)
 {
     struct pl_dav1dalloc *alloc = p->allocator_data;
@@ -591,13 +613,23 @@ static inline void pl_release_dav1dpicture(Dav1dPicture *p, void *cookie)
 
     assert(alloc->magic[0] == PL_MAGIC0);
     assert(alloc->magic[1] == PL_MAGIC1);
-    assert(alloc->gpu == cookie);
-    pl_buf_destroy(alloc->gpu, &alloc->buf);
+    if (alloc->pool) {
+        assert(alloc->pool == cookie);
+        pl_buf_pool_put(alloc->pool, &alloc->buf);
+    } else {
+        assert(alloc->gpu == cookie);
+        pl_buf_destroy(alloc->gpu, &alloc->buf);
+    }
     free(alloc);
 
     p->data[0] = p->data[1] = p->data[2] = p->allocator_data = NULL;
 }
 
+static inline void pl_release_dav1dpicture_pooled(Dav1dPicture *p, void *cookie)
+{
+    pl_release_dav1dpicture(p, cookie);
+}
+
 #undef PL_ALIGN2
 #undef PL_MAGIC0
 #undef PL_MAGIC1
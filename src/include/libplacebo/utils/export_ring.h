@@ -0,0 +1,116 @@
+/*
+ * This file is part of libplacebo.
+ *
+ * libplacebo is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * libplacebo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with libplacebo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBPLACEBO_EXPORT_RING_H
+#define LIBPLACEBO_EXPORT_RING_H
+
+#include <libplacebo/gpu.h>
+
+PL_API_BEGIN
+
+// A helper for handing off rendered frames to an external consumer (e.g. a
+// Wayland compositor or a hardware encoder) without any readback. The ring
+// owns a fixed set of exportable render targets, each paired with its own
+// `pl_sync`, and cycles through them as frames are rendered, exported and
+// eventually released again by the consumer.
+//
+// The typical per-frame flow looks like this:
+//
+//   struct pl_export_frame frame;
+//   if (!pl_export_ring_acquire(ring, &frame))
+//       // all targets are still held by the consumer, drop or wait
+//
+//   pl_render_image(rr, &image, &(struct pl_frame) { ... frame.tex ... }, ...);
+//   pl_export_ring_submit(ring, &frame);
+//
+//   // Pass `frame.mem` (dma_buf fd, modifier, stride) and a dup() of
+//   // `frame.sync->wait_handle` (acquire fence) to the consumer. Once the
+//   // consumer no longer needs the frame, it must signal
+//   // `frame.sync->signal_handle` (release fence), after which:
+//   pl_export_ring_release(ring, &frame);
+//
+// Thread-safety: Unsafe
+typedef PL_STRUCT(pl_export_ring) *pl_export_ring;
+
+struct pl_export_ring_params {
+    // Format and size of the render targets. `format` must be renderable.
+    pl_fmt format;
+    int w, h;
+
+    // Number of render targets in the ring, which bounds the number of
+    // frames that can be held by the consumer at the same time. (Default: 3)
+    int num_targets;
+
+    // Handle types used for exporting the render targets and their sync
+    // objects, respectively. Must be supported by `pl_gpu.export_caps`.
+    // (Default: PL_HANDLE_DMA_BUF and PL_HANDLE_FD)
+    enum pl_handle_type tex_handle;
+    enum pl_handle_type sync_handle;
+};
+
+#define pl_export_ring_params(...) (&(struct pl_export_ring_params) { __VA_ARGS__ })
+
+// Create a new export ring, allocating all render targets up-front. Returns
+// NULL on failure, e.g. if the requested handle types are not supported.
+pl_export_ring pl_export_ring_create(pl_gpu gpu, const struct pl_export_ring_params *params);
+
+// Destroy an export ring and all of its render targets. The consumer must be
+// done accessing all exported frames (and any external objects imported
+// from them) before calling this.
+void pl_export_ring_destroy(pl_export_ring *ring);
+
+struct pl_export_frame {
+    // Render target for this frame. Renderable, and additionally storable
+    // and blittable if supported by the format.
+    pl_tex tex;
+
+    // Shared memory backing `tex`, including the handle (e.g. dma_buf fd),
+    // DRM format modifier and stride chosen by the driver. The handle is
+    // owned by the ring, and valid until the ring is destroyed.
+    const struct pl_shared_mem *mem;
+
+    // Sync object for handing off `tex`. `wait_handle` fires once rendering
+    // is complete, and `signal_handle` must be signalled by the consumer
+    // when it is done with the frame. Only meaningful after a successful
+    // `pl_export_ring_submit`.
+    pl_sync sync;
+
+    // Internal index of this render target within the ring
+    int index;
+};
+
+// Acquire the next free render target, for rendering into. Returns false if
+// all targets are currently held by the consumer (i.e. submitted, but not
+// yet released). Frames acquired this way must eventually be either
+// submitted or released.
+bool pl_export_ring_acquire(pl_export_ring ring, struct pl_export_frame *frame);
+
+// Export an acquired frame after rendering into it, and flush the GPU. After
+// this returns successfully, `frame->sync->wait_handle` is guaranteed to be
+// signalled eventually. On failure, the frame is returned to the ring.
+bool pl_export_ring_submit(pl_export_ring ring, struct pl_export_frame *frame);
+
+// Return a frame to the ring. For submitted frames, the consumer must have
+// signalled (or at least submitted a signal operation for)
+// `frame->sync->signal_handle` before calling this, since the next use of
+// the render target implicitly waits on it. Frames that were acquired but
+// never submitted may be released directly.
+void pl_export_ring_release(pl_export_ring ring, struct pl_export_frame *frame);
+
+PL_API_END
+
+#endif // LIBPLACEBO_EXPORT_RING_H
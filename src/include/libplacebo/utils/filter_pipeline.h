@@ -0,0 +1,167 @@
+/*
+ * This file is part of libplacebo.
+ *
+ * libplacebo is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * libplacebo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with libplacebo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBPLACEBO_FILTER_PIPELINE_H
+#define LIBPLACEBO_FILTER_PIPELINE_H
+
+#include <libplacebo/renderer.h>
+#include <libplacebo/utils/upload.h>
+
+PL_API_BEGIN
+
+// A helper for using libplacebo as a headless video filter, i.e. processing
+// frames from host memory back into host memory. Frames pushed into the
+// pipeline are uploaded, rendered with `pl_render_image` and downloaded into
+// persistently mapped buffers, all asynchronously, with each frame in flight
+// using its own set of GPU resources. This keeps the GPU busy across several
+// frames at once, rather than stalling on every single transfer.
+//
+// The typical flow, e.g. as part of a filter callback, looks like this:
+//
+//   while (have_input && pl_filter_pipeline_push(pipe, &src, &dst, priv))
+//       // get the next input frame
+//
+//   struct pl_filter_output out;
+//   while (pl_filter_pipeline_pull(pipe, &out, 0)) {
+//       // pass `out.image` on to the next filter
+//       pl_filter_pipeline_release(pipe, &out);
+//   }
+//
+// To drain the pipeline, keep pulling with a nonzero timeout until
+// `pl_filter_pipeline_queued` returns 0.
+//
+// Thread-safety: Unsafe
+typedef PL_STRUCT(pl_filter_pipeline) *pl_filter_pipeline;
+
+struct pl_filter_pipeline_params {
+    // Renderer used for processing frames. Required, and must outlive the
+    // pipeline. The renderer's GPU is used for all other GPU operations.
+    pl_renderer renderer;
+
+    // Rendering parameters for each frame. (Optional)
+    const struct pl_render_params *render_params;
+
+    // Maximum number of frames in flight at the same time, including frames
+    // that have been pulled but not released yet. (Default: 4)
+    int queue_size;
+};
+
+#define pl_filter_pipeline_params(...) (&(struct pl_filter_pipeline_params) { __VA_ARGS__ })
+
+// Create a new filter pipeline. GPU resources are (re)created lazily as
+// frames are pushed. Returns NULL on failure.
+pl_filter_pipeline pl_filter_pipeline_create(pl_gpu gpu,
+                                             const struct pl_filter_pipeline_params *params);
+
+// Destroy a filter pipeline, discarding any frames still in flight. Images
+// returned by `pl_filter_pipeline_pull` become invalid.
+void pl_filter_pipeline_destroy(pl_filter_pipeline *pipe);
+
+// Description of a frame in host memory.
+struct pl_filter_image {
+    int num_planes;
+    struct pl_plane_data planes[PL_MAX_PLANES];
+    struct pl_color_repr repr;
+    struct pl_color_space color;
+};
+
+// Push a new frame into the pipeline, rendering `src` into a target laid out
+// as described by `dst`. Subsampled planes are inferred from the plane sizes,
+// similar to `pl_frame`. For `dst`, only the format and size of each plane
+// are used; `row_stride` is optional, and rounded up to the GPU's preferred
+// transfer alignment. The `pixels`, `buf` and `callback` fields are ignored.
+//
+// For `src`, the planes may either point to host memory, which is no longer
+// accessed after this function returns, or to a (host-mapped) `pl_buf`, in
+// which case the upload happens asynchronously and directly from that buffer.
+// Such buffers must not be modified until `pl_buf_poll` reports them as no
+// longer in use, which is guaranteed once the frame has been pulled.
+//
+// Returns false if the queue is full, in which case frames must be pulled
+// (and released) first, or if processing the frame failed.
+bool pl_filter_pipeline_push(pl_filter_pipeline pipe,
+                             const struct pl_filter_image *src,
+                             const struct pl_filter_image *dst,
+                             void *priv);
+
+struct pl_filter_output {
+    // Processed image, with the planes pointing into host-mapped memory
+    // owned by the pipeline. Valid until released.
+    struct pl_filter_image image;
+
+    // The `priv` passed to the corresponding `pl_filter_pipeline_push`
+    void *priv;
+
+    // Internal index of this frame within the pipeline
+    int index;
+};
+
+// Pull the oldest frame out of the pipeline, waiting up to `timeout`
+// nanoseconds for it to finish processing. Frames are always returned in the
+// order they were pushed. Returns false if there are no frames in flight, or
+// if the oldest frame is not done yet. Frames pulled this way must eventually
+// be released.
+bool pl_filter_pipeline_pull(pl_filter_pipeline pipe, struct pl_filter_output *out,
+                             uint64_t timeout);
+
+// Return a pulled frame's memory to the pipeline, for reuse by future frames.
+void pl_filter_pipeline_release(pl_filter_pipeline pipe, struct pl_filter_output *out);
+
+// Returns the number of frames pushed, but not pulled yet.
+int pl_filter_pipeline_queued(pl_filter_pipeline pipe);
+
+enum pl_filter_stage {
+    PL_FILTER_STAGE_UPLOAD,     // uploading `src` to textures
+    PL_FILTER_STAGE_RENDER,     // `pl_render_image`
+    PL_FILTER_STAGE_DOWNLOAD,   // downloading the result to host memory
+    PL_FILTER_STAGE_COUNT,
+};
+
+// Cumulative timing statistics. All times are in nanoseconds.
+struct pl_filter_timing {
+    int count;      // number of samples included in these statistics
+    uint64_t last;  // most recent sample
+    uint64_t mean;
+    uint64_t peak;
+};
+
+struct pl_filter_stage_stats {
+    // CPU time spent submitting this stage, per frame
+    struct pl_filter_timing cpu;
+
+    // GPU time spent executing this stage, per frame. Only available if the
+    // GPU supports timer queries. Not measured for `PL_FILTER_STAGE_RENDER`,
+    // see `pl_renderer_get_stats` instead.
+    struct pl_filter_timing gpu;
+};
+
+struct pl_filter_pipeline_stats {
+    struct pl_filter_stage_stats stages[PL_FILTER_STAGE_COUNT];
+
+    // Time between pushing a frame and successfully pulling it
+    struct pl_filter_timing latency;
+};
+
+// Returns the timing statistics accumulated by this pipeline.
+struct pl_filter_pipeline_stats pl_filter_pipeline_get_stats(pl_filter_pipeline pipe);
+
+// Resets the statistics returned by `pl_filter_pipeline_get_stats`.
+void pl_filter_pipeline_reset_stats(pl_filter_pipeline pipe);
+
+PL_API_END
+
+#endif // LIBPLACEBO_FILTER_PIPELINE_H
@@ -19,6 +19,7 @@
 #define LIBPLACEBO_FRAME_QUEUE_H
 
 #include <libplacebo/renderer.h>
+#include <libplacebo/utils/upload.h>
 
 PL_API_BEGIN
 
@@ -80,6 +81,24 @@ struct pl_source_frame {
     // (e.g. never became visible) and should instead be cleanly freed.
     // (Optional)
     void (*discard)(const struct pl_source_frame *src);
+
+    // Estimated memory footprint of this frame once mapped, in bytes. This is
+    // only used to account for the frame against the memory budget (see
+    // `pl_queue_params.memory_budget`) while it's not yet mapped. Once mapped,
+    // the size of the actual plane textures is used instead. (Optional)
+    size_t size_hint;
+
+    // Description of the planes that `map` will upload into `tex`, e.g. using
+    // `pl_upload_plane`. If provided, `pl_queue` hands `map` a set of
+    // recycled textures with a matching size and format whenever one is
+    // available, so that steady-state playback never needs to create or
+    // destroy any textures, even for sources with varying frame shapes.
+    //
+    // Only the shape (dimensions and format) of the planes is used, and only
+    // during `pl_queue_push`, so the data pointers may be left unset. At most
+    // 4 planes are supported. (Optional)
+    const struct pl_plane_data *planes;
+    int num_planes;
 };
 
 // Create a new, empty frame queue.
@@ -90,6 +109,18 @@ struct pl_source_frame {
 pl_queue pl_queue_create(pl_gpu gpu);
 void pl_queue_destroy(pl_queue *queue);
 
+// Variant of `pl_queue_create` optimized for the common case of exactly one
+// thread pushing frames (via `pl_queue_push` / `pl_queue_push_block`) and
+// exactly one thread calling `pl_queue_update`. In this mode, frames are
+// pushed into a lock-free ring buffer and only collected by the consumer,
+// so the producer never contends with `pl_queue_update` on the queue lock
+// in the steady state.
+//
+// Note: Pushing frames from more than one thread at a time is undefined
+// behavior on queues created this way. Frames returned by the
+// `pl_queue_params.get_frame` callback are exempt from this restriction.
+pl_queue pl_queue_create_spsc(pl_gpu gpu);
+
 // Explicitly clear the queue. This is essentially equivalent to destroying
 // and recreating the queue, but preserves any internal memory allocations.
 //
@@ -117,6 +148,38 @@ void pl_queue_push(pl_queue queue, const struct pl_source_frame *frame);
 bool pl_queue_push_block(pl_queue queue, uint64_t timeout,
                          const struct pl_source_frame *frame);
 
+// Push a batch of `num_frames` frames at once. This is equivalent to calling
+// `pl_queue_push` on each frame in order, but only takes the queue lock once
+// and updates the internal bookkeeping once for the entire batch. Never
+// blocks. EOF must still be signalled separately, with `pl_queue_push`.
+//
+// Note: On queues created with `pl_queue_create_spsc`, this bypasses the
+// lock-free push ring, and the same single-producer restriction applies.
+void pl_queue_push_bulk(pl_queue queue, const struct pl_source_frame *frames,
+                        int num_frames);
+
+// An independent cursor into a `pl_queue`, for rendering the same stream to
+// several outputs (e.g. displays with different refresh rates) at once. Each
+// consumer advances through the queue at its own pace, with its own vsync
+// timing estimates, while the frames themselves are shared between all
+// consumers, i.e. only ever mapped once. Frames are culled only once every
+// consumer has moved past them.
+//
+// Every queue has an implicit default consumer, which is used by all
+// `pl_queue_update` calls that don't specify `pl_queue_params.consumer`.
+typedef PL_STRUCT(pl_queue_consumer) *pl_queue_consumer;
+
+// Create a new consumer for `queue`. A consumer only starts holding on to
+// frames once it has been passed to `pl_queue_update` for the first time,
+// so it may be created at any point, e.g. when adding a new output. Consumers
+// are reset together with the queue by `pl_queue_reset`, and implicitly
+// destroyed by `pl_queue_destroy`.
+pl_queue_consumer pl_queue_consumer_create(pl_queue queue);
+
+// Destroy a consumer, releasing its hold on any frames. Frames returned to it
+// by `pl_queue_update` may not be used after this call.
+void pl_queue_consumer_destroy(pl_queue queue, pl_queue_consumer *consumer);
+
 struct pl_queue_params {
     // The PTS of the frame that will be rendered. This should be set to the
     // timestamp (in seconds) of the next vsync, relative to the initial frame.
@@ -130,6 +193,22 @@ struct pl_queue_params {
     // as returned by `pl_frame_mix_radius`.
     float radius;
 
+    // The frame mixer the resulting mix will be rendered with, i.e.
+    // `pl_render_params.frame_mixer`. If provided, the queue evaluates the
+    // mixer's weight for every frame within `radius`, and avoids requesting
+    // or mapping frames whose weight would be negligible. This reduces the
+    // number of frame uploads (and the renderer's frame cache size) for
+    // mixers with a large radius but a quickly decaying kernel. (Optional)
+    const struct pl_filter_config *frame_mixer;
+
+    // Frames whose absolute mixer weight is at most this value are skipped.
+    // Only relevant if `frame_mixer` is set. If left as 0.0, this defaults to
+    // 1e-3, which matches the cutoff used by `pl_render_image_mix` itself.
+    //
+    // Note: The frame nearest to `pts`, as well as the last frame before
+    // `pts`, are always included regardless of their weight.
+    float mixer_threshold;
+
     // The estimated duration of a vsync, in seconds. This will only be used as
     // a hint, the true value will be estimated by comparing `pts` timestamps
     // between calls to `pl_queue_update`. (Optional)
@@ -140,6 +219,14 @@ struct pl_queue_params {
     // timestamps between source frames. (Optional)
     float frame_duration;
 
+    // If true, `frame_duration` is instead taken to be the exact duration of
+    // every source frame, i.e. the source is declared to have a constant frame
+    // rate. This skips the frame duration estimation entirely, and lets the
+    // queue map timestamps to frames arithmetically rather than by searching.
+    // Frames which deviate from this cadence are still handled correctly, but
+    // lose the benefit. Ignored if `frame_duration` is unset.
+    bool constant_frame_rate;
+
     // If the difference between the (estimated) vsync duration and the
     // (measured) frame duration is smaller than this threshold, silently
     // disable interpolation and switch to ZOH semantics instead.
@@ -160,6 +247,24 @@ struct pl_queue_params {
     // should instead be interpreted by the provided callback.
     uint64_t timeout;
 
+    // If nonzero, limit the queue by the total size of all queued frames (in
+    // bytes), rather than by a fixed number of not-yet-mapped frames. This
+    // affects how long `pl_queue_push_block` will block. Frames required by
+    // `pl_queue_update` are always requested regardless of this limit.
+    //
+    // The size of frames which are not yet mapped is estimated from
+    // `pl_source_frame.size_hint`, or the size of the most recently mapped
+    // frame if absent.
+    size_t memory_budget;
+
+    // The consumer to advance, as created by `pl_queue_consumer_create`. The
+    // `pts` (and the vsync timing derived from it) is tracked separately for
+    // each consumer. If NULL, the queue's default consumer is used. (Optional)
+    //
+    // Note: Calls to `pl_queue_update` for different consumers may be made
+    // from different threads, but are serialized internally.
+    pl_queue_consumer consumer;
+
     // This callback will be used to pull new frames from the decoder. It may
     // block if needed. The user is responsible for setting appropriate time
     // limits and/or returning and interpreting QUEUE_MORE as sensible.
@@ -189,10 +294,51 @@ struct pl_queue_params {
 // the target timestamp, and can be passed to `pl_render_image_mix` as-is.
 //
 // Note: `out_mix` will only remain valid until the next call to
-// `pl_queue_update` or `pl_queue_reset`.
+// `pl_queue_update` (for the same consumer) or `pl_queue_reset`.
 enum pl_queue_status pl_queue_update(pl_queue queue, struct pl_frame_mix *out_mix,
                                      const struct pl_queue_params *params);
 
+// Map upcoming frames ahead of time, so that `pl_queue_update` will find them
+// already resident instead of calling `pl_source_frame.map` itself. This is
+// intended to be called from a separate thread (e.g. a dedicated worker, or
+// a task submitted to the user's own executor), concurrently with
+// `pl_queue_update`.
+//
+// Frames are mapped up to `lookahead` frames beyond the mixer radius most
+// recently passed to `pl_queue_update`, past the furthest consumer. If there are no such frames to map,
+// this function waits up to `timeout` nanoseconds for more frames to arrive.
+// Returns the number of frames that were mapped.
+//
+// Note: Since `map` will be called from the thread calling this function,
+// the `pl_gpu` must be usable from that thread. (e.g. for OpenGL, this
+// requires providing `pl_opengl_params.make_current`)
+int pl_queue_prefetch(pl_queue queue, int lookahead, uint64_t timeout);
+
+struct pl_queue_stats {
+    int num_frames;         // number of frames currently in the queue
+    int num_mapped;         // number of those frames that are mapped
+    size_t resident_bytes;  // total size of all mapped frames
+    size_t pending_bytes;   // estimated total size of all unmapped frames
+
+    // Frame timing statistics, as of the most recent `pl_queue_update` (of
+    // any consumer)
+    float estimated_fps;    // estimated source frame rate, or 0 if unknown
+    float estimated_vps;    // estimated display refresh rate, or 0 if unknown
+    float vsync_interval;   // most recently observed vsync interval, in seconds
+    float vsync_jitter;     // standard deviation of recent vsync intervals
+    uint64_t frames_dropped;    // frames evicted without ever being shown
+    uint64_t frames_repeated;   // updates that showed the same frame again
+    uint64_t stalls;            // updates that returned PL_QUEUE_MORE
+};
+
+// Returns a snapshot of the current queue state. This never blocks, and may
+// be called from any thread at any time, e.g. for telemetry purposes. Frames
+// pushed to an SPSC queue only show up here once collected by the consumer.
+//
+// Note: Individual fields are updated independently, so the snapshot as a
+// whole is not guaranteed to be self-consistent.
+struct pl_queue_stats pl_queue_get_stats(pl_queue queue);
+
 PL_API_END
 
 #endif // LIBPLACEBO_FRAME_QUEUE_H
@@ -0,0 +1,108 @@
+/*
+ * This file is part of libplacebo.
+ *
+ * libplacebo is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * libplacebo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with libplacebo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBPLACEBO_GPU_POOL_H
+#define LIBPLACEBO_GPU_POOL_H
+
+#include <libplacebo/renderer.h>
+
+PL_API_BEGIN
+
+// A helper for distributing rendering work across several GPUs. The pool
+// owns one `pl_renderer` per device, and places incoming streams (or
+// individual frames) on whichever device currently has the lowest measured
+// load, based on the GPU timing statistics of its renderer (see
+// `pl_renderer_get_stats` and `pl_gpu_pool_update`).
+//
+// The pool does not create or own the devices themselves, since these are
+// API-specific (e.g. one `pl_vulkan` per physical device). It merely needs
+// their `pl_gpu` handles, which must outlive the pool.
+//
+// Thread-safety: Safe (but the returned renderers are not)
+typedef PL_STRUCT(pl_gpu_pool) *pl_gpu_pool;
+
+struct pl_gpu_pool_device {
+    pl_gpu gpu;
+
+    // Opaque identifier of the device model, e.g. `vendorID << 16 | deviceID`
+    // from `VkPhysicalDeviceProperties`. Devices with the same (non-zero)
+    // model share their shader caches, see `pl_gpu_pool_sync_caches`. If 0,
+    // this device's cache is never shared.
+    uint64_t model;
+
+    // Relative weight of this device, used as an initial estimate of its
+    // throughput until timing statistics become available. If 0, defaults
+    // to 1.0.
+    float weight;
+};
+
+struct pl_gpu_pool_params {
+    const struct pl_gpu_pool_device *devices;
+    int num_devices;
+};
+
+#define pl_gpu_pool_params(...) (&(struct pl_gpu_pool_params) { __VA_ARGS__ })
+
+// Create a new pool for the given devices. Returns NULL on failure, or if
+// `num_devices` is 0.
+pl_gpu_pool pl_gpu_pool_create(pl_log log, const struct pl_gpu_pool_params *params);
+void pl_gpu_pool_destroy(pl_gpu_pool *pool);
+
+// Returns the number of devices in the pool, and the `pl_gpu` and
+// `pl_renderer` of a given device index, respectively.
+int pl_gpu_pool_num_devices(pl_gpu_pool pool);
+pl_gpu pl_gpu_pool_gpu(pl_gpu_pool pool, int idx);
+pl_renderer pl_gpu_pool_renderer(pl_gpu_pool pool, int idx);
+
+// Assign a stream, identified by an arbitrary user-provided ID, to a device.
+// The first call for a given ID places the stream on the device with the
+// lowest estimated load; subsequent calls return the same device until the
+// stream is released with `pl_gpu_pool_release`. Returns the device index.
+//
+// Note: Since streams placed on the same device share a `pl_renderer`,
+// users should make sure frame signatures are unique across streams.
+int pl_gpu_pool_assign(pl_gpu_pool pool, uint64_t stream_id);
+void pl_gpu_pool_release(pl_gpu_pool pool, uint64_t stream_id);
+
+// Pick a device for a single, independent frame (e.g. when batch-processing
+// frames from a single source). Frames are scheduled proportionally to the
+// measured throughput of each device. Returns the device index.
+int pl_gpu_pool_pick(pl_gpu_pool pool);
+
+// Update the load estimate of a device from the statistics of its renderer.
+// Since renderers are not thread-safe, this must be called from whichever
+// thread is using that device's renderer, typically after each frame.
+void pl_gpu_pool_update(pl_gpu_pool pool, int idx);
+
+// Returns the currently estimated per-frame GPU cost of a device, in
+// nanoseconds, or 0 if no timing statistics are available yet.
+uint64_t pl_gpu_pool_frame_cost(pl_gpu_pool pool, int idx);
+
+// Share the shader caches of all devices with the same model, by merging
+// the cached programs of every renderer into all of its peers. This is
+// cheap if nothing changed, and can be called e.g. after the first frame
+// has been rendered on a device, to avoid recompiling the same shaders on
+// every other device of the same model.
+//
+// Note: Only compiled programs are shared. LUTs and other shader objects are
+// backed by device-local resources, and are recreated on each device. This
+// must not be called concurrently with rendering on any device of the pool.
+void pl_gpu_pool_sync_caches(pl_gpu_pool pool);
+
+PL_API_END
+
+#endif // LIBPLACEBO_GPU_POOL_H
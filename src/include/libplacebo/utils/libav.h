@@ -84,10 +84,45 @@ static bool pl_test_pixfmt(pl_gpu gpu, enum AVPixelFormat pixfmt);
 static bool pl_frame_recreate_from_avframe(pl_gpu gpu, struct pl_frame *out_frame,
                                            pl_tex tex[4], const AVFrame *frame);
 
+// Per-stream cache of state derived from mapped frames, to avoid redoing
+// work that is identical between frames:
+//
+// - Wrapped hardware frame textures, for hwaccel formats backed by a fixed
+//   pool of images (currently only `AV_PIX_FMT_VULKAN`). FFmpeg recycles the
+//   same small set of images for the lifetime of a hwframes context, so
+//   re-using their wrapped textures avoids re-creating them (and their image
+//   views) on every `pl_map_avframe_ex` call. Only the per-frame semaphore
+//   exchange remains.
+//
+// - Mapped Dolby Vision metadata. Frames carrying byte-identical RPU side
+//   data share the same `pl_frame.repr.dovi` pointer, instead of re-mapping
+//   the (large) reshaping coefficients for every frame.
+//
+// Must be zero-initialized before first use, and freed with
+// `pl_avframe_cache_uninit` once no longer needed (and before the `pl_gpu` is
+// destroyed). Holds a reference to the most recently mapped hwframes context.
+// Cached textures remain valid until all frames mapped from them have been
+// unmapped, even if the hwframes context changes in the meantime.
+//
+// Thread-safety: Unsafe
+struct pl_avframe_cache {
+    // Internal state, do not touch
+    AVBufferRef *hw_frames_ctx;
+    struct pl_avframe_cache_entry **entries;
+    int num_entries;
+    struct pl_avframe_dovi *dovi;
+};
+
+static void pl_avframe_cache_uninit(pl_gpu gpu, struct pl_avframe_cache *cache);
+
 struct pl_avframe_params {
     // The AVFrame to map. Required.
     const AVFrame *frame;
 
+    // Optional cache for wrapped hwframe textures. See `pl_avframe_cache`.
+    // Frames mapped with a cache must be unmapped before it is uninitialized.
+    struct pl_avframe_cache *cache;
+
     // Backing textures for frame data. Required for all non-hwdec formats.
     // This must point to an array of four valid textures (or NULL entries).
     //
@@ -113,11 +148,29 @@ struct pl_avframe_params {
 //
 // Note: `out_frame->user_data` will hold a reference to the AVFrame
 // corresponding to the `pl_frame`. It will automatically be unref'd by
-// `pl_unmap_avframe`.
+// `pl_unmap_avframe`. The same applies to `out_frame->repr.dovi`, which
+// must not be replaced by the user.
 static bool pl_map_avframe_ex(pl_gpu gpu, struct pl_frame *out_frame,
                               const struct pl_avframe_params *params);
 static void pl_unmap_avframe(pl_gpu gpu, struct pl_frame *frame);
 
+// Counterpart to `pl_map_avframe_ex`, which maps a writable hardware frame
+// (DRM_PRIME, VAAPI, VULKAN or D3D11) as a `pl_frame` suitable for use as a
+// rendering target, e.g. for rendering directly into a hardware encoder's
+// input surfaces. The colorimetry of the resulting `pl_frame` is taken from
+// `frame`, so users should set the desired output colorspace on the AVFrame
+// (e.g. using `pl_avframe_set_color`) before mapping it. Fails if the frame's
+// textures can't be rendered to. Must be unmapped with `pl_unmap_avframe`,
+// and the same notes about `out_frame->user_data` apply.
+//
+// Note: For VULKAN frames, synchronization with libavutil happens
+// automatically through the frame's timeline semaphores, which are signalled
+// by `pl_render_image` et al. once rendering is complete. For all other
+// formats, the user must ensure rendering has finished before passing the
+// frame on to the encoder, e.g. with `pl_gpu_finish`.
+static bool pl_map_avframe_target(pl_gpu gpu, struct pl_frame *out_frame,
+                                  const AVFrame *frame);
+
 // Backwards compatibility with previous versions of this API.
 static inline bool pl_map_avframe(pl_gpu gpu, struct pl_frame *out_frame,
                                   pl_tex tex[4], const AVFrame *avframe)
@@ -147,6 +200,51 @@ static bool pl_download_avframe(pl_gpu gpu,
                                 const struct pl_frame *frame,
                                 AVFrame *out_frame);
 
+#if LIBAVUTIL_VERSION_MAJOR >= 57
+# define PL_HAVE_LAV_DOWNLOAD_PIPELINE
+
+// Pipelined, asynchronous alternative to `pl_download_avframe`, intended for
+// e.g. feeding rendered frames to a CPU encoder without stalling on every
+// readback. Keeps up to `depth` downloads in flight, into a recycling pool
+// of host-mapped buffers, and hands back completed frames in submission
+// order. Falls back to synchronous downloads if the GPU lacks support for
+// thread-safe host-mapped buffer transfers.
+struct pl_avdownload_params {
+    pl_gpu gpu;
+
+    // Maximum number of downloads in flight. Submitting more frames than
+    // this blocks until the oldest download completes. (Default: 4)
+    int depth;
+
+    // Called for every completed frame, in submission order, from within
+    // `pl_avdownload_submit`, `pl_avdownload_poll` or `pl_avdownload_destroy`.
+    // Ownership of `frame` passes to the callee, who must eventually free it
+    // with `av_frame_free`. Its buffers are recycled once unreferenced.
+    void (*frame_done)(void *priv, AVFrame *frame);
+    void *priv;
+};
+
+typedef struct pl_avdownload_t *pl_avdownload;
+
+static pl_avdownload pl_avdownload_create(const struct pl_avdownload_params *params);
+
+// Waits for all remaining downloads and delivers them before destroying the
+// pipeline. Frames handed out previously remain valid.
+static void pl_avdownload_destroy(pl_avdownload *dl);
+
+// Start downloading the planes of `frame`. The output frame gets its pixel
+// format, dimensions and properties from `props`, which should typically
+// match what was used for `pl_frame_recreate_from_avframe`. Returns whether
+// successful.
+static bool pl_avdownload_submit(pl_avdownload dl, const struct pl_frame *frame,
+                                 const AVFrame *props);
+
+// Deliver all downloads that have completed so far. If `flush` is true, wait
+// for all downloads currently in flight.
+static void pl_avdownload_poll(pl_avdownload dl, bool flush);
+
+#endif // LIBAVUTIL_VERSION_MAJOR >= 57
+
 // Helper functions to update the colorimetry data in an AVFrame based on
 // the values specified in the given color space / color repr / profile.
 //
@@ -175,6 +273,13 @@ static int pl_plane_data_from_pixfmt(struct pl_plane_data data[4],
                                      struct pl_bit_encoding *bits,
                                      enum AVPixelFormat pix_fmt);
 
+// Returns the packed format matching a given AVPixelFormat, for pixel formats
+// which `pl_plane_data_from_pixfmt` can't represent but `pl_upload_packed`
+// can unpack on the GPU (e.g. AV_PIX_FMT_YUYV422), or PL_PACKED_NONE.
+// Frames in such formats are handled transparently by `pl_map_avframe` and
+// `pl_upload_avframe`, if supported by the GPU.
+static enum pl_packed_fmt pl_packed_fmt_from_av(enum AVPixelFormat pix_fmt);
+
 // Callback for AVCodecContext.get_buffer2 that allocates memory from
 // persistently mapped buffers. This can be more efficient than regular
 // system memory, especially on platforms that don't support importing
@@ -184,6 +289,15 @@ static int pl_plane_data_from_pixfmt(struct pl_plane_data data[4],
 // That is, it should have type `pl_gpu *`.
 static int pl_get_buffer2(AVCodecContext *avctx, AVFrame *pic, int flags);
 
+// Variant of `pl_get_buffer2` that recycles buffers through a `pl_buf_pool`,
+// rather than creating (and destroying) a new buffer for every frame. Buffers
+// are only reused for new frames once the GPU is done uploading from them.
+//
+// Note: `avctx->opaque` must be a pointer that *points* to the pool. That is,
+// it should have type `pl_buf_pool *`. The pool may be destroyed while frames
+// allocated from it are still alive.
+static int pl_get_buffer2_pooled(AVCodecContext *avctx, AVFrame *pic, int flags);
+
 // Mapping functions for the various libavutil enums. Note that these are not
 // quite 1:1, and even for values that exist in both, the semantics sometimes
 // differ. Some special cases (e.g. ICtCp, or XYZ) are handled differently in
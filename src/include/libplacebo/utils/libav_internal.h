@@ -20,6 +20,7 @@
 #else
 
 #include <assert.h>
+#include <limits.h>
 
 #include <libavutil/hwcontext.h>
 #include <libavutil/hwcontext_drm.h>
@@ -34,6 +35,12 @@
 # include <libplacebo/vulkan.h>
 #endif
 
+#if defined(PL_HAVE_D3D11)
+# define HAVE_LAV_D3D11
+# include <libavutil/hwcontext_d3d11va.h>
+# include <libplacebo/d3d11.h>
+#endif
+
 static inline enum pl_color_system pl_system_from_av(enum AVColorSpace spc)
 {
     switch (spc) {
@@ -474,6 +481,18 @@ misaligned:
     return planes;
 }
 
+static inline enum pl_packed_fmt pl_packed_fmt_from_av(enum AVPixelFormat pix_fmt)
+{
+    switch (pix_fmt) {
+    case AV_PIX_FMT_YUYV422: return PL_PACKED_YUYV;
+    case AV_PIX_FMT_UYVY422: return PL_PACKED_UYVY;
+#if LIBAVUTIL_VERSION_INT >= AV_VERSION_INT(56, 42, 100)
+    case AV_PIX_FMT_Y210LE:  return PL_PACKED_Y210;
+#endif
+    default:                 return PL_PACKED_NONE;
+    }
+}
+
 static inline bool pl_test_pixfmt(pl_gpu gpu,
                                   enum AVPixelFormat pixfmt)
 {
@@ -491,9 +510,17 @@ static inline bool pl_test_pixfmt(pl_gpu gpu,
         return pl_vulkan_get(gpu);
 #endif
 
+#ifdef HAVE_LAV_D3D11
+    case AV_PIX_FMT_D3D11:
+        return pl_d3d11_get(gpu);
+#endif
+
     default: break;
     }
 
+    if (pl_packed_fmt_from_av(pixfmt))
+        return pl_test_packed(gpu, pl_packed_fmt_from_av(pixfmt));
+
     planes = pl_plane_data_from_pixfmt(data, &bits, pixfmt);
     if (!planes)
         return false;
@@ -828,6 +855,7 @@ struct pl_avalloc {
     uint32_t magic[2];
     pl_gpu gpu;
     pl_buf buf;
+    pl_buf_pool pool; // if set, `buf` is returned here instead of destroyed
 };
 
 static void pl_fix_hwframe_sample_depth(struct pl_frame *out, const AVFrame *frame)
@@ -844,8 +872,14 @@ static void pl_fix_hwframe_sample_depth(struct pl_frame *out, const AVFrame *fra
     }
 }
 
+// Whether a mapped texture can be used as the target of the renderer
+static inline bool pl_avframe_tex_is_target(pl_tex tex)
+{
+    return tex->params.renderable || tex->params.storable;
+}
+
 static bool pl_map_avframe_drm(pl_gpu gpu, struct pl_frame *out,
-                               const AVFrame *frame)
+                               const AVFrame *frame, bool target)
 {
     const AVHWFramesContext *hwfc = (AVHWFramesContext *) frame->hw_frames_ctx->data;
     const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(hwfc->sw_format);
@@ -870,8 +904,11 @@ static bool pl_map_avframe_drm(pl_gpu gpu, struct pl_frame *out,
             .w = AV_CEIL_RSHIFT(frame->width, is_chroma ? desc->log2_chroma_w : 0),
             .h = AV_CEIL_RSHIFT(frame->height, is_chroma ? desc->log2_chroma_h : 0),
             .format = fmt,
-            .sampleable = true,
-            .blit_src = fmt->caps & PL_FMT_CAP_BLITTABLE,
+            .sampleable = !target,
+            .renderable = target && (fmt->caps & PL_FMT_CAP_RENDERABLE),
+            .storable = target && (fmt->caps & PL_FMT_CAP_STORABLE),
+            .blit_src = !target && (fmt->caps & PL_FMT_CAP_BLITTABLE),
+            .blit_dst = target && (fmt->caps & PL_FMT_CAP_BLITTABLE),
             .import_handle = PL_HANDLE_DMA_BUF,
             .shared_mem = {
                 .handle.fd = object->fd,
@@ -883,6 +920,8 @@ static bool pl_map_avframe_drm(pl_gpu gpu, struct pl_frame *out,
         ));
         if (!out->planes[n].texture)
             return false;
+        if (target && !pl_avframe_tex_is_target(out->planes[n].texture))
+            return false;
     }
 
     pl_fix_hwframe_sample_depth(out, frame);
@@ -891,9 +930,10 @@ static bool pl_map_avframe_drm(pl_gpu gpu, struct pl_frame *out,
 
 // Derive a DMABUF from any other hwaccel format, and map that instead
 static bool pl_map_avframe_derived(pl_gpu gpu, struct pl_frame *out,
-                                   const AVFrame *frame)
+                                   const AVFrame *frame, bool target)
 {
-    const int flags = AV_HWFRAME_MAP_READ | AV_HWFRAME_MAP_DIRECT;
+    const int flags = (target ? AV_HWFRAME_MAP_WRITE : AV_HWFRAME_MAP_READ) |
+                      AV_HWFRAME_MAP_DIRECT;
     AVFrame *derived = av_frame_alloc();
     derived->width = frame->width;
     derived->height = frame->height;
@@ -903,7 +943,7 @@ static bool pl_map_avframe_derived(pl_gpu gpu, struct pl_frame *out,
         goto error;
     if (av_frame_copy_props(derived, frame) < 0)
         goto error;
-    if (!pl_map_avframe_drm(gpu, out, derived))
+    if (!pl_map_avframe_drm(gpu, out, derived, target))
         goto error;
 
     av_frame_free((AVFrame **) &out->user_data);
@@ -915,6 +955,128 @@ error:
     return false;
 }
 
+struct pl_avframe_cache_entry {
+    const void *key;    // the `AVVkFrame` these textures wrap
+    pl_tex tex[4];
+    int num_planes;
+    int refs;           // number of currently mapped frames using this entry
+    bool orphaned;      // no longer part of any cache
+};
+
+static inline void pl_avframe_cache_entry_free(pl_gpu gpu,
+                                               struct pl_avframe_cache_entry *entry)
+{
+    for (int n = 0; n < entry->num_planes; n++)
+        pl_tex_destroy(gpu, &entry->tex[n]);
+    av_free(entry);
+}
+
+// Drops all entries, deferring the destruction of those still in use
+static inline void pl_avframe_cache_flush(pl_gpu gpu, struct pl_avframe_cache *cache)
+{
+    for (int i = 0; i < cache->num_entries; i++) {
+        struct pl_avframe_cache_entry *entry = cache->entries[i];
+        if (entry->refs) {
+            entry->orphaned = true;
+        } else {
+            pl_avframe_cache_entry_free(gpu, entry);
+        }
+    }
+
+    av_freep(&cache->entries);
+    cache->num_entries = 0;
+    av_buffer_unref(&cache->hw_frames_ctx);
+}
+
+// Refcounted wrapper around mapped Dolby Vision metadata, shared between
+// all frames with identical side data (when using a `pl_avframe_cache`)
+struct pl_avframe_dovi {
+    struct pl_dovi_metadata dovi; // must be the first member
+    int refs;
+    uint8_t *data; // copy of the raw side data this was mapped from
+    size_t size;
+};
+
+static inline void pl_avframe_dovi_unref(struct pl_avframe_dovi **pdovi)
+{
+    struct pl_avframe_dovi *dovi = *pdovi;
+    if (dovi && --dovi->refs == 0)
+        av_free(dovi);
+    *pdovi = NULL;
+}
+
+#ifdef PL_HAVE_LAV_DOLBY_VISION
+// Returns a new reference to the mapped metadata for `sd`, or NULL on OOM
+static inline struct pl_avframe_dovi *
+pl_avframe_dovi_get(struct pl_avframe_cache *cache, const AVFrameSideData *sd)
+{
+    struct pl_avframe_dovi *dovi = cache ? cache->dovi : NULL;
+    if (dovi && dovi->size == sd->size && !memcmp(dovi->data, sd->data, sd->size)) {
+        dovi->refs++;
+        return dovi;
+    }
+
+    size_t size = cache ? sd->size : 0;
+    dovi = av_malloc(sizeof(*dovi) + size);
+    if (!dovi)
+        return NULL;
+
+    pl_map_dovi_metadata(&dovi->dovi, (const AVDOVIMetadata *) sd->data);
+    dovi->refs = 1;
+    dovi->data = (uint8_t *) (dovi + 1);
+    dovi->size = size;
+    if (cache) {
+        memcpy(dovi->data, sd->data, size);
+        pl_avframe_dovi_unref(&cache->dovi);
+        cache->dovi = dovi;
+        dovi->refs++;
+    }
+
+    return dovi;
+}
+#endif
+
+static inline void pl_avframe_cache_uninit(pl_gpu gpu, struct pl_avframe_cache *cache)
+{
+    pl_avframe_cache_flush(gpu, cache);
+    pl_avframe_dovi_unref(&cache->dovi);
+}
+
+// Returns the (possibly empty) entry for `key`, or NULL on OOM
+static inline struct pl_avframe_cache_entry *
+pl_avframe_cache_get(pl_gpu gpu, struct pl_avframe_cache *cache,
+                     const AVFrame *frame, const void *key)
+{
+    // Images are only guaranteed to persist as long as their hwframes context
+    if (!cache->hw_frames_ctx || cache->hw_frames_ctx->data != frame->hw_frames_ctx->data) {
+        pl_avframe_cache_flush(gpu, cache);
+        cache->hw_frames_ctx = av_buffer_ref(frame->hw_frames_ctx);
+        if (!cache->hw_frames_ctx)
+            return NULL;
+    }
+
+    for (int i = 0; i < cache->num_entries; i++) {
+        if (cache->entries[i]->key == key)
+            return cache->entries[i];
+    }
+
+    struct pl_avframe_cache_entry *entry = av_mallocz(sizeof(*entry));
+    if (!entry)
+        return NULL;
+    entry->key = key;
+
+    void *entries = av_realloc_array(cache->entries, cache->num_entries + 1,
+                                     sizeof(*cache->entries));
+    if (!entries) {
+        av_free(entry);
+        return NULL;
+    }
+
+    cache->entries = entries;
+    cache->entries[cache->num_entries++] = entry;
+    return entry;
+}
+
 #ifdef HAVE_LAV_VULKAN
 static bool pl_acquire_avframe(pl_gpu gpu, struct pl_frame *frame)
 {
@@ -950,7 +1112,8 @@ static void pl_release_avframe(pl_gpu gpu, struct pl_frame *frame)
 }
 
 static bool pl_map_avframe_vulkan(pl_gpu gpu, struct pl_frame *out,
-                                  const AVFrame *frame)
+                                  const AVFrame *frame, bool target,
+                                  struct pl_avframe_cache *cache)
 {
     const AVHWFramesContext *hwfc = (AVHWFramesContext *) frame->hw_frames_ctx->data;
     const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(hwfc->sw_format);
@@ -962,6 +1125,23 @@ static bool pl_map_avframe_vulkan(pl_gpu gpu, struct pl_frame *out,
     if (!vk)
         return false;
 
+    struct pl_avframe_cache_entry *entry = NULL;
+    if (cache) {
+        entry = pl_avframe_cache_get(gpu, cache, frame, vkf);
+        if (!entry)
+            return false;
+        if (entry->num_planes) {
+            assert(entry->num_planes == out->num_planes);
+            entry->refs++; // dropped again by `pl_unmap_avframe` on failure
+            for (int n = 0; n < out->num_planes; n++) {
+                out->planes[n].texture = entry->tex[n];
+                if (target && !pl_avframe_tex_is_target(entry->tex[n]))
+                    return false;
+            }
+            goto done;
+        }
+    }
+
     for (int n = 0; n < out->num_planes; n++) {
         struct pl_plane *plane = &out->planes[n];
         bool chroma = n == 1 || n == 2;
@@ -971,21 +1151,101 @@ static bool pl_map_avframe_vulkan(pl_gpu gpu, struct pl_frame *out,
             .height = AV_CEIL_RSHIFT(frame->height, chroma ? desc->log2_chroma_h : 0),
             .format = vk_fmt[n],
             .usage = vkfc->usage,
+            .user_data = entry,
         ));
         if (!plane->texture)
-            return false;
+            goto error;
+        if (entry)
+            entry->tex[entry->num_planes++] = plane->texture;
+        if (target && !pl_avframe_tex_is_target(plane->texture))
+            goto error;
     }
 
+    if (entry)
+        entry->refs++;
+
+done:
     out->acquire = pl_acquire_avframe;
     out->release = pl_release_avframe;
     pl_fix_hwframe_sample_depth(out, frame);
     return true;
+
+error:
+    // Don't leave partially initialized entries in the cache
+    if (entry) {
+        for (int n = 0; n < entry->num_planes; n++) {
+            pl_tex_destroy(gpu, &entry->tex[n]);
+            out->planes[n].texture = NULL;
+        }
+        entry->num_planes = 0;
+    }
+    return false;
 }
 
 static void pl_unmap_avframe_vulkan(pl_gpu gpu, struct pl_frame *frame)
 {
+    pl_tex tex0 = frame->planes[0].texture;
+    struct pl_avframe_cache_entry *entry = tex0 ? tex0->params.user_data : NULL;
+    if (!entry) {
+        for (int n = 0; n < frame->num_planes; n++)
+            pl_tex_destroy(gpu, &frame->planes[n].texture);
+        return;
+    }
+
+    // Cached textures are owned by the cache, so just drop our reference
     for (int n = 0; n < frame->num_planes; n++)
-        pl_tex_destroy(gpu, &frame->planes[n].texture);
+        frame->planes[n].texture = NULL;
+    if (entry->refs > 0)
+        entry->refs--;
+    if (!entry->refs && entry->orphaned)
+        pl_avframe_cache_entry_free(gpu, entry);
+}
+#endif
+
+#ifdef HAVE_LAV_D3D11
+static bool pl_map_avframe_d3d11(pl_gpu gpu, struct pl_frame *out,
+                                 const AVFrame *frame, bool target)
+{
+    const AVHWFramesContext *hwfc = (AVHWFramesContext *) frame->hw_frames_ctx->data;
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(hwfc->sw_format);
+    ID3D11Texture2D *tex = (ID3D11Texture2D *) frame->data[0];
+    DXGI_FORMAT fmts[2];
+    assert(frame->format == AV_PIX_FMT_D3D11);
+    if (!pl_d3d11_get(gpu))
+        return false;
+
+    // Each plane of a video texture is wrapped using its own view format
+    switch (hwfc->sw_format) {
+    case AV_PIX_FMT_NV12:
+        fmts[0] = DXGI_FORMAT_R8_UNORM;
+        fmts[1] = DXGI_FORMAT_R8G8_UNORM;
+        break;
+    case AV_PIX_FMT_P010:
+        fmts[0] = DXGI_FORMAT_R16_UNORM;
+        fmts[1] = DXGI_FORMAT_R16G16_UNORM;
+        break;
+    default:
+        return false;
+    }
+
+    assert(out->num_planes == 2);
+    for (int n = 0; n < out->num_planes; n++) {
+        struct pl_plane *plane = &out->planes[n];
+        plane->texture = pl_d3d11_wrap(gpu, pl_d3d11_wrap_params(
+            .tex = (ID3D11Resource *) tex,
+            .array_slice = (intptr_t) frame->data[1],
+            .fmt = fmts[n],
+            .w = AV_CEIL_RSHIFT(frame->width, n ? desc->log2_chroma_w : 0),
+            .h = AV_CEIL_RSHIFT(frame->height, n ? desc->log2_chroma_h : 0),
+        ));
+        if (!plane->texture)
+            return false;
+        if (target && !pl_avframe_tex_is_target(plane->texture))
+            return false;
+    }
+
+    pl_fix_hwframe_sample_depth(out, frame);
+    return true;
 }
 #endif
 
@@ -1010,12 +1270,11 @@ static inline bool pl_map_avframe_internal(pl_gpu gpu, struct pl_frame *out,
         if (sd) {
             const AVDOVIMetadata *metadata = (AVDOVIMetadata *) sd->data;
             const AVDOVIColorMetadata *color = av_dovi_get_color(metadata);
-            struct pl_dovi_metadata *dovi = malloc(sizeof(*dovi));
+            struct pl_avframe_dovi *dovi = pl_avframe_dovi_get(params->cache, sd);
             if (!dovi)
                 goto error; // oom
 
-            pl_map_dovi_metadata(dovi, metadata);
-            out->repr.dovi = dovi;
+            out->repr.dovi = &dovi->dovi;
             out->repr.sys = PL_COLOR_SYSTEM_DOLBYVISION;
             out->color.primaries = PL_COLOR_PRIM_BT_2020;
             out->color.transfer = PL_COLOR_TRC_PQ;
@@ -1029,18 +1288,25 @@ static inline bool pl_map_avframe_internal(pl_gpu gpu, struct pl_frame *out,
 
     switch (frame->format) {
     case AV_PIX_FMT_DRM_PRIME:
-        if (!pl_map_avframe_drm(gpu, out, frame))
+        if (!pl_map_avframe_drm(gpu, out, frame, false))
             goto error;
         return true;
 
     case AV_PIX_FMT_VAAPI:
-        if (!pl_map_avframe_derived(gpu, out, frame))
+        if (!pl_map_avframe_derived(gpu, out, frame, false))
             goto error;
         return true;
 
 #ifdef HAVE_LAV_VULKAN
     case AV_PIX_FMT_VULKAN:
-        if (!pl_map_avframe_vulkan(gpu, out, frame))
+        if (!pl_map_avframe_vulkan(gpu, out, frame, false, params->cache))
+            goto error;
+        return true;
+#endif
+
+#ifdef HAVE_LAV_D3D11
+    case AV_PIX_FMT_D3D11:
+        if (!pl_map_avframe_d3d11(gpu, out, frame, false))
             goto error;
         return true;
 #endif
@@ -1052,6 +1318,35 @@ static inline bool pl_map_avframe_internal(pl_gpu gpu, struct pl_frame *out,
     if (!tex)
         goto error;
 
+    if (pl_packed_fmt_from_av(frame->format)) {
+        struct pl_packed_data packed = {
+            .format = pl_packed_fmt_from_av(frame->format),
+            .width = frame->width,
+            .height = frame->height,
+            .pixels = frame->data[0],
+            .row_stride = frame->linesize[0],
+        };
+
+        bool flipped = frame->linesize[0] < 0;
+        if (flipped) {
+            packed.pixels = frame->data[0] + frame->linesize[0] * (frame->height - 1);
+            packed.row_stride = -frame->linesize[0];
+        }
+
+        // The packed data is copied before returning, so no need to keep
+        // the frame referenced for the duration of the upload
+        if (!pl_upload_packed(gpu, out->planes, tex, &out->repr.bits, &packed))
+            goto error;
+
+        out->num_planes = 2;
+        for (int p = 0; p < 2; p++) {
+            out->planes[p].shift_x = out->planes[p].shift_y = 0.0f;
+            out->planes[p].flipped = flipped;
+        }
+        pl_frame_set_chroma_location(out, pl_chroma_from_av(frame->chroma_location));
+        return true;
+    }
+
     planes = pl_plane_data_from_pixfmt(data, &out->repr.bits, frame->format);
     if (!planes)
         goto error;
@@ -1102,6 +1397,42 @@ static inline bool pl_map_avframe_ex(pl_gpu gpu, struct pl_frame *out_frame,
     return pl_map_avframe_internal(gpu, out_frame, params, true);
 }
 
+static inline bool pl_map_avframe_target(pl_gpu gpu, struct pl_frame *out_frame,
+                                         const AVFrame *frame)
+{
+    bool ok = false;
+
+    pl_frame_from_avframe(out_frame, frame);
+    out_frame->user_data = av_frame_clone(frame);
+    if (!out_frame->user_data)
+        goto done;
+
+    switch (frame->format) {
+    case AV_PIX_FMT_DRM_PRIME:
+        ok = pl_map_avframe_drm(gpu, out_frame, frame, true);
+        break;
+    case AV_PIX_FMT_VAAPI:
+        ok = pl_map_avframe_derived(gpu, out_frame, frame, true);
+        break;
+#ifdef HAVE_LAV_VULKAN
+    case AV_PIX_FMT_VULKAN:
+        ok = pl_map_avframe_vulkan(gpu, out_frame, frame, true, NULL);
+        break;
+#endif
+#ifdef HAVE_LAV_D3D11
+    case AV_PIX_FMT_D3D11:
+        ok = pl_map_avframe_d3d11(gpu, out_frame, frame, true);
+        break;
+#endif
+    default: break;
+    }
+
+done:
+    if (!ok)
+        pl_unmap_avframe(gpu, out_frame);
+    return ok;
+}
+
 static inline void pl_unmap_avframe(pl_gpu gpu, struct pl_frame *frame)
 {
     AVFrame *avframe = frame->user_data;
@@ -1123,6 +1454,11 @@ static inline void pl_unmap_avframe(pl_gpu gpu, struct pl_frame *frame)
     av_frame_free(&avframe);
 
 done:
+    if (frame->repr.dovi) {
+        // Only ever set by `pl_map_avframe_ex`, see `pl_avframe_dovi_get`
+        struct pl_avframe_dovi *dovi = (struct pl_avframe_dovi *) frame->repr.dovi;
+        pl_avframe_dovi_unref(&dovi);
+    }
     memset(frame, 0, sizeof(*frame)); // sanity
 }
 
@@ -1189,11 +1525,16 @@ static inline void pl_avalloc_free(void *opaque, uint8_t *data)
     assert(alloc->magic[0] == PL_MAGIC0);
     assert(alloc->magic[1] == PL_MAGIC1);
     assert(alloc->buf->data == data);
-    pl_buf_destroy(alloc->gpu, &alloc->buf);
+    if (alloc->pool) {
+        pl_buf_pool_put(alloc->pool, &alloc->buf);
+    } else {
+        pl_buf_destroy(alloc->gpu, &alloc->buf);
+    }
     free(alloc);
 }
 
-static inline int pl_get_buffer2(AVCodecContext *avctx, AVFrame *pic, int flags)
+static inline int pl_get_buffer2_internal(AVCodecContext *avctx, AVFrame *pic,
+                                          int flags, pl_gpu gpu, pl_buf_pool pool)
 {
     int alignment[AV_NUM_DATA_POINTERS];
     int width = pic->width;
@@ -1201,8 +1542,6 @@ static inline int pl_get_buffer2(AVCodecContext *avctx, AVFrame *pic, int flags)
     size_t planesize[4];
     int ret = 0;
 
-    pl_gpu *pgpu = avctx->opaque;
-    pl_gpu gpu = pgpu ? *pgpu : NULL;
     struct pl_plane_data data[4];
     struct pl_avalloc *alloc;
     int planes = pl_plane_data_from_pixfmt(data, NULL, pic->format);
@@ -1260,12 +1599,18 @@ static inline int pl_get_buffer2(AVCodecContext *avctx, AVFrame *pic, int flags)
         *alloc = (struct pl_avalloc) {
             .magic = { PL_MAGIC0, PL_MAGIC1 },
             .gpu = gpu,
-            .buf = pl_buf_create(gpu, pl_buf_params(
+            .pool = pool,
+        };
+
+        if (pool) {
+            alloc->buf = pl_buf_pool_get(pool, buf_size);
+        } else {
+            alloc->buf = pl_buf_create(gpu, pl_buf_params(
                 .size = buf_size,
                 .memory_type = PL_BUF_MEM_HOST,
                 .host_mapped = true,
-            )),
-        };
+            ));
+        }
 
         if (!alloc->buf) {
             free(alloc);
@@ -1276,8 +1621,12 @@ static inline int pl_get_buffer2(AVCodecContext *avctx, AVFrame *pic, int flags)
         pic->data[p] = (uint8_t *) PL_ALIGN2((uintptr_t) alloc->buf->data, alignment[p]);
         pic->buf[p] = av_buffer_create(alloc->buf->data, buf_size, pl_avalloc_free, alloc, 0);
         if (!pic->buf[p]) {
+            if (pool) {
+                pl_buf_pool_put(pool, &alloc->buf);
+            } else {
+                pl_buf_destroy(gpu, &alloc->buf);
+            }
             free(alloc);
-            pl_buf_destroy(gpu, &alloc->buf);
             av_frame_unref(pic);
             return AVERROR(ENOMEM);
         }
@@ -1289,6 +1638,221 @@ fallback:
     return avcodec_default_get_buffer2(avctx, pic, flags);
 }
 
+static inline int pl_get_buffer2(AVCodecContext *avctx, AVFrame *pic, int flags)
+{
+    pl_gpu *pgpu = avctx->opaque;
+    pl_gpu gpu = pgpu ? *pgpu : NULL;
+    return pl_get_buffer2_internal(avctx, pic, flags, gpu, NULL);
+}
+
+static inline int pl_get_buffer2_pooled(AVCodecContext *avctx, AVFrame *pic, int flags)
+{
+    pl_buf_pool *ppool = avctx->opaque;
+    pl_buf_pool pool = ppool ? *ppool : NULL;
+    pl_gpu gpu = pool ? pl_buf_pool_gpu(pool) : NULL;
+    return pl_get_buffer2_internal(avctx, pic, flags, gpu, pool);
+}
+
+#ifdef PL_HAVE_LAV_DOWNLOAD_PIPELINE
+
+struct pl_avdownload_entry {
+    AVFrame *frame;
+    pl_buf buf;
+};
+
+struct pl_avdownload_t {
+    struct pl_avdownload_params params;
+    bool sync; // fall back to `pl_download_avframe`
+    AVBufferPool *pool;
+    size_t pool_size;
+    struct pl_avdownload_entry *queue;
+    int head, num;
+};
+
+static inline pl_avdownload pl_avdownload_create(const struct pl_avdownload_params *params)
+{
+    pl_avdownload dl = calloc(1, sizeof(*dl));
+    if (!dl)
+        return NULL;
+
+    dl->params = *params;
+    dl->params.depth = PL_MAX(dl->params.depth, 0);
+    if (!dl->params.depth)
+        dl->params.depth = 4;
+
+    // Buffers may be released by the encoder from any thread
+    pl_gpu gpu = params->gpu;
+    dl->sync = !gpu->limits.thread_safe || !gpu->limits.max_mapped_size ||
+               !gpu->limits.buf_transfer;
+
+    dl->queue = calloc(dl->params.depth, sizeof(*dl->queue));
+    if (!dl->queue) {
+        free(dl);
+        return NULL;
+    }
+
+    return dl;
+}
+
+static inline AVBufferRef *pl_avdownload_alloc(void *opaque, size_t size)
+{
+    pl_gpu gpu = opaque;
+    struct pl_avalloc *alloc = malloc(sizeof(*alloc));
+    if (!alloc)
+        return NULL;
+
+    *alloc = (struct pl_avalloc) {
+        .magic = { PL_MAGIC0, PL_MAGIC1 },
+        .gpu = gpu,
+        .buf = pl_buf_create(gpu, pl_buf_params(
+            .size = size,
+            .memory_type = PL_BUF_MEM_HOST,
+            .host_mapped = true,
+            .host_readable = true,
+        )),
+    };
+
+    if (!alloc->buf) {
+        free(alloc);
+        return NULL;
+    }
+
+    AVBufferRef *ref = av_buffer_create(alloc->buf->data, size, pl_avalloc_free, alloc, 0);
+    if (!ref) {
+        pl_buf_destroy(gpu, &alloc->buf);
+        free(alloc);
+        return NULL;
+    }
+
+    return ref;
+}
+
+// Deliver completed frames, waiting for (at least) the oldest `num_wait`
+static inline void pl_avdownload_deliver(pl_avdownload dl, int num_wait)
+{
+    while (dl->num) {
+        struct pl_avdownload_entry *e = &dl->queue[dl->head];
+        uint64_t timeout = num_wait > 0 ? UINT64_MAX : 0;
+        if (pl_buf_poll(dl->params.gpu, e->buf, timeout))
+            break;
+
+        dl->head = (dl->head + 1) % dl->params.depth;
+        dl->num--;
+        num_wait--;
+        dl->params.frame_done(dl->params.priv, e->frame);
+        *e = (struct pl_avdownload_entry) {0};
+    }
+}
+
+static inline void pl_avdownload_poll(pl_avdownload dl, bool flush)
+{
+    pl_avdownload_deliver(dl, flush ? dl->num : 0);
+}
+
+static inline void pl_avdownload_destroy(pl_avdownload *pdl)
+{
+    pl_avdownload dl = *pdl;
+    if (!dl)
+        return;
+
+    pl_avdownload_poll(dl, true);
+    av_buffer_pool_uninit(&dl->pool); // deferred until all frames are freed
+    free(dl->queue);
+    free(dl);
+    *pdl = NULL;
+}
+
+static inline bool pl_avdownload_submit(pl_avdownload dl, const struct pl_frame *frame,
+                                        const AVFrame *props)
+{
+    pl_gpu gpu = dl->params.gpu;
+    if (frame->num_planes != av_pix_fmt_count_planes(props->format))
+        return false;
+
+    AVFrame *out = av_frame_alloc();
+    if (!out)
+        return false;
+    if (av_frame_copy_props(out, props) < 0)
+        goto error;
+    out->format = props->format;
+    out->width = props->width;
+    out->height = props->height;
+
+    if (dl->sync) {
+        if (av_frame_get_buffer(out, 0) < 0)
+            goto error;
+        if (!pl_download_avframe(gpu, frame, out))
+            goto error;
+        dl->params.frame_done(dl->params.priv, out);
+        return true;
+    }
+
+    // Lay out all planes contiguously in a single buffer, respecting the
+    // GPU's transfer alignment requirements
+    size_t offset[4], size = 0;
+    for (int p = 0; p < frame->num_planes; p++) {
+        pl_tex tex = frame->planes[p].texture;
+        size_t texel = tex->params.format->texel_size;
+        size_t pitch_align = PL_MAX(gpu->limits.align_tex_xfer_pitch, 1) * texel;
+        size_t offset_align = PL_MAX(gpu->limits.align_tex_xfer_offset, 1) * texel;
+        size_t pitch = (tex->params.w * texel + pitch_align - 1) / pitch_align * pitch_align;
+        if (pitch > INT_MAX)
+            goto error;
+
+        offset[p] = (size + offset_align - 1) / offset_align * offset_align;
+        out->linesize[p] = pitch;
+        size = offset[p] + pitch * PL_MAX(tex->params.h, 1);
+    }
+
+    if (size > gpu->limits.max_mapped_size)
+        goto error;
+
+    if (!dl->pool || dl->pool_size != size) {
+        av_buffer_pool_uninit(&dl->pool);
+        dl->pool = av_buffer_pool_init2(size, (void *) gpu, pl_avdownload_alloc, NULL);
+        dl->pool_size = size;
+        if (!dl->pool)
+            goto error;
+    }
+
+    out->buf[0] = av_buffer_pool_get(dl->pool);
+    if (!out->buf[0])
+        goto error;
+
+    struct pl_avalloc *alloc = av_buffer_pool_buffer_get_opaque(out->buf[0]);
+    assert(alloc->magic[0] == PL_MAGIC0);
+    assert(alloc->magic[1] == PL_MAGIC1);
+
+    for (int p = 0; p < frame->num_planes; p++) {
+        out->data[p] = out->buf[0]->data + offset[p];
+        bool ok = pl_tex_download(gpu, pl_tex_transfer_params(
+            .tex = frame->planes[p].texture,
+            .row_pitch = out->linesize[p],
+            .buf = alloc->buf,
+            .buf_offset = offset[p],
+        ));
+
+        if (!ok)
+            goto error;
+    }
+
+    // Make room for this frame, then queue it up
+    pl_gpu_flush(gpu);
+    pl_avdownload_deliver(dl, dl->num - dl->params.depth + 1);
+    dl->queue[(dl->head + dl->num++) % dl->params.depth] = (struct pl_avdownload_entry) {
+        .frame = out,
+        .buf = alloc->buf,
+    };
+
+    return true;
+
+error:
+    av_frame_free(&out);
+    return false;
+}
+
+#endif // PL_HAVE_LAV_DOWNLOAD_PIPELINE
+
 #undef PL_MAGIC0
 #undef PL_MAGIC1
 #undef PL_ALIGN
@@ -56,6 +56,16 @@ struct pl_plane_data {
     void (*callback)(void *priv);
     void *priv;
 
+    // If true, the user guarantees that the memory backing `pixels` stays
+    // allocated until it is explicitly released with `pl_upload_forget`, for
+    // example because it belongs to a persistent decoder frame pool. On GPUs
+    // supporting host pointer imports (`PL_HANDLE_HOST_PTR`), this allows the
+    // memory to be imported once, cached by address range, and uploaded from
+    // directly on subsequent uploads. Only takes effect for asynchronous
+    // uploads (i.e. with `callback` set), since synchronous uploads require
+    // copying the data regardless. (Optional)
+    bool pixels_persistent;
+
     // Note: When using this together with `pl_frame`, there is some amount of
     // overlap between `component_pad` and `pl_color_repr.bits`. Some key
     // differences between the two:
@@ -129,6 +139,117 @@ pl_fmt pl_plane_find_fmt(pl_gpu gpu, int out_map[4], const struct pl_plane_data
 bool pl_upload_plane(pl_gpu gpu, struct pl_plane *out_plane,
                      pl_tex *tex, const struct pl_plane_data *data);
 
+// Release any cached host pointer imports overlapping the given memory range,
+// as created by uploads with `pl_plane_data.pixels_persistent`. This must be
+// called before freeing (or unmapping) such memory. As with any asynchronous
+// upload, the memory must additionally not be freed before the `callback` of
+// every upload from it has fired.
+void pl_upload_forget(pl_gpu gpu, const void *pixels, size_t size);
+
+// Thread-safe pool of transient buffers. Idle buffers are keyed on their
+// parameters, and only handed out again once the GPU is done using them, as
+// determined by `pl_buf_poll`. By default, this hands out host-mapped buffers
+// (`PL_BUF_MEM_HOST`, `host_mapped`), intended for decoders writing frames
+// directly into GPU-visible memory, and uploading from there (e.g.
+// `pl_get_buffer2_pooled`).
+//
+// Thread-safety: Safe
+typedef PL_STRUCT(pl_buf_pool) *pl_buf_pool;
+
+struct pl_buf_pool_params {
+    // Maximum number of idle buffers to keep around for reuse. When this
+    // limit is exceeded, the least recently returned buffers are destroyed.
+    // (Default: 64)
+    int max_idle;
+
+    // If nonzero, caps the total size of all buffers allocated by this pool,
+    // whether idle or handed out, in bytes. When a new buffer would exceed
+    // this limit, idle buffers are destroyed to make room, and if that's not
+    // enough, `pl_buf_pool_get` fails instead.
+    size_t max_bytes;
+};
+
+#define pl_buf_pool_params(...) (&(struct pl_buf_pool_params) { __VA_ARGS__ })
+
+// Create a new, empty buffer pool. `params` may be NULL.
+pl_buf_pool pl_buf_pool_create(pl_gpu gpu, const struct pl_buf_pool_params *params);
+
+// Destroy a buffer pool, along with all idle buffers. Buffers currently handed
+// out may still be returned afterwards, in which case they're destroyed
+// directly. The `pl_gpu` must outlive all such buffers.
+void pl_buf_pool_destroy(pl_buf_pool *pool);
+
+// Returns the GPU that this pool allocates buffers from.
+pl_gpu pl_buf_pool_gpu(pl_buf_pool pool);
+
+// Get a buffer of exactly `size` bytes, reusing an idle buffer if possible.
+// Returns NULL on failure, including when `max_bytes` would be exceeded.
+pl_buf pl_buf_pool_get(pl_buf_pool pool, size_t size);
+
+// Like `pl_buf_pool_get`, but for arbitrary buffer parameters. Idle buffers
+// are reused if they have exactly the requested size, the same `export_handle`
+// and a superset of the requested capabilities (as with `pl_buf_recreate`).
+// `initial_data` and `import_handle` are not supported.
+//
+// Note: Reused buffers retain the `user_data` and `debug_tag` they were
+// originally created with.
+pl_buf pl_buf_pool_get_ex(pl_buf_pool pool, const struct pl_buf_params *params);
+
+// Return a buffer obtained from `pl_buf_pool_get` to the pool. Any pending
+// GPU operations using this buffer may still be in flight. Sets `*buf` to
+// NULL.
+void pl_buf_pool_put(pl_buf_pool pool, pl_buf *buf);
+
+// Thread-safe pool of transient textures, e.g. for intermediate results of
+// pre- or post-processing passes, following the same rules as `pl_buf_pool`.
+// Idle textures are only handed out again once `pl_tex_poll` reports them as
+// no longer in use by the GPU.
+//
+// Thread-safety: Safe
+typedef PL_STRUCT(pl_tex_pool) *pl_tex_pool;
+
+struct pl_tex_pool_params {
+    // Maximum number of idle textures to keep around for reuse. When this
+    // limit is exceeded, the least recently returned textures are destroyed.
+    // (Default: 64)
+    int max_idle;
+
+    // If nonzero, caps the total (estimated) size of all textures allocated
+    // by this pool, whether idle or handed out, in bytes. When a new texture
+    // would exceed this limit, idle textures are destroyed to make room, and
+    // if that's not enough, `pl_tex_pool_get` fails instead.
+    size_t max_bytes;
+};
+
+#define pl_tex_pool_params(...) (&(struct pl_tex_pool_params) { __VA_ARGS__ })
+
+// Create a new, empty texture pool. `params` may be NULL.
+pl_tex_pool pl_tex_pool_create(pl_gpu gpu, const struct pl_tex_pool_params *params);
+
+// Destroy a texture pool, along with all idle textures. Textures currently
+// handed out may still be returned afterwards, in which case they're destroyed
+// directly. The `pl_gpu` must outlive all such textures.
+void pl_tex_pool_destroy(pl_tex_pool *pool);
+
+// Returns the GPU that this pool allocates textures from.
+pl_gpu pl_tex_pool_gpu(pl_tex_pool pool);
+
+// Get a texture matching `params`, reusing an idle texture if possible. Idle
+// textures are reused if they have the same size, format and `export_handle`,
+// and a superset of the requested capabilities (as with `pl_tex_recreate`).
+// The contents of the returned texture are undefined. `initial_data` and
+// `import_handle` are not supported. Returns NULL on failure, including when
+// `max_bytes` would be exceeded.
+//
+// Note: Reused textures retain the `user_data` and `debug_tag` they were
+// originally created with.
+pl_tex pl_tex_pool_get(pl_tex_pool pool, const struct pl_tex_params *params);
+
+// Return a texture obtained from `pl_tex_pool_get` to the pool. Any pending
+// GPU operations using this texture may still be in flight. Sets `*tex` to
+// NULL.
+void pl_tex_pool_put(pl_tex_pool pool, pl_tex *tex);
+
 // Like `pl_upload_plane`, but only creates an uninitialized texture object
 // rather than actually performing an upload. This can be useful to, for
 // example, prepare textures to be used as the target of rendering.
@@ -139,6 +260,59 @@ bool pl_upload_plane(pl_gpu gpu, struct pl_plane *out_plane,
 bool pl_recreate_plane(pl_gpu gpu, struct pl_plane *out_plane,
                        pl_tex *tex, const struct pl_plane_data *data);
 
+// Packed 4:2:2 YCbCr formats, which can't be described by `pl_plane_data`
+// because luma and chroma samples are interleaved at different rates (and, in
+// the case of v210, share words of memory). These are uploaded as raw data
+// and unpacked into separate planes on the GPU, using a compute shader.
+enum pl_packed_fmt {
+    PL_PACKED_NONE = 0,
+    PL_PACKED_YUYV,         // 8-bit, bytes in order Y0 Cb Y1 Cr
+    PL_PACKED_UYVY,         // 8-bit, bytes in order Cb Y0 Cr Y1
+    PL_PACKED_Y210,         // 10-bit in the high bits of 16-bit LE words,
+                            // in order Y0 Cb Y1 Cr
+    PL_PACKED_V210,         // 10-bit, 6 pixels packed into 4 LE 32-bit words
+    PL_PACKED_FMT_COUNT,
+};
+
+// Description of the host representation of a packed image
+struct pl_packed_data {
+    enum pl_packed_fmt format;
+    int width, height;      // dimensions of the image, in luma samples
+    size_t row_stride;      // offset in bytes between rows (optional), must
+                            // be a multiple of 4
+
+    // As with `pl_plane_data`, exactly one of these must be set.
+    //
+    // 1. Uploading from host memory. The data is copied into an internal
+    //    staging buffer, and may be freed as soon as `pl_upload_packed`
+    //    returns.
+    const void *pixels;
+
+    // 2. Unpacking directly from a buffer, which must be `storable`. Since
+    //    this buffer is read asynchronously, users should use `pl_buf_poll`
+    //    to find out when it may be reused.
+    pl_buf buf;
+    size_t buf_offset;      // must be a multiple of 4
+};
+
+// Returns whether `pl_upload_packed` is supported for a given format. This
+// requires compute shaders with GLSL 1.30 or newer, storage buffers, as well as storable 8-bit (or 16-bit, for 10-bit
+// formats) texture formats with one and two components.
+bool pl_test_packed(pl_gpu gpu, enum pl_packed_fmt format);
+
+// Upload a packed image and unpack it into two planes: a luma plane at full
+// resolution (`out_planes[0]`) and a chroma plane with interleaved Cb/Cr
+// samples at half the horizontal resolution (`out_planes[1]`). `tex` must be
+// a valid pointer to an array of two textures (or NULL), which are
+// (re)created as needed. The bit encoding of the resulting samples is written
+// to `out_bits` (optional). Returns whether successful.
+//
+// Note: As with `pl_upload_plane`, `shift_x/y` and `flipped` of the resulting
+// planes are left uninitialized, and should be set explicitly by the user.
+bool pl_upload_packed(pl_gpu gpu, struct pl_plane out_planes[2], pl_tex tex[2],
+                      struct pl_bit_encoding *out_bits,
+                      const struct pl_packed_data *data);
+
 PL_API_END
 
 #endif // LIBPLACEBO_UPLOAD_H_
@@ -187,7 +187,9 @@ struct pl_vulkan_params {
 
     // When choosing the device, only choose a device with this exact UUID.
     // This overrides `allow_software` and `device_name`. No effect if `device`
-    // is set.
+    // is set. Since this stops probing as soon as the device is found, it's
+    // also the cheapest way of re-opening a previously chosen device, e.g. by
+    // remembering its `pl_gpu.uuid` across runs.
     uint8_t device_uuid[16];
 
     // When choosing the device, controls whether or not to also allow software
@@ -234,6 +236,24 @@ struct pl_vulkan_params {
     // VkPhysicalDeviceVulkan11Features is not allowed.
     const VkPhysicalDeviceFeatures2 *features;
 
+    // Keep device memory allocations below this fraction of each memory
+    // heap's budget, as reported by VK_EXT_memory_budget (or the heap size,
+    // if unsupported). When an allocation would exceed it, libplacebo first
+    // releases internally cached resources, and then falls back to other
+    // compatible heaps, before exceeding the budget as a last resort. If left
+    // as 0, defaults to 0.9.
+    float max_budget_usage;
+
+    // Small buffers that are frequently rewritten by the host, such as
+    // uniform buffers and upload staging buffers, are placed directly in
+    // device-local, host-visible memory where available (e.g. the PCIe BAR
+    // window, all of VRAM with Resizable BAR, or any memory on integrated
+    // GPUs). This limits the total amount of such memory used, in bytes, so
+    // as not to exhaust a small BAR window. If left as 0, defaults to 1/4 of
+    // the heap size (up to 256 MiB) on discrete GPUs, and is unlimited on
+    // integrated GPUs.
+    size_t max_bar_usage;
+
     // --- Misc/debugging options
 
     // Restrict specific features to e.g. work around driver bugs, or simply
@@ -314,9 +334,11 @@ struct pl_vulkan_swapchain_params {
     // this parameter if called.
     bool prefer_hdr PL_DEPRECATED;
 
-    // The preferred presentation mode. See the vulkan documentation for more
-    // information about these. If the device/surface combination does not
-    // support this mode, libplacebo will fall back to VK_PRESENT_MODE_FIFO_KHR.
+    // The preferred (initial) presentation mode. See the vulkan documentation
+    // for more information about these. If the device/surface combination does
+    // not support this mode, libplacebo will fall back to
+    // VK_PRESENT_MODE_FIFO_KHR. Can be changed later on with
+    // `pl_vulkan_swapchain_set_present_mode`.
     //
     // Warning: Leaving this zero-initialized is the same as having specified
     // VK_PRESENT_MODE_IMMEDIATE_KHR, which is probably not what the user
@@ -326,10 +348,10 @@ struct pl_vulkan_swapchain_params {
     // Allow up to N in-flight frames. This essentially controls how many
     // rendering commands may be queued up at the same time. See the
     // documentation for `pl_swapchain_get_latency` for more information. For
-    // vulkan specifically, we are only able to wait until the GPU has finished
-    // rendering a frame - we are unable to wait until the display has actually
-    // finished displaying it. So this only provides a rough guideline.
-    // Optional, defaults to 3.
+    // vulkan specifically, we are normally only able to wait until the GPU has
+    // finished rendering a frame - we are unable to wait until the display has
+    // actually finished displaying it (see `wait_present`). So this only
+    // provides a rough guideline. Optional, defaults to 3.
     int swapchain_depth;
 
     // This suppresses automatic recreation of the swapchain when any call
@@ -339,6 +361,22 @@ struct pl_vulkan_swapchain_params {
     // calling `pl_swapchain_resize` as appropriate. libplacebo will tolerate
     // the "suboptimal" status indefinitely.
     bool allow_suboptimal;
+
+    // If enabled, `pl_swapchain_swap_buffers` additionally blocks until the
+    // frame submitted `swapchain_depth - 1` frames ago has actually been
+    // presented on-screen, rather than merely rendered. This gives far more
+    // predictable (and lower) latency, at the cost of GPU utilization.
+    // Requires VK_KHR_present_wait, and is ignored otherwise.
+    bool wait_present;
+
+    // If enabled, `swapchain_depth` only acts as an upper bound, and the
+    // number of frames allowed in flight is adjusted dynamically based on the
+    // measured render times and frame intervals. Latency is reduced (down to
+    // a single frame) while frames render comfortably within a vsync, and
+    // buffering is increased again as soon as render times become jittery or
+    // a vsync is missed. `pl_swapchain_latency` reflects the current limit.
+    // Most useful with VK_PRESENT_MODE_FIFO_KHR.
+    bool adaptive_latency;
 };
 
 #define pl_vulkan_swapchain_params(...) (&(struct pl_vulkan_swapchain_params) { __VA_ARGS__ })
@@ -355,6 +393,53 @@ pl_swapchain pl_vulkan_create_swapchain(pl_vulkan vk,
 // who have `params->allow_suboptimal` enabled.
 bool pl_vulkan_swapchain_suboptimal(pl_swapchain sw);
 
+// Switches the presentation mode of the swapchain at runtime, e.g. between
+// VK_PRESENT_MODE_FIFO_KHR for smooth playback and VK_PRESENT_MODE_MAILBOX_KHR
+// for low-latency interaction. If VK_EXT_swapchain_maintenance1 is supported
+// and the surface reports the two modes as compatible, this takes effect on
+// the very next present, without recreating the swapchain. Otherwise, the
+// swapchain is transparently recreated on the next `pl_swapchain_start_frame`.
+//
+// Returns false (leaving the current mode in place) if the mode is not
+// supported by the device/surface combination.
+bool pl_vulkan_swapchain_set_present_mode(pl_swapchain sw, VkPresentModeKHR mode);
+
+// Returns the present ID of the most recently submitted frame, or 0 if
+// neither VK_KHR_present_id nor VK_GOOGLE_display_timing is supported. IDs
+// start at 1 and increase by one for every frame submitted to this swapchain.
+uint64_t pl_vulkan_swapchain_present_id(pl_swapchain sw);
+
+// Blocks until the frame with the given present ID (or any later frame) has
+// been presented, or until `timeout` (in nanoseconds) has elapsed. Returns
+// false on timeout or error, and also if VK_KHR_present_wait is unsupported,
+// in which case this returns immediately. Note that presentation may never
+// complete for e.g. hidden windows, so a finite timeout is recommended.
+//
+// This can be used to wait for a specific earlier frame before starting
+// rendering of the next one, to keep input latency to a minimum.
+bool pl_vulkan_swapchain_wait_present(pl_swapchain sw, uint64_t present_id,
+                                      uint64_t timeout);
+
+struct pl_vulkan_present_timing {
+    uint64_t present_id;        // present ID of the frame, see above
+    uint64_t desired_time;      // requested presentation time (or 0)
+    uint64_t actual_time;       // time the frame was actually presented
+    uint64_t earliest_time;     // earliest time the frame could have been
+                                // presented, if shown on a different vsync
+    uint64_t refresh_duration;  // duration of a display refresh cycle
+};
+
+// Retrieves the timing information of the most recently presented frame, as
+// reported by VK_GOOGLE_display_timing. All times are in nanoseconds, in the
+// time domain of the presentation engine (typically CLOCK_MONOTONIC). Returns
+// false if this extension is unavailable or no frame has been presented yet.
+//
+// Clients using `pl_queue` can derive `pl_queue_params.pts` from successive
+// `actual_time` values and pass `refresh_duration` as the vsync duration
+// hint, for exact vsync estimation.
+bool pl_vulkan_swapchain_present_timing(pl_swapchain sw,
+                                        struct pl_vulkan_present_timing *out);
+
 // Vulkan interop API, for sharing a single VkDevice (and associated vulkan
 // resources) directly with the API user. The use of this API is a bit sketchy
 // and requires careful communication of Vulkan API state.
@@ -408,6 +493,13 @@ struct pl_vulkan_import_params {
     void (*unlock_queue)(void *ctx, int qf, int qidx);
     void *queue_ctx;
 
+    // See `pl_vulkan_params.max_budget_usage`. To make use of the driver's
+    // budget, VK_EXT_memory_budget must be enabled on the imported device.
+    float max_budget_usage;
+
+    // See `pl_vulkan_params.max_bar_usage`.
+    size_t max_bar_usage;
+
     // --- Misc/debugging options
 
     // Restrict specific features to e.g. work around driver bugs, or simply
@@ -542,6 +634,76 @@ bool pl_vulkan_hold_raw(pl_gpu gpu, pl_tex tex, VkImageLayout *layout,
 void pl_vulkan_release(pl_gpu gpu, pl_tex tex, VkImageLayout layout,
                        pl_vulkan_sem sem_in);
 
+struct pl_vulkan_heap_stats {
+    VkMemoryHeapFlags flags;    // as reported by the device
+    uint64_t size;              // total size of the heap
+    uint64_t budget;            // memory budget for this process
+    uint64_t usage;             // estimated current usage by this process
+    uint64_t allocated;         // memory allocated by libplacebo itself
+};
+
+// Returns memory usage statistics for each memory heap of the device, which
+// are written to `out`. Without VK_EXT_memory_budget, `budget` is the heap
+// size, and `usage` only accounts for memory allocated by libplacebo. Returns
+// the number of heaps, or 0 for non-Vulkan GPUs.
+//
+// Note: Users concerned about memory pressure may want to react to this by
+// e.g. releasing renderer caches with `pl_renderer_flush_cache`, which
+// libplacebo can't release on its own.
+int pl_vulkan_heap_stats(pl_gpu gpu, struct pl_vulkan_heap_stats out[VK_MAX_MEMORY_HEAPS]);
+
+// Serialize the device-wide pipeline cache, which holds the compiled
+// pipeline binaries of all passes created on this `pl_gpu`, into an opaque
+// buffer that can be e.g. saved to disk and loaded again later. Writes at
+// most `size` bytes to `out_cache`. Returns the number of bytes written, or
+// the size required to hold the entire cache if `out_cache` is NULL. Returns
+// 0 for non-Vulkan GPUs.
+//
+// Note: This complements `pl_dispatch_save`, which only stores the SPIR-V of
+// each pass. Sharing one cache between all passes lets the driver deduplicate
+// internal shader binaries, keeping the result much smaller than storing a
+// separate pipeline cache per pass.
+size_t pl_vulkan_save_pipeline_cache(pl_gpu gpu, uint8_t *out_cache, size_t size);
+
+// Load the result of a previous `pl_vulkan_save_pipeline_cache` call, merging
+// it into the device-wide pipeline cache. Data created by a different device
+// or driver version is ignored. This is safe to call from any thread at any
+// time, e.g. from a worker thread loading the cache file in the background,
+// but pipelines can only benefit from it for passes created afterwards.
+void pl_vulkan_load_pipeline_cache(pl_gpu gpu, const uint8_t *cache, size_t size);
+
+struct pl_vulkan_defrag_params {
+    // Memory slabs with less than this fraction of their size in use are
+    // evacuated, by migrating their buffers into denser slabs. (Default: 0.4)
+    float threshold;
+
+    // Maximum time to spend migrating buffers, in nanoseconds. This bounds
+    // the CPU time spent recording copies, not the GPU time needed to execute
+    // them. (Default: 1 ms)
+    uint64_t time_budget;
+};
+
+#define PL_VULKAN_DEFRAG_DEFAULTS   \
+    .threshold   = 0.4f,            \
+    .time_budget = 1000000,
+
+#define pl_vulkan_defrag_params(...) (&(struct pl_vulkan_defrag_params) { PL_VULKAN_DEFRAG_DEFAULTS __VA_ARGS__ })
+
+// Compacts sparsely used device memory by moving idle buffers out of slabs
+// that fall below the efficiency threshold, using GPU copies. Evacuated slabs
+// are excluded from new allocations, and released by the regular garbage
+// collection in `pl_gpu_flush` once empty. This is intended to be called
+// during idle time, e.g. once per frame, to reclaim memory after long
+// uptimes with changing allocation patterns. Returns the number of buffers
+// migrated. Does nothing for non-Vulkan GPUs.
+//
+// Note: Only buffers whose memory is not visible to the user (i.e. not
+// host-mapped, imported or exported) are ever moved. Textures are not moved.
+//
+// Note: Unlike most other functions, this is not thread-safe with respect
+// to concurrent use of any `pl_buf` belonging to `gpu`.
+int pl_vulkan_defragment(pl_gpu gpu, const struct pl_vulkan_defrag_params *params);
+
 PL_API_END
 
 #endif // LIBPLACEBO_VULKAN_H_
@@ -21,13 +21,73 @@
 #include "common.h"
 #include "log.h"
 #include "pl_thread.h"
+#include "pl_thread_pool.h"
+
+// Pre-formatted message, for asynchronous logging. Messages longer than
+// `buf` are formatted into a separate heap allocation instead.
+#define LOG_SLOT_SIZE 256
+
+struct log_slot {
+    // Bounded multi-producer queue, after Dmitry Vyukov's MPMC design: the
+    // slot at position `pos` may be written when `seq == pos`, and becomes
+    // ready for delivery once the producer sets `seq = pos + 1`. The consumer
+    // releases it for the next round by setting `seq = pos + num_slots`.
+    atomic_size_t seq;
+    enum pl_log_level lev;
+    char *msg; // points to `buf` or a heap allocation
+    char buf[LOG_SLOT_SIZE];
+};
 
 struct priv {
     pl_mutex lock;
-    enum pl_log_level log_level_cap;
+    atomic_int log_level_cap;
     pl_str logbuffer;
+
+    // State for asynchronous logging, if `params.async_queue` was set
+    struct log_slot *slots;
+    size_t num_slots; // power of two
+    atomic_size_t head;
+    size_t tail;      // only accessed by the logging thread
+    atomic_uint_least64_t dropped;
+    pl_thread thread;
+
+    // Used for waking up the logging thread when it ran out of messages
+    pl_mutex wake_lock;
+    pl_cond wakeup;
+    atomic_bool sleeping;
+    bool shutdown;
+
+    // Internal thread pool for background jobs, created on demand
+    struct pl_thread_pool *pool;
 };
 
+static PL_THREAD_VOID log_thread(void *arg);
+
+static void log_async_init(struct pl_log *log)
+{
+    struct priv *p = PL_PRIV(log);
+    size_t num_slots = 1;
+    while (num_slots < log->params.async_queue)
+        num_slots <<= 1;
+
+    p->slots = pl_calloc_ptr(log, num_slots, p->slots);
+    for (size_t i = 0; i < num_slots; i++)
+        atomic_init(&p->slots[i].seq, i);
+    p->num_slots = num_slots;
+    pl_mutex_init(&p->wake_lock);
+    pl_cond_init(&p->wakeup);
+
+    if (pl_thread_create(&p->thread, log_thread, log) != 0) {
+        pl_cond_destroy(&p->wakeup);
+        pl_mutex_destroy(&p->wake_lock);
+        pl_free(p->slots);
+        p->slots = NULL;
+        log->params.async_queue = 0;
+        pl_warn(log, "Failed creating logging thread, falling back to "
+                "synchronous logging");
+    }
+}
+
 pl_log pl_log_create(int api_ver, const struct pl_log_params *params)
 {
     (void) api_ver;
@@ -35,6 +95,12 @@ pl_log pl_log_create(int api_ver, const struct pl_log_params *params)
     struct priv *p = PL_PRIV(log);
     log->params = *PL_DEF(params, &pl_log_default_params);
     pl_mutex_init(&p->lock);
+    if (log->params.async_queue > 0) {
+        log_async_init(log);
+    } else {
+        log->params.async_queue = 0;
+    }
+
     pl_info(log, "Initialized libplacebo %s (API v%d)", PL_VERSION, PL_API_VER);
     return log;
 }
@@ -48,6 +114,18 @@ void pl_log_destroy(pl_log *plog)
         return;
 
     struct priv *p = PL_PRIV(log);
+    pl_thread_pool_destroy(&p->pool);
+    if (p->slots) {
+        // The logging thread drains all pending messages before exiting
+        pl_mutex_lock(&p->wake_lock);
+        p->shutdown = true;
+        pl_cond_signal(&p->wakeup);
+        pl_mutex_unlock(&p->wake_lock);
+        pl_thread_join(p->thread);
+        pl_cond_destroy(&p->wakeup);
+        pl_mutex_destroy(&p->wake_lock);
+    }
+
     pl_mutex_destroy(&p->lock);
     pl_free((void *) log);
     *plog = NULL;
@@ -63,11 +141,23 @@ struct pl_log_params pl_log_update(pl_log ptr, const struct pl_log_params *param
     pl_mutex_lock(&p->lock);
     struct pl_log_params prev_params = log->params;
     log->params = *PL_DEF(params, &pl_log_default_params);
+    log->params.async_queue = prev_params.async_queue; // fixed at creation
     pl_mutex_unlock(&p->lock);
 
     return prev_params;
 }
 
+struct pl_thread_pool *pl_log_thread_pool(pl_log log)
+{
+    struct priv *p = PL_PRIV(log);
+    pl_mutex_lock(&p->lock);
+    if (!p->pool)
+        p->pool = pl_thread_pool_create();
+    struct pl_thread_pool *pool = p->pool;
+    pl_mutex_unlock(&p->lock);
+    return pool;
+}
+
 enum pl_log_level pl_log_level_update(pl_log ptr, enum pl_log_level level)
 {
     struct pl_log *log = (struct pl_log *) ptr;
@@ -89,9 +179,7 @@ void pl_log_level_cap(pl_log log, enum pl_log_level cap)
         return;
 
     struct priv *p = PL_PRIV(log);
-    pl_mutex_lock(&p->lock);
-    p->log_level_cap = cap;
-    pl_mutex_unlock(&p->lock);
+    atomic_store(&p->log_level_cap, cap);
 }
 
 static FILE *default_stream(void *stream, enum pl_log_level level)
@@ -133,6 +221,108 @@ void pl_log_color(void *stream, enum pl_log_level level, const char *msg)
         fflush(h);
 }
 
+// Deliver a pre-formatted message from the logging thread
+static void log_deliver(pl_log log, enum pl_log_level lev, const char *msg)
+{
+    struct priv *p = PL_PRIV(log);
+    pl_mutex_lock(&p->lock);
+    if (pl_msg_test(log, lev))
+        log->params.log_cb(log->params.log_priv, lev, msg);
+    pl_mutex_unlock(&p->lock);
+}
+
+static PL_THREAD_VOID log_thread(void *arg)
+{
+    pl_log log = arg;
+    struct priv *p = PL_PRIV(log);
+    uint64_t reported = 0;
+
+    for (;;) {
+        struct log_slot *slot = &p->slots[p->tail & (p->num_slots - 1)];
+        size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        if (seq == p->tail + 1) {
+            log_deliver(log, slot->lev, slot->msg);
+            if (slot->msg != slot->buf)
+                free(slot->msg);
+            atomic_store_explicit(&slot->seq, p->tail + p->num_slots,
+                                  memory_order_release);
+            p->tail++;
+            continue;
+        }
+
+        // Queue drained, report any dropped messages before going to sleep
+        uint64_t dropped = atomic_load_explicit(&p->dropped, memory_order_relaxed);
+        if (dropped != reported) {
+            char msg[64];
+            snprintf(msg, sizeof(msg), "Log queue overflow, dropped %"PRIu64
+                     " messages", dropped - reported);
+            log_deliver(log, PL_LOG_WARN, msg);
+            reported = dropped;
+            continue;
+        }
+
+        pl_mutex_lock(&p->wake_lock);
+        atomic_store(&p->sleeping, true);
+        seq = atomic_load(&slot->seq);
+        bool quit = p->shutdown && seq != p->tail + 1;
+        if (!quit && seq != p->tail + 1)
+            pl_cond_wait(&p->wakeup, &p->wake_lock);
+        atomic_store(&p->sleeping, false);
+        pl_mutex_unlock(&p->wake_lock);
+        if (quit)
+            break;
+    }
+
+    PL_THREAD_RETURN();
+}
+
+// Format a message into the queue and wake up the logging thread, without
+// taking any locks (unless the logging thread is asleep)
+static void log_push(pl_log log, enum pl_log_level lev, const char *fmt, va_list va)
+{
+    struct priv *p = PL_PRIV(log);
+    size_t pos = atomic_load_explicit(&p->head, memory_order_relaxed);
+    struct log_slot *slot;
+    for (;;) {
+        slot = &p->slots[pos & (p->num_slots - 1)];
+        size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t) seq - (intptr_t) pos;
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&p->head, &pos, pos + 1,
+                                                      memory_order_relaxed,
+                                                      memory_order_relaxed))
+                break;
+        } else if (diff < 0) {
+            atomic_fetch_add_explicit(&p->dropped, 1, memory_order_relaxed);
+            return; // queue full
+        } else {
+            pos = atomic_load_explicit(&p->head, memory_order_relaxed);
+        }
+    }
+
+    va_list copy;
+    va_copy(copy, va);
+    int len = vsnprintf(slot->buf, sizeof(slot->buf), fmt, copy);
+    va_end(copy);
+    slot->lev = lev;
+    slot->msg = slot->buf;
+    if (len >= (int) sizeof(slot->buf)) {
+        char *msg = malloc(len + 1);
+        if (msg) {
+            vsnprintf(msg, len + 1, fmt, va);
+            slot->msg = msg;
+        }
+    }
+
+    atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load(&p->sleeping)) {
+        pl_mutex_lock(&p->wake_lock);
+        pl_cond_signal(&p->wakeup);
+        pl_mutex_unlock(&p->wake_lock);
+    }
+}
+
 static void pl_msg_va(pl_log log, enum pl_log_level lev,
                       const char *fmt, va_list va)
 {
@@ -144,14 +334,23 @@ static void pl_msg_va(pl_log log, enum pl_log_level lev,
     if (!pl_msg_test(log, lev))
         return;
 
+    // Apply this cap before re-testing the log level, to avoid giving users
+    // messages that should have been dropped by the log level.
+    struct priv *p = PL_PRIV(log);
+    lev = PL_MAX(lev, atomic_load_explicit(&p->log_level_cap, memory_order_relaxed));
+
+    // Fatal messages are delivered synchronously, since they may well be
+    // the last thing we get to log
+    if (p->slots && lev != PL_LOG_FATAL) {
+        // Formatted without any lock held, level re-tested on delivery
+        if (pl_msg_test(log, lev))
+            log_push(log, lev, fmt, va);
+        return;
+    }
+
     // Re-test the log message level with held lock to avoid false positives,
     // which would be a considerably bigger deal than false negatives
-    struct priv *p = PL_PRIV(log);
     pl_mutex_lock(&p->lock);
-
-    // Apply this cap before re-testing the log level, to avoid giving users
-    // messages that should have been dropped by the log level.
-    lev = PL_MAX(lev, p->log_level_cap);
     if (!pl_msg_test(log, lev))
         goto done;
 
@@ -64,6 +64,10 @@ void pl_msg_source(pl_log log, enum pl_log_level lev, const char *src);
 // hack until a better solution can be thought of.
 void pl_log_level_cap(pl_log log, enum pl_log_level cap);
 
+// Returns the internal thread pool of `log`, creating it if needed. See
+// `pl_job_submit` for what this is used for.
+struct pl_thread_pool *pl_log_thread_pool(pl_log log);
+
 // CPU execution time reporting helper
 static inline void pl_log_cpu_time(pl_log log, time_t start, time_t stop,
                                    const char *operation)
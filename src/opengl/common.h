@@ -41,3 +41,7 @@ struct fbo_format {
 // For locking/unlocking
 bool gl_make_current(pl_opengl gl);
 void gl_release_current(pl_opengl gl);
+
+// For the secondary upload context, see `pl_opengl_params.make_current_upload`
+bool gl_make_current_upload(pl_opengl gl);
+void gl_release_current_upload(pl_opengl gl);
@@ -31,6 +31,9 @@ struct priv {
     // For context locking
     pl_mutex lock;
     int count;
+
+    // For the upload context, which is never bound recursively
+    pl_mutex upload_lock;
 };
 
 static void GLAPIENTRY debug_cb(GLenum source, GLenum type, GLuint id,
@@ -105,6 +108,7 @@ void pl_opengl_destroy(pl_opengl *ptr)
     pl_gpu_destroy(pl_gl->gpu);
     gl_release_current(pl_gl);
     pl_mutex_destroy(&p->lock);
+    pl_mutex_destroy(&p->upload_lock);
     pl_free_ptr((void **) ptr);
 }
 
@@ -117,6 +121,7 @@ pl_opengl pl_opengl_create(pl_log log, const struct pl_opengl_params *params)
     p->log = log;
 
     pl_mutex_init_type(&p->lock, PL_MUTEX_RECURSIVE);
+    pl_mutex_init(&p->upload_lock);
     if (!gl_make_current(pl_gl)) {
         pl_free(pl_gl);
         return NULL;
@@ -236,3 +241,24 @@ void gl_release_current(pl_opengl gl)
         p->params.release_current(p->params.priv);
     pl_mutex_unlock(&p->lock);
 }
+
+bool gl_make_current_upload(pl_opengl gl)
+{
+    struct priv *p = PL_PRIV(gl);
+    pl_mutex_lock(&p->upload_lock);
+    if (!p->params.make_current_upload(p->params.priv)) {
+        PL_ERR(p, "Failed making OpenGL upload context current on calling thread!");
+        pl_mutex_unlock(&p->upload_lock);
+        return false;
+    }
+
+    return true;
+}
+
+void gl_release_current_upload(pl_opengl gl)
+{
+    struct priv *p = PL_PRIV(gl);
+    if (p->params.release_current_upload)
+        p->params.release_current_upload(p->params.priv);
+    pl_mutex_unlock(&p->upload_lock);
+}
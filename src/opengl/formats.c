@@ -296,20 +296,34 @@ static void add_format(pl_gpu pgpu, const struct gl_format *gl_fmt)
 
 #if defined(PL_HAVE_UNIX) && defined(EPOXY_HAS_EGL)
     if (p->has_modifiers && fmt->fourcc && supported_fourcc(p, fmt->fourcc)) {
+        // On my system eglQueryDmaBufModifiersEXT seems to never return
+        // MOD_INVALID even though eglExportDMABUFImageQueryMESA happily
+        // returns such modifiers. Since we handle INVALID by not requiring
+        // modifiers at all, always add this value to the list of supported
+        // modifiers. May result in duplicates, but whatever.
+        //
+        // Try fetching the list in a single call first, since these queries
+        // are slow on some drivers, and only query the exact count if the
+        // list may have been truncated.
+        uint64_t mods_buf[16];
         int num_mods = 0;
         bool ok = eglQueryDmaBufModifiersEXT(p->egl_dpy, fmt->fourcc,
-                                             0, NULL, NULL, &num_mods);
+                                             PL_ARRAY_SIZE(mods_buf), mods_buf,
+                                             NULL, &num_mods);
+        if (ok && num_mods == PL_ARRAY_SIZE(mods_buf)) {
+            ok = eglQueryDmaBufModifiersEXT(p->egl_dpy, fmt->fourcc,
+                                            0, NULL, NULL, &num_mods);
+        }
+
         if (ok && num_mods) {
-            // On my system eglQueryDmaBufModifiersEXT seems to never return
-            // MOD_INVALID even though eglExportDMABUFImageQueryMESA happily
-            // returns such modifiers. Since we handle INVALID by not
-            // requiring modifiers at all, always add this value to the
-            // list of supported modifiers. May result in duplicates, but
-            // whatever.
             uint64_t *mods = pl_calloc(fmt, num_mods + 1, sizeof(uint64_t));
             mods[0] = DRM_FORMAT_MOD_INVALID;
-            ok = eglQueryDmaBufModifiersEXT(p->egl_dpy, fmt->fourcc, num_mods,
-                                            &mods[1], NULL, &num_mods);
+            if (num_mods <= PL_ARRAY_SIZE(mods_buf)) {
+                memcpy(&mods[1], mods_buf, num_mods * sizeof(uint64_t));
+            } else {
+                ok = eglQueryDmaBufModifiersEXT(p->egl_dpy, fmt->fourcc, num_mods,
+                                                &mods[1], NULL, &num_mods);
+            }
 
             if (ok) {
                 fmt->modifiers = mods;
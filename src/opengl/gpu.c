@@ -31,6 +31,96 @@
 
 static const struct pl_gpu_fns pl_fns_gl;
 
+static bool gl_stream_init(pl_gpu gpu)
+{
+    struct pl_gl *p = PL_PRIV(gpu);
+    struct gl_stream *s = &p->stream;
+    const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT |
+                             GL_MAP_COHERENT_BIT;
+
+    glGenBuffers(1, &s->buffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, s->buffer);
+    glBufferStorage(GL_COPY_WRITE_BUFFER, GL_STREAM_SIZE, NULL, flags);
+    s->data = glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, GL_STREAM_SIZE, flags);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    if (!s->data) {
+        PL_WARN(gpu, "Failed mapping streaming buffer, falling back to "
+                "direct uploads");
+        glDeleteBuffers(1, &s->buffer);
+        *s = (struct gl_stream) {0};
+        return false;
+    }
+
+    return true;
+}
+
+static void gl_stream_destroy(pl_gpu gpu)
+{
+    struct pl_gl *p = PL_PRIV(gpu);
+    struct gl_stream *s = &p->stream;
+    for (int i = 0; i < GL_STREAM_SEGMENTS; i++)
+        glDeleteSync(s->fences[i]);
+    glDeleteBuffers(1, &s->buffer); // implicitly unmaps
+    *s = (struct gl_stream) {0};
+}
+
+void *gl_stream_alloc(pl_gpu gpu, size_t size, size_t align,
+                      GLuint *buf, size_t *offset)
+{
+    struct pl_gl *p = PL_PRIV(gpu);
+    struct gl_stream *s = &p->stream;
+    const size_t seg_size = GL_STREAM_SIZE / GL_STREAM_SEGMENTS;
+    if (!p->has_stream || !size || size > seg_size)
+        return NULL;
+
+    size_t pos = PL_ALIGN(s->pos, align);
+    if (pos + size > seg_size) {
+        // Move on to the next segment, which first requires waiting until
+        // the GPU is done with all previous uses of it
+        int next = (s->seg + 1) % GL_STREAM_SEGMENTS;
+        if (s->fences[next]) {
+            GLenum res = glClientWaitSync(s->fences[next],
+                                          GL_SYNC_FLUSH_COMMANDS_BIT,
+                                          1000000000); // 1 second
+            if (res == GL_TIMEOUT_EXPIRED || res == GL_WAIT_FAILED) {
+                PL_WARN(gpu, "Timed out waiting for streaming buffer!");
+                return NULL;
+            }
+            glDeleteSync(s->fences[next]);
+            s->fences[next] = NULL;
+        }
+
+        // Fence off all uses of the segment we're leaving
+        s->fences[s->seg] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        s->seg = next;
+        pos = 0;
+    }
+
+    s->pos = pos + size;
+    *buf = s->buffer;
+    *offset = s->seg * seg_size + pos;
+    return s->data + *offset;
+}
+
+void gl_bind_texture(pl_gpu gpu, GLenum target, GLuint texture)
+{
+    struct pl_gl *p = PL_PRIV(gpu);
+    pl_assert(!p->state.active_unit);
+    glBindTexture(target, texture);
+    p->state.units[0].target = target;
+    p->state.units[0].texture = texture;
+}
+
+void gl_state_forget_texture(pl_gpu gpu, GLuint texture)
+{
+    struct pl_gl *p = PL_PRIV(gpu);
+    for (int i = 0; i < GL_STATE_UNITS; i++) {
+        if (p->state.units[i].texture == texture)
+            p->state.units[i].texture = 0;
+    }
+}
+
 static void gl_gpu_destroy(pl_gpu gpu)
 {
     struct pl_gl *p = PL_PRIV(gpu);
@@ -39,6 +129,24 @@ static void gl_gpu_destroy(pl_gpu gpu)
     while (p->callbacks.num > 0)
         gl_poll_callbacks(gpu);
 
+    for (int i = 0; i < GL_READBACK_SLOTS; i++)
+        pl_buf_destroy(gpu, &p->readback[i].buf);
+
+    if (MAKE_CURRENT()) {
+        if (p->has_stream)
+            gl_stream_destroy(gpu);
+        if (p->has_samplers) {
+            glDeleteSamplers(PL_ARRAY_SIZE(p->samplers) * PL_ARRAY_SIZE(p->samplers[0]),
+                             &p->samplers[0][0]);
+        }
+        glDeleteQueries(p->queries.num, p->queries.elem);
+        if (p->epoch_fence)
+            glDeleteSync(p->epoch_fence);
+        RELEASE_CURRENT();
+    }
+
+    pl_free(p->upload_cbs.elem);
+    pl_mutex_destroy(&p->sync_lock);
     pl_free((void *) gpu);
 }
 
@@ -115,6 +223,8 @@ pl_gpu pl_gpu_create_gl(pl_log log, pl_opengl gl, const struct pl_opengl_params
     struct pl_gl *p = PL_PRIV(gpu);
     p->impl = pl_fns_gl;
     p->gl = gl;
+    p->epoch = 1;
+    pl_mutex_init(&p->sync_lock);
 
     struct pl_glsl_version *glsl = &gpu->glsl;
     int ver = epoxy_gl_version();
@@ -162,14 +272,18 @@ pl_gpu pl_gpu_create_gl(pl_log log, pl_opengl gl, const struct pl_opengl_params
     limits->callbacks = gl_test_ext(gpu, "GL_ARB_sync", 32, 30);
     if (gl_test_ext(gpu, "GL_ARB_pixel_buffer_object", 31, 0))
         limits->max_buf_size = SIZE_MAX; // no restriction imposed by GL
-    if (gl_test_ext(gpu, "GL_ARB_uniform_buffer_object", 31, 0))
+    if (gl_test_ext(gpu, "GL_ARB_uniform_buffer_object", 31, 0)) {
         get(GL_MAX_UNIFORM_BLOCK_SIZE, &limits->max_ubo_size);
+        get(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &limits->align_ubo_offset);
+    }
     if (gl_test_ext(gpu, "GL_ARB_shader_storage_buffer_object", 43, 0))
         get(GL_MAX_SHADER_STORAGE_BLOCK_SIZE, &limits->max_ssbo_size);
     limits->max_vbo_size = limits->max_buf_size; // No additional restrictions
     if (gl_test_ext(gpu, "GL_ARB_buffer_storage", 44, 0))
         limits->max_mapped_size = limits->max_buf_size;
     limits->align_vertex_stride = 1;
+    limits->instancing = gl_test_ext(gpu, "GL_ARB_instanced_arrays", 33, 30) &&
+                         gl_test_ext(gpu, "GL_ARB_draw_instanced", 31, 30);
 
     get(GL_MAX_TEXTURE_SIZE, &limits->max_tex_2d_dim);
     if (gl_test_ext(gpu, "GL_EXT_texture3D", 21, 30))
@@ -221,6 +335,23 @@ pl_gpu pl_gpu_create_gl(pl_log log, pl_opengl gl, const struct pl_opengl_params
     p->has_fbos = gl_test_ext(gpu, "GL_ARB_framebuffer_object", 30, 20);
     p->has_storage = gl_test_ext(gpu, "GL_ARB_shader_image_load_store", 42, 0);
     p->has_readback = p->has_fbos;
+    p->has_samplers = gl_test_ext(gpu, "GL_ARB_sampler_objects", 33, 30);
+    p->has_meminfo = gl_test_ext(gpu, "GL_NVX_gpu_memory_info", 0, 0);
+    p->exclusive = params->exclusive;
+    p->has_upload_ctx = params->make_current && params->make_current_upload &&
+                        limits->callbacks;
+    p->has_parallel_compile = epoxy_has_gl_extension("GL_KHR_parallel_shader_compile");
+    if (p->has_parallel_compile) {
+        glMaxShaderCompilerThreadsKHR(0xFFFFFFFF); // as many as possible
+    } else {
+        p->impl.pass_create_async = NULL;
+        p->impl.pass_poll = NULL;
+    }
+
+    p->has_stream = limits->callbacks &&
+                    (gl_test_ext(gpu, "GL_ARB_buffer_storage", 44, 0) ||
+                     epoxy_has_gl_extension("GL_EXT_buffer_storage")) &&
+                    gl_stream_init(gpu);
 
     if (p->has_readback && p->gles_ver) {
         GLuint fbo = 0, tex = 0;
@@ -446,9 +577,27 @@ void gl_buf_write(pl_gpu gpu, pl_buf buf, size_t offset,
         return;
 
     struct pl_buf_gl *buf_gl = PL_PRIV(buf);
-    glBindBuffer(GL_ARRAY_BUFFER, buf_gl->buffer);
-    glBufferSubData(GL_ARRAY_BUFFER, buf_gl->offset + offset, size, data);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    // Prefer staging small writes through the streaming buffer, since
+    // glBufferSubData on buffers still in use by the GPU tends to either
+    // stall or trigger expensive resource shadowing in the driver
+    GLuint stream;
+    size_t stream_offset;
+    void *ptr = gl_stream_alloc(gpu, size, 4, &stream, &stream_offset);
+    if (ptr) {
+        memcpy(ptr, data, size);
+        glBindBuffer(GL_COPY_READ_BUFFER, stream);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buf_gl->buffer);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+                            stream_offset, buf_gl->offset + offset, size);
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    } else {
+        glBindBuffer(GL_ARRAY_BUFFER, buf_gl->buffer);
+        glBufferSubData(GL_ARRAY_BUFFER, buf_gl->offset + offset, size, data);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
     gl_check_err(gpu, "gl_buf_write");
     RELEASE_CURRENT();
 }
@@ -486,6 +635,7 @@ void gl_buf_copy(pl_gpu gpu, pl_buf dst, size_t dst_offset,
 }
 
 #define QUERY_OBJECT_NUM 8
+#define QUERY_OBJECT_BATCH 64
 
 struct pl_timer {
     GLuint query[QUERY_OBJECT_NUM];
@@ -499,22 +649,26 @@ static pl_timer gl_timer_create(pl_gpu gpu)
     if (!p->has_queries || !MAKE_CURRENT())
         return NULL;
 
+    // Generate query objects in batches, and recycle them from destroyed
+    // timers, rather than creating and deleting them for every single timer
+    if (p->queries.num < QUERY_OBJECT_NUM) {
+        PL_ARRAY_RESIZE(gpu, p->queries, p->queries.num + QUERY_OBJECT_BATCH);
+        glGenQueries(QUERY_OBJECT_BATCH, &p->queries.elem[p->queries.num]);
+        p->queries.num += QUERY_OBJECT_BATCH;
+    }
+
     pl_timer timer = pl_zalloc_ptr(NULL, timer);
-    glGenQueries(QUERY_OBJECT_NUM, timer->query);
+    p->queries.num -= QUERY_OBJECT_NUM;
+    memcpy(timer->query, &p->queries.elem[p->queries.num], sizeof(timer->query));
     RELEASE_CURRENT();
     return timer;
 }
 
 static void gl_timer_destroy(pl_gpu gpu, pl_timer timer)
 {
-    if (!MAKE_CURRENT()) {
-        PL_ERR(gpu, "Failed uninitializing timer, leaking resources!");
-        return;
-    }
-
-    glDeleteQueries(QUERY_OBJECT_NUM, timer->query);
-    gl_check_err(gpu, "gl_timer_destroy");
-    RELEASE_CURRENT();
+    struct pl_gl *p = PL_PRIV(gpu);
+    for (int i = 0; i < QUERY_OBJECT_NUM; i++)
+        PL_ARRAY_APPEND(gpu, p->queries, timer->query[i]);
     pl_free(timer);
 }
 
@@ -564,11 +718,28 @@ void gl_timer_end(pl_timer timer)
     }
 }
 
+// Fences off all commands issued so far, for the upload context to wait on.
+// Must be called with the context current, before flushing it.
+static void end_epoch(pl_gpu gpu)
+{
+    struct pl_gl *p = PL_PRIV(gpu);
+    if (!p->has_upload_ctx)
+        return;
+
+    pl_mutex_lock(&p->sync_lock);
+    if (p->epoch_fence)
+        glDeleteSync(p->epoch_fence);
+    p->epoch_fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    p->epoch++;
+    pl_mutex_unlock(&p->sync_lock);
+}
+
 static void gl_gpu_flush(pl_gpu gpu)
 {
     if (!MAKE_CURRENT())
         return;
 
+    end_epoch(gpu);
     glFlush();
     gl_check_err(gpu, "gl_gpu_flush");
     RELEASE_CURRENT();
@@ -579,22 +750,82 @@ static void gl_gpu_finish(pl_gpu gpu)
     if (!MAKE_CURRENT())
         return;
 
+    end_epoch(gpu);
     glFinish();
     gl_check_err(gpu, "gl_gpu_finish");
     RELEASE_CURRENT();
 }
 
+static void *gl_fence_create(pl_gpu gpu)
+{
+    if (!gpu->limits.callbacks || !MAKE_CURRENT())
+        return NULL;
+
+    GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glFlush();
+    gl_check_err(gpu, "gl_fence_create");
+    RELEASE_CURRENT();
+    return fence;
+}
+
+static bool gl_fence_wait(pl_gpu gpu, void *fence, uint64_t timeout)
+{
+    if (!MAKE_CURRENT())
+        return false;
+
+    GLenum res = glClientWaitSync(fence, timeout ? GL_SYNC_FLUSH_COMMANDS_BIT : 0,
+                                  timeout);
+    gl_check_err(gpu, "gl_fence_wait");
+    RELEASE_CURRENT();
+    return res == GL_ALREADY_SIGNALED || res == GL_CONDITION_SATISFIED ||
+           res == GL_WAIT_FAILED;
+}
+
+static void gl_fence_destroy(pl_gpu gpu, void *fence)
+{
+    if (!MAKE_CURRENT())
+        return;
+
+    glDeleteSync(fence);
+    RELEASE_CURRENT();
+}
+
 static bool gl_gpu_is_failed(pl_gpu gpu)
 {
     struct pl_gl *gl = PL_PRIV(gpu);
     return gl->failed;
 }
 
+// OpenGL drivers manage memory internally, so this is limited to the
+// (device-wide) video memory usage exposed by some vendor extensions
+static void gl_memory_stats(pl_gpu gpu, struct pl_gpu_memory_stats *stats)
+{
+    struct pl_gl *p = PL_PRIV(gpu);
+    if (!p->has_meminfo || !MAKE_CURRENT())
+        return;
+
+    GLint total = 0, avail = 0; // in KiB
+    glGetIntegerv(GL_GPU_MEMORY_INFO_TOTAL_AVAILABLE_MEMORY_NVX, &total);
+    glGetIntegerv(GL_GPU_MEMORY_INFO_CURRENT_AVAILABLE_VIDMEM_NVX, &avail);
+    gl_check_err(gpu, "gl_memory_stats");
+    RELEASE_CURRENT();
+
+    uint64_t used = (uint64_t) PL_MAX(total - avail, 0) << 10;
+    stats->heaps[0] = (struct pl_gpu_heap_usage) {
+        .size = (uint64_t) total << 10,
+        .allocated = used,
+        .used = used,
+        .device_local = true,
+    };
+    stats->num_heaps = 1;
+}
+
 static const struct pl_gpu_fns pl_fns_gl = {
     .destroy                = gl_gpu_destroy,
     .tex_create             = gl_tex_create,
     .tex_destroy            = gl_tex_destroy,
     .tex_invalidate         = gl_tex_invalidate,
+    .tex_reset_import       = gl_tex_reset_import,
     .tex_clear_ex           = gl_tex_clear_ex,
     .tex_blit               = gl_tex_blit,
     .tex_upload             = gl_tex_upload,
@@ -609,10 +840,16 @@ static const struct pl_gpu_fns pl_fns_gl = {
     .pass_create            = gl_pass_create,
     .pass_destroy           = gl_pass_destroy,
     .pass_run               = gl_pass_run,
+    .pass_create_async      = gl_pass_create_async,
+    .pass_poll              = gl_pass_poll,
     .timer_create           = gl_timer_create,
     .timer_destroy          = gl_timer_destroy,
     .timer_query            = gl_timer_query,
     .gpu_flush              = gl_gpu_flush,
     .gpu_finish             = gl_gpu_finish,
     .gpu_is_failed          = gl_gpu_is_failed,
+    .fence_create           = gl_fence_create,
+    .fence_wait             = gl_fence_wait,
+    .fence_destroy          = gl_fence_destroy,
+    .memory_stats           = gl_memory_stats,
 };
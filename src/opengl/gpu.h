@@ -19,12 +19,52 @@
 
 #include "../gpu.h"
 #include "common.h"
+#include "../pl_thread.h"
 
 // Thread safety: Unsafe, same as pl_gpu_destroy
 pl_gpu pl_gpu_create_gl(pl_log log, pl_opengl gl, const struct pl_opengl_params *params);
 
 // --- pl_gpu internal structs and functions
 
+// Persistently and coherently mapped ring buffer, used to stage small buffer
+// writes and texture uploads. Split into segments, each guarded by a fence,
+// so the host never overwrites data the GPU may still be reading from.
+#define GL_STREAM_SIZE     (4 << 20) // 4 MiB
+#define GL_STREAM_SEGMENTS 4
+
+struct gl_stream {
+    GLuint buffer;
+    uint8_t *data;
+    int seg;    // current segment
+    size_t pos; // offset into current segment
+    GLsync fences[GL_STREAM_SEGMENTS];
+};
+
+// Ring of persistently mapped PBOs, used to implement asynchronous texture
+// downloads without blocking on the transfer
+#define GL_READBACK_SLOTS 4
+
+struct gl_readback {
+    pl_buf buf;
+    bool busy; // transfer pending, or data not yet copied out
+};
+
+// Shadow copy of the binding state touched by `gl_pass_run`, used to skip
+// redundant state changes. Texture units beyond `GL_STATE_UNITS` are always
+// rebound.
+#define GL_STATE_UNITS 32
+
+struct gl_state {
+    GLuint program;
+    GLuint vao;
+    int active_unit;
+    struct {
+        GLenum target;
+        GLuint texture;
+        GLuint sampler;
+    } units[GL_STATE_UNITS];
+};
+
 struct pl_gl {
     struct pl_gpu_fns impl;
     pl_opengl gl;
@@ -43,6 +83,29 @@ struct pl_gl {
     // Sync objects and associated callbacks
     PL_ARRAY(struct gl_cb) callbacks;
 
+    // Streaming ring buffer, if `has_stream`
+    struct gl_stream stream;
+
+    // Readback ring, used if `pl_gpu_limits.max_mapped_size` is nonzero
+    struct gl_readback readback[GL_READBACK_SLOTS];
+    int readback_idx; // next slot to try
+
+    // Binding state, and cached sampler objects (if `has_samplers`)
+    struct gl_state state;
+    GLuint samplers[PL_TEX_SAMPLE_MODE_COUNT][PL_TEX_ADDRESS_MODE_COUNT];
+    bool exclusive; // keep bindings across passes, see `pl_opengl_params`
+
+    // Pool of unused query objects, shared by all timers
+    PL_ARRAY(GLuint) queries;
+
+    // State shared with the upload context, if `has_upload_ctx`. Each
+    // `gl_gpu_flush` ends the current epoch by fencing off all main context
+    // commands issued so far, which lets the upload context wait for any
+    // texture not accessed since then. Guarded by `sync_lock`.
+    pl_mutex sync_lock;
+    uint64_t epoch;
+    GLsync epoch_fence;
+    PL_ARRAY(struct gl_cb) upload_cbs; // moved to `callbacks` when polled
 
     // Incrementing counters to keep track of object uniqueness
     int buf_id;
@@ -60,9 +123,37 @@ struct pl_gl {
     bool has_queries;
     bool has_modifiers;
     bool has_readback;
+    bool has_stream;
+    bool has_parallel_compile;
+    bool has_samplers;
+    bool has_meminfo;
+    bool has_upload_ctx;
     int gather_comps;
 };
 
+// Allocates `size` bytes from the streaming ring buffer, with the given
+// offset alignment. Returns a pointer to the mapped memory, which must be
+// written to before issuing the GL commands consuming it, or NULL if the
+// allocation can't be satisfied (in which case the caller should fall back
+// to a direct upload). `buf` and `offset` identify the data on the GPU.
+//
+// Note: Must be called with the context current.
+void *gl_stream_alloc(pl_gpu gpu, size_t size, size_t align,
+                      GLuint *buf, size_t *offset);
+
+// Binds a texture to texture unit 0 (which must be the active unit outside
+// of `gl_pass_run`), keeping the shadow state in sync.
+void gl_bind_texture(pl_gpu gpu, GLenum target, GLuint texture);
+
+// Drops all references to a GL object from the shadow state. Must be called
+// before the object is deleted, since GL may reuse its name afterwards.
+void gl_state_forget_texture(pl_gpu gpu, GLuint texture);
+
+// Must be called before the main context accesses `tex`, to wait for any
+// pending upload performed on the upload context, and to record the access
+// in the current epoch.
+void gl_tex_use(pl_gpu gpu, pl_tex tex);
+
 void gl_timer_begin(pl_timer timer);
 void gl_timer_end(pl_timer timer);
 
@@ -104,11 +195,16 @@ struct pl_tex_gl {
     EGLImageKHR image;
 #endif
     int fd;
+
+    // For uploads on the upload context
+    uint64_t last_use; // epoch of the last main context access, or 0
+    GLsync upload_fence;
 };
 
 pl_tex gl_tex_create(pl_gpu, const struct pl_tex_params *);
 void gl_tex_destroy(pl_gpu, pl_tex);
 void gl_tex_invalidate(pl_gpu, pl_tex);
+void gl_tex_reset_import(pl_gpu, pl_tex);
 void gl_tex_clear_ex(pl_gpu, pl_tex, const union pl_clear_color);
 void gl_tex_blit(pl_gpu, const struct pl_tex_blit_params *);
 bool gl_tex_upload(pl_gpu, const struct pl_tex_transfer_params *);
@@ -136,3 +232,5 @@ int gl_desc_namespace(pl_gpu, enum pl_desc_type type);
 pl_pass gl_pass_create(pl_gpu, const struct pl_pass_params *);
 void gl_pass_destroy(pl_gpu, pl_pass);
 void gl_pass_run(pl_gpu, const struct pl_pass_run_params *);
+pl_pass gl_pass_create_async(pl_gpu, const struct pl_pass_params *);
+bool gl_pass_poll(pl_gpu, pl_pass, bool block, bool *ok);
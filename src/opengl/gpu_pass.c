@@ -18,6 +18,7 @@
 #include "gpu.h"
 #include "formats.h"
 #include "utils.h"
+#include "pl_clock.h"
 
 int gl_desc_namespace(pl_gpu gpu, enum pl_desc_type type)
 {
@@ -83,12 +84,16 @@ static enum pl_log_level gl_log_level(GLint status, GLint log_length)
     }
 }
 
-static bool gl_attach_shader(pl_gpu gpu, GLuint program, GLenum type, const char *src)
+static GLuint gl_compile_shader(GLenum type, const char *src)
 {
     GLuint shader = glCreateShader(type);
     glShaderSource(shader, 1, &src, NULL);
     glCompileShader(shader);
+    return shader;
+}
 
+static bool gl_check_shader(pl_gpu gpu, GLuint shader)
+{
     GLint status = 0;
     glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
     GLint log_length = 0;
@@ -102,30 +107,25 @@ static bool gl_attach_shader(pl_gpu gpu, GLuint program, GLenum type, const char
         pl_free(logstr);
     }
 
-    if (!status || !gl_check_err(gpu, "gl_attach_shader"))
-        goto error;
-
-    glAttachShader(program, shader);
-    glDeleteShader(shader);
-    return true;
-
-error:
-    glDeleteShader(shader);
-    return false;
+    return status;
 }
 
-static GLuint gl_compile_program(pl_gpu gpu, const struct pl_pass_params *params)
+// Starts compiling and linking the program. This does not check the result,
+// so it can complete in the background with GL_KHR_parallel_shader_compile.
+// The shader objects are returned in `shaders`, and must be passed to
+// `gl_finish_program` afterwards.
+static GLuint gl_start_program(pl_gpu gpu, const struct pl_pass_params *params,
+                               GLuint shaders[2])
 {
     GLuint prog = glCreateProgram();
-    bool ok = true;
 
     switch (params->type) {
     case PL_PASS_COMPUTE:
-        ok &= gl_attach_shader(gpu, prog, GL_COMPUTE_SHADER, params->glsl_shader);
+        shaders[0] = gl_compile_shader(GL_COMPUTE_SHADER, params->glsl_shader);
         break;
     case PL_PASS_RASTER:
-        ok &= gl_attach_shader(gpu, prog, GL_VERTEX_SHADER, params->vertex_shader);
-        ok &= gl_attach_shader(gpu, prog, GL_FRAGMENT_SHADER, params->glsl_shader);
+        shaders[0] = gl_compile_shader(GL_VERTEX_SHADER, params->vertex_shader);
+        shaders[1] = gl_compile_shader(GL_FRAGMENT_SHADER, params->glsl_shader);
         for (int i = 0; i < params->num_vertex_attribs; i++)
             glBindAttribLocation(prog, i, params->vertex_attribs[i].name);
         break;
@@ -134,45 +134,127 @@ static GLuint gl_compile_program(pl_gpu gpu, const struct pl_pass_params *params
         pl_unreachable();
     }
 
-    if (!ok || !gl_check_err(gpu, "gl_compile_program: attach shader"))
-        goto error;
+    for (int i = 0; i < 2; i++) {
+        if (shaders[i])
+            glAttachShader(prog, shaders[i]);
+    }
 
     glLinkProgram(prog);
+    if (!gl_check_err(gpu, "gl_start_program")) {
+        for (int i = 0; i < 2; i++) {
+            glDeleteShader(shaders[i]);
+            shaders[i] = 0;
+        }
+        glDeleteProgram(prog);
+        PL_ERR(gpu, "Failed compiling/linking GLSL program");
+        return 0;
+    }
+
+    return prog;
+}
+
+// Waits for the program to be linked, and checks the results. Consumes the
+// shader objects returned by `gl_start_program`.
+static bool gl_finish_program(pl_gpu gpu, GLuint prog, GLuint shaders[2])
+{
+    bool ok = true;
+    for (int i = 0; i < 2; i++) {
+        if (!shaders[i])
+            continue;
+        ok &= gl_check_shader(gpu, shaders[i]);
+        glDeleteShader(shaders[i]); // deferred until the program is deleted
+        shaders[i] = 0;
+    }
+
     GLint status = 0;
     glGetProgramiv(prog, GL_LINK_STATUS, &status);
     GLint log_length = 0;
     glGetProgramiv(prog, GL_INFO_LOG_LENGTH, &log_length);
 
     enum pl_log_level level = gl_log_level(status, log_length);
-    if (pl_msg_test(gpu->log, level)) {
+    if (ok && pl_msg_test(gpu->log, level)) {
         GLchar *logstr = pl_zalloc(NULL, log_length + 1);
         glGetProgramInfoLog(prog, log_length, NULL, logstr);
         PL_MSG(gpu, level, "shader link log (status=%d): %s", status, logstr);
         pl_free(logstr);
     }
 
-    if (!gl_check_err(gpu, "gl_compile_program: link program"))
-        goto error;
-
-    return prog;
+    if (!ok || !status || !gl_check_err(gpu, "gl_finish_program")) {
+        PL_ERR(gpu, "Failed compiling/linking GLSL program");
+        return false;
+    }
 
-error:
-    glDeleteProgram(prog);
-    PL_ERR(gpu, "Failed compiling/linking GLSL program");
-    return 0;
+    return true;
 }
 
 // For pl_pass.priv
 struct pl_pass_gl {
     GLuint program;
+    GLuint shaders[2];  // shader objects, while the program is being linked
+    bool ready;         // program is linked and set up
+    bool failed;        // program failed linking or setup
     GLuint vao;         // the VAO object
     uint64_t vao_id;    // buf_gl.id of VAO
     size_t vao_offset;  // VBO offset of VAO
+    uint64_t vao_inst_id;   // buf_gl.id of the VAO's instance buffer
+    size_t vao_inst_offset; // instance buffer offset of VAO
     GLuint buffer;      // VBO for raw vertex pointers
     GLuint index_buffer;
     GLint *var_locs;
 };
 
+static void bind_program(pl_gpu gpu, GLuint program)
+{
+    struct pl_gl *p = PL_PRIV(gpu);
+    if (p->state.program != program) {
+        glUseProgram(program);
+        p->state.program = program;
+    }
+}
+
+static void bind_vao(pl_gpu gpu, GLuint vao)
+{
+    struct pl_gl *p = PL_PRIV(gpu);
+    if (p->state.vao != vao) {
+        glBindVertexArray(vao);
+        p->state.vao = vao;
+    }
+}
+
+static void set_active_unit(pl_gpu gpu, int unit)
+{
+    struct pl_gl *p = PL_PRIV(gpu);
+    if (p->state.active_unit != unit) {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        p->state.active_unit = unit;
+    }
+}
+
+// Binds a texture and sampler object (if supported) to a texture unit
+static void bind_unit(pl_gpu gpu, int unit, GLenum target, GLuint texture,
+                      GLuint sampler)
+{
+    struct pl_gl *p = PL_PRIV(gpu);
+    bool bind_tex = true, bind_sampler = p->has_samplers;
+    if (unit < GL_STATE_UNITS) {
+        struct gl_state *st = &p->state;
+        bind_tex = st->units[unit].target != target ||
+                   st->units[unit].texture != texture;
+        bind_sampler &= st->units[unit].sampler != sampler;
+        st->units[unit].target = target;
+        st->units[unit].texture = texture;
+        st->units[unit].sampler = sampler;
+    }
+
+    if (bind_tex) {
+        set_active_unit(gpu, unit);
+        glBindTexture(target, texture);
+    }
+
+    if (bind_sampler)
+        glBindSampler(unit, sampler);
+}
+
 void gl_pass_destroy(pl_gpu gpu, pl_pass pass)
 {
     if (!MAKE_CURRENT()) {
@@ -181,10 +263,17 @@ void gl_pass_destroy(pl_gpu gpu, pl_pass pass)
     }
 
     struct pl_pass_gl *pass_gl = PL_PRIV(pass);
+    struct pl_gl *p = PL_PRIV(gpu);
+    if (p->state.program && p->state.program == pass_gl->program)
+        bind_program(gpu, 0);
+    if (p->state.vao && p->state.vao == pass_gl->vao)
+        bind_vao(gpu, 0);
     if (pass_gl->vao)
         glDeleteVertexArrays(1, &pass_gl->vao);
     glDeleteBuffers(1, &pass_gl->index_buffer);
     glDeleteBuffers(1, &pass_gl->buffer);
+    for (int i = 0; i < 2; i++)
+        glDeleteShader(pass_gl->shaders[i]);
     glDeleteProgram(pass_gl->program);
 
     gl_check_err(gpu, "gl_pass_destroy");
@@ -192,7 +281,20 @@ void gl_pass_destroy(pl_gpu gpu, pl_pass pass)
     pl_free((void *) pass);
 }
 
-static void gl_update_va(pl_pass pass, size_t vbo_offset)
+static void draw_elements(GLenum mode, GLsizei count, GLenum type,
+                          const void *indices, int instances)
+{
+    if (instances > 1) {
+        glDrawElementsInstanced(mode, count, type, indices, instances);
+    } else {
+        glDrawElements(mode, count, type, indices);
+    }
+}
+
+// Expects the vertex buffer to be bound to GL_ARRAY_BUFFER, and binds the
+// instance buffer (if any) in its place
+static void gl_update_va(pl_gpu gpu, pl_pass pass, size_t vbo_offset,
+                         GLuint inst_buffer, size_t inst_offset)
 {
     for (int i = 0; i < pass->params.num_vertex_attribs; i++) {
         const struct pl_vertex_attrib *va = &pass->params.vertex_attribs[i];
@@ -215,34 +317,53 @@ static void gl_update_va(pl_pass pass, size_t vbo_offset)
             pl_unreachable();
         }
 
+        if (va->instanced)
+            continue;
+
         glEnableVertexAttribArray(i);
         glVertexAttribPointer(i, va->fmt->num_components, glfmt->type, norm,
                               pass->params.vertex_stride,
                               (void *) (va->offset + vbo_offset));
+        if (gpu->limits.instancing)
+            glVertexAttribDivisor(i, 0);
     }
-}
 
-pl_pass gl_pass_create(pl_gpu gpu, const struct pl_pass_params *params)
-{
-    if (!MAKE_CURRENT())
-        return NULL;
+    if (!inst_buffer)
+        return;
 
-    struct pl_gl *p = PL_PRIV(gpu);
-    struct pl_pass *pass = pl_zalloc_obj(NULL, pass, struct pl_pass_gl);
-    struct pl_pass_gl *pass_gl = PL_PRIV(pass);
-    pass->params = pl_pass_params_copy(pass, params);
+    glBindBuffer(GL_ARRAY_BUFFER, inst_buffer);
+    for (int i = 0; i < pass->params.num_vertex_attribs; i++) {
+        const struct pl_vertex_attrib *va = &pass->params.vertex_attribs[i];
+        const struct gl_format **glfmtp = PL_PRIV(va->fmt);
+        const struct gl_format *glfmt = *glfmtp;
+        if (!va->instanced)
+            continue;
 
-    // Load/Compile program
-    if ((pass_gl->program = load_cached_program(gpu, params))) {
-        PL_DEBUG(gpu, "Using cached GL program");
-    } else {
-        clock_t start = clock();
-        pass_gl->program = gl_compile_program(gpu, params);
-        pl_log_cpu_time(gpu->log, start, clock(), "compiling shader");
+        bool norm = va->fmt->type == PL_FMT_UNORM || va->fmt->type == PL_FMT_SNORM;
+        glEnableVertexAttribArray(i);
+        glVertexAttribPointer(i, va->fmt->num_components, glfmt->type, norm,
+                              pass->params.instance_stride,
+                              (void *) (va->offset + inst_offset));
+        glVertexAttribDivisor(i, 1);
     }
+}
 
-    if (!pass_gl->program)
+// Finishes linking the program (if needed) and sets up the program state.
+// Must be called with the context current.
+static bool gl_pass_finish(pl_gpu gpu, struct pl_pass *pass)
+{
+    struct pl_pass_gl *pass_gl = PL_PRIV(pass);
+    const struct pl_pass_params *params = &pass->params;
+    if (pass_gl->ready || pass_gl->failed)
+        return pass_gl->ready;
+
+    bool linked = false;
+    for (int i = 0; i < 2; i++)
+        linked |= pass_gl->shaders[i];
+    uint64_t start = pl_clock_now();
+    if (linked && !gl_finish_program(gpu, pass_gl->program, pass_gl->shaders))
         goto error;
+    pl_gpu_count_driver(gpu, pl_clock_now() - start);
 
     // Update program cache if possible
     if (gl_test_ext(gpu, "GL_ARB_get_program_binary", 41, 30)) {
@@ -278,7 +399,7 @@ pl_pass gl_pass_create(pl_gpu gpu, const struct pl_pass_params *params)
         }
     }
 
-    glUseProgram(pass_gl->program);
+    bind_program(gpu, pass_gl->program);
     pass_gl->var_locs = pl_calloc(pass, params->num_variables, sizeof(GLint));
 
     for (int i = 0; i < params->num_variables; i++) {
@@ -290,7 +411,7 @@ pl_pass gl_pass_create(pl_gpu gpu, const struct pl_pass_params *params)
         // checked by virtue of the fact that all legal combinations of
         // parameters will have a valid GLSL type name
         if (!pl_var_glsl_type_name(params->variables[i])) {
-            glUseProgram(0);
+            bind_program(gpu, 0);
             PL_ERR(gpu, "Input variable '%s' does not match any known type!",
                    params->variables[i].name);
             goto error;
@@ -305,22 +426,65 @@ pl_pass gl_pass_create(pl_gpu gpu, const struct pl_pass_params *params)
         glUniform1i(loc, params->descriptors[i].binding);
     }
 
-    glUseProgram(0);
+    bind_program(gpu, 0);
+    if (!gl_check_err(gpu, "gl_pass_create"))
+        goto error;
+
+    pass_gl->ready = true;
+    return true;
+
+error:
+    pass_gl->failed = true;
+    return false;
+}
+
+static pl_pass pass_create(pl_gpu gpu, const struct pl_pass_params *params,
+                           bool async)
+{
+    if (!MAKE_CURRENT())
+        return NULL;
+
+    struct pl_gl *p = PL_PRIV(gpu);
+    struct pl_pass *pass = pl_zalloc_obj(NULL, pass, struct pl_pass_gl);
+    struct pl_pass_gl *pass_gl = PL_PRIV(pass);
+    pass->params = pl_pass_params_copy(pass, params);
+
+    // Load/Compile program
+    clock_t start = clock();
+    uint64_t start_ns = pl_clock_now();
+    if ((pass_gl->program = load_cached_program(gpu, params))) {
+        PL_DEBUG(gpu, "Using cached GL program");
+    } else {
+        pass_gl->program = gl_start_program(gpu, params, pass_gl->shaders);
+    }
+    pl_gpu_count_driver(gpu, pl_clock_now() - start_ns);
+
+    if (!pass_gl->program)
+        goto error;
 
     // Initialize the VAO and single vertex buffer
     glGenBuffers(1, &pass_gl->buffer);
     if (p->has_vao) {
         glGenVertexArrays(1, &pass_gl->vao);
         glBindBuffer(GL_ARRAY_BUFFER, pass_gl->buffer);
-        glBindVertexArray(pass_gl->vao);
-        gl_update_va(pass, 0);
-        glBindVertexArray(0);
+        bind_vao(gpu, pass_gl->vao);
+        gl_update_va(gpu, pass, 0, 0, 0);
+        bind_vao(gpu, 0);
         glBindBuffer(GL_ARRAY_BUFFER, 0);
     }
 
     if (!gl_check_err(gpu, "gl_pass_create"))
         goto error;
 
+    // Asynchronous passes are finished by `gl_pass_poll` or `gl_pass_run`
+    if (!async) {
+        bool compiled = pass_gl->shaders[0];
+        if (!gl_pass_finish(gpu, pass))
+            goto error;
+        if (compiled)
+            pl_log_cpu_time(gpu->log, start, clock(), "compiling shader");
+    }
+
     RELEASE_CURRENT();
     return pass;
 
@@ -331,6 +495,44 @@ error:
     return NULL;
 }
 
+pl_pass gl_pass_create(pl_gpu gpu, const struct pl_pass_params *params)
+{
+    return pass_create(gpu, params, false);
+}
+
+pl_pass gl_pass_create_async(pl_gpu gpu, const struct pl_pass_params *params)
+{
+    return pass_create(gpu, params, true);
+}
+
+bool gl_pass_poll(pl_gpu gpu, pl_pass pass, bool block, bool *ok)
+{
+    struct pl_pass_gl *pass_gl = PL_PRIV(pass);
+    if (pass_gl->ready || pass_gl->failed)
+        goto done;
+
+    if (!MAKE_CURRENT()) {
+        *ok = false;
+        return true;
+    }
+
+    if (!block && pass_gl->shaders[0]) {
+        GLint done = GL_FALSE;
+        glGetProgramiv(pass_gl->program, GL_COMPLETION_STATUS_KHR, &done);
+        if (!done) {
+            RELEASE_CURRENT();
+            return false;
+        }
+    }
+
+    gl_pass_finish(gpu, (struct pl_pass *) pass);
+    RELEASE_CURRENT();
+
+done:
+    *ok = pass_gl->ready;
+    return true;
+}
+
 static void update_var(pl_pass pass, const struct pl_var_update *vu)
 {
     struct pl_pass_gl *pass_gl = PL_PRIV(pass);
@@ -404,8 +606,41 @@ static void update_var(pl_pass pass, const struct pl_var_update *vu)
     pl_unreachable();
 }
 
-static void update_desc(pl_pass pass, int index, const struct pl_desc_binding *db)
+static const GLint wraps[PL_TEX_ADDRESS_MODE_COUNT] = {
+    [PL_TEX_ADDRESS_CLAMP]  = GL_CLAMP_TO_EDGE,
+    [PL_TEX_ADDRESS_REPEAT] = GL_REPEAT,
+    [PL_TEX_ADDRESS_MIRROR] = GL_MIRRORED_REPEAT,
+};
+
+static const GLint filters[PL_TEX_SAMPLE_MODE_COUNT] = {
+    [PL_TEX_SAMPLE_NEAREST] = GL_NEAREST,
+    [PL_TEX_SAMPLE_LINEAR]  = GL_LINEAR,
+};
+
+// Returns the (lazily created) sampler object for a given combination
+static GLuint get_sampler(pl_gpu gpu, enum pl_tex_sample_mode sample_mode,
+                          enum pl_tex_address_mode address_mode)
 {
+    struct pl_gl *p = PL_PRIV(gpu);
+    GLuint *sampler = &p->samplers[sample_mode][address_mode];
+    if (!*sampler) {
+        GLint filter = filters[sample_mode];
+        GLint wrap = wraps[address_mode];
+        glGenSamplers(1, sampler);
+        glSamplerParameteri(*sampler, GL_TEXTURE_MIN_FILTER, filter);
+        glSamplerParameteri(*sampler, GL_TEXTURE_MAG_FILTER, filter);
+        glSamplerParameteri(*sampler, GL_TEXTURE_WRAP_S, wrap);
+        glSamplerParameteri(*sampler, GL_TEXTURE_WRAP_T, wrap);
+        glSamplerParameteri(*sampler, GL_TEXTURE_WRAP_R, wrap);
+    }
+
+    return *sampler;
+}
+
+static void update_desc(pl_gpu gpu, pl_pass pass, int index,
+                        const struct pl_desc_binding *db)
+{
+    struct pl_gl *p = PL_PRIV(gpu);
     const struct pl_desc *desc = &pass->params.descriptors[index];
 
     static const GLenum access[] = {
@@ -414,24 +649,19 @@ static void update_desc(pl_pass pass, int index, const struct pl_desc_binding *d
         [PL_DESC_ACCESS_WRITEONLY] = GL_WRITE_ONLY,
     };
 
-    static const GLint wraps[PL_TEX_ADDRESS_MODE_COUNT] = {
-        [PL_TEX_ADDRESS_CLAMP]  = GL_CLAMP_TO_EDGE,
-        [PL_TEX_ADDRESS_REPEAT] = GL_REPEAT,
-        [PL_TEX_ADDRESS_MIRROR] = GL_MIRRORED_REPEAT,
-    };
-
-    static const GLint filters[PL_TEX_SAMPLE_MODE_COUNT] = {
-        [PL_TEX_SAMPLE_NEAREST] = GL_NEAREST,
-        [PL_TEX_SAMPLE_LINEAR]  = GL_LINEAR,
-    };
-
     switch (desc->type) {
     case PL_DESC_SAMPLED_TEX: {
         pl_tex tex = db->object;
         struct pl_tex_gl *tex_gl = PL_PRIV(tex);
-        glActiveTexture(GL_TEXTURE0 + desc->binding);
-        glBindTexture(tex_gl->target, tex_gl->texture);
+        gl_tex_use(gpu, tex);
+        if (p->has_samplers) {
+            GLuint sampler = get_sampler(gpu, db->sample_mode, db->address_mode);
+            bind_unit(gpu, desc->binding, tex_gl->target, tex_gl->texture, sampler);
+            return;
+        }
 
+        bind_unit(gpu, desc->binding, tex_gl->target, tex_gl->texture, 0);
+        set_active_unit(gpu, desc->binding);
         GLint filter = filters[db->sample_mode];
         GLint wrap = wraps[db->address_mode];
         glTexParameteri(tex_gl->target, GL_TEXTURE_MIN_FILTER, filter);
@@ -451,6 +681,7 @@ static void update_desc(pl_pass pass, int index, const struct pl_desc_binding *d
     case PL_DESC_STORAGE_IMG: {
         pl_tex tex = db->object;
         struct pl_tex_gl *tex_gl = PL_PRIV(tex);
+        gl_tex_use(gpu, tex);
         glBindImageTexture(desc->binding, tex_gl->texture, 0, GL_FALSE, 0,
                            access[desc->access], tex_gl->iformat);
         return;
@@ -458,8 +689,9 @@ static void update_desc(pl_pass pass, int index, const struct pl_desc_binding *d
     case PL_DESC_BUF_UNIFORM: {
         pl_buf buf = db->object;
         struct pl_buf_gl *buf_gl = PL_PRIV(buf);
+        size_t size = PL_DEF(db->buf_size, buf->params.size - db->buf_offset);
         glBindBufferRange(GL_UNIFORM_BUFFER, desc->binding, buf_gl->buffer,
-                          buf_gl->offset, buf->params.size);
+                          buf_gl->offset + db->buf_offset, size);
         return;
     }
     case PL_DESC_BUF_STORAGE: {
@@ -481,16 +713,20 @@ static void update_desc(pl_pass pass, int index, const struct pl_desc_binding *d
     pl_unreachable();
 }
 
-static void unbind_desc(pl_pass pass, int index, const struct pl_desc_binding *db)
+static void unbind_desc(pl_gpu gpu, pl_pass pass, int index,
+                        const struct pl_desc_binding *db)
 {
+    struct pl_gl *p = PL_PRIV(gpu);
     const struct pl_desc *desc = &pass->params.descriptors[index];
 
     switch (desc->type) {
     case PL_DESC_SAMPLED_TEX: {
+        // Leave textures bound if nobody else is going to touch them
+        if (p->exclusive)
+            return;
         pl_tex tex = db->object;
         struct pl_tex_gl *tex_gl = PL_PRIV(tex);
-        glActiveTexture(GL_TEXTURE0 + desc->binding);
-        glBindTexture(tex_gl->target, 0);
+        bind_unit(gpu, desc->binding, tex_gl->target, 0, 0);
         return;
     }
     case PL_DESC_STORAGE_IMG: {
@@ -533,13 +769,19 @@ void gl_pass_run(pl_gpu gpu, const struct pl_pass_run_params *params)
     struct pl_pass_gl *pass_gl = PL_PRIV(pass);
     struct pl_gl *p = PL_PRIV(gpu);
 
-    glUseProgram(pass_gl->program);
+    // Passes created by `gl_pass_create_async` may not be finished yet
+    if (!gl_pass_finish(gpu, (struct pl_pass *) pass)) {
+        RELEASE_CURRENT();
+        return;
+    }
+
+    bind_program(gpu, pass_gl->program);
 
     for (int i = 0; i < params->num_var_updates; i++)
         update_var(pass, &params->var_updates[i]);
     for (int i = 0; i < pass->params.num_descriptors; i++)
-        update_desc(pass, i, &params->desc_bindings[i]);
-    glActiveTexture(GL_TEXTURE0);
+        update_desc(gpu, pass, i, &params->desc_bindings[i]);
+    set_active_unit(gpu, 0);
 
     if (!gl_check_err(gpu, "gl_pass_run: updating uniforms")) {
         RELEASE_CURRENT();
@@ -549,6 +791,7 @@ void gl_pass_run(pl_gpu gpu, const struct pl_pass_run_params *params)
     switch (pass->params.type) {
     case PL_PASS_RASTER: {
         struct pl_tex_gl *target_gl = PL_PRIV(params->target);
+        gl_tex_use(gpu, params->target);
         glBindFramebuffer(GL_DRAW_FRAMEBUFFER, target_gl->fbo);
         if (!pass->params.load_target && p->has_invalidate_fb) {
             GLenum fb = target_gl->fbo ? GL_COLOR_ATTACHMENT0 : GL_COLOR;
@@ -594,17 +837,26 @@ void gl_pass_run(pl_gpu gpu, const struct pl_pass_run_params *params)
         }
 
         if (pass_gl->vao)
-            glBindVertexArray(pass_gl->vao);
+            bind_vao(gpu, pass_gl->vao);
 
+        pl_buf inst = params->instance_buf;
+        struct pl_buf_gl *inst_gl = inst ? PL_PRIV(inst) : NULL;
         uint64_t vert_id = vert ? vert_gl->id : 0;
         size_t vert_offset = vert ? params->buf_offset : 0;
+        uint64_t inst_id = inst ? inst_gl->id : 0;
+        size_t inst_offset = inst ? params->instance_offset : 0;
         if (!pass_gl->vao || pass_gl->vao_id != vert_id ||
-             pass_gl->vao_offset != vert_offset)
+             pass_gl->vao_offset != vert_offset ||
+             pass_gl->vao_inst_id != inst_id ||
+             pass_gl->vao_inst_offset != inst_offset)
         {
             // We need to update the VAO when the buffer ID or offset changes
-            gl_update_va(pass, vert_offset);
+            gl_update_va(gpu, pass, vert_offset, inst ? inst_gl->buffer : 0,
+                         inst_offset);
             pass_gl->vao_id = vert_id;
             pass_gl->vao_offset = vert_offset;
+            pass_gl->vao_inst_id = inst_id;
+            pass_gl->vao_inst_offset = inst_offset;
         }
 
         gl_check_err(gpu, "gl_pass_run: update/bind vertex buffer");
@@ -630,8 +882,9 @@ void gl_pass_run(pl_gpu gpu, const struct pl_pass_run_params *params)
             glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, pass_gl->index_buffer);
             glBufferData(GL_ELEMENT_ARRAY_BUFFER, pl_index_buf_size(params),
                          params->index_data, GL_STREAM_DRAW);
-            glDrawElements(mode, params->vertex_count,
-                           index_fmts[params->index_fmt], 0);
+            draw_elements(mode, params->vertex_count,
+                          index_fmts[params->index_fmt], NULL,
+                          params->instance_count);
             glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 
         } else if (params->index_buf) {
@@ -639,21 +892,27 @@ void gl_pass_run(pl_gpu gpu, const struct pl_pass_run_params *params)
             // The pointer argument becomes the index buffer offset
             struct pl_buf_gl *index_gl = PL_PRIV(params->index_buf);
             glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_gl->buffer);
-            glDrawElements(mode, params->vertex_count, GL_UNSIGNED_SHORT,
-                           (void *) params->index_offset);
+            draw_elements(mode, params->vertex_count, GL_UNSIGNED_SHORT,
+                          (void *) params->index_offset, params->instance_count);
             glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 
         } else {
 
             // Note: the VBO offset is handled in the VAO
-            glDrawArrays(mode, 0, params->vertex_count);
+            if (params->instance_count > 1) {
+                glDrawArraysInstanced(mode, 0, params->vertex_count,
+                                      params->instance_count);
+            } else {
+                glDrawArrays(mode, 0, params->vertex_count);
+            }
         }
 
         gl_timer_end(params->timer);
         gl_check_err(gpu, "gl_pass_run: drawing");
 
         if (pass_gl->vao) {
-            glBindVertexArray(0);
+            if (!p->exclusive)
+                bind_vao(gpu, 0);
         } else {
             for (int i = 0; i < pass->params.num_vertex_attribs; i++)
                 glDisableVertexAttribArray(i);
@@ -680,10 +939,11 @@ void gl_pass_run(pl_gpu gpu, const struct pl_pass_run_params *params)
     }
 
     for (int i = 0; i < pass->params.num_descriptors; i++)
-        unbind_desc(pass, i, &params->desc_bindings[i]);
-    glActiveTexture(GL_TEXTURE0);
+        unbind_desc(gpu, pass, i, &params->desc_bindings[i]);
+    set_active_unit(gpu, 0);
 
-    glUseProgram(0);
+    if (!p->exclusive)
+        bind_program(gpu, 0);
     gl_check_err(gpu, "gl_pass_run");
     RELEASE_CURRENT();
 }
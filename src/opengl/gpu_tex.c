@@ -32,6 +32,7 @@ void gl_tex_destroy(pl_gpu gpu, pl_tex tex)
     }
 
     struct pl_tex_gl *tex_gl = PL_PRIV(tex);
+    gl_state_forget_texture(gpu, tex_gl->texture);
     if (tex_gl->fbo && !tex_gl->wrapped_fb)
         glDeleteFramebuffers(1, &tex_gl->fbo);
 #ifdef EPOXY_HAS_EGL
@@ -47,12 +48,46 @@ void gl_tex_destroy(pl_gpu gpu, pl_tex tex)
     if (tex_gl->fd != -1)
         close(tex_gl->fd);
 #endif
+    if (tex_gl->upload_fence)
+        glDeleteSync(tex_gl->upload_fence);
 
     gl_check_err(gpu, "gl_tex_destroy");
     RELEASE_CURRENT();
     pl_free((void *) tex);
 }
 
+void gl_tex_use(pl_gpu gpu, pl_tex tex)
+{
+    struct pl_gl *p = PL_PRIV(gpu);
+    struct pl_tex_gl *tex_gl = PL_PRIV(tex);
+    tex_gl->last_use = p->epoch;
+    if (!tex_gl->upload_fence)
+        return;
+
+    glWaitSync(tex_gl->upload_fence, 0, GL_TIMEOUT_IGNORED);
+    glDeleteSync(tex_gl->upload_fence);
+    tex_gl->upload_fence = NULL;
+
+    // Changes made by another context only become visible once the object
+    // is re-bound, so make sure we don't skip that
+    gl_state_forget_texture(gpu, tex_gl->texture);
+    if (tex_gl->fbo && !tex_gl->wrapped_fb) {
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, tex_gl->fbo);
+        switch (pl_tex_params_dimension(tex->params)) {
+        case 1:
+            glFramebufferTexture1D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                                   GL_TEXTURE_1D, tex_gl->texture, 0);
+            break;
+        case 2:
+            glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                                   GL_TEXTURE_2D, tex_gl->texture, 0);
+            break;
+        case 3: pl_unreachable();
+        }
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+    }
+}
+
 static GLbitfield tex_barrier(pl_tex tex)
 {
     GLbitfield barrier = 0;
@@ -237,6 +272,17 @@ static bool gl_tex_export(pl_gpu gpu, enum pl_handle_type handle_type,
             goto error;
         }
 
+        // EGL offers no control over the modifier, so just verify that the
+        // one picked by the driver is acceptable to the consumer
+        bool mod_ok = !tex->params.num_export_modifiers;
+        for (int i = 0; i < tex->params.num_export_modifiers; i++)
+            mod_ok |= tex->params.export_modifiers[i] == modifier;
+        if (!mod_ok) {
+            PL_ERR(gpu, "Exported DRM format modifier %s is not supported by "
+                   "the consumer!", PRINT_DRM_MOD(modifier));
+            goto error;
+        }
+
         int offset = 0, stride = 0;
         ok = eglExportDMABUFImageMESA(p->egl_dpy,
                                       tex_gl->image,
@@ -337,6 +383,7 @@ pl_tex gl_tex_create(pl_gpu gpu, const struct pl_tex_params *params)
         .type = fmt->type,
         .barrier = tex_barrier(tex),
         .fd = -1,
+        .last_use = p->epoch,
     };
 
     static const GLint targets[] = {
@@ -350,7 +397,7 @@ pl_tex gl_tex_create(pl_gpu gpu, const struct pl_tex_params *params)
     tex_gl->target = targets[dims];
 
     glGenTextures(1, &tex_gl->texture);
-    glBindTexture(tex_gl->target, tex_gl->texture);
+    gl_bind_texture(gpu, tex_gl->target, tex_gl->texture);
 
     if (params->import_handle) {
         if (!gl_tex_import(gpu, params->import_handle, &params->shared_mem, tex))
@@ -380,9 +427,11 @@ pl_tex gl_tex_create(pl_gpu gpu, const struct pl_tex_params *params)
     if (params->export_handle) {
         if (!gl_tex_export(gpu, params->export_handle, params->initial_data, tex))
             goto error;
+        tex->params.export_modifiers = NULL;
+        tex->params.num_export_modifiers = 0;
     }
 
-    glBindTexture(tex_gl->target, 0);
+    gl_bind_texture(gpu, tex_gl->target, 0);
 
     if (!gl_check_err(gpu, "gl_tex_create: texture"))
         goto error;
@@ -740,6 +789,8 @@ pl_tex pl_opengl_wrap(pl_gpu gpu, const struct pl_opengl_wrap_params *params)
     }
 
     tex_gl->barrier = tex_barrier(tex);
+    tex_gl->last_use = p->epoch;
+    pl_gpu_track_tex(gpu, tex);
     RELEASE_CURRENT();
     return tex;
 
@@ -767,6 +818,13 @@ unsigned int pl_opengl_unwrap(pl_gpu gpu, pl_tex tex,
     if (out_fbo)
         *out_fbo = tex_gl->fbo;
 
+    // The user may access the texture directly from here on
+    struct pl_gl *p = PL_PRIV(gpu);
+    if (p->has_upload_ctx && MAKE_CURRENT()) {
+        gl_tex_use(gpu, tex);
+        RELEASE_CURRENT();
+    }
+
     return tex_gl->texture;
 }
 
@@ -777,6 +835,7 @@ void gl_tex_invalidate(pl_gpu gpu, pl_tex tex)
     if (!MAKE_CURRENT())
         return;
 
+    gl_tex_use(gpu, tex);
     if (tex_gl->texture && p->has_invalidate_tex)
         glInvalidateTexImage(tex_gl->texture, 0);
 
@@ -791,6 +850,25 @@ void gl_tex_invalidate(pl_gpu gpu, pl_tex tex)
     RELEASE_CURRENT();
 }
 
+void gl_tex_reset_import(pl_gpu gpu, pl_tex tex)
+{
+#ifdef EPOXY_HAS_EGL
+    struct pl_tex_gl *tex_gl = PL_PRIV(tex);
+    if (!tex_gl->image || !MAKE_CURRENT())
+        return;
+
+    // Some drivers only latch the buffer contents when the EGLImage is bound
+    // to the texture, so re-specify it to pick up what the external producer
+    // wrote in the meantime. This is still far cheaper than re-importing.
+    gl_bind_texture(gpu, tex_gl->target, tex_gl->texture);
+    glEGLImageTargetTexture2DOES(tex_gl->target, tex_gl->image);
+    egl_check_err(gpu, "EGLImageTargetTexture2DOES");
+    gl_bind_texture(gpu, tex_gl->target, 0);
+    gl_check_err(gpu, "gl_tex_reset_import");
+    RELEASE_CURRENT();
+#endif
+}
+
 void gl_tex_clear_ex(pl_gpu gpu, pl_tex tex, const union pl_clear_color color)
 {
     if (!MAKE_CURRENT())
@@ -798,6 +876,7 @@ void gl_tex_clear_ex(pl_gpu gpu, pl_tex tex, const union pl_clear_color color)
 
     struct pl_tex_gl *tex_gl = PL_PRIV(tex);
     pl_assert(tex_gl->fbo || tex_gl->wrapped_fb);
+    gl_tex_use(gpu, tex);
 
     switch (tex->params.format->type) {
     case PL_FMT_UNKNOWN:
@@ -836,6 +915,8 @@ void gl_tex_blit(pl_gpu gpu, const struct pl_tex_blit_params *params)
 
     pl_assert(src_gl->fbo || src_gl->wrapped_fb);
     pl_assert(dst_gl->fbo || dst_gl->wrapped_fb);
+    gl_tex_use(gpu, params->src);
+    gl_tex_use(gpu, params->dst);
     glBindFramebuffer(GL_READ_FRAMEBUFFER, src_gl->fbo);
     glBindFramebuffer(GL_DRAW_FRAMEBUFFER, dst_gl->fbo);
 
@@ -866,33 +947,16 @@ static int get_alignment(size_t pitch)
     return 1;
 }
 
-bool gl_tex_upload(pl_gpu gpu, const struct pl_tex_transfer_params *params)
+// Issues the actual upload commands, for a texture already bound to the
+// current context. `src` is either a host pointer or an offset into the
+// bound GL_PIXEL_UNPACK_BUFFER.
+static void upload_rect(pl_gpu gpu, const struct pl_tex_transfer_params *params,
+                        uintptr_t src)
 {
     struct pl_gl *p = PL_PRIV(gpu);
     pl_tex tex = params->tex;
     pl_fmt fmt = tex->params.format;
-    pl_buf buf = params->buf;
     struct pl_tex_gl *tex_gl = PL_PRIV(tex);
-    struct pl_buf_gl *buf_gl = buf ? PL_PRIV(buf) : NULL;
-
-    // If the user requests asynchronous uploads, it's more efficient to do
-    // them via a PBO - this allows us to skip blocking the caller, especially
-    // when the host pointer can be imported directly.
-    if (params->callback && !buf) {
-        size_t buf_size = pl_tex_transfer_size(params);
-        const size_t min_size = 32*1024; // 32 KiB
-        if (buf_size >= min_size && buf_size <= gpu->limits.max_buf_size)
-            return pl_tex_upload_pbo(gpu, params);
-    }
-
-    if (!MAKE_CURRENT())
-        return false;
-
-    uintptr_t src = (uintptr_t) params->ptr;
-    if (buf) {
-        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buf_gl->buffer);
-        src = buf_gl->offset + params->buf_offset;
-    }
 
     bool misaligned = params->row_pitch % fmt->texel_size;
     int stride_w = params->row_pitch / fmt->texel_size;
@@ -920,9 +984,6 @@ bool gl_tex_upload(pl_gpu gpu, const struct pl_tex_transfer_params *params)
         }
     }
 
-    glBindTexture(tex_gl->target, tex_gl->texture);
-    gl_timer_begin(params->timer);
-
     switch (dims) {
     case 1:
         glTexSubImage1D(tex_gl->target, 0, params->rc.x0, pl_rect_w(params->rc),
@@ -950,25 +1011,137 @@ bool gl_tex_upload(pl_gpu gpu, const struct pl_tex_transfer_params *params)
         break;
     }
 
-    gl_timer_end(params->timer);
-    glBindTexture(tex_gl->target, 0);
     glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
     if (p->has_stride)
         glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
     if (p->has_unpack_image_height)
         glPixelStorei(GL_UNPACK_IMAGE_HEIGHT, 0);
+}
+
+// Performs a host pointer upload on the upload context. Returns false if the
+// upload needs to happen on the main context instead, because the main
+// context may still have commands accessing `tex` pending, in which case
+// `*ok` is left untouched.
+static bool upload_shared(pl_gpu gpu, const struct pl_tex_transfer_params *params,
+                          bool *ok)
+{
+    struct pl_gl *p = PL_PRIV(gpu);
+    struct pl_tex_gl *tex_gl = PL_PRIV(params->tex);
+
+    // If accessed since the last flush, there's nothing we could wait on.
+    // (The epoch only ever advances, so checking this early is fine)
+    pl_mutex_lock(&p->sync_lock);
+    bool pending = tex_gl->last_use == p->epoch;
+    pl_mutex_unlock(&p->sync_lock);
+    if (pending || !gl_make_current_upload(p->gl))
+        return false;
+
+    pl_mutex_lock(&p->sync_lock);
+    if (tex_gl->last_use && p->epoch_fence)
+        glWaitSync(p->epoch_fence, 0, GL_TIMEOUT_IGNORED);
+    pl_mutex_unlock(&p->sync_lock);
+
+    // Don't touch the main context's shadow state from here
+    glBindTexture(tex_gl->target, tex_gl->texture);
+    upload_rect(gpu, params, (uintptr_t) params->ptr);
+    glBindTexture(tex_gl->target, 0);
+
+    if (tex_gl->upload_fence)
+        glDeleteSync(tex_gl->upload_fence);
+    tex_gl->upload_fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
 
+    if (params->callback) {
+        struct gl_cb cb = {
+            .sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0),
+            .callback = params->callback,
+            .priv = params->priv,
+        };
+
+        pl_mutex_lock(&p->sync_lock);
+        PL_ARRAY_APPEND(NULL, p->upload_cbs, cb);
+        pl_mutex_unlock(&p->sync_lock);
+    }
+
+    // Required for the fences to be waited on from the main context
+    glFlush();
+
+    // Avoid `gl_check_err`, which polls the main context's callbacks
+    *ok = true;
+    GLenum err;
+    while ((err = glGetError()) != GL_NO_ERROR) {
+        PL_ERR(gpu, "gl_tex_upload: OpenGL error on upload context: %s",
+               gl_err_str(err));
+        *ok = false;
+    }
+
+    gl_release_current_upload(p->gl);
+    return true;
+}
+
+bool gl_tex_upload(pl_gpu gpu, const struct pl_tex_transfer_params *params)
+{
+    struct pl_gl *p = PL_PRIV(gpu);
+    pl_tex tex = params->tex;
+    pl_buf buf = params->buf;
+    struct pl_tex_gl *tex_gl = PL_PRIV(tex);
+    struct pl_buf_gl *buf_gl = buf ? PL_PRIV(buf) : NULL;
+
+    bool ok;
+    if (p->has_upload_ctx && !buf && !params->timer &&
+        upload_shared(gpu, params, &ok))
+    {
+        return ok;
+    }
+
+    // If the user requests asynchronous uploads, it's more efficient to do
+    // them via a PBO - this allows us to skip blocking the caller, especially
+    // when the host pointer can be imported directly.
+    if (params->callback && !buf) {
+        size_t buf_size = pl_tex_transfer_size(params);
+        const size_t min_size = 32*1024; // 32 KiB
+        if (buf_size >= min_size && buf_size <= gpu->limits.max_buf_size)
+            return pl_tex_upload_pbo(gpu, params);
+    }
+
+    if (!MAKE_CURRENT())
+        return false;
+
+    gl_tex_use(gpu, tex);
+    uintptr_t src = (uintptr_t) params->ptr;
+    GLuint stream = 0;
     if (buf) {
-        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
-        if (buf->params.host_mapped) {
-            // Make sure the PBO is not reused until GL is done with it. If a
-            // previous operation is pending, "update" it by creating a new
-            // fence that will cover the previous operation as well.
-            glDeleteSync(buf_gl->fence);
-            buf_gl->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buf_gl->buffer);
+        src = buf_gl->offset + params->buf_offset;
+    } else {
+        // Stage host pointer uploads through the streaming buffer, if
+        // possible, to avoid the driver making its own (blocking) copy
+        size_t size = pl_tex_transfer_size(params);
+        size_t offset;
+        void *ptr = gl_stream_alloc(gpu, size, gpu->limits.align_tex_xfer_offset,
+                                    &stream, &offset);
+        if (ptr) {
+            memcpy(ptr, params->ptr, size);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, stream);
+            src = offset;
         }
     }
 
+    gl_bind_texture(gpu, tex_gl->target, tex_gl->texture);
+    gl_timer_begin(params->timer);
+    upload_rect(gpu, params, src);
+    gl_timer_end(params->timer);
+    gl_bind_texture(gpu, tex_gl->target, 0);
+
+    if (buf || stream)
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    if (buf && buf->params.host_mapped) {
+        // Make sure the PBO is not reused until GL is done with it. If a
+        // previous operation is pending, "update" it by creating a new
+        // fence that will cover the previous operation as well.
+        glDeleteSync(buf_gl->fence);
+        buf_gl->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
     if (params->callback) {
         PL_ARRAY_APPEND(gpu, p->callbacks, (struct gl_cb) {
             .sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0),
@@ -977,11 +1150,85 @@ bool gl_tex_upload(pl_gpu gpu, const struct pl_tex_transfer_params *params)
         });
     }
 
-    bool ok = gl_check_err(gpu, "gl_tex_upload");
+    ok = gl_check_err(gpu, "gl_tex_upload");
     RELEASE_CURRENT();
     return ok;
 }
 
+struct readback_ctx {
+    struct gl_readback *slot;
+    void *dst;
+    size_t size;
+    void (*callback)(void *priv);
+    void *priv;
+};
+
+static void readback_cb(void *priv)
+{
+    struct readback_ctx *ctx = priv;
+    memcpy(ctx->dst, ctx->slot->buf->data, ctx->size);
+    ctx->slot->busy = false;
+    ctx->callback(ctx->priv);
+    pl_free(ctx);
+}
+
+// Returns a free readback slot with room for at least `size` bytes, or NULL
+// if all slots are still in use
+static struct gl_readback *get_readback_slot(pl_gpu gpu, size_t size)
+{
+    struct pl_gl *p = PL_PRIV(gpu);
+    for (int i = 0; i < GL_READBACK_SLOTS; i++) {
+        int idx = (p->readback_idx + i) % GL_READBACK_SLOTS;
+        struct gl_readback *slot = &p->readback[idx];
+        if (slot->busy)
+            continue;
+
+        if (!slot->buf || slot->buf->params.size < size) {
+            pl_buf_destroy(gpu, &slot->buf);
+            slot->buf = pl_buf_create(gpu, pl_buf_params(
+                .size = PL_MIN(PL_ALIGN_POT(size), gpu->limits.max_mapped_size),
+                .host_mapped = true,
+                .debug_tag = PL_DEBUG_TAG,
+            ));
+            if (!slot->buf)
+                return NULL;
+        }
+
+        p->readback_idx = (idx + 1) % GL_READBACK_SLOTS;
+        return slot;
+    }
+
+    return NULL;
+}
+
+// Performs an asynchronous download into a readback slot, which is copied
+// out to the user's pointer from the completion callback
+static bool tex_download_readback(pl_gpu gpu, struct gl_readback *slot,
+                                  const struct pl_tex_transfer_params *params)
+{
+    struct pl_tex_transfer_params fixed = *params;
+    fixed.ptr = NULL;
+    fixed.buf = slot->buf;
+    fixed.buf_offset = 0;
+    fixed.callback = readback_cb;
+    fixed.priv = pl_alloc_struct(NULL, struct readback_ctx, {
+        .slot = slot,
+        .dst = params->ptr,
+        .size = pl_tex_transfer_size(params),
+        .callback = params->callback,
+        .priv = params->priv,
+    });
+
+    slot->busy = true;
+    if (!gl_tex_download(gpu, &fixed)) {
+        slot->busy = false;
+        pl_free(fixed.priv);
+        return false;
+    }
+
+    return true;
+}
+
 bool gl_tex_download(pl_gpu gpu, const struct pl_tex_transfer_params *params)
 {
     struct pl_gl *p = PL_PRIV(gpu);
@@ -995,6 +1242,18 @@ bool gl_tex_download(pl_gpu gpu, const struct pl_tex_transfer_params *params)
     if (params->callback && !buf) {
         size_t buf_size = pl_tex_transfer_size(params);
         const size_t min_size = 32*1024; // 32 KiB
+        bool can_import = gpu->import_caps.buf & PL_HANDLE_HOST_PTR;
+
+        // Prefer reusing one of our persistently mapped PBOs, unless we can
+        // import the destination directly (which avoids the extra memcpy)
+        if (!(can_import && buf_size >= min_size) &&
+            buf_size <= gpu->limits.max_mapped_size)
+        {
+            struct gl_readback *slot = get_readback_slot(gpu, buf_size);
+            if (slot)
+                return tex_download_readback(gpu, slot, params);
+        }
+
         if (buf_size >= min_size && buf_size <= gpu->limits.max_buf_size)
             return pl_tex_download_pbo(gpu, params);
     }
@@ -1002,6 +1261,7 @@ bool gl_tex_download(pl_gpu gpu, const struct pl_tex_transfer_params *params)
     if (!MAKE_CURRENT())
         return false;
 
+    gl_tex_use(gpu, tex);
     uintptr_t dst = (uintptr_t) params->ptr;
     if (buf) {
         glBindBuffer(GL_PIXEL_PACK_BUFFER, buf_gl->buffer);
@@ -1056,9 +1316,9 @@ bool gl_tex_download(pl_gpu gpu, const struct pl_tex_transfer_params *params)
             glPixelStorei(GL_PACK_ROW_LENGTH, 0);
     } else if (is_copy) {
         // We're downloading the entire texture
-        glBindTexture(tex_gl->target, tex_gl->texture);
+        gl_bind_texture(gpu, tex_gl->target, tex_gl->texture);
         glGetTexImage(tex_gl->target, 0, tex_gl->format, tex_gl->type, (void *) dst);
-        glBindTexture(tex_gl->target, 0);
+        gl_bind_texture(gpu, tex_gl->target, 0);
     } else {
         PL_ERR(gpu, "Partial downloads of 3D textures not implemented!");
         ok = false;
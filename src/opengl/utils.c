@@ -40,6 +40,13 @@ const char *gl_err_str(GLenum err)
 void gl_poll_callbacks(pl_gpu gpu)
 {
     struct pl_gl *gl = PL_PRIV(gpu);
+    if (gl->has_upload_ctx) {
+        pl_mutex_lock(&gl->sync_lock);
+        PL_ARRAY_CONCAT(gpu, gl->callbacks, gl->upload_cbs);
+        gl->upload_cbs.num = 0;
+        pl_mutex_unlock(&gl->sync_lock);
+    }
+
     while (gl->callbacks.num) {
         struct gl_cb cb = gl->callbacks.elem[0];
         GLenum res = glClientWaitSync(cb.sync, 0, 0);
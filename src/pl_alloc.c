@@ -25,6 +25,7 @@ struct header {
     size_t size;
     struct header *parent;
     struct ext *ext;
+    struct arena *arena; // owning arena (including the arena's own root)
 
     // Pointer to actual data, for alignment purposes
     intmax_t data[1];
@@ -42,6 +43,22 @@ struct ext {
 #define MAX_ALLOC (SIZE_MAX - PTR_OFFSET)
 #define MINIMUM_CHILDREN 4
 
+// Bump allocator backing `pl_arena_new` and the children of a `pl_ref`.
+// Allocations served by an arena are not attached to their parent, and only
+// released all at once.
+struct arena_chunk {
+    struct arena_chunk *next;
+    size_t size, used;
+    max_align_t data[];
+};
+
+struct arena {
+    struct header *root;
+    struct arena_chunk *first, *last, *cur;
+};
+
+#define ARENA_CHUNK_SIZE 4096
+
 static inline struct header *get_header(void *ptr)
 {
     if (!ptr)
@@ -61,6 +78,62 @@ static inline void *oom(void)
     abort();
 }
 
+static struct header *arena_alloc(struct arena *a, size_t size)
+{
+    size_t total = PL_ALIGN_MEM(PTR_OFFSET + size);
+    while (a->cur && a->cur->used + total > a->cur->size)
+        a->cur = a->cur->next;
+
+    if (!a->cur) {
+        size_t chunk_size = PL_ALIGN_MEM(total > ARENA_CHUNK_SIZE ? total : ARENA_CHUNK_SIZE);
+        struct arena_chunk *c = malloc(sizeof(*c) + chunk_size);
+        if (!c)
+            oom();
+        c->next = NULL;
+        c->size = chunk_size;
+        c->used = 0;
+        if (a->last) {
+            a->last->next = c;
+        } else {
+            a->first = c;
+        }
+        a->last = a->cur = c;
+    }
+
+    struct header *h = (struct header *) ((char *) a->cur->data + a->cur->used);
+    a->cur->used += total;
+
+#ifndef NDEBUG
+    h->magic = MAGIC;
+#endif
+    h->size = size;
+    h->parent = NULL;
+    h->ext = NULL;
+    h->arena = a;
+    return h;
+}
+
+static void arena_reset(struct arena *a)
+{
+    for (struct arena_chunk *c = a->first; c; c = c->next)
+        c->used = 0;
+    a->cur = a->first;
+}
+
+static void arena_destroy(struct arena *a)
+{
+    for (struct arena_chunk *c = a->first, *next; c; c = next) {
+        next = c->next;
+        free(c);
+    }
+    free(a);
+}
+
+static inline bool is_arena_child(struct header *h)
+{
+    return h->arena && h->arena->root != h;
+}
+
 static inline struct ext *alloc_ext(struct header *h)
 {
     if (!h)
@@ -120,6 +193,10 @@ void *pl_alloc(void *parent, size_t size)
     if (size >= MAX_ALLOC)
         return oom();
 
+    struct header *ph = get_header(parent);
+    if (ph && ph->arena)
+        return arena_alloc(ph->arena, size)->data;
+
     struct header *h = malloc(PTR_OFFSET + size);
     if (!h)
         return oom();
@@ -129,8 +206,9 @@ void *pl_alloc(void *parent, size_t size)
 #endif
     h->size = size;
     h->ext = NULL;
+    h->arena = NULL;
 
-    attach_child(get_header(parent), h);
+    attach_child(ph, h);
     return h->data;
 }
 
@@ -139,6 +217,13 @@ void *pl_zalloc(void *parent, size_t size)
     if (size >= MAX_ALLOC)
         return oom();
 
+    struct header *ph = get_header(parent);
+    if (ph && ph->arena) {
+        struct header *h = arena_alloc(ph->arena, size);
+        memset(h->data, 0, size);
+        return h->data;
+    }
+
     struct header *h = calloc(1, PTR_OFFSET + size);
     if (!h)
         return oom();
@@ -160,6 +245,17 @@ void *pl_realloc(void *parent, void *ptr, size_t size)
         return pl_alloc(parent, size);
 
     struct header *h = get_header(ptr);
+    if (is_arena_child(h)) {
+        if (size <= h->size) {
+            h->size = size;
+            return ptr;
+        }
+
+        struct header *new_h = arena_alloc(h->arena, size);
+        memcpy(new_h->data, h->data, h->size);
+        return new_h->data;
+    }
+
     assert(get_header(parent) == h->parent);
     if (h->size == size)
         return ptr;
@@ -196,12 +292,14 @@ done_reparenting:
 void pl_free(void *ptr)
 {
     struct header *h = get_header(ptr);
-    if (!h)
-        return;
+    if (!h || is_arena_child(h))
+        return; // arena allocations are only freed together with the arena
 
     pl_free_children(ptr);
     unlink_child(h->parent, h);
 
+    if (h->arena)
+        arena_destroy(h->arena);
     free(h->ext);
     free(h);
 }
@@ -221,6 +319,7 @@ void pl_free_children(void *ptr)
         h->ext->children[i]->parent = NULL; // prevent recursive access
         pl_free(h->ext->children[i]->data);
     }
+    h->ext->num_children = 0;
 
 #ifndef NDEBUG
     h->magic = MAGIC;
@@ -239,6 +338,7 @@ void *pl_steal(void *parent, void *ptr)
     if (!h)
         return NULL;
 
+    assert(!is_arena_child(h));
     struct header *new_par = get_header(parent);
     if (new_par != h->parent) {
         unlink_child(h->parent, h);
@@ -284,20 +384,51 @@ char *pl_strndup0(void *parent, const char *str, size_t size)
     return new;
 }
 
+static void *arena_new(void *parent, size_t size)
+{
+    void *ptr = pl_zalloc(parent, size);
+    struct header *h = get_header(ptr);
+    assert(!h->arena);
+    h->arena = calloc(1, sizeof(struct arena));
+    if (!h->arena)
+        return oom();
+    h->arena->root = h;
+    return ptr;
+}
+
+void *pl_arena_new(void *parent)
+{
+    return arena_new(parent, 0);
+}
+
+void pl_arena_reset(void *arena)
+{
+    struct header *h = get_header(arena);
+    assert(h->arena && h->arena->root == h);
+    pl_free_children(arena);
+    arena_reset(h->arena);
+}
+
 struct pl_ref {
     pl_rc_t rc;
 };
 
 struct pl_ref *pl_ref_new(void *parent)
 {
-    struct pl_ref *ref = pl_zalloc_ptr(parent, ref);
-    if (!ref)
-        return oom();
-
+    struct pl_ref *ref = arena_new(parent, sizeof(*ref));
     pl_rc_init(&ref->rc);
     return ref;
 }
 
+bool pl_ref_reset(struct pl_ref *ref)
+{
+    if (pl_rc_count(&ref->rc) > 1)
+        return false;
+
+    pl_arena_reset(ref);
+    return true;
+}
+
 struct pl_ref *pl_ref_dup(struct pl_ref *ref)
 {
     if (!ref)
@@ -19,6 +19,7 @@
 
 #include <stdalign.h>
 #include <stdarg.h>
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <string.h>
@@ -95,16 +96,36 @@ char *pl_strndup0(void *parent, const char *str, size_t size);
 #define pl_zalloc_obj(parent, ptr, priv) \
     (__typeof__(ptr)) pl_zalloc(parent, PL_ALIGN_MEM(sizeof(*(ptr))) + sizeof(priv))
 
+// Bump allocator for short-lived allocations sharing the same lifetime, e.g.
+// per-frame temporaries. The arena itself is a regular allocation (freed with
+// `pl_free`), but all of its children are bump-allocated from memory owned by
+// the arena, with the same restrictions as the children of a `pl_ref`.
+void *pl_arena_new(void *parent);
+
+// Frees all children of an arena, while keeping their memory around for
+// future allocations.
+void pl_arena_reset(void *arena);
+
 // Refcounting helper
 
 struct pl_ref;
 
 // pl_ref_deref will free the ref and all of its children as soon as the
 // internal refcount reaches 0
+//
+// Children of a ref are bump-allocated from memory owned by the ref, since
+// they all share the same lifetime. Freeing them individually is a no-op, and
+// growing them with `pl_realloc` leaves the old copy behind until the ref is
+// freed or reset. They can't be moved to another parent with `pl_steal`.
 struct pl_ref *pl_ref_new(void *parent);
 struct pl_ref *pl_ref_dup(struct pl_ref *ref);
 void pl_ref_deref(struct pl_ref **ref);
 
+// If `ref` holds the only reference, frees all of its children while keeping
+// their memory around for future allocations, and returns true. Otherwise,
+// does nothing and returns false.
+bool pl_ref_reset(struct pl_ref *ref);
+
 // Helper functions for dealing with arrays
 
 #define PL_ARRAY(type) struct { type *elem; int num; }
@@ -0,0 +1,85 @@
+/*
+ * This file is part of libplacebo.
+ *
+ * libplacebo is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * libplacebo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with libplacebo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "common.h"
+
+#ifdef PL_HAVE_WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+// Returns the current time of a monotonic clock, in nanoseconds. The
+// reference point is arbitrary, so only differences are meaningful.
+static inline uint64_t pl_clock_now(void)
+{
+#ifdef PL_HAVE_WIN32
+    LARGE_INTEGER freq, now;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&now);
+    uint64_t sec = now.QuadPart / freq.QuadPart,
+             rem = now.QuadPart % freq.QuadPart;
+    return sec * 1000000000LLU + rem * 1000000000LLU / freq.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LLU + ts.tv_nsec;
+#endif
+}
+
+// Lightweight CPU profiler, which attributes the elapsed time to one of a
+// fixed set of mutually exclusive sections at a time. Switching sections
+// charges the time since the last switch to the previously active section,
+// which keeps the accounting correct across early returns and error paths
+// as long as the profiler is eventually stopped.
+//
+// Only enabled if built with `-Dcpu-profiling=true`. Otherwise, these are
+// all no-ops, and the section times stay at 0.
+#define PL_PROF_MAX_SECTIONS 8
+
+struct pl_prof {
+    uint64_t times[PL_PROF_MAX_SECTIONS]; // cumulative, in nanoseconds
+    uint64_t last;  // time of the last switch
+    int section;    // currently active section, or -1 if stopped
+};
+
+#define PL_PROF_INIT { .section = -1 }
+
+#ifdef PL_CPU_PROFILE
+
+static inline void pl_prof_enter(struct pl_prof *prof, int section)
+{
+    const uint64_t now = pl_clock_now();
+    if (prof->section >= 0)
+        prof->times[prof->section] += now - prof->last;
+    prof->section = section;
+    prof->last = now;
+}
+
+static inline void pl_prof_stop(struct pl_prof *prof)
+{
+    pl_prof_enter(prof, -1);
+}
+
+#else // !PL_CPU_PROFILE
+
+static inline void pl_prof_enter(struct pl_prof *prof, int section) {}
+static inline void pl_prof_stop(struct pl_prof *prof) {}
+
+#endif
@@ -139,8 +139,15 @@ static inline pl_str pl_str_getline(pl_str str, pl_str *out_rest)
 // ignored. When successful, this allocates a new array to store the output.
 bool pl_str_decode_hex(void *alloc, pl_str hex, pl_str *out);
 
-// Compute a fast 64-bit hash
+// Compute a fast 64-bit hash. The result is the same on all platforms, but
+// may change between versions of libplacebo. Anything persisting these hashes
+// to disk should also store `PL_MEM_HASH_ID` and compare it on load.
 uint64_t pl_mem_hash(const void *mem, size_t size);
+#define PL_MEM_HASH_ID 0x31485957 // "WYH1"
+
+// Slower 64-bit hash (SipHash-2-4), for values whose stability across
+// libplacebo versions is part of the public API
+uint64_t pl_siphash(const void *mem, size_t size);
 static inline void pl_hash_merge(uint64_t *accum, uint64_t hash) {
     *accum ^= hash + 0x9e3779b9 + (*accum << 6) + (*accum >> 2);
 }
@@ -0,0 +1,254 @@
+/*
+ * This file is part of libplacebo.
+ *
+ * libplacebo is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * libplacebo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with libplacebo. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "common.h"
+#include "log.h"
+#include "pl_thread.h"
+#include "pl_thread_pool.h"
+
+#ifdef PL_HAVE_UNIX
+#include <unistd.h>
+#elif defined(PL_HAVE_WIN32)
+#include <windows.h>
+#endif
+
+enum job_state {
+    JOB_PENDING,
+    JOB_RUNNING,
+    JOB_DONE,
+};
+
+struct pl_job_t {
+    // One reference is held by the submitter, and one by the pool the job
+    // was queued on, since either one may end up running it
+    pl_rc_t rc;
+    atomic_int state;
+    void (*fn)(void *arg);
+    void *arg;
+
+    pl_mutex lock;
+    pl_cond done; // signaled when `state` becomes JOB_DONE
+};
+
+struct pl_thread_pool {
+    pl_mutex lock;
+    pl_cond wakeup; // signaled when jobs are queued, or on exit
+    PL_ARRAY(pl_job) queue;
+    PL_ARRAY(pl_thread) threads;
+    int max_threads;
+    int idle_threads;
+    bool exit;
+};
+
+static int num_cpus(void)
+{
+    long num = 0;
+#ifdef PL_HAVE_UNIX
+    num = sysconf(_SC_NPROCESSORS_ONLN);
+#elif defined(PL_HAVE_WIN32)
+    SYSTEM_INFO sysInfo;
+    GetSystemInfo(&sysInfo);
+    num = sysInfo.dwNumberOfProcessors;
+#endif
+    return PL_CLAMP(num, 1, 64);
+}
+
+static void job_unref(pl_job job)
+{
+    // Needs acquire semantics as well, since the last reference may be
+    // dropped on a different thread than the one that finished the job
+    if (atomic_fetch_sub_explicit(&job->rc, 1, memory_order_acq_rel) != 1)
+        return;
+
+    pl_cond_destroy(&job->done);
+    pl_mutex_destroy(&job->lock);
+    pl_free(job);
+}
+
+// Moves `job` from JOB_PENDING to JOB_RUNNING, returning false if it has
+// already been claimed by someone else
+static bool job_claim(pl_job job)
+{
+    int expected = JOB_PENDING;
+    return atomic_compare_exchange_strong(&job->state, &expected, JOB_RUNNING);
+}
+
+static void job_finish(pl_job job)
+{
+    pl_mutex_lock(&job->lock);
+    atomic_store(&job->state, JOB_DONE);
+    pl_cond_broadcast(&job->done);
+    pl_mutex_unlock(&job->lock);
+}
+
+// Entry point for pool threads (internal or external)
+static void job_entry(void *priv)
+{
+    pl_job job = priv;
+    if (job_claim(job)) {
+        job->fn(job->arg);
+        job_finish(job);
+    }
+
+    job_unref(job);
+}
+
+static PL_THREAD_VOID pool_thread(void *arg)
+{
+    struct pl_thread_pool *pool = arg;
+
+    pl_mutex_lock(&pool->lock);
+    for (;;) {
+        while (!pool->queue.num && !pool->exit) {
+            pool->idle_threads++;
+            pl_cond_wait(&pool->wakeup, &pool->lock);
+            pool->idle_threads--;
+        }
+
+        if (!pool->queue.num)
+            break; // exit
+
+        pl_job job = pool->queue.elem[0];
+        PL_ARRAY_REMOVE_AT(pool->queue, 0);
+        pl_mutex_unlock(&pool->lock);
+        job_entry(job);
+        pl_mutex_lock(&pool->lock);
+    }
+    pl_mutex_unlock(&pool->lock);
+
+    PL_THREAD_RETURN();
+}
+
+struct pl_thread_pool *pl_thread_pool_create(void)
+{
+    struct pl_thread_pool *pool = pl_zalloc_ptr(NULL, pool);
+    pool->max_threads = num_cpus();
+    pl_mutex_init(&pool->lock);
+    pl_cond_init(&pool->wakeup);
+    return pool;
+}
+
+void pl_thread_pool_destroy(struct pl_thread_pool **ppool)
+{
+    struct pl_thread_pool *pool = *ppool;
+    if (!pool)
+        return;
+
+    // Threads drain all remaining jobs before exiting
+    pl_mutex_lock(&pool->lock);
+    pool->exit = true;
+    pl_cond_broadcast(&pool->wakeup);
+    pl_mutex_unlock(&pool->lock);
+    for (int i = 0; i < pool->threads.num; i++)
+        pl_thread_join(pool->threads.elem[i]);
+
+    pl_assert(!pool->queue.num);
+    pl_cond_destroy(&pool->wakeup);
+    pl_mutex_destroy(&pool->lock);
+    pl_free_ptr(ppool);
+}
+
+static bool pool_push(struct pl_thread_pool *pool, pl_job job)
+{
+    pl_mutex_lock(&pool->lock);
+    if (pool->queue.num >= pool->idle_threads &&
+        pool->threads.num < pool->max_threads)
+    {
+        pl_thread thread;
+        if (pl_thread_create(&thread, pool_thread, pool) == 0)
+            PL_ARRAY_APPEND(pool, pool->threads, thread);
+    }
+
+    bool ok = pool->threads.num > 0;
+    if (ok) {
+        pl_rc_ref(&job->rc);
+        PL_ARRAY_APPEND(pool, pool->queue, job);
+        pl_cond_signal(&pool->wakeup);
+    }
+
+    pl_mutex_unlock(&pool->lock);
+    return ok;
+}
+
+pl_job pl_job_submit(pl_log log, void (*fn)(void *arg), void *arg)
+{
+    if (!log)
+        return NULL;
+
+    pl_job job = pl_zalloc_ptr(NULL, job);
+    *job = (struct pl_job_t) {
+        .fn  = fn,
+        .arg = arg,
+    };
+
+    pl_rc_init(&job->rc);
+    atomic_init(&job->state, JOB_PENDING);
+    pl_mutex_init(&job->lock);
+    pl_cond_init(&job->done);
+
+    struct pl_log_params params = log->params;
+    if (params.queue_job) {
+        pl_rc_ref(&job->rc);
+        params.queue_job(params.queue_priv, job_entry, job);
+        return job;
+    }
+
+    struct pl_thread_pool *pool = pl_log_thread_pool(log);
+    if (!pool || !pool_push(pool, job)) {
+        job_unref(job);
+        return NULL;
+    }
+
+    return job;
+}
+
+bool pl_job_done(pl_job job)
+{
+    return atomic_load(&job->state) == JOB_DONE;
+}
+
+static void job_wait(pl_job *pjob, bool run)
+{
+    pl_job job = *pjob;
+    if (!job)
+        return;
+
+    if (job_claim(job)) {
+        // Not started yet, take it over
+        if (run)
+            job->fn(job->arg);
+        job_finish(job);
+    } else {
+        pl_mutex_lock(&job->lock);
+        while (atomic_load(&job->state) != JOB_DONE)
+            pl_cond_wait(&job->done, &job->lock);
+        pl_mutex_unlock(&job->lock);
+    }
+
+    job_unref(job);
+    *pjob = NULL;
+}
+
+void pl_job_wait(pl_job *job)
+{
+    job_wait(job, true);
+}
+
+void pl_job_cancel(pl_job *job)
+{
+    job_wait(job, false);
+}
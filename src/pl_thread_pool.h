@@ -0,0 +1,48 @@
+/*
+ * This file is part of libplacebo.
+ *
+ * libplacebo is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * libplacebo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with libplacebo. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "common.h"
+
+// Shared executor for all CPU-side background work. Jobs run either on the
+// external thread pool provided by the user (`pl_log_params.queue_job`), or
+// on an internal pool of (at most) one thread per CPU core, owned by the
+// `pl_log` and started on demand.
+typedef struct pl_job_t *pl_job;
+
+// Schedule `fn(arg)` to run in the background. Returns NULL if this is not
+// possible (e.g. `log` is NULL, or no threads could be created), in which
+// case the caller should perform the work synchronously instead.
+pl_job pl_job_submit(pl_log log, void (*fn)(void *arg), void *arg);
+
+// Returns whether `job` has finished running, without blocking.
+bool pl_job_done(pl_job job);
+
+// Wait for `job` to finish and free it. Jobs that have not started running
+// yet are taken over and run directly on the calling thread, so waiting on a
+// job never depends on the availability of pool threads. No-op on NULL.
+void pl_job_wait(pl_job *job);
+
+// Like `pl_job_wait`, but jobs that have not started running yet are
+// discarded instead of run.
+void pl_job_cancel(pl_job *job);
+
+// Internal thread pool implementation, used by `pl_log`
+struct pl_thread_pool;
+struct pl_thread_pool *pl_thread_pool_create(void);
+void pl_thread_pool_destroy(struct pl_thread_pool **pool);
@@ -63,6 +63,7 @@ static inline int pl_mutex_init_type_internal(pl_mutex *mutex, enum pl_mutex_typ
 #define pl_mutex_destroy    pthread_mutex_destroy
 #define pl_mutex_lock       pthread_mutex_lock
 #define pl_mutex_unlock     pthread_mutex_unlock
+#define pl_mutex_trylock    pthread_mutex_trylock
 
 static inline int pl_cond_init(pl_cond *cond)
 {
@@ -106,3 +107,16 @@ static inline int pl_cond_timedwait(pl_cond *cond, pl_mutex *mutex, uint64_t tim
 
     return pthread_cond_timedwait(cond, mutex, &ts);
 }
+
+typedef pthread_t pl_thread;
+#define PL_THREAD_VOID void *
+#define PL_THREAD_RETURN() return NULL
+
+static inline int pl_thread_create(pl_thread *thread,
+                                   PL_THREAD_VOID (*fun)(void *),
+                                   void *__restrict arg)
+{
+    return pthread_create(thread, NULL, fun, arg);
+}
+
+#define pl_thread_join(thread) pthread_join(thread, NULL)
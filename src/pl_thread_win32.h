@@ -18,6 +18,7 @@
 #pragma once
 
 #include <windows.h>
+#include <process.h>
 #include <errno.h>
 
 typedef CRITICAL_SECTION   pl_mutex;
@@ -54,6 +55,11 @@ static inline int pl_mutex_unlock(pl_mutex *mutex)
     return 0;
 }
 
+static inline int pl_mutex_trylock(pl_mutex *mutex)
+{
+    return TryEnterCriticalSection(mutex) ? 0 : EBUSY;
+}
+
 static inline int pl_cond_init(pl_cond *cond)
 {
     InitializeConditionVariable(cond);
@@ -98,3 +104,24 @@ static inline int pl_cond_timedwait(pl_cond *cond, pl_mutex *mutex, uint64_t tim
     }
     return 0;
 }
+
+typedef HANDLE pl_thread;
+#define PL_THREAD_VOID unsigned __stdcall
+#define PL_THREAD_RETURN() return 0
+
+static inline int pl_thread_create(pl_thread *thread,
+                                   PL_THREAD_VOID (*fun)(void *),
+                                   void *__restrict arg)
+{
+    *thread = (HANDLE) _beginthreadex(NULL, 0, fun, arg, 0, NULL);
+    return *thread ? 0 : -1;
+}
+
+static inline int pl_thread_join(pl_thread thread)
+{
+    DWORD ret = WaitForSingleObject(thread, INFINITE);
+    if (ret != WAIT_OBJECT_0)
+        return ret == WAIT_ABANDONED ? EINVAL : EDEADLK;
+    CloseHandle(thread);
+    return 0;
+}
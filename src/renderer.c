@@ -21,6 +21,7 @@
 #include "filters.h"
 #include "shaders.h"
 #include "dispatch.h"
+#include "pl_clock.h"
 
 struct cached_frame {
     uint64_t signature;
@@ -30,6 +31,18 @@ struct cached_frame {
     pl_tex tex;
     int comps;
     bool evict; // for garbage collection
+    uint64_t last_use; // value of `rr->mix_count` when last used
+};
+
+// Retained result of a `pl_hook` marked as `deterministic`
+struct cached_hook {
+    uint64_t key;       // see `hook_cache_key`
+    uint64_t signature; // signature of the frame it was computed for
+    pl_tex tex;
+    struct pl_color_repr repr;
+    struct pl_color_space color;
+    struct pl_rect2df rect;
+    int comps;
 };
 
 struct sampler {
@@ -41,8 +54,17 @@ struct osd_vertex {
     float pos[2];
     float coord[2];
     float color[4];
+    float bounds[4]; // texture coordinate limits, for atlas textures
+};
+
+// Assigned area within the overlay atlas
+struct atlas_entry {
+    pl_tex tex;
+    struct pl_rect2d rc;
 };
 
+#define STATS_WINDOW 256
+
 struct pl_renderer {
     pl_gpu gpu;
     pl_dispatch dp;
@@ -59,6 +81,10 @@ struct pl_renderer {
     bool disable_grain;         // disable film grain code
     bool disable_hooks;         // disable user hooks / custom shaders
     bool disable_mixing;        // disable frame mixing
+    bool disable_color_lut;     // disable baking the color pipeline
+    bool disable_overlay_cache; // disable partial overlay updates
+    bool disable_overlay_atlas; // disable batching overlays into an atlas
+    bool disable_output_cache;  // disable re-using the last output
 
     // Shader resource objects and intermediate textures (FBOs)
     pl_shader_obj tone_map_state;
@@ -66,20 +92,80 @@ struct pl_renderer {
     pl_shader_obj icc_state;
     pl_shader_obj grain_state[4];
     pl_shader_obj lut_state[3];
+    pl_shader_obj dovi_state;
+    pl_tex color_lut;
+    uint64_t color_lut_sig;
     PL_ARRAY(pl_tex) fbos;
     struct sampler sampler_main;
+    struct sampler sampler_hook;
     struct sampler samplers_src[4];
     struct sampler samplers_dst[4];
     bool peak_detect_active;
 
+    // Set by `pl_renderer_precompile`. Passes are only compiled, so anything
+    // touching texture contents or retaining them must be skipped
+    bool compile_only;
+
     // Temporary storage for vertex/index data
     PL_ARRAY(struct osd_vertex) osd_vertices;
     PL_ARRAY(uint16_t) osd_indices;
-    struct pl_vertex_attrib osd_attribs[3];
+    struct pl_vertex_attrib osd_attribs[4];
+
+    // Texture atlas for batching overlays, packed row by row
+    pl_tex osd_atlas;
+    PL_ARRAY(struct atlas_entry) atlas_entries;
+    int atlas_x, atlas_y, atlas_row_h;
 
     // Frame cache (for frame mixing / interpolation)
     PL_ARRAY(struct cached_frame) frames;
     PL_ARRAY(pl_tex) frame_fbos;
+    uint64_t mix_count;
+    uint64_t params_sig;  // `params_signature` of `params_hash`
+    uint64_t params_hash; // cached result of `render_params_hash`
+
+    // Retained copy of the last frame prior to blending target overlays (for
+    // partial overlay updates)
+    pl_tex overlay_base;
+    pl_tex overlay_target; // target texture it was rendered to (not owned)
+    uint64_t overlay_sig;
+    PL_ARRAY(struct pl_rect2d) overlay_rects; // areas covered by overlays
+
+    // Retained copy of the last output (for repeated frames)
+    pl_tex output_cache;
+    uint64_t output_key; // see `output_cache_key`, or 0 if invalid
+
+    // Intermediate texture for tiled rendering
+    pl_tex tile_tex;
+
+    // Results of deterministic hooks (for pl_render_image_mix)
+    PL_ARRAY(struct cached_hook) hook_cache;
+
+    // Unused arenas backing `pass_state.tmp`, recycled across frames
+    PL_ARRAY(void *) arenas;
+
+    // Per-stage timing statistics, and the totals of the current frame
+    struct stage_stats {
+        uint64_t gpu[STATS_WINDOW];
+        uint64_t cpu[STATS_WINDOW];
+        int idx, num;
+    } stats[PL_RENDER_STAT_COUNT];
+    uint64_t frame_gpu[PL_RENDER_STAT_COUNT];
+    uint64_t frame_cpu[PL_RENDER_STAT_COUNT];
+    bool frame_used[PL_RENDER_STAT_COUNT];
+    int frame_depth; // nesting depth of the public rendering functions
+
+    // CPU time breakdown per `enum pl_render_cpu_section`, only measured if
+    // built with PL_CPU_PROFILE
+    uint64_t cpu_samples[PL_RENDER_CPU_COUNT][STATS_WINDOW];
+    int cpu_idx, cpu_num;
+    uint64_t frame_start;                       // clock value at frame start
+    uint64_t frame_dp_times[PL_RENDER_CPU_COUNT]; // `rr->dp` times at start
+
+    // Dynamic quality scaling state, see `pl_render_params.gpu_time_budget`
+    uint64_t frame_budget; // budget of the current frame
+    uint64_t quality_avg;  // moving average of the frame GPU time
+    int quality_level;
+    int quality_frames;    // frames rendered since the last level change
 };
 
 enum {
@@ -109,6 +195,10 @@ pl_renderer pl_renderer_create(pl_log log, pl_gpu gpu)
                 .name = "osd_color",
                 .offset = offsetof(struct osd_vertex, color),
                 .fmt = pl_find_vertex_fmt(gpu, PL_FMT_FLOAT, 4),
+            }, {
+                .name = "osd_bounds",
+                .offset = offsetof(struct osd_vertex, bounds),
+                .fmt = pl_find_vertex_fmt(gpu, PL_FMT_FLOAT, 4),
             }
         },
     };
@@ -136,11 +226,19 @@ void pl_renderer_destroy(pl_renderer *p_rr)
         pl_tex_destroy(rr->gpu, &rr->frames.elem[i].tex);
     for (int i = 0; i < rr->frame_fbos.num; i++)
         pl_tex_destroy(rr->gpu, &rr->frame_fbos.elem[i]);
+    pl_tex_destroy(rr->gpu, &rr->color_lut);
+    pl_tex_destroy(rr->gpu, &rr->overlay_base);
+    pl_tex_destroy(rr->gpu, &rr->output_cache);
+    pl_tex_destroy(rr->gpu, &rr->tile_tex);
+    pl_tex_destroy(rr->gpu, &rr->osd_atlas);
+    for (int i = 0; i < rr->hook_cache.num; i++)
+        pl_tex_destroy(rr->gpu, &rr->hook_cache.elem[i].tex);
 
     // Free all shader resource objects
     pl_shader_obj_destroy(&rr->tone_map_state);
     pl_shader_obj_destroy(&rr->dither_state);
     pl_shader_obj_destroy(&rr->icc_state);
+    pl_shader_obj_destroy(&rr->dovi_state);
     for (int i = 0; i < PL_ARRAY_SIZE(rr->lut_state); i++)
         pl_shader_obj_destroy(&rr->lut_state[i]);
     for (int i = 0; i < PL_ARRAY_SIZE(rr->grain_state); i++)
@@ -148,6 +246,7 @@ void pl_renderer_destroy(pl_renderer *p_rr)
 
     // Free all samplers
     sampler_destroy(rr, &rr->sampler_main);
+    sampler_destroy(rr, &rr->sampler_hook);
     for (int i = 0; i < PL_ARRAY_SIZE(rr->samplers_src); i++)
         sampler_destroy(rr, &rr->samplers_src[i]);
     for (int i = 0; i < PL_ARRAY_SIZE(rr->samplers_dst); i++)
@@ -172,11 +271,176 @@ void pl_renderer_flush_cache(pl_renderer rr)
     for (int i = 0; i < rr->frames.num; i++)
         pl_tex_destroy(rr->gpu, &rr->frames.elem[i].tex);
     rr->frames.num = 0;
+    rr->overlay_sig = 0;
+    rr->output_key = 0;
+
+    for (int i = 0; i < rr->hook_cache.num; i++)
+        pl_tex_destroy(rr->gpu, &rr->hook_cache.elem[i].tex);
+    rr->hook_cache.num = 0;
 
     pl_reset_detected_peak(rr->tone_map_state);
     rr->peak_detect_active = false;
 }
 
+void pl_renderer_reset_stats(pl_renderer rr)
+{
+    memset(rr->stats, 0, sizeof(rr->stats));
+    rr->cpu_idx = rr->cpu_num = 0;
+}
+
+static int cmp_u64(const void *pa, const void *pb)
+{
+    uint64_t a = *(const uint64_t *) pa, b = *(const uint64_t *) pb;
+    return (a > b) - (a < b);
+}
+
+static void window_stats(const uint64_t *samples, int num, uint64_t *mean,
+                         uint64_t *p95, uint64_t *peak)
+{
+    uint64_t sorted[STATS_WINDOW], sum = 0;
+    memcpy(sorted, samples, num * sizeof(sorted[0]));
+    qsort(sorted, num, sizeof(sorted[0]), cmp_u64);
+    for (int i = 0; i < num; i++)
+        sum += sorted[i];
+
+    *mean = sum / num;
+    *p95 = sorted[(num * 95 + 99) / 100 - 1];
+    *peak = sorted[num - 1];
+}
+
+struct pl_render_stats pl_renderer_get_stats(pl_renderer rr)
+{
+    struct pl_render_stats stats = {0};
+    for (int i = 0; i < PL_RENDER_STAT_COUNT; i++) {
+        const struct stage_stats *st = &rr->stats[i];
+        struct pl_render_stage_stats *out = &stats.stages[i];
+        if (!st->num)
+            continue;
+
+        out->num_frames = st->num;
+        window_stats(st->gpu, st->num, &out->gpu_mean, &out->gpu_p95, &out->gpu_peak);
+        window_stats(st->cpu, st->num, &out->cpu_mean, &out->cpu_p95, &out->cpu_peak);
+    }
+
+    for (int i = 0; rr->cpu_num && i < PL_RENDER_CPU_COUNT; i++) {
+        const uint64_t *samples = rr->cpu_samples[i];
+        const int last = (rr->cpu_idx + STATS_WINDOW - 1) % STATS_WINDOW;
+        struct pl_render_cpu_stats *out = &stats.cpu[i];
+        out->num_frames = rr->cpu_num;
+        out->last = samples[last];
+        window_stats(samples, rr->cpu_num, &out->mean, &out->p95, &out->peak);
+    }
+
+    stats.quality_level = rr->quality_level;
+    return stats;
+}
+
+static void stats_begin(pl_renderer rr, const struct pl_render_params *params)
+{
+    if (rr->frame_depth++)
+        return;
+
+    rr->frame_budget = params ? params->gpu_time_budget : 0;
+    memset(rr->frame_gpu, 0, sizeof(rr->frame_gpu));
+    memset(rr->frame_cpu, 0, sizeof(rr->frame_cpu));
+    memset(rr->frame_used, 0, sizeof(rr->frame_used));
+
+#ifdef PL_CPU_PROFILE
+    pl_dispatch_cpu_times(rr->dp, rr->frame_dp_times);
+    rr->frame_start = pl_clock_now();
+#endif
+}
+
+static void cpu_stats_update(pl_renderer rr)
+{
+#ifdef PL_CPU_PROFILE
+    uint64_t times[PL_RENDER_CPU_COUNT];
+    pl_dispatch_cpu_times(rr->dp, times);
+
+    // Everything not spent inside the dispatch is attributed to the
+    // renderer itself, i.e. mostly shader generation
+    uint64_t other = pl_clock_now() - rr->frame_start;
+    for (int i = 0; i < PL_RENDER_CPU_COUNT; i++) {
+        times[i] -= rr->frame_dp_times[i];
+        other -= PL_MIN(times[i], other);
+    }
+    times[PL_RENDER_CPU_GENERATE] += other;
+
+    for (int i = 0; i < PL_RENDER_CPU_COUNT; i++)
+        rr->cpu_samples[i][rr->cpu_idx] = times[i];
+    rr->cpu_idx = (rr->cpu_idx + 1) % STATS_WINDOW;
+    rr->cpu_num = PL_MIN(rr->cpu_num + 1, STATS_WINDOW);
+#endif
+}
+
+enum {
+    QUALITY_MAX = 3,
+    QUALITY_SETTLE = 8,     // frames to wait after lowering the level
+    QUALITY_RESTORE = 60,   // frames of headroom required to raise it again
+};
+
+static void quality_update(pl_renderer rr)
+{
+    const uint64_t budget = rr->frame_budget;
+    if (!budget) {
+        rr->quality_level = 0;
+        rr->quality_avg = rr->quality_frames = 0;
+        return;
+    }
+
+    uint64_t total = 0;
+    for (int i = 0; i < PL_RENDER_STAT_COUNT; i++)
+        total += rr->frame_gpu[i];
+    if (!total)
+        return; // no timer queries, or results not yet available
+
+    // Timer results lag behind by a few frames, so only trust the average
+    // once the frames rendered at the current level have had time to arrive
+    rr->quality_frames++;
+    rr->quality_avg = rr->quality_avg ? (rr->quality_avg * 7 + total) / 8 : total;
+    if (rr->quality_frames < QUALITY_SETTLE)
+        return;
+
+    int level = rr->quality_level;
+    if (rr->quality_avg > budget && level < QUALITY_MAX) {
+        level++;
+    } else if (rr->quality_avg < budget / 4 * 3 && level > 0 &&
+               rr->quality_frames >= QUALITY_RESTORE)
+    {
+        level--;
+    }
+
+    if (level == rr->quality_level)
+        return;
+
+    PL_DEBUG(rr, "Frame GPU time %.3f ms (budget %.3f ms), %s quality level "
+             "to %d", rr->quality_avg * 1e-6, budget * 1e-6,
+             level > rr->quality_level ? "lowering" : "raising", level);
+    rr->quality_level = level;
+    rr->quality_avg = rr->quality_frames = 0;
+}
+
+static void stats_end(pl_renderer rr)
+{
+    pl_assert(rr->frame_depth > 0);
+    if (--rr->frame_depth)
+        return;
+
+    for (int i = 0; i < PL_RENDER_STAT_COUNT; i++) {
+        struct stage_stats *st = &rr->stats[i];
+        if (!rr->frame_used[i])
+            continue;
+
+        st->gpu[st->idx] = rr->frame_gpu[i];
+        st->cpu[st->idx] = rr->frame_cpu[i];
+        st->idx = (st->idx + 1) % STATS_WINDOW;
+        st->num = PL_MIN(st->num + 1, STATS_WINDOW);
+    }
+
+    cpu_stats_update(rr);
+    quality_update(rr);
+}
+
 const struct pl_render_params pl_render_fast_params = { PL_RENDER_DEFAULTS };
 const struct pl_render_params pl_render_default_params = {
     PL_RENDER_DEFAULTS
@@ -346,6 +610,35 @@ struct pass_state {
     // Metadata for `rr->fbos`
     pl_fmt fbofmt[5];
     bool *fbos_used;
+    bool *fbos_pinned; // may still be referenced after `release_fbos`
+
+    // Whether to retain the frame for partial overlay updates
+    bool save_overlay_base;
+
+    // Set while user hooks are executing, for `pl_renderer_get_stats`
+    bool in_hook;
+
+    // Whether the result of `pass_read_image` is shared by several targets,
+    // and must therefore not depend on the size of `target`
+    bool shared_image;
+
+    // Whether this pass renders independently of the output image (e.g.
+    // frames cached for frame mixing), so its dispatches may be moved to an
+    // async compute queue
+    bool async;
+
+    // If nonzero, the signature of `image` and the hash of `params`, used
+    // to cache the results of deterministic hooks
+    uint64_t image_sig;
+    uint64_t params_hash;
+
+    // Record of all passes dispatched so far, for debugging. Only populated
+    // when trace logging is enabled.
+    struct graph_node {
+        pl_tex out;
+        pl_str desc;
+    } *graph;
+    int num_graph;
 
 };
 
@@ -402,10 +695,56 @@ static void find_fbo_format(struct pass_state *pass)
     rr->disable_fbos = true;
 }
 
+// Ordered by priority, see `enum pl_render_stat`
+static const struct {
+    const char *step;
+    enum pl_render_stat stat;
+} stat_steps[] = {
+    { "overlay",                PL_RENDER_STAT_OVERLAY },
+    { "scaling",                PL_RENDER_STAT_SCALER },
+    { "bicubic",                PL_RENDER_STAT_SCALER },
+    { "oversample",             PL_RENDER_STAT_SCALER },
+    { "debanding",              PL_RENDER_STAT_DEBAND },
+    { "film grain",             PL_RENDER_STAT_GRAIN },
+    { "tone mapping",           PL_RENDER_STAT_COLOR_MAP },
+    { "colorspace conversion",  PL_RENDER_STAT_COLOR_MAP },
+    { "cone distortion",        PL_RENDER_STAT_COLOR_MAP },
+    { "peak detection",         PL_RENDER_STAT_COLOR_MAP },
+    { "LUT",                    PL_RENDER_STAT_COLOR_MAP },
+    { "dithering",              PL_RENDER_STAT_DITHER },
+    { "color decoding",         PL_RENDER_STAT_READ },
+    { "merging planes",         PL_RENDER_STAT_READ },
+    { "reshaping",              PL_RENDER_STAT_READ },
+};
+
+static enum pl_render_stat classify_pass(const struct pass_state *pass,
+                                         const struct pl_shader_res *res)
+{
+    if (pass->in_hook)
+        return PL_RENDER_STAT_HOOKS;
+
+    for (int n = 0; n < PL_ARRAY_SIZE(stat_steps); n++) {
+        for (int i = 0; i < res->num_steps; i++) {
+            const char *step = res->steps[i]; // NULL for grouped duplicates
+            if (step && strstr(step, stat_steps[n].step))
+                return stat_steps[n].stat;
+        }
+    }
+
+    return PL_RENDER_STAT_OTHER;
+}
+
 static void info_callback(void *priv, const struct pl_dispatch_info *dinfo)
 {
     struct pass_state *pass = priv;
     const struct pl_render_params *params = pass->params;
+    pl_renderer rr = pass->rr;
+
+    enum pl_render_stat stat = classify_pass(pass, dinfo->shader);
+    rr->frame_gpu[stat] += dinfo->last;
+    rr->frame_cpu[stat] += dinfo->cpu_time;
+    rr->frame_used[stat] = true;
+
     if (!params->info_callback)
         return;
 
@@ -459,7 +798,9 @@ static pl_tex get_fbo(struct pass_state *pass, int w, int h, pl_fmt fmt,
         best_idx = rr->fbos.num;
         PL_ARRAY_APPEND(rr, rr->fbos, NULL);
         pl_grow(pass->tmp, &pass->fbos_used, rr->fbos.num * sizeof(bool));
+        pl_grow(pass->tmp, &pass->fbos_pinned, rr->fbos.num * sizeof(bool));
         pass->fbos_used[best_idx] = false;
+        pass->fbos_pinned[best_idx] = false;
     }
 
     if (!pl_tex_recreate(rr->gpu, &rr->fbos.elem[best_idx], &params))
@@ -469,6 +810,121 @@ static pl_tex get_fbo(struct pass_state *pass, int w, int h, pl_fmt fmt,
     return rr->fbos.elem[best_idx];
 }
 
+// Prevents `tex` from being recycled by `release_fbos` for the rest of the
+// pass, e.g. because it was handed out to a hook which may hold on to it
+static void pin_fbo(struct pass_state *pass, pl_tex tex)
+{
+    pl_renderer rr = pass->rr;
+    for (int i = 0; i < rr->fbos.num; i++) {
+        if (rr->fbos.elem[i] == tex)
+            pass->fbos_pinned[i] = true;
+    }
+}
+
+// Returns all intermediate FBOs except `keep` to the pool, so they can be
+// re-used by later stages of the same pass. Only safe to call once nothing
+// still pending (other than reads of `keep`) references any of them.
+static void release_fbos(struct pass_state *pass, pl_tex keep)
+{
+    pl_renderer rr = pass->rr;
+    for (int i = 0; i < rr->fbos.num; i++) {
+        if (pass->fbos_used[i] && !pass->fbos_pinned[i] && rr->fbos.elem[i] != keep)
+            pass->fbos_used[i] = false;
+    }
+}
+
+// Records the dispatch of `sh` into `out` as a node of the pass graph, with
+// edges to whichever earlier nodes produced the textures it reads from
+static void graph_add(struct pass_state *pass, const pl_shader sh, pl_tex out)
+{
+    pl_renderer rr = pass->rr;
+    if (!pl_msg_test(rr->log, PL_LOG_TRACE))
+        return;
+
+    pl_str desc = {0};
+    pl_str_append_asprintf(pass->tmp, &desc, "#%d: %dx%d %s [",
+                           pass->num_graph, out->params.w, out->params.h,
+                           out->params.format->name);
+    for (int i = 0; i < sh->steps.num; i++) {
+        pl_str_append_asprintf(pass->tmp, &desc, "%s%s", i ? ", " : "",
+                               sh->steps.elem[i]);
+    }
+    pl_str_append(pass->tmp, &desc, pl_str0("] <-"));
+
+    int num_inputs = 0;
+    for (int i = 0; i < sh->descs.num; i++) {
+        const struct pl_shader_desc *sd = &sh->descs.elem[i];
+        if (sd->desc.type != PL_DESC_SAMPLED_TEX &&
+            sd->desc.type != PL_DESC_STORAGE_IMG)
+            continue;
+
+        // FBOs get re-used, so the most recent writer is the producer
+        int src = -1;
+        for (int n = pass->num_graph - 1; n >= 0 && src < 0; n--) {
+            if (pass->graph[n].out == sd->binding.object)
+                src = n;
+        }
+
+        if (src >= 0) {
+            pl_str_append_asprintf(pass->tmp, &desc, " #%d", src);
+        } else {
+            pl_str_append(pass->tmp, &desc, pl_str0(" ext"));
+        }
+        num_inputs++;
+    }
+
+    if (!num_inputs)
+        pl_str_append(pass->tmp, &desc, pl_str0(" none"));
+
+    pl_grow(pass->tmp, &pass->graph, (pass->num_graph + 1) * sizeof(*pass->graph));
+    pass->graph[pass->num_graph++] = (struct graph_node) {
+        .out  = out,
+        .desc = desc,
+    };
+}
+
+// Returns a 32-bit replacement for `fmt` (rgb10a2) suitable for storing
+// `img`, or `fmt` itself if `img` needs the extra precision or alpha channel
+static pl_fmt compact_fbo_fmt(const struct pass_state *pass,
+                              const struct img *img, pl_fmt fmt)
+{
+    if (img->comps > 3 || img->color.transfer == PL_COLOR_TRC_LINEAR)
+        return fmt;
+
+    // Already as compact as it gets
+    if (fmt->internal_size <= 4)
+        return fmt;
+
+    enum pl_fmt_caps caps = PL_FMT_CAP_SAMPLEABLE | PL_FMT_CAP_RENDERABLE;
+    if (fmt->caps & PL_FMT_CAP_LINEAR)
+        caps |= PL_FMT_CAP_LINEAR;
+    if (img->sh && pl_shader_is_compute(img->sh))
+        caps |= PL_FMT_CAP_STORABLE;
+
+    pl_fmt low = pl_find_named_fmt(pass->rr->gpu, "rgb10a2");
+    return (low && (low->caps & caps) == caps) ? low : fmt;
+}
+
+// Picks the FBO format for an intermediate `img`. When rendering 8-bit SDR
+// content to an 8-bit target, gamma-encoded intermediates gain nothing from
+// more than 10 bits of precision, so store them as compactly as possible
+static pl_fmt intermediate_fmt(const struct pass_state *pass,
+                               const struct img *img)
+{
+    if (img->fmt)
+        return img->fmt;
+
+    pl_fmt fmt = pass->fbofmt[PL_DEF(img->comps, 4)];
+    int src_depth = pass->image.repr.bits.color_depth;
+    int dst_depth = pass->target.repr.bits.color_depth;
+    if (!fmt || !src_depth || src_depth > 8 || !dst_depth || dst_depth > 8)
+        return fmt;
+    if (pl_color_space_is_hdr(&img->color))
+        return fmt;
+
+    return compact_fbo_fmt(pass, img, fmt);
+}
+
 // Forcibly convert an img to `tex`, dispatching where necessary
 static pl_tex _img_tex(struct pass_state *pass, struct img *img, pl_debug_tag tag)
 {
@@ -478,7 +934,8 @@ static pl_tex _img_tex(struct pass_state *pass, struct img *img, pl_debug_tag ta
     }
 
     pl_renderer rr = pass->rr;
-    pl_tex tex = get_fbo(pass, img->w, img->h, img->fmt, img->comps, tag);
+    pl_tex tex = get_fbo(pass, img->w, img->h, intermediate_fmt(pass, img),
+                         img->comps, tag);
     img->fmt = NULL;
 
     if (!tex) {
@@ -490,9 +947,11 @@ static pl_tex _img_tex(struct pass_state *pass, struct img *img, pl_debug_tag ta
     }
 
     pl_assert(img->sh);
+    graph_add(pass, img->sh, tex);
     bool ok = pl_dispatch_finish(rr->dp, pl_dispatch_params(
         .shader = &img->sh,
         .target = tex,
+        .async = pass->async,
     ));
 
     if (!ok) {
@@ -523,6 +982,43 @@ static pl_shader img_sh(struct pass_state *pass, struct img *img)
     return img->sh;
 }
 
+// Try merging a pending `img` shader directly into `sh`, as an alternative to
+// dispatching it to an FBO only to sample it back at the same pixel positions.
+// This is only possible if `src` samples the img pixel-aligned at 1:1 size.
+// Returns the subpass identifier (consuming `img->sh`) on success, or 0 if
+// the img needs to be converted to `tex` as usual.
+static ident_t img_fuse(struct pass_state *pass, pl_shader sh, struct img *img,
+                        const struct pl_sample_src *src)
+{
+    if (!img->sh)
+        return NULL_IDENT;
+
+    const struct pl_rect2df aligned = { 0, 0, img->w, img->h };
+    if (src->new_w != img->w || src->new_h != img->h)
+        return NULL_IDENT;
+    if (!pl_rect2d_eq(src->rect, aligned))
+        return NULL_IDENT;
+
+    // The shader may nominally be larger than the area being consumed (e.g.
+    // when cropping off codec padding), which is harmless since the pixels
+    // still line up with the origin
+    int out_w = img->sh->output_w, out_h = img->sh->output_h;
+    img->sh->output_w = PL_MIN(PL_DEF(out_w, img->w), img->w);
+    img->sh->output_h = PL_MIN(PL_DEF(out_h, img->h), img->h);
+
+    ident_t sub = sh_subpass(sh, img->sh);
+    if (!sub) {
+        img->sh->output_w = out_w;
+        img->sh->output_h = out_h;
+        return NULL_IDENT;
+    }
+
+    PL_TRACE(pass->rr, "Fusing pixel-aligned %dx%d pass into consumer",
+             img->w, img->h);
+    pl_dispatch_abort(pass->rr->dp, &img->sh);
+    return sub;
+}
+
 enum sampler_type {
     SAMPLER_DIRECT,  // pick based on texture caps
     SAMPLER_NEAREST, // direct sampling, force nearest
@@ -591,8 +1087,13 @@ static struct sampler_info sample_src_info(struct pass_state *pass,
         bool can_linear = texfmt->caps & PL_FMT_CAP_LINEAR;
         bool can_fast = info.dir == SAMPLER_UP || params->skip_anti_aliasing;
 
+        // Bicubic sampling can fall back to `textureGather` instead
+        int glsl_ver = rr->gpu->glsl.version;
+        bool can_gather = texfmt->gatherable &&
+                          glsl_ver >= (src->components == 1 ? 130 : 400);
+
         if (can_fast && !params->disable_builtin_scalers) {
-            if (can_linear && info.config == &pl_filter_bicubic)
+            if ((can_linear || can_gather) && info.config == &pl_filter_bicubic)
                 info.type = SAMPLER_BICUBIC;
             if (can_linear && info.config == &pl_filter_bilinear)
                 info.type = SAMPLER_DIRECT;
@@ -604,11 +1105,45 @@ static struct sampler_info sample_src_info(struct pass_state *pass,
     return info;
 }
 
+// Whether the final output pass can write to `tex` directly from a compute
+// shader, avoiding an extra intermediate FBO and blit
+static bool target_can_compute(const struct pass_state *pass, pl_tex tex)
+{
+    if (!tex->params.storable)
+        return false;
+    if (pass->params->blend_params)
+        return tex->params.format->caps & PL_FMT_CAP_READWRITE;
+    return true;
+}
+
+static struct pl_sample_filter_params sampler_filter_params(struct pass_state *pass,
+                                                           const struct sampler_info *info,
+                                                           pl_shader_obj *lut,
+                                                           pl_tex target_tex)
+{
+    const struct pl_render_params *params = pass->params;
+    struct pl_sample_filter_params fparams = {
+        .filter      = *info->config,
+        .lut_entries = params->lut_entries,
+        .cutoff      = params->polar_cutoff,
+        .antiring    = params->antiringing_strength,
+        .no_widening = params->skip_anti_aliasing,
+        .lut         = lut,
+    };
+
+    if (target_tex) {
+        fparams.no_compute = !target_can_compute(pass, target_tex);
+    } else {
+        fparams.no_compute = !(pass->fbofmt[4]->caps & PL_FMT_CAP_STORABLE);
+    }
+
+    return fparams;
+}
+
 static void dispatch_sampler(struct pass_state *pass, pl_shader sh,
                              struct sampler *sampler, pl_tex target_tex,
                              const struct pl_sample_src *src)
 {
-    const struct pl_render_params *params = pass->params;
     if (!sampler)
         goto fallback;
 
@@ -643,27 +1178,25 @@ static void dispatch_sampler(struct pass_state *pass, pl_shader sh,
     }
 
     pl_assert(lut);
-    struct pl_sample_filter_params fparams = {
-        .filter      = *info.config,
-        .lut_entries = params->lut_entries,
-        .cutoff      = params->polar_cutoff,
-        .antiring    = params->antiringing_strength,
-        .no_widening = params->skip_anti_aliasing,
-        .lut         = lut,
-    };
-
-    if (target_tex) {
-        fparams.no_compute = !target_tex->params.storable;
-    } else {
-        fparams.no_compute = !(pass->fbofmt[4]->caps & PL_FMT_CAP_STORABLE);
-    }
+    struct pl_sample_filter_params fparams;
+    fparams = sampler_filter_params(pass, &info, lut, target_tex);
 
     bool ok;
     if (info.config->polar) {
         // Polar samplers are always a single function call
         ok = pl_shader_sample_polar(sh, src, &fparams);
+    } else if (info.dir_sep[0] && info.dir_sep[1] &&
+               pl_shader_sample_ortho_tiled(sh, src, &fparams))
+    {
+        // Scaling in both directions, fused into a single compute shader
+        ok = true;
     } else if (info.dir_sep[0] && info.dir_sep[1]) {
         // Scaling is needed in both directions
+        if (pl_shader_is_failed(sh)) {
+            ok = false;
+            goto done;
+        }
+
         pl_shader tsh = pl_dispatch_begin(rr->dp);
         ok = pl_shader_sample_ortho(tsh, PL_SEP_VERT, src, &fparams);
         if (!ok) {
@@ -705,11 +1238,65 @@ fallback:
     pl_shader_sample_direct(sh, src);
 }
 
+// Attempts scaling `src` with a single compute shader that linearizes (and
+// optionally sigmoidizes) the source texels while loading them, saving a
+// pre-processing pass. Returns NULL if this is not possible.
+static pl_shader dispatch_sampler_fused(struct pass_state *pass,
+                                        struct sampler *sampler, pl_tex target_tex,
+                                        const struct pl_sample_src *src,
+                                        const struct pl_color_space *csp,
+                                        const struct pl_sigmoid_params *sigmoid)
+{
+    pl_renderer rr = pass->rr;
+    struct sampler_info info = sample_src_info(pass, src);
+    if (info.type != SAMPLER_COMPLEX)
+        return NULL;
+
+    pl_shader_obj *lut = NULL;
+    switch (info.dir) {
+    case SAMPLER_NOOP:
+        return NULL;
+    case SAMPLER_DOWN:
+        lut = &sampler->downscaler_state;
+        break;
+    case SAMPLER_UP:
+        lut = &sampler->upscaler_state;
+        break;
+    }
+
+    // Separated scalers can only do this when fused into a single pass
+    if (!info.config->polar && !(info.dir_sep[0] && info.dir_sep[1]))
+        return NULL;
+
+    struct pl_sample_filter_params fparams;
+    fparams = sampler_filter_params(pass, &info, lut, target_tex);
+    if (fparams.no_compute)
+        return NULL;
+
+    fparams.linearize = csp;
+    fparams.sigmoidize = sigmoid;
+
+    pl_shader sh = pl_dispatch_begin_ex(rr->dp, true);
+    bool ok;
+    if (info.config->polar) {
+        ok = pl_shader_sample_polar(sh, src, &fparams);
+    } else {
+        ok = pl_shader_sample_ortho_tiled(sh, src, &fparams);
+    }
+
+    if (!ok) {
+        pl_dispatch_abort(rr->dp, &sh);
+        return NULL;
+    }
+
+    return sh;
+}
+
 static void swizzle_color(pl_shader sh, int comps, const int comp_map[4],
                           bool force_alpha)
 {
     ident_t orig = sh_fresh(sh, "orig_color");
-    GLSL("vec4 %s = color;                  \n"
+    GLSL("vec4 "$" = color;                 \n"
          "color = vec4(0.0, 0.0, 0.0, 1.0); \n", orig);
 
     static const int def_map[4] = {0, 1, 2, 3};
@@ -717,32 +1304,21 @@ static void swizzle_color(pl_shader sh, int comps, const int comp_map[4],
 
     for (int c = 0; c < comps; c++) {
         if (comp_map[c] >= 0)
-            GLSL("color[%d] = %s[%d]; \n", c, orig, comp_map[c]);
+            GLSL("color[%d] = "$"[%d]; \n", c, orig, comp_map[c]);
     }
 
     if (force_alpha)
-        GLSL("color.a = %s.a; \n", orig);
+        GLSL("color.a = "$".a; \n", orig);
 }
 
-// `scale` adapts from `pass->dst_rect` to the plane being rendered to
-static void draw_overlays(struct pass_state *pass, pl_tex fbo,
-                          int comps, const int comp_map[4],
-                          const struct pl_overlay *overlays, int num,
-                          struct pl_color_space color, struct pl_color_repr repr,
-                          const struct pl_transform2x2 *output_shift)
+// Normalizes an overlay (in-place) and computes the transformation from its
+// coordinates to the target plane. Returns false if the overlay should be
+// skipped.
+static bool overlay_setup(struct pass_state *pass, struct pl_overlay *ol,
+                          struct pl_overlay_part *fallback, bool is_target,
+                          const struct pl_transform2x2 *output_shift,
+                          struct pl_transform2x2 *out_tf)
 {
-    const struct pl_render_params *params = pass->params;
-    pl_renderer rr = pass->rr;
-    if (num <= 0 || rr->disable_overlay)
-        return;
-
-    enum pl_fmt_caps caps = fbo->params.format->caps;
-    if (!rr->disable_blending && !(caps & PL_FMT_CAP_BLENDABLE)) {
-        PL_WARN(rr, "Trying to draw an overlay to a non-blendable target. "
-                "Alpha blending is disabled, results may be incorrect!");
-        rr->disable_blending = true;
-    }
-
     const struct pl_frame *image = pass->src_ref >= 0 ? &pass->image : NULL;
     struct pl_transform2x2 src_to_dst;
     if (image) {
@@ -767,95 +1343,257 @@ static void draw_overlays(struct pass_state *pass, pl_tex fbo,
     pl_rect2df_rotate(&dst_crop, -pass->rotation);
     pl_rect2df_normalize(&dst_crop);
 
-    for (int n = 0; n < num; n++) {
-        struct pl_overlay ol = overlays[n];
-        struct pl_overlay_part fallback;
-        if (!ol.tex) {
-            // Backwards compatibility
-            ol.tex = ol.plane.texture;
-            ol.parts = &fallback;
-            ol.num_parts = 1;
-            fallback = (struct pl_overlay_part) {
-                .src = {
-                    .x0 = -ol.plane.shift_x,
-                    .y0 = -ol.plane.shift_y,
-                    .x1 = ol.tex->params.w - ol.plane.shift_x,
-                    .y1 = ol.tex->params.h - ol.plane.shift_y,
-                },
-                .dst = {
-                    .x0 = ol.rect.x0,
-                    .y0 = ol.rect.y0,
-                    .x1 = ol.rect.x1,
-                    .y1 = ol.rect.y1,
-                },
-                .color = {
-                    ol.base_color[0],
-                    ol.base_color[1],
-                    ol.base_color[2],
-                    1.0,
-                },
-            };
-        }
+    if (!ol->tex) {
+        // Backwards compatibility
+        ol->tex = ol->plane.texture;
+        ol->parts = fallback;
+        ol->num_parts = 1;
+        *fallback = (struct pl_overlay_part) {
+            .src = {
+                .x0 = -ol->plane.shift_x,
+                .y0 = -ol->plane.shift_y,
+                .x1 = ol->tex->params.w - ol->plane.shift_x,
+                .y1 = ol->tex->params.h - ol->plane.shift_y,
+            },
+            .dst = {
+                .x0 = ol->rect.x0,
+                .y0 = ol->rect.y0,
+                .x1 = ol->rect.x1,
+                .y1 = ol->rect.y1,
+            },
+            .color = {
+                ol->base_color[0],
+                ol->base_color[1],
+                ol->base_color[2],
+                1.0,
+            },
+        };
+    }
 
-        if (!ol.num_parts)
-            continue;
+    if (!ol->num_parts)
+        return false;
 
-        if (!ol.coords) {
-            ol.coords = overlays == target->overlays
-                            ? PL_OVERLAY_COORDS_DST_FRAME
-                            : PL_OVERLAY_COORDS_SRC_FRAME;
-        }
+    if (!ol->coords) {
+        ol->coords = is_target ? PL_OVERLAY_COORDS_DST_FRAME
+                               : PL_OVERLAY_COORDS_SRC_FRAME;
+    }
 
-        struct pl_transform2x2 tf = pl_transform2x2_identity;
-        switch (ol.coords) {
-            case PL_OVERLAY_COORDS_SRC_CROP:
-                if (!image)
-                    continue;
-                tf.c[0] = image->crop.x0;
-                tf.c[1] = image->crop.y0;
-                // fall through
-            case PL_OVERLAY_COORDS_SRC_FRAME:
-                if (!image)
-                    continue;
-                pl_transform2x2_rmul(&src_to_dst, &tf);
-                break;
-            case PL_OVERLAY_COORDS_DST_CROP:
-                tf.c[0] = dst_crop.x0;
-                tf.c[1] = dst_crop.y0;
-                break;
-            case PL_OVERLAY_COORDS_DST_FRAME:
-                break;
-            case PL_OVERLAY_COORDS_AUTO:
-            case PL_OVERLAY_COORDS_COUNT:
-                pl_unreachable();
-        }
+    struct pl_transform2x2 tf = pl_transform2x2_identity;
+    switch (ol->coords) {
+        case PL_OVERLAY_COORDS_SRC_CROP:
+            if (!image)
+                return false;
+            tf.c[0] = image->crop.x0;
+            tf.c[1] = image->crop.y0;
+            // fall through
+        case PL_OVERLAY_COORDS_SRC_FRAME:
+            if (!image)
+                return false;
+            pl_transform2x2_rmul(&src_to_dst, &tf);
+            break;
+        case PL_OVERLAY_COORDS_DST_CROP:
+            tf.c[0] = dst_crop.x0;
+            tf.c[1] = dst_crop.y0;
+            break;
+        case PL_OVERLAY_COORDS_DST_FRAME:
+            break;
+        case PL_OVERLAY_COORDS_AUTO:
+        case PL_OVERLAY_COORDS_COUNT:
+            pl_unreachable();
+    }
 
-        if (output_shift)
-            pl_transform2x2_rmul(output_shift, &tf);
+    if (output_shift)
+        pl_transform2x2_rmul(output_shift, &tf);
 
-        // Construct vertex/index buffers
-        rr->osd_vertices.num = 0;
-        rr->osd_indices.num = 0;
-        for (int i = 0; i < ol.num_parts; i++) {
-            const struct pl_overlay_part *part = &ol.parts[i];
+    *out_tf = tf;
+    return true;
+}
+
+struct overlay_item {
+    struct pl_overlay ol;
+    struct pl_overlay_part fallback;
+    struct pl_transform2x2 tf;
+    struct pl_rect2d rc; // area within the atlas, if batched
+};
+
+static void atlas_reset(pl_renderer rr)
+{
+    rr->atlas_entries.num = 0;
+    rr->atlas_x = rr->atlas_y = rr->atlas_row_h = 0;
+}
+
+// Finds the area of the atlas assigned to `tex`, or assigns a new one
+static bool atlas_place(pl_renderer rr, pl_tex tex, struct pl_rect2d *out)
+{
+    const int w = tex->params.w, h = tex->params.h;
+    for (int i = 0; i < rr->atlas_entries.num; i++) {
+        const struct atlas_entry *e = &rr->atlas_entries.elem[i];
+        if (e->tex == tex && pl_rect_w(e->rc) == w && pl_rect_h(e->rc) == h) {
+            *out = e->rc;
+            return true;
+        }
+    }
+
+    pl_tex atlas = rr->osd_atlas;
+    if (rr->atlas_x + w > atlas->params.w) {
+        rr->atlas_x = 0;
+        rr->atlas_y += rr->atlas_row_h;
+        rr->atlas_row_h = 0;
+    }
+
+    if (rr->atlas_x + w > atlas->params.w || rr->atlas_y + h > atlas->params.h)
+        return false;
+
+    *out = (struct pl_rect2d) {
+        rr->atlas_x, rr->atlas_y,
+        rr->atlas_x + w, rr->atlas_y + h,
+    };
+
+    rr->atlas_x += w;
+    rr->atlas_row_h = PL_MAX(rr->atlas_row_h, h);
+    PL_ARRAY_APPEND(rr, rr->atlas_entries, (struct atlas_entry) {
+        .tex = tex,
+        .rc = *out,
+    });
+    return true;
+}
+
+// Copies the textures of all `items` into `rr->osd_atlas`. Textures keep
+// their area from previous frames for as long as possible, and the atlas is
+// only repacked (or grown) once a new texture no longer fits
+static bool atlas_pack(pl_renderer rr, struct overlay_item *items, int num)
+{
+    pl_gpu gpu = rr->gpu;
+    pl_fmt fmt = items[0].ol.tex->params.format;
+    const int max_size = gpu->limits.max_tex_2d_dim;
+    int size = rr->osd_atlas ? rr->osd_atlas->params.w : PL_MIN(1024, max_size);
+    bool reset = false;
+
+    for (;;) {
+        pl_tex atlas = rr->osd_atlas;
+        if (!atlas || atlas->params.format != fmt || atlas->params.w != size) {
+            bool ok = pl_tex_recreate(gpu, &rr->osd_atlas, pl_tex_params(
+                .w = size,
+                .h = size,
+                .format = fmt,
+                .sampleable = true,
+                .blit_dst = true,
+                .debug_tag = PL_DEBUG_TAG,
+            ));
+
+            if (!ok) {
+                PL_ERR(rr, "Failed creating overlay atlas, disabling!");
+                rr->disable_overlay_atlas = true;
+                return false;
+            }
+
+            atlas_reset(rr);
+            reset = true;
+        }
+
+        bool ok = true;
+        for (int i = 0; ok && i < num; i++)
+            ok = atlas_place(rr, items[i].ol.tex, &items[i].rc);
+        if (ok)
+            break;
+
+        if (!reset) {
+            // Drop textures from previous frames and try again
+            atlas_reset(rr);
+            reset = true;
+            continue;
+        }
+
+        if (size >= max_size)
+            return false;
+        size = PL_MIN(size * 2, max_size);
+    }
+
+    for (int i = 0; i < num && !rr->compile_only; i++) {
+        pl_tex tex = items[i].ol.tex;
+        bool dupe = false;
+        for (int j = 0; !dupe && j < i; j++)
+            dupe = items[j].ol.tex == tex;
+        if (dupe)
+            continue;
+
+        const struct pl_rect2d *rc = &items[i].rc;
+        pl_tex_blit(gpu, pl_tex_blit_params(
+            .src = tex,
+            .dst = rr->osd_atlas,
+            .dst_rc = { rc->x0, rc->y0, 0, rc->x1, rc->y1, 1 },
+        ));
+    }
+
+    return true;
+}
+
+// Whether the overlay `b` can be drawn in the same atlas batch as `a`
+static bool can_batch_overlays(const struct pl_overlay *a,
+                               const struct pl_overlay *b)
+{
+    return a->mode == b->mode &&
+           a->tex->params.format == b->tex->params.format &&
+           b->tex->params.blit_src &&
+           pl_color_repr_equal(&a->repr, &b->repr) &&
+           pl_color_space_equal(&a->color, &b->color);
+}
+
+// Draws all `items` in a single pass. If `atlas` is set, the textures are
+// sampled from their respective areas of the atlas, otherwise `num` must be 1
+static bool draw_overlay_batch(struct pass_state *pass, pl_tex fbo,
+                               int comps, const int comp_map[4],
+                               const struct overlay_item *items, int num,
+                               struct pl_color_space color,
+                               struct pl_color_repr repr, pl_tex atlas)
+{
+    const struct pl_render_params *params = pass->params;
+    pl_renderer rr = pass->rr;
+    const struct pl_overlay *ol = &items[0].ol;
+    pl_tex osd_tex = atlas ? atlas : ol->tex;
+    const float tex_w = osd_tex->params.w, tex_h = osd_tex->params.h;
+
+    // Construct vertex/index buffers
+    rr->osd_vertices.num = 0;
+    rr->osd_indices.num = 0;
+    for (int n = 0; n < num; n++) {
+        const struct overlay_item *it = &items[n];
+        const struct pl_transform2x2 *tf = &it->tf;
+        float off_x = 0.0, off_y = 0.0;
+        float bounds[4] = { 0.0, 0.0, 1.0, 1.0 };
+        if (atlas) {
+            // Clamp to the texel centers, equivalent to PL_TEX_ADDRESS_CLAMP
+            off_x = it->rc.x0;
+            off_y = it->rc.y0;
+            bounds[0] = (it->rc.x0 + 0.5) / tex_w;
+            bounds[1] = (it->rc.y0 + 0.5) / tex_h;
+            bounds[2] = (it->rc.x1 - 0.5) / tex_w;
+            bounds[3] = (it->rc.y1 - 0.5) / tex_h;
+        }
+
+        for (int i = 0; i < it->ol.num_parts; i++) {
+            const struct pl_overlay_part *part = &it->ol.parts[i];
 
 #define EMIT_VERT(x, y)                                                         \
             do {                                                                \
                 float pos[2] = { part->dst.x, part->dst.y };                    \
-                pl_transform2x2_apply(&tf, pos);                                \
+                pl_transform2x2_apply(tf, pos);                                 \
                 PL_ARRAY_APPEND(rr, rr->osd_vertices, (struct osd_vertex) {     \
                     .pos = {                                                    \
                         2.0 * (pos[0] / fbo->params.w) - 1.0,                   \
                         2.0 * (pos[1] / fbo->params.h) - 1.0,                   \
                     },                                                          \
                     .coord = {                                                  \
-                        part->src.x / ol.tex->params.w,                         \
-                        part->src.y / ol.tex->params.h,                         \
+                        (part->src.x + off_x) / tex_w,                          \
+                        (part->src.y + off_y) / tex_h,                          \
                     },                                                          \
                     .color = {                                                  \
                         part->color[0], part->color[1],                         \
                         part->color[2], part->color[3],                         \
                     },                                                          \
+                    .bounds = {                                                 \
+                        bounds[0], bounds[1], bounds[2], bounds[3],             \
+                    },                                                          \
                 });                                                             \
             } while (0)
 
@@ -871,87 +1609,377 @@ static void draw_overlays(struct pass_state *pass, pl_tex fbo,
             PL_ARRAY_APPEND(rr, rr->osd_indices, idx_base + 1);
             PL_ARRAY_APPEND(rr, rr->osd_indices, idx_base + 3);
         }
+    }
 
-        // Draw parts
-        pl_shader sh = pl_dispatch_begin(rr->dp);
-        ident_t tex = sh_desc(sh, (struct pl_shader_desc) {
-            .desc = {
-                .name = "osd_tex",
-                .type = PL_DESC_SAMPLED_TEX,
-            },
-            .binding = {
-                .object = ol.tex,
-                .sample_mode = (ol.tex->params.format->caps & PL_FMT_CAP_LINEAR)
-                    ? PL_TEX_SAMPLE_LINEAR
-                    : PL_TEX_SAMPLE_NEAREST,
-            },
-        });
+    // Draw parts
+    pl_shader sh = pl_dispatch_begin(rr->dp);
+    ident_t tex = sh_desc(sh, (struct pl_shader_desc) {
+        .desc = {
+            .name = "osd_tex",
+            .type = PL_DESC_SAMPLED_TEX,
+        },
+        .binding = {
+            .object = osd_tex,
+            .sample_mode = (osd_tex->params.format->caps & PL_FMT_CAP_LINEAR)
+                ? PL_TEX_SAMPLE_LINEAR
+                : PL_TEX_SAMPLE_NEAREST,
+        },
+    });
 
-        sh_describe(sh, "overlay");
-        GLSL("// overlay \n");
+    sh_describe(sh, atlas ? "overlay (atlas)" : "overlay");
+    GLSL("// overlay \n");
 
-        switch (ol.mode) {
-        case PL_OVERLAY_NORMAL:
-            GLSL("vec4 color = %s(%s, coord); \n",
-                 sh_tex_fn(sh, ol.tex->params), tex);
-            break;
-        case PL_OVERLAY_MONOCHROME:
-            GLSL("vec4 color = osd_color; \n");
-            break;
-        case PL_OVERLAY_MODE_COUNT:
-            pl_unreachable();
-        };
+    const char *coord = "coord";
+    if (atlas) {
+        GLSL("vec2 osd_pos = clamp(coord, osd_bounds.xy, osd_bounds.zw); \n");
+        coord = "osd_pos";
+    }
 
-        sh->res.output = PL_SHADER_SIG_COLOR;
-        pl_shader_decode_color(sh, &ol.repr, NULL);
-        pl_shader_color_map(sh, params->color_map_params, ol.color, color,
-                            NULL, false);
+    switch (ol->mode) {
+    case PL_OVERLAY_NORMAL:
+        GLSL("vec4 color = %s("$", %s); \n",
+             sh_tex_fn(sh, osd_tex->params), tex, coord);
+        break;
+    case PL_OVERLAY_MONOCHROME:
+        GLSL("vec4 color = osd_color; \n");
+        break;
+    case PL_OVERLAY_MODE_COUNT:
+        pl_unreachable();
+    };
 
-        bool premul = repr.alpha == PL_ALPHA_PREMULTIPLIED;
-        pl_shader_encode_color(sh, &repr);
-        if (ol.mode == PL_OVERLAY_MONOCHROME) {
-            GLSL("color.%s *= %s(%s, coord).r; \n",
-                 premul ? "rgba" : "a",
-                 sh_tex_fn(sh, ol.tex->params), tex);
-        }
+    sh->res.output = PL_SHADER_SIG_COLOR;
+    struct pl_color_repr ol_repr = ol->repr;
+    pl_shader_decode_color(sh, &ol_repr, NULL);
+    pl_shader_color_map(sh, params->color_map_params, ol->color, color,
+                        NULL, false);
+
+    bool premul = repr.alpha == PL_ALPHA_PREMULTIPLIED;
+    pl_shader_encode_color(sh, &repr);
+    if (ol->mode == PL_OVERLAY_MONOCHROME) {
+        GLSL("color.%s *= %s("$", %s).r; \n",
+             premul ? "rgba" : "a",
+             sh_tex_fn(sh, osd_tex->params), tex, coord);
+    }
 
-        swizzle_color(sh, comps, comp_map, true);
+    swizzle_color(sh, comps, comp_map, true);
 
-        struct pl_blend_params blend_params = {
-            .src_rgb = premul ? PL_BLEND_ONE : PL_BLEND_SRC_ALPHA,
-            .src_alpha = PL_BLEND_ONE,
-            .dst_rgb = PL_BLEND_ONE_MINUS_SRC_ALPHA,
-            .dst_alpha = PL_BLEND_ONE_MINUS_SRC_ALPHA,
-        };
+    struct pl_blend_params blend_params = {
+        .src_rgb = premul ? PL_BLEND_ONE : PL_BLEND_SRC_ALPHA,
+        .src_alpha = PL_BLEND_ONE,
+        .dst_rgb = PL_BLEND_ONE_MINUS_SRC_ALPHA,
+        .dst_alpha = PL_BLEND_ONE_MINUS_SRC_ALPHA,
+    };
 
-        bool ok = pl_dispatch_vertex(rr->dp, pl_dispatch_vertex_params(
-            .shader = &sh,
-            .target = fbo,
-            .blend_params = rr->disable_blending ? NULL : &blend_params,
-            .vertex_stride = sizeof(struct osd_vertex),
-            .num_vertex_attribs = ol.mode == PL_OVERLAY_NORMAL ? 2 : 3,
-            .vertex_attribs = rr->osd_attribs,
-            .vertex_position_idx = 0,
-            .vertex_coords = PL_COORDS_NORMALIZED,
-            .vertex_type = PL_PRIM_TRIANGLE_LIST,
-            .vertex_count = rr->osd_indices.num,
-            .vertex_data = rr->osd_vertices.elem,
-            .index_data = rr->osd_indices.elem,
-        ));
+    int num_attribs = ol->mode == PL_OVERLAY_NORMAL ? 2 : 3;
+    if (atlas)
+        num_attribs = PL_ARRAY_SIZE(rr->osd_attribs);
+
+    return pl_dispatch_vertex(rr->dp, pl_dispatch_vertex_params(
+        .shader = &sh,
+        .target = fbo,
+        .blend_params = rr->disable_blending ? NULL : &blend_params,
+        .vertex_stride = sizeof(struct osd_vertex),
+        .num_vertex_attribs = num_attribs,
+        .vertex_attribs = rr->osd_attribs,
+        .vertex_position_idx = 0,
+        .vertex_coords = PL_COORDS_NORMALIZED,
+        .vertex_type = PL_PRIM_TRIANGLE_LIST,
+        .vertex_count = rr->osd_indices.num,
+        .vertex_data = rr->osd_vertices.elem,
+        .index_data = rr->osd_indices.elem,
+    ));
+}
 
-        if (!ok) {
+// `scale` adapts from `pass->dst_rect` to the plane being rendered to
+static void draw_overlays(struct pass_state *pass, pl_tex fbo,
+                          int comps, const int comp_map[4],
+                          const struct pl_overlay *overlays, int num,
+                          struct pl_color_space color, struct pl_color_repr repr,
+                          const struct pl_transform2x2 *output_shift)
+{
+    pl_renderer rr = pass->rr;
+    if (num <= 0 || rr->disable_overlay)
+        return;
+
+    enum pl_fmt_caps caps = fbo->params.format->caps;
+    if (!rr->disable_blending && !(caps & PL_FMT_CAP_BLENDABLE)) {
+        PL_WARN(rr, "Trying to draw an overlay to a non-blendable target. "
+                "Alpha blending is disabled, results may be incorrect!");
+        rr->disable_blending = true;
+    }
+
+    bool is_target = overlays == pass->target.overlays;
+    struct overlay_item *items = pl_calloc_ptr(pass->tmp, num, items);
+    int num_items = 0;
+    for (int n = 0; n < num; n++) {
+        struct overlay_item *it = &items[num_items];
+        it->ol = overlays[n];
+        if (overlay_setup(pass, &it->ol, &it->fallback, is_target,
+                          output_shift, &it->tf))
+        {
+            num_items++;
+        }
+    }
+
+    for (int n = 0; n < num_items;) {
+        // Batch consecutive overlays with the same state into a single draw
+        // call, as long as their vertices can still be indexed
+        const struct pl_overlay *ol = &items[n].ol;
+        bool use_atlas = !rr->disable_overlay_atlas && ol->tex->params.blit_src &&
+                         (ol->tex->params.format->caps & PL_FMT_CAP_BLITTABLE);
+        int end = n + 1, num_verts = 4 * ol->num_parts;
+        while (use_atlas && end < num_items) {
+            const struct pl_overlay *next = &items[end].ol;
+            if (!can_batch_overlays(ol, next))
+                break;
+            if (num_verts + 4 * next->num_parts > UINT16_MAX + 1)
+                break;
+            num_verts += 4 * next->num_parts;
+            end++;
+        }
+
+        pl_tex atlas = NULL;
+        if (end - n > 1 && atlas_pack(rr, &items[n], end - n)) {
+            PL_TRACE(rr, "Batching %d overlays into a %dx%d atlas", end - n,
+                     rr->osd_atlas->params.w, rr->osd_atlas->params.h);
+            atlas = rr->osd_atlas;
+        } else {
+            end = n + 1;
+        }
+
+        if (!draw_overlay_batch(pass, fbo, comps, comp_map, &items[n], end - n,
+                                color, repr, atlas))
+        {
             PL_ERR(rr, "Failed rendering overlays!");
             rr->disable_overlay = true;
             return;
         }
+
+        n = end;
+    }
+}
+
+// Appends the areas of `fbo` covered by each of the target overlays to
+// `rr->overlay_rects`
+static void get_overlay_rects(struct pass_state *pass, pl_tex fbo,
+                              const struct pl_transform2x2 *output_shift)
+{
+    const struct pl_frame *target = &pass->target;
+    pl_renderer rr = pass->rr;
+
+    for (int n = 0; n < target->num_overlays; n++) {
+        struct pl_overlay ol = target->overlays[n];
+        struct pl_overlay_part fallback;
+        struct pl_transform2x2 tf;
+        if (!overlay_setup(pass, &ol, &fallback, true, output_shift, &tf))
+            continue;
+
+        struct pl_rect2df rc = { INFINITY, INFINITY, -INFINITY, -INFINITY };
+        for (int i = 0; i < ol.num_parts; i++) {
+            const struct pl_rect2df *dst = &ol.parts[i].dst;
+            for (int c = 0; c < 4; c++) {
+                float pos[2] = {
+                    (c & 1) ? dst->x1 : dst->x0,
+                    (c & 2) ? dst->y1 : dst->y0,
+                };
+                pl_transform2x2_apply(&tf, pos);
+                rc.x0 = fminf(rc.x0, pos[0]);
+                rc.y0 = fminf(rc.y0, pos[1]);
+                rc.x1 = fmaxf(rc.x1, pos[0]);
+                rc.y1 = fmaxf(rc.y1, pos[1]);
+            }
+        }
+
+        struct pl_rect2d irc = {
+            .x0 = PL_MAX(floorf(rc.x0), 0),
+            .y0 = PL_MAX(floorf(rc.y0), 0),
+            .x1 = PL_MIN(ceilf(rc.x1), fbo->params.w),
+            .y1 = PL_MIN(ceilf(rc.y1), fbo->params.h),
+        };
+
+        if (irc.x1 > irc.x0 && irc.y1 > irc.y0)
+            PL_ARRAY_APPEND(rr, rr->overlay_rects, irc);
+    }
+}
+
+// Retains a copy of `fbo` (prior to blending the target overlays), so that
+// later overlay-only updates can be rendered by `pass_update_overlays`
+static void save_overlay_base(struct pass_state *pass, pl_tex fbo,
+                              const struct pl_transform2x2 *output_shift)
+{
+    pl_renderer rr = pass->rr;
+    if (rr->compile_only)
+        return;
+    rr->overlay_sig = 0;
+
+    bool ok = pl_tex_recreate(rr->gpu, &rr->overlay_base, pl_tex_params(
+        .w          = fbo->params.w,
+        .h          = fbo->params.h,
+        .format     = fbo->params.format,
+        .blit_src   = true,
+        .blit_dst   = true,
+        .debug_tag  = PL_DEBUG_TAG,
+    ));
+
+    if (!ok) {
+        PL_ERR(rr, "Failed creating overlay cache texture, disabling "
+               "partial overlay updates!");
+        rr->disable_overlay_cache = true;
+        return;
     }
+
+    pl_tex_blit(rr->gpu, pl_tex_blit_params(
+        .src = fbo,
+        .dst = rr->overlay_base,
+    ));
+
+    rr->overlay_rects.num = 0;
+    get_overlay_rects(pass, fbo, output_shift);
+    rr->overlay_target = fbo;
+    rr->overlay_sig = pass->params->overlay_cache_signature;
+}
+
+static bool can_update_overlays(const struct pass_state *pass)
+{
+    const struct pl_frame *target = &pass->target;
+    pl_renderer rr = pass->rr;
+    if (!pass->save_overlay_base || rr->compile_only)
+        return false;
+
+    pl_tex fbo = target->planes[0].texture;
+    return rr->overlay_sig == pass->params->overlay_cache_signature &&
+           rr->overlay_target == fbo &&
+           rr->overlay_base->params.w == fbo->params.w &&
+           rr->overlay_base->params.h == fbo->params.h &&
+           rr->overlay_base->params.format == fbo->params.format;
 }
 
 static pl_tex get_hook_tex(void *priv, int width, int height)
 {
     struct pass_state *pass = priv;
 
-    return get_fbo(pass, width, height, NULL, 4, PL_DEBUG_TAG);
+    pl_tex tex = get_fbo(pass, width, height, NULL, 4, PL_DEBUG_TAG);
+    pin_fbo(pass, tex);
+    return tex;
+}
+
+// Hook stages whose input only depends on the image itself, rather than on
+// any of the rendering parameters
+static const enum pl_hook_stage hook_input_stages =
+    PL_HOOK_RGB_INPUT | PL_HOOK_LUMA_INPUT | PL_HOOK_CHROMA_INPUT |
+    PL_HOOK_ALPHA_INPUT | PL_HOOK_XYZ_INPUT;
+
+static uint64_t hook_cache_key(const struct pass_state *pass,
+                               const struct pl_hook *hook, int idx,
+                               const struct pl_hook_params *hparams,
+                               const struct img *img)
+{
+    uint64_t key = pass->image_sig;
+    if (!(hparams->stage & hook_input_stages))
+        pl_hash_merge(&key, pass->params_hash);
+
+    pl_hash_merge(&key, (uintptr_t) hook);
+    pl_hash_merge(&key, idx);
+    pl_hash_merge(&key, hparams->stage);
+    pl_hash_merge(&key, ((uint64_t) img->w << 32) | img->h);
+    pl_hash_merge(&key, img->comps);
+    pl_hash_merge(&key, pl_mem_hash(&hparams->rect, sizeof(hparams->rect)));
+    pl_hash_merge(&key, pl_mem_hash(&hparams->repr, sizeof(hparams->repr)));
+    pl_hash_merge(&key, pl_mem_hash(&hparams->color, sizeof(hparams->color)));
+    pl_hash_merge(&key, pl_mem_hash(&hparams->src_rect, sizeof(hparams->src_rect)));
+    pl_hash_merge(&key, pl_mem_hash(&hparams->dst_rect, sizeof(hparams->dst_rect)));
+    pl_hash_merge(&key, pl_mem_hash(&hook->scale, sizeof(hook->scale)));
+    return key;
+}
+
+static struct cached_hook *find_cached_hook(pl_renderer rr, uint64_t key)
+{
+    for (int i = 0; i < rr->hook_cache.num; i++) {
+        if (rr->hook_cache.elem[i].key == key)
+            return &rr->hook_cache.elem[i];
+    }
+
+    return NULL;
+}
+
+// Retains a copy of the texture returned by a hook
+static void cache_hook_res(struct pass_state *pass, uint64_t key,
+                           const struct pl_hook_res *res)
+{
+    pl_renderer rr = pass->rr;
+    struct cached_hook *ch = find_cached_hook(rr, key);
+    if (!ch) {
+        PL_ARRAY_APPEND(rr, rr->hook_cache, (struct cached_hook) { .key = key });
+        ch = &rr->hook_cache.elem[rr->hook_cache.num - 1];
+    }
+
+    pl_fmt fmt = res->tex->params.format;
+    bool can_blit = res->tex->params.blit_src && (fmt->caps & PL_FMT_CAP_BLITTABLE);
+    bool ok = pl_tex_recreate(rr->gpu, &ch->tex, pl_tex_params(
+        .w          = res->tex->params.w,
+        .h          = res->tex->params.h,
+        .format     = fmt,
+        .sampleable = true,
+        .renderable = !can_blit,
+        .blit_dst   = can_blit,
+        .debug_tag  = PL_DEBUG_TAG,
+    ));
+
+    if (!ok) {
+        PL_WARN(rr, "Failed creating hook cache texture, not caching");
+        pl_tex_destroy(rr->gpu, &ch->tex);
+        PL_ARRAY_REMOVE_AT(rr->hook_cache, ch - rr->hook_cache.elem);
+        return;
+    }
+
+    struct pl_tex_blit_params blit = {
+        .src = res->tex,
+        .dst = ch->tex,
+    };
+
+    if (can_blit) {
+        pl_tex_blit(rr->gpu, &blit);
+    } else {
+        pl_tex_blit_raster(rr->gpu, rr->dp, &blit);
+    }
+
+    ch->signature = pass->image_sig;
+    ch->repr = res->repr;
+    ch->color = res->color;
+    ch->rect = res->rect;
+    ch->comps = res->components;
+}
+
+static inline struct pl_rect2df scale_rect(struct pl_rect2df rc, float sx, float sy)
+{
+    return (struct pl_rect2df) {
+        .x0 = rc.x0 * sx, .y0 = rc.y0 * sy,
+        .x1 = rc.x1 * sx, .y1 = rc.y1 * sy,
+    };
+}
+
+// Resamples the entirety of `img` (which must be a texture) to `w`x`h`,
+// leaving the result as a shader
+static void rescale_hook_img(struct pass_state *pass, struct img *img,
+                             int w, int h)
+{
+    pl_renderer rr = pass->rr;
+    pl_assert(img->tex && !img->sh);
+    float sx = (float) w / img->w, sy = (float) h / img->h;
+    struct pl_sample_src src = {
+        .tex        = img->tex,
+        .rect       = { 0, 0, img->w, img->h },
+        .new_w      = w,
+        .new_h      = h,
+        .components = img->comps,
+    };
+
+    img->sh = pl_dispatch_begin_ex(rr->dp, true);
+    dispatch_sampler(pass, img->sh, &rr->sampler_hook, NULL, &src);
+    img->tex = NULL;
+    img->rect = scale_rect(img->rect, sx, sy);
+    img->w = w;
+    img->h = h;
 }
 
 // Returns if any hook was applied (even if there were errors)
@@ -987,6 +2015,43 @@ static bool pass_hook(struct pass_state *pass, struct img *img,
             .dst_rect = pass->dst_rect,
         };
 
+        // Reduced resolution processing, see `pl_hook.scale`
+        const bool resizable = pl_hook_stage_resizable(stage);
+        const int orig_w = img->w, orig_h = img->h;
+        const struct pl_rect2df orig_rect = img->rect;
+        struct img orig_img = {0};
+        int scaled_w = orig_w, scaled_h = orig_h;
+        if (hook->input == PL_HOOK_SIG_TEX && hook->scale > 0 && hook->scale < 1) {
+            scaled_w = PL_MAX(lrintf(orig_w * hook->scale), 1);
+            scaled_h = PL_MAX(lrintf(orig_h * hook->scale), 1);
+        }
+        const bool scaled = scaled_w != orig_w || scaled_h != orig_h;
+
+        // Re-use the result from an earlier pass over the same frame, skipping
+        // the hook and everything its input depends on
+        uint64_t key = 0;
+        if (hook->deterministic && pass->image_sig && !rr->compile_only) {
+            key = hook_cache_key(pass, hook, n, &hparams, img);
+            const struct cached_hook *ch = find_cached_hook(rr, key);
+            if (ch) {
+                PL_TRACE(rr, "Re-using cached result of hook %d", n);
+                pl_dispatch_abort(rr->dp, &img->sh);
+                *img = (struct img) {
+                    .tex = ch->tex,
+                    .repr = ch->repr,
+                    .color = ch->color,
+                    .comps = ch->comps,
+                    .rect = ch->rect,
+                    .w = ch->tex->params.w,
+                    .h = ch->tex->params.h,
+                };
+                if (scaled)
+                    goto upscale;
+                ret = true;
+                continue;
+            }
+        }
+
         // TODO: Add some sort of `test` API function to the hooks that allows
         // us to skip having to touch the `img` state at all for no-ops
 
@@ -1000,6 +2065,22 @@ static bool pass_hook(struct pass_state *pass, struct img *img,
                 PL_ERR(rr, "Failed dispatching shader prior to hook!");
                 goto error;
             }
+            pin_fbo(pass, hparams.tex); // hooks may save their input
+            if (!scaled)
+                break;
+
+            orig_img = *img;
+            rescale_hook_img(pass, img, scaled_w, scaled_h);
+            hparams.tex = img_tex(pass, img);
+            if (!hparams.tex) {
+                PL_ERR(rr, "Failed downscaling hook input!");
+                *img = orig_img;
+                goto error;
+            }
+            pin_fbo(pass, hparams.tex);
+            hparams.rect = img->rect;
+            PL_TRACE(rr, "Running hook %d at reduced resolution: %dx%d -> %dx%d",
+                     n, orig_w, orig_h, scaled_w, scaled_h);
             break;
         }
 
@@ -1011,28 +2092,36 @@ static bool pass_hook(struct pass_state *pass, struct img *img,
             pl_unreachable();
         }
 
+        pass->in_hook = true;
         struct pl_hook_res res = hook->hook(hook->priv, &hparams);
+        pass->in_hook = false;
         if (res.failed) {
             PL_ERR(rr, "Failed executing hook, disabling");
+            if (orig_img.tex)
+                *img = orig_img;
             goto error;
         }
 
-        bool resizable = pl_hook_stage_resizable(stage);
         switch (res.output) {
         case PL_HOOK_SIG_NONE:
+            if (scaled)
+                *img = orig_img; // discard the downscaled input
             break;
 
         case PL_HOOK_SIG_TEX:
             if (!resizable) {
                 if (res.tex->params.w != img->w ||
                     res.tex->params.h != img->h ||
-                    !pl_rect2d_eq(res.rect, img->rect))
+                    !pl_rect2d_eq(res.rect, hparams.rect))
                 {
                     PL_ERR(rr, "User hook tried resizing non-resizable stage!");
                     goto error;
                 }
             }
 
+            if (key)
+                cache_hook_res(pass, key, &res);
+
             *img = (struct img) {
                 .tex = res.tex,
                 .repr = res.repr,
@@ -1042,13 +2131,16 @@ static bool pass_hook(struct pass_state *pass, struct img *img,
                 .w = res.tex->params.w,
                 .h = res.tex->params.h,
             };
+
+            if (scaled)
+                goto upscale;
             break;
 
         case PL_HOOK_SIG_COLOR:
             if (!resizable) {
                 if (res.sh->output_w != img->w ||
                     res.sh->output_h != img->h ||
-                    !pl_rect2d_eq(res.rect, img->rect))
+                    !pl_rect2d_eq(res.rect, hparams.rect))
                 {
                     PL_ERR(rr, "User hook tried resizing non-resizable stage!");
                     goto error;
@@ -1064,6 +2156,9 @@ static bool pass_hook(struct pass_state *pass, struct img *img,
                 .w = res.sh->output_w,
                 .h = res.sh->output_h,
             };
+
+            if (scaled)
+                goto upscale;
             break;
 
         case PL_HOOK_SIG_COUNT:
@@ -1072,6 +2167,25 @@ static bool pass_hook(struct pass_state *pass, struct img *img,
 
         // a hook was performed successfully
         ret = true;
+        continue;
+
+upscale:
+        if (!img_tex(pass, img)) {
+            PL_ERR(rr, "Failed dispatching hook output!");
+            goto error;
+        }
+
+        if (resizable) {
+            // Scale the result back up by the same factor, preserving any
+            // resizing performed by the hook itself
+            float sx = (float) orig_w / scaled_w, sy = (float) orig_h / scaled_h;
+            rescale_hook_img(pass, img, PL_MAX(lrintf(img->w * sx), 1),
+                             PL_MAX(lrintf(img->h * sy), 1));
+        } else {
+            rescale_hook_img(pass, img, orig_w, orig_h);
+            img->rect = orig_rect;
+        }
+        ret = true;
     }
 
     return ret;
@@ -1220,6 +2334,7 @@ struct plane_state {
     enum plane_type type;
     struct pl_plane plane;
     struct img img; // for per-plane shaders
+    struct img grain_src; // `img` before (deferred) film grain synthesis
     float plane_w, plane_h; // logical plane dimensions
 };
 
@@ -1324,6 +2439,7 @@ static bool plane_film_grain(struct pass_state *pass, int plane_idx,
     if (!grain_params.tex)
         return false;
 
+    const struct img grain_src = *img;
     img->sh = pl_dispatch_begin_ex(rr->dp, true);
     if (!pl_shader_film_grain(img->sh, &rr->grain_state[plane_idx], &grain_params)) {
         pl_dispatch_abort(rr->dp, &img->sh);
@@ -1331,8 +2447,13 @@ static bool plane_film_grain(struct pass_state *pass, int plane_idx,
         return false;
     }
 
+    // Leave the result as a shader, so it can be fused into the plane
+    // sampling pass if possible (see `img_fuse`). This only works for compute
+    // shaders, since the fragment shader variant derives the grain position
+    // from `gl_FragCoord`, which is only valid when rendering to the origin
+    // of a dedicated FBO.
     img->tex = NULL;
-    if (!img_tex(pass, img)) {
+    if (!pl_shader_is_compute(img->sh) && !img_tex(pass, img)) {
         PL_ERR(rr, "Failed applying film grain.. disabling!");
         pl_dispatch_abort(rr->dp, &img->sh);
         img->tex = grain_params.tex;
@@ -1340,10 +2461,30 @@ static bool plane_film_grain(struct pass_state *pass, int plane_idx,
         return false;
     }
 
+    if (img->sh)
+        st->grain_src = grain_src;
     img->repr = repr;
     return true;
 }
 
+// Best-effort fallback for when dispatching a deferred film grain shader
+// fails: drop the pending shader and sample the plane without film grain
+static bool plane_grain_fallback(struct pass_state *pass, struct plane_state *st)
+{
+    pl_renderer rr = pass->rr;
+    if (!st->grain_src.tex)
+        return false;
+
+    PL_WARN(rr, "Failed dispatching plane shader, disabling film grain!");
+    pl_dispatch_abort(rr->dp, &st->img.sh);
+    st->img = st->grain_src;
+    st->img.w = roundf(pl_rect_w(st->img.rect));
+    st->img.h = roundf(pl_rect_h(st->img.rect));
+    st->grain_src = (struct img) {0};
+    rr->disable_grain = true;
+    return true;
+}
+
 static const enum pl_hook_stage plane_hook_stages[] = {
     [PLANE_ALPHA]   = PL_HOOK_ALPHA_INPUT,
     [PLANE_CHROMA]  = PL_HOOK_CHROMA_INPUT,
@@ -1447,6 +2588,40 @@ static bool want_merge(struct pass_state *pass,
     return false;
 }
 
+// Computes the `pl_sample_src` for reading the plane `st` at the resolution
+// of `ref`, excluding the normalization `scale`
+static struct pl_sample_src plane_src(const struct plane_state *st,
+                                      const struct plane_state *ref,
+                                      float off_x, float off_y,
+                                      float stretch_x, float stretch_y)
+{
+    float scale_x = pl_rect_w(st->img.rect) / pl_rect_w(ref->img.rect),
+          scale_y = pl_rect_h(st->img.rect) / pl_rect_h(ref->img.rect),
+          base_x = st->img.rect.x0 - scale_x * off_x,
+          base_y = st->img.rect.y0 - scale_y * off_y;
+
+    struct pl_sample_src src = {
+        .tex        = st->img.tex,
+        .components = st->plane.components,
+        .address_mode = st->plane.address_mode,
+        .new_w      = ref->img.w,
+        .new_h      = ref->img.h,
+        .rect = {
+            base_x,
+            base_y,
+            base_x + stretch_x * pl_rect_w(st->img.rect),
+            base_y + stretch_y * pl_rect_h(st->img.rect),
+        },
+    };
+
+    if (st->plane.flipped) {
+        src.rect.y0 = st->plane_h - src.rect.y0;
+        src.rect.y1 = st->plane_h - src.rect.y1;
+    }
+
+    return src;
+}
+
 // This scales and merges all of the source images, and initializes pass->img.
 static bool pass_read_image(struct pass_state *pass)
 {
@@ -1475,26 +2650,79 @@ static bool pass_read_image(struct pass_state *pass)
     // Original ref texture, even after preprocessing
     pl_tex ref_tex = ref->plane.texture;
 
-    // Merge all compatible planes into 'combined' shaders
+    // Compute the sampling rect of each plane
     for (int i = 0; i < image->num_planes; i++) {
-        struct plane_state *sti = &planes[i];
-        if (!sti->type)
-            continue;
-        if (!want_merge(pass, sti, ref))
+        struct plane_state *st = &planes[i];
+        if (!st->type)
             continue;
 
-        for (int j = i+1; j < image->num_planes; j++) {
-            struct plane_state *stj = &planes[j];
-            bool merge = sti->type == stj->type &&
-                         sti->img.w == stj->img.w &&
-                         sti->img.h == stj->img.h &&
-                         sti->plane.shift_x == stj->plane.shift_x &&
-                         sti->plane.shift_y == stj->plane.shift_y;
-            if (!merge)
-                continue;
+        float rx = (float) st->plane.texture->params.w / ref_tex->params.w,
+              ry = (float) st->plane.texture->params.h / ref_tex->params.h;
 
-            pl_fmt fmt = merge_fmt(rr, &sti->img, &stj->img);
-            if (!fmt)
+        // Only accept integer scaling ratios. This accounts for the fact that
+        // fractionally subsampled planes get rounded up to the nearest integer
+        // size, which we want to discard.
+        float rrx = rx >= 1 ? roundf(rx) : 1.0 / roundf(1.0 / rx),
+              rry = ry >= 1 ? roundf(ry) : 1.0 / roundf(1.0 / ry);
+
+        float sx = st->plane.shift_x,
+              sy = st->plane.shift_y;
+
+        st->img.rect = (struct pl_rect2df) {
+            .x0 = (image->crop.x0 - sx) * rrx,
+            .y0 = (image->crop.y0 - sy) * rry,
+            .x1 = (image->crop.x1 - sx) * rrx,
+            .y1 = (image->crop.y1 - sy) * rry,
+        };
+
+        st->plane_w = ref_tex->params.w * rrx;
+        st->plane_h = ref_tex->params.h * rry;
+    }
+
+    // When downscaling to (or below) the resolution of a subsampled chroma
+    // plane, there's no point in upsampling chroma to the full resolution
+    // first. Instead, read all planes at the chroma resolution directly. This
+    // is decided up-front, so that plane merging doesn't anticipate chroma
+    // scaling that will never happen
+    struct plane_state *read_ref = ref;
+    int dst_w = abs(pl_rect_w(pass->dst_rect)),
+        dst_h = abs(pl_rect_h(pass->dst_rect));
+    bool reduce = !params->num_hooks && !pass->shared_image;
+    for (int i = 0; i < image->num_planes && reduce; i++) {
+        struct plane_state *st = &planes[i];
+        if (st->type != PLANE_CHROMA)
+            continue;
+
+        int w = fabsf(pl_rect_w(st->img.rect)),
+            h = fabsf(pl_rect_h(st->img.rect));
+        bool smaller = w < fabsf(pl_rect_w(read_ref->img.rect)) ||
+                       h < fabsf(pl_rect_h(read_ref->img.rect));
+        if (smaller && w >= dst_w && h >= dst_h) {
+            PL_TRACE(rr, "Reading planes at chroma resolution (plane %d)", i);
+            read_ref = st;
+        }
+    }
+
+    // Merge all compatible planes into 'combined' shaders
+    for (int i = 0; i < image->num_planes; i++) {
+        struct plane_state *sti = &planes[i];
+        if (!sti->type)
+            continue;
+        if (!want_merge(pass, sti, read_ref))
+            continue;
+
+        for (int j = i+1; j < image->num_planes; j++) {
+            struct plane_state *stj = &planes[j];
+            bool merge = sti->type == stj->type &&
+                         sti->img.w == stj->img.w &&
+                         sti->img.h == stj->img.h &&
+                         sti->plane.shift_x == stj->plane.shift_x &&
+                         sti->plane.shift_y == stj->plane.shift_y;
+            if (!merge)
+                continue;
+
+            pl_fmt fmt = merge_fmt(rr, &sti->img, &stj->img);
+            if (!fmt)
                 continue;
 
             PL_TRACE(rr, "Merging plane %d into plane %d", j, i);
@@ -1515,7 +2743,7 @@ static bool pass_read_image(struct pass_state *pass)
             if (!sub)
                 break; // skip merging
 
-            GLSL("tmp = %s(); \n", sub);
+            GLSL("tmp = "$"(); \n", sub);
             for (int jc = 0; jc < stj->img.comps; jc++) {
                 int map = stj->plane.component_mapping[jc];
                 if (!map)
@@ -1529,6 +2757,8 @@ static bool pass_read_image(struct pass_state *pass)
 
             sti->img.fmt = fmt;
             *stj = (struct plane_state) {0};
+            if (read_ref == stj)
+                read_ref = sti;
         }
 
         if (!img_tex(pass, &sti->img)) {
@@ -1539,34 +2769,11 @@ static bool pass_read_image(struct pass_state *pass)
         }
     }
 
-    // Compute the sampling rc of each plane
     for (int i = 0; i < image->num_planes; i++) {
         struct plane_state *st = &planes[i];
         if (!st->type)
             continue;
 
-        float rx = (float) st->plane.texture->params.w / ref_tex->params.w,
-              ry = (float) st->plane.texture->params.h / ref_tex->params.h;
-
-        // Only accept integer scaling ratios. This accounts for the fact that
-        // fractionally subsampled planes get rounded up to the nearest integer
-        // size, which we want to discard.
-        float rrx = rx >= 1 ? roundf(rx) : 1.0 / roundf(1.0 / rx),
-              rry = ry >= 1 ? roundf(ry) : 1.0 / roundf(1.0 / ry);
-
-        float sx = st->plane.shift_x,
-              sy = st->plane.shift_y;
-
-        st->img.rect = (struct pl_rect2df) {
-            .x0 = (image->crop.x0 - sx) * rrx,
-            .y0 = (image->crop.y0 - sy) * rry,
-            .x1 = (image->crop.x1 - sx) * rrx,
-            .y1 = (image->crop.y1 - sy) * rry,
-        };
-
-        st->plane_w = ref_tex->params.w * rrx;
-        st->plane_h = ref_tex->params.h * rry;
-
         PL_TRACE(rr, "Plane %d:", i);
         log_plane_info(rr, st);
 
@@ -1585,30 +2792,47 @@ static bool pass_read_image(struct pass_state *pass)
             log_plane_info(rr, st);
         }
 
+        // Pending plane shaders can only be fused into the read pass if the
+        // plane is sampled starting from its origin. Otherwise, dispatch them
+        // now, before the conceptual size (excluding the cropped area) is
+        // applied to the FBO size
+        if (st->img.sh && (st->img.rect.x0 || st->img.rect.y0)) {
+            if (!img_tex(pass, &st->img) && !plane_grain_fallback(pass, st)) {
+                PL_ERR(rr, "Failed dispatching plane shader, disabling "
+                       "film grain!");
+                rr->disable_grain = true;
+                return false;
+            }
+        }
+
         // Update the conceptual width/height after applying plane shaders
         st->img.w = roundf(pl_rect_w(st->img.rect));
         st->img.h = roundf(pl_rect_h(st->img.rect));
     }
 
+    // Conceptually, read all planes at the resolution of `read_ref`
+    ref = read_ref;
+
     pl_shader sh = pl_dispatch_begin_ex(rr->dp, true);
     sh_require(sh, PL_SHADER_SIG_NONE, 0, 0);
 
     // Initialize the color to black
-    const char *neutral_chroma = "0.0";
+    float neutral_chroma = 0.0;
     if (pl_color_system_is_ycbcr_like(image->repr.sys)) {
         int bits = image->repr.bits.sample_depth;
         if (bits) {
-            neutral_chroma = SH_FLOAT((float) (1 << (bits - 1)) / ((1 << bits) - 1));
+            neutral_chroma = (float) (1 << (bits - 1)) / ((1 << bits) - 1);
         } else {
-            neutral_chroma = "0.5"; // floating point formats
+            neutral_chroma = 0.5; // floating point formats
         }
     }
 
-    GLSL("vec4 color = vec4(0.0, %s, %s, 1.0);   \n"
+    ident_t chroma = SH_FLOAT(neutral_chroma);
+    GLSL("vec4 color = vec4(0.0, "$", "$", 1.0); \n"
          "// pass_read_image                     \n"
          "{                                      \n"
          "vec4 tmp;                              \n",
-         neutral_chroma, neutral_chroma);
+         chroma, chroma);
 
     // For quality reasons, explicitly drop subpixel offsets from the ref rect
     // and re-add them as part of `pass->img.rect`, always rounding towards 0.
@@ -1618,84 +2842,110 @@ static bool pass_read_image(struct pass_state *pass)
           stretch_x = roundf(pl_rect_w(ref->img.rect)) / pl_rect_w(ref->img.rect),
           stretch_y = roundf(pl_rect_h(ref->img.rect)) / pl_rect_h(ref->img.rect);
 
+    // Luma plane used to guide chroma upscaling, if enabled
+    struct pl_sample_src luma_src = {0};
+    for (int i = 0; i < image->num_planes && params->chroma_from_luma; i++) {
+        const struct plane_state *st = &planes[i];
+        if (st->type != PLANE_LUMA || !st->img.tex || rr->disable_sampling)
+            continue;
+        if (st->plane.component_mapping[0] != PL_CHANNEL_Y)
+            continue;
+        if (!(st->img.tex->params.format->caps & PL_FMT_CAP_LINEAR))
+            continue;
+
+        struct pl_color_repr repr = st->img.repr;
+        luma_src = plane_src(st, ref, off_x, off_y, stretch_x, stretch_y);
+        luma_src.scale = pl_color_repr_normalize(&repr);
+        break;
+    }
+
     for (int i = 0; i < image->num_planes; i++) {
         struct plane_state *st = &planes[i];
         const struct pl_plane *plane = &st->plane;
         if (!st->type)
             continue;
 
-        float scale_x = pl_rect_w(st->img.rect) / pl_rect_w(ref->img.rect),
-              scale_y = pl_rect_h(st->img.rect) / pl_rect_h(ref->img.rect),
-              base_x = st->img.rect.x0 - scale_x * off_x,
-              base_y = st->img.rect.y0 - scale_y * off_y;
-
-        struct pl_sample_src src = {
-            .tex        = st->img.tex,
-            .components = plane->components,
-            .address_mode = plane->address_mode,
-            .scale      = pl_color_repr_normalize(&st->img.repr),
-            .new_w      = ref->img.w,
-            .new_h      = ref->img.h,
-            .rect = {
-                base_x,
-                base_y,
-                base_x + stretch_x * pl_rect_w(st->img.rect),
-                base_y + stretch_y * pl_rect_h(st->img.rect),
-            },
-        };
+        struct pl_sample_src src;
+        src = plane_src(st, ref, off_x, off_y, stretch_x, stretch_y);
+        src.scale = pl_color_repr_normalize(&st->img.repr);
 
-        if (plane->flipped) {
-            src.rect.y0 = st->plane_h - src.rect.y0;
-            src.rect.y1 = st->plane_h - src.rect.y1;
-        }
-
-        PL_TRACE(rr, "Aligning plane %d: {%f %f %f %f} -> {%f %f %f %f}%s",
-                 i, st->img.rect.x0, st->img.rect.y0,
-                 st->img.rect.x1, st->img.rect.y1,
-                 src.rect.x0, src.rect.y0,
-                 src.rect.x1, src.rect.y1,
-                 plane->flipped ? " (flipped) " : "");
-
-        pl_shader psh = pl_dispatch_begin_ex(rr->dp, true);
-        if (deband_src(pass, psh,  &src) != DEBAND_SCALED)
-            dispatch_sampler(pass, psh, &rr->samplers_src[i], NULL, &src);
-
-        ident_t sub = sh_subpass(sh, psh);
-        if (!sub) {
-            // Can't merge shaders, so instead force FBO indirection here
-            struct img inter_img = {
-                .sh = psh,
-                .w = ref->img.w,
-                .h = ref->img.h,
-                .comps = src.components,
-            };
+        // Planes still pending as shaders (e.g. after film grain synthesis)
+        // can be merged directly if they don't need any further processing
+        bool deband = !rr->disable_debanding && params->deband_params;
+        ident_t sub = deband ? NULL_IDENT : img_fuse(pass, sh, &st->img, &src);
+        if (sub) {
+            GLSL("tmp = vec4("$") * "$"();\n", SH_FLOAT(src.scale), sub);
+        } else {
+            if (st->img.sh) {
+                src.tex = img_tex(pass, &st->img);
+                if (!src.tex) {
+                    if (!plane_grain_fallback(pass, st)) {
+                        PL_ERR(rr, "Failed dispatching plane shader, disabling "
+                               "film grain!");
+                        rr->disable_grain = true;
+                        pl_dispatch_abort(rr->dp, &sh);
+                        return false;
+                    }
+
+                    src = plane_src(st, ref, off_x, off_y, stretch_x, stretch_y);
+                    src.scale = pl_color_repr_normalize(&st->img.repr);
+                }
+            }
 
-            pl_tex inter_tex = img_tex(pass, &inter_img);
-            if (!inter_tex) {
-                PL_ERR(rr, "Failed dispatching subpass for plane.. disabling "
-                       "all plane shaders");
-                rr->disable_sampling = true;
-                rr->disable_debanding = true;
-                rr->disable_grain = true;
-                pl_dispatch_abort(rr->dp, &sh);
-                return false;
+            PL_TRACE(rr, "Aligning plane %d: {%f %f %f %f} -> {%f %f %f %f}%s",
+                     i, st->img.rect.x0, st->img.rect.y0,
+                     st->img.rect.x1, st->img.rect.y1,
+                     src.rect.x0, src.rect.y0,
+                     src.rect.x1, src.rect.y1,
+                     plane->flipped ? " (flipped) " : "");
+
+            pl_shader psh = pl_dispatch_begin_ex(rr->dp, true);
+            if (deband_src(pass, psh,  &src) != DEBAND_SCALED) {
+                bool upscaled = fabsf(pl_rect_w(src.rect)) < src.new_w ||
+                                fabsf(pl_rect_h(src.rect)) < src.new_h;
+                if (luma_src.tex && st->type == PLANE_CHROMA && upscaled) {
+                    pl_shader_sample_cfl(psh, &src, &luma_src);
+                } else {
+                    dispatch_sampler(pass, psh, &rr->samplers_src[i], NULL, &src);
+                }
             }
 
-            psh = pl_dispatch_begin_ex(rr->dp, true);
-            pl_shader_sample_direct(psh, pl_sample_src( .tex = inter_tex ));
             sub = sh_subpass(sh, psh);
-            pl_assert(sub);
+            if (!sub) {
+                // Can't merge shaders, so instead force FBO indirection here
+                struct img inter_img = {
+                    .sh = psh,
+                    .w = ref->img.w,
+                    .h = ref->img.h,
+                    .comps = src.components,
+                };
+
+                pl_tex inter_tex = img_tex(pass, &inter_img);
+                if (!inter_tex) {
+                    PL_ERR(rr, "Failed dispatching subpass for plane.. "
+                           "disabling all plane shaders");
+                    rr->disable_sampling = true;
+                    rr->disable_debanding = true;
+                    rr->disable_grain = true;
+                    pl_dispatch_abort(rr->dp, &sh);
+                    return false;
+                }
+
+                psh = pl_dispatch_begin_ex(rr->dp, true);
+                pl_shader_sample_direct(psh, pl_sample_src( .tex = inter_tex ));
+                sub = sh_subpass(sh, psh);
+                pl_assert(sub);
+            }
+
+            GLSL("tmp = "$"();\n", sub);
+            pl_dispatch_abort(rr->dp, &psh); // we don't need it anymore
         }
 
-        GLSL("tmp = %s();\n", sub);
         for (int c = 0; c < src.components; c++) {
             if (plane->component_mapping[c] < 0)
                 continue;
             GLSL("color[%d] = tmp[%d];\n", plane->component_mapping[c], c);
         }
-
-        // we don't need it anymore
-        pl_dispatch_abort(rr->dp, &psh);
     }
 
     GLSL("}\n");
@@ -1728,7 +2978,7 @@ static bool pass_read_image(struct pass_state *pass)
     if (lut_type == PL_LUT_NATIVE || lut_type == PL_LUT_CONVERSION) {
         // Fix bit depth normalization before applying LUT
         float scale = pl_color_repr_normalize(&pass->img.repr);
-        GLSL("color *= vec4(%s); \n", SH_FLOAT(scale));
+        GLSL("color *= vec4("$"); \n", SH_FLOAT(scale));
         pl_shader_set_alpha(sh, &pass->img.repr, PL_ALPHA_INDEPENDENT);
         pl_shader_custom_lut(sh, image->lut, &rr->lut_state[LUT_IMAGE]);
 
@@ -1739,8 +2989,23 @@ static bool pass_read_image(struct pass_state *pass)
         }
     }
 
-    if (needs_conversion)
-        pl_shader_decode_color(sh, &pass->img.repr, params->color_adjustment);
+    if (needs_conversion) {
+        struct pl_color_repr *repr = &pass->img.repr;
+        if (repr->sys == PL_COLOR_SYSTEM_DOLBYVISION && repr->dovi) {
+            // Perform the reshaping via a cached LUT instead, and strip it
+            // from the metadata used for the remainder of the decoding
+            float scale = pl_color_repr_normalize(repr);
+            GLSL("color.rgb *= vec3("$"); \n", SH_FLOAT(scale));
+            pl_shader_dovi_reshape_lut(sh, repr->dovi, &rr->dovi_state);
+
+            struct pl_dovi_metadata *dovi = pl_memdup(pass->tmp, repr->dovi, sizeof(*dovi));
+            for (int c = 0; c < PL_ARRAY_SIZE(dovi->comp); c++)
+                dovi->comp[c].num_pivots = 0;
+            repr->dovi = dovi;
+        }
+
+        pl_shader_decode_color(sh, repr, params->color_adjustment);
+    }
     if (lut_type == PL_LUT_NORMALIZED)
         pl_shader_custom_lut(sh, image->lut, &rr->lut_state[LUT_IMAGE]);
 
@@ -1827,25 +3092,104 @@ static bool pass_scale_main(struct pass_state *pass)
             use_linear = false; // linear HDR needs out-of-range signals
     }
 
-    if (use_linear || use_sigmoid) {
+    // If the scaled result goes straight into a single-plane target, pick
+    // the shader type based on the target's capabilities rather than the
+    // intermediate format's, since we'd otherwise force an extra FBO
+    // indirection for compute shaders that can't write to the target
+    pl_tex target_tex = NULL;
+    uint64_t output_hooks = PL_HOOK_POST_KERNEL | PL_HOOK_SCALED | PL_HOOK_OUTPUT;
+    if (pass->target.num_planes == 1) {
+        target_tex = pass->target.planes[0].texture;
+        for (int i = 0; i < params->num_hooks; i++) {
+            if (params->hooks[i]->stages & output_hooks)
+                target_tex = NULL;
+        }
+    }
+
+    float box_thresh = params->box_downscale_threshold;
+    bool use_box = box_thresh && info.dir == SAMPLER_DOWN &&
+                   (fbofmt->caps & PL_FMT_CAP_LINEAR);
+
+    // If the image is still a plain texture, try linearizing it as part of
+    // the scaler's texel fetch, instead of wasting a whole pass on it
+    pl_shader fused = NULL;
+    if ((use_linear || use_sigmoid) && img->tex && !need_fbo && !use_box) {
+        src.tex = img->tex;
+        fused = dispatch_sampler_fused(pass, &rr->sampler_main, target_tex, &src,
+                                       &img->color,
+                                       use_sigmoid ? params->sigmoid_params : NULL);
+        if (fused) {
+            PL_TRACE(rr, "Fused linearization into main scaler");
+            img->color.transfer = PL_COLOR_TRC_LINEAR;
+        }
+    }
+
+    if ((use_linear || use_sigmoid) && !fused) {
         pl_shader_linearize(img_sh(pass, img), &img->color);
         img->color.transfer = PL_COLOR_TRC_LINEAR;
         pass_hook(pass, img, PL_HOOK_LINEAR);
     }
 
-    if (use_sigmoid) {
+    if (use_sigmoid && !fused) {
         pl_shader_sigmoidize(img_sh(pass, img), params->sigmoid_params);
         pass_hook(pass, img, PL_HOOK_SIGMOID);
     }
 
     pass_hook(pass, img, PL_HOOK_PRE_KERNEL);
 
+    if (use_box) {
+        // Halve the image using bilinear sampling, which is equivalent to
+        // a 2x2 box filter, until the ratio is small enough for the scaler
+        box_thresh = PL_MAX(box_thresh, 2.0f);
+        while (fabsf(pl_rect_w(img->rect)) >= box_thresh * src.new_w &&
+               fabsf(pl_rect_h(img->rect)) >= box_thresh * src.new_h)
+        {
+            int w = ceilf(fabsf(pl_rect_w(img->rect)) / 2),
+                h = ceilf(fabsf(pl_rect_h(img->rect)) / 2);
+
+            pl_tex tex = img_tex(pass, img);
+            if (!tex)
+                return false;
+            release_fbos(pass, tex);
+
+            pl_shader sh = pl_dispatch_begin_ex(rr->dp, true);
+            pl_shader_sample_direct(sh, pl_sample_src(
+                .tex        = tex,
+                .rect       = img->rect,
+                .new_w      = w,
+                .new_h      = h,
+                .components = img->comps,
+            ));
+
+            PL_TRACE(rr, "Box reducing %dx%d -> %dx%d", tex->params.w,
+                     tex->params.h, w, h);
+
+            *img = (struct img) {
+                .sh     = sh,
+                .w      = w,
+                .h      = h,
+                .repr   = img->repr,
+                .rect   = { 0, 0, w, h },
+                .color  = img->color,
+                .comps  = img->comps,
+            };
+        }
+
+        src.rect = img->rect;
+    }
+
     src.tex = img_tex(pass, img);
     if (!src.tex)
         return false;
 
-    pl_shader sh = pl_dispatch_begin_ex(rr->dp, true);
-    dispatch_sampler(pass, sh, &rr->sampler_main, NULL, &src);
+    // All plane intermediates and earlier stages have been consumed by now
+    release_fbos(pass, src.tex);
+
+    pl_shader sh = fused;
+    if (!sh) {
+        sh = pl_dispatch_begin_ex(rr->dp, true);
+        dispatch_sampler(pass, sh, &rr->sampler_main, target_tex, &src);
+    }
     *img = (struct img) {
         .sh     = sh,
         .w      = src.new_w,
@@ -1873,35 +3217,17 @@ static bool pass_scale_main(struct pass_state *pass)
         1.0 - (params)->background_transparency,                                \
     }
 
-static bool pass_output_target(struct pass_state *pass)
+// Applies all of the color management steps (custom LUTs, ICC profiles, tone
+// and gamut mapping, color blindness simulation) needed to convert from the
+// image to the target color space, leaving the result in `color`
+static void pass_color_map(struct pass_state *pass, pl_shader sh,
+                           struct img *img, bool prelinearized)
 {
     const struct pl_render_params *params = pass->params;
     const struct pl_frame *image = &pass->image;
     const struct pl_frame *target = &pass->target;
     pl_renderer rr = pass->rr;
-
-    struct img *img = &pass->img;
-    pl_shader sh = img_sh(pass, img);
-
-    // Color management
-    bool prelinearized = false;
     bool need_conversion = true;
-    assert(image->color.primaries == img->color.primaries);
-    if (img->color.transfer == PL_COLOR_TRC_LINEAR) {
-        if (img->repr.alpha == PL_ALPHA_PREMULTIPLIED) {
-            // Very annoying edge case: since prelinerization happens with
-            // premultiplied alpha, but color mapping happens with independent
-            // alpha, we need to go back to non-linear representation *before*
-            // alpha mode conversion, to avoid distortion
-            img->color.transfer = image->color.transfer;
-            pl_shader_delinearize(sh, &img->color);
-        } else {
-            prelinearized = true;
-        }
-    }
-
-    // Do all processing in independent alpha, to avoid nonlinear distortions
-    pl_shader_set_alpha(sh, &img->repr, PL_ALPHA_INDEPENDENT);
 
     bool need_icc = !params->ignore_icc_profiles &&
                     (image->profile.data || target->profile.data) &&
@@ -1943,14 +3269,14 @@ static bool pass_output_target(struct pass_state *pass)
                             NULL, prelinearized);
 
         if (params->lut_type == PL_LUT_NORMALIZED) {
-            GLSLF("color.rgb *= vec3(1.0/%s); \n",
+            GLSLF("color.rgb *= vec3(1.0/"$"); \n",
                   SH_FLOAT(pl_color_transfer_nominal_peak(lut_in.transfer)));
         }
 
         pl_shader_custom_lut(sh, params->lut, &rr->lut_state[LUT_PARAMS]);
 
         if (params->lut_type == PL_LUT_NORMALIZED) {
-            GLSLF("color.rgb *= vec3(%s); \n",
+            GLSLF("color.rgb *= vec3("$"); \n",
                   SH_FLOAT(pl_color_transfer_nominal_peak(lut_out.transfer)));
         }
 
@@ -2021,6 +3347,213 @@ fallback:
     enum pl_lut_type lut_type = guess_frame_lut_type(target, true);
     if (lut_type == PL_LUT_NORMALIZED || lut_type == PL_LUT_CONVERSION)
         pl_shader_custom_lut(sh, target->lut, &rr->lut_state[LUT_TARGET]);
+}
+
+static uint64_t color_lut_signature(const struct pass_state *pass)
+{
+    const struct pl_render_params *params = pass->params;
+    const struct pl_frame *image = &pass->image;
+    const struct pl_frame *target = &pass->target;
+    pl_renderer rr = pass->rr;
+    uint64_t hash = 0;
+
+#define HASH_VAL(val) pl_hash_merge(&hash, pl_mem_hash(&(val), sizeof(val)))
+#define HASH_PTR(ptr)                                                           \
+    do {                                                                        \
+        if (ptr)                                                                \
+            pl_hash_merge(&hash, pl_mem_hash(ptr, sizeof(*(ptr))));             \
+    } while (0)
+
+    HASH_VAL(image->color);
+    HASH_VAL(target->color);
+    HASH_VAL(image->profile.signature);
+    HASH_VAL(target->profile.signature);
+    HASH_PTR(params->color_map_params);
+    HASH_PTR(params->cone_params);
+#ifdef PL_HAVE_LCMS
+    HASH_PTR(PL_DEF(params->icc_params, params->lut3d_params));
+#endif
+    HASH_VAL(params->ignore_icc_profiles);
+    HASH_VAL(params->force_icc_lut);
+    HASH_VAL(params->force_3dlut);
+    HASH_VAL(params->lut_type);
+    HASH_VAL(rr->disable_icc);
+    if (params->lut)
+        pl_hash_merge(&hash, params->lut->signature);
+    if (target->lut) {
+        pl_hash_merge(&hash, target->lut->signature);
+        HASH_VAL(target->lut_type);
+    }
+
+#undef HASH_VAL
+#undef HASH_PTR
+    return hash;
+}
+
+// Size of each dimension of the baked color LUT
+#define COLOR_LUT_SIZE 64
+
+// (Re)generates `rr->color_lut` by evaluating `pass_color_map` once for every
+// point of the LUT. The 3D LUT is unrolled into a 2D texture, with the blue
+// channel indexing the horizontal slices.
+static bool color_lut_generate(struct pass_state *pass)
+{
+    pl_renderer rr = pass->rr;
+    const int size = COLOR_LUT_SIZE;
+
+    bool ok = pl_tex_recreate(rr->gpu, &rr->color_lut, pl_tex_params(
+        .w          = size * size,
+        .h          = size,
+        .format     = pass->fbofmt[4],
+        .sampleable = true,
+        .renderable = true,
+        .debug_tag  = PL_DEBUG_TAG,
+    ));
+
+    if (!ok) {
+        PL_ERR(rr, "Failed creating color LUT texture!");
+        return false;
+    }
+
+    pl_shader sh = pl_dispatch_begin(rr->dp);
+    sh_require(sh, PL_SHADER_SIG_NONE, size * size, size);
+    sh_describe(sh, "color LUT");
+    GLSL("vec4 color;                                           \n"
+         "// color_lut_generate                                 \n"
+         "{                                                     \n"
+         "vec2 idx = floor(gl_FragCoord.xy);                    \n"
+         "float slice = floor(idx.x * "$");                     \n"
+         "vec3 rgb = vec3(idx.x - slice * "$", idx.y, slice);   \n"
+         "color = vec4(rgb * vec3("$"), 1.0);                   \n"
+         "}                                                     \n",
+         SH_FLOAT(1.0 / size), SH_FLOAT(size), SH_FLOAT(1.0 / (size - 1)));
+
+    // The LUT is indexed by the non-linear image signal
+    struct img img = pass->img;
+    img.color = pass->image.color;
+    pass_color_map(pass, sh, &img, false);
+
+    // Nothing else depends on the LUT until it's sampled by the main pass
+    ok = pl_dispatch_finish(rr->dp, pl_dispatch_params(
+        .shader = &sh,
+        .target = rr->color_lut,
+        .async = true,
+    ));
+
+    if (!ok) {
+        PL_ERR(rr, "Failed generating color LUT!");
+        return false;
+    }
+
+    return true;
+}
+
+// Applies the color management steps via `rr->color_lut`, regenerating it if
+// any of the inputs changed. Returns false if baking is disabled or not
+// possible, in which case `pass_color_map` must be used instead.
+static bool pass_bake_color_map(struct pass_state *pass, pl_shader sh,
+                                bool prelinearized)
+{
+    const struct pl_render_params *params = pass->params;
+    pl_renderer rr = pass->rr;
+    const int size = COLOR_LUT_SIZE;
+
+    if (!params->bake_color_lut || rr->disable_color_lut)
+        return false;
+
+    // The LUT can't capture the results of dynamic peak detection
+    if (rr->peak_detect_active)
+        return false;
+
+    pl_fmt fmt = pass->fbofmt[4];
+    if (!fmt || !(fmt->caps & PL_FMT_CAP_LINEAR) ||
+        size * size > rr->gpu->limits.max_tex_2d_dim)
+    {
+        PL_WARN(rr, "Baked color LUT unsupported by this GPU, disabling..");
+        rr->disable_color_lut = true;
+        return false;
+    }
+
+    uint64_t signature = color_lut_signature(pass);
+    if (!rr->color_lut || rr->color_lut_sig != signature) {
+        rr->color_lut_sig = 0;
+        uint64_t num_skipped = pl_dispatch_async_skipped(rr->dp);
+        if (!color_lut_generate(pass)) {
+            rr->disable_color_lut = true;
+            return false;
+        }
+
+        // The LUT contents are undefined while its shader is still compiling
+        if (pl_dispatch_async_skipped(rr->dp) != num_skipped)
+            return false;
+
+        rr->color_lut_sig = signature;
+    }
+
+    ident_t lut = sh_bind(sh, rr->color_lut, PL_TEX_ADDRESS_CLAMP,
+                          PL_TEX_SAMPLE_LINEAR, "color_lut", NULL,
+                          NULL, NULL, NULL);
+    if (!lut)
+        return false;
+
+    // The LUT only covers the normalized range of the non-linear signal
+    if (prelinearized) {
+        struct pl_color_space csp = pass->image.color;
+        pl_shader_delinearize(sh, &csp);
+    }
+
+    const char *tex_fn = sh_tex_fn(sh, rr->color_lut->params);
+    sh_describe(sh, "baked color LUT");
+    GLSL("// pass_bake_color_map                                     \n"
+         "{                                                          \n"
+         "vec3 idx = clamp(color.rgb, 0.0, 1.0) * vec3("$");        \n"
+         "float slice = min(floor(idx.b), "$");                      \n"
+         "vec2 pos = vec2(idx.r + slice * "$", idx.g) + vec2(0.5);   \n"
+         "pos *= vec2("$", "$");                                     \n"
+         "color.rgb = mix(%s("$", pos).rgb,                          \n"
+         "                %s("$", pos + vec2("$", 0.0)).rgb,         \n"
+         "                idx.b - slice);                            \n"
+         "}                                                          \n",
+         SH_FLOAT(size - 1), SH_FLOAT(size - 2), SH_FLOAT(size),
+         SH_FLOAT(1.0 / (size * size)), SH_FLOAT(1.0 / size),
+         tex_fn, lut, tex_fn, lut, SH_FLOAT(1.0 / size));
+
+    return true;
+}
+
+static bool pass_output_target(struct pass_state *pass)
+{
+    const struct pl_render_params *params = pass->params;
+    const struct pl_frame *image = &pass->image;
+    const struct pl_frame *target = &pass->target;
+    pl_renderer rr = pass->rr;
+
+    struct img *img = &pass->img;
+    pl_shader sh = img_sh(pass, img);
+
+    // Color management
+    bool prelinearized = false;
+    assert(image->color.primaries == img->color.primaries);
+    if (img->color.transfer == PL_COLOR_TRC_LINEAR) {
+        if (img->repr.alpha == PL_ALPHA_PREMULTIPLIED) {
+            // Very annoying edge case: since prelinerization happens with
+            // premultiplied alpha, but color mapping happens with independent
+            // alpha, we need to go back to non-linear representation *before*
+            // alpha mode conversion, to avoid distortion
+            img->color.transfer = image->color.transfer;
+            pl_shader_delinearize(sh, &img->color);
+        } else {
+            prelinearized = true;
+        }
+    }
+
+    // Do all processing in independent alpha, to avoid nonlinear distortions
+    pl_shader_set_alpha(sh, &img->repr, PL_ALPHA_INDEPENDENT);
+
+    if (!pass_bake_color_map(pass, sh, prelinearized))
+        pass_color_map(pass, sh, img, prelinearized);
+
+    enum pl_lut_type lut_type = guess_frame_lut_type(target, true);
 
     bool need_blend = params->blend_against_tiles || !target->repr.alpha;
     if (img->comps == 4 && need_blend) {
@@ -2030,15 +3563,15 @@ fallback:
             if (memcmp(color, zero, sizeof(zero)) == 0)
                 color = pl_render_default_params.tile_colors;
             int size = PL_DEF(params->tile_size, pl_render_default_params.tile_size);
-            GLSLH("#define bg_tile_a vec3(%s, %s, %s) \n",
+            GLSLH("#define bg_tile_a vec3("$", "$", "$") \n",
                   SH_FLOAT(color[0][0]), SH_FLOAT(color[0][1]), SH_FLOAT(color[0][2]));
-            GLSLH("#define bg_tile_b vec3(%s, %s, %s) \n",
+            GLSLH("#define bg_tile_b vec3("$", "$", "$") \n",
                   SH_FLOAT(color[1][0]), SH_FLOAT(color[1][1]), SH_FLOAT(color[1][2]));
-            GLSL("%s tile = lessThan(fract(gl_FragCoord.xy * %s), vec2(0.5));   \n"
+            GLSL("%s tile = lessThan(fract(gl_FragCoord.xy * "$"), vec2(0.5));  \n"
                  "vec3 bg_color = tile.x == tile.y ? bg_tile_a : bg_tile_b;     \n",
                  sh_bvec(sh, 2), SH_FLOAT(1.0 / size));
         } else {
-            GLSLH("#define bg_color vec3(%s, %s, %s) \n",
+            GLSLH("#define bg_color vec3("$", "$", "$") \n",
                   SH_FLOAT(params->background_color[0]),
                   SH_FLOAT(params->background_color[1]),
                   SH_FLOAT(params->background_color[2]));
@@ -2132,6 +3665,8 @@ fallback:
                 return false;
             }
 
+            release_fbos(pass, src.tex);
+
             PL_TRACE(rr, "Sampling %dx%d img aligned from {%f %f %f %f}",
                      pass->img.w, pass->img.h,
                      src.rect.x0, src.rect.y0,
@@ -2151,7 +3686,7 @@ fallback:
             // Single plane, so we can directly re-use the img shader unless
             // it's incompatible with the FBO capabilities
             bool is_comp = pl_shader_is_compute(img_sh(pass, img));
-            if (is_comp && !plane->texture->params.storable) {
+            if (is_comp && !target_can_compute(pass, plane->texture)) {
                 if (!img_tex(pass, img)) {
                     PL_ERR(rr, "Rendering requires compute shaders, but output "
                            "is not storable, and FBOs are unavailable. This "
@@ -2173,7 +3708,7 @@ fallback:
                 pl_shader_dither(sh, depth, &rr->dither_state, params->dither_params);
         }
 
-        GLSL("color *= vec4(1.0 / %s); \n", SH_FLOAT(scale));
+        GLSL("color *= vec4(1.0 / "$"); \n", SH_FLOAT(scale));
         swizzle_color(sh, plane->components, plane->component_mapping, false);
 
         struct pl_rect2d plane_rect = {
@@ -2196,6 +3731,7 @@ fallback:
             tscale.c[1] += plane->texture->params.h;
         }
 
+        graph_add(pass, sh, plane->texture);
         bool ok = pl_dispatch_finish(rr->dp, pl_dispatch_params(
             .shader = &sh,
             .target = plane->texture,
@@ -2213,6 +3749,9 @@ fallback:
                           &tscale);
         }
 
+        if (pass->save_overlay_base)
+            save_overlay_base(pass, plane->texture, &tscale);
+
         draw_overlays(pass, plane->texture, plane->components,
                       plane->component_mapping, target->overlays,
                       target->num_overlays, target->color, target->repr,
@@ -2452,17 +3991,39 @@ static bool acquire_frame(struct pass_state *pass, struct pl_frame *frame)
 static void pass_uninit(struct pass_state *pass)
 {
     pl_renderer rr = pass->rr;
+    if (pass->num_graph) {
+        PL_TRACE(rr, "Pass graph:");
+        for (int i = 0; i < pass->num_graph; i++)
+            PL_TRACE(rr, "    %.*s", PL_STR_FMT(pass->graph[i].desc));
+    }
+
+    pl_dispatch_callback(rr->dp, NULL, NULL);
     pl_dispatch_abort(rr->dp, &pass->img.sh);
     if (pass->image.release)
         pass->image.release(rr->gpu, &pass->image);
     if (pass->target.release)
         pass->target.release(rr->gpu, &pass->target);
-    pl_free_ptr(&pass->tmp);
+
+    if (pass->tmp) {
+        pl_arena_reset(pass->tmp);
+        PL_ARRAY_APPEND(rr, rr->arenas, pass->tmp);
+        pass->tmp = NULL;
+    }
 }
 
-static bool pass_init(struct pass_state *pass, bool acquire_image)
+// Per-pass temporary allocations are short-lived and numerous, so serve them
+// from a recycled arena instead of individual heap allocations
+static void *pass_tmp(pl_renderer rr)
 {
-    struct pl_frame *image = pass->src_ref < 0 ? NULL : &pass->image;
+    void *tmp;
+    if (!PL_ARRAY_POP(rr->arenas, &tmp))
+        tmp = pl_arena_new(rr);
+    return tmp;
+}
+
+static bool pass_init(struct pass_state *pass, bool acquire_image)
+{
+    struct pl_frame *image = pass->src_ref < 0 ? NULL : &pass->image;
     struct pl_frame *target = &pass->target;
     if (acquire_image && !acquire_frame(pass, image))
         goto error;
@@ -2509,7 +4070,7 @@ static bool pass_init(struct pass_state *pass, bool acquire_image)
         }
     }
 
-    pass->tmp = pl_tmp(NULL);
+    pass->tmp = pass_tmp(pass->rr);
     return true;
 
 error:
@@ -2532,7 +4093,10 @@ static void pass_begin_frame(struct pass_state *pass)
 
     size_t size = rr->fbos.num * sizeof(bool);
     pass->fbos_used = pl_realloc(pass->tmp, pass->fbos_used, size);
+    pass->fbos_pinned = pl_realloc(pass->tmp, pass->fbos_pinned, size);
     memset(pass->fbos_used, 0, size);
+    memset(pass->fbos_pinned, 0, size);
+    pass->num_graph = 0;
 }
 
 static bool draw_empty_overlays(pl_renderer rr,
@@ -2584,15 +4148,326 @@ static bool draw_empty_overlays(pl_renderer rr,
     return true;
 }
 
-bool pl_render_image(pl_renderer rr, const struct pl_frame *pimage,
-                     const struct pl_frame *ptarget,
-                     const struct pl_render_params *params)
+// Re-renders only the target overlays, on top of the frame retained by
+// `save_overlay_base`. This restores the areas covered by both the previous
+// and current overlays, so that stale overlays are erased, and then blends
+// the current overlays as usual.
+static void pass_update_overlays(struct pass_state *pass)
+{
+    const struct pl_frame *target = &pass->target;
+    const struct pl_plane *plane = &target->planes[0];
+    pl_renderer rr = pass->rr;
+    pl_tex fbo = plane->texture;
+
+    // Math replicated from `pass_output_target` (for a single plane)
+    struct pl_transform2x2 tscale = {
+        .mat = {{{ 1.0, 0.0 }, { 0.0, 1.0 }}},
+        .c = { -plane->shift_x, -plane->shift_y },
+    };
+
+    if (plane->flipped) {
+        tscale.mat.m[1][1] = -tscale.mat.m[1][1];
+        tscale.c[1] += fbo->params.h;
+    }
+
+    int num_old = rr->overlay_rects.num;
+    get_overlay_rects(pass, fbo, &tscale);
+    for (int i = 0; i < rr->overlay_rects.num; i++) {
+        const struct pl_rect2d *rc = &rr->overlay_rects.elem[i];
+        const struct pl_rect3d rc3 = {
+            .x0 = rc->x0, .y0 = rc->y0, .z0 = 0,
+            .x1 = rc->x1, .y1 = rc->y1, .z1 = 1,
+        };
+
+        pl_tex_blit(rr->gpu, pl_tex_blit_params(
+            .src    = rr->overlay_base,
+            .dst    = fbo,
+            .src_rc = rc3,
+            .dst_rc = rc3,
+        ));
+    }
+
+    PL_TRACE(rr, "Re-rendering %d overlay rects", rr->overlay_rects.num);
+    draw_overlays(pass, fbo, plane->components, plane->component_mapping,
+                  target->overlays, target->num_overlays, target->color,
+                  target->repr, &tscale);
+
+    // Only keep the rects of the current overlays
+    rr->overlay_rects.num -= num_old;
+    memmove(rr->overlay_rects.elem, rr->overlay_rects.elem + num_old,
+            rr->overlay_rects.num * sizeof(rr->overlay_rects.elem[0]));
+}
+
+// Re-renders a frame with a reduced set of features, used in place of frames
+// which depended on passes that were still being compiled asynchronously
+static bool render_async_fallback(pl_renderer rr, const struct pl_frame *image,
+                                  const struct pl_frame *target,
+                                  const struct pl_render_params *params)
+{
+    struct pl_render_params fallback = *params;
+    fallback.upscaler = NULL;
+    fallback.downscaler = NULL;
+    fallback.antiringing_strength = 0.0;
+    fallback.deband_params = NULL;
+    fallback.sigmoid_params = NULL;
+    fallback.peak_detect_params = NULL;
+    fallback.dither_params = NULL;
+    fallback.cone_params = NULL;
+    fallback.hooks = NULL;
+    fallback.num_hooks = 0;
+    fallback.disable_linear_scaling = true;
+
+    // The remaining passes are cheap, so just compile them directly
+    fallback.async_compile = false;
+
+    PL_TRACE(rr, "Passes still compiling, rendering frame using fallback params");
+    return pl_render_image(rr, image, target, &fallback);
+}
+
+// Number of target pixels by which each tile needs to overlap its neighbours,
+// given the size of a target pixel in source pixels
+static int tile_margin(const struct pl_render_params *params, float sx, float sy)
+{
+    // Baseline amount, which covers plane upsampling for all practical
+    // subsampling ratios
+    float radius = 8.0;
+
+    float scale = PL_MAX(sx, sy);
+    const struct pl_filter_config *filter;
+    filter = scale > 1.0 ? params->downscaler : params->upscaler;
+    if (filter && filter->kernel) {
+        float r = filter->kernel->radius * PL_MAX(PL_DEF(filter->blur, 1.0), 1.0);
+        radius += scale > 1.0 ? r * scale : r;
+    }
+
+    const struct pl_deband_params *deband = params->deband_params;
+    if (deband)
+        radius += PL_DEF(deband->radius, 16.0) * PL_DEF(deband->iterations, 1);
+
+    return ceilf(radius / PL_MIN(sx, sy)) + 2;
+}
+
+// `pass_read_image` drops subpixel differences between the crop size and the
+// rounded size of the image it reads, which would misalign the tiles. To
+// compensate, pick a crop size which maps onto the intended one after this
+static void fix_tile_crop(float *x0, float *x1)
+{
+    float w = fabsf(*x1 - *x0), n = roundf(w);
+    if (!n)
+        return;
+
+    w = sqrtf(w * n);
+    if (*x0 < *x1) {
+        *x1 = *x0 + w;
+    } else {
+        *x0 = *x1 + w;
+    }
+}
+
+// Attempts rendering the image in tiles of at most `params->render_tile_size`
+// pixels. Returns false if tiling is not needed or not possible, in which case
+// the image should be rendered normally. Otherwise, `*ok` is set to the result
+static bool render_tiled(pl_renderer rr, const struct pl_frame *pimage,
+                         const struct pl_frame *ptarget,
+                         const struct pl_render_params *params, bool *ok)
+{
+    const int size = params->render_tile_size;
+    if (ptarget->num_planes != 1 || params->blend_params)
+        return false;
+
+    struct pass_state pass = {
+        .rr = rr,
+        .params = params,
+        .image = *pimage,
+        .target = *ptarget,
+        .info.stage = PL_RENDER_STAGE_BLEND,
+    };
+
+    // Only the target needs to be acquired here, the image is acquired by
+    // each of the individual tile renders
+    pass.image.acquire = NULL;
+    pass.image.release = NULL;
+    if (!pass_init(&pass, false)) {
+        *ok = false;
+        return true;
+    }
+
+    pl_gpu gpu = rr->gpu;
+    const struct pl_frame *target = &pass.target;
+    const struct pl_plane *plane = &target->planes[0];
+    pl_tex fbo = plane->texture;
+    pl_fmt fmt = fbo->params.format;
+    struct pl_rect2d dst = pass.dst_rect;
+    bool flip_x = dst.x0 > dst.x1, flip_y = dst.y0 > dst.y1;
+    pl_rect2d_normalize(&dst);
+    const int dst_w = pl_rect_w(dst), dst_h = pl_rect_h(dst);
+    if ((dst_w <= size && dst_h <= size) || !dst_w || !dst_h)
+        goto untiled;
+    if (pass.rotation || plane->flipped || plane->shift_x || plane->shift_y)
+        goto untiled;
+
+    // Copying the tiles requires either a blit or a sampled raster pass
+    bool blit = (fmt->caps & PL_FMT_CAP_BLITTABLE) && fbo->params.blit_dst;
+    if (!blit && ((~fmt->caps & PL_FMT_CAP_SAMPLEABLE) ||
+                  fmt->type == PL_FMT_UINT || fmt->type == PL_FMT_SINT))
+    {
+        goto untiled;
+    }
+
+    const struct pl_rect2df *src = &pass.image.crop;
+    const float sx = pl_rect_w(*src) / dst_w, sy = pl_rect_h(*src) / dst_h;
+    const int margin = tile_margin(params, sx, sy);
+    const int tile = PL_MIN(size, (int) gpu->limits.max_tex_2d_dim - 2 * margin);
+    if (tile <= 0)
+        goto untiled;
+
+    // Distribute the area evenly, so all tiles can share the same passes
+    const int nx = (dst_w + tile - 1) / tile, ny = (dst_h + tile - 1) / tile;
+    const int tw = (dst_w + nx - 1) / nx, th = (dst_h + ny - 1) / ny;
+    bool ok_tex = pl_tex_recreate(gpu, &rr->tile_tex, pl_tex_params(
+        .w = tw + 2 * margin,
+        .h = th + 2 * margin,
+        .format = fmt,
+        .sampleable = true,
+        .renderable = true,
+        .blit_src = blit,
+        .storable = fbo->params.storable && (fmt->caps & PL_FMT_CAP_STORABLE),
+        .debug_tag = PL_DEBUG_TAG,
+    ));
+
+    if (!ok_tex) {
+        PL_ERR(rr, "Failed creating tile texture, rendering untiled!");
+        goto untiled;
+    }
+
+    PL_TRACE(rr, "Rendering %dx%d target crop in %dx%d tiles of %dx%d "
+             "(margin %d)", dst_w, dst_h, nx, ny, tw, th, margin);
+
+    if (!params->skip_target_clearing && pl_frame_is_cropped(target))
+        pl_frame_clear_rgba(gpu, target, CLEAR_COL(params));
+
+    struct pl_render_params tparams = *params;
+    tparams.render_tile_size = 0;
+    tparams.peak_detect_params = NULL;
+    tparams.overlay_cache_signature = 0;
+    tparams.skip_target_clearing = true;
+
+    // Free sampling drops the subpixel offset of the crop, which would
+    // misalign the tiles, so replace it by the equivalent general scaler.
+    // Since free sampling also reads past the edges of the crop, whereas the
+    // other scalers clamp to them, only clip the tiles in the latter case
+    bool down = sx > 1.0 + 1e-6 || sy > 1.0 + 1e-6;
+    const struct pl_filter_config **scaler;
+    scaler = down ? &tparams.downscaler : &tparams.upscaler;
+    bool clip = true;
+    if (!*scaler || (*scaler == &pl_filter_bilinear &&
+                     (!down || params->skip_anti_aliasing)))
+    {
+        clip = false;
+        *scaler = &pl_filter_bilinear;
+        tparams.disable_builtin_scalers = true;
+        tparams.skip_anti_aliasing = true;
+        tparams.disable_linear_scaling = true;
+    }
+
+    pl_tex tex = rr->tile_tex;
+    struct pl_frame ttarget = *target;
+    ttarget.planes[0].texture = tex;
+    ttarget.overlays = NULL;
+    ttarget.num_overlays = 0;
+    ttarget.acquire = NULL;
+    ttarget.release = NULL;
+
+    *ok = true;
+    for (int y = dst.y0; y < dst.y1; y += th) {
+        for (int x = dst.x0; x < dst.x1; x += tw) {
+            const int w = PL_MIN(tw, dst.x1 - x), h = PL_MIN(th, dst.y1 - y);
+
+            // Tile area including the margin, relative to the target crop
+            const int ox = x - margin, oy = y - margin;
+            int ex0 = ox - dst.x0, ex1 = ex0 + tex->params.w,
+                ey0 = oy - dst.y0, ey1 = ey0 + tex->params.h;
+            if (clip) {
+                ex0 = PL_MAX(ex0, 0);
+                ey0 = PL_MAX(ey0, 0);
+                ex1 = PL_MIN(ex1, dst_w);
+                ey1 = PL_MIN(ey1, dst_h);
+            }
+
+            ttarget.crop = (struct pl_rect2df) {
+                dst.x0 + ex0 - ox, dst.y0 + ey0 - oy,
+                dst.x0 + ex1 - ox, dst.y0 + ey1 - oy,
+            };
+
+            struct pl_frame timage = *pimage;
+            timage.crop = (struct pl_rect2df) {
+                .x0 = flip_x ? src->x1 - ex0 * sx : src->x0 + ex0 * sx,
+                .x1 = flip_x ? src->x1 - ex1 * sx : src->x0 + ex1 * sx,
+                .y0 = flip_y ? src->y1 - ey0 * sy : src->y0 + ey0 * sy,
+                .y1 = flip_y ? src->y1 - ey1 * sy : src->y0 + ey1 * sy,
+            };
+
+            fix_tile_crop(&timage.crop.x0, &timage.crop.x1);
+            fix_tile_crop(&timage.crop.y0, &timage.crop.y1);
+
+            if (!pl_render_image(rr, &timage, &ttarget, &tparams)) {
+                *ok = false;
+                goto done;
+            }
+
+            struct pl_tex_blit_params blit_params = {
+                .src = tex,
+                .dst = fbo,
+                .src_rc = { margin, margin, 0, margin + w, margin + h, 1 },
+                .dst_rc = { x, y, 0, x + w, y + h, 1 },
+                .sample_mode = PL_TEX_SAMPLE_NEAREST,
+            };
+
+            if (!blit) {
+                pl_tex_blit_raster(gpu, rr->dp, &blit_params);
+            } else if (!rr->compile_only) {
+                pl_tex_blit(gpu, &blit_params);
+            }
+        }
+    }
+
+    if (target->num_overlays) {
+        pass_begin_frame(&pass);
+        draw_overlays(&pass, fbo, plane->components, plane->component_mapping,
+                      target->overlays, target->num_overlays, target->color,
+                      target->repr, NULL);
+    }
+
+done:
+    pass_uninit(&pass);
+    return true;
+
+untiled:
+    pass_uninit(&pass);
+    return false;
+}
+
+static bool render_image(pl_renderer rr, const struct pl_frame *pimage,
+                         const struct pl_frame *ptarget,
+                         const struct pl_render_params *params)
 {
     params = PL_DEF(params, &pl_render_default_params);
     pl_dispatch_mark_dynamic(rr->dp, params->dynamic_constants);
+    pl_dispatch_mark_half(rr->dp, params->half_precision);
+    pl_dispatch_mark_fast_transfer(rr->dp, params->fast_transfer);
+    pl_dispatch_async_compile(rr->dp, params->async_compile);
     if (!pimage)
         return draw_empty_overlays(rr, ptarget, params);
 
+    bool tiled_ok;
+    if (params->render_tile_size > 0 &&
+        render_tiled(rr, pimage, ptarget, params, &tiled_ok))
+    {
+        return tiled_ok;
+    }
+
+    uint64_t num_skipped = pl_dispatch_async_skipped(rr->dp);
+
     struct pass_state pass = {
         .rr = rr,
         .params = params,
@@ -2604,7 +4479,20 @@ bool pl_render_image(pl_renderer rr, const struct pl_frame *pimage,
     if (!pass_init(&pass, true))
         return false;
 
+    const struct pl_frame *target = &pass.target;
+    pl_tex fbo = target->planes[0].texture;
+    pass.save_overlay_base = params->overlay_cache_signature &&
+                             !rr->disable_overlay_cache &&
+                             target->num_planes == 1 &&
+                             fbo->params.blit_src && fbo->params.blit_dst;
+
     pass_begin_frame(&pass);
+    if (can_update_overlays(&pass)) {
+        pass_update_overlays(&pass);
+        pass_uninit(&pass);
+        return true;
+    }
+
     if (!pass_read_image(&pass))
         goto error;
     if (!pass_scale_main(&pass))
@@ -2613,14 +4501,380 @@ bool pl_render_image(pl_renderer rr, const struct pl_frame *pimage,
         goto error;
 
     pass_uninit(&pass);
+    if (pl_dispatch_async_skipped(rr->dp) != num_skipped) {
+        bool ok = render_async_fallback(rr, pimage, ptarget, params);
+        rr->overlay_sig = 0; // don't retain the reduced-quality frame
+        return ok;
+    }
     return true;
 
 error:
     PL_ERR(rr, "Failed rendering image!");
+    rr->overlay_sig = 0;
     pass_uninit(&pass);
     return false;
 }
 
+struct scaled_params {
+    struct pl_render_params params;
+    struct pl_deband_params deband;
+};
+
+static const struct pl_filter_config *cheap_filter(const struct pl_filter_config *f)
+{
+    if (f && (f->polar || (f->kernel && f->kernel->radius > 2.0)))
+        return &pl_filter_bicubic;
+    return f;
+}
+
+// Applies the reductions for the current `pl_renderer.quality_level` to the
+// parameters of a top-level rendering call
+static const struct pl_render_params *scale_quality(pl_renderer rr,
+                                                    const struct pl_render_params *params,
+                                                    struct scaled_params *tmp)
+{
+    const int level = rr->quality_level;
+    if (rr->frame_depth > 1 || !params || !params->gpu_time_budget || !level)
+        return params;
+
+    struct pl_render_params *par = &tmp->params;
+    *par = *params;
+    if (par->params_signature)
+        par->params_signature ^= (uint64_t) level << 56;
+
+    if (level >= 1) {
+        par->upscaler = cheap_filter(par->upscaler);
+        par->downscaler = cheap_filter(par->downscaler);
+        if (par->deband_params) {
+            tmp->deband = *par->deband_params;
+            tmp->deband.iterations = PL_MIN(tmp->deband.iterations, 1);
+            par->deband_params = &tmp->deband;
+        }
+    }
+
+    if (level >= 2) {
+        par->deband_params = NULL;
+        par->sigmoid_params = NULL;
+    }
+
+    if (level >= 3) {
+        par->upscaler = NULL;
+        par->downscaler = NULL;
+        par->antiringing_strength = 0.0;
+        par->disable_linear_scaling = true;
+        par->hooks = NULL;
+        par->num_hooks = 0;
+    }
+
+    return par;
+}
+
+// Returns the key identifying the output of a top-level rendering call in
+// the output cache, or 0 if the output cache can't be used for it
+static uint64_t output_cache_key(pl_renderer rr, const struct pl_frame *target,
+                                 const struct pl_render_params *params)
+{
+    if (!params || !params->output_cache_signature || rr->disable_output_cache)
+        return 0;
+    if (rr->compile_only)
+        return 0;
+    if (rr->frame_depth > 1 || target->num_planes != 1 || target->acquire)
+        return 0;
+
+    pl_tex tex = target->planes[0].texture;
+    if (!tex->params.blit_src || !tex->params.blit_dst)
+        return 0;
+
+    uint64_t key = params->output_cache_signature;
+    pl_hash_merge(&key, pl_mem_hash(&target->crop, sizeof(target->crop)));
+    pl_hash_merge(&key, pl_mem_hash(&target->color, sizeof(target->color)));
+    pl_hash_merge(&key, pl_mem_hash(&target->repr, sizeof(target->repr)));
+    pl_hash_merge(&key, rr->quality_level);
+    return PL_DEF(key, 1);
+}
+
+static bool reuse_output(pl_renderer rr, const struct pl_frame *target,
+                         uint64_t key)
+{
+    if (!key || key != rr->output_key)
+        return false;
+
+    pl_tex tex = target->planes[0].texture, cache = rr->output_cache;
+    if (cache->params.w != tex->params.w || cache->params.h != tex->params.h ||
+        cache->params.format != tex->params.format)
+    {
+        return false;
+    }
+
+    PL_TRACE(rr, "Re-using cached output for repeated frame");
+    pl_tex_blit(rr->gpu, pl_tex_blit_params(
+        .src = cache,
+        .dst = tex,
+    ));
+    return true;
+}
+
+// Retains a copy of the output, for `reuse_output`
+static void save_output(pl_renderer rr, const struct pl_frame *target,
+                        uint64_t key)
+{
+    if (rr->compile_only)
+        return;
+    rr->output_key = 0;
+    if (!key)
+        return;
+
+    pl_tex tex = target->planes[0].texture;
+    bool ok = pl_tex_recreate(rr->gpu, &rr->output_cache, pl_tex_params(
+        .w          = tex->params.w,
+        .h          = tex->params.h,
+        .format     = tex->params.format,
+        .blit_src   = true,
+        .blit_dst   = true,
+        .debug_tag  = PL_DEBUG_TAG,
+    ));
+
+    if (!ok) {
+        PL_ERR(rr, "Failed creating output cache texture, disabling "
+               "output caching!");
+        rr->disable_output_cache = true;
+        return;
+    }
+
+    pl_tex_blit(rr->gpu, pl_tex_blit_params(
+        .src = tex,
+        .dst = rr->output_cache,
+    ));
+    rr->output_key = key;
+}
+
+bool pl_render_image(pl_renderer rr, const struct pl_frame *pimage,
+                     const struct pl_frame *ptarget,
+                     const struct pl_render_params *params)
+{
+    struct scaled_params tmp;
+    stats_begin(rr, params);
+    params = scale_quality(rr, params, &tmp);
+    uint64_t key = output_cache_key(rr, ptarget, params);
+    bool ok = reuse_output(rr, ptarget, key);
+    if (!ok) {
+        uint64_t num_skipped = pl_dispatch_async_skipped(rr->dp);
+        ok = render_image(rr, pimage, ptarget, params);
+        bool complete = pl_dispatch_async_skipped(rr->dp) == num_skipped;
+        save_output(rr, ptarget, ok && complete ? key : 0);
+    }
+    stats_end(rr);
+    return ok;
+}
+
+static bool render_image_multi(pl_renderer rr, const struct pl_frame *pimage,
+                               const struct pl_frame *targets, int num_targets,
+                               const struct pl_render_params *params)
+{
+    params = PL_DEF(params, &pl_render_default_params);
+    bool ok = true;
+    if (!pimage || num_targets <= 1)
+        goto individual;
+
+    pl_dispatch_mark_dynamic(rr->dp, params->dynamic_constants);
+    pl_dispatch_mark_half(rr->dp, params->half_precision);
+    pl_dispatch_mark_fast_transfer(rr->dp, params->fast_transfer);
+    pl_dispatch_async_compile(rr->dp, params->async_compile);
+    uint64_t num_skipped = pl_dispatch_async_skipped(rr->dp);
+
+    struct pass_state pass = {
+        .rr = rr,
+        .params = params,
+        .image = *pimage,
+        .target = targets[0],
+        .info.stage = PL_RENDER_STAGE_FRAME,
+    };
+
+    if (!pass_init(&pass, true))
+        return false;
+
+    // Sharing the image requires materializing it
+    if (!pass.fbofmt[4]) {
+        pass_uninit(&pass);
+        goto individual;
+    }
+
+    pass_begin_frame(&pass);
+    pass.shared_image = true;
+    if (!pass_read_image(&pass) || !img_tex(&pass, &pass.img)) {
+        PL_ERR(rr, "Failed rendering image!");
+        pass_uninit(&pass);
+        return false;
+    }
+
+    struct img base = pass.img;
+    int base_idx = -1;
+    for (int i = 0; i < rr->fbos.num; i++) {
+        if (rr->fbos.elem[i] == base.tex)
+            base_idx = i;
+    }
+
+    bool *shared = pl_calloc(NULL, num_targets, sizeof(bool));
+    for (int i = 0; i < num_targets; i++) {
+        struct pass_state tpass = {
+            .rr = rr,
+            .params = params,
+            .image = *pimage,
+            .target = targets[i],
+            .info.stage = PL_RENDER_STAGE_FRAME,
+        };
+
+        // The image remains acquired by `pass` for the duration
+        tpass.image.acquire = NULL;
+        tpass.image.release = NULL;
+        memcpy(tpass.fbofmt, pass.fbofmt, sizeof(pass.fbofmt));
+        if (!pass_init(&tpass, false)) {
+            ok = false;
+            shared[i] = true; // don't retry
+            continue;
+        }
+
+        // The image crop may get adjusted to the target's
+        if (!pl_rect2d_eq(tpass.image.crop, pass.image.crop)) {
+            PL_TRACE(rr, "Target %d crop incompatible, rendering individually", i);
+            pass_uninit(&tpass);
+            continue;
+        }
+
+        pass_begin_frame(&tpass);
+        if (base_idx >= 0) {
+            // Shared between all targets, so it must survive this one
+            tpass.fbos_used[base_idx] = true;
+            tpass.fbos_pinned[base_idx] = true;
+        }
+        tpass.img = base;
+        tpass.ref_rect = pass.ref_rect;
+        shared[i] = true;
+
+        if (!pass_scale_main(&tpass) || !pass_output_target(&tpass)) {
+            PL_ERR(rr, "Failed rendering image to target %d!", i);
+            ok = false;
+        }
+
+        pass_uninit(&tpass);
+    }
+
+    bool skipped = pl_dispatch_async_skipped(rr->dp) != num_skipped;
+    pass.img = (struct img) {0};
+    pass_uninit(&pass);
+
+    for (int i = 0; i < num_targets; i++) {
+        if (!shared[i]) {
+            ok &= pl_render_image(rr, pimage, &targets[i], params);
+        } else if (skipped) {
+            ok &= render_async_fallback(rr, pimage, &targets[i], params);
+        }
+    }
+
+    pl_free(shared);
+    return ok;
+
+individual:
+    for (int i = 0; i < num_targets; i++)
+        ok &= pl_render_image(rr, pimage, &targets[i], params);
+    return ok;
+}
+
+bool pl_render_image_multi(pl_renderer rr, const struct pl_frame *pimage,
+                           const struct pl_frame *targets, int num_targets,
+                           const struct pl_render_params *params)
+{
+    struct scaled_params tmp;
+    stats_begin(rr, params);
+    params = scale_quality(rr, params, &tmp);
+    bool ok = render_image_multi(rr, pimage, targets, num_targets, params);
+    stats_end(rr);
+    return ok;
+}
+
+bool pl_render_image_batch(pl_renderer rr, const struct pl_frame *images,
+                           const struct pl_frame *targets, int num_frames,
+                           const struct pl_render_params *params)
+{
+    bool ok = true;
+    for (int i = 0; i < num_frames; i++) {
+        if (!pl_render_image(rr, &images[i], &targets[i], params)) {
+            PL_ERR(rr, "Failed rendering frame %d of batch!", i);
+            ok = false;
+        }
+    }
+
+    pl_gpu_flush(rr->gpu);
+    return ok;
+}
+
+bool pl_render_composite(pl_renderer rr, const struct pl_composite_source *srcs,
+                         int num_srcs, const struct pl_frame *ptarget,
+                         const struct pl_render_params *params)
+{
+    params = PL_DEF(params, &pl_render_default_params);
+    if (!params->skip_target_clearing)
+        pl_frame_clear_rgba(rr->gpu, ptarget, CLEAR_COL(params));
+
+    // Target overlays are drawn once, on top of all sources
+    struct pl_frame target = *ptarget;
+    target.overlays = NULL;
+    target.num_overlays = 0;
+
+    bool ok = true;
+    for (int i = 0; i < num_srcs; i++) {
+        struct pl_render_params sparams = *PL_DEF(srcs[i].params, params);
+        sparams.skip_target_clearing = true;
+        target.crop = srcs[i].dst;
+        if (!pl_render_image(rr, srcs[i].image, &target, &sparams)) {
+            PL_ERR(rr, "Failed rendering source %d of composite!", i);
+            ok = false;
+        }
+    }
+
+    if (ptarget->num_overlays) {
+        struct pl_render_params oparams = *params;
+        oparams.skip_target_clearing = true;
+        ok &= draw_empty_overlays(rr, ptarget, &oparams);
+    }
+
+    pl_gpu_flush(rr->gpu);
+    return ok;
+}
+
+bool pl_renderer_precompile(pl_renderer rr,
+                            const struct pl_render_config *configs,
+                            int num_configs)
+{
+    // Peak detection accumulates state across frames, which the (never
+    // executed) passes must not leak into, so compile against a fresh one
+    pl_shader_obj tone_map_state = rr->tone_map_state;
+    bool peak_detect_active = rr->peak_detect_active;
+    rr->tone_map_state = NULL;
+
+    bool ret = true;
+    rr->compile_only = true;
+    pl_dispatch_compile_only(rr->dp, true);
+    for (int i = 0; i < num_configs; i++) {
+        const struct pl_render_config *cfg = &configs[i];
+        struct pl_render_params params = *PL_DEF(cfg->params, &pl_render_default_params);
+        params.async_compile = false;
+        params.skip_target_clearing = true;
+        params.info_callback = NULL;
+        if (!pl_render_image(rr, cfg->image, cfg->target, &params)) {
+            PL_ERR(rr, "Failed pre-compiling render configuration %d", i);
+            ret = false;
+        }
+    }
+    pl_dispatch_compile_only(rr->dp, false);
+    rr->compile_only = false;
+
+    pl_shader_obj_destroy(&rr->tone_map_state);
+    rr->tone_map_state = tone_map_state;
+    rr->peak_detect_active = peak_detect_active;
+    return ret;
+}
+
 static uint64_t render_params_hash(const struct pl_render_params *params_orig)
 {
     struct pl_render_params params = *params_orig;
@@ -2676,6 +4930,12 @@ static uint64_t render_params_hash(const struct pl_render_params *params_orig)
     CLEAR(params.frame_mixer);
     CLEAR(params.preserve_mixing_cache);
     CLEAR(params.skip_caching_single_frame);
+    CLEAR(params.mixing_cache_budget);
+    CLEAR(params.mixing_cache_low_precision);
+    CLEAR(params.overlay_cache_signature);
+    CLEAR(params.output_cache_signature);
+    CLEAR(params.render_tile_size);
+    CLEAR(params.params_signature);
     memset(params.background_color, 0, sizeof(params.background_color));
     CLEAR(params.background_transparency);
     CLEAR(params.skip_target_clearing);
@@ -2693,24 +4953,104 @@ static uint64_t render_params_hash(const struct pl_render_params *params_orig)
     CLEAR(params.force_3dlut);
     CLEAR(params.force_dither);
     CLEAR(params.dynamic_constants);
+    CLEAR(params.async_compile);
     CLEAR(params.allow_delayed_peak_detect);
+    CLEAR(params.bake_color_lut);
 
     pl_hash_merge(&hash, pl_mem_hash(&params, sizeof(params)));
     return hash;
 }
 
+static uint64_t render_params_hash_cached(pl_renderer rr,
+                                          const struct pl_render_params *params)
+{
+    if (!params->params_signature)
+        return render_params_hash(params);
+
+    if (params->params_signature != rr->params_sig) {
+        rr->params_hash = render_params_hash(params);
+        rr->params_sig = params->params_signature;
+    }
+
+    return rr->params_hash;
+}
+
 #define MAX_MIX_FRAMES 16
 
-bool pl_render_image_mix(pl_renderer rr, const struct pl_frame_mix *images,
-                         const struct pl_frame *ptarget,
-                         const struct pl_render_params *params)
+static size_t tex_size(pl_tex tex)
+{
+    if (!tex)
+        return 0;
+
+    const struct pl_tex_params *par = &tex->params;
+    return (size_t) par->w * PL_DEF(par->h, 1) * PL_DEF(par->d, 1) *
+           par->format->texel_size;
+}
+
+// Picks the format to store a frame rendered by `pass` in the mixing cache
+static pl_fmt cached_frame_fmt(const struct pass_state *pass)
+{
+    const struct pl_render_params *params = pass->params;
+    const struct img *img = &pass->img;
+    pl_fmt fmt = pass->fbofmt[4];
+    int depth = pass->target.repr.bits.color_depth;
+    if (!params->mixing_cache_low_precision || !depth || depth > 8)
+        return fmt;
+
+    return compact_fbo_fmt(pass, img, fmt);
+}
+
+// Evicts unneeded frames from the mixing cache, in LRU order, until it fits
+// into the configured budget
+static void cull_cached_frames(pl_renderer rr, size_t budget)
+{
+    size_t total = 0;
+    for (int i = 0; i < rr->frames.num; i++)
+        total += tex_size(rr->frames.elem[i].tex);
+    for (int i = 0; i < rr->frame_fbos.num; i++)
+        total += tex_size(rr->frame_fbos.elem[i]);
+
+    // Spare textures don't hold any useful content, so free them first
+    while (total > budget && rr->frame_fbos.num) {
+        pl_tex tex = rr->frame_fbos.elem[--rr->frame_fbos.num];
+        total -= tex_size(tex);
+        pl_tex_destroy(rr->gpu, &tex);
+    }
+
+    while (total > budget) {
+        int idx = -1;
+        for (int i = 0; i < rr->frames.num; i++) {
+            const struct cached_frame *f = &rr->frames.elem[i];
+            if (f->evict && (idx < 0 || f->last_use < rr->frames.elem[idx].last_use))
+                idx = i;
+        }
+
+        if (idx < 0)
+            break; // all remaining frames are still in use
+
+        struct cached_frame *f = &rr->frames.elem[idx];
+        PL_TRACE(rr, "Evicting frame with signature %llx from cache",
+                 (unsigned long long) f->signature);
+        total -= tex_size(f->tex);
+        pl_tex_destroy(rr->gpu, &f->tex);
+        PL_ARRAY_REMOVE_AT(rr->frames, idx);
+    }
+}
+
+static bool render_image_mix(pl_renderer rr, const struct pl_frame_mix *images,
+                             const struct pl_frame *ptarget,
+                             const struct pl_render_params *params)
 {
     if (!images->num_frames)
         return pl_render_image(rr, NULL, ptarget, params);
 
     params = PL_DEF(params, &pl_render_default_params);
-    uint64_t params_hash = render_params_hash(params);
+    uint64_t params_hash = render_params_hash_cached(rr, params);
     pl_dispatch_mark_dynamic(rr->dp, params->dynamic_constants);
+    pl_dispatch_mark_half(rr->dp, params->half_precision);
+    pl_dispatch_mark_fast_transfer(rr->dp, params->fast_transfer);
+    pl_dispatch_async_compile(rr->dp, params->async_compile);
+    uint64_t num_skipped = pl_dispatch_async_skipped(rr->dp);
 
     require(images->num_frames >= 1);
     for (int i = 0; i < images->num_frames - 1; i++)
@@ -2752,7 +5092,8 @@ bool pl_render_image_mix(pl_renderer rr, const struct pl_frame_mix *images,
     struct cached_frame frames[MAX_MIX_FRAMES];
     float weights[MAX_MIX_FRAMES];
     float wsum = 0.0;
-    pass.tmp = pl_tmp(NULL);
+    pass.tmp = pass_tmp(rr);
+    rr->mix_count++;
 
     // Garbage collect the cache by evicting all frames from the cache that are
     // not determined to still be required
@@ -2828,6 +5169,7 @@ bool pl_render_image_mix(pl_renderer rr, const struct pl_frame_mix *images,
             if (rr->frames.elem[j].signature == sig) {
                 f = &rr->frames.elem[j];
                 f->evict = false;
+                f->last_use = rr->mix_count;
                 break;
             }
         }
@@ -2858,6 +5200,7 @@ bool pl_render_image_mix(pl_renderer rr, const struct pl_frame_mix *images,
                 .signature = sig,
                 .color = images->frames[i]->color,
                 .profile = images->frames[i]->profile,
+                .last_use = rr->mix_count,
             };
         }
 
@@ -2884,29 +5227,16 @@ bool pl_render_image_mix(pl_renderer rr, const struct pl_frame_mix *images,
                     pl_tex_invalidate(rr->gpu, f->tex);
             }
 
-            bool ok = pl_tex_recreate(rr->gpu, &f->tex, pl_tex_params(
-                .w = out_w,
-                .h = out_h,
-                .format = pass.fbofmt[4],
-                .sampleable = true,
-                .renderable = true,
-                .blit_dst = pass.fbofmt[4]->caps & PL_FMT_CAP_BLITTABLE,
-                .storable = pass.fbofmt[4]->caps & PL_FMT_CAP_STORABLE,
-            ));
-
-            if (!ok) {
-                PL_ERR(rr, "Could not create intermediate texture for "
-                       "frame mixing.. disabling!");
-                rr->disable_mixing = true;
-                goto fallback;
-            }
-
+            bool ok;
             struct pass_state inter_pass = {
                 .rr = rr,
                 .params = pass.params,
                 .image = *images->frames[i],
                 .target = *ptarget,
                 .info.stage = PL_RENDER_STAGE_FRAME,
+                .image_sig = sig,
+                .params_hash = params_hash,
+                .async = true,
             };
 
             // Render a single frame up to `pass_output_target`
@@ -2923,13 +5253,40 @@ bool pl_render_image_mix(pl_renderer rr, const struct pl_frame_mix *images,
             pl_assert(inter_pass.img.w == out_w &&
                       inter_pass.img.h == out_h);
 
+            // Create the texture only now, since the best format depends on
+            // the result of the scaling pass
+            pl_fmt fmt = cached_frame_fmt(&inter_pass);
+            ok = pl_tex_recreate(rr->gpu, &f->tex, pl_tex_params(
+                .w = out_w,
+                .h = out_h,
+                .format = fmt,
+                .sampleable = true,
+                .renderable = true,
+                .blit_dst = fmt->caps & PL_FMT_CAP_BLITTABLE,
+                .storable = fmt->caps & PL_FMT_CAP_STORABLE,
+                .debug_tag = PL_DEBUG_TAG_MIXER,
+            ));
+
+            if (!ok) {
+                PL_ERR(rr, "Could not create intermediate texture for "
+                       "frame mixing.. disabling!");
+                rr->disable_mixing = true;
+                pass_uninit(&inter_pass);
+                if (!f->tex)
+                    PL_ARRAY_REMOVE_AT(rr->frames, f - rr->frames.elem);
+                goto fallback;
+            }
+
             if (inter_pass.img.tex) {
                 struct pl_tex_blit_params blit = {
                     .src = inter_pass.img.tex,
                     .dst = f->tex,
                 };
 
-                if (blit.src->params.blit_src && blit.dst->params.blit_dst) {
+                pl_fmt src_fmt = blit.src->params.format;
+                if (blit.src->params.blit_src && blit.dst->params.blit_dst &&
+                    src_fmt->internal_size == fmt->internal_size)
+                {
                     pl_tex_blit(rr->gpu, &blit);
                 } else {
                     pl_tex_blit_raster(rr->gpu, rr->dp, &blit);
@@ -2938,6 +5295,7 @@ bool pl_render_image_mix(pl_renderer rr, const struct pl_frame_mix *images,
                 ok = pl_dispatch_finish(rr->dp, pl_dispatch_params(
                     .shader = &inter_pass.img.sh,
                     .target = f->tex,
+                    .async = true,
                 ));
                 if (!ok)
                     goto inter_pass_error;
@@ -2966,6 +5324,15 @@ bool pl_render_image_mix(pl_renderer rr, const struct pl_frame_mix *images,
                           inter_pass.img.repr,
                           &shift);
 
+            if (pl_dispatch_async_skipped(rr->dp) != num_skipped) {
+                // This frame is incomplete, so don't keep it in the cache
+                PL_TRACE(rr, "  -> Passes still compiling, discarding frame");
+                pass_uninit(&inter_pass);
+                PL_ARRAY_APPEND(rr, rr->frame_fbos, f->tex);
+                PL_ARRAY_REMOVE_AT(rr->frames, f - rr->frames.elem);
+                goto fallback;
+            }
+
             f->params_hash = params_hash;
             f->color = inter_pass.img.color;
             f->comps = inter_pass.img.comps;
@@ -2985,17 +5352,36 @@ inter_pass_error:
         fidx++;
     }
 
-    // Evict the frames we *don't* need
-    for (int i = 0; i < rr->frames.num; ) {
-        if (rr->frames.elem[i].evict) {
-            PL_TRACE(rr, "Evicting frame with signature %llx from cache",
-                     (unsigned long long) rr->frames.elem[i].signature);
-            PL_ARRAY_APPEND(rr, rr->frame_fbos, rr->frames.elem[i].tex);
-            PL_ARRAY_REMOVE_AT(rr->frames, i);
-            continue;
-        } else {
+    // Evict the frames we *don't* need, or only as many as necessary to stay
+    // within the cache budget (if set)
+    if (params->mixing_cache_budget) {
+        cull_cached_frames(rr, params->mixing_cache_budget);
+    } else {
+        for (int i = 0; i < rr->frames.num; ) {
+            if (rr->frames.elem[i].evict) {
+                PL_TRACE(rr, "Evicting frame with signature %llx from cache",
+                         (unsigned long long) rr->frames.elem[i].signature);
+                PL_ARRAY_APPEND(rr, rr->frame_fbos, rr->frames.elem[i].tex);
+                PL_ARRAY_REMOVE_AT(rr->frames, i);
+                continue;
+            } else {
+                i++;
+            }
+        }
+    }
+
+    // Drop cached hook results for frames no longer in the cache
+    for (int i = 0; i < rr->hook_cache.num; ) {
+        bool keep = false;
+        for (int j = 0; j < rr->frames.num && !keep; j++)
+            keep = rr->frames.elem[j].signature == rr->hook_cache.elem[i].signature;
+        if (keep) {
             i++;
+            continue;
         }
+
+        pl_tex_destroy(rr->gpu, &rr->hook_cache.elem[i].tex);
+        PL_ARRAY_REMOVE_AT(rr->hook_cache, i);
     }
 
     // Sample and mix the output color
@@ -3036,7 +5422,7 @@ inter_pass_error:
         ident_t pos, tex = sh_bind(sh, frames[i].tex, PL_TEX_ADDRESS_CLAMP,
                                    sample_mode, "frame", NULL, &pos, NULL, NULL);
 
-        GLSL("color = %s(%s, %s); \n", sh_tex_fn(sh, *tpars), tex, pos);
+        GLSL("color = %s("$", "$"); \n", sh_tex_fn(sh, *tpars), tex, pos);
 
         // Note: This ignores differences in ICC profile, which we decide to
         // just simply not care about. Doing that properly would require
@@ -3045,16 +5431,15 @@ inter_pass_error:
         // exceptionally unlikely hypothetical.
         pl_shader_color_map(sh, NULL, frames[i].color, mix_color, NULL, false);
 
-        ident_t weight = "1.0";
         if (weights[i] != wsum) { // skip loading weight for nearest neighbour
-            weight = sh_var(sh, (struct pl_shader_var) {
+            GLSL("mix_color += "$" * color; \n", sh_var(sh, (struct pl_shader_var) {
                 .var = pl_var_float("weight"),
                 .data = &(float){ weights[i] / wsum },
                 .dynamic = true,
-            });
+            }));
+        } else {
+            GLSL("mix_color += color; \n");
         }
-
-        GLSL("mix_color += %s * color; \n", weight);
         comps = PL_MAX(comps, frames[i].comps);
     }
 
@@ -3077,6 +5462,8 @@ inter_pass_error:
 
     if (!pass_output_target(&pass))
         goto fallback;
+    if (pl_dispatch_async_skipped(rr->dp) != num_skipped)
+        goto fallback;
 
     pass_uninit(&pass);
     return true;
@@ -3093,6 +5480,25 @@ fallback:
 
 }
 
+bool pl_render_image_mix(pl_renderer rr, const struct pl_frame_mix *images,
+                         const struct pl_frame *ptarget,
+                         const struct pl_render_params *params)
+{
+    struct scaled_params tmp;
+    stats_begin(rr, params);
+    params = scale_quality(rr, params, &tmp);
+    uint64_t key = output_cache_key(rr, ptarget, params);
+    bool ok = reuse_output(rr, ptarget, key);
+    if (!ok) {
+        uint64_t num_skipped = pl_dispatch_async_skipped(rr->dp);
+        ok = render_image_mix(rr, images, ptarget, params);
+        bool complete = pl_dispatch_async_skipped(rr->dp) == num_skipped;
+        save_output(rr, ptarget, ok && complete ? key : 0);
+    }
+    stats_end(rr);
+    return ok;
+}
+
 void pl_frame_set_chroma_location(struct pl_frame *frame,
                                   enum pl_chroma_location chroma_loc)
 {
@@ -19,8 +19,11 @@
 #include <math.h>
 
 #include "common.h"
+#include "cache.h"
 #include "log.h"
 #include "shaders.h"
+#include "dispatch.h"
+#include "pl_thread_pool.h"
 
 pl_shader pl_shader_alloc(pl_log log, const struct pl_shader_params *params)
 {
@@ -53,7 +56,13 @@ void pl_shader_free(pl_shader *psh)
 
 void pl_shader_reset(pl_shader sh, const struct pl_shader_params *params)
 {
-    for (int i = 0; i < sh->tmp.num; i++)
+    // Recycle the memory of our own `tmp` object if nobody else retains it
+    struct pl_ref *tmp = sh->tmp.elem[0];
+    if (!pl_ref_reset(tmp)) {
+        pl_ref_deref(&tmp);
+        tmp = NULL;
+    }
+    for (int i = 1; i < sh->tmp.num; i++)
         pl_ref_deref(&sh->tmp.elem[i]);
 
     struct pl_shader new = {
@@ -72,12 +81,12 @@ void pl_shader_reset(pl_shader sh, const struct pl_shader_params *params)
     if (params)
         new.res.params = *params;
 
-    // Preserve buffer allocations
+    // Preserve buffer allocations (the text itself lives in `tmp`)
     for (int i = 0; i < PL_ARRAY_SIZE(new.buffers); i++)
-        new.buffers[i] = (pl_str) { .buf = sh->buffers[i].buf };
+        new.buffers[i].segs.elem = sh->buffers[i].segs.elem;
 
     *sh = new;
-    PL_ARRAY_APPEND(sh, sh->tmp, pl_ref_new(NULL));
+    PL_ARRAY_APPEND(sh, sh->tmp, PL_DEF(tmp, pl_ref_new(NULL)));
 }
 
 bool pl_shader_is_failed(const pl_shader sh)
@@ -186,16 +195,20 @@ bool pl_shader_output_size(const pl_shader sh, int *w, int *h)
 
 ident_t sh_fresh(pl_shader sh, const char *name)
 {
-    return pl_asprintf(SH_TMP(sh), "_%s_%d_%u", PL_DEF(name, "var"),
-                       sh->fresh++, SH_PARAMS(sh).id);
+    // `name` is purely informative. The shader ID lives in the top bits, to
+    // avoid conflicts when merging shaders with `sh_subpass`
+    unsigned int fresh = ++sh->fresh;
+    pl_assert(fresh < (1u << 24));
+    return (ident_t) SH_PARAMS(sh).id << 24 | fresh;
 }
 
 ident_t sh_var(pl_shader sh, struct pl_shader_var sv)
 {
-    sv.var.name = sh_fresh(sh, sv.var.name);
+    ident_t id = sh_fresh(sh, sv.var.name);
+    sv.var.name = sh_ident_pack(id);
     sv.data = pl_memdup(SH_TMP(sh), sv.data, pl_var_host_layout(0, &sv.var).size);
     PL_ARRAY_APPEND(sh, sh->vars, sv);
-    return (ident_t) sv.var.name;
+    return id;
 }
 
 static void merge_access(enum pl_desc_access *a, enum pl_desc_access b)
@@ -217,7 +230,14 @@ ident_t sh_desc(pl_shader sh, struct pl_shader_desc sd)
             if (sh->descs.elem[i].binding.object == sd.binding.object) {
                 merge_access(&sh->descs.elem[i].desc.access, sd.desc.access);
                 sh->descs.elem[i].memory |= sd.memory;
-                return (ident_t) sh->descs.elem[i].desc.name;
+                const char *name = sh->descs.elem[i].desc.name;
+                ident_t id = sh_ident_unpack(name);
+                if (!id) {
+                    // Externally named descriptor (e.g. from pl_shader_custom)
+                    id = sh_fresh(sh, "desc");
+                    GLSLH("#define "$" %s \n", id, name);
+                }
+                return id;
             }
         }
 
@@ -235,14 +255,23 @@ ident_t sh_desc(pl_shader sh, struct pl_shader_desc sd)
         pl_unreachable();
     }
 
-    sd.desc.name = sh_fresh(sh, sd.desc.name);
+    ident_t id = sh_fresh(sh, sd.desc.name);
+    sd.desc.name = sh_ident_pack(id);
     PL_ARRAY_APPEND(sh, sh->descs, sd);
-    return (ident_t) sd.desc.name;
+    return id;
 }
 
 ident_t sh_const(pl_shader sh, struct pl_shader_const sc)
 {
-    if (sh->res.params.dynamic_constants && !sc.compile_time) {
+    // Automatically promoted constants may end up in places like loop bounds,
+    // which only tolerate non-constant expressions since GLSL 130
+    bool dynamic = sh->res.params.dynamic_constants;
+    if (!dynamic && sh->dp && sh_glsl(sh).version >= 130) {
+        const char *desc = sh->steps.num ? sh->steps.elem[sh->steps.num - 1] : NULL;
+        dynamic = pl_dispatch_const_dynamic(sh->dp, desc, &sc);
+    }
+
+    if (dynamic && !sc.compile_time) {
         return sh_var(sh, (struct pl_shader_var) {
             .var = {
                 .name = sc.name,
@@ -255,26 +284,27 @@ ident_t sh_const(pl_shader sh, struct pl_shader_const sc)
         });
     }
 
-    sc.name = sh_fresh(sh, sc.name);
+    ident_t id = sh_fresh(sh, sc.name);
 
     pl_gpu gpu = SH_GPU(sh);
     if (gpu && gpu->limits.max_constants) {
+        sc.name = sh_ident_pack(id);
         sc.data = pl_memdup(SH_TMP(sh), sc.data, pl_var_type_size(sc.type));
         PL_ARRAY_APPEND(sh, sh->consts, sc);
-        return (ident_t) sc.name;
+        return id;
     }
 
     // Fallback for GPUs without specialization constants
     switch (sc.type) {
     case PL_VAR_SINT:
-        GLSLH("const int %s = %d; \n", sc.name, *(int *) sc.data);
-        return (ident_t) sc.name;
+        GLSLH("const int "$" = %d; \n", id, *(int *) sc.data);
+        return id;
     case PL_VAR_UINT:
-        GLSLH("const uint %s = %uu; \n", sc.name, *(unsigned int *) sc.data);
-        return (ident_t) sc.name;
+        GLSLH("const uint "$" = %uu; \n", id, *(unsigned int *) sc.data);
+        return id;
     case PL_VAR_FLOAT:
-        GLSLH("const float %s = %f; \n", sc.name, *(float *) sc.data);
-        return (ident_t) sc.name;
+        GLSLH("const float "$" = %f; \n", id, *(float *) sc.data);
+        return id;
     case PL_VAR_INVALID:
     case PL_VAR_TYPE_COUNT:
         break;
@@ -317,13 +347,13 @@ ident_t sh_attr_vec2(pl_shader sh, const char *name,
     pl_gpu gpu = SH_GPU(sh);
     if (!gpu) {
         SH_FAIL(sh, "Failed adding vertex attr '%s': No GPU available!", name);
-        return NULL;
+        return NULL_IDENT;
     }
 
     pl_fmt fmt = pl_find_vertex_fmt(gpu, PL_FMT_FLOAT, 2);
     if (!fmt) {
         SH_FAIL(sh, "Failed adding vertex attr '%s': no vertex fmt!", name);
-        return NULL;
+        return NULL_IDENT;
     }
 
     float vals[4][2] = {
@@ -334,16 +364,17 @@ ident_t sh_attr_vec2(pl_shader sh, const char *name,
     };
 
     float *data = pl_memdup(SH_TMP(sh), &vals[0][0], sizeof(vals));
+    ident_t id = sh_fresh(sh, name);
     struct pl_shader_va va = {
         .attr = {
-            .name     = sh_fresh(sh, name),
+            .name     = sh_ident_pack(id),
             .fmt      = pl_find_vertex_fmt(gpu, PL_FMT_FLOAT, 2),
         },
         .data = { &data[0], &data[2], &data[4], &data[6] },
     };
 
     PL_ARRAY_APPEND(sh, sh->vas, va);
-    return (ident_t) va.attr.name;
+    return id;
 }
 
 ident_t sh_bind(pl_shader sh, pl_tex tex,
@@ -354,12 +385,12 @@ ident_t sh_bind(pl_shader sh, pl_tex tex,
 {
     if (pl_tex_params_dimension(tex->params) != 2) {
         SH_FAIL(sh, "Failed binding texture '%s': not a 2D texture!", name);
-        return NULL;
+        return NULL_IDENT;
     }
 
     if (!tex->params.sampleable) {
         SH_FAIL(sh, "Failed binding texture '%s': texture not sampleable!", name);
-        return NULL;
+        return NULL_IDENT;
     }
 
     ident_t itex = sh_desc(sh, (struct pl_shader_desc) {
@@ -457,20 +488,60 @@ size_t sh_buf_desc_size(const struct pl_shader_desc *buf_desc)
     return last->layout.offset + last->layout.size;
 }
 
-void sh_append(pl_shader sh, enum pl_shader_buf buf, const char *fmt, ...)
+// Once the tail of a buffer exceeds this size, it gets flushed into a new
+// segment, to bound the cost of growing it
+#define SH_SEG_SIZE 2048
+
+static void buf_flush(pl_shader sh, struct sh_buf *b)
+{
+    if (!b->tail.len)
+        return;
+
+    PL_ARRAY_APPEND(sh, b->segs, b->tail);
+    b->tail = (pl_str) {0};
+}
+
+static struct sh_buf *buf_tail(pl_shader sh, enum pl_shader_buf buf)
 {
     pl_assert(buf >= 0 && buf < SH_BUF_COUNT);
+    struct sh_buf *b = &sh->buffers[buf];
+    if (b->tail.len >= SH_SEG_SIZE)
+        buf_flush(sh, b);
+    if (!b->tail.buf)
+        b->tail.buf = pl_alloc(SH_TMP(sh), SH_SEG_SIZE);
+    return b;
+}
+
+// Appends the text of `src` to `dst` by reference. `src` may belong to a
+// different shader, as long as `sh` retains a reference to its `SH_TMP`
+static void buf_splice(pl_shader sh, struct sh_buf *dst, const struct sh_buf *src)
+{
+    buf_flush(sh, dst);
+    PL_ARRAY_CONCAT(sh, dst->segs, src->segs);
+    if (src->tail.len)
+        PL_ARRAY_APPEND(sh, dst->segs, src->tail);
+}
+
+static void buf_clear(struct sh_buf *b)
+{
+    b->segs.num = 0;
+    b->tail = (pl_str) {0};
+}
+
+void sh_append(pl_shader sh, enum pl_shader_buf buf, const char *fmt, ...)
+{
+    struct sh_buf *b = buf_tail(sh, buf);
 
     va_list ap;
     va_start(ap, fmt);
-    pl_str_append_vasprintf_c(sh, &sh->buffers[buf], fmt, ap);
+    pl_str_append_vasprintf_c(SH_TMP(sh), &b->tail, fmt, ap);
     va_end(ap);
 }
 
 void sh_append_str(pl_shader sh, enum pl_shader_buf buf, pl_str str)
 {
-    pl_assert(buf >= 0 && buf < SH_BUF_COUNT);
-    pl_str_append(sh, &sh->buffers[buf], str);
+    struct sh_buf *b = buf_tail(sh, buf);
+    pl_str_append(SH_TMP(sh), &b->tail, str);
 }
 
 static const char *insigs[] = {
@@ -501,7 +572,7 @@ ident_t sh_subpass(pl_shader sh, const pl_shader sub)
 
     if (SH_PARAMS(sh).id == SH_PARAMS(sub).id) {
         PL_TRACE(sh, "Can't merge shaders: conflicting identifiers!");
-        return NULL;
+        return NULL_IDENT;
     }
 
     // Check for shader compatibility
@@ -513,7 +584,7 @@ ident_t sh_subpass(pl_shader sh, const pl_shader sub)
     {
         PL_TRACE(sh, "Can't merge shaders: incompatible sizes: %dx%d and %dx%d",
                  sh->output_w, sh->output_h, sub->output_w, sub->output_h);
-        return NULL;
+        return NULL_IDENT;
     }
 
     if (sub->type == SH_COMPUTE) {
@@ -524,28 +595,29 @@ ident_t sh_subpass(pl_shader sh, const pl_shader sub)
         if (!sh_try_compute(sh, subw, subh, flex, sub->res.compute_shmem)) {
             PL_TRACE(sh, "Can't merge shaders: incompatible block sizes or "
                      "exceeded shared memory resource capabilities");
-            return NULL;
+            return NULL_IDENT;
         }
     }
 
     sh->output_w = res_w;
     sh->output_h = res_h;
 
-    // Append the prelude and header
-    pl_str_append(sh, &sh->buffers[SH_BUF_PRELUDE], sub->buffers[SH_BUF_PRELUDE]);
-    pl_str_append(sh, &sh->buffers[SH_BUF_HEADER],  sub->buffers[SH_BUF_HEADER]);
+    // Append the prelude and header. The text of `sub` is kept alive by the
+    // references to its `tmp` objects, taken below
+    buf_splice(sh, &sh->buffers[SH_BUF_PRELUDE], &sub->buffers[SH_BUF_PRELUDE]);
+    buf_splice(sh, &sh->buffers[SH_BUF_HEADER],  &sub->buffers[SH_BUF_HEADER]);
 
     // Append the body as a new header function
     ident_t name = sh_fresh(sh, "sub");
     if (sub->res.input == PL_SHADER_SIG_SAMPLER) {
         pl_assert(sub->sampler_prefix);
-        GLSLH("%s %s(%c%s src_tex, vec2 tex_coord) {\n",
+        GLSLH("%s "$"(%c%s src_tex, vec2 tex_coord) {\n",
               outsigs[sub->res.output], name,
               sub->sampler_prefix, samplers2D[sub->sampler_type]);
     } else {
-        GLSLH("%s %s(%s) {\n", outsigs[sub->res.output], name, insigs[sub->res.input]);
+        GLSLH("%s "$"(%s) {\n", outsigs[sub->res.output], name, insigs[sub->res.input]);
     }
-    pl_str_append(sh, &sh->buffers[SH_BUF_HEADER], sub->buffers[SH_BUF_BODY]);
+    buf_splice(sh, &sh->buffers[SH_BUF_HEADER], &sub->buffers[SH_BUF_BODY]);
     GLSLH("%s\n}\n\n", retvals[sub->res.output]);
 
     // Copy over all of the descriptors etc.
@@ -569,30 +641,23 @@ static ident_t sh_split(pl_shader sh)
     ident_t name = sh_fresh(sh, "main");
     if (sh->res.input == PL_SHADER_SIG_SAMPLER) {
         pl_assert(sh->sampler_prefix);
-        GLSLH("%s %s(%c%s src_tex, vec2 tex_coord) {\n",
+        GLSLH("%s "$"(%c%s src_tex, vec2 tex_coord) {\n",
               outsigs[sh->res.output], name,
               sh->sampler_prefix, samplers2D[sh->sampler_type]);
     } else {
-        GLSLH("%s %s(%s) {\n", outsigs[sh->res.output], name, insigs[sh->res.input]);
+        GLSLH("%s "$"(%s) {\n", outsigs[sh->res.output], name, insigs[sh->res.input]);
     }
 
-    if (sh->buffers[SH_BUF_BODY].len) {
-        pl_str_append(sh, &sh->buffers[SH_BUF_HEADER], sh->buffers[SH_BUF_BODY]);
-        sh->buffers[SH_BUF_BODY].len = 0;
-        sh->buffers[SH_BUF_BODY].buf[0] = '\0'; // for sanity / efficiency
-    }
-
-    if (sh->buffers[SH_BUF_FOOTER].len) {
-        pl_str_append(sh, &sh->buffers[SH_BUF_HEADER], sh->buffers[SH_BUF_FOOTER]);
-        sh->buffers[SH_BUF_FOOTER].len = 0;
-        sh->buffers[SH_BUF_FOOTER].buf[0] = '\0';
-    }
+    buf_splice(sh, &sh->buffers[SH_BUF_HEADER], &sh->buffers[SH_BUF_BODY]);
+    buf_splice(sh, &sh->buffers[SH_BUF_HEADER], &sh->buffers[SH_BUF_FOOTER]);
+    buf_clear(&sh->buffers[SH_BUF_BODY]);
+    buf_clear(&sh->buffers[SH_BUF_FOOTER]);
 
     GLSLH("%s\n}\n\n", retvals[sh->res.output]);
     return name;
 }
 
-const struct pl_shader_res *pl_shader_finalize(pl_shader sh)
+const struct pl_shader_res *sh_finalize_internal(pl_shader sh)
 {
     if (sh->failed)
         return NULL;
@@ -601,21 +666,19 @@ const struct pl_shader_res *pl_shader_finalize(pl_shader sh)
         return &sh->res;
 
     // Split the shader. This finalizes the body and adds it to the header
-    sh->res.name = sh_split(sh);
+    sh->res.name = sh_ident_pack(sh_split(sh));
 
     // Padding for readability
     GLSLP("\n");
 
     // Concatenate the header onto the prelude to form the final output
-    pl_str *glsl = &sh->buffers[SH_BUF_PRELUDE];
-    pl_str_append(sh, glsl, sh->buffers[SH_BUF_HEADER]);
+    buf_splice(sh, &sh->buffers[SH_BUF_PRELUDE], &sh->buffers[SH_BUF_HEADER]);
+    buf_clear(&sh->buffers[SH_BUF_HEADER]);
 
     // Generate the pretty description
     sh->res.description = "(unknown shader)";
     if (sh->steps.num) {
-        // Reuse this buffer
-        pl_str *desc = &sh->buffers[SH_BUF_BODY];
-        desc->len = 0;
+        pl_str *desc = &(pl_str) {0};
 
         for (int i = 0; i < sh->steps.num; i++) {
             const char *step = sh->steps.elem[i];
@@ -633,10 +696,10 @@ const struct pl_shader_res *pl_shader_finalize(pl_shader sh)
             }
 
             if (i > 0)
-                pl_str_append(sh, desc, pl_str0(", "));
-            pl_str_append(sh, desc, pl_str0(step));
+                pl_str_append(SH_TMP(sh), desc, pl_str0(", "));
+            pl_str_append(SH_TMP(sh), desc, pl_str0(step));
             if (count > 1)
-                pl_str_append_asprintf(sh, desc, " x%d", count);
+                pl_str_append_asprintf(SH_TMP(sh), desc, " x%d", count);
         }
 
         sh->res.description = (char *) desc->buf;
@@ -654,12 +717,51 @@ const struct pl_shader_res *pl_shader_finalize(pl_shader sh)
     sh->res.steps = sh->steps.elem;
     sh->res.num_steps = sh->steps.num;
 
-    // Update the result pointer and return
-    sh->res.glsl = (char *) glsl->buf;
     sh->mutable = false;
     return &sh->res;
 }
 
+uint64_t sh_text_hash(const pl_shader sh)
+{
+    pl_assert(!sh->mutable);
+    const struct sh_buf *b = &sh->buffers[SH_BUF_PRELUDE];
+    uint64_t hash = 0;
+    for (int i = 0; i < b->segs.num; i++)
+        pl_hash_merge(&hash, pl_str_hash(b->segs.elem[i]));
+    pl_hash_merge(&hash, pl_str_hash(b->tail));
+    return hash;
+}
+
+void sh_buf_write(const struct sh_buf *b, void *alloc, pl_str *out)
+{
+    size_t len = out->len + b->tail.len;
+    for (int i = 0; i < b->segs.num; i++)
+        len += b->segs.elem[i].len;
+
+    pl_grow(alloc, &out->buf, len + 1);
+    for (int i = 0; i < b->segs.num; i++)
+        pl_str_append(alloc, out, b->segs.elem[i]);
+    pl_str_append(alloc, out, b->tail);
+}
+
+void sh_text_write(const pl_shader sh, void *alloc, pl_str *out)
+{
+    pl_assert(!sh->mutable);
+    sh_buf_write(&sh->buffers[SH_BUF_PRELUDE], alloc, out);
+}
+
+const struct pl_shader_res *pl_shader_finalize(pl_shader sh)
+{
+    const struct pl_shader_res *res = sh_finalize_internal(sh);
+    if (res && !res->glsl) {
+        pl_str glsl = {0};
+        sh_text_write(sh, SH_TMP(sh), &glsl);
+        sh->res.glsl = glsl.len ? (char *) glsl.buf : "";
+    }
+
+    return res;
+}
+
 bool sh_require(pl_shader sh, enum pl_shader_sig insig, int w, int h)
 {
     if (sh->failed) {
@@ -758,7 +860,7 @@ ident_t sh_prng(pl_shader sh, bool temporal, ident_t *p_state)
 
         // Based on pcg3d (http://jcgt.org/published/0009/03/02/)
         GLSLP("#define prng_t uvec3\n");
-        GLSLH("vec3 %s(inout uvec3 s) {                     \n"
+        GLSLH("vec3 "$"(inout uvec3 s) {                    \n"
               "    s = 1664525u * s + uvec3(1013904223u);   \n"
               "    s.x += s.y * s.z;                        \n"
               "    s.y += s.z * s.x;                        \n"
@@ -771,49 +873,53 @@ ident_t sh_prng(pl_shader sh, bool temporal, ident_t *p_state)
               "}                                            \n",
               randfun);
 
-        const char *seed = "0u";
+        ident_t seed;
         if (temporal) {
             seed = sh_var(sh, (struct pl_shader_var) {
                 .var  = pl_var_uint("seed"),
                 .data = &(unsigned int){ SH_PARAMS(sh).index },
                 .dynamic = true,
             });
-        };
+        } else {
+            seed = SH_UINT(0);
+        }
 
-        GLSL("uvec3 %s = uvec3(gl_FragCoord.xy, %s); \n", state, seed);
+        GLSL("uvec3 "$" = uvec3(gl_FragCoord.xy, "$"); \n", state, seed);
 
     } else {
 
         // Based on SGGP (https://briansharpe.wordpress.com/2011/10/01/gpu-texture-free-noise/)
         ident_t permute = sh_fresh(sh, "permute");
         GLSLP("#define prng_t float\n");
-        GLSLH("float %s(float x) {                          \n"
+        GLSLH("float "$"(float x) {                         \n"
               "    x = (34.0 * x + 1.0) * x;                \n"
               "    return fract(x * 1.0/289.0) * 289.0;     \n"
               "}                                            \n"
-              "vec3 %s(inout float s) {                     \n"
+              "vec3 "$"(inout float s) {                    \n"
               "    vec3 ret;                                \n"
-              "    ret.x = %s(s);                           \n"
-              "    ret.y = %s(ret.x);                       \n"
-              "    ret.z = %s(ret.y);                       \n"
+              "    ret.x = "$"(s);                          \n"
+              "    ret.y = "$"(ret.x);                      \n"
+              "    ret.z = "$"(ret.y);                      \n"
               "    s = ret.z;                               \n"
               "    return fract(ret * 1.0/41.0);            \n"
               "}                                            \n",
               permute, randfun, permute, permute, permute);
 
         static const double phi = 1.618033988749895;
-        const char *seed = "0.0";
+        ident_t seed;
         if (temporal) {
             seed = sh_var(sh, (struct pl_shader_var) {
                 .var  = pl_var_float("seed"),
                 .data = &(float){ modff(phi * SH_PARAMS(sh).index, &(float){0}) },
                 .dynamic = true,
             });
-        };
+        } else {
+            seed = SH_FLOAT(0.0);
+        }
 
-        GLSL("vec3 %s_m = vec3(fract(gl_FragCoord.xy * vec2(%f)), %s);  \n"
-             "%s_m += vec3(1.0);                                        \n"
-             "float %s = %s(%s(%s(%s_m.x) + %s_m.y) + %s_m.z);          \n",
+        GLSL("vec3 "$"_m = vec3(fract(gl_FragCoord.xy * vec2(%f)), "$"); \n"
+             $"_m += vec3(1.0);                                         \n"
+             "float "$" = "$"("$"("$"("$"_m.x) + "$"_m.y) + "$"_m.z);   \n",
              state, phi, seed,
              state,
              state, permute, permute, permute, state, state, state);
@@ -824,7 +930,7 @@ ident_t sh_prng(pl_shader sh, bool temporal, ident_t *p_state)
         *p_state = state;
 
     ident_t res = sh_fresh(sh, "RAND");
-    GLSLH("#define %s (%s(%s))\n", res, randfun, state);
+    GLSLH("#define "$" ("$"("$"))\n", res, randfun, state);
     return res;
 }
 
@@ -834,18 +940,68 @@ ident_t sh_prng(pl_shader sh, bool temporal, ident_t *p_state)
 static ident_t sh_lut_pos(pl_shader sh, int lut_size)
 {
     ident_t name = sh_fresh(sh, "LUT_POS");
-    GLSLH("#define %s(x) mix(%s, %s, (x)) \n",
+    GLSLH("#define "$"(x) mix("$", "$", (x)) \n",
           name, SH_FLOAT(0.5 / lut_size), SH_FLOAT(1.0 - 0.5 / lut_size));
     return name;
 }
 
+// Background generation of the LUT contents, see `sh_lut_params.priv_size`
+struct sh_lut_job {
+    pl_job job;
+    uint64_t key;
+    struct sh_lut_params params; // `priv` points to a private copy
+    void *data;
+};
+
+static void sh_lut_job_run(void *arg)
+{
+    struct sh_lut_job *job = arg;
+    job->params.fill(job->data, &job->params);
+}
+
+static struct sh_lut_job *sh_lut_job_start(pl_log log,
+                                           const struct sh_lut_params *params,
+                                           uint64_t key, size_t size)
+{
+    struct sh_lut_job *job = pl_zalloc_ptr(NULL, job);
+    job->key = key;
+    job->params = *params;
+    job->params.object = NULL;
+    job->params.priv = pl_memdup(job, params->priv, params->priv_size);
+    job->data = pl_zalloc(job, size);
+    job->job = pl_job_submit(log, sh_lut_job_run, job);
+    if (!job->job) {
+        pl_free(job);
+        return NULL;
+    }
+
+    return job;
+}
+
+static bool sh_lut_job_done(struct sh_lut_job *job)
+{
+    return pl_job_done(job->job);
+}
+
+// Discards the job's results, if any
+static void sh_lut_job_destroy(struct sh_lut_job **job)
+{
+    if (!*job)
+        return;
+
+    pl_job_cancel(&(*job)->job);
+    pl_free_ptr(job);
+}
+
 struct sh_lut_obj {
     enum sh_lut_method method;
     enum pl_var_type type;
-    bool linear;
+    bool linear, tetrahedral;
     int width, height, depth, comps;
     uint64_t signature;
     bool error; // reset if params change
+    bool shared; // `tex` is a reference to the GPU's shared texture cache
+    struct sh_lut_job *job; // pending background regeneration, or NULL
 
     // weights, depending on the method
     pl_tex tex;
@@ -856,7 +1012,12 @@ struct sh_lut_obj {
 static void sh_lut_uninit(pl_gpu gpu, void *ptr)
 {
     struct sh_lut_obj *lut = ptr;
-    pl_tex_destroy(gpu, &lut->tex);
+    sh_lut_job_destroy(&lut->job);
+    if (lut->shared) {
+        pl_tex_cache_release(gpu, &lut->tex);
+    } else {
+        pl_tex_destroy(gpu, &lut->tex);
+    }
     pl_free(lut->str.buf);
     pl_free(lut->data);
 
@@ -867,6 +1028,39 @@ static void sh_lut_uninit(pl_gpu gpu, void *ptr)
 #define SH_LUT_MAX_LITERAL_SOFT 64
 #define SH_LUT_MAX_LITERAL_HARD 256
 
+// Smaller LUTs are cheaper to regenerate than to look up in the `pl_cache`
+#define SH_LUT_MIN_CACHE_SIZE 1024
+
+// Allocates and fills the LUT contents, going through the `pl_gpu_cache` for
+// shared LUTs (whose contents are uniquely determined by their parameters)
+static void *sh_lut_fill(pl_gpu gpu, const struct sh_lut_params *params,
+                         size_t size)
+{
+    void *data = pl_zalloc(NULL, size);
+    pl_cache cache = pl_gpu_cache(gpu);
+    bool cacheable = params->shared && !params->dynamic &&
+                     size >= SH_LUT_MIN_CACHE_SIZE;
+    if (!cache || !cacheable) {
+        params->fill(data, params);
+        return data;
+    }
+
+    // The `fill` function is identified by its offset relative to `sh_lut`,
+    // which (unlike its address) is stable across runs
+    const uint64_t key_data[] = {
+        params->signature, (uintptr_t) params->fill - (uintptr_t) &sh_lut,
+        params->type, params->width, params->height, params->depth,
+        params->comps, PL_API_VER,
+    };
+    uint64_t key = pl_cache_key(PL_CACHE_KEY_LUT, pl_mem_hash(key_data, sizeof(key_data)));
+    if (pl_cache_get_exact(cache, key, data, size))
+        return data;
+
+    params->fill(data, params);
+    pl_cache_set_copy(cache, key, data, size);
+    return data;
+}
+
 ident_t sh_lut(pl_shader sh, const struct sh_lut_params *params)
 {
     pl_gpu gpu = SH_GPU(sh);
@@ -892,15 +1086,22 @@ ident_t sh_lut(pl_shader sh, const struct sh_lut_params *params)
                                     struct sh_lut_obj, sh_lut_uninit);
 
     if (!lut)
-        return NULL;
+        return NULL_IDENT;
+
+    // Tetrahedral interpolation is done on top of texelFetch, and needs at
+    // least two samples in each dimension
+    bool tetrahedral = params->tetrahedral && params->linear && dims == 3 &&
+                       gpu && gpu->glsl.version >= 130 && params->width >= 2 &&
+                       params->height >= 2 && params->depth >= 2;
 
     bool update = params->update || lut->signature != params->signature ||
                   params->type != lut->type || params->linear != lut->linear ||
+                  tetrahedral != lut->tetrahedral ||
                   params->width != lut->width || params->height != lut->height ||
                   params->depth != lut->depth || params->comps != lut->comps;
 
     if (lut->error && !update)
-        return NULL; // suppress error spam until something changes
+        return NULL_IDENT; // suppress error spam until something changes
 
     // Try picking the right number of dimensions for the texture LUT. This
     // allows e.g. falling back to 2D textures if 1D textures are unsupported.
@@ -926,7 +1127,7 @@ next_dim: ; // `continue` out of the inner loop
     };
 
     enum pl_fmt_caps texcaps = PL_FMT_CAP_SAMPLEABLE;
-    if (params->linear)
+    if (params->linear && !tetrahedral)
         texcaps |= PL_FMT_CAP_LINEAR;
 
     pl_fmt texfmt = NULL;
@@ -977,13 +1178,113 @@ next_dim: ; // `continue` out of the inner loop
         goto error;
     }
 
+    // Shared LUTs are keyed by their contents instead of the object state
+    bool shared = params->shared && method == SH_LUT_TEXTURE && !params->dynamic;
+    uint64_t shared_key = 0;
+    if (shared) {
+        const uint64_t key_data[] = {
+            params->signature, (uintptr_t) params->fill, (uintptr_t) texfmt,
+            params->type, params->linear, tetrahedral, params->width,
+            params->height, params->depth, params->comps,
+        };
+        shared_key = pl_mem_hash(key_data, sizeof(key_data));
+        update = !lut->shared || shared_key != lut->signature;
+    }
+
     // Reinitialize the existing LUT if needed
-    update |= method != lut->method;
-    if (update) {
+    update |= method != lut->method || shared != lut->shared;
+
+    // Regenerate the LUT in the background if only its contents changed,
+    // continuing to use the previous LUT in the meantime
+    size_t buf_size = size * params->comps * pl_var_type_size(params->type);
+    bool async = sh->res.params.async_luts && params->priv_size && !lut->error &&
+                 method == lut->method && shared == lut->shared &&
+                 params->type == lut->type && params->linear == lut->linear &&
+                 tetrahedral == lut->tetrahedral &&
+                 params->width == lut->width && params->height == lut->height &&
+                 params->depth == lut->depth && params->comps == lut->comps;
+
+    if (async && (update || lut->job)) {
+        uint64_t job_key = shared ? shared_key : params->signature;
+        if (!shared)
+            pl_hash_merge(&job_key, pl_mem_hash(params->priv, params->priv_size));
+
+        pl_tex cached = NULL;
+        if (shared && update && !lut->job)
+            cached = pl_tex_cache_get(gpu, shared_key);
+
+        if (cached) {
+            // Already available, no need to generate anything
+            pl_tex_cache_release(gpu, &lut->tex);
+            lut->tex = cached;
+            lut->signature = shared_key;
+            update = false;
+        } else if (lut->job && !sh_lut_job_done(lut->job)) {
+            update = false; // still busy, try again next time
+        } else if (lut->job && lut->job->key == job_key) {
+            PL_DEBUG(sh, "Background LUT generation done, uploading..");
+            tmp = pl_steal(NULL, lut->job->data);
+            sh_lut_job_destroy(&lut->job);
+            update = true;
+        } else {
+            // Parameters changed (again), start over with the current ones
+            sh_lut_job_destroy(&lut->job);
+            lut->job = sh_lut_job_start(sh->log, params, job_key, buf_size);
+            update = !lut->job; // fall back to synchronous generation
+        }
+    } else if (update) {
+        sh_lut_job_destroy(&lut->job);
+    }
+
+    if (update && lut->shared) {
+        pl_tex_cache_release(gpu, &lut->tex);
+        lut->shared = false;
+    }
+
+    if (update && shared) {
+        if (!texdim) {
+            PL_ERR(sh, "Texture LUT exceeds texture dimensions!");
+            goto error;
+        }
+
+        lut->tex = tmp ? NULL : pl_tex_cache_get(gpu, shared_key);
+        if (!lut->tex) {
+            PL_DEBUG(sh, "Shared LUT not found, generating..");
+            if (!tmp)
+                tmp = sh_lut_fill(gpu, params, buf_size);
+
+            pl_tex tex = pl_tex_create(gpu, pl_tex_params(
+                .w              = params->width,
+                .h              = PL_DEF(params->height, texdim >= 2 ? 1 : 0),
+                .d              = PL_DEF(params->depth,  texdim >= 3 ? 1 : 0),
+                .format         = texfmt,
+                .sampleable     = true,
+                .initial_data   = tmp,
+                .debug_tag      = PL_DEBUG_TAG,
+            ));
+
+            if (!tex) {
+                PL_ERR(sh, "Failed creating LUT texture!");
+                goto error;
+            }
+
+            lut->tex = pl_tex_cache_add(gpu, shared_key, tex);
+        }
+
+        lut->shared = true;
+        lut->signature = shared_key;
+        lut->method = method;
+        lut->type = params->type;
+        lut->linear = params->linear;
+        lut->tetrahedral = tetrahedral;
+        lut->width = params->width;
+        lut->height = params->height;
+        lut->depth = params->depth;
+        lut->comps = params->comps;
+    } else if (update) {
         PL_DEBUG(sh, "LUT cache invalidated, regenerating..");
-        size_t buf_size = size * params->comps * pl_var_type_size(params->type);
-        tmp = pl_zalloc(NULL, buf_size);
-        params->fill(tmp, params);
+        if (!tmp)
+            tmp = sh_lut_fill(gpu, params, buf_size);
 
         switch (method) {
         case SH_LUT_TEXTURE: {
@@ -1087,15 +1388,17 @@ next_dim: ; // `continue` out of the inner loop
         lut->method = method;
         lut->type = params->type;
         lut->linear = params->linear;
+        lut->tetrahedral = tetrahedral;
         lut->width = params->width;
         lut->height = params->height;
         lut->depth = params->depth;
         lut->comps = params->comps;
+        lut->signature = params->signature;
     }
 
     // Done updating, generate the GLSL
     ident_t name = sh_fresh(sh, "lut");
-    ident_t arr_name = NULL;
+    ident_t arr_name = NULL_IDENT;
 
     static const char * const swizzles[] = {"x", "xy", "xyz", "xyzw"};
     static const char * const vartypes[PL_VAR_TYPE_COUNT][4] = {
@@ -1114,18 +1417,55 @@ next_dim: ; // `continue` out of the inner loop
             },
             .binding = {
                 .object = lut->tex,
-                .sample_mode = params->linear ? PL_TEX_SAMPLE_LINEAR
-                                              : PL_TEX_SAMPLE_NEAREST,
+                .sample_mode = params->linear && !tetrahedral
+                                    ? PL_TEX_SAMPLE_LINEAR
+                                    : PL_TEX_SAMPLE_NEAREST,
             }
         });
 
+        if (tetrahedral) {
+            // Split the unit cube into six tetrahedra along its main
+            // diagonal, and interpolate between the four corners of the one
+            // containing `fpos`. `imax`/`imin` select the axes with the
+            // largest/smallest fractional part (with consistent tie-breaking)
+            const char *vtype = vartypes[PL_VAR_FLOAT][params->comps - 1];
+            const char *swiz = swizzles[params->comps - 1];
+            GLSLH("%s "$"(vec3 fpos) {                                      \n"
+                  "    const vec3 lut_size = vec3(%d.0, %d.0, %d.0);           \n"
+                  "    fpos = clamp(fpos, 0.0, 1.0) * (lut_size - vec3(1.0));  \n"
+                  "    vec3 base = min(floor(fpos), lut_size - vec3(2.0));     \n"
+                  "    vec3 f = fpos - base;                                   \n"
+                  "    ivec3 ipos = ivec3(base);                               \n"
+                  "    float xy = step(f.y, f.x),                              \n"
+                  "          yz = step(f.z, f.y),                              \n"
+                  "          xz = step(f.z, f.x);                              \n"
+                  "    vec3 imax = vec3(xy * xz, (1.0 - xy) * yz,              \n"
+                  "                     (1.0 - xz) * (1.0 - yz));              \n"
+                  "    vec3 imin = vec3((1.0 - xz) * (1.0 - xy),               \n"
+                  "                     (1.0 - yz) * xy, xz * yz);             \n"
+                  "    float fmax = dot(f, imax),                              \n"
+                  "          fmin = dot(f, imin),                              \n"
+                  "          fmid = f.x + f.y + f.z - fmax - fmin;             \n",
+                  vtype, name, params->width, params->height, params->depth);
+            GLSLH("    %s c0 = texelFetch("$", ipos, 0).%s;                    \n"
+                  "    %s c1 = texelFetch("$", ipos + ivec3(imax), 0).%s;      \n"
+                  "    %s c2 = texelFetch("$", ipos + ivec3(1.0 - imin), 0).%s; \n"
+                  "    %s c3 = texelFetch("$", ipos + ivec3(1), 0).%s;         \n"
+                  "    return (1.0 - fmax) * c0 + (fmax - fmid) * c1 +         \n"
+                  "           (fmid - fmin) * c2 + fmin * c3;                  \n"
+                  "}                                                           \n",
+                  vtype, tex, swiz, vtype, tex, swiz,
+                  vtype, tex, swiz, vtype, tex, swiz);
+            break;
+        }
+
         // texelFetch requires GLSL >= 130, so fall back to the linear code
         if (params->linear || gpu->glsl.version < 130) {
             ident_t pos_macros[PL_ARRAY_SIZE(sizes)] = {0};
             for (int i = 0; i < dims; i++)
                 pos_macros[i] = sh_lut_pos(sh, sizes[i]);
 
-            GLSLH("#define %s(pos) (%s(%s, %s(\\\n",
+            GLSLH("#define "$"(pos) (%s("$", %s(\\\n",
                   name, sh_tex_fn(sh, lut->tex->params),
                   tex, vartypes[PL_VAR_FLOAT][texdim - 1]);
 
@@ -1133,10 +1473,10 @@ next_dim: ; // `continue` out of the inner loop
                 char sep = i == 0 ? ' ' : ',';
                 if (pos_macros[i]) {
                     if (dims > 1) {
-                        GLSLH("   %c%s(%s(pos).%c)\\\n", sep, pos_macros[i],
+                        GLSLH("   %c"$"(%s(pos).%c)\\\n", sep, pos_macros[i],
                               vartypes[PL_VAR_FLOAT][dims - 1], "xyzw"[i]);
                     } else {
-                        GLSLH("   %c%s(float(pos))\\\n", sep, pos_macros[i]);
+                        GLSLH("   %c"$"(float(pos))\\\n", sep, pos_macros[i]);
                     }
                 } else {
                     GLSLH("   %c%f\\\n", sep, 0.5);
@@ -1144,7 +1484,7 @@ next_dim: ; // `continue` out of the inner loop
             }
             GLSLH("  )).%s)\n", swizzles[params->comps - 1]);
         } else {
-            GLSLH("#define %s(pos) (texelFetch(%s, %s(pos",
+            GLSLH("#define "$"(pos) (texelFetch("$", %s(pos",
                   name, tex, vartypes[PL_VAR_SINT][texdim - 1]);
 
             // Fill up extra components of the index
@@ -1172,10 +1512,10 @@ next_dim: ; // `continue` out of the inner loop
 
     case SH_LUT_LITERAL:
         arr_name = sh_fresh(sh, "weights");
-        GLSLH("const %s %s[%d] = %s[](\n  ",
+        GLSLH("const %s "$"[%d] = %s[](\n  ",
               vartypes[params->type][params->comps - 1], arr_name, size,
               vartypes[params->type][params->comps - 1]);
-        pl_str_append(sh, &sh->buffers[SH_BUF_HEADER], lut->str);
+        sh_append_str(sh, SH_BUF_HEADER, lut->str);
         GLSLH(");\n");
         break;
 
@@ -1184,7 +1524,7 @@ next_dim: ; // `continue` out of the inner loop
     }
 
     if (arr_name) {
-        GLSLH("#define %s(pos) (%s[int((pos)%s)\\\n",
+        GLSLH("#define "$"(pos) ("$"[int((pos)%s)\\\n",
               name, arr_name, dims > 1 ? "[0]" : "");
         int shift = params->width;
         for (int i = 1; i < dims; i++) {
@@ -1198,12 +1538,12 @@ next_dim: ; // `continue` out of the inner loop
             pl_assert(params->type == PL_VAR_FLOAT);
             ident_t arr_lut = name;
             name = sh_fresh(sh, "lut_lin");
-            GLSLH("%s %s(float fpos) {                              \n"
+            GLSLH("%s "$"(float fpos) {                             \n"
                   "    fpos = clamp(fpos, 0.0, 1.0) * %d.0;         \n"
                   "    float fbase = floor(fpos);                   \n"
                   "    float fceil = ceil(fpos);                    \n"
                   "    float fcoord = fpos - fbase;                 \n"
-                  "    return mix(%s(fbase), %s(fceil), fcoord);    \n"
+                  "    return mix("$"(fbase), "$"(fceil), fcoord);  \n"
                   "}                                                \n",
                   vartypes[PL_VAR_FLOAT][params->comps - 1], name,
                   size - 1,
@@ -1219,7 +1559,44 @@ next_dim: ; // `continue` out of the inner loop
 error:
     lut->error = true;
     pl_free(tmp);
-    return NULL;
+    return NULL_IDENT;
+}
+
+bool sh_memo_begin(pl_shader sh, struct sh_memo *memo, uint64_t key)
+{
+    struct sh_buf *body = &sh->buffers[SH_BUF_BODY];
+    buf_flush(sh, body);
+    if (memo->key == key && memo->text.len) {
+        // Mirror the segmentation of `sh_memo_end`, for stable text hashes
+        PL_ARRAY_APPEND(sh, body->segs, pl_strdup(SH_TMP(sh), memo->text));
+        return true;
+    }
+
+    // Invalidated until `sh_memo_end`, in case generation fails half-way
+    memo->key = key;
+    memo->text.len = 0;
+    memo->start = body->segs.num;
+    return false;
+}
+
+void sh_memo_end(pl_shader sh, struct sh_memo *memo)
+{
+    struct sh_buf *body = &sh->buffers[SH_BUF_BODY];
+    buf_flush(sh, body);
+    pl_assert(memo->start <= body->segs.num);
+    for (int i = memo->start; i < body->segs.num; i++)
+        pl_str_append(NULL, &memo->text, body->segs.elem[i]);
+
+    // Collapse the generated text into a single segment
+    body->segs.num = memo->start;
+    if (memo->text.len)
+        PL_ARRAY_APPEND(sh, body->segs, pl_strdup(SH_TMP(sh), memo->text));
+}
+
+void sh_memo_uninit(struct sh_memo *memo)
+{
+    pl_free(memo->text.buf);
+    *memo = (struct sh_memo) {0};
 }
 
 const char *sh_bvec(const pl_shader sh, int dims)
@@ -1241,3 +1618,39 @@ const char *sh_bvec(const pl_shader sh, int dims)
     pl_assert(dims > 0 && dims < PL_ARRAY_SIZE(bvecs));
     return sh_glsl(sh).version >= 130 ? bvecs[dims] : vecs[dims];
 }
+
+const char *sh_half(const pl_shader sh)
+{
+    if (!SH_PARAMS(sh).half_precision)
+        return "";
+
+    // Desktop GLSL (including GL_KHR_vulkan_glsl) accepts but ignores
+    // precision qualifiers, so only emit them where they have an effect
+    return sh_glsl(sh).gles ? "mediump " : "";
+}
+
+ident_t sh_half_begin(pl_shader sh)
+{
+    if (!sh_half(sh)[0])
+        return NULL_IDENT;
+
+    // The scope of `color` only starts after its initializer, so this shadows
+    // the outer variable with a copy of itself
+    ident_t out = sh_fresh(sh, "color_out");
+    GLSL("vec4 "$";                     \n"
+         "{                             \n"
+         "mediump vec4 color = color;   \n",
+         out);
+    return out;
+}
+
+void sh_half_end(pl_shader sh, ident_t out)
+{
+    if (!out)
+        return;
+
+    GLSL($" = color;    \n"
+         "}             \n"
+         "color = "$";  \n",
+         out, out);
+}
@@ -24,9 +24,37 @@
 #include "gpu.h"
 
 // This represents an identifier (e.g. name of function, uniform etc.) for
-// a shader resource. The generated identifiers are immutable, but only live
-// until pl_shader_reset - so make copies when passing to external stuff.
-typedef const char * ident_t;
+// a shader resource. Identifiers are compact integer handles, which are only
+// turned into text when formatted into the shader, using the `$` format
+// string placeholder, e.g. `GLSL("vec4 "$" = ...;", ident)`. They are
+// unique per shader (including merged sub-shaders), but only live until
+// pl_shader_reset.
+typedef unsigned int ident_t;
+#define $ "_%x"
+#define NULL_IDENT 0u
+
+// Converts an identifier to its textual representation, e.g. for the names of
+// variables and descriptors. The result lives until `pl_shader_reset`.
+#define sh_ident_pack(id) pl_asprintf(SH_TMP(sh), $, (ident_t) (id))
+
+// Inverse of `sh_ident_pack`. Returns 0 for names not generated by it (e.g.
+// user-provided names of custom shader resources)
+static inline ident_t sh_ident_unpack(const char *name)
+{
+    ident_t id = 0;
+    if (name[0] != '_' || !name[1] || strlen(name) > 9)
+        return NULL_IDENT;
+    for (const char *c = name + 1; *c; c++) {
+        if (*c >= '0' && *c <= '9') {
+            id = (id << 4) | (*c - '0');
+        } else if (*c >= 'a' && *c <= 'f') {
+            id = (id << 4) | (*c - 'a' + 10);
+        } else {
+            return NULL_IDENT;
+        }
+    }
+    return id;
+}
 
 enum pl_shader_buf {
     SH_BUF_PRELUDE, // extra #defines etc.
@@ -36,6 +64,16 @@ enum pl_shader_buf {
     SH_BUF_COUNT,
 };
 
+// Text of a shader buffer, stored as a rope of string segments. This allows
+// splicing the text of one buffer into another (e.g. in `sh_subpass`) by
+// reference, instead of copying it. Segments are allocated from `SH_TMP`,
+// which shaders retain a reference to when merging in other shaders, and are
+// never modified once added to `segs`.
+struct sh_buf {
+    PL_ARRAY(pl_str) segs;
+    pl_str tail; // segment currently being appended to
+};
+
 enum pl_shader_type {
     SH_AUTO,
     SH_COMPUTE,
@@ -51,12 +89,13 @@ struct pl_shader {
     int output_w;
     int output_h;
     bool transpose;
-    pl_str buffers[SH_BUF_COUNT];
+    struct sh_buf buffers[SH_BUF_COUNT];
     enum pl_shader_type type;
     bool flexible_work_groups;
     enum pl_sampler_type sampler_type;
     char sampler_prefix;
     int fresh;
+    pl_dispatch dp; // dispatch this shader was created by, if any
 
     // mutable versions of the fields from pl_shader_res
     PL_ARRAY(struct pl_shader_va) vas;
@@ -82,7 +121,18 @@ struct pl_glsl_version sh_glsl(const pl_shader sh);
 // Attempt enabling compute shaders for this pass, if possible
 bool sh_try_compute(pl_shader sh, int bw, int bh, bool flex, size_t mem);
 
-// Attempt merging a secondary shader into the current shader. Returns NULL if
+// Like `pl_shader_finalize`, but leaves `pl_shader_res.glsl` unset, deferring
+// the concatenation of the shader text. Instead, the text can be hashed with
+// `sh_text_hash`, and written out with `sh_text_write` only when needed (e.g.
+// on pass cache misses).
+const struct pl_shader_res *sh_finalize_internal(pl_shader sh);
+uint64_t sh_text_hash(const pl_shader sh);
+void sh_text_write(const pl_shader sh, void *alloc, pl_str *out);
+
+// Appends the flattened contents of a single shader buffer to `out`
+void sh_buf_write(const struct sh_buf *b, void *alloc, pl_str *out);
+
+// Attempt merging a secondary shader into the current shader. Returns 0 if
 // merging fails (e.g. incompatible signatures); otherwise returns an identifier
 // corresponding to the generated subpass function.
 ident_t sh_subpass(pl_shader sh, const pl_shader sub);
@@ -109,13 +159,13 @@ ident_t sh_const_float(pl_shader sh, const char *name, float val);
 #define SH_UINT(val)    sh_const_uint(sh, "const", val)
 #define SH_FLOAT(val)   sh_const_float(sh, "const", val)
 
-// Add a new vec2 vertex attribute from a pl_rect2df, or returns NULL on failure.
+// Add a new vec2 vertex attribute from a pl_rect2df, or returns 0 on failure.
 ident_t sh_attr_vec2(pl_shader sh, const char *name,
                      const struct pl_rect2df *rc);
 
 // Bind a texture under a given transformation and make its attributes
 // available as well. If an output pointer for one of the attributes is left
-// as NULL, that attribute will not be added. Returns NULL on failure. `rect`
+// as NULL, that attribute will not be added. Returns 0 on failure. `rect`
 // is optional, and defaults to the full texture if left as NULL.
 //
 // Note that for e.g. compute shaders, the vec2 out_pos might be a macro that
@@ -223,6 +273,13 @@ struct sh_lut_params {
     // rather than taking an ivecN. Requires `type == PL_VAR_FLOAT`!
     bool linear;
 
+    // If true, linear 3D LUTs are interpolated tetrahedrally in the shader,
+    // from nearest-neighbour texel fetches, rather than relying on hardware
+    // trilinear filtering. This is more accurate for a given LUT size, at the
+    // cost of four texture fetches per lookup. Silently falls back to
+    // trilinear filtering where unsupported.
+    bool tetrahedral;
+
     // If true, the LUT will always be regenerated, even if the dimensions have
     // not changed.
     bool update;
@@ -235,6 +292,13 @@ struct sh_lut_params {
     // rather than being treated as read-only.
     bool dynamic;
 
+    // If set to true, `signature` must uniquely identify the LUT contents
+    // (for this `fill` function). Texture LUTs are then shared between all
+    // shader objects on the same `pl_gpu` with matching parameters, rather than
+    // being generated per object, and `update` is ignored. Has no effect for
+    // dynamic or non-texture LUTs.
+    bool shared;
+
     // Will be called with a zero-initialized buffer whenever the data needs to
     // be computed, which happens whenever the size is changed, the shader
     // object is invalidated, or `update` is set to true.
@@ -242,23 +306,59 @@ struct sh_lut_params {
     // Note: Interpretation of `data` is according to `pl_var_type`.
     void (*fill)(void *data, const struct sh_lut_params *params);
     void *priv;
+
+    // If nonzero, `priv` points to a plain struct of this size which fully
+    // describes the LUT contents (together with `signature`), and `fill` only
+    // depends on it. This allows regenerating the LUT in the background when
+    // `pl_shader_params.async_luts` is set, using a private copy of `priv`.
+    size_t priv_size;
 };
 
 #define sh_lut_params(...) (&(struct sh_lut_params) { __VA_ARGS__ })
 
 // Makes a table of values available as a shader variable, using an a given
 // method (falling back if needed). The resulting identifier can be sampled
-// directly as %s(pos), where pos is a vector with the right number of
+// directly as $(pos), where pos is a vector with the right number of
 // dimensions. `pos` must be an integer vector within the bounds of the array,
 // unless the method is `SH_LUT_LINEAR`, in which case it's a float vector that
-// gets interpolated and clamped as needed. Returns NULL on error.
+// gets interpolated and clamped as needed. Returns 0 on error.
 ident_t sh_lut(pl_shader sh, const struct sh_lut_params *params);
 
+// Memoized block of GLSL text, for helpers which re-emit the same (large)
+// chunk of code on every invocation. Typically embedded in the helper's
+// shader object and released with `sh_memo_uninit`.
+struct sh_memo {
+    uint64_t key;
+    pl_str text;
+    int start;
+};
+
+// If `key` matches the memoized text, appends it to SH_BUF_BODY and returns
+// true, in which case the caller must skip generating it. Otherwise, returns
+// false, and all text appended to SH_BUF_BODY until the following call to
+// `sh_memo_end` gets memoized. `key` must capture every input that affects
+// the generated text, including all identifiers referenced by it. The block
+// must not register any variables, descriptors or other shader resources.
+bool sh_memo_begin(pl_shader sh, struct sh_memo *memo, uint64_t key);
+void sh_memo_end(pl_shader sh, struct sh_memo *memo);
+void sh_memo_uninit(struct sh_memo *memo);
+
 // Returns a GLSL-version appropriate "bvec"-like type. For GLSL 130+, this
 // returns bvecN. For GLSL 120, this returns vecN instead. The intended use of
 // this function is with mix(), which only accepts bvec in GLSL 130+.
 const char *sh_bvec(const pl_shader sh, int dims);
 
+// Returns "mediump " if `pl_shader_params.half_precision` is enabled and the
+// GLSL dialect honors precision qualifiers, or "" otherwise. Meant to prefix
+// declarations of temporaries which tolerate 16-bit float precision.
+const char *sh_half(const pl_shader sh);
+
+// Runs the code between these two calls on a reduced precision copy of
+// `color`, if enabled (see `sh_half`). The return value of `sh_half_begin`
+// must be passed to the matching `sh_half_end`.
+ident_t sh_half_begin(pl_shader sh);
+void sh_half_end(pl_shader sh, ident_t out);
+
 // Returns the appropriate `texture`-equivalent function for the shader and
 // given texture.
 static inline const char *sh_tex_fn(const pl_shader sh,
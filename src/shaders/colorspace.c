@@ -31,6 +31,36 @@ static const float HLG_A = 0.17883277,
                    HLG_C = 0.55991073,
                    HLG_REF = 1000.0 / PL_COLOR_SDR_WHITE;
 
+// Polynomial approximations used for `pl_shader_params.fast_transfer`, as
+// monomial coefficients in increasing order. These are minimax fits weighted
+// by the slope of the respective curve, such that the error stays below 1/4
+// of a 12-bit code value everywhere.
+//
+// PQ EOTF: log2(Y) as a function of log2(E), split at E = 1/4
+static const float PQ_FAST_LO[] = { -26.1705971,  11.9574862, -0.240289822,
+                                     3.32871485,  0.623998702, -3.14660835,
+                                     2.72495794 };
+static const float PQ_FAST_HI[] = { -6.76047325,  5.01119566,  1.13042295,
+                                     0.368707657, 0.128834799, 0.0807624832,
+                                     0.0402912349 };
+// PQ inverse EOTF: log2(E) as a function of log2(Y), for Y in [2^-40, 1]
+static const float PQ_FAST_INV[] = { -5.57433701, 10.0531902, -4.3632803,
+                                     -2.06406856,  2.8605516, -0.986209571,
+                                      0.07412415 };
+// HLG inverse OETF: upper (logarithmic) segment, for E in [0.5, 1]
+static const float HLG_FAST_INV[] = { 3.17987323, 4.04244137, 2.8168509,
+                                      1.33579099, 0.501380086, 0.120090082 };
+
+// Evaluates the polynomial `c` at `t` using Horner's scheme, storing the
+// result in the (already declared) vec3 `var`
+static void sh_poly(pl_shader sh, const char *var, const char *t,
+                    const float *c, int num)
+{
+    GLSL("%s = vec3(%f); \n", var, c[num - 1]);
+    for (int i = num - 2; i >= 0; i--)
+        GLSL("%s = %s * %s + vec3(%f); \n", var, var, t, c[i]);
+}
+
 // Common constants for Panasonic V-Log
 static const float VLOG_B = 0.00873,
                    VLOG_C = 0.241514,
@@ -81,8 +111,8 @@ static inline void reshape_mmr(pl_shader sh, ident_t mmr, bool single,
          "s = coeffs.x;                                         \n"
          "sigX.xyz = sig.xxy * sig.yzz;                         \n"
          "sigX.w = sigX.x * sig.z;                              \n"
-         "s += dot(%s[mmr_idx + 0].xyz, sig);                   \n"
-         "s += dot(%s[mmr_idx + 1], sigX);                      \n",
+         "s += dot("$"[mmr_idx + 0].xyz, sig);                  \n"
+         "s += dot("$"[mmr_idx + 1], sigX);                     \n",
          mmr, mmr);
 
     if (max_order >= 2) {
@@ -91,16 +121,16 @@ static inline void reshape_mmr(pl_shader sh, ident_t mmr, bool single,
 
         GLSL("vec3 sig2 = sig * sig;                            \n"
              "vec4 sigX2 = sigX * sigX;                         \n"
-             "s += dot(%s[mmr_idx + 2].xyz, sig2);              \n"
-             "s += dot(%s[mmr_idx + 3], sigX2);                 \n",
+             "s += dot("$"[mmr_idx + 2].xyz, sig2);             \n"
+             "s += dot("$"[mmr_idx + 3], sigX2);                \n",
              mmr, mmr);
 
         if (max_order == 3) {
             if (min_order < 3)
-                GLSL("if (order >= 3 { \n");
+                GLSL("if (order >= 3) { \n");
 
-            GLSL("s += dot(%s[mmr_idx + 4].xyz, sig2 * sig);    \n"
-                 "s += dot(%s[mmr_idx + 5], sigX2 * sigX);      \n",
+            GLSL("s += dot("$"[mmr_idx + 4].xyz, sig2 * sig);   \n"
+                 "s += dot("$"[mmr_idx + 5], sigX2 * sigX);     \n",
                  mmr, mmr);
 
             if (min_order < 3)
@@ -117,10 +147,22 @@ static inline void reshape_poly(pl_shader sh)
     GLSL("s = (coeffs.z * s + coeffs.y) * s + coeffs.x; \n");
 }
 
+static bool dovi_needs_reshape(const struct pl_dovi_metadata *data)
+{
+    for (int c = 0; c < 3; c++) {
+        if (data->comp[c].num_pivots)
+            return true;
+    }
+
+    return false;
+}
+
 void pl_shader_dovi_reshape(pl_shader sh, const struct pl_dovi_metadata *data)
 {
     if (!sh_require(sh, PL_SHADER_SIG_COLOR, 0, 0) || !data)
         return;
+    if (!dovi_needs_reshape(data))
+        return;
 
     sh_describe(sh, "reshaping");
     GLSL("// pl_shader_reshape                  \n"
@@ -216,8 +258,8 @@ void pl_shader_dovi_reshape(pl_shader sh, const struct pl_dovi_metadata *data)
             });
 
             // Efficiently branch into the correct set of coefficients
-            GLSL("#define test(i) bvec4(s >= %s[i])                 \n"
-                 "#define coef(i) %s[i]                             \n"
+            GLSL("#define test(i) bvec4(s >= "$"[i])                \n"
+                 "#define coef(i) "$"[i]                            \n"
                  "coeffs = mix(mix(mix(coef(0), coef(1), test(0)),  \n"
                  "                 mix(coef(2), coef(3), test(2)),  \n"
                  "                 test(1)),                        \n"
@@ -232,14 +274,14 @@ void pl_shader_dovi_reshape(pl_shader sh, const struct pl_dovi_metadata *data)
         } else {
 
             // No need for a single pivot, just set the coeffs directly
-            GLSL("coeffs = %s; \n", sh_var(sh, (struct pl_shader_var) {
+            GLSL("coeffs = "$"; \n", sh_var(sh, (struct pl_shader_var) {
                 .var = pl_var_vec4("coeffs"),
                 .data = coeffs_data,
             }));
 
         }
 
-        ident_t mmr = NULL;
+        ident_t mmr = NULL_IDENT;
         if (has_mmr) {
             mmr = sh_var(sh, (struct pl_shader_var) {
                 .data = mmr_packed_data,
@@ -272,7 +314,160 @@ void pl_shader_dovi_reshape(pl_shader sh, const struct pl_dovi_metadata *data)
         // to change from frame to frame (if they do, shoot the sample author)
         ident_t lo = SH_FLOAT(comp->pivots[0]);
         ident_t hi = SH_FLOAT(comp->pivots[comp->num_pivots - 1]);
-        GLSL("color[%d] = clamp(s, %s, %s); \n", c, lo, hi);
+        GLSL("color[%d] = clamp(s, "$", "$"); \n", c, lo, hi);
+    }
+
+    GLSL("} \n");
+}
+
+// CPU equivalent of the reshaping performed by `pl_shader_dovi_reshape`
+static float dovi_reshape_comp(const struct pl_reshape_data *comp,
+                               const float sig[3], int c)
+{
+    float s = sig[c];
+    if (!comp->num_pivots)
+        return s;
+
+    int i = 0;
+    while (i < comp->num_pivots - 2 && s >= comp->pivots[i + 1])
+        i++;
+
+    switch (comp->method[i]) {
+    case 0: { // polynomial
+        const float *coeffs = comp->poly_coeffs[i];
+        s = (coeffs[2] * s + coeffs[1]) * s + coeffs[0];
+        break;
+    }
+
+    case 1: { // MMR
+        const float sigX[4] = {
+            sig[0] * sig[1], sig[0] * sig[2], sig[1] * sig[2],
+            sig[0] * sig[1] * sig[2],
+        };
+
+        float pow_sig[3] = { sig[0], sig[1], sig[2] };
+        float pow_sigX[4] = { sigX[0], sigX[1], sigX[2], sigX[3] };
+        s = comp->mmr_constant[i];
+        for (int o = 0; o < comp->mmr_order[i]; o++) {
+            const float *mmr = comp->mmr_coeffs[i][o];
+            for (int k = 0; k < 3; k++) {
+                s += mmr[k] * pow_sig[k];
+                pow_sig[k] *= sig[k];
+            }
+            for (int k = 0; k < 4; k++) {
+                s += mmr[3 + k] * pow_sigX[k];
+                pow_sigX[k] *= sigX[k];
+            }
+        }
+        break;
+    }
+
+    default:
+        pl_unreachable();
+    }
+
+    return PL_CLAMP(s, comp->pivots[0], comp->pivots[comp->num_pivots - 1]);
+}
+
+static bool dovi_has_mmr(const struct pl_dovi_metadata *data)
+{
+    for (int c = 0; c < 3; c++) {
+        const struct pl_reshape_data *comp = &data->comp[c];
+        for (int i = 0; i < comp->num_pivots - 1; i++) {
+            if (comp->method[i] == 1)
+                return true;
+        }
+    }
+
+    return false;
+}
+
+static void fill_dovi_lut(void *data, const struct sh_lut_params *params)
+{
+    const struct pl_dovi_metadata *dovi = params->priv;
+    const int size = params->width;
+    float *lut = data;
+
+    if (params->depth) {
+        // Cross-channel MMR reshaping, indexed by all three components
+        for (int b = 0; b < size; b++) {
+            for (int g = 0; g < size; g++) {
+                for (int r = 0; r < size; r++) {
+                    const float sig[3] = {
+                        (float) r / (size - 1),
+                        (float) g / (size - 1),
+                        (float) b / (size - 1),
+                    };
+                    for (int c = 0; c < 3; c++)
+                        lut[c] = dovi_reshape_comp(&dovi->comp[c], sig, c);
+                    lut += params->comps;
+                }
+            }
+        }
+    } else {
+        // Independent polynomial reshaping, one curve per component
+        for (int i = 0; i < size; i++) {
+            const float x = (float) i / (size - 1);
+            const float sig[3] = { x, x, x };
+            for (int c = 0; c < 3; c++)
+                lut[c] = dovi_reshape_comp(&dovi->comp[c], sig, c);
+            lut += params->comps;
+        }
+    }
+}
+
+void pl_shader_dovi_reshape_lut(pl_shader sh, const struct pl_dovi_metadata *data,
+                                pl_shader_obj *state)
+{
+    if (!sh_require(sh, PL_SHADER_SIG_COLOR, 0, 0) || !data)
+        return;
+    if (!dovi_needs_reshape(data))
+        return;
+
+    // MMR needs a 3D LUT, which is only worth it as a texture
+    bool mmr = dovi_has_mmr(data);
+    pl_gpu gpu = SH_GPU(sh);
+    if (mmr && (!gpu || !gpu->limits.max_tex_3d_dim)) {
+        pl_shader_dovi_reshape(sh, data);
+        return;
+    }
+
+    const int size = mmr ? 33 : 256;
+    ident_t lut = sh_lut(sh, sh_lut_params(
+        .object = state,
+        .method = mmr ? SH_LUT_TEXTURE : SH_LUT_AUTO,
+        .type = PL_VAR_FLOAT,
+        .width = size,
+        .height = mmr ? size : 0,
+        .depth = mmr ? size : 0,
+        .comps = 4, // for better texel alignment
+        .linear = true,
+        .signature = pl_mem_hash(data, sizeof(*data)),
+        .fill = fill_dovi_lut,
+        .priv = (void *) data,
+        .priv_size = sizeof(*data),
+    ));
+
+    if (!lut) {
+        pl_shader_dovi_reshape(sh, data);
+        return;
+    }
+
+    sh_describe(sh, "reshaping (LUT)");
+    GLSL("// pl_shader_dovi_reshape_lut         \n"
+         "{                                     \n"
+         "vec3 sig = clamp(color.rgb, 0.0, 1.0);\n");
+
+    if (mmr) {
+        GLSL("vec3 res = "$"(sig).rgb; \n", lut);
+    } else {
+        GLSL("vec3 res = vec3("$"(sig.r).r, "$"(sig.g).g, "$"(sig.b).b); \n",
+             lut, lut, lut);
+    }
+
+    for (int c = 0; c < 3; c++) {
+        if (data->comp[c].num_pivots)
+            GLSL("color[%d] = res[%d]; \n", c, c);
     }
 
     GLSL("} \n");
@@ -295,13 +490,13 @@ void pl_shader_decode_color(pl_shader sh, struct pl_color_repr *repr,
     if (repr->sys == PL_COLOR_SYSTEM_XYZ) {
         ident_t scale = SH_FLOAT(pl_color_repr_normalize(repr));
         GLSL("color.rgb = max(color.rgb, vec3(0.0));            \n"
-             "color.rgb = pow(vec3(%s) * color.rgb, vec3(2.6)); \n",
+             "color.rgb = pow(vec3("$") * color.rgb, vec3(2.6)); \n",
              scale);
     }
 
     if (repr->sys == PL_COLOR_SYSTEM_DOLBYVISION) {
         ident_t scale = SH_FLOAT(pl_color_repr_normalize(repr));
-        GLSL("color.rgb *= vec3(%s); \n", scale);
+        GLSL("color.rgb *= vec3("$"); \n", scale);
         pl_shader_dovi_reshape(sh, repr->dovi);
     }
 
@@ -319,7 +514,24 @@ void pl_shader_decode_color(pl_shader sh, struct pl_color_repr *repr,
             .data = tr.c,
         });
 
-        GLSL("color.rgb = %s * color.rgb + %s;\n", cmat, cmat_c);
+        // The matrix tolerates reduced precision, except for systems whose
+        // output is passed through an HDR transfer function below
+        ident_t half = NULL_IDENT;
+        if (orig_sys != PL_COLOR_SYSTEM_BT_2100_PQ &&
+            orig_sys != PL_COLOR_SYSTEM_BT_2100_HLG &&
+            orig_sys != PL_COLOR_SYSTEM_DOLBYVISION)
+        {
+            half = sh_half_begin(sh);
+        }
+
+        if (half) {
+            GLSL("mediump mat3 cmat = "$";              \n"
+                 "color.rgb = cmat * color.rgb + "$";   \n",
+                 cmat, cmat_c);
+        } else {
+            GLSL("color.rgb = "$" * color.rgb + "$";\n", cmat, cmat_c);
+        }
+        sh_half_end(sh, half);
     }
 
     switch (orig_sys) {
@@ -430,7 +642,7 @@ void pl_shader_decode_color(pl_shader sh, struct pl_color_repr *repr,
              "color.rgb = pow(color.rgb, vec3(1.0/%f));             \n",
              PQ_M2, PQ_C1, PQ_C2, PQ_C3, PQ_M1);
         // LMS matrix
-        GLSL("color.rgb = %s * color.rgb; \n", mat);
+        GLSL("color.rgb = "$" * color.rgb; \n", mat);
         // PQ OETF
         GLSL("color.rgb = pow(max(color.rgb, 0.0), vec3(%f));       \n"
              "color.rgb = (vec3(%f) + vec3(%f) * color.rgb)         \n"
@@ -464,7 +676,7 @@ void pl_shader_decode_color(pl_shader sh, struct pl_color_repr *repr,
             .var = pl_var_float("gamma"),
             .data = &(float){ 1 / params->gamma },
         });
-        GLSL("color.rgb = pow(max(color.rgb, vec3(0.0)), vec3(%s)); \n", gamma);
+        GLSL("color.rgb = pow(max(color.rgb, vec3(0.0)), vec3("$")); \n", gamma);
     }
 
     GLSL("}\n");
@@ -564,7 +776,7 @@ void pl_shader_encode_color(pl_shader sh, const struct pl_color_repr *repr)
 
     if (!skip) {
         struct pl_color_repr copy = *repr;
-        ident_t xyzscale = NULL;
+        ident_t xyzscale = NULL_IDENT;
         if (repr->sys == PL_COLOR_SYSTEM_XYZ)
             xyzscale = SH_FLOAT(1.0 / pl_color_repr_normalize(&copy));
 
@@ -581,10 +793,10 @@ void pl_shader_encode_color(pl_shader sh, const struct pl_color_repr *repr)
             .data = tr.c,
         });
 
-        GLSL("color.rgb = %s * color.rgb + %s;\n", cmat, cmat_c);
+        GLSL("color.rgb = "$" * color.rgb + "$";\n", cmat, cmat_c);
 
         if (xyzscale)
-            GLSL("color.rgb = pow(color.rgb, vec3(1.0/2.6)) * vec3(%s); \n", xyzscale);
+            GLSL("color.rgb = pow(color.rgb, vec3(1.0/2.6)) * vec3("$"); \n", xyzscale);
     }
 
     if (repr->alpha == PL_ALPHA_PREMULTIPLIED)
@@ -600,21 +812,15 @@ static ident_t sh_luma_coeffs(pl_shader sh, const struct pl_raw_primaries *prim)
 
     // FIXME: Cannot use `const vec3` due to glslang bug #2025
     ident_t coeffs = sh_fresh(sh, "luma_coeffs");
-    GLSLH("#define %s vec3(%s, %s, %s) \n", coeffs,
+    GLSLH("#define "$" vec3("$", "$", "$") \n", coeffs,
           SH_FLOAT(rgb2xyz.m[1][0]), // RGB->Y vector
           SH_FLOAT(rgb2xyz.m[1][1]),
           SH_FLOAT(rgb2xyz.m[1][2]));
     return coeffs;
 }
 
-void pl_shader_linearize(pl_shader sh, const struct pl_color_space *csp)
+static void linearize(pl_shader sh, const struct pl_color_space *csp)
 {
-    if (!sh_require(sh, PL_SHADER_SIG_COLOR, 0, 0))
-        return;
-
-    if (csp->transfer == PL_COLOR_TRC_LINEAR)
-        return;
-
     // Note that this clamp may technically violate the definition of
     // ITU-R BT.2100, which allows for sub-blacks and super-whites to be
     // displayed on the display where such would be possible. That said, the
@@ -640,7 +846,7 @@ void pl_shader_linearize(pl_shader sh, const struct pl_color_space *csp)
         const float lw = powf(csp_max, 1/2.4f);
         const float a = powf(lw - lb, 2.4f);
         const float b = lb / (lw - lb);
-        GLSL("color.rgb = %s * pow(color.rgb + vec3(%s), vec3(2.4)); \n",
+        GLSL("color.rgb = "$" * pow(color.rgb + vec3("$"), vec3(2.4)); \n",
              SH_FLOAT(a), SH_FLOAT(b));
         return;
     }
@@ -670,6 +876,24 @@ void pl_shader_linearize(pl_shader sh, const struct pl_color_space *csp)
              sh_bvec(sh, 3));
         goto scale_out;
     case PL_COLOR_TRC_PQ:
+        if (SH_PARAMS(sh).fast_transfer) {
+            // Evaluated piecewise in the log domain, where the curve is smooth
+            GLSL("{                                                       \n"
+                 "vec3 pq_l = log2(max(color.rgb, vec3(1e-6)));           \n"
+                 "vec3 pq_t = clamp(pq_l * vec3(1.0/7.0) + vec3(9.0/7.0), \n"
+                 "                  -1.0, 1.0);                           \n"
+                 "vec3 pq_lo;                                             \n");
+            sh_poly(sh, "pq_lo", "pq_t", PQ_FAST_LO, PL_ARRAY_SIZE(PQ_FAST_LO));
+            GLSL("pq_t = clamp(pq_l + vec3(1.0), -1.0, 1.0); \n"
+                 "vec3 pq_hi;                                \n");
+            sh_poly(sh, "pq_hi", "pq_t", PQ_FAST_HI, PL_ARRAY_SIZE(PQ_FAST_HI));
+            GLSL("color.rgb = vec3(%f) * exp2(mix(pq_hi, pq_lo,          \n"
+                 "             %s(lessThan(pq_l, vec3(-2.0)))));         \n"
+                 "}                                                      \n",
+                 10000.0 / PL_COLOR_SDR_WHITE, sh_bvec(sh, 3));
+            return;
+        }
+
         GLSL("color.rgb = pow(color.rgb, vec3(1.0/%f));         \n"
              "color.rgb = max(color.rgb - vec3(%f), 0.0)        \n"
              "             / (vec3(%f) - vec3(%f) * color.rgb); \n"
@@ -683,16 +907,29 @@ void pl_shader_linearize(pl_shader sh, const struct pl_color_space *csp)
         const float y = fmaxf(1.2f + 0.42f * log10f(csp_max / HLG_REF), 1);
         const float b = sqrtf(3 * powf(csp_min / csp_max, 1 / y));
         // OETF^-1
-        GLSL("color.rgb = %s * color.rgb + vec3(%s);                     \n"
-             "color.rgb = mix(vec3(4.0) * color.rgb * color.rgb,         \n"
-             "                exp((color.rgb - vec3(%f)) * vec3(1.0/%f)) \n"
-             "                    + vec3(%f),                            \n"
-             "                %s(lessThan(vec3(0.5), color.rgb)));       \n",
-             SH_FLOAT(1 - b), SH_FLOAT(b),
-             HLG_C, HLG_A, HLG_B, sh_bvec(sh, 3));
+        if (SH_PARAMS(sh).fast_transfer) {
+            GLSL("color.rgb = "$" * color.rgb + vec3("$"); \n"
+                 "{                                      \n"
+                 "vec3 hlg_t = vec3(4.0) * color.rgb - vec3(3.0); \n"
+                 "vec3 hlg_hi;                                    \n",
+                 SH_FLOAT(1 - b), SH_FLOAT(b));
+            sh_poly(sh, "hlg_hi", "hlg_t", HLG_FAST_INV, PL_ARRAY_SIZE(HLG_FAST_INV));
+            GLSL("color.rgb = mix(vec3(4.0) * color.rgb * color.rgb, hlg_hi, \n"
+                 "                %s(lessThan(vec3(0.5), color.rgb)));       \n"
+                 "}                                                          \n",
+                 sh_bvec(sh, 3));
+        } else {
+            GLSL("color.rgb = "$" * color.rgb + vec3("$");                   \n"
+                 "color.rgb = mix(vec3(4.0) * color.rgb * color.rgb,         \n"
+                 "                exp((color.rgb - vec3(%f)) * vec3(1.0/%f)) \n"
+                 "                    + vec3(%f),                            \n"
+                 "                %s(lessThan(vec3(0.5), color.rgb)));       \n",
+                 SH_FLOAT(1 - b), SH_FLOAT(b),
+                 HLG_C, HLG_A, HLG_B, sh_bvec(sh, 3));
+        }
         // OOTF
         GLSL("color.rgb *= 1.0 / 12.0;                                   \n"
-             "color.rgb *= %s * pow(max(dot(%s, color.rgb), 0.0), %s);   \n",
+             "color.rgb *= "$" * pow(max(dot("$", color.rgb), 0.0), "$"); \n",
              SH_FLOAT(csp_max),
              sh_luma_coeffs(sh, pl_raw_primaries_get(csp->primaries)),
              SH_FLOAT(y - 1));
@@ -727,19 +964,13 @@ void pl_shader_linearize(pl_shader sh, const struct pl_color_space *csp)
 
 scale_out:
     if (csp_max != 1 || csp_min != 0) {
-        GLSL("color.rgb = %s * color.rgb + vec3(%s); \n",
+        GLSL("color.rgb = "$" * color.rgb + vec3("$"); \n",
              SH_FLOAT(csp_max - csp_min), SH_FLOAT(csp_min));
     }
 }
 
-void pl_shader_delinearize(pl_shader sh, const struct pl_color_space *csp)
+static void delinearize(pl_shader sh, const struct pl_color_space *csp)
 {
-    if (!sh_require(sh, PL_SHADER_SIG_COLOR, 0, 0))
-        return;
-
-    if (csp->transfer == PL_COLOR_TRC_LINEAR)
-        return;
-
     GLSL("// pl_shader_delinearize \n");
     float csp_min = csp->hdr.min_luma / PL_COLOR_SDR_WHITE;
     float csp_max = csp->hdr.max_luma / PL_COLOR_SDR_WHITE;
@@ -757,7 +988,7 @@ void pl_shader_delinearize(pl_shader sh, const struct pl_color_space *csp)
     case PL_COLOR_TRC_GAMMA28:
     case PL_COLOR_TRC_PRO_PHOTO: ;
         if (csp_max != 1 || csp_min != 0) {
-            GLSL("color.rgb = %s * color.rgb + vec3(%s); \n",
+            GLSL("color.rgb = "$" * color.rgb + vec3("$"); \n",
                  SH_FLOAT(1 / (csp_max - csp_min)),
                  SH_FLOAT(-csp_min / (csp_max - csp_min)));
         }
@@ -788,7 +1019,7 @@ void pl_shader_delinearize(pl_shader sh, const struct pl_color_space *csp)
         const float lw = powf(csp_max, 1/2.4f);
         const float a = powf(lw - lb, 2.4f);
         const float b = lb / (lw - lb);
-        GLSL("color.rgb = pow(%s * color.rgb, vec3(1.0/2.4)) - vec3(%s); \n",
+        GLSL("color.rgb = pow("$" * color.rgb, vec3(1.0/2.4)) - vec3("$"); \n",
              SH_FLOAT(1.0 / a), SH_FLOAT(b));
         return;
     }
@@ -818,6 +1049,18 @@ void pl_shader_delinearize(pl_shader sh, const struct pl_color_space *csp)
              sh_bvec(sh, 3));
         return;
     case PL_COLOR_TRC_PQ:
+        if (SH_PARAMS(sh).fast_transfer) {
+            GLSL("{                                                     \n"
+                 "vec3 pq_t = log2(max(color.rgb * vec3(1.0/%f),        \n"
+                 "                     vec3(1e-15)));                   \n"
+                 "pq_t = clamp(pq_t * vec3(1.0/20.0) + vec3(1.0), -1.0, 1.0); \n",
+                 10000 / PL_COLOR_SDR_WHITE);
+            sh_poly(sh, "color.rgb", "pq_t", PQ_FAST_INV, PL_ARRAY_SIZE(PQ_FAST_INV));
+            GLSL("color.rgb = exp2(color.rgb); \n"
+                 "}                            \n");
+            return;
+        }
+
         GLSL("color.rgb *= vec3(1.0/%f);                         \n"
              "color.rgb = pow(color.rgb, vec3(%f));              \n"
              "color.rgb = (vec3(%f) + vec3(%f) * color.rgb)      \n"
@@ -829,8 +1072,8 @@ void pl_shader_delinearize(pl_shader sh, const struct pl_color_space *csp)
         const float y = fmaxf(1.2f + 0.42f * log10f(csp_max / HLG_REF), 1);
         const float b = sqrtf(3 * powf(csp_min / csp_max, 1 / y));
         // OOTF^-1
-        GLSL("color.rgb *= 1.0 / %s;                                      \n"
-             "color.rgb *= 12.0 * max(1e-6, pow(dot(%s, color.rgb), %s)); \n",
+        GLSL("color.rgb *= 1.0 / "$";                                     \n"
+             "color.rgb *= 12.0 * max(1e-6, pow(dot("$", color.rgb), "$")); \n",
              SH_FLOAT(csp_max),
              sh_luma_coeffs(sh, pl_raw_primaries_get(csp->primaries)),
              SH_FLOAT((1 - y) / y));
@@ -838,7 +1081,7 @@ void pl_shader_delinearize(pl_shader sh, const struct pl_color_space *csp)
         GLSL("color.rgb = mix(vec3(0.5) * sqrt(color.rgb),                     \n"
              "                vec3(%f) * log(color.rgb - vec3(%f)) + vec3(%f), \n"
              "                %s(lessThan(vec3(1.0), color.rgb)));             \n"
-             "color.rgb = %s * color.rgb + vec3(%s);                           \n",
+             "color.rgb = "$" * color.rgb + vec3("$");                         \n",
              HLG_A, HLG_B, HLG_C, sh_bvec(sh, 3),
              SH_FLOAT(1 / (1 - b)), SH_FLOAT(-b / (1 - b)));
         return;
@@ -870,6 +1113,34 @@ void pl_shader_delinearize(pl_shader sh, const struct pl_color_space *csp)
     pl_unreachable();
 }
 
+// Wraps `fn`, using reduced precision for SDR transfer functions only
+static void transfer_fn(pl_shader sh, const struct pl_color_space *csp,
+                        void (*fn)(pl_shader, const struct pl_color_space *))
+{
+    if (!sh_require(sh, PL_SHADER_SIG_COLOR, 0, 0))
+        return;
+
+    if (csp->transfer == PL_COLOR_TRC_LINEAR)
+        return;
+
+    ident_t half = NULL_IDENT;
+    if (!pl_color_transfer_is_hdr(csp->transfer))
+        half = sh_half_begin(sh);
+
+    fn(sh, csp);
+    sh_half_end(sh, half);
+}
+
+void pl_shader_linearize(pl_shader sh, const struct pl_color_space *csp)
+{
+    transfer_fn(sh, csp, linearize);
+}
+
+void pl_shader_delinearize(pl_shader sh, const struct pl_color_space *csp)
+{
+    transfer_fn(sh, csp, delinearize);
+}
+
 const struct pl_sigmoid_params pl_sigmoid_default_params = { PL_SIGMOID_DEFAULTS };
 
 void pl_shader_sigmoidize(pl_shader sh, const struct pl_sigmoid_params *params)
@@ -888,8 +1159,8 @@ void pl_shader_sigmoidize(pl_shader sh, const struct pl_sigmoid_params *params)
 
     GLSL("// pl_shader_sigmoidize                                          \n"
          "color = clamp(color, 0.0, 1.0);                                  \n"
-         "color = vec4(%s) - log(vec4(1.0) / (color * vec4(%s) + vec4(%s)) \n"
-         "                         - vec4(1.0)) * vec4(%s);                \n",
+         "color = vec4("$") - log(vec4(1.0) / (color * vec4("$") + vec4("$")) \n"
+         "                         - vec4(1.0)) * vec4("$");               \n",
          SH_FLOAT(center), SH_FLOAT(scale), SH_FLOAT(offset), SH_FLOAT(1.0 / slope));
 }
 
@@ -907,8 +1178,8 @@ void pl_shader_unsigmoidize(pl_shader sh, const struct pl_sigmoid_params *params
 
     GLSL("// pl_shader_unsigmoidize                                           \n"
          "color = clamp(color, 0.0, 1.0);                                     \n"
-         "color = vec4(%s) / (vec4(1.0) + exp(vec4(%s) * (vec4(%s) - color))) \n"
-         "           - vec4(%s);                                              \n",
+         "color = vec4("$") / (vec4(1.0) + exp(vec4("$") * (vec4("$") - color))) \n"
+         "           - vec4("$");                                             \n",
          SH_FLOAT(1.0 / scale), SH_FLOAT(slope), SH_FLOAT(center), SH_FLOAT(offset / scale));
 }
 
@@ -922,6 +1193,7 @@ struct sh_tone_map_obj {
     pl_buf peak_buf;
     struct pl_shader_desc desc;
     float margin;
+    bool histogram; // `peak_buf` contains `frame_hist`
 };
 
 static void sh_tone_map_uninit(pl_gpu gpu, void *ptr)
@@ -932,6 +1204,9 @@ static void sh_tone_map_uninit(pl_gpu gpu, void *ptr)
     memset(obj, 0, sizeof(*obj));
 }
 
+// Number of bins for the histogram used for percentile peak detection
+#define PEAK_HIST_BINS 256
+
 static inline float iir_coeff(float rate)
 {
     float a = 1.0 - cos(1.0 / rate);
@@ -946,7 +1221,12 @@ bool pl_shader_detect_peak(pl_shader sh, struct pl_color_space csp,
     if (!sh_require(sh, PL_SHADER_SIG_COLOR, 0, 0))
         return false;
 
-    if (!sh_try_compute(sh, 8, 8, true, 2 * sizeof(int32_t))) {
+    const bool histogram = params->percentile > 0 && params->percentile < 100;
+    size_t shmem_req = 2 * sizeof(int32_t);
+    if (histogram)
+        shmem_req += PEAK_HIST_BINS * sizeof(uint32_t);
+
+    if (!sh_try_compute(sh, 8, 8, true, shmem_req)) {
         PL_ERR(sh, "HDR peak detection requires compute shaders!");
         return false;
     }
@@ -966,6 +1246,10 @@ bool pl_shader_detect_peak(pl_shader sh, struct pl_color_space csp,
     pl_gpu gpu = SH_GPU(sh);
     obj->margin = params->overshoot_margin;
 
+    // The buffer layout depends on whether the histogram is enabled
+    if (obj->peak_buf && obj->histogram != histogram)
+        pl_buf_destroy(gpu, &obj->peak_buf);
+
     if (!obj->peak_buf) {
         obj->desc = (struct pl_shader_desc) {
             .desc = {
@@ -981,6 +1265,11 @@ bool pl_shader_detect_peak(pl_shader sh, struct pl_color_space csp,
         ok &= sh_buf_desc_append(obj, gpu, &obj->desc, NULL, pl_var_int("frame_sum"));
         ok &= sh_buf_desc_append(obj, gpu, &obj->desc, NULL, pl_var_int("frame_max"));
         ok &= sh_buf_desc_append(obj, gpu, &obj->desc, NULL, pl_var_uint("counter"));
+        if (histogram) {
+            struct pl_var hist = pl_var_uint("frame_hist");
+            hist.dim_a = PEAK_HIST_BINS;
+            ok &= sh_buf_desc_append(obj, gpu, &obj->desc, NULL, hist);
+        }
 
         if (!ok) {
             PL_ERR(sh, "HDR peak detection exhausts device limits!");
@@ -989,8 +1278,7 @@ bool pl_shader_detect_peak(pl_shader sh, struct pl_color_space csp,
 
         // Create the SSBO
         size_t size = sh_buf_desc_size(&obj->desc);
-        static const uint8_t zero[32] = {0};
-        pl_assert(sizeof(zero) >= size);
+        void *zero = pl_zalloc(NULL, size);
         struct pl_buf_params buf_params = {
             .size = size,
             .host_readable = true,
@@ -1011,7 +1299,9 @@ bool pl_shader_detect_peak(pl_shader sh, struct pl_color_space csp,
             obj->peak_buf = pl_buf_create(gpu, &buf_params);
         }
 
+        pl_free(zero);
         obj->desc.binding.object = obj->peak_buf;
+        obj->histogram = histogram;
     }
 
     if (!obj->peak_buf) {
@@ -1036,11 +1326,23 @@ bool pl_shader_detect_peak(pl_shader sh, struct pl_color_space csp,
     // For performance, we want to do as few atomic operations on global
     // memory as possible, so use an atomic in shmem for the work group.
     ident_t wg_sum = sh_fresh(sh, "wg_sum"), wg_max = sh_fresh(sh, "wg_max");
-    GLSLH("shared int %s;   \n", wg_sum);
-    GLSLH("shared int %s;   \n", wg_max);
-    GLSL("%s = 0; %s = 0;   \n"
-         "barrier();        \n",
-         wg_sum, wg_max);
+    GLSLH("shared int "$";  \n", wg_sum);
+    GLSLH("shared int "$";  \n", wg_max);
+    GLSL($" = 0; "$" = 0;   \n", wg_sum, wg_max);
+
+    // Histogram of the per-pixel brightness, privatized per work group in
+    // shmem and merged into `frame_hist` at the end
+    ident_t wg_hist = NULL_IDENT;
+    if (histogram) {
+        wg_hist = sh_fresh(sh, "wg_hist");
+        GLSLH("shared uint "$"[%d]; \n", wg_hist, PEAK_HIST_BINS);
+        GLSL("for (uint i = gl_LocalInvocationIndex; i < %du;              \n"
+             "     i += gl_WorkGroupSize.x * gl_WorkGroupSize.y)            \n"
+             "    "$"[i] = 0u;                                              \n",
+             PEAK_HIST_BINS, wg_hist);
+    }
+
+    GLSL("barrier(); \n");
 
     // Chosen to avoid overflowing on an 8K buffer
     const float log_min = 1e-3, log_scale = 400.0, sig_scale = 10000.0;
@@ -1051,19 +1353,29 @@ bool pl_shader_detect_peak(pl_shader sh, struct pl_color_space csp,
          "int isig_log = int(sig_log * %f);                     \n",
          log_min, sig_scale, log_scale);
 
+    if (histogram) {
+        // Bin by the PQ-encoded brightness, for perceptually uniform bins
+        GLSL("float sig_pq = clamp(sig_max * %f, 0.0, 1.0);                 \n"
+             "sig_pq = pow(sig_pq, %f);                                     \n"
+             "sig_pq = pow((%f + %f * sig_pq) / (1.0 + %f * sig_pq), %f);   \n"
+             "atomicAdd("$"[min(uint(sig_pq * %d.0), %du)], 1u);            \n",
+             PL_COLOR_SDR_WHITE / 10000, PQ_M1, PQ_C1, PQ_C2, PQ_C3, PQ_M2,
+             wg_hist, PEAK_HIST_BINS, PEAK_HIST_BINS - 1);
+    }
+
     // Update the work group's shared atomics
     if (sh_glsl(sh).subgroup_size) {
         GLSL("int group_max = subgroupMax(isig_max);    \n"
              "int group_sum = subgroupAdd(isig_log);    \n"
              "if (subgroupElect()) {                    \n"
-             "    atomicMax(%s, group_max);             \n"
-             "    atomicAdd(%s, group_sum);             \n"
+             "    atomicMax("$", group_max);            \n"
+             "    atomicAdd("$", group_sum);            \n"
              "}                                         \n"
              "barrier();                                \n",
              wg_max, wg_sum);
     } else {
-        GLSL("atomicMax(%s, isig_max);  \n"
-             "atomicAdd(%s, isig_log);  \n"
+        GLSL("atomicMax("$", isig_max); \n"
+             "atomicAdd("$", isig_log); \n"
              "barrier();                \n",
              wg_max, wg_sum);
     }
@@ -1076,42 +1388,90 @@ bool pl_shader_detect_peak(pl_shader sh, struct pl_color_space csp,
     // state object will be used by the same pass.
     GLSLF("// pl_shader_detect_peak                                             \n"
           "if (gl_LocalInvocationIndex == 0u) {                                 \n"
-          "    int wg_avg = %s / int(gl_WorkGroupSize.x * gl_WorkGroupSize.y);  \n"
+          "    int wg_avg = "$" / int(gl_WorkGroupSize.x * gl_WorkGroupSize.y); \n"
           "    atomicAdd(frame_sum, wg_avg);                                    \n"
-          "    atomicMax(frame_max, %s);                                        \n"
+          "    atomicMax(frame_max, "$");                                       \n"
           "    memoryBarrierBuffer();                                           \n"
           "}                                                                    \n"
           "barrier();                                                           \n",
           wg_sum, wg_max);
 
+    if (histogram) {
+        GLSLF("for (uint i = gl_LocalInvocationIndex; i < %du;                  \n"
+              "     i += gl_WorkGroupSize.x * gl_WorkGroupSize.y)                \n"
+              "{                                                                 \n"
+              "    if ("$"[i] != 0u)                                             \n"
+              "        atomicAdd(frame_hist[i], "$"[i]);                         \n"
+              "}                                                                 \n"
+              "memoryBarrierBuffer();                                            \n"
+              "barrier();                                                        \n",
+              PEAK_HIST_BINS, wg_hist, wg_hist);
+    }
+
     // Finally, to update the global state per dispatch, we increment a counter
     GLSLF("if (gl_LocalInvocationIndex == 0u) {                                 \n"
           "    uint num_wg = gl_NumWorkGroups.x * gl_NumWorkGroups.y;           \n"
           "    if (atomicAdd(counter, 1u) == num_wg - 1u) {                     \n"
           "        vec2 cur = vec2(float(frame_sum) / float(num_wg), frame_max);\n"
           "        cur *= vec2(1.0 / %f, 1.0 / %f);                             \n"
-          "        cur.x = exp(cur.x);                                          \n"
-          "        cur.y = max(cur.y, %s);                                      \n",
-          log_scale, sig_scale, SH_FLOAT(PL_DEF(params->minimum_peak, 1.0)));
+          "        cur.x = exp(cur.x);                                          \n",
+          log_scale, sig_scale);
+
+    if (histogram) {
+        // Find the bin containing the requested percentile, and use its upper
+        // edge (PQ decoded) as the peak, but never more than the actual max
+        GLSLF("        uint total = 0u;                                     \n"
+              "        for (int i = 0; i < %d; i++)                         \n"
+              "            total += frame_hist[i];                          \n"
+              "        uint target = uint(float(total) * "$");              \n"
+              "        uint acc = 0u;                                       \n"
+              "        int bin = 0;                                         \n"
+              "        for (; bin < %d; bin++) {                            \n"
+              "            acc += frame_hist[bin];                          \n"
+              "            if (acc >= target)                               \n"
+              "                break;                                       \n"
+              "        }                                                    \n"
+              "        float pct = float(bin + 1) * 1.0 / %d.0;             \n"
+              "        pct = pow(pct, 1.0 / %f);                            \n"
+              "        pct = max(pct - %f, 0.0) / (%f - %f * pct);          \n"
+              "        pct = pow(pct, 1.0 / %f) * %f;                       \n"
+              "        cur.y = min(cur.y, pct);                             \n",
+              PEAK_HIST_BINS, SH_FLOAT(params->percentile / 100.0),
+              PEAK_HIST_BINS - 1, PEAK_HIST_BINS,
+              PQ_M2, PQ_C1, PQ_C2, PQ_C3, PQ_M1, 10000 / PL_COLOR_SDR_WHITE);
+    }
+
+    GLSLF("        cur.y = max(cur.y, "$"); \n",
+          SH_FLOAT(PL_DEF(params->minimum_peak, 1.0)));
 
     // Set the initial value accordingly if it contains no data
     GLSLF("        if (average.y == 0.0) \n"
           "            average = cur;    \n");
 
     // Use an IIR low-pass filter to smooth out the detected values
-    GLSLF("        average += %s * (cur - average); \n",
+    GLSLF("        average += "$" * (cur - average); \n",
           SH_FLOAT(iir_coeff(PL_DEF(params->smoothing_period, 100.0))));
 
     // Scene change hysteresis
     float log_db = 10.0 / log(10.0);
     if (params->scene_threshold_low > 0 && params->scene_threshold_high > 0) {
-        GLSLF("    float delta = abs(log(cur.x / average.x));               \n"
-              "    average = mix(average, cur, smoothstep(%s, %s, delta));  \n",
+        GLSLF("    float delta = abs(log(cur.x / average.x));               \n");
+        if (histogram) {
+            // The percentile peak is stable enough to detect scene changes
+            GLSLF("    delta = max(delta, abs(log(cur.y / average.y))); \n");
+        }
+        GLSLF("    average = mix(average, cur, smoothstep("$", "$", delta)); \n",
               SH_FLOAT(params->scene_threshold_low / log_db),
               SH_FLOAT(params->scene_threshold_high / log_db));
     }
 
     // Reset SSBO state for the next frame
+    if (histogram) {
+        GLSLF("        for (int i = 0; i < %d; i++) \n"
+              "            frame_hist[i] = 0u;      \n",
+              PEAK_HIST_BINS);
+    }
+
     GLSLF("        frame_sum = 0;            \n"
           "        frame_max = 0;            \n"
           "        counter = 0u;             \n"
@@ -1151,6 +1511,7 @@ bool pl_get_detected_peak(const pl_shader_obj state,
         pl_buf tmp = pl_buf_create(gpu, pl_buf_params(
             .size = sizeof(average),
             .host_readable = true,
+            .debug_tag = PL_DEBUG_TAG,
         ));
 
         if (!tmp) {
@@ -1229,6 +1590,274 @@ static void fill_lut(void *data, const struct sh_lut_params *params)
     }
 }
 
+static uint64_t tone_map_params_hash(const struct pl_tone_map_params *p)
+{
+    const float fvals[] = {
+        p->param, p->input_min, p->input_max, p->output_min, p->output_max,
+    };
+    // The function is identified by its offset relative to a built-in
+    // function, to keep the hash stable across runs (see `pl_cache`)
+    const uint64_t ivals[] = {
+        (uintptr_t) p->function - (uintptr_t) &pl_tone_map_clip,
+        p->input_scaling, p->output_scaling, p->lut_size,
+    };
+
+    uint64_t hash = pl_mem_hash(fvals, sizeof(fvals));
+    pl_hash_merge(&hash, pl_mem_hash(ivals, sizeof(ivals)));
+    return hash;
+}
+
+// Emits GLSL converting the variable `var` between PL_HDR_NORM and `scaling`
+static void glsl_from_norm(pl_shader sh, enum pl_hdr_scaling scaling,
+                           const char *var)
+{
+    switch (scaling) {
+    case PL_HDR_NORM:
+        return;
+    case PL_HDR_SQRT:
+        GLSLH("%s = sqrt(%s); \n", var, var);
+        return;
+    case PL_HDR_NITS:
+        GLSLH("%s *= %f; \n", var, PL_COLOR_SDR_WHITE);
+        return;
+    case PL_HDR_PQ:
+        GLSLH("%s = pow(%s * %f, %f);                    \n"
+              "%s = pow((%f + %f * %s) / (1.0 + %f * %s), %f); \n",
+              var, var, PL_COLOR_SDR_WHITE / 10000, PQ_M1,
+              var, PQ_C1, PQ_C2, var, PQ_C3, var, PQ_M2);
+        return;
+    case PL_HDR_SCALING_COUNT:
+        break;
+    }
+
+    pl_unreachable();
+}
+
+static void glsl_to_norm(pl_shader sh, enum pl_hdr_scaling scaling,
+                         const char *var)
+{
+    switch (scaling) {
+    case PL_HDR_NORM:
+        return;
+    case PL_HDR_SQRT:
+        GLSLH("%s *= %s; \n", var, var);
+        return;
+    case PL_HDR_NITS:
+        GLSLH("%s *= %f; \n", var, 1.0f / PL_COLOR_SDR_WHITE);
+        return;
+    case PL_HDR_PQ:
+        GLSLH("%s = pow(%s, %f);                             \n"
+              "%s = max(%s - %f, 0.0) / (%f - %f * %s);      \n"
+              "%s = pow(%s, %f) * %f;                        \n",
+              var, var, 1.0f / PQ_M2,
+              var, var, PQ_C1, PQ_C2, PQ_C3, var,
+              var, var, 1.0f / PQ_M1, 10000 / PL_COLOR_SDR_WHITE);
+        return;
+    case PL_HDR_SCALING_COUNT:
+        break;
+    }
+
+    pl_unreachable();
+}
+
+static bool glsl_tone_map_supported(const struct pl_tone_map_function *fun)
+{
+    return fun == &pl_tone_map_auto    || fun == &pl_tone_map_bt2390  ||
+           fun == &pl_tone_map_bt2446a || fun == &pl_tone_map_spline  ||
+           fun == &pl_tone_map_reinhard || fun == &pl_tone_map_mobius ||
+           fun == &pl_tone_map_hable   || fun == &pl_tone_map_gamma   ||
+           fun == &pl_tone_map_linear;
+}
+
+// Emits the GLSL body of a forward tone mapping curve, mapping `x` in place.
+// All values are in the function's preferred scaling, with only `in_max`
+// varying per frame. Mirrors the CPU implementations in tone_mapping.c
+static void glsl_tone_map_curve(pl_shader sh, const struct pl_tone_map_function *fun,
+                                float param, float in_min, float out_min,
+                                float out_max)
+{
+    const float out_range = out_max - out_min;
+
+    if (fun == &pl_tone_map_bt2390) {
+        GLSLH("float in_range = in_max - %f;                            \n"
+              "float minLum = %f / in_range;                            \n"
+              "float maxLum = %f / in_range;                            \n"
+              "float ks = %f * maxLum - %f;                             \n"
+              "float bp = minLum > 0.0 ? min(1.0 / minLum, 4.0) : 4.0;  \n"
+              "float gain_inv = 1.0 + minLum / maxLum                   \n"
+              "                 * pow(max(1.0 - maxLum, 0.0), bp);      \n"
+              "float gain = maxLum < 1.0 ? 1.0 / gain_inv : 1.0;        \n"
+              "x = (x - %f) / in_range;                                 \n"
+              "if (ks < 1.0) {                                          \n"
+              "    float tb = (x - ks) / (1.0 - ks);                    \n"
+              "    float tb2 = tb * tb;                                 \n"
+              "    float tb3 = tb2 * tb;                                \n"
+              "    float pb = (2.0 * tb3 - 3.0 * tb2 + 1.0) * ks        \n"
+              "             + (tb3 - 2.0 * tb2 + tb) * (1.0 - ks)       \n"
+              "             + (-2.0 * tb3 + 3.0 * tb2) * maxLum;        \n"
+              "    x = x < ks ? x : pb;                                 \n"
+              "}                                                        \n"
+              "if (x < 1.0) {                                           \n"
+              "    x += minLum * pow(1.0 - x, bp);                      \n"
+              "    x = gain * (x - minLum) + minLum;                    \n"
+              "}                                                        \n"
+              "x = x * in_range + %f;                                   \n",
+              in_min, out_min - in_min, out_max - in_min,
+              1 + param, param, in_min, in_min);
+        return;
+    }
+
+    if (fun == &pl_tone_map_bt2446a) {
+        const float psdr = 1 + 32 * powf(out_max / 10000, 1/2.4f);
+        const float lb = powf(out_min, 1/2.4f), lw = powf(out_max, 1/2.4f);
+        GLSLH("float phdr = 1.0 + 32.0 * pow(in_max / 10000.0, 1.0/2.4); \n"
+              "x = pow((x - %f) / (in_max - %f), 1.0/2.4);              \n"
+              "x = log(1.0 + (phdr - 1.0) * x) / log(phdr);             \n"
+              "if (x <= 0.7399) {                                       \n"
+              "    x = 1.0770 * x;                                      \n"
+              "} else if (x < 0.9909) {                                 \n"
+              "    x = (-1.1510 * x + 2.7811) * x - 0.6302;             \n"
+              "} else {                                                 \n"
+              "    x = 0.5 * x + 0.5;                                   \n"
+              "}                                                        \n"
+              "x = (pow(%f, x) - 1.0) / %f;                             \n"
+              "x = pow(%f * x + %f, 2.4);                               \n",
+              in_min, in_min, psdr, psdr - 1, lw - lb, lb);
+        return;
+    }
+
+    if (fun == &pl_tone_map_spline) {
+        const float pivot = param;
+        const float in_min_p = in_min - pivot;
+        const float Pa = (out_min - in_min) / (in_min_p * in_min_p);
+        GLSLH("float in_max_p = in_max - %f;                            \n"
+              "float t = 2.0 * in_max_p * in_max_p;                     \n"
+              "float Qa = (in_max - %f) / (in_max_p * t);               \n"
+              "float Qb = -3.0 * (in_max - %f) / t;                     \n"
+              "x -= %f;                                                 \n"
+              "x = x > 0.0 ? ((Qa * x + Qb) * x + 1.0) * x              \n"
+              "            : (%f * x + 1.0) * x;                        \n"
+              "x += %f;                                                 \n",
+              pivot, out_max, out_max, pivot, Pa, pivot);
+        return;
+    }
+
+    if (fun == &pl_tone_map_reinhard) {
+        const float offset = (1.0f - param) / param;
+        GLSLH("float peak = (in_max - %f) / %f;                         \n"
+              "x = (x - %f) / %f;                                       \n"
+              "x = x / (x + %f) * (peak + %f) / peak;                   \n"
+              "x = x * %f + %f;                                         \n",
+              in_min, out_range, in_min, out_range, offset, offset,
+              out_range, out_min);
+        return;
+    }
+
+    if (fun == &pl_tone_map_mobius) {
+        const float j = param;
+        GLSLH("float peak = (in_max - %f) / %f;                         \n"
+              "float a = %f * (peak - 1.0) / (%f + peak);               \n"
+              "float b = (%f - %f * peak + peak) / max(1e-6, peak - 1.0); \n"
+              "float scale = (b*b + %f * b + %f) / (b - a);             \n"
+              "x = (x - %f) / %f;                                       \n"
+              "x = x <= %f ? x : scale * (x + a) / (x + b);             \n"
+              "x = x * %f + %f;                                         \n",
+              in_min, out_range, -j*j, j*j - 2*j, j*j, 2*j, 2*j, j*j,
+              in_min, out_range, j, out_range, out_min);
+        return;
+    }
+
+    if (fun == &pl_tone_map_hable) {
+        const float A = 0.15f, B = 0.50f, C = 0.10f, D = 0.20f, E = 0.02f, F = 0.30f;
+        const float in_lb = powf(in_min, 1/2.4f);
+        const float lb = powf(out_min, 1/2.4f), lw = powf(out_max, 1/2.4f);
+        GLSLH("float peak = in_max / %f;                                \n"
+              "x = (pow(x, 1.0/2.4) - %f) / (pow(in_max, 1.0/2.4) - %f); \n"
+              "x = pow(x * pow(peak, 1.0/2.4), 2.4);                    \n"
+              "vec2 h = vec2(x, peak);                                  \n"
+              "h = (h * (%f*h + %f) + %f) / (h * (%f*h + %f) + %f) - %f; \n"
+              "x = pow(max(h.x / h.y, 0.0), 1.0/2.4);                   \n"
+              "x = pow(%f * x + %f, 2.4);                               \n",
+              out_max, in_lb, in_lb, A, C*B, D*E, A, B, D*F, E/F,
+              lw - lb, lb);
+        return;
+    }
+
+    if (fun == &pl_tone_map_gamma) {
+        const float cutoff = param;
+        GLSLH("float peak = (in_max - %f) / %f;                         \n"
+              "float gamma = %f / log(%f / peak);                       \n"
+              "x = (x - %f) / %f;                                       \n"
+              "x = x > %f ? pow(x / peak, gamma) : x;                   \n"
+              "x = x * %f + %f;                                         \n",
+              in_min, out_range, logf(cutoff), cutoff, in_min, out_range,
+              cutoff, out_range, out_min);
+        return;
+    }
+
+    if (fun == &pl_tone_map_linear) {
+        GLSLH("x = (x - %f) / (in_max - %f) * %f;                       \n"
+              "x = x * %f + %f;                                         \n",
+              in_min, in_min, param, out_range, out_min);
+        return;
+    }
+
+    pl_unreachable();
+}
+
+// Generates a GLSL function `float f(float x, float peak)` evaluating the
+// forward tone mapping curve described by `params` for a given input peak,
+// with `x` and `peak` in PL_HDR_NORM. This allows adapting the curve to the
+// detected peak directly on the GPU, without the need for a 2D LUT. Returns
+// Requires `glsl_tone_map_supported(fun)`.
+static ident_t glsl_tone_map(pl_shader sh, const struct pl_tone_map_function *fun,
+                             float param, float src_min, float dst_min,
+                             float dst_max)
+{
+    if (fun == &pl_tone_map_auto) {
+        // Mirrors the forward branches of the selection in `fix_params`
+        ident_t spline = glsl_tone_map(sh, &pl_tone_map_spline, 0,
+                                       src_min, dst_min, dst_max);
+        ident_t bt2446a = glsl_tone_map(sh, &pl_tone_map_bt2446a, 0,
+                                        src_min, dst_min, dst_max);
+        ident_t bt2390 = glsl_tone_map(sh, &pl_tone_map_bt2390, 0,
+                                       src_min, dst_min, dst_max);
+        ident_t fn = sh_fresh(sh, "tone_map_auto");
+        GLSLH("float "$"(float x, float peak) {  \n"
+              "    float ratio = peak / %f;      \n"
+              "    if (ratio > 10.0)             \n"
+              "        return "$"(x, peak);      \n"
+              "    else if (ratio > 2.0)         \n"
+              "        return "$"(x, peak);      \n"
+              "    else                          \n"
+              "        return "$"(x, peak);      \n"
+              "}                                 \n",
+              fn, dst_max, spline, bt2446a, bt2390);
+        return fn;
+    }
+
+    param = PL_DEF(param, fun->param_def);
+    param = PL_CLAMP(param, fun->param_min, fun->param_max);
+
+    const enum pl_hdr_scaling scaling = fun->scaling;
+    const float in_min = pl_hdr_rescale(PL_HDR_NORM, scaling, src_min),
+                out_min = pl_hdr_rescale(PL_HDR_NORM, scaling, dst_min),
+                out_max = pl_hdr_rescale(PL_HDR_NORM, scaling, dst_max);
+
+    ident_t fn = sh_fresh(sh, "tone_map_curve");
+    GLSLH("float "$"(float x, float in_max) {   \n"
+          "x = clamp(x, %f, in_max);            \n",
+          fn, src_min);
+    glsl_from_norm(sh, scaling, "x");
+    glsl_from_norm(sh, scaling, "in_max");
+    glsl_tone_map_curve(sh, fun, param, in_min, out_min, out_max);
+    GLSLH("x = clamp(x, %f, %f); \n", out_min, out_max);
+    glsl_to_norm(sh, scaling, "x");
+    GLSLH("return x; \n"
+          "}         \n");
+    return fn;
+}
+
 static void tone_map(pl_shader sh,
                      const struct pl_color_space *src,
                      const struct pl_color_space *dst,
@@ -1301,7 +1930,7 @@ static void tone_map(pl_shader sh,
     sh_describe(sh, "tone mapping");
     const struct pl_tone_map_function *fun = lut_params.function;
     struct sh_tone_map_obj *obj = NULL;
-    ident_t lut = NULL;
+    ident_t lut = NULL_IDENT, curve = NULL_IDENT;
 
     bool can_fixed = !params->force_tone_mapping_lut;
     bool is_noop = can_fixed && (!fun || fun == &pl_tone_map_clip);
@@ -1317,42 +1946,52 @@ static void tone_map(pl_shader sh,
         // Only use dynamic peak detection for range reductions
         dynamic_peak = obj->peak_buf && src_max > dst_max;
 
-        lut = sh_lut(sh, sh_lut_params(
-            .object = &obj->lut,
-            .method = SH_LUT_AUTO,
-            .type = PL_VAR_FLOAT,
-            .width = lut_params.lut_size,
-            .height = dynamic_peak ? lut_params.lut_size : 0,
-            .comps = 1,
-            .linear = true,
-            .update = !pl_tone_map_params_equal(&lut_params, &obj->params),
-            .fill = fill_lut,
-            .priv = &lut_params,
-        ));
-        obj->params = lut_params;
+        if (dynamic_peak && can_fixed && glsl_tone_map_supported(fun)) {
+            // Evaluate the curve for the detected peak directly, rather than
+            // precomputing a 2D LUT of curves for every possible peak
+            curve = glsl_tone_map(sh, fun, lut_params.param, src_min,
+                                  dst_min, dst_max);
+        } else {
+            lut = sh_lut(sh, sh_lut_params(
+                .object = &obj->lut,
+                .method = SH_LUT_AUTO,
+                .type = PL_VAR_FLOAT,
+                .width = lut_params.lut_size,
+                .height = dynamic_peak ? lut_params.lut_size : 0,
+                .comps = 1,
+                .linear = true,
+                .update = !pl_tone_map_params_equal(&lut_params, &obj->params),
+                .signature = tone_map_params_hash(&lut_params),
+                .shared = true,
+                .fill = fill_lut,
+                .priv = &lut_params,
+                .priv_size = sizeof(lut_params),
+            ));
+            obj->params = lut_params;
+        }
     }
 
     // Hard-clamp the input values to the claimed input peak. Do this
     // per-channel to fix issues with excessively oversaturated highlights in
     // broken files that contain values outside their stated brightness range.
-    GLSL("color.rgb = clamp(color.rgb, %s, %s); \n",
+    GLSL("color.rgb = clamp(color.rgb, "$", "$"); \n",
          SH_FLOAT(src_min), SH_FLOAT(src_max));
 
     if (is_noop) {
 
-        GLSL("#define tone_map(x) clamp((x), %s, %s) \n",
+        GLSL("#define tone_map(x) clamp((x), "$", "$") \n",
              SH_FLOAT(dst_min), SH_FLOAT(dst_max));
 
     } else if (pure_bpc) {
 
         // Pure black point compensation
         const float scale = (dst_max - dst_min) / (src_max - src_min);
-        GLSL("#define tone_map(x) (%s * (x) + %s) \n",
+        GLSL("#define tone_map(x) ("$" * (x) + "$") \n",
              SH_FLOAT(scale), SH_FLOAT(dst_min - scale * src_min));
 
-    } else if (lut && dynamic_peak) {
+    } else if ((lut || curve) && dynamic_peak) {
 
-        // Dynamic 2D LUT
+        // Dynamic 2D LUT or GLSL curve
         obj->desc.desc.access = PL_DESC_ACCESS_READONLY;
         obj->desc.memory = 0;
         sh_desc(sh, obj->desc);
@@ -1360,31 +1999,35 @@ static void tone_map(pl_shader sh,
         float idx_min, idx_max;
         dynamic_lut_range(&idx_min, &idx_max, &lut_params);
 
-        GLSL("const float idx_min = %s;                                     \n"
-             "const float idx_max = %s;                                     \n"
+        GLSL("float idx_min = "$";                                          \n"
+             "float idx_max = "$";                                          \n"
              "float input_max = idx_max;                                    \n"
              "if (average.y != 0.0) {                                       \n"
              "    float sig_peak = average.y;                               \n",
              SH_FLOAT(idx_min), SH_FLOAT(idx_max));
         // Allow a tiny bit of extra overshoot for the smoothed peak
         if (obj->margin > 0)
-            GLSL("sig_peak *= %s; \n", SH_FLOAT(obj->margin + 1));
+            GLSL("sig_peak *= "$"; \n", SH_FLOAT(obj->margin + 1));
         GLSL("    input_max = clamp(sqrt(sig_peak), idx_min, idx_max);      \n"
              "}                                                             \n");
 
-        // Sample the 2D LUT from a position determined by the detected max
-        GLSL("const float input_min = %s;                                   \n"
-             "float scale = 1.0 / (input_max - input_min);                  \n"
-             "float curve = (input_max - idx_min) / (idx_max - idx_min);    \n"
-             "float base = -input_min * scale;                              \n"
-             "#define tone_map(x) (%s(vec2(scale * sqrt(x) + base, curve))) \n",
-             SH_FLOAT(lut_params.input_min), lut);
+        if (curve) {
+            GLSL("#define tone_map(x) ("$"((x), input_max * input_max)) \n", curve);
+        } else {
+            // Sample the 2D LUT from a position determined by the detected max
+            GLSL("float input_min = "$";                                        \n"
+                 "float scale = 1.0 / (input_max - input_min);                  \n"
+                 "float curve = (input_max - idx_min) / (idx_max - idx_min);    \n"
+                 "float base = -input_min * scale;                              \n"
+                 "#define tone_map(x) ("$"(vec2(scale * sqrt(x) + base, curve))) \n",
+                 SH_FLOAT(lut_params.input_min), lut);
+        }
 
     } else if (lut) {
 
         // Regular 1D LUT
         const float lut_range = lut_params.input_max - lut_params.input_min;
-        GLSL("#define tone_map(x) (%s(%s * sqrt(x) + %s))   \n",
+        GLSL("#define tone_map(x) ("$"("$" * sqrt(x) + "$")) \n",
              lut, SH_FLOAT(1.0f / lut_range),
              SH_FLOAT(-lut_params.input_min / lut_range));
 
@@ -1393,7 +2036,7 @@ static void tone_map(pl_shader sh,
         // Fall back to hard-coded hable function for lack of anything better
         float A = 0.15f, B = 0.50f, C = 0.10f, D = 0.20f, E = 0.02f, F = 0.30f;
         ident_t hable = sh_fresh(sh, "hable");
-        GLSLH("float %s(float x) {                      \n"
+        GLSLH("float "$"(float x) {                     \n"
               "    return (x * (%f*x + %f) + %f) /      \n"
               "           (x * (%f*x + %f) + %f) - %f;  \n"
               "}                                        \n",
@@ -1404,7 +2047,7 @@ static void tone_map(pl_shader sh,
         const float peak_out = ((peak * (A*peak + C*B) + D*E) /
                                 (peak * (A*peak + B) + D*F)) - E/F;
 
-        GLSL("#define tone_map(x) (%s * %s(%s * x + %s) + %s)    \n",
+        GLSL("#define tone_map(x) ("$" * "$"("$" * x + "$") + "$") \n",
              SH_FLOAT((dst_max - dst_min) / peak_out),
              hable, SH_FLOAT(scale),
              SH_FLOAT(-scale * src_min),
@@ -1425,8 +2068,8 @@ static void tone_map(pl_shader sh,
     }
 
     ident_t ct = SH_FLOAT(params->tone_mapping_crosstalk);
-    GLSL("const float ct_scale = 1.0 - 3.0 * %s;                \n"
-         "float ct = %s * (color.r + color.g + color.b);        \n"
+    GLSL("float ct_scale = 1.0 - 3.0 * "$";                     \n"
+         "float ct = "$" * (color.r + color.g + color.b);       \n"
          "color.rgb = ct_scale * color.rgb + vec3(ct);          \n",
          ct, ct);
 
@@ -1438,7 +2081,7 @@ static void tone_map(pl_shader sh,
 
     case PL_TONE_MAP_MAX:
         GLSL("float sig_max = max(max(color.r, color.g), color.b);  \n"
-             "color.rgb *= tone_map(sig_max) / max(sig_max, %s);    \n",
+             "color.rgb *= tone_map(sig_max) / max(sig_max, "$");   \n",
              SH_FLOAT(dst_min));
         break;
 
@@ -1455,7 +2098,7 @@ static void tone_map(pl_shader sh,
             rgb2xyz.m[2][i] -= rgb2xyz.m[1][i];
         }
 
-        GLSL("vec3 xyz = %s * color.rgb; \n", sh_var(sh, (struct pl_shader_var) {
+        GLSL("vec3 xyz = "$" * color.rgb; \n", sh_var(sh, (struct pl_shader_var) {
             .var = pl_var_mat3("rgb2xyz"),
             .data = PL_TRANSPOSE_3X3(rgb2xyz.m),
         }));
@@ -1463,9 +2106,9 @@ static void tone_map(pl_shader sh,
         // Tuned to meet the desired desaturation at 1000 -> SDR
         float desat = dst_max > src_max ? 1.075f : 1.1f;
         float exponent = logf(desat) / logf(1000 / PL_COLOR_SDR_WHITE);
-        GLSL("float orig = max(xyz.y, %s);                      \n"
+        GLSL("float orig = max(xyz.y, "$");                     \n"
              "xyz.y = tone_map(xyz.y);                          \n"
-             "xyz.xz *= pow(xyz.y / orig, %s) * xyz.y / orig;   \n",
+             "xyz.xz *= pow(xyz.y / orig, "$") * xyz.y / orig;  \n",
              SH_FLOAT(dst_min), SH_FLOAT(exponent));
 
         // Extra luminance correction when reducing dynamic range
@@ -1473,7 +2116,7 @@ static void tone_map(pl_shader sh,
             GLSL("xyz.y -= max(0.1 * xyz.x, 0.0); \n");
 
         pl_matrix3x3_invert(&rgb2xyz);
-        GLSL("vec3 color_lin = %s * xyz; \n", sh_var(sh, (struct pl_shader_var) {
+        GLSL("vec3 color_lin = "$" * xyz; \n", sh_var(sh, (struct pl_shader_var) {
             .var = pl_var_mat3("xyz2rgb"),
             .data = PL_TRANSPOSE_3X3(rgb2xyz.m),
         }));
@@ -1488,7 +2131,7 @@ static void tone_map(pl_shader sh,
             const float a = powf(dst_min, y);
             const float b = powf(dst_max, -y);
             GLSL("float coeff = pow(xyz.y, %f);                         \n"
-                 "coeff = max(%s / coeff, %s * coeff);                  \n"
+                 "coeff = max("$" / coeff, "$" * coeff);                \n"
                  "color.rgb = mix(color_lin, color.rgb, coeff);         \n",
                  y, SH_FLOAT(a), SH_FLOAT(b));
         } else {
@@ -1503,7 +2146,7 @@ static void tone_map(pl_shader sh,
     }
 
     // Inverse crosstalk
-    GLSL("ct = %s * (color.r + color.g + color.b);          \n"
+    GLSL("ct = "$" * (color.r + color.g + color.b);         \n"
          "color.rgb = (color.rgb - vec3(ct)) / ct_scale;    \n",
          ct);
 
@@ -1540,7 +2183,7 @@ static void adapt_colors(pl_shader sh,
     // Normalize colors to range [0-1]
     float lb = dst->hdr.min_luma / PL_COLOR_SDR_WHITE;
     float lw = dst->hdr.max_luma / PL_COLOR_SDR_WHITE;
-    GLSL("color.rgb = %s * color.rgb + %s; \n",
+    GLSL("color.rgb = "$" * color.rgb + "$"; \n",
          SH_FLOAT(1 / (lw - lb)), SH_FLOAT(-lb / (lw - lb)));
 
     // Convert the input colors to be represented relative to the target
@@ -1553,7 +2196,7 @@ static void adapt_colors(pl_shader sh,
 
     pl_matrix3x3_rmul(&ref2ref, &mat);
     if (!is_identity_mat(&mat)) {
-        GLSL("color.rgb = %s * color.rgb;\n", sh_var(sh, (struct pl_shader_var) {
+        GLSL("color.rgb = "$" * color.rgb;\n", sh_var(sh, (struct pl_shader_var) {
             .var = pl_var_mat3("src2ref"),
             .data = PL_TRANSPOSE_3X3(mat.m),
         }));
@@ -1582,13 +2225,13 @@ static void adapt_colors(pl_shader sh,
         float cmax = 1;
         for (int i = 0; i < 3; i++)
             cmax = PL_MAX(cmax, ref2ref.m[i][i]);
-        GLSL("color.rgb *= %s; \n", SH_FLOAT(1 / cmax));
+        GLSL("color.rgb *= "$"; \n", SH_FLOAT(1 / cmax));
         break;
     }
 
     case PL_GAMUT_DESATURATE:
         GLSL("float cmin = min(min(color.r, color.g), color.b); \n"
-             "float luma = clamp(dot(%s, color.rgb), 0.0, 1.0); \n"
+             "float luma = clamp(dot("$", color.rgb), 0.0, 1.0); \n"
              "if (cmin < 0.0 - 1e-6)                            \n"
              "    color.rgb = mix(color.rgb, vec3(luma),        \n"
              "                    -cmin / (luma - cmin));       \n"
@@ -1610,14 +2253,14 @@ static void adapt_colors(pl_shader sh,
                                       PL_INTENT_RELATIVE_COLORIMETRIC);
 
     if (!is_identity_mat(&mat)) {
-        GLSL("color.rgb = %s * color.rgb;\n", sh_var(sh, (struct pl_shader_var) {
+        GLSL("color.rgb = "$" * color.rgb;\n", sh_var(sh, (struct pl_shader_var) {
             .var = pl_var_mat3("ref2dst"),
             .data = PL_TRANSPOSE_3X3(mat.m),
         }));
     }
 
     // Undo normalization
-    GLSL("color.rgb = %s * color.rgb + %s; \n",
+    GLSL("color.rgb = "$" * color.rgb + "$"; \n",
          SH_FLOAT(lw - lb), SH_FLOAT(lb));
 }
 
@@ -1667,7 +2310,7 @@ void pl_shader_cone_distort(pl_shader sh, struct pl_color_space csp,
 
     struct pl_matrix3x3 cone_mat;
     cone_mat = pl_get_cone_matrix(params, pl_raw_primaries_get(csp.primaries));
-    GLSL("color.rgb = %s * color.rgb;\n", sh_var(sh, (struct pl_shader_var) {
+    GLSL("color.rgb = "$" * color.rgb;\n", sh_var(sh, (struct pl_shader_var) {
         .var = pl_var_mat3("cone_mat"),
         .data = PL_TRANSPOSE_3X3(cone_mat.m),
     }));
@@ -1754,7 +2397,7 @@ void pl_shader_dither(pl_shader sh, int new_depth,
 
     enum pl_dither_method method = params->method;
     bool can_fixed = sh_glsl(sh).version >= 130;
-    ident_t lut = NULL;
+    ident_t lut = NULL_IDENT;
     int lut_size = 0;
 
     if (method == PL_DITHER_ORDERED_FIXED && !can_fixed) {
@@ -1787,8 +2430,11 @@ void pl_shader_dither(pl_shader sh, int new_depth,
             .height = lut_size,
             .comps = 1,
             .update = changed,
+            .signature = method,
+            .shared = true,
             .fill = fill_dither_matrix,
             .priv = obj,
+            .priv_size = sizeof(*obj),
         ));
         if (!lut)
             goto fallback;
@@ -1811,7 +2457,7 @@ done: ;
 
     if (size) {
         // Transform the screen position to the cyclic range [0,1)
-        GLSL("vec2 pos = fract(gl_FragCoord.xy * 1.0/%s);\n", SH_FLOAT(size));
+        GLSL("vec2 pos = fract(gl_FragCoord.xy * 1.0/"$");\n", SH_FLOAT(size));
 
         if (params->temporal) {
             int phase = SH_PARAMS(sh).index % 8;
@@ -1827,14 +2473,14 @@ done: ;
                 .data = &mat[0][0],
                 .dynamic = true,
             });
-            GLSL("pos = fract(%s * pos + vec2(1.0));\n", rot);
+            GLSL("pos = fract("$" * pos + vec2(1.0));\n", rot);
         }
     }
 
     switch (method) {
     case PL_DITHER_WHITE_NOISE: {
         ident_t prng = sh_prng(sh, params->temporal, NULL);
-        GLSL("bias = %s.x;\n", prng);
+        GLSL("bias = "$".x;\n", prng);
         break;
     }
 
@@ -1858,7 +2504,7 @@ done: ;
     case PL_DITHER_BLUE_NOISE:
     case PL_DITHER_ORDERED_LUT:
         pl_assert(lut);
-        GLSL("bias = %s(ivec2(pos * %s));\n", lut, SH_FLOAT(lut_size));
+        GLSL("bias = "$"(ivec2(pos * "$"));\n", lut, SH_FLOAT(lut_size));
         break;
 
     case PL_DITHER_METHOD_COUNT:
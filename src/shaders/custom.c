@@ -15,6 +15,7 @@
  * License along with libplacebo. If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <limits.h>
 #include <math.h>
 #include "gpu.h"
 #include "shaders.h"
@@ -136,6 +137,21 @@ struct szexp {
         pl_str varname;
         enum szexp_op op;
     } val;
+    int slot; // for SZEXP_VAR_*, index into `hook_priv.slots`
+};
+
+// Texture sizes referenced by `szexp` variables. Named textures are resolved
+// to slots at parse time, so expressions evaluate over a flat array
+enum szexp_slot {
+    SLOT_HOOKED,
+    SLOT_NATIVE_CROPPED,
+    SLOT_OUTPUT,
+    SLOT_NAMED, // first slot of `hook_priv.slot_names`
+};
+
+struct slot_size {
+    float size[2];
+    bool valid;
 };
 
 struct custom_shader_hook {
@@ -214,10 +230,9 @@ static bool parse_rpn_szexpr(pl_str line, struct szexp out[MAX_SZEXP_SIZE])
     return true;
 }
 
-// Evaluate a `szexp`, given a lookup function for named textures
+// Evaluate a `szexp`, given the sizes of all texture slots
 // Returns whether successful. 'result' is left untouched on failure
-static bool pl_eval_szexpr(pl_log log, void *priv,
-                           bool (*lookup)(void *priv, pl_str var, float size[2]),
+static bool pl_eval_szexpr(pl_log log, const struct slot_size *slots,
                            const struct szexp expr[MAX_SZEXP_SIZE],
                            float *result)
 {
@@ -280,16 +295,14 @@ static bool pl_eval_szexpr(pl_log log, void *priv,
 
         case SZEXP_VAR_W:
         case SZEXP_VAR_H: {
-            pl_str name = expr[i].val.varname;
-            float size[2];
-
-            if (!lookup(priv, name, size)) {
+            const struct slot_size *var = &slots[expr[i].slot];
+            if (!var->valid) {
                 pl_warn(log, "Variable '%.*s' not found in RPN expression!",
-                        PL_STR_FMT(name));
+                        PL_STR_FMT(expr[i].val.varname));
                 return false;
             }
 
-            stack[idx++] = (expr[i].tag == SZEXP_VAR_W) ? size[0] : size[1];
+            stack[idx++] = (expr[i].tag == SZEXP_VAR_W) ? var->size[0] : var->size[1];
             continue;
             }
         }
@@ -469,8 +482,10 @@ static bool parse_hook(pl_log log, pl_str *body, struct custom_shader_hook *out)
 }
 
 static bool parse_tex(pl_gpu gpu, void *alloc, pl_str *body,
-                      struct pl_shader_desc *out)
+                      struct pl_shader_desc *out, bool *shared)
 {
+    const pl_str section = *body;
+    *shared = false;
     *out = (struct pl_shader_desc) {
         .desc = {
             .name = "USER_TEX",
@@ -633,6 +648,21 @@ static bool parse_tex(pl_gpu gpu, void *alloc, pl_str *body,
     // Decode the rest of the section (up to the next //! marker) as raw hex
     // data for the texture
     pl_str tex, hexdata = split_magic(body);
+
+    // Immutable textures are shared GPU-wide, keyed by the section text
+    // itself, so loading the same shader again skips decoding and uploading
+    // the (potentially huge) texture data, and doesn't duplicate it in VRAM
+    uint64_t key = 0;
+    if (!params.storable) {
+        key = pl_str0_hash("mpv user shader texture");
+        pl_hash_merge(&key, pl_mem_hash(section.buf, hexdata.buf + hexdata.len - section.buf));
+        out->binding.object = pl_tex_cache_get(gpu, key);
+        if (out->binding.object) {
+            *shared = true;
+            return true;
+        }
+    }
+
     if (!pl_str_decode_hex(NULL, pl_str_strip(hexdata), &tex)) {
         PL_ERR(gpu, "Error while parsing TEXTURE body: must be a valid "
                     "hexadecimal sequence!");
@@ -652,17 +682,189 @@ static bool parse_tex(pl_gpu gpu, void *alloc, pl_str *body,
     }
 
     params.initial_data = tex.buf;
-    out->binding.object = pl_tex_create(gpu, &params);
+    pl_tex obj = pl_tex_create(gpu, &params);
     pl_free(tex.buf);
 
-    if (!out->binding.object) {
+    if (!obj) {
         PL_ERR(gpu, "Failed creating custom texture!");
         return false;
     }
 
+    if (!params.storable) {
+        obj = pl_tex_cache_add(gpu, key, obj);
+        *shared = true;
+    }
+
+    out->binding.object = obj;
+    return true;
+}
+
+static bool parse_var_data(pl_log log, pl_str str, enum pl_var_type type,
+                           pl_var_data *out)
+{
+    bool ok = false;
+    switch (type) {
+    case PL_VAR_SINT:
+        ok = pl_str_parse_int(str, &out->i);
+        break;
+    case PL_VAR_UINT: {
+        int64_t val;
+        ok = pl_str_parse_int64(str, &val) && val >= 0 && val <= UINT_MAX;
+        out->u = val;
+        break;
+    }
+    case PL_VAR_FLOAT:
+        ok = pl_str_parse_float(str, &out->f);
+        break;
+    case PL_VAR_INVALID:
+    case PL_VAR_TYPE_COUNT:
+        pl_unreachable();
+    }
+
+    if (!ok)
+        pl_err(log, "Failed parsing parameter value '%.*s'!", PL_STR_FMT(str));
+    return ok;
+}
+
+static bool parse_param(pl_log log, void *alloc, pl_str *body,
+                        struct pl_hook_par *out)
+{
+    *out = (struct pl_hook_par) {0};
+    pl_str minimum = {0}, maximum = {0};
+
+    while (true) {
+        pl_str rest;
+        pl_str line = pl_str_strip(pl_str_getline(*body, &rest));
+
+        if (!pl_str_eatstart0(&line, "//!"))
+            break;
+
+        *body = rest;
+
+        if (pl_str_eatstart0(&line, "PARAM")) {
+            out->name = pl_strdup0(alloc, pl_str_strip(line));
+            continue;
+        }
+
+        if (pl_str_eatstart0(&line, "DESC")) {
+            out->description = pl_strdup0(alloc, pl_str_strip(line));
+            continue;
+        }
+
+        if (pl_str_eatstart0(&line, "TYPE")) {
+            line = pl_str_strip(line);
+            if (pl_str_eatstart0(&line, "DYNAMIC")) {
+                out->mode = PL_HOOK_PAR_DYNAMIC;
+            } else if (pl_str_eatstart0(&line, "CONSTANT")) {
+                out->mode = PL_HOOK_PAR_CONSTANT;
+            }
+
+            line = pl_str_strip(line);
+            if (pl_str_equals0(line, "int")) {
+                out->type = PL_VAR_SINT;
+            } else if (pl_str_equals0(line, "uint")) {
+                out->type = PL_VAR_UINT;
+            } else if (pl_str_equals0(line, "float")) {
+                out->type = PL_VAR_FLOAT;
+            } else {
+                pl_err(log, "Unrecognized parameter type '%.*s'!", PL_STR_FMT(line));
+                return false;
+            }
+            continue;
+        }
+
+        if (pl_str_eatstart0(&line, "MINIMUM")) {
+            minimum = pl_str_strip(line);
+            continue;
+        }
+
+        if (pl_str_eatstart0(&line, "MAXIMUM")) {
+            maximum = pl_str_strip(line);
+            continue;
+        }
+
+        pl_err(log, "Unrecognized command '%.*s'!", PL_STR_FMT(line));
+        return false;
+    }
+
+    if (!out->name || !out->name[0]) {
+        pl_err(log, "Missing name for PARAM!");
+        return false;
+    }
+
+    if (!out->type) {
+        pl_err(log, "Missing TYPE for PARAM '%s'!", out->name);
+        return false;
+    }
+
+    switch (out->type) {
+    case PL_VAR_SINT:
+        out->minimum.i = INT_MIN;
+        out->maximum.i = INT_MAX;
+        break;
+    case PL_VAR_UINT:
+        out->minimum.u = 0;
+        out->maximum.u = UINT_MAX;
+        break;
+    case PL_VAR_FLOAT:
+        out->minimum.f = -INFINITY;
+        out->maximum.f = INFINITY;
+        break;
+    default: pl_unreachable();
+    }
+
+    pl_str initial = pl_str_strip(split_magic(body));
+    if ((minimum.len && !parse_var_data(log, minimum, out->type, &out->minimum)) ||
+        (maximum.len && !parse_var_data(log, maximum, out->type, &out->maximum)) ||
+        !parse_var_data(log, initial, out->type, &out->initial))
+    {
+        return false;
+    }
+
+    bool in_range;
+    switch (out->type) {
+    case PL_VAR_SINT:
+        in_range = out->minimum.i <= out->initial.i && out->initial.i <= out->maximum.i;
+        break;
+    case PL_VAR_UINT:
+        in_range = out->minimum.u <= out->initial.u && out->initial.u <= out->maximum.u;
+        break;
+    case PL_VAR_FLOAT:
+        in_range = out->minimum.f <= out->initial.f && out->initial.f <= out->maximum.f;
+        break;
+    default: pl_unreachable();
+    }
+
+    if (!in_range) {
+        pl_err(log, "Initial value of PARAM '%s' is out of range!", out->name);
+        return false;
+    }
+
+    out->data = pl_alloc_ptr(alloc, out->data);
+    *out->data = out->initial;
     return true;
 }
 
+// Current value of a parameter, clamped to its valid range
+static pl_var_data param_value(const struct pl_hook_par *par)
+{
+    pl_var_data val = *par->data;
+    switch (par->type) {
+    case PL_VAR_SINT:
+        val.i = PL_CLAMP(val.i, par->minimum.i, par->maximum.i);
+        break;
+    case PL_VAR_UINT:
+        val.u = PL_CLAMP(val.u, par->minimum.u, par->maximum.u);
+        break;
+    case PL_VAR_FLOAT:
+        val.f = PL_CLAMP(val.f, par->minimum.f, par->maximum.f);
+        break;
+    default: pl_unreachable();
+    }
+
+    return val;
+}
+
 static bool parse_buf(pl_gpu gpu, void *alloc, pl_str *body,
                       struct pl_shader_desc *out)
 {
@@ -770,6 +972,7 @@ static bool parse_buf(pl_gpu gpu, void *alloc, pl_str *body,
         .uniform = out->desc.type == PL_DESC_BUF_UNIFORM,
         .storable = out->desc.type == PL_DESC_BUF_STORAGE,
         .initial_data = data.len ? data.buf : NULL,
+        .debug_tag = PL_DEBUG_TAG,
     ));
 
     if (!out->binding.object) {
@@ -850,9 +1053,32 @@ static pl_str pl_stage_to_mp(enum pl_hook_stage stage)
     pl_unreachable();
 }
 
+#define MAX_SZEXP_REFS 16
+
+// Results of the size expressions of a pass, as of the last evaluation
+struct szexp_cache {
+    int num_refs; // number of distinct slots referenced, or -1 if too many
+    int refs[MAX_SZEXP_REFS];
+    struct slot_size inputs[MAX_SZEXP_REFS];
+    bool valid;
+    float run;
+    float out_size[2];
+};
+
 struct hook_pass {
     enum pl_hook_stage exec_stages;
     struct custom_shader_hook hook;
+    struct szexp_cache cache;
+
+    // If this pass saves its output under a name other than a stage, the
+    // indices of all passes binding or referencing that texture
+    bool named_output;
+    PL_ARRAY(int) consumers;
+
+    // Dynamic per hook invocation
+    bool cond_known; // condition doesn't depend on earlier passes
+    bool dead;       // output is not needed by any pass that will run
+    bool skip;       // pass won't run, either due to `dead` or its condition
 };
 
 struct pass_tex {
@@ -875,6 +1101,13 @@ struct hook_priv {
 
     // Fixed (for shader-local resources)
     PL_ARRAY(struct pl_shader_desc) descriptors;
+    PL_ARRAY(bool) shared; // whether each descriptor is from `pl_tex_cache`
+    PL_ARRAY(struct pl_hook_par) hook_params;
+
+    // Texture names referenced by size expressions, starting at SLOT_NAMED
+    PL_ARRAY(pl_str) slot_names;
+    struct slot_size *slots;
+    bool *written; // scratch space for `mark_dead_passes`
 
     // Dynamic per pass
     enum pl_hook_stage save_stages;
@@ -890,48 +1123,185 @@ static void hook_reset(void *priv)
 {
     struct hook_priv *p = priv;
     p->pass_textures.num = 0;
+    for (int i = 0; i < p->slot_names.num; i++)
+        p->slots[SLOT_NAMED + i].valid = false;
 }
 
-struct szexp_ctx {
-    struct hook_priv *priv;
-    const struct pl_hook_params *params;
-    struct pass_tex hooked;
-};
+// Returns the slot of a named texture, or -1 if it's never referenced
+static int find_slot(const struct hook_priv *p, pl_str name)
+{
+    for (int i = 0; i < p->slot_names.num; i++) {
+        if (pl_str_equals(name, p->slot_names.elem[i]))
+            return SLOT_NAMED + i;
+    }
 
-static bool lookup_tex(void *priv, pl_str var, float size[2])
+    return -1;
+}
+
+static void resolve_szexpr(struct hook_priv *p, struct szexp_cache *cache,
+                           struct szexp expr[MAX_SZEXP_SIZE])
 {
-    struct szexp_ctx *ctx = priv;
-    struct hook_priv *p = ctx->priv;
-    const struct pl_hook_params *params = ctx->params;
-
-    if (pl_str_equals0(var, "HOOKED")) {
-        pl_assert(ctx->hooked.tex);
-        size[0] = ctx->hooked.tex->params.w;
-        size[1] = ctx->hooked.tex->params.h;
-        return true;
+    for (int i = 0; i < MAX_SZEXP_SIZE && expr[i].tag != SZEXP_END; i++) {
+        if (expr[i].tag != SZEXP_VAR_W && expr[i].tag != SZEXP_VAR_H)
+            continue;
+
+        pl_str name = expr[i].val.varname;
+        int slot;
+        if (pl_str_equals0(name, "HOOKED")) {
+            slot = SLOT_HOOKED;
+        } else if (pl_str_equals0(name, "NATIVE_CROPPED")) {
+            slot = SLOT_NATIVE_CROPPED;
+        } else if (pl_str_equals0(name, "OUTPUT")) {
+            slot = SLOT_OUTPUT;
+        } else {
+            if (pl_str_equals0(name, "MAIN"))
+                name = pl_str0("MAINPRESUB");
+            slot = find_slot(p, name);
+            if (slot < 0) {
+                slot = SLOT_NAMED + p->slot_names.num;
+                PL_ARRAY_APPEND(p->alloc, p->slot_names, name);
+            }
+        }
+
+        expr[i].slot = slot;
+
+        // Register this slot as an input of the cached results
+        if (cache->num_refs < 0)
+            continue;
+        bool found = false;
+        for (int n = 0; n < cache->num_refs; n++)
+            found |= cache->refs[n] == slot;
+        if (found)
+            continue;
+        if (cache->num_refs == MAX_SZEXP_REFS) {
+            cache->num_refs = -1; // too many to bother caching
+            continue;
+        }
+        cache->refs[cache->num_refs++] = slot;
     }
+}
 
-    if (pl_str_equals0(var, "NATIVE_CROPPED")) {
-        size[0] = fabs(pl_rect_w(params->src_rect));
-        size[1] = fabs(pl_rect_h(params->src_rect));
-        return true;
+static void set_slot(struct hook_priv *p, int slot, float w, float h)
+{
+    p->slots[slot] = (struct slot_size) { .size = { w, h }, .valid = true };
+}
+
+// Evaluate the execution condition and output size of a pass, re-using the
+// previous results if none of the referenced texture sizes changed
+static bool eval_pass_szexprs(struct hook_priv *p, struct hook_pass *pass,
+                              float *run, float out_size[2])
+{
+    struct szexp_cache *cache = &pass->cache;
+    bool hit = cache->valid && cache->num_refs >= 0;
+    for (int i = 0; hit && i < cache->num_refs; i++) {
+        const struct slot_size *cur = &p->slots[cache->refs[i]],
+                               *old = &cache->inputs[i];
+        hit = cur->valid == old->valid && cur->size[0] == old->size[0] &&
+              cur->size[1] == old->size[1];
     }
 
-    if (pl_str_equals0(var, "OUTPUT")) {
-        size[0] = abs(pl_rect_w(params->dst_rect));
-        size[1] = abs(pl_rect_h(params->dst_rect));
+    if (hit) {
+        *run = cache->run;
+        out_size[0] = cache->out_size[0];
+        out_size[1] = cache->out_size[1];
         return true;
     }
 
-    if (pl_str_equals0(var, "MAIN"))
-        var = pl_str0("MAINPRESUB");
+    const struct custom_shader_hook *hook = &pass->hook;
+    cache->valid = false;
+    *run = 0;
+    out_size[0] = out_size[1] = 0;
+    if (!pl_eval_szexpr(p->log, p->slots, hook->cond, run))
+        return false;
 
-    for (int i = 0; i < p->pass_textures.num; i++) {
-        if (pl_str_equals(var, p->pass_textures.elem[i].name)) {
-            pl_tex tex = p->pass_textures.elem[i].tex;
-            size[0] = tex->params.w;
-            size[1] = tex->params.h;
+    // Only evaluate the output size if the pass actually runs
+    if (*run) {
+        if (!pl_eval_szexpr(p->log, p->slots, hook->width,  &out_size[0]) ||
+            !pl_eval_szexpr(p->log, p->slots, hook->height, &out_size[1]))
+        {
+            return false;
+        }
+    }
+
+    for (int i = 0; i < cache->num_refs; i++)
+        cache->inputs[i] = p->slots[cache->refs[i]];
+    cache->run = *run;
+    cache->out_size[0] = out_size[0];
+    cache->out_size[1] = out_size[1];
+    cache->valid = true;
+    return true;
+}
+
+// Determine which passes hooking `stage` don't need to run, because their
+// output is only consumed by later passes on the same stage that are skipped
+// themselves, either due to their condition or (recursively) for this reason
+static void mark_dead_passes(struct hook_priv *p, enum pl_hook_stage stage)
+{
+    pl_str name = pl_stage_to_mp(stage);
+    memset(p->written, 0, (SLOT_NAMED + p->slot_names.num) * sizeof(bool));
+
+    // Conditions can only be evaluated upfront if they don't depend on the
+    // size of any texture written by an earlier pass on this stage
+    for (int n = 0; n < p->hook_passes.num; n++) {
+        struct hook_pass *pass = &p->hook_passes.elem[n];
+        if (!(pass->exec_stages & stage))
+            continue;
+
+        const struct szexp *cond = pass->hook.cond;
+        pass->cond_known = true;
+        for (int i = 0; i < MAX_SZEXP_SIZE && cond[i].tag != SZEXP_END; i++) {
+            if (cond[i].tag == SZEXP_VAR_W || cond[i].tag == SZEXP_VAR_H)
+                pass->cond_known &= !p->written[cond[i].slot];
+        }
+
+        pl_str save = pass->hook.save_tex.len ? pass->hook.save_tex : name;
+        int slot = find_slot(p, save);
+        if (slot >= 0)
+            p->written[slot] = true;
+        if (pl_str_equals(save, name))
+            p->written[SLOT_HOOKED] = true;
+    }
+
+    for (int n = p->hook_passes.num - 1; n >= 0; n--) {
+        struct hook_pass *pass = &p->hook_passes.elem[n];
+        if (!(pass->exec_stages & stage))
+            continue;
+
+        // Consumers which may run at any other point keep this pass alive
+        bool live = !pass->named_output;
+        for (int i = 0; !live && i < pass->consumers.num; i++) {
+            int c = pass->consumers.elem[i];
+            const struct hook_pass *cons = &p->hook_passes.elem[c];
+            live = c <= n || (cons->exec_stages & ~stage) || !cons->skip;
+        }
+
+        pass->dead = pass->skip = !live;
+        if (pass->dead)
+            continue;
+
+        // Errors are deliberately ignored here, and reported when actually
+        // trying to run the pass
+        float run = 1.0f;
+        if (pass->cond_known && pl_eval_szexpr(NULL, p->slots, pass->hook.cond, &run))
+            pass->skip = !run;
+    }
+}
+
+static bool pass_uses_tex(const struct custom_shader_hook *hook, pl_str name)
+{
+    for (int i = 0; i < PL_ARRAY_SIZE(hook->bind_tex); i++) {
+        if (pl_str_equals(hook->bind_tex[i], name))
             return true;
+    }
+
+    const struct szexp *exprs[] = { hook->cond, hook->width, hook->height };
+    for (int n = 0; n < PL_ARRAY_SIZE(exprs); n++) {
+        for (int i = 0; i < MAX_SZEXP_SIZE && exprs[n][i].tag != SZEXP_END; i++) {
+            const struct szexp *expr = &exprs[n][i];
+            if (expr->tag != SZEXP_VAR_W && expr->tag != SZEXP_VAR_H)
+                continue;
+            if (pl_str_equals(expr->val.varname, name))
+                return true;
         }
     }
 
@@ -966,14 +1336,14 @@ static bool bind_pass_tex(pl_shader sh, pl_str name,
     if (!id)
         return false;
 
-    GLSLH("#define %.*s_raw %s \n", PL_STR_FMT(name), id);
-    GLSLH("#define %.*s_pos %s \n", PL_STR_FMT(name), pos);
-    GLSLH("#define %.*s_map %s_map \n", PL_STR_FMT(name), pos);
-    GLSLH("#define %.*s_size %s \n", PL_STR_FMT(name), size);
-    GLSLH("#define %.*s_pt %s \n", PL_STR_FMT(name), pt);
+    GLSLH("#define %.*s_raw "$" \n", PL_STR_FMT(name), id);
+    GLSLH("#define %.*s_pos "$" \n", PL_STR_FMT(name), pos);
+    GLSLH("#define %.*s_map "$"_map \n", PL_STR_FMT(name), pos);
+    GLSLH("#define %.*s_size "$" \n", PL_STR_FMT(name), size);
+    GLSLH("#define %.*s_pt "$" \n", PL_STR_FMT(name), pt);
 
     float off[2] = { ptex->rect.x0, ptex->rect.y0 };
-    GLSLH("#define %.*s_off %s \n", PL_STR_FMT(name),
+    GLSLH("#define %.*s_off "$" \n", PL_STR_FMT(name),
           sh_var(sh, (struct pl_shader_var) {
               .var = pl_var_vec2("offset"),
               .data = off,
@@ -981,20 +1351,20 @@ static bool bind_pass_tex(pl_shader sh, pl_str name,
 
     struct pl_color_repr repr = ptex->repr;
     ident_t scale = SH_FLOAT(pl_color_repr_normalize(&repr));
-    GLSLH("#define %.*s_mul %s \n", PL_STR_FMT(name), scale);
+    GLSLH("#define %.*s_mul "$" \n", PL_STR_FMT(name), scale);
 
     // Compatibility with mpv
     GLSLH("#define %.*s_rot mat2(1.0, 0.0, 0.0, 1.0) \n", PL_STR_FMT(name));
 
     // Sampling function boilerplate
-    GLSLH("#define %.*s_tex(pos) (%s * vec4(%s(%s, pos))) \n",
+    GLSLH("#define %.*s_tex(pos) ("$" * vec4(%s("$", pos))) \n",
           PL_STR_FMT(name), scale, sh_tex_fn(sh, ptex->tex->params), id);
-    GLSLH("#define %.*s_texOff(off) (%.*s_tex(%s + %s * vec2(off))) \n",
+    GLSLH("#define %.*s_texOff(off) (%.*s_tex("$" + "$" * vec2(off))) \n",
           PL_STR_FMT(name), PL_STR_FMT(name), pos, pt);
 
     bool can_gather = ptex->tex->params.format->gatherable;
     if (can_gather) {
-        GLSLH("#define %.*s_gather(pos, c) (%s * vec4(textureGather(%s, pos, c))) \n",
+        GLSLH("#define %.*s_gather(pos, c) ("$" * vec4(textureGather("$", pos, c))) \n",
               PL_STR_FMT(name), scale, id);
     }
 
@@ -1033,6 +1403,9 @@ static bool bind_pass_tex(pl_shader sh, pl_str name,
 
 static void save_pass_tex(struct hook_priv *p, struct pass_tex ptex)
 {
+    int slot = find_slot(p, ptex.name);
+    if (slot >= 0)
+        set_slot(p, slot, ptex.tex->params.w, ptex.tex->params.h);
 
     for (int i = 0; i < p->pass_textures.num; i++) {
         if (!pl_str_equals(p->pass_textures.elem[i].name, ptex.name))
@@ -1053,38 +1426,48 @@ static struct pl_hook_res hook_hook(void *priv, const struct pl_hook_params *par
     struct pl_hook_res res = {0};
 
     pl_shader sh = NULL;
-    struct szexp_ctx scope = {
-        .priv = p,
-        .params = params,
-        .hooked = {
-            .name = stage,
-            .tex = params->tex,
-            .rect = params->rect,
-            .repr = params->repr,
-            .color = params->color,
-            .comps = params->components,
-        },
+    const struct pass_tex input = {
+        .name = stage,
+        .tex = params->tex,
+        .rect = params->rect,
+        .repr = params->repr,
+        .color = params->color,
+        .comps = params->components,
     };
 
+    set_slot(p, SLOT_HOOKED, params->tex->params.w, params->tex->params.h);
+    set_slot(p, SLOT_NATIVE_CROPPED, fabs(pl_rect_w(params->src_rect)),
+                                     fabs(pl_rect_h(params->src_rect)));
+    set_slot(p, SLOT_OUTPUT, abs(pl_rect_w(params->dst_rect)),
+                             abs(pl_rect_h(params->dst_rect)));
+
     // Save the input texture if needed
     if (p->save_stages & params->stage) {
         PL_TRACE(p, "Saving input texture '%.*s' for binding",
-                 PL_STR_FMT(scope.hooked.name));
-        save_pass_tex(p, scope.hooked);
+                 PL_STR_FMT(input.name));
+        save_pass_tex(p, input);
     }
 
+    mark_dead_passes(p, params->stage);
+
     for (int n = 0; n < p->hook_passes.num; n++) {
-        const struct hook_pass *pass = &p->hook_passes.elem[n];
+        struct hook_pass *pass = &p->hook_passes.elem[n];
         if (!(pass->exec_stages & params->stage))
             continue;
 
         const struct custom_shader_hook *hook = &pass->hook;
+        if (pass->dead) {
+            PL_TRACE(p, "Skipping hook pass %d on stage '%.*s': output unused",
+                     n, PL_STR_FMT(stage));
+            continue;
+        }
+
         PL_TRACE(p, "Executing hook pass %d on stage '%.*s': %.*s",
                  n, PL_STR_FMT(stage), PL_STR_FMT(hook->pass_desc));
 
-        // Test for execution condition
-        float run = 0;
-        if (!pl_eval_szexpr(p->log, &scope, lookup_tex, hook->cond, &run))
+        // Test for execution condition, and compute the output size
+        float run, out_size[2];
+        if (!eval_pass_szexprs(p, pass, &run, out_size))
             goto error;
 
         if (!run) {
@@ -1092,13 +1475,6 @@ static struct pl_hook_res hook_hook(void *priv, const struct pl_hook_params *par
             continue;
         }
 
-        float out_size[2] = {0};
-        if (!pl_eval_szexpr(p->log, &scope, lookup_tex, hook->width,  &out_size[0]) ||
-            !pl_eval_szexpr(p->log, &scope, lookup_tex, hook->height, &out_size[1]))
-        {
-            goto error;
-        }
-
         int out_w = roundf(out_size[0]),
             out_h = roundf(out_size[1]);
 
@@ -1159,11 +1535,11 @@ static struct pl_hook_res hook_hook(void *priv, const struct pl_hook_params *par
                     // Directly bind this, no need to bother with all the
                     // `bind_pass_tex` boilerplate
                     ident_t id = sh_desc(sh, p->descriptors.elem[j]);
-                    GLSLH("#define %.*s %s \n", PL_STR_FMT(texname), id);
+                    GLSLH("#define %.*s "$" \n", PL_STR_FMT(texname), id);
 
                     if (p->descriptors.elem[j].desc.type == PL_DESC_SAMPLED_TEX) {
                         pl_tex tex = p->descriptors.elem[j].binding.object;
-                        GLSLH("#define %.*s_tex(pos) (%s(%s, pos)) \n",
+                        GLSLH("#define %.*s_tex(pos) (%s("$", pos)) \n",
                               PL_STR_FMT(texname), sh_tex_fn(sh, tex->params), id);
                     }
                     goto next_bind;
@@ -1208,37 +1584,70 @@ static struct pl_hook_res hook_hook(void *priv, const struct pl_hook_params *par
 
         // Set up the input variables
         p->frame_count++;
-        GLSLH("#define frame %s \n", sh_var(sh, (struct pl_shader_var) {
+        GLSLH("#define frame "$" \n", sh_var(sh, (struct pl_shader_var) {
             .var = pl_var_int("frame"),
             .data = &p->frame_count,
             .dynamic = true,
         }));
 
         float random = prng_step(p->prng_state);
-        GLSLH("#define random %s \n", sh_var(sh, (struct pl_shader_var) {
+        GLSLH("#define random "$" \n", sh_var(sh, (struct pl_shader_var) {
             .var = pl_var_float("random"),
             .data = &random,
             .dynamic = true,
         }));
 
         float src_size[2] = { pl_rect_w(params->src_rect), pl_rect_h(params->src_rect) };
-        GLSLH("#define input_size %s \n", sh_var(sh, (struct pl_shader_var) {
+        GLSLH("#define input_size "$" \n", sh_var(sh, (struct pl_shader_var) {
             .var = pl_var_vec2("input_size"),
             .data = src_size,
         }));
 
         float dst_size[2] = { pl_rect_w(params->dst_rect), pl_rect_h(params->dst_rect) };
-        GLSLH("#define target_size %s \n", sh_var(sh, (struct pl_shader_var) {
+        GLSLH("#define target_size "$" \n", sh_var(sh, (struct pl_shader_var) {
             .var = pl_var_vec2("target_size"),
             .data = dst_size,
         }));
 
         float tex_off[2] = { params->src_rect.x0, params->src_rect.y0 };
-        GLSLH("#define tex_offset %s \n", sh_var(sh, (struct pl_shader_var) {
+        GLSLH("#define tex_offset "$" \n", sh_var(sh, (struct pl_shader_var) {
             .var = pl_var_vec2("tex_offset"),
             .data = tex_off,
         }));
 
+        // Bind the current values of all tunable parameters
+        for (int i = 0; i < p->hook_params.num; i++) {
+            const struct pl_hook_par *par = &p->hook_params.elem[i];
+            pl_var_data val = param_value(par);
+            ident_t id;
+            switch (par->mode) {
+            case PL_HOOK_PAR_VARIABLE:
+            case PL_HOOK_PAR_DYNAMIC:
+                id = sh_var(sh, (struct pl_shader_var) {
+                    .var = {
+                        .name = par->name,
+                        .type = par->type,
+                        .dim_v = 1,
+                        .dim_m = 1,
+                        .dim_a = 1,
+                    },
+                    .data = &val,
+                    .dynamic = par->mode == PL_HOOK_PAR_DYNAMIC,
+                });
+                break;
+            case PL_HOOK_PAR_CONSTANT:
+                id = sh_const(sh, (struct pl_shader_const) {
+                    .type = par->type,
+                    .name = par->name,
+                    .data = &val,
+                });
+                break;
+            default: pl_unreachable();
+            }
+
+            GLSLH("#define %s "$" \n", par->name, id);
+        }
+
         // Helper sub-shaders
         uint64_t sh_id = SH_PARAMS(sh).id;
         pl_shader_reset(p->trc_helper, pl_shader_params(
@@ -1246,14 +1655,14 @@ static struct pl_hook_res hook_hook(void *priv, const struct pl_hook_params *par
             .gpu = p->gpu,
         ));
         pl_shader_linearize(p->trc_helper, params->orig_color);
-        GLSLH("#define linearize %s \n", sh_subpass(sh, p->trc_helper));
+        GLSLH("#define linearize "$" \n", sh_subpass(sh, p->trc_helper));
 
         pl_shader_reset(p->trc_helper, pl_shader_params(
             .id = ++sh_id,
             .gpu = p->gpu,
         ));
         pl_shader_delinearize(p->trc_helper, params->orig_color);
-        GLSLH("#define delinearize %s \n", sh_subpass(sh, p->trc_helper));
+        GLSLH("#define delinearize "$" \n", sh_subpass(sh, p->trc_helper));
 
         // Load and run the user shader itself
         sh_append_str(sh, SH_BUF_HEADER, hook->pass_body);
@@ -1261,7 +1670,7 @@ static struct pl_hook_res hook_hook(void *priv, const struct pl_hook_params *par
 
         bool ok;
         if (hook->is_compute) {
-            GLSLP("#define out_image %s \n", sh_desc(sh, (struct pl_shader_desc) {
+            GLSLP("#define out_image "$" \n", sh_desc(sh, (struct pl_shader_desc) {
                 .binding.object = fbo,
                 .desc = {
                     .name = "out_image",
@@ -1336,7 +1745,7 @@ static struct pl_hook_res hook_hook(void *priv, const struct pl_hook_params *par
 
         // Update the result object, unless we saved to a different name
         if (pl_str_equals(ptex.name, stage)) {
-            scope.hooked = ptex;
+            set_slot(p, SLOT_HOOKED, fbo->params.w, fbo->params.h);
             res = (struct pl_hook_res) {
                 .output = PL_HOOK_SIG_TEX,
                 .tex = fbo,
@@ -1400,11 +1809,48 @@ const struct pl_hook *pl_mpv_user_shader_parse(pl_gpu gpu,
         // Peek at the first header to dispatch the right type
         if (pl_str_startswith0(shader, "//!TEXTURE")) {
             struct pl_shader_desc sd;
-            if (!parse_tex(gpu, hook, &shader, &sd))
+            bool shared;
+            if (!parse_tex(gpu, hook, &shader, &sd, &shared))
                 goto error;
 
-            PL_INFO(gpu, "Registering named texture '%s'", sd.desc.name);
+            PL_INFO(gpu, "Registering named texture '%s'%s", sd.desc.name,
+                    shared ? " (shared)" : "");
             PL_ARRAY_APPEND(hook, p->descriptors, sd);
+            PL_ARRAY_APPEND(hook, p->shared, shared);
+            continue;
+        }
+
+        if (pl_str_startswith0(shader, "//!PARAM")) {
+            struct pl_hook_par par;
+            if (!parse_param(gpu->log, hook, &shader, &par))
+                goto error;
+
+            for (int i = 0; i < p->hook_params.num; i++) {
+                if (strcmp(par.name, p->hook_params.elem[i].name) == 0) {
+                    PL_ERR(gpu, "Duplicate PARAM '%s'!", par.name);
+                    goto error;
+                }
+            }
+
+            PL_INFO(gpu, "Registering parameter '%s'", par.name);
+            PL_ARRAY_APPEND(hook, p->hook_params, par);
+            continue;
+        }
+
+        if (pl_str_startswith0(shader, "//!SCALE")) {
+            pl_str line = pl_str_getline(shader, &shader);
+            line = pl_str_strip(line);
+            pl_str_eatstart0(&line, "//!SCALE");
+            if (!pl_str_parse_float(pl_str_strip(line), &hook->scale) ||
+                hook->scale <= 0.0f || hook->scale > 1.0f)
+            {
+                PL_ERR(gpu, "Error parsing SCALE: '%.*s'", PL_STR_FMT(line));
+                goto error;
+            }
+
+            // Skip anything else up until the next header
+            int next = pl_str_find(shader, pl_str0("//!"));
+            shader = pl_str_drop(shader, next < 0 ? shader.len : next);
             continue;
         }
 
@@ -1415,6 +1861,7 @@ const struct pl_hook *pl_mpv_user_shader_parse(pl_gpu gpu,
 
             PL_INFO(gpu, "Registering named buffer '%s'", sd.desc.name);
             PL_ARRAY_APPEND(hook, p->descriptors, sd);
+            PL_ARRAY_APPEND(hook, p->shared, false);
             continue;
         }
 
@@ -1427,6 +1874,10 @@ const struct pl_hook *pl_mpv_user_shader_parse(pl_gpu gpu,
             .hook = h,
         };
 
+        resolve_szexpr(p, &pass.cache, pass.hook.cond);
+        resolve_szexpr(p, &pass.cache, pass.hook.width);
+        resolve_szexpr(p, &pass.cache, pass.hook.height);
+
         for (int i = 0; i < PL_ARRAY_SIZE(h.hook_tex); i++)
             pass.exec_stages |= mp_stage_to_pl(h.hook_tex[i]);
         for (int i = 0; i < PL_ARRAY_SIZE(h.bind_tex); i++) {
@@ -1466,10 +1917,31 @@ const struct pl_hook *pl_mpv_user_shader_parse(pl_gpu gpu,
     for (int i = 0; i < p->hook_passes.num; i++)
         hook->stages |= p->hook_passes.elem[i].exec_stages;
 
+    // Build the dependency graph between passes, so that passes whose
+    // output ends up unused can be skipped
+    for (int i = 0; i < p->hook_passes.num; i++) {
+        struct hook_pass *pass = &p->hook_passes.elem[i];
+        pl_str save = pass->hook.save_tex;
+        pass->named_output = save.len && !mp_stage_to_pl(save) &&
+                             !pl_str_equals0(save, "HOOKED");
+        if (!pass->named_output)
+            continue;
+
+        for (int j = 0; j < p->hook_passes.num; j++) {
+            if (pass_uses_tex(&p->hook_passes.elem[j].hook, save))
+                PL_ARRAY_APPEND(hook, pass->consumers, j);
+        }
+    }
+
+    hook->parameters = p->hook_params.elem;
+    hook->num_parameters = p->hook_params.num;
+    p->slots = pl_calloc_ptr(hook, SLOT_NAMED + p->slot_names.num, p->slots);
+    p->written = pl_calloc_ptr(hook, SLOT_NAMED + p->slot_names.num, p->written);
     return hook;
 
 error:
-    pl_free(hook);
+    // Also releases any descriptors registered so far
+    pl_mpv_user_shader_destroy(&(const struct pl_hook *) { hook });
     return NULL;
 }
 
@@ -1494,7 +1966,11 @@ void pl_mpv_user_shader_destroy(const struct pl_hook **hookp)
             case PL_DESC_SAMPLED_TEX:
             case PL_DESC_STORAGE_IMG: {
                 pl_tex tex = p->descriptors.elem[i].binding.object;
-                pl_tex_destroy(p->gpu, &tex);
+                if (p->shared.elem[i]) {
+                    pl_tex_cache_release(p->gpu, &tex);
+                } else {
+                    pl_tex_destroy(p->gpu, &tex);
+                }
                 break;
 
             case PL_DESC_INVALID:
@@ -299,6 +299,63 @@ static struct grain_scale get_grain_scale(const struct pl_film_grain_params *par
     return ret;
 }
 
+// Auto-regressive filter taps, with all zero coefficients removed
+struct ar_taps {
+    int num, num_above;
+    int offset[24]; // relative to the current position in the grain buffer
+    int coeff[24];
+};
+
+// Returns the final coefficient (for the current position), which is not
+// included in the list of taps. The taps are sorted in raster order, with the
+// first `num_above` taps referring to previous rows.
+static int get_ar_taps(struct ar_taps *taps, const int8_t *coeff, int ar_lag)
+{
+    taps->num = 0;
+    for (int dy = -ar_lag; dy <= 0; dy++) {
+        if (!dy)
+            taps->num_above = taps->num;
+        for (int dx = -ar_lag; dx <= ar_lag; dx++) {
+            if (!dx && !dy)
+                return *coeff;
+            if (*coeff) {
+                taps->offset[taps->num] = dy * GRAIN_WIDTH + dx;
+                taps->coeff[taps->num++] = *coeff;
+            }
+            coeff++;
+        }
+    }
+
+    pl_unreachable();
+}
+
+// Applies the auto-regressive filter to row `y` of the grain buffer, on the
+// range [x0, x1). `extra` contains additional per-pixel contributions to add.
+static inline void apply_ar_taps(int16_t buf[GRAIN_HEIGHT][GRAIN_WIDTH],
+                                 const struct ar_taps *taps, int extra[],
+                                 int y, int x0, int x1, int shift,
+                                 const struct grain_scale *scale)
+{
+    // The contributions from previous rows don't depend on the current row,
+    // so these can be computed up-front (and vectorized)
+    for (int i = 0; i < taps->num_above; i++) {
+        const int16_t *src = &buf[0][0] + y * GRAIN_WIDTH + taps->offset[i];
+        const int c = taps->coeff[i];
+        for (int x = x0; x < x1; x++)
+            extra[x] += c * src[x];
+    }
+
+    int16_t *row = buf[y];
+    for (int x = x0; x < x1; x++) {
+        int sum = extra[x];
+        for (int i = taps->num_above; i < taps->num; i++)
+            sum += taps->coeff[i] * row[x + taps->offset[i]];
+
+        int16_t grain = row[x] + round2(sum, shift);
+        row[x] = PL_CLAMP(grain, scale->grain_min, scale->grain_max);
+    }
+}
+
 // Generates the basic grain table (LumaGrain in the spec).
 static void generate_grain_y(float out[GRAIN_HEIGHT_LUT][GRAIN_WIDTH_LUT],
                              int16_t buf[GRAIN_HEIGHT][GRAIN_WIDTH],
@@ -319,24 +376,13 @@ static void generate_grain_y(float out[GRAIN_HEIGHT_LUT][GRAIN_WIDTH_LUT],
     }
 
     const int ar_pad = 3;
-    int ar_lag = data->ar_coeff_lag;
+    struct ar_taps taps;
+    get_ar_taps(&taps, data->ar_coeffs_y, data->ar_coeff_lag);
 
     for (int y = ar_pad; y < GRAIN_HEIGHT; y++) {
-        for (int x = ar_pad; x < GRAIN_WIDTH - ar_pad; x++) {
-            const int8_t *coeff = data->ar_coeffs_y;
-            int sum = 0;
-            for (int dy = -ar_lag; dy <= 0; dy++) {
-                for (int dx = -ar_lag; dx <= ar_lag; dx++) {
-                    if (!dx && !dy)
-                        break;
-                    sum += *(coeff++) * buf[y + dy][x + dx];
-                }
-            }
-
-            int16_t grain = buf[y][x] + round2(sum, data->ar_coeff_shift);
-            grain = PL_CLAMP(grain, scale.grain_min, scale.grain_max);
-            buf[y][x] = grain;
-        }
+        int extra[GRAIN_WIDTH] = {0};
+        apply_ar_taps(buf, &taps, extra, y, ar_pad, GRAIN_WIDTH - ar_pad,
+                      data->ar_coeff_shift, &scale);
     }
 
     for (int y = 0; y < GRAIN_HEIGHT_LUT; y++) {
@@ -381,41 +427,35 @@ static void generate_grain_uv(float *out, int16_t buf[GRAIN_HEIGHT][GRAIN_WIDTH]
     }
 
     const int ar_pad = 3;
-    int ar_lag = data->ar_coeff_lag;
+    const int8_t *coeff = coeffs[channel];
+    pl_assert(coeff);
+
+    // The final coefficient applies to the contribution from the luma grain
+    // texture, and is only used if luma grain is present
+    struct ar_taps taps;
+    int luma_coeff = get_ar_taps(&taps, coeff, data->ar_coeff_lag);
+    if (!data->num_points_y)
+        luma_coeff = 0;
 
     for (int y = ar_pad; y < chromaH; y++) {
-        for (int x = ar_pad; x < chromaW - ar_pad; x++) {
-            const int8_t *coeff = coeffs[channel];
-            pl_assert(coeff);
-            int sum = 0;
-            for (int dy = -ar_lag; dy <= 0; dy++) {
-                for (int dx = -ar_lag; dx <= ar_lag; dx++) {
-                    // For the final (current) pixel, we need to add in the
-                    // contribution from the luma grain texture
-                    if (!dx && !dy) {
-                        if (!data->num_points_y)
-                            break;
-                        int luma = 0;
-                        int lumaX = ((x - ar_pad) << sub_x) + ar_pad;
-                        int lumaY = ((y - ar_pad) << sub_y) + ar_pad;
-                        for (int i = 0; i <= sub_y; i++) {
-                            for (int j = 0; j <= sub_x; j++) {
-                                luma += buf_y[lumaY + i][lumaX + j];
-                            }
-                        }
-                        luma = round2(luma, sub_x + sub_y);
-                        sum += luma * (*coeff);
-                        break;
+        int extra[GRAIN_WIDTH] = {0};
+        if (luma_coeff) {
+            for (int x = ar_pad; x < chromaW - ar_pad; x++) {
+                int luma = 0;
+                int lumaX = ((x - ar_pad) << sub_x) + ar_pad;
+                int lumaY = ((y - ar_pad) << sub_y) + ar_pad;
+                for (int i = 0; i <= sub_y; i++) {
+                    for (int j = 0; j <= sub_x; j++) {
+                        luma += buf_y[lumaY + i][lumaX + j];
                     }
-
-                    sum += *(coeff++) * buf[y + dy][x + dx];
                 }
+                luma = round2(luma, sub_x + sub_y);
+                extra[x] = luma * luma_coeff;
             }
-
-            int16_t grain = buf[y][x] + round2(sum, data->ar_coeff_shift);
-            grain = PL_CLAMP(grain, scale.grain_min, scale.grain_max);
-            buf[y][x] = grain;
         }
+
+        apply_ar_taps(buf, &taps, extra, y, ar_pad, chromaW - ar_pad,
+                      data->ar_coeff_shift, &scale);
     }
 
     int lutW = GRAIN_WIDTH_LUT >> sub_x;
@@ -510,7 +550,7 @@ static void sample(pl_shader sh, enum offset off, ident_t lut, int idx,
     GLSL("offset = uvec2(%du, %du) * uvec2((data >> %d) & 0xFu, \n"
          "                                 (data >> %d) & 0xFu);\n"
          "pos = offset + local_id.xy + uvec2(%d, %d);           \n"
-         "val = %s(pos)%s;                                      \n",
+         "val = "$"(pos)%s;                                     \n",
          sub_x ? 1 : 2, sub_y ? 1 : 2, off + 4, off,
          (BLOCK_SIZE >> sub_x) * dx,
          (BLOCK_SIZE >> sub_y) * dy,
@@ -526,6 +566,7 @@ struct grain_obj_av1 {
     // Previous parameters used to check reusability
     struct pl_film_grain_data data;
     struct pl_color_repr repr;
+    int sub_x, sub_y;
     bool fg_has_y;
     bool fg_has_u;
     bool fg_has_v;
@@ -659,6 +700,7 @@ bool pl_shader_fg_av1(pl_shader sh, pl_shader_obj *grain_state,
     // change per frame anyway.
     bool needs_update = !av1_grain_data_eq(&params->data, &obj->data) ||
                         !pl_color_repr_equal(params->repr, &obj->repr) ||
+                        sub_x != obj->sub_x || sub_y != obj->sub_y ||
                         fg_has_y != obj->fg_has_y ||
                         fg_has_u != obj->fg_has_u ||
                         fg_has_v != obj->fg_has_v;
@@ -694,15 +736,19 @@ bool pl_shader_fg_av1(pl_shader sh, pl_shader_obj *grain_state,
     // Try merging the chroma LUTs into a single texture
     int chroma_comps = 0;
     if (fg_has_u) {
-        generate_grain_uv(&obj->grain[chroma_comps][0][0], obj->grain_tmp_uv,
-                          obj->grain_tmp_y, PL_CHANNEL_CB, sub_x, sub_y,
-                          params);
+        if (needs_update) {
+            generate_grain_uv(&obj->grain[chroma_comps][0][0], obj->grain_tmp_uv,
+                              obj->grain_tmp_y, PL_CHANNEL_CB, sub_x, sub_y,
+                              params);
+        }
         idx[1] = chroma_comps++;
     }
     if (fg_has_v) {
-        generate_grain_uv(&obj->grain[chroma_comps][0][0], obj->grain_tmp_uv,
-                          obj->grain_tmp_y, PL_CHANNEL_CR, sub_x, sub_y,
-                          params);
+        if (needs_update) {
+            generate_grain_uv(&obj->grain[chroma_comps][0][0], obj->grain_tmp_uv,
+                              obj->grain_tmp_y, PL_CHANNEL_CR, sub_x, sub_y,
+                              params);
+        }
         idx[2] = chroma_comps++;
     }
 
@@ -809,6 +855,8 @@ bool pl_shader_fg_av1(pl_shader sh, pl_shader_obj *grain_state,
     // Done updating LUTs
     obj->data = params->data;
     obj->repr = *params->repr;
+    obj->sub_x = sub_x;
+    obj->sub_y = sub_y;
     obj->fg_has_y = fg_has_y;
     obj->fg_has_u = fg_has_u;
     obj->fg_has_v = fg_has_v;
@@ -835,13 +883,15 @@ bool pl_shader_fg_av1(pl_shader sh, pl_shader_obj *grain_state,
 
     // Load the data vector which holds the offsets
     if (is_compute) {
-        GLSLH("shared uint data; \n");
+        ident_t sdata = sh_fresh(sh, "data");
+        GLSLH("shared uint "$"; \n", sdata);
         GLSL("if (gl_LocalInvocationIndex == 0u) \n"
-             "    data = uint(%s(block_id));     \n"
-             "barrier();                         \n",
-             offsets);
+             "    "$" = uint("$"(block_id));     \n"
+             "barrier();                         \n"
+             "uint data = "$";                   \n",
+             sdata, offsets, sdata);
     } else {
-        GLSL("uint data = uint(%s(block_id)); \n", offsets);
+        GLSL("uint data = uint("$"(block_id)); \n", offsets);
     }
 
     struct grain_scale scale = get_grain_scale(params);
@@ -873,7 +923,7 @@ bool pl_shader_fg_av1(pl_shader sh, pl_shader_obj *grain_state,
     });
 
     ident_t tex_scale = SH_FLOAT(scale.texture_scale);
-    GLSL("color = vec4(%s) * texelFetch(%s, ivec2(global_id), 0); \n",
+    GLSL("color = vec4("$") * texelFetch("$", ivec2(global_id), 0); \n",
          tex_scale, tex);
 
     // If we need access to the external luma plane, load it now
@@ -883,7 +933,7 @@ bool pl_shader_fg_av1(pl_shader sh, pl_shader_obj *grain_state,
             // We already have the luma channel as part of the pre-sampled color
             for (int i = 0; i < 3; i++) {
                 if (channel_map(i, params) == PL_CHANNEL_Y) {
-                    GLSL("averageLuma = color[%s]; \n", SH_INT(i));
+                    GLSL("averageLuma = color["$"]; \n", SH_INT(i));
                     break;
                 }
             }
@@ -899,7 +949,7 @@ bool pl_shader_fg_av1(pl_shader sh, pl_shader_obj *grain_state,
             });
 
             GLSL("pos = global_id * uvec2(%du, %du);                    \n"
-                 "averageLuma = %s * texelFetch(%s, ivec2(pos), 0)[%s]; \n",
+                 "averageLuma = "$" * texelFetch("$", ivec2(pos), 0)["$"]; \n",
                  1 << sub_x, 1 << sub_y, tex_scale, luma,
                  SH_INT(params->luma_comp));
         }
@@ -953,12 +1003,12 @@ bool pl_shader_fg_av1(pl_shader sh, pl_shader_obj *grain_state,
                  "}                                             \n");
 
             // Correctly clip the interpolated grain
-            GLSL("grain = clamp(grain, %s, %s); \n", grain_min, grain_max);
+            GLSL("grain = clamp(grain, "$", "$"); \n", grain_min, grain_max);
         }
 
         if (c == PL_CHANNEL_Y) {
-            GLSL("color[%d] += %s(color[%d]) * grain;   \n"
-                 "color[%d] = clamp(color[%d], %s, %s); \n",
+            GLSL("color[%d] += "$"(color[%d]) * grain;  \n"
+                 "color[%d] = clamp(color[%d], "$", "$"); \n",
                  i, scaling[c], i,
                  i, i, minValue, maxLuma);
         } else {
@@ -981,11 +1031,11 @@ bool pl_shader_fg_av1(pl_shader sh, pl_shader_obj *grain_state,
                     .data = &(float) { c_offset * scale.grain_scale },
                 });
 
-                GLSL("val = dot(vec2(val, color[%d]), %s);  \n", i, mult);
-                GLSL("val += %s; \n", offset);
+                GLSL("val = dot(vec2(val, color[%d]), "$"); \n", i, mult);
+                GLSL("val += "$"; \n", offset);
             }
-            GLSL("color[%d] += %s(val) * grain;         \n"
-                 "color[%d] = clamp(color[%d], %s, %s); \n",
+            GLSL("color[%d] += "$"(val) * grain;        \n"
+                 "color[%d] = clamp(color[%d], "$", "$"); \n",
                  i, scaling[c],
                  i, i, minValue, maxChroma);
         }
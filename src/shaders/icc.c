@@ -19,6 +19,7 @@
 #include <math.h>
 
 #include "shaders.h"
+#include "pl_thread_pool.h"
 
 static cmsHPROFILE get_profile(pl_log log, cmsContext cms,
                                struct pl_icc_color_space iccsp,
@@ -178,52 +179,152 @@ static void error_callback(cmsContext cms, cmsUInt32Number code,
     pl_err(log, "lcms2: [%d] %s", (int) code, msg);
 }
 
-struct sh_icc_obj {
-    pl_log log;
+// Size of the 1D LUTs used for matrix-shaper profiles
+#define ICC_SHAPER_SIZE 1024
+
+// Decomposition of a transform between two matrix-shaper profiles into
+// per-channel input curves, an affine transform between the linear spaces,
+// and per-channel inverse output curves
+struct icc_shaper {
+    struct pl_matrix3x3 mat;
+    float offset[3];
+    float lin[ICC_SHAPER_SIZE][4]; // indexed by encoded input value
+    float enc[ICC_SHAPER_SIZE][4]; // indexed by sqrt(linear output value)
+};
+
+// Generated 3DLUT (or matrix-shaper decomposition), along with the
+// parameters it was generated for
+struct icc_lut {
     struct pl_icc_params params;
     struct pl_icc_color_space src, dst;
     struct pl_icc_result result;
     pl_shader_obj lut_obj;
-    bool updated; // to detect misuse of the API
+    struct icc_shaper *shaper;
+    pl_shader_obj lin_obj, enc_obj;
     bool ok;
+};
+
+// Number of previously generated 3DLUTs to keep around, so that switching
+// back and forth between e.g. displays or source color spaces is instant
+#define ICC_RECENT_LUTS 4
+
+struct sh_icc_obj {
+    pl_log log;
+    struct icc_lut cur;
+    struct icc_lut recent[ICC_RECENT_LUTS];
+    bool updated; // to detect misuse of the API
     ident_t lut;
+    ident_t lut_lin, lut_enc; // for matrix-shaper profiles
 };
 
-static void fill_icc(void *datap, const struct sh_lut_params *params)
+// Maximum number of jobs to split the 3DLUT generation across
+#define ICC_MAX_THREADS 8
+
+struct icc_slice {
+    pl_job job;
+    cmsHTRANSFORM trafo;
+    float *data;
+    int s_r, s_g, s_b;
+    int b_start, b_end;
+};
+
+static void fill_icc_slice(void *arg)
 {
-    struct sh_icc_obj *obj = params->priv;
-    pl_assert(params->comps == 4);
+    const struct icc_slice *sl = arg;
+    const int s_r = sl->s_r, s_g = sl->s_g, s_b = sl->s_b;
+    uint16_t *tmp = pl_alloc(NULL, 2 * s_r * 3 * sizeof(tmp[0]));
+    uint16_t *out = tmp + s_r * 3;
 
-    struct pl_icc_color_space src = obj->src;
-    cmsHPROFILE srcp = NULL, dstp = NULL;
-    cmsHTRANSFORM trafo = NULL;
-    uint16_t *tmp = NULL;
-    obj->ok = false;
+    for (int b = sl->b_start; b < sl->b_end; b++) {
+        for (int g = 0; g < s_g; g++) {
+            // Transform a single line of the output buffer
+            for (int r = 0; r < s_r; r++) {
+                tmp[r * 3 + 0] = r * 65535 / (s_r - 1);
+                tmp[r * 3 + 1] = g * 65535 / (s_g - 1);
+                tmp[r * 3 + 2] = b * 65535 / (s_b - 1);
+            }
+            cmsDoTransform(sl->trafo, tmp, out, s_r);
+
+            // Write this line into the right output position
+            size_t offset = (b * s_g + g) * s_r * 4;
+            float *data = sl->data + offset;
+            for (int r = 0; r < s_r; r++) {
+                data[r * 4 + 0] = out[r * 3 + 0] / 65535.0;
+                data[r * 4 + 1] = out[r * 3 + 1] / 65535.0;
+                data[r * 4 + 2] = out[r * 3 + 2] / 65535.0;
+                data[r * 4 + 3] = 1.0;
+            }
+        }
+    }
 
-    cmsContext cms = cmsCreateContext(NULL, (void *) obj->log);
-    if (!cms) {
+    pl_free(tmp);
+}
+
+// Opens the LittleCMS context and both profiles for `obj->cur`, updating
+// `obj->cur.result` in the process. Returns false on failure, in which case
+// the (partially) opened objects must still be released with `icc_close`.
+struct icc_profiles {
+    cmsContext cms;
+    cmsHPROFILE srcp, dstp;
+};
+
+static bool icc_open(struct sh_icc_obj *obj, struct icc_profiles *p)
+{
+    struct icc_lut *lut = &obj->cur;
+    struct pl_icc_color_space src = lut->src;
+    *p = (struct icc_profiles) {0};
+
+    p->cms = cmsCreateContext(NULL, (void *) obj->log);
+    if (!p->cms) {
         PL_ERR(obj, "Failed creating LittleCMS context!");
-        goto error;
+        return false;
     }
 
-    cmsSetLogErrorHandlerTHR(cms, error_callback);
+    cmsSetLogErrorHandlerTHR(p->cms, error_callback);
     clock_t start = clock();
-    dstp = get_profile(obj->log, cms, obj->dst, &obj->result.dst_color);
-    if (obj->params.use_display_contrast) {
-        src.color.hdr.max_luma = obj->result.dst_color.hdr.max_luma;
-        src.color.hdr.min_luma = obj->result.dst_color.hdr.min_luma;
+    p->dstp = get_profile(obj->log, p->cms, lut->dst, &lut->result.dst_color);
+    if (lut->params.use_display_contrast) {
+        src.color.hdr.max_luma = lut->result.dst_color.hdr.max_luma;
+        src.color.hdr.min_luma = lut->result.dst_color.hdr.min_luma;
     }
-    srcp = get_profile(obj->log, cms, src, &obj->result.src_color);
-    clock_t after_profiles = clock();
-    pl_log_cpu_time(obj->log, start, after_profiles, "opening ICC profiles");
-    if (!srcp || !dstp)
-        goto error;
+    p->srcp = get_profile(obj->log, p->cms, src, &lut->result.src_color);
+    pl_log_cpu_time(obj->log, start, clock(), "opening ICC profiles");
+    return p->srcp && p->dstp;
+}
 
-    uint32_t flags = cmsFLAGS_HIGHRESPRECALC | cmsFLAGS_BLACKPOINTCOMPENSATION |
-                     cmsFLAGS_NOCACHE;
+static void icc_close(struct icc_profiles *p)
+{
+    if (p->srcp)
+        cmsCloseProfile(p->srcp);
+    if (p->dstp)
+        cmsCloseProfile(p->dstp);
+    if (p->cms)
+        cmsDeleteContext(p->cms);
+    *p = (struct icc_profiles) {0};
+}
+
+// Note: cmsFLAGS_NOCACHE is required for the transform to be usable from
+// multiple threads at the same time
+static const uint32_t icc_flags = cmsFLAGS_HIGHRESPRECALC |
+                                  cmsFLAGS_BLACKPOINTCOMPENSATION |
+                                  cmsFLAGS_NOCACHE;
 
-    trafo = cmsCreateTransformTHR(cms, srcp, TYPE_RGB_16, dstp, TYPE_RGB_16,
-                                  obj->params.intent, flags);
+static void fill_icc(void *datap, const struct sh_lut_params *params)
+{
+    struct sh_icc_obj *obj = params->priv;
+    struct icc_lut *lut = &obj->cur;
+    pl_assert(params->comps == 4);
+
+    struct icc_profiles p;
+    cmsHTRANSFORM trafo = NULL;
+    lut->ok = false;
+
+    if (!icc_open(obj, &p))
+        goto error;
+
+    clock_t after_profiles = clock();
+    trafo = cmsCreateTransformTHR(p.cms, p.srcp, TYPE_RGB_16, p.dstp, TYPE_RGB_16,
+                                  lut->params.intent, icc_flags);
     clock_t after_transform = clock();
     pl_log_cpu_time(obj->log, after_profiles, after_transform, "creating ICC transform");
     if (!trafo) {
@@ -233,52 +334,210 @@ static void fill_icc(void *datap, const struct sh_lut_params *params)
 
     int s_r = params->width, s_g = params->height, s_b = params->depth;
     pl_assert(s_r > 1 && s_g > 1 && s_b > 1);
-    tmp = pl_alloc(NULL, 2 * s_r * 3 * sizeof(tmp[0]));
 
-    uint16_t *out = tmp + s_r * 3;
-    for (int b = 0; b < s_b; b++) {
-        for (int g = 0; g < s_g; g++) {
-            // Transform a single line of the output buffer
-            for (int r = 0; r < s_r; r++) {
-                tmp[r * 3 + 0] = r * 65535 / (s_r - 1);
-                tmp[r * 3 + 1] = g * 65535 / (s_g - 1);
-                tmp[r * 3 + 2] = b * 65535 / (s_b - 1);
-            }
-            cmsDoTransform(trafo, tmp, out, s_r);
+    // Split the 3DLUT into slabs along the blue axis, and generate each of
+    // them as a separate background job
+    struct icc_slice slices[ICC_MAX_THREADS];
+    const int num_slices = PL_MIN(s_b, ICC_MAX_THREADS);
+    for (int i = 0; i < num_slices; i++) {
+        slices[i] = (struct icc_slice) {
+            .trafo = trafo,
+            .data = datap,
+            .s_r = s_r,
+            .s_g = s_g,
+            .s_b = s_b,
+            .b_start = i * s_b / num_slices,
+            .b_end = (i + 1) * s_b / num_slices,
+        };
+
+        // The last slice is always generated on the calling thread
+        if (i < num_slices - 1)
+            slices[i].job = pl_job_submit(obj->log, fill_icc_slice, &slices[i]);
+    }
 
-            // Write this line into the right output position
-            size_t offset = (b * s_g + g) * s_r * 4;
-            float *data = ((float *) datap) + offset;
-            for (int r = 0; r < s_r; r++) {
-                data[r * 4 + 0] = out[r * 3 + 0] / 65535.0;
-                data[r * 4 + 1] = out[r * 3 + 1] / 65535.0;
-                data[r * 4 + 2] = out[r * 3 + 2] / 65535.0;
-                data[r * 4 + 3] = 1.0;
-            }
+    for (int i = num_slices - 1; i >= 0; i--) {
+        if (slices[i].job) {
+            pl_job_wait(&slices[i].job);
+        } else {
+            fill_icc_slice(&slices[i]); // fall back to synchronous generation
         }
     }
 
     pl_log_cpu_time(obj->log, after_transform, clock(), "generating ICC 3DLUT");
-    obj->ok = true;
+    lut->ok = true;
     // fall through
 
 error:
     if (trafo)
         cmsDeleteTransform(trafo);
-    if (srcp)
-        cmsCloseProfile(srcp);
-    if (dstp)
-        cmsCloseProfile(dstp);
-    if (cms)
-        cmsDeleteContext(cms);
-
-    pl_free_ptr(&tmp);
+    icc_close(&p);
+}
+
+// Returns true if `prof` is applied as a plain matrix/TRC profile in the
+// given direction, i.e. without any CLUT-based tags taking precedence
+static bool icc_is_shaper(cmsHPROFILE prof, enum pl_rendering_intent intent,
+                          int direction)
+{
+    return cmsGetColorSpace(prof) == cmsSigRgbData &&
+           cmsIsMatrixShaper(prof) && !cmsIsCLUT(prof, intent, direction);
+}
+
+static const cmsTagSignature icc_trc_tags[3] = {
+    cmsSigRedTRCTag, cmsSigGreenTRCTag, cmsSigBlueTRCTag,
+};
+
+// Attempts to decompose the transform between two matrix-shaper profiles
+// into 1D curves and an affine transform, which is exact for this class of
+// profiles (black point compensation included), and replaces the 3DLUT.
+// On success, sets `obj->cur.shaper` and `obj->cur.ok`.
+static void icc_probe_shaper(struct sh_icc_obj *obj)
+{
+    struct icc_lut *lut = &obj->cur;
+    const enum pl_rendering_intent intent = lut->params.intent;
+    struct icc_shaper *shaper = NULL;
+    cmsToneCurve *dst_inv[3] = {0};
+    cmsHTRANSFORM trafo = NULL;
+    struct icc_profiles p;
+
+    if (!icc_open(obj, &p))
+        goto done;
+    if (!icc_is_shaper(p.srcp, intent, LCMS_USED_AS_INPUT) ||
+        !icc_is_shaper(p.dstp, intent, LCMS_USED_AS_OUTPUT))
+        goto done;
+
+    const cmsToneCurve *src_trc[3], *dst_trc[3];
+    for (int c = 0; c < 3; c++) {
+        src_trc[c] = cmsReadTag(p.srcp, icc_trc_tags[c]);
+        dst_trc[c] = cmsReadTag(p.dstp, icc_trc_tags[c]);
+        if (!src_trc[c] || !dst_trc[c])
+            goto done;
+        // The 16-bit 3DLUT pipeline clips the curves to [0, 1]
+        if (cmsEvalToneCurveFloat(src_trc[c], 1.0f) > 1.0f + 1e-6f)
+            goto done;
+        dst_inv[c] = cmsReverseToneCurve(dst_trc[c]);
+        if (!dst_inv[c])
+            goto done;
+    }
+
+    trafo = cmsCreateTransformTHR(p.cms, p.srcp, TYPE_RGB_DBL, p.dstp,
+                                  TYPE_RGB_DBL, intent, icc_flags);
+    if (!trafo)
+        goto done;
+
+    // Recover the affine transform between the linear spaces by probing
+    // small, in-gamut deviations from mid-gray along each channel
+    double in[4][3] = {
+        {0.50, 0.50, 0.50},
+        {0.75, 0.50, 0.50},
+        {0.50, 0.75, 0.50},
+        {0.50, 0.50, 0.75},
+    };
+    double out[4][3], lin_in[4][3], lin_out[4][3];
+    cmsDoTransform(trafo, in, out, 4);
+    for (int i = 0; i < 4; i++) {
+        for (int c = 0; c < 3; c++) {
+            lin_in[i][c] = cmsEvalToneCurveFloat(src_trc[c], in[i][c]);
+            lin_out[i][c] = cmsEvalToneCurveFloat(dst_trc[c], out[i][c]);
+        }
+    }
+
+    shaper = pl_alloc_ptr(NULL, shaper);
+    for (int i = 0; i < 3; i++) {
+        double delta = lin_in[i + 1][i] - lin_in[0][i];
+        if (fabs(delta) < 1e-6)
+            goto done;
+        for (int r = 0; r < 3; r++)
+            shaper->mat.m[r][i] = (lin_out[i + 1][r] - lin_out[0][r]) / delta;
+    }
+
+    for (int r = 0; r < 3; r++) {
+        double off = lin_out[0][r];
+        for (int i = 0; i < 3; i++)
+            off -= shaper->mat.m[r][i] * lin_in[0][i];
+        shaper->offset[r] = off;
+    }
+
+    // Verify the decomposition against the actual transform, to guard
+    // against any non-affine processing hidden inside LittleCMS
+    enum { GRID = 5 };
+    double grid[GRID * GRID * GRID][3], ref[GRID * GRID * GRID][3];
+    for (int i = 0; i < GRID * GRID * GRID; i++) {
+        grid[i][0] = (double) (i % GRID) / (GRID - 1);
+        grid[i][1] = (double) (i / GRID % GRID) / (GRID - 1);
+        grid[i][2] = (double) (i / (GRID * GRID)) / (GRID - 1);
+    }
+
+    cmsDoTransform(trafo, grid, ref, GRID * GRID * GRID);
+    for (int i = 0; i < GRID * GRID * GRID; i++) {
+        float lin[3];
+        for (int c = 0; c < 3; c++)
+            lin[c] = cmsEvalToneCurveFloat(src_trc[c], grid[i][c]);
+        for (int r = 0; r < 3; r++) {
+            float v = shaper->offset[r];
+            for (int c = 0; c < 3; c++)
+                v += shaper->mat.m[r][c] * lin[c];
+            v = cmsEvalToneCurveFloat(dst_inv[r], PL_CLAMP(v, 0.0f, 1.0f));
+            if (fabs(v - PL_CLAMP(ref[i][r], 0.0, 1.0)) > 1e-3) {
+                PL_DEBUG(obj, "Matrix-shaper decomposition inexact, falling "
+                         "back to 3DLUT");
+                goto done;
+            }
+        }
+    }
+
+    for (int i = 0; i < ICC_SHAPER_SIZE; i++) {
+        const float x = (float) i / (ICC_SHAPER_SIZE - 1);
+        for (int c = 0; c < 3; c++) {
+            shaper->lin[i][c] = cmsEvalToneCurveFloat(src_trc[c], x);
+            shaper->enc[i][c] = cmsEvalToneCurveFloat(dst_inv[c], x * x);
+        }
+        shaper->lin[i][3] = shaper->enc[i][3] = 1.0f;
+    }
+
+    PL_INFO(obj, "Using matrix-shaper decomposition instead of 3DLUT");
+    lut->shaper = shaper;
+    lut->ok = true;
+    shaper = NULL;
+    // fall through
+
+done:
+    pl_free(shaper);
+    if (trafo)
+        cmsDeleteTransform(trafo);
+    for (int c = 0; c < 3; c++) {
+        if (dst_inv[c])
+            cmsFreeToneCurve(dst_inv[c]);
+    }
+    icc_close(&p);
+}
+
+static void fill_shaper_lin(void *datap, const struct sh_lut_params *params)
+{
+    const struct icc_shaper *shaper = params->priv;
+    memcpy(datap, shaper->lin, sizeof(shaper->lin));
+}
+
+static void fill_shaper_enc(void *datap, const struct sh_lut_params *params)
+{
+    const struct icc_shaper *shaper = params->priv;
+    memcpy(datap, shaper->enc, sizeof(shaper->enc));
+}
+
+static void icc_lut_free(struct icc_lut *lut)
+{
+    pl_shader_obj_destroy(&lut->lut_obj);
+    pl_shader_obj_destroy(&lut->lin_obj);
+    pl_shader_obj_destroy(&lut->enc_obj);
+    pl_free(lut->shaper);
+    *lut = (struct icc_lut) {0};
 }
 
 static void sh_icc_uninit(pl_gpu gpu, void *ptr)
 {
     struct sh_icc_obj *obj = ptr;
-    pl_shader_obj_destroy(&obj->lut_obj);
+    icc_lut_free(&obj->cur);
+    for (int i = 0; i < ICC_RECENT_LUTS; i++)
+        icc_lut_free(&obj->recent[i]);
     *obj = (struct sh_icc_obj) {0};
 }
 
@@ -289,6 +548,48 @@ static bool icc_csp_eq(const struct pl_icc_color_space *a,
            pl_color_space_equal(&a->color, &b->color);
 }
 
+static bool icc_lut_compat(const struct icc_lut *lut,
+                           const struct pl_icc_color_space *src,
+                           const struct pl_icc_color_space *dst,
+                           const struct pl_icc_params *params)
+{
+    return (lut->lut_obj || lut->shaper) &&
+           icc_csp_eq(&lut->src, src) && icc_csp_eq(&lut->dst, dst) &&
+           !memcmp(&lut->params, params, sizeof(*params));
+}
+
+// Makes a compatible 3DLUT current, if one was generated previously.
+// Otherwise, retires the current 3DLUT (if any) to the list of recently used
+// LUTs and returns false, leaving `obj->cur` empty.
+static bool icc_reuse_lut(struct sh_icc_obj *obj,
+                          const struct pl_icc_color_space *src,
+                          const struct pl_icc_color_space *dst,
+                          const struct pl_icc_params *params)
+{
+    if (icc_lut_compat(&obj->cur, src, dst, params))
+        return true;
+
+    for (int i = 0; i < ICC_RECENT_LUTS; i++) {
+        if (icc_lut_compat(&obj->recent[i], src, dst, params)) {
+            PL_SWAP(obj->cur, obj->recent[i]);
+            return true;
+        }
+    }
+
+    if (!obj->cur.ok) {
+        // Don't keep around failed LUTs
+        icc_lut_free(&obj->cur);
+        return false;
+    }
+
+    const int last = ICC_RECENT_LUTS - 1;
+    icc_lut_free(&obj->recent[last]);
+    memmove(&obj->recent[1], &obj->recent[0], last * sizeof(obj->recent[0]));
+    obj->recent[0] = obj->cur;
+    obj->cur = (struct icc_lut) {0};
+    return false;
+}
+
 bool pl_icc_update(pl_shader sh,
                    const struct pl_icc_color_space *srcp,
                    const struct pl_icc_color_space *dstp,
@@ -311,32 +612,64 @@ bool pl_icc_update(pl_shader sh,
     pl_color_space_infer(&src.color);
     pl_color_space_infer_ref(&dst.color, &src.color);
 
-    bool changed = !icc_csp_eq(&obj->src, &src) ||
-                   !icc_csp_eq(&obj->dst, &dst) ||
-                   memcmp(&obj->params, params, sizeof(*params));
+    bool changed = !icc_reuse_lut(obj, &src, &dst, params);
 
     // Update the object, since we need this information from `fill_icc`
     obj->log = sh->log;
-    obj->params = *params;
-    obj->src = src;
-    obj->dst = dst;
+    obj->cur.params = *params;
+    obj->cur.src = src;
+    obj->cur.dst = dst;
+    if (changed)
+        icc_probe_shaper(obj);
+
+    obj->lut = obj->lut_lin = obj->lut_enc = NULL_IDENT;
+    if (obj->cur.shaper) {
+        obj->lut_lin = sh_lut(sh, sh_lut_params(
+            .object = &obj->cur.lin_obj,
+            .type = PL_VAR_FLOAT,
+            .width = ICC_SHAPER_SIZE,
+            .comps = 4,
+            .linear = true,
+            .update = changed,
+            .fill = fill_shaper_lin,
+            .priv = obj->cur.shaper,
+        ));
+        obj->lut_enc = sh_lut(sh, sh_lut_params(
+            .object = &obj->cur.enc_obj,
+            .type = PL_VAR_FLOAT,
+            .width = ICC_SHAPER_SIZE,
+            .comps = 4,
+            .linear = true,
+            .update = changed,
+            .fill = fill_shaper_enc,
+            .priv = obj->cur.shaper,
+        ));
+        if (!obj->lut_lin || !obj->lut_enc)
+            return false;
+
+        obj->updated = true;
+        *out = obj->cur.result;
+        return true;
+    }
+
     obj->lut = sh_lut(sh, sh_lut_params(
-        .object = &obj->lut_obj,
+        .object = &obj->cur.lut_obj,
         .type = PL_VAR_FLOAT,
         .width = s_r,
         .height = s_g,
         .depth = s_b,
         .comps = 4,
         .linear = true,
+        .tetrahedral = params->tetrahedral,
         .update = changed,
         .fill = fill_icc,
         .priv = obj,
     ));
-    if (!obj->lut || !obj->ok)
+    if (!obj->lut || !obj->cur.ok)
         return false;
 
     obj->updated = true;
-    *out = obj->result;
+    *out = obj->cur.result;
     return true;
 }
 
@@ -348,14 +681,39 @@ void pl_icc_apply(pl_shader sh, pl_shader_obj *icc)
     struct sh_icc_obj *obj;
     obj = SH_OBJ(sh, icc, PL_SHADER_OBJ_ICC,
                  struct sh_icc_obj, sh_icc_uninit);
-    if (!obj || !obj->lut || !obj->updated || !obj->ok) {
+    bool has_lut = obj && (obj->lut || (obj->lut_lin && obj->lut_enc));
+    if (!has_lut || !obj->updated || !obj->cur.ok) {
         SH_FAIL(sh, "pl_icc_apply called without prior pl_icc_update?");
         return;
     }
 
+    if (obj->cur.shaper) {
+        const struct icc_shaper *shaper = obj->cur.shaper;
+        sh_describe(sh, "ICC matrix-shaper");
+        GLSL("// pl_icc_apply (matrix-shaper)                      \n"
+             "color.rgb = vec3("$"(color.r).r, "$"(color.g).g,     \n"
+             "                 "$"(color.b).b);                    \n"
+             "color.rgb = "$" * color.rgb + "$";                   \n"
+             "color.rgb = sqrt(clamp(color.rgb, 0.0, 1.0));        \n"
+             "color.rgb = vec3("$"(color.r).r, "$"(color.g).g,     \n"
+             "                 "$"(color.b).b);                    \n",
+             obj->lut_lin, obj->lut_lin, obj->lut_lin,
+             sh_var(sh, (struct pl_shader_var) {
+                 .var = pl_var_mat3("icc_mat"),
+                 .data = PL_TRANSPOSE_3X3(shaper->mat.m),
+             }),
+             sh_var(sh, (struct pl_shader_var) {
+                 .var = pl_var_vec3("icc_offset"),
+                 .data = shaper->offset,
+             }),
+             obj->lut_enc, obj->lut_enc, obj->lut_enc);
+        obj->updated = false;
+        return;
+    }
+
     sh_describe(sh, "ICC 3DLUT");
     GLSL("// pl_icc_apply \n"
-         "color.rgb = %s(color.rgb).rgb; \n",
+         "color.rgb = "$"(color.rgb).rgb; \n",
          obj->lut);
 
     obj->updated = false;
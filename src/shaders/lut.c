@@ -25,6 +25,48 @@ static inline bool isnumeric(char c)
     return (c >= '0' && c <= '9') || c == '-';
 }
 
+// Fast path for parsing the plain decimal numbers (e.g. `0.123456`) making up
+// the bulk of typical .cube files. Returns the number of bytes consumed, or 0
+// if the number needs to be parsed by the (slower) general purpose parser.
+static inline size_t parse_cube_num(pl_str str, float *out)
+{
+    static const double exp10[] = {
+        1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10,
+        1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18,
+    };
+
+    size_t pos = 0;
+    bool neg = false;
+    if (pos < str.len && (str.buf[pos] == '-' || str.buf[pos] == '+'))
+        neg = str.buf[pos++] == '-';
+
+    uint64_t mant = 0;
+    int digits = 0, frac = -1;
+    for (; pos < str.len; pos++) {
+        uint8_t c = str.buf[pos];
+        if (c >= '0' && c <= '9') {
+            mant = mant * 10 + (c - '0');
+            digits++;
+            frac += frac >= 0;
+        } else if (c == '.' && frac < 0) {
+            frac = 0;
+        } else {
+            break;
+        }
+    }
+
+    // Exactly representable as double, so the division below rounds exactly
+    // like the general purpose parser would
+    if (!digits || digits >= PL_ARRAY_SIZE(exp10) || mant >> 53)
+        return 0;
+    if (pos < str.len && (str.buf[pos] == 'e' || str.buf[pos] == 'E'))
+        return 0;
+
+    double num = frac > 0 ? mant / exp10[frac] : mant;
+    *out = neg ? -num : num;
+    return pos;
+}
+
 void pl_lut_free(struct pl_custom_lut **lut)
 {
     pl_free_ptr(lut);
@@ -140,8 +182,16 @@ struct pl_custom_lut *pl_lut_parse_cube(pl_log log, const char *cstr, size_t cst
         for (int c = 0; c < 3; c++) {
             static const char * const digits = "0123456789.-+e";
 
+            float num;
+            size_t len = parse_cube_num(str, &num);
+            if (len) {
+                str.buf += len;
+                str.len -= len;
+                goto got_num;
+            }
+
             // Extract valid digit sequence
-            size_t len = pl_strspn(str, digits);
+            len = pl_strspn(str, digits);
             pl_str entry = (pl_str) { str.buf, len };
             str.buf += len;
             str.len -= len;
@@ -157,12 +207,12 @@ struct pl_custom_lut *pl_lut_parse_cube(pl_log log, const char *cstr, size_t cst
                 goto error;
             }
 
-            float num;
             if (!pl_str_parse_float(entry, &num)) {
                 pl_err(log, "Failed parsing float value '%.*s'", PL_STR_FMT(entry));
                 goto error;
             }
 
+got_num:
             // Rescale to range 0.0 - 1.0
             *data++ = (num - min[c]) / (max[c] - min[c]);
 
@@ -183,6 +233,152 @@ error:
     return NULL;
 }
 
+// Binary LUT format. This consists of a fixed-size header followed by the raw
+// LUT data (in native byte order), which can be used directly (e.g. from a
+// memory mapped file) without any further parsing or copying.
+static const char lut_magic[] = {'P', 'L', 'U', 'T'};
+static const uint32_t lut_version = 1;
+static const uint32_t lut_byte_order = 0x01020304;
+
+struct lut_header {
+    char magic[4];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t size[3];
+    uint64_t signature;
+    float shaper_in[3][3], shaper_out[3][3];
+    struct lut_csp {
+        uint32_t sys, levels;
+        uint32_t primaries, transfer;
+        float min_luma, max_luma;
+    } in, out;
+};
+
+static struct lut_csp csp_save(const struct pl_color_repr *repr,
+                               const struct pl_color_space *csp)
+{
+    return (struct lut_csp) {
+        .sys        = repr->sys,
+        .levels     = repr->levels,
+        .primaries  = csp->primaries,
+        .transfer   = csp->transfer,
+        .min_luma   = csp->hdr.min_luma,
+        .max_luma   = csp->hdr.max_luma,
+    };
+}
+
+static bool csp_load(const struct lut_csp *in, struct pl_color_repr *repr,
+                     struct pl_color_space *csp)
+{
+    if (in->sys >= PL_COLOR_SYSTEM_COUNT || in->levels >= PL_COLOR_LEVELS_COUNT ||
+        in->primaries >= PL_COLOR_PRIM_COUNT || in->transfer >= PL_COLOR_TRC_COUNT)
+        return false;
+
+    repr->sys = in->sys;
+    repr->levels = in->levels;
+    csp->primaries = in->primaries;
+    csp->transfer = in->transfer;
+    csp->hdr.min_luma = in->min_luma;
+    csp->hdr.max_luma = in->max_luma;
+    return true;
+}
+
+static uint64_t lut_entries(const int size[3])
+{
+    return (uint64_t) size[0] * PL_DEF(size[1], 1) * PL_DEF(size[2], 1);
+}
+
+size_t pl_lut_save(const struct pl_custom_lut *lut, uint8_t *out)
+{
+    pl_static_assert(sizeof(struct lut_header) % sizeof(float) == 0);
+    size_t data_size = lut_entries(lut->size) * sizeof(float[3]);
+    if (out) {
+        struct lut_header hdr = {
+            .version    = lut_version,
+            .byte_order = lut_byte_order,
+            .size       = { lut->size[0], lut->size[1], lut->size[2] },
+            .signature  = lut->signature,
+            .in         = csp_save(&lut->repr_in, &lut->color_in),
+            .out        = csp_save(&lut->repr_out, &lut->color_out),
+        };
+
+        memcpy(hdr.magic, lut_magic, sizeof(lut_magic));
+        memcpy(hdr.shaper_in, lut->shaper_in.m, sizeof(hdr.shaper_in));
+        memcpy(hdr.shaper_out, lut->shaper_out.m, sizeof(hdr.shaper_out));
+        memcpy(out, &hdr, sizeof(hdr));
+        memcpy(out + sizeof(hdr), lut->data, data_size);
+    }
+
+    return sizeof(struct lut_header) + data_size;
+}
+
+struct pl_custom_lut *pl_lut_load(pl_log log, const uint8_t *buf, size_t buf_len)
+{
+    struct lut_header hdr;
+    if (buf_len < sizeof(hdr)) {
+        pl_err(log, "Failed loading LUT: truncated header");
+        return NULL;
+    }
+
+    memcpy(&hdr, buf, sizeof(hdr));
+    if (memcmp(hdr.magic, lut_magic, sizeof(lut_magic)) != 0) {
+        pl_err(log, "Failed loading LUT: invalid magic bytes");
+        return NULL;
+    }
+
+    if (hdr.version != lut_version) {
+        pl_err(log, "Failed loading LUT: wrong version");
+        return NULL;
+    }
+
+    if (hdr.byte_order != lut_byte_order) {
+        pl_err(log, "Failed loading LUT: byte order mismatch");
+        return NULL;
+    }
+
+    struct pl_custom_lut *lut = pl_zalloc_ptr(NULL, lut);
+    for (int i = 0; i < 3; i++) {
+        if (hdr.size[i] > 65536) {
+            pl_err(log, "Failed loading LUT: invalid dimensions %ux%ux%u",
+                   hdr.size[0], hdr.size[1], hdr.size[2]);
+            goto error;
+        }
+        lut->size[i] = hdr.size[i];
+    }
+
+    uint64_t data_size = lut_entries(lut->size) * sizeof(float[3]);
+    if (!lut->size[0] || buf_len - sizeof(hdr) < data_size) {
+        pl_err(log, "Failed loading LUT: truncated data, expected %llu bytes",
+               (unsigned long long) data_size);
+        goto error;
+    }
+
+    if (!csp_load(&hdr.in, &lut->repr_in, &lut->color_in) ||
+        !csp_load(&hdr.out, &lut->repr_out, &lut->color_out))
+    {
+        pl_err(log, "Failed loading LUT: invalid color metadata");
+        goto error;
+    }
+
+    lut->signature = hdr.signature;
+    memcpy(lut->shaper_in.m, hdr.shaper_in, sizeof(hdr.shaper_in));
+    memcpy(lut->shaper_out.m, hdr.shaper_out, sizeof(hdr.shaper_out));
+
+    // Reference the data directly if possible, to avoid a redundant copy
+    const uint8_t *data = buf + sizeof(hdr);
+    if ((uintptr_t) data % sizeof(float) == 0) {
+        lut->data = (const float *) data;
+    } else {
+        lut->data = pl_memdup(lut, data, data_size);
+    }
+
+    return lut;
+
+error:
+    pl_free(lut);
+    return NULL;
+}
+
 static void fill_lut(void *datap, const struct sh_lut_params *params)
 {
     const struct pl_custom_lut *lut = params->priv;
@@ -235,6 +431,7 @@ void pl_shader_custom_lut(pl_shader sh, const struct pl_custom_lut *lut,
         .depth = lut->size[2],
         .comps = 4, // for better texel alignment
         .linear = true,
+        .tetrahedral = lut->tetrahedral,
         .signature = lut->signature,
         .fill = fill_lut,
         .priv = (void *) lut,
@@ -249,7 +446,7 @@ void pl_shader_custom_lut(pl_shader sh, const struct pl_custom_lut *lut,
 
     static const struct pl_matrix3x3 zero = {0};
     if (memcmp(&lut->shaper_in, &zero, sizeof(zero)) != 0) {
-        GLSL("color.rgb = %s * color.rgb; \n", sh_var(sh, (struct pl_shader_var) {
+        GLSL("color.rgb = "$" * color.rgb; \n", sh_var(sh, (struct pl_shader_var) {
             .var = pl_var_mat3("shaper_in"),
             .data = PL_TRANSPOSE_3X3(lut->shaper_in.m),
         }));
@@ -258,17 +455,17 @@ void pl_shader_custom_lut(pl_shader sh, const struct pl_custom_lut *lut,
     switch (dims) {
     case 1:
         sh_describe(sh, "custom 1DLUT");
-        GLSL("color.rgb = vec3(%s(color.r).r, %s(color.g).g, %s(color.b).b); \n",
+        GLSL("color.rgb = vec3("$"(color.r).r, "$"(color.g).g, "$"(color.b).b); \n",
              fun, fun, fun);
         break;
     case 3:
         sh_describe(sh, "custom 3DLUT");
-        GLSL("color.rgb = %s(color.rgb).rgb; \n", fun);
+        GLSL("color.rgb = "$"(color.rgb).rgb; \n", fun);
         break;
     }
 
     if (memcmp(&lut->shaper_out, &zero, sizeof(zero)) != 0) {
-        GLSL("color.rgb = %s * color.rgb; \n", sh_var(sh, (struct pl_shader_var) {
+        GLSL("color.rgb = "$" * color.rgb; \n", sh_var(sh, (struct pl_shader_var) {
             .var = pl_var_mat3("shaper_out"),
             .data = PL_TRANSPOSE_3X3(lut->shaper_out.m),
         }));
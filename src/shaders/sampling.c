@@ -38,6 +38,44 @@ enum filter {
     FASTEST,
 };
 
+// Helper function to compute the src/dst sizes
+static void src_size(const struct pl_sample_src *src, float *src_w, float *src_h,
+                     int *out_w, int *out_h)
+{
+    if (src->tex) {
+        *src_w = pl_rect_w(src->rect);
+        *src_h = pl_rect_h(src->rect);
+    } else {
+        *src_w = src->sampled_w;
+        *src_h = src->sampled_h;
+    }
+
+    *src_w = PL_DEF(*src_w, src_params(src).w);
+    *src_h = PL_DEF(*src_h, src_params(src).h);
+    pl_assert(*src_w && *src_h);
+
+    *out_w = PL_DEF(src->new_w, roundf(fabs(*src_w)));
+    *out_h = PL_DEF(src->new_h, roundf(fabs(*src_h)));
+    pl_assert(*out_w && *out_h);
+}
+
+static uint8_t src_comp_mask(const struct pl_sample_src *src)
+{
+    uint8_t tex_mask = 0x0Fu;
+    if (src->tex) {
+        // Mask containing only the number of components in the texture
+        tex_mask = (1 << src->tex->params.format->num_components) - 1;
+    }
+
+    uint8_t src_mask = src->component_mask;
+    if (!src_mask)
+        src_mask = (1 << PL_DEF(src->components, 4)) - 1;
+
+    // Only actually sample components that are both requested and
+    // available in the texture being sampled
+    return tex_mask & src_mask;
+}
+
 // Helper function to compute the src/dst sizes and upscaling ratios
 static bool setup_src(pl_shader sh, const struct pl_sample_src *src,
                       ident_t *src_tex, ident_t *pos, ident_t *size, ident_t *pt,
@@ -53,8 +91,6 @@ static bool setup_src(pl_shader sh, const struct pl_sample_src *src,
         bool can_linear = fmt->caps & PL_FMT_CAP_LINEAR;
         pl_assert(pl_tex_params_dimension(src->tex->params) == 2);
         sig = PL_SHADER_SIG_NONE;
-        src_w = pl_rect_w(src->rect);
-        src_h = pl_rect_h(src->rect);
         switch (filter) {
         case FASTEST:
         case NEAREST:
@@ -76,8 +112,6 @@ static bool setup_src(pl_shader sh, const struct pl_sample_src *src,
     } else {
         pl_assert(src->tex_w && src->tex_h);
         sig = PL_SHADER_SIG_SAMPLER;
-        src_w = src->sampled_w;
-        src_h = src->sampled_h;
         if (filter == BEST || filter == FASTEST) {
             sample_mode = src->mode;
         } else {
@@ -90,13 +124,8 @@ static bool setup_src(pl_shader sh, const struct pl_sample_src *src,
         }
     }
 
-    src_w = PL_DEF(src_w, src_params(src).w);
-    src_h = PL_DEF(src_h, src_params(src).h);
-    pl_assert(src_w && src_h);
-
-    int out_w = PL_DEF(src->new_w, roundf(fabs(src_w)));
-    int out_h = PL_DEF(src->new_h, roundf(fabs(src_h)));
-    pl_assert(out_w && out_h);
+    int out_w, out_h;
+    src_size(src, &src_w, &src_h, &out_w, &out_h);
 
     if (ratio_x)
         *ratio_x = out_w / fabs(src_w);
@@ -105,21 +134,8 @@ static bool setup_src(pl_shader sh, const struct pl_sample_src *src,
     if (scale)
         *scale = PL_DEF(src->scale, 1.0);
 
-    if (comp_mask) {
-        uint8_t tex_mask = 0x0Fu;
-        if (src->tex) {
-            // Mask containing only the number of components in the texture
-            tex_mask = (1 << src->tex->params.format->num_components) - 1;
-        }
-
-        uint8_t src_mask = src->component_mask;
-        if (!src_mask)
-            src_mask = (1 << PL_DEF(src->components, 4)) - 1;
-
-        // Only actually sample components that are both requested and
-        // available in the texture being sampled
-        *comp_mask = tex_mask & src_mask;
-    }
+    if (comp_mask)
+        *comp_mask = src_comp_mask(src);
 
     if (resizeable)
         out_w = out_h = 0;
@@ -175,24 +191,80 @@ static bool setup_src(pl_shader sh, const struct pl_sample_src *src,
             pl_unreachable();
         }
 
-        *src_tex = "src_tex";
-        *pos = "tex_coord";
+        // Alias the function parameters of the sampler signature
+        *src_tex = sh_fresh(sh, "src_tex");
+        *pos = sh_fresh(sh, "pos");
+        GLSLP("#define "$" src_tex  \n"
+              "#define "$" tex_coord\n",
+              *src_tex, *pos);
     }
 
     return true;
 }
 
+// Loads all texels needed for the compute shader variant of
+// `pl_shader_deband` into shmem, and returns the name of the shmem arrays.
+static ident_t deband_load_shmem(pl_shader sh, const struct pl_sample_src *src,
+                                 ident_t tex, const char *fn, ident_t pt,
+                                 uint8_t comp_mask, int bw, int bh,
+                                 int iw, int ih, int offset)
+{
+    GLSL("uvec2 base_id = uvec2(0u); \n");
+    if (src->rect.x0 > src->rect.x1)
+        GLSL("base_id.x = gl_WorkGroupSize.x - 1u; \n");
+    if (src->rect.y0 > src->rect.y1)
+        GLSL("base_id.y = gl_WorkGroupSize.y - 1u; \n");
+
+    ident_t in = sh_fresh(sh, "in");
+    GLSLH("shared vec2 "$"_base; \n", in);
+    GLSL("if (gl_LocalInvocationID.xy == base_id)               \n"
+         "    "$"_base = base;                                  \n"
+         "barrier();                                            \n"
+         "ivec2 rel = ivec2(round((base - "$"_base) * size));   \n"
+         "for (int y = int(gl_LocalInvocationID.y); y < %d; y += %d) {  \n"
+         "for (int x = int(gl_LocalInvocationID.x); x < %d; x += %d) {  \n"
+         "vec4 c = %s("$", "$"_base + pt * vec2(x - %d, y - %d));       \n",
+         in, in, ih, bh, iw, bw, fn, tex, in, offset, offset);
+
+    for (uint8_t comps = comp_mask; comps;) {
+        uint8_t c = __builtin_ctz(comps);
+        GLSLH("shared %sfloat "$"%d[%d]; \n", sh_half(sh), in, c, ih * iw);
+        GLSL($"%d[%d * y + x] = c[%d];  \n", in, c, iw, c);
+        comps &= ~(1 << c);
+    }
+
+    GLSL("}}                     \n"
+         "barrier();             \n");
+    return in;
+}
+
 void pl_shader_deband(pl_shader sh, const struct pl_sample_src *src,
                       const struct pl_deband_params *params)
 {
+    params = PL_DEF(params, &pl_deband_default_params);
+    bool try_compute = params->iterations > 0 &&
+                       sh_glsl(sh).compute &&
+                       sh_glsl(sh).version >= 130; // needed for round()
+
     float scale;
-    ident_t tex, pos, pt;
+    ident_t tex, pos, size, pt;
+    uint8_t comp_mask;
     const char *fn;
-    if (!setup_src(sh, src, &tex, &pos, NULL, &pt, NULL, NULL, NULL, &scale,
-                   false, &fn, LINEAR))
+    if (!setup_src(sh, src, &tex, &pos, try_compute ? &size : NULL, &pt,
+                   NULL, NULL, &comp_mask, &scale, false, &fn, LINEAR))
         return;
 
-    params = PL_DEF(params, &pl_deband_default_params);
+    // The compute shader variant loads a tile of the input, padded by the
+    // maximum sampling radius, into shmem, and samples from there instead of
+    // the texture. This cuts down on texture bandwidth substantially, since
+    // neighbouring pixels sample mostly the same texels.
+    const int bw = 16, bh = 16;
+    const int offset = ceilf(params->iterations * params->radius) + 1;
+    const int iw = bw + 2 * offset, ih = bh + 2 * offset;
+    const int num_comps = __builtin_popcount(comp_mask);
+    size_t shmem_req = (iw * ih * num_comps + 2) * sizeof(float);
+    bool is_compute = try_compute && sh_try_compute(sh, bw, bh, false, shmem_req);
+
     sh_describe(sh, "debanding");
     GLSL("vec4 color;           \n"
          "// pl_shader_deband   \n"
@@ -201,30 +273,77 @@ void pl_shader_deband(pl_shader sh, const struct pl_sample_src *src,
     ident_t prng, state;
     prng = sh_prng(sh, true, &state);
 
-    GLSL("vec2 pos = %s;       \n"
+    GLSL("vec2 pos = "$";      \n"
          "vec4 avg, diff;      \n"
-         "color = %s(%s, pos); \n",
+         "color = %s("$", pos); \n",
          pos, fn, tex);
 
     if (params->iterations > 0) {
         // Helper function: Compute a stochastic approximation of the avg color
         // around a pixel, given a specified radius
         ident_t average = sh_fresh(sh, "average");
-        GLSLH("vec4 %s(vec2 pos, float range, inout prng_t %s) {\n"
-              // Compute a random angle and distance
-              "    vec2 dd = %s.xy * vec2(range, %f);           \n"
-              "    vec2 o = dd.x * vec2(cos(dd.y), sin(dd.y));  \n"
-              // Sample at quarter-turn intervals around the source pixel
-              "    vec4 sum = vec4(0.0);                        \n"
-              "    sum += %s(%s, pos + %s * vec2( o.x,  o.y));  \n"
-              "    sum += %s(%s, pos + %s * vec2(-o.x,  o.y));  \n"
-              "    sum += %s(%s, pos + %s * vec2(-o.x, -o.y));  \n"
-              "    sum += %s(%s, pos + %s * vec2( o.x, -o.y));  \n"
-              // Return the (normalized) average
-              "    return 0.25 * sum;                               \n"
-              "}\n",
-              average, state, prng, M_PI * 2,
-              fn, tex, pt, fn, tex, pt, fn, tex, pt, fn, tex, pt);
+        if (is_compute) {
+            GLSL("vec2 size = "$", pt = "$";                    \n"
+                 "vec2 fcoord = fract(pos * size - vec2(0.5));  \n"
+                 "vec2 base = pos - pt * fcoord;                \n",
+                 size, pt);
+
+            ident_t in = deband_load_shmem(sh, src, tex, fn, pt, comp_mask,
+                                           bw, bh, iw, ih, offset);
+
+            // Sample from the shmem tile, with manual bilinear interpolation.
+            // Texel centers are at integer coordinates. Components that were
+            // not loaded are taken from `def` instead.
+            ident_t fetch = sh_fresh(sh, "fetch");
+            GLSLH("vec4 "$"(vec2 t, vec4 def) {                         \n"
+                  "    ivec2 i = clamp(ivec2(floor(t)), ivec2(0),       \n"
+                  "                    ivec2(%d, %d));                  \n"
+                  "    vec2 f = clamp(t - vec2(i), 0.0, 1.0);           \n"
+                  "    int idx = %d * i.y + i.x;                        \n"
+                  "    vec4 c00 = def, c10 = def, c01 = def, c11 = def; \n",
+                  fetch, iw - 2, ih - 2, iw);
+            for (uint8_t comps = comp_mask; comps;) {
+                uint8_t c = __builtin_ctz(comps);
+                GLSLH("    c00[%d] = float("$"%d[idx]);                 \n"
+                      "    c10[%d] = float("$"%d[idx + 1]);             \n"
+                      "    c01[%d] = float("$"%d[idx + %d]);            \n"
+                      "    c11[%d] = float("$"%d[idx + %d]);            \n",
+                      c, in, c, c, in, c, c, in, c, iw, c, in, c, iw + 1);
+                comps &= ~(1 << c);
+            }
+            GLSLH("    return mix(mix(c00, c10, f.x), mix(c01, c11, f.x), f.y); \n"
+                  "}\n");
+
+            GLSLH("vec4 "$"(vec2 t, float range, inout prng_t "$", vec4 def) {\n"
+                  "    vec2 dd = "$".xy * vec2(range, %f);          \n"
+                  "    vec2 o = dd.x * vec2(cos(dd.y), sin(dd.y));  \n"
+                  "    vec4 sum = vec4(0.0);                        \n"
+                  "    sum += "$"(t + vec2( o.x,  o.y), def);       \n"
+                  "    sum += "$"(t + vec2(-o.x,  o.y), def);       \n"
+                  "    sum += "$"(t + vec2(-o.x, -o.y), def);       \n"
+                  "    sum += "$"(t + vec2( o.x, -o.y), def);       \n"
+                  "    return 0.25 * sum;                           \n"
+                  "}\n",
+                  average, state, prng, M_PI * 2, fetch, fetch, fetch, fetch);
+
+            GLSL("vec2 tpos = vec2(rel + ivec2(%d)) + fcoord; \n", offset);
+        } else {
+            GLSLH("vec4 "$"(vec2 pos, float range, inout prng_t "$") {\n"
+                  // Compute a random angle and distance
+                  "    vec2 dd = "$".xy * vec2(range, %f);          \n"
+                  "    vec2 o = dd.x * vec2(cos(dd.y), sin(dd.y));  \n"
+                  // Sample at quarter-turn intervals around the source pixel
+                  "    vec4 sum = vec4(0.0);                        \n"
+                  "    sum += %s("$", pos + "$" * vec2( o.x,  o.y)); \n"
+                  "    sum += %s("$", pos + "$" * vec2(-o.x,  o.y)); \n"
+                  "    sum += %s("$", pos + "$" * vec2(-o.x, -o.y)); \n"
+                  "    sum += %s("$", pos + "$" * vec2( o.x, -o.y)); \n"
+                  // Return the (normalized) average
+                  "    return 0.25 * sum;                               \n"
+                  "}\n",
+                  average, state, prng, M_PI * 2,
+                  fn, tex, pt, fn, tex, pt, fn, tex, pt, fn, tex, pt);
+        }
 
         ident_t radius = sh_const_float(sh, "radius", params->radius);
         ident_t threshold = sh_const_float(sh, "threshold",
@@ -233,18 +352,25 @@ void pl_shader_deband(pl_shader sh, const struct pl_sample_src *src,
         // For each iteration, compute the average at a given distance and
         // pick it instead of the color if the difference is below the threshold.
         for (int i = 1; i <= params->iterations; i++) {
-            GLSL("avg = %s(pos, %d.0 * %s, %s);                                     \n"
-                 "diff = abs(color - avg);                                          \n"
-                 "color = mix(avg, color, %s(greaterThan(diff, vec4(%s / %d.0))));  \n",
-                 average, i, radius, state, sh_bvec(sh, 4), threshold, i);
+            if (is_compute) {
+                GLSL("avg = "$"(tpos, %d.0 * "$", "$", color); \n",
+                     average, i, radius, state);
+            } else {
+                GLSL("avg = "$"(pos, %d.0 * "$", "$"); \n",
+                     average, i, radius, state);
+            }
+
+            GLSL("diff = abs(color - avg);                                          \n"
+                 "color = mix(avg, color, %s(greaterThan(diff, vec4("$" / %d.0)))); \n",
+                 sh_bvec(sh, 4), threshold, i);
         }
     }
 
-    GLSL("color *= vec4(%s);\n", SH_FLOAT(scale));
+    GLSL("color *= vec4("$");\n", SH_FLOAT(scale));
 
     // Add some random noise to smooth out residual differences
     if (params->grain > 0) {
-        GLSL( "color.rgb += %s * (%s - vec3(0.5)); \n",
+        GLSL( "color.rgb += "$" * ("$" - vec3(0.5)); \n",
              SH_FLOAT(params->grain / 1000.0), prng);
     }
 
@@ -261,7 +387,7 @@ bool pl_shader_sample_direct(pl_shader sh, const struct pl_sample_src *src)
         return false;
 
     GLSL("// pl_shader_sample_direct          \n"
-         "vec4 color = vec4(%s) * %s(%s, %s); \n",
+         "vec4 color = vec4("$") * %s("$", "$"); \n",
          SH_FLOAT(scale), fn, tex, pos);
     return true;
 }
@@ -277,7 +403,7 @@ bool pl_shader_sample_nearest(pl_shader sh, const struct pl_sample_src *src)
 
     sh_describe(sh, "nearest");
     GLSL("// pl_shader_sample_nearest         \n"
-         "vec4 color = vec4(%s) * %s(%s, %s); \n",
+         "vec4 color = vec4("$") * %s("$", "$"); \n",
          SH_FLOAT(scale), fn, tex, pos);
     return true;
 }
@@ -293,11 +419,25 @@ bool pl_shader_sample_bilinear(pl_shader sh, const struct pl_sample_src *src)
 
     sh_describe(sh, "bilinear");
     GLSL("// pl_shader_sample_bilinear        \n"
-         "vec4 color = vec4(%s) * %s(%s, %s); \n",
+         "vec4 color = vec4("$") * %s("$", "$"); \n",
          SH_FLOAT(scale), fn, tex, pos);
     return true;
 }
 
+// Whether `textureGather` can be used to fetch all components of `src`.
+// Gathering from components other than the R channel requires GLSL 400, which
+// introduces the overload of textureGather* that allows specifying the
+// component. This is also needed for the sampler2D interface, since the
+// texture format capabilities are unknown.
+static bool can_gather(pl_shader sh, const struct pl_sample_src *src)
+{
+    if (src->tex && !src->tex->params.format->gatherable)
+        return false;
+    if (src_comp_mask(src) != 0x1 || !src->tex)
+        return sh_glsl(sh).version >= 400;
+    return sh_glsl(sh).version >= 130;
+}
+
 static void bicubic_calcweights(pl_shader sh, const char *t, const char *s)
 {
     // Explanation of how bicubic scaling with only 4 texel fetches is done:
@@ -316,8 +456,78 @@ static void bicubic_calcweights(pl_shader sh, const char *t, const char *s)
          t, s, s);
 }
 
+// Variant of `pl_shader_sample_bicubic` using `textureGather`, for textures
+// which can't be sampled with linear filtering. Fetches each 2x2 quadrant of
+// the 4x4 neighbourhood at once, and weights the texels directly.
+static bool sample_bicubic_gather(pl_shader sh, const struct pl_sample_src *src)
+{
+    ident_t tex, pos, size, pt;
+    float scale;
+    uint8_t comp_mask;
+    if (!setup_src(sh, src, &tex, &pos, &size, &pt, NULL, NULL, &comp_mask,
+                   &scale, true, NULL, NEAREST))
+        return false;
+
+    sh_describe(sh, "bicubic (gather)");
+    GLSL("// pl_shader_sample_bicubic (gather)             \n"
+         "vec4 color = vec4(0.0);                          \n"
+         "{                                                \n"
+         "vec2 pos = "$", size = "$", pt = "$";            \n"
+         "vec2 fcoord = fract(pos * size - vec2(0.5));     \n"
+         "vec2 base = pos - pt * fcoord;                   \n"
+         "vec4 t = vec4(1.0, fcoord.x, fcoord.x * fcoord.x,\n"
+         "              fcoord.x * fcoord.x * fcoord.x);   \n"
+         "%svec4 wx = t * mat4( 1.0, -3.0,  3.0, -1.0,     \n"
+         "                      4.0,  0.0, -6.0,  3.0,     \n"
+         "                      1.0,  3.0,  3.0, -3.0,     \n"
+         "                      0.0,  0.0,  0.0,  1.0)     \n"
+         "                     * vec4(1.0/6.0);            \n"
+         "t = vec4(1.0, fcoord.y, fcoord.y * fcoord.y,     \n"
+         "         fcoord.y * fcoord.y * fcoord.y);        \n"
+         "%svec4 wy = t * mat4( 1.0, -3.0,  3.0, -1.0,     \n"
+         "                      4.0,  0.0, -6.0,  3.0,     \n"
+         "                      1.0,  3.0,  3.0, -3.0,     \n"
+         "                      0.0,  0.0,  0.0,  1.0)     \n"
+         "                     * vec4(1.0/6.0);            \n"
+         "%svec4 g;                                        \n",
+         pos, size, pt, sh_half(sh), sh_half(sh), sh_half(sh));
+
+    // The four texels are gathered counterclockwise starting from the
+    // bottom left, i.e. (0,1), (1,1), (1,0), (0,0) relative to the quadrant
+    static const char *wsel[2] = { "xy", "zw" };
+    for (int qy = 0; qy < 2; qy++) {
+        for (int qx = 0; qx < 2; qx++) {
+            const char *x = wsel[qx], *y = wsel[qy];
+            for (uint8_t comps = comp_mask; comps;) {
+                uint8_t c = __builtin_ctz(comps);
+                GLSL("g = textureGather("$", base + pt * vec2(%s, %s)", tex,
+                     qx ? "1.5" : "-0.5", qy ? "1.5" : "-0.5");
+                if (c)
+                    GLSL(", %d", c);
+                GLSL(");\n"
+                     "color[%d] += dot(g, vec4(wx.%c * wy.%c, wx.%c * wy.%c, \n"
+                     "                         wx.%c * wy.%c, wx.%c * wy.%c)); \n",
+                     c, x[0], y[1], x[1], y[1], x[1], y[0], x[0], y[0]);
+                comps &= ~(1 << c);
+            }
+        }
+    }
+
+    GLSL("color *= vec4("$"); \n", SH_FLOAT(scale));
+    if (!(comp_mask & (1 << PL_CHANNEL_A)))
+        GLSL("color.a = 1.0; \n");
+    GLSL("}\n");
+    return true;
+}
+
 bool pl_shader_sample_bicubic(pl_shader sh, const struct pl_sample_src *src)
 {
+    if (src->tex && !(src->tex->params.format->caps & PL_FMT_CAP_LINEAR) &&
+        can_gather(sh, src))
+    {
+        return sample_bicubic_gather(sh, src);
+    }
+
     ident_t tex, pos, size, pt;
     float rx, ry, scale;
     const char *fn;
@@ -334,9 +544,9 @@ bool pl_shader_sample_bicubic(pl_shader sh, const struct pl_sample_src *src)
     GLSL("// pl_shader_sample_bicubic                   \n"
          "vec4 color;                                   \n"
          "{                                             \n"
-         "vec2 pos  = %s;                               \n"
-         "vec2 pt   = %s;                               \n"
-         "vec2 size = %s;                               \n"
+         "vec2 pos  = "$";                              \n"
+         "vec2 pt   = "$";                              \n"
+         "vec2 size = "$";                              \n"
          "vec2 fcoord = fract(pos * size + vec2(0.5));  \n",
          pos, pt, size);
 
@@ -347,17 +557,19 @@ bool pl_shader_sample_bicubic(pl_shader sh, const struct pl_sample_src *src)
          "cdelta.xz = parmx.rg * vec2(-pt.x, pt.x); \n"
          "cdelta.yw = parmy.rg * vec2(-pt.y, pt.y); \n"
          // first y-interpolation
-         "vec4 ar = %s(%s, pos + cdelta.xy);        \n"
-         "vec4 ag = %s(%s, pos + cdelta.xw);        \n"
-         "vec4 ab = mix(ag, ar, parmy.b);           \n"
+         "%svec4 ar = %s("$", pos + cdelta.xy);     \n"
+         "%svec4 ag = %s("$", pos + cdelta.xw);     \n"
+         "%svec4 ab = mix(ag, ar, parmy.b);         \n"
          // second y-interpolation
-         "vec4 br = %s(%s, pos + cdelta.zy);        \n"
-         "vec4 bg = %s(%s, pos + cdelta.zw);        \n"
-         "vec4 aa = mix(bg, br, parmy.b);           \n"
+         "%svec4 br = %s("$", pos + cdelta.zy);     \n"
+         "%svec4 bg = %s("$", pos + cdelta.zw);     \n"
+         "%svec4 aa = mix(bg, br, parmy.b);         \n"
          // x-interpolation
-         "color = vec4(%s) * mix(aa, ab, parmx.b);  \n"
+         "color = vec4("$") * mix(aa, ab, parmx.b); \n"
          "}                                         \n",
-         fn, tex, fn, tex, fn, tex, fn, tex, SH_FLOAT(scale));
+         sh_half(sh), fn, tex, sh_half(sh), fn, tex, sh_half(sh),
+         sh_half(sh), fn, tex, sh_half(sh), fn, tex, sh_half(sh),
+         SH_FLOAT(scale));
 
     return true;
 }
@@ -382,9 +594,9 @@ bool pl_shader_sample_oversample(pl_shader sh, const struct pl_sample_src *src,
     GLSL("// pl_shader_sample_oversample                \n"
          "vec4 color;                                   \n"
          "{                                             \n"
-         "vec2 pt = %s, size = %s, pos = %s;            \n"
+         "vec2 pt = "$", size = "$", pos = "$";         \n"
          "vec2 fcoord = fract(pos * size - vec2(0.5));  \n"
-         "vec2 coeff = (fcoord - vec2(0.5)) * %s;       \n"
+         "vec2 coeff = (fcoord - vec2(0.5)) * "$";      \n"
          "coeff = clamp(coeff + vec2(0.5), 0.0, 1.0);   \n",
          pt, size, pos, ratio);
 
@@ -392,21 +604,144 @@ bool pl_shader_sample_oversample(pl_shader sh, const struct pl_sample_src *src,
         threshold = PL_MIN(threshold, 0.5f);
         ident_t thresh = sh_const_float(sh, "threshold", threshold);
         GLSL("coeff = mix(coeff, vec2(0.0),             \n"
-             "    lessThan(coeff, vec2(%s)));           \n"
+             "    lessThan(coeff, vec2("$")));          \n"
              "coeff = mix(coeff, vec2(1.0),             \n"
-             "    greaterThan(coeff, vec2(1.0 - %s)));  \n",
+             "    greaterThan(coeff, vec2(1.0 - "$"))); \n",
              thresh, thresh);
     }
 
     // Compute the right output blend of colors
     GLSL("pos += (coeff - fcoord) * pt;                 \n"
-         "color = vec4(%s) * %s(%s, pos);               \n"
+         "color = vec4("$") * %s("$", pos);             \n"
          "}                                             \n",
          SH_FLOAT(scale), fn, tex);
 
     return true;
 }
 
+bool pl_shader_sample_cfl(pl_shader sh, const struct pl_sample_src *src,
+                          const struct pl_sample_src *luma)
+{
+    if (!src->tex || !luma->tex) {
+        SH_FAIL(sh, "Chroma-from-luma sampling requires textures!");
+        return false;
+    }
+
+    pl_fmt luma_fmt = luma->tex->params.format;
+    if (!(luma_fmt->caps & PL_FMT_CAP_LINEAR)) {
+        SH_FAIL(sh, "Chroma-from-luma sampling requires a linearly sampleable "
+                "luma texture, format '%s' is not!", luma_fmt->name);
+        return false;
+    }
+
+    ident_t tex, pos, size, pt;
+    float scale;
+    const char *fn;
+    if (!setup_src(sh, src, &tex, &pos, &size, &pt, NULL, NULL, NULL, &scale,
+                   true, &fn, BEST))
+        return false;
+
+    float src_w, src_h, luma_w, luma_h;
+    int out_w, out_h, luma_out_w, luma_out_h;
+    src_size(src, &src_w, &src_h, &out_w, &out_h);
+    src_size(luma, &luma_w, &luma_h, &luma_out_w, &luma_out_h);
+    if (luma_out_w != out_w || luma_out_h != out_h) {
+        SH_FAIL(sh, "Chroma-from-luma sampling requires `src` and `luma` to "
+                "have the same output size!");
+        return false;
+    }
+
+    ident_t luma_pos, luma_tex;
+    luma_tex = sh_bind(sh, luma->tex, luma->address_mode, PL_TEX_SAMPLE_LINEAR,
+                       "luma_tex", &(struct pl_rect2df) {
+                           .x0 = luma->rect.x0,
+                           .y0 = luma->rect.y0,
+                           .x1 = luma->rect.x0 + luma_w,
+                           .y1 = luma->rect.y0 + luma_h,
+                       }, &luma_pos, NULL, NULL);
+    if (!luma_tex)
+        return false;
+
+    // Maps offsets in normalized chroma texture coordinates to offsets in
+    // normalized luma texture coordinates
+    const bool src_rect = src->tex->sampler_type == PL_SAMPLER_RECT;
+    const bool luma_rect = luma->tex->sampler_type == PL_SAMPLER_RECT;
+    const float ratio[2] = {
+        (luma_w / (luma_rect ? 1 : luma->tex->params.w)) /
+        (src_w / (src_rect ? 1 : src->tex->params.w)),
+        (luma_h / (luma_rect ? 1 : luma->tex->params.h)) /
+        (src_h / (src_rect ? 1 : src->tex->params.h)),
+    };
+
+    ident_t luma_ratio = sh_var(sh, (struct pl_shader_var) {
+        .var = pl_var_vec2("luma_ratio"),
+        .data = ratio,
+    });
+
+    const char *luma_fn = sh_tex_fn(sh, luma->tex->params);
+    ident_t src_scale = SH_FLOAT(scale);
+    ident_t luma_scale = SH_FLOAT(PL_DEF(luma->scale, 1.0));
+    sh_describe(sh, "chroma from luma");
+    GLSL("// pl_shader_sample_cfl                           \n"
+         "vec4 color;                                       \n"
+         "{                                                 \n"
+         "vec2 pt = "$", size = "$", pos = "$";             \n"
+         "vec2 luma_pos = "$", luma_ratio = "$";            \n"
+         "float luma = "$" * %s("$", luma_pos).x;           \n"
+         "vec2 fcoord = fract(pos * size - vec2(0.5));      \n"
+         "vec2 base = pos - fcoord * pt;                    \n"
+         "float sl = 0.0, sll = 0.0;                        \n"
+         "vec4 sc = vec4(0.0), scc = vec4(0.0), slc = vec4(0.0); \n"
+         "vec4 bilinear = vec4(0.0);                         \n"
+         "vec4 cmin = vec4(1e9), cmax = vec4(-1e9);         \n"
+         "vec2 cpos;                                        \n"
+         "vec4 c;                                           \n"
+         "float l;                                          \n",
+         pt, size, pos, luma_pos, luma_ratio, luma_scale, luma_fn, luma_tex);
+
+    // Gather statistics over the 4x4 chroma neighbourhood, pairing each
+    // chroma texel with the luma averaged over the chroma texel's footprint
+    for (int y = -1; y <= 2; y++) {
+        for (int x = -1; x <= 2; x++) {
+            GLSL("cpos = base + pt * vec2(%d.0, %d.0);                  \n"
+                 "c = "$" * %s("$", cpos);                              \n"
+                 "l = "$" * %s("$", luma_pos + (cpos - pos) * luma_ratio).x; \n"
+                 "sl += l;                                              \n"
+                 "sll += l * l;                                         \n"
+                 "sc += c;                                              \n"
+                 "scc += c * c;                                         \n"
+                 "slc += l * c;                                         \n",
+                 x, y, src_scale, fn, tex, luma_scale, luma_fn, luma_tex);
+
+            if (x < 0 || x > 1 || y < 0 || y > 1)
+                continue;
+
+            // Inner 2x2 texels, used for the bilinear estimate
+            GLSL("bilinear += %s * %s * c;  \n"
+                 "cmin = min(cmin, c);      \n"
+                 "cmax = max(cmax, c);      \n",
+                 x ? "fcoord.x" : "(1.0 - fcoord.x)",
+                 y ? "fcoord.y" : "(1.0 - fcoord.y)");
+        }
+    }
+
+    // Least squares fit of `c = alpha * l + beta`, with the coefficient of
+    // determination of the fit used as the blend weight. The prediction is
+    // clamped to the range of the inner texels to avoid overshoot
+    GLSL("float ml = sl / 16.0;                                 \n"
+         "float vl = sll / 16.0 - ml * ml;                      \n"
+         "vec4 mc = sc / 16.0;                                  \n"
+         "vec4 vc = scc / 16.0 - mc * mc;                       \n"
+         "vec4 cov = slc / 16.0 - ml * mc;                      \n"
+         "vec4 alpha = cov / max(vl, 1e-6);                     \n"
+         "vec4 pred = clamp(alpha * (luma - ml) + mc, cmin, cmax); \n"
+         "vec4 r2 = cov * cov / max(vl * vc, vec4(1e-12));      \n"
+         "color = mix(bilinear, pred, clamp(r2, 0.0, 1.0));     \n"
+         "}                                                     \n");
+
+    return true;
+}
+
 static bool filter_compat(pl_filter filter, float inv_scale,
                           int lut_entries, float cutoff,
                           const struct pl_filter_config *params)
@@ -424,7 +759,7 @@ static bool filter_compat(pl_filter filter, float inv_scale,
 }
 
 // Subroutine for computing and adding an individual texel contribution
-// If `in` is NULL, samples directly
+// If `in` is 0, samples directly
 // If `in` is set, takes the pixel from inX[idx] where X is the component,
 // `in` is the given identifier, and `idx` must be defined by the caller
 static void polar_sample(pl_shader sh, pl_filter filter, const char *fn,
@@ -444,21 +779,21 @@ static void polar_sample(pl_shader sh, pl_filter filter, const char *fn,
     // Check for samples that might be skippable
     bool maybe_skippable = dmax >= filter->radius_cutoff - M_SQRT2;
     if (maybe_skippable)
-        GLSL("if (d < %s) {\n", cutoff);
+        GLSL("if (d < "$") {\n", cutoff);
 
     // Get the weight for this pixel
-    GLSL("w = %s(d * 1.0/%s); \n"
+    GLSL("w = "$"(d * 1.0/"$"); \n"
          "wsum += w;          \n",
          lut, radius);
 
     if (in) {
         for (uint8_t comps = comp_mask; comps;) {
             uint8_t c = __builtin_ctz(comps);
-            GLSL("color[%d] += w * %s%d[idx]; \n", c, in, c);
+            GLSL("color[%d] += w * "$"%d[idx]; \n", c, in, c);
             comps &= ~(1 << c);
         }
     } else {
-        GLSL("c = %s(%s, base + pt * vec2(%d.0, %d.0)); \n",
+        GLSL("c = %s("$", base + pt * vec2(%d.0, %d.0)); \n",
              fn, tex, x, y);
         for (uint8_t comps = comp_mask; comps;) {
             uint8_t c = __builtin_ctz(comps);
@@ -471,10 +806,22 @@ static void polar_sample(pl_shader sh, pl_filter filter, const char *fn,
         GLSL("}\n");
 }
 
+// Number of previously generated filters to hold on to, so that alternating
+// between a handful of scaling ratios (e.g. while resizing) does not require
+// recomputing the filter weights every time
+#define SAMPLER_RECENT_FILTERS 4
+
 struct sh_sampler_obj {
     pl_filter filter;
+    uint64_t weights_hash; // content hash of `filter->weights`
+    struct sh_memo polar_taps; // for pl_shader_sample_polar
     pl_shader_obj lut;
     pl_shader_obj pass2; // for pl_shader_sample_ortho
+
+    struct {
+        pl_filter filter;
+        uint64_t weights_hash;
+    } recent[SAMPLER_RECENT_FILTERS];
 };
 
 static void sh_sampler_uninit(pl_gpu gpu, void *ptr)
@@ -483,9 +830,44 @@ static void sh_sampler_uninit(pl_gpu gpu, void *ptr)
     pl_shader_obj_destroy(&obj->lut);
     pl_shader_obj_destroy(&obj->pass2);
     pl_filter_free(&obj->filter);
+    for (int i = 0; i < SAMPLER_RECENT_FILTERS; i++)
+        pl_filter_free(&obj->recent[i].filter);
+    sh_memo_uninit(&obj->polar_taps);
     *obj = (struct sh_sampler_obj) {0};
 }
 
+// Makes a compatible filter current, if one was generated previously.
+// Otherwise, retires the current filter (if any) to the list of recently used
+// filters and returns false, leaving `obj->filter` empty.
+static bool sampler_reuse_filter(struct sh_sampler_obj *obj, float inv_scale,
+                                 int lut_entries, float cutoff,
+                                 const struct pl_filter_config *params)
+{
+    if (filter_compat(obj->filter, inv_scale, lut_entries, cutoff, params))
+        return true;
+
+    for (int i = 0; i < SAMPLER_RECENT_FILTERS; i++) {
+        if (filter_compat(obj->recent[i].filter, inv_scale, lut_entries,
+                          cutoff, params))
+        {
+            PL_SWAP(obj->filter, obj->recent[i].filter);
+            PL_SWAP(obj->weights_hash, obj->recent[i].weights_hash);
+            return true;
+        }
+    }
+
+    if (!obj->filter)
+        return false;
+
+    const int last = SAMPLER_RECENT_FILTERS - 1;
+    pl_filter_free(&obj->recent[last].filter);
+    memmove(&obj->recent[1], &obj->recent[0], last * sizeof(obj->recent[0]));
+    obj->recent[0].filter = obj->filter;
+    obj->recent[0].weights_hash = obj->weights_hash;
+    obj->filter = NULL;
+    return false;
+}
+
 static void fill_polar_lut(void *data, const struct sh_lut_params *params)
 {
     const struct sh_sampler_obj *obj = params->priv;
@@ -495,6 +877,224 @@ static void fill_polar_lut(void *data, const struct sh_lut_params *params)
     memcpy(data, filt->weights, params->width * sizeof(float));
 }
 
+#define GLSL_PI "3.14159265358979"
+
+// Emits a GLSL function `float name(float x)` evaluating the filter function
+// `f` analytically, for arguments in [0, max_x]. Returns the estimated cost
+// of doing so (relative to a single LUT lookup), or 0 if there is no
+// suitable closed form. If `name` is 0, only the cost is computed.
+static int filter_fn_glsl(pl_shader sh, const struct pl_filter_function *f,
+                          double max_x, ident_t name)
+{
+#define EMIT(cost, ...)                                                         \
+    do {                                                                        \
+        if (name) {                                                             \
+            GLSLH("float "$"(float x) { \n", name);                             \
+            GLSLH(__VA_ARGS__);                                                 \
+            GLSLH("}                    \n");                                   \
+        }                                                                       \
+        return cost;                                                            \
+    } while (0)
+
+    const double a = f->params[0], b = f->params[1];
+    if (f->weight == pl_filter_function_box.weight) {
+        EMIT(1, "return x < 0.5 ? 1.0 : 0.0; \n");
+    } else if (f->weight == pl_filter_function_triangle.weight) {
+        EMIT(1, "return 1.0 - x * "$"; \n", SH_FLOAT(1.0 / f->radius));
+    } else if (f->weight == pl_filter_function_cosine.weight) {
+        EMIT(2, "return cos(x); \n");
+    } else if (f->weight == pl_filter_function_hann.weight) {
+        EMIT(2, "return 0.5 + 0.5 * cos("GLSL_PI" * x); \n");
+    } else if (f->weight == pl_filter_function_hamming.weight) {
+        EMIT(2, "return 0.54 + 0.46 * cos("GLSL_PI" * x); \n");
+    } else if (f->weight == pl_filter_function_welch.weight) {
+        EMIT(1, "return 1.0 - x * x; \n");
+    } else if (f->weight == pl_filter_function_blackman.weight) {
+        EMIT(3, "x *= "GLSL_PI";                                \n"
+                "return "$" + 0.5 * cos(x) + "$" * cos(2.0 * x); \n",
+             SH_FLOAT((1 - a) / 2.0), SH_FLOAT(a / 2.0));
+    } else if (f->weight == pl_filter_function_bohman.weight) {
+        EMIT(3, "float pix = "GLSL_PI" * x;                                 \n"
+                "return (1.0 - x) * cos(pix) + sin(pix) * (1.0/"GLSL_PI");  \n");
+    } else if (f->weight == pl_filter_function_gaussian.weight) {
+        EMIT(2, "return exp("$" * x * x); \n", SH_FLOAT(-2.0 / a));
+    } else if (f->weight == pl_filter_function_quadratic.weight) {
+        EMIT(1, "return x < 0.5 ? 0.75 - x * x : 0.5 * (x - 1.5) * (x - 1.5); \n");
+    } else if (f->weight == pl_filter_function_sinc.weight) {
+        EMIT(2, "if (x < 1e-8)              \n"
+                "    return 1.0;            \n"
+                "x *= "GLSL_PI";            \n"
+                "return sin(x) / x;         \n");
+    } else if (f->weight == pl_filter_function_sphinx.weight) {
+        EMIT(3, "if (x < 1e-8)                                      \n"
+                "    return 1.0;                                    \n"
+                "x *= "GLSL_PI";                                    \n"
+                "return 3.0 * (sin(x) - x * cos(x)) / (x * x * x);  \n");
+    } else if (f->weight == pl_filter_function_jinc.weight) {
+        // Polynomial approximations of the Bessel function J1, from
+        // Abramowitz & Stegun 9.4.4 and 9.4.6. Only the first one is cheap,
+        // so this is only really worth it for small arguments
+        int cost = max_x * M_PI <= 3.0 ? 1 : 4;
+        EMIT(cost, "x *= "GLSL_PI";                                         \n"
+                   "if (x <= 3.0) {                                         \n"
+                   "    float y = x * x * (1.0/9.0);                        \n"
+                   "    return 2.0 * (0.5 + y * (-0.56249985 + y * (        \n"
+                   "        0.21093573 + y * (-0.03954289 + y * (           \n"
+                   "        0.00443319 + y * (-0.00031761 + y * 0.00001109  \n"
+                   "    ))))));                                             \n"
+                   "}                                                       \n"
+                   "float y = 3.0 / x;                                      \n"
+                   "float f = 0.79788456 + y * (0.00000156 + y * (          \n"
+                   "    0.01659667 + y * (0.00017105 + y * (-0.00249511 +   \n"
+                   "    y * (0.00113653 + y * -0.00020033)))));             \n"
+                   "float t = x - 2.35619449 + y * (0.12499612 + y * (      \n"
+                   "    0.00005650 + y * (-0.00637879 + y * (0.00074348 +   \n"
+                   "    y * (0.00079824 + y * -0.00029166)))));             \n"
+                   "return 2.0 * f * cos(t) / (x * sqrt(x));                \n");
+    } else if (f->weight == pl_filter_function_bcspline.weight) {
+        // See `bcspline` in filters.c
+        double p0 = (6.0 - 2.0 * a) / 6.0,
+               p2 = (-18.0 + 12.0 * a + 6.0 * b) / 6.0 / p0,
+               p3 = (12.0 - 9.0 * a - 6.0 * b) / 6.0 / p0,
+               q0 = (8.0 * a + 24.0 * b) / 6.0 / p0,
+               q1 = (-12.0 * a - 48.0 * b) / 6.0 / p0,
+               q2 = (6.0 * a + 30.0 * b) / 6.0 / p0,
+               q3 = (-a - 6.0 * b) / 6.0 / p0;
+        EMIT(1, "if (x < 1.0)                                       \n"
+                "    return 1.0 + x * x * ("$" + x * "$");          \n"
+                "if (x < 2.0)                                       \n"
+                "    return "$" + x * ("$" + x * ("$" + x * "$"));  \n"
+                "return 0.0;                                        \n",
+             SH_FLOAT(p2), SH_FLOAT(p3), SH_FLOAT(q0), SH_FLOAT(q1),
+             SH_FLOAT(q2), SH_FLOAT(q3));
+    } else if (f->weight == pl_filter_function_bicubic.weight) {
+        EMIT(1, "vec4 p = max(vec4(x) + vec4(2.0, 1.0, 0.0, -1.0), 0.0);    \n"
+                "return dot(p * p * p, vec4(1.0, -4.0, 6.0, -4.0) / 6.0);   \n");
+    } else if (f->weight == pl_filter_function_spline16.weight) {
+        EMIT(1, "if (x < 1.0)                                                   \n"
+                "    return ((x - 9.0/5.0) * x - 1.0/5.0) * x + 1.0;            \n"
+                "x -= 1.0;                                                      \n"
+                "return ((-1.0/3.0 * x + 4.0/5.0) * x - 7.0/15.0) * x;          \n");
+    } else if (f->weight == pl_filter_function_spline36.weight) {
+        EMIT(1, "if (x < 1.0)                                                       \n"
+                "    return ((13.0/11.0 * x - 453.0/209.0) * x - 3.0/209.0) * x + 1.0; \n"
+                "if (x < 2.0) {                                                     \n"
+                "    x -= 1.0;                                                      \n"
+                "    return ((-6.0/11.0 * x + 270.0/209.0) * x - 156.0/209.0) * x;  \n"
+                "}                                                                  \n"
+                "x -= 2.0;                                                          \n"
+                "return ((1.0/11.0 * x - 45.0/209.0) * x + 26.0/209.0) * x;         \n");
+    } else if (f->weight == pl_filter_function_spline64.weight) {
+        EMIT(1, "if (x < 1.0)                                                           \n"
+                "    return ((49.0/41.0 * x - 6387.0/2911.0) * x - 3.0/2911.0) * x + 1.0; \n"
+                "if (x < 2.0) {                                                         \n"
+                "    x -= 1.0;                                                          \n"
+                "    return ((-24.0/41.0 * x + 4032.0/2911.0) * x - 2328.0/2911.0) * x; \n"
+                "}                                                                      \n"
+                "if (x < 3.0) {                                                         \n"
+                "    x -= 2.0;                                                          \n"
+                "    return ((6.0/41.0 * x - 1008.0/2911.0) * x + 582.0/2911.0) * x;    \n"
+                "}                                                                      \n"
+                "x -= 3.0;                                                              \n"
+                "return ((-1.0/41.0 * x + 168.0/2911.0) * x - 97.0/2911.0) * x;         \n");
+    }
+
+    return 0; // no closed form (e.g. kaiser), or a custom filter function
+#undef EMIT
+}
+
+// Maximum estimated cost of evaluating a polar filter analytically. Compute
+// shaders read all source texels from shmem, so the LUT is the only texture
+// fetch left in the inner loop, and even fairly expensive closed forms beat
+// it. Fragment shaders are bound by the source texel fetches instead, so only
+// the cheapest kernels are worth it there.
+#define POLAR_ANALYTIC_COST_COMPUTE  6
+#define POLAR_ANALYTIC_COST_FRAGMENT 2
+
+// Returns whether the polar filter `filter` should be evaluated analytically
+static bool polar_use_analytic(pl_filter filter, bool is_compute)
+{
+    const struct pl_filter_config *cfg = &filter->params.config;
+    const struct pl_filter_function *kernel = cfg->kernel, *window = cfg->window;
+    int cost = filter_fn_glsl(NULL, kernel, kernel->radius, NULL_IDENT);
+    if (!cost)
+        return false;
+
+    if (window) {
+        int wcost = filter_fn_glsl(NULL, window, window->radius, NULL_IDENT);
+        if (!wcost)
+            return false;
+        cost += wcost;
+    }
+
+    return cost <= (is_compute ? POLAR_ANALYTIC_COST_COMPUTE
+                               : POLAR_ANALYTIC_COST_FRAGMENT);
+}
+
+// Emits a GLSL function with the same semantics as the polar LUT, i.e.
+// evaluating `pl_filter_sample` for distances normalized to [0, 1]. See
+// `pl_filter_sample` and `pl_filter_generate`.
+static ident_t polar_weight_fn(pl_shader sh, pl_filter filter)
+{
+    const struct pl_filter_config *cfg = &filter->params.config;
+    const struct pl_filter_function *kernel = cfg->kernel, *window = cfg->window;
+    const double radius = kernel->radius;
+
+    ident_t kernel_fn = sh_fresh(sh, "kernel"), window_fn = NULL_IDENT;
+    filter_fn_glsl(sh, kernel, radius, kernel_fn);
+    if (window) {
+        window_fn = sh_fresh(sh, "window");
+        filter_fn_glsl(sh, window, window->radius, window_fn);
+    }
+
+    ident_t fn = sh_fresh(sh, "polar_weight");
+    GLSLH("float "$"(float t) {        \n"
+          "float x = t * "$";          \n"
+          "float kx = x;               \n",
+          fn, SH_FLOAT(radius));
+    if (cfg->blur > 0.0)
+        GLSLH("kx *= "$"; \n", SH_FLOAT(1.0 / cfg->blur));
+    if (cfg->taper > 0.0) {
+        GLSLH("kx = kx <= "$" ? 0.0 : (kx - "$") * "$"; \n",
+              SH_FLOAT(cfg->taper), SH_FLOAT(cfg->taper),
+              SH_FLOAT(1.0 / (1.0 - cfg->taper / radius)));
+    }
+    GLSLH("if (kx > "$")               \n"
+          "    return 0.0;             \n"
+          "float k = "$"(kx);          \n",
+          SH_FLOAT(radius), kernel_fn);
+    if (window_fn) {
+        GLSLH("k *= "$"(x * "$"); \n", window_fn,
+              SH_FLOAT(window->radius / radius));
+    }
+    if (cfg->clamp > 0.0)
+        GLSLH("k = k < 0.0 ? "$" * k : k; \n", SH_FLOAT(1.0 - cfg->clamp));
+    GLSLH("return k;                   \n"
+          "}                           \n");
+    return fn;
+}
+
+// Applies the per-texel transformations requested by `params` to the texel
+// `c`, while loading it into shmem. Since this has to happen before scaling,
+// `*scale` is also applied here, and reset.
+static void load_transform(pl_shader sh, const struct pl_sample_filter_params *params,
+                           float *scale)
+{
+    if (!params->linearize && !params->sigmoidize)
+        return;
+
+    GLSL("{                             \n"
+         "vec4 color = vec4("$") * c;   \n",
+         SH_FLOAT(*scale));
+    if (params->linearize)
+        pl_shader_linearize(sh, params->linearize);
+    if (params->sigmoidize)
+        pl_shader_sigmoidize(sh, params->sigmoidize);
+    GLSL("c = color;    \n"
+         "}             \n");
+    *scale = 1.0;
+}
+
 bool pl_shader_sample_polar(pl_shader sh, const struct pl_sample_src *src,
                             const struct pl_sample_filter_params *params)
 {
@@ -526,11 +1126,10 @@ bool pl_shader_sample_polar(pl_shader sh, const struct pl_sample_src *src,
 
     int lut_entries = PL_DEF(params->lut_entries, 64);
     float cutoff = PL_DEF(params->cutoff, 0.001);
-    bool update = !filter_compat(obj->filter, inv_scale, lut_entries, cutoff,
-                                 &params->filter);
+    bool update = !sampler_reuse_filter(obj, inv_scale, lut_entries, cutoff,
+                                        &params->filter);
 
     if (update) {
-        pl_filter_free(&obj->filter);
         obj->filter = pl_filter_generate(sh->log, pl_filter_params(
             .config         = params->filter,
             .lut_entries    = lut_entries,
@@ -543,20 +1142,23 @@ bool pl_shader_sample_polar(pl_shader sh, const struct pl_sample_src *src,
             SH_FAIL(sh, "Failed initializing polar filter!");
             return false;
         }
+
+        obj->weights_hash = pl_mem_hash(obj->filter->weights,
+                                        lut_entries * sizeof(float));
     }
 
     sh_describe(sh, "polar scaling");
     GLSL("// pl_shader_sample_polar                     \n"
          "vec4 color = vec4(0.0);                       \n"
          "{                                             \n"
-         "vec2 pos = %s, size = %s, pt = %s;            \n"
+         "vec2 pos = "$", size = "$", pt = "$";         \n"
          "vec2 fcoord = fract(pos * size - vec2(0.5));  \n"
          "vec2 base = pos - pt * fcoord;                \n"
          "vec2 center = base + pt * vec2(0.5);          \n"
-         "float w, d, wsum = 0.0;                       \n"
+         "%sfloat w, d, wsum = 0.0;                     \n"
          "int idx;                                      \n"
-         "vec4 c;                                       \n",
-         pos, size, pt);
+         "%svec4 c;                                     \n",
+         pos, size, pt, sh_half(sh), sh_half(sh));
 
     int bound   = ceil(obj->filter->radius_cutoff);
     int offset  = bound - 1; // padding top/left
@@ -572,7 +1174,7 @@ bool pl_shader_sample_polar(pl_shader sh, const struct pl_sample_src *src,
     int iw = (int) ceil(bw / rx) + padding + 1,
         ih = (int) ceil(bh / ry) + padding + 1;
 
-    ident_t in = NULL;
+    ident_t in = NULL_IDENT;
     int num_comps = __builtin_popcount(comp_mask);
     int shmem_req = (iw * ih * num_comps + 2) * sizeof(float);
     bool is_compute = !params->no_compute &&
@@ -580,21 +1182,32 @@ bool pl_shader_sample_polar(pl_shader sh, const struct pl_sample_src *src,
                       sh_glsl(sh).version >= 130 && // needed for round()
                       sh_try_compute(sh, bw, bh, false, shmem_req);
 
+    if (!is_compute && (params->linearize || params->sigmoidize))
+        return false; // only possible while loading texels into shmem
+
     // For compute shaders, which read the input texels primarily from shmem,
     // using a texture-based LUT is better. For the fragment shader fallback
     // code, which is primarily texture bound, the extra cost of LUT
-    // interpolation is worth the reduction in texel fetches.
-    ident_t lut = sh_lut(sh, sh_lut_params(
-        .object = &obj->lut,
-        .method = is_compute ? SH_LUT_TEXTURE : SH_LUT_AUTO,
-        .type = PL_VAR_FLOAT,
-        .width = lut_entries,
-        .comps = 1,
-        .linear = true,
-        .update = update,
-        .fill = fill_polar_lut,
-        .priv = obj,
-    ));
+    // interpolation is worth the reduction in texel fetches. Kernels with
+    // cheap closed forms skip the LUT entirely.
+    ident_t lut;
+    if (!params->no_analytic && polar_use_analytic(obj->filter, is_compute)) {
+        lut = polar_weight_fn(sh, obj->filter);
+    } else {
+        lut = sh_lut(sh, sh_lut_params(
+            .object = &obj->lut,
+            .method = is_compute ? SH_LUT_TEXTURE : SH_LUT_AUTO,
+            .type = PL_VAR_FLOAT,
+            .width = lut_entries,
+            .comps = 1,
+            .linear = true,
+            .update = update,
+            .signature = obj->weights_hash,
+            .shared = true,
+            .fill = fill_polar_lut,
+            .priv = obj,
+        ));
+    }
 
     if (!lut) {
         SH_FAIL(sh, "Failed initializing polar LUT!");
@@ -604,6 +1217,21 @@ bool pl_shader_sample_polar(pl_shader sh, const struct pl_sample_src *src,
     ident_t cutoff_c = sh_const_float(sh, "radius_cutoff", obj->filter->radius_cutoff);
     ident_t radius_c = sh_const_float(sh, "radius", obj->filter->radius);
 
+    // The unrolled sampling loops below only depend on these inputs, so the
+    // generated text can be reused as long as none of them change
+    const struct pl_glsl_version glsl = sh_glsl(sh);
+    const uint64_t taps_params[] = {
+        is_compute, bound, offset, comp_mask, glsl.version,
+        (uint16_t) glsl.min_gather_offset, (uint16_t) glsl.max_gather_offset,
+        src->tex ? src->tex->params.format->gatherable : 2,
+    };
+    const ident_t taps_idents[] = { src_tex, lut, cutoff_c, radius_c };
+    uint64_t taps_key = pl_mem_hash(taps_params, sizeof(taps_params));
+    pl_hash_merge(&taps_key, pl_mem_hash(&obj->filter->radius_cutoff,
+                                         sizeof(obj->filter->radius_cutoff)));
+    pl_hash_merge(&taps_key, pl_str0_hash(fn));
+    pl_hash_merge(&taps_key, pl_mem_hash(taps_idents, sizeof(taps_idents)));
+
     if (is_compute) {
 
         // Compute shader kernel
@@ -614,11 +1242,11 @@ bool pl_shader_sample_polar(pl_shader sh, const struct pl_sample_src *src,
             GLSL("base_id.y = gl_WorkGroupSize.y - 1u; \n");
 
         in = sh_fresh(sh, "in");
-        GLSLH("shared vec2 %s_base; \n", in);
+        GLSLH("shared vec2 "$"_base; \n", in);
         GLSL("if (gl_LocalInvocationID.xy == base_id)               \n"
-             "    %s_base = base;                                   \n"
+             "    "$"_base = base;                                  \n"
              "barrier();                                            \n"
-             "ivec2 rel = ivec2(round((base - %s_base) * size));    \n",
+             "ivec2 rel = ivec2(round((base - "$"_base) * size));   \n",
              in, in);
 
         ident_t iw_c = sh_const(sh, (struct pl_shader_const) {
@@ -636,35 +1264,44 @@ bool pl_shader_sample_polar(pl_shader sh, const struct pl_sample_src *src,
         });
 
         // Load all relevant texels into shmem
-        GLSL("for (int y = int(gl_LocalInvocationID.y); y < %s; y += %d) {  \n"
-             "for (int x = int(gl_LocalInvocationID.x); x < %s; x += %d) {  \n"
-             "c = %s(%s, %s_base + pt * vec2(x - %d, y - %d));              \n",
+        GLSL("for (int y = int(gl_LocalInvocationID.y); y < "$"; y += %d) { \n"
+             "for (int x = int(gl_LocalInvocationID.x); x < "$"; x += %d) { \n"
+             "c = %s("$", "$"_base + pt * vec2(x - %d, y - %d));            \n",
              ih_c, bh, iw_c, bw, fn, src_tex, in, offset, offset);
+        load_transform(sh, params, &scale);
 
         for (uint8_t comps = comp_mask; comps;) {
             uint8_t c = __builtin_ctz(comps);
-            GLSLH("shared float %s%d[%s * %s]; \n", in, c, ih_c, iw_c);
-            GLSL("%s%d[%s * y + x] = c[%d]; \n", in, c, iw_c, c);
+            GLSLH("shared %sfloat "$"%d["$" * "$"]; \n", sh_half(sh), in, c, ih_c, iw_c);
+            GLSL($"%d["$" * y + x] = c[%d]; \n", in, c, iw_c, c);
             comps &= ~(1 << c);
         }
 
         GLSL("}}                     \n"
              "barrier();             \n");
 
+        pl_hash_merge(&taps_key, in);
+        pl_hash_merge(&taps_key, iw_c);
+        bool memoized = sh_memo_begin(sh, &obj->polar_taps, taps_key);
+
         // Dispatch the actual samples
-        for (int y = 1 - bound; y <= bound; y++) {
+        for (int y = 1 - bound; !memoized && y <= bound; y++) {
             for (int x = 1 - bound; x <= bound; x++) {
-                GLSL("idx = %s * rel.y + rel.x + %s * %d + %d; \n",
+                GLSL("idx = "$" * rel.y + rel.x + "$" * %d + %d; \n",
                      iw_c, iw_c, y + offset, x + offset);
                 polar_sample(sh, obj->filter, fn, src_tex, lut, cutoff_c, radius_c,
                              x, y, comp_mask, in);
             }
         }
+
+        if (!memoized)
+            sh_memo_end(sh, &obj->polar_taps);
     } else {
         // Fragment shader sampling
+        in = sh_fresh(sh, "in");
         for (uint8_t comps = comp_mask; comps;) {
             uint8_t c = __builtin_ctz(comps);
-            GLSL("vec4 in%d;\n", c);
+            GLSL("%svec4 "$"%d;\n", sh_half(sh), in, c);
             comps &= ~(1 << c);
         }
 
@@ -684,7 +1321,8 @@ bool pl_shader_sample_polar(pl_shader sh, const struct pl_sample_src *src,
             return false;
         }
 
-        for (int y = 1 - bound; y <= bound; y++) {
+        bool memoized = sh_memo_begin(sh, &obj->polar_taps, taps_key);
+        for (int y = 1 - bound; !memoized && y <= bound; y++) {
             for (int x = 1 - bound; x <= bound; x++) {
                 // Skip already gathered texels
                 uint32_t bit = 1llu << (base + x);
@@ -715,7 +1353,7 @@ bool pl_shader_sample_polar(pl_shader sh, const struct pl_sample_src *src,
                 if (!use_gather) {
                     // Switch to direct sampling instead
                     polar_sample(sh, obj->filter, fn, src_tex, lut, cutoff_c,
-                                 radius_c, x, y, comp_mask, NULL);
+                                 radius_c, x, y, comp_mask, NULL_IDENT);
                     continue;
                 }
 
@@ -724,19 +1362,19 @@ bool pl_shader_sample_polar(pl_shader sh, const struct pl_sample_src *src,
                     uint8_t c = __builtin_ctz(comps);
                     if (x || y) {
                         if (c) {
-                            GLSL("in%d = textureGatherOffset(%s, center, "
+                            GLSL($"%d = textureGatherOffset("$", center, "
                                  "ivec2(%d, %d), %d);\n",
-                                 c, src_tex, x, y, c);
+                                 in, c, src_tex, x, y, c);
                         } else {
-                            GLSL("in0 = textureGatherOffset(%s, center, "
-                                 "ivec2(%d, %d));\n", src_tex, x, y);
+                            GLSL($"0 = textureGatherOffset("$", center, "
+                                 "ivec2(%d, %d));\n", in, src_tex, x, y);
                         }
                     } else {
                         if (c) {
-                            GLSL("in%d = textureGather(%s, center, %d);\n",
-                                 c, src_tex, c);
+                            GLSL($"%d = textureGather("$", center, %d);\n",
+                                 in, c, src_tex, c);
                         } else {
-                            GLSL("in0 = textureGather(%s, center);\n", src_tex);
+                            GLSL($"0 = textureGather("$", center);\n", in, src_tex);
                         }
                     }
                     comps &= ~(1 << c);
@@ -753,7 +1391,7 @@ bool pl_shader_sample_polar(pl_shader sh, const struct pl_sample_src *src,
 
                     GLSL("idx = %d;\n", p);
                     polar_sample(sh, obj->filter, fn, src_tex, lut, cutoff_c,
-                                 radius_c, x+xo[p], y+yo[p], comp_mask, "in");
+                                 radius_c, x+xo[p], y+yo[p], comp_mask, in);
                 }
 
                 // Mark the other next row's pixels as already gathered
@@ -765,9 +1403,11 @@ bool pl_shader_sample_polar(pl_shader sh, const struct pl_sample_src *src,
             gathered_cur = gathered_next;
             gathered_next = 0;
         }
+        if (!memoized)
+            sh_memo_end(sh, &obj->polar_taps);
     }
 
-    GLSL("color = vec4(%s / wsum) * color; \n", SH_FLOAT(scale));
+    GLSL("color = vec4("$" / wsum) * color; \n", SH_FLOAT(scale));
     if (!(comp_mask & (1 << PL_CHANNEL_A)))
         GLSL("color.a = 1.0; \n");
 
@@ -785,6 +1425,69 @@ static void fill_ortho_lut(void *data, const struct sh_lut_params *params)
     memcpy(data, filt->weights, entries * sizeof(float));
 }
 
+// Initial value for the antiringing lower bound. This must stay within the
+// range of `mediump` floats when using half precision.
+static inline const char *ortho_ar_max(pl_shader sh)
+{
+    return sh_half(sh)[0] ? "1e4" : "1e9";
+}
+
+// (Re)generates the 1D filter for one direction of separated sampling
+static bool ortho_filter(pl_shader sh, struct sh_sampler_obj *obj, float ratio,
+                         const struct pl_sample_filter_params *params)
+{
+    float inv_scale = 1.0 / ratio;
+    inv_scale = PL_MAX(inv_scale, 1.0);
+
+    if (params->no_widening)
+        inv_scale = 1.0;
+
+    int lut_entries = PL_DEF(params->lut_entries, 64);
+    if (sampler_reuse_filter(obj, inv_scale, lut_entries, 0.0, &params->filter))
+        return true;
+
+    obj->filter = pl_filter_generate(sh->log, pl_filter_params(
+        .config             = params->filter,
+        .lut_entries        = lut_entries,
+        .filter_scale       = inv_scale,
+        .max_row_size       = SH_GPU(sh)->limits.max_tex_2d_dim / 4,
+        .row_stride_align   = 4,
+    ));
+
+    if (!obj->filter) {
+        // This should never happen, but just in case ..
+        SH_FAIL(sh, "Failed initializing separated filter!");
+        return false;
+    }
+
+    size_t entries = lut_entries * obj->filter->row_stride;
+    obj->weights_hash = pl_mem_hash(obj->filter->weights,
+                                    entries * sizeof(float));
+    return true;
+}
+
+// Binds the LUT for a filter generated by `ortho_filter`. Changes to the
+// filter weights are picked up via the signature
+static ident_t ortho_lut(pl_shader sh, struct sh_sampler_obj *obj)
+{
+    ident_t lut = sh_lut(sh, sh_lut_params(
+        .object = &obj->lut,
+        .type = PL_VAR_FLOAT,
+        .width = obj->filter->row_stride / 4,
+        .height = obj->filter->params.lut_entries,
+        .comps = 4,
+        .linear = true,
+        .signature = obj->weights_hash,
+        .shared = true,
+        .fill = fill_ortho_lut,
+        .priv = obj,
+    ));
+
+    if (!lut)
+        SH_FAIL(sh, "Failed initializing separated LUT!");
+    return lut;
+}
+
 bool pl_shader_sample_ortho(pl_shader sh, int pass,
                             const struct pl_sample_src *src,
                             const struct pl_sample_filter_params *params)
@@ -795,6 +1498,11 @@ bool pl_shader_sample_ortho(pl_shader sh, int pass,
         return false;
     }
 
+    if (params->linearize || params->sigmoidize) {
+        SH_FAIL(sh, "Per-texel transformations require tiled ortho sampling!");
+        return false;
+    }
+
     pl_gpu gpu = SH_GPU(sh);
     pl_assert(gpu);
 
@@ -839,50 +1547,14 @@ bool pl_shader_sample_ortho(pl_shader sh, int pass,
         assert(obj);
     }
 
-    float inv_scale = 1.0 / ratio[pass];
-    inv_scale = PL_MAX(inv_scale, 1.0);
-
-    if (params->no_widening)
-        inv_scale = 1.0;
-
-    int lut_entries = PL_DEF(params->lut_entries, 64);
-    bool update = !filter_compat(obj->filter, inv_scale, lut_entries, 0.0,
-                                 &params->filter);
-
-    if (update) {
-        pl_filter_free(&obj->filter);
-        obj->filter = pl_filter_generate(sh->log, pl_filter_params(
-            .config             = params->filter,
-            .lut_entries        = lut_entries,
-            .filter_scale       = inv_scale,
-            .max_row_size       = gpu->limits.max_tex_2d_dim / 4,
-            .row_stride_align   = 4,
-        ));
-
-        if (!obj->filter) {
-            // This should never happen, but just in case ..
-            SH_FAIL(sh, "Failed initializing separated filter!");
-            return false;
-        }
-    }
+    if (!ortho_filter(sh, obj, ratio[pass], params))
+        return false;
 
     int N = obj->filter->row_size; // number of samples to convolve
     int width = obj->filter->row_stride / 4; // width of the LUT texture
-    ident_t lut = sh_lut(sh, sh_lut_params(
-        .object = &obj->lut,
-        .type = PL_VAR_FLOAT,
-        .width = width,
-        .height = lut_entries,
-        .comps = 4,
-        .linear = true,
-        .update = update,
-        .fill = fill_ortho_lut,
-        .priv = obj,
-    ));
-    if (!lut) {
-        SH_FAIL(sh, "Failed initializing separated LUT!");
+    ident_t lut = ortho_lut(sh, obj);
+    if (!lut)
         return false;
-    }
 
     const int dir[PL_SEP_PASSES][2] = {
         [PL_SEP_HORIZ] = {1, 0},
@@ -898,22 +1570,23 @@ bool pl_shader_sample_ortho(pl_shader sh, int pass,
     GLSL("// pl_shader_sample_ortho                        \n"
          "vec4 color = vec4(0.0);                          \n"
          "{                                                \n"
-         "vec2 pos = %s, size = %s, pt = %s;               \n"
+         "vec2 pos = "$", size = "$", pt = "$";            \n"
          "vec2 dir = vec2(%d.0, %d.0);                     \n"
          "pt *= dir;                                       \n"
          "vec2 fcoord2 = fract(pos * size - vec2(0.5));    \n"
          "float fcoord = dot(fcoord2, dir);                \n"
          "vec2 base = pos - fcoord * pt - pt * vec2(%d.0); \n"
-         "float weight;                                    \n"
-         "vec4 ws, c;                                      \n",
+         "%sfloat weight;                                  \n"
+         "%svec4 ws, c;                                    \n",
          pos, size, pt,
          dir[pass][0], dir[pass][1],
-         N / 2 - 1);
+         N / 2 - 1, sh_half(sh), sh_half(sh));
 
     bool use_ar = params->antiring > 0;
     if (use_ar) {
-        GLSL("vec4 hi = vec4(0.0); \n"
-             "vec4 lo = vec4(1e9); \n");
+        GLSL("%svec4 hi = vec4(0.0); \n"
+             "%svec4 lo = vec4(%s); \n",
+             sh_half(sh), sh_half(sh), ortho_ar_max(sh));
     }
 
     // Dispatch all of the samples
@@ -923,12 +1596,12 @@ bool pl_shader_sample_ortho(pl_shader sh, int pass,
         // need to fetch another LUT entry. Otherwise, just use the previous
         if (n % 4 == 0) {
             float denom = PL_MAX(1, width - 1); // avoid division by zero
-            GLSL("ws = %s(vec2(%f, fcoord));\n", lut, (n / 4) / denom);
+            GLSL("ws = "$"(vec2(%f, fcoord));\n", lut, (n / 4) / denom);
         }
         GLSL("weight = ws[%d];\n", n % 4);
 
         // Load the input texel and add it to the running sum
-        GLSL("c = %s(%s, base + pt * vec2(%d.0)); \n",
+        GLSL("c = %s("$", base + pt * vec2(%d.0)); \n",
              fn, src_tex, n);
 
         for (uint8_t comps = comp_mask; comps;) {
@@ -945,11 +1618,189 @@ bool pl_shader_sample_ortho(pl_shader sh, int pass,
     }
 
     if (use_ar) {
-        GLSL("color = mix(color, clamp(color, lo, hi), %s);\n",
+        GLSL("color = mix(color, clamp(color, lo, hi), "$");\n",
              sh_const_float(sh, "antiring", params->antiring));
     }
 
-    GLSL("color *= vec4(%s);\n", SH_FLOAT(scale));
+    GLSL("color *= vec4("$");\n", SH_FLOAT(scale));
+    if (!(comp_mask & (1 << PL_CHANNEL_A)))
+        GLSL("color.a = 1.0; \n");
+
+    GLSL("}\n");
+    return true;
+}
+
+// Emits the weighted sum of the filter taps read from the `in` shmem arrays,
+// starting at index `idx` and advancing by `stride` per tap, into `out`
+static void ortho_tile_taps(pl_shader sh, pl_filter filter, ident_t lut,
+                            const char *fcoord, ident_t in, const char *idx,
+                            int stride, const char *out, uint8_t comp_mask,
+                            ident_t antiring)
+{
+    int N = filter->row_size;
+    int width = filter->row_stride / 4;
+    GLSL("%s = vec4(0.0); \n", out);
+    if (antiring) {
+        GLSL("hi = vec4(0.0); \n"
+             "lo = vec4(%s); \n", ortho_ar_max(sh));
+    }
+
+    for (int n = 0; n < N; n++) {
+        if (n % 4 == 0) {
+            float denom = PL_MAX(1, width - 1); // avoid division by zero
+            GLSL("ws = "$"(vec2(%f, %s));\n", lut, (n / 4) / denom, fcoord);
+        }
+        GLSL("weight = ws[%d];\n", n % 4);
+
+        for (uint8_t comps = comp_mask; comps;) {
+            uint8_t c = __builtin_ctz(comps);
+            GLSL("c[%d] = "$"%d[%s + %d]; \n"
+                 "%s[%d] += weight * c[%d]; \n",
+                 c, in, c, idx, n * stride, out, c, c);
+            comps &= ~(1 << c);
+
+            if (antiring && (n == N / 2 - 1 || n == N / 2)) {
+                GLSL("lo[%d] = min(lo[%d], c[%d]); \n"
+                     "hi[%d] = max(hi[%d], c[%d]); \n",
+                     c, c, c, c, c, c);
+            }
+        }
+    }
+
+    if (antiring)
+        GLSL("%s = mix(%s, clamp(%s, lo, hi), "$");\n", out, out, out, antiring);
+}
+
+bool pl_shader_sample_ortho_tiled(pl_shader sh, const struct pl_sample_src *src,
+                                  const struct pl_sample_filter_params *params)
+{
+    pl_assert(params);
+    if (params->filter.polar) {
+        SH_FAIL(sh, "Trying to use separated sampling with a polar filter?");
+        return false;
+    }
+
+    pl_gpu gpu = SH_GPU(sh);
+    pl_assert(gpu);
+
+    if (params->no_compute || !sh_glsl(sh).compute || sh_glsl(sh).version < 130)
+        return false; // needed for shmem and round()
+
+    // Use the same sampler objects as `pl_shader_sample_ortho`, so switching
+    // between both code paths does not regenerate the filters
+    struct sh_sampler_obj *vobj, *hobj;
+    vobj = SH_OBJ(sh, params->lut, PL_SHADER_OBJ_SAMPLER,
+                  struct sh_sampler_obj, sh_sampler_uninit);
+    if (!vobj)
+        return false;
+    hobj = SH_OBJ(sh, &vobj->pass2, PL_SHADER_OBJ_SAMPLER,
+                  struct sh_sampler_obj, sh_sampler_uninit);
+    assert(hobj);
+
+    float src_w, src_h;
+    int out_w, out_h;
+    src_size(src, &src_w, &src_h, &out_w, &out_h);
+    float rx = out_w / fabs(src_w), ry = out_h / fabs(src_h);
+    if (!ortho_filter(sh, hobj, rx, params) || !ortho_filter(sh, vobj, ry, params))
+        return false;
+
+    // Each work group loads its source tile, plus the filter border, into
+    // shmem. The horizontal pass then reduces every tile row to one value per
+    // output column, which the vertical pass reads back from shmem.
+    const int bw = 32, bh = 8;
+    int Nh = hobj->filter->row_size, Nv = vobj->filter->row_size;
+    int offx = Nh / 2 - 1, offy = Nv / 2 - 1;
+    int iw = (int) ceil(bw / rx) + Nh + 1,
+        ih = (int) ceil(bh / ry) + Nv + 1;
+
+    uint8_t comp_mask = src_comp_mask(src);
+    int num_comps = __builtin_popcount(comp_mask);
+    int shmem_req = ((iw + bw) * ih * num_comps + 2) * sizeof(float);
+    if (!sh_try_compute(sh, bw, bh, false, shmem_req))
+        return false;
+
+    float scale;
+    ident_t src_tex, pos, size, pt;
+    const char *fn;
+    if (!setup_src(sh, src, &src_tex, &pos, &size, &pt, NULL, NULL, &comp_mask,
+                   &scale, false, &fn, FASTEST))
+        return false;
+
+    ident_t hlut = ortho_lut(sh, hobj), vlut = ortho_lut(sh, vobj);
+    if (!hlut || !vlut)
+        return false;
+
+    ident_t antiring = NULL_IDENT;
+    if (params->antiring > 0)
+        antiring = sh_const_float(sh, "antiring", params->antiring);
+
+    sh_describe(sh, "ortho scaling (tiled)");
+    GLSL("// pl_shader_sample_ortho_tiled                  \n"
+         "vec4 color = vec4(0.0);                          \n"
+         "{                                                \n"
+         "vec2 pos = "$", size = "$", pt = "$";            \n"
+         "vec2 fcoord = fract(pos * size - vec2(0.5));     \n"
+         "vec2 base = pos - pt * fcoord;                   \n"
+         "%sfloat weight;                                  \n"
+         "%svec4 ws, c, sum;                               \n"
+         "int idx;                                         \n",
+         pos, size, pt, sh_half(sh), sh_half(sh));
+    if (antiring)
+        GLSL("%svec4 hi, lo; \n", sh_half(sh));
+
+    GLSL("uvec2 base_id = uvec2(0u); \n");
+    if (src->rect.x0 > src->rect.x1)
+        GLSL("base_id.x = gl_WorkGroupSize.x - 1u; \n");
+    if (src->rect.y0 > src->rect.y1)
+        GLSL("base_id.y = gl_WorkGroupSize.y - 1u; \n");
+
+    ident_t in = sh_fresh(sh, "in"), tmp = sh_fresh(sh, "tmp");
+    GLSLH("shared vec2 "$"_base; \n", in);
+    GLSL("if (gl_LocalInvocationID.xy == base_id)               \n"
+         "    "$"_base = base;                                  \n"
+         "barrier();                                            \n"
+         "ivec2 rel = ivec2(round((base - "$"_base) * size));   \n",
+         in, in);
+
+    // Load all relevant texels into shmem
+    GLSL("for (int y = int(gl_LocalInvocationID.y); y < %d; y += %d) {  \n"
+         "for (int x = int(gl_LocalInvocationID.x); x < %d; x += %d) {  \n"
+         "c = %s("$", "$"_base + pt * vec2(x - %d, y - %d));            \n",
+         ih, bh, iw, bw, fn, src_tex, in, offx, offy);
+    load_transform(sh, params, &scale);
+
+    for (uint8_t comps = comp_mask; comps;) {
+        uint8_t c = __builtin_ctz(comps);
+        GLSLH("shared %sfloat "$"%d[%d]; \n", sh_half(sh), in, c, ih * iw);
+        GLSLH("shared %sfloat "$"%d[%d]; \n", sh_half(sh), tmp, c, ih * bw);
+        GLSL($"%d[%d * y + x] = c[%d];  \n", in, c, iw, c);
+        comps &= ~(1 << c);
+    }
+
+    GLSL("}}                     \n"
+         "barrier();             \n");
+
+    // Horizontal pass, over every tile row for this invocation's column
+    GLSL("for (int y = int(gl_LocalInvocationID.y); y < %d; y += %d) {  \n"
+         "idx = %d * y + rel.x;                                         \n",
+         ih, bh, iw);
+    ortho_tile_taps(sh, hobj->filter, hlut, "fcoord.x", in, "idx", 1, "sum",
+                    comp_mask, antiring);
+    for (uint8_t comps = comp_mask; comps;) {
+        uint8_t c = __builtin_ctz(comps);
+        GLSL($"%d[%d * y + int(gl_LocalInvocationID.x)] = sum[%d];  \n",
+             tmp, c, bw, c);
+        comps &= ~(1 << c);
+    }
+    GLSL("}                      \n"
+         "barrier();             \n");
+
+    // Vertical pass, producing the final output
+    GLSL("idx = %d * rel.y + int(gl_LocalInvocationID.x); \n", bw);
+    ortho_tile_taps(sh, vobj->filter, vlut, "fcoord.y", tmp, "idx", bw, "color",
+                    comp_mask, antiring);
+
+    GLSL("color *= vec4("$");\n", SH_FLOAT(scale));
     if (!(comp_mask & (1 << PL_CHANNEL_A)))
         GLSL("color.a = 1.0; \n");
 
@@ -48,7 +48,7 @@
         v2 = ROTL(v2, 32);                                                     \
     } while (0)
 
-uint64_t pl_mem_hash(const void *mem, size_t size)
+uint64_t pl_siphash(const void *mem, size_t size)
 {
     if (!size)
         return 0x8533321381b8254bULL;
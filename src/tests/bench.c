@@ -1,6 +1,24 @@
 #include "tests.h"
 #include <sys/time.h>
 
+#ifdef PL_HAVE_VULKAN
+#include "vulkan/common.h"
+#endif
+
+#if defined(PL_HAVE_OPENGL) && defined(EPOXY_HAS_EGL)
+#include <libplacebo/opengl.h>
+#include <epoxy/gl.h>
+#include <epoxy/egl.h>
+#define BENCH_OPENGL
+#endif
+
+#ifdef PL_HAVE_D3D11
+#include <libplacebo/d3d11.h>
+#endif
+
+#include <libplacebo/dummy.h>
+#include <libplacebo/utils/frame_queue.h>
+
 #define TEX_SIZE 2048
 #define CUBE_SIZE 64
 #define NUM_FBOS 16
@@ -47,6 +65,336 @@ static pl_tex create_test_img(pl_gpu gpu)
     return tex;
 }
 
+enum bench_mode {
+    MODE_DEFAULT,
+    MODE_COMPILE,   // shader compilation latency
+    MODE_TRANSFERS, // texture transfer throughput
+    MODE_CPU,       // CPU overhead, on a dummy GPU
+    MODE_SOAK,      // memory growth and fragmentation over time
+};
+
+enum output_format {
+    OUTPUT_TEXT,
+    OUTPUT_JSON,
+    OUTPUT_CSV,
+};
+
+static struct {
+    enum bench_mode mode;
+    enum output_format format;
+    FILE *out;              // destination of the JSON/CSV results
+    const char *baseline;   // CSV results to compare against, or NULL
+    double threshold;       // maximum allowed regression, in percent
+    const char *backend;    // only run this backend, or NULL for all
+    int soak_secs;          // duration of the soak test
+} opts = {
+    .threshold = 10.0,
+};
+
+// Human-readable progress is only printed if it doesn't get mixed into the
+// machine-readable results
+static bool print_text(void)
+{
+    return opts.format == OUTPUT_TEXT || opts.out != stdout;
+}
+
+struct timing {
+    double mean, median, p99; // in ms
+    double variance;          // in ms^2
+};
+
+// One entry per backend (and device) the benchmarks ran on
+struct device_info {
+    char backend[16];
+    char gpu[256];
+    char driver[512];
+    char api[64];
+};
+
+static PL_ARRAY(struct device_info) devices;
+
+static int cur_device = -1; // index of the device currently being benchmarked
+
+// Breakdown of the time spent creating all passes of a frame (median ms)
+struct compile_info {
+    int passes;
+    double generation;  // shader generation, LUTs etc. (everything else)
+    double spirv;       // GLSL to SPIR-V/HLSL translation
+    double driver;      // driver compilation and pipeline creation
+};
+
+struct bench_result {
+    int device; // index into `devices`
+    char name[128];
+    unsigned long frames;
+    double ms_per_frame;
+    struct timing cpu, gpu;
+    struct compile_info compile; // only for `--compile` benchmarks
+    double gbps;                 // only for `--transfers` benchmarks
+};
+
+static PL_ARRAY(struct bench_result) results;
+
+typedef PL_ARRAY(uint64_t) samples_t;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * UINT64_C(1000000000) + ts.tv_nsec;
+}
+
+static int cmp_u64(const void *pa, const void *pb)
+{
+    uint64_t a = *(const uint64_t *) pa, b = *(const uint64_t *) pb;
+    return (a > b) - (a < b);
+}
+
+static struct timing compute_timing(samples_t *samples)
+{
+    struct timing t = {0};
+    const int num = samples->num;
+    if (!num)
+        return t;
+
+    uint64_t *elem = samples->elem;
+    qsort(elem, num, sizeof(elem[0]), cmp_u64);
+    double sum = 0.0, sq = 0.0;
+    for (int i = 0; i < num; i++)
+        sum += elem[i];
+    const double mean = sum / num;
+    for (int i = 0; i < num; i++)
+        sq += (elem[i] - mean) * (elem[i] - mean);
+
+    t.mean = 1e-6 * mean;
+    t.median = 1e-6 * elem[num / 2];
+    t.p99 = 1e-6 * elem[(num * 99 + 99) / 100 - 1];
+    t.variance = 1e-12 * sq / num;
+    return t;
+}
+
+static struct bench_result *add_result(const char *name, unsigned long frames,
+                                       float secs, samples_t *cpu, samples_t *gpu)
+{
+    pl_assert(cur_device >= 0);
+    struct bench_result res = {
+        .device = cur_device,
+        .frames = frames,
+        .ms_per_frame = 1000.0 * secs / frames,
+        .cpu = compute_timing(cpu),
+        .gpu = compute_timing(gpu),
+    };
+
+    snprintf(res.name, sizeof(res.name), "%s", name);
+    PL_ARRAY_APPEND(NULL, results, res);
+    return &results.elem[results.num - 1];
+}
+
+static void json_string(FILE *f, const char *str)
+{
+    fputc('"', f);
+    for (; *str; str++) {
+        if (*str == '"' || *str == '\\')
+            fputc('\\', f);
+        if ((unsigned char) *str >= 0x20)
+            fputc(*str, f);
+    }
+    fputc('"', f);
+}
+
+static void json_timing(FILE *f, const char *key, const struct timing *t)
+{
+    fprintf(f, "\"%s\": { \"mean\": %.6f, \"median\": %.6f, \"p99\": %.6f, "
+            "\"variance\": %.9f }", key, t->mean, t->median, t->p99, t->variance);
+}
+
+static void write_results(FILE *f)
+{
+    switch (opts.format) {
+    case OUTPUT_TEXT:
+        return;
+
+    case OUTPUT_JSON:
+        fprintf(f, "{\n  \"backends\": [\n");
+        for (int d = 0; d < devices.num; d++) {
+            const struct device_info *info = &devices.elem[d];
+            fprintf(f, "    {\n      \"backend\": ");
+            json_string(f, info->backend);
+            fprintf(f, ",\n      \"gpu\": ");
+            json_string(f, info->gpu);
+            fprintf(f, ",\n      \"driver\": ");
+            json_string(f, info->driver);
+            fprintf(f, ",\n      \"api_version\": ");
+            json_string(f, info->api);
+            fprintf(f, ",\n      \"benchmarks\": [\n");
+            bool first = true;
+            for (int i = 0; i < results.num; i++) {
+                const struct bench_result *res = &results.elem[i];
+                if (res->device != d)
+                    continue;
+                fprintf(f, "%s        { \"name\": ", first ? "" : ",\n");
+                json_string(f, res->name);
+                fprintf(f, ", \"frames\": %lu, \"ms_per_frame\": %.6f, ",
+                        res->frames, res->ms_per_frame);
+                json_timing(f, "cpu", &res->cpu);
+                fprintf(f, ", ");
+                json_timing(f, "gpu", &res->gpu);
+                if (res->compile.passes) {
+                    const struct compile_info *c = &res->compile;
+                    fprintf(f, ", \"compile\": { \"passes\": %d, \"generation\": %.6f, "
+                            "\"spirv\": %.6f, \"driver\": %.6f }",
+                            c->passes, c->generation, c->spirv, c->driver);
+                }
+                if (res->gbps)
+                    fprintf(f, ", \"gbps\": %.6f", res->gbps);
+                fprintf(f, " }");
+                first = false;
+            }
+            fprintf(f, "\n      ]\n    }%s\n", d + 1 < devices.num ? "," : "");
+        }
+        fprintf(f, "  ]\n}\n");
+        return;
+
+    case OUTPUT_CSV:
+        fprintf(f, "backend,gpu,driver,api_version,name,frames,ms_per_frame,"
+                   "cpu_mean,cpu_median,cpu_p99,cpu_variance,"
+                   "gpu_mean,gpu_median,gpu_p99,gpu_variance,"
+                   "passes,generation,spirv,driver,gbps\n");
+        for (int i = 0; i < results.num; i++) {
+            const struct bench_result *res = &results.elem[i];
+            const struct device_info *info = &devices.elem[res->device];
+            const struct compile_info *c = &res->compile;
+            fprintf(f, "\"%s\",\"%s\",\"%s\",\"%s\",\"%s\",%lu,%.6f,"
+                    "%.6f,%.6f,%.6f,%.9f,%.6f,%.6f,%.6f,%.9f,%d,%.6f,%.6f,%.6f,%.6f\n",
+                    info->backend, info->gpu, info->driver, info->api,
+                    res->name, res->frames, res->ms_per_frame,
+                    res->cpu.mean, res->cpu.median, res->cpu.p99, res->cpu.variance,
+                    res->gpu.mean, res->gpu.median, res->gpu.p99, res->gpu.variance,
+                    c->passes, c->generation, c->spirv, c->driver, res->gbps);
+        }
+        return;
+    }
+}
+
+// Median GPU times are the least affected by system noise, so prefer those
+// where available, and fall back to median CPU times otherwise. Benchmarks
+// without either (e.g. transfers) are compared by average wall time.
+static double result_time(const struct bench_result *res, const char **metric)
+{
+    if (res->gpu.median) {
+        *metric = "gpu";
+        return res->gpu.median;
+    } else if (res->cpu.median) {
+        *metric = "cpu";
+        return res->cpu.median;
+    }
+
+    *metric = "wall";
+    return res->ms_per_frame;
+}
+
+// Prints the results of all backends next to each other
+static void print_summary(void)
+{
+    if (devices.num < 2)
+        return;
+
+    printf("\n= Summary (median ms/frame, gpu time where available) =\n%-40s", "");
+    for (int d = 0; d < devices.num; d++)
+        printf(" %14s", devices.elem[d].backend);
+    printf("\n");
+
+    for (int i = 0; i < results.num; i++) {
+        const char *name = results.elem[i].name;
+        bool seen = false;
+        for (int j = 0; j < i; j++)
+            seen |= !strcmp(results.elem[j].name, name);
+        if (seen)
+            continue;
+
+        printf("%-40s", name);
+        for (int d = 0; d < devices.num; d++) {
+            const struct bench_result *res = NULL;
+            for (int j = i; j < results.num; j++) {
+                if (results.elem[j].device == d && !strcmp(results.elem[j].name, name))
+                    res = &results.elem[j];
+            }
+
+            if (res) {
+                const char *metric;
+                double time = result_time(res, &metric);
+                printf(" %10.4f %s", time, metric);
+            } else {
+                printf(" %14s", "-");
+            }
+        }
+        printf("\n");
+    }
+}
+
+// Compares the results against a baseline in the CSV format written by
+// `--csv`, returning false if any benchmark regressed beyond the threshold.
+// Results are matched up by backend and benchmark name.
+static bool compare_baseline(const char *path)
+{
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        fprintf(stderr, "Failed opening baseline '%s'!\n", path);
+        return false;
+    }
+
+    bool ok = true;
+    char line[2048];
+    while (fgets(line, sizeof(line), f)) {
+        struct device_info binfo = {0};
+        struct bench_result base = {0};
+        int num = sscanf(line, "\"%15[^\"]\",\"%255[^\"]\",\"%511[^\"]\",\"%63[^\"]\","
+                         "\"%127[^\"]\",%lu,%lf,%lf,%lf,%lf,%lf,%lf,%lf,%lf,%lf",
+                         binfo.backend, binfo.gpu, binfo.driver, binfo.api,
+                         base.name, &base.frames, &base.ms_per_frame,
+                         &base.cpu.mean, &base.cpu.median, &base.cpu.p99,
+                         &base.cpu.variance, &base.gpu.mean, &base.gpu.median,
+                         &base.gpu.p99, &base.gpu.variance);
+        if (num != 15)
+            continue; // header
+
+        const struct bench_result *res = NULL;
+        for (int i = 0; i < results.num; i++) {
+            const struct bench_result *r = &results.elem[i];
+            if (!strcmp(r->name, base.name) &&
+                !strcmp(devices.elem[r->device].backend, binfo.backend))
+            {
+                res = r;
+            }
+        }
+        if (!res) {
+            fprintf(stderr, "'%s' (%s): not run, skipping\n", base.name, binfo.backend);
+            continue;
+        }
+
+        const char *metric, *base_metric;
+        double after = result_time(res, &metric);
+        double before = result_time(&base, &base_metric);
+        if (strcmp(metric, base_metric)) {
+            before = base.cpu.median;
+            after = res->cpu.median;
+            metric = "cpu";
+        }
+        if (!before)
+            continue;
+
+        double delta = 100.0 * (after - before) / before;
+        bool regressed = delta > opts.threshold;
+        fprintf(stderr, "'%s' (%s): %s median %2.6f ms -> %2.6f ms (%+.1f%%)%s\n",
+                base.name, binfo.backend, metric, before, after, delta,
+                regressed ? " REGRESSION" : "");
+        ok &= !regressed;
+    }
+
+    fclose(f);
+    return ok;
+}
+
 struct bench {
     void (*run_sh)(pl_shader sh, pl_shader_obj *state,
                    pl_tex src);
@@ -115,11 +463,14 @@ static void benchmark(pl_gpu gpu, const char *name,
     uint64_t gputime_total = 0;
     unsigned long gputime_count = 0;
     uint64_t gputime;
+    samples_t cpu_samples = {0}, gpu_samples = {0};
 
     gettimeofday(&start, NULL);
     do {
         frames++;
+        uint64_t cpu_start = now_ns();
         run_bench(gpu, dp, &state, src, fbos[index++], timer, bench);
+        PL_ARRAY_APPEND(NULL, cpu_samples, now_ns() - cpu_start);
         index %= NUM_FBOS;
         if (index == 0) {
             pl_gpu_flush(gpu);
@@ -128,6 +479,7 @@ static void benchmark(pl_gpu gpu, const char *name,
         while ((gputime = pl_timer_query(gpu, timer))) {
             gputime_total += gputime;
             gputime_count++;
+            PL_ARRAY_APPEND(NULL, gpu_samples, gputime);
         }
     } while (stop.tv_sec - start.tv_sec < BENCH_DUR);
 
@@ -138,16 +490,22 @@ static void benchmark(pl_gpu gpu, const char *name,
     while ((gputime = pl_timer_query(gpu, timer))) {
         gputime_total += gputime;
         gputime_count++;
+        PL_ARRAY_APPEND(NULL, gpu_samples, gputime);
     }
 
     float secs = (float) (stop.tv_sec - start.tv_sec) +
                  1e-6 * (stop.tv_usec - start.tv_usec);
-    printf("'%s':\t%4lu frames in %1.6f seconds => %2.6f ms/frame (%5.2f FPS)",
-          name, frames, secs, 1000 * secs / frames, frames / secs);
-    if (gputime_count)
-        printf(", gpu time: %2.6f ms", 1e-6 * (gputime_total / gputime_count));
-    printf("\n");
+    if (print_text()) {
+        printf("'%s':\t%4lu frames in %1.6f seconds => %2.6f ms/frame (%5.2f FPS)",
+              name, frames, secs, 1000 * secs / frames, frames / secs);
+        if (gputime_count)
+            printf(", gpu time: %2.6f ms", 1e-6 * (gputime_total / gputime_count));
+        printf("\n");
+    }
 
+    add_result(name, frames, secs, &cpu_samples, &gpu_samples);
+    pl_free(cpu_samples.elem);
+    pl_free(gpu_samples.elem);
     pl_timer_destroy(gpu, &timer);
     pl_shader_obj_destroy(&state);
     pl_dispatch_destroy(&dp);
@@ -350,6 +708,12 @@ static void bench_reshape_mmr(pl_shader sh, pl_shader_obj *state, pl_tex src)
     pl_shader_dovi_reshape(sh, &dovi_meta); // this includes MMR
 }
 
+static void bench_reshape_mmr_lut(pl_shader sh, pl_shader_obj *state, pl_tex src)
+{
+    pl_shader_sample_direct(sh, pl_sample_src( .tex = src ));
+    pl_shader_dovi_reshape_lut(sh, &dovi_meta, state);
+}
+
 static float data[TEX_SIZE * TEX_SIZE * 4 + 8192];
 
 static void bench_download(pl_gpu gpu, pl_tex tex)
@@ -388,64 +752,1674 @@ static void bench_upload_async(pl_gpu gpu, pl_tex tex)
     ));
 }
 
-int main()
+// Texture transfer throughput, over a matrix of formats, sizes, row pitches,
+// transfer sources and synchronization modes
+#define XFER_DUR_MS 500
+#define XFER_DEPTH 4 // maximum number of transfers in flight
+
+struct xfer_plane_fmt {
+    enum pl_fmt_type type;
+    int comps, depth;
+    int shift; // log2 of the subsampling ratio
+};
+
+static const struct xfer_format {
+    const char *name;
+    int num_planes;
+    struct xfer_plane_fmt planes[2];
+} xfer_formats[] = {
+    { "r8",      1, {{ PL_FMT_UNORM, 1, 8 }} },
+    { "rg16",    1, {{ PL_FMT_UNORM, 2, 16 }} },
+    { "rgba8",   1, {{ PL_FMT_UNORM, 4, 8 }} },
+    { "rgba16f", 1, {{ PL_FMT_FLOAT, 4, 16 }} },
+    { "nv12",    2, {{ PL_FMT_UNORM, 1, 8 }, { PL_FMT_UNORM, 2, 8, 1 }} },
+};
+
+static const struct xfer_size {
+    const char *name;
+    int w, h;
+} xfer_sizes[] = {
+    { "720p",   1280,  720 },
+    { "1080p",  1920, 1080 },
+    { "4k",     3840, 2160 },
+    { "8k",     7680, 4320 },
+};
+
+enum xfer_src {
+    XFER_PTR,       // `pl_tex_transfer_params.ptr`
+    XFER_BUF,       // host-mapped `pl_buf`
+    XFER_IMPORT,    // `pl_buf` imported from a host pointer
+    XFER_SRC_COUNT,
+};
+
+static const char * const xfer_srcs[XFER_SRC_COUNT] = {
+    [XFER_PTR]      = "ptr",
+    [XFER_BUF]      = "mapped_buf",
+    [XFER_IMPORT]   = "host_ptr_import",
+};
+
+struct xfer_plane {
+    pl_tex tex;
+    pl_buf buf;
+    void *alloc;
+    uint8_t *ptr;   // aligned to `pl_gpu_limits.align_host_ptr`
+    size_t pitch;
+    size_t size;
+    size_t bytes;   // payload, excluding row padding
+};
+
+static bool xfer_once(pl_gpu gpu, struct xfer_plane *planes, int num_planes,
+                      enum xfer_src src, bool upload, bool async)
+{
+    for (int i = 0; i < num_planes; i++) {
+        struct pl_tex_transfer_params par = {
+            .tex        = planes[i].tex,
+            .row_pitch  = planes[i].pitch,
+        };
+
+        if (src == XFER_PTR) {
+            par.ptr = planes[i].ptr;
+            par.callback = async ? dummy_cb : NULL;
+        } else {
+            par.buf = planes[i].buf;
+        }
+
+        if (!(upload ? pl_tex_upload(gpu, &par) : pl_tex_download(gpu, &par)))
+            return false;
+    }
+
+    // Buffer transfers are always asynchronous, so wait for them explicitly,
+    // as a user accessing the data right away would
+    if (src != XFER_PTR && !async) {
+        for (int i = 0; i < num_planes; i++) {
+            while (pl_buf_poll(gpu, planes[i].buf, UINT64_MAX))
+                ; // do nothing
+        }
+    }
+
+    return true;
+}
+
+static void benchmark_xfer(pl_gpu gpu, const char *name,
+                           struct xfer_plane *planes, int num_planes,
+                           enum xfer_src src, bool upload, bool async)
 {
-    setbuf(stdout, NULL);
-    setbuf(stderr, NULL);
+    size_t bytes = 0;
+    for (int i = 0; i < num_planes; i++)
+        bytes += planes[i].bytes;
+
+    // Warm up staging buffers etc.
+    if (!xfer_once(gpu, planes, num_planes, src, upload, async)) {
+        fprintf(stderr, "'%s': transfer failed, skipping\n", name);
+        return;
+    }
+    pl_gpu_finish(gpu);
 
-    pl_log log = pl_log_create(PL_API_VER, pl_log_params(
-        .log_cb     = isatty(fileno(stdout)) ? pl_log_color : pl_log_simple,
-        .log_level  = PL_LOG_WARN,
+    unsigned long frames = 0;
+    uint64_t start = now_ns(), elapsed;
+    do {
+        REQUIRE(xfer_once(gpu, planes, num_planes, src, upload, async));
+        pl_gpu_flush(gpu);
+        if (++frames % XFER_DEPTH == 0)
+            pl_gpu_finish(gpu);
+        elapsed = now_ns() - start;
+    } while (elapsed < XFER_DUR_MS * UINT64_C(1000000));
+
+    pl_gpu_finish(gpu);
+    float secs = 1e-9 * (now_ns() - start);
+    samples_t none = {0};
+    struct bench_result *res = add_result(name, frames, secs, &none, &none);
+    res->gbps = 1e-9 * bytes * frames / secs;
+    if (print_text()) {
+        printf("'%s':\t%4lu transfers in %1.6f seconds => %2.6f ms/transfer, "
+               "%6.2f GB/s\n", name, frames, secs, res->ms_per_frame, res->gbps);
+    }
+}
+
+static void xfer_plane_destroy(pl_gpu gpu, struct xfer_plane *plane)
+{
+    pl_tex_destroy(gpu, &plane->tex);
+    pl_buf_destroy(gpu, &plane->buf);
+    free(plane->alloc);
+}
+
+static bool xfer_plane_create(pl_gpu gpu, pl_fmt fmt, int w, int h,
+                              bool aligned, struct xfer_plane *plane)
+{
+    const size_t texel = fmt->texel_size;
+    const size_t align = PL_MAX(gpu->limits.align_host_ptr, 4096);
+    *plane = (struct xfer_plane) {
+        .pitch = aligned ? PL_ALIGN(w * texel, gpu->limits.align_tex_xfer_pitch)
+                         : (w + 1) * texel,
+        .bytes = w * h * texel,
+    };
+
+    plane->size = plane->pitch * h;
+    plane->alloc = malloc(plane->size + align);
+    if (!plane->alloc)
+        return false;
+    plane->ptr = (uint8_t *) PL_ALIGN((uintptr_t) plane->alloc, align);
+    memset(plane->ptr, 0x80, plane->size);
+
+    plane->tex = pl_tex_create(gpu, pl_tex_params(
+        .format         = fmt,
+        .w              = w,
+        .h              = h,
+        .host_writable  = true,
+        .host_readable  = true,
     ));
 
-    pl_vulkan vk = pl_vulkan_create(log, pl_vulkan_params(
-        .allow_software = true,
-        .async_transfer = false,
-        .queue_count = NUM_FBOS,
+    return plane->tex;
+}
+
+static bool xfer_buf_create(pl_gpu gpu, enum xfer_src src, struct xfer_plane *plane)
+{
+    pl_buf_destroy(gpu, &plane->buf);
+    switch (src) {
+    case XFER_PTR:
+        return true;
+    case XFER_BUF:
+        if (plane->size > gpu->limits.max_mapped_size)
+            return false;
+        plane->buf = pl_buf_create(gpu, pl_buf_params(
+            .size           = plane->size,
+            .host_mapped    = true,
+        ));
+        return plane->buf;
+    case XFER_IMPORT:
+        if (!(gpu->import_caps.buf & PL_HANDLE_HOST_PTR))
+            return false;
+        plane->buf = pl_buf_create(gpu, pl_buf_params(
+            .size           = plane->size,
+            .import_handle  = PL_HANDLE_HOST_PTR,
+            .shared_mem     = {
+                .handle.ptr = plane->ptr,
+                .size       = plane->size,
+            },
+        ));
+        return plane->buf;
+    case XFER_SRC_COUNT:
+        break;
+    }
+
+    pl_unreachable();
+}
+
+static void run_transfers(pl_gpu gpu)
+{
+    const struct device_info *info = &devices.elem[cur_device];
+    if (print_text())
+        printf("= Running transfer benchmarks on %s (%s) =\n", info->backend, info->gpu);
+
+    for (int f = 0; f < PL_ARRAY_SIZE(xfer_formats); f++) {
+        const struct xfer_format *xf = &xfer_formats[f];
+        pl_fmt fmts[2] = {0};
+        bool ok = true;
+        for (int p = 0; p < xf->num_planes; p++) {
+            const struct xfer_plane_fmt *pf = &xf->planes[p];
+            fmts[p] = pl_find_fmt(gpu, pf->type, pf->comps, pf->depth, pf->depth,
+                                  PL_FMT_CAP_HOST_READABLE);
+            ok &= !!fmts[p];
+        }
+        if (!ok)
+            continue;
+
+        for (int s = 0; s < PL_ARRAY_SIZE(xfer_sizes); s++) {
+            const struct xfer_size *xs = &xfer_sizes[s];
+            for (int aligned = 1; aligned >= 0; aligned--) {
+                struct xfer_plane planes[2] = {0};
+                for (int p = 0; p < xf->num_planes; p++) {
+                    const int shift = xf->planes[p].shift;
+                    ok &= xfer_plane_create(gpu, fmts[p], xs->w >> shift,
+                                            xs->h >> shift, aligned, &planes[p]);
+                }
+
+                for (enum xfer_src src = 0; ok && src < XFER_SRC_COUNT; src++) {
+                    bool have_src = true;
+                    for (int p = 0; p < xf->num_planes; p++)
+                        have_src &= xfer_buf_create(gpu, src, &planes[p]);
+                    if (!have_src)
+                        continue;
+
+                    for (int upload = 1; upload >= 0; upload--) {
+                        for (int async = 0; async <= 1; async++) {
+                            if (src == XFER_PTR && async && !gpu->limits.callbacks)
+                                continue;
+
+                            char name[128];
+                            snprintf(name, sizeof(name), "%s %s %s %s %s %s",
+                                     upload ? "upload" : "download", xf->name,
+                                     xs->name, aligned ? "aligned" : "unaligned",
+                                     xfer_srcs[src], async ? "async" : "sync");
+                            benchmark_xfer(gpu, name, planes, xf->num_planes,
+                                           src, upload, async);
+                        }
+                    }
+                }
+
+                for (int p = 0; p < xf->num_planes; p++)
+                    xfer_plane_destroy(gpu, &planes[p]);
+                if (!ok) {
+                    fprintf(stderr, "Failed allocating %s %s textures, skipping\n",
+                            xf->name, xs->name);
+                    ok = true;
+                    break;
+                }
+            }
+        }
+    }
+}
+
+// End-to-end renderer scenarios
+#define NUM_RENDER_FBOS 4
+#define MAX_MIX_FRAMES 4
+
+struct scenario {
+    const char *name;
+    int src_w, src_h;
+    int dst_w, dst_h;
+    struct pl_color_repr repr;
+    struct pl_color_space color;
+    struct pl_color_space target_color;
+    struct pl_film_grain_data film_grain;
+    int num_frames;     // if nonzero, use `pl_render_image_mix`
+    int num_overlays;   // number of (subtitle-like) target overlays
+    struct pl_render_params params;
+};
+
+static pl_tex create_frame_img(pl_gpu gpu, int w, int h)
+{
+    pl_fmt fmt = pl_find_fmt(gpu, PL_FMT_FLOAT, 4, 16, 32, PL_FMT_CAP_LINEAR);
+    REQUIRE(fmt);
+
+    // Smooth gradients with a bit of noise, to give debanding, scaling and
+    // peak detection something realistic to work with
+    float *data = malloc(w * h * sizeof(float[4]));
+    REQUIRE(data);
+    for (int y = 0; y < h; y++) {
+        for (int x = 0; x < w; x++) {
+            float *color = &data[(y * w + x) * 4];
+            float noise = (rand() % 256) / (255.0 * 64.0);
+            color[0] = (float) x / w + noise;
+            color[1] = (float) y / h + noise;
+            color[2] = (float) ((x ^ y) & 0xFF) / 255.0;
+            color[3] = 1.0;
+        }
+    }
+
+    pl_tex tex = pl_tex_create(gpu, pl_tex_params(
+        .format         = fmt,
+        .w              = w,
+        .h              = h,
+        .sampleable     = true,
+        .initial_data   = data,
     ));
 
-    if (!vk)
-        return SKIP;
+    free(data);
+    REQUIRE(tex);
+    return tex;
+}
+
+static pl_tex create_overlay_img(pl_gpu gpu, int w, int h)
+{
+    pl_fmt fmt = pl_find_fmt(gpu, PL_FMT_UNORM, 4, 8, 8, PL_FMT_CAP_SAMPLEABLE);
+    REQUIRE(fmt);
+
+    uint8_t *data = malloc(w * h * 4);
+    REQUIRE(data);
+    for (int i = 0; i < w * h; i++) {
+        uint8_t alpha = (i % w) % 8 < 6 ? 0xFF : 0x00; // glyph-like columns
+        memcpy(&data[i * 4], (uint8_t[4]) { 0xFF, 0xFF, 0xFF, alpha }, 4);
+    }
+
+    pl_tex tex = pl_tex_create(gpu, pl_tex_params(
+        .format         = fmt,
+        .w              = w,
+        .h              = h,
+        .sampleable     = true,
+        .blit_src       = !!(fmt->caps & PL_FMT_CAP_BLITTABLE),
+        .initial_data   = data,
+    ));
+
+    free(data);
+    REQUIRE(tex);
+    return tex;
+}
+
+struct pass_counter {
+    unsigned long passes;
+    uint64_t frame_gpu; // sum of the most recent GPU times of this frame
+};
+
+static void count_pass(void *priv, const struct pl_render_info *info)
+{
+    struct pass_counter *cnt = priv;
+    cnt->passes++;
+    cnt->frame_gpu += info->pass->last;
+}
+
+static const char * const stat_names[PL_RENDER_STAT_COUNT] = {
+    [PL_RENDER_STAT_HOOKS]      = "hooks",
+    [PL_RENDER_STAT_OVERLAY]    = "overlay",
+    [PL_RENDER_STAT_SCALER]     = "scaler",
+    [PL_RENDER_STAT_DEBAND]     = "deband",
+    [PL_RENDER_STAT_GRAIN]      = "grain",
+    [PL_RENDER_STAT_COLOR_MAP]  = "color_map",
+    [PL_RENDER_STAT_DITHER]     = "dither",
+    [PL_RENDER_STAT_READ]       = "read",
+    [PL_RENDER_STAT_OTHER]      = "other",
+};
+
+// Resources shared by all frames rendered for a scenario
+struct render_state {
+    const struct scenario *sc;
+    int num_src;
+    pl_tex src[MAX_MIX_FRAMES];
+    struct pl_frame images[MAX_MIX_FRAMES];
+    pl_tex osd;
+    struct pl_overlay *overlays;
+    struct pl_overlay_part *parts;
+    pl_tex fbos[NUM_RENDER_FBOS];
+};
+
+static void render_setup(pl_gpu gpu, const struct scenario *sc,
+                         struct render_state *st)
+{
+    *st = (struct render_state) {
+        .sc = sc,
+        .num_src = PL_CLAMP(sc->num_frames, 1, MAX_MIX_FRAMES),
+    };
+
+    for (int i = 0; i < st->num_src; i++) {
+        st->src[i] = create_frame_img(gpu, sc->src_w, sc->src_h);
+        st->images[i] = (struct pl_frame) {
+            .num_planes = 1,
+            .planes     = {{
+                .texture            = st->src[i],
+                .components         = 3,
+                .component_mapping  = {0, 1, 2},
+            }},
+            .repr       = sc->repr,
+            .color      = sc->color,
+            .film_grain = sc->film_grain,
+        };
+    }
+
+    if (sc->num_overlays) {
+        const int ow = 64, oh = 32;
+        st->osd = create_overlay_img(gpu, ow, oh);
+        st->overlays = calloc(sc->num_overlays, sizeof(*st->overlays));
+        st->parts = calloc(sc->num_overlays, sizeof(*st->parts));
+        REQUIRE(st->overlays && st->parts);
+        const int cols = PL_MAX(sc->dst_w / ow, 1);
+        for (int i = 0; i < sc->num_overlays; i++) {
+            float x = (i % cols) * ow, y = sc->dst_h - (i / cols + 1) * oh;
+            st->parts[i] = (struct pl_overlay_part) {
+                .src = { 0, 0, ow, oh },
+                .dst = { x, y, x + ow, y + oh },
+            };
+            st->overlays[i] = (struct pl_overlay) {
+                .tex        = st->osd,
+                .mode       = PL_OVERLAY_NORMAL,
+                .repr       = pl_color_repr_rgb,
+                .color      = pl_color_space_srgb,
+                .parts      = &st->parts[i],
+                .num_parts  = 1,
+            };
+        }
+    }
+
+    pl_fmt fmt = pl_find_fmt(gpu, PL_FMT_UNORM, 4, 8, 8, PL_FMT_CAP_RENDERABLE);
+    REQUIRE(fmt);
+
+    for (int i = 0; i < NUM_RENDER_FBOS; i++) {
+        st->fbos[i] = pl_tex_create(gpu, pl_tex_params(
+            .format         = fmt,
+            .w              = sc->dst_w,
+            .h              = sc->dst_h,
+            .renderable     = true,
+            .storable       = !!(fmt->caps & PL_FMT_CAP_STORABLE),
+        ));
+        REQUIRE(st->fbos[i]);
+    }
+}
+
+static void render_teardown(pl_gpu gpu, struct render_state *st)
+{
+    for (int i = 0; i < st->num_src; i++)
+        pl_tex_destroy(gpu, &st->src[i]);
+    for (int i = 0; i < NUM_RENDER_FBOS; i++)
+        pl_tex_destroy(gpu, &st->fbos[i]);
+    pl_tex_destroy(gpu, &st->osd);
+    free(st->overlays);
+    free(st->parts);
+}
+
+// Renders output frame number `frame` into `fbos[frame % NUM_RENDER_FBOS]`
+static void render_frame(pl_renderer rr, struct render_state *st,
+                         unsigned long frame,
+                         const struct pl_render_params *params)
+{
+    const struct scenario *sc = st->sc;
+    struct pl_frame target;
+    pl_frame_from_swapchain(&target, &(struct pl_swapchain_frame) {
+        .fbo         = st->fbos[frame % NUM_RENDER_FBOS],
+        .flipped     = false,
+        .color_repr  = pl_color_repr_rgb,
+        .color_space = sc->target_color,
+    });
+    target.overlays = st->overlays;
+    target.num_overlays = sc->num_overlays;
+
+    if (!sc->num_frames) {
+        REQUIRE(pl_render_image(rr, &st->images[0], &target, params));
+        return;
+    }
+
+    // Advance the frame mix by one source frame per output frame, reusing
+    // the source textures in a round-robin fashion
+    const struct pl_frame *frame_ptrs[MAX_MIX_FRAMES];
+    uint64_t sigs[MAX_MIX_FRAMES];
+    float pts[MAX_MIX_FRAMES];
+    for (int i = 0; i < sc->num_frames; i++) {
+        uint64_t sig = frame + i;
+        frame_ptrs[i] = &st->images[sig % st->num_src];
+        sigs[i] = sig;
+        pts[i] = i - sc->num_frames / 2 + 0.4;
+    }
+
+    REQUIRE(pl_render_image_mix(rr, &(struct pl_frame_mix) {
+        .num_frames     = sc->num_frames,
+        .frames         = frame_ptrs,
+        .signatures     = sigs,
+        .timestamps     = pts,
+        .vsync_duration = 0.4,
+    }, &target, params));
+}
+
+static void benchmark_render(pl_gpu gpu, const struct scenario *sc)
+{
+    pl_renderer rr = pl_renderer_create(gpu->log, gpu);
+    struct render_state st;
+    render_setup(gpu, sc, &st);
+
+    struct pass_counter cnt = {0};
+    struct pl_render_params params = sc->params;
+    params.info_callback = count_pass;
+    params.info_priv = &cnt;
+    samples_t cpu_samples = {0}, gpu_samples = {0};
+
+    // The first frame (and flush) includes shader compilation, LUT
+    // generation etc., so it's excluded from the measurements
+    render_frame(rr, &st, 0, &params);
+    pl_gpu_finish(gpu);
+    pl_renderer_reset_stats(rr);
+    cnt.passes = 0;
+
+    struct timeval start = {0}, stop = {0};
+    unsigned long frames = 0;
+    gettimeofday(&start, NULL);
+    for (;;) {
+        cnt.frame_gpu = 0;
+        uint64_t cpu_start = now_ns();
+        render_frame(rr, &st, ++frames, &params);
+        PL_ARRAY_APPEND(NULL, cpu_samples, now_ns() - cpu_start);
+        if (cnt.frame_gpu)
+            PL_ARRAY_APPEND(NULL, gpu_samples, cnt.frame_gpu);
+        if ((frames + 1) % NUM_RENDER_FBOS == 0) {
+            pl_gpu_flush(gpu);
+            gettimeofday(&stop, NULL);
+            if (stop.tv_sec - start.tv_sec >= BENCH_DUR)
+                break;
+        }
+    }
+
+    pl_gpu_finish(gpu);
+    gettimeofday(&stop, NULL);
+
+    float secs = (float) (stop.tv_sec - start.tv_sec) +
+                 1e-6 * (stop.tv_usec - start.tv_usec);
+
+    struct pl_render_stats stats = pl_renderer_get_stats(rr);
+    uint64_t cpu_total = 0, gpu_total = 0;
+    for (int i = 0; i < PL_RENDER_STAT_COUNT; i++) {
+        cpu_total += stats.stages[i].cpu_mean * stats.stages[i].num_frames;
+        gpu_total += stats.stages[i].gpu_mean * stats.stages[i].num_frames;
+    }
+
+    add_result(sc->name, frames, secs, &cpu_samples, &gpu_samples);
+    pl_free(cpu_samples.elem);
+    pl_free(gpu_samples.elem);
+    if (!print_text())
+        goto done;
+
+    // Statistics only cover the most recent frames
+    const int num_stats = PL_MIN(frames, 256);
+    printf("'%s':\t%4lu frames in %1.6f seconds => %2.6f ms/frame (%5.2f FPS), "
+           "%5.1f passes/frame, cpu time: %2.6f ms",
+           sc->name, frames, secs, 1000 * secs / frames, frames / secs,
+           (float) cnt.passes / frames, 1e-6 * cpu_total / num_stats);
+    if (gpu_total)
+        printf(", gpu time: %2.6f ms", 1e-6 * gpu_total / num_stats);
+    printf("\n");
+
+    for (int i = 0; i < PL_RENDER_STAT_COUNT; i++) {
+        const struct pl_render_stage_stats *stage = &stats.stages[i];
+        if (!stage->num_frames || !stage->gpu_peak)
+            continue;
+        printf("    %-10s gpu mean %2.6f ms, p95 %2.6f ms, peak %2.6f ms\n",
+               stat_names[i], 1e-6 * stage->gpu_mean, 1e-6 * stage->gpu_p95,
+               1e-6 * stage->gpu_peak);
+    }
+
+done:
+    pl_renderer_destroy(&rr);
+    render_teardown(gpu, &st);
+}
+
+// Calls `fn` for all end-to-end rendering scenarios. The scenario is only
+// valid for the duration of the call.
+static void for_each_scenario(void *priv,
+                              void (*fn)(void *priv, const struct scenario *sc))
+{
+    struct pl_filter_config ewa_lanczossharp = pl_filter_ewa_lanczos;
+    ewa_lanczossharp.blur = 0.981251;
+
+    const struct pl_color_space hdr10 = {
+        .primaries  = PL_COLOR_PRIM_BT_2020,
+        .transfer   = PL_COLOR_TRC_PQ,
+        .hdr.max_luma = 1000,
+    };
+
+    const struct pl_color_repr yuv = {
+        .sys    = PL_COLOR_SYSTEM_BT_709,
+        .levels = PL_COLOR_LEVELS_LIMITED,
+    };
+
+    fn(priv, &(struct scenario) {
+        .name = "render 1080p->4k ewa_lanczossharp",
+        .src_w = 1920, .src_h = 1080, .dst_w = 3840, .dst_h = 2160,
+        .repr = yuv, .color = pl_color_space_bt709,
+        .target_color = pl_color_space_monitor,
+        .params = {
+            PL_RENDER_DEFAULTS
+            .upscaler       = &ewa_lanczossharp,
+            .downscaler     = &pl_filter_mitchell,
+            .sigmoid_params = &pl_sigmoid_default_params,
+            .dither_params  = &pl_dither_default_params,
+            .deband_params  = &pl_deband_default_params,
+        },
+    });
+
+    fn(priv, &(struct scenario) {
+        .name = "render 4k hdr10->sdr peak detect",
+        .src_w = 3840, .src_h = 2160, .dst_w = 3840, .dst_h = 2160,
+        .repr = { .sys = PL_COLOR_SYSTEM_BT_2020_NC, .levels = PL_COLOR_LEVELS_LIMITED },
+        .color = hdr10, .target_color = pl_color_space_monitor,
+        .params = {
+            PL_RENDER_DEFAULTS
+            .peak_detect_params = &pl_peak_detect_default_params,
+            .dither_params      = &pl_dither_default_params,
+        },
+    });
+
+    fn(priv, &(struct scenario) {
+        .name = "render 4k dolby vision p5->sdr",
+        .src_w = 3840, .src_h = 2160, .dst_w = 3840, .dst_h = 2160,
+        .repr = {
+            .sys    = PL_COLOR_SYSTEM_DOLBYVISION,
+            .levels = PL_COLOR_LEVELS_FULL,
+            .dovi   = &dovi_meta,
+        },
+        .color = {
+            .primaries  = PL_COLOR_PRIM_BT_2020,
+            .transfer   = PL_COLOR_TRC_PQ,
+        },
+        .target_color = pl_color_space_monitor,
+        .params = {
+            PL_RENDER_DEFAULTS
+            .dither_params = &pl_dither_default_params,
+        },
+    });
+
+    fn(priv, &(struct scenario) {
+        .name = "render 4k av1 grain",
+        .src_w = 3840, .src_h = 2160, .dst_w = 3840, .dst_h = 2160,
+        .repr = yuv, .color = pl_color_space_bt709,
+        .target_color = pl_color_space_monitor,
+        .film_grain = {
+            .type = PL_FILM_GRAIN_AV1,
+            .params.av1 = av1_grain_data,
+        },
+        .params = { PL_RENDER_DEFAULTS },
+    });
+
+    fn(priv, &(struct scenario) {
+        .name = "render 1080p interpolation mix4",
+        .src_w = 1920, .src_h = 1080, .dst_w = 1920, .dst_h = 1080,
+        .repr = yuv, .color = pl_color_space_bt709,
+        .target_color = pl_color_space_monitor,
+        .num_frames = 4,
+        .params = {
+            PL_RENDER_DEFAULTS
+            .frame_mixer = &pl_filter_mitchell_clamp,
+        },
+    });
+
+    fn(priv, &(struct scenario) {
+        .name = "render 1080p 200 subtitle overlays",
+        .src_w = 1920, .src_h = 1080, .dst_w = 1920, .dst_h = 1080,
+        .repr = yuv, .color = pl_color_space_bt709,
+        .target_color = pl_color_space_monitor,
+        .num_overlays = 200,
+        .params = { PL_RENDER_DEFAULTS },
+    });
+}
+
+static void render_scenario(void *priv, const struct scenario *sc)
+{
+    benchmark_render(priv, sc);
+}
+
+static void run_benchmarks(pl_gpu gpu)
+{
+    const struct device_info *info = &devices.elem[cur_device];
+    if (print_text())
+        printf("= Running benchmarks on %s (%s) =\n", info->backend, info->gpu);
 
 #define BENCH_SH(fn) &(struct bench) { .run_sh = fn }
 #define BENCH_TEX(fn) &(struct bench) { .run_tex = fn }
 
-    printf("= Running benchmarks =\n");
-    benchmark(vk->gpu, "tex_download ptr", BENCH_TEX(bench_download));
-    benchmark(vk->gpu, "tex_download ptr async", BENCH_TEX(bench_download_async));
-    benchmark(vk->gpu, "tex_upload ptr", BENCH_TEX(bench_upload));
-    benchmark(vk->gpu, "tex_upload ptr async", BENCH_TEX(bench_upload_async));
-    benchmark(vk->gpu, "bilinear", BENCH_SH(bench_bilinear));
-    benchmark(vk->gpu, "bicubic", BENCH_SH(bench_bicubic));
-    benchmark(vk->gpu, "deband", BENCH_SH(bench_deband));
-    benchmark(vk->gpu, "deband_heavy", BENCH_SH(bench_deband_heavy));
+    benchmark(gpu, "tex_download ptr", BENCH_TEX(bench_download));
+    benchmark(gpu, "tex_download ptr async", BENCH_TEX(bench_download_async));
+    benchmark(gpu, "tex_upload ptr", BENCH_TEX(bench_upload));
+    benchmark(gpu, "tex_upload ptr async", BENCH_TEX(bench_upload_async));
+    benchmark(gpu, "bilinear", BENCH_SH(bench_bilinear));
+    benchmark(gpu, "bicubic", BENCH_SH(bench_bicubic));
+    benchmark(gpu, "deband", BENCH_SH(bench_deband));
+    benchmark(gpu, "deband_heavy", BENCH_SH(bench_deband_heavy));
 
     // Polar sampling
-    benchmark(vk->gpu, "polar", BENCH_SH(bench_polar));
-    if (vk->gpu->glsl.compute)
-        benchmark(vk->gpu, "polar_nocompute", BENCH_SH(bench_polar_nocompute));
+    benchmark(gpu, "polar", BENCH_SH(bench_polar));
+    if (gpu->glsl.compute)
+        benchmark(gpu, "polar_nocompute", BENCH_SH(bench_polar_nocompute));
 
     // Dithering algorithms
-    benchmark(vk->gpu, "dither_blue", BENCH_SH(bench_dither_blue));
-    benchmark(vk->gpu, "dither_white", BENCH_SH(bench_dither_white));
-    benchmark(vk->gpu, "dither_ordered_fixed", BENCH_SH(bench_dither_ordered_fix));
+    benchmark(gpu, "dither_blue", BENCH_SH(bench_dither_blue));
+    benchmark(gpu, "dither_white", BENCH_SH(bench_dither_white));
+    benchmark(gpu, "dither_ordered_fixed", BENCH_SH(bench_dither_ordered_fix));
 
     // HDR peak detection
-    if (vk->gpu->glsl.compute)
-        benchmark(vk->gpu, "hdr_peakdetect", BENCH_SH(bench_hdr_peak));
+    if (gpu->glsl.compute)
+        benchmark(gpu, "hdr_peakdetect", BENCH_SH(bench_hdr_peak));
 
     // Tone mapping
-    benchmark(vk->gpu, "hdr_lut", BENCH_SH(bench_hdr_lut));
-    benchmark(vk->gpu, "hdr_clip", BENCH_SH(bench_hdr_clip));
+    benchmark(gpu, "hdr_lut", BENCH_SH(bench_hdr_lut));
+    benchmark(gpu, "hdr_clip", BENCH_SH(bench_hdr_clip));
 
     // Misc stuff
-    benchmark(vk->gpu, "av1_grain", BENCH_SH(bench_av1_grain));
-    benchmark(vk->gpu, "av1_grain_lap", BENCH_SH(bench_av1_grain_lap));
-    benchmark(vk->gpu, "h274_grain", BENCH_SH(bench_h274_grain));
-    benchmark(vk->gpu, "reshape_poly", BENCH_SH(bench_reshape_poly));
-    benchmark(vk->gpu, "reshape_mmr", BENCH_SH(bench_reshape_mmr));
+    benchmark(gpu, "av1_grain", BENCH_SH(bench_av1_grain));
+    benchmark(gpu, "av1_grain_lap", BENCH_SH(bench_av1_grain_lap));
+    benchmark(gpu, "h274_grain", BENCH_SH(bench_h274_grain));
+    benchmark(gpu, "reshape_poly", BENCH_SH(bench_reshape_poly));
+    benchmark(gpu, "reshape_mmr", BENCH_SH(bench_reshape_mmr));
+    benchmark(gpu, "reshape_mmr_lut", BENCH_SH(bench_reshape_mmr_lut));
+
+    // End-to-end rendering
+    for_each_scenario((void *) gpu, render_scenario);
+}
+
+static bool want_backend(const char *name)
+{
+    return !opts.backend || !strcmp(opts.backend, name);
+}
+
+// Backends may be created several times (e.g. by `--compile`), in which
+// case all of their results are collected under the same device
+static struct device_info *add_device(const char *backend)
+{
+    for (cur_device = 0; cur_device < devices.num; cur_device++) {
+        if (!strcmp(devices.elem[cur_device].backend, backend))
+            return &devices.elem[cur_device];
+    }
+
+    struct device_info info = {0};
+    snprintf(info.backend, sizeof(info.backend), "%s", backend);
+    PL_ARRAY_APPEND(NULL, devices, info);
+    return &devices.elem[cur_device];
+}
+
+typedef void (*bench_fn)(pl_gpu gpu);
+
+#ifdef PL_HAVE_VULKAN
+static void bench_vulkan(pl_log log, bench_fn run)
+{
+    pl_vk_inst inst = pl_vk_inst_create(log, NULL);
+    if (!inst)
+        return;
+
+    pl_vulkan vk = pl_vulkan_create(log, pl_vulkan_params(
+        .instance = inst->instance,
+        .get_proc_addr = inst->get_proc_addr,
+        .allow_software = true,
+        .async_transfer = false,
+        .queue_count = NUM_FBOS,
+    ));
+
+    if (vk) {
+        PL_VK_LOAD_FUN(inst->instance, GetPhysicalDeviceProperties2, inst->get_proc_addr);
+        VkPhysicalDeviceDriverProperties drv = {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DRIVER_PROPERTIES,
+        };
+
+        VkPhysicalDeviceProperties2 props = {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+            .pNext = vk->api_version >= VK_API_VERSION_1_2 ? &drv : NULL,
+        };
+
+        GetPhysicalDeviceProperties2(vk->phys_device, &props);
+        const VkPhysicalDeviceProperties *p = &props.properties;
+        struct device_info *info = add_device("vulkan");
+        snprintf(info->gpu, sizeof(info->gpu), "%s", p->deviceName);
+        if (drv.driverName[0]) {
+            snprintf(info->driver, sizeof(info->driver), "%s %s",
+                     drv.driverName, drv.driverInfo);
+        } else {
+            snprintf(info->driver, sizeof(info->driver), "0x%"PRIx32, p->driverVersion);
+        }
+        snprintf(info->api, sizeof(info->api), "%d.%d.%d",
+                 (int) VK_VERSION_MAJOR(vk->api_version),
+                 (int) VK_VERSION_MINOR(vk->api_version),
+                 (int) VK_VERSION_PATCH(vk->api_version));
+
+        run(vk->gpu);
+    }
 
     pl_vulkan_destroy(&vk);
-    pl_log_destroy(&log);
+    pl_vk_inst_destroy(&inst);
+}
+#endif
+
+#ifdef BENCH_OPENGL
+// Same surfaceless EGL setup as used by `opengl_surfaceless.c`, but only
+// trying the most capable desktop and ES contexts
+static void bench_opengl(pl_log log, bench_fn run)
+{
+    if (!epoxy_has_egl_extension(EGL_NO_DISPLAY, "EGL_MESA_platform_surfaceless"))
+        return;
+
+    EGLDisplay dpy = eglGetPlatformDisplayEXT(EGL_PLATFORM_SURFACELESS_MESA,
+                                              EGL_DEFAULT_DISPLAY, NULL);
+    EGLint major, minor;
+    if (dpy == EGL_NO_DISPLAY || !eglInitialize(dpy, &major, &minor))
+        return;
+
+    struct {
+        EGLenum api;
+        EGLenum render;
+        EGLint attribs[8];
+    } egl_vers[] = {
+        { EGL_OPENGL_API, EGL_OPENGL_BIT, {
+            EGL_CONTEXT_MAJOR_VERSION, 4,
+            EGL_CONTEXT_MINOR_VERSION, 6,
+            EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+            EGL_NONE,
+        }},
+        { EGL_OPENGL_API, EGL_OPENGL_BIT, { EGL_NONE } },
+        { EGL_OPENGL_ES_API, EGL_OPENGL_ES3_BIT, {
+            EGL_CONTEXT_CLIENT_VERSION, 3,
+            EGL_NONE,
+        }},
+    };
+
+    for (int i = 0; i < PL_ARRAY_SIZE(egl_vers); i++) {
+        const EGLint cfg_attribs[] = {
+            EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+            EGL_RENDERABLE_TYPE, egl_vers[i].render,
+            EGL_NONE
+        };
+
+        EGLConfig config = 0;
+        EGLint num_configs = 0;
+        if (!eglChooseConfig(dpy, cfg_attribs, &config, 1, &num_configs) ||
+            !num_configs || !eglBindAPI(egl_vers[i].api))
+        {
+            continue;
+        }
+
+        EGLContext egl = eglCreateContext(dpy, config, EGL_NO_CONTEXT,
+                                          egl_vers[i].attribs);
+        if (!egl)
+            continue;
+
+        pl_opengl gl = NULL;
+        bool done = false;
+        if (eglMakeCurrent(dpy, EGL_NO_SURFACE, EGL_NO_SURFACE, egl)) {
+            gl = pl_opengl_create(log, pl_opengl_params(
+                .allow_software = true,
+                .egl_display = dpy,
+                .egl_context = egl,
+            ));
+        }
+
+        if (gl) {
+            struct device_info *info = add_device("opengl");
+            snprintf(info->gpu, sizeof(info->gpu), "%s", glGetString(GL_RENDERER));
+            snprintf(info->driver, sizeof(info->driver), "%s", glGetString(GL_VENDOR));
+            snprintf(info->api, sizeof(info->api), "%s", glGetString(GL_VERSION));
+            run(gl->gpu);
+            pl_opengl_destroy(&gl);
+            done = true;
+        }
+
+        eglMakeCurrent(dpy, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        eglDestroyContext(dpy, egl);
+        if (done)
+            break;
+    }
+
+    eglTerminate(dpy);
+}
+#endif
+
+#ifdef PL_HAVE_D3D11
+static void bench_d3d11(pl_log log, bench_fn run)
+{
+    pl_d3d11 d3d11 = pl_d3d11_create(log, pl_d3d11_params(
+        .allow_software = true,
+    ));
+    if (!d3d11)
+        return;
+
+    struct device_info *info = add_device("d3d11");
+    IDXGIDevice1 *dxgi_dev = NULL;
+    IDXGIAdapter1 *adapter = NULL;
+    if (SUCCEEDED(ID3D11Device_QueryInterface(d3d11->device, &IID_IDXGIDevice1,
+                                              (void **) &dxgi_dev)) &&
+        SUCCEEDED(IDXGIDevice1_GetParent(dxgi_dev, &IID_IDXGIAdapter1,
+                                         (void **) &adapter)))
+    {
+        DXGI_ADAPTER_DESC1 desc;
+        if (SUCCEEDED(IDXGIAdapter1_GetDesc1(adapter, &desc))) {
+            WideCharToMultiByte(CP_UTF8, 0, desc.Description, -1, info->gpu,
+                                sizeof(info->gpu), NULL, NULL);
+        }
+
+        LARGE_INTEGER version;
+        if (SUCCEEDED(IDXGIAdapter1_CheckInterfaceSupport(adapter, &IID_IDXGIDevice,
+                                                          &version)))
+        {
+            snprintf(info->driver, sizeof(info->driver), "%u.%u.%u.%u",
+                     HIWORD(version.HighPart), LOWORD(version.HighPart),
+                     HIWORD(version.LowPart), LOWORD(version.LowPart));
+        }
+    }
+
+    if (adapter)
+        IDXGIAdapter1_Release(adapter);
+    if (dxgi_dev)
+        IDXGIDevice1_Release(dxgi_dev);
+
+    D3D_FEATURE_LEVEL fl = ID3D11Device_GetFeatureLevel(d3d11->device);
+    snprintf(info->api, sizeof(info->api), "%u_%u",
+             ((unsigned) fl) >> 12, (((unsigned) fl) >> 8) & 0xf);
+
+    run(d3d11->gpu);
+    pl_d3d11_destroy(&d3d11);
+}
+#endif
+
+// CPU overhead of the frame queue, renderer and dispatch bookkeeping. These
+// run on a dummy GPU with no-op passes, so no actual GPU work is involved
+#define CPU_DUR_MS 1000
+#define CPU_BATCH 64        // number of calls timed together, for cheap calls
+#define CPU_RESET 4096      // reset the queue periodically, to bound the PTS
+#define CPU_W 640
+#define CPU_H 360
+
+struct cpu_rate {
+    const char *name;
+    float src_fps, dst_fps;
+};
+
+static const struct cpu_rate cpu_rates[] = {
+    { "24->60",   24.0,  60.0 },
+    { "24->240",  24.0, 240.0 },
+    { "60->240",  60.0, 240.0 },
+    { "240->240", 240.0, 240.0 },
+};
+
+struct cpu_source {
+    float fps;
+    unsigned long num;
+    struct pl_frame frame;
+};
+
+static bool cpu_map(pl_gpu gpu, pl_tex *tex, const struct pl_source_frame *src,
+                    struct pl_frame *out_frame)
+{
+    const struct cpu_source *source = src->frame_data;
+    *out_frame = source->frame;
+    return true;
+}
+
+static enum pl_queue_status cpu_get_frame(struct pl_source_frame *out_frame,
+                                          const struct pl_queue_params *qparams)
+{
+    struct cpu_source *source = qparams->priv;
+    *out_frame = (struct pl_source_frame) {
+        .pts        = source->num++ / source->fps,
+        .frame_data = source,
+        .map        = cpu_map,
+    };
+    return PL_QUEUE_OK;
+}
+
+struct cpu_bench {
+    pl_gpu gpu;
+    pl_queue queue;
+    struct cpu_source source;
+    struct pl_frame target;
+    struct pl_queue_params qparams;
+    unsigned long vsync;
+};
+
+static void cpu_bench_reset(struct cpu_bench *cb, const struct cpu_rate *rate,
+                            const struct pl_render_params *params)
+{
+    pl_queue_reset(cb->queue);
+    cb->source.num = 0;
+    cb->source.fps = rate->src_fps;
+    cb->vsync = 0;
+    cb->qparams = (struct pl_queue_params) {
+        .radius                  = pl_frame_mix_radius(params),
+        .vsync_duration          = 1.0 / rate->dst_fps,
+        .frame_duration          = 1.0 / rate->src_fps,
+        .interpolation_threshold = 0.01,
+        .get_frame               = cpu_get_frame,
+        .priv                    = &cb->source,
+    };
+}
+
+static void cpu_queue_update(struct cpu_bench *cb, const struct cpu_rate *rate,
+                             struct pl_frame_mix *mix)
+{
+    cb->qparams.pts = cb->vsync++ / rate->dst_fps;
+    REQUIRE(pl_queue_update(cb->queue, mix, &cb->qparams) == PL_QUEUE_OK);
+}
+
+static void cpu_add_result(const char *name, unsigned long calls, uint64_t elapsed,
+                           samples_t *samples)
+{
+    samples_t none = {0};
+    struct bench_result *res = add_result(name, calls, 1e-9 * elapsed, samples, &none);
+    if (print_text()) {
+        printf("'%s':\t%8lu calls in %1.6f seconds => %8.1f ns/call "
+               "(median %8.1f ns, p99 %8.1f ns)\n", name, calls, 1e-9 * elapsed,
+               1e6 * res->ms_per_frame, 1e6 * res->cpu.median, 1e6 * res->cpu.p99);
+    }
+}
+
+static void bench_queue_update(struct cpu_bench *cb, const struct cpu_rate *rate,
+                               const struct pl_filter_preset *mixer)
+{
+    const struct pl_render_params params = { .frame_mixer = mixer->filter };
+    samples_t samples = {0};
+    unsigned long calls = 0;
+    uint64_t elapsed = 0;
+    struct pl_frame_mix mix;
+
+    cpu_bench_reset(cb, rate, &params);
+    while (elapsed < CPU_DUR_MS * UINT64_C(1000000)) {
+        if (calls && calls % CPU_RESET == 0)
+            cpu_bench_reset(cb, rate, &params);
+
+        uint64_t start = now_ns();
+        for (int i = 0; i < CPU_BATCH; i++)
+            cpu_queue_update(cb, rate, &mix);
+        uint64_t batch = now_ns() - start;
+        PL_ARRAY_APPEND(NULL, samples, batch / CPU_BATCH);
+        elapsed += batch;
+        calls += CPU_BATCH;
+    }
+
+    char name[128];
+    snprintf(name, sizeof(name), "queue_update %s %s", rate->name, mixer->name);
+    cpu_add_result(name, calls, elapsed, &samples);
+    pl_free(samples.elem);
+}
+
+static void bench_render_mix(struct cpu_bench *cb, const struct cpu_rate *rate,
+                             const struct pl_filter_preset *mixer)
+{
+    pl_renderer rr = pl_renderer_create(cb->gpu->log, cb->gpu);
+    struct pl_render_params params = pl_render_default_params;
+    params.frame_mixer = mixer->filter;
+    samples_t samples = {0};
+    unsigned long calls = 0;
+    uint64_t elapsed = 0;
+    struct pl_frame_mix mix;
+
+    // Only time the rendering itself, the queue is measured separately
+    cpu_bench_reset(cb, rate, &params);
+    cpu_queue_update(cb, rate, &mix);
+    REQUIRE(pl_render_image_mix(rr, &mix, &cb->target, &params));
+    while (elapsed < CPU_DUR_MS * UINT64_C(1000000)) {
+        if (calls && calls % CPU_RESET == 0) {
+            cpu_bench_reset(cb, rate, &params);
+            pl_renderer_flush_cache(rr);
+        }
+
+        cpu_queue_update(cb, rate, &mix);
+        uint64_t start = now_ns();
+        REQUIRE(pl_render_image_mix(rr, &mix, &cb->target, &params));
+        uint64_t time = now_ns() - start;
+        PL_ARRAY_APPEND(NULL, samples, time);
+        elapsed += time;
+        calls++;
+    }
+
+    char name[128];
+    snprintf(name, sizeof(name), "render_image_mix %s %s", rate->name, mixer->name);
+    cpu_add_result(name, calls, elapsed, &samples);
+    pl_free(samples.elem);
+    pl_renderer_destroy(&rr);
+}
+
+static void bench_dispatch_lookup(struct cpu_bench *cb)
+{
+    pl_dispatch dp = pl_dispatch_create(cb->gpu->log, cb->gpu);
+    pl_tex src = cb->source.frame.planes[0].texture;
+    pl_tex fbo = cb->target.planes[0].texture;
+    samples_t samples = {0};
+    unsigned long calls = 0;
+    uint64_t elapsed = 0;
+    for (bool warmup = true; elapsed < CPU_DUR_MS * UINT64_C(1000000); warmup = false) {
+        struct pl_color_repr repr = {
+            .sys    = PL_COLOR_SYSTEM_BT_709,
+            .levels = PL_COLOR_LEVELS_LIMITED,
+        };
+
+        uint64_t start = now_ns();
+        pl_shader sh = pl_dispatch_begin(dp);
+        pl_shader_sample_direct(sh, pl_sample_src( .tex = src ));
+        pl_shader_decode_color(sh, &repr, NULL);
+        REQUIRE(pl_dispatch_finish(dp, pl_dispatch_params(
+            .shader = &sh,
+            .target = fbo,
+        )));
+        uint64_t time = now_ns() - start;
+        if (warmup)
+            continue; // pass creation
+        PL_ARRAY_APPEND(NULL, samples, time);
+        elapsed += time;
+        calls++;
+    }
+
+    cpu_add_result("dispatch cached pass", calls, elapsed, &samples);
+    pl_free(samples.elem);
+    pl_dispatch_destroy(&dp);
+}
+
+static void run_cpu(pl_gpu gpu)
+{
+    if (print_text())
+        printf("= Running CPU overhead benchmarks =\n");
+
+    pl_fmt fmt = pl_find_named_fmt(gpu, "rgba8");
+    REQUIRE(fmt);
+    pl_tex src = pl_tex_create(gpu, pl_tex_params(
+        .w = CPU_W, .h = CPU_H, .format = fmt, .sampleable = true,
+    ));
+    pl_tex fbo = pl_tex_create(gpu, pl_tex_params(
+        .w = CPU_W, .h = CPU_H, .format = fmt, .renderable = true,
+    ));
+    REQUIRE(src && fbo);
+
+    struct cpu_bench cb = {
+        .gpu = gpu,
+        .queue = pl_queue_create(gpu),
+    };
+
+    pl_frame_from_swapchain(&cb.target, &(struct pl_swapchain_frame) {
+        .fbo         = fbo,
+        .color_repr  = pl_color_repr_rgb,
+        .color_space = pl_color_space_monitor,
+    });
+
+    cb.source.frame = (struct pl_frame) {
+        .num_planes = 1,
+        .planes     = {{
+            .texture            = src,
+            .components         = 3,
+            .component_mapping  = {0, 1, 2},
+        }},
+        .repr       = pl_color_repr_sdtv,
+        .color      = pl_color_space_bt709,
+    };
+
+    for (int r = 0; r < PL_ARRAY_SIZE(cpu_rates); r++) {
+        for (int m = 0; m < pl_num_frame_mixers; m++)
+            bench_queue_update(&cb, &cpu_rates[r], &pl_frame_mixers[m]);
+    }
+
+    for (int r = 0; r < PL_ARRAY_SIZE(cpu_rates); r++) {
+        for (int m = 0; m < pl_num_frame_mixers; m++)
+            bench_render_mix(&cb, &cpu_rates[r], &pl_frame_mixers[m]);
+    }
+
+    bench_dispatch_lookup(&cb);
+
+    pl_queue_destroy(&cb.queue);
+    pl_tex_destroy(gpu, &src);
+    pl_tex_destroy(gpu, &fbo);
+}
+
+// Shader compilation latency, i.e. the time it takes to render the first
+// frame of a scenario on a freshly created device, with and without caches
+#define COMPILE_REPS 3
+
+enum compile_mode {
+    COMPILE_COLD,       // no caches at all
+    COMPILE_DISPATCH,   // `pl_renderer_load` (SPIR-V, GL program binaries, DXBC)
+    COMPILE_PIPELINE,   // driver pipeline/shader cache only
+    COMPILE_BOTH,       // both of the above
+    COMPILE_MODE_COUNT,
+};
+
+static const char * const compile_modes[COMPILE_MODE_COUNT] = {
+    [COMPILE_COLD]      = "cold",
+    [COMPILE_DISPATCH]  = "dispatch cache",
+    [COMPILE_PIPELINE]  = "pipeline cache",
+    [COMPILE_BOTH]      = "both caches",
+};
+
+// State of the compile benchmark currently being run
+static struct {
+    const struct scenario *sc;
+    enum compile_mode mode;
+    pl_str dispatch;        // renderer cache saved by the first cold run
+    pl_str pipeline;        // driver cache saved by the first cold run
+    samples_t total, generation, spirv, driver;
+    int passes;
+} compile;
+
+static size_t save_pipeline_cache(pl_gpu gpu, uint8_t *out, size_t size)
+{
+#ifdef PL_HAVE_VULKAN
+    if (pl_vulkan_get(gpu))
+        return pl_vulkan_save_pipeline_cache(gpu, out, size);
+#endif
+#ifdef PL_HAVE_D3D11
+    if (pl_d3d11_get(gpu))
+        return pl_d3d11_save_shader_cache(gpu, out, size);
+#endif
     return 0;
 }
+
+static void load_pipeline_cache(pl_gpu gpu, pl_str cache)
+{
+#ifdef PL_HAVE_VULKAN
+    if (pl_vulkan_get(gpu))
+        pl_vulkan_load_pipeline_cache(gpu, cache.buf, cache.len);
+#endif
+#ifdef PL_HAVE_D3D11
+    if (pl_d3d11_get(gpu))
+        pl_d3d11_load_shader_cache(gpu, cache.buf, cache.len);
+#endif
+}
+
+static void compile_run(pl_gpu gpu)
+{
+    const struct scenario *sc = compile.sc;
+    const enum compile_mode mode = compile.mode;
+    struct render_state st;
+    render_setup(gpu, sc, &st);
+    pl_gpu_finish(gpu);
+
+    if (mode == COMPILE_PIPELINE || mode == COMPILE_BOTH)
+        load_pipeline_cache(gpu, compile.pipeline);
+    pl_renderer rr = pl_renderer_create(gpu->log, gpu);
+    if (mode == COMPILE_DISPATCH || mode == COMPILE_BOTH)
+        pl_renderer_load(rr, compile.dispatch.buf);
+
+    struct pl_gpu_compile_stats before = pl_gpu_get_compile_stats(gpu);
+    uint64_t start = now_ns();
+    render_frame(rr, &st, 0, &sc->params);
+    uint64_t total = now_ns() - start;
+    struct pl_gpu_compile_stats after = pl_gpu_get_compile_stats(gpu);
+
+    // Everything not spent creating passes is attributed to generating the
+    // shaders (and their LUTs etc.) in the first place
+    uint64_t passes = after.total - before.total;
+    PL_ARRAY_APPEND(NULL, compile.total, total);
+    PL_ARRAY_APPEND(NULL, compile.generation, total - PL_MIN(passes, total));
+    PL_ARRAY_APPEND(NULL, compile.spirv, after.spirv - before.spirv);
+    PL_ARRAY_APPEND(NULL, compile.driver, after.driver - before.driver);
+    compile.passes = after.num_passes - before.num_passes;
+    pl_gpu_finish(gpu);
+
+    if (mode == COMPILE_COLD && !compile.dispatch.len) {
+        compile.dispatch.len = pl_renderer_save(rr, NULL);
+        compile.dispatch.buf = pl_alloc(NULL, compile.dispatch.len);
+        pl_renderer_save(rr, compile.dispatch.buf);
+        compile.pipeline.len = save_pipeline_cache(gpu, NULL, 0);
+        compile.pipeline.buf = pl_alloc(NULL, compile.pipeline.len);
+        save_pipeline_cache(gpu, compile.pipeline.buf, compile.pipeline.len);
+    }
+
+    pl_renderer_destroy(&rr);
+    render_teardown(gpu, &st);
+}
+
+struct compile_backend {
+    pl_log log;
+    void (*create)(pl_log log, bench_fn run);
+};
+
+static void compile_scenario(void *priv, const struct scenario *sc)
+{
+    const struct compile_backend *backend = priv;
+    compile.sc = sc;
+
+    for (enum compile_mode mode = 0; mode < COMPILE_MODE_COUNT; mode++) {
+        // e.g. OpenGL has no driver cache separate from the program binaries
+        if (mode == COMPILE_DISPATCH && !compile.dispatch.len)
+            continue;
+        if ((mode == COMPILE_PIPELINE || mode == COMPILE_BOTH) && !compile.pipeline.len)
+            continue;
+
+        compile.mode = mode;
+        for (int i = 0; i < COMPILE_REPS; i++)
+            backend->create(backend->log, compile_run);
+        if (!compile.total.num)
+            break; // no device
+
+        uint64_t sum = 0;
+        for (int i = 0; i < compile.total.num; i++)
+            sum += compile.total.elem[i];
+
+        char name[128];
+        snprintf(name, sizeof(name), "compile %s (%s)", sc->name, compile_modes[mode]);
+        samples_t none = {0};
+        struct bench_result *res = add_result(name, compile.total.num, 1e-9 * sum,
+                                              &compile.total, &none);
+        res->compile = (struct compile_info) {
+            .passes     = compile.passes,
+            .generation = compute_timing(&compile.generation).median,
+            .spirv      = compute_timing(&compile.spirv).median,
+            .driver     = compute_timing(&compile.driver).median,
+        };
+
+        if (print_text()) {
+            const struct compile_info *c = &res->compile;
+            printf("'%s' (%s):\t%3d passes, total %2.3f ms, generation %2.3f ms, "
+                   "spirv %2.3f ms, driver %2.3f ms\n", name,
+                   devices.elem[res->device].backend, c->passes, res->cpu.median,
+                   c->generation, c->spirv, c->driver);
+        }
+
+        compile.total.num = compile.generation.num = 0;
+        compile.spirv.num = compile.driver.num = 0;
+    }
+
+    pl_free(compile.total.elem);
+    pl_free(compile.generation.elem);
+    pl_free(compile.spirv.elem);
+    pl_free(compile.driver.elem);
+    pl_free(compile.dispatch.buf);
+    pl_free(compile.pipeline.buf);
+    memset(&compile, 0, sizeof(compile));
+}
+
+// Long-running soak test, cycling a single renderer through changing source
+// resolutions, formats, color spaces, scalers and hooks, to expose memory
+// growth and fragmentation that only builds up over time
+#define SOAK_PHASE_FRAMES 24   // frames rendered per configuration
+#define SOAK_REPORTS 16        // number of periodic reports (at most 1/min)
+
+static const char soak_hook[] =
+    "//!HOOK MAIN\n"
+    "//!BIND HOOKED\n"
+    "//!DESC soak tint\n"
+    "vec4 hook() { return HOOKED_texOff(0) * vec4(0.9, 1.0, 0.9, 1.0); }\n";
+
+struct soak_report {
+    struct pl_gpu_memory_stats mem;
+    uint64_t heap_bytes;        // sum of all allocated heap memory
+    int passes;                 // total number of passes compiled
+};
+
+static struct soak_report soak_report(pl_gpu gpu)
+{
+    struct soak_report r = {
+        .mem    = pl_gpu_get_memory_stats(gpu),
+        .passes = pl_gpu_get_compile_stats(gpu).num_passes,
+    };
+
+    for (int i = 0; i < r.mem.num_heaps; i++)
+        r.heap_bytes += r.mem.heaps[i].allocated;
+    return r;
+}
+
+static double soak_mib(const struct soak_report *r)
+{
+    return (r->mem.total.tex_bytes + r->mem.total.buf_bytes) / 1048576.0;
+}
+
+static void run_soak(pl_gpu gpu)
+{
+    const struct device_info *info = &devices.elem[cur_device];
+    if (print_text()) {
+        printf("= Running %d second soak test on %s (%s) =\n", opts.soak_secs,
+               info->backend, info->gpu);
+    }
+
+    static const struct { int w, h; } src_sizes[] = {
+        { 1920, 1080 }, { 1280, 720 }, { 3840, 2160 }, { 720, 480 }, { 2560, 1440 },
+    };
+
+    static const struct { int w, h; } dst_sizes[] = {
+        { 1920, 1080 }, { 2560, 1440 },
+    };
+
+    static const int depths[] = { 8, 16 };
+    const struct pl_color_space *colors[] = {
+        &pl_color_space_bt709, &pl_color_space_hdr10, &pl_color_space_bt2020_hlg,
+    };
+    const struct pl_filter_config *scalers[] = {
+        &pl_filter_bilinear, &pl_filter_spline36, &pl_filter_ewa_lanczos,
+        &pl_filter_mitchell,
+    };
+
+    // Largest source frame, at 16 bits per component
+    const size_t data_size = 3840 * 2160 * 3 * sizeof(uint16_t);
+    uint8_t *pixels = malloc(data_size);
+    REQUIRE(pixels);
+    for (size_t i = 0; i < data_size; i++)
+        pixels[i] = (i * 37) ^ (i >> 11);
+
+    pl_fmt fmt = pl_find_fmt(gpu, PL_FMT_UNORM, 4, 8, 8, PL_FMT_CAP_RENDERABLE);
+    REQUIRE(fmt);
+
+    const struct pl_hook *hook = pl_mpv_user_shader_parse(gpu, soak_hook,
+                                                          sizeof(soak_hook) - 1);
+    REQUIRE(hook);
+
+    pl_renderer rr = pl_renderer_create(gpu->log, gpu);
+    pl_tex src = NULL, fbos[NUM_RENDER_FBOS] = {0};
+    struct pass_counter cnt = {0};
+    samples_t cpu_all = {0}, gpu_all = {0}, cpu = {0}, gpu_times = {0};
+    struct soak_report first = {0}, last = {0};
+    unsigned long frames = 0;
+    int num_reports = 0;
+
+    const uint64_t duration = opts.soak_secs * UINT64_C(1000000000);
+    const uint64_t interval = PL_CLAMP(duration / SOAK_REPORTS,
+                                       UINT64_C(1000000000), UINT64_C(60000000000));
+    const uint64_t start = now_ns();
+    uint64_t next_report = start + interval, now = start;
+
+    for (int phase = 0; now - start < duration; phase++) {
+        const int src_w = src_sizes[phase % PL_ARRAY_SIZE(src_sizes)].w,
+                  src_h = src_sizes[phase % PL_ARRAY_SIZE(src_sizes)].h,
+                  dst_w = dst_sizes[phase / 7 % PL_ARRAY_SIZE(dst_sizes)].w,
+                  dst_h = dst_sizes[phase / 7 % PL_ARRAY_SIZE(dst_sizes)].h,
+                  depth = depths[phase % PL_ARRAY_SIZE(depths)];
+
+        // Mimic a player reconfiguring on every change of stream or window
+        struct pl_frame image = {
+            .repr  = pl_color_repr_rgb,
+            .color = *colors[phase % PL_ARRAY_SIZE(colors)],
+        };
+        REQUIRE(pl_upload_plane(gpu, &image.planes[0], &src, &(struct pl_plane_data) {
+            .type           = PL_FMT_UNORM,
+            .width          = src_w,
+            .height         = src_h,
+            .component_size = { depth, depth, depth },
+            .component_map  = { 0, 1, 2 },
+            .pixel_stride   = 3 * depth / 8,
+            .row_stride     = src_w * 3 * depth / 8,
+            .pixels         = pixels,
+        }));
+        image.num_planes = 1;
+
+        for (int i = 0; i < NUM_RENDER_FBOS; i++) {
+            REQUIRE(pl_tex_recreate(gpu, &fbos[i], pl_tex_params(
+                .format     = fmt,
+                .w          = dst_w,
+                .h          = dst_h,
+                .renderable = true,
+                .storable   = !!(fmt->caps & PL_FMT_CAP_STORABLE),
+            )));
+        }
+
+        struct pl_render_params params = pl_render_default_params;
+        params.upscaler = params.downscaler = scalers[phase % PL_ARRAY_SIZE(scalers)];
+        params.hooks = phase % 7 < 3 ? &hook : NULL;
+        params.num_hooks = params.hooks ? 1 : 0;
+        params.info_callback = count_pass;
+        params.info_priv = &cnt;
+
+        for (int f = 0; f < SOAK_PHASE_FRAMES; f++, frames++) {
+            struct pl_frame target;
+            pl_frame_from_swapchain(&target, &(struct pl_swapchain_frame) {
+                .fbo         = fbos[frames % NUM_RENDER_FBOS],
+                .color_repr  = pl_color_repr_rgb,
+                .color_space = pl_color_space_monitor,
+            });
+
+            cnt.frame_gpu = 0;
+            uint64_t cpu_start = now_ns();
+            REQUIRE(pl_render_image(rr, &image, &target, &params));
+            uint64_t cpu_time = now_ns() - cpu_start;
+            PL_ARRAY_APPEND(NULL, cpu, cpu_time);
+            PL_ARRAY_APPEND(NULL, cpu_all, cpu_time);
+            if (cnt.frame_gpu) {
+                PL_ARRAY_APPEND(NULL, gpu_times, cnt.frame_gpu);
+                PL_ARRAY_APPEND(NULL, gpu_all, cnt.frame_gpu);
+            }
+            if ((frames + 1) % NUM_RENDER_FBOS == 0) {
+                pl_gpu_flush(gpu);
+                if (now_ns() - start >= duration)
+                    break;
+            }
+        }
+
+        now = now_ns();
+        if (now < next_report && now - start < duration)
+            continue;
+
+        // Let all resources of the current configuration settle first
+        pl_gpu_finish(gpu);
+        last = soak_report(gpu);
+        if (!num_reports++)
+            first = last;
+
+        if (print_text()) {
+            struct timing tc = compute_timing(&cpu), tg = compute_timing(&gpu_times);
+            printf("  %6.0fs: %7.1f MiB in %3d textures / %3d buffers, ",
+                   1e-9 * (now - start), soak_mib(&last),
+                   last.mem.total.num_textures, last.mem.total.num_buffers);
+            if (last.mem.num_heaps)
+                printf("%7.1f MiB heaps, ", last.heap_bytes / 1048576.0);
+            if (last.mem.slab_efficiency)
+                printf("slab efficiency %5.1f%%, ", 100.0 * last.mem.slab_efficiency);
+            printf("%4d passes, cpu p50 %2.3f ms p99 %2.3f ms", last.passes,
+                   tc.median, tc.p99);
+            if (gpu_times.num)
+                printf(", gpu p50 %2.3f ms p99 %2.3f ms", tg.median, tg.p99);
+            printf("\n");
+        }
+
+        cpu.num = gpu_times.num = 0;
+        next_report = now + interval;
+    }
+
+    pl_gpu_finish(gpu);
+    const float secs = 1e-9 * (now_ns() - start);
+    add_result("soak", frames, secs, &cpu_all, &gpu_all);
+    if (print_text()) {
+        printf("'soak':\t%lu frames in %1.3f seconds, memory %+.1f MiB, "
+               "heaps %+.1f MiB, %+d passes since the first report\n",
+               frames, secs, soak_mib(&last) - soak_mib(&first),
+               ((double) last.heap_bytes - first.heap_bytes) / 1048576.0,
+               last.passes - first.passes);
+    }
+
+    pl_free(cpu.elem);
+    pl_free(gpu_times.elem);
+    pl_free(cpu_all.elem);
+    pl_free(gpu_all.elem);
+    pl_renderer_destroy(&rr);
+    pl_mpv_user_shader_destroy(&hook);
+    pl_tex_destroy(gpu, &src);
+    for (int i = 0; i < NUM_RENDER_FBOS; i++)
+        pl_tex_destroy(gpu, &fbos[i]);
+    free(pixels);
+}
+
+static void bench_dummy(pl_log log, bench_fn run)
+{
+    pl_gpu gpu = pl_gpu_dummy_create(log, pl_gpu_dummy_params( .noop_passes = true ));
+    if (!gpu)
+        return;
+
+    struct device_info *info = add_device("dummy");
+    snprintf(info->gpu, sizeof(info->gpu), "dummy");
+    snprintf(info->driver, sizeof(info->driver), "libplacebo %s", PL_VERSION);
+    snprintf(info->api, sizeof(info->api), "%d", PL_API_VER);
+    run(gpu);
+    pl_gpu_dummy_destroy(&gpu);
+}
+
+static void run_backend(pl_log log, const char *name,
+                        void (*create)(pl_log log, bench_fn run))
+{
+    // The dummy GPU can't execute anything, so it's only useful for `--cpu`,
+    // and conversely, the CPU benchmarks should not involve any real GPU
+    if (!want_backend(name) || (opts.mode == MODE_CPU) != !strcmp(name, "dummy"))
+        return;
+
+    switch (opts.mode) {
+    case MODE_DEFAULT:
+        create(log, run_benchmarks);
+        return;
+    case MODE_COMPILE:
+        for_each_scenario(&(struct compile_backend) { log, create },
+                          compile_scenario);
+        return;
+    case MODE_TRANSFERS:
+        create(log, run_transfers);
+        return;
+    case MODE_CPU:
+        create(log, run_cpu);
+        return;
+    case MODE_SOAK:
+        create(log, run_soak);
+        return;
+    }
+}
+
+static const char usage[] =
+    "Usage: bench [options]\n"
+    "  --backend NAME      only run on this backend (vulkan, opengl or d3d11)\n"
+    "  --compile           measure shader compilation latency instead, with and\n"
+    "                      without the dispatch and pipeline caches\n"
+    "  --transfers         measure texture upload/download throughput instead\n"
+    "  --cpu               measure the CPU overhead of the frame queue, renderer\n"
+    "                      and dispatch instead, on a dummy GPU\n"
+    "  --soak SECS         render with constantly changing settings for SECS\n"
+    "                      seconds instead, periodically reporting memory usage,\n"
+    "                      slab efficiency, pass counts and frame times\n"
+    "  --json, --csv       write machine-readable results\n"
+    "  --output FILE       write the results to FILE instead of stdout\n"
+    "  --baseline FILE     compare against results from a previous --csv run,\n"
+    "                      failing if any benchmark regressed\n"
+    "  --threshold PCT     maximum allowed regression (default: 10)\n";
+
+int main(int argc, char **argv)
+{
+    setbuf(stdout, NULL);
+    setbuf(stderr, NULL);
+
+    // e.g. `meson test benchmark --test-args '--csv --baseline base.csv'`
+    opts.out = stdout;
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i], *val = i + 1 < argc ? argv[i + 1] : NULL;
+        if (!strcmp(arg, "--json")) {
+            opts.format = OUTPUT_JSON;
+        } else if (!strcmp(arg, "--csv")) {
+            opts.format = OUTPUT_CSV;
+        } else if (!strcmp(arg, "--compile")) {
+            opts.mode = MODE_COMPILE;
+        } else if (!strcmp(arg, "--transfers")) {
+            opts.mode = MODE_TRANSFERS;
+        } else if (!strcmp(arg, "--cpu")) {
+            opts.mode = MODE_CPU;
+        } else if (!strcmp(arg, "--soak") && val && atoi(val) > 0) {
+            opts.mode = MODE_SOAK;
+            opts.soak_secs = atoi(val);
+            i++;
+        } else if (!strcmp(arg, "--backend") && val) {
+            opts.backend = val;
+            i++;
+        } else if (!strcmp(arg, "--output") && val) {
+            if (!(opts.out = fopen(val, "w"))) {
+                fprintf(stderr, "Failed opening '%s' for writing!\n", val);
+                return 1;
+            }
+            i++;
+        } else if (!strcmp(arg, "--baseline") && val) {
+            opts.baseline = val;
+            i++;
+        } else if (!strcmp(arg, "--threshold") && val) {
+            opts.threshold = atof(val);
+            i++;
+        } else {
+            fprintf(stderr, "%s", usage);
+            return 1;
+        }
+    }
+
+    pl_log log = pl_log_create(PL_API_VER, pl_log_params(
+        .log_cb     = isatty(fileno(stdout)) ? pl_log_color : pl_log_simple,
+        .log_level  = PL_LOG_WARN,
+    ));
+
+#ifdef PL_HAVE_UNIX
+    // Keep the driver's own on-disk shader cache from hiding cold compiles
+    if (opts.mode == MODE_COMPILE) {
+        setenv("MESA_SHADER_CACHE_DISABLE", "true", 1);
+        setenv("__GL_SHADER_DISK_CACHE", "0", 1);
+    }
+#endif
+
+    run_backend(log, "dummy", bench_dummy);
+#ifdef PL_HAVE_VULKAN
+    run_backend(log, "vulkan", bench_vulkan);
+#endif
+#ifdef BENCH_OPENGL
+    run_backend(log, "opengl", bench_opengl);
+#endif
+#ifdef PL_HAVE_D3D11
+    run_backend(log, "d3d11", bench_d3d11);
+#endif
+
+    if (!devices.num) {
+        pl_log_destroy(&log);
+        return SKIP;
+    }
+
+    if (print_text())
+        print_summary();
+    write_results(opts.out);
+    if (opts.out != stdout)
+        fclose(opts.out);
+
+    bool ok = !opts.baseline || compare_baseline(opts.baseline);
+    pl_free(results.elem);
+    pl_free(devices.elem);
+    pl_log_destroy(&log);
+    return ok ? 0 : 1;
+}
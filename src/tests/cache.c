@@ -0,0 +1,161 @@
+#include "tests.h"
+#include "cache.h"
+
+struct backing {
+    pl_cache_obj objs[16];
+    int num_set;
+    int num_get;
+};
+
+static void backing_set(void *priv, pl_cache_obj obj)
+{
+    struct backing *b = priv;
+    b->num_set++;
+    for (int i = 0; i < PL_ARRAY_SIZE(b->objs); i++) {
+        pl_cache_obj *slot = &b->objs[i];
+        if (slot->size && slot->key != obj.key)
+            continue;
+        pl_cache_obj_free(slot);
+        if (obj.size) {
+            *slot = (pl_cache_obj) {
+                .key  = obj.key,
+                .data = malloc(obj.size),
+                .size = obj.size,
+                .free = free,
+            };
+            REQUIRE(slot->data);
+            memcpy(slot->data, obj.data, obj.size);
+        }
+        return;
+    }
+}
+
+static pl_cache_obj backing_get(void *priv, uint64_t key)
+{
+    struct backing *b = priv;
+    b->num_get++;
+    for (int i = 0; i < PL_ARRAY_SIZE(b->objs); i++) {
+        pl_cache_obj *slot = &b->objs[i];
+        if (slot->size && slot->key == key) {
+            pl_cache_obj obj = *slot;
+            *slot = (pl_cache_obj) {0};
+            return obj;
+        }
+    }
+
+    return (pl_cache_obj) {0};
+}
+
+int main()
+{
+    pl_log log = pl_test_logger();
+    pl_cache cache = pl_cache_create(pl_cache_params(
+        .log             = log,
+        .max_object_size = 16,
+        .max_total_size  = 32,
+    ));
+
+    // Basic insertion and retrieval
+    static const uint8_t data[16] = "0123456789abcde";
+    pl_cache_obj obj = { .key = 1, .data = (void *) data, .size = 8 };
+    pl_cache_set(cache, &obj);
+    REQUIRE(!obj.data && !obj.size);
+    REQUIRE(pl_cache_objects(cache) == 1);
+    REQUIRE(pl_cache_size(cache) == 8);
+
+    obj = (pl_cache_obj) { .key = 1 };
+    REQUIRE(pl_cache_get(cache, &obj));
+    REQUIRE(obj.size == 8 && obj.free);
+    REQUIRE(memcmp(obj.data, data, 8) == 0);
+    pl_cache_obj_free(&obj);
+
+    obj = (pl_cache_obj) { .key = 2 };
+    REQUIRE(!pl_cache_get(cache, &obj));
+    REQUIRE(!obj.data && !obj.size);
+
+    uint8_t buf[8];
+    REQUIRE(pl_cache_get_exact(cache, 1, buf, sizeof(buf)));
+    REQUIRE(memcmp(buf, data, sizeof(buf)) == 0);
+    REQUIRE(!pl_cache_get_exact(cache, 1, buf, 4));
+    REQUIRE(!pl_cache_get_exact(NULL, 1, buf, sizeof(buf)));
+
+    // Objects exceeding the maximum object size are ignored
+    pl_cache_set_copy(cache, 2, data, 17);
+    REQUIRE(pl_cache_objects(cache) == 1);
+
+    // Least recently used objects get evicted to stay within the budget
+    pl_cache_set_copy(cache, 2, data, 16);
+    REQUIRE(pl_cache_get_exact(cache, 1, buf, sizeof(buf))); // touch key 1
+    pl_cache_set_copy(cache, 3, data, 16);
+    REQUIRE(pl_cache_objects(cache) == 2);
+    REQUIRE(pl_cache_size(cache) == 24);
+    REQUIRE(pl_cache_get_exact(cache, 1, buf, 8));
+    REQUIRE(!pl_cache_get_exact(cache, 2, buf, 16));
+
+    // Replacing and deleting objects
+    pl_cache_set_copy(cache, 1, data + 8, 8);
+    REQUIRE(pl_cache_get_exact(cache, 1, buf, 8));
+    REQUIRE(memcmp(buf, data + 8, 8) == 0);
+    pl_cache_set(cache, &(pl_cache_obj) { .key = 3 });
+    REQUIRE(pl_cache_objects(cache) == 1);
+    REQUIRE(pl_cache_size(cache) == 8);
+
+    // Serialization round trip
+    pl_cache_set_copy(cache, 4, data, 12);
+    size_t size = pl_cache_save(cache, NULL);
+    uint8_t *saved = malloc(size);
+    REQUIRE(saved);
+    REQUIRE(pl_cache_save(cache, saved) == size);
+
+    pl_cache copy = pl_cache_create(pl_cache_params( .log = log ));
+    REQUIRE(pl_cache_load(copy, saved, size) == 2);
+    REQUIRE(pl_cache_size(copy) == 20);
+    uint8_t buf12[12];
+    REQUIRE(pl_cache_get_exact(copy, 4, buf12, sizeof(buf12)));
+    REQUIRE(memcmp(buf12, data, sizeof(buf12)) == 0);
+
+    // Corrupt objects are skipped, invalid data is rejected entirely
+    pl_cache_reset(copy);
+    REQUIRE(pl_cache_objects(copy) == 0);
+    saved[size - 1] ^= 0xFF;
+    REQUIRE(pl_cache_load(copy, saved, size) == 1);
+    REQUIRE(pl_cache_load(copy, saved, size - 4) == 1);
+    REQUIRE(pl_cache_load(copy, saved, 4) < 0);
+    saved[0] ^= 0xFF;
+    REQUIRE(pl_cache_load(copy, saved, size) < 0);
+    free(saved);
+    pl_cache_destroy(&copy);
+    pl_cache_destroy(&cache);
+    REQUIRE(!cache);
+
+    // External storage callbacks
+    struct backing backing = {0};
+    cache = pl_cache_create(pl_cache_params(
+        .log  = log,
+        .set  = backing_set,
+        .get  = backing_get,
+        .priv = &backing,
+    ));
+
+    pl_cache_set_copy(cache, 5, data, 16);
+    REQUIRE(backing.num_set == 1);
+    pl_cache_reset(cache);
+    REQUIRE(pl_cache_get_exact(cache, 5, buf, 8) == false); // wrong size
+    REQUIRE(backing.num_get == 1);
+    REQUIRE(pl_cache_objects(cache) == 1); // fetched into cache
+    uint8_t buf16[16];
+    REQUIRE(pl_cache_get_exact(cache, 5, buf16, sizeof(buf16)));
+    REQUIRE(memcmp(buf16, data, sizeof(buf16)) == 0);
+    REQUIRE(backing.num_get == 1);
+    REQUIRE(!pl_cache_get_exact(cache, 6, buf, 8));
+    REQUIRE(backing.num_get == 2);
+
+    pl_cache_set(cache, &(pl_cache_obj) { .key = 5 });
+    REQUIRE(backing.num_set == 2);
+    REQUIRE(pl_cache_objects(cache) == 0);
+
+    pl_cache_destroy(&cache);
+    for (int i = 0; i < PL_ARRAY_SIZE(backing.objs); i++)
+        pl_cache_obj_free(&backing.objs[i]);
+    pl_log_destroy(&log);
+}
@@ -1,16 +1,108 @@
 #include "tests.h"
+#include "log.h"
+#include "pl_thread_pool.h"
 
 static int irand()
 {
     return rand() - RAND_MAX / 2;
 }
 
+struct log_count {
+    int msgs;
+    int dropped;
+    bool long_ok;
+};
+
+static void count_cb(void *priv, enum pl_log_level level, const char *msg)
+{
+    struct log_count *count = priv;
+    int dropped;
+    if (sscanf(msg, "Log queue overflow, dropped %d messages", &dropped) == 1) {
+        count->dropped += dropped;
+    } else if (strncmp(msg, "msg ", 4) == 0) {
+        count->msgs++;
+    } else if (strncmp(msg, "long ", 5) == 0) {
+        count->long_ok = strlen(msg) == 5 + 1000;
+    }
+}
+
+static void inc_job(void *priv)
+{
+    pl_rc_t *counter = priv;
+    pl_rc_ref(counter);
+}
+
+struct job_queue {
+    PL_ARRAY(void *) privs;
+    void (*job)(void *job_priv);
+};
+
+static void queue_job(void *priv, void (*job)(void *job_priv), void *job_priv)
+{
+    struct job_queue *queue = priv;
+    queue->job = job;
+    PL_ARRAY_APPEND(NULL, queue->privs, job_priv);
+}
+
 int main()
 {
     pl_log log = pl_test_logger();
     pl_log_update(log, NULL);
     pl_log_destroy(&log);
 
+    // Test asynchronous logging, including dropped and long messages
+    struct log_count count = {0};
+    log = pl_log_create(PL_API_VER, pl_log_params(
+        .log_cb      = count_cb,
+        .log_priv    = &count,
+        .log_level   = PL_LOG_DEBUG,
+        .async_queue = 16,
+    ));
+    // The queue still has room for these, behind the initialization message
+    pl_info(log, "long %1000d", 0);
+    pl_trace(log, "msg filtered");
+    for (int i = 0; i < 1000; i++)
+        pl_debug(log, "msg %d", i);
+    pl_log_destroy(&log);
+    REQUIRE(count.long_ok);
+    REQUIRE(count.msgs + count.dropped == 1000);
+    REQUIRE(count.msgs >= 14);
+
+    // Test the background job pool, with both the internal and an external
+    // (deferred) executor
+    log = pl_test_logger();
+    pl_rc_t counter;
+    pl_rc_init(&counter);
+    pl_job jobs[64];
+    for (int i = 0; i < PL_ARRAY_SIZE(jobs); i++) {
+        jobs[i] = pl_job_submit(log, inc_job, &counter);
+        REQUIRE(jobs[i]);
+    }
+    for (int i = 0; i < PL_ARRAY_SIZE(jobs); i++) {
+        pl_job_wait(&jobs[i]);
+        REQUIRE(!jobs[i]);
+    }
+    REQUIRE(pl_rc_count(&counter) == 1 + PL_ARRAY_SIZE(jobs));
+    pl_log_destroy(&log);
+
+    struct job_queue queue = {0};
+    log = pl_log_create(PL_API_VER, pl_log_params(
+        .queue_job  = queue_job,
+        .queue_priv = &queue,
+    ));
+    pl_rc_init(&counter);
+    jobs[0] = pl_job_submit(log, inc_job, &counter);
+    jobs[1] = pl_job_submit(log, inc_job, &counter);
+    REQUIRE(!pl_job_done(jobs[0]));
+    pl_job_wait(&jobs[0]);  // runs inline
+    pl_job_cancel(&jobs[1]); // never runs
+    REQUIRE(pl_rc_count(&counter) == 2);
+    for (int i = 0; i < queue.privs.num; i++)
+        queue.job(queue.privs.elem[i]); // must be no-ops by now
+    REQUIRE(pl_rc_count(&counter) == 2);
+    pl_free(queue.privs.elem);
+    pl_log_destroy(&log);
+
     // Test some misc helper functions
     struct pl_rect2d rc2 = {
         irand(), irand(),
@@ -133,4 +225,37 @@ int main()
     REQUIRE(feq(rc.x1, -50, 1e-6));
     REQUIRE(feq(rc.y0, 980, 1e-6));
     REQUIRE(feq(rc.y1, -100, 1e-6));
+
+    // Test the arena-backed children of refs
+    struct pl_ref *ref = pl_ref_new(NULL);
+    char *str = pl_asprintf(ref, "%d", 1234);
+    PL_ARRAY(int) arr = {0};
+    for (int i = 0; i < 5000; i++)
+        PL_ARRAY_APPEND(ref, arr, i);
+    for (int i = 0; i < arr.num; i++)
+        REQUIRE(arr.elem[i] == i);
+    REQUIRE(strcmp(str, "1234") == 0);
+    pl_free(str); // no-op
+
+    struct pl_ref *dup = pl_ref_dup(ref);
+    REQUIRE(!pl_ref_reset(ref));
+    pl_ref_deref(&dup);
+    REQUIRE(pl_ref_reset(ref));
+    REQUIRE(strcmp(pl_asprintf(ref, "%s", "reused"), "reused") == 0);
+    pl_ref_deref(&ref);
+    REQUIRE(!ref);
+
+    // Test standalone arenas, including regular (stolen) children
+    void *parent = pl_tmp(NULL);
+    void *arena = pl_arena_new(parent);
+    int *nums = pl_calloc_ptr(arena, 1000, nums);
+    for (int i = 0; i < 1000; i++)
+        REQUIRE(nums[i] == 0);
+    nums = pl_realloc(arena, nums, 2000 * sizeof(*nums));
+    REQUIRE(pl_get_size(nums) == 2000 * sizeof(*nums));
+    pl_steal(arena, pl_strdup0(NULL, pl_str0("stolen")));
+    pl_arena_reset(arena);
+    str = pl_asprintf(arena, "%d", 5678);
+    REQUIRE(strcmp(str, "5678") == 0);
+    pl_free(parent); // frees the arena
 }
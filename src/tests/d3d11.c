@@ -41,11 +41,21 @@ int main()
         const struct pl_d3d11 *d3d11 = pl_d3d11_create(log, pl_d3d11_params(
             .debug = true,
             .adapter_luid = desc.AdapterLuid,
+            .exclusive = i % 2,
         ));
         REQUIRE(d3d11);
 
         gpu_shader_tests(d3d11->gpu);
 
+        // Round-trip the shader cache populated by the shader tests
+        size_t cache_size = pl_d3d11_save_shader_cache(d3d11->gpu, NULL, 0);
+        REQUIRE(cache_size);
+        uint8_t *cache = malloc(cache_size);
+        REQUIRE(cache);
+        REQUIRE(pl_d3d11_save_shader_cache(d3d11->gpu, cache, cache_size) == cache_size);
+        pl_d3d11_load_shader_cache(d3d11->gpu, cache, cache_size);
+        free(cache);
+
         pl_d3d11_destroy(&d3d11);
     }
 
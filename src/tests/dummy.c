@@ -1,5 +1,7 @@
 #include "gpu_tests.h"
 
+#include <libplacebo/utils/gpu_pool.h>
+
 int main()
 {
     pl_log log = pl_test_logger();
@@ -59,9 +61,150 @@ int main()
     REQUIRE(res->input == PL_SHADER_SIG_SAMPLER);
     printf("generated sampler2D shader:\n\n%s\n", res->glsl);
 
+    // Half precision should only affect GLSL ES, and never HDR curves
+    struct pl_shader_params half_params = {
+        .gpu = gpu,
+        .glsl = { .version = 300, .gles = true },
+        .half_precision = true,
+    };
+
+    pl_shader_reset(sh, &half_params);
+    REQUIRE(pl_shader_sample_polar(sh, &src, &filter_params));
+    pl_shader_linearize(sh, &pl_color_space_hdr10);
+    REQUIRE((res = pl_shader_finalize(sh)));
+    REQUIRE(strstr(res->glsl, "mediump float w"));
+    REQUIRE(!strstr(res->glsl, "mediump vec4 color"));
+
+    pl_shader_reset(sh, &half_params);
+    REQUIRE(pl_shader_sample_polar(sh, &src, &filter_params));
+    pl_shader_linearize(sh, &pl_color_space_srgb);
+    REQUIRE((res = pl_shader_finalize(sh)));
+    REQUIRE(strstr(res->glsl, "mediump vec4 color"));
+
+    half_params.glsl.gles = false;
+    pl_shader_reset(sh, &half_params);
+    REQUIRE(pl_shader_sample_polar(sh, &src, &filter_params));
+    pl_shader_linearize(sh, &pl_color_space_srgb);
+    REQUIRE((res = pl_shader_finalize(sh)));
+    REQUIRE(!strstr(res->glsl, "mediump"));
+
+    // Text spliced in from sub-shaders must outlive them
+    pl_shader_reset(sh, pl_shader_params( .gpu = gpu ));
+    pl_shader sub = pl_shader_alloc(log, pl_shader_params( .gpu = gpu, .id = 1 ));
+    pl_shader_linearize(sub, &pl_color_space_hdr10);
+    REQUIRE(sh_require(sh, PL_SHADER_SIG_COLOR, 0, 0));
+    ident_t fn = sh_subpass(sh, sub);
+    REQUIRE(fn);
+    pl_shader_reset(sub, NULL);
+    pl_shader_linearize(sub, &pl_color_space_srgb);
+    pl_shader_free(&sub);
+    GLSL("color = "$"(color); \n", fn);
+    REQUIRE((res = pl_shader_finalize(sh)));
+    REQUIRE(strstr(res->glsl, "// pl_shader_linearize"));
+    REQUIRE(strstr(res->glsl, "vec3(1.0/78.84375"));
+    pl_str text = {0};
+    sh_text_write(sh, NULL, &text);
+    REQUIRE(pl_str_equals(text, pl_str0(res->glsl)));
+    REQUIRE(sh_text_hash(sh) == sh_text_hash(sh));
+    pl_free(text.buf);
+
     pl_shader_free(&sh);
     pl_shader_obj_destroy(&lut);
     pl_tex_destroy(gpu, &dummy);
+
+    // Multi-GPU scheduling, with a second device twice as fast
+    pl_gpu gpu2 = pl_gpu_dummy_create(log, NULL);
+    pl_gpu_pool pool = pl_gpu_pool_create(log, pl_gpu_pool_params(
+        .devices = (struct pl_gpu_pool_device[]) {
+            { .gpu = gpu,  .model = 1 },
+            { .gpu = gpu2, .model = 1, .weight = 2.0 },
+        },
+        .num_devices = 2,
+    ));
+    REQUIRE(pool);
+    REQUIRE(pl_gpu_pool_num_devices(pool) == 2);
+    REQUIRE(pl_gpu_pool_gpu(pool, 1) == gpu2);
+    REQUIRE(pl_gpu_pool_renderer(pool, 0));
+
+    int picks[2] = {0};
+    for (int i = 0; i < 30; i++)
+        picks[pl_gpu_pool_pick(pool)]++;
+    REQUIRE(picks[0] == 10);
+    REQUIRE(picks[1] == 20);
+
+    int s0 = pl_gpu_pool_assign(pool, 100);
+    REQUIRE(pl_gpu_pool_assign(pool, 100) == s0);
+    pl_gpu_pool_release(pool, 100);
+    pl_gpu_pool_sync_caches(pool);
+    pl_gpu_pool_destroy(&pool);
+    pl_gpu_dummy_destroy(&gpu2);
+
+    // No-op passes allow running the whole renderer on the CPU
+    pl_gpu noop = pl_gpu_dummy_create(log, pl_gpu_dummy_params(
+        .noop_passes  = true,
+        .record_stats = true,
+    ));
+    pl_fmt fmt = pl_find_named_fmt(noop, "rgba8");
+    pl_tex img = pl_tex_create(noop, pl_tex_params(
+        .w = 64, .h = 64, .format = fmt, .sampleable = true,
+    ));
+    pl_tex fbo = pl_tex_create(noop, pl_tex_params(
+        .w = 32, .h = 32, .format = fmt, .renderable = true,
+    ));
+    REQUIRE(img && fbo);
+
+    struct pl_gpu_dummy_stats dstats = pl_gpu_dummy_get_stats(noop);
+    REQUIRE(dstats.tex_allocs == 2);
+    REQUIRE(dstats.vram == (64 * 64 + 32 * 32) * 4);
+
+    struct pl_frame image, target;
+    pl_frame_from_swapchain(&target, &(struct pl_swapchain_frame) {
+        .fbo         = fbo,
+        .color_repr  = pl_color_repr_rgb,
+        .color_space = pl_color_space_srgb,
+    });
+    image = target;
+    image.planes[0].texture = img;
+
+    pl_renderer rr = pl_renderer_create(log, noop);
+    pl_gpu_dummy_reset_stats(noop);
+    REQUIRE(pl_render_image(rr, &image, &target, &pl_render_high_quality_params));
+
+    dstats = pl_gpu_dummy_get_stats(noop);
+    REQUIRE(dstats.pass_runs > 0);
+    REQUIRE(dstats.invocations >= 32 * 32);
+    REQUIRE(dstats.tex_fetches >= 32 * 32);
+    REQUIRE(dstats.alu_ops > dstats.invocations);
+    REQUIRE(dstats.bytes_read >= 64 * 64 * 4);
+    REQUIRE(dstats.bytes_written >= 32 * 32 * 4);
+    REQUIRE(dstats.vram_peak >= dstats.vram);
+    REQUIRE(dstats.vram > (64 * 64 + 32 * 32) * 4);
+    REQUIRE(pl_gpu_get_compile_stats(noop).num_passes > 0);
+
+    struct pl_gpu_memory_stats mem = pl_gpu_get_memory_stats(noop);
+    REQUIRE(mem.owners[PL_GPU_MEM_USER].num_textures == 2);
+    REQUIRE(mem.owners[PL_GPU_MEM_USER].tex_bytes == (64 * 64 + 32 * 32) * 4);
+    REQUIRE(mem.owners[PL_GPU_MEM_RENDERER].num_textures > 0);
+    REQUIRE(mem.total.tex_bytes > mem.owners[PL_GPU_MEM_USER].tex_bytes);
+
+    struct pl_render_stats rstats = pl_renderer_get_stats(rr);
+#ifdef PL_CPU_PROFILE
+    REQUIRE(rstats.cpu[PL_RENDER_CPU_GENERATE].num_frames == 1);
+    REQUIRE(rstats.cpu[PL_RENDER_CPU_FINALIZE].last > 0);
+    REQUIRE(rstats.cpu[PL_RENDER_CPU_SUBMIT].last > 0);
+#else
+    REQUIRE(rstats.cpu[PL_RENDER_CPU_GENERATE].num_frames == 0);
+#endif
+    pl_renderer_destroy(&rr);
+
+    mem = pl_gpu_get_memory_stats(noop);
+    REQUIRE(mem.total.num_textures == 2);
+    REQUIRE(mem.total.tex_bytes == mem.owners[PL_GPU_MEM_USER].tex_bytes);
+    pl_tex_destroy(noop, &img);
+    pl_tex_destroy(noop, &fbo);
+    REQUIRE(pl_gpu_dummy_get_stats(noop).vram == 0);
+    pl_gpu_dummy_destroy(&noop);
+
     pl_gpu_dummy_destroy(&gpu);
     pl_log_destroy(&log);
 }
@@ -32,6 +32,14 @@ int main()
                 }
                 REQUIRE(feq(sum, 1.0, 1e-6));
             }
+
+            // Ensure the rows for opposite offsets mirror each other
+            for (int i = 0; i < params.lut_entries; i++) {
+                const float *row = &flt->weights[i * flt->row_stride];
+                const float *mirror = &flt->weights[(params.lut_entries - 1 - i) * flt->row_stride];
+                for (int n = 0; n < flt->row_size; n++)
+                    REQUIRE(feq(row[n], mirror[flt->row_size - 1 - n], 1e-6));
+            }
         }
 
         pl_filter_free(&flt);
@@ -18,5 +18,7 @@ int main()
         size_t len = __AFL_FUZZ_TESTCASE_LEN;
         lut = pl_lut_parse_cube(NULL, (char *) buf, len);
         pl_lut_free(&lut);
+        lut = pl_lut_load(NULL, buf, len);
+        pl_lut_free(&lut);
     }
 }
@@ -1,5 +1,14 @@
 #include "tests.h"
 #include "shaders.h"
+#include "pl_clock.h"
+#include <libplacebo/utils/export_ring.h>
+#include <libplacebo/utils/filter_pipeline.h>
+
+#ifdef PL_HAVE_WIN32
+#include <windows.h>
+#else
+#include <poll.h>
+#endif
 
 static void pl_buffer_tests(pl_gpu gpu)
 {
@@ -17,6 +26,7 @@ static void pl_buffer_tests(pl_gpu gpu)
     pl_buf buf = NULL, tbuf = NULL;
 
     printf("test buffer static creation and readback\n");
+    struct pl_gpu_mem_usage mem = pl_gpu_get_memory_stats(gpu).owners[PL_GPU_MEM_USER];
     buf = pl_buf_create(gpu, &(struct pl_buf_params) {
         .size = buf_size,
         .host_readable = true,
@@ -24,6 +34,9 @@ static void pl_buffer_tests(pl_gpu gpu)
     });
 
     REQUIRE(buf);
+    struct pl_gpu_mem_usage mem_new = pl_gpu_get_memory_stats(gpu).owners[PL_GPU_MEM_USER];
+    REQUIRE(mem_new.num_buffers == mem.num_buffers + 1);
+    REQUIRE(mem_new.buf_bytes == mem.buf_bytes + buf->params.size);
     REQUIRE(pl_buf_read(gpu, buf, 0, test_dst, buf_size));
     REQUIRE(memcmp(test_src, test_dst, buf_size) == 0);
     pl_buf_destroy(gpu, &buf);
@@ -73,6 +86,106 @@ static void pl_buffer_tests(pl_gpu gpu)
         REQUIRE(!pl_buf_poll(gpu, buf, 0));
         REQUIRE(memcmp(test_src, buf->data, buf_size) == 0);
         pl_buf_destroy(gpu, &buf);
+
+        printf("test host mapped buffer pool\n");
+        pl_buf_pool pool = pl_buf_pool_create(gpu, pl_buf_pool_params(
+            .max_idle = 1,
+        ));
+
+        REQUIRE(pl_buf_pool_gpu(pool) == gpu);
+        buf = pl_buf_pool_get(pool, buf_size);
+        REQUIRE(buf && buf->data && buf->params.size == buf_size);
+        pl_buf orig = buf;
+        pl_buf_pool_put(pool, &buf);
+        REQUIRE(!buf);
+        pl_gpu_finish(gpu);
+        buf = pl_buf_pool_get(pool, buf_size);
+        REQUIRE(buf == orig);
+
+        // Buffers of different sizes are never reused
+        tbuf = pl_buf_pool_get(pool, buf_size / 2);
+        REQUIRE(tbuf && tbuf != buf && tbuf->params.size == buf_size / 2);
+        pl_buf_pool_put(pool, &tbuf);
+
+        // Buffers returned after destruction are destroyed directly
+        pl_buf_pool pool_ref = pool;
+        pl_buf_pool_destroy(&pool);
+        REQUIRE(!pool);
+        pl_buf_pool_put(pool_ref, &buf);
+        REQUIRE(!buf);
+
+        // Allocations exceeding `max_bytes` fail, unless idle buffers can be
+        // evicted to make room
+        pool = pl_buf_pool_create(gpu, pl_buf_pool_params(
+            .max_bytes = buf_size,
+        ));
+
+        buf = pl_buf_pool_get(pool, buf_size / 2);
+        REQUIRE(buf);
+        tbuf = pl_buf_pool_get(pool, buf_size);
+        REQUIRE(!tbuf);
+        pl_buf_pool_put(pool, &buf);
+        pl_gpu_finish(gpu);
+        tbuf = pl_buf_pool_get(pool, buf_size);
+        REQUIRE(tbuf);
+        pl_buf_pool_put(pool, &tbuf);
+        pl_buf_pool_destroy(&pool);
+    }
+
+    printf("test buffer pool with custom params\n");
+    pl_buf_pool pool = pl_buf_pool_create(gpu, NULL);
+    const struct pl_buf_params *params = pl_buf_params(
+        .size = buf_size,
+        .host_writable = true,
+        .host_readable = true,
+    );
+
+    buf = pl_buf_pool_get_ex(pool, params);
+    REQUIRE(buf);
+    pl_buf_write(gpu, buf, 0, test_src, buf_size);
+    REQUIRE(pl_buf_read(gpu, buf, 0, test_dst, buf_size));
+    REQUIRE(memcmp(test_src, test_dst, buf_size) == 0);
+    pl_buf orig = buf;
+    pl_buf_pool_put(pool, &buf);
+    pl_gpu_finish(gpu);
+
+    // Buffers lacking requested capabilities are never reused
+    tbuf = pl_buf_pool_get_ex(pool, pl_buf_params(
+        .size = buf_size,
+        .host_writable = true,
+        .storable = true,
+    ));
+    REQUIRE(tbuf != orig);
+    pl_buf_pool_put(pool, &tbuf);
+    buf = pl_buf_pool_get_ex(pool, pl_buf_params(
+        .size = buf_size,
+        .host_readable = true,
+    ));
+    REQUIRE(buf == orig);
+    pl_buf_pool_put(pool, &buf);
+    pl_buf_pool_destroy(&pool);
+
+    // Test frame throttling
+    for (int i = 0; i < 4; i++) {
+        REQUIRE(pl_gpu_end_frame(gpu, 2, UINT64_MAX));
+        REQUIRE(pl_gpu_frames_in_flight(gpu) <= 2);
+    }
+    REQUIRE(pl_gpu_end_frame(gpu, 0, 0));
+    pl_gpu_finish(gpu);
+    REQUIRE(pl_gpu_end_frame(gpu, 1, UINT64_MAX));
+    REQUIRE(pl_gpu_frames_in_flight(gpu) <= 1);
+
+    // Test completion handles
+    union pl_handle done;
+    if (gpu->limits.thread_safe && pl_gpu_completion_handle(gpu, &done)) {
+#ifdef PL_HAVE_WIN32
+        REQUIRE(WaitForSingleObject(done.handle, 10000) == WAIT_OBJECT_0);
+        CloseHandle(done.handle);
+#else
+        struct pollfd pfd = { .fd = done.fd, .events = POLLIN };
+        REQUIRE(poll(&pfd, 1, 10000) == 1);
+        close(done.fd);
+#endif
     }
 
     free(test_src);
@@ -221,6 +334,111 @@ static void pl_texture_tests(pl_gpu gpu)
     }
 
     free(test_src);
+
+    pl_fmt fmt = pl_find_fmt(gpu, PL_FMT_UNORM, 4, 8, 8, PL_FMT_CAP_SAMPLEABLE);
+    if (!fmt || gpu->limits.max_tex_2d_dim < 16)
+        return;
+
+    printf("testing texture pool\n");
+    const size_t tex_bytes = 16 * 16 * fmt->texel_size;
+    pl_tex_pool pool = pl_tex_pool_create(gpu, pl_tex_pool_params(
+        .max_bytes = tex_bytes,
+    ));
+
+    REQUIRE(pl_tex_pool_gpu(pool) == gpu);
+    struct pl_tex_params params = {
+        .format     = fmt,
+        .w          = 16,
+        .h          = 16,
+        .sampleable = true,
+    };
+
+    pl_tex tex = pl_tex_pool_get(pool, &params);
+    REQUIRE(tex);
+    pl_tex orig = tex;
+    pl_tex_pool_put(pool, &tex);
+    REQUIRE(!tex);
+    pl_gpu_finish(gpu);
+    tex = pl_tex_pool_get(pool, &params);
+    REQUIRE(tex == orig);
+
+    // The budget covers textures handed out, and idle textures of different
+    // sizes are evicted to make room
+    struct pl_tex_params small = params;
+    small.w = small.h = 8;
+    pl_tex tex2 = pl_tex_pool_get(pool, &small);
+    REQUIRE(!tex2);
+    pl_tex_pool_put(pool, &tex);
+    pl_gpu_finish(gpu);
+    tex2 = pl_tex_pool_get(pool, &small);
+    REQUIRE(tex2 && tex2->params.w == 8);
+
+    // Textures returned after destruction are destroyed directly
+    pl_tex_pool pool_ref = pool;
+    pl_tex_pool_destroy(&pool);
+    REQUIRE(!pool);
+    pl_tex_pool_put(pool_ref, &tex2);
+    REQUIRE(!tex2);
+}
+
+static int cmp_float(const void *pa, const void *pb)
+{
+    float a = *(const float *) pa, b = *(const float *) pb;
+    return PL_CMP(a, b);
+}
+
+// Returns a path for a scratch file called `name` inside the temporary
+// directory, made unique per process so concurrent test runs don't collide
+static const char *test_tmp_path(char *buf, size_t size, const char *name)
+{
+#ifdef PL_HAVE_WIN32
+    char dir[MAX_PATH + 1];
+    if (!GetTempPathA(sizeof(dir), dir))
+        strcpy(dir, ".\\");
+    snprintf(buf, size, "%s%s.%lu", dir, name,
+             (unsigned long) GetCurrentProcessId());
+#else
+    const char *dir = getenv("TMPDIR");
+    snprintf(buf, size, "%s/%s.%ld", dir && dir[0] ? dir : "/tmp", name,
+             (long) getpid());
+#endif
+    return buf;
+}
+
+// Collects the signatures of all passes saved by `pl_dispatch_save`. This only
+// includes passes with a cached program, so it may be empty on some GPUs
+static int dispatch_saved_passes(pl_dispatch dp, uint64_t *sigs, int max_sigs)
+{
+    size_t size = pl_dispatch_save(dp, NULL);
+    uint8_t *cache = malloc(size);
+    REQUIRE(cache);
+    REQUIRE(pl_dispatch_save(dp, cache) == size);
+
+    // Skip the magic bytes, cache version and hash ID
+    size_t pos = 12;
+    uint32_t num;
+    memcpy(&num, &cache[pos], sizeof(num));
+    pos += sizeof(num);
+    REQUIRE(num <= max_sigs);
+    for (int i = 0; i < num; i++) {
+        uint64_t len;
+        memcpy(&sigs[i], &cache[pos], sizeof(sigs[i]));
+        memcpy(&len, &cache[pos + sizeof(sigs[i])], sizeof(len));
+        pos += sizeof(sigs[i]) + sizeof(len) + len;
+        REQUIRE(pos <= size);
+    }
+
+    free(cache);
+    return num;
+}
+
+static bool has_sig(const uint64_t *sigs, int num_sigs, uint64_t sig)
+{
+    for (int i = 0; i < num_sigs; i++) {
+        if (sigs[i] == sig)
+            return true;
+    }
+    return false;
 }
 
 static void pl_shader_tests(pl_gpu gpu)
@@ -282,6 +500,7 @@ static void pl_shader_tests(pl_gpu gpu)
         {{ 1.0,  1.0}, {1, 1, 0}},
     };
 
+    struct pl_gpu_compile_stats cstats = pl_gpu_get_compile_stats(gpu);
     pl_pass pass;
     pass = pl_pass_create(gpu, &(struct pl_pass_params) {
         .type           = PL_PASS_RASTER,
@@ -305,6 +524,10 @@ static void pl_shader_tests(pl_gpu gpu)
         }},
     });
     REQUIRE(pass);
+    struct pl_gpu_compile_stats cstats_new = pl_gpu_get_compile_stats(gpu);
+    REQUIRE(cstats_new.num_passes == cstats.num_passes + 1);
+    REQUIRE(cstats_new.total > cstats.total);
+    REQUIRE(cstats_new.driver >= cstats.driver);
     if (pass->params.cached_program || pass->params.cached_program_len) {
         // Ensure both are set if either one is set
         REQUIRE(pass->params.cached_program);
@@ -416,6 +639,49 @@ static void pl_shader_tests(pl_gpu gpu)
 
     TEST_FBO_PATTERN(1e-6, "%s", "using custom vertices");
 
+    if (gpu->limits.instancing) {
+        // Draw the quad twice, with the second instance overwriting the
+        // (wrongly colored) first one
+        static const float gains[] = { 0.0, 1.0 };
+        sh = pl_dispatch_begin(dp);
+        REQUIRE(pl_shader_custom(sh, &(struct pl_custom_shader) {
+            .body       = "color = vec4(gain * col, 1.0);",
+            .input      = PL_SHADER_SIG_NONE,
+            .output     = PL_SHADER_SIG_COLOR,
+        }));
+
+        REQUIRE(pl_dispatch_vertex(dp, &(struct pl_dispatch_vertex_params) {
+            .shader         = &sh,
+            .target         = fbo,
+            .vertex_stride  = sizeof(struct vertex),
+            .vertex_position_idx = 0,
+            .num_vertex_attribs = 3,
+            .vertex_attribs = (struct pl_vertex_attrib[]) {{
+                .name   = "pos",
+                .fmt    = pl_find_vertex_fmt(gpu, PL_FMT_FLOAT, 2),
+                .offset = offsetof(struct vertex, pos),
+            }, {
+                .name   = "col",
+                .fmt    = pl_find_vertex_fmt(gpu, PL_FMT_FLOAT, 3),
+                .offset = offsetof(struct vertex, color),
+            }, {
+                .name      = "gain",
+                .fmt       = pl_find_vertex_fmt(gpu, PL_FMT_FLOAT, 1),
+                .instanced = true,
+            }},
+
+            .vertex_type    = PL_PRIM_TRIANGLE_STRIP,
+            .vertex_coords  = PL_COORDS_NORMALIZED,
+            .vertex_count   = PL_ARRAY_SIZE(vertices),
+            .vertex_data    = vertices,
+            .instance_stride = sizeof(float),
+            .instance_count = PL_ARRAY_SIZE(gains),
+            .instance_data  = gains,
+        }));
+
+        TEST_FBO_PATTERN(1e-6, "%s", "using instanced vertices");
+    }
+
     pl_tex src;
     src = pl_tex_create(gpu, &(struct pl_tex_params) {
         .format         = fbo_fmt,
@@ -446,6 +712,43 @@ static void pl_shader_tests(pl_gpu gpu)
         }));
 
         TEST_FBO_PATTERN(1e-6, "%s", "pl_tex_blit_compute");
+
+        // Test box-filtered 4x downscaling, using vertical stripes of width 1
+        // and period 4, which a single bilinear tap would miss entirely
+        static float stripes[FBO_H * FBO_W * 4];
+        for (int i = 0; i < FBO_W * FBO_H; i++) {
+            for (int c = 0; c < 4; c++)
+                stripes[i * 4 + c] = (i % FBO_W) % 4 == 0 ? 1.0 : 0.0;
+        }
+
+        pl_tex stripes_tex = pl_tex_create(gpu, pl_tex_params(
+            .format         = fbo_fmt,
+            .w              = FBO_W,
+            .h              = FBO_H,
+            .sampleable     = true,
+            .initial_data   = stripes,
+        ));
+
+        REQUIRE(stripes_tex);
+        REQUIRE(pl_tex_blit_compute(gpu, dp, &(struct pl_tex_blit_params) {
+            .src = stripes_tex,
+            .dst = fbo,
+            .src_rc = {0, 0, 0, FBO_W, FBO_H, 1},
+            .dst_rc = {0, 0, 0, FBO_W / 4, FBO_H / 4, 1},
+            .sample_mode = PL_TEX_SAMPLE_LINEAR,
+        }));
+
+        REQUIRE(pl_tex_download(gpu, &(struct pl_tex_transfer_params) {
+            .tex = fbo,
+            .ptr = data,
+        }));
+
+        for (int y = 0; y < FBO_H / 4; y++) {
+            for (int x = 0; x < FBO_W / 4; x++)
+                REQUIRE(feq(data[(y * FBO_W + x) * 4], 0.25, 1e-3));
+        }
+
+        pl_tex_destroy(gpu, &stripes_tex);
     }
 
     // Test encoding/decoding of all gamma functions, color spaces, etc.
@@ -463,6 +766,31 @@ static void pl_shader_tests(pl_gpu gpu)
         TEST_FBO_PATTERN(epsilon, "transfer function %d", (int) trc);
     }
 
+    // Test the fast PQ/HLG approximations against the exact inverse curves,
+    // which should round-trip to within 1/4 of a 12-bit code value
+    static const enum pl_color_transfer fast_trcs[] = {
+        PL_COLOR_TRC_PQ, PL_COLOR_TRC_HLG,
+    };
+
+    for (int i = 0; i < PL_ARRAY_SIZE(fast_trcs); i++) {
+        const struct pl_color_space csp = { .transfer = fast_trcs[i] };
+        for (int fast_lin = 0; fast_lin <= 1; fast_lin++) {
+            sh = pl_dispatch_begin(dp);
+            pl_shader_sample_nearest(sh, pl_sample_src( .tex = src ));
+            SH_PARAMS(sh).fast_transfer = fast_lin;
+            pl_shader_linearize(sh, &csp);
+            SH_PARAMS(sh).fast_transfer = !fast_lin;
+            pl_shader_delinearize(sh, &csp);
+            REQUIRE(pl_dispatch_finish(dp, pl_dispatch_params(
+                .shader = &sh,
+                .target = fbo,
+            )));
+
+            TEST_FBO_PATTERN(0.25 / 4095 + 1e-5, "fast transfer function %d",
+                             (int) csp.transfer);
+        }
+    }
+
     for (enum pl_color_system sys = 0; sys < PL_COLOR_SYSTEM_COUNT; sys++) {
         if (sys == PL_COLOR_SYSTEM_DOLBYVISION)
             continue; // requires metadata
@@ -494,6 +822,18 @@ static void pl_shader_tests(pl_gpu gpu)
         TEST_FBO_PATTERN(epsilon, "color system %d", (int) sys);
     }
 
+    // Test automatic promotion of frequently changing constants
+    pl_dispatch const_dp = pl_dispatch_create(gpu->log, gpu);
+    for (int i = 0; i < 6; i++) {
+        sh = pl_dispatch_begin(const_dp);
+        sh_const_float(sh, "stable", 1.0f);
+        sh_const_float(sh, "varying", 1.0f + i);
+        REQUIRE(sh->vars.num == (i >= 3 ? 1 : 0));
+        pl_dispatch_abort(const_dp, &sh);
+        pl_dispatch_reset_frame(const_dp);
+    }
+    pl_dispatch_destroy(&const_dp);
+
     // Repeat this a few times to test the caching
     for (int i = 0; i < 10; i++) {
         if (i == 5) {
@@ -541,6 +881,347 @@ static void pl_shader_tests(pl_gpu gpu)
         TEST_FBO_PATTERN(1e-6, "deband iter %d", i);
     }
 
+    // Test sharing compiled programs between dispatch objects via pl_cache
+    pl_cache obj_cache = pl_cache_create(pl_cache_params( .log = gpu->log ));
+    pl_gpu_set_cache(gpu, obj_cache);
+    int num_objects = 0;
+    for (int i = 0; i < 2; i++) {
+        pl_dispatch cache_dp = pl_dispatch_create(gpu->log, gpu);
+        sh = pl_dispatch_begin(cache_dp);
+        pl_shader_deband(sh, pl_sample_src( .tex = src ), pl_deband_params(
+            .iterations     = 0,
+            .grain          = 0.0,
+        ));
+
+        REQUIRE(pl_dispatch_finish(cache_dp, &(struct pl_dispatch_params) {
+            .shader = &sh,
+            .target = fbo,
+        }));
+        TEST_FBO_PATTERN(1e-6, "deband with pl_cache %d", i);
+        pl_dispatch_destroy(&cache_dp);
+
+        // The second dispatch re-uses the program stored by the first
+        if (i == 0)
+            num_objects = pl_cache_objects(obj_cache);
+        REQUIRE(pl_cache_objects(obj_cache) == num_objects);
+    }
+    pl_gpu_set_cache(gpu, NULL);
+    pl_cache_destroy(&obj_cache);
+
+    // Debanding averages symmetric samples, which leaves a linear gradient
+    // unchanged away from the edges. Test both the compute shader (shmem)
+    // path, if available, and the fragment shader path
+    for (int i = 0; i < 2; i++) {
+        sh = pl_dispatch_begin(dp);
+        if (i == 1)
+            sh->type = SH_FRAGMENT;
+
+        const int radius = 2, iters = 2;
+        pl_shader_deband(sh, pl_sample_src( .tex = src ), pl_deband_params(
+            .iterations = iters,
+            .radius     = radius,
+            .threshold  = 1000.0,
+            .grain      = 0.0,
+        ));
+
+        REQUIRE(pl_dispatch_finish(dp, &(struct pl_dispatch_params) {
+            .shader = &sh,
+            .target = fbo,
+        }));
+
+        printf("testing pattern of deband %s\n", i ? "fragment" : "auto");
+        REQUIRE(pl_tex_download(gpu, &(struct pl_tex_transfer_params) {
+            .tex = fbo,
+            .ptr = data,
+        }));
+
+        const int pad = radius * iters + 1;
+        for (int y = pad; y < FBO_H - pad; y++) {
+            for (int x = pad; x < FBO_W - pad; x++) {
+                float *color = &data[(y * FBO_W + x) * 4];
+                REQUIRE(feq(color[0], (x + 0.5) / FBO_W, 1e-3));
+                REQUIRE(feq(color[1], (y + 0.5) / FBO_H, 1e-3));
+                REQUIRE(feq(color[2], 0.0, 1e-3));
+                REQUIRE(feq(color[3], 1.0, 1e-3));
+            }
+        }
+    }
+
+    // Test chroma-from-luma upsampling on a chroma plane that is an exact
+    // linear function of the luma across a sharp edge, which should be
+    // reconstructed without the blurring of plain bilinear upsampling
+    static float luma_data[FBO_H * FBO_W * 4];
+    static float chroma_data[FBO_H / 2 * FBO_W / 2 * 4];
+#define CFL_LUMA(x) ((x) < FBO_W / 2 ? 0.2f : 0.8f)
+    for (int y = 0; y < FBO_H; y++) {
+        for (int x = 0; x < FBO_W; x++) {
+            for (int c = 0; c < 4; c++)
+                luma_data[(y * FBO_W + x) * 4 + c] = CFL_LUMA(x);
+        }
+    }
+    for (int y = 0; y < FBO_H / 2; y++) {
+        for (int x = 0; x < FBO_W / 2; x++) {
+            float *color = &chroma_data[(y * FBO_W / 2 + x) * 4];
+            float luma = CFL_LUMA(2 * x);
+            color[0] = 0.5f * luma + 0.1f;
+            color[1] = 1.0f - luma;
+            color[2] = 0.0f;
+            color[3] = 1.0f;
+        }
+    }
+
+    pl_tex luma_tex = pl_tex_create(gpu, pl_tex_params(
+        .format         = fbo_fmt,
+        .w              = FBO_W,
+        .h              = FBO_H,
+        .sampleable     = true,
+        .initial_data   = luma_data,
+    ));
+    pl_tex chroma_tex = pl_tex_create(gpu, pl_tex_params(
+        .format         = fbo_fmt,
+        .w              = FBO_W / 2,
+        .h              = FBO_H / 2,
+        .sampleable     = true,
+        .initial_data   = chroma_data,
+    ));
+    REQUIRE(luma_tex && chroma_tex);
+
+    sh = pl_dispatch_begin(dp);
+    REQUIRE(pl_shader_sample_cfl(sh,
+        pl_sample_src( .tex = chroma_tex, .new_w = FBO_W, .new_h = FBO_H ),
+        pl_sample_src( .tex = luma_tex )));
+    REQUIRE(pl_dispatch_finish(dp, &(struct pl_dispatch_params) {
+        .shader = &sh,
+        .target = fbo,
+    }));
+
+    printf("testing pattern of chroma from luma\n");
+    REQUIRE(pl_tex_download(gpu, &(struct pl_tex_transfer_params) {
+        .tex = fbo,
+        .ptr = data,
+    }));
+
+    for (int y = 0; y < FBO_H; y++) {
+        for (int x = 0; x < FBO_W; x++) {
+            float *color = &data[(y * FBO_W + x) * 4];
+            REQUIRE(feq(color[0], 0.5f * CFL_LUMA(x) + 0.1f, 1e-3));
+            REQUIRE(feq(color[1], 1.0f - CFL_LUMA(x), 1e-3));
+        }
+    }
+#undef CFL_LUMA
+
+    pl_tex_destroy(gpu, &luma_tex);
+    pl_tex_destroy(gpu, &chroma_tex);
+
+    // Test evicting passes from the pass cache once it exceeds its budget.
+    // Every shader is dispatched in a separate group of frames, so that it
+    // ages past the point where it becomes eligible for eviction
+    pl_dispatch budget_dp = pl_dispatch_create(gpu->log, gpu);
+    pl_dispatch_pass_budget(budget_dp, 2, 0);
+    uint64_t pass_sigs[3] = {0}, saved[4];
+    const int pass_order[] = { 0, 1, 0, 2 };
+    int num_saved = 0;
+    for (int i = 0; i < PL_ARRAY_SIZE(pass_order); i++) {
+        sh = pl_dispatch_begin(budget_dp);
+        switch (pass_order[i]) {
+        case 0: pl_shader_sample_nearest(sh, pl_sample_src( .tex = src )); break;
+        case 1: pl_shader_sample_bilinear(sh, pl_sample_src( .tex = src )); break;
+        case 2: pl_shader_deband(sh, pl_sample_src( .tex = src ), NULL); break;
+        }
+        REQUIRE(pl_dispatch_finish(budget_dp, pl_dispatch_params(
+            .shader = &sh,
+            .target = fbo,
+        )));
+
+        // The only newly saved signature belongs to this shader
+        int num = dispatch_saved_passes(budget_dp, saved, PL_ARRAY_SIZE(saved));
+        for (int j = 0; j < num; j++) {
+            bool known = false;
+            for (int k = 0; k < PL_ARRAY_SIZE(pass_sigs); k++)
+                known |= pass_sigs[k] == saved[j];
+            if (!known)
+                pass_sigs[pass_order[i]] = saved[j];
+        }
+
+        num_saved = num;
+        for (int f = 0; f < 16; f++)
+            pl_dispatch_reset_frame(budget_dp);
+    }
+
+    if (num_saved) {
+        // The first shader was used again more recently than the second, so
+        // only the second should have been evicted
+        num_saved = dispatch_saved_passes(budget_dp, saved, PL_ARRAY_SIZE(saved));
+        REQUIRE(num_saved == 2);
+        REQUIRE(has_sig(saved, num_saved, pass_sigs[0]));
+        REQUIRE(!has_sig(saved, num_saved, pass_sigs[1]));
+        REQUIRE(has_sig(saved, num_saved, pass_sigs[2]));
+
+        // Passes in active use are kept even when over budget
+        sh = pl_dispatch_begin(budget_dp);
+        pl_shader_deband(sh, pl_sample_src( .tex = src ), NULL);
+        REQUIRE(pl_dispatch_finish(budget_dp, pl_dispatch_params(
+            .shader = &sh,
+            .target = fbo,
+        )));
+        pl_dispatch_reset_frame(budget_dp);
+        pl_dispatch_pass_budget(budget_dp, 0, 1);
+        num_saved = dispatch_saved_passes(budget_dp, saved, PL_ARRAY_SIZE(saved));
+        REQUIRE(num_saved == 1);
+        REQUIRE(saved[0] == pass_sigs[2]);
+    }
+    pl_dispatch_destroy(&budget_dp);
+
+    // Test streaming uniforms across frames, enough to wrap the UBO ring
+    pl_dispatch ubo_dp = pl_dispatch_create(gpu->log, gpu);
+    for (int f = 0; f < 24; f++) {
+        for (int y = 0; y < FBO_H; y++) {
+            for (int x = 0; x < FBO_W; x++) {
+                const float val[4] = { x, y, f, 1.0 };
+                sh = pl_dispatch_begin(ubo_dp);
+                REQUIRE(pl_shader_custom(sh, &(struct pl_custom_shader) {
+                    .body = "color = ubo_val;",
+                    .output = PL_SHADER_SIG_COLOR,
+                    .num_variables = 1,
+                    .variables = &(struct pl_shader_var) {
+                        .var = pl_var_vec4("ubo_val"),
+                        .data = val,
+                    },
+                }));
+                REQUIRE(pl_dispatch_finish(ubo_dp, pl_dispatch_params(
+                    .shader = &sh,
+                    .target = fbo,
+                    .rect = { x, y, x + 1, y + 1 },
+                )));
+            }
+        }
+
+        pl_dispatch_reset_frame(ubo_dp);
+        if (f % 8 != 7)
+            continue;
+
+        REQUIRE(pl_tex_download(gpu, pl_tex_transfer_params(
+            .tex = fbo,
+            .ptr = data,
+        )));
+        for (int y = 0; y < FBO_H; y++) {
+            for (int x = 0; x < FBO_W; x++) {
+                const float *color = &data[(y * FBO_W + x) * 4];
+                REQUIRE(feq(color[0], x, 1e-6));
+                REQUIRE(feq(color[1], y, 1e-6));
+                REQUIRE(feq(color[2], f, 1e-6));
+            }
+        }
+    }
+    pl_dispatch_destroy(&ubo_dp);
+
+    // Test the persistent cache file
+    char cache_path[512];
+    test_tmp_path(cache_path, sizeof(cache_path), "pl_test_dispatch_cache.bin");
+    remove(cache_path);
+    for (int i = 0; i < 2; i++) {
+        pl_dispatch dp2 = pl_dispatch_create(gpu->log, gpu);
+        REQUIRE(pl_dispatch_cache_open(dp2, cache_path, 0));
+        sh = pl_dispatch_begin(dp2);
+        pl_shader_sample_nearest(sh, pl_sample_src( .tex = src ));
+        REQUIRE(pl_dispatch_finish(dp2, pl_dispatch_params(
+            .shader = &sh,
+            .target = fbo,
+        )));
+        TEST_FBO_PATTERN(1e-6, "cache file iter %d", i);
+        pl_dispatch_destroy(&dp2);
+    }
+    remove(cache_path);
+
+    // Test the trace export
+    char trace_path[512];
+    test_tmp_path(trace_path, sizeof(trace_path), "pl_test_dispatch_trace.json");
+    REQUIRE(pl_dispatch_trace_begin(dp, trace_path));
+    for (int i = 0; i < 2; i++) {
+        sh = pl_dispatch_begin(dp);
+        pl_shader_sample_nearest(sh, pl_sample_src( .tex = src ));
+        REQUIRE(pl_dispatch_finish(dp, pl_dispatch_params(
+            .shader = &sh,
+            .target = fbo,
+        )));
+        pl_dispatch_reset_frame(dp);
+    }
+    pl_dispatch_trace_end(dp);
+
+    FILE *trace = fopen(trace_path, "rb");
+    REQUIRE(trace);
+    char trace_buf[8192] = {0};
+    size_t trace_len = fread(trace_buf, 1, sizeof(trace_buf) - 1, trace);
+    fclose(trace);
+    REQUIRE(trace_len > 0 && trace_buf[0] == '[');
+    REQUIRE(strstr(trace_buf, "\"submit\""));
+    remove(trace_path);
+
+    // Test asynchronous pass compilation
+    pl_dispatch_async_compile(dp, true);
+    for (int i = 0; i < 2; i++) {
+        uint64_t skipped = pl_dispatch_async_skipped(dp);
+        sh = pl_dispatch_begin(dp);
+        pl_shader_sample_nearest(sh, pl_sample_src( .tex = src ));
+        REQUIRE(pl_shader_custom(sh, &(struct pl_custom_shader) {
+            .body   = "color = 2.0 * color - color;",
+            .input  = PL_SHADER_SIG_COLOR,
+            .output = PL_SHADER_SIG_COLOR,
+        }));
+
+        REQUIRE(pl_dispatch_finish(dp, pl_dispatch_params(
+            .shader = &sh,
+            .target = fbo,
+        )));
+
+        if (i == 0 && pl_gpu_parallel_compile(gpu)) {
+            // The driver may or may not have finished compiling already
+            REQUIRE(pl_dispatch_async_skipped(dp) <= skipped + 1);
+            pl_dispatch_async_wait(dp);
+        } else if (i == 0 && gpu->limits.thread_safe) {
+            REQUIRE(pl_dispatch_async_skipped(dp) == skipped + 1);
+            pl_dispatch_async_wait(dp);
+        } else {
+            REQUIRE(pl_dispatch_async_skipped(dp) == skipped);
+            TEST_FBO_PATTERN(1e-6, "%s", "async compilation");
+        }
+    }
+
+    // Test asynchronous LUT regeneration. The extra object keeps a reference
+    // to the original (shared) LUT, so its texture can't be recycled
+    pl_shader_obj dither_state = NULL, dither_ref = NULL;
+    sh = pl_dispatch_begin(dp);
+    pl_shader_dither(sh, 8, &dither_ref, pl_dither_params(
+        .method = PL_DITHER_ORDERED_LUT,
+    ));
+    pl_dispatch_abort(dp, &sh);
+
+    pl_tex dither_tex[2] = {0};
+    const uint64_t timeout = pl_clock_now() + 10 * UINT64_C(1000000000);
+    for (int i = 0; !dither_tex[1] || dither_tex[1] == dither_tex[0]; i++) {
+        sh = pl_dispatch_begin(dp);
+        pl_shader_dither(sh, 8, &dither_state, pl_dither_params(
+            .method = i ? PL_DITHER_BLUE_NOISE : PL_DITHER_ORDERED_LUT,
+        ));
+
+        pl_tex tex = NULL;
+        for (int n = 0; n < sh->descs.num; n++) {
+            if (sh->descs.elem[n].desc.type == PL_DESC_SAMPLED_TEX)
+                tex = sh->descs.elem[n].binding.object;
+        }
+        pl_dispatch_abort(dp, &sh);
+        if (!tex)
+            break; // LUT not backed by a texture on this GPU
+
+        dither_tex[!!i] = tex;
+        if (i == 1) // must keep using the previous LUT at first
+            REQUIRE(dither_tex[1] == dither_tex[0]);
+        REQUIRE(pl_clock_now() < timeout);
+    }
+    pl_shader_obj_destroy(&dither_state);
+    pl_shader_obj_destroy(&dither_ref);
+    pl_dispatch_async_compile(dp, false);
+
     // Test peak detection and readback if possible
     sh = pl_dispatch_begin(dp);
     pl_shader_sample_nearest(sh, pl_sample_src( .tex = src ));
@@ -580,25 +1261,116 @@ static void pl_shader_tests(pl_gpu gpu)
     pl_dispatch_abort(dp, &sh);
     pl_shader_obj_destroy(&peak_state);
 
-#ifdef PL_HAVE_LCMS
-    // Test the use of ICC profiles if available
+    // Test percentile-based peak detection, which should match the real
+    // percentile up to the histogram bin resolution
     sh = pl_dispatch_begin(dp);
     pl_shader_sample_nearest(sh, pl_sample_src( .tex = src ));
+    peak_params.percentile = 50.0;
+    if (pl_shader_detect_peak(sh, csp_gamma22, &peak_state, &peak_params)) {
+        REQUIRE(pl_dispatch_compute(dp, &(struct pl_dispatch_compute_params) {
+            .shader = &sh,
+            .width = fbo->params.w,
+            .height = fbo->params.h,
+        }));
 
-    pl_shader_obj icc = NULL;
-    struct pl_icc_color_space src_color = { .color = pl_color_space_bt709 };
-    struct pl_icc_color_space dst_color = { .color = pl_color_space_srgb };
-    struct pl_icc_result out;
+        float peak, avg;
+        REQUIRE(pl_get_detected_peak(peak_state, &peak, &avg));
 
-    if (pl_icc_update(sh, &src_color, &dst_color, &icc, &out, NULL)) {
-        pl_icc_apply(sh, &icc);
-        REQUIRE(pl_dispatch_finish(dp, &(struct pl_dispatch_params) {
+        float smax[FBO_W * FBO_H];
+        for (int i = 0; i < FBO_W * FBO_H; i++) {
+            float *color = &data[i * 4];
+            smax[i] = powf(PL_MAX(color[0], color[1]), 2.2);
+            smax[i] = (1 - 1e-3f) * smax[i] + 1e-3f;
+        }
+        qsort(smax, FBO_W * FBO_H, sizeof(float), cmp_float);
+        float real_peak = PL_MAX(smax[FBO_W * FBO_H / 2 - 1], peak_params.minimum_peak);
+        printf("detected 50%% peak: %f, real: %f\n", peak, real_peak);
+        float peak_pq = pl_hdr_rescale(PL_HDR_NORM, PL_HDR_PQ, peak),
+              real_pq = pl_hdr_rescale(PL_HDR_NORM, PL_HDR_PQ, real_peak);
+        REQUIRE(peak_pq >= real_pq - 1e-4);
+        REQUIRE(peak_pq <= real_pq + 1.0 / 256);
+    }
+
+    pl_dispatch_abort(dp, &sh);
+    pl_shader_obj_destroy(&peak_state);
+
+    // Test dynamic tone mapping, which evaluates the built-in tone mapping
+    // functions for the detected peak directly, against the 2D LUT fallback
+    struct pl_color_space csp_pq = {
+        .primaries = PL_COLOR_PRIM_BT_709,
+        .transfer = PL_COLOR_TRC_PQ,
+        .hdr.max_luma = 10000,
+    };
+
+    sh = pl_dispatch_begin(dp);
+    pl_shader_sample_nearest(sh, pl_sample_src( .tex = src ));
+    if (pl_shader_detect_peak(sh, csp_pq, &peak_state, NULL)) {
+        REQUIRE(pl_dispatch_compute(dp, &(struct pl_dispatch_compute_params) {
             .shader = &sh,
-            .target = fbo,
+            .width = fbo->params.w,
+            .height = fbo->params.h,
         }));
+
+        for (int i = 0; i < pl_num_tone_map_functions; i++) {
+            const struct pl_tone_map_function *fun = pl_tone_map_functions[i];
+            static float out[2][FBO_H * FBO_W * 4];
+            for (int n = 0; n < 2; n++) {
+                sh = pl_dispatch_begin(dp);
+                pl_shader_sample_nearest(sh, pl_sample_src( .tex = src ));
+                pl_shader_color_map(sh, pl_color_map_params(
+                    .tone_mapping_function = fun,
+                    .tone_mapping_mode = PL_TONE_MAP_RGB,
+                    .force_tone_mapping_lut = n,
+                ), csp_pq, pl_color_space_bt709, &peak_state, false);
+
+                REQUIRE(pl_dispatch_finish(dp, &(struct pl_dispatch_params) {
+                    .shader = &sh,
+                    .target = fbo,
+                }));
+                REQUIRE(pl_tex_download(gpu, &(struct pl_tex_transfer_params) {
+                    .tex = fbo,
+                    .ptr = out[n],
+                }));
+            }
+
+            float max_err = 0;
+            for (int n = 0; n < FBO_H * FBO_W * 4; n++)
+                max_err = PL_MAX(max_err, fabsf(out[0][n] - out[1][n]));
+            printf("dynamic tone mapping '%s': max error %f\n", fun->name, max_err);
+            REQUIRE(max_err < 1e-2);
+        }
     }
 
     pl_dispatch_abort(dp, &sh);
+    pl_shader_obj_destroy(&peak_state);
+
+#ifdef PL_HAVE_LCMS
+    // Test the use of ICC profiles if available, switching back and forth
+    // between source color spaces to exercise the reuse of old 3DLUTs
+    pl_shader_obj icc = NULL;
+    const struct pl_color_space icc_srcs[] = {
+        pl_color_space_bt709, pl_color_space_hdr10, pl_color_space_bt709,
+    };
+
+    for (int i = 0; i < PL_ARRAY_SIZE(icc_srcs); i++) {
+        sh = pl_dispatch_begin(dp);
+        pl_shader_sample_nearest(sh, pl_sample_src( .tex = src ));
+
+        struct pl_icc_color_space src_color = { .color = icc_srcs[i] };
+        struct pl_icc_color_space dst_color = { .color = pl_color_space_srgb };
+        struct pl_icc_result out;
+
+        if (pl_icc_update(sh, &src_color, &dst_color, &icc, &out, NULL)) {
+            pl_icc_apply(sh, &icc);
+            REQUIRE(pl_dispatch_finish(dp, &(struct pl_dispatch_params) {
+                .shader = &sh,
+                .target = fbo,
+            }));
+        }
+
+        pl_dispatch_abort(dp, &sh);
+    }
+
     pl_shader_obj_destroy(&icc);
 #endif
 
@@ -686,6 +1458,38 @@ static void pl_shader_tests(pl_gpu gpu)
             .shader = &sh,
             .target = fbo,
         }));
+
+        // Test the LUT-based reshaping against the direct version, both with
+        // MMR (3D LUT) and with only polynomial reshaping (1D LUT)
+        struct pl_dovi_metadata poly_meta = dovi_meta;
+        poly_meta.comp[1].num_pivots = poly_meta.comp[2].num_pivots = 0;
+        const struct pl_dovi_metadata *metas[] = { &dovi_meta, &poly_meta };
+
+        static float ref[FBO_H * FBO_W * 4];
+        pl_shader_obj dovi_lut = NULL;
+        for (int m = 0; m < PL_ARRAY_SIZE(metas); m++) {
+            for (int i = 0; i < 2; i++) {
+                sh = pl_dispatch_begin(dp);
+                pl_shader_sample_direct(sh, pl_sample_src( .tex = src ));
+                if (i) {
+                    pl_shader_dovi_reshape_lut(sh, metas[m], &dovi_lut);
+                } else {
+                    pl_shader_dovi_reshape(sh, metas[m]);
+                }
+                REQUIRE(pl_dispatch_finish(dp, &(struct pl_dispatch_params) {
+                    .shader = &sh,
+                    .target = fbo,
+                }));
+                REQUIRE(pl_tex_download(gpu, &(struct pl_tex_transfer_params) {
+                    .tex = fbo,
+                    .ptr = i ? data : ref,
+                }));
+            }
+
+            for (int i = 0; i < FBO_H * FBO_W * 4; i++)
+                REQUIRE(feq(data[i], ref[i], 1e-3));
+        }
+        pl_shader_obj_destroy(&dovi_lut);
     }
 
     pl_dispatch_destroy(&dp);
@@ -701,7 +1505,7 @@ static void pl_scaler_tests(pl_gpu gpu)
         return;
 
     float *fbo_data = NULL;
-    pl_shader_obj lut = NULL;
+    pl_shader_obj lut = NULL, shared_luts[2] = {0};
 
     static float data_5x5[5][5] = {
         { 0, 0, 0, 0, 0 },
@@ -769,10 +1573,236 @@ static void pl_scaler_tests(pl_gpu gpu)
         }
     }
 
-error:
-    free(fbo_data);
-    pl_shader_obj_destroy(&lut);
-    pl_dispatch_destroy(&dp);
+    // Memoized polar sampling code must match freshly generated code
+    pl_str polar_body[2] = {0};
+    for (int i = 0; i < 2; i++) {
+        sh = pl_dispatch_begin(dp);
+        REQUIRE(pl_shader_sample_polar(sh,
+            pl_sample_src(
+                .tex        = dot5x5,
+                .new_w      = fbo->params.w,
+                .new_h      = fbo->params.h,
+            ),
+            pl_sample_filter_params(
+                .filter     = pl_filter_ewa_lanczos,
+                .lut        = i ? &lut : &shared_luts[0],
+                .no_compute = !fbo->params.storable,
+            )
+        ));
+        sh_buf_write(&sh->buffers[SH_BUF_BODY], NULL, &polar_body[i]);
+        pl_dispatch_abort(dp, &sh);
+    }
+    REQUIRE(pl_str_equals(polar_body[0], polar_body[1]));
+    pl_free(polar_body[0].buf);
+    pl_free(polar_body[1].buf);
+    pl_shader_obj_destroy(&shared_luts[0]);
+
+    // Analytic evaluation of polar kernels must match the LUT
+    static const struct pl_filter_config *analytic_filters[] = {
+        &pl_filter_ewa_robidoux, &pl_filter_ewa_jinc, &pl_filter_ewa_hann,
+    };
+
+    for (int f = 0; fbo->params.host_readable && f < PL_ARRAY_SIZE(analytic_filters); f++) {
+        float *res[2] = {0};
+        bool analytic = false;
+        for (int i = 0; i < 2; i++) {
+            sh = pl_dispatch_begin(dp);
+            REQUIRE(pl_shader_sample_polar(sh,
+                pl_sample_src(
+                    .tex        = dot5x5,
+                    .new_w      = fbo->params.w,
+                    .new_h      = fbo->params.h,
+                ),
+                pl_sample_filter_params(
+                    .filter      = *analytic_filters[f],
+                    .lut         = &shared_luts[i],
+                    .no_compute  = !fbo->params.storable,
+                    .no_analytic = i == 0,
+                )
+            ));
+
+            pl_str header = {0};
+            sh_buf_write(&sh->buffers[SH_BUF_HEADER], NULL, &header);
+            bool has_fn = pl_str_find(header, pl_str0("polar_weight")) >= 0;
+            REQUIRE(!has_fn || i);
+            analytic |= has_fn;
+            pl_free(header.buf);
+            REQUIRE(pl_dispatch_finish(dp, pl_dispatch_params(
+                .shader = &sh,
+                .target = fbo,
+            )));
+
+            res[i] = malloc(fbo->params.w * fbo->params.h * sizeof(float));
+            REQUIRE(pl_tex_download(gpu, pl_tex_transfer_params(
+                .tex = fbo,
+                .ptr = res[i],
+            )));
+        }
+
+        printf("polar filter %d: %s\n", f, analytic ? "analytic" : "LUT");
+        for (int i = 0; analytic && i < fbo->params.w * fbo->params.h; i++)
+            REQUIRE(feq(res[0][i], res[1][i], 1e-2));
+        free(res[0]);
+        free(res[1]);
+        pl_shader_obj_destroy(&shared_luts[0]);
+        pl_shader_obj_destroy(&shared_luts[1]);
+    }
+
+    // Identical filter LUTs should be shared between shader objects
+    pl_tex lut_tex[2] = {0};
+    for (int i = 0; i < 2; i++) {
+        sh = pl_dispatch_begin(dp);
+        REQUIRE(pl_shader_sample_ortho(sh, PL_SEP_VERT,
+            pl_sample_src(
+                .tex        = dot5x5,
+                .new_w      = fbo->params.w,
+                .new_h      = fbo->params.h,
+            ),
+            pl_sample_filter_params(
+                .filter     = pl_filter_spline36,
+                .lut        = &shared_luts[i],
+            )
+        ));
+
+        for (int n = 0; n < sh->descs.num; n++) {
+            const struct pl_shader_desc *sd = &sh->descs.elem[n];
+            if (sd->desc.type == PL_DESC_SAMPLED_TEX && sd->binding.object != dot5x5)
+                lut_tex[i] = sd->binding.object;
+        }
+        pl_dispatch_abort(dp, &sh);
+    }
+    REQUIRE(lut_tex[0] && lut_tex[0] == lut_tex[1]);
+
+    // The tiled compute path must match two separate ortho passes
+    if (fbo->params.storable && fbo->params.host_readable) {
+        struct pl_sample_src src = {
+            .tex        = dot5x5,
+            .new_w      = fbo->params.w,
+            .new_h      = fbo->params.h,
+        };
+
+        struct pl_sample_filter_params fparams = {
+            .filter     = pl_filter_spline36,
+            .antiring   = 0.5,
+            .lut        = &shared_luts[0],
+        };
+
+        sh = pl_dispatch_begin(dp);
+        if (!pl_shader_sample_ortho_tiled(sh, &src, &fparams)) {
+            REQUIRE(!pl_shader_is_failed(sh));
+            pl_dispatch_abort(dp, &sh);
+            goto error;
+        }
+        REQUIRE(pl_dispatch_finish(dp, pl_dispatch_params(
+            .shader = &sh,
+            .target = fbo,
+        )));
+
+        float *tiled = malloc(fbo->params.w * fbo->params.h * sizeof(float));
+        REQUIRE(pl_tex_download(gpu, pl_tex_transfer_params(
+            .tex = fbo,
+            .ptr = tiled,
+        )));
+
+        fbo_params.w = dot5x5->params.w;
+        fbo_params.sampleable = true;
+        pl_tex tmp = pl_tex_create(gpu, &fbo_params);
+        REQUIRE(tmp);
+        sh = pl_dispatch_begin(dp);
+        REQUIRE(pl_shader_sample_ortho(sh, PL_SEP_VERT, &src, &fparams));
+        REQUIRE(pl_dispatch_finish(dp, pl_dispatch_params(
+            .shader = &sh,
+            .target = tmp,
+        )));
+
+        src.tex = tmp;
+        sh = pl_dispatch_begin(dp);
+        REQUIRE(pl_shader_sample_ortho(sh, PL_SEP_HORIZ, &src, &fparams));
+        REQUIRE(pl_dispatch_finish(dp, pl_dispatch_params(
+            .shader = &sh,
+            .target = fbo,
+        )));
+
+        REQUIRE(pl_tex_download(gpu, pl_tex_transfer_params(
+            .tex = fbo,
+            .ptr = fbo_data,
+        )));
+
+        for (int i = 0; i < fbo->params.w * fbo->params.h; i++)
+            REQUIRE(feq(tiled[i], fbo_data[i], 1e-3));
+
+        // Linearizing and sigmoidizing the texels as they are loaded must
+        // match doing so in a separate pass
+        static float ramp_5x5[5][5];
+        for (int i = 0; i < 25; i++)
+            ramp_5x5[i / 5][i % 5] = i / 24.0;
+
+        pl_tex ramp = pl_tex_create(gpu, pl_tex_params(
+            .w              = 5,
+            .h              = 5,
+            .format         = src_fmt,
+            .sampleable     = true,
+            .initial_data   = &ramp_5x5[0][0],
+        ));
+
+        fbo_params.h = dot5x5->params.h;
+        pl_tex pre = pl_tex_create(gpu, &fbo_params);
+        REQUIRE(ramp && pre);
+        sh = pl_dispatch_begin(dp);
+        pl_shader_sample_direct(sh, pl_sample_src( .tex = ramp ));
+        pl_shader_linearize(sh, &pl_color_space_srgb);
+        pl_shader_sigmoidize(sh, &pl_sigmoid_default_params);
+        REQUIRE(pl_dispatch_finish(dp, pl_dispatch_params(
+            .shader = &sh,
+            .target = pre,
+        )));
+
+        src.tex = pre;
+        sh = pl_dispatch_begin(dp);
+        REQUIRE(pl_shader_sample_ortho_tiled(sh, &src, &fparams));
+        REQUIRE(pl_dispatch_finish(dp, pl_dispatch_params(
+            .shader = &sh,
+            .target = fbo,
+        )));
+        REQUIRE(pl_tex_download(gpu, pl_tex_transfer_params(
+            .tex = fbo,
+            .ptr = fbo_data,
+        )));
+
+        src.tex = ramp;
+        fparams.linearize = &pl_color_space_srgb;
+        fparams.sigmoidize = &pl_sigmoid_default_params;
+        sh = pl_dispatch_begin(dp);
+        REQUIRE(pl_shader_sample_ortho_tiled(sh, &src, &fparams));
+        REQUIRE(pl_dispatch_finish(dp, pl_dispatch_params(
+            .shader = &sh,
+            .target = fbo,
+        )));
+        REQUIRE(pl_tex_download(gpu, pl_tex_transfer_params(
+            .tex = fbo,
+            .ptr = tiled,
+        )));
+
+        for (int i = 0; i < fbo->params.w * fbo->params.h; i++)
+            REQUIRE(feq(tiled[i], fbo_data[i], 1e-2));
+
+        // The separated fallback can't do this
+        sh = pl_dispatch_begin(dp);
+        REQUIRE(!pl_shader_sample_ortho(sh, PL_SEP_VERT, &src, &fparams));
+        pl_dispatch_abort(dp, &sh);
+
+        free(tiled);
+        pl_tex_destroy(gpu, &tmp);
+        pl_tex_destroy(gpu, &pre);
+        pl_tex_destroy(gpu, &ramp);
+    }
+
+error:
+    free(fbo_data);
+    pl_shader_obj_destroy(&lut);
+    pl_shader_obj_destroy(&shared_luts[0]);
+    pl_shader_obj_destroy(&shared_luts[1]);
+    pl_dispatch_destroy(&dp);
     pl_tex_destroy(gpu, &dot5x5);
     pl_tex_destroy(gpu, &fbo);
 }
@@ -805,6 +1835,67 @@ static const char *user_shader_tests[] = {
     "    return NATIVEBIG_texOff(0);                                        \n"
     "}                                                                      \n",
 
+    // Test skipping passes whose outputs end up unused
+    "//!HOOK MAIN                                                           \n"
+    "//!DESC unused intermediate                                            \n"
+    "//!BIND HOOKED                                                         \n"
+    "//!SAVE TEMP                                                           \n"
+    "                                                                       \n"
+    "vec4 hook()                                                            \n"
+    "{                                                                      \n"
+    "    return HOOKED_texOff(0);                                           \n"
+    "}                                                                      \n"
+    "                                                                       \n"
+    "//!HOOK MAIN                                                           \n"
+    "//!DESC disabled consumer                                              \n"
+    "//!BIND TEMP                                                           \n"
+    "//!SAVE TEMP2                                                          \n"
+    "//!WHEN OUTPUT.w 0 <                                                   \n"
+    "                                                                       \n"
+    "vec4 hook()                                                            \n"
+    "{                                                                      \n"
+    "    return TEMP_texOff(0);                                             \n"
+    "}                                                                      \n"
+    "                                                                       \n"
+    "//!HOOK MAIN                                                           \n"
+    "//!DESC final pass                                                     \n"
+    "//!BIND HOOKED                                                         \n"
+    "                                                                       \n"
+    "vec4 hook()                                                            \n"
+    "{                                                                      \n"
+    "    return HOOKED_texOff(0);                                           \n"
+    "}                                                                      \n",
+
+    // Test tunable parameters
+    "//!PARAM strength                                                      \n"
+    "//!DESC blend strength                                                 \n"
+    "//!TYPE float                                                          \n"
+    "//!MINIMUM 0.0                                                         \n"
+    "//!MAXIMUM 1.0                                                         \n"
+    "0.5                                                                    \n"
+    "                                                                       \n"
+    "//!PARAM offset                                                        \n"
+    "//!TYPE DYNAMIC int                                                    \n"
+    "//!MINIMUM -8                                                          \n"
+    "//!MAXIMUM 8                                                           \n"
+    "0                                                                      \n"
+    "                                                                       \n"
+    "//!PARAM taps                                                          \n"
+    "//!TYPE CONSTANT int                                                   \n"
+    "//!MINIMUM 1                                                           \n"
+    "//!MAXIMUM 4                                                           \n"
+    "2                                                                      \n"
+    "                                                                       \n"
+    "//!HOOK MAIN                                                           \n"
+    "//!DESC blend with neighbour                                           \n"
+    "//!BIND HOOKED                                                         \n"
+    "                                                                       \n"
+    "vec4 hook()                                                            \n"
+    "{                                                                      \n"
+    "    vec4 other = HOOKED_texOff(vec2(float(taps + offset), 0.0));       \n"
+    "    return mix(HOOKED_texOff(0), other, strength);                     \n"
+    "}                                                                      \n",
+
     // Test use of textures
     "//!HOOK MAIN                                                           \n"
     "//!DESC turn everything into colorful pixels                           \n"
@@ -853,7 +1944,21 @@ static const char *user_shader_tests[] = {
     "//!BUFFER buf_storage                                                  \n"
     "//!VAR vec2 bat                                                        \n"
     "//!VAR int big[32];                                                    \n"
-    "//!STORAGE                                                             \n"
+    "//!STORAGE                                                             \n",
+
+    // Test reduced resolution processing
+    "//!SCALE 0.5                                                           \n"
+    "                                                                       \n"
+    "//!HOOK LUMA                                                           \n"
+    "//!HOOK MAIN                                                           \n"
+    "//!HOOK OUTPUT                                                         \n"
+    "//!DESC half resolution sharpen                                        \n"
+    "//!BIND HOOKED                                                         \n"
+    "                                                                       \n"
+    "vec4 hook()                                                            \n"
+    "{                                                                      \n"
+    "    return 2.0 * HOOKED_texOff(0) - HOOKED_texOff(vec2(1.0, 0.0));     \n"
+    "}                                                                      \n"
 
 };
 
@@ -877,14 +1982,31 @@ static const char *test_luts[] = {
 
 };
 
+static int num_frames_mapped;
+
 static bool frame_passthrough(pl_gpu gpu, pl_tex *tex,
                               const struct pl_source_frame *src, struct pl_frame *out_frame)
 {
     const struct pl_frame *frame = src->frame_data;
     *out_frame = *frame;
+    num_frames_mapped++;
     return true;
 }
 
+static int num_tex_mismatched;
+
+static bool frame_upload(pl_gpu gpu, pl_tex *tex,
+                         const struct pl_source_frame *src, struct pl_frame *out_frame)
+{
+    const struct pl_plane_data *data = src->frame_data;
+    if (!tex[0] || tex[0]->params.w != data->width ||
+        tex[0]->params.h != data->height)
+        num_tex_mismatched++;
+
+    *out_frame = (struct pl_frame) { .num_planes = 1 };
+    return pl_upload_plane(gpu, &out_frame->planes[0], &tex[0], data);
+}
+
 static enum pl_queue_status get_frame_ptr(struct pl_source_frame *out_frame,
                                           const struct pl_queue_params *qparams)
 {
@@ -902,6 +2024,48 @@ static void render_info_cb(void *priv, const struct pl_render_info *info)
            info->pass->shader->description);
 }
 
+static void count_merge_cb(void *priv, const struct pl_render_info *info)
+{
+    int *count = priv;
+    if (strstr(info->pass->shader->description, "merging planes"))
+        (*count)++;
+}
+
+static struct pl_hook_res count_hook(void *priv, const struct pl_hook_params *params)
+{
+    int *count = priv;
+    (*count)++;
+    return (struct pl_hook_res) {
+        .output = PL_HOOK_SIG_TEX,
+        .tex = params->tex,
+        .repr = params->repr,
+        .color = params->color,
+        .components = params->components,
+        .rect = params->rect,
+    };
+}
+
+struct size_hook_state {
+    int calls;
+    int w, h;
+};
+
+static struct pl_hook_res size_hook(void *priv, const struct pl_hook_params *params)
+{
+    struct size_hook_state *state = priv;
+    state->calls++;
+    state->w = params->tex->params.w;
+    state->h = params->tex->params.h;
+    return (struct pl_hook_res) {
+        .output = PL_HOOK_SIG_TEX,
+        .tex = params->tex,
+        .repr = params->repr,
+        .color = params->color,
+        .components = params->components,
+        .rect = params->rect,
+    };
+}
+
 static void pl_render_tests(pl_gpu gpu)
 {
     pl_tex img5x5_tex = NULL, fbo = NULL;
@@ -963,6 +2127,46 @@ static void pl_render_tests(pl_gpu gpu)
         .color          = pl_color_space_srgb,
     };
 
+    // Pre-compile cropped, blended and tiled renders into the cropped target
+    struct pl_render_params blend_params = pl_render_default_params;
+    blend_params.blend_params = &pl_alpha_overlay;
+    struct pl_render_params tile_params = pl_render_default_params;
+    tile_params.render_tile_size = 2;
+    struct pl_frame tiled_target = target;
+    tiled_target.crop = (struct pl_rect2df) {1, 1, fbo->params.w - 1, fbo->params.h - 1};
+
+    const struct pl_render_config configs[] = {
+        { .image = &image, .target = &target },
+        { .image = &image, .target = &target,
+          .params = &pl_render_high_quality_params },
+        { .image = &image, .target = &target, .params = &blend_params },
+        { .image = &image, .target = &tiled_target, .params = &tile_params },
+    };
+
+    REQUIRE(pl_renderer_precompile(rr, configs, PL_ARRAY_SIZE(configs)));
+    for (int i = 0; i < PL_ARRAY_SIZE(configs); i++) {
+        const struct pl_render_config *cfg = &configs[i];
+        REQUIRE(pl_render_image(rr, cfg->image, cfg->target, cfg->params));
+    }
+
+    // Pre-compilation must not touch the target, not even to clear the
+    // area outside of the crop
+    pl_tex_clear_ex(gpu, fbo, (union pl_clear_color){{ 0.25 }});
+    REQUIRE(pl_renderer_precompile(rr, configs, PL_ARRAY_SIZE(configs)));
+    if (fbo->params.host_readable) {
+        float fbo_data[5][5];
+        memset(fbo_data, 0xAA, sizeof(fbo_data));
+        REQUIRE(pl_tex_download(gpu, &(struct pl_tex_transfer_params) {
+            .tex = fbo,
+            .ptr = fbo_data,
+        }));
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++)
+                REQUIRE(fbo_data[y][x] == 0.25);
+        }
+    }
+
+    pl_tex_clear_ex(gpu, fbo, (union pl_clear_color){0});
     REQUIRE(pl_render_image(rr, &image, &target, NULL));
 
     // TODO: embed a reference texture and ensure it matches
@@ -1000,6 +2204,71 @@ static void pl_render_tests(pl_gpu gpu)
     TEST_PARAMS(dither, temporal, true);
     TEST(cone_params, pl_cone_params, pl_vision_deuteranomaly, strength, 0);
 
+    // Test luma-guided upscaling of a subsampled chroma plane
+    static float data_3x3[3][3][2] = {
+        {{ 0.5, 0.5 }, { 0.2, 0.8 }, { 0.5, 0.5 }},
+        {{ 0.8, 0.2 }, { 0.5, 0.5 }, { 0.5, 0.5 }},
+        {{ 0.5, 0.5 }, { 0.5, 0.5 }, { 0.3, 0.6 }},
+    };
+
+    struct pl_plane chroma3x3 = {0};
+    pl_tex chroma3x3_tex = NULL;
+    REQUIRE(pl_upload_plane(gpu, &chroma3x3, &chroma3x3_tex, &(struct pl_plane_data) {
+        .type = PL_FMT_FLOAT,
+        .width = 3,
+        .height = 3,
+        .component_size = { 8 * sizeof(float), 8 * sizeof(float) },
+        .component_map  = { 1, 2 },
+        .pixel_stride = 2 * sizeof(float),
+        .pixels = &data_3x3,
+    }));
+
+    // Render to the full target, since the chroma plane would otherwise be
+    // read at its native resolution
+    struct pl_frame image_yuv = image, target_full = target;
+    image_yuv.num_planes = 2;
+    image_yuv.planes[1] = chroma3x3;
+    target_full.crop = (struct pl_rect2df) {0};
+    for (int i = 0; i < 2; i++) {
+        struct pl_render_params params = pl_render_default_params;
+        params.chroma_from_luma = i;
+        printf("testing `params.chroma_from_luma = %d`\n", i);
+        REQUIRE(pl_render_image(rr, &image_yuv, &target_full, &params));
+        pl_gpu_flush(gpu);
+    }
+    pl_tex_destroy(gpu, &chroma3x3_tex);
+
+    // Test that planar chroma is not merged when it ends up being read at
+    // its native resolution anyway
+    static float data_u[3][3], data_v[3][3];
+    struct pl_plane planes_uv[2] = {0};
+    pl_tex uv_tex[2] = {0};
+    for (int p = 0; p < 2; p++) {
+        REQUIRE(pl_upload_plane(gpu, &planes_uv[p], &uv_tex[p], &(struct pl_plane_data) {
+            .type = PL_FMT_FLOAT,
+            .width = 3,
+            .height = 3,
+            .component_size = { 8 * sizeof(float) },
+            .component_map  = { p + 1 },
+            .pixel_stride = sizeof(float),
+            .pixels = p ? data_v : data_u,
+        }));
+    }
+
+    int num_merged = 0;
+    struct pl_frame image_420 = image;
+    image_420.num_planes = 3;
+    image_420.planes[1] = planes_uv[0];
+    image_420.planes[2] = planes_uv[1];
+    struct pl_render_params params_420 = pl_render_default_params;
+    params_420.info_callback = count_merge_cb;
+    params_420.info_priv = &num_merged;
+    REQUIRE(pl_render_image(rr, &image_420, &target, &params_420));
+    REQUIRE(num_merged == 0);
+    pl_gpu_flush(gpu);
+    for (int p = 0; p < 2; p++)
+        pl_tex_destroy(gpu, &uv_tex[p]);
+
     // Test HDR tone mapping
     image.color = pl_color_space_hdr10;
     TEST_PARAMS(color_map, tone_mapping_mode, PL_TONE_MAP_MODE_COUNT - 1);
@@ -1022,6 +2291,36 @@ static void pl_render_tests(pl_gpu gpu)
     REQUIRE(pl_render_image(rr, &image, &target, &params));
     params = pl_render_default_params;
 
+    // Test box pre-reduction for large downscaling ratios
+    struct pl_rect2df crop = target.crop;
+    target.crop = (struct pl_rect2df) {2, 2, 3, 3};
+    params.box_downscale_threshold = 2.0;
+    params.downscaler = &pl_filter_mitchell;
+    REQUIRE(pl_render_image(rr, &image, &target, &params));
+    params = pl_render_default_params;
+    target.crop = crop;
+
+    // Test baking the output color pipeline into a LUT, as well as re-using it
+    image.color = pl_color_space_hdr10;
+    params.bake_color_lut = true;
+    params.peak_detect_params = NULL;
+    REQUIRE(pl_render_image(rr, &image, &target, &params));
+    REQUIRE(pl_render_image(rr, &image, &target, &params));
+    params = pl_render_default_params;
+    image.color = pl_color_space_srgb;
+
+    // Test Dolby Vision reshaping, which goes through a cached LUT
+    if (gpu->glsl.version >= 130) {
+        struct pl_color_repr repr = image.repr;
+        image.repr.sys = PL_COLOR_SYSTEM_DOLBYVISION;
+        image.repr.dovi = &dovi_meta;
+        image.color = pl_color_space_hdr10;
+        REQUIRE(pl_render_image(rr, &image, &target, &params));
+        REQUIRE(pl_render_image(rr, &image, &target, &params));
+        image.repr = repr;
+        image.color = pl_color_space_srgb;
+    }
+
     // Test film grain synthesis
     image.film_grain.type = PL_FILM_GRAIN_AV1;
     image.film_grain.params.av1 = av1_grain_data,
@@ -1050,7 +2349,31 @@ static void pl_render_tests(pl_gpu gpu)
         params.num_hooks = 1;
         REQUIRE(pl_render_image(rr, &image, &target, &params));
 
+        // Changing parameters must not require re-parsing the shader
+        if (hook->num_parameters) {
+            for (int n = 0; n < hook->num_parameters; n++) {
+                const struct pl_hook_par *par = &hook->parameters[n];
+                REQUIRE(par->data);
+                *par->data = par->maximum;
+            }
+            REQUIRE(pl_render_image(rr, &image, &target, &params));
+        }
+
+        // Parsing the same shader again must re-use its immutable textures
+        struct pl_gpu_memory_stats mem = pl_gpu_get_memory_stats(gpu);
+        const struct pl_hook *hook2;
+        hook2 = pl_mpv_user_shader_parse(gpu, user_shader_tests[i],
+                                         strlen(user_shader_tests[i]));
+        REQUIRE(hook2);
+        if (!strstr(user_shader_tests[i], "//!STORAGE")) {
+            REQUIRE(pl_gpu_get_memory_stats(gpu).total.num_textures ==
+                    mem.total.num_textures);
+        }
+
         pl_mpv_user_shader_destroy(&hook);
+        params.hooks = &hook2;
+        REQUIRE(pl_render_image(rr, &image, &target, &params));
+        pl_mpv_user_shader_destroy(&hook2);
     }
     params = pl_render_default_params;
 
@@ -1076,6 +2399,13 @@ static void pl_render_tests(pl_gpu gpu)
             REQUIRE(pl_render_image(rr, &image, &target, &params));
         }
 
+        if (lut->size[2]) {
+            printf("testing tetrahedral interpolation\n");
+            lut->tetrahedral = true;
+            image.lut_type = target.lut_type = params.lut_type = PL_LUT_NORMALIZED;
+            REQUIRE(pl_render_image(rr, &image, &target, &params));
+        }
+
         image.lut = target.lut = params.lut = NULL;
         pl_lut_free(&lut);
     }
@@ -1115,6 +2445,290 @@ static void pl_render_tests(pl_gpu gpu)
     REQUIRE(pl_render_image(rr, NULL, &target, &params));
     target.num_overlays = 0;
 
+    // Test partial overlay updates, against a full re-render
+    pl_fmt fbo_fmt = fbo->params.format;
+    enum pl_fmt_caps blit_caps = PL_FMT_CAP_BLITTABLE | PL_FMT_CAP_HOST_READABLE;
+    if ((fbo_fmt->caps & blit_caps) == blit_caps) {
+        pl_tex blit_fbo = pl_tex_create(gpu, pl_tex_params(
+            .w = fbo->params.w,
+            .h = fbo->params.h,
+            .format = fbo_fmt,
+            .renderable = true,
+            .host_readable = true,
+            .blit_src = true,
+            .blit_dst = true,
+        ));
+        REQUIRE(blit_fbo);
+
+        struct pl_frame blit_target = target;
+        blit_target.planes[0].texture = blit_fbo;
+        struct pl_overlay_part part = {
+            .src = {0, 2, 3, 5},
+            .dst = {0, 0, 3, 3},
+        };
+
+        blit_target.num_overlays = 1;
+        blit_target.overlays = &(struct pl_overlay) {
+            .tex = img5x5.texture,
+            .mode = PL_OVERLAY_NORMAL,
+            .num_parts = 1,
+            .parts = &part,
+        };
+
+        static float out[2][5][5][4];
+        params.overlay_cache_signature = 1;
+        REQUIRE(pl_render_image(rr, &image, &blit_target, &params));
+        part.dst = (struct pl_rect2df) {2, 1, 5, 3};
+        REQUIRE(pl_render_image(rr, &image, &blit_target, &params));
+        REQUIRE(pl_tex_download(gpu, pl_tex_transfer_params(
+            .tex = blit_fbo,
+            .ptr = out[0],
+        )));
+
+        params.overlay_cache_signature = 2;
+        REQUIRE(pl_render_image(rr, &image, &blit_target, &params));
+        REQUIRE(pl_tex_download(gpu, pl_tex_transfer_params(
+            .tex = blit_fbo,
+            .ptr = out[1],
+        )));
+
+        REQUIRE(memcmp(out[0], out[1], sizeof(out[0])) == 0);
+        params.overlay_cache_signature = 0;
+
+        // Test re-using the output for repeated frames
+        params.output_cache_signature = 1;
+        REQUIRE(pl_render_image(rr, &image, &blit_target, &params));
+        pl_tex_clear(gpu, blit_fbo, (float[4]) {0});
+        REQUIRE(pl_render_image(rr, &image, &blit_target, &params));
+        REQUIRE(pl_tex_download(gpu, pl_tex_transfer_params(
+            .tex = blit_fbo,
+            .ptr = out[0],
+        )));
+        REQUIRE(memcmp(out[0], out[1], sizeof(out[0])) == 0);
+        params.output_cache_signature = 0;
+        pl_tex_destroy(gpu, &blit_fbo);
+    }
+
+    // Test rendering to multiple targets, against individual renders
+    if (fbo_fmt->caps & PL_FMT_CAP_HOST_READABLE) {
+        pl_tex multi_fbo[2];
+        struct pl_frame multi_targets[2];
+        for (int i = 0; i < 2; i++) {
+            multi_fbo[i] = pl_tex_create(gpu, pl_tex_params(
+                .w = 4 + i * 3,
+                .h = 3 + i * 4,
+                .format = fbo_fmt,
+                .renderable = true,
+                .host_readable = true,
+            ));
+            REQUIRE(multi_fbo[i]);
+
+            multi_targets[i] = target;
+            multi_targets[i].planes[0].texture = multi_fbo[i];
+            multi_targets[i].crop = (struct pl_rect2df) {0};
+        }
+
+        static float out[2][2][7][7][4];
+        REQUIRE(pl_render_image_multi(rr, &image, multi_targets, 2, &params));
+        for (int i = 0; i < 2; i++) {
+            REQUIRE(pl_tex_download(gpu, pl_tex_transfer_params(
+                .tex = multi_fbo[i],
+                .ptr = out[0][i],
+            )));
+        }
+
+        for (int i = 0; i < 2; i++) {
+            REQUIRE(pl_render_image(rr, &image, &multi_targets[i], &params));
+            REQUIRE(pl_tex_download(gpu, pl_tex_transfer_params(
+                .tex = multi_fbo[i],
+                .ptr = out[1][i],
+            )));
+        }
+
+        const float *a = &out[0][0][0][0][0], *b = &out[1][0][0][0][0];
+        for (int i = 0; i < sizeof(out[0]) / sizeof(float); i++)
+            REQUIRE(fabs(a[i] - b[i]) <= 1e-3 * fmax(fabs(b[i]), 1.0));
+
+        // Batched rendering should match the individual renders exactly
+        const struct pl_frame batch_images[2] = { image, image };
+        REQUIRE(pl_render_image_batch(rr, batch_images, multi_targets, 2, &params));
+        for (int i = 0; i < 2; i++) {
+            REQUIRE(pl_tex_download(gpu, pl_tex_transfer_params(
+                .tex = multi_fbo[i],
+                .ptr = out[0][i],
+            )));
+        }
+
+        REQUIRE(memcmp(out[0], out[1], sizeof(out[0])) == 0);
+
+        // Compositing should match clearing once and rendering each source
+        // into its own rect
+        const struct pl_composite_source srcs[2] = {
+            { .image = &image, .dst = {0, 0, 3, 7} },
+            { .image = &image, .dst = {3, 2, 7, 5} },
+        };
+
+        struct pl_frame comp_target = multi_targets[1];
+        REQUIRE(pl_render_composite(rr, srcs, 2, &comp_target, &params));
+        REQUIRE(pl_tex_download(gpu, pl_tex_transfer_params(
+            .tex = multi_fbo[1],
+            .ptr = out[0][1],
+        )));
+
+        struct pl_render_params comp_params = params;
+        pl_frame_clear_rgba(gpu, &comp_target, (float[4]) {
+            params.background_color[0], params.background_color[1],
+            params.background_color[2], 1.0 - params.background_transparency,
+        });
+        comp_params.skip_target_clearing = true;
+        for (int i = 0; i < 2; i++) {
+            comp_target.crop = srcs[i].dst;
+            REQUIRE(pl_render_image(rr, &image, &comp_target, &comp_params));
+        }
+        REQUIRE(pl_tex_download(gpu, pl_tex_transfer_params(
+            .tex = multi_fbo[1],
+            .ptr = out[1][1],
+        )));
+
+        REQUIRE(memcmp(out[0][1], out[1][1], sizeof(out[0][1])) == 0);
+
+        for (int i = 0; i < 2; i++)
+            pl_tex_destroy(gpu, &multi_fbo[i]);
+    }
+
+    // Test tiled rendering, against an untiled render
+    if (fbo_fmt->caps & PL_FMT_CAP_HOST_READABLE) {
+        pl_tex tile_fbo = pl_tex_create(gpu, pl_tex_params(
+            .w = 13,
+            .h = 11,
+            .format = fbo_fmt,
+            .renderable = true,
+            .host_readable = true,
+            .blit_dst = fbo_fmt->caps & PL_FMT_CAP_BLITTABLE,
+        ));
+        REQUIRE(tile_fbo);
+
+        struct pl_frame tile_target = target;
+        tile_target.planes[0].texture = tile_fbo;
+        tile_target.crop = (struct pl_rect2df) { 1, 10, 12, 1 };
+
+        // Noise patterns are not continuous across tiles
+        params.dither_params = NULL;
+        params.deband_params = NULL;
+
+        static float out[2][11][13];
+        for (int i = 0; i < 2; i++) {
+            params.render_tile_size = i ? 0 : 4;
+            REQUIRE(pl_render_image(rr, &image, &tile_target, &params));
+            REQUIRE(pl_tex_download(gpu, pl_tex_transfer_params(
+                .tex = tile_fbo,
+                .ptr = out[i],
+            )));
+        }
+
+        // Compare relative to the peak, since the target is 32-bit
+        const float *a = &out[0][0][0], *b = &out[1][0][0];
+        const int num = sizeof(out[0]) / sizeof(float);
+        float peak = 1.0;
+        for (int i = 0; i < num; i++)
+            peak = fmaxf(peak, fabsf(b[i]));
+        for (int i = 0; i < num; i++)
+            REQUIRE(fabsf(a[i] - b[i]) <= 1e-4 * peak);
+
+        params.render_tile_size = 0;
+        params.dither_params = pl_render_default_params.dither_params;
+        params.deband_params = pl_render_default_params.deband_params;
+        pl_tex_destroy(gpu, &tile_fbo);
+    }
+
+    // Test batching overlays into an atlas, against separate draws
+    if ((fbo_fmt->caps & blit_caps) == blit_caps) {
+        static float data_3x2[2][3] = {
+            { 0.2, 1.0, 0.4 },
+            { 0.7, 0.1, 0.9 },
+        };
+
+        pl_tex osd_tex[2][2];
+        for (int i = 0; i < 2; i++) {
+            for (int j = 0; j < 2; j++) {
+                osd_tex[i][j] = pl_tex_create(gpu, pl_tex_params(
+                    .w = j ? 3 : 5,
+                    .h = j ? 2 : 5,
+                    .format = fbo_fmt,
+                    .sampleable = true,
+                    .blit_src = !i,
+                    .initial_data = j ? (void *) data_3x2 : (void *) data_5x5,
+                ));
+                REQUIRE(osd_tex[i][j]);
+            }
+        }
+
+        const struct pl_overlay_part parts[] = {{
+            .src = {-1, 0, 5, 6},
+            .dst = {1, 1, 8, 5},
+        }, {
+            .src = {0.5, 0.5, 3, 2},
+            .dst = {4, 2, 10, 8},
+        }};
+
+        pl_tex osd_fbo = pl_tex_create(gpu, pl_tex_params(
+            .w = 13,
+            .h = 11,
+            .format = fbo_fmt,
+            .renderable = true,
+            .host_readable = true,
+        ));
+        REQUIRE(osd_fbo);
+
+        static float out[2][11][13];
+        for (int i = 0; i < 2; i++) {
+            struct pl_overlay ols[3];
+            for (int n = 0; n < 3; n++) {
+                ols[n] = (struct pl_overlay) {
+                    .tex = osd_tex[i][n % 2],
+                    .mode = PL_OVERLAY_NORMAL,
+                    .parts = &parts[n % 2],
+                    .num_parts = 1,
+                    .repr = pl_color_repr_rgb,
+                    .color = pl_color_space_srgb,
+                };
+            }
+
+            struct pl_frame osd_target = {
+                .num_planes = 1,
+                .planes = {{
+                    .texture = osd_fbo,
+                    .components = 1,
+                    .component_mapping = {0},
+                }},
+                .repr = pl_color_repr_rgb,
+                .color = pl_color_space_srgb,
+                .overlays = ols,
+                .num_overlays = 3,
+            };
+
+            REQUIRE(pl_render_image(rr, &image, &osd_target, &params));
+            REQUIRE(pl_tex_download(gpu, pl_tex_transfer_params(
+                .tex = osd_fbo,
+                .ptr = out[i],
+            )));
+        }
+
+        const float *a = &out[0][0][0], *b = &out[1][0][0];
+        const int num = sizeof(out[0]) / sizeof(float);
+        float peak = 1.0;
+        for (int i = 0; i < num; i++)
+            peak = fmaxf(peak, fabsf(b[i]));
+        for (int i = 0; i < num; i++)
+            REQUIRE(fabsf(a[i] - b[i]) <= 1e-4 * peak);
+
+        for (int i = 0; i < 2; i++) {
+            for (int j = 0; j < 2; j++)
+                pl_tex_destroy(gpu, &osd_tex[i][j]);
+        }
+        pl_tex_destroy(gpu, &osd_fbo);
+    }
+
     // Test rotation
     for (pl_rotation rot = 0; rot < PL_ROTATION_360; rot += PL_ROTATION_90) {
         image.rotation = rot;
@@ -1172,9 +2786,30 @@ static void pl_render_tests(pl_gpu gpu)
         qparams.pts += qparams.vsync_duration;
     }
 
+    // Test skipping frames with negligible weight, using a mixer whose
+    // effective support is only half of its nominal radius
+    struct pl_filter_config narrow_mixer = pl_filter_mitchell_clamp;
+    narrow_mixer.blur = 0.5;
+    mix_params.frame_mixer = &narrow_mixer;
+    qparams.pts = 0.0;
+    qparams.frame_mixer = &narrow_mixer;
+
+    pl_queue_reset(queue);
+    for (int i = 0; i < NUM_MIX_FRAMES; i++)
+        pl_queue_push(queue, &srcframes[i]);
+    pl_queue_push(queue, NULL);
+
+    while ((ret = pl_queue_update(queue, &mix, &qparams)) != PL_QUEUE_EOF) {
+        REQUIRE(ret == PL_QUEUE_OK);
+        REQUIRE(mix.num_frames <= 2);
+        REQUIRE(pl_render_image_mix(rr, &mix, &target, &mix_params));
+        qparams.pts += qparams.vsync_duration;
+    }
+
     // Test dynamically pulling all frames, with oversample mixer
     const struct pl_source_frame *frame_ptr = &srcframes[0];
     mix_params.frame_mixer = &pl_oversample_frame_mixer;
+    mix_params.params_signature = 1; // also test the cached params hash
 
     qparams = (struct pl_queue_params) {
         .radius = pl_frame_mix_radius(&mix_params),
@@ -1191,13 +2826,362 @@ static void pl_render_tests(pl_gpu gpu)
         REQUIRE(pl_render_image_mix(rr, &mix, &target, &mix_params));
         qparams.pts += qparams.vsync_duration;
     }
+    mix_params.params_signature = 0;
+
+    // Test the mixing cache budget, with reduced precision frames
+    struct pl_frame target8 = target;
+    target8.repr.bits.color_depth = 8;
+    mix_params.mixing_cache_budget = 1; // only keep the frames in use
+    mix_params.mixing_cache_low_precision = true;
+    frame_ptr = &srcframes[0];
+    qparams.pts = 0.0;
+
+    pl_queue_reset(queue);
+    while ((ret = pl_queue_update(queue, &mix, &qparams)) != PL_QUEUE_EOF) {
+        REQUIRE(ret == PL_QUEUE_OK);
+        REQUIRE(pl_render_image_mix(rr, &mix, &target8, &mix_params));
+        qparams.pts += qparams.vsync_duration;
+    }
 
     // Test large PTS jump
     pl_queue_reset(queue);
     REQUIRE(pl_queue_update(queue, &mix, &qparams) == PL_QUEUE_EOF);
 
+    // Test texture recycling for frames of alternating shapes, which should
+    // only ever need to create a single texture per shape
+    static const uint8_t plane_bytes[16 * 16] = {0};
+    const struct pl_plane_data plane_shapes[2] = {
+        {
+            .type           = PL_FMT_UNORM,
+            .width          = 16,
+            .height         = 16,
+            .component_size = {8},
+            .component_map  = {0},
+            .pixel_stride   = 1,
+            .pixels         = plane_bytes,
+        }, {
+            .type           = PL_FMT_UNORM,
+            .width          = 8,
+            .height         = 8,
+            .component_size = {8},
+            .component_map  = {0},
+            .pixel_stride   = 1,
+            .pixels         = plane_bytes,
+        },
+    };
+
+    if (pl_plane_find_fmt(gpu, NULL, &plane_shapes[0])) {
+        pl_queue_reset(queue);
+        for (int i = 0; i < NUM_MIX_FRAMES; i++) {
+            const struct pl_plane_data *shape = &plane_shapes[i % 2];
+            pl_queue_push(queue, &(struct pl_source_frame) {
+                .pts        = i * qparams.frame_duration,
+                .map        = frame_upload,
+                .frame_data = (void *) shape,
+                .planes     = shape,
+                .num_planes = 1,
+            });
+        }
+        pl_queue_push(queue, NULL);
+
+        num_tex_mismatched = 0;
+        struct pl_queue_params rparams = {
+            .vsync_duration = qparams.frame_duration,
+            .frame_duration = qparams.frame_duration,
+        };
+
+        while ((ret = pl_queue_update(queue, &mix, &rparams)) != PL_QUEUE_EOF) {
+            REQUIRE(ret == PL_QUEUE_OK);
+            rparams.pts += rparams.vsync_duration;
+        }
+
+        printf("frames with mismatched textures: %d\n", num_tex_mismatched);
+        REQUIRE(num_tex_mismatched <= 2);
+    }
+
+    // Same, but through the lock-free ring of an SPSC queue, with `planes`
+    // only valid during the push (the ring is drained by `pl_queue_update`)
+    if (pl_plane_find_fmt(gpu, NULL, &plane_shapes[0])) {
+        pl_queue spsc = pl_queue_create_spsc(gpu);
+        struct pl_plane_data push_plane;
+        for (int i = 0; i < 11; i++) {
+            push_plane = plane_shapes[i % 2];
+            pl_queue_push(spsc, &(struct pl_source_frame) {
+                .pts        = i * qparams.frame_duration,
+                .map        = frame_upload,
+                .frame_data = (void *) &plane_shapes[i % 2],
+                .planes     = &push_plane,
+                .num_planes = 1,
+            });
+        }
+        pl_queue_push(spsc, NULL);
+
+        // Clobber the plane data before the consumer gets to see it
+        push_plane = plane_shapes[1];
+        REQUIRE(pl_queue_get_stats(spsc).num_frames == 0);
+
+        // Skip every other frame, so that both shapes are up for reuse at
+        // once and picking the right one depends on the shape hints
+        num_tex_mismatched = 0;
+        struct pl_queue_params rparams = {
+            .vsync_duration = 2 * qparams.frame_duration,
+            .frame_duration = qparams.frame_duration,
+        };
+
+        while ((ret = pl_queue_update(spsc, &mix, &rparams)) != PL_QUEUE_EOF) {
+            REQUIRE(ret == PL_QUEUE_OK);
+            rparams.pts += rparams.vsync_duration;
+        }
+
+        printf("frames with mismatched textures (SPSC): %d\n",
+               num_tex_mismatched);
+        REQUIRE(num_tex_mismatched <= 2);
+        pl_queue_destroy(&spsc);
+    }
+
+    // Test rendering the same stream to two outputs with different refresh
+    // rates, which should still only map every frame once
+    pl_queue_consumer consumers[2] = {
+        pl_queue_consumer_create(queue),
+        pl_queue_consumer_create(queue),
+    };
+
+    pl_queue_reset(queue);
+    for (int i = 0; i < NUM_MIX_FRAMES; i++)
+        pl_queue_push(queue, &srcframes[i]);
+    pl_queue_push(queue, NULL);
+
+    struct pl_queue_params cparams[2];
+    for (int i = 0; i < 2; i++) {
+        cparams[i] = (struct pl_queue_params) {
+            .radius = pl_frame_mix_radius(&(struct pl_render_params) {
+                .frame_mixer = &pl_filter_mitchell_clamp,
+            }),
+            .vsync_duration = i ? 1.0 / 50.0 : 1.0 / 60.0,
+            .frame_duration = qparams.frame_duration,
+            .consumer = consumers[i],
+        };
+    }
+
+    int num_updates[2] = {0};
+    bool consumer_eof[2] = {0};
+    num_frames_mapped = 0;
+    while (!consumer_eof[0] || !consumer_eof[1]) {
+        for (int i = 0; i < 2; i++) {
+            if (consumer_eof[i])
+                continue;
+            ret = pl_queue_update(queue, &mix, &cparams[i]);
+            if (ret == PL_QUEUE_EOF) {
+                consumer_eof[i] = true;
+                continue;
+            }
+
+            REQUIRE(ret == PL_QUEUE_OK);
+            REQUIRE(mix.num_frames > 0);
+            cparams[i].pts += cparams[i].vsync_duration;
+            num_updates[i]++;
+        }
+    }
+
+    REQUIRE(num_frames_mapped == NUM_MIX_FRAMES);
+    REQUIRE(num_updates[0] > num_updates[1]);
+    pl_queue_consumer_destroy(queue, &consumers[0]);
+    pl_queue_consumer_destroy(queue, &consumers[1]);
+    REQUIRE(!consumers[0] && !consumers[1]);
+
     pl_queue_destroy(&queue);
 
+    // Test pre-pushing all frames into a lock-free SPSC queue, with prefetching
+    queue = pl_queue_create_spsc(gpu);
+    qparams.get_frame = NULL;
+    qparams.pts = 0.0;
+    for (int i = 0; i < NUM_MIX_FRAMES; i++) {
+        if (!pl_queue_push_block(queue, 1, &srcframes[i]))
+            pl_queue_push(queue, &srcframes[i]);
+    }
+    pl_queue_push(queue, NULL);
+
+    // Every push except the last one drained the ring (on the blocking path),
+    // and frames still pending in it are only counted once collected
+    REQUIRE(pl_queue_get_stats(queue).num_frames == NUM_MIX_FRAMES - 1);
+
+    int spsc_frames = 0;
+    qparams.memory_budget = 4 * sizeof(data_5x5);
+    while ((ret = pl_queue_update(queue, &mix, &qparams)) != PL_QUEUE_EOF) {
+        REQUIRE(ret == PL_QUEUE_OK);
+        REQUIRE(pl_queue_prefetch(queue, 1, 0) >= 0);
+        REQUIRE(pl_queue_get_stats(queue).resident_bytes > 0);
+        REQUIRE(pl_render_image_mix(rr, &mix, &target, &mix_params));
+        qparams.pts += qparams.vsync_duration;
+        spsc_frames++;
+    }
+    REQUIRE(spsc_frames > 0);
+
+    struct pl_queue_stats qstats = pl_queue_get_stats(queue);
+    REQUIRE(qstats.estimated_fps > 0 && qstats.estimated_vps > 0);
+    REQUIRE(qstats.frames_repeated > 0);
+    REQUIRE(qstats.stalls == 0);
+
+    pl_queue_reset(queue);
+    pl_queue_destroy(&queue);
+
+    // Test bulk pushing into a CFR queue, which should give the same results
+    // as the estimating path for a perfectly regular source
+    pl_queue cfr_queue = pl_queue_create(gpu);
+    queue = pl_queue_create(gpu);
+    qparams.memory_budget = 0;
+    qparams.pts = 0.0;
+    for (int i = 0; i < NUM_MIX_FRAMES; i++)
+        pl_queue_push(queue, &srcframes[i]);
+    pl_queue_push(queue, NULL);
+    pl_queue_push_bulk(cfr_queue, srcframes, NUM_MIX_FRAMES);
+    pl_queue_push(cfr_queue, NULL);
+    REQUIRE(pl_queue_get_stats(queue).num_frames == NUM_MIX_FRAMES);
+    REQUIRE(pl_queue_get_stats(cfr_queue).num_frames == NUM_MIX_FRAMES);
+
+    struct pl_queue_params cfr_params = qparams;
+    cfr_params.constant_frame_rate = true;
+    for (;;) {
+        struct pl_frame_mix cfr_mix;
+        enum pl_queue_status cfr_ret;
+        ret = pl_queue_update(queue, &mix, &qparams);
+        cfr_ret = pl_queue_update(cfr_queue, &cfr_mix, &cfr_params);
+        REQUIRE(ret == cfr_ret);
+        if (ret == PL_QUEUE_EOF)
+            break;
+
+        REQUIRE(ret == PL_QUEUE_OK);
+        REQUIRE(mix.num_frames == cfr_mix.num_frames);
+        for (int i = 0; i < mix.num_frames; i++) {
+            REQUIRE(mix.signatures[i] == cfr_mix.signatures[i]);
+            REQUIRE(fabsf(mix.timestamps[i] - cfr_mix.timestamps[i]) < 1e-3);
+        }
+
+        qparams.pts += qparams.vsync_duration;
+        cfr_params.pts = qparams.pts;
+    }
+
+    qstats = pl_queue_get_stats(cfr_queue);
+    REQUIRE(fabs(qstats.estimated_fps - 24.0) < 1e-3);
+    pl_queue_destroy(&cfr_queue);
+    pl_queue_destroy(&queue);
+
+    // Test re-using the results of deterministic hooks when re-rendering
+    int hook_calls = 0;
+    struct pl_hook det_hook = {
+        .stages = PL_HOOK_LUMA_INPUT,
+        .input = PL_HOOK_SIG_TEX,
+        .hook = count_hook,
+        .priv = &hook_calls,
+        .deterministic = true,
+    };
+
+    const struct pl_hook *det_hooks = &det_hook;
+    const struct pl_frame *hook_frame = &image;
+    const uint64_t hook_sig = 0x1234;
+    const float hook_pts = 0.0;
+    struct pl_frame_mix hook_mix = {
+        .num_frames = 1,
+        .frames = &hook_frame,
+        .signatures = &hook_sig,
+        .timestamps = &hook_pts,
+        .vsync_duration = 1.0,
+    };
+
+    struct pl_render_params hook_params = pl_render_default_params;
+    hook_params.hooks = &det_hooks;
+    hook_params.num_hooks = 1;
+
+    struct pl_frame hook_target = target;
+    hook_target.crop = (struct pl_rect2df) { 0, 0, 5, 5 };
+    REQUIRE(pl_render_image_mix(rr, &hook_mix, &hook_target, &hook_params));
+    if (hook_calls) {
+        // Changing unrelated params forces re-rendering the cached frame
+        hook_params.dither_params = NULL;
+        REQUIRE(pl_render_image_mix(rr, &hook_mix, &hook_target, &hook_params));
+        REQUIRE(hook_calls == 1);
+
+        // Changing the output size changes the hook params
+        hook_target.crop.x1 = hook_target.crop.y1 = 4;
+        REQUIRE(pl_render_image_mix(rr, &hook_mix, &hook_target, &hook_params));
+        REQUIRE(hook_calls == 2);
+
+        det_hook.deterministic = false;
+        hook_params.dither_params = &pl_dither_default_params;
+        REQUIRE(pl_render_image_mix(rr, &hook_mix, &hook_target, &hook_params));
+        REQUIRE(hook_calls == 3);
+    }
+
+    // Test running hooks at reduced resolution
+    struct size_hook_state size_state = {0};
+    struct pl_hook scaled_hook = {
+        .stages = PL_HOOK_LUMA_INPUT | PL_HOOK_OUTPUT,
+        .input = PL_HOOK_SIG_TEX,
+        .hook = size_hook,
+        .priv = &size_state,
+        .scale = 0.5,
+    };
+
+    const struct pl_hook *scaled_hooks = &scaled_hook;
+    hook_params = pl_render_default_params;
+    hook_params.hooks = &scaled_hooks;
+    hook_params.num_hooks = 1;
+    hook_target.crop = (struct pl_rect2df) { 0, 0, 4, 4 };
+    REQUIRE(pl_render_image(rr, &image, &hook_target, &hook_params));
+    if (size_state.calls) {
+        REQUIRE(size_state.w == 2 && size_state.h == 2); // OUTPUT
+        size_state.calls = 0;
+        scaled_hook.scale = 0.0;
+        REQUIRE(pl_render_image(rr, &image, &hook_target, &hook_params));
+        REQUIRE(size_state.calls);
+        REQUIRE(size_state.w == 4 && size_state.h == 4);
+    }
+
+    // Test the per-stage statistics accumulated by all of the above
+    struct pl_render_stats stats = pl_renderer_get_stats(rr);
+    int num_frames = 0;
+    for (int i = 0; i < PL_RENDER_STAT_COUNT; i++) {
+        const struct pl_render_stage_stats *st = &stats.stages[i];
+        REQUIRE(st->num_frames <= 256);
+        REQUIRE(st->gpu_mean <= st->gpu_peak);
+        REQUIRE(st->gpu_p95 <= st->gpu_peak);
+        REQUIRE(st->cpu_mean <= st->cpu_peak);
+        REQUIRE(st->cpu_p95 <= st->cpu_peak);
+        num_frames += st->num_frames;
+    }
+    REQUIRE(num_frames > 0);
+    REQUIRE(stats.stages[PL_RENDER_STAT_OTHER].num_frames > 0); // frame mixing
+
+    pl_renderer_reset_stats(rr);
+    stats = pl_renderer_get_stats(rr);
+    for (int i = 0; i < PL_RENDER_STAT_COUNT; i++)
+        REQUIRE(stats.stages[i].num_frames == 0);
+
+    // Test dynamic quality scaling, if timer queries are available
+    struct pl_render_params budget_params = pl_render_high_quality_params;
+    budget_params.gpu_time_budget = 1;
+    uint64_t gpu_total = 0;
+    for (int i = 0; i < 300 && stats.quality_level < 3; i++) {
+        REQUIRE(pl_render_image(rr, &image, &target, &budget_params));
+        stats = pl_renderer_get_stats(rr);
+        for (int n = 0; n < PL_RENDER_STAT_COUNT; n++)
+            gpu_total += stats.stages[n].gpu_peak;
+    }
+
+    if (gpu_total) {
+        REQUIRE(stats.quality_level == 3);
+        budget_params.gpu_time_budget = UINT64_MAX;
+        for (int i = 0; i < 300 && stats.quality_level > 0; i++) {
+            REQUIRE(pl_render_image(rr, &image, &target, &budget_params));
+            stats = pl_renderer_get_stats(rr);
+        }
+        REQUIRE(stats.quality_level == 0);
+    }
+
+    budget_params.gpu_time_budget = 0;
+    REQUIRE(pl_render_image(rr, &image, &target, &budget_params));
+    REQUIRE(pl_renderer_get_stats(rr).quality_level == 0);
+
 error:
     pl_renderer_destroy(&rr);
     pl_tex_destroy(gpu, &img5x5_tex);
@@ -1339,6 +3323,131 @@ error:
     }
 }
 
+static void pl_packed_tests(pl_gpu gpu)
+{
+    static const int depths[PL_PACKED_FMT_COUNT] = {
+        [PL_PACKED_YUYV] = 8,
+        [PL_PACKED_UYVY] = 8,
+        [PL_PACKED_Y210] = 10,
+        [PL_PACKED_V210] = 10,
+    };
+
+    const int width = 13, height = 5, chroma_w = (width + 1) / 2;
+    for (enum pl_packed_fmt f = PL_PACKED_NONE + 1; f < PL_PACKED_FMT_COUNT; f++) {
+        if (!pl_test_packed(gpu, f))
+            continue;
+
+        // Generate some arbitrary samples, then pack them on the CPU
+        const int depth = depths[f], mask = (1 << depth) - 1;
+        #define SAMPLE(x, y, c) (((x) * 37 + (y) * 101 + (c) * 53) & mask)
+        size_t row_stride = f == PL_PACKED_V210 ? PL_ALIGN((width + 5) / 6 * 16, 128)
+                          : f == PL_PACKED_Y210 ? chroma_w * 8 : chroma_w * 4;
+        uint8_t *packed = calloc(height, row_stride);
+        REQUIRE(packed);
+
+        for (int y = 0; y < height; y++) {
+            uint8_t *row = packed + y * row_stride;
+            for (int x = 0; x < chroma_w; x++) {
+                int y0 = SAMPLE(2 * x, y, 0), cb = SAMPLE(x, y, 1), cr = SAMPLE(x, y, 2);
+                int y1 = 2 * x + 1 < width ? SAMPLE(2 * x + 1, y, 0) : 0;
+                uint16_t *row16 = (uint16_t *) row;
+                switch (f) {
+                case PL_PACKED_YUYV:
+                    memcpy(&row[4 * x], (uint8_t[4]) { y0, cb, y1, cr }, 4);
+                    break;
+                case PL_PACKED_UYVY:
+                    memcpy(&row[4 * x], (uint8_t[4]) { cb, y0, cr, y1 }, 4);
+                    break;
+                case PL_PACKED_Y210:
+                    row16[4 * x + 0] = y0 << 6;
+                    row16[4 * x + 1] = cb << 6;
+                    row16[4 * x + 2] = y1 << 6;
+                    row16[4 * x + 3] = cr << 6;
+                    break;
+                default: break;
+                }
+            }
+
+            if (f == PL_PACKED_V210) {
+                // Order of samples within each group, as (plane, offset)
+                static const int order[12][2] = {
+                    {1, 0}, {0, 0}, {2, 0}, {0, 1}, {1, 1}, {0, 2},
+                    {2, 1}, {0, 3}, {1, 2}, {0, 4}, {2, 2}, {0, 5},
+                };
+                uint32_t *words = (uint32_t *) row;
+                for (int g = 0; g < (width + 5) / 6; g++) {
+                    for (int i = 0; i < 12; i++) {
+                        const int plane = order[i][0];
+                        int x = (plane ? 3 : 6) * g + order[i][1];
+                        if (x >= (plane ? chroma_w : width))
+                            continue;
+                        words[4 * g + i / 3] |= (uint32_t) SAMPLE(x, y, plane) << (i % 3 * 10);
+                    }
+                }
+            }
+        }
+
+        pl_tex tex[2] = {0};
+        struct pl_plane planes[2];
+        struct pl_bit_encoding bits;
+        REQUIRE(pl_upload_packed(gpu, planes, tex, &bits, &(struct pl_packed_data) {
+            .format = f,
+            .width = width,
+            .height = height,
+            .pixels = packed,
+        }));
+        REQUIRE(bits.sample_depth == depth && bits.color_depth == depth);
+        REQUIRE(planes[0].components == 1 && planes[1].components == 2);
+        REQUIRE(tex[0]->params.w == width && tex[1]->params.w == chroma_w);
+
+        for (int p = 0; p < 2; p++) {
+            pl_fmt fmt = tex[p]->params.format;
+            const enum pl_fmt_caps caps = PL_FMT_CAP_HOST_READABLE | PL_FMT_CAP_BLITTABLE;
+            if ((fmt->caps & caps) != caps)
+                continue;
+
+            pl_tex dst = pl_tex_create(gpu, pl_tex_params(
+                .w = tex[p]->params.w,
+                .h = height,
+                .format = fmt,
+                .blit_dst = true,
+                .host_readable = true,
+            ));
+            REQUIRE(dst);
+
+            const int comps = p + 1, w = tex[p]->params.w;
+            uint16_t *out = malloc(w * height * fmt->texel_size);
+            REQUIRE(out);
+            pl_tex_blit(gpu, pl_tex_blit_params(.src = tex[p], .dst = dst));
+            REQUIRE(pl_tex_download(gpu, pl_tex_transfer_params(
+                .tex = dst,
+                .ptr = out,
+            )));
+
+            for (int y = 0; y < height; y++) {
+                for (int x = 0; x < w; x++) {
+                    for (int c = 0; c < comps; c++) {
+                        int idx = (y * w + x) * comps + c;
+                        float got = fmt->texel_size == comps
+                                  ? ((uint8_t *) out)[idx] / 255.0f
+                                  : out[idx] / 65535.0f;
+                        float ref = SAMPLE(x, y, p + c) / (float) mask;
+                        REQUIRE(fabs(got - ref) < 0.5f / mask);
+                    }
+                }
+            }
+
+            free(out);
+            pl_tex_destroy(gpu, &dst);
+        }
+        #undef SAMPLE
+
+        pl_tex_destroy(gpu, &tex[0]);
+        pl_tex_destroy(gpu, &tex[1]);
+        free(packed);
+    }
+}
+
 static void pl_test_export_import(pl_gpu gpu,
                                   enum pl_handle_type handle_type)
 {
@@ -1371,8 +3480,26 @@ static void pl_test_export_import(pl_gpu gpu,
         .shared_mem = export->shared_mem,
     });
     REQUIRE(import);
-
     pl_tex_destroy(gpu, &import);
+
+    if (handle_type == PL_HANDLE_DMA_BUF &&
+        export->shared_mem.drm_format_mod != DRM_FORMAT_MOD_INVALID)
+    {
+        // Restricting the modifiers to the one picked before must succeed
+        const uint64_t mod = export->shared_mem.drm_format_mod;
+        pl_tex_destroy(gpu, &export);
+        export = pl_tex_create(gpu, &(struct pl_tex_params) {
+            .w = 32,
+            .h = 32,
+            .format = fmt,
+            .export_handle = handle_type,
+            .export_modifiers = &mod,
+            .num_export_modifiers = 1,
+        });
+        REQUIRE(export);
+        REQUIRE(export->shared_mem.drm_format_mod == mod);
+    }
+
     pl_tex_destroy(gpu, &export);
 
 skip_tex: ;
@@ -1403,6 +3530,86 @@ skip_tex: ;
     pl_buf_destroy(gpu, &exp_buf);
 }
 
+static void pl_test_timeline_sync(pl_gpu gpu, enum pl_handle_type handle_type)
+{
+    if (!(gpu->export_caps.sync_timeline & handle_type) ||
+        !(gpu->export_caps.tex & handle_type))
+        return;
+
+    pl_fmt fmt = pl_find_fmt(gpu, PL_FMT_UNORM, 1, 0, 0, PL_FMT_CAP_BLITTABLE);
+    if (!fmt)
+        return;
+
+    printf("testing timeline sync export\n");
+    pl_sync sync = pl_sync_create_timeline(gpu, handle_type);
+    REQUIRE(sync);
+    REQUIRE(sync->timeline);
+    REQUIRE(!sync->wait_value && !sync->signal_value);
+
+    pl_tex tex = pl_tex_create(gpu, pl_tex_params(
+        .w = 32,
+        .h = 32,
+        .format = fmt,
+        .blit_dst = true,
+        .export_handle = handle_type,
+    ));
+    REQUIRE(tex);
+
+    pl_tex_clear(gpu, tex, (float[4]) {0});
+    REQUIRE(pl_tex_export(gpu, tex, sync));
+    REQUIRE(sync->wait_value == 1 && sync->signal_value == 1);
+
+    // Destroying exported textures is always allowed
+    pl_gpu_finish(gpu);
+    pl_tex_destroy(gpu, &tex);
+    pl_sync_destroy(gpu, &sync);
+}
+
+static void pl_test_export_ring(pl_gpu gpu)
+{
+    if (!(gpu->export_caps.tex & PL_HANDLE_DMA_BUF) ||
+        !(gpu->export_caps.sync & PL_HANDLE_FD))
+        return;
+
+    pl_fmt fmt = pl_find_fmt(gpu, PL_FMT_UNORM, 4, 8, 8, PL_FMT_CAP_RENDERABLE |
+                                                         PL_FMT_CAP_BLITTABLE);
+    if (!fmt)
+        return;
+
+    printf("testing export ring\n");
+    pl_export_ring ring = pl_export_ring_create(gpu, pl_export_ring_params(
+        .format         = fmt,
+        .w              = 32,
+        .h              = 32,
+        .num_targets    = 2,
+    ));
+    REQUIRE(ring);
+
+    struct pl_export_frame frames[3];
+    REQUIRE(pl_export_ring_acquire(ring, &frames[0]));
+    REQUIRE(pl_export_ring_acquire(ring, &frames[1]));
+    REQUIRE(!pl_export_ring_acquire(ring, &frames[2]));
+    REQUIRE(frames[0].tex != frames[1].tex);
+
+    pl_tex_clear(gpu, frames[0].tex, (float[4]) {0});
+    REQUIRE(pl_export_ring_submit(ring, &frames[0]));
+    const struct pl_shared_mem mem = *frames[0].mem;
+    REQUIRE_HANDLE(mem, PL_HANDLE_DMA_BUF);
+    REQUIRE(frames[0].sync->wait_handle.fd >= 0);
+
+    // Frames that were never submitted can be released directly
+    pl_export_ring_release(ring, &frames[1]);
+    REQUIRE(pl_export_ring_acquire(ring, &frames[2]));
+    REQUIRE(frames[2].tex == frames[1].tex);
+    pl_export_ring_release(ring, &frames[2]);
+
+    // Emulate the consumer's release fence by destroying the ring, which is
+    // always allowed for exported textures
+    pl_gpu_finish(gpu);
+    pl_export_ring_destroy(&ring);
+    REQUIRE(!ring);
+}
+
 static void pl_test_host_ptr(pl_gpu gpu)
 {
     if (!(gpu->import_caps.buf & PL_HANDLE_HOST_PTR))
@@ -1434,13 +3641,294 @@ static void pl_test_host_ptr(pl_gpu gpu)
 
     REQUIRE(buf);
     REQUIRE(memcmp(data + offset, buf->data, slice) == 0);
-
     pl_buf_destroy(gpu, &buf);
+
+    // Test uploading planes from persistent (cached) host memory
+    struct pl_plane_data plane = {
+        .type = PL_FMT_UNORM,
+        .width = 256,
+        .height = 64,
+        .component_size = {8},
+        .component_map = {0},
+        .pixel_stride = 1,
+        .pixels = data,
+        .pixels_persistent = true,
+    };
+
+    const enum pl_fmt_caps caps = PL_FMT_CAP_HOST_READABLE | PL_FMT_CAP_BLITTABLE;
+    pl_fmt fmt = pl_plane_find_fmt(gpu, NULL, &plane);
+    if (fmt && (fmt->caps & caps) == caps && gpu->limits.callbacks) {
+        pl_tex tex = NULL;
+        pl_tex dst = pl_tex_create(gpu, pl_tex_params(
+            .w = plane.width,
+            .h = plane.height,
+            .format = fmt,
+            .blit_dst = true,
+            .host_readable = true,
+        ));
+        REQUIRE(dst);
+
+        uint8_t *out = malloc(256 * 64);
+        for (int i = 0; i < 2; i++) {
+            bool done = false;
+            plane.callback = test_cb;
+            plane.priv = &done;
+            REQUIRE(pl_upload_plane(gpu, NULL, &tex, &plane));
+            pl_gpu_finish(gpu);
+            REQUIRE(done);
+
+            pl_tex_blit(gpu, pl_tex_blit_params(.src = tex, .dst = dst));
+            REQUIRE(pl_tex_download(gpu, pl_tex_transfer_params(
+                .tex = dst,
+                .ptr = out,
+            )));
+            REQUIRE(memcmp(data, out, 256 * 64) == 0);
+        }
+
+        // Download into persistent (cached) host memory
+        uint8_t *dl = aligned_alloc(0x1000, size);
+        for (int i = 0; i < 2; i++) {
+            memset(dl, 0, 256 * 64);
+            REQUIRE(pl_tex_download(gpu, pl_tex_transfer_params(
+                .tex = dst,
+                .ptr = dl,
+                .ptr_persistent = true,
+            )));
+            REQUIRE(memcmp(data, dl, 256 * 64) == 0);
+        }
+        pl_tex_transfer_forget(gpu, dl, size);
+        free(dl);
+
+        pl_upload_forget(gpu, data, size);
+        pl_tex_destroy(gpu, &tex);
+        pl_tex_destroy(gpu, &dst);
+        free(out);
+    }
+
     free(data);
 
 #endif // unix
 }
 
+static void pl_filter_pipeline_tests(pl_gpu gpu)
+{
+    enum { W = 16, H = 8, FRAMES = 5 };
+    struct pl_filter_image fmt = {
+        .num_planes = 1,
+        .planes = {{
+            .type           = PL_FMT_UNORM,
+            .width          = W,
+            .height         = H,
+            .component_size = {8, 8, 8, 8},
+            .component_map  = {0, 1, 2, 3},
+            .pixel_stride   = 4,
+        }},
+        .repr   = pl_color_repr_rgb,
+        .color  = pl_color_space_srgb,
+    };
+
+    pl_fmt tex_fmt = pl_plane_find_fmt(gpu, NULL, &fmt.planes[0]);
+    if (!tex_fmt || !(tex_fmt->caps & PL_FMT_CAP_RENDERABLE) ||
+        !(tex_fmt->caps & PL_FMT_CAP_HOST_READABLE))
+        return;
+
+    printf("testing filter pipeline\n");
+    pl_renderer rr = pl_renderer_create(gpu->log, gpu);
+    pl_filter_pipeline pipe = pl_filter_pipeline_create(gpu, pl_filter_pipeline_params(
+        .renderer       = rr,
+        .render_params  = &(struct pl_render_params) {0},
+        .queue_size     = 3,
+    ));
+    REQUIRE(pipe);
+
+    static uint8_t data[FRAMES][H][W][4];
+    for (int f = 0; f < FRAMES; f++) {
+        for (int y = 0; y < H; y++) {
+            for (int x = 0; x < W; x++) {
+                for (int c = 0; c < 3; c++)
+                    data[f][y][x][c] = (f * 41 + y * 17 + x * 5 + c * 63) & 0xFF;
+                data[f][y][x][3] = 0xFF;
+            }
+        }
+    }
+
+    int pushed = 0, pulled = 0;
+    while (pulled < FRAMES) {
+        while (pushed < FRAMES) {
+            struct pl_filter_image src = fmt;
+            src.planes[0].pixels = data[pushed];
+            if (!pl_filter_pipeline_push(pipe, &src, &fmt, &data[pushed]))
+                break;
+            pushed++;
+        }
+
+        // The queue must have filled up before anything was pulled
+        REQUIRE(pl_filter_pipeline_queued(pipe) > 0);
+        REQUIRE(pushed == FRAMES || pushed - pulled == 3);
+
+        struct pl_filter_output out;
+        REQUIRE(pl_filter_pipeline_pull(pipe, &out, UINT64_MAX));
+        REQUIRE(out.priv == &data[pulled]); // returned in order
+        REQUIRE(out.image.num_planes == 1);
+
+        const struct pl_plane_data *plane = &out.image.planes[0];
+        REQUIRE(plane->row_stride >= W * 4);
+        for (int y = 0; y < H; y++) {
+            const uint8_t *row = (const uint8_t *) plane->pixels + y * plane->row_stride;
+            for (int x = 0; x < W * 4; x++)
+                REQUIRE(abs(row[x] - data[pulled][y][x / 4][x % 4]) <= 1);
+        }
+
+        pl_filter_pipeline_release(pipe, &out);
+        pulled++;
+    }
+
+    REQUIRE(!pl_filter_pipeline_queued(pipe));
+    struct pl_filter_output out;
+    REQUIRE(!pl_filter_pipeline_pull(pipe, &out, 0));
+
+    struct pl_filter_pipeline_stats stats = pl_filter_pipeline_get_stats(pipe);
+    for (int i = 0; i < PL_FILTER_STAGE_COUNT; i++)
+        REQUIRE(stats.stages[i].cpu.count == FRAMES);
+    REQUIRE(stats.latency.count == FRAMES);
+    REQUIRE(stats.latency.peak >= stats.latency.mean);
+
+    pl_filter_pipeline_reset_stats(pipe);
+    stats = pl_filter_pipeline_get_stats(pipe);
+    REQUIRE(!stats.latency.count);
+
+    pl_filter_pipeline_destroy(&pipe);
+    REQUIRE(!pipe);
+    pl_renderer_destroy(&rr);
+}
+
+static void count_frame_passes_cb(void *priv, const struct pl_render_info *info)
+{
+    int *count = priv;
+    if (info->stage == PL_RENDER_STAGE_FRAME)
+        (*count)++;
+}
+
+// Renders a few standard scenarios, asserting upper bounds on the work done
+// per frame, and that re-rendering the same frame hits all caches, i.e. does
+// not compile any passes, allocate any textures or upload any texture data.
+// This catches structural performance regressions without relying on timing.
+static void pl_render_budget_tests(pl_gpu gpu)
+{
+    pl_fmt fmt_dst = pl_find_fmt(gpu, PL_FMT_UNORM, 4, 8, 8, PL_FMT_CAP_RENDERABLE);
+    if (!fmt_dst)
+        return;
+
+    static const struct {
+        const char *name;
+        const struct pl_render_params *params;
+        bool ycbcr;
+        int scale;          // upscaling factor
+        int max_passes;     // upper bound on passes per frame
+    } scenarios[] = {
+        { "rgb passthrough", &pl_render_fast_params,         false, 1, 1 },
+        { "rgb upscale",     &pl_render_default_params,      false, 2, 3 },
+        { "yuv420 upscale",  &pl_render_default_params,      true,  2, 5 },
+        { "yuv420 hq",       &pl_render_high_quality_params, true,  2, 5 },
+    };
+
+    const int w = 64, h = 64;
+    uint8_t *pixels = malloc(w * h);
+    REQUIRE(pixels);
+    for (int i = 0; i < w * h; i++)
+        pixels[i] = (i * 37) ^ (i >> 6);
+
+    pl_tex src_tex[3] = {0};
+    for (int s = 0; s < PL_ARRAY_SIZE(scenarios); s++) {
+        printf("testing render budget: %s\n", scenarios[s].name);
+        const int dst_w = w * scenarios[s].scale, dst_h = h * scenarios[s].scale;
+        pl_tex fbo = pl_tex_create(gpu, pl_tex_params(
+            .format     = fmt_dst,
+            .w          = dst_w,
+            .h          = dst_h,
+            .renderable = true,
+        ));
+        REQUIRE(fbo);
+
+        struct pl_frame image = {
+            .repr       = pl_color_repr_rgb,
+            .color      = pl_color_space_srgb,
+        };
+
+        const int num_planes = scenarios[s].ycbcr ? 3 : 1;
+        for (int i = 0; i < num_planes; i++) {
+            const int sub = i > 0 ? 1 : 0;
+            const struct pl_plane_data data = {
+                .type           = PL_FMT_UNORM,
+                .width          = w >> sub,
+                .height         = h >> sub,
+                .component_size = {8},
+                .component_map  = {scenarios[s].ycbcr ? i : 0},
+                .pixel_stride   = 1,
+                .row_stride     = w,
+                .pixels         = pixels,
+            };
+            REQUIRE(pl_upload_plane(gpu, &image.planes[i], &src_tex[i], &data));
+        }
+
+        image.num_planes = num_planes;
+        if (scenarios[s].ycbcr) {
+            image.repr = pl_color_repr_sdtv;
+            image.color = pl_color_space_bt709;
+            pl_frame_set_chroma_location(&image, PL_CHROMA_LEFT);
+        } else {
+            // Treat the single plane as a greyscale RGB image
+            image.planes[0].components = 3;
+            image.planes[0].component_mapping[1] = 0;
+            image.planes[0].component_mapping[2] = 0;
+        }
+
+        struct pl_frame target;
+        pl_frame_from_swapchain(&target, &(struct pl_swapchain_frame) {
+            .fbo         = fbo,
+            .color_repr  = pl_color_repr_rgb,
+            .color_space = pl_color_space_srgb,
+        });
+
+        // Use a fresh renderer for each scenario, since constants changing
+        // between scenarios would otherwise get promoted to uniforms
+        pl_renderer rr = pl_renderer_create(gpu->log, gpu);
+        int passes = 0;
+        struct pl_render_params params = *scenarios[s].params;
+        params.info_callback = count_frame_passes_cb;
+        params.info_priv = &passes;
+
+        // The first frame may compile passes and allocate resources as needed
+        REQUIRE(pl_render_image(rr, &image, &target, &params));
+        pl_gpu_flush(gpu);
+
+        struct pl_gpu_compile_stats compile = pl_gpu_get_compile_stats(gpu);
+        struct pl_gpu_memory_stats mem = pl_gpu_get_memory_stats(gpu);
+        passes = 0;
+        REQUIRE(pl_render_image(rr, &image, &target, &params));
+        pl_gpu_flush(gpu);
+
+        struct pl_gpu_compile_stats compile2 = pl_gpu_get_compile_stats(gpu);
+        struct pl_gpu_memory_stats mem2 = pl_gpu_get_memory_stats(gpu);
+        printf("  passes: %d, new passes: %d, new textures: %d, uploaded: %"PRIu64"\n",
+               passes, compile2.num_passes - compile.num_passes,
+               mem2.total.num_textures - mem.total.num_textures,
+               mem2.tex_upload_bytes - mem.tex_upload_bytes);
+
+        REQUIRE(passes >= 1 && passes <= scenarios[s].max_passes);
+        REQUIRE(compile2.num_passes == compile.num_passes);
+        REQUIRE(mem2.total.num_textures <= mem.total.num_textures);
+        REQUIRE(mem2.tex_upload_bytes == mem.tex_upload_bytes);
+
+        pl_renderer_destroy(&rr);
+        pl_tex_destroy(gpu, &fbo);
+    }
+
+    for (int i = 0; i < PL_ARRAY_SIZE(src_tex); i++)
+        pl_tex_destroy(gpu, &src_tex[i]);
+    free(pixels);
+}
+
 static void gpu_shader_tests(pl_gpu gpu)
 {
     pl_buffer_tests(gpu);
@@ -1449,6 +3937,9 @@ static void gpu_shader_tests(pl_gpu gpu)
     pl_scaler_tests(gpu);
     pl_render_tests(gpu);
     pl_ycbcr_tests(gpu);
+    pl_packed_tests(gpu);
+    pl_filter_pipeline_tests(gpu);
+    pl_render_budget_tests(gpu);
 
     REQUIRE(!pl_gpu_is_failed(gpu));
 }
@@ -1456,6 +3947,8 @@ static void gpu_shader_tests(pl_gpu gpu)
 static void gpu_interop_tests(pl_gpu gpu)
 {
     pl_test_export_import(gpu, PL_HANDLE_DMA_BUF);
+    pl_test_timeline_sync(gpu, PL_HANDLE_FD);
+    pl_test_export_ring(gpu);
     pl_test_host_ptr(gpu);
 
     REQUIRE(!pl_gpu_is_failed(gpu));
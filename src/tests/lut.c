@@ -73,6 +73,25 @@ int main()
         const struct pl_shader_res *res = pl_shader_finalize(sh);
         REQUIRE(res);
         printf("Generated LUT shader:\n%s\n", res->glsl);
+
+        // Test round-tripping through the binary format
+        size_t size = pl_lut_save(lut, NULL);
+        uint8_t *buf = malloc(size);
+        REQUIRE(buf);
+        REQUIRE(pl_lut_save(lut, buf) == size);
+
+        struct pl_custom_lut *lut2 = pl_lut_load(log, buf, size);
+        REQUIRE(lut2);
+        REQUIRE(lut2->signature == lut->signature);
+        REQUIRE(memcmp(lut2->size, lut->size, sizeof(lut->size)) == 0);
+        size_t entries = lut->size[0] * PL_DEF(lut->size[1], 1) * PL_DEF(lut->size[2], 1);
+        REQUIRE(memcmp(lut2->data, lut->data, entries * sizeof(float[3])) == 0);
+        REQUIRE(!pl_lut_load(log, buf, size - 1));
+        buf[0] = 'X';
+        REQUIRE(!pl_lut_load(log, buf, size));
+
+        pl_lut_free(&lut2);
+        free(buf);
         pl_lut_free(&lut);
     }
 
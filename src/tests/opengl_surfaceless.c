@@ -47,6 +47,84 @@ static void opengl_interop_tests(pl_gpu gpu)
     pl_tex_destroy(gpu, &export);
 }
 
+struct context_priv {
+    EGLDisplay display;
+    EGLSurface surface;
+    EGLContext main;
+    EGLContext upload;
+    int num_uploads;
+};
+
+static bool make_current(void *priv)
+{
+    struct context_priv *p = priv;
+    return eglMakeCurrent(p->display, p->surface, p->surface, p->main);
+}
+
+static void release_current(void *priv)
+{
+    struct context_priv *p = priv;
+    eglMakeCurrent(p->display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+}
+
+static bool make_current_upload(void *priv)
+{
+    struct context_priv *p = priv;
+    p->num_uploads++;
+    return eglMakeCurrent(p->display, EGL_NO_SURFACE, EGL_NO_SURFACE, p->upload);
+}
+
+static void opengl_upload_tests(pl_gpu gpu, struct context_priv *ctx)
+{
+    pl_fmt fmt = pl_find_fmt(gpu, PL_FMT_UNORM, 4, 8, 8, PL_FMT_CAP_HOST_READABLE);
+    if (!fmt || !ctx->upload || !gpu->limits.callbacks)
+        return;
+
+    printf("testing opengl upload context\n");
+    pl_tex tex = pl_tex_create(gpu, pl_tex_params(
+        .w = 16,
+        .h = 16,
+        .format = fmt,
+        .sampleable = true,
+        .host_writable = true,
+        .host_readable = true,
+    ));
+    REQUIRE(tex);
+
+    uint8_t src[16 * 16 * 4], dst[sizeof(src)];
+    for (int i = 0; i < 2; i++) {
+        for (int n = 0; n < sizeof(src); n++)
+            src[n] = RANDOM * 256;
+
+        // The first upload races against the texture's creation, so it
+        // must happen on the main context. Flushing lets the second one
+        // happen on the upload context.
+        bool done = false;
+        int num_uploads = ctx->num_uploads;
+        REQUIRE(pl_tex_upload(gpu, pl_tex_transfer_params(
+            .tex = tex,
+            .ptr = src,
+            .callback = test_cb,
+            .priv = &done,
+        )));
+        REQUIRE(ctx->num_uploads == num_uploads + i);
+        pl_gpu_flush(gpu);
+
+        memset(dst, 0, sizeof(dst));
+        REQUIRE(pl_tex_download(gpu, pl_tex_transfer_params(
+            .tex = tex,
+            .ptr = dst,
+        )));
+        REQUIRE(memcmp(src, dst, sizeof(src)) == 0);
+
+        while (!done)
+            pl_gpu_finish(gpu);
+        pl_gpu_flush(gpu);
+    }
+
+    pl_tex_destroy(gpu, &tex);
+}
+
 #define PBUFFER_WIDTH 640
 #define PBUFFER_HEIGHT 480
 
@@ -153,6 +231,7 @@ int main()
 
     printf("Initialized EGL v%d.%d\n", major, minor);
     int egl_ver = major * 10 + minor;
+    bool surfaceless = epoxy_has_egl_extension(dpy, "EGL_KHR_surfaceless_context");
 
     struct {
         EGLenum api;
@@ -182,6 +261,10 @@ int main()
 
     for (int i = 0; i < PL_ARRAY_SIZE(egl_vers); i++) {
 
+        // Alternate between testing with and without an upload context
+        bool want_upload = surfaceless && i % 2 == 0;
+        EGLContext upload = EGL_NO_CONTEXT;
+
         const int cfg_attribs[] = {
             EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
             EGL_RENDERABLE_TYPE, egl_vers[i].render,
@@ -208,6 +291,8 @@ int main()
 
             printf("Attempting creation of OpenGL ES v%d context\n", egl_vers[i].major);
             egl = eglCreateContext(dpy, config, EGL_NO_CONTEXT, egl_attribs);
+            if (egl && want_upload)
+                upload = eglCreateContext(dpy, config, egl, egl_attribs);
         } else {
             // Desktop OpenGL
             const int egl_attribs[] = {
@@ -221,6 +306,8 @@ int main()
             printf("Attempting creation of Desktop OpenGL v%d.%d context\n",
                    egl_vers[i].major, egl_vers[i].minor);
             egl = eglCreateContext(dpy, config, EGL_NO_CONTEXT, egl_attribs);
+            if (egl && want_upload)
+                upload = eglCreateContext(dpy, config, egl, egl_attribs);
         }
 
         if (!egl)
@@ -237,14 +324,27 @@ int main()
         if (!eglMakeCurrent(dpy, surf, surf, egl))
             goto error;
 
+        struct context_priv ctx = {
+            .display = dpy,
+            .surface = surf,
+            .main = egl,
+            .upload = upload,
+        };
+
         pl_opengl gl = pl_opengl_create(log, pl_opengl_params(
             .max_glsl_version = egl_vers[i].glsl_ver,
             .debug = true,
             .egl_display = dpy,
             .egl_context = egl,
+            .exclusive = i % 2,
 #ifdef CI_ALLOW_SW
             .allow_software = true,
 #endif
+            .make_current = upload ? make_current : NULL,
+            .release_current = upload ? release_current : NULL,
+            .make_current_upload = upload ? make_current_upload : NULL,
+            .release_current_upload = upload ? release_current : NULL,
+            .priv = &ctx,
         ));
         if (!gl)
             goto next;
@@ -266,6 +366,7 @@ int main()
         opengl_interop_tests(gpu);
         opengl_swapchain_tests(gl, dpy, surf);
         opengl_test_export_import(gl, PL_HANDLE_DMA_BUF);
+        opengl_upload_tests(gpu, &ctx);
 
         // Reduce log spam after first successful test
         pl_log_level_update(log, PL_LOG_INFO);
@@ -273,6 +374,8 @@ int main()
 next:
         pl_opengl_destroy(&gl);
         eglDestroySurface(dpy, surf);
+        if (upload)
+            eglDestroyContext(dpy, upload);
         eglDestroyContext(dpy, egl);
         continue;
 
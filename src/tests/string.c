@@ -96,6 +96,47 @@ int main()
     REQUIRE(!pl_str_parse_int(test, &i));
     REQUIRE(!pl_str_parse_int(empty, &i));
 
+    // Every prefix length and single-byte change should produce a distinct
+    // hash, regardless of the alignment of the input
+    uint8_t data[128], copy[129];
+    uint64_t hashes[129];
+    for (int n = 0; n < sizeof(data); n++)
+        data[n] = n * 37 + 11;
+    for (int n = 0; n <= sizeof(data); n++) {
+        hashes[n] = pl_mem_hash(data, n);
+        for (int m = 0; m < n; m++)
+            REQUIRE(hashes[m] != hashes[n]);
+    }
+    for (int n = 1; n <= sizeof(data); n++) {
+        memcpy(copy + 1, data, n);
+        REQUIRE(pl_mem_hash(copy + 1, n) == hashes[n]);
+        copy[n / 2 + 1] ^= 0x40;
+        REQUIRE(pl_mem_hash(copy + 1, n) != hashes[n]);
+    }
+
+    // Locale-invariant formatting, including repeated appends to grow the
+    // output buffer
+    pl_str fmt = {0};
+    char ref[256];
+    for (i = 0; i < 100; i++) {
+        pl_str_append_asprintf_c(tmp, &fmt, "%d,%u;%s%c%%%.*s|%lld %llu %zu_%x\n",
+                                 -i, i * 7u, "abc", 'x', 2, "yzw",
+                                 -((long long) i << 40), (unsigned long long) i << 50,
+                                 (size_t) i, i * 0x2aef1c3u);
+    }
+    size_t pos = 0;
+    for (i = 0; i < 100; i++) {
+        int len = snprintf(ref, sizeof(ref), "%d,%u;%s%c%%%.*s|%lld %llu %zu_%x\n",
+                           -i, i * 7u, "abc", 'x', 2, "yzw",
+                           -((long long) i << 40), (unsigned long long) i << 50,
+                           (size_t) i, i * 0x2aef1c3u);
+        REQUIRE(pos + len <= fmt.len);
+        REQUIRE(memcmp(fmt.buf + pos, ref, len) == 0);
+        pos += len;
+    }
+    REQUIRE(pos == fmt.len);
+    REQUIRE(fmt.buf[fmt.len] == '\0');
+
     pl_free(tmp);
     return 0;
 }
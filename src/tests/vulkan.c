@@ -104,6 +104,47 @@ static void vulkan_swapchain_tests(pl_vulkan vk, VkSurfaceKHR surf)
     pl_swapchain_destroy(&sw);
 }
 
+static void vulkan_defrag_tests(pl_gpu gpu)
+{
+    enum { NUM_BUFS = 64, BUF_SIZE = 16 * 1024 };
+    pl_buf bufs[NUM_BUFS] = {0};
+    uint8_t data[BUF_SIZE], out[BUF_SIZE];
+
+    for (int i = 0; i < NUM_BUFS; i++) {
+        memset(data, i, sizeof(data));
+        bufs[i] = pl_buf_create(gpu, pl_buf_params(
+            .size = BUF_SIZE,
+            .host_readable = true,
+            .initial_data = data,
+        ));
+        REQUIRE(bufs[i]);
+    }
+
+    // Leave behind sparsely used slabs
+    for (int i = 0; i < NUM_BUFS; i++) {
+        if (i % 4)
+            pl_buf_destroy(gpu, &bufs[i]);
+    }
+
+    pl_gpu_finish(gpu);
+    int num = pl_vulkan_defragment(gpu, pl_vulkan_defrag_params(
+        .threshold = 1.0f,
+        .time_budget = UINT64_MAX / 2,
+    ));
+    REQUIRE(num >= 0);
+    printf("Migrated %d buffers\n", num);
+
+    // Contents must survive migration
+    for (int i = 0; i < NUM_BUFS; i += 4) {
+        memset(data, i, sizeof(data));
+        REQUIRE(pl_buf_read(gpu, bufs[i], 0, out, sizeof(out)));
+        REQUIRE(memcmp(data, out, sizeof(out)) == 0);
+        pl_buf_destroy(gpu, &bufs[i]);
+    }
+
+    pl_gpu_finish(gpu);
+}
+
 int main()
 {
     pl_log log = pl_test_logger();
@@ -193,10 +234,19 @@ int main()
 
         gpu_shader_tests(vk->gpu);
         vulkan_swapchain_tests(vk, surf);
+        vulkan_defrag_tests(vk->gpu);
 
         // Print heap statistics
         pl_vk_print_heap(vk->gpu, PL_LOG_DEBUG);
 
+        struct pl_vulkan_heap_stats heaps[VK_MAX_MEMORY_HEAPS];
+        int num_heaps = pl_vulkan_heap_stats(vk->gpu, heaps);
+        REQUIRE(num_heaps > 0);
+        for (int h = 0; h < num_heaps; h++) {
+            REQUIRE(heaps[h].budget);
+            REQUIRE(heaps[h].allocated <= heaps[h].size);
+        }
+
         // Test importing this context via the vulkan interop API
         pl_vulkan vk2 = pl_vulkan_import(log, pl_vulkan_import_params(
             .instance = vk->instance,
@@ -212,6 +262,16 @@ int main()
             .queue_transfer = vk->queue_transfer,
         ));
         REQUIRE(vk2);
+
+        // Round-trip the pipeline cache populated by the shader tests
+        size_t cache_size = pl_vulkan_save_pipeline_cache(vk->gpu, NULL, 0);
+        REQUIRE(cache_size);
+        uint8_t *cache = malloc(cache_size);
+        REQUIRE(cache);
+        cache_size = pl_vulkan_save_pipeline_cache(vk->gpu, cache, cache_size);
+        REQUIRE(cache_size);
+        pl_vulkan_load_pipeline_cache(vk2->gpu, cache, cache_size);
+        free(cache);
         pl_vulkan_destroy(&vk2);
 
         // Run these tests last because they disable some validation layers
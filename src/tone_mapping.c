@@ -219,18 +219,28 @@ static inline float rescale_out(float x, const struct pl_tone_map_params *params
     return x * (params->output_max - params->output_min) + params->output_min;
 }
 
-static inline float bt1886_eotf(float x, float min, float max)
+// BT.1886 curve for a given black/white point. The roots of both are
+// precomputed, since pow() dominates the cost of generating the LUT
+struct bt1886 {
+    float lb, lw;
+};
+
+static inline struct bt1886 bt1886_init(float min, float max)
+{
+    return (struct bt1886) {
+        .lb = powf(min, 1/2.4f),
+        .lw = powf(max, 1/2.4f),
+    };
+}
+
+static inline float bt1886_eotf(float x, struct bt1886 c)
 {
-    const float lb = powf(min, 1/2.4f);
-    const float lw = powf(max, 1/2.4f);
-    return powf((lw - lb) * x + lb, 2.4f);
+    return powf((c.lw - c.lb) * x + c.lb, 2.4f);
 }
 
-static inline float bt1886_oetf(float x, float min, float max)
+static inline float bt1886_oetf(float x, struct bt1886 c)
 {
-    const float lb = powf(min, 1/2.4f);
-    const float lw = powf(max, 1/2.4f);
-    return (powf(x, 1/2.4f) - lb) / (lw - lb);
+    return (powf(x, 1/2.4f) - c.lb) / (c.lw - c.lb);
 }
 
 const struct pl_tone_map_function pl_tone_map_auto = {
@@ -299,10 +309,12 @@ static void bt2446a(float *lut, const struct pl_tone_map_params *params)
 {
     const float phdr = 1 + 32 * powf(params->input_max / 10000, 1/2.4f);
     const float psdr = 1 + 32 * powf(params->output_max / 10000, 1/2.4f);
+    const float log_phdr = logf(phdr);
+    const struct bt1886 out = bt1886_init(params->output_min, params->output_max);
 
     FOREACH_LUT(lut, x) {
         x = powf(rescale_in(x, params), 1/2.4f);
-        x = logf(1 + (phdr - 1) * x) / logf(phdr);
+        x = logf(1 + (phdr - 1) * x) / log_phdr;
 
         if (x <= 0.7399f) {
             x = 1.0770f * x;
@@ -313,14 +325,16 @@ static void bt2446a(float *lut, const struct pl_tone_map_params *params)
         }
 
         x = (powf(psdr, x) - 1) / (psdr - 1);
-        x = bt1886_eotf(x, params->output_min, params->output_max);
+        x = bt1886_eotf(x, out);
     }
 }
 
 static void bt2446a_inv(float *lut, const struct pl_tone_map_params *params)
 {
+    const struct bt1886 in = bt1886_init(params->input_min, params->input_max);
+
     FOREACH_LUT(lut, x) {
-        x = bt1886_oetf(x, params->input_min, params->input_max);
+        x = bt1886_oetf(x, in);
         x *= 255.0;
         if (x > 70) {
             x = powf(x, (2.8305e-6f * x - 7.4622e-4f) * x + 1.2528f);
@@ -448,12 +462,17 @@ static void hable_map(float *lut, const struct pl_tone_map_params *params)
     const float peak = params->input_max / params->output_max,
                 scale = 1.0f / hable(peak);
 
+    const struct bt1886 in = bt1886_init(params->input_min, params->input_max);
+    const struct bt1886 mid = bt1886_init(0, peak);
+    const struct bt1886 unit = { .lb = 0, .lw = 1 };
+    const struct bt1886 out = bt1886_init(params->output_min, params->output_max);
+
     FOREACH_LUT(lut, x) {
-        x = bt1886_oetf(x, params->input_min, params->input_max);
-        x = bt1886_eotf(x, 0, peak);
+        x = bt1886_oetf(x, in);
+        x = bt1886_eotf(x, mid);
         x = scale * hable(x);
-        x = bt1886_oetf(x, 0, 1);
-        x = bt1886_eotf(x, params->output_min, params->output_max);
+        x = bt1886_oetf(x, unit);
+        x = bt1886_eotf(x, out);
     }
 }
 
@@ -0,0 +1,153 @@
+/*
+ * This file is part of libplacebo.
+ *
+ * libplacebo is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * libplacebo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with libplacebo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "common.h"
+#include "log.h"
+
+#include <libplacebo/utils/export_ring.h>
+
+#define DEFAULT_TARGETS 3
+
+enum target_state {
+    TARGET_FREE,
+    TARGET_ACQUIRED, // handed out for rendering
+    TARGET_EXPORTED, // held by the consumer
+};
+
+struct target {
+    pl_tex tex;
+    pl_sync sync;
+    enum target_state state;
+};
+
+struct pl_export_ring {
+    pl_gpu gpu;
+    PL_ARRAY(struct target) targets;
+    int next; // index to start searching for free targets at
+};
+
+pl_export_ring pl_export_ring_create(pl_gpu gpu, const struct pl_export_ring_params *params)
+{
+    pl_fmt fmt = params->format;
+    enum pl_handle_type tex_handle = PL_DEF(params->tex_handle, PL_HANDLE_DMA_BUF);
+    enum pl_handle_type sync_handle = PL_DEF(params->sync_handle, PL_HANDLE_FD);
+    if (!fmt || !(fmt->caps & PL_FMT_CAP_RENDERABLE)) {
+        PL_ERR(gpu, "Export ring requires a renderable format!");
+        return NULL;
+    }
+
+    if (!(gpu->export_caps.tex & tex_handle) ||
+        !(gpu->export_caps.sync & sync_handle))
+    {
+        PL_ERR(gpu, "Export ring handle types (tex 0x%x, sync 0x%x) not "
+               "supported by this GPU!", (unsigned) tex_handle,
+               (unsigned) sync_handle);
+        return NULL;
+    }
+
+    pl_export_ring ring = pl_zalloc_ptr(NULL, ring);
+    ring->gpu = gpu;
+
+    const int num = PL_DEF(params->num_targets, DEFAULT_TARGETS);
+    for (int i = 0; i < num; i++) {
+        struct target tgt = {
+            .tex = pl_tex_create(gpu, pl_tex_params(
+                .w              = params->w,
+                .h              = params->h,
+                .format         = fmt,
+                .renderable     = true,
+                .storable       = fmt->caps & PL_FMT_CAP_STORABLE,
+                .blit_dst       = fmt->caps & PL_FMT_CAP_BLITTABLE,
+                .export_handle  = tex_handle,
+            )),
+            .sync = pl_sync_create(gpu, sync_handle),
+        };
+
+        PL_ARRAY_APPEND(ring, ring->targets, tgt);
+        if (!tgt.tex || !tgt.sync) {
+            PL_ERR(gpu, "Failed creating exportable render target %d!", i);
+            pl_export_ring_destroy(&ring);
+            return NULL;
+        }
+    }
+
+    return ring;
+}
+
+void pl_export_ring_destroy(pl_export_ring *pring)
+{
+    pl_export_ring ring = *pring;
+    if (!ring)
+        return;
+
+    for (int i = 0; i < ring->targets.num; i++) {
+        struct target *tgt = &ring->targets.elem[i];
+        pl_tex_destroy(ring->gpu, &tgt->tex);
+        pl_sync_destroy(ring->gpu, &tgt->sync);
+    }
+
+    pl_free_ptr(pring);
+}
+
+bool pl_export_ring_acquire(pl_export_ring ring, struct pl_export_frame *frame)
+{
+    const int num = ring->targets.num;
+    for (int n = 0; n < num; n++) {
+        int idx = (ring->next + n) % num;
+        struct target *tgt = &ring->targets.elem[idx];
+        if (tgt->state != TARGET_FREE)
+            continue;
+
+        tgt->state = TARGET_ACQUIRED;
+        ring->next = (idx + 1) % num;
+        *frame = (struct pl_export_frame) {
+            .tex    = tgt->tex,
+            .mem    = &tgt->tex->shared_mem,
+            .sync   = tgt->sync,
+            .index  = idx,
+        };
+        return true;
+    }
+
+    PL_TRACE(ring->gpu, "All %d export ring targets are in use", num);
+    return false;
+}
+
+bool pl_export_ring_submit(pl_export_ring ring, struct pl_export_frame *frame)
+{
+    pl_assert(frame->index >= 0 && frame->index < ring->targets.num);
+    struct target *tgt = &ring->targets.elem[frame->index];
+    pl_assert(tgt->state == TARGET_ACQUIRED);
+
+    if (!pl_tex_export(ring->gpu, tgt->tex, tgt->sync)) {
+        PL_ERR(ring->gpu, "Failed exporting render target %d!", frame->index);
+        tgt->state = TARGET_FREE;
+        return false;
+    }
+
+    pl_gpu_flush(ring->gpu);
+    tgt->state = TARGET_EXPORTED;
+    return true;
+}
+
+void pl_export_ring_release(pl_export_ring ring, struct pl_export_frame *frame)
+{
+    pl_assert(frame->index >= 0 && frame->index < ring->targets.num);
+    struct target *tgt = &ring->targets.elem[frame->index];
+    pl_assert(tgt->state != TARGET_FREE);
+    tgt->state = TARGET_FREE;
+}
@@ -0,0 +1,408 @@
+/*
+ * This file is part of libplacebo.
+ *
+ * libplacebo is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * libplacebo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with libplacebo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "common.h"
+#include "log.h"
+#include "pl_clock.h"
+
+#include <libplacebo/utils/filter_pipeline.h>
+
+#define DEFAULT_QUEUE_SIZE 4
+
+enum entry_state {
+    ENTRY_FREE,
+    ENTRY_QUEUED, // pushed, still being processed
+    ENTRY_PULLED, // held by the user
+};
+
+// Each entry owns an independent set of GPU resources, so that frames in
+// flight have no dependencies on each other
+struct entry {
+    enum entry_state state;
+    pl_tex tex_in[PL_MAX_PLANES];
+    pl_tex tex_out[PL_MAX_PLANES];
+    pl_timer upload_timer;
+    pl_timer download_timer;
+    pl_buf buf;     // host-mapped download buffer
+    void *host;     // fallback, if mapped buffers are unavailable
+    struct pl_filter_image image;
+    void *priv;
+    uint64_t pushed;
+};
+
+struct timing {
+    int count;
+    uint64_t last, sum, peak;
+};
+
+struct pl_filter_pipeline {
+    pl_gpu gpu;
+    pl_renderer rr;
+    const struct pl_render_params *render_params;
+
+    struct entry *entries;
+    int num_entries;
+    int idx_in;  // next entry to push into
+    int idx_out; // oldest entry still queued
+    int queued;
+
+    struct timing cpu[PL_FILTER_STAGE_COUNT];
+    struct timing gpu_time[PL_FILTER_STAGE_COUNT];
+    struct timing latency;
+};
+
+static void timing_add(struct timing *t, uint64_t sample)
+{
+    t->count++;
+    t->last = sample;
+    t->sum += sample;
+    t->peak = PL_MAX(t->peak, sample);
+}
+
+static struct pl_filter_timing timing_get(const struct timing *t)
+{
+    return (struct pl_filter_timing) {
+        .count  = t->count,
+        .last   = t->last,
+        .mean   = t->count ? t->sum / t->count : 0,
+        .peak   = t->peak,
+    };
+}
+
+pl_filter_pipeline pl_filter_pipeline_create(pl_gpu gpu,
+                                             const struct pl_filter_pipeline_params *params)
+{
+    if (!params->renderer) {
+        PL_ERR(gpu, "Filter pipeline requires a renderer!");
+        return NULL;
+    }
+
+    pl_filter_pipeline pipe = pl_zalloc_ptr(NULL, pipe);
+    pipe->gpu = gpu;
+    pipe->rr = params->renderer;
+    pipe->render_params = params->render_params;
+    pipe->num_entries = PL_DEF(params->queue_size, DEFAULT_QUEUE_SIZE);
+    pipe->entries = pl_calloc_ptr(pipe, pipe->num_entries, pipe->entries);
+    for (int i = 0; i < pipe->num_entries; i++) {
+        pipe->entries[i].upload_timer = pl_timer_create(gpu);
+        pipe->entries[i].download_timer = pl_timer_create(gpu);
+    }
+
+    return pipe;
+}
+
+void pl_filter_pipeline_destroy(pl_filter_pipeline *ppipe)
+{
+    pl_filter_pipeline pipe = *ppipe;
+    if (!pipe)
+        return;
+
+    for (int i = 0; i < pipe->num_entries; i++) {
+        struct entry *e = &pipe->entries[i];
+        for (int n = 0; n < PL_MAX_PLANES; n++) {
+            pl_tex_destroy(pipe->gpu, &e->tex_in[n]);
+            pl_tex_destroy(pipe->gpu, &e->tex_out[n]);
+        }
+        pl_timer_destroy(pipe->gpu, &e->upload_timer);
+        pl_timer_destroy(pipe->gpu, &e->download_timer);
+        pl_buf_destroy(pipe->gpu, &e->buf);
+    }
+
+    pl_free_ptr(ppipe);
+}
+
+static void setup_plane(struct pl_plane *plane, pl_tex tex, const int map[4])
+{
+    *plane = (struct pl_plane) { .texture = tex };
+    for (int i = 0; i < 4; i++) {
+        plane->component_mapping[i] = map[i];
+        if (map[i] >= 0)
+            plane->components = i+1;
+    }
+}
+
+static bool upload_src(pl_filter_pipeline pipe, struct entry *e,
+                       const struct pl_filter_image *src, struct pl_frame *image)
+{
+    pl_gpu gpu = pipe->gpu;
+    for (int i = 0; i < src->num_planes; i++) {
+        const struct pl_plane_data *data = &src->planes[i];
+        pl_assert(!data->buf ^ !data->pixels); // exactly one
+
+        int map[4];
+        pl_fmt fmt = pl_plane_find_fmt(gpu, map, data);
+        if (!fmt) {
+            PL_ERR(gpu, "Failed picking any compatible texture format for "
+                   "input plane %d!", i);
+            return false;
+        }
+
+        bool ok = pl_tex_recreate(gpu, &e->tex_in[i], pl_tex_params(
+            .w          = data->width,
+            .h          = data->height,
+            .format     = fmt,
+            .sampleable = true,
+            .host_writable = true,
+            .blit_src   = fmt->caps & PL_FMT_CAP_BLITTABLE,
+        ));
+        if (!ok) {
+            PL_ERR(gpu, "Failed initializing input plane texture!");
+            return false;
+        }
+
+        // Not using `pl_upload_plane` here, so we can attach our timer
+        ok = pl_tex_upload(gpu, pl_tex_transfer_params(
+            .tex        = e->tex_in[i],
+            .row_pitch  = data->row_stride,
+            .ptr        = (void *) data->pixels,
+            .buf        = data->buf,
+            .buf_offset = data->buf_offset,
+            .timer      = e->upload_timer,
+        ));
+        if (!ok)
+            return false;
+
+        setup_plane(&image->planes[i], e->tex_in[i], map);
+    }
+
+    return true;
+}
+
+static bool create_dst(pl_filter_pipeline pipe, struct entry *e,
+                       const struct pl_filter_image *dst, struct pl_frame *target)
+{
+    pl_gpu gpu = pipe->gpu;
+    for (int i = 0; i < dst->num_planes; i++) {
+        const struct pl_plane_data *data = &dst->planes[i];
+        struct pl_plane_data tmp = *data;
+        tmp.pixels = NULL;
+        tmp.buf = NULL;
+
+        if (!pl_recreate_plane(gpu, &target->planes[i], &e->tex_out[i], &tmp))
+            return false;
+
+        if (!e->tex_out[i]->params.host_readable) {
+            PL_ERR(gpu, "Output plane %d format '%s' is not host readable!",
+                   i, e->tex_out[i]->params.format->name);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool download_dst(pl_filter_pipeline pipe, struct entry *e,
+                         const struct pl_filter_image *dst)
+{
+    pl_gpu gpu = pipe->gpu;
+    size_t offset[PL_MAX_PLANES], stride[PL_MAX_PLANES], total_size = 0;
+    for (int i = 0; i < dst->num_planes; i++) {
+        pl_tex tex = e->tex_out[i];
+        pl_fmt fmt = tex->params.format;
+
+        // Align the stride and offset to the GPU's preferred values, for
+        // the fastest possible transfers
+        size_t min_stride = tex->params.w * fmt->texel_size;
+        stride[i] = PL_DEF(dst->planes[i].row_stride, min_stride);
+        stride[i] = PL_ALIGN(PL_MAX(stride[i], min_stride),
+                             pl_lcm(fmt->texel_align, gpu->limits.align_tex_xfer_pitch));
+        size_t align = pl_lcm(pl_lcm(fmt->texel_size, 4),
+                              gpu->limits.align_tex_xfer_offset);
+        offset[i] = PL_ALIGN(total_size, align);
+        total_size = offset[i] + stride[i] * tex->params.h;
+    }
+
+    uint8_t *base;
+    bool mapped = gpu->limits.buf_transfer && total_size <= gpu->limits.max_mapped_size;
+    if (mapped) {
+        bool ok = pl_buf_recreate(gpu, &e->buf, pl_buf_params(
+            .size           = total_size,
+            .host_mapped    = true,
+            .debug_tag      = PL_DEBUG_TAG,
+        ));
+        if (!ok) {
+            PL_ERR(gpu, "Failed creating download buffer!");
+            return false;
+        }
+        base = e->buf->data;
+    } else {
+        // Fall back to synchronous downloads into host memory
+        pl_buf_destroy(gpu, &e->buf);
+        e->host = pl_realloc(pipe, e->host, total_size);
+        base = e->host;
+    }
+
+    e->image = *dst;
+    for (int i = 0; i < dst->num_planes; i++) {
+        bool ok = pl_tex_download(gpu, pl_tex_transfer_params(
+            .tex        = e->tex_out[i],
+            .row_pitch  = stride[i],
+            .ptr        = mapped ? NULL : base + offset[i],
+            .buf        = mapped ? e->buf : NULL,
+            .buf_offset = offset[i],
+            .timer      = e->download_timer,
+        ));
+        if (!ok)
+            return false;
+
+        struct pl_plane_data *plane = &e->image.planes[i];
+        plane->pixels = base + offset[i];
+        plane->row_stride = stride[i];
+        plane->buf = NULL;
+        plane->buf_offset = 0;
+        plane->callback = NULL;
+        plane->priv = NULL;
+    }
+
+    return true;
+}
+
+bool pl_filter_pipeline_push(pl_filter_pipeline pipe,
+                             const struct pl_filter_image *src,
+                             const struct pl_filter_image *dst,
+                             void *priv)
+{
+    struct entry *e = &pipe->entries[pipe->idx_in];
+    if (e->state != ENTRY_FREE) {
+        PL_TRACE(pipe->gpu, "All %d filter pipeline entries are in use",
+                 pipe->num_entries);
+        return false;
+    }
+
+    pl_assert(src->num_planes > 0 && src->num_planes <= PL_MAX_PLANES);
+    pl_assert(dst->num_planes > 0 && dst->num_planes <= PL_MAX_PLANES);
+
+    struct pl_frame image = {
+        .num_planes = src->num_planes,
+        .repr       = src->repr,
+        .color      = src->color,
+    };
+
+    struct pl_frame target = {
+        .num_planes = dst->num_planes,
+        .repr       = dst->repr,
+        .color      = dst->color,
+    };
+
+    uint64_t start = pl_clock_now(), now;
+    if (!upload_src(pipe, e, src, &image))
+        goto error;
+
+    now = pl_clock_now();
+    timing_add(&pipe->cpu[PL_FILTER_STAGE_UPLOAD], now - start);
+    start = now;
+
+    if (!create_dst(pipe, e, dst, &target))
+        goto error;
+    if (!pl_render_image(pipe->rr, &image, &target, pipe->render_params))
+        goto error;
+
+    now = pl_clock_now();
+    timing_add(&pipe->cpu[PL_FILTER_STAGE_RENDER], now - start);
+    start = now;
+
+    if (!download_dst(pipe, e, dst))
+        goto error;
+
+    // Make sure this frame starts processing in the background, so we can
+    // move on to the next one
+    pl_gpu_flush(pipe->gpu);
+    now = pl_clock_now();
+    timing_add(&pipe->cpu[PL_FILTER_STAGE_DOWNLOAD], now - start);
+
+    e->state = ENTRY_QUEUED;
+    e->priv = priv;
+    e->pushed = now;
+    pipe->idx_in = (pipe->idx_in + 1) % pipe->num_entries;
+    pipe->queued++;
+    return true;
+
+error:
+    PL_ERR(pipe->gpu, "Failed processing frame in filter pipeline!");
+    return false;
+}
+
+static void query_timer(pl_gpu gpu, pl_timer timer, struct timing *t)
+{
+    // Sum up the results of all planes that used this timer
+    uint64_t ts, sum = 0;
+    while ((ts = pl_timer_query(gpu, timer)))
+        sum += ts;
+    if (sum)
+        timing_add(t, sum);
+}
+
+bool pl_filter_pipeline_pull(pl_filter_pipeline pipe, struct pl_filter_output *out,
+                             uint64_t timeout)
+{
+    if (!pipe->queued)
+        return false;
+
+    struct entry *e = &pipe->entries[pipe->idx_out];
+    pl_assert(e->state == ENTRY_QUEUED);
+    if (e->buf && pl_buf_poll(pipe->gpu, e->buf, timeout))
+        return false;
+
+    query_timer(pipe->gpu, e->upload_timer, &pipe->gpu_time[PL_FILTER_STAGE_UPLOAD]);
+    query_timer(pipe->gpu, e->download_timer, &pipe->gpu_time[PL_FILTER_STAGE_DOWNLOAD]);
+    timing_add(&pipe->latency, pl_clock_now() - e->pushed);
+
+    e->state = ENTRY_PULLED;
+    *out = (struct pl_filter_output) {
+        .image  = e->image,
+        .priv   = e->priv,
+        .index  = pipe->idx_out,
+    };
+
+    pipe->idx_out = (pipe->idx_out + 1) % pipe->num_entries;
+    pipe->queued--;
+    return true;
+}
+
+void pl_filter_pipeline_release(pl_filter_pipeline pipe, struct pl_filter_output *out)
+{
+    pl_assert(out->index >= 0 && out->index < pipe->num_entries);
+    struct entry *e = &pipe->entries[out->index];
+    pl_assert(e->state == ENTRY_PULLED);
+    e->state = ENTRY_FREE;
+}
+
+int pl_filter_pipeline_queued(pl_filter_pipeline pipe)
+{
+    return pipe->queued;
+}
+
+struct pl_filter_pipeline_stats pl_filter_pipeline_get_stats(pl_filter_pipeline pipe)
+{
+    struct pl_filter_pipeline_stats stats = {
+        .latency = timing_get(&pipe->latency),
+    };
+
+    for (int i = 0; i < PL_FILTER_STAGE_COUNT; i++) {
+        stats.stages[i].cpu = timing_get(&pipe->cpu[i]);
+        stats.stages[i].gpu = timing_get(&pipe->gpu_time[i]);
+    }
+
+    return stats;
+}
+
+void pl_filter_pipeline_reset_stats(pl_filter_pipeline pipe)
+{
+    memset(pipe->cpu, 0, sizeof(pipe->cpu));
+    memset(pipe->gpu_time, 0, sizeof(pipe->gpu_time));
+    pipe->latency = (struct timing) {0};
+}
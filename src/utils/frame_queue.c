@@ -16,6 +16,7 @@
  */
 
 #include <errno.h>
+#include <limits.h>
 #include <math.h>
 
 #include "common.h"
@@ -26,12 +27,23 @@ struct cache_entry {
     pl_tex tex[4];
 };
 
+// Expected shape of a plane texture, as derived from `pl_source_frame.planes`
+struct tex_shape {
+    pl_fmt fmt;
+    int w, h;
+};
+
 struct entry {
     struct cache_entry cache;
+    struct tex_shape shapes[4];
+    int num_shapes;
     struct pl_source_frame src;
     struct pl_frame frame;
     uint64_t signature;
+    size_t size; // measured size once mapped
+    bool shown;  // was part of a returned frame mix
     bool mapped;
+    bool mapping; // being mapped by `pl_queue_prefetch`
     bool ok;
 };
 
@@ -50,6 +62,9 @@ struct entry {
 // Maximum number of not-yet-mapped frames to allow queueing in advance
 #define PREFETCH_FRAMES 2
 
+// Size of the lock-free push ring for SPSC queues (must be a power of two)
+#define RING_SIZE 16
+
 struct pool {
     float samples[MAX_SAMPLES];
     float estimate;
@@ -59,6 +74,66 @@ struct pool {
     int total;
 };
 
+// Lock-free single-producer/single-consumer ring of pushed frames. The
+// producer only ever writes `head`, and the consumer (i.e. whoever holds
+// `lock_weak`) only ever writes `tail`.
+struct ring {
+    struct ring_entry {
+        struct pl_source_frame src; // with `planes` already resolved
+        struct tex_shape shapes[4];
+        int num_shapes;
+        bool eof;
+    } elem[RING_SIZE];
+    atomic_uint head;
+    atomic_uint tail;
+    atomic_int room;        // frames that can be pushed without blocking
+    atomic_bool waiting;    // consumer is blocked waiting for a frame
+};
+
+// Statistics exported by `pl_queue_get_stats`. These are only written with
+// `lock_weak` held, but may be read at any time without locking.
+struct stats {
+    atomic_int num_frames;
+    atomic_int num_mapped;
+    atomic_size_t resident_bytes;
+    atomic_size_t pending_bytes;
+    atomic_uint_least64_t frame_duration; // in nanoseconds
+    atomic_uint_least64_t vsync_duration; // in nanoseconds
+    atomic_uint_least64_t vsync_interval; // in nanoseconds
+    atomic_uint_least64_t vsync_jitter;   // in nanoseconds
+    atomic_uint_least64_t frames_dropped;
+    atomic_uint_least64_t frames_repeated;
+    atomic_uint_least64_t stalls;
+};
+
+// Per-consumer state. Each consumer advances through the shared queue
+// independently, and frames are only culled once all consumers are done
+// with them.
+struct pl_queue_consumer {
+    bool active;    // has called `pl_queue_update` at least once
+    bool done;      // has consumed the last frame after EOF
+    float cull_pts; // PTS of the oldest frame still needed, roughly
+    float radius;   // effective radius, as of the last `pl_queue_update`
+    int threshold_frames;
+    uint64_t last_shown; // signature of the last frame shown, plus one
+
+    // Average vsync fps estimation state
+    struct pool vps;
+
+    // Effective support of the last used frame mixer
+    struct pl_filter_config mixer;
+    float mixer_threshold;
+    float mixer_support;
+    float reported_vps;
+    float reported_fps;
+    float prev_pts;
+
+    // Storage for temporary arrays
+    PL_ARRAY(uint64_t) tmp_sig;
+    PL_ARRAY(float) tmp_ts;
+    PL_ARRAY(const struct pl_frame *) tmp_frame;
+};
+
 struct pl_queue {
     pl_gpu gpu;
     pl_log log;
@@ -78,23 +153,34 @@ struct pl_queue {
     // Frame queue and state
     PL_ARRAY(struct entry *) queue;
     uint64_t signature;
-    int threshold_frames;
     bool want_frame;
     bool eof;
+    float cfr_duration; // exact frame duration, or 0 if not known to be CFR
+    int num_prefetching;
 
-    // Average vsync/frame fps estimation state
-    struct pool vps, fps;
-    float reported_vps;
-    float reported_fps;
-    float prev_pts;
+    // Memory budget state
+    size_t memory_budget; // as of the last `pl_queue_update`
+    size_t frame_size;    // size of the most recently mapped frame
 
-    // Storage for temporary arrays
-    PL_ARRAY(uint64_t) tmp_sig;
-    PL_ARRAY(float) tmp_ts;
-    PL_ARRAY(const struct pl_frame *) tmp_frame;
+    // Statistics state. Allocated separately so that `pl_queue_reset` can
+    // clear it without racing against concurrent `pl_queue_get_stats`.
+    struct stats *stats;
+
+    // Average frame fps estimation state
+    struct pool fps;
+
+    // All consumers, including the default consumer used by `pl_queue_update`
+    // calls that don't specify one. Allocated separately so that they
+    // survive `pl_queue_reset`.
+    PL_ARRAY(pl_queue_consumer) consumers;
+    pl_queue_consumer def;
 
     // Queue of GPU objects to reuse
     PL_ARRAY(struct cache_entry) cache;
+
+    // Push ring, only present for `pl_queue_create_spsc`. Allocated
+    // separately so that it survives `pl_queue_reset`.
+    struct ring *ring;
 };
 
 pl_queue pl_queue_create(pl_gpu gpu)
@@ -105,12 +191,104 @@ pl_queue pl_queue_create(pl_gpu gpu)
         .log = gpu->log,
     };
 
+    p->stats = pl_zalloc_ptr(p, p->stats);
+    p->def = pl_zalloc_ptr(p, p->def);
+    PL_ARRAY_APPEND(p, p->consumers, p->def);
+
     pl_mutex_init(&p->lock_strong);
     pl_mutex_init(&p->lock_weak);
     PL_CHECK_ERR(pl_cond_init(&p->wakeup));
     return p;
 }
 
+pl_queue pl_queue_create_spsc(pl_gpu gpu)
+{
+    pl_queue p = pl_queue_create(gpu);
+    p->ring = pl_zalloc_ptr(p, p->ring);
+    atomic_init(&p->ring->head, 0);
+    atomic_init(&p->ring->tail, 0);
+    atomic_init(&p->ring->room, PREFETCH_FRAMES);
+    atomic_init(&p->ring->waiting, false);
+    return p;
+}
+
+static void queue_push(pl_queue p, const struct pl_source_frame *src,
+                       const struct tex_shape *shapes, int num_shapes);
+static void publish_residency(pl_queue p);
+static void update_room(pl_queue p);
+
+// Move all frames pushed into the ring so far into the queue proper. Must be
+// called with `lock_weak` held.
+static void drain_ring(pl_queue p)
+{
+    struct ring *ring = p->ring;
+    if (!ring)
+        return;
+
+    unsigned tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    unsigned head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    if (tail == head)
+        return;
+
+    for (; tail != head; tail++) {
+        const struct ring_entry *e = &ring->elem[tail % RING_SIZE];
+        queue_push(p, e->eof ? NULL : &e->src, e->shapes, e->num_shapes);
+    }
+
+    atomic_store_explicit(&ring->tail, tail, memory_order_release);
+    publish_residency(p);
+    update_room(p);
+}
+
+// Resolves the texture shapes of `src->planes`, which is only valid for the
+// duration of the push. Returns the number of shapes written to `shapes`.
+static int resolve_shapes(pl_queue p, const struct pl_source_frame *src,
+                          struct tex_shape shapes[4])
+{
+    int num_shapes = PL_MIN(src->num_planes, 4);
+    for (int i = 0; i < num_shapes; i++) {
+        const struct pl_plane_data *data = &src->planes[i];
+        shapes[i] = (struct tex_shape) {
+            .fmt = pl_plane_find_fmt(p->gpu, NULL, data),
+            .w = data->width,
+            .h = data->height,
+        };
+    }
+
+    return num_shapes;
+}
+
+// Returns false if the ring is full
+static bool ring_push(pl_queue p, const struct pl_source_frame *src)
+{
+    struct ring *ring = p->ring;
+    unsigned head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    unsigned tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    if (head - tail >= RING_SIZE)
+        return false;
+
+    struct ring_entry *e = &ring->elem[head % RING_SIZE];
+    e->eof = !src;
+    if (src) {
+        e->src = *src;
+        e->num_shapes = resolve_shapes(p, src, e->shapes);
+        e->src.planes = NULL;
+        e->src.num_planes = 0;
+    }
+
+    // Both this store and the load of `waiting` are sequentially consistent,
+    // pairing with the consumer setting `waiting` before draining, so that
+    // at least one side is guaranteed to observe the other
+    atomic_store(&ring->head, head + 1);
+    if (atomic_load(&ring->waiting)) {
+        pl_mutex_lock(&p->lock_weak);
+        pl_cond_broadcast(&p->wakeup);
+        pl_mutex_unlock(&p->lock_weak);
+    }
+
+    return true;
+}
+
 static inline void unmap_frame(pl_queue p, struct entry *entry)
 {
     if (!entry->mapped && entry->src.discard) {
@@ -133,6 +311,7 @@ void pl_queue_destroy(pl_queue *queue)
     if (!p)
         return;
 
+    drain_ring(p);
     for (int n = 0; n < p->queue.num; n++) {
         struct entry *entry = p->queue.elem[n];
         unmap_frame(p, entry);
@@ -154,6 +333,11 @@ void pl_queue_destroy(pl_queue *queue)
 
 static inline void cull_entry(pl_queue p, struct entry *entry)
 {
+    // Wait for all in-flight prefetches, since `pl_queue_prefetch` may
+    // otherwise observe the queue while we're in the middle of culling it
+    while (p->num_prefetching)
+        pl_cond_wait(&p->wakeup, &p->lock_weak);
+
     unmap_frame(p, entry);
 
     // Recycle non-empty texture cache entries
@@ -169,14 +353,37 @@ static inline void cull_entry(pl_queue p, struct entry *entry)
     pl_free(entry);
 }
 
+static void reset_consumer(pl_queue_consumer c)
+{
+    *c = (struct pl_queue_consumer) {
+        .tmp_sig.elem = c->tmp_sig.elem,
+        .tmp_ts.elem = c->tmp_ts.elem,
+        .tmp_frame.elem = c->tmp_frame.elem,
+    };
+}
+
 void pl_queue_reset(pl_queue p)
 {
     pl_mutex_lock(&p->lock_strong);
     pl_mutex_lock(&p->lock_weak);
 
+    drain_ring(p);
     for (int i = 0; i < p->queue.num; i++)
         cull_entry(p, p->queue.elem[i]);
 
+    struct stats *stats = p->stats;
+    atomic_store(&stats->num_frames, 0);
+    atomic_store(&stats->num_mapped, 0);
+    atomic_store(&stats->resident_bytes, 0);
+    atomic_store(&stats->pending_bytes, 0);
+    atomic_store(&stats->frame_duration, 0);
+    atomic_store(&stats->vsync_duration, 0);
+    atomic_store(&stats->vsync_interval, 0);
+    atomic_store(&stats->vsync_jitter, 0);
+    atomic_store(&stats->frames_dropped, 0);
+    atomic_store(&stats->frames_repeated, 0);
+    atomic_store(&stats->stalls, 0);
+
     *p = (struct pl_queue) {
         .gpu = p->gpu,
         .log = p->log,
@@ -188,17 +395,54 @@ void pl_queue_reset(pl_queue p)
 
         // Explicitly preserve allocations
         .queue.elem = p->queue.elem,
-        .tmp_sig.elem = p->tmp_sig.elem,
-        .tmp_ts.elem = p->tmp_ts.elem,
-        .tmp_frame.elem = p->tmp_frame.elem,
 
         // Reuse GPU object cache entirely
         .cache = p->cache,
+        .ring = p->ring,
+        .stats = p->stats,
+        .consumers = p->consumers,
+        .def = p->def,
     };
 
-    pl_cond_signal(&p->wakeup);
+    for (int i = 0; i < p->consumers.num; i++)
+        reset_consumer(p->consumers.elem[i]);
+
+    update_room(p);
+    pl_cond_broadcast(&p->wakeup);
+    pl_mutex_unlock(&p->lock_weak);
+    pl_mutex_unlock(&p->lock_strong);
+}
+
+pl_queue_consumer pl_queue_consumer_create(pl_queue p)
+{
+    pl_queue_consumer c = pl_zalloc_ptr(p, c);
+    pl_mutex_lock(&p->lock_strong);
+    pl_mutex_lock(&p->lock_weak);
+    PL_ARRAY_APPEND(p, p->consumers, c);
+    pl_mutex_unlock(&p->lock_weak);
+    pl_mutex_unlock(&p->lock_strong);
+    return c;
+}
+
+void pl_queue_consumer_destroy(pl_queue p, pl_queue_consumer *consumer)
+{
+    pl_queue_consumer c = *consumer;
+    if (!c)
+        return;
+
+    pl_mutex_lock(&p->lock_strong);
+    pl_mutex_lock(&p->lock_weak);
+    for (int i = 0; i < p->consumers.num; i++) {
+        if (p->consumers.elem[i] == c) {
+            PL_ARRAY_REMOVE_AT(p->consumers, i);
+            break;
+        }
+    }
     pl_mutex_unlock(&p->lock_weak);
     pl_mutex_unlock(&p->lock_strong);
+
+    pl_free(c);
+    *consumer = NULL;
 }
 
 static inline float delta(float old, float new)
@@ -206,6 +450,21 @@ static inline float delta(float old, float new)
     return fabs((new - old) / PL_MIN(new, old));
 }
 
+static float pool_variance(const struct pool *pool)
+{
+    if (!pool->num)
+        return 0.0;
+
+    float mean = pool->sum / pool->num, var = 0.0;
+    for (int i = 0; i < pool->num; i++) {
+        int idx = (pool->idx - 1 - i + MAX_SAMPLES) % MAX_SAMPLES;
+        float diff = pool->samples[idx] - mean;
+        var += diff * diff;
+    }
+
+    return var / pool->num;
+}
+
 static inline void update_estimate(struct pool *pool, float cur)
 {
     if (pool->num) {
@@ -229,7 +488,33 @@ static inline void update_estimate(struct pool *pool, float cur)
         pool->estimate = pool->sum / pool->num;
 }
 
-static void queue_push(pl_queue p, const struct pl_source_frame *src)
+static size_t entry_size(pl_queue p, const struct entry *entry);
+
+// Publish the current queue residency to `pl_queue_get_stats`
+static void publish_residency(pl_queue p)
+{
+    int num_mapped = 0;
+    size_t resident = 0, pending = 0;
+    for (int i = 0; i < p->queue.num; i++) {
+        const struct entry *entry = p->queue.elem[i];
+        if (entry->mapped && !entry->mapping) {
+            num_mapped++;
+            resident += entry->size;
+        } else {
+            pending += entry_size(p, entry);
+        }
+    }
+
+    struct stats *stats = p->stats;
+    atomic_store_explicit(&stats->num_frames, p->queue.num, memory_order_relaxed);
+    atomic_store_explicit(&stats->num_mapped, num_mapped, memory_order_relaxed);
+    atomic_store_explicit(&stats->resident_bytes, resident, memory_order_relaxed);
+    atomic_store_explicit(&stats->pending_bytes, pending, memory_order_relaxed);
+}
+
+// If `shapes` is NULL, the texture shapes are resolved from `src->planes`
+static void queue_push(pl_queue p, const struct pl_source_frame *src,
+                       const struct tex_shape *shapes, int num_shapes)
 {
     if (p->eof && !src)
         return; // ignore duplicate EOF
@@ -241,7 +526,7 @@ static void queue_push(pl_queue p, const struct pl_source_frame *src)
         return;
     }
 
-    pl_cond_signal(&p->wakeup);
+    pl_cond_broadcast(&p->wakeup);
 
     if (!src) {
         PL_TRACE(p, "Received EOF, draining frame queue...");
@@ -251,7 +536,9 @@ static void queue_push(pl_queue p, const struct pl_source_frame *src)
     }
 
     // Update FPS estimates if possible/reasonable
-    if (p->queue.num) {
+    if (p->cfr_duration) {
+        // Frame duration is known exactly, no need to estimate anything
+    } else if (p->queue.num) {
         float last_pts = p->queue.elem[p->queue.num - 1]->src.pts;
         float delta = src->pts - last_pts;
         if (delta < 0.0) {
@@ -265,12 +552,24 @@ static void queue_push(pl_queue p, const struct pl_source_frame *src)
         PL_DEBUG(p, "First frame received with non-zero PTS %f", src->pts);
     }
 
+    struct tex_shape src_shapes[4];
+    if (!shapes) {
+        num_shapes = resolve_shapes(p, src, src_shapes);
+        shapes = src_shapes;
+    }
+
     struct entry *entry = pl_alloc_ptr(NULL, entry);
     *entry = (struct entry) {
         .signature = p->signature++,
         .src = *src,
+        .num_shapes = num_shapes,
     };
-    PL_ARRAY_POP(p->cache, &entry->cache);
+
+    memcpy(entry->shapes, shapes, num_shapes * sizeof(*shapes));
+
+    // Not needed past this point, and not guaranteed to remain valid
+    entry->src.planes = NULL;
+    entry->src.num_planes = 0;
     PL_TRACE(p, "Added new frame id %"PRIu64" with PTS %f",
              entry->signature, src->pts);
 
@@ -285,33 +584,92 @@ static void queue_push(pl_queue p, const struct pl_source_frame *src)
     p->want_frame = false;
 }
 
-void pl_queue_push(pl_queue p, const struct pl_source_frame *frame)
+static void push_locked(pl_queue p, const struct pl_source_frame *frame)
 {
     pl_mutex_lock(&p->lock_weak);
-    queue_push(p, frame);
+    drain_ring(p);
+    queue_push(p, frame, NULL, 0);
+    publish_residency(p);
     pl_mutex_unlock(&p->lock_weak);
 }
 
-static bool queue_has_room(pl_queue p)
+void pl_queue_push(pl_queue p, const struct pl_source_frame *frame)
+{
+    if (p->ring && ring_push(p, frame))
+        return;
+
+    push_locked(p, frame);
+}
+
+static size_t entry_size(pl_queue p, const struct entry *entry)
+{
+    if (entry->size)
+        return entry->size;
+    return entry->src.size_hint ? entry->src.size_hint : p->frame_size;
+}
+
+// Number of frames that may still be pushed before the queue is "too full"
+static int queue_room(pl_queue p)
 {
     if (p->want_frame)
-        return true;
+        return PREFETCH_FRAMES;
+
+    // Budget-based limit, if we have some estimate of the next frame's size
+    size_t frame_size = p->frame_size;
+    if (p->queue.num)
+        frame_size = entry_size(p, p->queue.elem[p->queue.num - 1]);
+    if (p->memory_budget && frame_size) {
+        size_t used = 0;
+        for (int i = 0; i < p->queue.num; i++)
+            used += entry_size(p, p->queue.elem[i]);
+        if (used >= p->memory_budget)
+            return 0;
+        return PL_MIN((p->memory_budget - used) / frame_size, INT_MAX);
+    }
 
     // Examine the queue tail
     for (int i = p->queue.num - 1; i >= 0; i--) {
         if (p->queue.elem[i]->mapped)
-            return true;
+            return PREFETCH_FRAMES - (p->queue.num - i - 1);
         if (p->queue.num - i >= PREFETCH_FRAMES)
-            return false;
+            return 0;
     }
 
-    return true;
+    return PREFETCH_FRAMES - p->queue.num;
+}
+
+static inline bool queue_has_room(pl_queue p)
+{
+    return queue_room(p) > 0;
+}
+
+// Publish the current amount of room to the ring producer. Frames that are
+// still pending in the ring count against it.
+static void update_room(pl_queue p)
+{
+    struct ring *ring = p->ring;
+    if (!ring)
+        return;
+
+    unsigned tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    unsigned head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    atomic_store(&ring->room, queue_room(p) - (int) (head - tail));
 }
 
 bool pl_queue_push_block(pl_queue p, uint64_t timeout,
                          const struct pl_source_frame *frame)
 {
+    if (p->ring) {
+        // Fast path: skip the lock entirely if the consumer has told us
+        // there is room, falling back to the blocking path otherwise
+        bool room = !timeout || !frame ||
+                    atomic_fetch_sub(&p->ring->room, 1) > 0;
+        if (room && ring_push(p, frame))
+            return true;
+    }
+
     pl_mutex_lock(&p->lock_weak);
+    drain_ring(p);
     if (!timeout || !frame || p->eof)
         goto skip_blocking;
 
@@ -324,29 +682,45 @@ bool pl_queue_push_block(pl_queue p, uint64_t timeout,
 
 skip_blocking:
 
-    queue_push(p, frame);
+    queue_push(p, frame, NULL, 0);
+    publish_residency(p);
     pl_mutex_unlock(&p->lock_weak);
     return true;
 }
 
-static void report_estimates(pl_queue p)
+void pl_queue_push_bulk(pl_queue p, const struct pl_source_frame *frames,
+                        int num_frames)
+{
+    if (!num_frames)
+        return;
+
+    pl_mutex_lock(&p->lock_weak);
+    drain_ring(p);
+    for (int i = 0; i < num_frames; i++)
+        queue_push(p, &frames[i], NULL, 0);
+    publish_residency(p);
+    update_room(p);
+    pl_mutex_unlock(&p->lock_weak);
+}
+
+static void report_estimates(pl_queue p, pl_queue_consumer c)
 {
-    if (p->fps.total >= MIN_SAMPLES && p->vps.total >= MIN_SAMPLES) {
-        if (p->reported_fps && p->reported_vps) {
+    if (p->fps.total >= MIN_SAMPLES && c->vps.total >= MIN_SAMPLES) {
+        if (c->reported_fps && c->reported_vps) {
             // Only re-report the estimates if they've changed considerably
             // from the previously reported values
             static const float report_delta = 0.3;
-            float delta_fps = delta(p->reported_fps, p->fps.estimate);
-            float delta_vps = delta(p->reported_vps, p->vps.estimate);
+            float delta_fps = delta(c->reported_fps, p->fps.estimate);
+            float delta_vps = delta(c->reported_vps, c->vps.estimate);
             if (delta_fps < report_delta && delta_vps < report_delta)
                 return;
         }
 
         PL_INFO(p, "Estimated source FPS: %.3f, display FPS: %.3f",
-                1.0 / p->fps.estimate, 1.0 / p->vps.estimate);
+                1.0 / p->fps.estimate, 1.0 / c->vps.estimate);
 
-        p->reported_fps = p->fps.estimate;
-        p->reported_vps = p->vps.estimate;
+        c->reported_fps = p->fps.estimate;
+        c->reported_vps = c->vps.estimate;
     }
 }
 
@@ -361,13 +735,28 @@ static enum pl_queue_status get_frame(pl_queue p, const struct pl_queue_params *
             return PL_QUEUE_MORE;
 
         p->want_frame = true;
-        pl_cond_signal(&p->wakeup);
-
-        while (p->want_frame) {
-            if (pl_cond_timedwait(&p->wakeup, &p->lock_weak, params->timeout) == ETIMEDOUT)
-                return PL_QUEUE_MORE;
+        update_room(p);
+        pl_cond_broadcast(&p->wakeup);
+
+        struct ring *ring = p->ring;
+        if (ring)
+            atomic_store(&ring->waiting, true);
+
+        enum pl_queue_status ret = PL_QUEUE_OK;
+        for (;;) {
+            drain_ring(p);
+            if (!p->want_frame)
+                break;
+            if (pl_cond_timedwait(&p->wakeup, &p->lock_weak, params->timeout) == ETIMEDOUT) {
+                ret = PL_QUEUE_MORE;
+                break;
+            }
         }
 
+        if (ring)
+            atomic_store(&ring->waiting, false);
+        if (ret != PL_QUEUE_OK)
+            return ret;
         return p->eof ? PL_QUEUE_EOF : PL_QUEUE_OK;
     }
 
@@ -379,10 +768,10 @@ static enum pl_queue_status get_frame(pl_queue p, const struct pl_queue_params *
     enum pl_queue_status ret;
     switch ((ret = params->get_frame(&src, params))) {
     case PL_QUEUE_OK:
-        pl_queue_push(p, &src);
+        push_locked(p, &src);
         break;
     case PL_QUEUE_EOF:
-        pl_queue_push(p, NULL);
+        push_locked(p, NULL);
         break;
     case PL_QUEUE_MORE:
     case PL_QUEUE_ERR:
@@ -393,41 +782,150 @@ static enum pl_queue_status get_frame(pl_queue p, const struct pl_queue_params *
     return ret;
 }
 
+// Update the size of a freshly mapped frame
+static void measure_frame(pl_queue p, struct entry *entry)
+{
+    if (!entry->ok)
+        return;
+
+    size_t size = 0;
+    for (int i = 0; i < entry->frame.num_planes; i++) {
+        pl_tex tex = entry->frame.planes[i].texture;
+        if (!tex)
+            continue;
+        size += (size_t) tex->params.w * PL_DEF(tex->params.h, 1) *
+                PL_DEF(tex->params.d, 1) * tex->params.format->texel_size;
+    }
+
+    entry->size = PL_DEF(size, entry->src.size_hint);
+    if (entry->size)
+        p->frame_size = entry->size;
+    publish_residency(p);
+}
+
+static bool cache_matches(const struct cache_entry *cache,
+                          const struct entry *entry)
+{
+    for (int i = 0; i < entry->num_shapes; i++) {
+        const struct tex_shape *shape = &entry->shapes[i];
+        pl_tex tex = cache->tex[i];
+        if (!tex || !shape->fmt || tex->params.format != shape->fmt ||
+            tex->params.w != shape->w || tex->params.h != shape->h)
+        {
+            return false;
+        }
+    }
+
+    return entry->num_shapes > 0;
+}
+
+// Hand a set of recycled textures to `entry` prior to mapping it, preferring
+// one that matches the expected plane shapes (if known)
+static void acquire_cache(pl_queue p, struct entry *entry)
+{
+    static const struct cache_entry null_cache = {0};
+    if (!p->cache.num || memcmp(&entry->cache, &null_cache, sizeof(null_cache)))
+        return;
+
+    int idx = p->cache.num - 1;
+    for (int i = idx; i >= 0; i--) {
+        if (cache_matches(&p->cache.elem[i], entry)) {
+            idx = i;
+            break;
+        }
+    }
+
+    entry->cache = p->cache.elem[idx];
+    PL_ARRAY_REMOVE_AT(p->cache, idx);
+}
+
 static bool map_frame(pl_queue p, struct entry *entry)
 {
+    while (entry->mapping)
+        pl_cond_wait(&p->wakeup, &p->lock_weak);
+
     if (!entry->mapped) {
         PL_TRACE(p, "Mapping frame id %"PRIu64" with PTS %f",
                  entry->signature, entry->src.pts);
         entry->mapped = true;
+        acquire_cache(p, entry);
         entry->ok = entry->src.map(p->gpu, entry->cache.tex,
                                    &entry->src, &entry->frame);
         if (!entry->ok)
             PL_ERR(p, "Failed mapping frame id %"PRIu64" with PTS %f",
                    entry->signature, entry->src.pts);
+        measure_frame(p, entry);
     }
 
     return entry->ok;
 }
 
-// Advance the queue as needed to make sure idx 0 is the last frame before
-// `pts`, and idx 1 is the first frame after `pts` (unless this is the last).
-//
-// Returns PL_QUEUE_OK only if idx 0 is still legal under ZOH semantics.
-static enum pl_queue_status advance(pl_queue p, float pts,
-                                    const struct pl_queue_params *params)
+// Returns the index of the last frame with PTS <= `pts`, or 0 if there is no
+// such frame. For CFR sources, the index is computed directly rather than
+// searched for, with the scan only correcting for deviations from the cadence.
+static int find_frame(pl_queue p, float pts)
 {
-    // Cull all frames except the last frame before `pts`
-    int culled = 0;
-    for (int i = 1; i < p->queue.num; i++) {
-        if (p->queue.elem[i]->src.pts <= pts) {
-            cull_entry(p, p->queue.elem[i - 1]);
-            culled++;
-        }
+    int idx = 0;
+    if (p->cfr_duration && p->queue.num) {
+        float pos = (pts - p->queue.elem[0]->src.pts) / p->cfr_duration;
+        idx = PL_CLAMP(pos, 0.0f, p->queue.num - 1);
+        while (idx > 0 && p->queue.elem[idx]->src.pts > pts)
+            idx--;
+    }
+
+    while (idx + 1 < p->queue.num && p->queue.elem[idx + 1]->src.pts <= pts)
+        idx++;
+    return idx;
+}
+
+// Cull a frame from the front of the queue, counting it as dropped if it was
+// never shown
+static void evict_entry(pl_queue p, struct entry *entry)
+{
+    if (!entry->shown) {
+        PL_TRACE(p, "Dropping frame id %"PRIu64" with PTS %f",
+                 entry->signature, entry->src.pts);
+        atomic_fetch_add_explicit(&p->stats->frames_dropped, 1, memory_order_relaxed);
     }
+
+    cull_entry(p, entry);
+}
+
+// Cull all frames that no active consumer needs anymore, i.e. all frames
+// before the last frame preceding the earliest consumer's `cull_pts`
+static void cull_frames(pl_queue p)
+{
+    int culled = p->queue.num;
+    for (int i = 0; i < p->consumers.num; i++) {
+        const struct pl_queue_consumer *c = p->consumers.elem[i];
+        if (c->active && !c->done)
+            culled = PL_MIN(culled, find_frame(p, c->cull_pts));
+    }
+
+    for (int i = 0; i < culled; i++)
+        evict_entry(p, p->queue.elem[i]);
     PL_ARRAY_REMOVE_RANGE(p->queue, 0, culled);
+}
+
+// Advance the consumer as needed to make sure `find_frame(p, pts)` is the
+// last frame before `pts`, and the frame after it is the first frame after
+// `pts` (unless this is the last). Frames before that are culled once no
+// other consumer needs them.
+//
+// Returns PL_QUEUE_OK only if `find_frame(p, pts)` is still legal under ZOH
+// semantics.
+static enum pl_queue_status advance(pl_queue p, pl_queue_consumer c, float pts,
+                                    const struct pl_queue_params *params)
+{
+    if (c->done)
+        return PL_QUEUE_EOF;
+
+    c->active = true;
+    c->cull_pts = pts;
+    cull_frames(p);
 
     // Keep adding new frames until we find one in the future, or EOF
-    while (p->queue.num < 2) {
+    while (p->queue.num - find_frame(p, pts) < 2) {
         enum pl_queue_status ret;
         switch ((ret = get_frame(p, params))) {
         case PL_QUEUE_ERR:
@@ -438,19 +936,18 @@ static enum pl_queue_status advance(pl_queue p, float pts,
             goto done;
         case PL_QUEUE_MORE:
         case PL_QUEUE_OK:
-            while (p->queue.num > 1 && p->queue.elem[1]->src.pts <= pts) {
-                cull_entry(p, p->queue.elem[0]);
-                PL_ARRAY_REMOVE_AT(p->queue, 0);
-            }
+            cull_frames(p);
             if (ret == PL_QUEUE_MORE)
                 return ret;
             continue;
         }
     }
 
-done:
-    if (p->eof && p->queue.num == 1) {
-        if (p->queue.elem[0]->src.pts == 0.0 || !p->fps.estimate) {
+done: ;
+    const int idx = find_frame(p, pts);
+    if (p->eof && idx == p->queue.num - 1) {
+        const struct entry *last = p->queue.elem[idx];
+        if (last->src.pts == 0.0 || !p->fps.estimate) {
             // If the last frame has PTS 0.0, or we have no FPS estimate, then
             // this is probably a single-frame file, in which case we want to
             // extend the ZOH to infinity, rather than returning. Not a perfect
@@ -460,9 +957,9 @@ done:
 
         // Last frame is held for an extra `p->fps.estimate` duration,
         // afterwards this function just returns EOF.
-        if (p->queue.elem[0]->src.pts + p->fps.estimate < pts) {
-            cull_entry(p, p->queue.elem[0]);
-            p->queue.num = 0;
+        if (last->src.pts + p->fps.estimate < pts) {
+            c->done = true;
+            cull_frames(p);
             return PL_QUEUE_EOF;
         }
     }
@@ -471,53 +968,52 @@ done:
     return PL_QUEUE_OK;
 }
 
-static inline enum pl_queue_status point(pl_queue p, struct pl_frame_mix *mix,
+static inline enum pl_queue_status point(pl_queue p, pl_queue_consumer c,
+                                         struct pl_frame_mix *mix,
                                          const struct pl_queue_params *params)
 {
-    // Find closest frame (nearest neighbour semantics)
+    // Find closest frame (nearest neighbour semantics), which is either the
+    // last frame before `pts` or the one immediately following it
     pl_assert(p->queue.num);
-    struct entry *entry = p->queue.elem[0];
-    double best = fabs(entry->src.pts - params->pts);
-    for (int i = 1; i < p->queue.num; i++) {
-        double dist = fabs(p->queue.elem[i]->src.pts - params->pts);
-        if (dist < best) {
-            entry = p->queue.elem[i];
-            best = dist;
-            continue;
-        } else {
-            break;
-        }
+    int idx = find_frame(p, params->pts);
+    struct entry *entry = p->queue.elem[idx];
+    if (idx + 1 < p->queue.num) {
+        struct entry *next = p->queue.elem[idx + 1];
+        if (fabs(next->src.pts - params->pts) < fabs(entry->src.pts - params->pts))
+            entry = next;
     }
 
     if (!map_frame(p, entry))
         return PL_QUEUE_ERR;
 
     // Return a mix containing only this single frame
-    p->tmp_sig.num = p->tmp_ts.num = p->tmp_frame.num = 0;
-    PL_ARRAY_APPEND(p, p->tmp_sig, entry->signature);
-    PL_ARRAY_APPEND(p, p->tmp_frame, &entry->frame);
-    PL_ARRAY_APPEND(p, p->tmp_ts, 0.0);
+    c->tmp_sig.num = c->tmp_ts.num = c->tmp_frame.num = 0;
+    PL_ARRAY_APPEND(c, c->tmp_sig, entry->signature);
+    PL_ARRAY_APPEND(c, c->tmp_frame, &entry->frame);
+    PL_ARRAY_APPEND(c, c->tmp_ts, 0.0);
+    entry->shown = true;
     *mix = (struct pl_frame_mix) {
         .num_frames = 1,
-        .frames = p->tmp_frame.elem,
-        .signatures = p->tmp_sig.elem,
-        .timestamps = p->tmp_ts.elem,
+        .frames = c->tmp_frame.elem,
+        .signatures = c->tmp_sig.elem,
+        .timestamps = c->tmp_ts.elem,
         .vsync_duration = 1.0,
     };
 
     PL_TRACE(p, "Showing single frame id %"PRIu64" with PTS %f for target PTS %f",
              entry->signature, entry->src.pts, params->pts);
 
-    report_estimates(p);
+    report_estimates(p, c);
     return PL_QUEUE_OK;
 }
 
 // Present a single frame as appropriate for `pts`
-static enum pl_queue_status nearest(pl_queue p, struct pl_frame_mix *mix,
+static enum pl_queue_status nearest(pl_queue p, pl_queue_consumer c,
+                                    struct pl_frame_mix *mix,
                                     const struct pl_queue_params *params)
 {
     enum pl_queue_status ret;
-    switch ((ret = advance(p, params->pts, params))) {
+    switch ((ret = advance(p, c, params->pts, params))) {
     case PL_QUEUE_ERR:
     case PL_QUEUE_EOF:
         return ret;
@@ -535,16 +1031,17 @@ static enum pl_queue_status nearest(pl_queue p, struct pl_frame_mix *mix,
     if (!mix)
         return PL_QUEUE_OK;
 
-    return point(p, mix, params);
+    return point(p, c, mix, params);
 }
 
 // Special case of `interpolate` for radius = 0, in which case we need exactly
 // the previous frame and the following frame
-static enum pl_queue_status oversample(pl_queue p, struct pl_frame_mix *mix,
+static enum pl_queue_status oversample(pl_queue p, pl_queue_consumer c,
+                                       struct pl_frame_mix *mix,
                                        const struct pl_queue_params *params)
 {
     enum pl_queue_status ret;
-    switch ((ret = advance(p, params->pts, params))) {
+    switch ((ret = advance(p, c, params->pts, params))) {
     case PL_QUEUE_ERR:
     case PL_QUEUE_EOF:
         return ret;
@@ -563,87 +1060,136 @@ static enum pl_queue_status oversample(pl_queue p, struct pl_frame_mix *mix,
         return PL_QUEUE_OK;
 
     // Can't oversample with only a single frame, fall back to point sampling
-    if (p->queue.num < 2 || p->queue.elem[0]->src.pts > params->pts) {
-        if (point(p, mix, params) != PL_QUEUE_OK)
+    const int idx = find_frame(p, params->pts);
+    if (p->queue.num - idx < 2 || p->queue.elem[idx]->src.pts > params->pts) {
+        if (point(p, c, mix, params) != PL_QUEUE_OK)
             return PL_QUEUE_ERR;
         return ret;
     }
 
-    struct entry *entries[2] = { p->queue.elem[0], p->queue.elem[1] };
+    struct entry *entries[2] = { p->queue.elem[idx], p->queue.elem[idx + 1] };
     pl_assert(entries[0]->src.pts <= params->pts);
     pl_assert(entries[1]->src.pts >= params->pts);
 
     // Returning a mix containing both of these two frames
-    p->tmp_sig.num = p->tmp_ts.num = p->tmp_frame.num = 0;
+    c->tmp_sig.num = c->tmp_ts.num = c->tmp_frame.num = 0;
     for (int i = 0; i < 2; i++) {
         if (!map_frame(p, entries[i]))
             return PL_QUEUE_ERR;
 
         float ts = (entries[i]->src.pts - params->pts) / p->fps.estimate;
-        PL_ARRAY_APPEND(p, p->tmp_sig, entries[i]->signature);
-        PL_ARRAY_APPEND(p, p->tmp_frame, &entries[i]->frame);
-        PL_ARRAY_APPEND(p, p->tmp_ts, ts);
+        PL_ARRAY_APPEND(c, c->tmp_sig, entries[i]->signature);
+        PL_ARRAY_APPEND(c, c->tmp_frame, &entries[i]->frame);
+        PL_ARRAY_APPEND(c, c->tmp_ts, ts);
+        entries[i]->shown = true;
     }
 
     *mix = (struct pl_frame_mix) {
         .num_frames = 2,
-        .frames = p->tmp_frame.elem,
-        .signatures = p->tmp_sig.elem,
-        .timestamps = p->tmp_ts.elem,
-        .vsync_duration = p->vps.estimate / p->fps.estimate,
+        .frames = c->tmp_frame.elem,
+        .signatures = c->tmp_sig.elem,
+        .timestamps = c->tmp_ts.elem,
+        .vsync_duration = c->vps.estimate / p->fps.estimate,
     };
 
     PL_TRACE(p, "Oversampling 2 frames for target PTS %f:", params->pts);
     for (int i = 0; i < mix->num_frames; i++)
         PL_TRACE(p, "    id %"PRIu64" ts %f", mix->signatures[i], mix->timestamps[i]);
 
-    report_estimates(p);
+    report_estimates(p, c);
     return ret;
 }
 
+// Default cutoff for negligible frame weights, matching `pl_render_image_mix`
+#define MIXER_THRESHOLD 1e-3
+
+static float mixer_threshold(const struct pl_queue_params *params)
+{
+    return params->mixer_threshold ? params->mixer_threshold : MIXER_THRESHOLD;
+}
+
+static bool mixer_weighted(const struct pl_queue_params *params)
+{
+    const struct pl_filter_config *mixer = params->frame_mixer;
+    return mixer && mixer->kernel && mixer->kernel != pl_filter_oversample.kernel;
+}
+
+// Returns the effective radius of the configured frame mixer, i.e. the
+// largest distance at which a frame still receives a non-negligible weight
+static float effective_radius(pl_queue p, pl_queue_consumer c,
+                              const struct pl_queue_params *params)
+{
+    if (!mixer_weighted(params))
+        return params->radius;
+
+    const float threshold = mixer_threshold(params);
+    if (!pl_filter_config_eq(&c->mixer, params->frame_mixer) ||
+        c->mixer_threshold != threshold)
+    {
+        // Scan the kernel from the outside in, in small enough steps to never
+        // miss a lobe. The result is rounded up to the next step, to err on
+        // the side of including frames.
+        const int steps = 256;
+        const float radius = params->frame_mixer->kernel->radius;
+        int i = steps;
+        while (i > 0 && fabs(pl_filter_sample(params->frame_mixer,
+                                              radius * i / steps)) <= threshold)
+            i--;
+
+        c->mixer = *params->frame_mixer;
+        c->mixer_threshold = threshold;
+        c->mixer_support = radius * PL_MIN(i + 1, steps) / steps;
+        PL_DEBUG(p, "Effective frame mixer radius: %.3f (of %.3f)",
+                 c->mixer_support, radius);
+    }
+
+    return PL_MIN(params->radius, c->mixer_support);
+}
+
 // Present a mixture of frames, relative to the vsync ratio
-static enum pl_queue_status interpolate(pl_queue p, struct pl_frame_mix *mix,
+static enum pl_queue_status interpolate(pl_queue p, pl_queue_consumer c,
+                                        struct pl_frame_mix *mix,
                                         const struct pl_queue_params *params)
 {
     // No FPS estimate available, possibly source contains only a single frame,
     // or this is the first frame to be rendered. Fall back to point sampling.
     if (!p->fps.estimate)
-        return nearest(p, mix, params);
+        return nearest(p, c, mix, params);
 
     // Silently disable interpolation if the ratio dips lower than the
     // configured threshold
-    float ratio = fabs(p->fps.estimate / p->vps.estimate - 1.0);
+    float ratio = fabs(p->fps.estimate / c->vps.estimate - 1.0);
     if (ratio < params->interpolation_threshold) {
-        if (!p->threshold_frames) {
+        if (!c->threshold_frames) {
             PL_INFO(p, "Detected fps ratio %.4f below threshold %.4f, "
                     "disabling interpolation",
                     ratio, params->interpolation_threshold);
         }
 
-        p->threshold_frames = THRESHOLD_FRAMES + 1;
-        return nearest(p, mix, params);
-    } else if (ratio < THRESHOLD_MAX_RATIO && p->threshold_frames > 1) {
-        p->threshold_frames--;
-        return nearest(p, mix, params);
+        c->threshold_frames = THRESHOLD_FRAMES + 1;
+        return nearest(p, c, mix, params);
+    } else if (ratio < THRESHOLD_MAX_RATIO && c->threshold_frames > 1) {
+        c->threshold_frames--;
+        return nearest(p, c, mix, params);
     } else {
-        if (p->threshold_frames) {
+        if (c->threshold_frames) {
             PL_INFO(p, "Detected fps ratio %.4f exceeds threshold %.4f, "
                     "re-enabling interpolation",
                     ratio, params->interpolation_threshold);
         }
-        p->threshold_frames = 0;
+        c->threshold_frames = 0;
     }
 
     // No radius information, special case in which we only need the previous
     // and next frames.
     if (!params->radius)
-        return oversample(p, mix, params);
+        return oversample(p, c, mix, params);
 
-    float min_pts = params->pts - params->radius * p->fps.estimate,
-          max_pts = params->pts + params->radius * p->fps.estimate;
+    float min_pts = params->pts - c->radius * p->fps.estimate,
+          max_pts = params->pts + c->radius * p->fps.estimate;
 
     enum pl_queue_status ret;
-    switch ((ret = advance(p, min_pts, params))) {
+    switch ((ret = advance(p, c, min_pts, params))) {
     case PL_QUEUE_ERR:
     case PL_QUEUE_EOF:
         return ret;
@@ -672,29 +1218,55 @@ done: ;
     if (!mix)
         return PL_QUEUE_OK;
 
+    // Determine the frames which must be included regardless of their weight,
+    // namely the last frame before the target PTS (for ZOH semantics) and the
+    // frame nearest to it (the renderer's reference frame)
+    const int first = find_frame(p, min_pts);
+    int current = first, nearest_idx = first;
+    for (int i = first + 1; i < p->queue.num; i++) {
+        const struct entry *entry = p->queue.elem[i];
+        if (entry->src.pts <= params->pts)
+            current = i;
+        if (fabs(entry->src.pts - params->pts) <
+            fabs(p->queue.elem[nearest_idx]->src.pts - params->pts))
+            nearest_idx = i;
+    }
+
     // Construct a mix object representing the current queue state, starting at
     // the last frame before `min_pts` to make sure there's a fallback frame
     // available for ZOH semantics.
-    p->tmp_sig.num = p->tmp_ts.num = p->tmp_frame.num = 0;
-    for (int i = 0; i < p->queue.num; i++) {
+    const bool weighted = mixer_weighted(params);
+    const float threshold = mixer_threshold(params);
+    c->tmp_sig.num = c->tmp_ts.num = c->tmp_frame.num = 0;
+    for (int i = first; i < p->queue.num; i++) {
         struct entry *entry = p->queue.elem[i];
         if (entry->src.pts > max_pts)
             break;
+
+        float ts = (entry->src.pts - params->pts) / p->fps.estimate;
+        if (weighted && i != current && i != nearest_idx &&
+            fabs(pl_filter_sample(params->frame_mixer, ts)) <= threshold)
+        {
+            PL_TRACE(p, "Skipping frame id %"PRIu64" with negligible weight",
+                     entry->signature);
+            continue;
+        }
+
         if (!map_frame(p, entry))
             return PL_QUEUE_ERR;
 
-        float ts = (entry->src.pts - params->pts) / p->fps.estimate;
-        PL_ARRAY_APPEND(p, p->tmp_sig, entry->signature);
-        PL_ARRAY_APPEND(p, p->tmp_frame, &entry->frame);
-        PL_ARRAY_APPEND(p, p->tmp_ts, ts);
+        PL_ARRAY_APPEND(c, c->tmp_sig, entry->signature);
+        PL_ARRAY_APPEND(c, c->tmp_frame, &entry->frame);
+        PL_ARRAY_APPEND(c, c->tmp_ts, ts);
+        entry->shown = true;
     }
 
     *mix = (struct pl_frame_mix) {
-        .num_frames = p->tmp_frame.num,
-        .frames = p->tmp_frame.elem,
-        .signatures = p->tmp_sig.elem,
-        .timestamps = p->tmp_ts.elem,
-        .vsync_duration = p->vps.estimate / p->fps.estimate,
+        .num_frames = c->tmp_frame.num,
+        .frames = c->tmp_frame.elem,
+        .signatures = c->tmp_sig.elem,
+        .timestamps = c->tmp_ts.elem,
+        .vsync_duration = c->vps.estimate / p->fps.estimate,
     };
 
     PL_TRACE(p, "Showing mix of %d frames for target PTS %f:",
@@ -702,7 +1274,7 @@ done: ;
     for (int i = 0; i < mix->num_frames; i++)
         PL_TRACE(p, "    id %"PRIu64" ts %f", mix->signatures[i], mix->timestamps[i]);
 
-    report_estimates(p);
+    report_estimates(p, c);
     return ret;
 }
 
@@ -741,15 +1313,47 @@ static inline void default_estimate(struct pool *pool, float val)
         pool->estimate = val;
 }
 
+static void update_stats(pl_queue p, pl_queue_consumer c,
+                         const struct pl_frame_mix *mix,
+                         enum pl_queue_status ret)
+{
+    struct stats *stats = p->stats;
+    atomic_store_explicit(&stats->frame_duration, p->fps.estimate * 1e9,
+                          memory_order_relaxed);
+    atomic_store_explicit(&stats->vsync_duration, c->vps.estimate * 1e9,
+                          memory_order_relaxed);
+    if (ret == PL_QUEUE_MORE)
+        atomic_fetch_add_explicit(&stats->stalls, 1, memory_order_relaxed);
+
+    if (mix && mix->num_frames) {
+        // The frame currently being shown is the last one not in the future
+        uint64_t cur = mix->signatures[0];
+        for (int i = 1; i < mix->num_frames && mix->timestamps[i] <= 0.0; i++)
+            cur = mix->signatures[i];
+        if (c->last_shown == cur + 1)
+            atomic_fetch_add_explicit(&stats->frames_repeated, 1, memory_order_relaxed);
+        c->last_shown = cur + 1;
+    }
+
+    publish_residency(p);
+}
+
 enum pl_queue_status pl_queue_update(pl_queue p, struct pl_frame_mix *out_mix,
                                      const struct pl_queue_params *params)
 {
+    pl_queue_consumer c = PL_DEF(params->consumer, p->def);
     pl_mutex_lock(&p->lock_strong);
     pl_mutex_lock(&p->lock_weak);
+    drain_ring(p);
+    p->cfr_duration = 0.0;
+    if (params->constant_frame_rate && params->frame_duration > 0.0) {
+        p->cfr_duration = params->frame_duration;
+        p->fps.estimate = params->frame_duration;
+    }
     default_estimate(&p->fps, params->frame_duration);
-    default_estimate(&p->vps, params->vsync_duration);
+    default_estimate(&c->vps, params->vsync_duration);
 
-    float delta = params->pts - p->prev_pts;
+    float delta = params->pts - c->prev_pts;
     if (delta < 0.0) {
 
         // This is a backwards PTS jump. This is something we can handle
@@ -772,15 +1376,22 @@ enum pl_queue_status pl_queue_update(pl_queue p, struct pl_frame_mix *out_mix,
         // discontinuous jump after a suspend. To prevent this from exploding
         // the FPS estimate, treat this as a new frame.
         PL_TRACE(p, "Discontinuous target PTS jump %f -> %f, ignoring...",
-                 p->prev_pts, params->pts);
+                 c->prev_pts, params->pts);
 
     } else if (delta > 0) {
 
-        update_estimate(&p->vps, params->pts - p->prev_pts);
+        update_estimate(&c->vps, params->pts - c->prev_pts);
+        atomic_store_explicit(&p->stats->vsync_interval, delta * 1e9,
+                              memory_order_relaxed);
+        atomic_store_explicit(&p->stats->vsync_jitter,
+                              sqrtf(pool_variance(&c->vps)) * 1e9,
+                              memory_order_relaxed);
 
     }
 
-    p->prev_pts = params->pts;
+    c->prev_pts = params->pts;
+    c->radius = effective_radius(p, c, params);
+    p->memory_budget = params->memory_budget;
 
     // As a special case, prefill the queue if this is the first frame
     if (!params->pts && !p->queue.num) {
@@ -796,16 +1407,111 @@ enum pl_queue_status pl_queue_update(pl_queue p, struct pl_frame_mix *out_mix,
     static const float min_vsync = 1.0 / MAX_FPS;
     enum pl_queue_status ret;
 
-    if (p->vps.estimate > min_vsync && p->vps.estimate < max_vsync) {
+    if (c->vps.estimate > min_vsync && c->vps.estimate < max_vsync) {
         // We know the vsync duration, so construct an interpolation mix
-        ret = interpolate(p, out_mix, params);
+        ret = interpolate(p, c, out_mix, params);
     } else {
         // We don't know the vsync duration (yet), so just point-sample
-        ret = nearest(p, out_mix, params);
+        ret = nearest(p, c, out_mix, params);
     }
 
-    pl_cond_signal(&p->wakeup);
+    update_stats(p, c, out_mix, ret);
+    update_room(p);
+    pl_cond_broadcast(&p->wakeup);
     pl_mutex_unlock(&p->lock_weak);
     pl_mutex_unlock(&p->lock_strong);
     return ret;
 }
+
+// Find the next frame within the prefetch window which still needs mapping.
+// The window extends past the furthest consumer, so it covers all of them.
+static struct entry *next_prefetch(pl_queue p, int lookahead)
+{
+    float prev_pts = 0.0, radius = 0.0;
+    for (int i = 0; i < p->consumers.num; i++) {
+        const struct pl_queue_consumer *c = p->consumers.elem[i];
+        prev_pts = PL_MAX(prev_pts, c->prev_pts);
+        radius = PL_MAX(radius, c->radius);
+    }
+
+    int limit = 0;
+    while (limit < p->queue.num && p->queue.elem[limit]->src.pts <= prev_pts)
+        limit++;
+    limit = PL_MIN(limit + (int) ceilf(radius) + lookahead, p->queue.num);
+
+    for (int i = 0; i < limit; i++) {
+        struct entry *entry = p->queue.elem[i];
+        if (!entry->mapped)
+            return entry;
+    }
+
+    return NULL;
+}
+
+int pl_queue_prefetch(pl_queue p, int lookahead, uint64_t timeout)
+{
+    int num = 0;
+    pl_mutex_lock(&p->lock_weak);
+    for (;;) {
+        drain_ring(p);
+        struct entry *entry = next_prefetch(p, lookahead);
+        if (!entry) {
+            if (num || !timeout || p->eof)
+                break;
+            if (pl_cond_timedwait(&p->wakeup, &p->lock_weak, timeout) == ETIMEDOUT)
+                break;
+            continue;
+        }
+
+        // Map the frame without holding the lock, to avoid stalling
+        // `pl_queue_update` (or the producer) for the duration of the upload
+        PL_TRACE(p, "Prefetching frame id %"PRIu64" with PTS %f",
+                 entry->signature, entry->src.pts);
+        entry->mapped = entry->mapping = true;
+        acquire_cache(p, entry);
+        p->num_prefetching++;
+        pl_mutex_unlock(&p->lock_weak);
+        bool ok = entry->src.map(p->gpu, entry->cache.tex, &entry->src,
+                                 &entry->frame);
+        pl_mutex_lock(&p->lock_weak);
+
+        if (!ok) {
+            PL_ERR(p, "Failed mapping frame id %"PRIu64" with PTS %f",
+                   entry->signature, entry->src.pts);
+        }
+
+        entry->ok = ok;
+        entry->mapping = false;
+        measure_frame(p, entry);
+        p->num_prefetching--;
+        update_room(p);
+        pl_cond_broadcast(&p->wakeup);
+        num++;
+    }
+
+    pl_mutex_unlock(&p->lock_weak);
+    return num;
+}
+
+static inline float rate(uint64_t duration)
+{
+    return duration ? 1e9 / duration : 0.0;
+}
+
+struct pl_queue_stats pl_queue_get_stats(pl_queue p)
+{
+    struct stats *stats = p->stats;
+    return (struct pl_queue_stats) {
+        .num_frames         = atomic_load_explicit(&stats->num_frames, memory_order_relaxed),
+        .num_mapped         = atomic_load_explicit(&stats->num_mapped, memory_order_relaxed),
+        .resident_bytes     = atomic_load_explicit(&stats->resident_bytes, memory_order_relaxed),
+        .pending_bytes      = atomic_load_explicit(&stats->pending_bytes, memory_order_relaxed),
+        .estimated_fps      = rate(atomic_load_explicit(&stats->frame_duration, memory_order_relaxed)),
+        .estimated_vps      = rate(atomic_load_explicit(&stats->vsync_duration, memory_order_relaxed)),
+        .vsync_interval     = atomic_load_explicit(&stats->vsync_interval, memory_order_relaxed) * 1e-9,
+        .vsync_jitter       = atomic_load_explicit(&stats->vsync_jitter, memory_order_relaxed) * 1e-9,
+        .frames_dropped     = atomic_load_explicit(&stats->frames_dropped, memory_order_relaxed),
+        .frames_repeated    = atomic_load_explicit(&stats->frames_repeated, memory_order_relaxed),
+        .stalls             = atomic_load_explicit(&stats->stalls, memory_order_relaxed),
+    };
+}
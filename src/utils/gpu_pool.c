@@ -0,0 +1,257 @@
+/*
+ * This file is part of libplacebo.
+ *
+ * libplacebo is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * libplacebo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with libplacebo. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "common.h"
+#include "log.h"
+#include "pl_thread.h"
+
+#include <libplacebo/utils/gpu_pool.h>
+
+// Assumed per-frame cost of a device with weight 1.0, in nanoseconds, until
+// any actual measurements are available
+#define DEFAULT_COST 1000000
+
+struct device {
+    pl_gpu gpu;
+    pl_renderer rr;
+    uint64_t model;
+    float weight;
+    uint64_t cost;      // measured per-frame GPU cost, or 0
+    uint64_t vtime;     // virtual time consumed by `pl_gpu_pool_pick`
+    int streams;        // number of assigned streams
+    size_t cache_size;  // size of the last saved shader cache
+};
+
+struct stream {
+    uint64_t id;
+    int idx;
+};
+
+struct pl_gpu_pool {
+    pl_log log;
+    pl_mutex lock;
+    PL_ARRAY(struct device) devices;
+    PL_ARRAY(struct stream) streams;
+};
+
+pl_gpu_pool pl_gpu_pool_create(pl_log log, const struct pl_gpu_pool_params *params)
+{
+    if (!params->num_devices)
+        return NULL;
+
+    pl_gpu_pool pool = pl_zalloc_ptr(NULL, pool);
+    pool->log = log;
+    pl_mutex_init(&pool->lock);
+
+    for (int i = 0; i < params->num_devices; i++) {
+        const struct pl_gpu_pool_device *dev = &params->devices[i];
+        pl_renderer rr = pl_renderer_create(log, dev->gpu);
+        if (!rr) {
+            PL_ERR(pool, "Failed creating renderer for device %d!", i);
+            pl_gpu_pool_destroy(&pool);
+            return NULL;
+        }
+
+        PL_ARRAY_APPEND(pool, pool->devices, (struct device) {
+            .gpu    = dev->gpu,
+            .rr     = rr,
+            .model  = dev->model,
+            .weight = PL_DEF(dev->weight, 1.0f),
+            .cache_size = pl_renderer_save(rr, NULL), // don't share empty caches
+        });
+    }
+
+    return pool;
+}
+
+void pl_gpu_pool_destroy(pl_gpu_pool *ppool)
+{
+    pl_gpu_pool pool = *ppool;
+    if (!pool)
+        return;
+
+    for (int i = 0; i < pool->devices.num; i++)
+        pl_renderer_destroy(&pool->devices.elem[i].rr);
+
+    pl_mutex_destroy(&pool->lock);
+    pl_free_ptr(ppool);
+}
+
+int pl_gpu_pool_num_devices(pl_gpu_pool pool)
+{
+    return pool->devices.num;
+}
+
+pl_gpu pl_gpu_pool_gpu(pl_gpu_pool pool, int idx)
+{
+    pl_assert(idx >= 0 && idx < pool->devices.num);
+    return pool->devices.elem[idx].gpu;
+}
+
+pl_renderer pl_gpu_pool_renderer(pl_gpu_pool pool, int idx)
+{
+    pl_assert(idx >= 0 && idx < pool->devices.num);
+    return pool->devices.elem[idx].rr;
+}
+
+// Estimated per-frame cost of a device. Devices without measurements yet are
+// extrapolated from the best measured device, scaled by their relative weight
+static uint64_t device_cost(pl_gpu_pool pool, const struct device *dev)
+{
+    if (dev->cost)
+        return dev->cost;
+
+    double ref = 0.0;
+    for (int i = 0; i < pool->devices.num; i++) {
+        const struct device *other = &pool->devices.elem[i];
+        if (!other->cost)
+            continue;
+        double cost = other->cost * other->weight;
+        ref = ref ? PL_MIN(ref, cost) : cost;
+    }
+
+    return PL_MAX(PL_DEF(ref, DEFAULT_COST) / dev->weight, 1.0);
+}
+
+// Pick the device with the lowest load after adding one more frame of work
+static int least_loaded(pl_gpu_pool pool)
+{
+    int best = 0;
+    uint64_t best_load = UINT64_MAX;
+    for (int i = 0; i < pool->devices.num; i++) {
+        const struct device *dev = &pool->devices.elem[i];
+        uint64_t cost = device_cost(pool, dev);
+        uint64_t load = dev->vtime + (dev->streams + 1) * cost;
+        if (load < best_load) {
+            best_load = load;
+            best = i;
+        }
+    }
+
+    return best;
+}
+
+int pl_gpu_pool_assign(pl_gpu_pool pool, uint64_t stream_id)
+{
+    pl_mutex_lock(&pool->lock);
+    for (int i = 0; i < pool->streams.num; i++) {
+        if (pool->streams.elem[i].id == stream_id) {
+            int idx = pool->streams.elem[i].idx;
+            pl_mutex_unlock(&pool->lock);
+            return idx;
+        }
+    }
+
+    int idx = least_loaded(pool);
+    pool->devices.elem[idx].streams++;
+    PL_ARRAY_APPEND(pool, pool->streams, (struct stream) {
+        .id  = stream_id,
+        .idx = idx,
+    });
+
+    PL_DEBUG(pool, "Assigned stream 0x%llx to device %d",
+             (unsigned long long) stream_id, idx);
+    pl_mutex_unlock(&pool->lock);
+    return idx;
+}
+
+void pl_gpu_pool_release(pl_gpu_pool pool, uint64_t stream_id)
+{
+    pl_mutex_lock(&pool->lock);
+    for (int i = 0; i < pool->streams.num; i++) {
+        if (pool->streams.elem[i].id == stream_id) {
+            pool->devices.elem[pool->streams.elem[i].idx].streams--;
+            PL_ARRAY_REMOVE_AT(pool->streams, i);
+            break;
+        }
+    }
+    pl_mutex_unlock(&pool->lock);
+}
+
+int pl_gpu_pool_pick(pl_gpu_pool pool)
+{
+    pl_mutex_lock(&pool->lock);
+    int idx = least_loaded(pool);
+    struct device *dev = &pool->devices.elem[idx];
+    dev->vtime += device_cost(pool, dev);
+
+    // Only the relative virtual times matter, so keep them from growing
+    uint64_t base = UINT64_MAX;
+    for (int i = 0; i < pool->devices.num; i++)
+        base = PL_MIN(base, pool->devices.elem[i].vtime);
+    for (int i = 0; i < pool->devices.num; i++)
+        pool->devices.elem[i].vtime -= base;
+
+    pl_mutex_unlock(&pool->lock);
+    return idx;
+}
+
+void pl_gpu_pool_update(pl_gpu_pool pool, int idx)
+{
+    pl_assert(idx >= 0 && idx < pool->devices.num);
+    struct pl_render_stats stats = pl_renderer_get_stats(pool->devices.elem[idx].rr);
+
+    // Fall back to CPU times if the GPU does not support timer queries
+    uint64_t gpu = 0, cpu = 0;
+    for (int i = 0; i < PL_RENDER_STAT_COUNT; i++) {
+        gpu += stats.stages[i].gpu_mean;
+        cpu += stats.stages[i].cpu_mean;
+    }
+
+    pl_mutex_lock(&pool->lock);
+    pool->devices.elem[idx].cost = PL_DEF(gpu, cpu);
+    pl_mutex_unlock(&pool->lock);
+}
+
+uint64_t pl_gpu_pool_frame_cost(pl_gpu_pool pool, int idx)
+{
+    pl_assert(idx >= 0 && idx < pool->devices.num);
+    pl_mutex_lock(&pool->lock);
+    uint64_t cost = pool->devices.elem[idx].cost;
+    pl_mutex_unlock(&pool->lock);
+    return cost;
+}
+
+void pl_gpu_pool_sync_caches(pl_gpu_pool pool)
+{
+    pl_mutex_lock(&pool->lock);
+    for (int i = 0; i < pool->devices.num; i++) {
+        struct device *src = &pool->devices.elem[i];
+        if (!src->model)
+            continue;
+
+        size_t size = pl_renderer_save(src->rr, NULL);
+        if (size == src->cache_size)
+            continue; // nothing new to share
+
+        uint8_t *cache = pl_alloc(NULL, size);
+        pl_renderer_save(src->rr, cache);
+        src->cache_size = size;
+
+        for (int j = 0; j < pool->devices.num; j++) {
+            struct device *dst = &pool->devices.elem[j];
+            if (j == i || dst->model != src->model)
+                continue;
+            PL_DEBUG(pool, "Sharing %zu bytes of shader cache from device %d "
+                     "to device %d", size, i, j);
+            pl_renderer_load(dst->rr, cache);
+        }
+
+        pl_free(cache);
+    }
+    pl_mutex_unlock(&pool->lock);
+}
@@ -20,6 +20,8 @@
 #include "log.h"
 #include "common.h"
 #include "gpu.h"
+#include "shaders.h"
+#include "pl_thread.h"
 
 #define MAX_COMPS 4
 
@@ -152,11 +154,9 @@ misaligned:
     return false;
 }
 
-pl_fmt pl_plane_find_fmt(pl_gpu gpu, int out_map[4], const struct pl_plane_data *data)
+static pl_fmt find_plane_fmt(pl_gpu gpu, int out_map[4],
+                             const struct pl_plane_data *data)
 {
-    int dummy[4] = {0};
-    out_map = PL_DEF(out_map, dummy);
-
     // Count the number of components and initialize out_map
     int num = 0;
     for (int i = 0; i < PL_ARRAY_SIZE(data->component_size); i++) {
@@ -201,6 +201,33 @@ next_fmt: ; // acts as `continue`
     return NULL;
 }
 
+pl_fmt pl_plane_find_fmt(pl_gpu gpu, int out_map[4], const struct pl_plane_data *data)
+{
+    int dummy[4] = {0};
+    out_map = PL_DEF(out_map, dummy);
+
+    // This gets called for every single uploaded plane (and repeatedly while
+    // probing pixel formats), so remember the result for each layout
+    struct plane_fmt_key key;
+    memset(&key, 0, sizeof(key));
+    key.type = data->type;
+    key.pixel_stride = data->pixel_stride;
+    key.row_stride = data->row_stride;
+    for (int i = 0; i < 4; i++) {
+        key.component_size[i] = data->component_size[i];
+        key.component_pad[i] = data->component_pad[i];
+        key.component_map[i] = data->component_map[i];
+    }
+
+    pl_fmt fmt;
+    if (pl_plane_fmt_cache_get(gpu, &key, &fmt, out_map))
+        return fmt;
+
+    fmt = find_plane_fmt(gpu, out_map, data);
+    pl_plane_fmt_cache_add(gpu, &key, fmt, out_map);
+    return fmt;
+}
+
 bool pl_upload_plane(pl_gpu gpu, struct pl_plane *out_plane,
                      pl_tex *tex, const struct pl_plane_data *data)
 {
@@ -239,7 +266,7 @@ bool pl_upload_plane(pl_gpu gpu, struct pl_plane *out_plane,
         }
     }
 
-    return pl_tex_upload(gpu, pl_tex_transfer_params(
+    struct pl_tex_transfer_params params = {
         .tex        = *tex,
         .row_pitch  = data->row_stride,
         .ptr        = (void *) data->pixels,
@@ -247,7 +274,33 @@ bool pl_upload_plane(pl_gpu gpu, struct pl_plane *out_plane,
         .buf_offset = data->buf_offset,
         .callback   = data->callback,
         .priv       = data->priv,
-    ));
+    };
+
+    // Try uploading directly from (cached) imported host memory, to avoid
+    // the extra memcpy into a staging buffer
+    pl_buf import = NULL;
+    if (data->pixels && data->pixels_persistent && data->callback &&
+        gpu->limits.buf_transfer)
+    {
+        size_t row_stride = PL_DEF(data->row_stride, data->width * data->pixel_stride);
+        size_t size = (data->height - 1) * row_stride + data->width * data->pixel_stride;
+        size_t offset = 0;
+        import = pl_buf_cache_import(gpu, data->pixels, size, &offset);
+        if (import && offset % data->pixel_stride == 0 && offset % 4 == 0) {
+            params.buf = import;
+            params.buf_offset = offset;
+            params.ptr = NULL;
+        }
+    }
+
+    ok = pl_tex_upload(gpu, &params);
+    pl_buf_cache_release(gpu, &import);
+    return ok;
+}
+
+void pl_upload_forget(pl_gpu gpu, const void *pixels, size_t size)
+{
+    pl_buf_cache_forget(gpu, pixels, size);
 }
 
 bool pl_recreate_plane(pl_gpu gpu, struct pl_plane *out_plane,
@@ -287,3 +340,584 @@ bool pl_recreate_plane(pl_gpu gpu, struct pl_plane *out_plane,
 
     return true;
 }
+
+static const struct packed_fmt {
+    int depth;  // bits per sample
+    int pixels; // pixels per group
+    int words;  // 32-bit words per group
+    int align;  // natural row alignment, in bytes
+} packed_fmts[PL_PACKED_FMT_COUNT] = {
+    [PL_PACKED_YUYV] = { .depth =  8, .pixels = 2, .words = 1, .align = 4 },
+    [PL_PACKED_UYVY] = { .depth =  8, .pixels = 2, .words = 1, .align = 4 },
+    [PL_PACKED_Y210] = { .depth = 10, .pixels = 2, .words = 2, .align = 4 },
+    [PL_PACKED_V210] = { .depth = 10, .pixels = 6, .words = 4, .align = 128 },
+};
+
+static pl_fmt packed_plane_fmt(pl_gpu gpu, enum pl_packed_fmt format, int comps)
+{
+    return pl_find_fmt(gpu, PL_FMT_UNORM, comps, packed_fmts[format].depth, 0,
+                       PL_FMT_CAP_SAMPLEABLE | PL_FMT_CAP_STORABLE);
+}
+
+bool pl_test_packed(pl_gpu gpu, enum pl_packed_fmt format)
+{
+    if (format <= PL_PACKED_NONE || format >= PL_PACKED_FMT_COUNT)
+        return false;
+    if (!gpu->glsl.compute || gpu->glsl.version < 130 || !gpu->limits.max_ssbo_size)
+        return false; // needs integer arithmetic and SSBOs
+
+    return packed_plane_fmt(gpu, format, 1) && packed_plane_fmt(gpu, format, 2);
+}
+
+bool pl_upload_packed(pl_gpu gpu, struct pl_plane out_planes[2], pl_tex tex[2],
+                      struct pl_bit_encoding *out_bits,
+                      const struct pl_packed_data *data)
+{
+    pl_assert(!data->buf ^ !data->pixels); // exactly one
+    if (!pl_test_packed(gpu, data->format)) {
+        PL_ERR(gpu, "Unpacking packed pixel format %d is not supported!",
+               data->format);
+        return false;
+    }
+
+    struct pl_gpu_fns *impl = PL_PRIV(gpu);
+    const struct packed_fmt *pf = &packed_fmts[data->format];
+    const int groups = (data->width + pf->pixels - 1) / pf->pixels;
+    const int chroma_w = (data->width + 1) / 2;
+    size_t row_stride = data->row_stride;
+    if (!row_stride)
+        row_stride = PL_ALIGN(groups * pf->words * 4, pf->align);
+    if (row_stride % 4 || data->buf_offset % 4) {
+        PL_ERR(gpu, "Packed data row stride and offset must be multiples of 4!");
+        return false;
+    }
+
+    const size_t size = (data->height - 1) * row_stride + groups * pf->words * 4;
+    pl_fmt fmts[2] = {
+        packed_plane_fmt(gpu, data->format, 1),
+        packed_plane_fmt(gpu, data->format, 2),
+    };
+
+    for (int p = 0; p < 2; p++) {
+        bool ok = pl_tex_recreate(gpu, &tex[p], pl_tex_params(
+            .w = p ? chroma_w : data->width,
+            .h = data->height,
+            .format = fmts[p],
+            .sampleable = true,
+            .storable = true,
+            .blit_src = fmts[p]->caps & PL_FMT_CAP_BLITTABLE,
+        ));
+
+        if (!ok) {
+            PL_ERR(gpu, "Failed initializing plane texture!");
+            return false;
+        }
+
+        if (out_planes) {
+            out_planes[p].texture = tex[p];
+            out_planes[p].components = p + 1;
+            out_planes[p].component_mapping[0] = p ? PL_CHANNEL_CB : PL_CHANNEL_Y;
+            out_planes[p].component_mapping[1] = p ? PL_CHANNEL_CR : -1;
+            out_planes[p].component_mapping[2] = -1;
+            out_planes[p].component_mapping[3] = -1;
+        }
+    }
+
+    if (out_bits) {
+        *out_bits = (struct pl_bit_encoding) {
+            .sample_depth = pf->depth,
+            .color_depth = pf->depth,
+        };
+    }
+
+    // Copy host memory into a (pooled) staging buffer
+    pl_buf buf = data->buf;
+    size_t offset = data->buf_offset;
+    if (data->pixels) {
+        buf = pl_staging_get(gpu, size, true);
+        if (!buf)
+            return false;
+        pl_buf_write(gpu, buf, 0, data->pixels, size);
+        offset = 0;
+    }
+
+    bool ok = false;
+    if (!buf->params.storable || offset + size > buf->params.size) {
+        PL_ERR(gpu, "Packed data buffer must be storable and large enough to "
+               "hold the image!");
+        goto done;
+    }
+
+    const int threads = PL_MIN(256, groups);
+    pl_shader sh = pl_dispatch_begin(impl->dp);
+    if (!sh_try_compute(sh, threads, 1, false, 0)) {
+        PL_ERR(gpu, "Failed unpacking packed pixel data!");
+        pl_dispatch_abort(impl->dp, &sh);
+        goto done;
+    }
+
+    struct pl_var words = pl_var_uint("words");
+    words.dim_a = buf->params.size / 4;
+    struct pl_shader_desc desc = {
+        .binding.object = buf,
+        .desc = {
+            .name = "PackedData",
+            .type = PL_DESC_BUF_STORAGE,
+            .access = PL_DESC_ACCESS_READONLY,
+        },
+    };
+
+    if (!sh_buf_desc_append(SH_TMP(sh), gpu, &desc, NULL, words)) {
+        PL_ERR(gpu, "Packed data buffer exceeds device limits!");
+        pl_dispatch_abort(impl->dp, &sh);
+        goto done;
+    }
+    sh_desc(sh, desc);
+
+    ident_t img[2];
+    for (int p = 0; p < 2; p++) {
+        img[p] = sh_desc(sh, (struct pl_shader_desc) {
+            .binding.object = tex[p],
+            .desc = {
+                .name = p ? "chroma" : "luma",
+                .type = PL_DESC_STORAGE_IMG,
+                .access = PL_DESC_ACCESS_WRITEONLY,
+            },
+        });
+    }
+
+    // Skip the bounds check if the number of groups is a natural multiple
+    // of the thread size, as in `pl_tex_upload_texel`
+    int groups_x = (groups + threads - 1) / threads;
+    if (groups_x * threads != groups) {
+        GLSL("if (gl_GlobalInvocationID.x >= %d) \n"
+             "    return;                        \n", groups);
+    }
+
+    GLSL("ivec2 pos = ivec2(gl_GlobalInvocationID);         \n"
+         "uint base = uint(pos.y) * "$" + uint(pos.x) * %du + "$"; \n"
+         "float y[%d];                                      \n"
+         "vec2 c[%d];                                       \n",
+         SH_UINT(row_stride / 4), pf->words, SH_UINT(offset / 4),
+         pf->pixels, pf->pixels / 2);
+
+    for (int i = 0; i < pf->words; i++)
+        GLSL("uint w%d = words[base + %du]; \n", i, i);
+
+    const float scale = 1.0f / ((1 << pf->depth) - 1);
+    switch (data->format) {
+    case PL_PACKED_YUYV:
+        GLSL("y[0] = float(w0 & 0xFFu);           \n"
+             "c[0].x = float((w0 >> 8) & 0xFFu);  \n"
+             "y[1] = float((w0 >> 16) & 0xFFu);   \n"
+             "c[0].y = float(w0 >> 24);           \n");
+        break;
+    case PL_PACKED_UYVY:
+        GLSL("c[0].x = float(w0 & 0xFFu);         \n"
+             "y[0] = float((w0 >> 8) & 0xFFu);    \n"
+             "c[0].y = float((w0 >> 16) & 0xFFu); \n"
+             "y[1] = float(w0 >> 24);             \n");
+        break;
+    case PL_PACKED_Y210:
+        GLSL("y[0] = float((w0 & 0xFFFFu) >> 6);  \n"
+             "c[0].x = float(w0 >> 22);           \n"
+             "y[1] = float((w1 & 0xFFFFu) >> 6);  \n"
+             "c[0].y = float(w1 >> 22);           \n");
+        break;
+    case PL_PACKED_V210: {
+        // Sample order within each group of six pixels, by 10-bit field
+        static const char *order[12] = {
+            "c[0].x", "y[0]", "c[0].y",
+            "y[1]", "c[1].x", "y[2]",
+            "c[1].y", "y[3]", "c[2].x",
+            "y[4]", "c[2].y", "y[5]",
+        };
+        for (int i = 0; i < PL_ARRAY_SIZE(order); i++) {
+            GLSL("%s = float((w%d >> %du) & 0x3FFu); \n",
+                 order[i], i / 3, (i % 3) * 10);
+        }
+        break;
+    }
+    case PL_PACKED_NONE:
+    case PL_PACKED_FMT_COUNT:
+        pl_unreachable();
+    }
+
+    // Write out all samples, skipping those past the edge of the image
+    for (int i = 0; i < pf->pixels; i++) {
+        GLSL("if (pos.x * %d + %d < %d)                              \n"
+             "    imageStore("$", ivec2(pos.x * %d + %d, pos.y),      \n"
+             "               vec4("$" * y[%d], 0.0, 0.0, 0.0));       \n",
+             pf->pixels, i, data->width,
+             img[0], pf->pixels, i,
+             SH_FLOAT(scale), i);
+    }
+
+    for (int i = 0; i < pf->pixels / 2; i++) {
+        GLSL("if (pos.x * %d + %d < %d)                              \n"
+             "    imageStore("$", ivec2(pos.x * %d + %d, pos.y),      \n"
+             "               vec4("$" * c[%d], 0.0, 0.0));            \n",
+             pf->pixels / 2, i, chroma_w,
+             img[1], pf->pixels / 2, i,
+             SH_FLOAT(scale), i);
+    }
+
+    ok = pl_dispatch_compute(impl->dp, pl_dispatch_compute_params(
+        .shader = &sh,
+        .dispatch_size = { groups_x, data->height, 1 },
+    ));
+
+done:
+    if (data->pixels)
+        pl_staging_put(gpu, buf);
+    return ok;
+}
+
+#define DEFAULT_MAX_IDLE 64
+
+// Generic object pool, shared by `pl_buf_pool` and `pl_tex_pool`
+struct obj_pool_fns {
+    size_t (*size)(const void *obj);
+    bool (*busy)(pl_gpu gpu, const void *obj);
+    bool (*match)(const void *obj, const void *params);
+    void (*destroy)(pl_gpu gpu, const void *obj);
+};
+
+struct obj_pool {
+    void *alloc; // owning allocation, freed along with the pool
+    pl_gpu gpu;
+    pl_mutex lock;
+    const struct obj_pool_fns *fns;
+    int max_idle;
+    size_t max_bytes;
+    PL_ARRAY(const void *) idle; // in order of return, oldest first
+    int num_out;                 // number of objects currently handed out
+    size_t total_bytes;          // size of all objects, idle or handed out
+    bool destroyed;
+};
+
+static void obj_pool_init(struct obj_pool *pool, void *alloc, pl_gpu gpu,
+                          const struct obj_pool_fns *fns,
+                          int max_idle, size_t max_bytes)
+{
+    pool->alloc = alloc;
+    pool->gpu = gpu;
+    pool->fns = fns;
+    pool->max_idle = PL_DEF(max_idle, DEFAULT_MAX_IDLE);
+    pool->max_bytes = max_bytes;
+    pl_mutex_init(&pool->lock);
+}
+
+static void obj_pool_free(struct obj_pool *pool)
+{
+    pl_mutex_destroy(&pool->lock);
+    pl_free(pool->alloc);
+}
+
+static void obj_pool_destroy(struct obj_pool *pool)
+{
+    pl_mutex_lock(&pool->lock);
+    for (int i = 0; i < pool->idle.num; i++)
+        pool->fns->destroy(pool->gpu, pool->idle.elem[i]);
+    pool->idle.num = 0;
+    pool->total_bytes = 0;
+    pool->destroyed = true;
+    bool done = !pool->num_out;
+    pl_mutex_unlock(&pool->lock);
+
+    // Otherwise, freed by the last `obj_pool_put`
+    if (done)
+        obj_pool_free(pool);
+}
+
+// Returns a matching idle object, or NULL after reserving `size` bytes for a
+// new object, which the caller must then create. Sets `*ok` to false if the
+// reservation failed.
+static const void *obj_pool_get(struct obj_pool *pool, const void *params,
+                                size_t size, bool *ok)
+{
+    pl_gpu gpu = pool->gpu;
+    const void *obj = NULL;
+    *ok = true;
+
+    pl_mutex_lock(&pool->lock);
+    pl_assert(!pool->destroyed);
+    for (int i = pool->idle.num - 1; i >= 0; i--) {
+        const void *cur = pool->idle.elem[i];
+        if (!pool->fns->match(cur, params) || pool->fns->busy(gpu, cur))
+            continue;
+        PL_ARRAY_REMOVE_AT(pool->idle, i);
+        obj = cur;
+        break;
+    }
+
+    if (obj) {
+        pool->num_out++;
+        pl_mutex_unlock(&pool->lock);
+        return obj;
+    }
+
+    // Make room for the new object by evicting idle objects, oldest first
+    const size_t max_bytes = pool->max_bytes;
+    while (max_bytes && pool->total_bytes + size > max_bytes && pool->idle.num) {
+        const void *evict = pool->idle.elem[0];
+        pool->total_bytes -= pool->fns->size(evict);
+        PL_ARRAY_REMOVE_AT(pool->idle, 0);
+        pool->fns->destroy(gpu, evict);
+    }
+
+    if (max_bytes && pool->total_bytes + size > max_bytes) {
+        pl_mutex_unlock(&pool->lock);
+        PL_TRACE(gpu, "Pool exhausted, refusing to allocate %zu bytes", size);
+        *ok = false;
+        return NULL;
+    }
+
+    // Reserve the space before dropping the lock
+    pool->total_bytes += size;
+    pool->num_out++;
+    pl_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+// Undoes the reservation made by `obj_pool_get`, if object creation failed
+static void obj_pool_unreserve(struct obj_pool *pool, size_t size)
+{
+    pl_mutex_lock(&pool->lock);
+    pool->total_bytes -= size;
+    pool->num_out--;
+    pl_mutex_unlock(&pool->lock);
+}
+
+static void obj_pool_put(struct obj_pool *pool, const void *obj)
+{
+    const void *evict = NULL;
+    pl_mutex_lock(&pool->lock);
+    pl_assert(pool->num_out > 0);
+    pool->num_out--;
+    if (pool->destroyed) {
+        bool done = !pool->num_out;
+        pl_mutex_unlock(&pool->lock);
+        pool->fns->destroy(pool->gpu, obj);
+        if (done)
+            obj_pool_free(pool);
+        return;
+    }
+
+    if (pool->idle.num == pool->max_idle) {
+        evict = pool->idle.elem[0];
+        pool->total_bytes -= pool->fns->size(evict);
+        PL_ARRAY_REMOVE_AT(pool->idle, 0);
+    }
+    PL_ARRAY_APPEND(pool->alloc, pool->idle, obj);
+    pl_mutex_unlock(&pool->lock);
+
+    if (evict)
+        pool->fns->destroy(pool->gpu, evict);
+}
+
+static size_t buf_size(const void *obj)
+{
+    pl_buf buf = obj;
+    return buf->params.size;
+}
+
+static bool buf_busy(pl_gpu gpu, const void *obj)
+{
+    return pl_buf_poll(gpu, obj, 0);
+}
+
+static bool buf_match(const void *obj, const void *params)
+{
+    pl_buf buf = obj;
+    const struct pl_buf_params *par = params;
+    return buf->params.size == par->size &&
+           buf->params.export_handle == par->export_handle &&
+           pl_buf_params_superset(buf->params, *par);
+}
+
+static void buf_destroy(pl_gpu gpu, const void *obj)
+{
+    pl_buf buf = obj;
+    pl_buf_destroy(gpu, &buf);
+}
+
+static const struct obj_pool_fns buf_pool_fns = {
+    .size    = buf_size,
+    .busy    = buf_busy,
+    .match   = buf_match,
+    .destroy = buf_destroy,
+};
+
+struct pl_buf_pool {
+    struct obj_pool pool;
+};
+
+pl_buf_pool pl_buf_pool_create(pl_gpu gpu, const struct pl_buf_pool_params *params)
+{
+    struct pl_buf_pool_params par = {0};
+    if (params)
+        par = *params;
+
+    pl_buf_pool pool = pl_zalloc_ptr(NULL, pool);
+    obj_pool_init(&pool->pool, pool, gpu, &buf_pool_fns,
+                  par.max_idle, par.max_bytes);
+    return pool;
+}
+
+void pl_buf_pool_destroy(pl_buf_pool *ppool)
+{
+    pl_buf_pool pool = *ppool;
+    if (!pool)
+        return;
+
+    obj_pool_destroy(&pool->pool);
+    *ppool = NULL;
+}
+
+pl_gpu pl_buf_pool_gpu(pl_buf_pool pool)
+{
+    return pool->pool.gpu;
+}
+
+pl_buf pl_buf_pool_get(pl_buf_pool pool, size_t size)
+{
+    return pl_buf_pool_get_ex(pool, pl_buf_params(
+        .size = size,
+        .memory_type = PL_BUF_MEM_HOST,
+        .host_mapped = true,
+    ));
+}
+
+pl_buf pl_buf_pool_get_ex(pl_buf_pool pool, const struct pl_buf_params *params)
+{
+    struct obj_pool *p = &pool->pool;
+    if (params->initial_data || params->import_handle) {
+        PL_ERR(p->gpu, "pl_buf_pool_get_ex may not be used with `initial_data` "
+               "or `import_handle`!");
+        return NULL;
+    }
+
+    bool ok;
+    pl_buf buf = obj_pool_get(p, params, params->size, &ok);
+    if (buf || !ok)
+        return buf;
+
+    buf = pl_buf_create(p->gpu, params);
+    if (!buf)
+        obj_pool_unreserve(p, params->size);
+    return buf;
+}
+
+void pl_buf_pool_put(pl_buf_pool pool, pl_buf *pbuf)
+{
+    if (!*pbuf)
+        return;
+
+    obj_pool_put(&pool->pool, *pbuf);
+    *pbuf = NULL;
+}
+
+// Estimated size of a texture, ignoring any padding or alignment
+static size_t tex_params_size(const struct pl_tex_params *params)
+{
+    return (size_t) params->format->texel_size * params->w *
+           PL_MAX(params->h, 1) * PL_MAX(params->d, 1);
+}
+
+static size_t tex_size(const void *obj)
+{
+    pl_tex tex = obj;
+    return tex_params_size(&tex->params);
+}
+
+static bool tex_busy(pl_gpu gpu, const void *obj)
+{
+    return pl_tex_poll(gpu, obj, 0);
+}
+
+static bool tex_match(const void *obj, const void *params)
+{
+    pl_tex tex = obj;
+    const struct pl_tex_params *par = params;
+    return tex->params.export_handle == par->export_handle &&
+           pl_tex_params_superset(tex->params, *par);
+}
+
+static void tex_destroy(pl_gpu gpu, const void *obj)
+{
+    pl_tex tex = obj;
+    pl_tex_destroy(gpu, &tex);
+}
+
+static const struct obj_pool_fns tex_pool_fns = {
+    .size    = tex_size,
+    .busy    = tex_busy,
+    .match   = tex_match,
+    .destroy = tex_destroy,
+};
+
+struct pl_tex_pool {
+    struct obj_pool pool;
+};
+
+pl_tex_pool pl_tex_pool_create(pl_gpu gpu, const struct pl_tex_pool_params *params)
+{
+    struct pl_tex_pool_params par = {0};
+    if (params)
+        par = *params;
+
+    pl_tex_pool pool = pl_zalloc_ptr(NULL, pool);
+    obj_pool_init(&pool->pool, pool, gpu, &tex_pool_fns,
+                  par.max_idle, par.max_bytes);
+    return pool;
+}
+
+void pl_tex_pool_destroy(pl_tex_pool *ppool)
+{
+    pl_tex_pool pool = *ppool;
+    if (!pool)
+        return;
+
+    obj_pool_destroy(&pool->pool);
+    *ppool = NULL;
+}
+
+pl_gpu pl_tex_pool_gpu(pl_tex_pool pool)
+{
+    return pool->pool.gpu;
+}
+
+pl_tex pl_tex_pool_get(pl_tex_pool pool, const struct pl_tex_params *params)
+{
+    struct obj_pool *p = &pool->pool;
+    if (params->initial_data || params->import_handle) {
+        PL_ERR(p->gpu, "pl_tex_pool_get may not be used with `initial_data` "
+               "or `import_handle`!");
+        return NULL;
+    }
+
+    bool ok;
+    size_t size = tex_params_size(params);
+    pl_tex tex = obj_pool_get(p, params, size, &ok);
+    if (tex) {
+        pl_tex_invalidate(p->gpu, tex);
+        return tex;
+    } else if (!ok) {
+        return NULL;
+    }
+
+    tex = pl_tex_create(p->gpu, params);
+    if (!tex)
+        obj_pool_unreserve(p, size);
+    return tex;
+}
+
+void pl_tex_pool_put(pl_tex_pool pool, pl_tex *ptex)
+{
+    if (!*ptex)
+        return;
+
+    obj_pool_put(&pool->pool, *ptex);
+    *ptex = NULL;
+}
@@ -22,7 +22,7 @@
 static VkResult vk_cmd_poll(struct vk_ctx *vk, struct vk_cmd *cmd,
                             uint64_t timeout)
 {
-    return vk->WaitForFences(vk->dev, 1, &cmd->fence, false, timeout);
+    return vk->WaitForFences(vk->dev, 1, &cmd->submit_fence, false, timeout);
 }
 
 static void flush_callbacks(struct vk_ctx *vk)
@@ -50,6 +50,10 @@ static void vk_cmd_reset(struct vk_ctx *vk, struct vk_cmd *cmd)
     cmd->depvalues.num = 0;
     cmd->sigs.num = 0;
     cmd->sigvalues.num = 0;
+    cmd->img_barriers.num = 0;
+    cmd->buf_barriers.num = 0;
+    cmd->barrier_src = cmd->barrier_dst = 0;
+    cmd->submit_fence = cmd->fence;
 }
 
 static void vk_cmd_destroy(struct vk_ctx *vk, struct vk_cmd *cmd)
@@ -86,6 +90,7 @@ static struct vk_cmd *vk_cmd_create(struct vk_ctx *vk, struct vk_cmdpool *pool)
 
     VK(vk->CreateFence(vk->dev, &finfo, PL_VK_ALLOC, &cmd->fence));
     PL_VK_NAME(FENCE, cmd->fence, "cmd");
+    cmd->submit_fence = cmd->fence;
 
     return cmd;
 
@@ -99,7 +104,11 @@ void vk_dev_callback(struct vk_ctx *vk, vk_cb callback,
                      const void *priv, const void *arg)
 {
     pl_mutex_lock(&vk->lock);
-    if (vk->cmds_pending.num > 0) {
+    if (vk->cmds_queued.num > 0) {
+        // Queued commands end up after all pending commands
+        struct vk_cmd *last_cmd = vk->cmds_queued.elem[vk->cmds_queued.num - 1];
+        vk_cmd_callback(last_cmd, callback, priv, arg);
+    } else if (vk->cmds_pending.num > 0) {
         struct vk_cmd *last_cmd = vk->cmds_pending.elem[vk->cmds_pending.num - 1];
         vk_cmd_callback(last_cmd, callback, priv, arg);
     } else {
@@ -135,6 +144,44 @@ void vk_cmd_sig(struct vk_cmd *cmd, pl_vulkan_sem sig)
     PL_ARRAY_APPEND(cmd, cmd->sigvalues, sig.value);
 }
 
+void vk_cmd_barrier(struct vk_ctx *vk, struct vk_cmd *cmd,
+                    VkPipelineStageFlags src, VkPipelineStageFlags dst,
+                    const VkImageMemoryBarrier *img,
+                    const VkBufferMemoryBarrier *buf)
+{
+    // Multiple barriers affecting the same resource can't be batched, since
+    // they would no longer be ordered with respect to each other
+    bool conflict = false;
+    for (int i = 0; img && i < cmd->img_barriers.num; i++)
+        conflict |= cmd->img_barriers.elem[i].image == img->image;
+    for (int i = 0; buf && i < cmd->buf_barriers.num; i++)
+        conflict |= cmd->buf_barriers.elem[i].buffer == buf->buffer;
+    if (conflict)
+        vk_cmd_flush_barriers(vk, cmd);
+
+    if (img)
+        PL_ARRAY_APPEND(cmd, cmd->img_barriers, *img);
+    if (buf)
+        PL_ARRAY_APPEND(cmd, cmd->buf_barriers, *buf);
+    cmd->barrier_src |= src;
+    cmd->barrier_dst |= dst;
+}
+
+void vk_cmd_flush_barriers(struct vk_ctx *vk, struct vk_cmd *cmd)
+{
+    if (!cmd->img_barriers.num && !cmd->buf_barriers.num)
+        return;
+
+    vk->CmdPipelineBarrier(cmd->buf, cmd->barrier_src, cmd->barrier_dst, 0,
+                           0, NULL,
+                           cmd->buf_barriers.num, cmd->buf_barriers.elem,
+                           cmd->img_barriers.num, cmd->img_barriers.elem);
+
+    cmd->img_barriers.num = 0;
+    cmd->buf_barriers.num = 0;
+    cmd->barrier_src = cmd->barrier_dst = 0;
+}
+
 void vk_sem_uninit(struct vk_ctx *vk, struct vk_sem *sem)
 {
     vk->DestroySemaphore(vk->dev, sem->semaphore, PL_VK_ALLOC);
@@ -328,7 +375,7 @@ error:
     return NULL;
 }
 
-bool vk_cmd_submit(struct vk_ctx *vk, struct vk_cmd **pcmd)
+bool vk_cmd_queue(struct vk_ctx *vk, struct vk_cmd **pcmd)
 {
     struct vk_cmd *cmd = *pcmd;
     if (!cmd)
@@ -336,68 +383,146 @@ bool vk_cmd_submit(struct vk_ctx *vk, struct vk_cmd **pcmd)
 
     *pcmd = NULL;
     struct vk_cmdpool *pool = cmd->pool;
-
+    vk_cmd_flush_barriers(vk, cmd);
     VK(vk->EndCommandBuffer(cmd->buf));
-    VK(vk->ResetFences(vk->dev, 1, &cmd->fence));
-
-    VkTimelineSemaphoreSubmitInfo tinfo = {
-        .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
-        .waitSemaphoreValueCount = cmd->depvalues.num,
-        .pWaitSemaphoreValues = cmd->depvalues.elem,
-        .signalSemaphoreValueCount = cmd->sigvalues.num,
-        .pSignalSemaphoreValues = cmd->sigvalues.elem,
-    };
 
-    VkSubmitInfo sinfo = {
-        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-        .pNext = &tinfo,
-        .commandBufferCount = 1,
-        .pCommandBuffers = &cmd->buf,
-        .waitSemaphoreCount = cmd->deps.num,
-        .pWaitSemaphores = cmd->deps.elem,
-        .pWaitDstStageMask = cmd->depstages.elem,
-        .signalSemaphoreCount = cmd->sigs.num,
-        .pSignalSemaphores = cmd->sigs.elem,
-    };
+    pl_mutex_lock(&vk->lock);
+    PL_ARRAY_APPEND(vk->alloc, vk->cmds_queued, cmd);
+    bool flush = vk->cmds_queued.num >= PL_VK_MAX_QUEUED_CMDS;
+    pl_mutex_unlock(&vk->lock);
+    return flush ? vk_flush_commands(vk) : true;
 
-    if (pl_msg_test(vk->log, PL_LOG_TRACE)) {
-        PL_TRACE(vk, "Submitting command %p on queue %p (QF %d):",
-                 (void *) cmd->buf, (void *) cmd->queue, pool->qf);
-        for (int n = 0; n < cmd->deps.num; n++) {
-            PL_TRACE(vk, "    waits on semaphore %p = %"PRIu64,
-                     (void *) cmd->deps.elem[n], cmd->depvalues.elem[n]);
-        }
-        for (int n = 0; n < cmd->sigs.num; n++) {
-            PL_TRACE(vk, "    signals semaphore %p = %"PRIu64,
-                    (void *) cmd->sigs.elem[n], cmd->sigvalues.elem[n]);
+error:
+    vk_cmd_reset(vk, cmd);
+    pl_mutex_lock(&vk->lock);
+    PL_ARRAY_APPEND(pool, pool->cmds, cmd);
+    pl_mutex_unlock(&vk->lock);
+    vk->failed = true;
+    return false;
+}
+
+bool vk_cmd_submit(struct vk_ctx *vk, struct vk_cmd **pcmd)
+{
+    bool ok = vk_cmd_queue(vk, pcmd);
+    return vk_flush_commands(vk) && ok;
+}
+
+// Submits a batch of commands belonging to the same queue, using a single
+// vkQueueSubmit. Must be called with `vk->lock` held.
+static bool submit_batch(struct vk_ctx *vk, struct vk_cmd **batch, int num)
+{
+    VkTimelineSemaphoreSubmitInfo tinfos[PL_VK_MAX_QUEUED_CMDS];
+    VkSubmitInfo sinfos[PL_VK_MAX_QUEUED_CMDS];
+    pl_assert(num <= PL_VK_MAX_QUEUED_CMDS);
+
+    // The batch can only signal a single fence, so all commands share the
+    // fence of the last one. Since commands are polled in order, the last
+    // command is never recycled before the others.
+    struct vk_cmd *last = batch[num - 1];
+    struct vk_cmdpool *pool = last->pool;
+    VK(vk->ResetFences(vk->dev, 1, &last->fence));
+
+    for (int i = 0; i < num; i++) {
+        struct vk_cmd *cmd = batch[i];
+        pl_assert(cmd->queue == last->queue);
+        cmd->submit_fence = last->fence;
+
+        tinfos[i] = (VkTimelineSemaphoreSubmitInfo) {
+            .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+            .waitSemaphoreValueCount = cmd->depvalues.num,
+            .pWaitSemaphoreValues = cmd->depvalues.elem,
+            .signalSemaphoreValueCount = cmd->sigvalues.num,
+            .pSignalSemaphoreValues = cmd->sigvalues.elem,
+        };
+
+        sinfos[i] = (VkSubmitInfo) {
+            .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+            .pNext = &tinfos[i],
+            .commandBufferCount = 1,
+            .pCommandBuffers = &cmd->buf,
+            .waitSemaphoreCount = cmd->deps.num,
+            .pWaitSemaphores = cmd->deps.elem,
+            .pWaitDstStageMask = cmd->depstages.elem,
+            .signalSemaphoreCount = cmd->sigs.num,
+            .pSignalSemaphores = cmd->sigs.elem,
+        };
+
+        if (pl_msg_test(vk->log, PL_LOG_TRACE)) {
+            PL_TRACE(vk, "Submitting command %p on queue %p (QF %d):",
+                     (void *) cmd->buf, (void *) cmd->queue, pool->qf);
+            for (int n = 0; n < cmd->deps.num; n++) {
+                PL_TRACE(vk, "    waits on semaphore %p = %"PRIu64,
+                         (void *) cmd->deps.elem[n], cmd->depvalues.elem[n]);
+            }
+            for (int n = 0; n < cmd->sigs.num; n++) {
+                PL_TRACE(vk, "    signals semaphore %p = %"PRIu64,
+                        (void *) cmd->sigs.elem[n], cmd->sigvalues.elem[n]);
+            }
+            if (cmd == last)
+                PL_TRACE(vk, "    signals fence %p", (void *) cmd->fence);
+            if (cmd->callbacks.num)
+                PL_TRACE(vk, "    signals %d callbacks", cmd->callbacks.num);
         }
-        PL_TRACE(vk, "    signals fence %p", (void *) cmd->fence);
-        if (cmd->callbacks.num)
-            PL_TRACE(vk, "    signals %d callbacks", cmd->callbacks.num);
     }
 
-    vk->lock_queue(vk->queue_ctx, pool->qf, cmd->qindex);
-    VkResult res = vk->QueueSubmit(cmd->queue, 1, &sinfo, cmd->fence);
-    vk->unlock_queue(vk->queue_ctx, pool->qf, cmd->qindex);
+    vk->lock_queue(vk->queue_ctx, pool->qf, last->qindex);
+    VkResult res = vk->QueueSubmit(last->queue, num, sinfos, last->fence);
+    vk->unlock_queue(vk->queue_ctx, pool->qf, last->qindex);
     PL_VK_ASSERT(res, "vkQueueSubmit");
 
-    pl_mutex_lock(&vk->lock);
-    PL_ARRAY_APPEND(vk->alloc, vk->cmds_pending, cmd);
-    pl_mutex_unlock(&vk->lock);
+    for (int i = 0; i < num; i++)
+        PL_ARRAY_APPEND(vk->alloc, vk->cmds_pending, batch[i]);
+    vk->stat_cmds += num;
+    vk->stat_submits++;
     return true;
 
 error:
-    vk_cmd_reset(vk, cmd);
-    pl_mutex_lock(&vk->lock);
-    PL_ARRAY_APPEND(pool, pool->cmds, cmd);
-    pl_mutex_unlock(&vk->lock);
+    for (int i = 0; i < num; i++) {
+        struct vk_cmd *cmd = batch[i];
+        vk_cmd_reset(vk, cmd);
+        PL_ARRAY_APPEND(cmd->pool, cmd->pool->cmds, cmd);
+    }
     vk->failed = true;
     return false;
 }
 
+bool vk_flush_commands(struct vk_ctx *vk)
+{
+    bool ret = true;
+
+    // Hold the lock for the entire flush, so that commands queued by other
+    // threads are never still in flight when this function returns
+    pl_mutex_lock(&vk->lock);
+    while (vk->cmds_queued.num) {
+        // Gather the commands for the first queue, preserving their order
+        struct vk_cmd *batch[PL_VK_MAX_QUEUED_CMDS];
+        VkQueue queue = vk->cmds_queued.elem[0]->queue;
+        int num = 0;
+        for (int i = 0; i < vk->cmds_queued.num && num < PL_ARRAY_SIZE(batch);) {
+            struct vk_cmd *cmd = vk->cmds_queued.elem[i];
+            if (cmd->queue != queue) {
+                i++;
+                continue;
+            }
+
+            batch[num++] = cmd;
+            PL_ARRAY_REMOVE_AT(vk->cmds_queued, i);
+        }
+
+        // Timeline semaphore waits may be submitted before their signals, so
+        // the relative order of batches on different queues doesn't matter
+        ret &= submit_batch(vk, batch, num);
+    }
+    pl_mutex_unlock(&vk->lock);
+    return ret;
+}
+
 bool vk_poll_commands(struct vk_ctx *vk, uint64_t timeout)
 {
     bool ret = false;
+    if (timeout)
+        vk_flush_commands(vk);
+
     pl_mutex_lock(&vk->lock);
 
     while (vk->cmds_pending.num) {
@@ -410,7 +535,7 @@ bool vk_poll_commands(struct vk_ctx *vk, uint64_t timeout)
         if (!vk->cmds_pending.num || vk->cmds_pending.elem[0] != cmd)
             continue; // another thread modified this state while blocking
 
-        PL_TRACE(vk, "VkFence signalled: %p", (void *) cmd->fence);
+        PL_TRACE(vk, "VkFence signalled: %p", (void *) cmd->submit_fence);
         PL_ARRAY_REMOVE_AT(vk->cmds_pending, 0); // remove before callbacks
         vk_cmd_reset(vk, cmd);
         PL_ARRAY_APPEND(pool, pool->cmds, cmd);
@@ -439,6 +564,13 @@ void vk_rotate_queues(struct vk_ctx *vk)
         PL_TRACE(vk, "QF %d: %d/%d", pool->qf, pool->idx_queues, pool->num_queues);
     }
 
+    if (vk->stat_cmds) {
+        PL_TRACE(vk, "Submitted %d commands using %d vkQueueSubmit calls "
+                 "(%d saved)", vk->stat_cmds, vk->stat_submits,
+                 vk->stat_cmds - vk->stat_submits);
+    }
+    vk->stat_cmds = vk->stat_submits = 0;
+
     pl_mutex_unlock(&vk->lock);
 }
 
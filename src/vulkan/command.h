@@ -30,8 +30,9 @@ struct vk_callback {
     void *arg;
 };
 
-// Associate a callback with the completion of all currently pending commands.
-// This will essentially run once the device is completely idle.
+// Associate a callback with the completion of all currently pending (or
+// queued) commands. This will essentially run once the device is completely
+// idle.
 void vk_dev_callback(struct vk_ctx *vk, vk_cb callback,
                      const void *priv, const void *arg);
 
@@ -45,6 +46,8 @@ struct vk_cmd {
     int qindex;              // the index of `queue` in `pool`
     VkCommandBuffer buf;     // the command buffer itself
     VkFence fence;           // the fence guards cmd buffer reuse
+    VkFence submit_fence;    // fence signalled by the batch containing this
+                             // command (possibly owned by another command)
     // The semaphores represent dependencies that need to complete before
     // this command can be executed. These are *not* owned by the vk_cmd
     PL_ARRAY(VkSemaphore) deps;
@@ -58,6 +61,11 @@ struct vk_cmd {
     // to fire once the VkFence completes. These are used for multiple purposes,
     // ranging from garbage collection (resource deallocation) to fencing.
     PL_ARRAY(struct vk_callback) callbacks;
+    // Pipeline barriers that have been recorded but not yet emitted, together
+    // with the union of their stage masks. See `vk_cmd_barrier`.
+    PL_ARRAY(VkImageMemoryBarrier) img_barriers;
+    PL_ARRAY(VkBufferMemoryBarrier) buf_barriers;
+    VkPipelineStageFlags barrier_src, barrier_dst;
 };
 
 // Associate a callback with the completion of the current command. This
@@ -73,6 +81,20 @@ void vk_cmd_dep(struct vk_cmd *cmd, VkPipelineStageFlags stage, pl_vulkan_sem de
 // after the command completes.
 void vk_cmd_sig(struct vk_cmd *cmd, pl_vulkan_sem sig);
 
+// Record an image and/or buffer memory barrier (either may be NULL). Instead
+// of being emitted immediately, barriers are accumulated and emitted together
+// as a single vkCmdPipelineBarrier by `vk_cmd_flush_barriers`, merging their
+// stage masks.
+void vk_cmd_barrier(struct vk_ctx *vk, struct vk_cmd *cmd,
+                    VkPipelineStageFlags src, VkPipelineStageFlags dst,
+                    const VkImageMemoryBarrier *img,
+                    const VkBufferMemoryBarrier *buf);
+
+// Emit all pending pipeline barriers. This must be called before recording
+// any action command (draw, dispatch, copy, clear etc.), as well as before
+// beginning a render pass. Ending a command implicitly flushes barriers.
+void vk_cmd_flush_barriers(struct vk_ctx *vk, struct vk_cmd *cmd);
+
 // Synchronization scope
 struct vk_sync_scope {
     uint64_t value;             // last timeline semaphore value
@@ -126,24 +148,35 @@ void vk_cmdpool_destroy(struct vk_ctx *vk, struct vk_cmdpool *pool);
 struct vk_cmd *vk_cmd_begin(struct vk_ctx *vk, struct vk_cmdpool *pool,
                             pl_debug_tag debug_tag);
 
-// Finish recording a command buffer and submit it for execution. This function
-// takes over ownership of **cmd, and sets *cmd to NULL in doing so.
+// Finish recording a command buffer and queue it for execution. Queued
+// commands are submitted in batches, with one vkQueueSubmit per queue, the
+// next time commands are flushed. This function takes over ownership of
+// **cmd, and sets *cmd to NULL in doing so.
+bool vk_cmd_queue(struct vk_ctx *vk, struct vk_cmd **cmd);
+
+// Like `vk_cmd_queue`, but also flushes all queued commands. Use this when
+// the effects of the command must be observable outside of libplacebo.
 bool vk_cmd_submit(struct vk_ctx *vk, struct vk_cmd **cmd);
 
+// Submit all queued commands for execution.
+bool vk_flush_commands(struct vk_ctx *vk);
+
 // Block until some commands complete executing. This is the only function that
 // actually processes the callbacks. Will wait at most `timeout` nanoseconds
 // for the completion of any command. The timeout may also be passed as 0, in
 // which case this function will not block, but only poll for completed
 // commands. Returns whether any forward progress was made.
 //
-// This does *not* flush any queued commands, forgetting to do so may result
-// in infinite loops if waiting for the completion of callbacks that were
-// never flushed!
+// Queued commands are implicitly flushed when blocking (`timeout` > 0), but
+// not otherwise. Note that this also does *not* flush the currently
+// recording command, forgetting to do so may result in infinite loops if
+// waiting for the completion of callbacks that were never submitted!
 bool vk_poll_commands(struct vk_ctx *vk, uint64_t timeout);
 
 // Rotate through queues in each command pool. Call this once per frame, after
 // submitting all of the command buffers for that frame. Calling this more
-// often than that is possible but bad for performance.
+// often than that is possible but bad for performance. Also logs and resets
+// the submission statistics.
 void vk_rotate_queues(struct vk_ctx *vk);
 
 // Wait until all commands are complete, i.e. the device is idle. This is
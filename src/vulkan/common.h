@@ -44,6 +44,10 @@
 // Hard-coded limit on the number of pending commands, to avoid OOM loops
 #define PL_VK_MAX_PENDING_CMDS 1024
 
+// Maximum number of commands that are queued up before being submitted in
+// a single batch, to avoid starving the GPU
+#define PL_VK_MAX_QUEUED_CMDS 16
+
 // Shitty compatibility alias for very old vulkan.h versions
 #ifndef VK_API_VERSION_1_2
 #define VK_API_VERSION_1_2 VK_MAKE_VERSION(1, 2, 0)
@@ -88,6 +92,11 @@ struct vk_ctx {
     // Pending commands. These are shared for the entire mpvk_ctx to ensure
     // submission and callbacks are FIFO
     PL_ARRAY(struct vk_cmd *) cmds_pending; // submitted but not completed
+    PL_ARRAY(struct vk_cmd *) cmds_queued;  // finished but not yet submitted
+
+    // Submission statistics, reset by `vk_rotate_queues`
+    int stat_cmds;      // number of commands submitted
+    int stat_submits;   // number of vkQueueSubmit calls used to do so
 
     // Pending callbacks that still need to be drained before processing
     // callbacks for the next command (in case commands are recursively being
@@ -107,10 +116,12 @@ struct vk_ctx {
     PL_VK_FUN(GetPhysicalDeviceFormatProperties2KHR);
     PL_VK_FUN(GetPhysicalDeviceImageFormatProperties2KHR);
     PL_VK_FUN(GetPhysicalDeviceMemoryProperties);
+    PL_VK_FUN(GetPhysicalDeviceMemoryProperties2);
     PL_VK_FUN(GetPhysicalDeviceProperties);
     PL_VK_FUN(GetPhysicalDeviceProperties2);
     PL_VK_FUN(GetPhysicalDeviceQueueFamilyProperties);
     PL_VK_FUN(GetPhysicalDeviceSurfaceCapabilitiesKHR);
+    PL_VK_FUN(GetPhysicalDeviceSurfaceCapabilities2KHR);
     PL_VK_FUN(GetPhysicalDeviceSurfaceFormatsKHR);
     PL_VK_FUN(GetPhysicalDeviceSurfacePresentModesKHR);
     PL_VK_FUN(GetPhysicalDeviceSurfaceSupportKHR);
@@ -205,12 +216,15 @@ struct vk_ctx {
     PL_VK_FUN(GetMemoryFdKHR);
     PL_VK_FUN(GetMemoryFdPropertiesKHR);
     PL_VK_FUN(GetMemoryHostPointerPropertiesEXT);
+    PL_VK_FUN(GetPastPresentationTimingGOOGLE);
     PL_VK_FUN(GetPipelineCacheData);
     PL_VK_FUN(GetQueryPoolResults);
+    PL_VK_FUN(GetRefreshCycleDurationGOOGLE);
     PL_VK_FUN(GetSemaphoreFdKHR);
     PL_VK_FUN(GetSwapchainImagesKHR);
     PL_VK_FUN(InvalidateMappedMemoryRanges);
     PL_VK_FUN(MapMemory);
+    PL_VK_FUN(MergePipelineCaches);
     PL_VK_FUN(QueuePresentKHR);
     PL_VK_FUN(QueueSubmit);
     PL_VK_FUN(ResetEvent);
@@ -226,4 +240,22 @@ struct vk_ctx {
     PL_VK_FUN(GetMemoryWin32HandleKHR);
     PL_VK_FUN(GetSemaphoreWin32HandleKHR);
 #endif
+
+#ifdef VK_KHR_dynamic_rendering
+    PL_VK_FUN(CmdBeginRenderingKHR);
+    PL_VK_FUN(CmdEndRenderingKHR);
+#endif
+
+#ifdef VK_KHR_present_wait
+    PL_VK_FUN(WaitForPresentKHR);
+#endif
+
+#ifdef VK_EXT_descriptor_buffer
+    PL_VK_FUN(CmdBindDescriptorBuffersEXT);
+    PL_VK_FUN(CmdSetDescriptorBufferOffsetsEXT);
+    PL_VK_FUN(GetBufferDeviceAddressKHR);
+    PL_VK_FUN(GetDescriptorEXT);
+    PL_VK_FUN(GetDescriptorSetLayoutBindingOffsetEXT);
+    PL_VK_FUN(GetDescriptorSetLayoutSizeEXT);
+#endif
 };
@@ -38,6 +38,7 @@ struct vk_ext {
     const char *name;
     uint32_t core_ver;
     struct vk_fun *funs;
+    bool swapchain; // only enabled alongside VK_KHR_swapchain
 };
 
 #define PL_VK_INST_FUN(N)                   \
@@ -57,6 +58,10 @@ static const char *vk_instance_extensions[] = {
     VK_EXT_SWAPCHAIN_COLOR_SPACE_EXTENSION_NAME,
     VK_KHR_EXTERNAL_MEMORY_CAPABILITIES_EXTENSION_NAME,
     VK_KHR_EXTERNAL_SEMAPHORE_CAPABILITIES_EXTENSION_NAME,
+#ifdef VK_EXT_surface_maintenance1
+    VK_KHR_GET_SURFACE_CAPABILITIES_2_EXTENSION_NAME,
+    VK_EXT_SURFACE_MAINTENANCE_1_EXTENSION_NAME,
+#endif
 };
 
 // List of mandatory instance-level function pointers, including functions
@@ -72,6 +77,7 @@ static const struct vk_fun vk_inst_funs[] = {
     PL_VK_INST_FUN(GetPhysicalDeviceFormatProperties2KHR),
     PL_VK_INST_FUN(GetPhysicalDeviceImageFormatProperties2KHR),
     PL_VK_INST_FUN(GetPhysicalDeviceMemoryProperties),
+    PL_VK_INST_FUN(GetPhysicalDeviceMemoryProperties2),
     PL_VK_INST_FUN(GetPhysicalDeviceProperties),
     PL_VK_INST_FUN(GetPhysicalDeviceProperties2),
     PL_VK_INST_FUN(GetPhysicalDeviceQueueFamilyProperties),
@@ -177,6 +183,74 @@ static const struct vk_ext vk_device_extensions[] = {
             PL_VK_DEV_FUN(WaitSemaphoresKHR),
             {0}
         },
+    }, {
+        .name = VK_EXT_MEMORY_BUDGET_EXTENSION_NAME,
+#ifdef VK_EXT_graphics_pipeline_library
+    }, {
+        .name = VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME,
+    }, {
+        .name = VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME,
+#endif
+#ifdef VK_EXT_descriptor_buffer
+    }, {
+        .name = VK_KHR_BUFFER_DEVICE_ADDRESS_EXTENSION_NAME,
+        .core_ver = VK_API_VERSION_1_2,
+        .funs = (struct vk_fun[]) {
+            PL_VK_DEV_FUN(GetBufferDeviceAddressKHR),
+            {0}
+        },
+    }, {
+        .name = VK_EXT_DESCRIPTOR_BUFFER_EXTENSION_NAME,
+        .funs = (struct vk_fun[]) {
+            PL_VK_DEV_FUN(CmdBindDescriptorBuffersEXT),
+            PL_VK_DEV_FUN(CmdSetDescriptorBufferOffsetsEXT),
+            PL_VK_DEV_FUN(GetDescriptorEXT),
+            PL_VK_DEV_FUN(GetDescriptorSetLayoutBindingOffsetEXT),
+            PL_VK_DEV_FUN(GetDescriptorSetLayoutSizeEXT),
+            {0}
+        },
+#endif
+#ifdef VK_KHR_dynamic_rendering
+    }, {
+        .name = VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME,
+        .core_ver = VK_API_VERSION_1_3,
+        .funs = (struct vk_fun[]) {
+            PL_VK_DEV_FUN(CmdBeginRenderingKHR),
+            PL_VK_DEV_FUN(CmdEndRenderingKHR),
+            {0}
+        },
+#endif
+#ifdef VK_KHR_present_wait
+    }, {
+        .name = VK_KHR_PRESENT_ID_EXTENSION_NAME,
+        .swapchain = true,
+    }, {
+        .name = VK_KHR_PRESENT_WAIT_EXTENSION_NAME,
+        .swapchain = true,
+        .funs = (struct vk_fun[]) {
+            PL_VK_DEV_FUN(WaitForPresentKHR),
+            {0}
+        },
+#endif
+    }, {
+        .name = VK_GOOGLE_DISPLAY_TIMING_EXTENSION_NAME,
+        .swapchain = true,
+        .funs = (struct vk_fun[]) {
+            PL_VK_DEV_FUN(GetPastPresentationTimingGOOGLE),
+            PL_VK_DEV_FUN(GetRefreshCycleDurationGOOGLE),
+            {0}
+        },
+#ifdef VK_EXT_swapchain_maintenance1
+    }, {
+        .name = VK_EXT_SWAPCHAIN_MAINTENANCE_1_EXTENSION_NAME,
+        .swapchain = true,
+        .funs = (struct vk_fun[]) {
+            // From VK_KHR_get_surface_capabilities2, needed to query the
+            // compatible present modes
+            PL_VK_INST_FUN(GetPhysicalDeviceSurfaceCapabilities2KHR),
+            {0}
+        },
+#endif
 #ifdef VK_KHR_portability_subset
     }, {
         .name = VK_KHR_PORTABILITY_SUBSET_EXTENSION_NAME,
@@ -201,6 +275,26 @@ const char * const pl_vulkan_recommended_extensions[] = {
     VK_KHR_IMAGE_FORMAT_LIST_EXTENSION_NAME,
     VK_EXT_IMAGE_DRM_FORMAT_MODIFIER_EXTENSION_NAME,
     VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME,
+    VK_EXT_MEMORY_BUDGET_EXTENSION_NAME,
+#ifdef VK_EXT_graphics_pipeline_library
+    VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME,
+    VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME,
+#endif
+#ifdef VK_EXT_descriptor_buffer
+    VK_KHR_BUFFER_DEVICE_ADDRESS_EXTENSION_NAME,
+    VK_EXT_DESCRIPTOR_BUFFER_EXTENSION_NAME,
+#endif
+#ifdef VK_KHR_dynamic_rendering
+    VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME,
+#endif
+#ifdef VK_KHR_present_wait
+    VK_KHR_PRESENT_ID_EXTENSION_NAME,
+    VK_KHR_PRESENT_WAIT_EXTENSION_NAME,
+#endif
+    VK_GOOGLE_DISPLAY_TIMING_EXTENSION_NAME,
+#ifdef VK_EXT_swapchain_maintenance1
+    VK_EXT_SWAPCHAIN_MAINTENANCE_1_EXTENSION_NAME,
+#endif
 #ifdef VK_KHR_portability_subset
     VK_KHR_PORTABILITY_SUBSET_EXTENSION_NAME,
 #endif
@@ -216,20 +310,96 @@ static_assert(PL_ARRAY_SIZE(pl_vulkan_recommended_extensions) + 1 ==
               "vk_device_extensions?");
 
 // pNext chain of features we want enabled
+#ifdef VK_EXT_graphics_pipeline_library
+static const VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT pipeline_library = {
+    .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT,
+    .graphicsPipelineLibrary = true,
+};
+#endif
+
 static const VkPhysicalDeviceTimelineSemaphoreFeatures timeline_semaphores = {
     .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES,
+#ifdef VK_EXT_graphics_pipeline_library
+    .pNext = (void *) &pipeline_library,
+#endif
     .timelineSemaphore = true,
 };
 
+#ifdef VK_KHR_dynamic_rendering
+static const VkPhysicalDeviceDynamicRenderingFeaturesKHR dynamic_rendering = {
+    .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES_KHR,
+    .pNext = (void *) &timeline_semaphores,
+    .dynamicRendering = true,
+};
+#endif
+
 static const VkPhysicalDeviceHostQueryResetFeatures host_query_reset = {
     .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_HOST_QUERY_RESET_FEATURES,
+#ifdef VK_KHR_dynamic_rendering
+    .pNext = (void *) &dynamic_rendering,
+#else
     .pNext = (void *) &timeline_semaphores,
+#endif
     .hostQueryReset = true,
 };
 
+#ifdef VK_EXT_descriptor_buffer
+static const VkPhysicalDeviceBufferDeviceAddressFeatures buffer_device_address = {
+    .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_BUFFER_DEVICE_ADDRESS_FEATURES,
+    .pNext = (void *) &host_query_reset,
+    .bufferDeviceAddress = true,
+};
+
+static const VkPhysicalDeviceDescriptorBufferFeaturesEXT descriptor_buffer = {
+    .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_BUFFER_FEATURES_EXT,
+    .pNext = (void *) &buffer_device_address,
+    .descriptorBuffer = true,
+};
+#endif
+
+#ifdef VK_KHR_present_wait
+static const VkPhysicalDevicePresentIdFeaturesKHR present_id = {
+    .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR,
+#ifdef VK_EXT_descriptor_buffer
+    .pNext = (void *) &descriptor_buffer,
+#else
+    .pNext = (void *) &host_query_reset,
+#endif
+    .presentId = true,
+};
+
+static const VkPhysicalDevicePresentWaitFeaturesKHR present_wait = {
+    .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR,
+    .pNext = (void *) &present_id,
+    .presentWait = true,
+};
+#endif
+
+#ifdef VK_EXT_swapchain_maintenance1
+static const VkPhysicalDeviceSwapchainMaintenance1FeaturesEXT swapchain_maintenance1 = {
+    .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SWAPCHAIN_MAINTENANCE_1_FEATURES_EXT,
+#if defined(VK_KHR_present_wait)
+    .pNext = (void *) &present_wait,
+#elif defined(VK_EXT_descriptor_buffer)
+    .pNext = (void *) &descriptor_buffer,
+#else
+    .pNext = (void *) &host_query_reset,
+#endif
+    .swapchainMaintenance1 = true,
+};
+#endif
+
 const VkPhysicalDeviceFeatures2 pl_vulkan_recommended_features = {
     .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+#if defined(VK_EXT_swapchain_maintenance1)
+    .pNext = (void *) &swapchain_maintenance1,
+#elif defined(VK_KHR_present_wait)
+    .pNext = (void *) &present_wait,
+#elif defined(VK_EXT_descriptor_buffer)
+    .pNext = (void *) &descriptor_buffer,
+#else
     .pNext = (void *) &host_query_reset,
+#endif
     .features = {
         .shaderImageGatherExtended = true,
         .shaderStorageImageReadWithoutFormat = true,
@@ -330,6 +500,7 @@ static const struct vk_fun vk_dev_funs[] = {
     PL_VK_DEV_FUN(GetQueryPoolResults),
     PL_VK_DEV_FUN(InvalidateMappedMemoryRanges),
     PL_VK_DEV_FUN(MapMemory),
+    PL_VK_DEV_FUN(MergePipelineCaches),
     PL_VK_DEV_FUN(QueueSubmit),
     PL_VK_DEV_FUN(ResetEvent),
     PL_VK_DEV_FUN(ResetFences),
@@ -901,6 +1072,21 @@ VkPhysicalDevice pl_vulkan_choose_device(pl_log log,
         PL_INFO(vk, "    GPU %d: %s (%s)", i, prop.properties.deviceName, dtype);
         PL_INFO(vk, "           uuid: %s", PRINT_UUID(id_props.deviceUUID));
 
+        // Check for explicitly requested devices first, to avoid probing
+        // surface support for devices we're going to exclude anyway
+        bool name_set = params->device_name && params->device_name[0] != '\0';
+        if (uuid_set) {
+            if (memcmp(id_props.deviceUUID, params->device_uuid, VK_UUID_SIZE) != 0) {
+                PL_DEBUG(vk, "     -> excluding due to UUID mismatch");
+                continue;
+            }
+        } else if (name_set) {
+            if (strcmp(params->device_name, prop.properties.deviceName) != 0) {
+                PL_DEBUG(vk, "      -> excluding due to name mismatch");
+                continue;
+            }
+        }
+
         if (params->surface) {
             if (!supports_surf(log, inst, get_addr, devices[i], params->surface)) {
                 PL_DEBUG(vk, "      -> excluding due to lack of surface support");
@@ -909,21 +1095,12 @@ VkPhysicalDevice pl_vulkan_choose_device(pl_log log,
         }
 
         if (uuid_set) {
-            if (memcmp(id_props.deviceUUID, params->device_uuid, VK_UUID_SIZE) == 0) {
-                dev = devices[i];
-                continue;
-            } else {
-                PL_DEBUG(vk, "     -> excluding due to UUID mismatch");
-                continue;
-            }
-        } else if (params->device_name && params->device_name[0] != '\0') {
-            if (strcmp(params->device_name, prop.properties.deviceName) == 0) {
-                dev = devices[i];
-                continue;
-            } else {
-                PL_DEBUG(vk, "      -> excluding due to name mismatch");
-                continue;
-            }
+            // UUIDs are unique, so there's no need to look any further
+            dev = devices[i];
+            break;
+        } else if (name_set) {
+            dev = devices[i];
+            continue;
         }
 
         if (!params->allow_software && t == VK_PHYSICAL_DEVICE_TYPE_CPU) {
@@ -1075,8 +1252,11 @@ static bool device_init(struct vk_ctx *vk, const struct pl_vulkan_params *params
         PL_DEBUG(vk, "    %s", exts_avail[i].extensionName);
 
     // Add all extensions we need
+    bool has_swapchain = params->surface;
     if (params->surface)
         PL_ARRAY_APPEND(vk->alloc, vk->exts, VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+    for (int i = 0; i < params->num_extensions; i++)
+        has_swapchain |= !strcmp(params->extensions[i], VK_KHR_SWAPCHAIN_EXTENSION_NAME);
 
     // Keep track of all optional function pointers associated with extensions
     PL_ARRAY(const struct vk_fun *) ext_funs = {0};
@@ -1091,6 +1271,9 @@ static bool device_init(struct vk_ctx *vk, const struct pl_vulkan_params *params
             continue;
         }
 
+        if (ext->swapchain && !has_swapchain)
+            continue; // dependency not satisfied
+
         for (int n = 0; n < num_exts_avail; n++) {
             if (strcmp(ext->name, exts_avail[n].extensionName) == 0) {
                 PL_ARRAY_APPEND(vk->alloc, vk->exts, ext->name);
@@ -1253,7 +1436,8 @@ static void unlock_queue(pl_vulkan pl_vk, int qf, int qidx)
     vk->unlock_queue(vk->queue_ctx, qf, qidx);
 }
 
-static bool finalize_context(struct pl_vulkan *pl_vk, int max_glsl_version)
+static bool finalize_context(struct pl_vulkan *pl_vk, int max_glsl_version,
+                             float max_budget_usage, size_t max_bar_usage)
 {
     struct vk_ctx *vk = PL_PRIV(pl_vk);
 
@@ -1261,7 +1445,7 @@ static bool finalize_context(struct pl_vulkan *pl_vk, int max_glsl_version)
     pl_assert(vk->pool_compute);
     pl_assert(vk->pool_transfer);
 
-    vk->ma = vk_malloc_create(vk);
+    vk->ma = vk_malloc_create(vk, max_budget_usage, max_bar_usage);
     if (!vk->ma)
         return false;
 
@@ -1428,7 +1612,8 @@ pl_vulkan pl_vulkan_create(pl_log log, const struct pl_vulkan_params *params)
     if (!device_init(vk, params))
         goto error;
 
-    if (!finalize_context(pl_vk, params->max_glsl_version))
+    if (!finalize_context(pl_vk, params->max_glsl_version,
+                          params->max_budget_usage, params->max_bar_usage))
         goto error;
 
     return pl_vk;
@@ -1525,6 +1710,29 @@ pl_vulkan pl_vulkan_import(pl_log log, const struct pl_vulkan_import_params *par
             vk_link_struct(features, vk_struct_memdup(vk->alloc, &ts));
         }
 
+#ifdef VK_EXT_descriptor_buffer
+        if (vk12 && vk12->bufferDeviceAddress) {
+            const VkPhysicalDeviceBufferDeviceAddressFeatures bda = {
+                .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_BUFFER_DEVICE_ADDRESS_FEATURES,
+                .bufferDeviceAddress = true,
+            };
+            vk_link_struct(features, vk_struct_memdup(vk->alloc, &bda));
+        }
+#endif
+
+#ifdef VK_KHR_dynamic_rendering
+        const VkPhysicalDeviceVulkan13Features *vk13 = vk_find_struct(features,
+            VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES);
+
+        if (vk13 && vk13->dynamicRendering) {
+            const VkPhysicalDeviceDynamicRenderingFeaturesKHR dr = {
+                .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES_KHR,
+                .dynamicRendering = true,
+            };
+            vk_link_struct(features, vk_struct_memdup(vk->alloc, &dr));
+        }
+#endif
+
         vk->features = *features;
     }
 
@@ -1625,7 +1833,8 @@ next_qf: ;
         goto error;
     }
 
-    if (!finalize_context(pl_vk, params->max_glsl_version))
+    if (!finalize_context(pl_vk, params->max_glsl_version,
+                          params->max_budget_usage, params->max_bar_usage))
         goto error;
 
     pl_free(tmp);
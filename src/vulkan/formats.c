@@ -184,6 +184,9 @@ void vk_setup_formats(struct pl_gpu *gpu)
     // Texture format emulation requires at least support for texel buffers
     bool has_emu = gpu->glsl.compute && gpu->limits.max_buffer_texels;
 
+    // DRM format modifiers are only relevant for dma-buf interop
+    bool has_dmabuf = (gpu->export_caps.tex | gpu->import_caps.tex) & PL_HANDLE_DMA_BUF;
+
     for (const struct vk_format *pvk_fmt = vk_formats; pvk_fmt->tfmt; pvk_fmt++) {
         const struct vk_format *vk_fmt = pvk_fmt;
 
@@ -194,7 +197,10 @@ void vk_setup_formats(struct pl_gpu *gpu)
         // Suppress some errors/warnings spit out by the format probing code
         pl_log_level_cap(vk->log, PL_LOG_INFO);
 
+        // Querying the modifier list can be fairly expensive on some drivers,
+        // so skip it for formats that can't be shared as dma-bufs anyway
         bool has_drm_mods = vk->GetImageDrmFormatModifierPropertiesEXT;
+        bool probe_mods = has_drm_mods && has_dmabuf && pl_fmt_fourcc(&vk_fmt->fmt);
         VkDrmFormatModifierPropertiesEXT modifiers[16] = {0};
         VkDrmFormatModifierPropertiesListEXT drm_props = {
             .sType = VK_STRUCTURE_TYPE_DRM_FORMAT_MODIFIER_PROPERTIES_LIST_EXT,
@@ -204,7 +210,7 @@ void vk_setup_formats(struct pl_gpu *gpu)
 
         VkFormatProperties2KHR prop2 = {
             .sType = VK_STRUCTURE_TYPE_FORMAT_PROPERTIES_2,
-            .pNext = has_drm_mods ? &drm_props : NULL,
+            .pNext = probe_mods ? &drm_props : NULL,
         };
 
         vk->GetPhysicalDeviceFormatProperties2KHR(vk->physd, vk_fmt->tfmt, &prop2);
@@ -214,6 +220,11 @@ void vk_setup_formats(struct pl_gpu *gpu)
         VkFormatProperties *prop = &prop2.formatProperties;
         while (has_emu && !prop->optimalTilingFeatures && vk_fmt->emufmt) {
             vk_fmt = vk_fmt->emufmt;
+            if (probe_mods) {
+                // Emulated formats can't be shared, so don't bother
+                prop2.pNext = NULL;
+                probe_mods = false;
+            }
             vk->GetPhysicalDeviceFormatProperties2KHR(vk->physd, vk_fmt->tfmt, &prop2);
         }
 
@@ -254,7 +265,7 @@ void vk_setup_formats(struct pl_gpu *gpu)
         // We can set this universally
         fmt->fourcc = pl_fmt_fourcc(fmt);
 
-        if (has_drm_mods) {
+        if (probe_mods) {
 
             if (drm_props.drmFormatModifierCount == PL_ARRAY_SIZE(modifiers)) {
                 PL_WARN(gpu, "DRM modifier list for format %s possibly truncated",
@@ -298,7 +309,7 @@ void vk_setup_formats(struct pl_gpu *gpu)
             fmt->num_modifiers = modlist.num;
             fmt->modifiers = modlist.elem;
 
-        } else if (gpu->export_caps.tex & PL_HANDLE_DMA_BUF) {
+        } else if (!has_drm_mods && (gpu->export_caps.tex & PL_HANDLE_DMA_BUF)) {
 
             // Hard-code a list of static mods that we're likely to support
             static const uint64_t static_mods[2] = {
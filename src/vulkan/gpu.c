@@ -18,19 +18,32 @@
 #include "gpu.h"
 #include "formats.h"
 #include "glsl/spirv.h"
+#include "pl_clock.h"
 
 #ifdef PL_HAVE_UNIX
 #include <unistd.h>
 #endif
 
-// Gives us enough queries for 8 results
+// Gives us enough queries for 8 results per timer
 #define QUERY_POOL_SIZE 16
 
+// Number of timers sharing a single VkQueryPool
+#define TIMER_POOL_SLOTS 64
+
+struct vk_timer_pool {
+    VkQueryPool qpool;
+    uint64_t used; // bitmask of slots in use
+};
+
 struct pl_timer {
-    VkQueryPool qpool; // even=start, odd=stop
+    struct vk_timer_pool *pool;
+    int slot;
+    uint32_t base; // first query of this timer in `pool`; even=start, odd=stop
     int index_write; // next index to write to
     int index_read; // next index to read from
     uint64_t pending; // bitmask of queries that are still running
+    uint64_t fetched; // bitmask of queries already read back into `results`
+    uint64_t results[QUERY_POOL_SIZE / 2];
 };
 
 static inline uint64_t timer_bit(int index)
@@ -41,10 +54,11 @@ static inline uint64_t timer_bit(int index)
 static void timer_destroy_cb(pl_gpu gpu, pl_timer timer)
 {
     struct pl_vk *p = PL_PRIV(gpu);
-    struct vk_ctx *vk = p->vk;
 
     pl_assert(!timer->pending);
-    vk->DestroyQueryPool(vk->dev, timer->qpool, PL_VK_ALLOC);
+    pl_mutex_lock(&p->timer_lock);
+    timer->pool->used &= ~(1llu << timer->slot);
+    pl_mutex_unlock(&p->timer_lock);
     pl_free(timer);
 }
 
@@ -52,37 +66,70 @@ static pl_timer vk_timer_create(pl_gpu gpu)
 {
     struct pl_vk *p = PL_PRIV(gpu);
     struct vk_ctx *vk = p->vk;
+    pl_timer timer = NULL;
 
-    pl_timer timer = pl_alloc_ptr(NULL, timer);
-    *timer = (struct pl_timer) {0};
+    pl_mutex_lock(&p->timer_lock);
 
-    struct VkQueryPoolCreateInfo qinfo = {
-        .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
-        .queryType = VK_QUERY_TYPE_TIMESTAMP,
-        .queryCount = QUERY_POOL_SIZE,
-    };
+    // Sub-allocate the queries from a shared pool, to avoid creating (and
+    // binding) a separate tiny VkQueryPool for every single timer
+    struct vk_timer_pool *pool = NULL;
+    for (int i = 0; i < p->timer_pools.num; i++) {
+        if (~p->timer_pools.elem[i]->used) {
+            pool = p->timer_pools.elem[i];
+            break;
+        }
+    }
 
-    VK(vk->CreateQueryPool(vk->dev, &qinfo, PL_VK_ALLOC, &timer->qpool));
-    return timer;
+    if (!pool) {
+        struct VkQueryPoolCreateInfo qinfo = {
+            .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+            .queryType = VK_QUERY_TYPE_TIMESTAMP,
+            .queryCount = QUERY_POOL_SIZE * TIMER_POOL_SLOTS,
+        };
+
+        VkQueryPool qpool;
+        VK(vk->CreateQueryPool(vk->dev, &qinfo, PL_VK_ALLOC, &qpool));
+        pool = pl_zalloc_ptr(NULL, pool);
+        pool->qpool = qpool;
+        PL_ARRAY_APPEND(NULL, p->timer_pools, pool);
+    }
+
+    int slot = 0;
+    while (pool->used & (1llu << slot))
+        slot++;
+    pool->used |= 1llu << slot;
+
+    timer = pl_alloc_ptr(NULL, timer);
+    *timer = (struct pl_timer) {
+        .pool = pool,
+        .slot = slot,
+        .base = slot * QUERY_POOL_SIZE,
+    };
 
+    // fall through
 error:
-    timer_destroy_cb(gpu, timer);
-    return NULL;
+    pl_mutex_unlock(&p->timer_lock);
+    return timer;
 }
 
-static void vk_timer_destroy(pl_gpu gpu, pl_timer timer)
+void vk_gpu_callback(pl_gpu gpu, vk_cb callback, const void *priv, const void *arg)
 {
     struct pl_vk *p = PL_PRIV(gpu);
     struct vk_ctx *vk = p->vk;
     pl_mutex_lock(&p->recording);
     if (p->cmd) {
-        vk_cmd_callback(p->cmd, (vk_cb) timer_destroy_cb, gpu, timer);
+        vk_cmd_callback(p->cmd, callback, priv, arg);
     } else {
-        vk_dev_callback(vk, (vk_cb) timer_destroy_cb, gpu, timer);
+        vk_dev_callback(vk, callback, priv, arg);
     }
     pl_mutex_unlock(&p->recording);
 }
 
+static void vk_timer_destroy(pl_gpu gpu, pl_timer timer)
+{
+    vk_gpu_callback(gpu, (vk_cb) timer_destroy_cb, gpu, timer);
+}
+
 static uint64_t vk_timer_query(pl_gpu gpu, pl_timer timer)
 {
     struct pl_vk *p = PL_PRIV(gpu);
@@ -91,26 +138,49 @@ static uint64_t vk_timer_query(pl_gpu gpu, pl_timer timer)
     if (timer->index_read == timer->index_write)
         return 0; // no more unprocessed results
 
-    vk_poll_commands(vk, 0);
-    if (timer->pending & timer_bit(timer->index_read))
-        return 0; // still waiting for results
-
-    VkResult res;
-    uint64_t ts[2] = {0};
-    res = vk->GetQueryPoolResults(vk->dev, timer->qpool, timer->index_read, 2,
-                                  sizeof(ts), &ts[0], sizeof(uint64_t),
-                                  VK_QUERY_RESULT_64_BIT);
-
-    switch (res) {
-    case VK_SUCCESS:
-        timer->index_read = (timer->index_read + 2) % QUERY_POOL_SIZE;
-        return (ts[1] - ts[0]) * vk->limits.timestampPeriod;
-    case VK_NOT_READY:
-        return 0;
-    default:
-        PL_VK_ASSERT(res, "Retrieving query pool results");
+    uint64_t bit = timer_bit(timer->index_read);
+    if (!(timer->fetched & bit)) {
+        vk_poll_commands(vk, 0);
+        if (timer->pending & bit)
+            return 0; // still waiting for results
+
+        // Read back all completed results in one go, rather than issuing a
+        // separate call for every single one
+        int num = 0;
+        for (int idx = timer->index_read; idx != timer->index_write &&
+             idx < QUERY_POOL_SIZE && !(timer->pending & timer_bit(idx)); idx += 2)
+        {
+            num++;
+        }
+
+        uint64_t ts[QUERY_POOL_SIZE];
+        VkResult res;
+        res = vk->GetQueryPoolResults(vk->dev, timer->pool->qpool,
+                                      timer->base + timer->index_read, 2 * num,
+                                      2 * num * sizeof(uint64_t), &ts[0],
+                                      sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+
+        switch (res) {
+        case VK_SUCCESS:
+            for (int i = 0; i < num; i++) {
+                int idx = timer->index_read + 2 * i;
+                uint64_t delta = ts[2 * i + 1] - ts[2 * i];
+                timer->results[idx / 2] = delta * vk->limits.timestampPeriod;
+                timer->fetched |= timer_bit(idx);
+            }
+            break;
+        case VK_NOT_READY:
+            return 0;
+        default:
+            PL_VK_ASSERT(res, "Retrieving query pool results");
+        }
     }
 
+    timer->fetched &= ~bit;
+    uint64_t ret = timer->results[timer->index_read / 2];
+    timer->index_read = (timer->index_read + 2) % QUERY_POOL_SIZE;
+    return ret;
+
 error:
     return 0;
 }
@@ -135,10 +205,12 @@ static void timer_begin(pl_gpu gpu, struct vk_cmd *cmd, pl_timer timer)
     VkQueueFlags reset_flags = VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT;
     if (cmd->pool->props.queueFlags & reset_flags) {
         // Use direct command buffer resets
-        vk->CmdResetQueryPool(cmd->buf, timer->qpool, timer->index_write, 2);
+        vk->CmdResetQueryPool(cmd->buf, timer->pool->qpool,
+                              timer->base + timer->index_write, 2);
     } else if (p->host_query_reset) {
         // Use host query resets
-        vk->ResetQueryPoolEXT(vk->dev, timer->qpool, timer->index_write, 2);
+        vk->ResetQueryPoolEXT(vk->dev, timer->pool->qpool,
+                              timer->base + timer->index_write, 2);
     } else {
         PL_TRACE(gpu, "QF %d supports no mechanism for resetting queries",
                  cmd->pool->qf);
@@ -146,7 +218,7 @@ static void timer_begin(pl_gpu gpu, struct vk_cmd *cmd, pl_timer timer)
     }
 
     vk->CmdWriteTimestamp(cmd->buf, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
-                          timer->qpool, timer->index_write);
+                          timer->pool->qpool, timer->base + timer->index_write);
 
     p->cmd_timer = timer;
 }
@@ -174,7 +246,17 @@ struct vk_cmd *_begin_cmd(pl_gpu gpu, enum queue_type type, const char *label,
     }
 
     if (!p->cmd || p->cmd->pool != pool) {
-        vk_cmd_submit(vk, &p->cmd);
+        // Submit commands recorded on a dedicated transfer queue (i.e. async
+        // texture uploads) immediately, so they can start executing while
+        // the rendering work already in flight is still running. Consumers
+        // on other queues only wait for them upon first use of the texture,
+        // via the timeline semaphore in `vk_sem_barrier`.
+        struct vk_cmdpool *prev = p->cmd ? p->cmd->pool : NULL;
+        if (prev == vk->pool_transfer && prev != vk->pool_graphics) {
+            vk_cmd_submit(vk, &p->cmd);
+        } else {
+            vk_cmd_queue(vk, &p->cmd);
+        }
         p->cmd = vk_cmd_begin(vk, pool, label);
         if (!p->cmd) {
             pl_mutex_unlock(&p->recording);
@@ -182,6 +264,7 @@ struct vk_cmd *_begin_cmd(pl_gpu gpu, enum queue_type type, const char *label,
         }
     }
 
+    vk_buf_flush_writes(gpu, p->cmd);
     if (vk->CmdBeginDebugUtilsLabelEXT && supports_marks(p->cmd)) {
         vk->CmdBeginDebugUtilsLabelEXT(p->cmd->buf, &(VkDebugUtilsLabelEXT) {
             .sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_LABEL_EXT,
@@ -200,7 +283,7 @@ static void timer_end_cb(void *ptimer, void *pindex)
     timer->pending &= ~timer_bit(index);
 }
 
-bool _end_cmd(pl_gpu gpu, struct vk_cmd **pcmd, bool submit)
+bool _end_cmd(pl_gpu gpu, struct vk_cmd **pcmd, bool submit, bool flush)
 {
     struct pl_vk *p = PL_PRIV(gpu);
     struct vk_ctx *vk = p->vk;
@@ -208,7 +291,7 @@ bool _end_cmd(pl_gpu gpu, struct vk_cmd **pcmd, bool submit)
     if (!pcmd) {
         if (submit) {
             pl_mutex_lock(&p->recording);
-            ret = vk_cmd_submit(p->vk, &p->cmd);
+            ret = flush ? vk_cmd_submit(vk, &p->cmd) : vk_cmd_queue(vk, &p->cmd);
             pl_mutex_unlock(&p->recording);
         }
         return ret;
@@ -220,7 +303,8 @@ bool _end_cmd(pl_gpu gpu, struct vk_cmd **pcmd, bool submit)
     if (p->cmd_timer) {
         pl_timer timer = p->cmd_timer;
         vk->CmdWriteTimestamp(cmd->buf, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
-                              timer->qpool, timer->index_write + 1);
+                              timer->pool->qpool,
+                              timer->base + timer->index_write + 1);
 
         timer->pending |= timer_bit(timer->index_write);
         vk_cmd_callback(cmd, (vk_cb) timer_end_cb, timer,
@@ -229,6 +313,7 @@ bool _end_cmd(pl_gpu gpu, struct vk_cmd **pcmd, bool submit)
         timer->index_write = (timer->index_write + 2) % QUERY_POOL_SIZE;
         if (timer->index_write == timer->index_read) {
             // forcibly drop the least recent result to make space
+            timer->fetched &= ~timer_bit(timer->index_read);
             timer->index_read = (timer->index_read + 2) % QUERY_POOL_SIZE;
         }
 
@@ -239,19 +324,26 @@ bool _end_cmd(pl_gpu gpu, struct vk_cmd **pcmd, bool submit)
         vk->CmdEndDebugUtilsLabelEXT(cmd->buf);
 
     if (submit)
-        ret = vk_cmd_submit(vk, &p->cmd);
+        ret = flush ? vk_cmd_submit(vk, &p->cmd) : vk_cmd_queue(vk, &p->cmd);
 
     pl_mutex_unlock(&p->recording);
     return ret;
 }
 
+static void vk_gpu_trim(void *priv)
+{
+    pl_gpu_trim(priv);
+}
+
 static void vk_gpu_destroy(pl_gpu gpu)
 {
     struct pl_vk *p = PL_PRIV(gpu);
     struct vk_ctx *vk = p->vk;
 
+    vk_malloc_set_trim(vk->ma, NULL, NULL);
     pl_dispatch_destroy(&p->dp);
-    vk_cmd_submit(vk, &p->cmd);
+    vk_buf_record_writes(gpu, NULL);
+    CMD_SUBMIT(NULL);
     vk_wait_idle(vk);
 
     for (enum pl_tex_sample_mode s = 0; s < PL_TEX_SAMPLE_MODE_COUNT; s++) {
@@ -259,8 +351,21 @@ static void vk_gpu_destroy(pl_gpu gpu)
             vk->DestroySampler(vk->dev, p->samplers[s][a], PL_VK_ALLOC);
     }
 
+    for (int i = 0; i < p->timer_pools.num; i++) {
+        vk->DestroyQueryPool(vk->dev, p->timer_pools.elem[i]->qpool, PL_VK_ALLOC);
+        pl_free(p->timer_pools.elem[i]);
+    }
+    pl_free(p->timer_pools.elem);
+
+    vk_gpl_uninit(gpu);
+    vk_module_uninit(gpu);
+    vk_pipecache_uninit(gpu);
     spirv_compiler_destroy(&p->spirv);
     pl_mutex_destroy(&p->recording);
+    pl_mutex_destroy(&p->write_lock);
+    pl_mutex_destroy(&p->timer_lock);
+    pl_free(p->buf_writes.elem);
+    pl_free(p->buf_write_data.buf);
     pl_free((void *) gpu);
 }
 
@@ -275,15 +380,21 @@ pl_vulkan pl_vulkan_get(pl_gpu gpu)
     return NULL;
 }
 
-static pl_handle_caps vk_sync_handle_caps(struct vk_ctx *vk)
+static pl_handle_caps vk_sync_handle_caps(struct vk_ctx *vk, bool timeline)
 {
     pl_handle_caps caps = 0;
 
     for (int i = 0; vk_sync_handle_list[i]; i++) {
         enum pl_handle_type type = vk_sync_handle_list[i];
 
+        VkSemaphoreTypeCreateInfo stinfo = {
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+            .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+        };
+
         VkPhysicalDeviceExternalSemaphoreInfo info = {
             .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTERNAL_SEMAPHORE_INFO_KHR,
+            .pNext = timeline ? &stinfo : NULL,
             .handleType = vk_sync_handle_type(type),
         };
 
@@ -388,12 +499,19 @@ pl_gpu pl_gpu_create_vk(struct vk_ctx *vk)
 
     struct pl_vk *p = PL_PRIV(gpu);
     pl_mutex_init(&p->recording);
+    pl_mutex_init(&p->write_lock);
+    pl_mutex_init(&p->timer_lock);
+    pl_mutex_init(&p->pipecache_lock);
+    pl_mutex_init(&p->gpl_lock);
+    pl_mutex_init(&p->module_lock);
     p->impl = pl_fns_vk;
     p->vk = vk;
 
     p->spirv = spirv_compiler_create(vk->log);
     if (!p->spirv)
         goto error;
+    if (!vk_pipecache_init(gpu))
+        goto error;
 
     // Query all device properties
     VkPhysicalDevicePCIBusInfoPropertiesEXT pci_props = {
@@ -433,6 +551,20 @@ pl_gpu pl_gpu_create_vk(struct vk_ctx *vk)
     vk_link_struct(&props, &port_props);
 #endif
 
+#ifdef VK_EXT_graphics_pipeline_library
+    VkPhysicalDeviceGraphicsPipelineLibraryPropertiesEXT gpl_props = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_PROPERTIES_EXT,
+    };
+    vk_link_struct(&props, &gpl_props);
+#endif
+
+#ifdef VK_EXT_descriptor_buffer
+    VkPhysicalDeviceDescriptorBufferPropertiesEXT descbuf_props = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_BUFFER_PROPERTIES_EXT,
+    };
+    vk_link_struct(&props, &descbuf_props);
+#endif
+
 
     vk->GetPhysicalDeviceProperties2(vk->physd, &props);
 
@@ -478,9 +610,11 @@ pl_gpu pl_gpu_create_vk(struct vk_ctx *vk)
         .max_ubo_size       = vk->limits.maxUniformBufferRange,
         .max_ssbo_size      = vk->limits.maxStorageBufferRange,
         .max_vbo_size       = SIZE_MAX,
+        .instancing         = true,
         .max_mapped_size    = SIZE_MAX,
         .max_buffer_texels  = vk->limits.maxTexelBufferElements,
         .align_host_ptr     = host_props.minImportedHostPointerAlignment,
+        .align_ubo_offset   = vk->limits.minUniformBufferOffsetAlignment,
         // pl_tex
         .max_tex_1d_dim     = vk->limits.maxImageDimension1D,
         .max_tex_2d_dim     = vk->limits.maxImageDimension2D,
@@ -511,7 +645,8 @@ pl_gpu pl_gpu_create_vk(struct vk_ctx *vk)
     gpu->import_caps.buf = vk_malloc_handle_caps(vk->ma, true);
     gpu->export_caps.tex = vk_tex_handle_caps(vk, false);
     gpu->import_caps.tex = vk_tex_handle_caps(vk, true);
-    gpu->export_caps.sync = vk_sync_handle_caps(vk);
+    gpu->export_caps.sync = vk_sync_handle_caps(vk, false);
+    gpu->export_caps.sync_timeline = vk_sync_handle_caps(vk, true);
     gpu->import_caps.sync = 0; // Not supported yet
 
     if (pl_gpu_supports_interop(gpu)) {
@@ -535,6 +670,69 @@ pl_gpu pl_gpu_create_vk(struct vk_ctx *vk)
             p->host_query_reset = host_query_reset->hostQueryReset;
     }
 
+#ifdef VK_EXT_graphics_pipeline_library
+    // Only worth it if linking is actually fast, since we link pipelines
+    // on the spot instead of waiting for an optimized pipeline
+    const VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT *gpl;
+    gpl = vk_find_struct(&vk->features,
+        VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT);
+    for (int i = 0; i < vk->exts.num; i++) {
+        if (strcmp(vk->exts.elem[i], VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME) == 0)
+            p->gpl = gpl && gpl->graphicsPipelineLibrary;
+    }
+    p->gpl &= gpl_props.graphicsPipelineLibraryFastLinking;
+    if (p->gpl)
+        PL_DEBUG(gpu, "Using graphics pipeline libraries for raster passes");
+#endif
+
+#ifdef VK_KHR_dynamic_rendering
+    const VkPhysicalDeviceDynamicRenderingFeaturesKHR *dynamic_rendering;
+    dynamic_rendering = vk_find_struct(&vk->features,
+        VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES_KHR);
+    if (vk->CmdBeginRenderingKHR && vk->CmdEndRenderingKHR) {
+        p->dynamic_rendering = dynamic_rendering &&
+                               dynamic_rendering->dynamicRendering;
+    }
+    if (p->dynamic_rendering)
+        PL_DEBUG(gpu, "Using dynamic rendering for raster passes");
+#endif
+
+#ifdef VK_EXT_descriptor_buffer
+    const VkPhysicalDeviceDescriptorBufferFeaturesEXT *descbuf;
+    const VkPhysicalDeviceBufferDeviceAddressFeatures *bda;
+    descbuf = vk_find_struct(&vk->features,
+        VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_BUFFER_FEATURES_EXT);
+    bda = vk_find_struct(&vk->features,
+        VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_BUFFER_DEVICE_ADDRESS_FEATURES);
+    if (vk->GetDescriptorEXT && vk->GetBufferDeviceAddressKHR) {
+        p->descbuf = descbuf && descbuf->descriptorBuffer &&
+                     bda && bda->bufferDeviceAddress;
+    }
+
+    if (p->descbuf) {
+        bool robust = vk->features.features.robustBufferAccess;
+        const VkPhysicalDeviceDescriptorBufferPropertiesEXT *dp = &descbuf_props;
+        p->descbuf_align = dp->descriptorBufferOffsetAlignment;
+        p->descbuf_range = PL_MIN(dp->maxResourceDescriptorBufferRange,
+                                  dp->maxSamplerDescriptorBufferRange);
+        p->descbuf_size[PL_DESC_SAMPLED_TEX] = dp->combinedImageSamplerDescriptorSize;
+        p->descbuf_size[PL_DESC_STORAGE_IMG] = dp->storageImageDescriptorSize;
+        p->descbuf_size[PL_DESC_BUF_UNIFORM] = robust
+            ? dp->robustUniformBufferDescriptorSize
+            : dp->uniformBufferDescriptorSize;
+        p->descbuf_size[PL_DESC_BUF_STORAGE] = robust
+            ? dp->robustStorageBufferDescriptorSize
+            : dp->storageBufferDescriptorSize;
+        p->descbuf_size[PL_DESC_BUF_TEXEL_UNIFORM] = robust
+            ? dp->robustUniformTexelBufferDescriptorSize
+            : dp->uniformTexelBufferDescriptorSize;
+        p->descbuf_size[PL_DESC_BUF_TEXEL_STORAGE] = robust
+            ? dp->robustStorageTexelBufferDescriptorSize
+            : dp->storageTexelBufferDescriptorSize;
+        PL_DEBUG(gpu, "Using descriptor buffers for pass descriptors");
+    }
+#endif
+
     vk_setup_formats(gpu);
 
     // Compute the correct minimum texture alignment
@@ -570,6 +768,9 @@ pl_gpu pl_gpu_create_vk(struct vk_ctx *vk)
         }
     }
 
+    // Release cached resources when running low on memory
+    vk_malloc_set_trim(vk->ma, vk_gpu_trim, gpu);
+
     // Create the dispatch last, after any setup of `gpu` is done
     p->dp = pl_dispatch_create(vk->log, gpu);
     return pl_gpu_finalize(gpu);
@@ -622,13 +823,15 @@ void vk_sync_deref(pl_gpu gpu, pl_sync sync)
         vk_sync_destroy(gpu, sync);
 }
 
-static pl_sync vk_sync_create(pl_gpu gpu, enum pl_handle_type handle_type)
+static pl_sync sync_create(pl_gpu gpu, enum pl_handle_type handle_type,
+                           bool timeline)
 {
     struct pl_vk *p = PL_PRIV(gpu);
     struct vk_ctx *vk = p->vk;
 
     struct pl_sync *sync = pl_zalloc_obj(NULL, sync, struct pl_sync_vk);
     sync->handle_type = handle_type;
+    sync->timeline = timeline;
 
     struct pl_sync_vk *sync_vk = PL_PRIV(sync);
     pl_rc_init(&sync_vk->rc);
@@ -653,6 +856,15 @@ static pl_sync vk_sync_create(pl_gpu gpu, enum pl_handle_type handle_type)
         pl_unreachable();
     }
 
+    VkSemaphoreTypeCreateInfo stinfo = {
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+        .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+        .initialValue = 0,
+    };
+
+    if (timeline)
+        vk_link_struct(&einfo, &stinfo);
+
     const VkSemaphoreCreateInfo sinfo = {
         .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
         .pNext = &einfo,
@@ -704,10 +916,21 @@ error:
     return NULL;
 }
 
+static pl_sync vk_sync_create(pl_gpu gpu, enum pl_handle_type handle_type)
+{
+    return sync_create(gpu, handle_type, false);
+}
+
+static pl_sync vk_sync_create_timeline(pl_gpu gpu, enum pl_handle_type handle_type)
+{
+    return sync_create(gpu, handle_type, true);
+}
+
 static void vk_gpu_flush(pl_gpu gpu)
 {
     struct pl_vk *p = PL_PRIV(gpu);
     struct vk_ctx *vk = p->vk;
+    vk_buf_record_writes(gpu, NULL);
     CMD_SUBMIT(NULL);
     vk_rotate_queues(vk);
     vk_malloc_garbage_collect(vk->ma);
@@ -717,10 +940,59 @@ static void vk_gpu_finish(pl_gpu gpu)
 {
     struct pl_vk *p = PL_PRIV(gpu);
     struct vk_ctx *vk = p->vk;
+    vk_buf_record_writes(gpu, NULL);
     CMD_SUBMIT(NULL);
     vk_wait_idle(vk);
 }
 
+// Frame fences are implemented as device callbacks, which fire once all
+// commands submitted before them have completed
+struct vk_fence {
+    bool done;
+};
+
+static void vk_fence_signal(void *priv, void *arg)
+{
+    struct vk_fence *fence = priv;
+    fence->done = true;
+}
+
+static void *vk_fence_create(pl_gpu gpu)
+{
+    struct pl_vk *p = PL_PRIV(gpu);
+    struct vk_ctx *vk = p->vk;
+    vk_gpu_flush(gpu);
+
+    struct vk_fence *fence = pl_zalloc_ptr(NULL, fence);
+    vk_dev_callback(vk, vk_fence_signal, fence, NULL);
+    return fence;
+}
+
+static bool vk_fence_wait(pl_gpu gpu, void *priv, uint64_t timeout)
+{
+    struct pl_vk *p = PL_PRIV(gpu);
+    struct vk_ctx *vk = p->vk;
+    struct vk_fence *fence = priv;
+    const uint64_t start = timeout ? pl_clock_now() : 0;
+
+    for (;;) {
+        uint64_t left = 0;
+        if (timeout) {
+            uint64_t elapsed = pl_clock_now() - start;
+            left = elapsed < timeout ? timeout - elapsed : 0;
+        }
+
+        vk_poll_commands(vk, left);
+        if (fence->done || !left)
+            return fence->done;
+    }
+}
+
+static void vk_fence_destroy(pl_gpu gpu, void *fence)
+{
+    pl_free(fence);
+}
+
 static bool vk_gpu_is_failed(pl_gpu gpu)
 {
     struct pl_vk *p = PL_PRIV(gpu);
@@ -744,6 +1016,8 @@ struct vk_cmd *pl_vk_steal_cmd(pl_gpu gpu)
         cmd = vk_cmd_begin(vk, pool, NULL);
     }
 
+    if (cmd)
+        vk_buf_flush_writes(gpu, cmd);
     return cmd;
 }
 
@@ -754,11 +1028,27 @@ void pl_vk_print_heap(pl_gpu gpu, enum pl_log_level lev)
     vk_malloc_print_stats(vk->ma, lev);
 }
 
+int pl_vulkan_heap_stats(pl_gpu gpu, struct pl_vulkan_heap_stats out[VK_MAX_MEMORY_HEAPS])
+{
+    if (!pl_vulkan_get(gpu))
+        return 0;
+
+    struct pl_vk *p = PL_PRIV(gpu);
+    return vk_malloc_heap_stats(p->vk->ma, out);
+}
+
+static void vk_memory_stats(pl_gpu gpu, struct pl_gpu_memory_stats *stats)
+{
+    struct pl_vk *p = PL_PRIV(gpu);
+    vk_malloc_memory_stats(p->vk->ma, stats);
+}
+
 static const struct pl_gpu_fns pl_fns_vk = {
     .destroy                = vk_gpu_destroy,
     .tex_create             = vk_tex_create,
     .tex_destroy            = vk_tex_deref,
     .tex_invalidate         = vk_tex_invalidate,
+    .tex_reset_import       = vk_tex_reset_import,
     .tex_clear_ex           = vk_tex_clear_ex,
     .tex_blit               = vk_tex_blit,
     .tex_upload             = vk_tex_upload,
@@ -766,7 +1056,7 @@ static const struct pl_gpu_fns pl_fns_vk = {
     .tex_poll               = vk_tex_poll,
     .tex_export             = vk_tex_export,
     .buf_create             = vk_buf_create,
-    .buf_destroy            = vk_buf_deref,
+    .buf_destroy            = vk_buf_destroy,
     .buf_write              = vk_buf_write,
     .buf_read               = vk_buf_read,
     .buf_copy               = vk_buf_copy,
@@ -777,6 +1067,7 @@ static const struct pl_gpu_fns pl_fns_vk = {
     .pass_destroy           = vk_pass_destroy,
     .pass_run               = vk_pass_run,
     .sync_create            = vk_sync_create,
+    .sync_create_timeline   = vk_sync_create_timeline,
     .sync_destroy           = vk_sync_deref,
     .timer_create           = vk_timer_create,
     .timer_destroy          = vk_timer_destroy,
@@ -784,4 +1075,9 @@ static const struct pl_gpu_fns pl_fns_vk = {
     .gpu_flush              = vk_gpu_flush,
     .gpu_finish             = vk_gpu_finish,
     .gpu_is_failed          = vk_gpu_is_failed,
+    .fence_create           = vk_fence_create,
+    .fence_wait             = vk_fence_wait,
+    .fence_destroy          = vk_fence_destroy,
+    .fence_wait_unlocked    = true,
+    .memory_stats           = vk_memory_stats,
 };
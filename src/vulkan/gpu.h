@@ -50,6 +50,29 @@ enum queue_type {
     ANY,
 };
 
+// A graphics pipeline library shared between passes
+struct vk_gpl_lib {
+    uint64_t key;           // hash of the fixed function state
+    VkPipeline lib;
+};
+
+// A shader module shared between passes with identical SPIR-V
+struct vk_module {
+    uint64_t key;           // hash of the SPIR-V code
+    size_t size;            // size of the SPIR-V code
+    VkShaderModule mod;
+    int refcount;
+    uint64_t last_use;      // for evicting idle modules
+};
+
+// A deferred `vk_buf_write`, see `pl_vk.buf_writes`
+struct vk_buf_write {
+    pl_buf buf;             // holds a reference until recorded
+    size_t offset;
+    size_t size;
+    size_t data_offset;     // offset into `pl_vk.buf_write_data`
+};
+
 struct pl_vk {
     struct pl_gpu_fns impl;
     struct vk_ctx *vk;
@@ -72,23 +95,79 @@ struct pl_vk {
     struct vk_cmd *cmd;
     pl_timer cmd_timer;
 
+    // Small updates to buffers without host mapping are deferred, and
+    // recorded together (behind a single merged barrier) by the next command
+    // begun. See `vk_buf_flush_writes`.
+    pl_mutex write_lock;
+    PL_ARRAY(struct vk_buf_write) buf_writes;
+    pl_str buf_write_data;
+
+    // Shared query pools that all timers are sub-allocated from
+    pl_mutex timer_lock;
+    PL_ARRAY(struct vk_timer_pool *) timer_pools;
+
     // Array of VkSamplers for every combination of sample/address modes
     VkSampler samplers[PL_TEX_SAMPLE_MODE_COUNT][PL_TEX_ADDRESS_MODE_COUNT];
 
+    // Source of unique object IDs, see `vk_obj_id`
+    _Atomic uint64_t obj_ids;
+
+    // Device-wide pipeline cache, shared by all passes. Merging into it
+    // requires exclusive access, so caches loaded by the user are deferred
+    // until no pipelines are being created.
+    VkPipelineCache pipecache;
+    pl_mutex pipecache_lock;
+    int pipecache_users;                        // current users of `pipecache`
+    PL_ARRAY(VkPipelineCache) pipecache_merge;  // pending caches to merge
+
+    // Use VK_EXT_graphics_pipeline_library for raster passes. The vertex
+    // input and fragment output interface libraries only depend on fixed
+    // function state, so they're shared between all passes.
+    bool gpl;
+    pl_mutex gpl_lock;
+    PL_ARRAY(struct vk_gpl_lib) gpl_libs;
+
+    // Device-wide cache of shader modules, so passes sharing the same shader
+    // (e.g. the full-screen quad vertex shader) also share the same module.
+    // Unreferenced modules are kept around for reuse, up to a limit.
+    pl_mutex module_lock;
+    PL_ARRAY(struct vk_module) modules;
+    uint64_t module_clock;
+
+    // Use VK_KHR_dynamic_rendering for raster passes, instead of creating
+    // render pass and framebuffer objects
+    bool dynamic_rendering;
+
+    // Use VK_EXT_descriptor_buffer for passes that can't use push
+    // descriptors, instead of descriptor pools
+    bool descbuf;
+    VkDeviceSize descbuf_align;                 // offset alignment of sets
+    VkDeviceSize descbuf_range;                 // max. range of a binding
+    size_t descbuf_size[PL_DESC_TYPE_COUNT];    // size of each descriptor
+
     // To avoid spamming warnings
     bool warned_modless;
 };
 
 struct vk_cmd *_begin_cmd(pl_gpu, enum queue_type, const char *label, pl_timer);
-bool _end_cmd(pl_gpu, struct vk_cmd **, bool submit);
+bool _end_cmd(pl_gpu, struct vk_cmd **, bool submit, bool flush);
 
 #define CMD_BEGIN(type)              _begin_cmd(gpu, type, __func__, NULL)
 #define CMD_BEGIN_TIMED(type, timer) _begin_cmd(gpu, type, __func__, timer)
-#define CMD_FINISH(cmd) _end_cmd(gpu, cmd, false)
-#define CMD_SUBMIT(cmd) _end_cmd(gpu, cmd, true)
+// CMD_QUEUE defers the actual vkQueueSubmit until the next flush, allowing
+// multiple commands to be batched together
+#define CMD_FINISH(cmd) _end_cmd(gpu, cmd, false, false)
+#define CMD_QUEUE(cmd)  _end_cmd(gpu, cmd, true, false)
+#define CMD_SUBMIT(cmd) _end_cmd(gpu, cmd, true, true)
+
+// Like `vk_dev_callback`, but also waits for the command currently being
+// recorded (if any), which may still reference the object being released.
+// Must not be called while recording a command on the same thread.
+void vk_gpu_callback(pl_gpu, vk_cb callback, const void *priv, const void *arg);
 
 struct pl_tex_vk {
     pl_rc_t rc;
+    uint64_t id; // assigned lazily by `vk_obj_id`, never reused
     bool external_img;
     enum queue_type transfer_queue;
     VkImageType type;
@@ -100,7 +179,7 @@ struct pl_tex_vk {
     // for sampling
     VkImageView view;
     // for rendering
-    VkFramebuffer framebuffer;
+    VkFramebuffer framebuffer; // only without `pl_vk.dynamic_rendering`
     // for vk_tex_upload/download fallback code
     pl_fmt texel_fmt;
 
@@ -116,6 +195,7 @@ struct pl_tex_vk {
 pl_tex vk_tex_create(pl_gpu, const struct pl_tex_params *);
 void vk_tex_deref(pl_gpu, pl_tex);
 void vk_tex_invalidate(pl_gpu, pl_tex);
+void vk_tex_reset_import(pl_gpu, pl_tex);
 void vk_tex_clear_ex(pl_gpu, pl_tex, const union pl_clear_color);
 void vk_tex_blit(pl_gpu, const struct pl_tex_blit_params *);
 bool vk_tex_upload(pl_gpu, const struct pl_tex_transfer_params *);
@@ -127,7 +207,9 @@ void vk_tex_barrier(pl_gpu, struct vk_cmd *, pl_tex, VkPipelineStageFlags,
 
 struct pl_buf_vk {
     pl_rc_t rc;
+    uint64_t id; // assigned lazily by `vk_obj_id`, never reused
     struct vk_memslice mem;
+    struct vk_malloc_params mparams; // for re-allocation by defragmentation
     enum queue_type update_queue;
     VkBufferView view; // for texel buffers
 
@@ -135,10 +217,12 @@ struct pl_buf_vk {
     struct vk_sem sem;
     bool exported;
     bool needs_flush;
+    bool write_pending; // in `pl_vk.buf_writes`, guarded by `write_lock`
 };
 
 pl_buf vk_buf_create(pl_gpu, const struct pl_buf_params *);
 void vk_buf_deref(pl_gpu, pl_buf);
+void vk_buf_destroy(pl_gpu, pl_buf);
 void vk_buf_write(pl_gpu, pl_buf, size_t offset, const void *src, size_t size);
 bool vk_buf_read(pl_gpu, pl_buf, size_t offset, void *dst, size_t size);
 void vk_buf_copy(pl_gpu, pl_buf dst, size_t dst_offset,
@@ -153,6 +237,15 @@ void vk_buf_barrier(pl_gpu, struct vk_cmd *, pl_buf, VkPipelineStageFlags,
 // Flush visible writes to a buffer made by the API
 void vk_buf_flush(pl_gpu, struct vk_cmd *, pl_buf, size_t offset, size_t size);
 
+// Record all deferred buffer writes into `cmd`. Called by `_begin_cmd`, so
+// they always precede any subsequent use of the buffers.
+void vk_buf_flush_writes(pl_gpu, struct vk_cmd *);
+
+// Records the deferred buffer writes into a command of their own, so that
+// a subsequent `CMD_SUBMIT(NULL)` actually submits them. If `buf` is not
+// NULL, this only happens if that buffer has a write pending.
+void vk_buf_record_writes(pl_gpu, pl_buf buf);
+
 struct pl_pass_vk;
 
 int vk_desc_namespace(pl_gpu, enum pl_desc_type);
@@ -160,6 +253,16 @@ pl_pass vk_pass_create(pl_gpu, const struct pl_pass_params *);
 void vk_pass_destroy(pl_gpu, pl_pass);
 void vk_pass_run(pl_gpu, const struct pl_pass_run_params *);
 
+// Create/destroy the device-wide `pl_vk.pipecache`
+bool vk_pipecache_init(pl_gpu);
+void vk_pipecache_uninit(pl_gpu);
+
+// Destroy all shared graphics pipeline libraries
+void vk_gpl_uninit(pl_gpu);
+
+// Destroy all cached shader modules. They must all be unreferenced
+void vk_module_uninit(pl_gpu);
+
 struct pl_sync_vk {
     pl_rc_t rc;
     VkSemaphore wait;
@@ -16,6 +16,16 @@
  */
 
 #include "gpu.h"
+#include "pl_clock.h"
+
+// Maximum size of buffers placed in device-local, host-visible memory by
+// preference, see `vk_malloc_params.streaming`
+#define MAX_STREAMING_SIZE (32 << 20)
+
+// Buffer updates up to this size are deferred and batched, up to a total of
+// `MAX_BATCH_SIZE` bytes at a time
+#define MAX_BATCH_WRITE (4 << 10)
+#define MAX_BATCH_SIZE  (64 << 10)
 
 void vk_buf_barrier(pl_gpu gpu, struct vk_cmd *cmd, pl_buf buf,
                     VkPipelineStageFlags stage, VkAccessFlags access,
@@ -61,10 +71,8 @@ void vk_buf_barrier(pl_gpu gpu, struct vk_cmd *cmd, pl_buf buf,
         .size = size,
     };
 
-    if (last.access || barr.srcQueueFamilyIndex != barr.dstQueueFamilyIndex) {
-        vk->CmdPipelineBarrier(cmd->buf, last.stage, stage, 0, 0, NULL,
-                               1, &barr, 0, NULL);
-    }
+    if (last.access || barr.srcQueueFamilyIndex != barr.dstQueueFamilyIndex)
+        vk_cmd_barrier(vk, cmd, last.stage, stage, NULL, &barr);
 
     buf_vk->exported = export;
     vk_cmd_callback(cmd, (vk_cb) vk_buf_deref, gpu, buf);
@@ -87,6 +95,17 @@ void vk_buf_deref(pl_gpu gpu, pl_buf buf)
     }
 }
 
+void vk_buf_destroy(pl_gpu gpu, pl_buf buf)
+{
+    struct pl_vk *p = PL_PRIV(gpu);
+    struct pl_buf_vk *buf_vk = PL_PRIV(buf);
+
+    // The buffer may outlive this call while still in use by the GPU, but
+    // must no longer be considered for migration
+    vk_malloc_set_owner(p->vk->ma, &buf_vk->mem, NULL);
+    vk_buf_deref(gpu, buf);
+}
+
 pl_buf vk_buf_create(pl_gpu gpu, const struct pl_buf_params *params)
 {
     struct pl_vk *p = PL_PRIV(gpu);
@@ -139,7 +158,6 @@ pl_buf vk_buf_create(pl_gpu gpu, const struct pl_buf_params *params)
     if (params->storable) {
         mparams.buf_usage |= VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
         *align = pl_lcm(*align, vk->limits.minStorageBufferOffsetAlignment);
-        buf_vk->update_queue = COMPUTE;
         mem_type = PL_BUF_MEM_DEVICE;
         if (params->format) {
             mparams.buf_usage |= VK_BUFFER_USAGE_STORAGE_TEXEL_BUFFER_BIT;
@@ -147,6 +165,12 @@ pl_buf vk_buf_create(pl_gpu gpu, const struct pl_buf_params *params)
         }
     }
 
+#ifdef VK_EXT_descriptor_buffer
+    // Descriptor buffers reference buffers by their device address
+    if (p->descbuf && (params->uniform || params->storable))
+        mparams.buf_usage |= VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
+#endif
+
     if (is_texel) {
         *align = pl_lcm(*align, vk->limits.minTexelBufferOffsetAlignment);
         *align = pl_lcm(*align, params->format->texel_size);
@@ -202,6 +226,14 @@ pl_buf vk_buf_create(pl_gpu gpu, const struct pl_buf_params *params)
         pl_unreachable();
     }
 
+    // Small buffers frequently rewritten by the host (e.g. uniform and upload
+    // staging buffers) benefit from being directly readable by the GPU
+    mparams.streaming = params->host_writable && !params->host_readable &&
+                        !params->host_mapped && !params->import_handle &&
+                        !params->export_handle &&
+                        params->memory_type != PL_BUF_MEM_HOST &&
+                        params->size <= MAX_STREAMING_SIZE;
+
     if (params->import_handle) {
         size_t offset = params->shared_mem.offset;
         if (PL_ALIGN(offset, *align) != offset) {
@@ -220,6 +252,11 @@ pl_buf vk_buf_create(pl_gpu gpu, const struct pl_buf_params *params)
     if (params->host_mapped)
         buf->data = buf_vk->mem.data;
 
+    // Buffers whose memory is visible to the user can't be moved around
+    buf_vk->mparams = mparams;
+    if (!params->host_mapped && !params->import_handle && !params->export_handle)
+        vk_malloc_set_owner(vk->ma, &buf_vk->mem, buf);
+
     if (params->export_handle) {
         buf->shared_mem = buf_vk->mem.shared_mem;
         buf->shared_mem.drm_format_mod = DRM_FORMAT_MOD_LINEAR;
@@ -292,9 +329,8 @@ void vk_buf_flush(pl_gpu gpu, struct vk_cmd *cmd, pl_buf buf,
         .size = size,
     };
 
-    vk->CmdPipelineBarrier(cmd->buf, buf_vk->sem.write.stage,
-                           VK_PIPELINE_STAGE_HOST_BIT, 0,
-                           0, NULL, 1, &buffBarrier, 0, NULL);
+    vk_cmd_barrier(vk, cmd, buf_vk->sem.write.stage, VK_PIPELINE_STAGE_HOST_BIT,
+                   NULL, &buffBarrier);
 
     // Invalidate the mapped memory as soon as this barrier completes
     if (buf_vk->mem.data && !buf_vk->mem.coherent)
@@ -314,13 +350,130 @@ bool vk_buf_poll(pl_gpu gpu, pl_buf buf, uint64_t timeout)
 
     // Otherwise, we're force to submit any queued command so that the
     // user is guaranteed to see progress eventually, even if they call
-    // this in a tight loop
+    // this in a tight loop. This includes deferred writes, which hold a
+    // reference to the buffer without being part of any command yet.
+    vk_buf_record_writes(gpu, buf);
     CMD_SUBMIT(NULL);
     vk_poll_commands(vk, timeout);
 
     return pl_rc_count(&buf_vk->rc) > 1;
 }
 
+// Attempts deferring a buffer update until `vk_buf_flush_writes`. Returns
+// false if the write needs to be recorded immediately instead.
+static bool batch_write(pl_gpu gpu, pl_buf buf, size_t offset,
+                        const void *data, size_t size)
+{
+    struct pl_vk *p = PL_PRIV(gpu);
+    struct pl_buf_vk *buf_vk = PL_PRIV(buf);
+    if (size > MAX_BATCH_WRITE)
+        return false;
+
+    pl_mutex_lock(&p->write_lock);
+    bool ok = p->buf_write_data.len + size <= MAX_BATCH_SIZE;
+
+    // Writes recorded together are not ordered with respect to each other,
+    // so every buffer may only appear once. Contiguous writes to the most
+    // recently updated buffer (e.g. consecutive UBO regions) can be merged.
+    struct vk_buf_write *merge = NULL;
+    for (int i = 0; ok && i < p->buf_writes.num; i++) {
+        struct vk_buf_write *w = &p->buf_writes.elem[i];
+        if (w->buf != buf)
+            continue;
+        ok = i == p->buf_writes.num - 1 && w->offset + w->size == offset &&
+             w->size % 4 == 0;
+        merge = w;
+    }
+
+    if (ok) {
+        if (merge) {
+            merge->size += size;
+        } else {
+            pl_rc_ref(&buf_vk->rc);
+            buf_vk->write_pending = true;
+            PL_ARRAY_APPEND(NULL, p->buf_writes, (struct vk_buf_write) {
+                .buf = buf,
+                .offset = offset,
+                .size = size,
+                .data_offset = p->buf_write_data.len,
+            });
+        }
+
+        pl_str_append(NULL, &p->buf_write_data, (pl_str) {
+            .buf = (uint8_t *) data,
+            .len = size,
+        });
+    }
+
+    pl_mutex_unlock(&p->write_lock);
+    return ok;
+}
+
+void vk_buf_flush_writes(pl_gpu gpu, struct vk_cmd *cmd)
+{
+    struct pl_vk *p = PL_PRIV(gpu);
+    struct vk_ctx *vk = p->vk;
+
+    pl_mutex_lock(&p->write_lock);
+    if (!p->buf_writes.num)
+        goto done;
+
+    for (int i = 0; i < p->buf_writes.num; i++) {
+        const struct vk_buf_write *w = &p->buf_writes.elem[i];
+        vk_buf_barrier(gpu, cmd, w->buf, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       VK_ACCESS_TRANSFER_WRITE_BIT, w->offset, w->size, false);
+    }
+
+    vk_cmd_flush_barriers(vk, cmd);
+    for (int i = 0; i < p->buf_writes.num; i++) {
+        const struct vk_buf_write *w = &p->buf_writes.elem[i];
+        struct pl_buf_vk *buf_vk = PL_PRIV(w->buf);
+        const uint8_t *data = p->buf_write_data.buf + w->data_offset;
+        buf_vk->write_pending = false;
+        VkDeviceSize buf_offset = buf_vk->mem.offset + w->offset;
+        size_t size_rem = w->size % 4;
+        size_t size_base = w->size - size_rem;
+
+        if (size_base) {
+            vk->CmdUpdateBuffer(cmd->buf, buf_vk->mem.buf, buf_offset,
+                                size_base, data);
+        }
+
+        if (size_rem) {
+            uint8_t tail[4] = {0};
+            memcpy(tail, data + size_base, size_rem);
+            vk->CmdUpdateBuffer(cmd->buf, buf_vk->mem.buf, buf_offset + size_base,
+                                sizeof(tail), tail);
+        }
+
+        vk_buf_deref(gpu, w->buf);
+    }
+
+    PL_TRACE(gpu, "Recorded %d batched buffer writes (%zu bytes)",
+             p->buf_writes.num, p->buf_write_data.len);
+    p->buf_writes.num = 0;
+    p->buf_write_data.len = 0;
+
+done:
+    pl_mutex_unlock(&p->write_lock);
+}
+
+void vk_buf_record_writes(pl_gpu gpu, pl_buf buf)
+{
+    struct pl_vk *p = PL_PRIV(gpu);
+    struct pl_buf_vk *buf_vk = buf ? PL_PRIV(buf) : NULL;
+    pl_mutex_lock(&p->write_lock);
+    bool pending = buf_vk ? buf_vk->write_pending : p->buf_writes.num;
+    pl_mutex_unlock(&p->write_lock);
+    if (!pending)
+        return;
+
+    // `_begin_cmd` takes care of recording the writes
+    struct vk_cmd *cmd = CMD_BEGIN(ANY);
+    if (cmd)
+        CMD_FINISH(&cmd);
+}
+
 void vk_buf_write(pl_gpu gpu, pl_buf buf, size_t offset,
                   const void *data, size_t size)
 {
@@ -339,6 +492,10 @@ void vk_buf_write(pl_gpu gpu, pl_buf buf, size_t offset,
         memcpy((void *) addr, data, size);
         buf_vk->needs_flush = true;
     } else {
+        pl_assert(!buf->params.host_readable); // no flush needed due to this
+        if (batch_write(gpu, buf, offset, data, size))
+            return;
+
         struct vk_cmd *cmd = CMD_BEGIN(buf_vk->update_queue);
         if (!cmd) {
             PL_ERR(gpu, "Failed updating buffer!");
@@ -361,6 +518,7 @@ void vk_buf_write(pl_gpu gpu, pl_buf buf, size_t offset,
                      "instead!");
         }
 
+        vk_cmd_flush_barriers(vk, cmd);
         for (size_t xfer = 0; xfer < size_base; xfer += max_transfer) {
             vk->CmdUpdateBuffer(cmd->buf, buf_vk->mem.buf,
                                 buf_offset + xfer,
@@ -433,6 +591,7 @@ void vk_buf_copy(pl_gpu gpu, pl_buf dst, size_t dst_offset,
         .size = size,
     };
 
+    vk_cmd_flush_barriers(vk, cmd);
     vk->CmdCopyBuffer(cmd->buf, src_vk->mem.buf, dst_vk->mem.buf,
                       1, &region);
 
@@ -460,3 +619,113 @@ bool vk_buf_export(pl_gpu gpu, pl_buf buf)
 
     return CMD_SUBMIT(&cmd);
 }
+
+struct vk_buf_garbage {
+    struct vk_memslice mem;
+    VkBufferView view;
+};
+
+static void free_garbage(struct vk_ctx *vk, struct vk_buf_garbage *garbage)
+{
+    vk->DestroyBufferView(vk->dev, garbage->view, PL_VK_ALLOC);
+    vk_malloc_free(vk->ma, &garbage->mem);
+    pl_free(garbage);
+}
+
+// Moves a buffer to a newly allocated slice, freeing the old slice once the
+// copy has completed
+static bool vk_buf_migrate(void *priv, void *owner)
+{
+    pl_gpu gpu = priv;
+    pl_buf buf = owner;
+    struct pl_vk *p = PL_PRIV(gpu);
+    struct vk_ctx *vk = p->vk;
+    struct pl_buf_vk *buf_vk = PL_PRIV(buf);
+    struct vk_buf_garbage *garbage = NULL;
+    struct vk_memslice mem = {0};
+    VkBufferView view = VK_NULL_HANDLE;
+
+    // Avoid having to track pending uses of the old memory by only moving
+    // buffers which are completely idle
+    if (pl_rc_count(&buf_vk->rc) > 1)
+        return false;
+
+    if (!vk_malloc_slice(vk->ma, &mem, &buf_vk->mparams))
+        return false;
+
+    if (buf_vk->view) {
+        struct pl_fmt_vk *fmtp = PL_PRIV(buf->params.format);
+        VkBufferViewCreateInfo vinfo = {
+            .sType = VK_STRUCTURE_TYPE_BUFFER_VIEW_CREATE_INFO,
+            .buffer = mem.buf,
+            .format = PL_DEF(fmtp->vk_fmt->bfmt, fmtp->vk_fmt->tfmt),
+            .offset = mem.offset,
+            .range = mem.size,
+        };
+
+        VK(vk->CreateBufferView(vk->dev, &vinfo, PL_VK_ALLOC, &view));
+        PL_VK_NAME(BUFFER_VIEW, view, PL_DEF(buf->params.debug_tag, "texel"));
+    }
+
+    struct vk_cmd *cmd = CMD_BEGIN(buf_vk->update_queue);
+    if (!cmd)
+        goto error;
+
+    // Treat the copy as a write, so that subsequent users of the buffer wait
+    // for it to complete
+    vk_buf_barrier(gpu, cmd, buf, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                   VK_ACCESS_TRANSFER_WRITE_BIT, 0, buf->params.size, false);
+
+    vk_cmd_flush_barriers(vk, cmd);
+    vk->CmdCopyBuffer(cmd->buf, buf_vk->mem.buf, mem.buf, 1, &(VkBufferCopy) {
+        .srcOffset = buf_vk->mem.offset,
+        .dstOffset = mem.offset,
+        .size = buf_vk->mparams.reqs.size,
+    });
+
+    garbage = pl_alloc_ptr(NULL, garbage);
+    *garbage = (struct vk_buf_garbage) {
+        .mem = buf_vk->mem,
+        .view = buf_vk->view,
+    };
+
+    buf_vk->mem = mem;
+    buf_vk->view = view;
+    vk_malloc_set_owner(vk->ma, &garbage->mem, NULL);
+    vk_malloc_set_owner(vk->ma, &buf_vk->mem, buf);
+
+    vk_buf_flush(gpu, cmd, buf, 0, buf->params.size);
+    vk_cmd_callback(cmd, (vk_cb) free_garbage, vk, garbage);
+    CMD_FINISH(&cmd);
+    return true;
+
+error:
+    vk->DestroyBufferView(vk->dev, view, PL_VK_ALLOC);
+    vk_malloc_free(vk->ma, &mem);
+    return false;
+}
+
+int pl_vulkan_defragment(pl_gpu gpu, const struct pl_vulkan_defrag_params *params)
+{
+    if (!pl_vulkan_get(gpu))
+        return 0;
+
+    struct pl_vk *p = PL_PRIV(gpu);
+    struct vk_ctx *vk = p->vk;
+
+    // Release buffers (and their references) from completed commands first.
+    // Deferred writes also hold references, so record those beforehand.
+    vk_buf_record_writes(gpu, NULL);
+    vk_poll_commands(vk, 0);
+
+    int num = vk_malloc_defrag(vk->ma, &(struct vk_defrag_params) {
+        .threshold = params->threshold,
+        .deadline = pl_clock_now() + params->time_budget,
+        .migrate = vk_buf_migrate,
+        .priv = (void *) gpu,
+    });
+
+    if (num)
+        CMD_SUBMIT(NULL);
+    return num;
+}
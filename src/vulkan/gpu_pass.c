@@ -17,6 +17,26 @@
 
 #include "gpu.h"
 #include "glsl/spirv.h"
+#include "pl_clock.h"
+#include "pl_thread_pool.h"
+
+#ifdef VK_EXT_descriptor_buffer
+#define DESCBUF_PIPELINE_FLAGS VK_PIPELINE_CREATE_DESCRIPTOR_BUFFER_BIT_EXT
+#define DESCBUF_USAGE (VK_BUFFER_USAGE_RESOURCE_DESCRIPTOR_BUFFER_BIT_EXT | \
+                       VK_BUFFER_USAGE_SAMPLER_DESCRIPTOR_BUFFER_BIT_EXT)
+#else
+#define DESCBUF_PIPELINE_FLAGS 0
+#endif
+
+// Background link-time optimization of a fast-linked pipeline
+struct vk_gpl_job {
+    pl_job job;
+    pl_gpu gpu;
+    VkGraphicsPipelineCreateInfo cinfo;
+    VkPipelineLibraryCreateInfoKHR libinfo;
+    VkPipeline libs[4];
+    VkPipeline pipe;        // optimized pipeline, or NULL on failure
+};
 
 // For pl_pass.priv
 struct pl_pass_vk {
@@ -24,8 +44,9 @@ struct pl_pass_vk {
     VkPipeline base;
     VkPipeline pipe;
     VkPipelineLayout pipeLayout;
-    VkRenderPass renderPass;
+    VkRenderPass renderPass;        // only without `pl_vk.dynamic_rendering`
     VkImageLayout initialLayout;
+    VkAttachmentLoadOp loadOp;
     // Descriptor set (bindings)
     bool use_pushd;
     VkDescriptorSetLayout dsLayout;
@@ -34,13 +55,27 @@ struct pl_pass_vk {
     // allocate a fixed number and use a bitmask of all available sets.
     VkDescriptorSet dss[16];
     uint16_t dmask;
+    // Hash of the bindings last written to each set (or 0), so that passes
+    // re-run with the same resources (the common case for per-frame passes)
+    // can skip updating the set altogether
+    uint64_t ds_keys[16];
+    // With `pl_vk.descbuf`, the sets are instead laid out back-to-back in a
+    // host-visible descriptor buffer, and `dss` is unused
+    bool use_descbuf;
+    struct vk_memslice descbuf;
+    VkDeviceSize descbuf_stride;    // size of a single set, aligned
+    VkDeviceSize *descbuf_offsets;  // offset of each binding within a set
 
     // For recompilation
     VkVertexInputAttributeDescription *attrs;
-    VkPipelineCache cache;
     VkShaderModule vert;
     VkShaderModule shader;
 
+    // Graphics pipeline libraries, if `pl_vk.gpl` is enabled
+    VkPipeline lib_vert;    // pre-rasterization shaders
+    VkPipeline lib_frag;    // fragment shader, re-created for specialization
+    struct vk_gpl_job *gpl_job;
+
     // For updating
     VkWriteDescriptorSet *dswrite;
     VkDescriptorImageInfo *dsiinfo;
@@ -54,36 +89,33 @@ int vk_desc_namespace(pl_gpu gpu, enum pl_desc_type type)
     return 0;
 }
 
+static void gpl_job_destroy(pl_gpu gpu, struct vk_gpl_job **job);
+
 static void pass_destroy_cb(pl_gpu gpu, pl_pass pass)
 {
     struct pl_vk *p = PL_PRIV(gpu);
     struct vk_ctx *vk = p->vk;
     struct pl_pass_vk *pass_vk = PL_PRIV(pass);
 
+    gpl_job_destroy(gpu, &pass_vk->gpl_job);
     vk->DestroyPipeline(vk->dev, pass_vk->pipe, PL_VK_ALLOC);
     vk->DestroyPipeline(vk->dev, pass_vk->base, PL_VK_ALLOC);
+    vk->DestroyPipeline(vk->dev, pass_vk->lib_vert, PL_VK_ALLOC);
+    vk->DestroyPipeline(vk->dev, pass_vk->lib_frag, PL_VK_ALLOC);
     vk->DestroyRenderPass(vk->dev, pass_vk->renderPass, PL_VK_ALLOC);
     vk->DestroyPipelineLayout(vk->dev, pass_vk->pipeLayout, PL_VK_ALLOC);
-    vk->DestroyPipelineCache(vk->dev, pass_vk->cache, PL_VK_ALLOC);
     vk->DestroyDescriptorPool(vk->dev, pass_vk->dsPool, PL_VK_ALLOC);
+    vk_malloc_free(vk->ma, &pass_vk->descbuf);
     vk->DestroyDescriptorSetLayout(vk->dev, pass_vk->dsLayout, PL_VK_ALLOC);
-    vk->DestroyShaderModule(vk->dev, pass_vk->vert, PL_VK_ALLOC);
-    vk->DestroyShaderModule(vk->dev, pass_vk->shader, PL_VK_ALLOC);
+    module_release(gpu, &pass_vk->vert);
+    module_release(gpu, &pass_vk->shader);
 
     pl_free((void *) pass);
 }
 
 void vk_pass_destroy(pl_gpu gpu, pl_pass pass)
 {
-    struct pl_vk *p = PL_PRIV(gpu);
-    struct vk_ctx *vk = p->vk;
-    pl_mutex_lock(&p->recording);
-    if (p->cmd) {
-        vk_cmd_callback(p->cmd, (vk_cb) pass_destroy_cb, gpu, pass);
-    } else {
-        vk_dev_callback(vk, (vk_cb) pass_destroy_cb, gpu, pass);
-    }
-    pl_mutex_unlock(&p->recording);
+    vk_gpu_callback(gpu, (vk_cb) pass_destroy_cb, gpu, pass);
 }
 
 static const VkDescriptorType dsType[] = {
@@ -96,7 +128,7 @@ static const VkDescriptorType dsType[] = {
 };
 
 #define CACHE_MAGIC {'P','L','V','K'}
-#define CACHE_VERSION 4
+#define CACHE_VERSION 5
 static const char vk_cache_magic[4] = CACHE_MAGIC;
 
 struct vk_cache_header {
@@ -106,7 +138,6 @@ struct vk_cache_header {
     size_t vert_spirv_len;
     size_t frag_spirv_len;
     size_t comp_spirv_len;
-    size_t pipecache_len;
 };
 
 static uint64_t cache_signature(pl_gpu gpu, const struct pl_pass_params *params)
@@ -123,8 +154,7 @@ static uint64_t cache_signature(pl_gpu gpu, const struct pl_pass_params *params)
 static bool vk_use_cached_program(const struct pl_pass_params *params,
                                   const struct spirv_compiler *spirv,
                                   pl_str *vert_spirv, pl_str *frag_spirv,
-                                  pl_str *comp_spirv, pl_str *pipecache,
-                                  uint64_t signature)
+                                  pl_str *comp_spirv, uint64_t signature)
 {
     pl_str cache = {
         .buf = (uint8_t *) params->cached_program,
@@ -153,10 +183,153 @@ static bool vk_use_cached_program(const struct pl_pass_params *params,
     GET(vert_spirv);
     GET(frag_spirv);
     GET(comp_spirv);
-    GET(pipecache);
     return true;
 }
 
+bool vk_pipecache_init(pl_gpu gpu)
+{
+    struct pl_vk *p = PL_PRIV(gpu);
+    struct vk_ctx *vk = p->vk;
+
+    VkPipelineCacheCreateInfo pcinfo = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+    };
+
+    VK(vk->CreatePipelineCache(vk->dev, &pcinfo, PL_VK_ALLOC, &p->pipecache));
+    return true;
+
+error:
+    return false;
+}
+
+// Merges all pending caches into `pl_vk.pipecache`
+//
+// Note: Must be called with `pipecache_lock` held and no active users
+static void pipecache_merge_pending(pl_gpu gpu)
+{
+    struct pl_vk *p = PL_PRIV(gpu);
+    struct vk_ctx *vk = p->vk;
+    pl_assert(!p->pipecache_users);
+    if (!p->pipecache_merge.num)
+        return;
+
+    VkResult res = vk->MergePipelineCaches(vk->dev, p->pipecache,
+                                           p->pipecache_merge.num,
+                                           p->pipecache_merge.elem);
+    if (res != VK_SUCCESS)
+        PL_WARN(gpu, "Failed merging pipeline caches: %s", vk_res_str(res));
+
+    for (int i = 0; i < p->pipecache_merge.num; i++)
+        vk->DestroyPipelineCache(vk->dev, p->pipecache_merge.elem[i], PL_VK_ALLOC);
+    p->pipecache_merge.num = 0;
+}
+
+void vk_pipecache_uninit(pl_gpu gpu)
+{
+    struct pl_vk *p = PL_PRIV(gpu);
+    struct vk_ctx *vk = p->vk;
+
+    pl_mutex_lock(&p->pipecache_lock);
+    pipecache_merge_pending(gpu);
+    pl_mutex_unlock(&p->pipecache_lock);
+
+    vk->DestroyPipelineCache(vk->dev, p->pipecache, PL_VK_ALLOC);
+    pl_free(p->pipecache_merge.elem);
+    pl_mutex_destroy(&p->pipecache_lock);
+}
+
+// Grants shared access to `pl_vk.pipecache`, for pipeline creation and
+// serialization. This never blocks on other users.
+static VkPipelineCache pipecache_acquire(pl_gpu gpu)
+{
+    struct pl_vk *p = PL_PRIV(gpu);
+    pl_mutex_lock(&p->pipecache_lock);
+    p->pipecache_users++;
+    pl_mutex_unlock(&p->pipecache_lock);
+    return p->pipecache;
+}
+
+static void pipecache_release(pl_gpu gpu)
+{
+    struct pl_vk *p = PL_PRIV(gpu);
+    pl_mutex_lock(&p->pipecache_lock);
+    if (!--p->pipecache_users)
+        pipecache_merge_pending(gpu);
+    pl_mutex_unlock(&p->pipecache_lock);
+}
+
+size_t pl_vulkan_save_pipeline_cache(pl_gpu gpu, uint8_t *out_cache, size_t size)
+{
+    if (!pl_vulkan_get(gpu))
+        return 0;
+
+    struct pl_vk *p = PL_PRIV(gpu);
+    struct vk_ctx *vk = p->vk;
+    VkPipelineCache cache = pipecache_acquire(gpu);
+    VkResult res = vk->GetPipelineCacheData(vk->dev, cache, &size, out_cache);
+    pipecache_release(gpu);
+
+    switch (res) {
+    case VK_SUCCESS:
+        return size;
+    case VK_INCOMPLETE:
+        PL_DEBUG(gpu, "Pipeline cache truncated to %zu bytes", size);
+        return size;
+    default:
+        PL_ERR(gpu, "Failed saving pipeline cache: %s", vk_res_str(res));
+        return 0;
+    }
+}
+
+void pl_vulkan_load_pipeline_cache(pl_gpu gpu, const uint8_t *cache, size_t size)
+{
+    if (!pl_vulkan_get(gpu) || !size)
+        return;
+
+    struct pl_vk *p = PL_PRIV(gpu);
+    struct vk_ctx *vk = p->vk;
+
+    // Drivers are required to reject incompatible data, but check the header
+    // anyway to provide a more useful message
+    VkPhysicalDeviceProperties props;
+    vk->GetPhysicalDeviceProperties(vk->physd, &props);
+    VkPipelineCacheHeaderVersionOne header;
+    if (size < sizeof(header)) {
+        PL_ERR(gpu, "Failed loading pipeline cache: data too short");
+        return;
+    }
+
+    memcpy(&header, cache, sizeof(header));
+    if (header.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE ||
+        header.vendorID != props.vendorID ||
+        header.deviceID != props.deviceID ||
+        memcmp(header.pipelineCacheUUID, props.pipelineCacheUUID, VK_UUID_SIZE) != 0)
+    {
+        PL_INFO(gpu, "Ignoring pipeline cache created by a different device "
+                "or driver version");
+        return;
+    }
+
+    VkPipelineCacheCreateInfo pcinfo = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+        .pInitialData = cache,
+        .initialDataSize = size,
+    };
+
+    VkPipelineCache loaded;
+    VkResult res = vk->CreatePipelineCache(vk->dev, &pcinfo, PL_VK_ALLOC, &loaded);
+    if (res != VK_SUCCESS) {
+        PL_ERR(gpu, "Failed loading pipeline cache: %s", vk_res_str(res));
+        return;
+    }
+
+    pl_mutex_lock(&p->pipecache_lock);
+    PL_ARRAY_APPEND(NULL, p->pipecache_merge, loaded);
+    if (!p->pipecache_users)
+        pipecache_merge_pending(gpu);
+    pl_mutex_unlock(&p->pipecache_lock);
+}
+
 static VkResult vk_compile_glsl(pl_gpu gpu, void *alloc,
                                 enum glsl_shader_stage stage,
                                 const char *shader,
@@ -182,25 +355,366 @@ static void destroy_pipeline(struct vk_ctx *vk, VkPipeline pipeline)
     vk->DestroyPipeline(vk->dev, pipeline, PL_VK_ALLOC);
 }
 
-static VkResult vk_recreate_pipelines(struct vk_ctx *vk, pl_pass pass,
-                                      bool derivable, VkPipeline base,
-                                      VkPipeline *out_pipe)
+void vk_gpl_uninit(pl_gpu gpu)
+{
+    struct pl_vk *p = PL_PRIV(gpu);
+    struct vk_ctx *vk = p->vk;
+
+    for (int i = 0; i < p->gpl_libs.num; i++)
+        vk->DestroyPipeline(vk->dev, p->gpl_libs.elem[i].lib, PL_VK_ALLOC);
+    pl_free(p->gpl_libs.elem);
+    pl_mutex_destroy(&p->gpl_lock);
+}
+
+// Maximum number of unreferenced shader modules to keep around for reuse
+#define VK_MODULE_CACHE_IDLE 32
+
+void vk_module_uninit(pl_gpu gpu)
 {
+    struct pl_vk *p = PL_PRIV(gpu);
+    struct vk_ctx *vk = p->vk;
+
+    for (int i = 0; i < p->modules.num; i++) {
+        pl_assert(!p->modules.elem[i].refcount);
+        vk->DestroyShaderModule(vk->dev, p->modules.elem[i].mod, PL_VK_ALLOC);
+    }
+    pl_free(p->modules.elem);
+    pl_mutex_destroy(&p->module_lock);
+}
+
+// Returns a (new) reference to the shader module for the given SPIR-V code,
+// creating it if needed. Must be released with `module_release`.
+static VkResult module_acquire(pl_gpu gpu, pl_str spirv, const char *name,
+                               VkShaderModule *out)
+{
+    struct pl_vk *p = PL_PRIV(gpu);
+    struct vk_ctx *vk = p->vk;
+    uint64_t key = pl_str_hash(spirv);
+    VkResult res = VK_SUCCESS;
+
+    pl_mutex_lock(&p->module_lock);
+    for (int i = 0; i < p->modules.num; i++) {
+        struct vk_module *m = &p->modules.elem[i];
+        if (m->key == key && m->size == spirv.len) {
+            PL_TRACE(gpu, "Re-using cached %s shader module", name);
+            m->refcount++;
+            m->last_use = ++p->module_clock;
+            *out = m->mod;
+            goto done;
+        }
+    }
+
+    VkShaderModuleCreateInfo sinfo = {
+        .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+        .pCode = (uint32_t *) spirv.buf,
+        .codeSize = spirv.len,
+    };
+
+    res = vk->CreateShaderModule(vk->dev, &sinfo, PL_VK_ALLOC, out);
+    if (res != VK_SUCCESS)
+        goto done;
+
+    PL_VK_NAME(SHADER_MODULE, *out, name);
+    PL_ARRAY_APPEND(NULL, p->modules, (struct vk_module) {
+        .key = key,
+        .size = spirv.len,
+        .mod = *out,
+        .refcount = 1,
+        .last_use = ++p->module_clock,
+    });
+
+done:
+    pl_mutex_unlock(&p->module_lock);
+    return res;
+}
+
+// Releases a reference acquired by `module_acquire`. Safe to call on
+// VK_NULL_HANDLE. Evicts the least recently used idle modules once there are
+// more than VK_MODULE_CACHE_IDLE of them.
+static void module_release(pl_gpu gpu, VkShaderModule *mod)
+{
+    struct pl_vk *p = PL_PRIV(gpu);
+    struct vk_ctx *vk = p->vk;
+    if (!*mod)
+        return;
+
+    pl_mutex_lock(&p->module_lock);
+    int num_idle = 0;
+    for (int i = 0; i < p->modules.num; i++) {
+        struct vk_module *m = &p->modules.elem[i];
+        if (m->mod == *mod) {
+            pl_assert(m->refcount > 0);
+            m->refcount--;
+        }
+        num_idle += !m->refcount;
+    }
+
+    while (num_idle > VK_MODULE_CACHE_IDLE) {
+        int lru = -1;
+        for (int i = 0; i < p->modules.num; i++) {
+            const struct vk_module *m = &p->modules.elem[i];
+            if (!m->refcount && (lru < 0 || m->last_use < p->modules.elem[lru].last_use))
+                lru = i;
+        }
+
+        vk->DestroyShaderModule(vk->dev, p->modules.elem[lru].mod, PL_VK_ALLOC);
+        PL_ARRAY_REMOVE_AT(p->modules, lru);
+        num_idle--;
+    }
+    pl_mutex_unlock(&p->module_lock);
+
+    *mod = VK_NULL_HANDLE;
+}
+
+static void gpl_job_run(void *arg)
+{
+    struct vk_gpl_job *job = arg;
+    struct pl_vk *p = PL_PRIV(job->gpu);
+    struct vk_ctx *vk = p->vk;
+
+    clock_t start = clock();
+    uint64_t start_ns = pl_clock_now();
+    VkPipelineCache cache = pipecache_acquire(job->gpu);
+    VkResult res = vk->CreateGraphicsPipelines(vk->dev, cache, 1, &job->cinfo,
+                                               PL_VK_ALLOC, &job->pipe);
+    pipecache_release(job->gpu);
+    pl_gpu_count_driver(job->gpu, pl_clock_now() - start_ns);
+    if (res != VK_SUCCESS) {
+        PL_WARN(vk, "Failed creating optimized pipeline: %s", vk_res_str(res));
+        job->pipe = VK_NULL_HANDLE;
+    } else {
+        pl_log_cpu_time(job->gpu->log, start, clock(), "optimizing pipeline");
+    }
+}
+
+// Starts building a link-time optimized version of a fast-linked pipeline in
+// the background. Failure is not fatal, since the fast-linked pipeline can
+// still be used indefinitely.
+static void gpl_job_start(pl_gpu gpu, struct pl_pass_vk *pass_vk,
+                          const VkGraphicsPipelineCreateInfo *link)
+{
+    const VkPipelineLibraryCreateInfoKHR *libinfo = link->pNext;
+    struct vk_gpl_job *job = pl_zalloc_ptr(NULL, job);
+    job->gpu = gpu;
+    job->cinfo = *link;
+    job->cinfo.pNext = &job->libinfo;
+    job->cinfo.flags |= VK_PIPELINE_CREATE_LINK_TIME_OPTIMIZATION_BIT_EXT;
+    job->libinfo = *libinfo;
+    job->libinfo.pLibraries = job->libs;
+
+    pl_assert(libinfo->libraryCount == PL_ARRAY_SIZE(job->libs));
+    memcpy(job->libs, libinfo->pLibraries, sizeof(job->libs));
+
+    job->job = pl_job_submit(gpu->log, gpl_job_run, job);
+    if (!job->job) {
+        pl_free(job);
+        return;
+    }
+
+    pass_vk->gpl_job = job;
+}
+
+static bool gpl_job_done(struct vk_gpl_job *job)
+{
+    return pl_job_done(job->job);
+}
+
+static void gpl_job_destroy(pl_gpu gpu, struct vk_gpl_job **job)
+{
+    if (!*job)
+        return;
+
+    struct pl_vk *p = PL_PRIV(gpu);
+    struct vk_ctx *vk = p->vk;
+    pl_job_cancel(&(*job)->job);
+    vk->DestroyPipeline(vk->dev, (*job)->pipe, PL_VK_ALLOC);
+    pl_free_ptr(job);
+}
+
+// Creates a single graphics pipeline library containing the given state
+// subsets, out of a complete set of graphics pipeline state
+static VkResult gpl_create_lib(struct vk_ctx *vk, VkPipelineCache cache,
+                               const VkGraphicsPipelineCreateInfo *base,
+                               VkGraphicsPipelineLibraryFlagsEXT flags,
+                               VkPipeline *out_lib)
+{
+    VkGraphicsPipelineLibraryCreateInfoEXT libinfo = {
+        .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_LIBRARY_CREATE_INFO_EXT,
+        .pNext = base->pNext, // e.g. VkPipelineRenderingCreateInfo
+        .flags = flags,
+    };
+
+    VkGraphicsPipelineCreateInfo cinfo = *base;
+    cinfo.pNext = &libinfo;
+    cinfo.flags = VK_PIPELINE_CREATE_LIBRARY_BIT_KHR |
+                  VK_PIPELINE_CREATE_RETAIN_LINK_TIME_OPTIMIZATION_INFO_BIT_EXT;
+    cinfo.flags |= base->flags & DESCBUF_PIPELINE_FLAGS;
+    cinfo.basePipelineHandle = VK_NULL_HANDLE;
+    cinfo.basePipelineIndex = -1;
+
+    // Only include the shader stage belonging to this subset
+    cinfo.stageCount = 0;
+    cinfo.pStages = NULL;
+    for (int i = 0; i < base->stageCount; i++) {
+        const VkPipelineShaderStageCreateInfo *stage = &base->pStages[i];
+        bool vert = stage->stage == VK_SHADER_STAGE_VERTEX_BIT;
+        VkGraphicsPipelineLibraryFlagsEXT req = vert
+            ? VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT
+            : VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT;
+        if (flags & req) {
+            cinfo.stageCount = 1;
+            cinfo.pStages = stage;
+        }
+    }
+
+    // The interface libraries don't access any resources, and may outlive
+    // the pass they were created for
+    if (!cinfo.stageCount)
+        cinfo.layout = VK_NULL_HANDLE;
+
+    return vk->CreateGraphicsPipelines(vk->dev, cache, 1, &cinfo, PL_VK_ALLOC,
+                                       out_lib);
+}
+
+// Returns the shared interface library matching `key`, creating it if needed
+static VkResult gpl_get_shared(pl_gpu gpu, VkPipelineCache cache,
+                               const VkGraphicsPipelineCreateInfo *cinfo,
+                               VkGraphicsPipelineLibraryFlagsEXT flags,
+                               uint64_t key, VkPipeline *out_lib)
+{
+    struct pl_vk *p = PL_PRIV(gpu);
+    VkResult res = VK_SUCCESS;
+
+    pl_mutex_lock(&p->gpl_lock);
+    for (int i = 0; i < p->gpl_libs.num; i++) {
+        if (p->gpl_libs.elem[i].key == key) {
+            *out_lib = p->gpl_libs.elem[i].lib;
+            goto done;
+        }
+    }
+
+    res = gpl_create_lib(p->vk, cache, cinfo, flags, out_lib);
+    if (res == VK_SUCCESS) {
+        PL_ARRAY_APPEND(NULL, p->gpl_libs, (struct vk_gpl_lib) {
+            .key = key,
+            .lib = *out_lib,
+        });
+    }
+
+done:
+    pl_mutex_unlock(&p->gpl_lock);
+    return res;
+}
+
+// Creates a raster pipeline by fast-linking graphics pipeline libraries. Only
+// the fragment shader library is re-created for every call, the remaining
+// libraries are created once and reused.
+static VkResult gpl_create_pipeline(pl_gpu gpu, pl_pass pass,
+                                    VkPipelineCache cache,
+                                    const VkGraphicsPipelineCreateInfo *cinfo,
+                                    VkPipeline *out_pipe)
+{
+    struct pl_vk *p = PL_PRIV(gpu);
+    struct vk_ctx *vk = p->vk;
     struct pl_pass_vk *pass_vk = PL_PRIV(pass);
     const struct pl_pass_params *params = &pass->params;
+    VkResult res;
+
+    // All libraries linked together must agree on the use of descriptor
+    // buffers, so the shared libraries are keyed by this as well
+    VkPipelineCreateFlags lib_flags = cinfo->flags & DESCBUF_PIPELINE_FLAGS;
+
+    uint64_t input_key = VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT;
+    pl_hash_merge(&input_key, lib_flags);
+    pl_hash_merge(&input_key, params->vertex_stride);
+    pl_hash_merge(&input_key, params->instance_stride);
+    pl_hash_merge(&input_key, params->vertex_type);
+    pl_hash_merge(&input_key, pl_mem_hash(pass_vk->attrs,
+                  params->num_vertex_attribs * sizeof(pass_vk->attrs[0])));
+
+    uint64_t output_key = VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_OUTPUT_INTERFACE_BIT_EXT;
+    pl_hash_merge(&output_key, lib_flags);
+    pl_hash_merge(&output_key, params->target_format->signature);
+    pl_hash_merge(&output_key, pl_mem_hash(cinfo->pColorBlendState->pAttachments,
+                  sizeof(VkPipelineColorBlendAttachmentState)));
+
+    VkPipeline lib_input, lib_output;
+    res = gpl_get_shared(gpu, cache, cinfo,
+                         VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT,
+                         input_key, &lib_input);
+    if (res != VK_SUCCESS)
+        return res;
+
+    res = gpl_get_shared(gpu, cache, cinfo,
+                         VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_OUTPUT_INTERFACE_BIT_EXT,
+                         output_key, &lib_output);
+    if (res != VK_SUCCESS)
+        return res;
+
+    if (!pass_vk->lib_vert) {
+        res = gpl_create_lib(vk, cache, cinfo,
+                             VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT,
+                             &pass_vk->lib_vert);
+        if (res != VK_SUCCESS)
+            return res;
+    }
 
-    // The old pipeline might still be in use, so we have to destroy it
-    // asynchronously with a device idle callback
-    if (*out_pipe) {
-        vk_dev_callback(vk, (vk_cb) destroy_pipeline, vk, *out_pipe);
-        *out_pipe = NULL;
+    // Pipelines linked against the old library might still be in use, so we
+    // have to destroy it asynchronously as well
+    if (pass_vk->lib_frag) {
+        vk_gpu_callback(gpu, (vk_cb) destroy_pipeline, vk, pass_vk->lib_frag);
+        pass_vk->lib_frag = VK_NULL_HANDLE;
     }
 
+    res = gpl_create_lib(vk, cache, cinfo,
+                         VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT,
+                         &pass_vk->lib_frag);
+    if (res != VK_SUCCESS)
+        return res;
+
+    VkPipeline libs[] = { lib_input, pass_vk->lib_vert, pass_vk->lib_frag, lib_output };
+    VkPipelineLibraryCreateInfoKHR libinfo = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_LIBRARY_CREATE_INFO_KHR,
+        .libraryCount = PL_ARRAY_SIZE(libs),
+        .pLibraries = libs,
+    };
+
+    VkGraphicsPipelineCreateInfo link = {
+        .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+        .pNext = &libinfo,
+        .flags = lib_flags,
+        .layout = cinfo->layout,
+        .renderPass = cinfo->renderPass,
+        .basePipelineIndex = -1,
+    };
+
+    res = vk->CreateGraphicsPipelines(vk->dev, cache, 1, &link, PL_VK_ALLOC, out_pipe);
+    if (res != VK_SUCCESS)
+        return res;
+
+    // Passes without specialization constants are never re-linked, so it's
+    // worth replacing them by fully optimized pipelines later on
+    if (!pass_vk->spec_size)
+        gpl_job_start(gpu, pass_vk, &link);
+    return VK_SUCCESS;
+}
+
+static VkResult vk_create_pipeline(pl_gpu gpu, pl_pass pass,
+                                   VkPipelineCache cache, bool derivable,
+                                   VkPipeline base, VkPipeline *out_pipe)
+{
+    struct pl_vk *p = PL_PRIV(gpu);
+    struct vk_ctx *vk = p->vk;
+    struct pl_pass_vk *pass_vk = PL_PRIV(pass);
+    const struct pl_pass_params *params = &pass->params;
+
     VkPipelineCreateFlags flags = 0;
     if (derivable)
         flags |= VK_PIPELINE_CREATE_ALLOW_DERIVATIVES_BIT;
     if (base)
         flags |= VK_PIPELINE_CREATE_DERIVATIVE_BIT;
+    if (pass_vk->use_descbuf)
+        flags |= DESCBUF_PIPELINE_FLAGS;
 
     const VkSpecializationInfo *specInfo = &pass_vk->specInfo;
     if (!specInfo->dataSize)
@@ -238,8 +752,35 @@ static VkResult vk_recreate_pipelines(struct vk_ctx *vk, pl_pass pass,
             [PL_PRIM_TRIANGLE_STRIP] = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP,
         };
 
+        // Per-instance attributes are sourced from a second binding
+        const VkVertexInputBindingDescription bindings[] = {
+            {
+                .binding = 0,
+                .stride = params->vertex_stride,
+                .inputRate = VK_VERTEX_INPUT_RATE_VERTEX,
+            }, {
+                .binding = 1,
+                .stride = params->instance_stride,
+                .inputRate = VK_VERTEX_INPUT_RATE_INSTANCE,
+            },
+        };
+
+        const void *pnext = NULL;
+#ifdef VK_KHR_dynamic_rendering
+        VkFormat target_fmt = (VkFormat) params->target_format->signature;
+        VkPipelineRenderingCreateInfoKHR rendering = {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO_KHR,
+            .colorAttachmentCount = 1,
+            .pColorAttachmentFormats = &target_fmt,
+        };
+
+        if (p->dynamic_rendering)
+            pnext = &rendering;
+#endif
+
         VkGraphicsPipelineCreateInfo cinfo = {
             .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+            .pNext = pnext,
             .flags = flags,
             .stageCount = 2,
             .pStages = (VkPipelineShaderStageCreateInfo[]) {
@@ -258,12 +799,8 @@ static VkResult vk_recreate_pipelines(struct vk_ctx *vk, pl_pass pass,
             },
             .pVertexInputState = &(VkPipelineVertexInputStateCreateInfo) {
                 .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
-                .vertexBindingDescriptionCount = 1,
-                .pVertexBindingDescriptions = &(VkVertexInputBindingDescription) {
-                    .binding = 0,
-                    .stride = params->vertex_stride,
-                    .inputRate = VK_VERTEX_INPUT_RATE_VERTEX,
-                },
+                .vertexBindingDescriptionCount = params->instance_stride ? 2 : 1,
+                .pVertexBindingDescriptions = bindings,
                 .vertexAttributeDescriptionCount = params->num_vertex_attribs,
                 .pVertexAttributeDescriptions = pass_vk->attrs,
             },
@@ -305,7 +842,10 @@ static VkResult vk_recreate_pipelines(struct vk_ctx *vk, pl_pass pass,
             .basePipelineIndex = -1,
         };
 
-        return vk->CreateGraphicsPipelines(vk->dev, pass_vk->cache, 1, &cinfo,
+        if (p->gpl)
+            return gpl_create_pipeline(gpu, pass, cache, &cinfo, out_pipe);
+
+        return vk->CreateGraphicsPipelines(vk->dev, cache, 1, &cinfo,
                                            PL_VK_ALLOC, out_pipe);
     }
 
@@ -325,7 +865,7 @@ static VkResult vk_recreate_pipelines(struct vk_ctx *vk, pl_pass pass,
             .basePipelineIndex = -1,
         };
 
-        return vk->CreateComputePipelines(vk->dev, pass_vk->cache, 1, &cinfo,
+        return vk->CreateComputePipelines(vk->dev, cache, 1, &cinfo,
                                           PL_VK_ALLOC, out_pipe);
     }
 
@@ -337,6 +877,76 @@ static VkResult vk_recreate_pipelines(struct vk_ctx *vk, pl_pass pass,
     pl_unreachable();
 }
 
+static VkResult vk_recreate_pipelines(pl_gpu gpu, pl_pass pass,
+                                      bool derivable, VkPipeline base,
+                                      VkPipeline *out_pipe)
+{
+    struct pl_vk *p = PL_PRIV(gpu);
+    struct vk_ctx *vk = p->vk;
+
+    // The old pipeline might still be in use, so we have to destroy it
+    // asynchronously, once the device is idle
+    if (*out_pipe) {
+        vk_gpu_callback(gpu, (vk_cb) destroy_pipeline, vk, *out_pipe);
+        *out_pipe = NULL;
+    }
+
+    VkPipelineCache cache = pipecache_acquire(gpu);
+    VkResult res = vk_create_pipeline(gpu, pass, cache, derivable, base, out_pipe);
+    pipecache_release(gpu);
+    return res;
+}
+
+#ifdef VK_EXT_descriptor_buffer
+// Allocates the descriptor buffer for a pass, after `dsLayout` was created.
+// Returns false if the pass should use descriptor pools instead.
+static bool descbuf_init(pl_gpu gpu, pl_pass pass)
+{
+    struct pl_vk *p = PL_PRIV(gpu);
+    struct vk_ctx *vk = p->vk;
+    struct pl_pass_vk *pass_vk = PL_PRIV(pass);
+    const int num_ds = PL_ARRAY_SIZE(pass_vk->dss);
+    const int num_desc = pass->params.num_descriptors;
+
+    VkDeviceSize size;
+    vk->GetDescriptorSetLayoutSizeEXT(vk->dev, pass_vk->dsLayout, &size);
+    pass_vk->descbuf_stride = PL_ALIGN(size, p->descbuf_align);
+    if (pass_vk->descbuf_stride * num_ds > p->descbuf_range) {
+        PL_DEBUG(gpu, "Descriptor set size %zu exceeds the descriptor buffer "
+                 "range, falling back to descriptor pools", (size_t) size);
+        return false;
+    }
+
+    pass_vk->descbuf_offsets = pl_calloc_ptr(pass, num_desc, pass_vk->descbuf_offsets);
+    for (int i = 0; i < num_desc; i++) {
+        vk->GetDescriptorSetLayoutBindingOffsetEXT(vk->dev, pass_vk->dsLayout,
+                                                   pass->params.descriptors[i].binding,
+                                                   &pass_vk->descbuf_offsets[i]);
+    }
+
+    struct vk_malloc_params mparams = {
+        .reqs = {
+            .size = pass_vk->descbuf_stride * num_ds,
+            .alignment = p->descbuf_align,
+            .memoryTypeBits = UINT32_MAX,
+        },
+        .required = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                    VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        .optimal = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        .buf_usage = DESCBUF_USAGE | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+    };
+
+    if (!vk_malloc_slice(vk->ma, &pass_vk->descbuf, &mparams)) {
+        PL_DEBUG(gpu, "Failed allocating descriptor buffer, falling back to "
+                 "descriptor pools");
+        return false;
+    }
+
+    pl_assert(pass_vk->descbuf.addr && pass_vk->descbuf.data);
+    return true;
+}
+#endif
+
 pl_pass vk_pass_create(pl_gpu gpu, const struct pl_pass_params *params)
 {
     struct pl_vk *p = PL_PRIV(gpu);
@@ -400,6 +1010,13 @@ pl_pass vk_pass_create(pl_gpu gpu, const struct pl_pass_params *params)
             .descriptorCount = 1,
             .stageFlags = stageFlags[params->type],
         };
+
+        // Samplers are shared by all passes and outlive them, so fixed
+        // samplers can be baked directly into the layout. They still get
+        // written as part of the descriptor updates, where they're ignored.
+        if (desc->fixed_sampler)
+            bindings[i].pImmutableSamplers =
+                &p->samplers[desc->sample_mode][desc->address_mode];
     }
 
     VkDescriptorSetLayoutCreateInfo dinfo = {
@@ -417,10 +1034,27 @@ pl_pass vk_pass_create(pl_gpu gpu, const struct pl_pass_params *params)
                 num_desc, p->max_push_descriptors);
     }
 
+#ifdef VK_EXT_descriptor_buffer
+    if (!pass_vk->use_pushd && p->descbuf) {
+        dinfo.flags |= VK_DESCRIPTOR_SET_LAYOUT_CREATE_DESCRIPTOR_BUFFER_BIT_EXT;
+        pass_vk->use_descbuf = true;
+    }
+#endif
+
     VK(vk->CreateDescriptorSetLayout(vk->dev, &dinfo, PL_VK_ALLOC,
                                      &pass_vk->dsLayout));
 
-    if (!pass_vk->use_pushd) {
+#ifdef VK_EXT_descriptor_buffer
+    if (pass_vk->use_descbuf && !descbuf_init(gpu, pass)) {
+        vk->DestroyDescriptorSetLayout(vk->dev, pass_vk->dsLayout, PL_VK_ALLOC);
+        dinfo.flags &= ~VK_DESCRIPTOR_SET_LAYOUT_CREATE_DESCRIPTOR_BUFFER_BIT_EXT;
+        pass_vk->use_descbuf = false;
+        VK(vk->CreateDescriptorSetLayout(vk->dev, &dinfo, PL_VK_ALLOC,
+                                         &pass_vk->dsLayout));
+    }
+#endif
+
+    if (!pass_vk->use_pushd && !pass_vk->use_descbuf) {
         PL_ARRAY(VkDescriptorPoolSize) dsPoolSizes = {0};
 
         for (enum pl_desc_type t = 0; t < PL_DESC_TYPE_COUNT; t++) {
@@ -505,20 +1139,29 @@ no_descriptors: ;
     VK(vk->CreatePipelineLayout(vk->dev, &linfo, PL_VK_ALLOC,
                                 &pass_vk->pipeLayout));
 
-    pl_str vert = {0}, frag = {0}, comp = {0}, pipecache = {0};
+    pl_str vert = {0}, frag = {0}, comp = {0};
     uint64_t sig = cache_signature(gpu, params);
-    if (vk_use_cached_program(params, p->spirv, &vert, &frag, &comp, &pipecache, sig)) {
-        PL_DEBUG(gpu, "Using cached SPIR-V and VkPipeline");
+    if (vk_use_cached_program(params, p->spirv, &vert, &frag, &comp, sig)) {
+        PL_DEBUG(gpu, "Using cached SPIR-V");
     } else {
-        pipecache.len = 0;
+        uint64_t spirv_start = pl_clock_now();
         switch (params->type) {
-        case PL_PASS_RASTER:
-            VK(vk_compile_glsl(gpu, tmp, GLSL_SHADER_VERTEX,
-                               params->vertex_shader, &vert));
-            VK(vk_compile_glsl(gpu, tmp, GLSL_SHADER_FRAGMENT,
-                               params->glsl_shader, &frag));
+        case PL_PASS_RASTER: {
+            // Compile the fragment shader in the background, overlapping it
+            // with the (usually cached) vertex shader
+            struct spirv_job *job;
+            job = spirv_compile_glsl_async(p->spirv, &gpu->glsl,
+                                           GLSL_SHADER_FRAGMENT,
+                                           params->glsl_shader);
+            VkResult res = vk_compile_glsl(gpu, tmp, GLSL_SHADER_VERTEX,
+                                           params->vertex_shader, &vert);
+            frag = spirv_job_wait(&job, tmp);
+            VK(res);
+            if (!frag.len)
+                goto error;
             comp.len = 0;
             break;
+        }
         case PL_PASS_COMPUTE:
             VK(vk_compile_glsl(gpu, tmp, GLSL_SHADER_COMPUTE,
                                params->glsl_shader, &comp));
@@ -529,32 +1172,15 @@ no_descriptors: ;
         case PL_PASS_TYPE_COUNT:
             pl_unreachable();
         }
+        pl_gpu_count_spirv(gpu, pl_clock_now() - spirv_start);
     }
 
-    VkPipelineCacheCreateInfo pcinfo = {
-        .sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
-        .pInitialData = pipecache.buf,
-        .initialDataSize = pipecache.len,
-    };
-
-    VK(vk->CreatePipelineCache(vk->dev, &pcinfo, PL_VK_ALLOC, &pass_vk->cache));
-
-    VkShaderModuleCreateInfo sinfo = {
-        .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
-    };
-
+    uint64_t driver_start = pl_clock_now();
     clock_t start = clock();
     switch (params->type) {
     case PL_PASS_RASTER: {
-        sinfo.pCode = (uint32_t *) vert.buf;
-        sinfo.codeSize = vert.len;
-        VK(vk->CreateShaderModule(vk->dev, &sinfo, PL_VK_ALLOC, &pass_vk->vert));
-        PL_VK_NAME(SHADER_MODULE, pass_vk->vert, "vertex");
-
-        sinfo.pCode = (uint32_t *) frag.buf;
-        sinfo.codeSize = frag.len;
-        VK(vk->CreateShaderModule(vk->dev, &sinfo, PL_VK_ALLOC, &pass_vk->shader));
-        PL_VK_NAME(SHADER_MODULE, pass_vk->shader, "fragment");
+        VK(module_acquire(gpu, vert, "vertex", &pass_vk->vert));
+        VK(module_acquire(gpu, frag, "fragment", &pass_vk->shader));
 
         pass_vk->attrs = pl_calloc_ptr(pass, params->num_vertex_attribs, pass_vk->attrs);
         for (int i = 0; i < params->num_vertex_attribs; i++) {
@@ -562,29 +1188,33 @@ no_descriptors: ;
             const struct vk_format **pfmt_vk = PL_PRIV(va->fmt);
 
             pass_vk->attrs[i] = (VkVertexInputAttributeDescription) {
-                .binding  = 0,
+                .binding  = va->instanced ? 1 : 0,
                 .location = va->location,
                 .offset   = va->offset,
                 .format   = PL_DEF((*pfmt_vk)->bfmt, (*pfmt_vk)->tfmt),
             };
         }
 
-        VkAttachmentLoadOp loadOp;
         if (pass->params.load_target) {
             pass_vk->initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-            loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+            pass_vk->loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
         } else {
             pass_vk->initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-            loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+            pass_vk->loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
         }
 
+        // With dynamic rendering, the attachment is specified directly when
+        // beginning rendering, so no render pass object is needed
+        if (p->dynamic_rendering)
+            break;
+
         VkRenderPassCreateInfo rinfo = {
             .sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,
             .attachmentCount = 1,
             .pAttachments = &(VkAttachmentDescription) {
                 .format = (VkFormat) params->target_format->signature,
                 .samples = VK_SAMPLE_COUNT_1_BIT,
-                .loadOp = loadOp,
+                .loadOp = pass_vk->loadOp,
                 .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
                 .initialLayout = pass_vk->initialLayout,
                 .finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
@@ -604,10 +1234,7 @@ no_descriptors: ;
         break;
     }
     case PL_PASS_COMPUTE: {
-        sinfo.pCode = (uint32_t *) comp.buf;
-        sinfo.codeSize = comp.len;
-        VK(vk->CreateShaderModule(vk->dev, &sinfo, PL_VK_ALLOC, &pass_vk->shader));
-        PL_VK_NAME(SHADER_MODULE, pass_vk->shader, "compute");
+        VK(module_acquire(gpu, comp, "compute", &pass_vk->shader));
         break;
     }
     case PL_PASS_INVALID:
@@ -620,28 +1247,19 @@ no_descriptors: ;
 
     // Create the graphics/compute pipeline
     VkPipeline *pipe = has_spec ? &pass_vk->base : &pass_vk->pipe;
-    VK(vk_recreate_pipelines(vk, pass, has_spec, NULL, pipe));
+    VK(vk_recreate_pipelines(gpu, pass, has_spec, NULL, pipe));
     pl_log_cpu_time(gpu->log, after_compilation, clock(), "creating pipeline");
+    pl_gpu_count_driver(gpu, pl_clock_now() - driver_start);
 
     if (!has_spec) {
         // We can free these if we no longer need them for specialization
         pl_free_ptr(&pass_vk->attrs);
-        vk->DestroyShaderModule(vk->dev, pass_vk->vert, PL_VK_ALLOC);
-        vk->DestroyShaderModule(vk->dev, pass_vk->shader, PL_VK_ALLOC);
-        pass_vk->vert = VK_NULL_HANDLE;
-        pass_vk->shader = VK_NULL_HANDLE;
-    }
-
-    // Update params->cached_program
-    pl_str cache = {0};
-    VK(vk->GetPipelineCacheData(vk->dev, pass_vk->cache, &cache.len, NULL));
-    cache.buf = pl_alloc(tmp, cache.len);
-    VK(vk->GetPipelineCacheData(vk->dev, pass_vk->cache, &cache.len, cache.buf));
-    if (!has_spec) {
-        vk->DestroyPipelineCache(vk->dev, pass_vk->cache, PL_VK_ALLOC);
-        pass_vk->cache = VK_NULL_HANDLE;
+        module_release(gpu, &pass_vk->vert);
+        module_release(gpu, &pass_vk->shader);
     }
 
+    // Update params->cached_program. The pipeline binaries themselves live in
+    // the device-wide pipeline cache, see `pl_vulkan_save_pipeline_cache`
     struct vk_cache_header header = {
         .magic = CACHE_MAGIC,
         .cache_version = CACHE_VERSION,
@@ -649,18 +1267,16 @@ no_descriptors: ;
         .vert_spirv_len = vert.len,
         .frag_spirv_len = frag.len,
         .comp_spirv_len = comp.len,
-        .pipecache_len = cache.len,
     };
 
-    PL_DEBUG(vk, "Pass statistics: size %zu, SPIR-V: vert %zu frag %zu comp %zu",
-             cache.len, vert.len, frag.len, comp.len);
+    PL_DEBUG(vk, "Pass statistics: SPIR-V: vert %zu frag %zu comp %zu",
+             vert.len, frag.len, comp.len);
 
     pl_str prog = {0};
     pl_str_append(pass, &prog, (pl_str){ (uint8_t *) &header, sizeof(header) });
     pl_str_append(pass, &prog, vert);
     pl_str_append(pass, &prog, frag);
     pl_str_append(pass, &prog, comp);
-    pl_str_append(pass, &prog, cache);
     pass->params.cached_program = prog.buf;
     pass->params.cached_program_len = prog.len;
 
@@ -747,15 +1363,16 @@ static void vk_update_descriptor(pl_gpu gpu, struct vk_cmd *cmd, pl_pass pass,
     case PL_DESC_BUF_STORAGE: {
         pl_buf buf = db.object;
         struct pl_buf_vk *buf_vk = PL_PRIV(buf);
+        size_t size = PL_DEF(db.buf_size, buf->params.size - db.buf_offset);
 
         vk_buf_barrier(gpu, cmd, buf, passStages[pass->params.type],
-                       access[desc->access], 0, buf->params.size, false);
+                       access[desc->access], db.buf_offset, size, false);
 
         VkDescriptorBufferInfo *binfo = &pass_vk->dsbinfo[idx];
         *binfo = (VkDescriptorBufferInfo) {
             .buffer = buf_vk->mem.buf,
-            .offset = buf_vk->mem.offset,
-            .range = buf->params.size,
+            .offset = buf_vk->mem.offset + db.buf_offset,
+            .range = size,
         };
 
         wds->pBufferInfo = binfo;
@@ -806,6 +1423,124 @@ static void vk_release_descriptor(pl_gpu gpu, struct vk_cmd *cmd, pl_pass pass,
     pl_unreachable();
 }
 
+#ifdef VK_EXT_descriptor_buffer
+// Writes a descriptor prepared by `vk_update_descriptor` into the given set
+// of the descriptor buffer
+static void descbuf_write(pl_gpu gpu, pl_pass pass, struct pl_desc_binding db,
+                          int idx, uint8_t *set)
+{
+    struct pl_vk *p = PL_PRIV(gpu);
+    struct vk_ctx *vk = p->vk;
+    struct pl_pass_vk *pass_vk = PL_PRIV(pass);
+    const struct pl_desc *desc = &pass->params.descriptors[idx];
+
+    VkDescriptorGetInfoEXT info = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_GET_INFO_EXT,
+        .type = dsType[desc->type],
+    };
+
+    VkDescriptorAddressInfoEXT ainfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_ADDRESS_INFO_EXT,
+    };
+
+    switch (desc->type) {
+    case PL_DESC_SAMPLED_TEX:
+        info.data.pCombinedImageSampler = &pass_vk->dsiinfo[idx];
+        break;
+    case PL_DESC_STORAGE_IMG:
+        info.data.pStorageImage = &pass_vk->dsiinfo[idx];
+        break;
+    case PL_DESC_BUF_UNIFORM:
+    case PL_DESC_BUF_STORAGE: {
+        pl_buf buf = db.object;
+        struct pl_buf_vk *buf_vk = PL_PRIV(buf);
+        pl_assert(buf_vk->mem.addr);
+        ainfo.address = buf_vk->mem.addr + db.buf_offset;
+        ainfo.range = pass_vk->dsbinfo[idx].range;
+        if (desc->type == PL_DESC_BUF_UNIFORM) {
+            info.data.pUniformBuffer = &ainfo;
+        } else {
+            info.data.pStorageBuffer = &ainfo;
+        }
+        break;
+    }
+    case PL_DESC_BUF_TEXEL_UNIFORM:
+    case PL_DESC_BUF_TEXEL_STORAGE: {
+        pl_buf buf = db.object;
+        struct pl_buf_vk *buf_vk = PL_PRIV(buf);
+        struct pl_fmt_vk *fmtp = PL_PRIV(buf->params.format);
+        pl_assert(buf_vk->mem.addr);
+        ainfo.address = buf_vk->mem.addr;
+        ainfo.range = buf_vk->mem.size;
+        ainfo.format = PL_DEF(fmtp->vk_fmt->bfmt, fmtp->vk_fmt->tfmt);
+        if (desc->type == PL_DESC_BUF_TEXEL_UNIFORM) {
+            info.data.pUniformTexelBuffer = &ainfo;
+        } else {
+            info.data.pStorageTexelBuffer = &ainfo;
+        }
+        break;
+    }
+    case PL_DESC_INVALID:
+    case PL_DESC_TYPE_COUNT:
+        pl_unreachable();
+    }
+
+    vk->GetDescriptorEXT(vk->dev, &info, p->descbuf_size[desc->type],
+                         set + pass_vk->descbuf_offsets[idx]);
+}
+#endif
+
+static inline uint64_t vk_obj_id(struct pl_vk *p, uint64_t *id)
+{
+    if (!*id)
+        *id = atomic_fetch_add(&p->obj_ids, 1) + 1;
+    return *id;
+}
+
+// Computes a key uniquely identifying the contents of the descriptors
+// prepared by `vk_update_descriptor`. The object IDs are included because
+// Vulkan handles may be recycled once the objects they refer to are destroyed.
+static uint64_t pass_ds_key(pl_gpu gpu, pl_pass pass,
+                            const struct pl_pass_run_params *params)
+{
+    struct pl_vk *p = PL_PRIV(gpu);
+    struct pl_pass_vk *pass_vk = PL_PRIV(pass);
+    const int num = pass->params.num_descriptors;
+
+    uint64_t key = pl_mem_hash(pass_vk->dsiinfo, num * sizeof(pass_vk->dsiinfo[0]));
+    pl_hash_merge(&key, pl_mem_hash(pass_vk->dsbinfo, num * sizeof(pass_vk->dsbinfo[0])));
+    for (int i = 0; i < num; i++) {
+        struct pl_desc_binding db = params->desc_bindings[i];
+        switch (pass->params.descriptors[i].type) {
+        case PL_DESC_SAMPLED_TEX:
+        case PL_DESC_STORAGE_IMG: {
+            pl_tex tex = db.object;
+            struct pl_tex_vk *tex_vk = PL_PRIV(tex);
+            pl_hash_merge(&key, vk_obj_id(p, &tex_vk->id));
+            continue;
+        }
+        case PL_DESC_BUF_UNIFORM:
+        case PL_DESC_BUF_STORAGE:
+        case PL_DESC_BUF_TEXEL_UNIFORM:
+        case PL_DESC_BUF_TEXEL_STORAGE: {
+            pl_buf buf = db.object;
+            struct pl_buf_vk *buf_vk = PL_PRIV(buf);
+            pl_hash_merge(&key, vk_obj_id(p, &buf_vk->id));
+            pl_hash_merge(&key, (uint64_t) buf_vk->view);
+            pl_hash_merge(&key, buf_vk->mem.addr);
+            continue;
+        }
+        case PL_DESC_INVALID:
+        case PL_DESC_TYPE_COUNT:
+            break;
+        }
+
+        pl_unreachable();
+    }
+
+    return PL_DEF(key, 1);
+}
+
 static void set_ds(struct pl_pass_vk *pass_vk, void *dsbit)
 {
     pass_vk->dmask |= (uintptr_t) dsbit;
@@ -848,8 +1583,21 @@ void vk_pass_run(pl_gpu gpu, const struct pl_pass_run_params *params)
     // Check if we need to re-specialize this pipeline
     if (need_respec(pass, params)) {
         clock_t start = clock();
-        VK(vk_recreate_pipelines(vk, pass, false, pass_vk->base, &pass_vk->pipe));
+        uint64_t start_ns = pl_clock_now();
+        VK(vk_recreate_pipelines(gpu, pass, false, pass_vk->base, &pass_vk->pipe));
         pl_log_cpu_time(gpu->log, start, clock(), "re-specializing shader");
+        pl_gpu_count_driver(gpu, pl_clock_now() - start_ns);
+    }
+
+    // Swap in the optimized pipeline once it's ready
+    if (pass_vk->gpl_job && gpl_job_done(pass_vk->gpl_job)) {
+        struct vk_gpl_job *job = pass_vk->gpl_job;
+        if (job->pipe) {
+            vk_gpu_callback(gpu, (vk_cb) destroy_pipeline, vk, pass_vk->pipe);
+            pass_vk->pipe = job->pipe;
+            job->pipe = VK_NULL_HANDLE;
+        }
+        gpl_job_destroy(gpu, &pass_vk->gpl_job);
     }
 
     if (!pass_vk->use_pushd) {
@@ -860,22 +1608,30 @@ void vk_pass_run(pl_gpu gpu, const struct pl_pass_run_params *params)
         }
     }
 
-    static const enum queue_type types[] = {
-        [PL_PASS_RASTER]  = GRAPHICS,
-        [PL_PASS_COMPUTE] = COMPUTE,
-    };
+    // Only move compute passes to the async compute queue when hinted to,
+    // since dependent passes would otherwise bounce between queues, incurring
+    // a submission and semaphore wait for every switch. Cross-queue
+    // dependencies are resolved by the timeline semaphores in `vk_sem`.
+    enum queue_type queue = GRAPHICS;
+    if (pass->params.type == PL_PASS_COMPUTE) {
+        bool gfx_compute = vk->pool_graphics->props.queueFlags & VK_QUEUE_COMPUTE_BIT;
+        if (params->async || !gfx_compute)
+            queue = COMPUTE;
+    }
 
-    struct vk_cmd *cmd = CMD_BEGIN_TIMED(types[pass->params.type], params->timer);
+    struct vk_cmd *cmd = CMD_BEGIN_TIMED(queue, params->timer);
     if (!cmd)
         goto error;
 
     // Find a descriptor set to use
     VkDescriptorSet ds = VK_NULL_HANDLE;
+    int ds_idx = -1;
     if (!pass_vk->use_pushd) {
         for (int i = 0; i < PL_ARRAY_SIZE(pass_vk->dss); i++) {
             uint16_t dsbit = 1u << i;
             if (pass_vk->dmask & dsbit) {
                 ds = pass_vk->dss[i];
+                ds_idx = i;
                 pass_vk->dmask &= ~dsbit; // unset
                 vk_cmd_callback(cmd, (vk_cb) set_ds, pass_vk,
                                 (void *)(uintptr_t) dsbit);
@@ -888,7 +1644,24 @@ void vk_pass_run(pl_gpu gpu, const struct pl_pass_run_params *params)
     for (int i = 0; i < pass->params.num_descriptors; i++)
         vk_update_descriptor(gpu, cmd, pass, params->desc_bindings[i], ds, i);
 
+    // Skip rewriting the set if it already contains the same bindings
+    bool ds_dirty = true;
     if (!pass_vk->use_pushd) {
+        uint64_t key = pass_ds_key(gpu, pass, params);
+        ds_dirty = pass_vk->ds_keys[ds_idx] != key;
+        pass_vk->ds_keys[ds_idx] = key;
+    }
+
+#ifdef VK_EXT_descriptor_buffer
+    if (pass_vk->use_descbuf && ds_dirty) {
+        uint8_t *set = pass_vk->descbuf.data;
+        set += ds_idx * pass_vk->descbuf_stride;
+        for (int i = 0; i < pass->params.num_descriptors; i++)
+            descbuf_write(gpu, pass, params->desc_bindings[i], i, set);
+    }
+#endif
+
+    if (!pass_vk->use_pushd && !pass_vk->use_descbuf && ds_dirty) {
         vk->UpdateDescriptorSets(vk->dev, pass->params.num_descriptors,
                                  pass_vk->dswrite, 0, NULL);
     }
@@ -907,6 +1680,23 @@ void vk_pass_run(pl_gpu gpu, const struct pl_pass_run_params *params)
                                   pass_vk->pipeLayout, 0, 1, &ds, 0, NULL);
     }
 
+#ifdef VK_EXT_descriptor_buffer
+    if (pass_vk->use_descbuf) {
+        VkDescriptorBufferBindingInfoEXT binfo = {
+            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_BUFFER_BINDING_INFO_EXT,
+            .address = pass_vk->descbuf.addr,
+            .usage = DESCBUF_USAGE,
+        };
+
+        const uint32_t index = 0;
+        const VkDeviceSize offset = ds_idx * pass_vk->descbuf_stride;
+        vk->CmdBindDescriptorBuffersEXT(cmd->buf, 1, &binfo);
+        vk->CmdSetDescriptorBufferOffsetsEXT(cmd->buf, bindPoint[pass->params.type],
+                                             pass_vk->pipeLayout, 0, 1,
+                                             &index, &offset);
+    }
+#endif
+
     if (pass_vk->use_pushd) {
         vk->CmdPushDescriptorSetKHR(cmd->buf, bindPoint[pass->params.type],
                                     pass_vk->pipeLayout, 0,
@@ -943,6 +1733,19 @@ void vk_pass_run(pl_gpu gpu, const struct pl_pass_run_params *params)
         VkDeviceSize offset = vert_vk->mem.offset + params->buf_offset;
         vk->CmdBindVertexBuffers(cmd->buf, 0, 1, &vert_vk->mem.buf, &offset);
 
+        pl_buf inst = params->instance_buf;
+        if (inst) {
+            struct pl_buf_vk *inst_vk = PL_PRIV(inst);
+            if (inst != vert) {
+                vk_buf_barrier(gpu, cmd, inst, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+                               VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT, 0,
+                               inst->params.size, false);
+            }
+
+            VkDeviceSize inst_offset = inst_vk->mem.offset + params->instance_offset;
+            vk->CmdBindVertexBuffers(cmd->buf, 1, 1, &inst_vk->mem.buf, &inst_offset);
+        }
+
         if (index) {
             if (index != vert) {
                 vk_buf_barrier(gpu, cmd, index, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
@@ -960,9 +1763,18 @@ void vk_pass_run(pl_gpu gpu, const struct pl_pass_run_params *params)
                                    index_fmts[params->index_fmt]);
         }
 
+        // Without a render pass to perform the layout transition implicitly,
+        // transition to the attachment layout directly (discarding the
+        // contents unless we're loading them)
+        VkImageLayout layout = pass_vk->initialLayout;
+        if (p->dynamic_rendering) {
+            if (!pass->params.load_target)
+                tex_vk->may_invalidate = true;
+            layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+        }
+
         vk_tex_barrier(gpu, cmd, tex, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-                       VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
-                       pass_vk->initialLayout, false);
+                       VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, layout, false);
 
         VkViewport viewport = {
             .x = params->viewport.x0,
@@ -979,28 +1791,57 @@ void vk_pass_run(pl_gpu gpu, const struct pl_pass_run_params *params)
         vk->CmdSetViewport(cmd->buf, 0, 1, &viewport);
         vk->CmdSetScissor(cmd->buf, 0, 1, &scissor);
 
-        VkRenderPassBeginInfo binfo = {
-            .sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
-            .renderPass = pass_vk->renderPass,
-            .framebuffer = tex_vk->framebuffer,
-            .renderArea.extent = {tex->params.w, tex->params.h},
-        };
+        vk_cmd_flush_barriers(vk, cmd);
+
+#ifdef VK_KHR_dynamic_rendering
+        if (p->dynamic_rendering) {
+            vk->CmdBeginRenderingKHR(cmd->buf, &(VkRenderingInfoKHR) {
+                .sType = VK_STRUCTURE_TYPE_RENDERING_INFO_KHR,
+                .renderArea.extent = {tex->params.w, tex->params.h},
+                .layerCount = 1,
+                .colorAttachmentCount = 1,
+                .pColorAttachments = &(VkRenderingAttachmentInfoKHR) {
+                    .sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO_KHR,
+                    .imageView = tex_vk->view,
+                    .imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+                    .loadOp = pass_vk->loadOp,
+                    .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+                },
+            });
+        }
+#endif
+
+        if (!p->dynamic_rendering) {
+            VkRenderPassBeginInfo binfo = {
+                .sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
+                .renderPass = pass_vk->renderPass,
+                .framebuffer = tex_vk->framebuffer,
+                .renderArea.extent = {tex->params.w, tex->params.h},
+            };
 
-        vk->CmdBeginRenderPass(cmd->buf, &binfo, VK_SUBPASS_CONTENTS_INLINE);
+            vk->CmdBeginRenderPass(cmd->buf, &binfo, VK_SUBPASS_CONTENTS_INLINE);
+        }
 
+        const uint32_t instances = PL_MAX(params->instance_count, 1);
         if (index) {
-            vk->CmdDrawIndexed(cmd->buf, params->vertex_count, 1, 0, 0, 0);
+            vk->CmdDrawIndexed(cmd->buf, params->vertex_count, instances, 0, 0, 0);
         } else {
-            vk->CmdDraw(cmd->buf, params->vertex_count, 1, 0, 0);
+            vk->CmdDraw(cmd->buf, params->vertex_count, instances, 0, 0);
         }
 
-        vk->CmdEndRenderPass(cmd->buf);
+#ifdef VK_KHR_dynamic_rendering
+        if (p->dynamic_rendering)
+            vk->CmdEndRenderingKHR(cmd->buf);
+#endif
+        if (!p->dynamic_rendering)
+            vk->CmdEndRenderPass(cmd->buf);
 
         // The renderPass implicitly transitions the texture to this layout
         tex_vk->layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
         break;
     }
     case PL_PASS_COMPUTE:
+        vk_cmd_flush_barriers(vk, cmd);
         vk->CmdDispatch(cmd->buf, params->compute_groups[0],
                         params->compute_groups[1],
                         params->compute_groups[2]);
@@ -1013,8 +1854,9 @@ void vk_pass_run(pl_gpu gpu, const struct pl_pass_run_params *params)
     for (int i = 0; i < pass->params.num_descriptors; i++)
         vk_release_descriptor(gpu, cmd, pass, params->desc_bindings[i], i);
 
-    // submit this command buffer for better intra-frame granularity
-    CMD_SUBMIT(&cmd);
+    // queue this command buffer for better intra-frame granularity, it will be
+    // submitted together with any others at the next flush
+    CMD_QUEUE(&cmd);
 
 error:
     return;
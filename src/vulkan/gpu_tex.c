@@ -75,10 +75,8 @@ void vk_tex_barrier(pl_gpu gpu, struct vk_cmd *cmd, pl_tex tex,
     }
 
     bool is_xfer = barr.srcQueueFamilyIndex != barr.dstQueueFamilyIndex;
-    if (last.access || is_trans || is_xfer) {
-        vk->CmdPipelineBarrier(cmd->buf, last.stage, stage, 0, 0, NULL,
-                               0, NULL, 1, &barr);
-    }
+    if (last.access || is_trans || is_xfer)
+        vk_cmd_barrier(vk, cmd, last.stage, stage, &barr, NULL);
 
     tex_vk->layout = layout;
     vk_cmd_callback(cmd, (vk_cb) vk_tex_deref, gpu, tex);
@@ -169,6 +167,19 @@ static bool vk_init_image(pl_gpu gpu, pl_tex tex, pl_debug_tag debug_tag)
     }
 
     if (params->renderable) {
+        uint32_t fb_w = tex->params.w, fb_h = tex->params.h;
+        if (fb_w > vk->limits.maxFramebufferWidth ||
+            fb_h > vk->limits.maxFramebufferHeight)
+        {
+            PL_ERR(gpu, "Framebuffer of size %dx%d exceeds the maximum allowed "
+                   "dimensions: %dx%d", fb_w, fb_h,
+                   vk->limits.maxFramebufferWidth,
+                   vk->limits.maxFramebufferHeight);
+            goto error;
+        }
+    }
+
+    if (params->renderable && !p->dynamic_rendering) {
         // Framebuffers need to be created against a specific render pass
         // layout, so we need to temporarily create a skeleton/dummy render
         // pass for vulkan to figure out the compatibility
@@ -206,16 +217,6 @@ static bool vk_init_image(pl_gpu gpu, pl_tex tex, pl_debug_tag debug_tag)
             .layers = 1,
         };
 
-        if (finfo.width > vk->limits.maxFramebufferWidth ||
-            finfo.height > vk->limits.maxFramebufferHeight)
-        {
-            PL_ERR(gpu, "Framebuffer of size %dx%d exceeds the maximum allowed "
-                   "dimensions: %dx%d", finfo.width, finfo.height,
-                   vk->limits.maxFramebufferWidth,
-                   vk->limits.maxFramebufferHeight);
-            goto error;
-        }
-
         VK(vk->CreateFramebuffer(vk->dev, &finfo, PL_VK_ALLOC,
                                  &tex_vk->framebuffer));
         PL_VK_NAME(FRAMEBUFFER, tex_vk->framebuffer, debug_tag);
@@ -239,6 +240,8 @@ pl_tex vk_tex_create(pl_gpu gpu, const struct pl_tex_params *params)
     struct pl_tex *tex = pl_zalloc_obj(NULL, tex, struct pl_tex_vk);
     tex->params = *params;
     tex->params.initial_data = NULL;
+    tex->params.export_modifiers = NULL;
+    tex->params.num_export_modifiers = 0;
     tex->sampler_type = PL_SAMPLER_NORMAL;
 
     struct pl_tex_vk *tex_vk = PL_PRIV(tex);
@@ -411,6 +414,47 @@ pl_tex vk_tex_create(pl_gpu gpu, const struct pl_tex_params *params)
         .pNext = handle_type ? &ext_props : NULL,
     };
 
+    if (params->export_handle == PL_HANDLE_DMA_BUF) {
+        // Narrow down the modifiers to those supported by the consumer, as
+        // well as by the driver for this combination of image parameters.
+        // The driver then picks the optimal one out of the remaining list,
+        // which favors compressed or tiled layouts over LINEAR.
+        PL_ARRAY(uint64_t) mods = {0};
+        for (int i = 0; i < params->format->num_modifiers; i++) {
+            uint64_t mod = params->format->modifiers[i];
+            bool wanted = !params->num_export_modifiers;
+            for (int j = 0; j < params->num_export_modifiers; j++)
+                wanted |= params->export_modifiers[j] == mod;
+            if (!wanted)
+                continue;
+
+            drm_pinfo.drmFormatModifier = mod;
+            if (vk->GetPhysicalDeviceImageFormatProperties2KHR(vk->physd, &pinfo,
+                                                               &props) != VK_SUCCESS)
+                continue;
+
+            VkExtent3D max = props.imageFormatProperties.maxExtent;
+            if (params->w > max.width || params->h > max.height ||
+                params->d > max.depth ||
+                !vk_external_mem_check(vk, &ext_props.externalMemoryProperties,
+                                       handle_type, false))
+                continue;
+
+            PL_ARRAY_APPEND(tex, mods, mod);
+        }
+
+        if (!mods.num) {
+            PL_ERR(gpu, "No DRM format modifier of format %s is supported by "
+                   "both the consumer and the requested image parameters!",
+                   params->format->name);
+            goto error;
+        }
+
+        drm_list.drmFormatModifierCount = mods.num;
+        drm_list.pDrmFormatModifiers = mods.elem;
+        drm_pinfo.drmFormatModifier = mods.elem[0]; // for the checks below
+    }
+
     VkResult res;
     res = vk->GetPhysicalDeviceImageFormatProperties2KHR(vk->physd, &pinfo, &props);
     if (res == VK_ERROR_FORMAT_NOT_SUPPORTED) {
@@ -490,6 +534,8 @@ pl_tex vk_tex_create(pl_gpu gpu, const struct pl_tex_params *params)
 
             VK(vk->GetImageDrmFormatModifierPropertiesEXT(vk->dev, tex_vk->img, &mod_props));
             tex->shared_mem.drm_format_mod = mod_props.drmFormatModifier;
+            PL_DEBUG(gpu, "Exporting DMA-BUF with DRM format modifier %s",
+                     PRINT_DRM_MOD(mod_props.drmFormatModifier));
 
             VkSubresourceLayout layout = {0};
             VkImageSubresource plane = {
@@ -544,6 +590,15 @@ void vk_tex_invalidate(pl_gpu gpu, pl_tex tex)
     tex_vk->may_invalidate = true;
 }
 
+void vk_tex_reset_import(pl_gpu gpu, pl_tex tex)
+{
+    // The external producer (e.g. a decoder) may have written to the memory
+    // in the meantime, so treat it exactly like a freshly imported image
+    struct pl_tex_vk *tex_vk = PL_PRIV(tex);
+    tex_vk->layout = VK_IMAGE_LAYOUT_UNDEFINED;
+    tex_vk->may_invalidate = true;
+}
+
 void vk_tex_clear_ex(pl_gpu gpu, pl_tex tex, const union pl_clear_color color)
 {
     struct pl_vk *p = PL_PRIV(gpu);
@@ -568,6 +623,7 @@ void vk_tex_clear_ex(pl_gpu gpu, pl_tex tex, const union pl_clear_color color)
         .layerCount = 1,
     };
 
+    vk_cmd_flush_barriers(vk, cmd);
     vk->CmdClearColorImage(cmd->buf, tex_vk->img, tex_vk->layout,
                            clearColor, 1, &range);
 
@@ -628,6 +684,7 @@ void vk_tex_blit(pl_gpu gpu, const struct pl_tex_blit_params *params)
             },
         };
 
+        vk_cmd_flush_barriers(vk, cmd);
         vk->CmdCopyImage(cmd->buf, src_vk->img, src_vk->layout,
                          dst_vk->img, dst_vk->layout, 1, &region);
     } else {
@@ -645,6 +702,7 @@ void vk_tex_blit(pl_gpu gpu, const struct pl_tex_blit_params *params)
             [PL_TEX_SAMPLE_LINEAR]  = VK_FILTER_LINEAR,
         };
 
+        vk_cmd_flush_barriers(vk, cmd);
         vk->CmdBlitImage(cmd->buf, src_vk->img, src_vk->layout,
                          dst_vk->img, dst_vk->layout, 1, &region,
                          filters[params->sample_mode]);
@@ -777,6 +835,7 @@ bool vk_tex_upload(pl_gpu gpu, const struct pl_tex_transfer_params *params)
                        false);
         vk_buf_barrier(gpu, cmd, tbuf, VK_PIPELINE_STAGE_TRANSFER_BIT,
                        VK_ACCESS_TRANSFER_WRITE_BIT, 0, size, false);
+        vk_cmd_flush_barriers(vk, cmd);
         vk->CmdCopyBuffer(cmd->buf, buf_vk->mem.buf, tbuf_vk->mem.buf,
                           1, &region);
 
@@ -821,6 +880,7 @@ bool vk_tex_upload(pl_gpu gpu, const struct pl_tex_transfer_params *params)
         vk_tex_barrier(gpu, cmd, tex, VK_PIPELINE_STAGE_TRANSFER_BIT,
                        VK_ACCESS_TRANSFER_WRITE_BIT,
                        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, false);
+        vk_cmd_flush_barriers(vk, cmd);
         vk->CmdCopyBufferToImage(cmd->buf, buf_vk->mem.buf, tex_vk->img,
                                  tex_vk->layout, 1, &region);
 
@@ -901,6 +961,7 @@ bool vk_tex_download(pl_gpu gpu, const struct pl_tex_transfer_params *params)
         vk_buf_barrier(gpu, cmd, buf, VK_PIPELINE_STAGE_TRANSFER_BIT,
                        VK_ACCESS_TRANSFER_WRITE_BIT, params->buf_offset, size,
                        false);
+        vk_cmd_flush_barriers(vk, cmd);
         vk->CmdCopyBuffer(cmd->buf, tbuf_vk->mem.buf, buf_vk->mem.buf,
                           1, &region);
         vk_buf_flush(gpu, cmd, buf, params->buf_offset, size);
@@ -939,6 +1000,7 @@ bool vk_tex_download(pl_gpu gpu, const struct pl_tex_transfer_params *params)
         vk_tex_barrier(gpu, cmd, tex, VK_PIPELINE_STAGE_TRANSFER_BIT,
                        VK_ACCESS_TRANSFER_READ_BIT,
                        VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, false);
+        vk_cmd_flush_barriers(vk, cmd);
         vk->CmdCopyImageToBuffer(cmd->buf, tex_vk->img, tex_vk->layout,
                                  buf_vk->mem.buf, 1, &region);
         vk_buf_flush(gpu, cmd, buf, params->buf_offset, size);
@@ -990,12 +1052,20 @@ bool vk_tex_export(pl_gpu gpu, pl_tex tex, pl_sync sync)
     // Make the next barrier appear as though coming from a different queue
     tex_vk->sem.write.queue = tex_vk->sem.read.queue = NULL;
 
-    vk_cmd_sig(cmd, (pl_vulkan_sem){ sync_vk->wait });
+    // Timeline sync objects advance to the next value on every export
+    uint64_t value = sync->timeline ? sync->wait_value + 1 : 0;
+    vk_cmd_sig(cmd, (pl_vulkan_sem){ sync_vk->wait, value });
     if (!CMD_SUBMIT(&cmd))
         goto error;
 
+    if (sync->timeline) {
+        struct pl_sync *sync_mut = (struct pl_sync *) sync;
+        sync_mut->wait_value = sync_mut->signal_value = value;
+    }
+
     // Remember the other dependency and hold on to the sync object
-    PL_ARRAY_APPEND(tex, tex_vk->ext_deps, (pl_vulkan_sem){ sync_vk->signal });
+    PL_ARRAY_APPEND(tex, tex_vk->ext_deps,
+                    (pl_vulkan_sem){ sync_vk->signal, value });
     pl_rc_ref(&sync_vk->rc);
     tex_vk->ext_sync = sync;
     return true;
@@ -1074,6 +1144,7 @@ pl_tex pl_vulkan_wrap(pl_gpu gpu, const struct pl_vulkan_wrap_params *params)
     if (!vk_init_image(gpu, tex, PL_DEF(params->debug_tag, "wrapped")))
         goto error;
 
+    pl_gpu_track_tex(gpu, tex);
     return tex;
 
 error:
@@ -19,6 +19,7 @@
 #include "command.h"
 #include "utils.h"
 #include "pl_thread.h"
+#include "pl_clock.h"
 
 #ifdef PL_HAVE_UNIX
 #include <errno.h>
@@ -54,6 +55,27 @@
 // this many invocations of `vk_malloc_garbage_collect` will be released.
 #define MAXIMUM_SLAB_AGE 8
 
+// Default fraction of each heap's memory budget that allocations are kept
+// below, if not overridden by the user
+#define DEFAULT_BUDGET_FRACTION 0.9f
+
+// Default limit on the amount of device-local, host-visible memory (i.e. the
+// PCIe BAR) used for streaming allocations, as a fraction of its heap size and
+// as an absolute maximum
+#define DEFAULT_BAR_FRACTION 0.25
+#define DEFAULT_BAR_MAX (256LLU << 20)
+
+// Controls the number of independently locked caches of recently freed
+// slices, and the number of slices each of them can hold. Threads spread out
+// over these by trying each cache in turn, so concurrent allocations rarely
+// contend on the same lock.
+#define NUM_SLICE_CACHES  8
+#define SLICE_CACHE_SIZE 32
+
+// Controls the maximum size of slices held by the slice caches. Larger
+// allocations always go through the pools. (Default: 1 MB)
+#define MAXIMUM_CACHED_SIZE (1LLU << 20)
+
 // A single slab represents a contiguous region of allocated memory. Actual
 // allocations are served as pages of this. Slabs are organized into pools,
 // each of which contains a list of slabs of differing page sizes.
@@ -70,9 +92,14 @@ struct vk_slab {
     size_t pagesize;        // size in bytes per page
     size_t used;            // number of bytes actually in use
     uint64_t age;           // timestamp of last use
+    bool evacuating;        // slab is being emptied by `vk_malloc_defrag`
+    void *owners[MAXIMUM_PAGE_COUNT]; // optional, see `vk_malloc_set_owner`
+    int cached;             // number of pages held by slice caches
+    struct vk_malloc_params pool_params; // params of the owning `vk_pool`
 
     // optional, depends on the memory type:
     VkBuffer buffer;        // buffer spanning the entire slab
+    uint64_t addr;          // device address of `buffer`, if requested
     void *data;             // mapped memory corresponding to `mem`
     bool coherent;          // mapped memory is coherent
     union pl_handle handle; // handle associated with this device memory
@@ -92,6 +119,22 @@ struct vk_pool {
     int index;                        // running index in `vk_malloc.pools`
 };
 
+// A page which was freed by the user, but retained for reuse by subsequent
+// allocations of the same size from the same pool. These pages remain
+// reserved in the slab's `spacemap`, but are not counted towards `used`.
+struct vk_cached_slice {
+    struct vk_slab *slab;
+    VkDeviceSize offset;
+    VkDeviceSize size;
+    bool stale;             // survived one `vk_malloc_garbage_collect`
+};
+
+struct vk_slice_cache {
+    pl_mutex lock;
+    struct vk_cached_slice slices[SLICE_CACHE_SIZE]; // oldest first
+    int num;
+};
+
 // The overall state of the allocator, which keeps track of a vk_pool for each
 // memory type.
 struct vk_malloc {
@@ -100,8 +143,39 @@ struct vk_malloc {
     VkPhysicalDeviceMemoryProperties props;
     PL_ARRAY(struct vk_pool) pools;
     uint64_t age;
+
+    // Memory budget accounting, indexed by heap
+    pl_mutex budget_lock;
+    bool has_budget;        // VK_EXT_memory_budget is enabled
+    float budget_fraction;  // fraction of the budget to stay below
+    uint64_t trim_age;      // value of `age` at the last trim
+    VkDeviceSize budget[VK_MAX_MEMORY_HEAPS];
+    VkDeviceSize usage[VK_MAX_MEMORY_HEAPS];     // as of the last query
+    VkDeviceSize allocated[VK_MAX_MEMORY_HEAPS]; // allocated by us
+    VkDeviceSize queried[VK_MAX_MEMORY_HEAPS];   // `allocated` at last query
+
+    // Device-local, host-visible memory types (e.g. resizable BAR) preferred
+    // for streaming allocations, and the amount of memory allocated from them
+    uint32_t bar_mask;
+    VkDeviceSize bar_limit;
+    VkDeviceSize bar_allocated; // protected by `budget_lock`
+
+    // Optional callback to free up cached resources under memory pressure
+    void (*trim)(void *priv);
+    void *trim_priv;
+
+    // Caches of recently freed slices, which bypass `lock` entirely
+    struct vk_slice_cache caches[NUM_SLICE_CACHES];
+    atomic_uint cache_idx;
 };
 
+static inline bool is_bar(VkMemoryType mtype)
+{
+    const VkMemoryPropertyFlags bar = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT |
+                                      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+    return (mtype.propertyFlags & bar) == bar;
+}
+
 static inline float efficiency(size_t used, size_t total)
 {
     if (!total)
@@ -265,6 +339,15 @@ static void slab_free(struct vk_ctx *vk, struct vk_slab *slab)
         PL_DEBUG(vk, "Freeing slab of size %s", PRINT_SIZE(slab->size));
     }
 
+    if (slab->mem && !slab->imported) {
+        struct vk_malloc *ma = vk->ma;
+        pl_mutex_lock(&ma->budget_lock);
+        ma->allocated[slab->mtype.heapIndex] -= slab->size;
+        if (is_bar(slab->mtype))
+            ma->bar_allocated -= slab->size;
+        pl_mutex_unlock(&ma->budget_lock);
+    }
+
     vk->DestroyBuffer(vk->dev, slab->buffer, PL_VK_ALLOC);
     // also implicitly unmaps the memory if needed
     vk->FreeMemory(vk->dev, slab->mem, PL_VK_ALLOC);
@@ -273,14 +356,70 @@ static void slab_free(struct vk_ctx *vk, struct vk_slab *slab)
     pl_free(slab);
 }
 
-// type_mask: optional
-// thread-safety: safe
-static bool find_best_memtype(const struct vk_malloc *ma, uint32_t type_mask,
-                              const struct vk_malloc_params *params,
-                              uint32_t *out_index)
+// Refresh the memory budget from the driver, if possible
+//
+// Note: Must be called with `ma->budget_lock` held
+static void update_budget(struct vk_malloc *ma)
 {
     struct vk_ctx *vk = ma->vk;
-    int best = -1;
+    if (!ma->has_budget)
+        return;
+
+    VkPhysicalDeviceMemoryBudgetPropertiesEXT budget_props = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT,
+    };
+
+    VkPhysicalDeviceMemoryProperties2 props = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2,
+        .pNext = &budget_props,
+    };
+
+    vk->GetPhysicalDeviceMemoryProperties2(vk->physd, &props);
+    for (int i = 0; i < ma->props.memoryHeapCount; i++) {
+        ma->budget[i] = budget_props.heapBudget[i];
+        ma->usage[i] = budget_props.heapUsage[i];
+        ma->queried[i] = ma->allocated[i];
+    }
+}
+
+// Estimated current usage of a heap, accounting for allocations made or
+// freed by us since the last budget query
+//
+// Note: Must be called with `ma->budget_lock` held
+static VkDeviceSize heap_usage(const struct vk_malloc *ma, int heap)
+{
+    VkDeviceSize usage = ma->usage[heap] + ma->allocated[heap];
+    return usage > ma->queried[heap] ? usage - ma->queried[heap] : 0;
+}
+
+// thread-safety: safe
+static bool heap_has_room(struct vk_malloc *ma, int heap, VkDeviceSize size)
+{
+    pl_mutex_lock(&ma->budget_lock);
+    VkDeviceSize limit = (double) ma->budget_fraction * ma->budget[heap];
+    bool ok = heap_usage(ma, heap) + size <= limit;
+    pl_mutex_unlock(&ma->budget_lock);
+    return ok;
+}
+
+// thread-safety: safe
+static bool bar_has_room(struct vk_malloc *ma, VkDeviceSize size)
+{
+    pl_mutex_lock(&ma->budget_lock);
+    bool ok = ma->bar_allocated + size <= ma->bar_limit;
+    pl_mutex_unlock(&ma->budget_lock);
+    return ok;
+}
+
+// Returns the best memory type index, or -1. If `size` is nonzero, memory
+// types whose heap would exceed the budget are skipped.
+//
+// thread-safety: safe
+static int find_memtype(struct vk_malloc *ma, uint32_t type_mask,
+                        const struct vk_malloc_params *params,
+                        VkDeviceSize size)
+{
+    int best = -1, index = -1;
 
     // The vulkan spec requires memory types to be sorted in the "optimal"
     // order, so the first matching type we find will be the best/fastest one.
@@ -304,21 +443,116 @@ static bool find_best_memtype(const struct vk_malloc *ma, uint32_t type_mask,
         if (!(type_mask & (1LU << i)))
             continue;
 
+        if (size && !heap_has_room(ma, mtype->heapIndex, size))
+            continue;
+
         // Calculate the score as the number of optimal property flags matched
         int score = __builtin_popcountl(mtype->propertyFlags & params->optimal);
         if (score > best) {
-            *out_index = i;
+            index = i;
             best = score;
         }
     }
 
-    if (best < 0) {
+    return index;
+}
+
+// type_mask: optional
+// thread-safety: safe
+static bool find_best_memtype(struct vk_malloc *ma, uint32_t type_mask,
+                              const struct vk_malloc_params *params,
+                              uint32_t *out_index)
+{
+    struct vk_ctx *vk = ma->vk;
+    type_mask &= params->reqs.memoryTypeBits;
+    int index = find_memtype(ma, type_mask, params, 0);
+    if (index < 0) {
         PL_ERR(vk, "Found no memory type matching property flags 0x%x and type "
                "bits 0x%x!",
                (unsigned) params->required, (unsigned) type_mask);
         return false;
     }
 
+    *out_index = index;
+    return true;
+}
+
+static void garbage_collect(struct vk_malloc *ma, bool force);
+
+// Free up memory by trimming caches and releasing all empty slabs. This is
+// done at most once per `vk_malloc_garbage_collect` cycle, since it's costly
+// and unlikely to help twice in a row.
+//
+// thread-safety: safe, but must not be called with `ma->lock` held
+static void trim_memory(struct vk_malloc *ma)
+{
+    pl_mutex_lock(&ma->lock);
+    bool skip = ma->trim_age == ma->age;
+    ma->trim_age = ma->age;
+    pl_mutex_unlock(&ma->lock);
+    if (skip)
+        return;
+
+    if (ma->trim)
+        ma->trim(ma->trim_priv);
+    garbage_collect(ma, true);
+
+    pl_mutex_lock(&ma->budget_lock);
+    update_budget(ma);
+    pl_mutex_unlock(&ma->budget_lock);
+}
+
+// Like `find_best_memtype`, but also respects the memory budget: if the best
+// memory type's heap is over budget, try trimming caches first, and then fall
+// back to other compatible heaps with room to spare. As a last resort, the
+// budget is exceeded rather than failing the allocation outright.
+//
+// thread-safety: safe, but must not be called with `ma->lock` held
+static bool pick_memtype(struct vk_malloc *ma, uint32_t type_mask,
+                         const struct vk_malloc_params *params,
+                         VkDeviceSize size, uint32_t *out_index)
+{
+    struct vk_ctx *vk = ma->vk;
+    if (params->streaming && (type_mask & ma->bar_mask)) {
+        // Frequently rewritten data is best placed directly in device-local,
+        // host-visible memory, so the GPU can read it without an extra copy
+        struct vk_malloc_params bar = *params;
+        bar.optimal |= VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT |
+                       VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+        int index = find_memtype(ma, type_mask & ma->bar_mask, &bar, size);
+        if (index >= 0 && bar_has_room(ma, size)) {
+            *out_index = index;
+            return true;
+        }
+
+        // Over the limit, so stay out of the BAR entirely if possible
+        if (find_memtype(ma, type_mask & ~ma->bar_mask, params, 0) >= 0)
+            type_mask &= ~ma->bar_mask;
+    }
+
+    if (!find_best_memtype(ma, type_mask, params, out_index))
+        return false;
+
+    int heap = ma->props.memoryTypes[*out_index].heapIndex;
+    if (heap_has_room(ma, heap, size))
+        return true;
+
+    PL_DEBUG(vk, "Allocation of %s would exceed the budget of heap %d, "
+             "trimming caches", PRINT_SIZE(size), heap);
+    trim_memory(ma);
+    if (heap_has_room(ma, heap, size))
+        return true;
+
+    int index = find_memtype(ma, type_mask, params, size);
+    if (index >= 0) {
+        PL_DEBUG(vk, "Falling back to memory type %d in heap %d", index,
+                 (int) ma->props.memoryTypes[index].heapIndex);
+        *out_index = index;
+        return true;
+    }
+
+    PL_DEBUG(vk, "No compatible heap has room, exceeding the budget of "
+             "heap %d", heap);
     return true;
 }
 
@@ -344,6 +578,22 @@ static bool buf_external_check(struct vk_ctx *vk, VkBufferUsageFlags usage,
                                  handle_type, import);
 }
 
+// Returns the device address of a buffer, or 0 if it has none
+static uint64_t buf_address(struct vk_ctx *vk, VkBuffer buf,
+                            VkBufferUsageFlags usage)
+{
+#ifdef VK_EXT_descriptor_buffer
+    if (usage & VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT) {
+        return vk->GetBufferDeviceAddressKHR(vk->dev, &(VkBufferDeviceAddressInfo) {
+            .sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO,
+            .buffer = buf,
+        });
+    }
+#endif
+
+    return 0;
+}
+
 // thread-safety: safe
 static struct vk_slab *slab_alloc(struct vk_malloc *ma,
                                   const struct vk_malloc_params *params)
@@ -434,7 +684,17 @@ static struct vk_slab *slab_alloc(struct vk_malloc *ma,
     if (params->ded_image)
         vk_link_struct(&minfo, &dinfo);
 
-    if (!find_best_memtype(ma, type_mask, params, &minfo.memoryTypeIndex))
+#ifdef VK_EXT_descriptor_buffer
+    VkMemoryAllocateFlagsInfo finfo = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO,
+        .flags = VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT,
+    };
+
+    if (params->buf_usage & VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT)
+        vk_link_struct(&minfo, &finfo);
+#endif
+
+    if (!pick_memtype(ma, type_mask, params, slab->size, &minfo.memoryTypeIndex))
         goto error;
 
     const VkMemoryType *mtype = &ma->props.memoryTypes[minfo.memoryTypeIndex];
@@ -457,13 +717,20 @@ static struct vk_slab *slab_alloc(struct vk_malloc *ma,
     }
 
     slab->mtype = *mtype;
+    pl_mutex_lock(&ma->budget_lock);
+    ma->allocated[mtype->heapIndex] += slab->size;
+    if (is_bar(*mtype))
+        ma->bar_allocated += slab->size;
+    pl_mutex_unlock(&ma->budget_lock);
     if (mtype->propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
         VK(vk->MapMemory(vk->dev, slab->mem, 0, VK_WHOLE_SIZE, 0, &slab->data));
         slab->coherent = mtype->propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
     }
 
-    if (slab->buffer)
+    if (slab->buffer) {
         VK(vk->BindBufferMemory(vk->dev, slab->buffer, slab->mem, 0));
+        slab->addr = buf_address(vk, slab->buffer, params->buf_usage);
+    }
 
 #ifdef PL_HAVE_UNIX
     if (slab->handle_type == PL_HANDLE_FD ||
@@ -511,12 +778,220 @@ static void pool_uninit(struct vk_ctx *vk, struct vk_pool *pool)
     *pool = (struct vk_pool) {0};
 }
 
-struct vk_malloc *vk_malloc_create(struct vk_ctx *vk)
+// Returns a page to its slab's free space
+//
+// Note: Must be called with `slab->lock` held
+static void release_page(struct vk_malloc *ma, struct vk_slab *slab,
+                         VkDeviceSize offset)
+{
+    int page_idx = offset / slab->pagesize;
+    slab->spacemap |= 0x1LLU << page_idx;
+    slab->owners[page_idx] = NULL;
+    slab->age = ma->age;
+}
+
+// Returns the first `num` slices held by a cache to their slabs
+//
+// Note: Must be called with `cache->lock` held
+static void cache_flush(struct vk_malloc *ma, struct vk_slice_cache *cache,
+                        int num)
+{
+    for (int i = 0; i < num; i++) {
+        struct vk_cached_slice *entry = &cache->slices[i];
+        struct vk_slab *slab = entry->slab;
+        pl_mutex_lock(&slab->lock);
+        release_page(ma, slab, entry->offset);
+        slab->cached--;
+        pl_mutex_unlock(&slab->lock);
+    }
+
+    cache->num -= num;
+    memmove(&cache->slices[0], &cache->slices[num],
+            cache->num * sizeof(cache->slices[0]));
+}
+
+// Flushes all stale slices from the slice caches, and marks the remaining ones
+// as stale. If `force` is true, flushes everything instead.
+static void flush_caches(struct vk_malloc *ma, bool force)
+{
+    for (int i = 0; i < NUM_SLICE_CACHES; i++) {
+        struct vk_slice_cache *cache = &ma->caches[i];
+        pl_mutex_lock(&cache->lock);
+        int num = 0;
+        while (num < cache->num && (force || cache->slices[num].stale))
+            num++;
+        cache_flush(ma, cache, num);
+        for (int n = 0; n < cache->num; n++)
+            cache->slices[n].stale = true;
+        pl_mutex_unlock(&cache->lock);
+    }
+}
+
+// Tries retaining a freed slice in one of the slice caches. Returns false if
+// all caches are currently busy.
+static bool cache_put(struct vk_malloc *ma, struct vk_slab *slab,
+                      const struct vk_memslice *slice)
+{
+    unsigned start = atomic_fetch_add_explicit(&ma->cache_idx, 1, memory_order_relaxed);
+    for (int i = 0; i < NUM_SLICE_CACHES; i++) {
+        struct vk_slice_cache *cache = &ma->caches[(start + i) % NUM_SLICE_CACHES];
+        if (pl_mutex_trylock(&cache->lock))
+            continue;
+
+        // Return the older half of the cache in one batch, to amortize the
+        // cost of taking all of the slab locks
+        if (cache->num == SLICE_CACHE_SIZE)
+            cache_flush(ma, cache, SLICE_CACHE_SIZE / 2);
+
+        pl_mutex_lock(&slab->lock);
+        if (slab->evacuating) {
+            // Don't hand out pages from slabs we're trying to empty
+            pl_mutex_unlock(&slab->lock);
+            pl_mutex_unlock(&cache->lock);
+            return false;
+        }
+
+        slab->owners[slice->offset / slab->pagesize] = NULL;
+        slab->used -= slice->size;
+        slab->cached++;
+        pl_mutex_unlock(&slab->lock);
+
+        cache->slices[cache->num++] = (struct vk_cached_slice) {
+            .slab = slab,
+            .offset = slice->offset,
+            .size = slice->size,
+        };
+        pl_mutex_unlock(&cache->lock);
+        return true;
+    }
+
+    return false;
+}
+
+static inline bool pool_params_eq(const struct vk_malloc_params *a,
+                                  const struct vk_malloc_params *b)
+{
+    return a->reqs.size == b->reqs.size &&
+           a->reqs.alignment == b->reqs.alignment &&
+           a->reqs.memoryTypeBits == b->reqs.memoryTypeBits &&
+           a->required == b->required &&
+           a->optimal == b->optimal &&
+           a->buf_usage == b->buf_usage &&
+           a->export_handle == b->export_handle &&
+           a->streaming == b->streaming;
+}
+
+// Strips the fields from a set of malloc params which don't affect the
+// choice of `vk_pool`
+static struct vk_malloc_params pool_params_fixed(const struct vk_malloc_params *params)
+{
+    struct vk_malloc_params fixed = *params;
+    fixed.reqs.alignment = 0;
+    fixed.reqs.size = 0;
+    fixed.shared_mem = (struct pl_shared_mem) {0};
+    return fixed;
+}
+
+// Tries finding a cached slice of exactly the given (aligned) size, suitable
+// for the given malloc params. Returns the slab containing this slice.
+static struct vk_slab *cache_get(struct vk_malloc *ma,
+                                 const struct vk_malloc_params *params,
+                                 size_t size, size_t align,
+                                 VkDeviceSize *offset)
+{
+    if (size > MAXIMUM_CACHED_SIZE)
+        return NULL;
+
+    const struct vk_malloc_params fixed = pool_params_fixed(params);
+    unsigned start = atomic_fetch_add_explicit(&ma->cache_idx, 1, memory_order_relaxed);
+    for (int i = 0; i < NUM_SLICE_CACHES; i++) {
+        struct vk_slice_cache *cache = &ma->caches[(start + i) % NUM_SLICE_CACHES];
+        if (pl_mutex_trylock(&cache->lock))
+            continue;
+
+        // Prefer the most recently freed slices, which are more likely to
+        // still be hot in the caches
+        for (int n = cache->num - 1; n >= 0; n--) {
+            struct vk_cached_slice *entry = &cache->slices[n];
+            struct vk_slab *slab = entry->slab;
+            if (entry->size != size || entry->offset % align)
+                continue;
+            if (!pool_params_eq(&slab->pool_params, &fixed))
+                continue;
+
+            // Hold on to the cache lock until the slab is accounted for,
+            // to prevent it from being garbage collected in between
+            *offset = entry->offset;
+            pl_mutex_lock(&slab->lock);
+            slab->cached--;
+            slab->used += size;
+            slab->age = ma->age;
+            pl_mutex_unlock(&slab->lock);
+
+            cache->num--;
+            memmove(&cache->slices[n], &cache->slices[n + 1],
+                    (cache->num - n) * sizeof(cache->slices[0]));
+            pl_mutex_unlock(&cache->lock);
+            return slab;
+        }
+
+        pl_mutex_unlock(&cache->lock);
+    }
+
+    return NULL;
+}
+
+struct vk_malloc *vk_malloc_create(struct vk_ctx *vk, float budget_fraction,
+                                   size_t max_bar_usage)
 {
     struct vk_malloc *ma = pl_zalloc_ptr(NULL, ma);
     pl_mutex_init(&ma->lock);
+    pl_mutex_init(&ma->budget_lock);
+    for (int i = 0; i < NUM_SLICE_CACHES; i++)
+        pl_mutex_init(&ma->caches[i].lock);
     vk->GetPhysicalDeviceMemoryProperties(vk->physd, &ma->props);
     ma->vk = vk;
+    ma->budget_fraction = PL_DEF(budget_fraction, DEFAULT_BUDGET_FRACTION);
+    ma->trim_age = UINT64_MAX;
+
+    // Without VK_EXT_memory_budget, fall back to the heap sizes and our
+    // own allocations as the best available approximation
+    for (int i = 0; i < ma->props.memoryHeapCount; i++)
+        ma->budget[i] = ma->props.memoryHeaps[i].size;
+    for (int i = 0; i < vk->exts.num; i++) {
+        if (strcmp(vk->exts.elem[i], VK_EXT_MEMORY_BUDGET_EXTENSION_NAME) == 0)
+            ma->has_budget = true;
+    }
+    update_budget(ma);
+
+    VkDeviceSize bar_heap = 0;
+    for (int i = 0; i < ma->props.memoryTypeCount; i++) {
+        const VkMemoryType mtype = ma->props.memoryTypes[i];
+        if (!is_bar(mtype))
+            continue;
+        ma->bar_mask |= 1LU << i;
+        bar_heap = PL_MAX(bar_heap, ma->props.memoryHeaps[mtype.heapIndex].size);
+    }
+
+    VkPhysicalDeviceProperties props;
+    vk->GetPhysicalDeviceProperties(vk->physd, &props);
+    if (max_bar_usage) {
+        ma->bar_limit = max_bar_usage;
+    } else if (props.deviceType == VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU ||
+               props.deviceType == VK_PHYSICAL_DEVICE_TYPE_CPU)
+    {
+        // Unified memory: there is no separate BAR window to run out of
+        ma->bar_limit = UINT64_MAX;
+    } else {
+        ma->bar_limit = PL_MIN(DEFAULT_BAR_FRACTION * bar_heap, DEFAULT_BAR_MAX);
+    }
+
+    if (ma->bar_mask) {
+        PL_INFO(vk, "Using up to %s of device-local host-visible memory "
+                "(types 0x%"PRIx32") for streaming buffers",
+                ma->bar_limit == UINT64_MAX ? "(unlimited)" : PRINT_SIZE(ma->bar_limit),
+                ma->bar_mask);
+    }
 
     vk_malloc_print_stats(ma, PL_LOG_INFO);
     return ma;
@@ -528,26 +1003,40 @@ void vk_malloc_destroy(struct vk_malloc **ma_ptr)
     if (!ma)
         return;
 
+    flush_caches(ma, true);
     for (int i = 0; i < ma->pools.num; i++)
         pool_uninit(ma->vk, &ma->pools.elem[i]);
 
+    for (int i = 0; i < NUM_SLICE_CACHES; i++)
+        pl_mutex_destroy(&ma->caches[i].lock);
+    pl_mutex_destroy(&ma->budget_lock);
     pl_mutex_destroy(&ma->lock);
     pl_free_ptr(ma_ptr);
 }
 
-void vk_malloc_garbage_collect(struct vk_malloc *ma)
+void vk_malloc_set_trim(struct vk_malloc *ma, void (*trim)(void *priv), void *priv)
+{
+    ma->trim = trim;
+    ma->trim_priv = priv;
+}
+
+static void garbage_collect(struct vk_malloc *ma, bool force)
 {
     struct vk_ctx *vk = ma->vk;
 
+    flush_caches(ma, force);
+
     pl_mutex_lock(&ma->lock);
-    ma->age++;
+    if (!force)
+        ma->age++;
 
     for (int i = 0; i < ma->pools.num; i++) {
         struct vk_pool *pool = &ma->pools.elem[i];
         for (int n = 0; n < pool->slabs.num; n++) {
             struct vk_slab *slab = pool->slabs.elem[n];
             pl_mutex_lock(&slab->lock);
-            if (slab->used || (ma->age - slab->age) <= MAXIMUM_SLAB_AGE) {
+            bool young = !force && (ma->age - slab->age) <= MAXIMUM_SLAB_AGE;
+            if (slab->used || slab->cached || young) {
                 pl_mutex_unlock(&slab->lock);
                 continue;
             }
@@ -564,6 +1053,73 @@ void vk_malloc_garbage_collect(struct vk_malloc *ma)
     pl_mutex_unlock(&ma->lock);
 }
 
+void vk_malloc_garbage_collect(struct vk_malloc *ma)
+{
+    garbage_collect(ma, false);
+
+    pl_mutex_lock(&ma->budget_lock);
+    update_budget(ma);
+    pl_mutex_unlock(&ma->budget_lock);
+}
+
+int vk_malloc_heap_stats(struct vk_malloc *ma,
+                         struct pl_vulkan_heap_stats out[VK_MAX_MEMORY_HEAPS])
+{
+    pl_mutex_lock(&ma->budget_lock);
+    update_budget(ma);
+    for (int i = 0; i < ma->props.memoryHeapCount; i++) {
+        out[i] = (struct pl_vulkan_heap_stats) {
+            .flags = ma->props.memoryHeaps[i].flags,
+            .size = ma->props.memoryHeaps[i].size,
+            .budget = ma->budget[i],
+            .usage = heap_usage(ma, i),
+            .allocated = ma->allocated[i],
+        };
+    }
+    pl_mutex_unlock(&ma->budget_lock);
+
+    return ma->props.memoryHeapCount;
+}
+
+void vk_malloc_memory_stats(struct vk_malloc *ma, struct pl_gpu_memory_stats *out)
+{
+    // Dedicated slabs are always fully used, so only the unused part of
+    // the pooled slabs needs to be subtracted from the allocated memory
+    VkDeviceSize unused[VK_MAX_MEMORY_HEAPS] = {0};
+    size_t pool_size = 0;
+    size_t pool_used = 0;
+
+    pl_mutex_lock(&ma->lock);
+    for (int i = 0; i < ma->pools.num; i++) {
+        struct vk_pool *pool = &ma->pools.elem[i];
+        for (int j = 0; j < pool->slabs.num; j++) {
+            struct vk_slab *slab = pool->slabs.elem[j];
+            pl_mutex_lock(&slab->lock);
+            unused[slab->mtype.heapIndex] += slab->size - slab->used;
+            pool_size += slab->size;
+            pool_used += slab->used;
+            pl_mutex_unlock(&slab->lock);
+        }
+    }
+    pl_mutex_unlock(&ma->lock);
+
+    const int num_heaps = PL_MIN(ma->props.memoryHeapCount, PL_GPU_MAX_HEAPS);
+    pl_mutex_lock(&ma->budget_lock);
+    for (int i = 0; i < num_heaps; i++) {
+        VkMemoryHeap heap = ma->props.memoryHeaps[i];
+        out->heaps[i] = (struct pl_gpu_heap_usage) {
+            .size = heap.size,
+            .allocated = ma->allocated[i],
+            .used = ma->allocated[i] - PL_MIN(unused[i], ma->allocated[i]),
+            .device_local = heap.flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT,
+        };
+    }
+    pl_mutex_unlock(&ma->budget_lock);
+
+    out->num_heaps = num_heaps;
+    out->slab_efficiency = pool_size ? (float) pool_used / pool_size : 0.0f;
+}
+
 pl_handle_caps vk_malloc_handle_caps(const struct vk_malloc *ma, bool import)
 {
     struct vk_ctx *vk = ma->vk;
@@ -591,43 +1147,26 @@ void vk_malloc_free(struct vk_malloc *ma, struct vk_memslice *slice)
         goto done;
     }
 
-    pl_mutex_lock(&slab->lock);
+    if (slice->size <= MAXIMUM_CACHED_SIZE && cache_put(ma, slab, slice))
+        goto done;
 
-    int page_idx = slice->offset / slab->pagesize;
-    slab->spacemap |= 0x1LLU << page_idx;
+    pl_mutex_lock(&slab->lock);
+    release_page(ma, slab, slice->offset);
     slab->used -= slice->size;
-    slab->age = ma->age;
     pl_assert(slab->used >= 0);
-
     pl_mutex_unlock(&slab->lock);
 
 done:
     *slice = (struct vk_memslice) {0};
 }
 
-static inline bool pool_params_eq(const struct vk_malloc_params *a,
-                                  const struct vk_malloc_params *b)
-{
-    return a->reqs.size == b->reqs.size &&
-           a->reqs.alignment == b->reqs.alignment &&
-           a->reqs.memoryTypeBits == b->reqs.memoryTypeBits &&
-           a->required == b->required &&
-           a->optimal == b->optimal &&
-           a->buf_usage == b->buf_usage &&
-           a->export_handle == b->export_handle;
-}
-
 static struct vk_pool *find_pool(struct vk_malloc *ma,
                                  const struct vk_malloc_params *params)
 {
     pl_assert(!params->import_handle);
     pl_assert(!params->ded_image);
 
-    struct vk_malloc_params fixed = *params;
-    fixed.reqs.alignment = 0;
-    fixed.reqs.size = 0;
-    fixed.shared_mem = (struct pl_shared_mem) {0};
-
+    struct vk_malloc_params fixed = pool_params_fixed(params);
     for (int i = 0; i < ma->pools.num; i++) {
         if (pool_params_eq(&ma->pools.elem[i].params, &fixed))
             return &ma->pools.elem[i];
@@ -664,6 +1203,8 @@ static struct vk_slab *pool_get_page(struct vk_malloc *ma, struct vk_pool *pool,
             continue;
         if (slab->pagesize % align)
             continue;
+        if (slab->evacuating)
+            continue;
 
         pl_mutex_lock(&slab->lock);
         int page_idx = __builtin_ffsll(slab->spacemap);
@@ -701,6 +1242,7 @@ static struct vk_slab *pool_get_page(struct vk_malloc *ma, struct vk_pool *pool,
 
     slab->spacemap = (slab_pages == sizeof(uint64_t) * 8) ? ~0LLU : ~(~0LLU << slab_pages);
     slab->pagesize = pagesize;
+    slab->pool_params = pool->params;
     PL_ARRAY_APPEND(NULL, pool->slabs, slab);
 
     // Return the first page in this newly allocated slab
@@ -743,6 +1285,16 @@ static bool vk_malloc_import(struct vk_malloc *ma, struct vk_memslice *out,
     if (params->ded_image)
         vk_link_struct(&ainfo, &dinfo);
 
+#ifdef VK_EXT_descriptor_buffer
+    VkMemoryAllocateFlagsInfo finfo = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO,
+        .flags = VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT,
+    };
+
+    if (params->buf_usage & VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT)
+        vk_link_struct(&ainfo, &finfo);
+#endif
+
     VkBuffer buffer = VK_NULL_HANDLE;
     VkMemoryRequirements reqs = params->reqs;
 
@@ -913,8 +1465,12 @@ static bool vk_malloc_import(struct vk_malloc *ma, struct vk_memslice *out,
         }
     }
 
-    if (buffer)
+    if (buffer) {
         VK(vk->BindBufferMemory(vk->dev, buffer, vkmem, 0));
+        slab->addr = buf_address(vk, buffer, params->buf_usage);
+        if (slab->addr)
+            out->addr = slab->addr + out->offset;
+    }
 
     return true;
 
@@ -952,6 +1508,9 @@ bool vk_malloc_slice(struct vk_malloc *ma, struct vk_memslice *out,
             return false;
         slab->dedicated = true;
         offset = 0;
+    } else if ((slab = cache_get(ma, params, PL_ALIGN(size, align), align, &offset))) {
+        // Reusing a recently freed slice, already accounted for
+        size = PL_ALIGN(size, align);
     } else {
         pl_mutex_lock(&ma->lock);
         struct vk_pool *pool = find_pool(ma, params);
@@ -979,6 +1538,7 @@ bool vk_malloc_slice(struct vk_malloc *ma, struct vk_memslice *out,
         .offset = offset,
         .size = size,
         .buf = slab->buffer,
+        .addr = slab->addr ? slab->addr + offset : 0,
         .data = slab->data ? (uint8_t *) slab->data + offset : 0x0,
         .coherent = slab->coherent,
         .priv = slab,
@@ -990,3 +1550,136 @@ bool vk_malloc_slice(struct vk_malloc *ma, struct vk_memslice *out,
     };
     return true;
 }
+
+void vk_malloc_set_owner(struct vk_malloc *ma, const struct vk_memslice *slice,
+                         void *owner)
+{
+    struct vk_slab *slab = slice->priv;
+    if (!slab || slab->dedicated)
+        return;
+
+    pl_mutex_lock(&slab->lock);
+    slab->owners[slice->offset / slab->pagesize] = owner;
+    pl_mutex_unlock(&slab->lock);
+}
+
+// Mark all sparsely used slabs in a pool for evacuation, as long as their
+// live pages could be moved into denser slabs of the same page size
+//
+// Note: Must be called with `ma->lock` held
+static int pool_mark_evacuating(struct vk_pool *pool, float threshold)
+{
+    int num = 0;
+
+    for (int i = 0; i < pool->slabs.num; i++) {
+        struct vk_slab *slab = pool->slabs.elem[i];
+        pl_mutex_lock(&slab->lock);
+        slab->evacuating = false;
+        pl_mutex_unlock(&slab->lock);
+    }
+
+    for (int i = 0; i < pool->slabs.num; i++) {
+        struct vk_slab *slab = pool->slabs.elem[i];
+        pl_mutex_lock(&slab->lock);
+        size_t pages = slab->size / slab->pagesize;
+        size_t live = pages - __builtin_popcountll(slab->spacemap);
+        size_t used = slab->used;
+        bool sparse = live && used < threshold * slab->size;
+        pl_mutex_unlock(&slab->lock);
+        if (!sparse)
+            continue;
+
+        // Only ever move allocations towards denser slabs, to avoid
+        // ping-ponging them between equally sparse slabs
+        size_t room = 0;
+        for (int n = 0; n < pool->slabs.num && room < live; n++) {
+            struct vk_slab *dst = pool->slabs.elem[n];
+            if (dst == slab || dst->pagesize != slab->pagesize)
+                continue;
+            pl_mutex_lock(&dst->lock);
+            if (!dst->evacuating && dst->used > used)
+                room += __builtin_popcountll(dst->spacemap);
+            pl_mutex_unlock(&dst->lock);
+        }
+
+        if (room < live)
+            continue;
+
+        pl_mutex_lock(&slab->lock);
+        slab->evacuating = true;
+        pl_mutex_unlock(&slab->lock);
+        num++;
+    }
+
+    return num;
+}
+
+// Returns the first owner of a page in an evacuating slab, skipping owners
+// contained in `skip`.
+//
+// Note: Must be called with `ma->lock` held
+static void *find_evacuee(struct vk_malloc *ma, void * const *skip, int num_skip)
+{
+    for (int i = 0; i < ma->pools.num; i++) {
+        struct vk_pool *pool = &ma->pools.elem[i];
+        for (int n = 0; n < pool->slabs.num; n++) {
+            struct vk_slab *slab = pool->slabs.elem[n];
+            void *owner = NULL;
+
+            pl_mutex_lock(&slab->lock);
+            for (int p = 0; slab->evacuating && !owner && p < MAXIMUM_PAGE_COUNT; p++) {
+                owner = slab->owners[p];
+                for (int k = 0; owner && k < num_skip; k++) {
+                    if (skip[k] == owner)
+                        owner = NULL;
+                }
+            }
+            pl_mutex_unlock(&slab->lock);
+
+            if (owner)
+                return owner;
+        }
+    }
+
+    return NULL;
+}
+
+int vk_malloc_defrag(struct vk_malloc *ma, const struct vk_defrag_params *params)
+{
+    struct vk_ctx *vk = ma->vk;
+    PL_ARRAY(void *) skipped = {0};
+    int num_slabs = 0, num_moved = 0;
+
+    // Return all cached slices first, so they can't keep slabs occupied
+    flush_caches(ma, true);
+
+    pl_mutex_lock(&ma->lock);
+    for (int i = 0; i < ma->pools.num; i++)
+        num_slabs += pool_mark_evacuating(&ma->pools.elem[i], params->threshold);
+    pl_mutex_unlock(&ma->lock);
+
+    if (!num_slabs)
+        return 0;
+
+    // Don't hold the lock while migrating, since the callback needs to
+    // re-enter the allocator
+    while (pl_clock_now() < params->deadline) {
+        pl_mutex_lock(&ma->lock);
+        void *owner = find_evacuee(ma, skipped.elem, skipped.num);
+        pl_mutex_unlock(&ma->lock);
+        if (!owner)
+            break;
+
+        if (params->migrate(params->priv, owner)) {
+            num_moved++;
+        } else {
+            PL_ARRAY_APPEND(NULL, skipped, owner);
+        }
+    }
+
+    PL_DEBUG(vk, "Defragmentation: evacuating %d slabs, migrated %d "
+             "allocations, skipped %d", num_slabs, num_moved, skipped.num);
+
+    pl_free(skipped.elem);
+    return num_moved;
+}
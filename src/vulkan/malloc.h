@@ -20,8 +20,12 @@
 #include "common.h"
 
 // All memory allocated from a vk_malloc MUST be explicitly released by
-// the caller before vk_malloc_destroy is called.
-struct vk_malloc *vk_malloc_create(struct vk_ctx *vk);
+// the caller before vk_malloc_destroy is called. New allocations are kept
+// below `budget_fraction` of each heap's memory budget where possible, and at
+// most `max_bar_usage` bytes of device-local host-visible memory are used for
+// `streaming` allocations. (If zero, defaults are used)
+struct vk_malloc *vk_malloc_create(struct vk_ctx *vk, float budget_fraction,
+                                   size_t max_bar_usage);
 void vk_malloc_destroy(struct vk_malloc **ma);
 
 // Get the supported handle types for this malloc instance
@@ -37,6 +41,7 @@ struct vk_memslice {
     // depending on the type/flags:
     struct pl_shared_mem shared_mem;
     VkBuffer buf;   // associated buffer (when `buf_usage` is nonzero)
+    uint64_t addr;  // device address of `buf` at `offset` (if requested)
     void *data;     // pointer to slice (for persistently mapped slices)
     bool coherent;  // whether `data` is coherent
 };
@@ -50,6 +55,7 @@ struct vk_malloc_params {
     enum pl_handle_type export_handle;
     enum pl_handle_type import_handle;
     struct pl_shared_mem shared_mem; // for `import_handle`
+    bool streaming; // prefer device-local host-visible memory, within limits
 };
 
 bool vk_malloc_slice(struct vk_malloc *ma, struct vk_memslice *out,
@@ -58,8 +64,48 @@ bool vk_malloc_slice(struct vk_malloc *ma, struct vk_memslice *out,
 void vk_malloc_free(struct vk_malloc *ma, struct vk_memslice *slice);
 
 // Clean up unused slabs. Call this roughly once per frame to reduce
-// memory pressure / memory leaks.
+// memory pressure / memory leaks. Also refreshes the memory budget.
 void vk_malloc_garbage_collect(struct vk_malloc *ma);
 
+// Sets a callback to release cached resources when an allocation would
+// exceed the memory budget. It is called from within allocations, so it
+// must not recursively allocate memory, nor grab any locks that may be held
+// while allocating.
+void vk_malloc_set_trim(struct vk_malloc *ma, void (*trim)(void *priv), void *priv);
+
+// Returns the current memory budget statistics, one entry per heap
+int vk_malloc_heap_stats(struct vk_malloc *ma,
+                         struct pl_vulkan_heap_stats out[VK_MAX_MEMORY_HEAPS]);
+
+// Fills in the heap usage and slab efficiency of `pl_gpu_memory_stats`
+void vk_malloc_memory_stats(struct vk_malloc *ma, struct pl_gpu_memory_stats *out);
+
+// Associates an opaque owner with a slice, which will be handed back to the
+// `migrate` callback by `vk_malloc_defrag`. Only slices with an owner are
+// ever migrated. The owner is implicitly cleared by `vk_malloc_free`.
+void vk_malloc_set_owner(struct vk_malloc *ma, const struct vk_memslice *slice,
+                         void *owner);
+
+struct vk_defrag_params {
+    // Slabs with less than this fraction of their size in use are evacuated,
+    // if their allocations fit into denser slabs.
+    float threshold;
+
+    // Stop migrating allocations once `pl_clock_now()` passes this
+    uint64_t deadline;
+
+    // Called for the owner of every slice that should be moved. On success,
+    // this must allocate a new slice, associate the owner with it, and clear
+    // the owner of the old slice. Returns whether the allocation was moved.
+    bool (*migrate)(void *priv, void *owner);
+    void *priv;
+};
+
+// Marks sparsely used slabs for evacuation and migrates as many of their
+// allocations as possible within the deadline. Evacuating slabs are excluded
+// from new allocations until the next call, and freed by the regular garbage
+// collection once empty. Returns the number of allocations migrated.
+int vk_malloc_defrag(struct vk_malloc *ma, const struct vk_defrag_params *params);
+
 // For debugging purposes. Doesn't include dedicated slab allocations!
 void vk_malloc_print_stats(struct vk_malloc *ma, enum pl_log_level);
@@ -15,12 +15,15 @@
  * License along with libplacebo.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <math.h>
+
 #include "common.h"
 #include "command.h"
 #include "formats.h"
 #include "utils.h"
 #include "gpu.h"
 #include "swapchain.h"
+#include "pl_clock.h"
 #include "pl_thread.h"
 
 struct sem_pair {
@@ -41,6 +44,7 @@ struct priv {
     VkSwapchainKHR old_swapchain;
     int cur_width, cur_height;
     int swapchain_depth;
+    int cur_depth;                  // current limit, <= swapchain_depth
     pl_rc_t frames_in_flight;       // number of frames currently queued
     bool suboptimal;                // true once VK_SUBOPTIMAL_KHR is returned
     bool needs_recreate;            // swapchain needs to be recreated
@@ -53,6 +57,30 @@ struct priv {
     PL_ARRAY(struct sem_pair) sems; // pool of semaphores used to synchronize images
     int idx_sems;                   // index of next free semaphore pair
     int last_imgidx;                // the image index last acquired (for submit)
+
+    // presentation timing:
+    bool has_present_id;            // VK_KHR_present_id is usable
+    bool has_present_wait;          // VK_KHR_present_wait is usable
+    bool has_display_timing;        // VK_GOOGLE_display_timing is usable
+    uint64_t present_id;            // ID of the last submitted frame
+    struct pl_vulkan_present_timing timing; // last known present timing
+
+    // present mode switching:
+    bool has_mode_switch;           // VK_EXT_swapchain_maintenance1 is usable
+    VkPresentModeKHR present_mode;  // mode to use for the next present
+    VkPresentModeKHR *compat_modes; // switchable without recreation
+    int num_compat_modes;
+
+    // adaptive latency control (all times in nanoseconds):
+    pl_mutex stats_lock;            // protects the render time statistics
+    uint64_t *submit_times;         // ring buffer, indexed by present ID
+    uint64_t last_done;             // completion time of the last frame
+    double avg_render;              // moving average of the render time
+    double avg_jitter;              // moving average of its deviation
+    double peak_render;             // maximum render time since last swap
+    uint64_t last_swap;             // time of the last `swap_buffers`
+    double avg_interval;            // estimated vsync interval
+    int stable_frames;              // consecutive frames with low load
 };
 
 static struct pl_sw_fns vulkan_swapchain;
@@ -266,6 +294,68 @@ static bool pick_surf_format(pl_swapchain sw, const struct pl_color_space *hint)
     return true;
 }
 
+static bool present_mode_supported(struct priv *p, VkPresentModeKHR mode)
+{
+    struct vk_ctx *vk = p->vk;
+    VkPresentModeKHR *modes = NULL;
+    uint32_t num_modes = 0;
+    bool supported = false;
+
+    VK(vk->GetPhysicalDeviceSurfacePresentModesKHR(vk->physd, p->surf, &num_modes, NULL));
+    modes = pl_calloc_ptr(NULL, num_modes, modes);
+    VK(vk->GetPhysicalDeviceSurfacePresentModesKHR(vk->physd, p->surf, &num_modes, modes));
+
+    for (int i = 0; i < num_modes; i++)
+        supported |= (modes[i] == mode);
+
+    // fall through
+error:
+    pl_free(modes);
+    return supported;
+}
+
+// Returns the list of present modes that a swapchain created with `mode` can
+// switch between on the fly, allocated on `alloc`
+static int query_compat_modes(struct priv *p, void *alloc, VkPresentModeKHR mode,
+                              VkPresentModeKHR **out_modes)
+{
+    *out_modes = NULL;
+
+#ifdef VK_EXT_swapchain_maintenance1
+    struct vk_ctx *vk = p->vk;
+    VkSurfacePresentModeEXT mode_info = {
+        .sType = VK_STRUCTURE_TYPE_SURFACE_PRESENT_MODE_EXT,
+        .presentMode = mode,
+    };
+
+    VkPhysicalDeviceSurfaceInfo2KHR surf_info = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SURFACE_INFO_2_KHR,
+        .pNext = &mode_info,
+        .surface = p->surf,
+    };
+
+    VkSurfacePresentModeCompatibilityEXT compat = {
+        .sType = VK_STRUCTURE_TYPE_SURFACE_PRESENT_MODE_COMPATIBILITY_EXT,
+    };
+
+    VkSurfaceCapabilities2KHR caps = {
+        .sType = VK_STRUCTURE_TYPE_SURFACE_CAPABILITIES_2_KHR,
+        .pNext = &compat,
+    };
+
+    VK(vk->GetPhysicalDeviceSurfaceCapabilities2KHR(vk->physd, &surf_info, &caps));
+    compat.pPresentModes = pl_calloc_ptr(alloc, compat.presentModeCount,
+                                         compat.pPresentModes);
+    VK(vk->GetPhysicalDeviceSurfaceCapabilities2KHR(vk->physd, &surf_info, &caps));
+    *out_modes = compat.pPresentModes;
+    return compat.presentModeCount;
+
+error:
+    pl_free(compat.pPresentModes);
+#endif
+    return 0;
+}
+
 static void set_hdr_metadata(struct priv *p, const struct pl_hdr_metadata *metadata)
 {
     struct vk_ctx *vk = p->vk;
@@ -323,6 +413,11 @@ pl_swapchain pl_vulkan_create_swapchain(pl_vulkan plvk,
     p->surf = params->surface;
     p->swapchain_depth = PL_DEF(params->swapchain_depth, 3);
     pl_assert(p->swapchain_depth > 0);
+    p->cur_depth = p->swapchain_depth;
+    if (params->adaptive_latency) {
+        pl_mutex_init(&p->stats_lock);
+        p->submit_times = pl_calloc_ptr(sw, p->swapchain_depth + 1, p->submit_times);
+    }
     atomic_init(&p->frames_in_flight, 0);
     p->last_imgidx = -1;
     p->protoInfo = (VkSwapchainCreateInfoKHR) {
@@ -335,6 +430,27 @@ pl_swapchain pl_vulkan_create_swapchain(pl_vulkan plvk,
         .clipped = true,
     };
 
+#ifdef VK_KHR_present_wait
+    const VkPhysicalDevicePresentIdFeaturesKHR *present_id;
+    const VkPhysicalDevicePresentWaitFeaturesKHR *present_wait;
+    present_id = vk_find_struct(&vk->features,
+        VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR);
+    present_wait = vk_find_struct(&vk->features,
+        VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR);
+    p->has_present_id = present_id && present_id->presentId;
+    p->has_present_wait = p->has_present_id && vk->WaitForPresentKHR &&
+                          present_wait && present_wait->presentWait;
+#endif
+    p->has_display_timing = vk->GetPastPresentationTimingGOOGLE;
+    PL_DEBUG(vk, "Present wait: %s, display timing: %s",
+             p->has_present_wait ? "yes" : "no",
+             p->has_display_timing ? "yes" : "no");
+
+    if (params->wait_present && !p->has_present_wait) {
+        PL_WARN(vk, "Requested `wait_present`, but VK_KHR_present_wait is "
+                "not supported by this device, ignoring!");
+    }
+
     // These fields will be updated by `vk_sw_recreate`
     p->color_space = pl_color_space_unknown;
     p->color_repr = (struct pl_color_repr) {
@@ -343,23 +459,21 @@ pl_swapchain pl_vulkan_create_swapchain(pl_vulkan plvk,
         .alpha  = PL_ALPHA_UNKNOWN,
     };
 
-    // Make sure the swapchain present mode is supported
-    VkPresentModeKHR *modes = NULL;
-    uint32_t num_modes = 0;
-    VK(vk->GetPhysicalDeviceSurfacePresentModesKHR(vk->physd, p->surf, &num_modes, NULL));
-    modes = pl_calloc_ptr(NULL, num_modes, modes);
-    VK(vk->GetPhysicalDeviceSurfacePresentModesKHR(vk->physd, p->surf, &num_modes, modes));
-
-    bool supported = false;
-    for (int i = 0; i < num_modes; i++)
-        supported |= (modes[i] == p->protoInfo.presentMode);
-    pl_free_ptr(&modes);
+#ifdef VK_EXT_swapchain_maintenance1
+    const VkPhysicalDeviceSwapchainMaintenance1FeaturesEXT *maint1;
+    maint1 = vk_find_struct(&vk->features,
+        VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SWAPCHAIN_MAINTENANCE_1_FEATURES_EXT);
+    p->has_mode_switch = maint1 && maint1->swapchainMaintenance1 &&
+                         vk->GetPhysicalDeviceSurfaceCapabilities2KHR;
+#endif
 
-    if (!supported) {
+    // Make sure the swapchain present mode is supported
+    if (!present_mode_supported(p, p->protoInfo.presentMode)) {
         PL_WARN(vk, "Requested swap mode unsupported by this device, falling "
                 "back to VK_PRESENT_MODE_FIFO_KHR");
         p->protoInfo.presentMode = VK_PRESENT_MODE_FIFO_KHR;
     }
+    p->present_mode = p->protoInfo.presentMode;
 
     // Enumerate the supported surface color spaces
     uint32_t num_formats = 0;
@@ -389,7 +503,6 @@ pl_swapchain pl_vulkan_create_swapchain(pl_vulkan plvk,
     return sw;
 
 error:
-    pl_free(modes);
     pl_free(sw);
     return NULL;
 }
@@ -410,6 +523,8 @@ static void vk_sw_destroy(pl_swapchain sw)
     }
 
     vk->DestroySwapchainKHR(vk->dev, p->swapchain, PL_VK_ALLOC);
+    if (p->params.adaptive_latency)
+        pl_mutex_destroy(&p->stats_lock);
     pl_mutex_destroy(&p->lock);
     pl_free((void *) sw);
 }
@@ -417,7 +532,10 @@ static void vk_sw_destroy(pl_swapchain sw)
 static int vk_sw_latency(pl_swapchain sw)
 {
     struct priv *p = PL_PRIV(sw);
-    return p->swapchain_depth;
+    pl_mutex_lock(&p->lock);
+    int depth = p->cur_depth;
+    pl_mutex_unlock(&p->lock);
+    return depth;
 }
 
 static bool update_swapchain_info(struct priv *p, VkSwapchainCreateInfoKHR *info,
@@ -570,18 +688,46 @@ static bool vk_sw_recreate(pl_swapchain sw, int w, int h)
     while (p->old_swapchain)
         vk_poll_commands(vk, UINT64_MAX);
 
+    // Pick up any present mode switch that required recreation
+    p->protoInfo.presentMode = p->present_mode;
     VkSwapchainCreateInfoKHR sinfo = p->protoInfo;
     sinfo.oldSwapchain = p->swapchain;
 
     if (!update_swapchain_info(p, &sinfo, w, h))
         return false;
 
+#ifdef VK_EXT_swapchain_maintenance1
+    // Allow switching between all compatible present modes later on
+    VkSwapchainPresentModesCreateInfoEXT modes_info = {
+        .sType = VK_STRUCTURE_TYPE_SWAPCHAIN_PRESENT_MODES_CREATE_INFO_EXT,
+    };
+
+    VkPresentModeKHR *compat_modes = NULL;
+    int num_compat_modes = 0;
+    if (p->has_mode_switch)
+        num_compat_modes = query_compat_modes(p, sw, sinfo.presentMode, &compat_modes);
+    if (num_compat_modes > 1) {
+        modes_info.presentModeCount = num_compat_modes;
+        modes_info.pPresentModes = compat_modes;
+        vk_link_struct(&sinfo, &modes_info);
+    }
+#else
+    VkPresentModeKHR *compat_modes = NULL;
+    int num_compat_modes = 0;
+#endif
+
     PL_INFO(sw, "(Re)creating swapchain of size %dx%d",
             sinfo.imageExtent.width,
             sinfo.imageExtent.height);
 
     VK(vk->CreateSwapchainKHR(vk->dev, &sinfo, PL_VK_ALLOC, &p->swapchain));
 
+    // Only valid for the swapchain it was created with
+    pl_free(p->compat_modes);
+    p->compat_modes = compat_modes;
+    p->num_compat_modes = num_compat_modes;
+    compat_modes = NULL;
+
     p->suboptimal = false;
     p->needs_recreate = false;
     p->cur_width = sinfo.imageExtent.width;
@@ -660,12 +806,20 @@ static bool vk_sw_recreate(pl_swapchain sw, int w, int h)
     p->hdr_metadata = pl_hdr_metadata_empty;
     set_hdr_metadata(p, &metadata);
 
+    // Used as the frame time budget for the adaptive latency control
+    if (p->params.adaptive_latency && p->has_display_timing) {
+        VkRefreshCycleDurationGOOGLE refresh = {0};
+        if (vk->GetRefreshCycleDurationGOOGLE(vk->dev, p->swapchain, &refresh) == VK_SUCCESS)
+            p->timing.refresh_duration = refresh.refreshDuration;
+    }
+
     pl_free(vkimages);
     return true;
 
 error:
     PL_ERR(vk, "Failed (re)creating swapchain!");
     pl_free(vkimages);
+    pl_free(compat_modes);
     if (p->swapchain != sinfo.oldSwapchain) {
         vk->DestroySwapchainKHR(vk->dev, p->swapchain, PL_VK_ALLOC);
         p->swapchain = VK_NULL_HANDLE;
@@ -740,8 +894,30 @@ static bool vk_sw_start_frame(pl_swapchain sw,
     return false;
 }
 
+// Exponential moving average, with a time constant of about 16 frames
+static inline void update_avg(double *avg, double val)
+{
+    *avg = *avg ? *avg + (val - *avg) / 16.0 : val;
+}
+
 static void present_cb(struct priv *p, void *arg)
 {
+    if (p->params.adaptive_latency) {
+        // Note: This may run from inside `vk_poll_commands` while `p->lock`
+        // is held by the same thread, hence the separate lock
+        pl_mutex_lock(&p->stats_lock);
+        uint64_t now = pl_clock_now();
+        uint64_t start = p->submit_times[(uintptr_t) arg];
+        // The GPU can't start on this frame before finishing the previous one
+        start = PL_MAX(start, p->last_done);
+        double render = now > start ? now - start : 0;
+        update_avg(&p->avg_jitter, fabs(render - p->avg_render));
+        update_avg(&p->avg_render, render);
+        p->peak_render = PL_MAX(p->peak_render, render);
+        p->last_done = now;
+        pl_mutex_unlock(&p->stats_lock);
+    }
+
     (void) pl_rc_deref(&p->frames_in_flight);
 }
 
@@ -772,8 +948,16 @@ static bool vk_sw_submit_frame(pl_swapchain sw)
         return false;
     }
 
+    uintptr_t slot = 0;
+    if (p->params.adaptive_latency) {
+        slot = (p->present_id + 1) % (p->swapchain_depth + 1);
+        pl_mutex_lock(&p->stats_lock);
+        p->submit_times[slot] = pl_clock_now();
+        pl_mutex_unlock(&p->stats_lock);
+    }
+
     pl_rc_ref(&p->frames_in_flight);
-    vk_cmd_callback(cmd, (vk_cb) present_cb, p, NULL);
+    vk_cmd_callback(cmd, (vk_cb) present_cb, p, (void *) slot);
     if (!vk_cmd_submit(vk, &cmd)) {
         pl_mutex_unlock(&p->lock);
         return false;
@@ -795,6 +979,42 @@ static bool vk_sw_submit_frame(pl_swapchain sw)
         .pImageIndices = &idx,
     };
 
+    uint64_t present_id = ++p->present_id;
+#ifdef VK_KHR_present_wait
+    VkPresentIdKHR id_info = {
+        .sType = VK_STRUCTURE_TYPE_PRESENT_ID_KHR,
+        .swapchainCount = 1,
+        .pPresentIds = &present_id,
+    };
+
+    if (p->has_present_id)
+        vk_link_struct(&pinfo, &id_info);
+#endif
+
+    VkPresentTimeGOOGLE present_time = {
+        .presentID = (uint32_t) present_id,
+    };
+
+    VkPresentTimesInfoGOOGLE time_info = {
+        .sType = VK_STRUCTURE_TYPE_PRESENT_TIMES_INFO_GOOGLE,
+        .swapchainCount = 1,
+        .pTimes = &present_time,
+    };
+
+    if (p->has_display_timing)
+        vk_link_struct(&pinfo, &time_info);
+
+#ifdef VK_EXT_swapchain_maintenance1
+    VkSwapchainPresentModeInfoEXT mode_info = {
+        .sType = VK_STRUCTURE_TYPE_SWAPCHAIN_PRESENT_MODE_INFO_EXT,
+        .swapchainCount = 1,
+        .pPresentModes = &p->present_mode,
+    };
+
+    if (p->num_compat_modes > 1)
+        vk_link_struct(&pinfo, &mode_info);
+#endif
+
     PL_TRACE(vk, "vkQueuePresentKHR waits on %p", (void *) sem_out);
     vk->lock_queue(vk->queue_ctx, pool->qf, qidx);
     VkResult res = vk->QueuePresentKHR(queue, &pinfo);
@@ -820,12 +1040,113 @@ static bool vk_sw_submit_frame(pl_swapchain sw)
     }
 }
 
+// Must be called with `p->lock` held
+static bool wait_present(struct priv *p, uint64_t present_id, uint64_t timeout)
+{
+#ifdef VK_KHR_present_wait
+    struct vk_ctx *vk = p->vk;
+    if (!p->has_present_wait || !p->swapchain)
+        return false;
+
+    VkResult res = vk->WaitForPresentKHR(vk->dev, p->swapchain, present_id,
+                                         timeout);
+    switch (res) {
+    case VK_SUBOPTIMAL_KHR:
+        p->suboptimal = true;
+        // fall through
+    case VK_SUCCESS:
+        return true;
+    case VK_TIMEOUT:
+        PL_TRACE(vk, "Timed out waiting for present ID %"PRIu64, present_id);
+        return false;
+    case VK_ERROR_OUT_OF_DATE_KHR:
+        p->needs_recreate = true;
+        return false;
+    default:
+        PL_ERR(vk, "Failed waiting for present ID %"PRIu64": %s",
+               present_id, vk_res_str(res));
+        return false;
+    }
+#else
+    return false;
+#endif
+}
+
+// Must be called with `p->lock` held
+static void update_latency(struct priv *p)
+{
+    // Fetch the completion times of any already finished frames
+    pl_mutex_unlock(&p->lock);
+    vk_poll_commands(p->vk, 0);
+    pl_mutex_lock(&p->lock);
+
+    uint64_t now = pl_clock_now();
+    double interval = p->last_swap ? now - p->last_swap : 0;
+    p->last_swap = now;
+    if (!interval)
+        return;
+
+    pl_mutex_lock(&p->stats_lock);
+    double render = p->avg_render, jitter = p->avg_jitter, peak = p->peak_render;
+    p->peak_render = 0;
+    pl_mutex_unlock(&p->stats_lock);
+    if (!render)
+        return;
+
+    // Intervals spanning more than one vsync indicate a missed frame, and
+    // only feed into the vsync estimate very slowly (in case the display
+    // rate genuinely dropped, or we're not vsync-limited at all)
+    bool missed = p->avg_interval && interval > 1.5 * p->avg_interval;
+    if (missed) {
+        p->avg_interval += (interval - p->avg_interval) / 256.0;
+    } else {
+        update_avg(&p->avg_interval, interval);
+    }
+
+    double budget = p->timing.refresh_duration;
+    budget = budget ? budget : p->avg_interval;
+    double load = (render + 2.0 * jitter) / budget;
+
+    int depth = p->cur_depth;
+    if (load > 0.75 || peak > budget || missed) {
+        // Back off immediately, to avoid further stuttering
+        depth = PL_MIN(depth + 1, p->swapchain_depth);
+        p->stable_frames = 0;
+    } else if (load < 0.5) {
+        // Only reduce latency after a sustained period of low load
+        if (++p->stable_frames >= 60) {
+            depth = PL_MAX(depth - 1, 1);
+            p->stable_frames = 0;
+        }
+    } else {
+        p->stable_frames = 0;
+    }
+
+    if (depth != p->cur_depth) {
+        PL_DEBUG(p->vk, "Adjusting swapchain depth: %d -> %d (render time "
+                 "%.2f ms, jitter %.2f ms, frame budget %.2f ms)",
+                 p->cur_depth, depth, render * 1e-6, jitter * 1e-6,
+                 budget * 1e-6);
+        p->cur_depth = depth;
+    }
+}
+
 static void vk_sw_swap_buffers(pl_swapchain sw)
 {
     struct priv *p = PL_PRIV(sw);
 
     pl_mutex_lock(&p->lock);
-    while (pl_rc_count(&p->frames_in_flight) >= p->swapchain_depth) {
+    if (p->params.adaptive_latency)
+        update_latency(p);
+
+    if (p->params.wait_present && p->present_id >= p->cur_depth) {
+        // Bounded, since presentation may never complete (e.g. for hidden
+        // windows), in which case we fall back to the normal logic below
+        uint64_t target = p->present_id - (p->cur_depth - 1);
+        wait_present(p, target, UINT64_C(1000000000));
+    }
+
+    while (pl_rc_count(&p->frames_in_flight) >= p->cur_depth) {
         pl_mutex_unlock(&p->lock); // don't hold mutex while blocking
         vk_poll_commands(p->vk, UINT64_MAX);
         pl_mutex_lock(&p->lock);
@@ -866,12 +1187,125 @@ static void vk_sw_colorspace_hint(pl_swapchain sw, const struct pl_color_space *
     pl_mutex_unlock(&p->lock);
 }
 
+bool pl_vulkan_swapchain_set_present_mode(pl_swapchain sw, VkPresentModeKHR mode)
+{
+    struct priv *p = PL_PRIV(sw);
+    struct vk_ctx *vk = p->vk;
+    bool ok = true;
+
+    pl_mutex_lock(&p->lock);
+    if (mode == p->present_mode)
+        goto done;
+
+    if (!present_mode_supported(p, mode)) {
+        PL_ERR(vk, "Requested present mode %s unsupported by this device!",
+               vk_present_mode_name(mode));
+        ok = false;
+        goto done;
+    }
+
+    bool compatible = false;
+    for (int i = 0; i < p->num_compat_modes; i++)
+        compatible |= p->compat_modes[i] == mode;
+
+    if (compatible) {
+        PL_DEBUG(vk, "Switching present mode %s -> %s on the fly",
+                 vk_present_mode_name(p->present_mode),
+                 vk_present_mode_name(mode));
+    } else {
+        // The next `pl_swapchain_start_frame` recreates the swapchain,
+        // passing the old one along to avoid tearing down the presentation
+        PL_DEBUG(vk, "Switching present mode %s -> %s, recreating swapchain",
+                 vk_present_mode_name(p->present_mode),
+                 vk_present_mode_name(mode));
+        p->needs_recreate = true;
+    }
+
+    p->present_mode = mode;
+
+done:
+    pl_mutex_unlock(&p->lock);
+    return ok;
+}
+
 bool pl_vulkan_swapchain_suboptimal(pl_swapchain sw)
 {
     struct priv *p = PL_PRIV(sw);
     return p->suboptimal;
 }
 
+uint64_t pl_vulkan_swapchain_present_id(pl_swapchain sw)
+{
+    struct priv *p = PL_PRIV(sw);
+    if (!p->has_present_id && !p->has_display_timing)
+        return 0;
+
+    pl_mutex_lock(&p->lock);
+    uint64_t id = p->present_id;
+    pl_mutex_unlock(&p->lock);
+    return id;
+}
+
+bool pl_vulkan_swapchain_wait_present(pl_swapchain sw, uint64_t present_id,
+                                      uint64_t timeout)
+{
+    struct priv *p = PL_PRIV(sw);
+    pl_mutex_lock(&p->lock);
+    bool ok = wait_present(p, present_id, timeout);
+    pl_mutex_unlock(&p->lock);
+    return ok;
+}
+
+bool pl_vulkan_swapchain_present_timing(pl_swapchain sw,
+                                        struct pl_vulkan_present_timing *out)
+{
+    struct priv *p = PL_PRIV(sw);
+    struct vk_ctx *vk = p->vk;
+    if (!p->has_display_timing)
+        return false;
+
+    pl_mutex_lock(&p->lock);
+    if (!p->swapchain)
+        goto done;
+
+    VkRefreshCycleDurationGOOGLE refresh = {0};
+    VkResult res = vk->GetRefreshCycleDurationGOOGLE(vk->dev, p->swapchain, &refresh);
+    if (res == VK_SUCCESS)
+        p->timing.refresh_duration = refresh.refreshDuration;
+
+    // Drain all pending timing results, keeping only the most recent one
+    VkPastPresentationTimingGOOGLE timings[8];
+    do {
+        uint32_t num = PL_ARRAY_SIZE(timings);
+        res = vk->GetPastPresentationTimingGOOGLE(vk->dev, p->swapchain,
+                                                  &num, timings);
+        if (res != VK_SUCCESS && res != VK_INCOMPLETE) {
+            PL_ERR(vk, "Failed querying presentation timing: %s",
+                   vk_res_str(res));
+            break;
+        }
+
+        if (num) {
+            const VkPastPresentationTimingGOOGLE *t = &timings[num - 1];
+            // Recover the full 64-bit ID from the truncated 32-bit value
+            uint64_t id = (p->present_id & ~UINT64_C(0xFFFFFFFF)) | t->presentID;
+            if (id > p->present_id)
+                id -= UINT64_C(1) << 32;
+            p->timing.present_id = id;
+            p->timing.desired_time = t->desiredPresentTime;
+            p->timing.actual_time = t->actualPresentTime;
+            p->timing.earliest_time = t->earliestPresentTime;
+        }
+    } while (res == VK_INCOMPLETE);
+
+done: ;
+    bool ok = p->timing.present_id > 0;
+    if (ok)
+        *out = p->timing;
+    pl_mutex_unlock(&p->lock);
+    return ok;
+}
+
 static struct pl_sw_fns vulkan_swapchain = {
     .destroy            = vk_sw_destroy,
     .latency            = vk_sw_latency,
@@ -27,6 +27,7 @@ const char *vk_handle_name(VkExternalMemoryHandleTypeFlagBitsKHR handle);
 const char *vk_obj_type(VkObjectType obj);
 const char *vk_alpha_mode(VkCompositeAlphaFlagsKHR alpha);
 const char *vk_surface_transform(VkSurfaceTransformFlagsKHR transform);
+const char *vk_present_mode_name(VkPresentModeKHR mode);
 
 // Return the size of an arbitrary vulkan struct. Returns 0 for unknown structs
 size_t vk_struct_size(VkStructureType stype);
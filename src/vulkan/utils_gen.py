@@ -96,6 +96,17 @@ const char *vk_surface_transform(VkSurfaceTransformFlagsKHR tf)
     }
 }
 
+const char *vk_present_mode_name(VkPresentModeKHR mode)
+{
+    switch (mode) {
+%for mode in vkpresentmodes:
+    case ${mode}: return "${mode}";
+%endfor
+
+    default: return "unknown present mode";
+    }
+}
+
 
 const char *vk_obj_type(VkObjectType obj)
 {
@@ -219,6 +230,7 @@ if __name__ == '__main__':
             vkhandles = get_vkenum(registry, 'VkExternalMemoryHandleTypeFlagBits'),
             vkalphas  = get_vkenum(registry, 'VkCompositeAlphaFlagBitsKHR'),
             vktransforms = get_vkenum(registry, 'VkSurfaceTransformFlagBitsKHR'),
+            vkpresentmodes = get_vkenum(registry, 'VkPresentModeKHR'),
             vkobjects = get_vkobjects(registry),
             vkstructs = get_vkstructs(registry),
             vkaccess = get_vkaccess(registry),
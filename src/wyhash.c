@@ -0,0 +1,112 @@
+/*
+   wyhash reference C implementation (final version)
+   Modified for use by libplacebo:
+    - Hard-coded the seed and secret
+    - Always read input as little-endian, so the result is portable
+    - Added a fallback for platforms lacking 128-bit integer multiplication
+
+   Author: Wang Yi <godspeed_china@yeah.net>
+
+   This is free and unencumbered software released into the public domain
+   under The Unlicense (http://unlicense.org/).
+ */
+
+#include "common.h"
+
+static const uint64_t secret[4] = {
+    0x2d358dccaa6c78a5ULL, 0x8bb84b93962eacc9ULL,
+    0x4b33a62ed433d4a3ULL, 0x4d5a2da51de1aa47ULL,
+};
+
+static const uint64_t seed0 = 0x4e8dd8b1aa0e5d7bULL;
+
+static inline void mum(uint64_t *a, uint64_t *b)
+{
+#ifdef __SIZEOF_INT128__
+    __uint128_t r = (__uint128_t) *a * *b;
+    *a = (uint64_t) r;
+    *b = (uint64_t) (r >> 64);
+#else
+    uint64_t ha = *a >> 32, hb = *b >> 32, la = (uint32_t) *a, lb = (uint32_t) *b;
+    uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+    uint64_t t = rl + (rm0 << 32), c = t < rl;
+    uint64_t lo = t + (rm1 << 32);
+    c += lo < t;
+    *a = lo;
+    *b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
+}
+
+static inline uint64_t mix(uint64_t a, uint64_t b)
+{
+    mum(&a, &b);
+    return a ^ b;
+}
+
+// These compile down to plain loads on little-endian platforms
+static inline uint64_t read64(const uint8_t *p)
+{
+    return ((uint64_t) p[0])       | ((uint64_t) p[1] << 8)  |
+           ((uint64_t) p[2] << 16) | ((uint64_t) p[3] << 24) |
+           ((uint64_t) p[4] << 32) | ((uint64_t) p[5] << 40) |
+           ((uint64_t) p[6] << 48) | ((uint64_t) p[7] << 56);
+}
+
+static inline uint64_t read32(const uint8_t *p)
+{
+    return ((uint64_t) p[0])       | ((uint64_t) p[1] << 8)  |
+           ((uint64_t) p[2] << 16) | ((uint64_t) p[3] << 24);
+}
+
+static inline uint64_t read_small(const uint8_t *p, size_t k)
+{
+    return ((uint64_t) p[0] << 16) | ((uint64_t) p[k >> 1] << 8) | p[k - 1];
+}
+
+uint64_t pl_mem_hash(const void *mem, size_t size)
+{
+    const uint8_t *p = mem;
+    uint64_t seed = seed0 ^ mix(seed0 ^ secret[0], secret[1]);
+    uint64_t a, b;
+
+    if (size <= 16) {
+        if (size >= 4) {
+            const size_t off = (size >> 3) << 2;
+            a = (read32(p) << 32) | read32(p + off);
+            b = (read32(p + size - 4) << 32) | read32(p + size - 4 - off);
+        } else if (size > 0) {
+            a = read_small(p, size);
+            b = 0;
+        } else {
+            a = b = 0;
+        }
+    } else {
+        size_t i = size;
+        if (i > 48) {
+            // Three independent lanes, to keep the multipliers busy
+            uint64_t see1 = seed, see2 = seed;
+            do {
+                seed = mix(read64(p +  0) ^ secret[1], read64(p +  8) ^ seed);
+                see1 = mix(read64(p + 16) ^ secret[2], read64(p + 24) ^ see1);
+                see2 = mix(read64(p + 32) ^ secret[3], read64(p + 40) ^ see2);
+                p += 48;
+                i -= 48;
+            } while (i > 48);
+            seed ^= see1 ^ see2;
+        }
+
+        while (i > 16) {
+            seed = mix(read64(p) ^ secret[1], read64(p + 8) ^ seed);
+            p += 16;
+            i -= 16;
+        }
+
+        a = read64(p + i - 16);
+        b = read64(p + i - 8);
+    }
+
+    a ^= secret[1];
+    b ^= seed;
+    mum(&a, &b);
+    return mix(a ^ secret[0] ^ size, b ^ secret[1]);
+}